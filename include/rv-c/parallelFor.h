@@ -0,0 +1,43 @@
+#ifndef RV_C_PARALLELFOR_H
+#define RV_C_PARALLELFOR_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Task runtime interface of parallel chunked loops (RV_PARALLEL_CHUNKS).
+// The loop vectorizer splits the iteration space of a chunked loop into
+// chunks of a multiple of the vector width and outlines the vectorized chunk
+// loop into a task. The loop itself is replaced by one call
+//
+//   rv_parallel_for(Task, Ctx, NumChunks)
+//
+// (RV_PARALLEL_RUNTIME renames the symbol). The runtime has to call
+// Task(Ctx, First, Last) for disjoint ranges [First, Last) (First < Last)
+// that cover [0, NumChunks), in any order and on any thread, and return
+// once all of them have finished. Only the last chunk runs a remainder.
+
+typedef void (*RVChunkTask)(void *Ctx, int64_t First, int64_t Last);
+
+void rv_parallel_for(RVChunkTask Task, void *Ctx, int64_t NumChunks);
+
+// Reference runtimes, define one of these macros in exactly one translation unit.
+#if defined(RV_PARALLEL_FOR_SERIAL)
+void rv_parallel_for(RVChunkTask Task, void *Ctx, int64_t NumChunks) {
+  Task(Ctx, 0, NumChunks);
+}
+#elif defined(RV_PARALLEL_FOR_OPENMP)
+void rv_parallel_for(RVChunkTask Task, void *Ctx, int64_t NumChunks) {
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t Chunk = 0; Chunk < NumChunks; ++Chunk)
+    Task(Ctx, Chunk, Chunk + 1);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RV_C_PARALLELFOR_H
@@ -0,0 +1,61 @@
+#ifndef RV_C_WFV_H
+#define RV_C_WFV_H
+
+#include "llvm-c/ExternC.h"
+#include "llvm-c/TargetMachine.h"
+#include "llvm-c/Types.h"
+
+#include <stdint.h>
+
+LLVM_C_EXTERN_C_BEGIN
+
+// Whole-function vectorization for JITs.
+// A vectorizer handle holds the resolver chain (SLEEF, vector libraries,
+// recursive vectorization) and the analysis managers of one module at a time
+// and can vectorize any number of functions in it.
+
+typedef struct RVOpaqueVectorizer *RVVectorizerRef;
+
+typedef enum {
+  RVShapeUniform = 0,    // same value in all lanes
+  RVShapeContiguous = 1, // lane i holds base + i
+  RVShapeStrided = 2,    // lane i holds base + i * Stride
+  RVShapeVarying = 3     // arbitrary value per lane
+} RVShapeKind;
+
+typedef struct {
+  RVShapeKind Kind;
+  int64_t Stride;       // RVShapeStrided only
+  unsigned Alignment;   // known alignment of the (lane 0) value, 0 if unknown
+} RVShape;
+
+// Create a vectorizer for the functions of \p M.
+// \p TM provides the target cost model (may be NULL).
+// \p Arch (RV_ARCH names: "avx2", "avx512", "advsimd", "sve") selects the SIMD
+// ISA. If NULL, it follows the target features of the first vectorized function.
+RVVectorizerRef RVCreateVectorizer(LLVMModuleRef M, LLVMTargetMachineRef TM, const char *Arch);
+
+void RVDisposeVectorizer(RVVectorizerRef V);
+
+// Vectorize \p ScalarFn at \p Width.
+// \p ArgShapes has one entry per argument of \p ScalarFn (NULL: all uniform),
+// \p MaskPos is the position of the mask argument in the vector function (-1 for none).
+// The vector function is named \p VectorName (mangled Vector Function ABI name if NULL);
+// an existing declaration of that name is used as the signature.
+// Returns the vector function or NULL if vectorization failed.
+LLVMValueRef RVVectorizeFunction(RVVectorizerRef V, LLVMValueRef ScalarFn, unsigned Width,
+                                 const RVShape *ArgShapes, unsigned NumArgShapes,
+                                 RVShape ResultShape, int MaskPos, const char *VectorName);
+
+// Vectorize the functions of \p M with \p V from now on.
+// Keeps the resolver chain and the loaded SLEEF modules, mappings of the previous module are dropped.
+// The ISA config of \p V is kept as well (all modules should target the same ISA).
+void RVSetVectorizerModule(RVVectorizerRef V, LLVMModuleRef M);
+
+// Forget the SLEEF bitcode modules of \p C in the process-wide registry (they are
+// freed with the last vectorizer of \p C, which must be disposed before \p C).
+void RVReleaseContext(LLVMContextRef C);
+
+LLVM_C_EXTERN_C_END
+
+#endif // RV_C_WFV_H
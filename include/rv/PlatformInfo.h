@@ -16,20 +16,30 @@
 #include "rv/resolver/resolver.h"
 #include "rv/intrinsics.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 
 namespace rv {
 
 class ListResolver;
+class ShapeSummaries;
+struct ShapeSummary;
 
 class PlatformInfo {
   void registerDeclareSIMDFunction(llvm::Function & F);
   void addIntrinsicMappings();
+  // intrinsic and declare-simd mappings of the functions in mod
+  void registerModuleMappings();
 
 public:
   PlatformInfo(llvm::Module &mod, llvm::TargetTransformInfo *TTI,
                llvm::TargetLibraryInfo *TLI);
   ~PlatformInfo();
 
+  // re-target this platform to \p newMod.
+  // Keeps the resolver chain (and the SLEEF modules it has loaded) but drops all mappings
+  // and caches of the previous module. TTI and TLI have to be set again.
+  void setModule(llvm::Module & newMod);
+
   void setTTI(llvm::TargetTransformInfo *TTI);
   void setTLI(llvm::TargetLibraryInfo *TLI);
 
@@ -39,17 +49,21 @@ public:
   // insert a new function resolver into the resolver chain
   void addResolverService(std::unique_ptr<ResolverService>&& newResolver, bool givePrecedence);
 
+  // the cheapest resolver of the chain for a call of \p funcName (services answer in chain order).
+  // An answer without a cost estimate (explicit mappings, declare simd) ends the search, nullptr if
+  // vectorWidth scalar calls are cheaper than the best answer (replication).
   std::unique_ptr<FunctionResolver>
   getResolver(llvm::StringRef funcName,
               llvm::FunctionType & scaFuncTy,
               const VectorShapeVec & argShapes,
               int vectorWidth,
-              bool hasPredicate) const;
+              bool hasPredicate,
+              int maxULPError = -1) const;
 
-  llvm::Module &getModule() const { return mod; }
-  llvm::LLVMContext &getContext() const { return mod.getContext(); }
+  llvm::Module &getModule() const { return *mod; }
+  llvm::LLVMContext &getContext() const { return mod->getContext(); }
 
-  const llvm::DataLayout &getDataLayout() const { return mod.getDataLayout(); }
+  const llvm::DataLayout &getDataLayout() const { return mod->getDataLayout(); }
 
   // FIXME use RVIntrinsic instead
   // materialize a declaration for \p rvIntrin and register the appropriate mappings.
@@ -60,7 +74,7 @@ public:
   size_t getMaxVectorBits() const;
 
   // allow quick access to the builtin resolver
-  ListResolver& getListResolver() { return *listResolver; }
+  ListResolver& getListResolver() { resolverMemo.clear(); return *listResolver; }
   void addMapping(VectorMapping&& mapping);
   void addMapping(const VectorMapping& mapping) { addMapping(VectorMapping(mapping)); }
   void forgetAllMappingsFor(const llvm::Function & scaFunc);
@@ -69,19 +83,34 @@ public:
   void dump() const;
   void print(llvm::raw_ostream & out) const;
 
-  // return the mangled vector function name for this target platform
+  // return the mangled vector function name for this target platform.
+  // Uses the Vector Function ABI (_ZGV<isa><mask><vlen><params>_<name>) unless RV_LEGACY_MANGLING is set.
   std::string createMangledVectorName(llvm::StringRef scaName, const VectorShapeVec & argShapes, int vectorWidth, int maskPos);
 
   // request an RV intrinsic for this module
   llvm::Function& requestIntrinsic(RVIntrinsic id, llvm::Type * DataTy = nullptr);
 
+  // compute the shape transfer summaries of all functions in the module (see rv/analysis/shapeSummary.h)
+  void computeShapeSummaries();
+  // the summary of \p F (nullptr if there is none)
+  const ShapeSummary * getShapeSummary(const llvm::Function & F) const;
+
+  // Vector Function ABI ISA token for this target (b/c/d/e on x86, n on AArch64, _LLVM_ otherwise)
+  std::string getVectorABIISA() const;
+
 private:
   // Direct access to builtin list resolver.
-  llvm::Module &mod;
+  llvm::Module *mod;
   llvm::TargetTransformInfo *mTTI;
   llvm::TargetLibraryInfo *mTLI;
   std::vector<std::unique_ptr<ResolverService>> resolverServices;
   ListResolver * listResolver;
+
+  // getResolver query -> index of the resolver service that answered it (-1 for none).
+  // Dropped whenever mappings or resolver services change.
+  mutable llvm::StringMap<int> resolverMemo;
+
+  std::unique_ptr<ShapeSummaries> shapeSummaries;
 };
 
 } // namespace rv
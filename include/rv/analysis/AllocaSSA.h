@@ -10,6 +10,8 @@
 #ifndef RV_ANALYSIS_ALLOCASSA_H
 #define RV_ANALYSIS_ALLOCASSA_H
 
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/IR/Instruction.h>
@@ -19,6 +21,7 @@
 #include <rv/region/Region.h>
 
 #include <map>
+#include <vector>
 
 namespace rv {
 
@@ -135,7 +138,6 @@ class AllocaSSA {
 
   using DefMap = std::map<const llvm::AllocaInst*, Desc*>;
   struct BlockSummary {
-    AllocSet liveAllocas; // computed during computeLiveness
     const llvm::BasicBlock & BB;
     Join allocJoin;
     const PtrProvenance & getJoinSet() const { return allocJoin.provSet; }
@@ -152,6 +154,16 @@ class AllocaSSA {
 
   std::map<const llvm::Instruction*, Effect*> instMap; // owns the Effect objects
 
+  // region blocks in RPO, the dataflow problems are indexed by RPO number
+  std::vector<const llvm::BasicBlock*> rpoBlocks;
+  llvm::DenseMap<const llvm::BasicBlock*, unsigned> blockIndex;
+
+  // allocas loaded from in the region (liveness bit index)
+  std::vector<const llvm::AllocaInst*> loadedAllocas;
+  llvm::DenseMap<const llvm::AllocaInst*, unsigned> allocaIndex;
+  // live-in allocas per block (computed during computeLiveness)
+  std::vector<llvm::BitVector> liveIn;
+
   // returns the last defining effect on @allocInst
   Desc * getLastDef(const llvm::BasicBlock & BB, const llvm::AllocaInst & allocInst) const;
 
@@ -182,11 +194,15 @@ class AllocaSSA {
   void computeLiveness();
 
   bool isLive(const llvm::AllocaInst & alloca, const llvm::BasicBlock & BB) const {
-    const auto * summary = getBlockSummary(BB);
-    if (!summary) return false;
-    return summary->liveAllocas.count(&alloca);
+    auto itBlock = blockIndex.find(&BB);
+    auto itAlloca = allocaIndex.find(&alloca);
+    if (itBlock == blockIndex.end() || itAlloca == allocaIndex.end()) return false;
+    return liveIn[itBlock->second].test(itAlloca->second);
   }
 
+  // live-in allocas of \p BB
+  AllocSet getLiveAllocas(const llvm::BasicBlock & BB) const;
+
 public:
   // pointer provenance
   const auto & getProvenance(const llvm::Value& val) const {
@@ -9,13 +9,12 @@
 #ifndef RV_ANALYSIS_UNDEADMASKANALYSIS_H
 #define RV_ANALYSIS_UNDEADMASKANALYSIS_H
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Dominators.h>
 #include "llvm/IR/PassManager.h"
 
-#include <map>
-
 namespace rv {
 
 class VectorizationInfo;
@@ -43,11 +42,13 @@ class UndeadMaskAnalysis {
   // whether @lhs ^ @lhsNegated implies @rhs ^ @rhsNegated
   // (returns false if answer unknown)
   bool implies(const llvm::Value & lhs, bool lhsNegated, const llvm::Value & rhs, bool rhsNegated);
-  std::map<const llvm::Value*, const llvm::BasicBlock*> liveDominatorMap;
+  llvm::DenseMap<const llvm::Value*, const llvm::BasicBlock*> liveDominatorMap;
 
 public:
   UndeadMaskAnalysis(VectorizationInfo & vecInfo, llvm::FunctionAnalysisManager &FAM);
   bool isUndead(const llvm::Value & mask, const llvm::BasicBlock & where);
+  // whether all lanes of @mask are active in @where (constant true or implied by a dominating rv_all branch)
+  bool isAllTrue(const llvm::Value & mask, const llvm::BasicBlock & where);
   void print(llvm::raw_ostream &);
 };
 
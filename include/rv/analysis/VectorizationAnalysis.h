@@ -37,6 +37,7 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <map>
+#include <memory>
 #include <queue>
 #include <string>
 #include <unordered_set>
@@ -64,7 +65,9 @@ class VectorizationAnalysis {
   const llvm::DominatorTree &DT;
 
   // Divergence computation:
-  llvm::SyncDependenceAnalysis SDA;
+  // (created on the first join point query that misses the cache of the VectorizationInfo)
+  const llvm::PostDominatorTree &PDT;
+  std::unique_ptr<llvm::SyncDependenceAnalysis> SDA;
   PredicateAnalysis PredA;
 
   FunctionRegion funcRegion;
@@ -73,6 +76,10 @@ class VectorizationAnalysis {
 
   llvm::DenseSet<const llvm::BasicBlock *> mControlDivergentBlocks;
 
+  // alignments that hold in the region (llvm.assume align bundles, aligned allocations)
+  AlignmentFacts alignFacts;
+  void collectAlignmentFacts(const llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+
   bool updateTerminator(const llvm::Instruction &Term) const;
 
   /// update disjoin paths divergence (and push PHIs)
@@ -81,6 +88,9 @@ class VectorizationAnalysis {
                                const llvm::Loop *BranchLoop);
   void taintLoopLiveOuts(const llvm::BasicBlock &LoopHeader);
 
+  // join points of the divergent terminator \p Term (cached in the VectorizationInfo)
+  const VectorizationInfo::JoinPoints &getJoinPoints(const llvm::Instruction &Term);
+
 public:
   VectorizationAnalysis(Config config, PlatformInfo &platInfo,
                         VectorizationInfo &VecInfo,
@@ -90,6 +100,14 @@ public:
   VectorizationAnalysis &operator=(VectorizationAnalysis) = delete;
 
   void analyze();
+
+  // Incremental re-analysis after a transformation changed the IR of an
+  // analyzed region. \p updateList holds the new and modified instructions,
+  // in-region instructions without a shape are treated as new as well.
+  // Only the shapes of these and their (transitive) users are re-computed,
+  // the shapes and divergence info of the rest of the region are kept.
+  // Erased values must have been dropped from the VectorizationInfo.
+  // Falls back to a full analysis if a divergent terminator is affected.
   void updateAnalysis(InstVec &updateList);
 
   void addInitial(const llvm::Instruction *inst, VectorShape shape);
@@ -116,6 +134,15 @@ private:
   // Run Fix-Point-Iteration after initialization
   void compute(const llvm::Function &F);
 
+  // one step of the fixed point iteration on \p I
+  void computeStep(const llvm::Instruction &I, VectorShapeTransformer &vecShapeTrans);
+  // taint the in-region allocas behind \p taintedPtrOps and join \p New into the shape of \p I
+  void applyShape(const llvm::Instruction &I, VectorShape New, const SmallValVec &taintedPtrOps);
+  // whether the transfer function of \p I only reads the VectorizationInfo (may run concurrently with others)
+  static bool isConcurrentStep(const llvm::Instruction &I);
+  // compute() in rounds over the whole worklist, the transfer functions of a round run on \p numThreads threads
+  void computeParallel(const llvm::Function &F, unsigned numThreads);
+
   // specialized transfer functions
   VectorShape computePHIShape(const llvm::PHINode &phi);
 
@@ -154,6 +181,9 @@ private:
 
   // Cast undefined instruction shapes to uniform shapes
   void promoteUndefShapesToUniform(const llvm::Function &F);
+
+  // mark all non-loop exiting branches as divergent (config.foldAllBranches)
+  void foldAllBranches(const llvm::Function &F);
 };
 
 } // namespace rv
@@ -0,0 +1,86 @@
+//===- rv/analysis/controlDependence.h - cached control dependences --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Control dependences of a function as a new-PM analysis. All relations are
+// stored in compressed rows (one offset array, one block array) in the block
+// order of the function:
+//
+//   getControlDependences(B)  branch blocks that B is directly control dependent on
+//   getInfluenceRegion(A)     blocks reachable from the successors of the branch A
+//                             before its immediate post dominator (the blocks whose
+//                             predicate turns varying if A diverges)
+//
+// The result is derived from the post dominator tree and invalidated with it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_ANALYSIS_CONTROLDEPENDENCE_H
+#define RV_ANALYSIS_CONTROLDEPENDENCE_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/PassManager.h>
+
+#include <vector>
+
+namespace llvm {
+  class BasicBlock;
+  class Function;
+  class PostDominatorTree;
+}
+
+namespace rv {
+
+class ControlDependence {
+  llvm::DenseMap<const llvm::BasicBlock*, unsigned> blockIndex;
+
+  // block index -> branch blocks (direct control dependences)
+  std::vector<unsigned> cdepOffsets;
+  std::vector<const llvm::BasicBlock*> cdepBlocks;
+
+  // block index -> influence region (empty for blocks with less than two successors)
+  std::vector<unsigned> regionOffsets;
+  std::vector<const llvm::BasicBlock*> regionBlocks;
+
+  static llvm::ArrayRef<const llvm::BasicBlock*>
+  getRow(const std::vector<unsigned> & offsets, const std::vector<const llvm::BasicBlock*> & rows, unsigned idx) {
+    return llvm::makeArrayRef(rows.data() + offsets[idx], offsets[idx + 1] - offsets[idx]);
+  }
+
+public:
+  ControlDependence(const llvm::Function & F, const llvm::PostDominatorTree & PDT);
+
+  // whether \p block existed when the dependences were computed
+  bool contains(const llvm::BasicBlock & block) const { return blockIndex.count(&block); }
+
+  llvm::ArrayRef<const llvm::BasicBlock*> getControlDependences(const llvm::BasicBlock & block) const;
+  llvm::ArrayRef<const llvm::BasicBlock*> getInfluenceRegion(const llvm::BasicBlock & branchBlock) const;
+
+  // \p A and \p B are control dependent on the same branches
+  bool isControlEquivalent(const llvm::BasicBlock & A, const llvm::BasicBlock & B) const;
+
+  // stays valid as long as the CFG and the post dominator tree do
+  bool invalidate(llvm::Function & F, const llvm::PreservedAnalyses & PA,
+                  llvm::FunctionAnalysisManager::Invalidator & Inv);
+};
+
+class ControlDependenceAnalysis : public llvm::AnalysisInfoMixin<ControlDependenceAnalysis> {
+  friend llvm::AnalysisInfoMixin<ControlDependenceAnalysis>;
+  static llvm::AnalysisKey Key;
+
+public:
+  using Result = ControlDependence;
+  Result run(llvm::Function & F, llvm::FunctionAnalysisManager & FAM);
+};
+
+// the cached control dependences of \p F (registers the analysis with \p FAM on first use)
+const ControlDependence & GetControlDependence(llvm::Function & F, llvm::FunctionAnalysisManager & FAM);
+
+} // namespace rv
+
+#endif // RV_ANALYSIS_CONTROLDEPENDENCE_H
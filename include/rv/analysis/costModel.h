@@ -10,13 +10,17 @@
 #define RV_ANALYSIS_COSTMODEL_H
 
 #include <cstddef>
+#include <vector>
 
 namespace llvm {
+  class raw_ostream;
   class Instruction;
   class Type;
   class BasicBlock;
   class TargetTransformInfo;
   class Function;
+  class GlobalVariable;
+  class Value;
 }
 
 namespace rv {
@@ -27,16 +31,95 @@ class VectorizationInfo;
 class Region;
 
 struct VectorMapping;
+struct VectorLiveRange;
+
+// lowering of a load/store whose address is neither uniform nor contiguous
+enum class VaryingAccessKind {
+  GatherScatter, // llvm.masked.gather/scatter
+  Cascade,       // one (mask-guarded) scalar access per lane (NatBuilder::createCascadeMemory)
+  StridedSpan,   // loads with a small constant stride: load the spanned range and pick the lanes with a shuffle
+  TableLookup,   // loads from a small constant table: the table lives in registers, each lookup is a lane permutation
+  ClusteredScatter // stores: one masked vector store if the active lanes fall within one vector of memory (runtime check), a scatter otherwise
+};
+
+// a load of @table[@index] from a constant global table that fits in @numParts vector registers
+// (of vectorWidth entries). One permutation reads @partsPerLookup registers, the results of several
+// permutations are blended by the high index bits.
+struct TableLookup {
+  const llvm::GlobalVariable * table;
+  const llvm::Value * index;
+  unsigned numParts;
+  unsigned partsPerLookup;
+
+  TableLookup() : table(nullptr), index(nullptr), numParts(0), partsPerLookup(0) {}
+};
+
+// cost estimate of a vectorized region/block in reciprocal throughput units (TTI::TCK_RecipThroughput)
+struct RegionCost {
+  RegionCost()
+  : scalarCost(0.0), vectorCost(0.0)
+  , replicationCost(0.0), gatherScatterCost(0.0), cascadeCost(0.0), blendCost(0.0), maskCost(0.0)
+  , scalarSize(0.0), vectorSize(0.0)
+  {}
+
+  double scalarCost; // scalar baseline (vectorWidth executions of the scalar code)
+  double vectorCost; // total vector code (including all penalties below)
+
+  // shares of vectorCost
+  double replicationCost;   // scalarized instructions (per-lane execution + insert/extract)
+  double gatherScatterCost; // gather/scatter intrinsics
+  double cascadeCost;       // gather/scatter emulated with per-lane branches (createCascadeMemory)
+  double blendCost;         // selects replacing phis at divergent joins and loop exits
+  double maskCost;          // edge masks, mask joins and any-of reductions for divergent loop exits
+
+  // code size (instructions) of the scalar region and the estimated size of its vector code
+  double scalarSize;
+  double vectorSize;
+
+  RegionCost & operator+=(const RegionCost & o);
+
+  // expected speedup in percent (100 == break even)
+  unsigned getScore() const;
+  bool isBeneficial() const { return vectorCost < scalarCost; }
+  // vector code size over scalar code size
+  double getCodeGrowth() const { return scalarSize > 0.0 ? vectorSize / scalarSize : 1.0; }
+
+  void print(llvm::raw_ostream & out) const;
+};
 
 class CostModel {
   PlatformInfo & platInfo;
   Config & config;
   llvm::TargetTransformInfo & tti;
+  const VectorizationInfo * vecInfo; // shapes of a prior VA run (optional)
 
+  // whether @inst will execute once per lane (true if there is no VA result)
   bool needsReplication(const llvm::Instruction & inst) const;
 
+  // whether instructions in @block will execute under a varying mask
+  bool needsMask(const llvm::BasicBlock & block) const;
+
+  // add the costs for @inst to @cost (requires vecInfo)
+  void addInstructionCost(const llvm::Instruction & inst, RegionCost & cost) const;
+  void addMemoryCost(const llvm::Instruction & inst, RegionCost & cost) const;
+  void addReplicationCost(const llvm::Instruction & inst, RegionCost & cost) const;
+  void addControlCost(const llvm::BasicBlock & block, RegionCost & cost) const;
+
+  // live ranges of the values of @region that will occupy vector registers, returns the number of positions
+  size_t collectLiveRanges(const Region & region, std::vector<VectorLiveRange> & oRanges) const;
+
 public:
   CostModel(PlatformInfo & _platInfo, Config & _config);
+  CostModel(PlatformInfo & _platInfo, Config & _config, const VectorizationInfo & _vecInfo);
+
+  // the vector register bits of the target, bounded by config.maxVectorBits
+  size_t getMaxVectorBits() const;
+
+  // share of the operations of @F that run on the FP and multiplier units
+  static double GetHeavyOpDensity(const llvm::Function & F);
+  // vector register bits for @F on AVX-512 targets: light integer code loses less at 256 bits than 512-bit vectors
+  // cost in core frequency (license levels on Skylake-SP/Cascade Lake), code dense in heavy operations uses 512 bits
+  static size_t PickAVX512Bits(const llvm::Function & F);
 
   // whether this is an vectorizable LLVM intrinsic
   bool IsVectorizableFunction(llvm::Function & Callee) const;
@@ -53,6 +136,35 @@ public:
   // pick a vector width for a single block/the region
   size_t pickWidthForBlock(const llvm::BasicBlock & block, size_t maxWidth) const;
   size_t pickWidthForRegion(const Region & region, size_t maxWidth) const;
+
+  // the widest width up to @maxWidth at which the peak of live vector registers in @region fits the register file
+  // of the target (values of wide elements occupy several registers at wide widths)
+  size_t pickWidthForPressure(const Region & region, size_t maxWidth) const;
+
+  // cheapest lowering of the non-dense load/store @inst (requires vecInfo).
+  // @masked: @inst executes under a varying mask. The cost of the choice is returned in @oCost.
+  VaryingAccessKind pickVaryingAccess(const llvm::Instruction & inst, bool masked, double * oCost = nullptr) const;
+
+  // number of elements per lane spanned by @inst if it qualifies for VaryingAccessKind::StridedSpan (0 otherwise)
+  unsigned getStridedSpanFactor(const llvm::Instruction & inst, bool masked) const;
+
+  // whether @inst qualifies for VaryingAccessKind::TableLookup on the target (vpermps/vpermt2ps, pshufb, tbl)
+  bool getTableLookup(const llvm::Instruction & inst, TableLookup & oLookup) const;
+
+  // reciprocal throughput of @inst executed once in scalar code
+  double getScalarCost(const llvm::Instruction & inst) const;
+
+  // estimated cost of @block/the whole region at the vector width of the VectorizationInfo.
+  // Requires the VectorizationInfo constructor.
+  RegionCost estimateBlockCost(const llvm::BasicBlock & block) const;
+  RegionCost estimateRegionCost() const;
+
+  // estimateRegionCost().getScore()
+  unsigned scoreRegion() const;
+
+  // vector iterations that a software prefetch in the region (a loop body) runs ahead of the access,
+  // the memory latency over the estimated cost of one iteration (requires vecInfo)
+  unsigned pickPrefetchDistance() const;
 };
 
 }
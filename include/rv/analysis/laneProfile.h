@@ -0,0 +1,83 @@
+//===- rv/analysis/laneProfile.h - lane occupancy profiles of divergent branches --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Profile of how often the active lanes of a divergent branch agree.
+// With RV_LANE_PROFILE_GEN=<file> the vectorized code counts, per branch and
+// executed vector instance, whether all active lanes went to the true
+// successor, all went to the false successor or the lanes were mixed. The
+// counts are appended to <file> at program exit. A later compile with
+// RV_LANE_PROFILE=<file> reads them back and BOSCC/CIF only insert uniform
+// branches where uniform outcomes were observed.
+//
+// Profile lines read "<function> <region> <branch> <allTrue> <allFalse> <mixed>".
+// Branches are numbered by their order in the region, regions by the order in
+// which they were vectorized in their function. Repeated lines are summed.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_ANALYSIS_LANEPROFILE_H
+#define RV_ANALYSIS_LANEPROFILE_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+  class BranchInst;
+}
+
+namespace rv {
+
+struct Config;
+class PlatformInfo;
+class VectorizationInfo;
+
+struct BranchOutcomes {
+  uint64_t allTrue;
+  uint64_t allFalse;
+  uint64_t mixed;
+
+  uint64_t getTotal() const { return allTrue + allFalse + mixed; }
+
+  // fraction of the vector instances where all active lanes took successor \p succIdx
+  double getAllTakenRatio(unsigned succIdx) const;
+};
+
+class LaneProfile {
+  const Config & config;
+  VectorizationInfo & vecInfo;
+  PlatformInfo & platInfo;
+
+  std::string funcName;
+  unsigned regionIdx;
+
+  // divergent branches of the region by profile index
+  llvm::SmallVector<llvm::BranchInst*, 16> branches;
+  llvm::DenseMap<const llvm::BranchInst*, unsigned> branchIndex;
+
+  // outcomes of the branches (RV_LANE_PROFILE)
+  llvm::DenseMap<unsigned, BranchOutcomes> outcomes;
+
+  void readProfile(const std::string & profilePath);
+
+public:
+  // number the divergent branches of the region (before any CFG transformation) and load their profile.
+  LaneProfile(const Config & _config, VectorizationInfo & _vecInfo, PlatformInfo & _platInfo);
+
+  // emit the counters and the exit handler that writes them to the RV_LANE_PROFILE_GEN file.
+  void instrument();
+
+  // profiled outcomes of \p branch, nullptr if there are none.
+  const BranchOutcomes * getOutcomes(const llvm::BranchInst & branch) const;
+};
+
+} // namespace rv
+
+#endif // RV_ANALYSIS_LANEPROFILE_H
@@ -58,6 +58,14 @@ namespace rv {
     // minimum dependence distance between two loop iterations
     Optional<iter_t> minDepDist;
 
+    // unroll hint for later passes (llvm.loop.unroll.count)
+    Optional<iter_t> unrollCount;
+
+    // the stores of the loop write output that is not read again soon (rv.loop.nontemporal)
+    Optional<bool> nontemporalStores;
+    // run the vectorized loop in thread chunks of this many vector iterations (rv.loop.parallel_chunks)
+    Optional<iter_t> parallelChunks;
+
     llvm::raw_ostream& print(llvm::raw_ostream & out) const;
     void dump() const;
   };
@@ -68,6 +76,12 @@ namespace rv {
   // Encode \p loopMD as LLVM LoopVectorizer Metadata hints for the loop \p L.
   void SetLLVMLoopAnnotations(llvm::Loop & L, LoopMD && loopMD);
 
+  // The access groups listed by llvm.loop.parallel_accesses in the loop ID of \p L.
+  std::vector<llvm::Metadata*> GetParallelAccessGroups(const llvm::Loop & L);
+
+  // Add llvm.loop.parallel_accesses for \p accessGroups to the loop ID of \p L (its other entries stay).
+  void AddParallelAccessGroups(llvm::Loop & L, llvm::ArrayRef<llvm::Metadata*> accessGroups);
+
   // Encode \p llvmLoopMD as MDNodes to attach to an LLVM Loop ID node.
   void AppendMDEntries(llvm::LLVMContext & ctx, std::vector<llvm::Metadata*> & mdArgs, const LoopMD & llvmLoopMD);
 
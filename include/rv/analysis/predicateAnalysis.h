@@ -10,6 +10,7 @@
 #define RV_ANALYSIS_PREDICATEANALYSIS_H
 
 #include "rv/analysis/DFG.h"
+#include "rv/analysis/controlDependence.h"
 #include <llvm/IR/Dominators.h>
 #include <llvm/Analysis/PostDominators.h>
 #include <llvm/ADT/ArrayRef.h>
@@ -21,14 +22,21 @@ namespace rv {
 
 // This analysis determines whether a basic block predicate will be varying
 // without actually emitting the predicate computation.
+// The blocks that a divergent branch affects come from the cached influence
+// regions of ControlDependenceAnalysis.
 class PredicateAnalysis {
   VectorizationInfo & vecInfo;
   const llvm::PostDominatorTree & PDT;
+  const ControlDependence & CD;
+
+  // walk the CFG for blocks that are younger than \p CD
+  void addDivergentBranchUncached(const llvm::BasicBlock & rootBlock, llvm::ArrayRef<const llvm::BasicBlock*> & divSuccArray, BlockCallbackFunc BlockCallback);
 
 public:
-  PredicateAnalysis(VectorizationInfo & _vecInfo, const llvm::PostDominatorTree & _PDT)
+  PredicateAnalysis(VectorizationInfo & _vecInfo, const llvm::PostDominatorTree & _PDT, const ControlDependence & _CD)
   : vecInfo(_vecInfo)
   , PDT(_PDT)
+  , CD(_CD)
   {}
 
   /// update the analysis with a newly detected divergent branch (or divergent loop where \p rootBlock is the loop header)
@@ -0,0 +1,137 @@
+//===- rv/analysis/profitModel.h - learned profitability model --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Learned correction of the analytic speedup estimate (RV_PROFIT_MODEL).
+//
+// The model is an ensemble of regression trees (gradient boosting) over static
+// features of the region (ProfitFeatures: cost-model shares, shape counts,
+// divergence, memory access classes and the transformation toggles under
+// consideration). The sum of the leaf values of all trees is the log of the
+// ratio of the measured speedup over the analytic one (RegionCost::getScore):
+//
+//   predicted = analytic * exp(sum of leaves)
+//
+// An empty ensemble predicts the analytic speedup. The loop vectorizer scores
+// its candidate widths with the model, VectorizerInterface::linearize picks
+// BOSCC/CIF and the gather lowering by the predicted speedup.
+//
+// tools/rv-train-profit.py fits the trees to the measured speedups of the
+// benchmark suite (test_rv.py -p -j) and writes either a model file for
+// RV_PROFIT_MODEL=<file> (one per target) or profitModel.gen.inc, the
+// model compiled into RV (RV_PROFIT_MODEL=builtin). Model files read:
+//
+//   # comment
+//   target <name>
+//   tree
+//   node <id> <feature> <threshold> <left id> <right id>   (feature < threshold: left)
+//   leaf <id> <value>
+//
+// Node ids count from 0 (the root) in every tree, children have higher ids than
+// their parent (pre-order). The shipped profitModel.gen.inc is empty (it
+// predicts the analytic speedup), the model is opt-in until one is trained.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_ANALYSIS_PROFITMODEL_H
+#define RV_ANALYSIS_PROFITMODEL_H
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace rv {
+
+struct Config;
+struct RegionCost;
+class VectorizationInfo;
+
+enum class ProfitFeature : int {
+  Width = 0,
+  Score,              // analytic speedup in percent (RegionCost::getScore)
+  CodeGrowth,         // vector code size over scalar code size
+  ReplicationShare,   // shares of the vector cost (RegionCost)
+  GatherScatterShare,
+  CascadeShare,
+  BlendShare,
+  MaskShare,
+  NumInstructions,    // instructions in the region
+  VaryingShare,       // share of instructions with a varying shape
+  DivergentBranches,  // branches on a varying condition
+  MaskedBlockShare,   // share of blocks under a varying predicate
+  UniformMemShare,    // shares of the loads/stores by address shape
+  ContiguousMemShare,
+  VaryingMemShare,    // strided and varying addresses
+  BOSCC,              // Config toggles the decision is made for
+  CIF,
+  Gathers,
+  NumFeatures
+};
+
+struct ProfitFeatures {
+  double values[(int) ProfitFeature::NumFeatures];
+
+  ProfitFeatures();
+
+  double & operator[](ProfitFeature feature) { return values[(int) feature]; }
+  double operator[](ProfitFeature feature) const { return values[(int) feature]; }
+
+  // the name of \p feature in model files and the predict records of rvTool
+  static const char * GetName(ProfitFeature feature);
+
+  // the features of the region of \p vecInfo (after VA) with the cost estimate \p cost under \p config
+  static ProfitFeatures Collect(const VectorizationInfo & vecInfo, const RegionCost & cost, const Config & config);
+
+  // "name": value, ... (the members of a JSON object)
+  void print(llvm::raw_ostream & out) const;
+};
+
+// a node of a regression tree (flat array, leaves have feature < 0)
+struct ProfitNode {
+  int feature;
+  double threshold;
+  int left;  // feature < threshold
+  int right;
+  double value; // leaves
+};
+
+class ProfitModel {
+  std::string target;
+  std::vector<ProfitNode> nodes;
+  std::vector<int> roots;
+
+  bool read(const std::string & modelPath);
+
+public:
+  // the model compiled into RV (profitModel.gen.inc)
+  ProfitModel();
+  // the model file \p modelPath (empty on errors)
+  ProfitModel(const std::string & modelPath);
+
+  // the RV_PROFIT_MODEL model (a file or "builtin"), nullptr if RV_PROFIT_MODEL is not set
+  static const ProfitModel * get();
+
+  bool empty() const { return roots.empty(); }
+  const std::string & getTarget() const { return target; }
+
+  // sum of the leaf values of all trees for \p features
+  double predictLogRatio(const ProfitFeatures & features) const;
+
+  // predicted speedup in percent (like RegionCost::getScore)
+  unsigned predictScore(const ProfitFeatures & features) const;
+
+  // whether the model predicts a higher speedup with the toggle \p feature on than off
+  // (ties keep \p current)
+  bool prefers(ProfitFeatures features, ProfitFeature feature, bool current) const;
+};
+
+} // namespace rv
+
+#endif // RV_ANALYSIS_PROFITMODEL_H
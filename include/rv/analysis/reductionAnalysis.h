@@ -24,6 +24,7 @@
 
 namespace llvm {
   class Constant;
+  class DominatorTree;
   class Loop;
 }
 
@@ -58,16 +59,45 @@ public:
   RedKind kind;
   // the instructions that make up this reduction pattern
   InstSet elements;
+  // prefix scan: the intermediate values are used inside @levelLoop. This is the value the (single) reductor folds into the chain.
+  llvm::Value * scanInput;
+  // index recurrence (RedKind::Bot): the induction value the latch select picks.
+  llvm::Value * indexValue;
+  // argmin/argmax: the min/max reduction whose compare selects the index. nullptr if every pick wins (last index).
+  Reduction * keyReduction;
+  // dot product: the multiply of two sign/zero-extended i8/i16 values that the (single) reductor accumulates.
+  llvm::Instruction * dotProduct;
+  // forward recurrence (RedKind::Bot, prev = cur of the last iteration): the value the phi forwards.
+  // Higher orders forward another recurrence phi. @recurrenceOrder counts the steps back to the computed value.
+  llvm::Instruction * recurrenceInput;
+  int recurrenceOrder;
+  // tail-folded loops: the latch select (tailMask ? update : phi) that keeps the phi value on masked-out lanes.
+  // It is part of @elements but does not fold anything into the chain.
+  llvm::SelectInst * tailBlend;
 
   Reduction(InstSet _elements)
   : levelLoop(nullptr)
   , kind(RedKind::Bot)
   , elements(_elements)
+  , scanInput(nullptr)
+  , indexValue(nullptr)
+  , keyReduction(nullptr)
+  , dotProduct(nullptr)
+  , recurrenceInput(nullptr)
+  , recurrenceOrder(0)
+  , tailBlend(nullptr)
   {}
 
   Reduction(llvm::Loop & _levelLoop, RedKind _kind)
   : levelLoop(&_levelLoop)
   , kind(_kind)
+  , scanInput(nullptr)
+  , indexValue(nullptr)
+  , keyReduction(nullptr)
+  , dotProduct(nullptr)
+  , recurrenceInput(nullptr)
+  , recurrenceOrder(0)
+  , tailBlend(nullptr)
   {}
 
 
@@ -75,6 +105,13 @@ public:
   : levelLoop(&_levelLoop)
   , kind(RedKind::Bot)
   , elements()
+  , scanInput(nullptr)
+  , indexValue(nullptr)
+  , keyReduction(nullptr)
+  , dotProduct(nullptr)
+  , recurrenceInput(nullptr)
+  , recurrenceOrder(0)
+  , tailBlend(nullptr)
   {
     elements.insert(&_seedElem);
   }
@@ -88,9 +125,16 @@ public:
   bool canPrivatize() const { false; } // TODO implement
 #endif
 
-  VectorShape getShape(int vectorWidth) const { return kind == RedKind::Bot ? VectorShape::undef() : VectorShape::varying(); } // infer a suitable vector shape
+  VectorShape getShape(int vectorWidth) const { return kind == RedKind::Bot && !isIndex() && !isRecurrence() ? VectorShape::undef() : VectorShape::varying(); } // infer a suitable vector shape
 
   // shorthands
+  bool isScan() const { return scanInput != nullptr; }
+  bool isIndex() const { return indexValue != nullptr; }
+  bool isDotProduct() const { return dotProduct != nullptr; }
+  bool isRecurrence() const { return recurrenceInput != nullptr; }
+  bool isTailBlended() const { return tailBlend != nullptr; }
+  // number of elements without the tail blend
+  size_t numChainNodes() const { return elements.size() - (tailBlend ? 1 : 0); }
   bool contains(llvm::Instruction & elem) const { return elements.find(&elem) != elements.end(); }
   bool add(llvm::Instruction & elem) { return elements.insert(&elem).second; }
   void erase(llvm::Instruction & elem) { elements.erase(&elem); }
@@ -107,6 +151,9 @@ class ReductionAnalysis {
   std::map<llvm::Instruction*, Reduction*> reductMap;
 
   const llvm::LoopInfo & loopInfo;
+  const llvm::DominatorTree & domTree;
+  // live lanes of a tail-folded loop (nullptr otherwise)
+  llvm::Value * tailMask;
 
   // adds the unseen instruction @inst to @redGroup in all mappings
   bool addToGroup(Reduction & redGroup, llvm::Instruction & inst);
@@ -121,6 +168,12 @@ class ReductionAnalysis {
   // check whether this instruction has a general stride pattern
   StridePattern * tryMatchStridePattern(llvm::PHINode & headerPhi);
 
+  // check whether the recurrence @red of @headerPhi selects an induction value (argmin/argmax, last index)
+  bool matchIndexRecurrence(Reduction & red, llvm::PHINode & headerPhi, llvm::Loop & loop);
+
+  // check whether @headerPhi only forwards a value of the last iteration (prev = cur, or a chain of those for higher orders)
+  bool matchForwardRecurrence(Reduction & red, llvm::PHINode & headerPhi, llvm::Loop & loop);
+
 
   // returns true if the value of this instruction can be recomputed even if loop iterations execute in parallel/or SIMD fashing
   bool canReconstructInductively(llvm::Instruction & inst) const { return getStrideInfo(inst); }
@@ -132,7 +185,8 @@ public:
   ~ReductionAnalysis();
 
   // analyze all recurrence patterns inside @hostLoop
-  void analyze(llvm::Loop & hostLoop);
+  // @tailMask: the live lanes of a tail-folded loop. Latch selects on it are seen through.
+  void analyze(llvm::Loop & hostLoop, llvm::Value * tailMask = nullptr);
 
   // look up a (general) reduction by its constituent
   Reduction * getReductionInfo(llvm::Instruction & inst) const;
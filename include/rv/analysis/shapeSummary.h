@@ -0,0 +1,74 @@
+//===- rv/analysis/shapeSummary.h - inter-procedural shape transfer summaries --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Shape transfer summaries of the defined functions of a module (RV_NO_SHAPE_SUMMARIES).
+// Without them, the VA only knows the result shape of a call to a defined
+// function once the callee has been vectorized for these argument shapes
+// (greedy IPV), or if the callee is marked readonly and all arguments are
+// uniform.
+//
+// The summary of a callee records which arguments its result depends on
+// (data and control flow) and whether it is free of side effects. Summaries
+// are computed bottom-up over the SCCs of the call graph, calls to summarized
+// functions map the dependences of their arguments through. The result of a
+// call to a side effect free function is uniform if all arguments it depends
+// on are uniform. If the function returns the same argument on every path,
+// the result also keeps the alignment of that argument.
+//
+// Recursive functions, functions with lane intrinsics and functions that
+// call unknown code (or write to non-local memory) are not summarized.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_ANALYSIS_SHAPESUMMARY_H
+#define RV_ANALYSIS_SHAPESUMMARY_H
+
+#include <llvm/ADT/DenseMap.h>
+
+#include "rv/shape/vectorShape.h"
+
+#include <cstdint>
+
+namespace llvm {
+  class Function;
+  class Module;
+  class raw_ostream;
+}
+
+namespace rv {
+
+struct ShapeSummary {
+  uint64_t dependentArgs; // bit i: the result depends on argument i
+  int returnedArg; // the argument returned on every path (-1 if none)
+
+  // the result shape of a call with \p argShapes (returns false if the summary does not improve on varying)
+  bool getResultShape(const VectorShapeVec & argShapes, VectorShape & resultShape) const;
+
+  void print(llvm::raw_ostream & out) const;
+};
+
+class ShapeSummaries {
+  llvm::DenseMap<const llvm::Function*, ShapeSummary> summaries;
+
+  // summarize \p F given the summaries of its callees (returns false if \p F is opaque)
+  bool summarize(const llvm::Function & F, ShapeSummary & summary) const;
+
+public:
+  ShapeSummaries(llvm::Module & mod);
+
+  // the summary of \p F (nullptr if \p F is opaque)
+  const ShapeSummary * getSummary(const llvm::Function & F) const;
+
+  size_t size() const { return summaries.size(); }
+
+  void print(llvm::raw_ostream & out) const;
+};
+
+} // namespace rv
+
+#endif // RV_ANALYSIS_SHAPESUMMARY_H
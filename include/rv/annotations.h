@@ -10,10 +10,12 @@
 #define RV_ANNOTATIONS_H
 
 #include "rv/analysis/reductions.h"
+#include "rv/vectorMapping.h"
 
 namespace llvm {
   class Function;
   class PHINode;
+  class CallBase;
 }
 
 namespace rv {
@@ -22,6 +24,20 @@ namespace rv {
 
   void SetReductionHint(llvm::PHINode & loopHeaderPhi, RedKind redKind);
   RedKind ReadReductionHint(const llvm::PHINode & loopHeaderPhi);
+
+  // accuracy of vector math (tenth of ULP, like Config::maxULPErrorBound).
+  // Function-level bounds hold for all math calls in \p func.
+  void SetULPErrorBound(llvm::Function & func, unsigned ulpBound);
+  void SetULPErrorBound(llvm::CallBase & call, unsigned ulpBound);
+  // returns -1 if there is no bound for this function
+  int ReadULPErrorBound(const llvm::Function & func);
+  // call-site bound ("rv.ulp" or "fpmath" metadata), otw the bound of the calling function (or -1)
+  int ReadULPErrorBound(const llvm::CallBase & call);
+
+  // records \p mapping on its vector function (the scalar function is referred to by name)
+  void SetVariantMapping(llvm::Function & vecFunc, const VectorMapping & mapping);
+  // the recorded mapping of \p vecFunc, returns false if there is none or its scalar function is gone
+  bool ReadVariantMapping(llvm::Function & vecFunc, VectorMapping & mapping);
 }
 
 #endif
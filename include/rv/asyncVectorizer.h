@@ -0,0 +1,121 @@
+//===- rv/asyncVectorizer.h - background vectorization for JITs --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Whole-function vectorization off the critical path of a JIT.
+// submit() snapshots the scalar function (as bitcode, other definitions of its
+// module become declarations) and returns right away. Worker threads
+// vectorize the snapshots in their own LLVMContext, each with a long-lived
+// VectorizerSession (generic target analyses, the Config selects the ISA).
+// Hot jobs run before cold ones. Once a job is done, takeResult() parses the
+// vector function (with the rv_* intrinsics lowered and the definitions the
+// resolvers linked in) into a context of the caller's choice, the JIT swaps
+// it in for the scalar version.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_ASYNCVECTORIZER_H
+#define RV_ASYNCVECTORIZER_H
+
+#include "rv/config.h"
+#include "rv/vectorMapping.h"
+
+#include <llvm/ADT/SmallVector.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+  class LLVMContext;
+  class Module;
+}
+
+namespace rv {
+
+class VectorizerSession;
+
+class AsyncVectorizer {
+public:
+  using JobId = uint64_t;
+
+  enum class Priority { Cold = 0, Hot = 1 };
+  enum class JobState { Queued, Running, Done, Failed, Cancelled };
+
+  // called on the worker thread when a job reaches Done, Failed or Cancelled
+  using CompletionFn = std::function<void(JobId, JobState)>;
+
+private:
+  struct Job {
+    JobId id;
+    std::string scalarName;
+    std::string vectorName;
+    VectorMapping mapping; // functions are looked up by name in the snapshot
+    llvm::SmallVector<char, 0> snapshot; // scalar module bitcode
+    llvm::SmallVector<char, 0> result;   // vector module bitcode (Done)
+    Priority priority;
+    JobState state;
+    std::atomic<bool> cancelRequested;
+    CompletionFn onDone;
+
+    Job(JobId _id, Priority _priority) : id(_id), priority(_priority), state(JobState::Queued), cancelRequested(false) {}
+  };
+  using JobRef = std::shared_ptr<Job>;
+
+  Config config;
+  mutable std::mutex lock;
+  std::condition_variable queueCond; // new jobs or shutdown
+  std::condition_variable doneCond;  // a job finished
+  std::deque<JobRef> queues[2];      // per Priority
+  std::map<JobId, JobRef> jobs;      // until takeResult/forget
+  std::vector<std::thread> workers;
+  JobId nextId;
+  bool shutdown;
+
+  void runWorker();
+  void runJob(Job & job, llvm::LLVMContext & workerCtx, VectorizerSession & session);
+  JobRef popJob(); // blocks, nullptr on shutdown
+  void finishJob(Job & job, JobState state);
+  JobRef lookup(JobId id) const;
+
+public:
+  // \p numWorkers background threads (0: one per hardware thread)
+  AsyncVectorizer(Config config, unsigned numWorkers = 1);
+  // cancels the queued jobs and waits for the running ones
+  ~AsyncVectorizer();
+
+  // enqueue the vectorization of \p mapping (scalarFn must be a definition, vectorFn its SIMD declaration).
+  // Returns immediately. The module of scalarFn must not be modified concurrently with this call.
+  JobId submit(const VectorMapping & mapping, Priority priority = Priority::Cold, CompletionFn onDone = nullptr);
+
+  // move a queued job to the back of the \p priority queue. False if it is not queued anymore.
+  bool setPriority(JobId id, Priority priority);
+  // drop a queued job, a running job stops at the next phase boundary. False if it has finished already.
+  bool cancel(JobId id);
+
+  // unknown (forgotten) jobs are Failed
+  JobState getState(JobId id) const;
+  // block until the job has finished
+  JobState wait(JobId id);
+
+  // the vector function of a Done job in a new module of \p ctx (nullptr otherwise), forgets the job
+  std::unique_ptr<llvm::Module> takeResult(JobId id, llvm::LLVMContext & ctx);
+  // drop the record of a finished job
+  void forget(JobId id);
+};
+
+} // namespace rv
+
+#endif // RV_ASYNCVECTORIZER_H
@@ -9,8 +9,11 @@
 #ifndef RV_CONFIG_H
 #define RV_CONFIG_H
 
+#include <llvm/ADT/StringRef.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <string>
+
 namespace llvm {
   class Function;
 }
@@ -40,37 +43,162 @@ struct Config {
 // native configuration (backend)
   bool scalarizeIndexComputation;
   bool useScatterGatherIntrinsics;
+  bool enableGatherCost; // pick gathers/scatters, scalar cascades or strided span loads per access by cost (RV_NO_GATHER_COST: always gathers if useScatterGatherIntrinsics)
   bool enableMaskedMove;
   bool useSafeDivisors; // blend-in safe divisors to eliminate spurious arithmetic exceptions
+  bool enableMaskBits; // any/all/ballot/popcount of masks through their scalar iW bitmask on x86 (RV_NO_MASK_BITS)
+  bool enableDivisionLowering; // integer division by uniform divisors as multiply-high sequences, by small varying divisors in floating point (RV_NO_DIV_LOWERING)
+  bool enableFPEstimates; // fast-math x / y and x / sqrt(y) through rcp14/rsqrt14 (rcpps/rsqrtps, frecpe/frsqrte) and Newton-Raphson steps for maxULPErrorBound (RV_NO_FP_ESTIMATES)
+  bool enableNativeFPMinMax; // select-based min/max, minnum/maxnum and FMin/FMax reductions as minps/maxps (fminnm/fmaxnm) under nnan and nsz or on operands that are known not NaN (RV_NO_NATIVE_FMINMAX)
+  bool enableBitMasks; // bitset tests (w >> s) & 1 of a uniform word and contiguous s as the bits of w bitcast to the mask, bitset updates *p |= c << s as the mask bits, bool loads tested against 0 (RV_NO_BIT_MASKS)
+  bool enableIndexNarrowing; // compute varying 64-bit gather/scatter indexes in 32-bit lanes if their value range fits (RV_NO_INDEX_NARROWING)
+  bool enableVectorInductions; // vector loops: keep strided integers at constant distances from the induction variable as vector phis stepped once per iteration (RV_NO_VECTOR_INDUCTIONS)
+  bool enableTableLookup; // varying loads from constant tables of up to 4 registers as in-register permutations (vpermps/vpermt2ps, pshufb, tbl) if cheaper than a gather (RV_NO_TABLE_LOOKUP)
+  bool enableDemandedLanes; // compute varying lane-wise code that only feeds a constant-lane rv_extract for that single lane (RV_NO_DEMANDED_LANES)
+  bool enableAVX512WidthPolicy; // createForFunction: 256-bit vectors on AVX-512 targets unless the function is dense in FP/multiply operations (CostModel::PickAVX512Bits) (RV_NO_AVX512_WIDTH_POLICY)
+  bool enableScatterCoalescing; // let the cost model lower scatters as a range check, an in-register permutation and one masked store if the active lanes hit one vector of memory, the scatter otherwise (RV_SCATTER_COALESCE)
+  bool enableAddressDispatch; // test at runtime whether the addresses of varying loads are uniform or contiguous and branch to a scalar or vector load, gather otherwise (RV_ADDRESS_DISPATCH)
+  bool enableIndexRuns; // test at runtime whether the indices of varying loads x[idx[j]] loaded contiguously from an index array are consecutive and branch to a vector load, gather otherwise (RV_INDEX_RUNS)
+  bool enableSpeculativeLoads; // masked uniform loads from dereferenceable pointers without an rv_any guard, unmasked contiguous loads if the whole vector is dereferenceable (RV_NO_SPECULATIVE_LOADS)
+  bool enableAccessMetadata; // vector memory accesses keep the TBAA, alias scope and access group metadata of their scalar accesses, vectorized parallel loops keep llvm.loop.parallel_accesses (RV_NO_ACCESS_MD)
+  bool enableVectorWidening; // varying values of short vector types <k x T> (float4 code) are widened to <k*W x T> in SoA order, element j of lane l at j*W+l (RV_VECTOR_WIDENING, off by default)
+  bool enableIntegerEmulation; // popcount, ctlz/cttz, 64-bit ashr and 8-bit shifts as branch-free sequences if TTI prices the vector instruction higher, 64-bit multiply-high always (RV_NO_INT_EMULATION)
+  bool enableSelectAccessSplit; // loads and stores through select(varying c, p, q) of uniform or contiguous p and q as two masked accesses (and a blend) instead of a gather/scatter (RV_NO_SELECT_SPLIT)
+  bool enableComplexLowering; // __mulsc3/__muldc3/__divsc3/__divdc3 calls become inline branch-free code on the real and imaginary parts before VA (RV_NO_COMPLEX_LOWERING)
+  bool enableNarrowIdioms; // saturating add/sub, rounding averages and saturating narrowing on u8/i16 (..) values computed in int and truncated back stay in the narrow type (uadd.sat, ..) before the vector width is picked (RV_NO_NARROW_IDIOMS)
 
 // optimization flags
   bool enableSplitAllocas;
   bool enableStructOpt;
+  bool enableSoAGathers; // struct-of-vector layout (structOpt) also for private arrays with varying element indices, those accesses become gathers/scatters with 32-bit offsets (RV_NO_SOA_GATHERS)
+  bool enablePromoteAllocas; // keep small varying arrays that are only accessed element-wise in registers (one select per element and access) (RV_NO_PROMOTE_ALLOCAS)
+  bool enablePromoteMemReductions; // accumulate *p += x on a uniform, invariant p in inner loops in a register and update memory at the loop exits (RV_NO_PROMOTE_MEMREDS)
   bool enableSROV;
   bool enableIRPolish;
   bool enableHeuristicBOSCC;
   bool enableCoherentIF;
+  bool enableEarlyExits; // skip the rest of the region at divergent early-out branches once all lanes took the return path (RV_EARLY_EXITS)
+  bool enableUniformVersioning; // WFV: clone the region for the case that its main divergence source is uniform at runtime (RV_UNIFORM_VERSIONING)
+  bool enableTripCountVersioning; // WFV: clone divergent loops for the case that their trip-count values are uniform at runtime (RV_TRIPCOUNT_VERSIONING)
+  bool enableSwitchDispatch; // lower divergent switches to a loop over the distinct case values of the active lanes (if cheaper than the cascade) (RV_NO_SWITCH_DISPATCH)
+  std::string laneProfileGen; // RV_LANE_PROFILE_GEN: count uniform outcomes of divergent branches into this file
+  std::string laneProfileUse; // RV_LANE_PROFILE: only insert BOSCC/CIF branches where this profile saw uniform outcomes
   bool enableOptimizedBlends;
+  bool enableVectorLICM; // hoist invariant masks, broadcasts and loads out of loops and drop redundant blends after vectorization (RV_NO_VECTOR_LICM)
+  bool enableExitBits; // divergent loops with several exits track the lanes that left through each exit in scalar ballot bitmasks (RV_NO_EXIT_BITS)
+  bool enableRecursionToLoop; // WFV: self-recursive functions without side effects run as a loop over a per-lane stack of argument frames (RV_RECURSION_LOOPS)
+  bool enableMathFusion; // expand pow(x, n), fuse pow(exp(x), y), exp(y * log(x)) and sin/cos pairs of the same operand, share exp/log calls on related operands (RV_NO_MATH_FUSION)
+  bool enableSleefColdSplit; // outline the slow paths of linked SLEEF functions into cold functions, inline only the fast path into regions of moderate size (RV_NO_SLEEF_COLD_SPLIT)
+  bool enablePressureWidth; // bound the vector width where the peak of live vector registers exceeds the register file (CostModel::pickWidthForPressure) (RV_NO_PRESSURE_WIDTH)
+  bool enablePressureSched; // linearizer: order dominator subtrees to keep few vector values live instead of rpo (RV_SCHED_PRESSURE)
+  bool enableMaskCSE; // fold, re-use and hoist loop-invariant mask expressions in the MaskExpander (RV_NO_MASK_CSE)
+  bool enableInterleavedAccess; // load/store strided members of AoS layouts as shuffled contiguous chunks (instead of gathers)
+  bool enableGatherCoalescing; // gather varying loads at small constant offsets from the same addresses (struct fields) as 64-bit elements and split them with shuffles (RV_NO_GATHER_COALESCING)
+  bool enableShuffleTrees; // (de-)interleave power-of-two factors >= 4 in rounds of shared uzp/zip shuffles on targets with single-instruction two-source permutes (RV_NO_SHUFFLE_TREES)
+  bool enableTailFolding; // let the loop vectorizer fold the remainder into the vector loop (if cheaper)
+  bool enableVectorEpilogue; // let the loop vectorizer vectorize the remainder loop at a narrower width (if cheaper)
+  bool enableOverlapTail; // let the loop vectorizer finish idempotent loops with a full vector iteration that overlaps the previous one (if cheaper) (RV_OVERLAP_TAIL)
+  bool enableProfileTrips; // loop vectorizer: expected trip counts of loops without a constant one from PGO branch weights (or trips= in RV_TUNING) bound the width and pick the remainder (RV_NO_PROFILE_TRIPS)
+  bool enableAutoLoopVec; // loop vectorizer: also consider loops without annotations (dependence analysis)
+  bool enableRuntimeAliasChecks; // loop vectorizer: version loops on runtime overlap checks between possibly aliasing accesses
+  bool enableStrideVersioning; // loop vectorizer: version loops on symbolic strides being 1 (contiguous accesses)
+  bool enableAlignPeeling; // loop vectorizer: peel scalar iterations until the main contiguous access is vector aligned
+  bool enableLaneRefill; // loop vectorizer: lanes that finish their divergent inner loop pull the next outer iteration
+  bool enableLoopCollapse; // loop vectorizer: collapse perfect nests whose vectorized level has fewer iterations than the full width (RV_LOOP_COLLAPSE)
+  bool enableDepForwarding; // loop vectorizer: loops narrowed to a small dependence distance run several groups per vector iteration (RV_DEP_FORWARDING)
+  bool enableSearchLoops; // loop vectorizer: scan search loops (data-dependent exit) in aligned vector blocks before the scalar loop
+  bool enablePrefetch; // loop vectorizer: software prefetches ahead of gathers and large-stride accesses (RV_PREFETCH)
+  bool enableStreamingStores; // nontemporal stores for write-only contiguous output (set per loop, see LoopVectorizer::chooseStreamingStores)
 
 // greedy inter-procedural vectorizatoin
   bool enableGreedyIPV;
+  bool enableShapeSummaries; // loop vectorizer: summarize which arguments the results of side effect free functions depend on (RV_NO_SHAPE_SUMMARIES)
+  bool enableWaterfallCalls; // varying indirect calls: one call per distinct target, vector variants where available (RV_NO_WATERFALL)
+  bool enableTransposedReductions; // reduce the exit values of several reductions of the same kind together (RV_NO_TRANSPOSED_REDUCTIONS)
+  bool enableUniformOffload; // broadcast uniform values once at the latest point that dominates their users, outside of loops (RV_NO_UNIFORM_OFFLOAD)
+  bool enableResolverCosts; // call resolvers report cost estimates, calls go to the cheapest resolver or are replicated (RV_NO_RESOLVER_COSTS)
+  bool enableFastVariantCC; // recursively vectorized variants of module-local functions are internal and use fastcc (RV_NO_FAST_VARIANT_CC)
   bool enableVP; // use LLVM-VP intrinsics (requires cmake -DRV_ENABLE_VP=on)
 
   // maximum ULP error bound for math functions
   // unit for maxULPErrorBound is tenth of ULP (a value of 10 implies that an ULP error of <= 1.0 is acceptable)
   int maxULPErrorBound;
 
+  // external vector math library (RV_VECLIB), takes precedence over SLEEF
+  enum VecLib {
+    VecLib_None = 0,
+    VecLib_LibMVec = 1, // glibc libmvec (Vector Function ABI names)
+    VecLib_SVML = 2, // SVML-style names (__svml_<func><width>)
+  };
+  VecLib vecLib;
+  // "<function> <batch function>" lines of batch APIs for calls without a vector variant (RV_BATCH_MAP, see addBatchResolver)
+  std::string batchMapPath;
+
+  // lowering of floating-point reductions that may not be reassociated (RV_RED_ORDER)
+  enum RedOrder {
+    RedOrder_Fast = 0, // lane-private partial accumulators (reassociates)
+    RedOrder_Strict = 1, // fold every vector into a scalar accumulator in source order
+    RedOrder_Blocked = 2, // tree-reduce every vector, fold the blocks in source order (bounded reassociation)
+  };
+  RedOrder fpRedOrder;
+  // rotating vector accumulators of reassociable reductions (RV_RED_ACCUMULATORS) to hide the latency of the update
+  int redAccumulators;
+  // loop vectorizer: copies of the vector body of loops with reductions (RV_INTERLEAVE, 0 picks the factor by the update
+  // latency, 1 disables interleaving)
+  int interleave;
+  // native vector registers that one value of the widest element type may span (RV_SPLIT_PARTS).
+  // Above 1 regions with mixed element sizes may run at the natural width of their narrower types.
+  int maxSplitParts;
+  // bound on the vector register width in bits (RV_MAX_VECTOR_BITS, 0 for the register width of the target).
+  // The "rv-max-vector-bits" attribute of a function takes precedence, otw AVX-512 functions get one by enableAVX512WidthPolicy
+  int maxVectorBits;
+  // loop vectorizer: rows of 2D tiles (RV_TILE_ROWS). Above 1 the parallel loop around a vectorized
+  // innermost loop is unrolled and jammed, every vector iteration covers tileRows x width elements.
+  int tileRows;
+  // software prefetch distance in vector iterations (RV_PREFETCH_DISTANCE, 0 picks it by cost, see CostModel::pickPrefetchDistance)
+  int prefetchDistance;
+  // loop vectorizer: use streaming stores in loops that write at least this many bytes to a write-only stream
+  // (RV_NONTEMPORAL_BYTES, 0 for annotated loops only)
+  int streamingStoreMinBytes;
+  // replicated instructions whose straight-line copies (about one instruction per lane and varying operand) exceed this
+  // size run in a loop over the (active) lanes instead (RV_REPLICATION_BUDGET, 0 always emits straight-line copies)
+  int replicationBudget;
+  // divergent loops leave to a scalar clone of the loop once fewer lanes than this are live (RV_DIV_LOOP_SCALAR_TAIL,
+  // 0 disables, "auto" picks the threshold with the cost model)
+  int divLoopScalarTail;
+  // bound on the instructions of the vectorized region over those of the scalar region (RV_CODE_GROWTH_BUDGET, 0
+  // disables). Exceeding it disables CIF/BOSCC, then scalarizes with lane loops, loop vectorization picks narrower widths
+  int codeGrowthBudget;
+  // loop vectorizer: run outermost parallel loops in thread chunks of this many vector iterations through the task
+  // runtime parallelRuntime (RV_PARALLEL_CHUNKS, 0 for loops annotated with rv.loop.parallel_chunks only)
+  int parallelChunks;
+  std::string parallelRuntime; // RV_PARALLEL_RUNTIME (default rv_parallel_for, see include/rv-c/parallelFor.h)
+  // threads of the VA fixed point on regions with at least VAParallelMinInsts instructions (RV_VA_THREADS, 0 for one per
+  // hardware thread, 1 is serial). The shapes do not depend on the number of threads.
+  int vaThreads;
+
 // target features
   bool useVE;
   bool useSSE;
   bool useAVX;
   bool useAVX2;
   bool useAVX512;
+  bool useAVX512VL; // AVX-512 instructions on 128/256-bit vectors (vcompress, vexpand, ..)
+  bool useAVX512CD; // vpconflict
   bool useNEON;
   bool useADVSIMD;
+  bool useSVE; // fixed-length SVE code (the width follows the vscale_range of the function)
+  bool useVNNI; // vpdpbusd/vpdpwssd (AVX512-VNNI or AVX-VNNI)
+  bool useDotProd; // sdot/udot (Armv8.2 dot product)
+  bool useFP16; // native half arithmetic (AVX512-FP16, Armv8.2 FP16), otw half math runs in f32
+  bool useF16C; // vcvtps2ph/vcvtph2ps
+  bool useBF16; // vcvtneps2bf16 (AVX512-BF16)
 
 // code gen options
   bool useAVL; // generate AVL loops
+  bool checkShapeHints; // RV_CHECK_SHAPES: trap if the lanes of rv_uniform/rv_strided values differ from their hint, rv_align pointers and aligned pointer arguments of WFV mappings miss their alignment (debugging, canary runs)
+  std::string shapeCheckHook; // RV_CHECK_SHAPES_HOOK: call this function (const char * site, const char * kind, uint64_t lanes) instead of trapping on violated shapes (implies RV_CHECK_SHAPES)
+  std::string laneStatsPath; // RV_LANE_STATS: count executions and active lanes of divergent blocks into this file
 
   void print(llvm::raw_ostream&) const;
 
@@ -79,9 +207,14 @@ struct Config {
 
   // auto-detect target machine features (SIMD ISAs) for function \p F.
   static Config createForFunction(llvm::Function & F);
+
+  // configuration of \p F with the SIMD ISA \p arch (RV_ARCH names) in place of its own target features.
+  static Config createForArch(llvm::Function & F, llvm::StringRef arch);
 };
 
 std::string to_string(Config::VAMethod vam);
+std::string to_string(Config::VecLib vecLib);
+std::string to_string(Config::RedOrder redOrder);
 
 }
 
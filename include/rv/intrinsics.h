@@ -13,6 +13,7 @@
 #include <llvm/ADT/StringRef.h>
 
 namespace llvm {
+  class IRBuilderBase;
   class Function;
   class Module;
   class Value;
@@ -42,8 +43,30 @@ namespace rv {
     Insert = 101 , // rv_insert(V, L, X) returns the result of inserting the uniform value X into the L-th lane of V
     VecLoad = 102, // rv_load(V)
     VecStore = 103, // rv_store(V)
-    Shuffle = 104, // rv_shuffle(V, S) returns the varying value V shifted by constant S
+    Shuffle = 104, // rv_shuffle(V, S) returns in lane i the value of V in lane (i + S) mod W (S constant, uniform or varying)
     Align = 105, // rv_align(V, C) informs RV that V has the alignment constant C
+    Philox = 106, // rv_philox(K, S, C) returns 64 random bits of Philox4x32-10 with key K for counter (C, S) (lane independent)
+    Uniform = 107, // rv_uniform(V) returns V and informs RV that V is the same in all (active) lanes
+    Strided = 108, // rv_strided(V, S) returns V and informs RV that lane i holds V_0 + i * S (constant S, bytes for pointers)
+
+  // cross-lane intrinsics (inactive lanes do not contribute, min/max are signed for integers)
+    ReduceAdd = 200, // rv_reduce_add(V) returns the sum of V over all active lanes (uniform)
+    ReduceMul = 201, // rv_reduce_mul(V) product
+    ReduceMin = 202, // rv_reduce_min(V) minimum
+    ReduceMax = 203, // rv_reduce_max(V) maximum
+    ReduceAnd = 204, // rv_reduce_and(V) bitwise and
+    ReduceOr = 205, // rv_reduce_or(V) bitwise or
+    ScanAdd = 210, // rv_scan_add(V) returns in each active lane the sum of V over the active lanes up to and including it
+    ScanMul = 211, // rv_scan_mul(V) inclusive product scan
+    ScanMin = 212, // rv_scan_min(V) inclusive minimum scan
+    ScanMax = 213, // rv_scan_max(V) inclusive maximum scan
+    ScanAnd = 214, // rv_scan_and(V) inclusive bitwise and scan
+    ScanOr = 215, // rv_scan_or(V) inclusive bitwise or scan
+    ShuffleXor = 220, // rv_shuffle_xor(V, M) returns in lane i the value of V in lane i ^ M (uniform M, butterfly)
+    Broadcast = 221, // rv_broadcast(V, L) returns in lane i the value of V in lane L_i (uniform for a uniform L)
+    Sort = 222, // rv_sort(K, V) returns in lane i the value V of the active lane with the i-th smallest key K (stable, rv_sort(K, K) sorts the keys)
+    Partition = 223, // rv_partition(V, M) returns V with the active lanes where M holds first, then the other active lanes (stable)
+    Rank = 224, // rv_rank(K) returns in each active lane the position of its key K in the stable sort order of the active lanes
   };
 
   VectorMapping GetIntrinsicMapping(llvm::Function&, RVIntrinsic rvIntrin);
@@ -54,6 +77,10 @@ namespace rv {
   RVIntrinsic GetIntrinsicID(const llvm::Value&);
 
   llvm::Function &DeclareIntrinsic(RVIntrinsic id, llvm::Module &, llvm::Type* DataTy = nullptr);
+
+  // emit Philox4x32-10 on the (i64 or <N x i64>) \p seed, \p stream and \p counter.
+  // Returns the first two output words as i64 (element-wise for vectors).
+  llvm::Value * CreatePhilox4x32(llvm::IRBuilderBase & builder, llvm::Value * seed, llvm::Value * stream, llvm::Value * counter);
 }
 
 
@@ -0,0 +1,93 @@
+//===- rv/passes/AoSoALayoutPass.h - AoSoA layout for annotated global arrays --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Module-wide array-of-structs to array-of-struct-of-arrays transformation.
+// A global array of a struct type that carries the `rv_layout` annotation
+//
+//   struct Particle { float x, y, z; };
+//   __attribute__((annotate("rv_layout"))) static Particle P[N];   // or "rv_layout=16"
+//
+// is re-laid out in blocks of B (default 8) elements, { [B x float], [B x float], [B x float] }.
+// Element i, field k lives at block i / B, row k, lane i % B. Accesses are
+// rewritten to (i >> log2 B, k, i & (B - 1)): contiguous indices that are
+// B-aligned get a uniform block and a contiguous lane, i.e. vector loads
+// instead of strided gathers.
+//
+// The annotation marks the struct type: all annotated globals of one type (and
+// block size) are transformed together, including the pointer arguments of
+// internal functions that they are passed to. If any use does not allow the
+// new layout (the address escapes, a function may see other pointers, ..)
+// the type keeps its layout.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_PASSES_AOSOALAYOUTPASS_H
+#define RV_PASSES_AOSOALAYOUTPASS_H
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+  class ArrayType;
+  class Constant;
+  class DataLayout;
+  class GetElementPtrInst;
+  class GlobalVariable;
+  class Module;
+  class StructType;
+}
+
+namespace rv {
+
+class AoSoALayout {
+  llvm::Module & mod;
+  const llvm::DataLayout & DL;
+
+  // the struct type and block size that is currently transformed
+  llvm::StructType * elemTy;
+  unsigned blockSize;
+  llvm::StructType * blockTy; // { [B x field0], [B x field1], .. }
+
+  // globals and arguments that point to the first element of an array of elemTy
+  llvm::SmallPtrSet<llvm::Value*, 16> basePtrs;
+  llvm::SmallVector<llvm::Value*, 16> baseQueue;
+
+  // element offset (nullptr for zero) and field (-1 for the whole element) of \p gep on an element pointer
+  bool decomposeGEP(llvm::GetElementPtrInst & gep, llvm::Value *& elemDelta, int & field) const;
+
+  // whether all uses of \p ptr (points to an element or to \p field of it) allow the new layout
+  bool checkUses(llvm::Value & ptr, int field);
+  // every call of an internal function that receives a base pointer passes a base pointer
+  bool checkCallSites() const;
+
+  // address of \p field of element \p elemIdx (nullptr for zero) in blocked layout
+  llvm::Value * createFieldAddress(llvm::IRBuilder<> & builder, llvm::Value & basePtr, llvm::Value * elemIdx, int field);
+  void rewriteUses(llvm::Value & ptr, llvm::Value & basePtr, llvm::Value * elemIdx, int field,
+                   llvm::SmallVectorImpl<llvm::Instruction*> & deadInsts);
+
+  // initializer of the blocked global, nullptr if \p init can not be transposed
+  llvm::Constant * transposeInitializer(llvm::Constant & init, llvm::ArrayType & blockedTy) const;
+
+  // transform all \p globals (arrays of elemTy) to blocks of blockSize elements
+  bool transformType(llvm::ArrayRef<llvm::GlobalVariable*> globals);
+
+public:
+  AoSoALayout(llvm::Module & _mod);
+  bool run();
+};
+
+struct AoSoALayoutWrapperPass : llvm::PassInfoMixin<AoSoALayoutWrapperPass> {
+  static llvm::StringRef name() { return "rv::AoSoALayoutWrapperPass"; }
+  llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+};
+
+} // namespace rv
+
+#endif // RV_PASSES_AOSOALAYOUTPASS_H
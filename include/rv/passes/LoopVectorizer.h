@@ -15,9 +15,12 @@
 #include "rv/transform/remTransform.h"
 #include "rv/analysis/reductionAnalysis.h"
 #include "rv/analysis/loopAnnotations.h"
+#include "rv/analysis/costModel.h"
+#include "rv/analysis/profitModel.h"
 #include "rv/config.h"
 #include "llvm/IR/PassManager.h"
 #include "rv/transform/remTransform.h"
+#include "rv/transform/parallelChunkTrans.h"
 #include "rv/rv.h"
 #include "rv/legacy/passes.h"
 #include "rv/passes/PassManagerSession.h"
@@ -37,6 +40,8 @@ namespace llvm {
 
 namespace rv {
 
+struct TuningEntry;
+
 class LoopVectorizer {
 public:
   LoopVectorizer(llvm::Function &F, llvm::TargetTransformInfo &TTI,
@@ -55,13 +60,14 @@ private:
   llvm::OptimizationRemarkEmitter &PassORE;
 
   bool enableDiagOutput;
+  unsigned numThreads; // RV_LOOPVEC_THREADS
   bool introduced;
 
   // cost estimation
   struct LoopScore {
     LoopScore(bool HasSIMDAnnotation = false)
         : Score(0), HasSIMDAnnotation(HasSIMDAnnotation) {}
-    unsigned Score;
+    unsigned Score; // estimated speedup in percent (see RegionCost::getScore)
     bool HasSIMDAnnotation;
   };
 
@@ -71,6 +77,16 @@ private:
     , VectorWidth(0)
     , DepDist(0)
     , TripAlign(0)
+    , FoldTail(false)
+    , EpilogueWidth(0)
+    , OverlapTail(false)
+    , AliasGuard(nullptr)
+    , LaneRefill(false)
+    , Interleave(1)
+    , PeelAccess(nullptr)
+    , StreamingStores(false)
+    , ChunkSize(0)
+    , Tuning(nullptr)
     {}
 
     llvm::BasicBlock *Header;
@@ -78,26 +94,121 @@ private:
 
     iter_t DepDist; // minimal dependence distance between loop iterations
     iter_t TripAlign; // multiple of loop trip count
+    bool FoldTail; // run the remainder as a masked vector iteration (no scalar loop)
+    unsigned EpilogueWidth; // vectorize the remainder loop at this width first (0 for none)
+    bool OverlapTail; // finish with a full vector iteration that overlaps the previous one (idempotent loops, no scalar remainder)
+
+    // pairs of accesses that may alias, the vector loop only runs if their
+    // address ranges do not overlap
+    std::vector<std::pair<llvm::Instruction *, llvm::Instruction *>> AliasChecks;
+    llvm::Value *AliasGuard; // runtime check result (once emitted)
+
+    // loop-invariant strides the vector loop speculates to be 1 (guarded by AliasGuard)
+    std::vector<llvm::Value *> StrideChecks;
+
+    bool LaneRefill; // restructure for lanes that pull new items (LaneRefillTransform)
+    unsigned Interleave; // copies of the vector body, each with its own reduction accumulators
+    llvm::Instruction *PeelAccess; // peel scalar iterations until this access is vector aligned (AlignPeelTransform)
+    bool StreamingStores; // write-only output streams use nontemporal stores (Config::enableStreamingStores)
+    uint64_t ChunkSize; // iterations per thread chunk (ParallelChunkTransform), 0 if the loop runs on one thread
+    const TuningEntry *Tuning; // RV_TUNING entry of the loop (if any)
+    std::vector<llvm::Metadata *> AccessGroups; // llvm.loop.parallel_accesses of the scalar loop (kept by the vector and remainder loop)
   };
 
   /// \return true if legal (in that case LJ&LS get populated)
   bool scoreLoop(LoopJob& LJ, LoopScore& LS, llvm::Loop & L);
 
+  /// derive the minimal dependence distance of L from DependenceInfo.
+  /// If \p AliasChecks is set, accesses to distinct objects that may alias are
+  /// recorded there instead of failing (they need a runtime check).
+  /// \return ParallelDistance if there are no loop-carried dependences, 1 if unknown
+  iter_t computeDependenceDistance(llvm::Loop & L, std::vector<std::pair<llvm::Instruction *, llvm::Instruction *>> * AliasChecks);
+
+  /// apply the LaneRefillTransform to the loop of \p LJ (moves LJ.Header to the lane loop)
+  bool prepareLaneRefill(LoopJob & LJ);
+
+  /// unroll and jam the parallel parent loop of the loop of \p LJ by RVConfig.tileRows,
+  /// so one vector iteration covers a tile of rows x VectorWidth elements.
+  /// \return true if the nest was tiled
+  bool prepareTiling(LoopJob & LJ);
+
+  /// collapse the perfect nest around (or of) the loop of \p LJ into one loop (LoopCollapseTransform)
+  /// if the level of LJ has too few iterations for the full width and both levels are parallel enough.
+  /// \return true if the nest was collapsed (LJ is the collapsed loop at its new width)
+  bool prepareCollapse(LoopJob & LJ);
+
+  /// wrap the loop of \p LJ in a loop over thread chunks of LJ.ChunkSize iterations (ParallelChunkTransform)
+  void prepareParallelChunks(LoopJob & LJ);
+
+  /// replace the (vectorized) chunk loops by calls to the task runtime
+  bool outlineParallelChunks();
+  std::vector<ChunkLoop> ChunkLoops;
+
+  /// peel the loop of \p LJ until LJ.PeelAccess is vector aligned (AlignPeelTransform)
+  void prepareAlignPeel(LoopJob & LJ);
+
+  /// emit the overlap checks of LJ.AliasChecks, the unit stride checks of LJ.StrideChecks
+  /// and the alignment check of LJ.PeelAccess before L
+  /// \return an i1 that is true iff all checked address ranges are disjoint, all strides are 1 and the peeled access is aligned
+  llvm::Value * emitAliasChecks(llvm::Loop & L, LoopJob & LJ);
+
+  /// run the VA on L (as is) and return the cost model estimate at \p VectorWidth.
+  /// With \p Masked, every block executes under a partial mask (tail folding).
+  /// \p Features receives the features for the profit model (RV_PROFIT_MODEL).
+  RegionCost computeLoopCost(llvm::Loop & L, unsigned VectorWidth, bool Masked,
+                             ProfitFeatures * Features = nullptr);
+
+  /// pick the cheapest way to run the remainder iterations of LJ: scalar
+  /// loop, folded tail or a narrower vector epilogue (sets FoldTail/EpilogueWidth)
+  void chooseRemainder(llvm::Loop & L, LoopJob & LJ);
+
+  /// pick the interleave factor of LJ (RV_INTERLEAVE or reduction latency
+  /// vs. body cost, sets Interleave)
+  void chooseInterleave(llvm::Loop & L, LoopJob & LJ);
+
+  /// decide whether LJ writes its output streams with nontemporal stores
+  /// (rv.loop.nontemporal or a write-only stream of RV_NONTEMPORAL_BYTES, sets StreamingStores)
+  void chooseStreamingStores(llvm::Loop & L, LoopJob & LJ);
+
+  /// decide whether LJ runs in thread chunks (RV_PARALLEL_CHUNKS or
+  /// rv.loop.parallel_chunks, sets ChunkSize to a multiple of the vector width)
+  void chooseParallelChunks(llvm::Loop & L, LoopJob & LJ);
+
+  /// pick the level of the nest of \p L (job \p LJ) to vectorize among the
+  /// legal \p InnerLevels by score and access shapes (contiguous vs strided)
+  LoopJob selectNestLevel(llvm::Loop & L, LoopJob & LJ, LoopScore & LS,
+                          std::vector<std::pair<LoopJob, LoopScore>> & InnerLevels);
+
+  /// insert vector scan loops before all search loops (SearchLoopTransform)
+  bool vectorizeSearchLoops();
+
   // Step 1: Decide which loops to vectorize.
   // Step 2: Prepare all loops for vectorization.
   // Step 3: Vectorize the regions.
   bool collectLoopJobs(llvm::LoopInfo & LI);
   std::vector<LoopJob> LoopsToPrepare;
   bool prepareLoopVectorization(); // TODO mark this function as un-vectorizable (or prepare a holdout copy)
+  bool prepareLoopJob(LoopJob & LJ);
 
   struct LoopVectorizerJob {
     LoopJob LJ;
     ValueSet uniOverrides;
     llvm::Value *EntryAVL; // loop entry AVL (FIXME)
+    llvm::Value *TailMask; // entry mask of tail-folded loops
   };
   std::vector<LoopVectorizerJob> LoopsToVectorize;
   bool vectorizeLoopRegions();
   bool vectorizeLoop(LoopVectorizerJob& LVJob);
+  /// emit the remark and decision record of the prepared loop of \p LVJob
+  void reportVectorized(LoopVectorizerJob& LVJob);
+
+  /// outline the prepared loops into functions, vectorize these in worker
+  /// threads (private LLVMContexts) and inline them back in job order.
+  /// Loops that cannot be outlined are vectorized in place.
+  bool vectorizeLoopRegionsParallel();
+
+  /// set up the resolver chain of \p platInfo according to RVConfig
+  void addResolvers(PlatformInfo & platInfo);
 
   PassManagerSession PMS;
   std::unique_ptr<VectorizerInterface> vectorizer;
@@ -107,13 +218,18 @@ private:
 
   // convert L into a vectorizable loop
   // this will create a new scalar loop that can be vectorized directly with RV
-  PreparedLoop transformToVectorizableLoop(llvm::Loop &L, int VectorWidth, int tripAlign, ValueSet & uniformOverrides);
+  // (guarded by runtime alias checks, if LJ has any)
+  PreparedLoop transformToVectorizableLoop(llvm::Loop &L, LoopJob & LJ, ValueSet & uniformOverrides);
 
   bool canAdjustTripCount(llvm::Loop &L, int VectorWidth, int TripCount);
 
   // return the trip count of L if it is constant. Otw, returns -1
   int getTripCount(llvm::Loop &L);
 
+  // the expected trip count of L without a constant one: trips= of its tuning entry or the estimate of the PGO
+  // branch weights (Config::enableProfileTrips). Otw, returns -1
+  int getProfiledTripCount(llvm::Loop &L, const LoopJob &LJ);
+
   // the trip count of the loop is always a multiple of this value
   // returns 1 for loop w/o known alignment
   int getTripAlignment(llvm::Loop & L);
@@ -14,11 +14,19 @@
 #include "llvm/Analysis/LoopAnalysisManager.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
 
+#include <memory>
+
+namespace llvm {
+  class Module;
+  class TargetMachine;
+}
+
 namespace rv {
 
 class PassManagerSession {
 public:
-  PassManagerSession();
+  // \p TM provides the target analyses (TTI), generic ones if nullptr
+  PassManagerSession(llvm::TargetMachine *TM = nullptr);
 
   llvm::FunctionAnalysisManager FAM;
   llvm::LoopAnalysisManager LAM;
@@ -26,6 +34,10 @@ public:
   llvm::ModuleAnalysisManager MAM;
 };
 
+// A target machine for the target triple of \p M (the subtarget of a function follows its
+// target-cpu and target-features), nullptr if the target is not registered in this process.
+std::unique_ptr<llvm::TargetMachine> CreateTargetMachine(const llvm::Module & M);
+
 }
 
 #endif // RV_PASSES_PASSMANAGERSESSION_H
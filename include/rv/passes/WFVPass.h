@@ -12,17 +12,24 @@
 
 #include "llvm/Pass.h"
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseSet.h"
 
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include "rv/transform/remTransform.h"
 #include "rv/passes/PassManagerSession.h"
 #include "rv/config.h"
+#include "rv/vectorCache.h"
+#include "rv/vectorizationInfo.h"
 #include "rv/analysis/reductionAnalysis.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 #include "rv/legacy/passes.h"
 
 #include <limits>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace llvm {
@@ -44,21 +51,64 @@ struct VectorMapping;
 class VectorizerInterface;
 
 class WFV {
-  PassManagerSession PMS;
+  std::unique_ptr<llvm::TargetMachine> TM; // target analyses of the module (generic ones if nullptr)
+  std::unique_ptr<PassManagerSession> PMS;
 
   bool enableDiagOutput; // WFV_DIAG
+  bool exportVariants; // (Thin)LTO: keep the vector functions alive through the link
+  unsigned numThreads; // RV_WFV_THREADS
+  bool streaming; // RV_STREAMING: bottom-up job order, analyses and vector math modules are released eagerly
+  std::vector<std::string> multiVersionArchs; // RV_MULTIVERSION
+  bool shareShapes; // RV_NO_SHARED_VA: jobs of the same scalar function and signature re-use a width-independent VA result
+  bool inPlaceLastJob; // RV_NO_INPLACE_WFV: the last job of an unreferenced local function vectorizes it without a copy
+  std::string dispatchMode; // RV_WFV_DISPATCH: emit <name>_dispatch loops over the variants ("parallel" for the task runtime)
 
   std::vector<VectorMapping> wfvJobs;
 
+  // width-independent VA results by GetSharedShapesKey (for the jobs of one configuration)
+  std::map<std::string, VectorizationInfo::Snapshot> sharedShapes;
+
+  VectorCache cache; // RV_CACHE_DIR
+  llvm::StringSet<> inheritedDefs; // definitions in the module before vectorization
+
   /// collect all stray Vector Function ABI strings in the attributes of \p F.
   void collectJobs(llvm::Function &F);
 
   /// generate the Vector Function ABI variant encoded in \p wfvJob.
+  /// \p shareAnalysis: \p vectorizer runs the configuration of sharedShapes.
+  /// \p inPlace: transform the scalar function itself instead of a copy, the
+  /// caller erases it afterwards.
   void vectorizeFunction(VectorizerInterface &vectorizer,
-                         VectorMapping &wfvJob);
+                         VectorMapping &wfvJob, bool shareAnalysis,
+                         bool inPlace);
+
+  /// use the target machine of \p M for the target analyses.
+  void initTarget(llvm::Module &M);
+
+  /// vectorize the jobs with indices \p jobIds in \p M (the mappings of all
+  /// jobs are available for recursive vectorization).
+  /// \p jobReports: keep the reports of each job in (*jobReports)[jobIdx].
+  void vectorizeJobs(llvm::Module &M, llvm::ArrayRef<size_t> jobIds,
+                     std::vector<std::string> *jobReports = nullptr);
+
+  /// order \p jobIds bottom-up in the call graph of \p M (callees first).
+  void sortJobsBottomUp(llvm::Module &M, std::vector<size_t> &jobIds) const;
+
+  /// distribute the jobs over worker threads, each owning a private
+  /// LLVMContext and copy of \p M. Merges the results back into \p M.
+  void runParallel(llvm::Module &M);
+
+  /// emit a clone of every vector function for each of multiVersionArchs and
+  /// replace the vector function by an ifunc that picks the best supported
+  /// clone at load time (the original vector function is the fallback).
+  void emitMultiVersions(llvm::Module &M);
+
+  /// emit a dispatch wrapper for every scalar function of wfvJobs, calling its
+  /// widest unmasked and masked variants of matching argument shapes.
+  void emitDispatchWrappers();
 
 public:
-  WFV();
+  WFV(bool exportVariants = false);
   bool run(llvm::Module &);
 };
 
@@ -73,8 +123,11 @@ public:
 };
 
 struct WFVWrapperPass : llvm::PassInfoMixin<WFVWrapperPass> {
+  bool exportVariants;
 public:
-  WFVWrapperPass();
+  // \p exportVariants: the module is compiled for (Thin)LTO, callers in other modules may
+  // reference the vector functions only after cross-module import.
+  WFVWrapperPass(bool exportVariants = false);
   llvm::PreservedAnalyses run(llvm::Module &M,
                               llvm::ModuleAnalysisManager &MAM);
 };
@@ -0,0 +1,46 @@
+//===- rv/passes/cleanupPass.h - cleanup of the functions RV changed --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// VectorizerInterface::vectorize tags the functions it generates code in
+// (the vector function of WFV, the host function of an outer loop). The
+// cleanup pass runs InstCombine, EarlyCSE, DCE and SimplifyCFG (and the
+// IRPolisher with RV_ENABLE_POLISH) on the tagged functions only and drops
+// the tag. Untouched functions of the module are not visited.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_PASSES_CLEANUPPASS_H
+#define RV_PASSES_CLEANUPPASS_H
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+  class Function;
+  class Module;
+}
+
+namespace rv {
+
+// tag @F for the cleanup pass
+void MarkForCleanup(llvm::Function & F);
+
+// whether @F has been changed by RV since the last cleanup
+bool IsMarkedForCleanup(const llvm::Function & F);
+
+class CleanupWrapperPass : public llvm::PassInfoMixin<CleanupWrapperPass> {
+public:
+  CleanupWrapperPass();
+
+  static llvm::StringRef name() { return "rv::CleanupWrapperPass"; }
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+};
+
+} // namespace rv
+
+#endif // RV_PASSES_CLEANUPPASS_H
@@ -29,6 +29,10 @@ namespace rv {
 // so the IR polisher tries to replace these by vectors of
 // i32/i64 instead. Note that this requires SSE41/AVX2 for
 // the integer vector instructions.
+// With AVX-512, <n x i1> values live in mask registers: the
+// polisher keeps them (the backend folds compares and masks
+// into masked instructions) and only lowers the boolean
+// reductions to mask register tests (kortest).
 class IRPolisher {
   llvm::Function &F;
   llvm::Type* boolVector;
@@ -67,6 +71,7 @@ class IRPolisher {
 
   llvm::Value *mapIntrinsicCall(llvm::IRBuilder<>&, llvm::CallInst*, unsigned);
   llvm::Value *lowerIntrinsicCall(llvm::CallInst*);
+  llvm::Value *lowerHalfConversion(llvm::CastInst*);
 
   llvm::Value *replaceCmpInst(llvm::IRBuilder<>&, llvm::CmpInst*, unsigned);
   llvm::Value *replaceSelectInst(llvm::IRBuilder<>&, llvm::SelectInst*, unsigned);
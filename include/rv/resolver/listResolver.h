@@ -39,7 +39,7 @@ class ListResolver : public ResolverService {
 
 public:
   ListResolver(llvm::Module & destModule)
-  : destModule(destModule)
+  : destModule(&destModule)
   {}
 
   ~ListResolver();
@@ -59,10 +59,12 @@ public:
 
   void print(llvm::raw_ostream & out) const override;
 
+  void resetModule(llvm::Module & newModule) override;
+
   std::unique_ptr<FunctionResolver> resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredication, llvm::Module & destModule) override;
 
 private:
-  llvm::Module & destModule;
+  llvm::Module * destModule;
   VectorFuncMap funcMappings;
 };
 
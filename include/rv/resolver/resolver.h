@@ -25,13 +25,17 @@ namespace llvm {
 
 namespace rv {
 
-// represents an abstract notion of cost associated with a function.
+// estimated cost of a call in reciprocal throughput units (TTI::TCK_RecipThroughput, like RegionCost).
 struct
 FunctionCost {
-  size_t cost;
+  double cost; // negative if unknown
+
+  static FunctionCost Unknown() { return FunctionCost{-1.0}; }
+  bool isKnown() const { return cost >= 0.0; }
 };
 
 
+
 // Represents a way to vectorize a function.
 //
 // Provides access to a cost esimate, the result value shape and the vectorized function.
@@ -39,6 +43,8 @@ class
 FunctionResolver {
 protected:
   llvm::Module & targetModule;
+  FunctionCost vectorCost;
+  FunctionCost replicationCost;
 
 public:
   virtual ~FunctionResolver();
@@ -47,10 +53,21 @@ public:
 
   FunctionResolver(llvm::Module & _targetModule)
   : targetModule(_targetModule)
+  , vectorCost(FunctionCost::Unknown())
+  , replicationCost(FunctionCost::Unknown())
   {}
 
-  // return a cost estimate for this function.
-  virtual FunctionCost requestCostEstimate() { return FunctionCost{1}; }
+  // set by the resolver service (PlatformInfo::getResolver picks the cheapest resolver)
+  void setCostEstimates(FunctionCost _vectorCost, FunctionCost _replicationCost) {
+    vectorCost = _vectorCost;
+    replicationCost = _replicationCost;
+  }
+
+  // return a cost estimate for one call of the vector function (Unknown if the resolver cannot tell).
+  virtual FunctionCost requestCostEstimate() { return vectorCost; }
+
+  // the cost of vectorWidth calls of the scalar function instead (Unknown if the resolver cannot tell).
+  virtual FunctionCost requestReplicationCostEstimate() { return replicationCost; }
 
   // materialized the vectorized function in the module @insertInto and returns a reference to it.
   virtual llvm::Function& requestVectorized() = 0;
@@ -65,6 +82,16 @@ public:
   virtual VectorShape requestResultShape() = 0;
 };
 
+// set the estimated costs of \p resolver for a call of the math function \p funcName (libm name or llvm.<func>
+// intrinsic) of type \p scaFuncTy on \p vectorWidth lanes: one SLEEF/libmvec/SVML call per \p registerBits bit
+// register against vectorWidth scalar libm calls. Measurements of the implementation \p impl (xsinf_u35) on \p isa
+// (the SLEEF arch suffix) take precedence: mathCosts.gen.inc and "<isa> <impl> <scalar> <vector> <max ulp>" lines
+// of RV_MATH_COSTS=<file> in cycles per element (tools/rv-mathbench.py). Otherwise the built-in reference costs
+// are rough reciprocal throughputs, "<func> <scalar call> <vector call on one register>" lines replace them.
+// Leaves the costs unknown for other functions.
+void SetMathCallCosts(FunctionResolver & resolver, llvm::StringRef funcName, const llvm::FunctionType & scaFuncTy,
+                      int vectorWidth, unsigned registerBits, llvm::StringRef isa = "", llvm::StringRef impl = "");
+
 // abstract function resolver interface
 class
 ResolverService {
@@ -72,6 +99,16 @@ public:
   virtual ~ResolverService();
   virtual std::unique_ptr<FunctionResolver> resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) = 0;
 
+  // resolve for a call site that requires an accuracy of \p maxULPError (tenth of ULP, -1 if unspecified).
+  // Services whose implementations do not trade accuracy for speed ignore the bound.
+  virtual std::unique_ptr<FunctionResolver> resolveWithAccuracy(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, int maxULPError, llvm::Module & destModule) {
+    (void) maxULPError;
+    return resolve(funcName, scaFuncTy, argShapes, vectorWidth, hasPredicate, destModule);
+  }
+
+  // the platform was attached to \p newModule: drop all state about the previous module.
+  virtual void resetModule(llvm::Module & newModule) { (void) newModule; }
+
   void dump() const;
   virtual void print(llvm::raw_ostream & out) const;
 };
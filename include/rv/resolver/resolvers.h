@@ -12,10 +12,44 @@
 #include "rv/config.h"
 #include "rv/PlatformInfo.h"
 
+#include <memory>
+
+namespace llvm {
+  class Function;
+  class LLVMContext;
+  class Module;
+}
+
 namespace rv {
   // Use the SLEEF library to implement math functions.
   void addSleefResolver(const Config & config, PlatformInfo & platInfo);
 
+  // The vector math modules parsed into one LLVMContext.
+  struct VecmathModules;
+
+  // The SLEEF resolver keeps the vector math modules of its context loaded while it lives.
+  // The handle keeps them loaded across resolvers (e.g. the jobs of a worker). Destroy it before \p Ctx.
+  std::shared_ptr<VecmathModules> retainSleefModules(llvm::LLVMContext & Ctx);
+
+  // Forget the modules of \p Ctx in the process-wide registry (they are freed with their last owner).
+  void releaseSleefModules(llvm::LLVMContext & Ctx);
+
+  // The lazily loaded compiler-rt module of \p Ctx (nullptr without RV_ENABLE_CRT).
+  // Shares the ownership of the SLEEF modules of \p Ctx.
+  std::shared_ptr<llvm::Module> requestCompilerRTModule(llvm::LLVMContext & Ctx);
+
+  // Replace SLEEF sin and cos calls on the same vector operand (and the same
+  // ISA and ULP bound) in \p vecFunc by one call to SLEEF's sincos.
+  bool FuseSleefSinCos(llvm::Function & vecFunc);
+
+  // Declare the vector variants of an external vector math library (Config::vecLib, RV_VECLIB).
+  // Takes precedence over SLEEF if added first.
+  void addVectorLibraryResolver(const Config & config, PlatformInfo & platInfo);
+
+  // Call the batch API (fn_batch(n, in.., out)) of external functions without a vector variant once for all active
+  // lanes ("rv-batch" attribute or Config::batchMapPath, RV_BATCH_MAP).
+  void addBatchResolver(const Config & config, PlatformInfo & platInfo);
+
   // Vectorize functions that are declares with "pragma omp declare simd".
   void addOpenMPResolver(const Config & config, PlatformInfo & platInfo);
 
@@ -60,6 +60,15 @@ public:
     void analyze(VectorizationInfo& vecInfo,
                  llvm::FunctionAnalysisManager &FAM);
 
+    //
+    // Update a prior analysis after the scalar function was transformed.
+    // Only re-computes the shapes of @updateList (new and modified instructions),
+    // in-region instructions without a shape and everything that depends on them.
+    //
+    void updateAnalysis(VectorizationInfo& vecInfo,
+                        llvm::FunctionAnalysisManager &FAM,
+                        const std::vector<const llvm::Instruction*> & updateList);
+
 
     //
     // Linearize divergent regions of the scalar function to preserve semantics for the
@@ -88,9 +97,22 @@ public:
 
     const Config & getConfig() const { return config; }
 
+    // instructions of the vectorized region over those of the scalar region after the last phase of the current job
+    double getCodeGrowth() const { return codeGrowth; }
+
 private:
     Config config;
     PlatformInfo & platInfo;
+
+    // code growth of the current job (reset by linearize)
+    size_t scalarRegionSize;  // scalar region before linearize
+    size_t outsideRegionSize; // rest of the scalar function
+    double codeGrowth;
+    bool laneLoopFallback;    // NatBuilder replicates in loops over the lanes
+    bool profitGathers;       // gather/scatter intrinsics (false if the profit model predicts per-lane accesses to be faster)
+
+    // measure the code growth after @phase and report when it exceeds Config::codeGrowthBudget
+    bool exceedsGrowthBudget(VectorizationInfo & vecInfo, const char * phase, bool vectorized);
 };
 
 
@@ -28,36 +28,61 @@ using stride_t = int64_t;
 namespace rv {
 
 // describes how the contents of a vector vary with the vectorized dimension
+//
+// Packed into 64 bits (shapes are copied by value everywhere):
+//   bit 0       defined
+//   bit 1       hasConstantStride
+//   bits 2-31   alignment
+//   bits 32-63  stride (signed)
+// General alignment if not hasConstantStride, else alignment of first.
+// The encoding is canonical: the undef shape is all zero, varying shapes have a zero stride field.
+// Strides beyond 32 bits fall back to varying shapes, alignments beyond 30 bits to a divisor.
 class VectorShape {
-  stride_t stride;
-  bool hasConstantStride;
-  align_t alignment; // NOTE: General alignment if not hasConstantStride, else alignment of first
-  bool defined;
+  uint64_t bits;
+
+  static constexpr uint64_t DefinedBit = 1;
+  static constexpr uint64_t StridedBit = 2;
+  static constexpr unsigned AlignShift = 2;
+  static constexpr uint64_t AlignMask = (1ull << 30) - 1;
+  static constexpr unsigned StrideShift = 32;
+  static constexpr uint64_t KindAndStrideMask = ~(AlignMask << AlignShift);
+
+  static uint64_t encodeAlignment(align_t alignment);
+  static constexpr uint64_t encodeStrided(int32_t stride) {
+    return (uint64_t(uint32_t(stride)) << StrideShift) | StridedBit | DefinedBit;
+  }
+  static bool fitsStride(stride_t stride) { return stride == (stride_t) (int32_t) stride; }
 
   VectorShape(align_t _alignment);              // varying
   VectorShape(stride_t _stride, align_t _alignment); // strided
 
 public:
-  VectorShape(); // undef
+  VectorShape() : bits(0) {} // undef
 
-  bool isDefined() const { return defined; }
-  stride_t getStride() const { return stride; }
-  align_t getAlignmentFirst() const { return alignment; }
+  bool isDefined() const { return bits & DefinedBit; }
+  stride_t getStride() const { return (int32_t) (uint32_t) (bits >> StrideShift); }
+  align_t getAlignmentFirst() const { return (bits >> AlignShift) & AlignMask; }
 
   // The maximum common alignment for every possible entry (<6, 8, 10, ...> -> 2)
   align_t getAlignmentGeneral() const;
 
-  void setAlignment(align_t newAlignment) { alignment = newAlignment; }
-  void setStride(stride_t newStride) { hasConstantStride = true; stride = newStride; }
-  void setVarying(align_t newAlignment) { hasConstantStride = false; alignment = newAlignment; }
+  // undef stays all zero (its alignment is meaningless)
+  void setAlignment(align_t newAlignment) {
+    if (!isDefined()) return;
+    bits = (bits & KindAndStrideMask) | encodeAlignment(newAlignment);
+  }
+  void setStride(stride_t newStride) { *this = strided(newStride, getAlignmentFirst()); }
+  void setVarying(align_t newAlignment) { *this = varying(newAlignment); }
 
-  bool isVarying() const { return defined && !hasConstantStride; }
-  bool hasStridedShape() const { return defined && hasConstantStride; }
-  bool isStrided(stride_t ofStride) const { return hasStridedShape() && stride == ofStride; }
-  bool isStrided() const { return hasStridedShape() && stride != 0 && stride != 1; }
-  bool isUniform() const { return isStrided(0); }
+  bool isVarying() const { return (bits & (DefinedBit | StridedBit)) == DefinedBit; }
+  bool hasStridedShape() const { return bits & StridedBit; }
+  bool isStrided(stride_t ofStride) const {
+    return fitsStride(ofStride) && (bits & KindAndStrideMask) == encodeStrided(ofStride);
+  }
+  bool isStrided() const { return hasStridedShape() && !isUniform() && !isContiguous(); }
+  bool isUniform() const { return (bits & KindAndStrideMask) == encodeStrided(0); }
   bool greaterThanUniform() const { return !isUniform() && isDefined(); }
-  inline bool isContiguous() const { return isStrided(1); }
+  inline bool isContiguous() const { return (bits & KindAndStrideMask) == encodeStrided(1); }
 
   static VectorShape varying(align_t aligned = 1) { return VectorShape(aligned); }
   static VectorShape strided(stride_t stride, align_t aligned = 1) { return VectorShape(stride, aligned); }
@@ -69,8 +94,10 @@ public:
 
   static VectorShape join(VectorShape a, VectorShape b);
 
-  bool operator==(const VectorShape &a) const;
-  bool operator!=(const VectorShape &a) const;
+  bool operator==(const VectorShape &a) const { return bits == a.bits; }
+  bool operator!=(const VectorShape &a) const { return bits != a.bits; }
+  // the canonical encoding (equal shapes have equal keys)
+  uint64_t getKey() const { return bits; }
   VectorShape operator/(int64_t D) const;
 
   // lattice order
@@ -100,6 +127,12 @@ public:
 };
 
 typedef std::vector<VectorShape> VectorShapeVec;
+
+// hash-consed shape vectors (eg the argument shapes of a call signature).
+// Equal vectors are interned to the same object, so signatures compare and hash by pointer.
+// Interned vectors live until the end of the process.
+using ShapeSignature = const VectorShapeVec *;
+ShapeSignature InternShapes(const VectorShapeVec & shapes);
 }
 
 #endif /* INCLUDE_RV_VECTORSHAPE_H_ */
@@ -14,11 +14,14 @@
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Value.h>
 #include <llvm/Analysis/LoopInfo.h>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallVector.h>
 
 
 namespace rv {
   using SmallValVec = llvm::SmallVector<const llvm::Value*, 2>;
+  // pointer alignments stated in the source (assumptions, aligned allocations)
+  using AlignmentFacts = llvm::DenseMap<const llvm::Value*, align_t>;
   class VectorizationInfo;
   class PlatformInfo;
 
@@ -27,6 +30,7 @@ namespace rv {
     const llvm::LoopInfo & LI;
     PlatformInfo & platInfo;
     const VectorizationInfo & vecInfo;
+    const AlignmentFacts * alignFacts;
     VectorShape getObservedShape(const llvm::BasicBlock & observerBlock, const llvm::Value & val) const;
 
     VectorShape
@@ -50,11 +54,12 @@ namespace rv {
     computeShapeForPHINode(const llvm::PHINode &Phi) const;
 
   public:
-    VectorShapeTransformer(const llvm::DataLayout & DL, const llvm::LoopInfo & _LI, PlatformInfo & _platInfo, const VectorizationInfo & _vecInfo)
+    VectorShapeTransformer(const llvm::DataLayout & DL, const llvm::LoopInfo & _LI, PlatformInfo & _platInfo, const VectorizationInfo & _vecInfo, const AlignmentFacts * _alignFacts = nullptr)
     : DL(DL)
     , LI(_LI)
     , platInfo(_platInfo)
     , vecInfo(_vecInfo)
+    , alignFacts(_alignFacts)
     {}
 
     // This calls computeIdealShapeForInst internally and adjusts the result
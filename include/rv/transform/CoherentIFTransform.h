@@ -28,6 +28,7 @@ namespace llvm {
 
 namespace rv {
 
+class LaneProfile;
 class MaskExpander;
 class VectorizationInfo;
 
@@ -39,9 +40,10 @@ class CoherentIFTransform {
   llvm::PostDominatorTree & postDomTree;
   llvm::LoopInfo & loopInfo;
   llvm::BranchProbabilityInfo * pbInfo;
+  const LaneProfile * laneProfile;
 
 public:
-  CoherentIFTransform(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, llvm::FunctionAnalysisManager &FAM);
+  CoherentIFTransform(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, llvm::FunctionAnalysisManager &FAM, const LaneProfile * _laneProfile = nullptr);
 
   bool run();
 };
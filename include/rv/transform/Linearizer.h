@@ -23,6 +23,7 @@
 
 #include <llvm/IR/Dominators.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/ADT/BitVector.h>
 #include <llvm/ADT/DenseSet.h>
 #include <llvm/IR/Function.h>
 #include "llvm/IR/PassManager.h"
@@ -54,11 +55,19 @@ namespace rv {
   // internal helper class for partially folded incoming blocks of PHI nodes
   class SuperInput;
 
+  // incoming values of a phi node by incoming block (built once per phi, PHINode::getIncomingValueForBlock is linear)
+  typedef llvm::DenseMap<const llvm::BasicBlock *, llvm::Value *> IncomingValueMap;
+
   class Linearizer {
 
   // block index helper
   void scheduleLoop(llvm::Loop * loop, std::string padStr, RPOT::rpo_iterator itStart, RPOT::rpo_iterator itEnd);
   void scheduleDomRegion(llvm::BasicBlock * domEntry, llvm::Loop * loop, std::string padStr, RPOT::rpo_iterator itStart, RPOT::rpo_iterator itEnd);
+  // re-order the idom children of @domEntry in @loop to keep few vector values live (RV_SCHED_PRESSURE)
+  void orderByPressure(llvm::BasicBlock & domEntry, llvm::Loop * loop, llvm::SmallVectorImpl<RPOT::rpo_iterator> & children) const;
+  // estimated maximal number of simultaneously live vector values along the block index
+  size_t estimateMaxLive() const;
+  bool usePressureSched;
 
   // statistics
       // preserved control-unifowm phi ndoes
@@ -105,8 +114,8 @@ namespace rv {
       // do phi nodes in this block need to be folded?
       bool needsPhiFolding;
 
-      // a set of some blocks that will reach this block
-      llvm::SmallPtrSet<llvm::BasicBlock*, 4> reachingBlocks;
+      // a set of some blocks that will reach this block (bits by block index)
+      llvm::BitVector reachingBlocks;
 
       RelayNode(llvm::BasicBlock & _head, int _id)
       : head(_head)
@@ -122,8 +131,13 @@ namespace rv {
         return next == nullptr;
       }
 
-      void addReachingBlock(llvm::BasicBlock & reachingBlock) {
-        reachingBlocks.insert(&reachingBlock);
+      void addReachingBlock(int blockId) {
+        if ((int) reachingBlocks.size() <= blockId) reachingBlocks.resize(blockId + 1);
+        reachingBlocks.set(blockId);
+      }
+
+      bool isReachedBy(int blockId) const {
+        return blockId < (int) reachingBlocks.size() && reachingBlocks.test(blockId);
       }
 
       void enable(llvm::BasicBlock & relayBlock, RelayNode * _tail) {
@@ -172,12 +186,12 @@ namespace rv {
       }
 
       // dump all reaching blocks
-      if (!relay->reachingBlocks.empty()) {
+      if (relay->reachingBlocks.any()) {
         bool first = true;
         llvm::errs() << " reaching [";
-        for (auto * reachBlock : relay->reachingBlocks) {
+        for (int reachId : relay->reachingBlocks.set_bits()) {
           if (!first) llvm::errs() << ", ";
-          llvm::errs() << reachBlock->getName();
+          llvm::errs() << getBlock(reachId).getName();
           first = false;
         }
         llvm::errs() << "] ";
@@ -213,25 +227,28 @@ namespace rv {
       return nextRelay;
     }
 
-    // relay chain merging
+    // relay chain merging (both chains are sorted by block index, shared nodes are merged)
     RelayNode * mergeRelays(RelayNode * a, RelayNode * b) {
-      if (a->id < b->id) {
+      if (a->id > b->id) std::swap(a, b);
+      RelayNode * head = a;
+
+      // interleave b into the tail of a
+      while (b && a != b) {
+        assert(a->id < b->id);
         if (!a->next) {
           // we reached the tail of a
           a->next = b;
-
-        } else {
-          // we need to interleave here
-          auto * tailHead = mergeRelays(a->next, b);
-          a->next = tailHead;
+          break;
+        }
+        if (a->next->id > b->id) {
+          RelayNode * rest = a->next;
+          a->next = b;
+          b = rest;
         }
-      } else if (a->id > b->id) {
-        return mergeRelays(b, a);
-      } else {
-        // return a;
+        a = a->next;
       }
 
-      return a;
+      return head;
     }
 
     // merges the chain starting at @targetId into the chain defined by @headRelay
@@ -324,7 +341,7 @@ namespace rv {
     /// \brief promotes a definition from @defBlockId to @blockId (returns intermediate definitions on the interval between @defBlockId an @destBlockID
     llvm::Value & promoteDefinitionExt(llvm::SmallVector<llvm::Value*, 16> & defs, llvm::Value & inst, llvm::Value & defaultDef, int defBlockId, int destBlockId);
 
-    llvm::Value * createSuperInput(llvm::PHINode & phi, SuperInput & superInput);
+    llvm::Value * createSuperInput(llvm::PHINode & phi, const IncomingValueMap & inValues, SuperInput & superInput);
 
   // analysis structures
   protected:
@@ -0,0 +1,63 @@
+//===- rv/transform/alignPeelTrans.h - peel iterations until an access is aligned --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Alignment peeling for the loop vectorizer (RV_ALIGN_PEEL).
+// A scalar copy of the loop runs the first
+//
+//   P = ((-ptr) mod (vectorWidth * elemSize)) / elemSize
+//
+// iterations of the loop, so the remaining iterations start at a
+// vector-aligned address of the peeled access. The loop itself is left in
+// place (its header phis start from the values of the peel loop).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_ALIGNPEELTRANS_H
+#define RV_TRANSFORM_ALIGNPEELTRANS_H
+
+namespace llvm {
+  class BasicBlock;
+  class DominatorTree;
+  class Function;
+  class Instruction;
+  class Loop;
+  class LoopInfo;
+  class ScalarEvolution;
+}
+
+namespace rv {
+
+class AlignPeelTransform {
+  llvm::Function & F;
+  llvm::DominatorTree & DT;
+  llvm::LoopInfo & LI;
+  llvm::ScalarEvolution & SE;
+  unsigned vectorWidth;
+
+public:
+  AlignPeelTransform(llvm::Function & _F, llvm::DominatorTree & _DT, llvm::LoopInfo & _LI, llvm::ScalarEvolution & _SE, unsigned _vectorWidth)
+  : F(_F)
+  , DT(_DT)
+  , LI(_LI)
+  , SE(_SE)
+  , vectorWidth(_vectorWidth)
+  {}
+
+  // the contiguous access of \p L that is worth aligning (stores first).
+  // nullptr if \p L is not supported or all contiguous accesses are known to be aligned.
+  llvm::Instruction * getPeelAccess(llvm::Loop & L) const;
+
+  // peel the leading iterations of \p L until \p access is vector aligned.
+  // Returns the header of the peel loop.
+  // LoopInfo, DominatorTree and ScalarEvolution are invalid afterwards.
+  llvm::BasicBlock * run(llvm::Loop & L, llvm::Instruction & access);
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_ALIGNPEELTRANS_H
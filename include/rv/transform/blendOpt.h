@@ -0,0 +1,69 @@
+//===- rv/transform/blendOpt.h - simplify blends after linearization --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Blend (select) optimization on the linearized region (RV_NO_BLENDOPT):
+// - chains:   select(m1, a, select(m2, a, b))  ->  select(m1 || m2, a, b)
+//             select(m1, select(m2, a, b), b)  ->  select(m1 && m2, a, b)
+// - equal:    select(m, a, a') with a, a' identical side-effect free instructions -> a
+// - implied:  a varying select(m, a, b) in a block whose predicate implies m (!m) -> a (b)
+// - stores:   the stored select(m, a, b) in a block whose predicate implies m (!m) -> store a (b)
+//
+// Implication is decided by the mask structure (MaskExpander::implies).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_BLENDOPT_H
+#define RV_TRANSFORM_BLENDOPT_H
+
+#include <cstddef>
+
+namespace llvm {
+  class SelectInst;
+  class StoreInst;
+  class Value;
+}
+
+namespace rv {
+
+class VectorizationInfo;
+class MaskExpander;
+
+class BlendOptimizer {
+  VectorizationInfo & vecInfo;
+  MaskExpander & maskEx;
+
+  size_t numMergedBlends;
+  size_t numEqualBlends;
+  size_t numImpliedBlends;
+  size_t numStoreBlends;
+
+  // whether the predicate of the block of @blend decides its condition (to @oValue)
+  bool isDecided(llvm::Value & pred, llvm::SelectInst & blend, llvm::Value *& oValue) const;
+
+  llvm::Value * mergeChain(llvm::SelectInst & blend);
+  llvm::Value * foldEqual(llvm::SelectInst & blend);
+  llvm::Value * foldImplied(llvm::SelectInst & blend);
+  bool sinkIntoStore(llvm::StoreInst & store);
+
+public:
+  BlendOptimizer(VectorizationInfo & _vecInfo, MaskExpander & _maskEx)
+  : vecInfo(_vecInfo)
+  , maskEx(_maskEx)
+  , numMergedBlends(0)
+  , numEqualBlends(0)
+  , numImpliedBlends(0)
+  , numStoreBlends(0)
+  {}
+
+  // returns the number of removed blends
+  size_t run();
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_BLENDOPT_H
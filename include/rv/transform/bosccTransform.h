@@ -28,6 +28,7 @@ namespace llvm {
 
 namespace rv {
 
+class LaneProfile;
 class MaskExpander;
 class VectorizationInfo;
 
@@ -39,9 +40,12 @@ class BOSCCTransform {
   llvm::PostDominatorTree & postDomTree;
   llvm::LoopInfo & loopInfo;
   llvm::BranchProbabilityInfo * pbInfo;
+  const LaneProfile * laneProfile;
+  bool heuristicBOSCC; // skip regions picked by BranchEstimate (or the lane profile)
+  bool earlyExits; // skip the remainder of the region next to early-out paths to a return
 
 public:
-  BOSCCTransform(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, llvm::FunctionAnalysisManager &FAM);
+  BOSCCTransform(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, llvm::FunctionAnalysisManager &FAM, const LaneProfile * _laneProfile = nullptr, bool _heuristicBOSCC = true, bool _earlyExits = false);
 
   bool run();
 };
@@ -18,6 +18,14 @@ namespace rv {
   // link the compiler-rt code for the specified complex arithmetic function @funcName with @funcTy into @insertInto
   llvm::Function *
   requestScalarImplementation(const llvm::StringRef & funcName, llvm::FunctionType & funcTy, llvm::Module &insertInto);
+
+  // replace the complex multiplication or division @call (__mulsc3, __muldc3, __divsc3, __divdc3) by inline
+  // straight-line code on the real and imaginary parts. The C99 Annex G NaN/Inf recovery is computed for all inputs
+  // and blended in, it is skipped if the call (or its function) is nnan and ninf. Returns false for other calls.
+  bool LowerComplexCall(llvm::CallInst & call);
+
+  // LowerComplexCall for all calls in @func, returns the number of lowered calls
+  unsigned LowerComplexArithmetic(llvm::Function & func);
 }
 
 
@@ -0,0 +1,58 @@
+//===- rv/transform/dispatchWrapper.h - SPMD dispatch loops for WFV variants --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Dispatch wrappers for the WFV variants of a function (RV_WFV_DISPATCH).
+// For foo(a, b) with a uniform, b varying and a varying result:
+//
+//   void foo_dispatch(i64 n, a, ptr b, ptr out)
+//     for (i = 0; i + W <= n; i += W)
+//       out[i:W] = foo_unmasked(a, b[i:W])
+//     if (i < n)
+//       out[i:W] = foo_masked(a, b[i:W], lane < n - i)   // masked loads and stores
+//
+// Uniform arguments are passed on, linear arguments are the value of item 0
+// (item i gets arg + i * stride), varying arguments are arrays of n elements
+// and a varying result goes to a trailing array argument. Full chunks call the
+// unmasked variant (the masked one with all lanes active if there is none),
+// the tail calls the masked variant (the scalar function per item if there is
+// none). The loop prefetches the varying inputs DispatchPrefetchChunks chunks
+// ahead.
+//
+// The parallel wrapper passes blocks of DispatchBlockChunks chunks as tasks
+// to the task runtime of include/rv-c/parallelFor.h (Config::parallelRuntime).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_DISPATCHWRAPPER_H
+#define RV_TRANSFORM_DISPATCHWRAPPER_H
+
+#include <llvm/ADT/StringRef.h>
+
+namespace llvm {
+  class Function;
+}
+
+namespace rv {
+
+struct VectorMapping;
+
+// W-lane chunks per runtime task of the parallel wrapper
+const unsigned DispatchBlockChunks = 64;
+// prefetch distance of the varying inputs in chunks
+const unsigned DispatchPrefetchChunks = 4;
+
+// Emit scalarFn_dispatch for the variants @unmaskedJob and @maskedJob (either may be nullptr, not both) of the
+// same scalar function, width and argument shapes. Returns nullptr if a varying argument or result is not a
+// scalar of an integer, floating-point or pointer type or the name is taken.
+llvm::Function *
+CreateDispatchWrapper(const VectorMapping * unmaskedJob, const VectorMapping * maskedJob, bool parallel,
+                      llvm::StringRef runtimeName);
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_DISPATCHWRAPPER_H
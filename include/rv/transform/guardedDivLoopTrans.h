@@ -36,6 +36,7 @@ using BlockSet = llvm::SmallPtrSet<llvm::BasicBlock*, 4>;
 
 class PlatformInfo;
 class LiveValueTracker;
+struct Config;
 
 
 struct GuardedTrackerDesc {
@@ -90,6 +91,18 @@ struct GuardedTransformSession {
   size_t numKillExits;
   size_t numDivExits;
 
+  // exit trackers are (uniform) i32 lane bitmasks updated by a ballot in the pure latch instead of varying masks.
+  // exitDescs then hold the bitmask phi (trackerPhi) and the mask of lanes leaving in this iteration (updatePhi)
+  bool exitBits;
+
+  // scalar tail: a scalar clone of the loop finishes the live lanes once fewer than scalarTailThreshold of them are left
+  unsigned scalarTailThreshold; // 0 if the loop has no scalar tail
+  llvm::BasicBlock * clonedHeader;
+  llvm::BasicBlock * cloneExit; // the only exit of the clone
+  llvm::SmallVector<llvm::BasicBlock*, 16> clonedBlocks;
+  llvm::SmallVector<std::pair<llvm::PHINode*, llvm::PHINode*>, 8> clonedHeaderPhis; // (header phi, its clone)
+  llvm::SmallVector<std::pair<llvm::Value*, llvm::PHINode*>, 4> clonedLiveOuts; // (live out, its LCSSA phi in cloneExit)
+
   GuardedTransformSession(llvm::Loop & _loop, llvm::LoopInfo & _loopInfo, VectorizationInfo & _vecInfo, PlatformInfo & _platInfo)
   : loop(_loop)
   , loopName(loop.getName().str())
@@ -103,6 +116,10 @@ struct GuardedTransformSession {
   , liveMaskDesc()
   , numKillExits(0)
   , numDivExits(0)
+  , exitBits(false)
+  , scalarTailThreshold(0)
+  , clonedHeader(nullptr)
+  , cloneExit(nullptr)
   {}
 
   // transform to a uniform loop
@@ -115,12 +132,20 @@ struct GuardedTransformSession {
   void finalizeLiveOutTracker(GuardedTrackerDesc & desc);
 
   llvm::BasicBlock & requestPureLatch();
+
+  // clone the loop for a scalar tail (before transformLoop)
+  void cloneScalarTail(unsigned threshold);
+
+  // leave the transformed loop for a loop over the live lanes that runs the scalar clone on each of them.
+  // The lanes write their live outs into the live out trackers (after transformLoop)
+  void attachScalarTail();
 };
 
 
 
 // actual transformation
 class GuardedDivLoopTrans {
+  Config & config;
   PlatformInfo & platInfo;
   VectorizationInfo & vecInfo;
   llvm::FunctionAnalysisManager & FAM;
@@ -133,6 +158,12 @@ class GuardedDivLoopTrans {
   // return true, if any loops were transformed
   bool transformDivergentLoopControl(llvm::LoopInfo & LI, llvm::Loop & loop);
 
+  // live lane count below which @loop switches to a scalar tail (0 if it should not or can not)
+  unsigned getScalarTailThreshold(llvm::Loop & loop) const;
+
+  // whether the exit trackers of @loop can be lane bitmasks
+  bool useExitBits(llvm::Loop & loop, unsigned tailThreshold) const;
+
   // this finalizes the control conversion on @loop
   // void convertToLatchExitLoop(llvm::Loop & loop, LiveValueTracker & liveOutTracker);
 
@@ -142,7 +173,7 @@ class GuardedDivLoopTrans {
 
   // replace this value update phi with a proper blend cascade
 public:
-  GuardedDivLoopTrans(PlatformInfo & _platInfo, VectorizationInfo & _vecInfo, llvm::FunctionAnalysisManager &FAM);
+  GuardedDivLoopTrans(Config & _config, PlatformInfo & _platInfo, VectorizationInfo & _vecInfo, llvm::FunctionAnalysisManager &FAM);
   ~GuardedDivLoopTrans();
 
   // makes all divergent loops in the region uniform
@@ -153,6 +184,8 @@ public:
   size_t numDivergentLoops;
   size_t numKillExits;
   size_t numDivExits;
+  size_t numScalarTails;
+  size_t numExitBitLoops;
 };
 
 }
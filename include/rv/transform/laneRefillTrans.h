@@ -0,0 +1,62 @@
+//===- rv/transform/laneRefillTrans.h - refill retired lanes of divergent inner loops --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Persistent-lane form for outer loops with a divergent inner loop (RV_LANE_REFILL).
+// The loop
+//
+//   for (k = 0; k < N; ++k) { pre(k); while (c) body; post(k); }
+//
+// becomes a loop over the vectorWidth lanes around a persistent loop that
+// runs one inner iteration per step. Lanes whose item finished pull the next
+// item of the shared queue (rv_ballot/rv_lane_id prefix sum) until all N
+// items are done. The result is only correct when vectorized at vectorWidth
+// (the lane loop must not run as a scalar loop).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_LANEREFILLTRANS_H
+#define RV_TRANSFORM_LANEREFILLTRANS_H
+
+#include <llvm/ADT/SmallVector.h>
+
+namespace llvm {
+  class BasicBlock;
+  class Function;
+  class Loop;
+  class ScalarEvolution;
+}
+
+namespace rv {
+
+class PlatformInfo;
+
+class LaneRefillTransform {
+  llvm::Function & F;
+  llvm::ScalarEvolution & SE;
+  PlatformInfo & platInfo;
+  unsigned vectorWidth;
+
+public:
+  LaneRefillTransform(llvm::Function & _F, llvm::ScalarEvolution & _SE, PlatformInfo & _platInfo, unsigned _vectorWidth)
+  : F(_F)
+  , SE(_SE)
+  , platInfo(_platInfo)
+  , vectorWidth(_vectorWidth)
+  {}
+
+  // whether \p L has the pre(k); inner loop; post(k) structure this transform supports.
+  bool canTransform(llvm::Loop & L) const;
+
+  // restructure \p L. Returns the header of the lane loop (trip count vectorWidth).
+  // LoopInfo, DominatorTree and ScalarEvolution are invalid afterwards.
+  llvm::BasicBlock * run(llvm::Loop & L);
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_LANEREFILLTRANS_H
@@ -0,0 +1,63 @@
+//===- rv/transform/loopCollapseTrans.h - collapse perfect loop nests --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Loop collapsing for the loop vectorizer (RV_LOOP_COLLAPSE).
+// The perfect nest
+//
+//   for (i = i0; ..; i += s) for (j = j0; ..; ++j) body(i, j);
+//
+// becomes one loop of N * M iterations (the trip counts of both loops, M
+// must not depend on i) over the body. The inner header phis have to be
+// inductions with constant steps. Each iteration recovers i and j from the
+// collapsed iteration number, so the lanes of a vector iteration are
+// independent of each other:
+//
+//   for (k = 0; k < N * M; ++k) {
+//     i = i0 + (k / M) * s;  j = j0 + (k % M) * t;
+//     body(i, j);
+//   }
+//
+// Side effect free instructions of the outer header move into the collapsed
+// body. Phis that carry a value through both loops (reductions over the nest)
+// keep updating from one run of the inner loop to the next.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_LOOPCOLLAPSETRANS_H
+#define RV_TRANSFORM_LOOPCOLLAPSETRANS_H
+
+namespace llvm {
+  class BasicBlock;
+  class Function;
+  class Loop;
+  class ScalarEvolution;
+}
+
+namespace rv {
+
+class LoopCollapseTransform {
+  llvm::Function & F;
+  llvm::ScalarEvolution & SE;
+
+public:
+  LoopCollapseTransform(llvm::Function & _F, llvm::ScalarEvolution & _SE)
+  : F(_F)
+  , SE(_SE)
+  {}
+
+  // whether \p OuterL is a perfect nest of two loops this transform supports.
+  bool canCollapse(llvm::Loop & OuterL) const;
+
+  // collapse the nest of \p OuterL. Returns the header of the collapsed loop (the former inner header).
+  // LoopInfo, DominatorTree and ScalarEvolution are invalid afterwards.
+  llvm::BasicBlock * run(llvm::Loop & OuterL);
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_LOOPCOLLAPSETRANS_H
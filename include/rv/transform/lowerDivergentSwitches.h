@@ -6,6 +6,15 @@
 //
 //===----------------------------------------------------------------------===//
 //
+// Divergent switches become a cascade of compare-and-branch blocks, after
+// linearization every case body runs under its mask.
+// Switches with many cases are instead lowered to a dispatch loop
+// (RV_NO_SWITCH_DISPATCH to disable): every lane numbers its target block
+// (one select per case), each iteration picks the target of the first pending
+// lane, runs it for all lanes that share it through a uniform switch and
+// retires those lanes. The loop takes at most one iteration per target.
+//
+//===----------------------------------------------------------------------===//
 
 #ifndef RV_TRANSFORM_LOWERDIVERGENTSWITCHES_H
 #define RV_TRANSFORM_LOWERDIVERGENTSWITCHES_H
@@ -13,6 +22,8 @@
 #include <llvm/IR/Instruction.h>
 #include "llvm/IR/PassManager.h"
 
+#include <llvm/ADT/SmallPtrSet.h>
+
 namespace llvm {
   class SwitchInst;
   class LoopInfo;
@@ -21,19 +32,42 @@ namespace llvm {
 
 namespace rv {
 
+class Config;
+class PlatformInfo;
 class VectorizationInfo;
 
 class LowerDivergentSwitches {
+  const Config & config;
   VectorizationInfo & vecInfo;
+  PlatformInfo & platInfo;
   llvm::FunctionAnalysisManager & FAM;
   llvm::LoopInfo & LI;
+  unsigned numDispatchLoops;
+
+  // the case blocks of a switch that are only left towards its post dominator
+  struct CaseRegion {
+    llvm::BasicBlock * joinBlock;
+    llvm::SmallPtrSet<llvm::BasicBlock*, 16> blocks;
+    unsigned numTargets; // distinct successors (including the join block)
+    unsigned bodySize; // instructions in all case blocks
+  };
+
+  // whether \p swInst's cases can run in a dispatch loop, collects its CaseRegion
+  bool getCaseRegion(llvm::SwitchInst & swInst, CaseRegion & caseRegion);
+  // whether the dispatch loop beats the linearized cascade for \p caseRegion
+  bool preferDispatch(const llvm::SwitchInst & swInst, const CaseRegion & caseRegion) const;
 
   void lowerSwitch(llvm::SwitchInst & swInst);
+  void lowerSwitchDispatch(llvm::SwitchInst & swInst, CaseRegion & caseRegion);
   void replaceIncoming(llvm::BasicBlock & phiBlock, llvm::BasicBlock & oldIncoming, llvm::BasicBlock & newIncoming);
 
 public:
-  LowerDivergentSwitches(VectorizationInfo & _vecInfo, llvm::FunctionAnalysisManager & FAM);
+  LowerDivergentSwitches(const Config & _config, VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, llvm::FunctionAnalysisManager & FAM);
+
   bool run();
+
+  // dispatch loops created by run() (their divergence is not in the VectorizationInfo yet)
+  unsigned getNumDispatchLoops() const { return numDispatchLoops; }
 };
 
 } // namespace rv
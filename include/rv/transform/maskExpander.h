@@ -13,6 +13,7 @@
 
 
 #include "rv/vectorizationInfo.h"
+#include "rv/config.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/IRBuilder.h"
@@ -20,9 +21,11 @@
 #include "llvm/IR/CFG.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/PassManager.h"
+#include "llvm/IR/ValueHandle.h"
 
 #include <vector>
 #include <map>
+#include <tuple>
 
 
 
@@ -33,6 +36,7 @@ using EdgeVec = llvm::SmallVector<llvm::Loop::Edge, 4>;
 
 
 class MaskExpander {
+  const Config & config;
   VectorizationInfo & vecInfo;
   llvm::FunctionAnalysisManager & FAM;
   const llvm::LoopInfo & loopInfo; // invariant
@@ -52,7 +56,28 @@ class MaskExpander {
 
   const EdgePred* getEdgePred(const llvm::BasicBlock & srcBlock, int succIdx) const;
   EdgePred & requestEdgePred(const llvm::BasicBlock & srcBlock, int succIdx);
+
+// mask algebra (RV_NO_MASK_CSE)
+  // hash-consed and/or/not instructions by (opcode, lhs, rhs)
+  using MaskOpKey = std::tuple<unsigned, const llvm::Value*, const llvm::Value*>;
+  std::map<MaskOpKey, llvm::WeakVH> maskOps;
+  size_t numFoldedMasks;
+  size_t numReusedMasks;
+  size_t numHoistedMasks;
+
+  // @lhs @opcode @rhs (not @lhs if @rhs == nullptr) as an existing value, nullptr if it does not fold
+  llvm::Value * foldMaskOp(unsigned opcode, llvm::Value & lhs, llvm::Value * rhs) const;
+  // a dominating instruction that computes @lhs @opcode @rhs at the insert point of @builder
+  llvm::Instruction * lookupMaskOp(unsigned opcode, llvm::Value & lhs, llvm::Value * rhs, llvm::IRBuilder<> & builder) const;
+  // terminator of the outermost preheader (in the region) of the loops around @insertBlock that @lhs and @rhs are invariant in
+  llvm::Instruction * getHoistPoint(llvm::BasicBlock & insertBlock, llvm::Value & lhs, llvm::Value * rhs) const;
+  // emit (or re-use) @lhs @opcode @rhs with the vector shape @shape
+  llvm::Value & createMaskOp(llvm::IRBuilder<> & builder, unsigned opcode, llvm::Value & lhs, llvm::Value * rhs,
+                             VectorShape shape, const llvm::Twine & name = llvm::Twine());
 public:
+  // whether @lhs implies @rhs by the structure of the mask expressions (false if unknown)
+  bool implies(llvm::Value & lhs, llvm::Value & rhs, int depth = 0) const;
+
 // lazy mask creation
   // request the block-local branch predicate
   llvm::Value & requestBranchMask(llvm::Instruction & term,
@@ -105,7 +130,8 @@ public:
   // expand all masks in the region
   void expandRegionMasks();
 
-  MaskExpander(VectorizationInfo & _vecInfo,
+  MaskExpander(const Config & _config,
+               VectorizationInfo & _vecInfo,
                llvm::FunctionAnalysisManager &FAM);
   ~MaskExpander();
 };
@@ -0,0 +1,73 @@
+//===- rv/transform/mathFusion.h - fuse and expand math calls before vectorization --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Math call patterns that are cheaper than one vector math call each
+// (RV_NO_MATH_FUSION):
+//
+//   pow(x, n)       ->  x * x * .. (square-and-multiply) for a constant integer n
+//   pow(exp(x), y)  ->  exp(x * y)
+//   exp(y * log(x)) ->  pow(x, y)                  (also exp2/log2)
+//
+// and calls that share their range reduction with a dominating call f(a) of
+// the same function:
+//
+//   f(a)            ->  f(a)                       exp, log, pow, .. families
+//   exp(-a)         ->  1 / exp(a)                 (also exp2)
+//   exp(a + c)      ->  exp(a) * exp(c)            (also exp2)
+//   log(a * c)      ->  log(a) + log(c)            c > 0 (also log2, log10)
+//
+// Every vector math call on the varying operands is a SLEEF call (or a
+// replicated libm call otherwise), the rewrites leave one or no call.
+// Exponents beyond 2 and the pow/exp fusion change the rounding and require
+// approximate functions (afn) on the call, as do the related-argument rewrites.
+// exp(y * log(x)) -> pow(x, y) differs for negative x and also requires nnan.
+//
+// sin(x) and cos(x) of the same operand are fused after vectorization, once
+// the SLEEF implementations are known (see FuseSleefSinCos).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_MATHFUSION_H
+#define RV_TRANSFORM_MATHFUSION_H
+
+#include <llvm/ADT/StringRef.h>
+
+namespace llvm {
+  class CallInst;
+  class DominatorTree;
+  class Instruction;
+  class Value;
+}
+
+namespace rv {
+
+class VectorizationInfo;
+
+class MathFusion {
+  VectorizationInfo & vecInfo;
+
+  // uniform if all of \p operands are uniform, varying otherwise
+  void setShape(llvm::Instruction & inst, llvm::Value & a, llvm::Value & b);
+
+  bool expandPowi(llvm::CallInst & powCall);
+  bool fusePowExp(llvm::CallInst & powCall);
+  bool fuseExpLog(llvm::CallInst & expCall);
+
+  // replace \p call by the result of \p domCall (same function) if their operands are related (see above)
+  bool shareMathCall(llvm::CallInst & call, llvm::CallInst & domCall, llvm::StringRef family);
+  size_t shareMathCalls(const llvm::DominatorTree & domTree);
+
+public:
+  MathFusion(VectorizationInfo & _vecInfo);
+
+  bool run();
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_MATHFUSION_H
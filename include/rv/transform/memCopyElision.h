@@ -14,23 +14,35 @@
 #include "rv/vectorizationInfo.h"
 #include "rv/PlatformInfo.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/PassManager.h"
 
 namespace llvm {
   class Instruction;
   class DataLayout;
   class Type;
+  class LoopInfo;
+  class MemIntrinsic;
+  class MemTransferInst;
 }
 
 
 namespace rv {
 
 // eliminate memcpy/mommov instructions that operate on divergent pointers
+// Copies without a common field type are lowered to byte offset chunks instead (gather/scatter after vectorization):
+// constant sizes up to MaxUnrolledBytes in straight-line code, larger or varying sizes in a uniform loop whose
+// per-lane length masks retire lanes that are done. The same applies to divergent memsets.
 class
 MemCopyElision {
+  PlatformInfo & platInfo;
   VectorizationInfo & vecInfo;
+  llvm::FunctionAnalysisManager & FAM;
   const llvm::DataLayout & layout;
   bool IsDivergent(llvm::Instruction & inst) const;
 
+  // constant sizes above this many bytes are copied in a loop
+  static const size_t MaxUnrolledBytes = 64;
+
   // request a base GEP for accessing @numBytes with flat GEP (or return nullptr)
   llvm::Value * deriveBase(llvm::Value * ptr, size_t numBytes);
   // derive a common aggregate type that aTy and bTy could be bitcase to too access up to @numBytes
@@ -43,9 +55,28 @@ MemCopyElision {
   // implement a memcpy with load/store
   void lowerMemCopy(llvm::Value * aBase, llvm::Value * bBase, llvm::Type * commonTy, llvm::IRBuilder<> & builder, size_t numBytes);
 
+  // lower @mcInst with the common type of its base pointers, returns false if there is none
+  bool lowerTypedCopy(llvm::MemTransferInst & mcInst, size_t numBytes);
+
+  // pointer to the @chunkTy at byte @offset of @ptr
+  llvm::Value * createChunkPtr(llvm::Value * ptr, llvm::Value * offset, llvm::Type * chunkTy, llvm::IRBuilder<> & builder);
+  // the @chunkTy value that @memInst writes at @offset (loaded from the source or splat of the memset byte)
+  llvm::Value * createChunkValue(llvm::MemIntrinsic & memInst, llvm::Type * chunkTy, llvm::Value * offset, llvm::Align srcAlign, llvm::IRBuilder<> & builder);
+  void storeChunk(llvm::MemIntrinsic & memInst, llvm::Value * chunkVal, llvm::Value * offset, llvm::Align destAlign, llvm::IRBuilder<> & builder);
+  // implement a memcpy/memmove/memset of @numBytes with integer chunks (all loads precede the stores)
+  void lowerChunked(llvm::MemIntrinsic & memInst, size_t numBytes, llvm::IRBuilder<> & builder);
+  // implement a memcpy/memset of any length with a uniform loop over byte offsets (new blocks, updates @LI)
+  void lowerChunkLoop(llvm::MemIntrinsic & memInst, llvm::LoopInfo & LI);
+
+  // the shape of a value computed from @a and @b
+  VectorShape getJoinedShape(llvm::Value * a, llvm::Value * b) const;
+  void setShape(llvm::Value * val, VectorShape shape);
+
 public:
-  MemCopyElision(PlatformInfo & platInfo, VectorizationInfo & _vecInfo)
-  : vecInfo(_vecInfo)
+  MemCopyElision(PlatformInfo & _platInfo, VectorizationInfo & _vecInfo, llvm::FunctionAnalysisManager & _FAM)
+  : platInfo(_platInfo)
+  , vecInfo(_vecInfo)
+  , FAM(_FAM)
   , layout(platInfo.getDataLayout())
   {}
 
@@ -0,0 +1,49 @@
+//===- rv/transform/narrowIdioms.h - saturating and averaging idioms on narrow integers --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Integer idioms on u8/i16 (..) values that C computes in int and truncates
+// back to the narrow type (RV_NO_NARROW_IDIOMS):
+//
+//   trunc(clamp(ext a + ext b, MIN, MAX))  ->  uadd.sat/sadd.sat(a, b)
+//   trunc(clamp(ext a - ext b, MIN, MAX))  ->  usub.sat/ssub.sat(a, b)
+//   trunc((ext a + ext b + 1) >> 1)        ->  (a | b) - ((a ^ b) >> 1)
+//   trunc((ext a + ext b) >> 1)            ->  (a & b) + ((a ^ b) >> 1)
+//   trunc(clamp(ext x, lo, hi))            ->  trunc(clamp(x, lo, hi))
+//
+// ext is a zext (sext) of the narrow type (the result type of the trunc or,
+// for the last pattern, any type between it and the wide type), MIN and MAX
+// are the bounds of the narrow type. Clamps are smin/smax (umin/umax on
+// non-negative values) in any order, bounds outside of the value range of the
+// clamped value are ignored.
+//
+// Without the wide intermediates the vector width is not bounded by them and
+// the backends select saturating adds and subtracts (paddus/psubs, uqadd) and
+// saturating packs (packus/packss, sqxtun) for the narrow operations.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_NARROWIDIOMS_H
+#define RV_TRANSFORM_NARROWIDIOMS_H
+
+namespace llvm {
+  class Function;
+  class LoopInfo;
+  class TruncInst;
+}
+
+namespace rv {
+
+// replace @trunc by the narrow form of the idiom it ends, returns false if it ends none
+bool FoldNarrowIdiom(llvm::TruncInst & trunc);
+
+// FoldNarrowIdiom for all truncs in @func (only in loops if @loopInfo is given), returns the number of folded idioms
+unsigned FoldNarrowIdioms(llvm::Function & func, const llvm::LoopInfo * loopInfo);
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_NARROWIDIOMS_H
@@ -0,0 +1,80 @@
+//===- rv/transform/parallelChunkTrans.h - thread chunks of parallel loops --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Parallel chunked loops for the loop vectorizer (RV_PARALLEL_CHUNKS).
+// Before vectorization, the iteration space of a parallel loop is split
+// into chunks of chunkSize iterations (a multiple of the vector width):
+//
+//   for (c = 0; c < numChunks; ++c)
+//     for (i = start(c * chunkSize); i < start(c * chunkSize + min(chunkSize, tripCount - c * chunkSize)); ++i)
+//       body
+//
+// The inner loop is vectorized as usual, only the last chunk has a
+// remainder. Afterwards, the chunk loop body is outlined into a task that
+// the task runtime (include/rv-c/parallelFor.h) runs on its threads.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_PARALLELCHUNKTRANS_H
+#define RV_TRANSFORM_PARALLELCHUNKTRANS_H
+
+#include <llvm/ADT/StringRef.h>
+#include <cstdint>
+
+namespace llvm {
+  class BasicBlock;
+  class Function;
+  class Loop;
+  class LoopInfo;
+  class PHINode;
+  class ScalarEvolution;
+  class Value;
+}
+
+namespace rv {
+
+// the chunk loop around a chunked loop
+struct ChunkLoop {
+  llvm::BasicBlock * header; // chunk index phi
+  llvm::BasicBlock * latch; // exiting block, the only exit of the chunk body
+  llvm::PHINode * chunkIdx;
+  llvm::Value * numChunks; // defined before the chunk loop
+  uint64_t chunkSize;
+
+  ChunkLoop() : header(nullptr), latch(nullptr), chunkIdx(nullptr), numChunks(nullptr), chunkSize(0) {}
+};
+
+class ParallelChunkTransform {
+  llvm::Function & F;
+  llvm::LoopInfo & LI;
+  llvm::ScalarEvolution & SE;
+
+public:
+  ParallelChunkTransform(llvm::Function & _F, llvm::LoopInfo & _LI, llvm::ScalarEvolution & _SE)
+  : F(_F)
+  , LI(_LI)
+  , SE(_SE)
+  {}
+
+  // whether \p L can run in chunks (outermost loop, computable trip count, affine
+  // header phis, no live-outs). Otw, \p reason says why not.
+  bool canTransform(llvm::Loop & L, const char *& reason) const;
+
+  // wrap \p L in a loop over chunks of \p chunkSize iterations.
+  // LoopInfo, DominatorTree and ScalarEvolution are invalid afterwards.
+  ChunkLoop run(llvm::Loop & L, uint64_t chunkSize);
+
+  // outline the body of the (vectorized) chunk loop \p CL into a task and replace \p CL by
+  // a call to the task runtime \p runtimeName.
+  // \return false if the body could not be outlined (the chunks then run in sequence)
+  static bool outlineTask(llvm::Function & F, ChunkLoop & CL, llvm::StringRef runtimeName);
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_PARALLELCHUNKTRANS_H
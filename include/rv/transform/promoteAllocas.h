@@ -0,0 +1,68 @@
+//===- rv/transform/promoteAllocas.h - promote small varying arrays to registers  --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A varying alloca of a small array [N x T] that is only accessed element-wise
+// (dynamic indices that mem2reg/SROA could not resolve) is vectorized as
+// private memory per lane, every access becomes a gather/scatter.
+// This transformation replaces the array by N SSA values (one vector register
+// per element after vectorization):
+//
+//   load a[i]      ->  select(i == N-1, a.N-1, .. select(i == 1, a.1, a.0))
+//   store a[i], v  ->  a.k = select(i == k && P, v, a.k)  for every k
+//
+// where P is the predicate of the (linearized) block. Uniform indices yield
+// uniform selects, varying (but in-bounds, hence bounded) indices a lookup in
+// registers.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_PROMOTEALLOCAS_H
+#define RV_TRANSFORM_PROMOTEALLOCAS_H
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/IRBuilder.h>
+
+#include "rv/shape/vectorShape.h"
+
+namespace llvm {
+  class AllocaInst;
+  class Instruction;
+  class Value;
+}
+
+namespace rv {
+
+class VectorizationInfo;
+
+class PromoteAllocas {
+  VectorizationInfo & vecInfo;
+
+  // a load or store of element elemIdx (nullptr for zero)
+  struct ElemAccess {
+    llvm::Instruction * inst;
+    llvm::Value * elemIdx;
+  };
+
+  // the element accesses of \p allocaInst if it can be promoted
+  bool collectAccesses(llvm::AllocaInst & allocaInst, llvm::SmallVectorImpl<ElemAccess> & accesses,
+                       llvm::SmallVectorImpl<llvm::Instruction*> & deadInsts) const;
+
+  // i == k (or true for a constant match)
+  llvm::Value * createElemMatch(llvm::IRBuilder<> & builder, llvm::Value * elemIdx, unsigned k);
+
+  void promote(llvm::AllocaInst & allocaInst, llvm::ArrayRef<ElemAccess> accesses);
+
+public:
+  PromoteAllocas(VectorizationInfo & _vecInfo);
+
+  bool run();
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_PROMOTEALLOCAS_H
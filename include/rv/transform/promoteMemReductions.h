@@ -0,0 +1,77 @@
+//===- rv/transform/promoteMemReductions.h - keep in-loop memory reductions in registers  --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A loop inside the region that accumulates a varying value into memory at a
+// uniform, loop-invariant address
+//
+//   loop:  *p = *p + x
+//
+// reduces the vector x and goes through memory in every iteration. This
+// transformation keeps the accumulator in a register for the duration of the
+// loop (one vector register after vectorization) and updates memory once at
+// the loop exits:
+//
+//   loop:  acc = phi(0, acc')   acc' = acc + x
+//   exit:  *p = *p + acc        (one horizontal reduction)
+//
+// The other memory accesses of the loop must not alias p.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_PROMOTEMEMREDUCTIONS_H
+#define RV_TRANSFORM_PROMOTEMEMREDUCTIONS_H
+
+#include <llvm/IR/PassManager.h>
+
+#include "rv/analysis/reductions.h"
+
+namespace llvm {
+  class AAResults;
+  class Instruction;
+  class LoadInst;
+  class Loop;
+  class LoopInfo;
+  class MemoryLocation;
+  class StoreInst;
+}
+
+namespace rv {
+
+class VectorizationInfo;
+
+class PromoteMemReductions {
+  VectorizationInfo & vecInfo;
+  llvm::LoopInfo & LI;
+  llvm::AAResults * AA; // optional (cached result)
+
+  // store(p, load(p) op x)
+  struct MemReduction {
+    llvm::LoadInst * load;
+    llvm::StoreInst * store;
+    llvm::Instruction * reductor;
+    RedKind kind;
+  };
+
+  // whether \p store in \p L updates a uniform, invariant accumulator with a varying value
+  bool matchReduction(llvm::Loop & L, llvm::StoreInst & store, MemReduction & red) const;
+
+  // whether \p inst can not access \p loc
+  bool isDisjoint(llvm::Instruction & inst, const llvm::MemoryLocation & loc) const;
+
+  void promote(llvm::Loop & L, MemReduction & red);
+
+public:
+  PromoteMemReductions(VectorizationInfo & _vecInfo, llvm::FunctionAnalysisManager & FAM);
+
+  // \returns true if any accumulator was promoted (the analysis has to be updated)
+  bool run();
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_PROMOTEMEMREDUCTIONS_H
@@ -0,0 +1,81 @@
+//===- rv/transform/recursionToLoop.h - self-recursion as a loop over an explicit stack --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// WFV of a self-recursive function calls the vector function itself under an
+// any-guard, every level of the recursion runs with the lanes that are still
+// active. This transformation (RV_RECURSION_LOOPS) runs the activations as a
+// loop over a private stack of argument frames instead:
+//
+//   f(n) = n < 2 ? n : f(n-1) + f(n-2)
+//
+//   push(n); acc = 0
+//   while (sp > 0) {
+//     n = pop()
+//     if (n < 2) { acc += n; continue; }
+//     push(n-1); push(n-2); acc += 0
+//   }
+//   return acc
+//
+// After vectorization this is a divergent loop: every lane works off its own
+// stack. Legal if
+// - the only side effects of f are stores to its own allocas (the code after
+//   a recursive call now runs before the callee),
+// - the recursive calls do not pass addresses of allocas (all frames share
+//   them),
+// - each call result flows into the return value through a chain of
+//   associative, commutative operations of one kind (add, mul, and, or; fp
+//   only with reassoc).
+// Calls beyond the stack depth go to the recursive function instead.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_RECURSIONTOLOOP_H
+#define RV_TRANSFORM_RECURSIONTOLOOP_H
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/IRBuilder.h>
+
+#include "rv/analysis/reductions.h"
+
+namespace llvm {
+  class AllocaInst;
+  class CallInst;
+  class Function;
+}
+
+namespace rv {
+
+class RecursionToLoop {
+  llvm::Function & func;
+  llvm::Function & selfFunc; // recursive calls in @func call this function (the original of a clone)
+  unsigned stackDepth;
+
+  llvm::SmallVector<llvm::CallInst*, 4> recCalls;
+  RedKind kind; // combines the results of the activations (Bot for void functions)
+
+  // whether the result of @call only flows into the return value through reduction operations
+  bool matchResultChain(llvm::CallInst & call);
+
+  bool canTransform();
+
+  // acc := acc op @val
+  void accumulate(llvm::IRBuilder<> & builder, llvm::AllocaInst & accSlot, llvm::Value & val);
+
+  // stack[@sp] := @args
+  void storeFrame(llvm::IRBuilder<> & builder, llvm::AllocaInst & stack, llvm::Value & sp, llvm::ArrayRef<llvm::Value*> args);
+
+public:
+  RecursionToLoop(llvm::Function & _func, llvm::Function & _selfFunc, unsigned _stackDepth = 64);
+
+  // \returns true if the recursion was replaced by a loop
+  bool run();
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_RECURSIONTOLOOP_H
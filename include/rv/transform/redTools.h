@@ -20,11 +20,22 @@ namespace rv {
 struct Config;
 
 // materialize a single instance of firstArg [[RedKind~OpCode]] secondArg
-llvm::Instruction& CreateReductInst(llvm::IRBuilder<> & builder, RedKind redKind, llvm::Value & firstArg, llvm::Value & secondArg);
+llvm::Value& CreateReductInst(llvm::IRBuilder<> & builder, RedKind redKind, llvm::Value & firstArg, llvm::Value & secondArg);
+
+// floating-point min/max of @A and @B. minnum/maxnum (native min/max instructions) if the builder has the nnan and nsz
+// flags, an ordered compare and a select otherwise
+llvm::Value& CreateFPMinMax(llvm::IRBuilder<> & builder, llvm::Value & A, llvm::Value & B, bool createMin);
 
 // reduce the vector @vectorVal to a scalar value (using redKind)
 llvm::Value & CreateVectorReduce(Config & config, llvm::IRBuilder<> & builder, RedKind redKind, llvm::Value & vectorVal, llvm::Value * initVal);
 
+// reduce the vectors @vectorVals (same type, at most width many) together by transposing them in pairs with vertical @redKind operations.
+// The reduction of vectorVals[k] ends up in lane k * @laneStride of the result.
+llvm::Value & CreateTransposedReduce(llvm::IRBuilder<> & builder, RedKind redKind, llvm::ArrayRef<llvm::Value*> vectorVals, unsigned & laneStride);
+
+// prefix scan of the vector @vectorVal in log2(width) shuffle steps. Lane i of the result combines lanes 0..i (@inclusive) or 0..i-1 (neutral element in lane 0).
+llvm::Value & CreateVectorScan(llvm::IRBuilder<> & builder, RedKind redKind, llvm::Value & vectorVal, bool inclusive);
+
 // if laneOffset is >= 0 create an extract from that offset, if laneOffset < 0 add the vector width first
 // will return @vecVal if it is not a vector (uniform value)
 llvm::Value & CreateExtract(llvm::IRBuilder<> & builder, llvm::Value & vecVal, int laneOffset);
@@ -14,6 +14,7 @@
 #include "llvm/IR/Function.h"
 
 #include <set>
+#include <vector>
 
 namespace llvm {
   class LoopInfo;
@@ -36,9 +37,10 @@ class VectorizationInfo;
 struct PreparedLoop {
   llvm::Loop* TheLoop;
   llvm::Value * EntryAVL;
-  PreparedLoop() : TheLoop(nullptr), EntryAVL(nullptr) {}
-  PreparedLoop(llvm::Loop *_TheLoop, llvm::Value *_EntryAVL)
-      : TheLoop(_TheLoop), EntryAVL(_EntryAVL) {}
+  llvm::Value * TailMask; // live lanes of each iteration (tail predication only)
+  PreparedLoop() : TheLoop(nullptr), EntryAVL(nullptr), TailMask(nullptr) {}
+  PreparedLoop(llvm::Loop *_TheLoop, llvm::Value *_EntryAVL, llvm::Value *_TailMask)
+      : TheLoop(_TheLoop), EntryAVL(_EntryAVL), TailMask(_TailMask) {}
 };
 
 class RemainderTransform {
@@ -61,12 +63,22 @@ class RemainderTransform {
 public:
   RemainderTransform(llvm::Function &_F, llvm::FunctionAnalysisManager & FAM, ReductionAnalysis & _reda);
 
-  // create a vectorizable loop or return nullptr if remTrans can not currently do it
+  // create a vectorizable loop or return nullptr if remTrans can not currently do it.
+  // With \p useTailPredication, the vector loop also executes the last partial iteration under PreparedLoop::TailMask
+  // and there is no scalar remainder.
+  // If \p vecLoopGuard is set, the vector loop is only entered if it evaluates to true (otw the scalar loop runs all iterations).
+  // With \p useOverlapTail, the last vector iteration starts vectorWidth iterations before the end (overlapping the previous
+  // one) and the scalar loop only runs loops of less than vectorWidth iterations (see ::canOverlapTail).
   PreparedLoop
-  createVectorizableLoop(llvm::Loop & L, ValueSet & uniOverrides, bool useTailPredication, int vectorWidth, int tripAlign);
+  createVectorizableLoop(llvm::Loop & L, ValueSet & uniOverrides, bool useTailPredication, int vectorWidth, int tripAlign, llvm::Value * vecLoopGuard = nullptr, bool useOverlapTail = false);
 
   // Check whether ::createVectorizableLoop will succeed on \p L.
   bool analyzeLoopStructure(llvm::Loop &L);
+
+  // Whether re-executing iterations of \p L is harmless (overlapping last vector iteration): a unit-step induction is the only
+  // header phi, nothing is live out, there are no side effects but stores and no load reads what a store writes (except for
+  // the pairs in \p checkedPairs, which runtime checks keep apart in the vector loop).
+  bool canOverlapTail(llvm::Loop & L, const std::vector<std::pair<llvm::Instruction*, llvm::Instruction*>> & checkedPairs);
 };
 
 }
@@ -0,0 +1,74 @@
+//===- rv/transform/searchLoopTrans.h - speculative vectorization of search loops --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Bounded search loops (RV_SEARCH_LOOPS), e.g.
+//
+//   for (; i < n; ++i) if (p[i] == key) break; // memchr-like
+//
+// have a data-dependent exit, so they can not be turned into a lock-step loop.
+// A vector loop in front of the scalar loop scans the array in aligned blocks
+// of vectorBytes with masked loads: lanes before the start and beyond the trip
+// count are not read. The first exiting lane (ballot bitmask, cttz) is the
+// resume iteration of the scalar loop, which then runs the terminating
+// iteration (and computes all live-outs) as before.
+// Unbounded loops (while (p[i] != key) ++i) are not transformed: IR has no
+// load that may read past the element that terminates the scalar loop.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_SEARCHLOOPTRANS_H
+#define RV_TRANSFORM_SEARCHLOOPTRANS_H
+
+namespace llvm {
+  class BasicBlock;
+  class CmpInst;
+  class Function;
+  class LoadInst;
+  class Loop;
+  class LoopInfo;
+  class SCEV;
+  class ScalarEvolution;
+  class Value;
+}
+
+namespace rv {
+
+class SearchLoopTransform {
+  llvm::Function & F;
+  llvm::LoopInfo & LI;
+  llvm::ScalarEvolution & SE;
+  unsigned vectorBytes;
+
+public:
+  struct SearchLoop {
+    llvm::LoadInst * load; // contiguous load of the searched array
+    llvm::CmpInst * cmp; // compares the loaded element to key
+    llvm::Value * key; // loop invariant
+    bool exitOnMatch; // the loop exits if cmp is true
+    const llvm::SCEV * exitCount; // backedge-taken count of the bound exit
+  };
+
+  SearchLoopTransform(llvm::Function & _F, llvm::LoopInfo & _LI, llvm::ScalarEvolution & _SE, unsigned _vectorBytes)
+  : F(_F)
+  , LI(_LI)
+  , SE(_SE)
+  , vectorBytes(_vectorBytes)
+  {}
+
+  // whether \p L is a search loop (populates \p search)
+  bool analyze(llvm::Loop & L, SearchLoop & search) const;
+
+  // insert the vector search loop before \p L.
+  // Returns the header of the vector loop.
+  // LoopInfo and ScalarEvolution are invalid afterwards.
+  llvm::BasicBlock * run(llvm::Loop & L, const SearchLoop & search);
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_SEARCHLOOPTRANS_H
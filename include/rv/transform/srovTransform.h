@@ -19,6 +19,7 @@
 namespace llvm {
   class AllocaInst;
   class DataLayout;
+  class Instruction;
 }
 
 namespace rv {
@@ -32,7 +33,8 @@ class SROVTransform {
 public:
   SROVTransform(VectorizationInfo & _vecInfo, const PlatformInfo & _platInfo);
 
-  bool run();
+  // if \p replicates is given, the (new) replicated instructions are appended to it
+  bool run(std::vector<const llvm::Instruction*> * replicates = nullptr);
 };
 
 
@@ -6,6 +6,12 @@
 //
 //===----------------------------------------------------------------------===//
 //
+// Replaces the private (varying) alloca of a type T by one of the vectorized
+// type, eg [N x float] by [N x <W x float>]. Element j of lane i then is at
+// base + (j * W + i). Accesses with uniform addresses load/store whole vectors.
+// Element accesses a[j] with a varying j on an array are gathers/scatters with
+// the 32-bit offsets j * W + lane (if allowVaryingIndices).
+//
 
 #ifndef RV_TRANSFORM_STRUCTOPT_H
 #define RV_TRANSFORM_STRUCTOPT_H
@@ -19,6 +25,7 @@
 namespace llvm {
   class AllocaInst;
   class DataLayout;
+  class GetElementPtrInst;
 }
 
 namespace rv {
@@ -28,6 +35,7 @@ class VectorizationInfo;
 class StructOpt {
   VectorizationInfo & vecInfo;
   const llvm::DataLayout & layout;
+  bool allowVaryingIndices;
 
   /// whether the alloca layout can be changed without breaking the IR
   /// I.e. not the case if the allocated object is passed to a call.
@@ -35,7 +43,14 @@ class StructOpt {
 
   /// whether every address computation on this alloc is uniform
   /// the alloca can still be varying because of stored varying values
-  bool allUniformGeps(llvm::AllocaInst & allocInst);
+  /// (with allowVaryingIndices, varying element accesses are collected in \p varyingElemGeps)
+  bool allUniformGeps(llvm::AllocaInst & allocInst, llvm::SmallVectorImpl<llvm::GetElementPtrInst*> & varyingElemGeps);
+
+  /// whether \p gep is a[j] on the array alloca \p allocInst that is only loaded from and stored to
+  bool isElementAccess(llvm::AllocaInst & allocInst, llvm::GetElementPtrInst & gep);
+
+  /// lane i's element pointer of the varying element access \p gep to the transformed alloca \p vecAlloc
+  llvm::Value * createVaryingElemPtr(llvm::GetElementPtrInst & gep, llvm::AllocaInst & vecAlloc);
 
   /// try to optimize the layout of this alloca
   bool optimizeAlloca(llvm::AllocaInst & allocInst);
@@ -60,16 +75,18 @@ class StructOpt {
                                   llvm::Value * storeVal);
 
   // execute the data layout transformation
-  void transformLayout(llvm::AllocaInst & allocaInst, llvm::ValueToValueMapTy & transformMap);
+  void transformLayout(llvm::AllocaInst & allocaInst, llvm::ValueToValueMapTy & transformMap,
+                       llvm::ArrayRef<llvm::GetElementPtrInst*> varyingElemGeps);
 
   // aggressive mem2reg promotion of small allocas
   bool shouldPromote(llvm::AllocaInst & allocaInst);
   void promoteAlloca(llvm::AllocaInst & allocaInst);
   size_t numTransformed;
   size_t numPromoted;
+  size_t numVaryingAccesses;
 
 public:
-  StructOpt(VectorizationInfo & _vecInfo, const llvm::DataLayout & _layout);
+  StructOpt(VectorizationInfo & _vecInfo, const llvm::DataLayout & _layout, bool _allowVaryingIndices = true);
 
   bool run();
 };
@@ -0,0 +1,82 @@
+//===- rv/transform/uniformVersioning.h - version regions on runtime-uniform values --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Uniform-value versioning (RV_UNIFORM_VERSIONING, WFV regions).
+// Picks the varying value X that alone causes the divergence of the most
+// branches (e.g. a per-lane material id) and versions the region on
+//
+//   rv_all(X == rv_extract(X, 0))
+//
+// at the region entry. In the cloned fast path X is replaced by the pinned
+// uniform rv_extract(X, 0), so VA (to be re-run) finds uniform control there.
+//
+// Trip-count versioning (RV_TRIPCOUNT_VERSIONING, WFV regions) does the same for
+// divergent loops whose exits only diverge on varying values of the loop entry
+// (e.g. a per-lane trip count n): the preheader checks rv_all(n == rv_extract(n, 0))
+// and enters a clone of the loop in which n is pinned uniform. That clone is a
+// uniform loop without live-lane tracking, the divergent loop is the fallback.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_UNIFORMVERSIONING_H
+#define RV_TRANSFORM_UNIFORMVERSIONING_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+  class Instruction;
+  class Loop;
+  class Value;
+}
+
+namespace rv {
+
+class PlatformInfo;
+class VectorizationInfo;
+
+class UniformVersioning {
+  VectorizationInfo & vecInfo;
+  PlatformInfo & platInfo;
+  llvm::FunctionAnalysisManager & FAM;
+
+  // whether the region can be versioned on @val (available at the region entry)
+  bool isCandidate(const llvm::Value & val) const;
+  // the only candidate value that @term's divergence depends on (nullptr if none)
+  llvm::Value * getDivergenceSource(llvm::Instruction & term) const;
+  // clone the region below the definition of @source into a uniform fast path
+  void version(llvm::Value & source);
+
+  // whether @loop can be cloned (preheader, dedicated exits, LCSSA form)
+  bool isVersionableLoop(const llvm::Loop & loop) const;
+  // the varying values of the loop entry that the divergent exits of @loop depend on (false if anything else)
+  bool getExitSources(const llvm::Loop & loop, llvm::SmallVectorImpl<llvm::Value*> & sources) const;
+  // clone @loop into a uniform version that runs if all lanes agree on @sources
+  void versionLoop(llvm::Loop & loop, llvm::ArrayRef<llvm::Value*> sources);
+  // re-compute the CFG analyses after versioning
+  void invalidateCFG();
+
+public:
+  UniformVersioning(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, llvm::FunctionAnalysisManager & _FAM)
+  : vecInfo(_vecInfo)
+  , platInfo(_platInfo)
+  , FAM(_FAM)
+  {}
+
+  // returns true if the region was versioned (shapes need to be re-computed)
+  bool run();
+
+  // version the divergent loops of the region on their trip-count sources,
+  // returns true if a loop was versioned (shapes need to be re-computed)
+  bool runLoops();
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_UNIFORMVERSIONING_H
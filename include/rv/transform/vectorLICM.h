@@ -0,0 +1,65 @@
+//===- rv/transform/vectorLICM.h - hoist invariant vector code after vectorization --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Cleanup of the vectorized function (RV_NO_VECTOR_LICM):
+// - hoisting: loop-invariant vector computations (mask and/or/not/compares of
+//   the entry mask, broadcasts, blends) move to the loop preheader. So do
+//   (masked) vector loads of invariant addresses under an invariant mask if
+//   nothing in the loop writes memory and the load executes in every
+//   iteration.
+// - blends:   select(m, a, poison) -> a, select(m, a, a) -> a,
+//             select(m, a, undef) -> a if a is never undef or poison,
+//             select(m, select(m, a, b), c) -> select(m, a, c),
+//             select(m, a, select(m, b, c)) -> select(m, a, c)
+//   These are InstSimplify folds. They run first here, so that hoisting sees
+//   through the blends.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TRANSFORM_VECTORLICM_H
+#define RV_TRANSFORM_VECTORLICM_H
+
+#include <cstddef>
+
+namespace llvm {
+  class DominatorTree;
+  class Function;
+  class Instruction;
+  class Loop;
+  class LoopInfo;
+  class SelectInst;
+}
+
+namespace rv {
+
+class VectorLICM {
+  llvm::Function & vecFunc;
+
+  size_t numHoisted;
+  size_t numHoistedLoads;
+  size_t numBlends;
+
+  // whether @inst may move to the preheader of @L (its operands are defined outside)
+  bool canHoist(llvm::Loop & L, llvm::DominatorTree & domTree, llvm::Instruction & inst, bool loopWritesMemory) const;
+
+  // hoist the invariant instructions in @L (inner loops first)
+  void hoistFromLoop(llvm::Loop & L, llvm::LoopInfo & loopInfo, llvm::DominatorTree & domTree);
+
+  // replace or simplify @blend. \returns true if it changed
+  bool simplifyBlend(llvm::SelectInst & blend);
+
+public:
+  VectorLICM(llvm::Function & _vecFunc);
+
+  // \returns true if the function changed
+  bool run();
+};
+
+} // namespace rv
+
+#endif // RV_TRANSFORM_VECTORLICM_H
@@ -0,0 +1,68 @@
+//===- rv/tuningFile.h - per-loop/per-function tuning decisions --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Tuning file (RV_TUNING=<file>, written by tools/rv-autotune.py) that
+// replaces the heuristic choices of the loop vectorizer and WFV.
+//
+// Lines read "<function> <region> <key>=<value> ..." where <region> is the
+// loop header name (loop vectorizer), "wfv" (whole-function vectorization) or
+// "*" (any region of the function). '#' starts a comment. Keys:
+//
+//   width=<n>        vector width (1: do not vectorize), loop vectorizer only
+//   interleave=<n>   interleave factor, loop vectorizer only
+//   trips=<n>        expected trip count (eg from an instrumented run), loop vectorizer only
+//   boscc, cif, srov, structopt, soa-gathers, gathercost, gathers, table-lookup, interleaved-access,
+//   gather-coalescing, address-dispatch, index-runs, tailfold, epilogue, overlap-tail, promote-allocas,
+//   promote-memory-reductions = 0|1   Config toggles
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_TUNINGFILE_H
+#define RV_TUNINGFILE_H
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rv {
+
+struct Config;
+
+struct TuningEntry {
+  unsigned width; // 0 if not set
+  unsigned interleave; // 0 if not set
+  unsigned trips; // 0 if not set
+  std::vector<std::pair<std::string, bool>> flags; // Config toggles
+
+  TuningEntry() : width(0), interleave(0), trips(0), flags() {}
+
+  // apply the Config toggles to \p config
+  void apply(Config & config) const;
+};
+
+class TuningFile {
+  llvm::StringMap<TuningEntry> entries; // "<function> <region>"
+
+  void read(const std::string & tuningPath);
+
+public:
+  TuningFile(const std::string & tuningPath);
+
+  // the RV_TUNING file, nullptr if RV_TUNING is not set
+  static const TuningFile * get();
+
+  // the entry of \p region in \p funcName (falls back to "<function> *"), nullptr if there is none
+  const TuningEntry * lookup(llvm::StringRef funcName, llvm::StringRef region) const;
+};
+
+} // namespace rv
+
+#endif // RV_TUNINGFILE_H
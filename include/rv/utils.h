@@ -26,14 +26,20 @@ MaterializeEntryMask(llvm::Function &F, rv::PlatformInfo &platInfo);
 llvm::Type*
 vectorizeType(llvm::Type* scalarTy, VectorShape shape, unsigned vectorWidth);
 
+// struct-of-vectors type of a varying aggregate (e.g. {float, [2 x i32]} -> {<W x float>, [2 x <W x i32>]}).
+// nullptr if \p scalarTy is not an aggregate of integer and floating-point leaves.
+llvm::Type*
+getStructOfVectorsType(llvm::Type & scalarTy, unsigned vectorWidth);
+
 llvm::Function*
 createVectorDeclaration(llvm::Function& scalarFn, VectorShape resShape,
                         const VectorShapeVec& argShapes, unsigned vectorWidth,
                         int maskPos);
 
-// parse an omp 4 X86DeclareSIMD signature
+// parse a Vector Function ABI signature (_ZGV<isa><mask><vlen><params>_<name>).
+// The vector function is called \p vectorFnName (or \p attribText if empty).
 bool
-parseVectorMapping(llvm::Function & scalarFn, llvm::StringRef & attribText, VectorMapping & mapping, bool createMissingDecl);
+parseVectorMapping(llvm::Function & scalarFn, llvm::StringRef & attribText, VectorMapping & mapping, bool createMissingDecl, llvm::StringRef vectorFnName = llvm::StringRef());
 
 template<class T>
 inline
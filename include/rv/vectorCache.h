@@ -0,0 +1,66 @@
+//===- rv/vectorCache.h - persistent cache of vector functions --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Content-addressed on-disk cache for vectorized functions (RV_CACHE_DIR).
+// The key hashes the scalar function IR, the VectorMapping, the RV
+// configuration and the target. The value is a bitcode module holding the
+// vector function and every definition it pulled in (eg SLEEF functions).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_VECTORCACHE_H
+#define RV_VECTORCACHE_H
+
+#include "rv/config.h"
+#include "rv/vectorMapping.h"
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+
+#include <string>
+
+namespace llvm {
+  class Function;
+  class raw_ostream;
+}
+
+namespace rv {
+
+class VectorCache {
+  std::string cacheDir;
+
+  std::string getEntryPath(llvm::StringRef key) const;
+
+public:
+  // use \p _cacheDir as the cache location (disabled if empty).
+  VectorCache(std::string _cacheDir);
+
+  // cache location from RV_CACHE_DIR.
+  VectorCache();
+
+  bool isEnabled() const { return !cacheDir.empty(); }
+
+  // compute the cache key for \p mapping. Covers the scalar function, the definitions it transitively
+  // references (callee bodies, global initializers), the mapping, the configuration and the target.
+  // Must be called on the unmodified scalar function.
+  std::string computeKey(const VectorMapping & mapping, const Config & config) const;
+
+  // give the vector function declaration \p vecFn the cached body for \p key.
+  // Returns false on a miss.
+  bool load(llvm::StringRef key, llvm::Function & vecFn);
+
+  // store \p vecFn and all definitions it references that are not listed in \p inheritedDefs.
+  void store(llvm::StringRef key, llvm::Function & vecFn, const llvm::StringSet<> & inheritedDefs);
+
+  // process-wide hit/miss statistics
+  static void printStatistics(llvm::raw_ostream & out);
+};
+
+} // namespace rv
+
+#endif // RV_VECTORCACHE_H
@@ -21,13 +21,16 @@ class Value;
 #include "rv/shape/vectorShape.h"
 #include "rv/vectorMapping.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/ValueHandle.h"
 #include "llvm/Support/raw_ostream.h"
 
-#include <set>
-#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 namespace rv {
 
@@ -43,24 +46,46 @@ class VectorizationInfo {
   VectorMapping mapping;
 
   // value, argument and instruction shapes
-  std::unordered_map<const llvm::Value *, VectorShape> shapes;
+  // (open addressing, reserved for all instructions of the function)
+  llvm::DenseMap<const llvm::Value *, VectorShape> shapes;
 
   // detected divergent loops
-  std::set<const llvm::Loop *> mDivergentLoops;
+  llvm::SmallPtrSet<const llvm::Loop *, 4> mDivergentLoops;
 
   // basic block properties // TODO fuse into struct
   // materialized basic block predicates
-  std::unordered_map<const llvm::BasicBlock *, llvm::TrackingVH<llvm::Value>>
+  llvm::DenseMap<const llvm::BasicBlock *, llvm::TrackingVH<llvm::Value>>
       predicates;
   // whether the block is the exit of a divergent loop exit
-  std::set<const llvm::BasicBlock *> DivergentLoopExits;
+  llvm::SmallPtrSet<const llvm::BasicBlock *, 8> DivergentLoopExits;
   // whether the block is a join point of disjoint paths from a varying branch
-  std::set<const llvm::BasicBlock *> JoinDivergentBlocks;
+  llvm::SmallPtrSet<const llvm::BasicBlock *, 8> JoinDivergentBlocks;
   // whether the block will receive a non-uniform predicate
-  std::map<const llvm::BasicBlock *, bool> VaryingPredicateBlocks;
+  llvm::DenseMap<const llvm::BasicBlock *, bool> VaryingPredicateBlocks;
+
+public:
+  // join points of a divergent terminator (sync dependences, only depend on the CFG)
+  struct JoinPoints {
+    // blocks reachable by disjoint paths from the terminator
+    llvm::SmallVector<const llvm::BasicBlock *, 4> joinDivBlocks;
+    // loop exits that become divergent (of the loop carrying the terminator and its parents)
+    llvm::SmallVector<const llvm::BasicBlock *, 4> loopDivBlocks;
+  };
+
+private:
+  // cached join points per terminator (shared by all analysis runs until the CFG changes)
+  llvm::DenseMap<const llvm::Instruction *, std::unique_ptr<JoinPoints>> joinPointCache;
+
+  // predicate of the region entry (nullptr for all lanes)
+  llvm::TrackingVH<llvm::Value> entryMask;
+  // active vector length of the region entry (nullptr if not strip-mined)
+  llvm::TrackingVH<llvm::Value> entryAVL;
 
   // fixed shapes (will be preserved through VA)
-  std::set<const llvm::Value *> pinned;
+  llvm::SmallPtrSet<const llvm::Value *, 8> pinned;
+
+  // an inferred shape depends on the vector width (see noteWidthDependence, noted by concurrent VA workers)
+  mutable std::atomic<bool> widthDependent;
 
 public:
   VectorizationInfo(Region &region, VectorMapping _mapping);
@@ -77,6 +102,16 @@ public:
   bool inRegion(const llvm::BasicBlock &block) const;
   llvm::BasicBlock &getEntry() const;
 
+  // region entry mask (eg the live lanes of a tail-folded loop iteration).
+  // Must be defined in the entry block. nullptr if all lanes enter the region.
+  llvm::Value *getEntryMask() const { return entryMask; }
+  void setEntryMask(llvm::Value &mask) { entryMask = &mask; }
+
+  // region entry AVL of strip-mined loops (uniform, lanes [0, AVL) are live, implied by the entry mask).
+  // nullptr unless AVL loops are generated (Config::useAVL).
+  llvm::Value *getEntryAVL() const { return entryAVL; }
+  void setEntryAVL(llvm::Value &avl) { entryAVL = &avl; }
+
   // disjoin path divergence
   bool isJoinDivergent(const llvm::BasicBlock &JoinBlock) const {
     return JoinDivergentBlocks.count(&JoinBlock);
@@ -85,6 +120,15 @@ public:
     return JoinDivergentBlocks.insert(&JoinBlock).second;
   }
 
+  // cached join points of the terminator \p term (nullptr if not computed yet)
+  const JoinPoints *getCachedJoinPoints(const llvm::Instruction &term) const {
+    auto it = joinPointCache.find(&term);
+    return it == joinPointCache.end() ? nullptr : it->second.get();
+  }
+  const JoinPoints &cacheJoinPoints(const llvm::Instruction &term, JoinPoints joinPoints);
+  // drop all cached join points, required after a transformation changed the CFG of the region
+  void forgetJoinPoints() { joinPointCache.clear(); }
+
   // loop divergence
   bool addDivergentLoop(const llvm::Loop &divLoop);
   void removeDivergentLoop(const llvm::Loop &divLoop);
@@ -127,6 +171,27 @@ public:
   // this is required to re-run the DA
   void forgetInferredProperties();
 
+  // VA inferred a shape with a rule that involves the vector width (alloca
+  // alignment, stride * width bounds, call resolvers). Otherwise the inferred
+  // properties hold for any width.
+  void noteWidthDependence() const { widthDependent = true; }
+  bool isWidthDependent() const { return widthDependent; }
+
+  // inferred properties by position in the scalar function (arguments, then
+  // every block followed by its instructions)
+  struct Snapshot {
+    std::vector<unsigned> opcodes; // 0 for blocks, to check that the structure matches
+    std::vector<std::pair<unsigned, VectorShape>> shapes;
+    std::vector<std::pair<unsigned, bool>> varyingPredicateBlocks;
+    std::vector<unsigned> divergentLoopHeaders;
+    std::vector<unsigned> divergentLoopExits;
+    std::vector<unsigned> joinDivergentBlocks;
+  };
+  Snapshot takeSnapshot() const;
+  // transfer the inferred properties of a function with the same structure.
+  // \returns false (and changes nothing) if the structure differs.
+  bool applySnapshot(const Snapshot &snapshot, const llvm::LoopInfo &LI);
+
   bool isTemporalDivergent(const llvm::LoopInfo &LI,
                            const llvm::BasicBlock &ObservingBlock,
                            const llvm::Value &Val) const;
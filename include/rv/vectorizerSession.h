@@ -0,0 +1,76 @@
+//===- rv/vectorizerSession.h - long-lived vectorizer state --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Vectorizer state that outlives one module (eg in a JIT).
+// The session owns the config, the resolver chain (incl. the SLEEF modules it
+// has loaded), the PlatformInfo and the analysis managers. Attaching another
+// module only re-registers the mappings of that module.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_VECTORIZERSESSION_H
+#define RV_VECTORIZERSESSION_H
+
+#include "rv/config.h"
+#include "rv/passes/PassManagerSession.h"
+
+#include <functional>
+#include <memory>
+
+namespace llvm {
+  class Module;
+  class TargetMachine;
+  class raw_ostream;
+}
+
+namespace rv {
+
+class PlatformInfo;
+class VectorizerInterface;
+struct VectorMapping;
+
+class VectorizerSession {
+  Config config;
+  PassManagerSession PMS;
+  std::unique_ptr<PlatformInfo> platInfo;
+  std::unique_ptr<VectorizerInterface> vectorizer;
+  llvm::Module * attachedMod;
+
+public:
+  // \p TM provides the target analyses (TTI), generic ones if nullptr
+  VectorizerSession(Config config, llvm::TargetMachine *TM = nullptr);
+  ~VectorizerSession();
+
+  // vectorize functions of \p mod from now on (detaches the current module).
+  // The resolver chain is set up on the first attach.
+  void attach(llvm::Module & mod);
+  // drop all analyses of the attached module (call before the module is modified elsewhere or destroyed).
+  void detach();
+  bool isAttached() const { return attachedMod; }
+
+  // vectorize the scalar function of \p wfvJob into its vector declaration (same pipeline as the WFV pass).
+  // Functions of the attached module only. \p isCancelled is polled between the phases,
+  // the vector function stays a declaration if it returns true.
+  bool vectorizeFunction(VectorMapping & wfvJob, const std::function<bool()> & isCancelled = nullptr);
+
+  // only valid while a module is attached
+  llvm::Module & getModule() const { return *attachedMod; }
+  PlatformInfo & getPlatformInfo() { return *platInfo; }
+  VectorizerInterface & getVectorizer() { return *vectorizer; }
+
+  llvm::FunctionAnalysisManager & getFAM() { return PMS.FAM; }
+  const Config & getConfig() const { return config; }
+};
+
+// also write the structured report records (RV_REPORT_JSON lines) that the calling thread emits to \p out,
+// nullptr stops. Servers use this to return the report of one request.
+void SetThreadReportStream(llvm::raw_ostream * out);
+
+} // namespace rv
+
+#endif // RV_VECTORIZERSESSION_H
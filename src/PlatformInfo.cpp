@@ -9,11 +9,13 @@
 
 #include "rv/PlatformInfo.h"
 #include "rv/resolver/listResolver.h"
+#include "rv/analysis/shapeSummary.h"
 #include "rv/intrinsics.h"
 
 #include "utils/rvTools.h"
 #include "rv/utils.h"
 
+#include <llvm/ADT/SmallString.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/raw_ostream.h>
@@ -21,6 +23,7 @@
 #include <llvm/ADT/Triple.h>
 
 #include "rvConfig.h"
+#include "report.h"
 
 #include <sstream>
 
@@ -70,10 +73,29 @@ PlatformInfo::registerDeclareSIMDFunction(Function & F) {
     if (!parseVectorMapping(F, attribText, vecMapping, true)) continue;
     addMapping(std::move(vecMapping));
   }
+
+  // LLVM's variant list: vector-function-abi-variant="_ZGV<..>_<name>(<vector name>),.."
+  auto variantAttr = F.getFnAttribute("vector-function-abi-variant");
+  if (!variantAttr.isValid()) return;
+
+  SmallVector<StringRef, 4> variants;
+  variantAttr.getValueAsString().split(variants, ',', -1, false);
+  for (StringRef variant : variants) {
+    auto mangledAndName = variant.trim().split('(');
+    StringRef mangledName = mangledAndName.first;
+    StringRef vectorName = mangledAndName.second.rtrim(')');
+
+    VectorMapping vecMapping;
+    if (!parseVectorMapping(F, mangledName, vecMapping, true, vectorName)) continue;
+    addMapping(std::move(vecMapping));
+  }
 }
 
 void
-PlatformInfo::addMapping(VectorMapping&& mapping) { listResolver->addMapping(std::move(mapping)); }
+PlatformInfo::addMapping(VectorMapping&& mapping) {
+  resolverMemo.clear();
+  listResolver->addMapping(std::move(mapping));
+}
 
 void
 PlatformInfo::addIntrinsicMappings() {
@@ -94,24 +116,44 @@ PlatformInfo::addIntrinsicMappings() {
   }
 }
 
+void
+PlatformInfo::registerModuleMappings() {
+  // add Rv intrinsic mappings
+  addIntrinsicMappings();
+
+  // register OpenMP "pragma omp declare simd" functions
+  for (auto & F : *mod) {
+    registerDeclareSIMDFunction(F);
+  }
+}
+
 PlatformInfo::PlatformInfo(Module &_mod, TargetTransformInfo *TTI,
                            TargetLibraryInfo *TLI)
-: mod(_mod)
+: mod(&_mod)
 , mTTI(TTI)
 , mTLI(TLI)
 , resolverServices()
 , listResolver(nullptr)
 {
-  resolverServices.push_back(std::unique_ptr<ResolverService>(new ListResolver(mod)));
+  resolverServices.push_back(std::unique_ptr<ResolverService>(new ListResolver(*mod)));
   listResolver = static_cast<ListResolver*>(&*resolverServices[0]);
 
-  // add Rv intrinsic mappings
-  addIntrinsicMappings();
+  registerModuleMappings();
+}
 
-  // register OpenMP "pragma omp declare simd" functions
-  for (auto & F : mod) {
-    registerDeclareSIMDFunction(F);
+void
+PlatformInfo::setModule(Module & newMod) {
+  // the analyses and mappings of the old module are stale
+  mod = &newMod;
+  mTTI = nullptr;
+  mTLI = nullptr;
+  resolverMemo.clear();
+  shapeSummaries.reset();
+  for (auto & resolver : resolverServices) {
+    resolver->resetModule(newMod);
   }
+
+  registerModuleMappings();
 }
 
 PlatformInfo::~PlatformInfo() {}
@@ -128,6 +170,17 @@ void
 PlatformInfo::addResolverService(std::unique_ptr<ResolverService>&& newResolver, bool givePrecedence) {
   auto itInsert = givePrecedence ? resolverServices.begin() : resolverServices.end();
   resolverServices.insert(itInsert, std::move(newResolver));
+  resolverMemo.clear();
+}
+
+// memo key of a getResolver query
+static void
+CreateResolverQueryKey(SmallVectorImpl<char> & key, StringRef funcName, const FunctionType & scaFuncTy,
+                       const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, int maxULPError) {
+  raw_svector_ostream out(key);
+  // (interned argument shapes compare by address)
+  out << funcName << '/' << (const void*) &scaFuncTy << '/' << vectorWidth << '/' << hasPredicate << '/' << maxULPError
+      << '/' << (const void*) InternShapes(argShapes);
 }
 
 std::unique_ptr<FunctionResolver>
@@ -135,31 +188,77 @@ PlatformInfo::getResolver(StringRef funcName,
                           FunctionType & scaFuncTy,
                           const VectorShapeVec & argShapes,
                           int vectorWidth,
-                          bool hasPredicate) const {
+                          bool hasPredicate,
+                          int maxULPError) const {
   IF_DEBUG_PLAT {
     errs() << "Resolver query:\n"
            << "scaName:  " << funcName << "\n"
            << "width:    " << vectorWidth << "\n"
            << "pred:     " << hasPredicate << "\n"
+           << "ulp:      " << maxULPError << "\n"
            << "argShapes:";
     for (auto argShape : argShapes) errs() << ", " << argShape.str();
     errs() << "\n";
   }
 
-  for (const auto & resolver : resolverServices) {
-    std::unique_ptr<FunctionResolver> funcResolver = resolver->resolve(funcName, scaFuncTy, argShapes, vectorWidth, hasPredicate, mod);
+  SmallString<128> queryKey;
+  CreateResolverQueryKey(queryKey, funcName, scaFuncTy, argShapes, vectorWidth, hasPredicate, maxULPError);
+
+  // repeated query: go straight to the service that answered it before
+  auto itMemo = resolverMemo.find(queryKey);
+  if (itMemo != resolverMemo.end()) {
+    if (itMemo->second < 0) return nullptr;
+    auto & resolver = *resolverServices[itMemo->second];
+    std::unique_ptr<FunctionResolver> funcResolver = resolver.resolveWithAccuracy(funcName, scaFuncTy, argShapes, vectorWidth, hasPredicate, maxULPError, *mod);
     if (funcResolver) return funcResolver;
   }
-  return nullptr;
+
+  // the cheapest answer (ties go to the earlier service)
+  std::unique_ptr<FunctionResolver> bestResolver;
+  int bestService = -1;
+  double bestCost = 0.0;
+  for (size_t i = 0; i < resolverServices.size(); ++i) {
+    std::unique_ptr<FunctionResolver> funcResolver = resolverServices[i]->resolveWithAccuracy(funcName, scaFuncTy, argShapes, vectorWidth, hasPredicate, maxULPError, *mod);
+    if (!funcResolver) continue;
+
+    // no estimate: take the first such answer unless a cheaper one is known already
+    FunctionCost cost = funcResolver->requestCostEstimate();
+    if (!cost.isKnown()) {
+      if (!bestResolver) {
+        bestResolver = std::move(funcResolver);
+        bestService = i;
+      }
+      break;
+    }
+    if (bestResolver && cost.cost >= bestCost) continue;
+
+    IF_DEBUG_PLAT { errs() << "\tservice " << i << ": cost " << cost.cost << "\n"; }
+    bestResolver = std::move(funcResolver);
+    bestService = i;
+    bestCost = cost.cost;
+  }
+
+  // replication is cheaper
+  if (bestResolver) {
+    FunctionCost bestReplCost = bestResolver->requestReplicationCostEstimate();
+    if (bestResolver->requestCostEstimate().isKnown() && bestReplCost.isKnown() && bestReplCost.cost < bestCost) {
+      IF_DEBUG_PLAT { errs() << "\treplication: cost " << bestReplCost.cost << "\n"; }
+      bestResolver = nullptr;
+      bestService = -1;
+    }
+  }
+
+  resolverMemo[queryKey] = bestService;
+  return bestResolver;
 }
 
 llvm::Function &
 PlatformInfo::requestRVIntrinsicFunc(RVIntrinsic rvIntrin) {
-  auto * func = mod.getFunction(GetIntrinsicName(rvIntrin));
+  auto * func = mod->getFunction(GetIntrinsicName(rvIntrin));
   if (func) return *func;
 
   // create a legal declaration
-  func = &DeclareIntrinsic(rvIntrin, mod);
+  func = &DeclareIntrinsic(rvIntrin, *mod);
 
   // add VA mappings
   auto vecMapping = GetIntrinsicMapping(*func, rvIntrin);
@@ -171,14 +270,14 @@ PlatformInfo::requestRVIntrinsicFunc(RVIntrinsic rvIntrin) {
 Function*
 PlatformInfo::requestVectorMaskReductionFunc(const std::string &name, size_t width) {
   std::string mangledName = name + "_v" + std::to_string(width);
-  auto *redFunc = mod.getFunction(mangledName);
+  auto *redFunc = mod->getFunction(mangledName);
   if (redFunc)
     return redFunc;
-  auto &context = mod.getContext();
+  auto &context = mod->getContext();
   auto *boolTy = Type::getInt1Ty(context);
   auto *vecBoolTy = FixedVectorType::get(boolTy, width);
   auto *funcTy = FunctionType::get(boolTy, vecBoolTy, false);
-  redFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
+  redFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, mod);
   redFunc->setDoesNotAccessMemory();
   redFunc->setDoesNotThrow();
   redFunc->setConvergent();
@@ -207,10 +306,16 @@ PlatformInfo::dump() const {
 
 
 bool
-PlatformInfo::forgetMapping(const VectorMapping & mapping) { return listResolver->forgetMapping(mapping); }
+PlatformInfo::forgetMapping(const VectorMapping & mapping) {
+  resolverMemo.clear();
+  return listResolver->forgetMapping(mapping);
+}
 
 void
-PlatformInfo::forgetAllMappingsFor(const Function & scaFunc) { listResolver->forgetAllMappingsFor(scaFunc); }
+PlatformInfo::forgetAllMappingsFor(const Function & scaFunc) {
+  resolverMemo.clear();
+  listResolver->forgetAllMappingsFor(scaFunc);
+}
 
 void
 PlatformInfo::print(llvm::raw_ostream & out) const {
@@ -223,9 +328,63 @@ PlatformInfo::print(llvm::raw_ostream & out) const {
   out << "] }\n";
 }
 
+void
+PlatformInfo::computeShapeSummaries() {
+  shapeSummaries.reset(new ShapeSummaries(*mod));
+}
+
+const ShapeSummary *
+PlatformInfo::getShapeSummary(const Function & F) const {
+  if (!shapeSummaries) return nullptr;
+  return shapeSummaries->getSummary(F);
+}
+
+std::string
+PlatformInfo::getVectorABIISA() const {
+  llvm::Triple Triple(getModule().getTargetTriple());
+  if (Triple.isX86() && mTTI) {
+    size_t vectorBits = getMaxVectorBits();
+    if (vectorBits >= 512) return "e";
+    if (vectorBits >= 256) return "d";
+    return "b";
+  }
+  if (Triple.isAArch64()) return "n";
+  return "_LLVM_";
+}
+
+// Vector Function ABI parameter token of \p argShape
+static std::string
+MangleVectorABIParam(const VectorShape & argShape) {
+  std::stringstream ss;
+  if (argShape.isUniform()) {
+    ss << "u";
+  } else if (argShape.isVarying()) {
+    ss << "v";
+  } else {
+    int stride = argShape.getStride();
+    ss << "l";
+    if (stride < 0) ss << "n" << -stride;
+    else if (stride != 1) ss << stride;
+  }
+  if (argShape.getAlignmentFirst() > 1) {
+    ss << "a" << argShape.getAlignmentFirst();
+  }
+  return ss.str();
+}
+
 std::string
 PlatformInfo::createMangledVectorName(StringRef scalarName, const VectorShapeVec & argShapes, int vectorWidth, int maskPos) {
-  // TODO use VectorABI mangling when aplicable
+  // the Vector Function ABI passes the mask last
+  bool maskLast = maskPos < 0 || maskPos == (int) argShapes.size();
+  if (maskLast && !CheckFlag("RV_LEGACY_MANGLING")) {
+    std::stringstream ss;
+    ss << "_ZGV" << getVectorABIISA() << (maskPos >= 0 ? "M" : "N") << vectorWidth;
+    for (const auto & argShape : argShapes) {
+      ss << MangleVectorABIParam(argShape);
+    }
+    ss << "_" << scalarName.str();
+    return ss.str();
+  }
 
   std::stringstream ss;
   ss
@@ -253,11 +412,11 @@ PlatformInfo::createMangledVectorName(StringRef scalarName, const VectorShapeVec
 llvm::Function &
 PlatformInfo::requestIntrinsic(RVIntrinsic id, llvm::Type * DataTy) {
   std::string MangledName = GetIntrinsicName(id, DataTy);
-  Function *F = mod.getFunction(MangledName);
+  Function *F = mod->getFunction(MangledName);
   if (F) return *F;
 
   // declare and register with platInfo for this module
-  F = &DeclareIntrinsic(id, mod, DataTy);
+  F = &DeclareIntrinsic(id, *mod, DataTy);
   auto vecMapping = GetIntrinsicMapping(*F, id);
   addMapping(std::move(vecMapping));
   return *F;
@@ -39,54 +39,69 @@ GetAccessedPointer(const Instruction & I) {
 
 void
 AllocaSSA::computeLiveness() {
-  SmallPtrSet<BasicBlock*, 2> endingBlocks;
-  region.getEndingBlocks(endingBlocks);
+  // allocas loaded from in every block
+  std::vector<SmallVector<unsigned, 4>> blockLoads(rpoBlocks.size());
+  for (unsigned i = 0; i < rpoBlocks.size(); ++i) {
+    for (auto & inst : *rpoBlocks[i]) {
+      if (!isa<LoadInst>(inst)) continue;
+      const auto * ptr = GetAccessedPointer(inst);
+      if (!isa<Instruction>(ptr)) continue;
+      const auto & ptrProv = getProvenance(*ptr);
+      for (auto * liveAlloc : ptrProv.allocs) { // TODO support for wildcard..
+        IF_DEBUG_LN errs() << "Live " << liveAlloc->getName() << " in " << rpoBlocks[i]->getName() << "\n";
+        auto itIndex = allocaIndex.try_emplace(liveAlloc, loadedAllocas.size());
+        if (itIndex.second) loadedAllocas.push_back(liveAlloc);
+        blockLoads[i].push_back(itIndex.first->second);
+      }
+    }
+  }
 
-  std::vector<BasicBlock*> stack;
-  for (auto * BB : endingBlocks) stack.push_back(BB);
+  liveIn.assign(rpoBlocks.size(), BitVector(loadedAllocas.size()));
+  for (unsigned i = 0; i < rpoBlocks.size(); ++i) {
+    for (unsigned allocIdx : blockLoads[i]) liveIn[i].set(allocIdx);
+  }
+  if (loadedAllocas.empty()) return;
 
-  std::set<const BasicBlock*> alreadyVisited;
+  // backward propagation, blocks are taken off the stack in post order first
+  std::vector<unsigned> stack;
+  BitVector onStack(rpoBlocks.size(), true);
+  for (unsigned i = 0; i < rpoBlocks.size(); ++i) stack.push_back(i);
 
   while (!stack.empty()) {
-    auto & currBlock = *stack.back();
+    unsigned blockIdx = stack.back();
     stack.pop_back();
+    onStack.reset(blockIdx);
 
-    IF_DEBUG_LN errs() << "live inspect " << currBlock.getName() << "\n";
-
-    bool changed = alreadyVisited.insert(&currBlock).second;
-    IF_DEBUG_LN errs() << "\tfirst: " << changed << "\n";
-    auto & summary = requestBlockSummary(currBlock);
-
-    // mark alloca live if used
-    for (auto & inst : currBlock) {
-      if (isa<LoadInst>(inst)) {
-        const auto * ptr = GetAccessedPointer(inst);
-        if (!isa<Instruction>(ptr)) continue;
-        PtrProvenance ptrProv = getProvenance(cast<Instruction>(*ptr));
-        for (auto * liveAlloc : ptrProv.allocs) { // TODO support for wildcard..
-          IF_DEBUG_LN errs() << "Live " << liveAlloc->getName() << "\n";
-          changed |= summary.liveAllocas.insert(liveAlloc).second;
-        }
-      }
-    }
-
-    for (auto * pred : predecessors(&currBlock)) {
-      bool predChanged = changed;
+    for (auto * pred : predecessors(rpoBlocks[blockIdx])) {
+      auto itPred = blockIndex.find(pred);
+      if (itPred == blockIndex.end()) continue; // outside of the region
 
       // dont need to transfer to self
-      if (pred == &currBlock) continue;
+      unsigned predIdx = itPred->second;
+      if (predIdx == blockIdx) continue;
 
       // transfer liveness to predecessors
-      auto & predSummary = requestBlockSummary(*pred);
-      for (auto * liveAlloc : summary.liveAllocas) {
-        predChanged |= predSummary.liveAllocas.insert(liveAlloc).second;
+      if (!liveIn[blockIdx].test(liveIn[predIdx])) continue;
+      liveIn[predIdx] |= liveIn[blockIdx];
+      if (!onStack.test(predIdx)) {
+        onStack.set(predIdx);
+        stack.push_back(predIdx);
       }
-
-      if (predChanged) stack.push_back(pred);
     }
   }
 }
 
+AllocSet
+AllocaSSA::getLiveAllocas(const BasicBlock & BB) const {
+  AllocSet liveAllocas;
+  auto itBlock = blockIndex.find(&BB);
+  if (itBlock == blockIndex.end()) return liveAllocas;
+  for (unsigned allocIdx : liveIn[itBlock->second].set_bits()) {
+    liveAllocas.insert(loadedAllocas[allocIdx]);
+  }
+  return liveAllocas;
+}
+
 void
 AllocaSSA::computePointerProvenance() {
   std::vector<const BasicBlock*> worklist;
@@ -159,8 +174,9 @@ AllocaSSA::print(raw_ostream & out) const {
         if (!summary->getJoinSet().isBottom()) {
             out << "\t join "; summary->getJoinSet().print(out) << "\n";
         }
-        if (!summary->liveAllocas.empty()) {
-            out << "\t live "; Print(summary->liveAllocas, out) << "\n";
+        auto liveAllocas = getLiveAllocas(BB);
+        if (!liveAllocas.empty()) {
+            out << "\t live "; Print(liveAllocas, out) << "\n";
         }
         blockPrinted = true;
       }
@@ -251,6 +267,12 @@ GetWrittenPointers(const Instruction & inst, SmallVector<const Value*, 1> & writ
 
 void
 AllocaSSA::compute() {
+  region.for_blocks_rpo([this](const BasicBlock & BB) {
+    blockIndex[&BB] = rpoBlocks.size();
+    rpoBlocks.push_back(&BB);
+    return true;
+  });
+
   computePointerProvenance();
 
   computeLiveness();
@@ -264,18 +286,14 @@ AllocaSSA::compute() {
     allocVec.push_back(allocInst);
   }
 
-  std::set<const BasicBlock*> worklist;
-  worklist.insert(&region.getRegionEntry());
-
-  bool keepGoing = true;
-  while (keepGoing) {
+  // blocks scheduled for the next RPO sweep
+  BitVector worklist(rpoBlocks.size());
+  worklist.set(blockIndex.lookup(&region.getRegionEntry()));
 
-    keepGoing = false;
-    region.for_blocks_rpo([&](const BasicBlock & currBlock) {
-      auto itItem = worklist.find(&currBlock);
-      // skip this block if its not scheduled
-      if (itItem == worklist.end()) return true;
-      worklist.erase(itItem);
+  while (worklist.any()) {
+    for (int blockIdx = worklist.find_first(); blockIdx != -1; blockIdx = worklist.find_next(blockIdx)) {
+      worklist.reset(blockIdx);
+      const BasicBlock & currBlock = *rpoBlocks[blockIdx];
 
       BlockSummary & summary = requestBlockSummary(currBlock);
       DefMap oldLastDefs = summary.lastDef;
@@ -310,7 +328,6 @@ AllocaSSA::compute() {
 
       // update join
       bool blockChanged = summary.allocJoin.provSet.merge(joinSet);
-      keepGoing |= blockChanged;
 
       // register join as live-in definition
       // TODO implement wildcard support
@@ -364,17 +381,15 @@ AllocaSSA::compute() {
         summary.lastDef = lastDefMap;
       }
 
-      keepGoing |= blockChanged;
-      if (!blockChanged) return true;
+      if (!blockChanged) continue;
 
       // push successors
       auto & term = *currBlock.getTerminator();
       for (int i = 0; i < (int) term.getNumSuccessors(); ++i) {
-        worklist.insert(term.getSuccessor(i));
+        auto itSucc = blockIndex.find(term.getSuccessor(i));
+        if (itSucc != blockIndex.end()) worklist.set(itSucc->second);
       }
-
-      return !worklist.empty(); // keep going
-    });
+    }
   }
 }
 
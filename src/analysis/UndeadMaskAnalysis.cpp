@@ -214,6 +214,42 @@ bool UndeadMaskAnalysis::isUndead(const Value &mask, const BasicBlock &where) {
   return false;
 }
 
+bool UndeadMaskAnalysis::isAllTrue(const Value &mask, const BasicBlock &where) {
+  if (IsConstMask(mask, true))
+    return true;
+
+  // look for a dominating rv_all(c) branch taken on true where c implies @mask
+  auto *domNode = domTree.getNode(const_cast<BasicBlock *>(&where));
+  for (; domNode; domNode = domNode->getIDom()) {
+    const auto *block = domNode->getBlock();
+    if (!vecInfo.getRegion().contains(block))
+      return false;
+
+    const auto *predBlock = GetUniquePredecessor(*block);
+    if (!predBlock)
+      continue;
+    auto *predBranch = dyn_cast<BranchInst>(predBlock->getTerminator());
+    if (!predBranch || !predBranch->isConditional() ||
+        IsTargetOnFalse(*predBranch, *block))
+      continue;
+
+    const auto *predCond = predBranch->getCondition();
+    if (GetIntrinsicID(*predCond) != RVIntrinsic::All)
+      continue;
+
+    // rv_all only considers the lanes that are active in the branching block
+    auto *predMask = vecInfo.getPredicate(*predBlock);
+    if (predMask && !isAllTrue(*predMask, *predBlock))
+      return false;
+
+    const auto *allArg = cast<const CallInst>(predCond)->getArgOperand(0);
+    if (implies(*allArg, false, mask, false))
+      return true;
+  }
+
+  return false;
+}
+
 void UndeadMaskAnalysis::print(raw_ostream &Out) {
   Out << "UDM {\n";
   vecInfo.getRegion().for_blocks_rpo([&](const BasicBlock &BB) {
@@ -15,9 +15,15 @@
 #include "utils/mathUtils.h"
 #include "utils/rvTools.h"
 
+#include "llvm/Analysis/AssumeBundleQueries.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Dominators.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/ThreadPool.h"
 
 #include "report.h"
 #include <fstream>
@@ -33,6 +39,11 @@
 // FIXME
 const bool IsLCSSAForm = true;
 
+// functions below this size run the fixed point on one thread (see Config::vaThreads)
+static const unsigned VAParallelMinInsts = 10000;
+// rounds with fewer concurrent transfer functions evaluate them on the calling thread
+static const size_t VAParallelMinRound = 256;
+
 using namespace llvm;
 
 
@@ -46,17 +57,64 @@ VectorizationAnalysis::VectorizationAnalysis(Config _config,
       layout(platInfo.getDataLayout()),
       LI(*FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction())),
       DT(FAM.getResult<DominatorTreeAnalysis>(vecInfo.getScalarFunction())),
-      SDA(DT,
-          FAM.getResult<PostDominatorTreeAnalysis>(vecInfo.getScalarFunction()),
-          LI),
-      PredA(vecInfo, FAM.getResult<PostDominatorTreeAnalysis>(
-                         vecInfo.getScalarFunction())),
+      PDT(FAM.getResult<PostDominatorTreeAnalysis>(vecInfo.getScalarFunction())),
+      PredA(vecInfo, PDT, GetControlDependence(vecInfo.getScalarFunction(), FAM)),
       funcRegion(vecInfo.getScalarFunction()),
       funcRegionWrapper(funcRegion), // FIXME
       allocaSSA(funcRegionWrapper) {
   // compute pointer provenance
   allocaSSA.compute();
   IF_DEBUG_VA allocaSSA.print(errs());
+
+  collectAlignmentFacts(vecInfo.getScalarFunction(), FAM);
+}
+
+void VectorizationAnalysis::collectAlignmentFacts(const Function &F,
+                                                  FunctionAnalysisManager &FAM) {
+  auto &TLI = FAM.getResult<TargetLibraryAnalysis>(const_cast<Function &>(F));
+  const Instruction *regionCxt = &*vecInfo.getEntry().getFirstInsertionPt();
+
+  auto addFact = [&](const Value &ptr, uint64_t alignment) {
+    if (!ptr.getType()->isPointerTy() || alignment <= 1 || !isPowerOf2_64(alignment))
+      return;
+    auto &known = alignFacts[&ptr];
+    known = std::max<align_t>(known, alignment);
+  };
+
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      const auto *call = dyn_cast<CallBase>(&I);
+      if (!call)
+        continue;
+
+      // aligned_alloc, aligned new, ..
+      if (auto *allocAlign = dyn_cast_or_null<ConstantInt>(getAllocAlignment(call, &TLI))) {
+        addFact(*call, allocAlign->getZExtValue());
+        continue;
+      }
+
+      // __builtin_assume_aligned, omp simd aligned(..): the assumption has to
+      // hold where the region (or the in-region definition) executes
+      auto *assume = dyn_cast<AssumeInst>(call);
+      if (!assume)
+        continue;
+      for (const auto &BOI : assume->bundle_op_infos()) {
+        auto RK = getKnowledgeFromBundle(*const_cast<AssumeInst *>(assume), BOI);
+        if (RK.AttrKind != Attribute::Alignment || !RK.WasOn)
+          continue;
+        const auto *defInst = dyn_cast<Instruction>(RK.WasOn);
+        const Instruction *cxt = defInst && vecInfo.inRegion(*defInst) ? defInst : regionCxt;
+        if (!isValidAssumeForContext(assume, cxt, &DT))
+          continue;
+        addFact(*RK.WasOn, RK.ArgValue);
+      }
+    }
+  }
+
+  IF_DEBUG_VA {
+    for (const auto &it : alignFacts)
+      errs() << "VA: alignment fact " << it.second << " for " << *it.first << "\n";
+  }
 }
 
 bool VectorizationAnalysis::putOnWorklist(const llvm::Instruction &inst) {
@@ -240,16 +298,16 @@ void VectorizationAnalysis::propagateControlDivergence(
   // divergent due to divergence in in \p Term.
 
   // Disjoint-paths joins.
-  const auto &DivDesc = SDA.getJoinBlocks(rootNode);
+  const auto &Joins = getJoinPoints(rootNode);
 
-  for (const BasicBlock *JoinBlock : DivDesc.JoinDivBlocks) {
+  for (const BasicBlock *JoinBlock : Joins.joinDivBlocks) {
     vecInfo.addJoinDivergentBlock(*JoinBlock);
     pushPHINodes(*JoinBlock);
   }
 
   // Identified divergent loop exits.
   const Loop *L = BranchLoop;
-  for (const BasicBlock *ExitBlock : DivDesc.LoopDivBlocks) {
+  for (const BasicBlock *ExitBlock : Joins.loopDivBlocks) {
     auto ExitLoop = LI.getLoopFor(ExitBlock);
     while (L && L != ExitLoop) {
       vecInfo.addDivergentLoop(*L);
@@ -261,6 +319,21 @@ void VectorizationAnalysis::propagateControlDivergence(
   }
 }
 
+const VectorizationInfo::JoinPoints &
+VectorizationAnalysis::getJoinPoints(const Instruction &Term) {
+  if (const auto *Cached = vecInfo.getCachedJoinPoints(Term))
+    return *Cached;
+
+  if (!SDA)
+    SDA.reset(new SyncDependenceAnalysis(DT, PDT, LI));
+  const auto &DivDesc = SDA->getJoinBlocks(Term);
+
+  VectorizationInfo::JoinPoints Joins;
+  Joins.joinDivBlocks.append(DivDesc.JoinDivBlocks.begin(), DivDesc.JoinDivBlocks.end());
+  Joins.loopDivBlocks.append(DivDesc.LoopDivBlocks.begin(), DivDesc.LoopDivBlocks.end());
+  return vecInfo.cacheJoinPoints(Term, std::move(Joins));
+}
+
 void VectorizationAnalysis::propagateBranchDivergence(const Instruction &Term) {
   IF_DEBUG_VA {
     errs() << "VE: propBranchDiv " << Term.getParent()->getName() << "\n";
@@ -298,55 +371,139 @@ void VectorizationAnalysis::propagateLoopDivergence(const Loop &ExitingLoop) {
 void VectorizationAnalysis::compute(const Function &F) {
   IF_DEBUG_VA { errs() << "\n\n-- VA::compute() log -- \n"; }
 
-  VectorShapeTransformer vecShapeTrans(layout, LI, platInfo, vecInfo);
+  unsigned numThreads = config.vaThreads > 0 ? config.vaThreads : hardware_concurrency().compute_thread_count();
+  if (numThreads > 1 && F.getInstructionCount() >= VAParallelMinInsts) {
+    computeParallel(F, numThreads);
+    return;
+  }
+
+  VectorShapeTransformer vecShapeTrans(layout, LI, platInfo, vecInfo, &alignFacts);
 
   // main fixed point loop
   while (const Instruction *nextI = takeFromWorklist()) {
-    const Instruction &I = *nextI;
+    computeStep(*nextI, vecShapeTrans);
+  }
+}
 
-    if (vecInfo.isPinned(I)) {
-      continue;
-    }
+void VectorizationAnalysis::computeStep(const Instruction &I, VectorShapeTransformer &vecShapeTrans) {
+  if (vecInfo.isPinned(I)) {
+    return;
+  }
 
-    IF_DEBUG_VA { errs() << "# next: " << I << "\n"; }
+  IF_DEBUG_VA { errs() << "# next: " << I << "\n"; }
 
-    // Queue all missing operands on first visit
-    bool FirstVisit = !vecInfo.hasKnownShape(I);
+  // Queue all missing operands on first visit
+  bool FirstVisit = !vecInfo.hasKnownShape(I);
 
-    // Compute at least an explicit 'undef' shape for PHINodes to break dependence cycles.
-    if (!isa<PHINode>(I) && FirstVisit && pushMissingOperands(I))
-      continue;
+  // Compute at least an explicit 'undef' shape for PHINodes to break dependence cycles.
+  if (!isa<PHINode>(I) && FirstVisit && pushMissingOperands(I))
+    return;
 
-    // check whether this terminator switches to a divergent state
-    if (I.isTerminator() && updateTerminator(I)) {
-      vecInfo.setVectorShape(I, VectorShape::varying());
-      // propagate control divergence to affected instructions
-      propagateBranchDivergence(I);
-      continue;
+  // check whether this terminator switches to a divergent state
+  if (I.isTerminator() && updateTerminator(I)) {
+    vecInfo.setVectorShape(I, VectorShape::varying());
+    // propagate control divergence to affected instructions
+    propagateBranchDivergence(I);
+    return;
+  }
+
+  // Query the transformer
+  SmallValVec taintedPtrOps;
+  VectorShape New = vecShapeTrans.computeShape(I, taintedPtrOps);
+  applyShape(I, New, taintedPtrOps);
+}
+
+void VectorizationAnalysis::applyShape(const Instruction &I, VectorShape New, const SmallValVec &taintedPtrOps) {
+  // taint allocas
+  for (auto *ptr : taintedPtrOps) {
+    const auto &prov = allocaSSA.getProvenance(*ptr);
+    for (const auto *allocaInst : prov.allocs) {
+      // Out-of-region allocas are shared
+      if (!vecInfo.inRegion(*allocaInst))
+        continue;
+
+      // In-region allocas are private
+      updateShape(*allocaInst, VectorShape::varying());
     }
+  }
+
+  IF_DEBUG_VA { errs() << "\t computed: " << New.str() << "\n"; }
+
+  // if shape changed put users on worklist
+  updateShape(I, New);
+}
 
-    // Query the transformer
+bool VectorizationAnalysis::isConcurrentStep(const Instruction &I) {
+  // calls query (and may run) the resolvers, allocas note the width, terminators propagate divergence
+  return !I.isTerminator() && !isa<CallBase>(I) && !isa<AllocaInst>(I);
+}
+
+void VectorizationAnalysis::computeParallel(const Function &F, unsigned numThreads) {
+  // the workers only read the VectorizationInfo, each one with its own transformer (and struct layout cache)
+  VectorShapeTransformer serialTrans(layout, LI, platInfo, vecInfo, &alignFacts);
+  std::vector<VectorShapeTransformer> workerTrans(numThreads, serialTrans);
+  ThreadPool pool(hardware_concurrency(numThreads));
+
+  struct StepResult {
+    VectorShape shape;
     SmallValVec taintedPtrOps;
-    VectorShape New = vecShapeTrans.computeShape(I, taintedPtrOps);
-
-    // taint allocas
-    for (auto *ptr : taintedPtrOps) {
-      const auto &prov = allocaSSA.getProvenance(*ptr);
-      for (const auto *allocaInst : prov.allocs) {
-        // Out-of-region allocas are shared
-        if (!vecInfo.inRegion(*allocaInst))
-          continue;
+  };
+  std::vector<const Instruction *> round;
+  std::vector<const Instruction *> concurrent;
+  std::vector<StepResult> results;
+  size_t numRounds = 0, numConcurrent = 0;
+
+  // Jacobi rounds: all transfer functions of a round see the shapes from before the round, the results are applied in
+  // worklist order. Neither depends on the number of threads and the shapes only grow by joins, so this reaches the
+  // fixed point of the serial loop.
+  while (!mWorklist.empty()) {
+    ++numRounds;
+    round.clear();
+    while (const Instruction *I = takeFromWorklist()) round.push_back(I);
+
+    // steps that are not plain transfer functions on known operand shapes run serially in the apply loop
+    concurrent.clear();
+    for (const Instruction *I : round) {
+      if (vecInfo.isPinned(*I) || !isConcurrentStep(*I)) continue;
+      bool missingOps = !isa<PHINode>(I) && !vecInfo.hasKnownShape(*I) &&
+                        any_of(I->operands(), [&](const Value *op) { return isa<Instruction>(op) && !vecInfo.hasKnownShape(*op); });
+      if (!missingOps) concurrent.push_back(I);
+    }
+    numConcurrent += concurrent.size();
 
-        // In-region allocas are private
-        updateShape(*allocaInst, VectorShape::varying());
+    results.assign(concurrent.size(), StepResult());
+    auto computeSlice = [&](unsigned slice, unsigned numSlices) {
+      size_t begin = concurrent.size() * slice / numSlices, end = concurrent.size() * (slice + 1) / numSlices;
+      for (size_t i = begin; i < end; ++i) {
+        results[i].shape = workerTrans[slice].computeShape(*concurrent[i], results[i].taintedPtrOps);
       }
+    };
+    if (concurrent.size() < VAParallelMinRound) {
+      computeSlice(0, 1);
+    } else {
+      for (unsigned slice = 0; slice < numThreads; ++slice) {
+        pool.async([&computeSlice, slice, numThreads] { computeSlice(slice, numThreads); });
+      }
+      pool.wait();
     }
 
-    IF_DEBUG_VA { errs() << "\t computed: " << New.str() << "\n"; }
+    // apply (concurrent is a subsequence of round)
+    size_t nextConcurrent = 0;
+    for (const Instruction *I : round) {
+      if (nextConcurrent < concurrent.size() && concurrent[nextConcurrent] == I) {
+        IF_DEBUG_VA { errs() << "# next: " << *I << "\n"; }
+        applyShape(*I, results[nextConcurrent].shape, results[nextConcurrent].taintedPtrOps);
+        ++nextConcurrent;
+      } else {
+        computeStep(*I, serialTrans);
+      }
+    }
+  }
 
-    // if shape changed put users on worklist
-    updateShape(I, New);
-  };
+  IF_DEBUG_VA {
+    errs() << "VA: " << numRounds << " rounds on " << numThreads << " threads, " << numConcurrent
+           << " concurrent transfer functions\n";
+  }
 }
 
 void VectorizationAnalysis::analyze() {
@@ -362,33 +519,109 @@ void VectorizationAnalysis::analyze() {
   // replace undef instruction shapes with uniform
   promoteUndefShapesToUniform(F);
 
-  // mark all non-loop exiting branches as divergent to trigger a full
-  // linearization
-  // FIXME factor this out into a separate transformation
-  if (config.foldAllBranches) {
-    for (auto &BB : F) {
-      auto &term = *BB.getTerminator();
-      if (term.getNumSuccessors() <= 1)
-        continue; // uninteresting
+  foldAllBranches(F);
 
-      if (!vecInfo.inRegion(BB))
-        continue; // no begin vectorized
+  IF_DEBUG_VA {
+    errs() << "VecInfo after VA:\n";
+    vecInfo.dump();
+  }
+}
 
-      auto *loop = LI.getLoopFor(&BB);
-      bool keepShape = loop && loop->isLoopExiting(&BB);
+void VectorizationAnalysis::updateAnalysis(InstVec &updateList) {
+  auto &F = vecInfo.getScalarFunction();
+  assert(!F.isDeclaration());
 
-      if (!keepShape) {
-        vecInfo.setVectorShape(term, VectorShape::varying());
-      }
+  IF_DEBUG_VA { errs() << "\n\n-- VA::updateAnalysis() log -- \n"; }
+
+  // seeds: the updated instructions and all new (shapeless) instructions
+  std::vector<const Instruction *> Stack(updateList.begin(), updateList.end());
+  for (const BasicBlock &BB : F) {
+    if (!vecInfo.inRegion(BB))
+      continue;
+    if (!vecInfo.hasKnownShape(BB))
+      vecInfo.setVectorShape(BB, VectorShape::uni());
+    for (const Instruction &I : BB) {
+      if (!vecInfo.hasKnownShape(I))
+        Stack.push_back(&I);
+    }
+  }
+
+  // the cone of affected instructions
+  std::unordered_set<const Instruction *> Affected;
+  while (!Stack.empty()) {
+    const Instruction *I = Stack.back();
+    Stack.pop_back();
+    if (!vecInfo.inRegion(*I) || !Affected.insert(I).second)
+      continue;
+
+    // control divergence of this terminator may have become stale
+    if (I->isTerminator() && !vecInfo.isPinned(*I) &&
+        vecInfo.hasKnownShape(*I) && getShape(*I).isVarying()) {
+      Report() << "VA: divergent terminator affected by update, re-running full analysis.\n";
+      vecInfo.forgetInferredProperties();
+      analyze();
+      return;
+    }
+
+    for (const auto *User : I->users()) {
+      if (const auto *UserInst = dyn_cast<Instruction>(User))
+        Stack.push_back(UserInst);
     }
   }
 
   IF_DEBUG_VA {
-    errs() << "VecInfo after VA:\n";
+    errs() << "VA: re-computing " << Affected.size() << " instructions\n";
+  }
+
+  // forget inferred shapes on the cone and re-propagate from there
+  for (const Instruction *I : Affected) {
+    if (!vecInfo.isPinned(*I))
+      vecInfo.dropVectorShape(*I);
+  }
+  adjustValueShapes(F);
+  for (const Instruction *I : Affected) {
+    if (isa<AllocaInst>(I) && !vecInfo.isPinned(*I)) {
+      vecInfo.noteWidthDependence();
+      updateShape(*I, VectorShape::uni(vecInfo.getMapping().vectorWidth));
+    } else {
+      putOnWorklist(*I);
+    }
+  }
+
+  compute(F);
+  promoteUndefShapesToUniform(F);
+  foldAllBranches(F);
+
+  IF_DEBUG_VA {
+    errs() << "VecInfo after VA update:\n";
     vecInfo.dump();
   }
 }
 
+void VectorizationAnalysis::foldAllBranches(const Function &F) {
+  // mark all non-loop exiting branches as divergent to trigger a full
+  // linearization
+  // FIXME factor this out into a separate transformation
+  if (!config.foldAllBranches)
+    return;
+
+  for (auto &BB : F) {
+    auto &term = *BB.getTerminator();
+    if (term.getNumSuccessors() <= 1)
+      continue; // uninteresting
+
+    if (!vecInfo.inRegion(BB))
+      continue; // no begin vectorized
+
+    auto *loop = LI.getLoopFor(&BB);
+    bool keepShape = loop && loop->isLoopExiting(&BB);
+
+    if (!keepShape) {
+      vecInfo.setVectorShape(term, VectorShape::varying());
+    }
+  }
+}
+
 static bool AllUniformOrUndefCall(const VectorizationInfo & VecInfo, const Instruction &I) {
   const auto *C = dyn_cast<CallInst>(&I);
   if (!C) return false;
@@ -408,7 +641,7 @@ void VectorizationAnalysis::promoteUndefShapesToUniform(const Function &F) {
   // Walk through the program and query recursive resolvers for all completly
   // unifrom calls we have missed
 
-  VectorShapeTransformer vecShapeTrans(layout, LI, platInfo, vecInfo);
+  VectorShapeTransformer vecShapeTrans(layout, LI, platInfo, vecInfo, &alignFacts);
 
   std::vector<const CallInst*> CVec;
   for (const BasicBlock &BB : F) {
@@ -428,6 +661,9 @@ void VectorizationAnalysis::adjustValueShapes(const Function &F) {
     align_t ArgAlign = 1;
     if (arg.getType()->isPointerTy()) {
       ArgAlign = arg.getPointerAlignment(layout).value();
+      auto itFact = alignFacts.find(&arg);
+      if (itFact != alignFacts.end())
+        ArgAlign = std::max<align_t>(ArgAlign, itFact->second);
     }
 
     if (!vecInfo.hasKnownShape(arg)) {
@@ -444,10 +680,44 @@ void VectorizationAnalysis::adjustValueShapes(const Function &F) {
         std::max<align_t>(ArgAlign, argShape.getAlignmentFirst()));
     vecInfo.setVectorShape(arg, argShape);
   }
+
+  // Values of the region's context that are stated to be aligned
+  for (const auto &it : alignFacts) {
+    const auto *inst = dyn_cast<Instruction>(it.first);
+    if (!inst || vecInfo.inRegion(*inst) || vecInfo.hasKnownShape(*inst))
+      continue;
+    vecInfo.setVectorShape(*inst, VectorShape::uni(std::max<align_t>(it.second, inst->getPointerAlignment(layout).value())));
+  }
+}
+
+// shape hints in the source (rv_uniform(V), rv_strided(V, S)) hold by contract
+static void
+PinShapeHints(VectorizationInfo & vecInfo) {
+  vecInfo.getRegion().for_blocks([&](const BasicBlock &BB) {
+    for (const Instruction &I : BB) {
+      auto id = GetIntrinsicID(I);
+      if (id == RVIntrinsic::Uniform) {
+        vecInfo.setPinnedShape(I, VectorShape::uni());
+      } else if (id == RVIntrinsic::Strided) {
+        auto * stride = dyn_cast<ConstantInt>(I.getOperand(1));
+        if (stride) vecInfo.setPinnedShape(I, VectorShape::strided(stride->getSExtValue()));
+      }
+    }
+    return true;
+  });
 }
 
 void VectorizationAnalysis::init(const Function &F) {
   adjustValueShapes(F);
+  PinShapeHints(vecInfo);
+
+  // a partial entry mask reaches every block of the region
+  if (vecInfo.getEntryMask()) {
+    vecInfo.getRegion().for_blocks([&](const BasicBlock &BB) {
+      vecInfo.setVaryingPredicateFlag(BB, true);
+      return true;
+    });
+  }
 
   // Propagation of vector shapes starts at values that do not depend on other
   // values:
@@ -468,6 +738,7 @@ void VectorizationAnalysis::init(const Function &F) {
 
     for (const Instruction &I : BB) {
       if (isa<AllocaInst>(&I)) {
+        vecInfo.noteWidthDependence();
         updateShape(I, VectorShape::uni(vecInfo.getMapping().vectorWidth));
       } else if (const CallInst *call = dyn_cast<CallInst>(&I)) {
         if (!call->arg_empty())
@@ -0,0 +1,143 @@
+//===- src/analysis/controlDependence.cpp - cached control dependences --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/analysis/controlDependence.h"
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/PostDominators.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Function.h>
+
+#include <utility>
+
+using namespace llvm;
+
+namespace rv {
+
+AnalysisKey ControlDependenceAnalysis::Key;
+
+// the successors of \p block without duplicates
+static SmallVector<const BasicBlock*, 4>
+GetUniqueSuccessors(const BasicBlock & block) {
+  SmallPtrSet<const BasicBlock*, 4> seen;
+  SmallVector<const BasicBlock*, 4> succs;
+  for (const auto * succ : successors(&block)) {
+    if (seen.insert(succ).second) succs.push_back(succ);
+  }
+  return succs;
+}
+
+// the immediate post dominator of \p block (nullptr for the virtual exit)
+static const BasicBlock *
+GetIPDom(const PostDominatorTree & PDT, const BasicBlock & block) {
+  const auto * node = PDT.getNode(&block);
+  const auto * idom = node ? node->getIDom() : nullptr;
+  return idom ? idom->getBlock() : nullptr;
+}
+
+// fill the rows \p offsets, \p rows from the (row, entry) pairs \p pairs (sorted by row, stable)
+static void
+BuildRows(size_t numRows, const std::vector<std::pair<unsigned, const BasicBlock*>> & pairs,
+          std::vector<unsigned> & offsets, std::vector<const BasicBlock*> & rows) {
+  offsets.assign(numRows + 1, 0);
+  for (const auto & it : pairs) ++offsets[it.first + 1];
+  for (size_t i = 0; i < numRows; ++i) offsets[i + 1] += offsets[i];
+
+  rows.resize(pairs.size());
+  std::vector<unsigned> fillPos(offsets.begin(), offsets.end() - 1);
+  for (const auto & it : pairs) rows[fillPos[it.first]++] = it.second;
+}
+
+ControlDependence::ControlDependence(const Function & F, const PostDominatorTree & PDT) {
+  std::vector<const BasicBlock*> blocks;
+  for (const auto & block : F) {
+    blockIndex[&block] = blocks.size();
+    blocks.push_back(&block);
+  }
+
+  std::vector<std::pair<unsigned, const BasicBlock*>> cdepPairs;
+  std::vector<std::pair<unsigned, const BasicBlock*>> regionPairs;
+  // blocks visited by the current region walk
+  std::vector<unsigned> visitStamp(blocks.size(), 0);
+  unsigned stamp = 0;
+
+  for (unsigned branchIdx = 0; branchIdx < blocks.size(); ++branchIdx) {
+    const auto & branchBlock = *blocks[branchIdx];
+    auto succs = GetUniqueSuccessors(branchBlock);
+    if (succs.size() < 2) continue;
+    const auto * pdBound = GetIPDom(PDT, branchBlock);
+
+    // direct control dependences: the post dominator tree paths from the successors up to the bound
+    for (const auto * succ : succs) {
+      for (const auto * runner = succ; runner && runner != pdBound; runner = GetIPDom(PDT, *runner)) {
+        cdepPairs.emplace_back(blockIndex[runner], &branchBlock);
+      }
+    }
+
+    // influence region: everything reachable from the successors before the bound
+    ++stamp;
+    SmallVector<const BasicBlock*, 16> stack(succs.begin(), succs.end());
+    while (!stack.empty()) {
+      const auto * block = stack.pop_back_val();
+      if (block == pdBound) continue;
+      unsigned idx = blockIndex[block];
+      if (visitStamp[idx] == stamp) continue;
+      visitStamp[idx] = stamp;
+      regionPairs.emplace_back(branchIdx, block);
+      for (const auto * succ : successors(block)) stack.push_back(succ);
+    }
+  }
+
+  // cdepPairs are keyed by the dependent block, their rows are in branch order
+  BuildRows(blocks.size(), cdepPairs, cdepOffsets, cdepBlocks);
+  BuildRows(blocks.size(), regionPairs, regionOffsets, regionBlocks);
+}
+
+ArrayRef<const BasicBlock*>
+ControlDependence::getControlDependences(const BasicBlock & block) const {
+  auto it = blockIndex.find(&block);
+  if (it == blockIndex.end()) return None;
+  return getRow(cdepOffsets, cdepBlocks, it->second);
+}
+
+ArrayRef<const BasicBlock*>
+ControlDependence::getInfluenceRegion(const BasicBlock & branchBlock) const {
+  auto it = blockIndex.find(&branchBlock);
+  if (it == blockIndex.end()) return None;
+  return getRow(regionOffsets, regionBlocks, it->second);
+}
+
+bool
+ControlDependence::isControlEquivalent(const BasicBlock & A, const BasicBlock & B) const {
+  if (!contains(A) || !contains(B)) return false;
+  // rows are in branch order
+  return getControlDependences(A) == getControlDependences(B);
+}
+
+bool
+ControlDependence::invalidate(Function & F, const PreservedAnalyses & PA,
+                              FunctionAnalysisManager::Invalidator & Inv) {
+  auto PAC = PA.getChecker<ControlDependenceAnalysis>();
+  if (!PAC.preserved() && !PAC.preservedSet<CFGAnalyses>()) return true;
+  return Inv.invalidate<PostDominatorTreeAnalysis>(F, PA);
+}
+
+ControlDependence
+ControlDependenceAnalysis::run(Function & F, FunctionAnalysisManager & FAM) {
+  return ControlDependence(F, FAM.getResult<PostDominatorTreeAnalysis>(F));
+}
+
+const ControlDependence &
+GetControlDependence(Function & F, FunctionAnalysisManager & FAM) {
+  // the host pipeline does not know RV's analyses
+  FAM.registerPass([] { return ControlDependenceAnalysis(); });
+  return FAM.getResult<ControlDependenceAnalysis>(F);
+}
+
+} // namespace rv
@@ -17,7 +17,16 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 #include "rv/utils.h"
 #include "rvConfig.h"
@@ -32,17 +41,104 @@ using namespace llvm;
 
 namespace rv {
 
+// charged for instructions TTI has no valid cost for
+static const double InvalidCostPenalty = 1000.0;
+// extracting an operand from/inserting the result into a vector register (per lane)
+static const double LaneInsertExtractCost = 1.0;
+// lane-wise branch around each scalar access of a masked cascade
+static const double CascadeBranchCost = 2.0;
+// expected share of active lanes under a varying mask (the cascade skips the inactive ones)
+static const double MaskedLaneRatio = 0.5;
+// largest stride (in elements) for which the whole spanned range is loaded (VaryingAccessKind::StridedSpan)
+static const unsigned MaxSpanFactor = 4;
+// expected share of clustered scatters that take the masked store (VaryingAccessKind::ClusteredScatter)
+static const double ClusteredScatterHitRatio = 0.5;
+// largest constant table (in vector registers) that is kept in registers (VaryingAccessKind::TableLookup)
+static const unsigned MaxTableParts = 4;
+// memory latency hidden by software prefetches (unless TTI has a prefetch distance for the target)
+static const double PrefetchLatency = 300.0;
+// prefetching further ahead only pollutes the cache
+static const unsigned MaxPrefetchDistance = 64;
+// share of heavy (FP, multiply) operations from which 512-bit vectors outweigh their lower frequency license
+static const double MinHeavyDensity512 = 0.3;
+
+static double
+ToDouble(InstructionCost cost) {
+  if (!cost.isValid()) return InvalidCostPenalty;
+  return (double) *cost.getValue();
+}
+
+static VectorType*
+WidenType(Type & laneTy, size_t vectorWidth) {
+  if (!VectorType::isValidElementType(&laneTy)) return nullptr;
+  return FixedVectorType::get(&laneTy, vectorWidth);
+}
+
+RegionCost &
+RegionCost::operator+=(const RegionCost & o) {
+  scalarCost += o.scalarCost;
+  vectorCost += o.vectorCost;
+  replicationCost += o.replicationCost;
+  gatherScatterCost += o.gatherScatterCost;
+  cascadeCost += o.cascadeCost;
+  blendCost += o.blendCost;
+  maskCost += o.maskCost;
+  scalarSize += o.scalarSize;
+  vectorSize += o.vectorSize;
+  return *this;
+}
+
+unsigned
+RegionCost::getScore() const {
+  double divisor = vectorCost < 1.0 ? 1.0 : vectorCost;
+  return (unsigned) ((100.0 * scalarCost) / divisor + 0.5);
+}
+
+void
+RegionCost::print(raw_ostream & out) const {
+  out << "scalar " << scalarCost << ", vector " << vectorCost
+      << " (replication " << replicationCost
+      << ", gather/scatter " << gatherScatterCost
+      << ", cascade " << cascadeCost
+      << ", blend " << blendCost
+      << ", mask " << maskCost
+      << "), score " << getScore()
+      << ", code growth " << getCodeGrowth();
+}
 
 CostModel::CostModel(PlatformInfo & _platInfo, Config & _config)
 : platInfo(_platInfo)
 , config(_config)
 , tti(*platInfo.getTTI())
+, vecInfo(nullptr)
+{}
+
+CostModel::CostModel(PlatformInfo & _platInfo, Config & _config, const VectorizationInfo & _vecInfo)
+: platInfo(_platInfo)
+, config(_config)
+, tti(*platInfo.getTTI())
+, vecInfo(&_vecInfo)
 {}
 
 
 bool
 CostModel::needsReplication(const Instruction & inst) const {
-  return true; // TODO query vecInfo
+  if (!vecInfo) return true;
+  auto shape = vecInfo->getVectorShape(inst);
+  return shape.isDefined() && !shape.isUniform();
+}
+
+bool
+CostModel::needsMask(const BasicBlock & block) const {
+  if (!vecInfo) return false;
+
+  // after linearization
+  auto * pred = vecInfo->getPredicate(block);
+  if (pred) return !vecInfo->getVectorShape(*pred).isUniform();
+
+  // before linearization (VA result)
+  bool isVarying = false;
+  return vecInfo->getVaryingPredicateFlag(block, isVarying) && isVarying;
 }
 
 static
@@ -56,12 +152,51 @@ CountDataPhis(const BasicBlock & block) {
   return t;
 }
 
+size_t
+CostModel::getMaxVectorBits() const {
+  size_t targetBits = platInfo.getMaxVectorBits();
+  return config.maxVectorBits > 0 ? std::min<size_t>(targetBits, config.maxVectorBits) : targetBits;
+}
+
+// whether @inst runs on the FP or multiplier units (AVX-512 "heavy" instructions)
+static bool
+IsHeavyOp(const Instruction & inst) {
+  if (inst.getType()->isFPOrFPVectorTy() && !isa<PHINode>(inst) && !isa<SelectInst>(inst) && !isa<LoadInst>(inst)) return true;
+  switch (inst.getOpcode()) {
+    case Instruction::FCmp:
+    case Instruction::FPToSI:
+    case Instruction::FPToUI:
+    case Instruction::Mul:
+      return true;
+    default:
+      return false;
+  }
+}
+
+double
+CostModel::GetHeavyOpDensity(const Function & F) {
+  size_t numHeavy = 0, numOps = 0;
+  for (const auto & block : F) {
+    for (const auto & inst : block) {
+      if (isa<PHINode>(inst) || inst.isTerminator() || isa<DbgInfoIntrinsic>(inst)) continue;
+      ++numOps;
+      numHeavy += IsHeavyOp(inst);
+    }
+  }
+  return numOps > 0 ? numHeavy / (double) numOps : 0.0;
+}
+
+size_t
+CostModel::PickAVX512Bits(const Function & F) {
+  return GetHeavyOpDensity(F) >= MinHeavyDensity512 ? 512 : 256;
+}
+
 size_t
 CostModel::pickWidthForMapping(const VectorMapping & mapping) const {
   if (mapping.vectorFn) return mapping.vectorWidth;
 
   // default to vector of bytes
-  size_t vecWidth = platInfo.getMaxVectorWidth();
+  size_t vecWidth = getMaxVectorBits() / 8;
 
   auto * scaFuncTy = mapping.scalarFn->getFunctionType();
   for (size_t i = 0; i < scaFuncTy->getNumParams(); ++i) {
@@ -155,8 +290,8 @@ CostModel::pickWidthForInstruction(const Instruction & inst, size_t maxWidth) co
     return maxWidth;
   }
 
-// default to type based width
-  return pickWidthForType(instTy, maxWidth);
+// default to type based width (values of wide elements may span maxSplitParts registers)
+  return std::min<size_t>(maxWidth, config.maxSplitParts * pickWidthForType(instTy, maxWidth));
 }
 
 size_t
@@ -164,10 +299,16 @@ CostModel::pickWidthForType(const Type & type, size_t maxWidth) const {
 
   // assume that only floating point values are vectorized
   size_t rawSize = type.getPrimitiveSizeInBits();
+
+  // without native FP16 arithmetic, half values are promoted to f32 registers (bfloat always is)
+  const auto & elemTy = *type.getScalarType();
+  if ((elemTy.isHalfTy() && !config.useFP16) || elemTy.isBFloatTy()) {
+    rawSize = 32 * (rawSize / 16);
+  }
   if ((rawSize > 0) &&
        (type.isIntOrIntVectorTy() || type.isFPOrFPVectorTy()))
   {
-    maxWidth = std::min<size_t>(maxWidth, platInfo.getMaxVectorBits() / rawSize);
+    maxWidth = std::min<size_t>(maxWidth, getMaxVectorBits() / rawSize);
   }
   return maxWidth;
 }
@@ -188,9 +329,95 @@ CostModel::pickWidthForBlock(const BasicBlock & block, size_t maxWidth) const {
   return maxWidth;
 }
 
+// the live range of a value that may occupy vector registers, in (rpo) instruction positions of the region
+struct VectorLiveRange {
+  size_t begin, end;
+  size_t bits;
+};
+
+size_t
+CostModel::collectLiveRanges(const Region & region, std::vector<VectorLiveRange> & oRanges) const {
+  DenseMap<const Instruction *, size_t> positions;
+  DenseMap<const BasicBlock *, size_t> blockEnds;
+  size_t numPoints = 0;
+  region.for_blocks_rpo([&](const BasicBlock & block) {
+    for (const auto & inst : block) positions[&inst] = numPoints++;
+    blockEnds[&block] = numPoints - 1;
+    return true;
+  });
+
+  for (const auto & it : positions) {
+    const auto & inst = *it.first;
+    const auto & type = *inst.getType();
+    if (!(type.isIntegerTy() || type.isFloatingPointTy()) || type.isIntegerTy(1)) continue;
+    if (!needsReplication(inst)) continue;
+
+    // from the def to the last use. Uses around a back edge (incoming values of earlier phis) and outside the
+    // region keep it live until the end
+    VectorLiveRange range{it.second, it.second, type.getPrimitiveSizeInBits()};
+    for (const auto & use : inst.uses()) {
+      auto * userInst = dyn_cast<Instruction>(use.getUser());
+      if (!userInst) continue;
+      auto * userPhi = dyn_cast<PHINode>(userInst);
+      auto itEnd = userPhi ? blockEnds.find(userPhi->getIncomingBlock(use)) : blockEnds.end();
+      auto itUse = positions.find(userInst);
+      size_t usePos = numPoints - 1;
+      if (userPhi && itEnd != blockEnds.end() && positions.lookup(userPhi) > it.second) usePos = itEnd->second;
+      else if (!userPhi && itUse != positions.end()) usePos = itUse->second;
+      range.end = std::max(range.end, usePos);
+    }
+    oRanges.push_back(range);
+  }
+  return numPoints;
+}
+
+// the peak number of vector registers for the values of @ranges at @width
+static size_t
+GetMaxLiveRegisters(const std::vector<VectorLiveRange> & ranges, size_t numPoints, size_t width, size_t registerBits) {
+  std::vector<long> liveDelta(numPoints + 1, 0);
+  for (const auto & range : ranges) {
+    long numRegs = (width * range.bits + registerBits - 1) / registerBits;
+    liveDelta[range.begin] += numRegs;
+    liveDelta[range.end + 1] -= numRegs;
+  }
+
+  long numLive = 0, maxLive = 0;
+  for (size_t i = 0; i < numPoints; ++i) {
+    numLive += liveDelta[i];
+    maxLive = std::max(maxLive, numLive);
+  }
+  return maxLive;
+}
+
+size_t
+CostModel::pickWidthForPressure(const Region & region, size_t maxWidth) const {
+  size_t registerBits = getMaxVectorBits();
+  unsigned numRegisters = tti.getNumberOfRegisters(tti.getRegisterClassForType(true));
+  if (maxWidth <= 1 || registerBits == 0 || numRegisters == 0) return maxWidth;
+
+  std::vector<VectorLiveRange> ranges;
+  size_t numPoints = collectLiveRanges(region, ranges);
+  if (ranges.empty()) return maxWidth;
+
+  // narrower widths until the peak fits the register file (or the values occupy one register each)
+  size_t width = maxWidth;
+  size_t maxLive = GetMaxLiveRegisters(ranges, numPoints, width, registerBits);
+  while (width > 1 && maxLive > numRegisters) {
+    size_t narrowLive = GetMaxLiveRegisters(ranges, numPoints, width / 2, registerBits);
+    if (narrowLive >= maxLive) break;
+    width /= 2;
+    maxLive = narrowLive;
+  }
+
+  IF_DEBUG_CM if (width < maxWidth) {
+    errs() << "cm: register pressure (" << maxLive << " live of " << numRegisters << " registers) bounds the width to " << width << "\n";
+  }
+  return width;
+}
+
 size_t
 CostModel::pickWidthForRegion(const Region & region, size_t maxWidth) const {
-  size_t width = std::min(maxWidth, platInfo.getMaxVectorBits());
+  size_t width = std::min(maxWidth, getMaxVectorBits());
 
   IF_DEBUG_CM { errs() << "cm: bounding vector width for region " << region.str() << ", initial max width " << width << "\n"; }
 
@@ -199,8 +426,521 @@ CostModel::pickWidthForRegion(const Region & region, size_t maxWidth) const {
       return width > 1;
   });
 
+  // split wide elements only as far as the narrowest element type fills a register
+  if (config.maxSplitParts > 1) {
+    size_t narrowBits = 0;
+    region.for_blocks([&](const BasicBlock & block) {
+      for (const auto & inst : block) {
+        if (!needsReplication(inst)) continue;
+        const Type * types[] = {inst.getType(), isa<CastInst>(inst) ? inst.getOperand(0)->getType() : nullptr};
+        for (const auto * type : types) {
+          if (!type || !(type->isIntegerTy() || type->isFloatingPointTy())) continue;
+          size_t bits = type->getPrimitiveSizeInBits();
+          if (bits > 1 && (narrowBits == 0 || bits < narrowBits)) narrowBits = bits;
+        }
+      }
+      return true;
+    });
+    if (narrowBits > 0) width = std::min<size_t>(width, std::max<size_t>(1, getMaxVectorBits() / narrowBits));
+  }
+
+  if (config.enablePressureWidth) width = pickWidthForPressure(region, width);
+
   return width;
 }
 
 
+double
+CostModel::getScalarCost(const Instruction & inst) const {
+  return ToDouble(tti.getInstructionCost(&inst, TargetTransformInfo::TCK_RecipThroughput));
+}
+
+void
+CostModel::addReplicationCost(const Instruction & inst, RegionCost & cost) const {
+  const size_t vectorWidth = vecInfo->getVectorWidth();
+
+  // lanes need their varying operands extracted and their result inserted
+  size_t numTransfers = inst.getType()->isVoidTy() ? 0 : 1;
+  for (const auto & op : inst.operands()) {
+    if (!isa<Instruction>(op.get()) && !isa<Argument>(op.get())) continue;
+    if (!vecInfo->getVectorShape(*op.get()).isUniform()) ++numTransfers;
+  }
+
+  double replCost = vectorWidth * (getScalarCost(inst) + numTransfers * LaneInsertExtractCost);
+  cost.vectorCost += replCost;
+  cost.replicationCost += replCost;
+  // the copy of each lane (replaces the one instruction counted by addInstructionCost)
+  cost.vectorSize += vectorWidth * (1 + numTransfers) - 1;
+}
+
+void
+CostModel::addMemoryCost(const Instruction & inst, RegionCost & cost) const {
+  const size_t vectorWidth = vecInfo->getVectorWidth();
+  const auto CostKind = TargetTransformInfo::TCK_RecipThroughput;
+  auto & mutInst = const_cast<Instruction&>(inst);
+
+  const Value * ptr = getLoadStorePointerOperand(&inst);
+  auto * accessTy = getLoadStoreType(&mutInst);
+  auto * vecTy = WidenType(*accessTy, vectorWidth);
+  if (!vecTy) {
+    addReplicationCost(inst, cost);
+    return;
+  }
+
+  const bool isLoad = isa<LoadInst>(inst);
+  const bool masked = needsMask(*inst.getParent());
+  auto addrShape = vecInfo->getVectorShape(*ptr);
+  int byteSize = (int) vecInfo->getDataLayout().getTypeStoreSize(accessTy);
+  Align alignment = getLoadStoreAlignment(&mutInst);
+  unsigned addrSpace = getLoadStoreAddressSpace(&mutInst);
+  double scaMemCost = getScalarCost(inst);
+
+  if (addrShape.isUniform()) {
+    double uniCost = scaMemCost;
+
+    // stores of varying values to uniform addresses are lowered as reductions
+    if (!isLoad) {
+      const auto & storedVal = *cast<StoreInst>(inst).getValueOperand();
+      if (!vecInfo->getVectorShape(storedVal).isUniform()) {
+        unsigned redOpcode = accessTy->isFloatingPointTy() ? Instruction::FAdd : Instruction::Add;
+        uniCost += ToDouble(tti.getArithmeticReductionCost(redOpcode, vecTy, FastMathFlags(), CostKind));
+      }
+    }
+
+    // masked uniform accesses are guarded by an any-of test on the mask
+    if (masked) {
+      auto * maskTy = FixedVectorType::get(Type::getInt1Ty(inst.getContext()), vectorWidth);
+      double anyCost = ToDouble(tti.getArithmeticReductionCost(Instruction::Or, maskTy, FastMathFlags(), CostKind));
+      uniCost += anyCost;
+      cost.maskCost += anyCost;
+    }
+    cost.vectorCost += uniCost;
+    return;
+  }
+
+  // same conditions as NatBuilder::vectorizeMemoryInstruction
+  bool isDense = addrShape.isContiguous() || addrShape.isStrided(byteSize);
+  if (isDense && !(masked && !config.enableMaskedMove)) {
+    double denseCost = masked ? ToDouble(tti.getMaskedMemoryOpCost(inst.getOpcode(), vecTy, alignment, addrSpace, CostKind))
+                              : ToDouble(tti.getMemoryOpCost(inst.getOpcode(), vecTy, alignment, addrSpace, CostKind));
+    cost.vectorCost += denseCost;
+    return;
+  }
+
+  // select of two dense or uniform addresses (NatBuilder::createSelectSplitAccess): two accesses and a blend
+  auto * sel = dyn_cast<SelectInst>(ptr);
+  bool isSimple = isLoad ? cast<LoadInst>(inst).isSimple() : cast<StoreInst>(inst).isSimple();
+  if (config.enableSelectAccessSplit && sel && isSimple && !vecInfo->getVectorShape(*sel->getCondition()).isUniform() &&
+      (accessTy->isIntegerTy() || accessTy->isFloatingPointTy() || accessTy->isPointerTy())) {
+    double splitCost = 0.0;
+    bool isSplit = true;
+    for (const Value * arm : {sel->getTrueValue(), sel->getFalseValue()}) {
+      auto armShape = vecInfo->getVectorShape(*arm);
+      if (armShape.isStrided(byteSize) && config.enableMaskedMove) {
+        splitCost += ToDouble(tti.getMaskedMemoryOpCost(inst.getOpcode(), vecTy, alignment, addrSpace, CostKind));
+      } else if (isLoad && armShape.isUniform()) {
+        splitCost += scaMemCost;
+      } else {
+        isSplit = false;
+      }
+    }
+    if (isSplit) {
+      if (isLoad) splitCost += ToDouble(tti.getCmpSelInstrCost(Instruction::Select, vecTy, nullptr, CmpInst::BAD_ICMP_PREDICATE, CostKind));
+      cost.vectorCost += splitCost;
+      return;
+    }
+  }
+
+  double varyingCost;
+  auto kind = pickVaryingAccess(inst, masked, &varyingCost);
+  cost.vectorCost += varyingCost;
+  if (kind == VaryingAccessKind::GatherScatter) cost.gatherScatterCost += varyingCost;
+  else if (kind == VaryingAccessKind::Cascade) {
+    cost.cascadeCost += varyingCost;
+    // a branch, the access and the lane transfers per lane
+    cost.vectorSize += vectorWidth * 4 - 1;
+  }
+}
+
+unsigned
+CostModel::getStridedSpanFactor(const Instruction & inst, bool masked) const {
+  if (!isa<LoadInst>(inst) || (masked && !config.enableMaskedMove)) return 0;
+
+  const auto & DL = vecInfo->getDataLayout();
+  auto * accessTy = getLoadStoreType(const_cast<Instruction*>(&inst));
+  int64_t byteSize = DL.getTypeStoreSize(accessTy);
+  if (byteSize == 0 || byteSize != (int64_t) DL.getTypeAllocSize(accessTy)) return 0;
+
+  auto addrShape = vecInfo->getVectorShape(*getLoadStorePointerOperand(&inst));
+  if (!addrShape.isStrided() || addrShape.getStride() <= 0 || addrShape.getStride() % byteSize != 0) return 0;
+  int64_t factor = addrShape.getStride() / byteSize;
+  return (factor > 1 && factor <= MaxSpanFactor) ? (unsigned) factor : 0;
+}
+
+bool
+CostModel::getTableLookup(const Instruction & inst, TableLookup & oLookup) const {
+  auto * load = dyn_cast<LoadInst>(&inst);
+  if (!config.enableTableLookup || !load || !load->isSimple()) return false;
+
+  // @table[i] or gep @table, 0, i
+  auto * gep = dyn_cast<GetElementPtrInst>(load->getPointerOperand());
+  if (!gep) return false;
+  auto * table = dyn_cast<GlobalVariable>(gep->getPointerOperand());
+  if (!table || !table->isConstant() || !table->hasDefinitiveInitializer()) return false;
+  auto * init = table->getInitializer();
+  if (!isa<ConstantDataArray>(init) && !isa<ConstantArray>(init) && !isa<ConstantAggregateZero>(init)) return false;
+  auto * tableTy = dyn_cast<ArrayType>(table->getValueType());
+  auto * elemTy = load->getType();
+  if (!tableTy || tableTy->getElementType() != elemTy) return false;
+
+  const Value * index = nullptr;
+  if (gep->getSourceElementType() == tableTy && gep->getNumIndices() == 2) {
+    auto * firstIdx = dyn_cast<ConstantInt>(gep->getOperand(1));
+    if (!firstIdx || !firstIdx->isZero()) return false;
+    index = gep->getOperand(2);
+  } else if (gep->getSourceElementType() == elemTy && gep->getNumIndices() == 1) {
+    index = gep->getOperand(1);
+  } else {
+    return false;
+  }
+  if (!index->getType()->isIntegerTy() || vecInfo->getVectorShape(*index).isUniform()) return false;
+
+  // a register holds vectorWidth entries: vpermps/vpermt2ps on 32-bit entries, pshufb/tbl on bytes
+  const size_t vectorWidth = vecInfo->getVectorWidth();
+  unsigned elemBits = elemTy->getPrimitiveSizeInBits();
+  bool isElemTy = elemTy->isIntegerTy() || elemTy->isFloatingPointTy();
+  unsigned partsPerLookup = 0;
+  if (isElemTy && elemBits == 32 && config.useAVX512 && vectorWidth == 16) partsPerLookup = 2;
+  else if (isElemTy && elemBits == 32 && config.useAVX2 && vectorWidth == 8) partsPerLookup = 1;
+  else if (elemTy->isIntegerTy(8) && config.useADVSIMD && vectorWidth == 16) partsPerLookup = MaxTableParts;
+  else if (elemTy->isIntegerTy(8) && config.useSSE && vectorWidth == 16) partsPerLookup = 1;
+  if (partsPerLookup == 0) return false;
+
+  uint64_t numEntries = tableTy->getNumElements();
+  unsigned numParts = (numEntries + vectorWidth - 1) / vectorWidth;
+  if (numParts == 0 || numParts > MaxTableParts) return false;
+
+  oLookup.table = table;
+  oLookup.index = index;
+  oLookup.numParts = numParts;
+  oLookup.partsPerLookup = std::min(partsPerLookup, numParts);
+  return true;
+}
+
+VaryingAccessKind
+CostModel::pickVaryingAccess(const Instruction & inst, bool masked, double * oCost) const {
+  const size_t vectorWidth = vecInfo->getVectorWidth();
+  const auto CostKind = TargetTransformInfo::TCK_RecipThroughput;
+  auto & mutInst = const_cast<Instruction&>(inst);
+
+  const Value * ptr = getLoadStorePointerOperand(&inst);
+  auto * accessTy = getLoadStoreType(&mutInst);
+  auto * vecTy = WidenType(*accessTy, vectorWidth);
+  Align alignment = getLoadStoreAlignment(&mutInst);
+  unsigned addrSpace = getLoadStoreAddressSpace(&mutInst);
+
+  // emulated gather/scatter (createCascadeMemory): one scalar access per lane, branches skip the inactive lanes
+  double laneCost = getScalarCost(inst) + 2 * LaneInsertExtractCost;
+  double cascadeCost = masked ? vectorWidth * (CascadeBranchCost + MaskedLaneRatio * laneCost)
+                              : vectorWidth * laneCost;
+  auto bestKind = VaryingAccessKind::Cascade;
+  double bestCost = cascadeCost;
+
+  if (config.useScatterGatherIntrinsics && vecTy) {
+    double gsCost = ToDouble(tti.getGatherScatterOpCost(inst.getOpcode(), vecTy, ptr, masked, alignment, CostKind, &inst));
+    if (!config.enableGatherCost || gsCost <= bestCost) {
+      bestKind = VaryingAccessKind::GatherScatter;
+      bestCost = gsCost;
+    }
+  }
+
+  // scatters whose active lanes hit one vector of memory: the lowest active address, the in-window test,
+  // a broadcast/compare/blend per lane into the window and one masked store. The rest take the scatter.
+  if (config.enableScatterCoalescing && config.enableMaskedMove && vecTy && isa<StoreInst>(inst) && isPowerOf2_64(vectorWidth)) {
+    const auto & DL = vecInfo->getDataLayout();
+    uint64_t byteSize = DL.getTypeStoreSize(accessTy);
+    if (isPowerOf2_64(byteSize) && byteSize == DL.getTypeAllocSize(accessTy)) {
+      auto * slotTy = FixedVectorType::get(Type::getInt64Ty(inst.getContext()), vectorWidth);
+      auto * maskTy = FixedVectorType::get(Type::getInt1Ty(inst.getContext()), vectorWidth);
+      double checkCost = ToDouble(tti.getMinMaxReductionCost(slotTy, maskTy, true, CostKind))
+                       + ToDouble(tti.getArithmeticReductionCost(Instruction::Or, slotTy, FastMathFlags(), CostKind))
+                       + 4 * ToDouble(tti.getArithmeticInstrCost(Instruction::Sub, slotTy, CostKind));
+      double laneCost = ToDouble(tti.getShuffleCost(TargetTransformInfo::SK_Broadcast, slotTy))
+                      + ToDouble(tti.getShuffleCost(TargetTransformInfo::SK_Broadcast, vecTy))
+                      + ToDouble(tti.getCmpSelInstrCost(Instruction::ICmp, slotTy, maskTy, CmpInst::ICMP_EQ, CostKind))
+                      + ToDouble(tti.getCmpSelInstrCost(Instruction::Select, vecTy, maskTy, CmpInst::BAD_ICMP_PREDICATE, CostKind))
+                      + ToDouble(tti.getArithmeticInstrCost(Instruction::Or, maskTy, CostKind));
+      double windowCost = vectorWidth * laneCost + ToDouble(tti.getMaskedMemoryOpCost(Instruction::Store, vecTy, alignment, addrSpace, CostKind));
+      double clusterCost = checkCost + ClusteredScatterHitRatio * windowCost + (1.0 - ClusteredScatterHitRatio) * bestCost;
+      if (clusterCost < bestCost) {
+        bestKind = VaryingAccessKind::ClusteredScatter;
+        bestCost = clusterCost;
+      }
+    }
+  }
+
+  // the lanes of a small stride lie in a short range: load it whole (masked if there are inactive lanes)
+  unsigned spanFactor = vecTy ? getStridedSpanFactor(inst, masked) : 0;
+  if (config.enableGatherCost && spanFactor > 0) {
+    auto * spanTy = FixedVectorType::get(accessTy, (vectorWidth - 1) * spanFactor + 1);
+    double spanCost = masked ? ToDouble(tti.getMaskedMemoryOpCost(Instruction::Load, spanTy, alignment, addrSpace, CostKind))
+                             : ToDouble(tti.getMemoryOpCost(Instruction::Load, spanTy, alignment, addrSpace, CostKind));
+    spanCost += ToDouble(tti.getShuffleCost(TargetTransformInfo::SK_PermuteSingleSrc, spanTy));
+    if (spanCost < bestCost) {
+      bestKind = VaryingAccessKind::StridedSpan;
+      bestCost = spanCost;
+    }
+  }
+
+  // the lanes of a lookup in a small constant table are permutations of the table registers
+  TableLookup lookup;
+  if (config.enableGatherCost && vecTy && getTableLookup(inst, lookup)) {
+    auto permKind = lookup.partsPerLookup > 1 ? TargetTransformInfo::SK_PermuteTwoSrc : TargetTransformInfo::SK_PermuteSingleSrc;
+    unsigned numLookups = (lookup.numParts + lookup.partsPerLookup - 1) / lookup.partsPerLookup;
+    auto * maskTy = FixedVectorType::get(Type::getInt1Ty(inst.getContext()), vectorWidth);
+    double selectCost = ToDouble(tti.getCmpSelInstrCost(Instruction::Select, vecTy, maskTy, CmpInst::BAD_ICMP_PREDICATE, CostKind));
+    double tableCost = numLookups * ToDouble(tti.getShuffleCost(permKind, vecTy)) + (numLookups - 1) * 2 * selectCost;
+    if (tableCost < bestCost) {
+      bestKind = VaryingAccessKind::TableLookup;
+      bestCost = tableCost;
+    }
+  }
+
+  IF_DEBUG_CM {
+    errs() << "CM: varying access " << inst << " : "
+           << (bestKind == VaryingAccessKind::GatherScatter ? "gather/scatter" : bestKind == VaryingAccessKind::Cascade ? "cascade" :
+               bestKind == VaryingAccessKind::StridedSpan ? "strided span" :
+               bestKind == VaryingAccessKind::TableLookup ? "table lookup" : "clustered scatter")
+           << " (cost " << bestCost << ")\n";
+  }
+
+  if (oCost) *oCost = bestCost;
+  return bestKind;
+}
+
+void
+CostModel::addInstructionCost(const Instruction & inst, RegionCost & cost) const {
+  const size_t vectorWidth = vecInfo->getVectorWidth();
+  const auto CostKind = TargetTransformInfo::TCK_RecipThroughput;
+
+  cost.scalarCost += vectorWidth * getScalarCost(inst);
+  cost.scalarSize += 1;
+
+  // terminators are accounted for with the block
+  if (inst.isTerminator()) return;
+  cost.vectorSize += 1;
+
+  if (isa<LoadInst>(inst) || isa<StoreInst>(inst)) {
+    addMemoryCost(inst, cost);
+    return;
+  }
+
+  auto * vecTy = WidenType(*inst.getType(), vectorWidth);
+  auto * maskTy = FixedVectorType::get(Type::getInt1Ty(inst.getContext()), vectorWidth);
+
+  if (auto * phi = dyn_cast<PHINode>(&inst)) {
+    // phis at divergent joins and on divergent loop exits turn into blends
+    const auto & block = *phi->getParent();
+    size_t numBlends = 0;
+    if (vecInfo->isJoinDivergent(block)) numBlends = phi->getNumIncomingValues() - 1;
+    else if (vecInfo->isDivergentLoopExit(block)) numBlends = 1;
+    if (numBlends == 0 || !needsReplication(inst)) return;
+
+    double selectCost = vecTy ? ToDouble(tti.getCmpSelInstrCost(Instruction::Select, vecTy, maskTy, CmpInst::BAD_ICMP_PREDICATE, CostKind))
+                              : vectorWidth * LaneInsertExtractCost;
+    double blendCost = numBlends * selectCost;
+    cost.vectorCost += blendCost;
+    cost.blendCost += blendCost;
+    cost.vectorSize += numBlends - 1;
+    return;
+  }
+
+  if (!needsReplication(inst)) {
+    cost.vectorCost += getScalarCost(inst);
+    return;
+  }
+
+  // only the base lane of (non-varying) strided address computations is materialized
+  if (isa<GetElementPtrInst>(inst) && !vecInfo->getVectorShape(inst).isVarying()) {
+    cost.vectorCost += getScalarCost(inst);
+    return;
+  }
+
+  if (auto * call = dyn_cast<CallInst>(&inst)) {
+    auto * callee = call->getCalledFunction();
+    if (!callee || IsCriticalSection(*callee)) {
+      addReplicationCost(inst, cost);
+      return;
+    }
+
+    Intrinsic::ID id = callee->getIntrinsicID();
+    if (id == Intrinsic::lifetime_start || id == Intrinsic::lifetime_end) return;
+
+    // widened intrinsics
+    if (id != Intrinsic::not_intrinsic && vecTy) {
+      SmallVector<Type*, 4> argTys;
+      bool widenable = true;
+      for (const auto & arg : call->args()) {
+        auto * argVecTy = WidenType(*arg->getType(), vectorWidth);
+        widenable &= (argVecTy != nullptr);
+        argTys.push_back(argVecTy);
+      }
+      if (widenable) {
+        IntrinsicCostAttributes attribs(id, vecTy, argTys);
+        cost.vectorCost += ToDouble(tti.getIntrinsicInstrCost(attribs, CostKind));
+        return;
+      }
+    }
+
+    // mapped functions (SLEEF, declare simd, ..)
+    // resolvers without an estimate: assume the vector implementation runs at scalar throughput
+    VectorShapeVec argShapes;
+    for (const auto & arg : call->args()) argShapes.push_back(vecInfo->getVectorShape(*arg.get()));
+    StringRef calleeName = callee->getName();
+    if (IsVectorizableFunction(*callee)) {
+      cost.vectorCost += getScalarCost(inst);
+      return;
+    }
+    auto resolver = platInfo.getResolver(calleeName, *callee->getFunctionType(), argShapes, vectorWidth, needsMask(*inst.getParent()), ReadULPErrorBound(*call));
+    if (resolver) {
+      FunctionCost callCost = resolver->requestCostEstimate();
+      cost.vectorCost += callCost.isKnown() ? callCost.cost : getScalarCost(inst);
+      return;
+    }
+
+    addReplicationCost(inst, cost);
+    return;
+  }
+
+  if (!vecTy) {
+    addReplicationCost(inst, cost);
+    return;
+  }
+
+  if (isa<BinaryOperator>(inst) || isa<UnaryOperator>(inst)) {
+    cost.vectorCost += ToDouble(tti.getArithmeticInstrCost(inst.getOpcode(), vecTy, CostKind));
+    return;
+  }
+
+  if (auto * castInst = dyn_cast<CastInst>(&inst)) {
+    auto * srcVecTy = WidenType(*castInst->getSrcTy(), vectorWidth);
+    if (!srcVecTy) {
+      addReplicationCost(inst, cost);
+      return;
+    }
+    cost.vectorCost += ToDouble(tti.getCastInstrCost(inst.getOpcode(), vecTy, srcVecTy, TargetTransformInfo::CastContextHint::None, CostKind));
+    return;
+  }
+
+  if (auto * cmp = dyn_cast<CmpInst>(&inst)) {
+    auto * opVecTy = WidenType(*cmp->getOperand(0)->getType(), vectorWidth);
+    if (!opVecTy) {
+      addReplicationCost(inst, cost);
+      return;
+    }
+    cost.vectorCost += ToDouble(tti.getCmpSelInstrCost(inst.getOpcode(), opVecTy, vecTy, cmp->getPredicate(), CostKind));
+    return;
+  }
+
+  if (isa<SelectInst>(inst)) {
+    cost.vectorCost += ToDouble(tti.getCmpSelInstrCost(inst.getOpcode(), vecTy, maskTy, CmpInst::BAD_ICMP_PREDICATE, CostKind));
+    return;
+  }
+
+  if (isa<GetElementPtrInst>(inst)) {
+    // varying addresses: one vector add per index
+    auto * idxTy = WidenType(*vecInfo->getDataLayout().getIntPtrType(inst.getType()), vectorWidth);
+    cost.vectorCost += (inst.getNumOperands() - 1) * ToDouble(tti.getArithmeticInstrCost(Instruction::Add, idxTy, CostKind));
+    return;
+  }
+
+  addReplicationCost(inst, cost);
+}
+
+void
+CostModel::addControlCost(const BasicBlock & block, RegionCost & cost) const {
+  const size_t vectorWidth = vecInfo->getVectorWidth();
+  const auto CostKind = TargetTransformInfo::TCK_RecipThroughput;
+  auto * maskTy = FixedVectorType::get(Type::getInt1Ty(block.getContext()), vectorWidth);
+  double maskOpCost = ToDouble(tti.getArithmeticInstrCost(Instruction::And, maskTy, CostKind));
+
+  // joining the edge masks of all predecessors
+  if (needsMask(block)) {
+    size_t numPreds = pred_size(&block);
+    if (numPreds > 1) {
+      double joinCost = (numPreds - 1) * maskOpCost;
+      cost.vectorCost += joinCost;
+      cost.maskCost += joinCost;
+      cost.vectorSize += numPreds - 1;
+    }
+  }
+
+  const auto * term = block.getTerminator();
+  if (!term) return;
+
+  const auto * branch = dyn_cast<BranchInst>(term);
+  bool varyingBranch = branch && branch->isConditional() && !vecInfo->getVectorShape(*branch->getCondition()).isUniform();
+  cost.vectorSize += 1;
+  if (!varyingBranch) {
+    cost.vectorCost += getScalarCost(*term);
+    return;
+  }
+
+  // linearized: edge masks for both successors
+  double edgeCost = 2 * maskOpCost;
+  cost.vectorCost += edgeCost;
+  cost.maskCost += edgeCost;
+  cost.vectorSize += 2;
+
+  // divergent loop exits keep the loop running while any lane is live
+  for (const auto * succ : branch->successors()) {
+    if (!vecInfo->isDivergentLoopExit(*succ)) continue;
+    double exitCost = maskOpCost + getScalarCost(*term)
+                    + ToDouble(tti.getArithmeticReductionCost(Instruction::Or, maskTy, FastMathFlags(), CostKind));
+    cost.vectorCost += exitCost;
+    cost.maskCost += exitCost;
+    cost.vectorSize += 3;
+  }
+}
+
+RegionCost
+CostModel::estimateBlockCost(const BasicBlock & block) const {
+  assert(vecInfo && "cost estimates require a VA result");
+  RegionCost cost;
+  for (const auto & inst : block) addInstructionCost(inst, cost);
+  addControlCost(block, cost);
+  return cost;
+}
+
+RegionCost
+CostModel::estimateRegionCost() const {
+  assert(vecInfo && "cost estimates require a VA result");
+  RegionCost cost;
+  vecInfo->getRegion().for_blocks([&](const BasicBlock & block) {
+    cost += estimateBlockCost(block);
+    return true;
+  });
+
+  IF_DEBUG_CM {
+    errs() << "cm: region " << vecInfo->getRegion().str() << " at width " << vecInfo->getVectorWidth() << ": ";
+    cost.print(errs());
+    errs() << "\n";
+  }
+  return cost;
+}
+
+unsigned
+CostModel::scoreRegion() const {
+  return estimateRegionCost().getScore();
+}
+
+unsigned
+CostModel::pickPrefetchDistance() const {
+  double latency = tti.getPrefetchDistance() > 0 ? (double) tti.getPrefetchDistance() : PrefetchLatency;
+  double iterationCost = std::max(1.0, estimateRegionCost().vectorCost);
+  unsigned distance = (unsigned) std::ceil(latency / iterationCost);
+  return std::max(1u, std::min(distance, MaxPrefetchDistance));
+}
+
+
 }
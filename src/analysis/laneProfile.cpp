@@ -0,0 +1,194 @@
+//===- src/analysis/laneProfile.cpp - lane occupancy profiles of divergent branches --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/analysis/laneProfile.h"
+
+#include "rv/config.h"
+#include "rv/PlatformInfo.h"
+#include "rv/vectorizationInfo.h"
+#include "rv/intrinsics.h"
+
+#include "rvConfig.h"
+#include "report.h"
+#include "utils/profileWriter.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#if 1
+#define IF_DEBUG_LP IF_DEBUG
+#else
+#define IF_DEBUG_LP if (true)
+#endif
+
+using namespace llvm;
+
+// counters per branch: all true, all false, mixed
+static const unsigned NumOutcomeSlots = 3;
+
+// function attribute counting the profiled regions of a function
+static const char * RegionCountAttr = "rv.lane.profile.regions";
+
+namespace rv {
+
+double
+BranchOutcomes::getAllTakenRatio(unsigned succIdx) const {
+  uint64_t total = getTotal();
+  if (total == 0) return 0.0;
+  uint64_t allTaken = succIdx == 0 ? allTrue : allFalse;
+  return allTaken / (double) total;
+}
+
+// number of \p F's regions that were profiled before
+static unsigned
+RequestRegionIndex(Function & F) {
+  unsigned regionIdx = 0;
+  auto regionAttr = F.getFnAttribute(RegionCountAttr);
+  if (regionAttr.isValid()) regionAttr.getValueAsString().getAsInteger(10, regionIdx);
+  F.addFnAttr(RegionCountAttr, std::to_string(regionIdx + 1));
+  return regionIdx;
+}
+
+LaneProfile::LaneProfile(const Config & _config, VectorizationInfo & _vecInfo, PlatformInfo & _platInfo)
+: config(_config)
+, vecInfo(_vecInfo)
+, platInfo(_platInfo)
+, funcName()
+, regionIdx(0)
+{
+  if (config.laneProfileGen.empty() && config.laneProfileUse.empty()) return;
+
+  auto & F = vecInfo.getScalarFunction();
+  funcName = F.getName().str();
+  regionIdx = RequestRegionIndex(F);
+
+  for (auto & block : F) {
+    if (!vecInfo.inRegion(block)) continue;
+    auto * branch = dyn_cast<BranchInst>(block.getTerminator());
+    if (!branch || !branch->isConditional()) continue;
+    if (vecInfo.getVectorShape(*branch).isUniform()) continue;
+
+    branchIndex[branch] = branches.size();
+    branches.push_back(branch);
+  }
+
+  if (!config.laneProfileUse.empty()) readProfile(config.laneProfileUse);
+}
+
+void
+LaneProfile::readProfile(const std::string & profilePath) {
+  auto bufferOrErr = MemoryBuffer::getFile(profilePath);
+  if (!bufferOrErr) {
+    Report() << "lane profile: could not read " << profilePath << "\n";
+    return;
+  }
+
+  StringRef text = (*bufferOrErr)->getBuffer();
+  while (!text.empty()) {
+    StringRef line;
+    std::tie(line, text) = text.split('\n');
+
+    SmallVector<StringRef, 6> fields;
+    line.split(fields, ' ', -1, false);
+    if (fields.size() != 6 || fields[0] != funcName) continue;
+
+    unsigned lineRegion, lineBranch;
+    BranchOutcomes lineOutcomes;
+    if (fields[1].getAsInteger(10, lineRegion) ||
+        fields[2].getAsInteger(10, lineBranch) ||
+        fields[3].getAsInteger(10, lineOutcomes.allTrue) ||
+        fields[4].getAsInteger(10, lineOutcomes.allFalse) ||
+        fields[5].getAsInteger(10, lineOutcomes.mixed)) {
+      Report() << "lane profile: skipping malformed line '" << line << "'\n";
+      continue;
+    }
+    if (lineRegion != regionIdx || lineBranch >= branches.size()) continue;
+
+    auto itInserted = outcomes.insert(std::make_pair(lineBranch, BranchOutcomes{0, 0, 0}));
+    auto & branchOutcomes = itInserted.first->second;
+    branchOutcomes.allTrue += lineOutcomes.allTrue;
+    branchOutcomes.allFalse += lineOutcomes.allFalse;
+    branchOutcomes.mixed += lineOutcomes.mixed;
+  }
+
+  IF_DEBUG_LP {
+    errs() << "lane profile: " << outcomes.size() << " of " << branches.size() << " branches profiled in region " << regionIdx << " of " << funcName << "\n";
+  }
+}
+
+const BranchOutcomes *
+LaneProfile::getOutcomes(const BranchInst & branch) const {
+  auto itBranch = branchIndex.find(&branch);
+  if (itBranch == branchIndex.end()) return nullptr;
+  auto itOutcomes = outcomes.find(itBranch->second);
+  if (itOutcomes == outcomes.end()) return nullptr;
+  return &itOutcomes->second;
+}
+
+// appends the counters to \p profilePath at program exit
+static void
+CreateProfileWriter(Module & mod, GlobalVariable & counters, StringRef funcName, unsigned regionIdx, unsigned numBranches, StringRef profilePath) {
+  ProfileWriter writer(mod, profilePath, "rv.lane.profile.write");
+  auto & builder = writer.getBuilder();
+  auto * funcNameStr = builder.CreateGlobalStringPtr(funcName);
+  for (unsigned i = 0; i < numBranches; ++i) {
+    SmallVector<Value*, 6> lineArgs = {funcNameStr, builder.getInt32(regionIdx), builder.getInt32(i)};
+    for (unsigned slot = 0; slot < NumOutcomeSlots; ++slot) {
+      lineArgs.push_back(writer.loadCounter(counters, i * NumOutcomeSlots + slot));
+    }
+    writer.print("%s %u %u %llu %llu %llu\n", lineArgs);
+  }
+  writer.finalize();
+}
+
+void
+LaneProfile::instrument() {
+  if (branches.empty()) return;
+
+  auto & mod = *vecInfo.getScalarFunction().getParent();
+  auto & ctx = mod.getContext();
+  auto * counterTy = Type::getInt64Ty(ctx);
+  auto & counters = CreateCounterArray(mod, branches.size() * NumOutcomeSlots, "rv.lane.profile.counters");
+
+  auto & allFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::All);
+  auto & anyFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::Any);
+
+  for (unsigned i = 0; i < branches.size(); ++i) {
+    auto & branch = *branches[i];
+    auto * cond = branch.getCondition();
+    IRBuilder<> builder(&branch);
+
+    // all/any are taken over the active lanes, instances without active lanes do not count
+    auto * allTrue = builder.CreateCall(&allFunc, cond, "lp.alltrue");
+    auto * anyTrue = builder.CreateCall(&anyFunc, cond, "lp.anytrue");
+    auto * anyLive = builder.CreateCall(&anyFunc, builder.getTrue(), "lp.live");
+    auto * outcomeSlot = builder.CreateSelect(allTrue, builder.getInt32(0), builder.CreateSelect(anyTrue, builder.getInt32(2), builder.getInt32(1)), "lp.slot");
+    auto * slotIdx = builder.CreateAdd(builder.getInt32(i * NumOutcomeSlots), outcomeSlot, "lp.idx");
+    auto * slotPtr = builder.CreateInBoundsGEP(counters.getValueType(), &counters, {builder.getInt32(0), slotIdx}, "lp.ptr");
+    auto * count = builder.CreateLoad(counterTy, slotPtr, "lp.count");
+    auto * increment = builder.CreateZExt(anyLive, counterTy);
+    auto * newCount = builder.CreateAdd(count, increment, "lp.inc");
+    auto * store = builder.CreateStore(newCount, slotPtr);
+
+    // constants folded by the builder are not instructions
+    Value * profValues[] = {allTrue, anyTrue, anyLive, outcomeSlot, slotIdx, slotPtr, count, increment, newCount, store};
+    for (auto * profVal : profValues) {
+      if (isa<Instruction>(profVal)) vecInfo.setVectorShape(*profVal, VectorShape::uni());
+    }
+  }
+
+  CreateProfileWriter(mod, counters, funcName, regionIdx, branches.size(), config.laneProfileGen);
+  Report() << "lane profile: instrumented " << branches.size() << " divergent branches of " << funcName << "\n";
+}
+
+} // namespace rv
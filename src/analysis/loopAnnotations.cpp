@@ -25,6 +25,9 @@ LoopMD::print(raw_ostream & out) const {
   if (vectorizeEnable.isSet()) out << "vectorizeEnable = " << vectorizeEnable.get() << ", ";
   if (minDepDist.isSet()) out << "minDepDist = " << DepDistToString(minDepDist.get()) << ", ";
   if (explicitVectorWidth.isSet()) out << "explicitVectorWidth = " << explicitVectorWidth.get() << ", ";
+  if (unrollCount.isSet()) out << "unrollCount = " << unrollCount.get() << ", ";
+  if (nontemporalStores.isSet()) out << "nontemporalStores = " << nontemporalStores.get() << ", ";
+  if (parallelChunks.isSet()) out << "parallelChunks = " << parallelChunks.get() << ", ";
   out << "}";
   return out;
 }
@@ -68,6 +71,16 @@ OptimisticJoin(LoopMD && A, LoopMD && B) {
     md.explicitVectorWidth = std::min<iter_t>(A.explicitVectorWidth.safeGet(ParallelDistance), B.explicitVectorWidth.safeGet(ParallelDistance));
   }
 
+  // streaming stores if any hint says so
+  if (A.nontemporalStores.isSet() || B.nontemporalStores.isSet()) {
+    md.nontemporalStores = A.nontemporalStores.safeGet(false) || B.nontemporalStores.safeGet(false);
+  }
+
+  // use the larger chunks
+  if (A.parallelChunks.isSet() || B.parallelChunks.isSet()) {
+    md.parallelChunks = std::max<iter_t>(A.parallelChunks.safeGet(0), B.parallelChunks.safeGet(0));
+  }
+
   return md;
 }
 
@@ -130,6 +143,12 @@ GetLoopAnnotation(llvm::Loop & L) {
 
     } else if (text.equals("rv.loop.mindepdist")) {
       rvAnnot.minDepDist = cast<ConstantInt>(Cst->getValue())->getSExtValue();
+
+    } else if (text.equals("rv.loop.nontemporal")) {
+      rvAnnot.nontemporalStores = !Cst->getValue()->isNullValue();
+
+    } else if (text.equals("rv.loop.parallel_chunks")) {
+      rvAnnot.parallelChunks = cast<ConstantInt>(Cst->getValue())->getSExtValue();
     }
   }
 
@@ -158,6 +177,46 @@ ClearLoopVectorizeAnnotations(llvm::Loop & L) {
   L.setLoopID(emptyLoopMetadata);
 }
 
+std::vector<Metadata*>
+GetParallelAccessGroups(const llvm::Loop & L) {
+  std::vector<Metadata*> accessGroups;
+  auto *LID = L.getLoopID();
+  if (!LID) return accessGroups;
+
+  for (const MDOperand &Op : drop_begin(LID->operands())) {
+    auto *OpMD = dyn_cast<MDNode>(Op);
+    if (!OpMD || OpMD->getNumOperands() < 1) continue;
+    auto *Str = dyn_cast<MDString>(OpMD->getOperand(0));
+    if (!Str || !Str->getString().equals("llvm.loop.parallel_accesses")) continue;
+    for (const MDOperand &groupOp : drop_begin(OpMD->operands()))
+      accessGroups.push_back(groupOp.get());
+  }
+  return accessGroups;
+}
+
+void
+AddParallelAccessGroups(llvm::Loop & L, ArrayRef<Metadata*> accessGroups) {
+  if (accessGroups.empty()) return;
+  auto & ctx = L.getHeader()->getContext();
+
+  // slot 0 is the self reference
+  std::vector<Metadata*> mdArgs;
+  mdArgs.push_back(nullptr);
+  if (auto *LID = L.getLoopID()) {
+    for (const MDOperand &Op : drop_begin(LID->operands()))
+      mdArgs.push_back(Op.get());
+  }
+
+  std::vector<Metadata*> parallelArgs;
+  parallelArgs.push_back(MDString::get(ctx, "llvm.loop.parallel_accesses"));
+  parallelArgs.insert(parallelArgs.end(), accessGroups.begin(), accessGroups.end());
+  mdArgs.push_back(MDNode::get(ctx, parallelArgs));
+
+  MDNode *loopID = MDNode::getDistinct(ctx, mdArgs);
+  loopID->replaceOperandWith(0, loopID);
+  L.setLoopID(loopID);
+}
+
 void
 AppendMDEntries(LLVMContext & ctx, std::vector<Metadata*> & mdArgs, const LoopMD & llvmLoopMD) {
   if (llvmLoopMD.alreadyVectorized.isSet()) {
@@ -175,6 +234,11 @@ AppendMDEntries(LLVMContext & ctx, std::vector<Metadata*> & mdArgs, const LoopMD
                                               llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), llvmLoopMD.explicitVectorWidth.get()))};
     mdArgs.push_back(llvm::MDNode::get(ctx, mdVectorWidth));
   }
+  if (llvmLoopMD.unrollCount.isSet()) {
+    llvm::Metadata *mdUnrollCount[] = { llvm::MDString::get(ctx, "llvm.loop.unroll.count"),
+                                              llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), llvmLoopMD.unrollCount.get()))};
+    mdArgs.push_back(llvm::MDNode::get(ctx, mdUnrollCount));
+  }
 }
 
 // Encode \p loopMD as LLVM LoopVectorizer Metadata hints for the loop \p L.
@@ -182,11 +246,13 @@ void
 SetLLVMLoopAnnotations(llvm::Loop & L, LoopMD && llvmLoopMD) {
   auto & ctx = L.getHeader()->getContext();
 
+  // slot 0 is the self reference
   std::vector<Metadata*> mdArgs;
+  mdArgs.push_back(nullptr);
 
   AppendMDEntries(ctx, mdArgs, llvmLoopMD);
 
-  llvm::MDNode *emptyLoopMetadata = llvm::MDNode::get(ctx, mdArgs);
+  llvm::MDNode *emptyLoopMetadata = llvm::MDNode::getDistinct(ctx, mdArgs);
   emptyLoopMetadata->replaceOperandWith(0, emptyLoopMetadata);
 
   L.setLoopID(emptyLoopMetadata);
@@ -24,6 +24,23 @@ using namespace rv;
 
 void
 PredicateAnalysis::addDivergentBranch(const llvm::BasicBlock & rootBlock, llvm::ArrayRef<const llvm::BasicBlock*> & divSuccArray, BlockCallbackFunc BlockCallback) {
+  if (!CD.contains(rootBlock)) {
+    addDivergentBranchUncached(rootBlock, divSuccArray, BlockCallback);
+    return;
+  }
+
+  // divergent control re-converges at the end of the influence region of rootBlock (if at all)
+  for (const auto * regionBlock : CD.getInfluenceRegion(rootBlock)) {
+    bool wasVarying = false;
+    if (vecInfo.getVaryingPredicateFlag(*regionBlock, wasVarying) && wasVarying) continue;
+
+    vecInfo.setVaryingPredicateFlag(*regionBlock, true);
+    BlockCallback(*regionBlock);
+  }
+}
+
+void
+PredicateAnalysis::addDivergentBranchUncached(const llvm::BasicBlock & rootBlock, llvm::ArrayRef<const llvm::BasicBlock*> & divSuccArray, BlockCallbackFunc BlockCallback) {
 // infer pdbound (re-convergence point)
   const auto * rootPdNode = PDT.getNode(&rootBlock);
   const auto * pdBoundNode = rootPdNode ? rootPdNode->getIDom() : nullptr;
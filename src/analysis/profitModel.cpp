@@ -0,0 +1,261 @@
+//===- src/analysis/profitModel.cpp - learned profitability model --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/analysis/profitModel.h"
+
+#include "rv/analysis/costModel.h"
+#include "rv/config.h"
+#include "rv/vectorizationInfo.h"
+
+#include "report.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+
+namespace rv {
+
+// BuiltinProfitTarget, BuiltinProfitNodes, BuiltinProfitRoots (tools/rv-train-profit.py --cpp)
+#include "profitModel.gen.inc"
+
+static const char * FeatureNames[] = {
+  "width", "score", "code_growth", "replication_share", "gather_scatter_share", "cascade_share", "blend_share",
+  "mask_share", "num_instructions", "varying_share", "divergent_branches", "masked_block_share",
+  "uniform_mem_share", "contiguous_mem_share", "varying_mem_share", "boscc", "cif", "gathers"
+};
+static_assert(sizeof(FeatureNames) / sizeof(FeatureNames[0]) == (size_t) ProfitFeature::NumFeatures,
+              "one name per profit feature");
+
+ProfitFeatures::ProfitFeatures() {
+  for (auto & value : values) value = 0.0;
+}
+
+const char *
+ProfitFeatures::GetName(ProfitFeature feature) {
+  return FeatureNames[(int) feature];
+}
+
+// the feature named \p name, -1 if unknown
+static int
+GetFeatureIndex(StringRef name) {
+  for (int i = 0; i < (int) ProfitFeature::NumFeatures; ++i) {
+    if (name == FeatureNames[i]) return i;
+  }
+  return -1;
+}
+
+ProfitFeatures
+ProfitFeatures::Collect(const VectorizationInfo & vecInfo, const RegionCost & cost, const Config & config) {
+  ProfitFeatures features;
+  double vectorCost = cost.vectorCost > 0.0 ? cost.vectorCost : 1.0;
+  features[ProfitFeature::Width] = vecInfo.getVectorWidth();
+  features[ProfitFeature::Score] = cost.getScore();
+  features[ProfitFeature::CodeGrowth] = cost.getCodeGrowth();
+  features[ProfitFeature::ReplicationShare] = cost.replicationCost / vectorCost;
+  features[ProfitFeature::GatherScatterShare] = cost.gatherScatterCost / vectorCost;
+  features[ProfitFeature::CascadeShare] = cost.cascadeCost / vectorCost;
+  features[ProfitFeature::BlendShare] = cost.blendCost / vectorCost;
+  features[ProfitFeature::MaskShare] = cost.maskCost / vectorCost;
+
+  const auto & DL = vecInfo.getDataLayout();
+  size_t numInsts = 0, numVarying = 0, numDivergent = 0;
+  size_t numBlocks = 0, numMasked = 0;
+  size_t numMem = 0, numUniformMem = 0, numContiguousMem = 0;
+  vecInfo.getRegion().for_blocks([&](const BasicBlock & block) {
+    ++numBlocks;
+    bool isMasked = false;
+    if (vecInfo.getVaryingPredicateFlag(block, isMasked) && isMasked) ++numMasked;
+
+    for (const auto & inst : block) {
+      ++numInsts;
+      if (!inst.getType()->isVoidTy() && vecInfo.getVectorShape(inst).isVarying()) ++numVarying;
+      if (const auto * branch = dyn_cast<BranchInst>(&inst)) {
+        if (branch->isConditional() && !vecInfo.getVectorShape(*branch->getCondition()).isUniform()) ++numDivergent;
+      }
+
+      const Value * ptr = getLoadStorePointerOperand(&inst);
+      if (!ptr) continue;
+      ++numMem;
+      auto ptrShape = vecInfo.getVectorShape(*ptr);
+      if (ptrShape.isUniform()) {
+        ++numUniformMem;
+      } else if (ptrShape.hasStridedShape() &&
+                 ptrShape.getStride() == (int) DL.getTypeStoreSize(getLoadStoreType(const_cast<Instruction*>(&inst)))) {
+        ++numContiguousMem;
+      }
+    }
+    return true;
+  });
+
+  features[ProfitFeature::NumInstructions] = numInsts;
+  features[ProfitFeature::VaryingShare] = numInsts ? numVarying / (double) numInsts : 0.0;
+  features[ProfitFeature::DivergentBranches] = numDivergent;
+  features[ProfitFeature::MaskedBlockShare] = numBlocks ? numMasked / (double) numBlocks : 0.0;
+  if (numMem > 0) {
+    features[ProfitFeature::UniformMemShare] = numUniformMem / (double) numMem;
+    features[ProfitFeature::ContiguousMemShare] = numContiguousMem / (double) numMem;
+    features[ProfitFeature::VaryingMemShare] = (numMem - numUniformMem - numContiguousMem) / (double) numMem;
+  }
+  features[ProfitFeature::BOSCC] = config.enableHeuristicBOSCC;
+  features[ProfitFeature::CIF] = config.enableCoherentIF;
+  features[ProfitFeature::Gathers] = config.useScatterGatherIntrinsics;
+  return features;
+}
+
+void
+ProfitFeatures::print(raw_ostream & out) const {
+  for (int i = 0; i < (int) ProfitFeature::NumFeatures; ++i) {
+    if (i > 0) out << ", ";
+    out << "\"" << FeatureNames[i] << "\": " << values[i];
+  }
+}
+
+ProfitModel::ProfitModel()
+: target(BuiltinProfitTarget)
+{
+  for (const auto & node : BuiltinProfitNodes) nodes.push_back(node);
+  for (int root : BuiltinProfitRoots) {
+    if (root >= 0) roots.push_back(root);
+  }
+}
+
+ProfitModel::ProfitModel(const std::string & modelPath) {
+  if (!read(modelPath)) {
+    Report() << "profit model: ignoring " << modelPath << "\n";
+    nodes.clear();
+    roots.clear();
+  }
+}
+
+bool
+ProfitModel::read(const std::string & modelPath) {
+  auto bufferOrErr = MemoryBuffer::getFile(modelPath);
+  if (!bufferOrErr) {
+    Report() << "profit model: could not read " << modelPath << "\n";
+    return false;
+  }
+
+  // node ids are local to their tree
+  int treeBase = -1;
+  StringRef text = (*bufferOrErr)->getBuffer();
+  while (!text.empty()) {
+    StringRef line;
+    std::tie(line, text) = text.split('\n');
+    line = line.split('#').first.trim();
+    if (line.empty()) continue;
+
+    SmallVector<StringRef, 8> fields;
+    line.split(fields, ' ', -1, false);
+    if (fields[0] == "target" && fields.size() == 2) {
+      target = fields[1].str();
+      continue;
+    }
+    if (fields[0] == "tree" && fields.size() == 1) {
+      treeBase = nodes.size();
+      roots.push_back(treeBase);
+      continue;
+    }
+
+    unsigned id;
+    bool isNode = fields[0] == "node" && fields.size() == 6;
+    bool isLeaf = fields[0] == "leaf" && fields.size() == 3;
+    if (treeBase < 0 || !(isNode || isLeaf) || fields[1].getAsInteger(10, id)) {
+      Report() << "profit model: malformed line '" << line << "'\n";
+      return false;
+    }
+
+    ProfitNode node{-1, 0.0, -1, -1, 0.0};
+    unsigned left = 0, right = 0;
+    if (isLeaf) {
+      node.value = std::strtod(fields[2].str().c_str(), nullptr);
+    } else {
+      node.feature = GetFeatureIndex(fields[2]);
+      node.threshold = std::strtod(fields[3].str().c_str(), nullptr);
+      if (node.feature < 0 || fields[4].getAsInteger(10, left) || fields[5].getAsInteger(10, right)) {
+        Report() << "profit model: malformed line '" << line << "'\n";
+        return false;
+      }
+      // children come after their parent (pre-order), a back edge would never reach a leaf
+      if (left <= id || right <= id) {
+        Report() << "profit model: child id not above its parent in line '" << line << "'\n";
+        return false;
+      }
+      node.left = treeBase + left;
+      node.right = treeBase + right;
+    }
+    if (nodes.size() <= (size_t) treeBase + id) nodes.resize(treeBase + id + 1, ProfitNode{-1, 0.0, -1, -1, 0.0});
+    nodes[treeBase + id] = node;
+  }
+
+  // every root and child has to be a node of the model
+  for (int root : roots) {
+    if (root >= (int) nodes.size()) {
+      Report() << "profit model: empty tree in " << modelPath << "\n";
+      return false;
+    }
+  }
+  for (const auto & node : nodes) {
+    if (node.feature >= 0 && (node.left >= (int) nodes.size() || node.right >= (int) nodes.size())) {
+      Report() << "profit model: dangling child in " << modelPath << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+const ProfitModel *
+ProfitModel::get() {
+  static std::once_flag loaded;
+  static std::unique_ptr<ProfitModel> profitModel;
+  std::call_once(loaded, [] {
+    const char * modelPath = getenv("RV_PROFIT_MODEL");
+    if (!modelPath) return;
+    if (StringRef(modelPath) == "builtin") profitModel.reset(new ProfitModel());
+    else profitModel.reset(new ProfitModel(modelPath));
+    Report() << "profit model: " << profitModel->roots.size() << " trees (target " << profitModel->target << ")\n";
+  });
+  return profitModel.get();
+}
+
+double
+ProfitModel::predictLogRatio(const ProfitFeatures & features) const {
+  double sum = 0.0;
+  for (int root : roots) {
+    int id = root;
+    while (nodes[id].feature >= 0) {
+      id = features.values[nodes[id].feature] < nodes[id].threshold ? nodes[id].left : nodes[id].right;
+    }
+    sum += nodes[id].value;
+  }
+  return sum;
+}
+
+unsigned
+ProfitModel::predictScore(const ProfitFeatures & features) const {
+  return (unsigned) (features[ProfitFeature::Score] * std::exp(predictLogRatio(features)) + 0.5);
+}
+
+bool
+ProfitModel::prefers(ProfitFeatures features, ProfitFeature feature, bool current) const {
+  features[feature] = 1.0;
+  double onRatio = predictLogRatio(features);
+  features[feature] = 0.0;
+  double offRatio = predictLogRatio(features);
+  if (onRatio == offRatio) return current;
+  return onRatio > offRatio;
+}
+
+} // namespace rv
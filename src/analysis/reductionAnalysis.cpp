@@ -10,6 +10,7 @@
 
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/PatternMatch.h>
@@ -36,6 +37,14 @@ InferRedKind(Instruction & inst, Reduction & red) {
     return RedKind::FMin;
   } else if (m_OrdFMax(m_Value(), m_Value()).match(&inst)) {
     return RedKind::FMax;
+  } else if (m_SMin(m_Value(), m_Value()).match(&inst)) {
+    return RedKind::SMin;
+  } else if (m_SMax(m_Value(), m_Value()).match(&inst)) {
+    return RedKind::SMax;
+  } else if (m_UMin(m_Value(), m_Value()).match(&inst)) {
+    return RedKind::UMin;
+  } else if (m_UMax(m_Value(), m_Value()).match(&inst)) {
+    return RedKind::UMax;
   }
 
   switch (inst.getOpcode()) {
@@ -100,7 +109,8 @@ Reduction::print(raw_ostream & out) const {
     levelLoop ? "(" + std::to_string(levelLoop->getLoopDepth()) + ") " + levelLoop->getName().str()
               : "<none>";
 
-   out << "Reduction { levelLoop = " << loopName << " redKind " << to_string(kind) << " elems:\n";
+   out << "Reduction { levelLoop = " << loopName << " redKind " << to_string(kind) << (isScan() ? " scan" : "") << (isIndex() ? " index" : "") << (isDotProduct() ? " dot" : "")
+       << (isRecurrence() ? " recurrence(" + std::to_string(recurrenceOrder) + ")" : "") << (isTailBlended() ? " tail" : "") << " elems:\n";
    for (const Instruction * elem : elements) {
      out << "- " << *elem << "\n";
    }
@@ -114,6 +124,8 @@ Reduction::print(raw_ostream & out) const {
 
 ReductionAnalysis::ReductionAnalysis(Function & F, FunctionAnalysisManager &FAM)
 : loopInfo(*FAM.getCachedResult<LoopAnalysis>(F))
+, domTree(FAM.getResult<DominatorTreeAnalysis>(F))
+, tailMask(nullptr)
 {}
 
 ReductionAnalysis::~ReductionAnalysis() {
@@ -302,6 +314,11 @@ static void forOperands(Instruction& Inst, std::function<void(Value*)> Func) {
      Func(RHS);
      return;
    }
+   if (m_MaxOrMin(m_Value(LHS), m_Value(RHS)).match(&Inst)) {
+     Func(LHS);
+     Func(RHS);
+     return;
+   }
 
    for (size_t i = 0; i < Inst.getNumOperands(); ++i)
      Func(Inst.getOperand(i));
@@ -336,9 +353,215 @@ ClassifyReduction(Reduction & red) {
   return kind;
 }
 
+static bool
+IsMinMaxKind(RedKind kind) {
+  switch (kind) {
+    case RedKind::SMin:
+    case RedKind::SMax:
+    case RedKind::UMin:
+    case RedKind::UMax:
+    case RedKind::FMin:
+    case RedKind::FMax:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool
+ReductionAnalysis::matchIndexRecurrence(Reduction & red, PHINode & headerPhi, Loop & loop) {
+  // idx = c ? i : idx with the select as the latch value
+  auto * latch = loop.getLoopLatch();
+  if (!latch || red.elements.size() != 2 || headerPhi.getNumIncomingValues() != 2) return false;
+  auto * sel = dyn_cast<SelectInst>(headerPhi.getIncomingValueForBlock(latch));
+  if (!sel || !red.contains(*sel)) return false;
+
+  bool pickTrue = sel->getFalseValue() == &headerPhi;
+  if (!pickTrue && sel->getTrueValue() != &headerPhi) return false;
+  auto * indexInst = dyn_cast<Instruction>(pickTrue ? sel->getTrueValue() : sel->getFalseValue());
+  auto * indexStride = indexInst ? getStrideInfo(*indexInst) : nullptr;
+  if (!indexStride || indexStride->inc == 0) return false;
+
+  // intermediate indices must not be used in the loop
+  for (auto * user : headerPhi.users()) {
+    if (user != sel) return false;
+  }
+  for (auto * user : sel->users()) {
+    auto * userInst = cast<Instruction>(user);
+    if (userInst != &headerPhi && loop.contains(userInst->getParent())) return false;
+  }
+
+  // argmin/argmax: the condition is the compare of a min/max select (key = c ? x : key)
+  Reduction * keyRed = nullptr;
+  if (auto * cmp = dyn_cast<CmpInst>(sel->getCondition())) {
+    for (int i = 0; i < 2; ++i) {
+      auto * keyPhi = dyn_cast<PHINode>(cmp->getOperand(i));
+      auto * cmpRed = keyPhi ? getReductionInfo(*keyPhi) : nullptr;
+      if (!cmpRed || cmpRed == &red || !IsMinMaxKind(cmpRed->kind) || !isHeaderPhi(*keyPhi, loop)) continue;
+
+      auto * keySel = dyn_cast<SelectInst>(keyPhi->getIncomingValueForBlock(latch));
+      if (!keySel || keySel->getCondition() != cmp) return false;
+      Value * newKey = pickTrue ? keySel->getTrueValue() : keySel->getFalseValue();
+      Value * oldKey = pickTrue ? keySel->getFalseValue() : keySel->getTrueValue();
+      if (oldKey != keyPhi || newKey != cmp->getOperand(1 - i)) return false; // index and key picked under different conditions
+      keyRed = cmpRed;
+    }
+  }
+
+  red.indexValue = indexInst;
+  red.keyReduction = keyRed;
+  IF_DEBUG_RED { errs() << "red: index recurrence " << headerPhi.getName() << (keyRed ? " (keyed)" : " (last index)") << "\n"; }
+  return true;
+}
+
+bool
+ReductionAnalysis::matchForwardRecurrence(Reduction & red, PHINode & headerPhi, Loop & loop) {
+  // prev = phi [init, cur] where cur does not depend on prev
+  auto * latch = loop.getLoopLatch();
+  if (!latch || red.elements.size() != 1 || headerPhi.getNumIncomingValues() != 2) return false;
+  // replicated phis (vector and aggregate types) have no vector to splice
+  if (!VectorType::isValidElementType(headerPhi.getType())) return false;
+
+  auto * input = dyn_cast<Instruction>(headerPhi.getIncomingValueForBlock(latch));
+  if (!input || input == &headerPhi || !loop.contains(input->getParent())) return false;
+
+  // the computed value at the bottom of the chain
+  Instruction * root = input;
+  int order = 1;
+  if (auto * inputPhi = dyn_cast<PHINode>(input)) {
+    // higher order: forwards a lower order recurrence
+    auto * inputRed = isHeaderPhi(*inputPhi, loop) ? getReductionInfo(*inputPhi) : nullptr;
+    if (!inputRed || !inputRed->isRecurrence()) return false;
+    order = inputRed->recurrenceOrder + 1;
+    while (auto * lowerPhi = dyn_cast<PHINode>(root)) {
+      root = getReductionInfo(*lowerPhi)->recurrenceInput;
+    }
+  } else {
+    // computed in every iteration, full per-iteration values (not the partial values of a reduction)
+    if (getReductionInfo(*input) || !domTree.dominates(input->getParent(), latch)) return false;
+  }
+
+  // the spliced vector is available after @root: it has to dominate all users in the loop
+  for (auto & use : headerPhi.uses()) {
+    auto * userInst = cast<Instruction>(use.getUser());
+    if (!loop.contains(userInst->getParent())) continue;
+    if (!domTree.dominates(root, use)) {
+      IF_DEBUG_RED { errs() << "red: recurrence " << headerPhi.getName() << " used before its input " << *root << "\n"; }
+      return false;
+    }
+  }
+
+  red.recurrenceInput = input;
+  red.recurrenceOrder = order;
+  IF_DEBUG_RED { errs() << "red: forward recurrence " << headerPhi.getName() << " of order " << order << "\n"; }
+  return true;
+}
+
+// users of the chain inside @loop that are not part of it.
+// Helpers that only feed back into the chain (the compare of a min/max select) do not count.
+static InstSet
+CollectLoopUsers(Reduction & red, Loop & loop) {
+  InstSet loopUsers;
+  for (auto * elem : red.elements) {
+    for (auto * user : elem->users()) {
+      auto * userInst = cast<Instruction>(user);
+      if (!loop.contains(userInst->getParent()) || red.contains(*userInst)) continue;
+
+      bool feedsChain = !userInst->user_empty() && all_of(userInst->users(), [&](User * chainUser) {
+        auto * chainInst = dyn_cast<Instruction>(chainUser);
+        return chainInst && red.contains(*chainInst);
+      });
+      if (!feedsChain) loopUsers.insert(userInst);
+    }
+  }
+  return loopUsers;
+}
+
+// match a prefix scan (acc = acc (+) x with uses of acc in the loop).
+// Returns the scan input x or nullptr if the recurrence can not be computed as a scan.
+static Value *
+MatchScanInput(Reduction & red, PHINode & phi, Loop & loop, const InstSet & loopUsers, const DominatorTree & domTree) {
+  // a header phi and a single reductor that executes in every iteration
+  auto * latch = loop.getLoopLatch();
+  if (!latch || red.elements.size() != 2 || phi.getNumIncomingValues() != 2) return nullptr;
+  auto * reductor = dyn_cast<Instruction>(phi.getIncomingValueForBlock(latch));
+  if (!reductor || reductor == &phi || !red.contains(*reductor)) return nullptr;
+  if (!domTree.dominates(reductor->getParent(), latch)) return nullptr;
+
+  // acc - x would need a negated scan
+  auto oc = reductor->getOpcode();
+  if (oc == Instruction::Sub || oc == Instruction::FSub) return nullptr;
+
+  Value * scanInput = nullptr;
+  forOperands(*reductor, [&](Value * op) {
+    if (op != &phi) scanInput = op;
+  });
+  if (!scanInput) return nullptr;
+
+  // the prefix values are computed at the scan input
+  auto * inputInst = dyn_cast<Instruction>(scanInput);
+  if (!inputInst || !loop.contains(inputInst->getParent())) return scanInput;
+  for (auto * user : loopUsers) {
+    if (!domTree.dominates(inputInst, user)) return nullptr;
+  }
+  return scanInput;
+}
+
+// match the tail blend (tailMask ? update : phi) of a tail-folded loop where the update is part of the chain.
+// Returns the select or nullptr.
+static SelectInst *
+MatchTailBlend(Reduction & red, PHINode & phi, Loop & loop, Value * tailMask) {
+  auto * latch = loop.getLoopLatch();
+  if (!tailMask || !latch || phi.getNumIncomingValues() != 2) return nullptr;
+  auto * blend = dyn_cast<SelectInst>(phi.getIncomingValueForBlock(latch));
+  if (!blend || blend->getCondition() != tailMask || blend->getFalseValue() != &phi || !red.contains(*blend)) return nullptr;
+  auto * update = dyn_cast<Instruction>(blend->getTrueValue());
+  if (!update || update == &phi || !red.contains(*update)) return nullptr;
+  return blend;
+}
+
+// the value that updates @phi in each iteration (seen through the tail blend)
+static Value *
+GetLatchUpdate(Reduction & red, PHINode & phi, BasicBlock & latch) {
+  if (red.isTailBlended()) return red.tailBlend->getTrueValue();
+  return phi.getIncomingValueForBlock(&latch);
+}
+
+// match an i32 dot product (acc = acc + ext(a) * ext(b) with a, b of type i8 or i16).
+// Returns the multiply or nullptr.
+static Instruction *
+MatchDotProduct(Reduction & red, PHINode & phi, Loop & loop, const DominatorTree & domTree) {
+  auto * latch = loop.getLoopLatch();
+  if (!latch || red.numChainNodes() != 2 || phi.getNumIncomingValues() != 2) return nullptr;
+  if (!phi.getType()->isIntegerTy(32)) return nullptr;
+  auto * reductor = dyn_cast<BinaryOperator>(GetLatchUpdate(red, phi, *latch));
+  for (auto * user : phi.users()) {
+    if (user != reductor && user != red.tailBlend) return nullptr;
+  }
+  if (!reductor || reductor->getOpcode() != Instruction::Add || !red.contains(*reductor)) return nullptr;
+  if (!domTree.dominates(reductor->getParent(), latch)) return nullptr;
+
+  Value * addend = reductor->getOperand(0) == &phi ? reductor->getOperand(1) : reductor->getOperand(0);
+  auto * mul = dyn_cast<BinaryOperator>(addend);
+  if (!mul || mul->getOpcode() != Instruction::Mul || !mul->hasOneUse()) return nullptr;
+
+  // both factors are extended from the same narrow type
+  Type * narrowTy = nullptr;
+  for (auto & op : mul->operands()) {
+    auto * ext = dyn_cast<CastInst>(op.get());
+    if (!ext || (!isa<SExtInst>(ext) && !isa<ZExtInst>(ext))) return nullptr;
+    Type * srcTy = ext->getSrcTy();
+    if (!srcTy->isIntegerTy(8) && !srcTy->isIntegerTy(16)) return nullptr;
+    if (narrowTy && narrowTy != srcTy) return nullptr;
+    narrowTy = srcTy;
+  }
+  return mul;
+}
+
 void
-ReductionAnalysis::analyze(Loop & hostLoop) {
+ReductionAnalysis::analyze(Loop & hostLoop, Value * _tailMask) {
   clear();
+  tailMask = _tailMask;
 
 // init work list (loop header phis for now)
   std::vector<Loop*> loopStack;
@@ -350,6 +573,7 @@ ReductionAnalysis::analyze(Loop & hostLoop) {
 #endif
 
   std::vector<PHINode*> seedNodes;
+  std::vector<std::pair<PHINode*, Reduction*>> loopReductions;
   NodeStack nodeStack;
   while (!loopStack.empty()) {
     auto * loop = loopStack.back();
@@ -449,11 +673,60 @@ ReductionAnalysis::analyze(Loop & hostLoop) {
       red->kind = ClassifyReduction(*red);
     }
     red->levelLoop = &hostLoop;
+    red->tailBlend = MatchTailBlend(*red, *seedPhi, hostLoop, tailMask);
 
     // register with the analysis
     for (auto * inst : red->elements) {
       reductMap[inst] = red;
     }
+    loopReductions.emplace_back(seedPhi, red);
+  }
+
+  // recurrences that select an induction value (once all chains are known)
+  for (auto & phiRed : loopReductions) {
+    if (phiRed.second->kind == RedKind::Bot) matchIndexRecurrence(*phiRed.second, *phiRed.first, hostLoop);
+  }
+
+  // plain forward recurrences (higher orders once the lower order phi is known)
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (auto & phiRed : loopReductions) {
+      auto * red = phiRed.second;
+      if (red->kind != RedKind::Bot || red->isIndex() || red->isRecurrence()) continue;
+      changed |= matchForwardRecurrence(*red, *phiRed.first, hostLoop);
+    }
+  }
+
+  // intermediate values used in the loop -> prefix scan or unsupported
+  for (auto & phiRed : loopReductions) {
+    auto * red = phiRed.second;
+    if (red->kind != RedKind::Bot && red->kind != RedKind::Top) {
+      auto loopUsers = CollectLoopUsers(*red, hostLoop);
+
+      // the compare of an argmin/argmax also picks the index
+      for (auto itUser = loopUsers.begin(); itUser != loopUsers.end(); ) {
+        auto * user = *itUser;
+        bool isKeyCompare = isa<CmpInst>(user) && all_of(user->users(), [&](User * cmpUser) {
+          auto * cmpUserInst = cast<Instruction>(cmpUser);
+          auto * userRed = getReductionInfo(*cmpUserInst);
+          return red->contains(*cmpUserInst) || (userRed && userRed->keyReduction == red);
+        });
+        if (isKeyCompare) itUser = loopUsers.erase(itUser);
+        else ++itUser;
+      }
+
+      if (!loopUsers.empty()) {
+        red->scanInput = MatchScanInput(*red, *phiRed.first, hostLoop, loopUsers, domTree);
+        if (!red->isScan()) {
+          IF_DEBUG_RED { errs() << "red: intermediate values used in the loop, not a scan: " << *phiRed.first << "\n"; }
+          red->kind = RedKind::Top;
+        }
+      }
+
+      if (red->kind == RedKind::Add && !red->isScan()) {
+        red->dotProduct = MatchDotProduct(*red, *phiRed.first, hostLoop, domTree);
+      }
+    }
 
     IF_DEBUG_RED { red->dump(); }
   }
@@ -0,0 +1,237 @@
+//===- src/analysis/shapeSummary.cpp - inter-procedural shape transfer summaries --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/analysis/shapeSummary.h"
+
+#include "rv/intrinsics.h"
+
+#include "rvConfig.h"
+
+#include <llvm/ADT/SCCIterator.h>
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+#if 1
+#define IF_DEBUG_SUM IF_DEBUG
+#else
+#define IF_DEBUG_SUM if (false)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+bool
+ShapeSummary::getResultShape(const VectorShapeVec & argShapes, VectorShape & resultShape) const {
+  // keeps the alignment of the argument
+  // (the call is not vectorized, strided results of calls are not materialized)
+  if (returnedArg >= 0 && returnedArg < (int) argShapes.size() && argShapes[returnedArg].isUniform()) {
+    resultShape = argShapes[returnedArg];
+    return true;
+  }
+
+  for (size_t i = 0; i < argShapes.size(); ++i) {
+    if ((dependentArgs & (uint64_t(1) << i)) && !argShapes[i].isUniform()) return false;
+  }
+  resultShape = VectorShape::uni();
+  return true;
+}
+
+void
+ShapeSummary::print(raw_ostream & out) const {
+  out << "deps {";
+  bool first = true;
+  for (unsigned i = 0; i < 64; ++i) {
+    if (!(dependentArgs & (uint64_t(1) << i))) continue;
+    if (!first) out << ", ";
+    out << i;
+    first = false;
+  }
+  out << "}";
+  if (returnedArg >= 0) out << ", returns arg " << returnedArg;
+}
+
+// calls that neither write memory nor depend on the lane (nullptr if the call is opaque)
+static const Function *
+GetSummarizableCallee(const CallInst & call) {
+  if (call.isInlineAsm()) return nullptr;
+  const auto * callee = call.getCalledFunction();
+  if (!callee) return nullptr;
+  auto rvIntrin = GetIntrinsicID(*callee);
+  if (rvIntrin != RVIntrinsic::Unknown && rvIntrin != RVIntrinsic::Philox) return nullptr;
+  return callee;
+}
+
+bool
+ShapeSummaries::summarize(const Function & F, ShapeSummary & summary) const {
+  if (F.isDeclaration() || F.isVarArg() || F.arg_size() > 64) return false;
+
+  DenseMap<const Value*, uint64_t> deps;
+  for (const auto & arg : F.args()) {
+    deps[&arg] = uint64_t(1) << arg.getArgNo();
+  }
+  auto getDeps = [&](const Value * val) -> uint64_t {
+    auto it = deps.find(val);
+    return it == deps.end() ? 0 : it->second;
+  };
+  auto getOperandDeps = [&](const Instruction & inst) {
+    uint64_t opDeps = 0;
+    for (const auto & op : inst.operands()) opDeps |= getDeps(op.get());
+    return opDeps;
+  };
+
+  uint64_t memDeps = 0; // values stored to local memory
+  uint64_t ctrlDeps = 0; // branch conditions
+
+  // all dependences only grow, iterate until nothing changes
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (const auto & block : F) {
+      for (const auto & inst : block) {
+        uint64_t instDeps = 0;
+
+        if (const auto * store = dyn_cast<StoreInst>(&inst)) {
+          const auto * ptr = store->getPointerOperand();
+          if (store->isVolatile() || !isa<AllocaInst>(getUnderlyingObject(ptr))) {
+            IF_DEBUG_SUM { errs() << "shapeSummary: " << F.getName() << " writes memory " << *store << "\n"; }
+            return false;
+          }
+          uint64_t newMemDeps = memDeps | getOperandDeps(inst) | ctrlDeps;
+          changed |= newMemDeps != memDeps;
+          memDeps = newMemDeps;
+          continue;
+
+        } else if (const auto * call = dyn_cast<CallInst>(&inst)) {
+          const auto * callee = GetSummarizableCallee(*call);
+          if (!callee) return false;
+          if (isa<DbgInfoIntrinsic>(call) || isa<AssumeInst>(call) ||
+              (isa<IntrinsicInst>(call) && cast<IntrinsicInst>(call)->isLifetimeStartOrEnd())) {
+            continue;
+          }
+
+          auto itSummary = summaries.find(callee);
+          if (itSummary != summaries.end()) {
+            // map the argument dependences of the callee through
+            for (unsigned i = 0; i < call->arg_size(); ++i) {
+              if (itSummary->second.dependentArgs & (uint64_t(1) << i)) instDeps |= getDeps(call->getArgOperand(i));
+            }
+          } else if (callee->isDeclaration() && callee->onlyReadsMemory()) {
+            instDeps = getOperandDeps(inst);
+          } else {
+            IF_DEBUG_SUM { errs() << "shapeSummary: " << F.getName() << " calls opaque " << callee->getName() << "\n"; }
+            return false;
+          }
+
+        } else if (isa<CallBase>(inst)) {
+          return false; // invoke, callbr
+
+        } else if (isa<PHINode>(inst)) {
+          instDeps = getOperandDeps(inst) | ctrlDeps;
+
+        } else if (isa<LoadInst>(inst)) {
+          const auto * load = cast<LoadInst>(&inst);
+          if (load->isVolatile()) return false;
+          instDeps = getOperandDeps(inst);
+          if (isa<AllocaInst>(getUnderlyingObject(load->getPointerOperand()))) instDeps |= memDeps;
+
+        } else if (isa<BranchInst>(inst) || isa<SwitchInst>(inst)) {
+          uint64_t newCtrlDeps = ctrlDeps | getOperandDeps(inst);
+          changed |= newCtrlDeps != ctrlDeps;
+          ctrlDeps = newCtrlDeps;
+          continue;
+
+        } else if (isa<ReturnInst>(inst) || isa<UnreachableInst>(inst)) {
+          continue;
+
+        } else if (inst.mayHaveSideEffects() || isa<IndirectBrInst>(inst)) {
+          // atomics, fences, invokes, ..
+          IF_DEBUG_SUM { errs() << "shapeSummary: " << F.getName() << " has side effects " << inst << "\n"; }
+          return false;
+
+        } else {
+          instDeps = getOperandDeps(inst);
+        }
+
+        auto & oldDeps = deps[&inst];
+        if ((oldDeps | instDeps) != oldDeps) {
+          oldDeps |= instDeps;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // result deps and the returned argument
+  uint64_t resultDeps = 0;
+  int returnedArg = -1;
+  size_t numReturns = 0;
+  bool returnsSameArg = true;
+  for (const auto & block : F) {
+    const auto * ret = dyn_cast<ReturnInst>(block.getTerminator());
+    if (!ret) continue;
+    numReturns++;
+    const auto * retVal = ret->getReturnValue();
+    if (!retVal) continue;
+    resultDeps |= getDeps(retVal);
+
+    const auto * retArg = dyn_cast<Argument>(retVal);
+    if (!retArg || (returnedArg >= 0 && (int) retArg->getArgNo() != returnedArg)) {
+      returnsSameArg = false;
+    } else {
+      returnedArg = retArg->getArgNo();
+    }
+  }
+  if (numReturns > 1) resultDeps |= ctrlDeps;
+
+  summary.dependentArgs = resultDeps;
+  summary.returnedArg = returnsSameArg ? returnedArg : -1;
+  return true;
+}
+
+ShapeSummaries::ShapeSummaries(Module & mod) {
+  CallGraph callGraph(mod);
+
+  // bottom-up: callees are summarized before their callers
+  for (auto itSCC = scc_begin(&callGraph); !itSCC.isAtEnd(); ++itSCC) {
+    if (itSCC.hasCycle()) continue; // recursion
+
+    const auto * F = (*itSCC)[0]->getFunction();
+    if (!F) continue;
+
+    ShapeSummary summary;
+    if (summarize(*F, summary)) summaries[F] = summary;
+  }
+
+  IF_DEBUG_SUM { print(errs()); }
+}
+
+const ShapeSummary *
+ShapeSummaries::getSummary(const Function & F) const {
+  auto it = summaries.find(&F);
+  return it == summaries.end() ? nullptr : &it->second;
+}
+
+void
+ShapeSummaries::print(raw_ostream & out) const {
+  out << "ShapeSummaries {\n";
+  for (const auto & it : summaries) {
+    out << "\t" << it.first->getName() << ": ";
+    it.second.print(out);
+    out << "\n";
+  }
+  out << "}\n";
+}
+
+} // namespace rv
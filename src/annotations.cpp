@@ -11,17 +11,21 @@
 
 #include "rvConfig.h"
 #include <cassert>
+#include <string>
 
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Metadata.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
 
 using namespace llvm;
 
 namespace {
   const char* rv_atomic_string = "rv_atomic";
   const char* rv_redkind_string  = "rv_redkind";
+  const char* rv_ulp_string = "rv.ulp";
+  const char* rv_variant_string = "rv.variant";
 }
 
 namespace rv {
@@ -65,4 +69,117 @@ ReadReductionHint(const llvm::PHINode & loopHeaderPhi) {
   return kind;
 }
 
+void
+SetULPErrorBound(llvm::Function & func, unsigned ulpBound) {
+  func.addFnAttr(rv_ulp_string, std::to_string(ulpBound));
+}
+
+void
+SetULPErrorBound(llvm::CallBase & call, unsigned ulpBound) {
+  auto & ctx = call.getContext();
+  auto * boundNode = ConstantAsMetadata::get(ConstantInt::get(Type::getInt32Ty(ctx), ulpBound));
+  call.setMetadata(rv_ulp_string, MDNode::get(ctx, boundNode));
+}
+
+int
+ReadULPErrorBound(const llvm::Function & func) {
+  if (!func.hasFnAttribute(rv_ulp_string)) return -1;
+  unsigned ulpBound;
+  if (func.getFnAttribute(rv_ulp_string).getValueAsString().getAsInteger(10, ulpBound)) return -1;
+  return (int) ulpBound;
+}
+
+int
+ReadULPErrorBound(const llvm::CallBase & call) {
+  auto * boxedBound = call.getMetadata(rv_ulp_string);
+  if (boxedBound && boxedBound->getNumOperands() >= 1) {
+    auto * boundConst = mdconst::dyn_extract<ConstantInt>(boxedBound->getOperand(0));
+    if (boundConst) return (int) boundConst->getZExtValue();
+  }
+
+  // !fpmath holds the maximal ULP error as a float
+  auto * fpMath = call.getMetadata(LLVMContext::MD_fpmath);
+  if (fpMath && fpMath->getNumOperands() >= 1) {
+    auto * ulpConst = mdconst::dyn_extract<ConstantFP>(fpMath->getOperand(0));
+    if (ulpConst) return (int) (ulpConst->getValueAPF().convertToFloat() * 10.0f);
+  }
+
+  const auto * caller = call.getFunction();
+  return caller ? ReadULPErrorBound(*caller) : -1;
+}
+
+// shapes are encoded as {kind (0 undef, 1 varying, 2 strided), stride, alignment}
+static MDNode *
+CreateShapeNode(LLVMContext & ctx, const VectorShape & shape) {
+  auto * intTy = Type::getInt64Ty(ctx);
+  int64_t kind = !shape.isDefined() ? 0 : (shape.isVarying() ? 1 : 2);
+  int64_t stride = shape.hasStridedShape() ? shape.getStride() : 0;
+  return MDNode::get(ctx, {ConstantAsMetadata::get(ConstantInt::get(intTy, kind)),
+                           ConstantAsMetadata::get(ConstantInt::get(intTy, stride, true)),
+                           ConstantAsMetadata::get(ConstantInt::get(intTy, shape.getAlignmentFirst()))});
+}
+
+static bool
+ReadShapeNode(const MDOperand & op, VectorShape & shape) {
+  auto * shapeNode = dyn_cast<MDNode>(op);
+  if (!shapeNode || shapeNode->getNumOperands() != 3) return false;
+  int64_t fields[3];
+  for (int i = 0; i < 3; ++i) {
+    auto * fieldConst = mdconst::dyn_extract<ConstantInt>(shapeNode->getOperand(i));
+    if (!fieldConst) return false;
+    fields[i] = fieldConst->getSExtValue();
+  }
+  switch (fields[0]) {
+    case 0: shape = VectorShape::undef(); return true;
+    case 1: shape = VectorShape::varying(fields[2]); return true;
+    case 2: shape = VectorShape::strided(fields[1], fields[2]); return true;
+    default: return false;
+  }
+}
+
+void
+SetVariantMapping(llvm::Function & vecFunc, const VectorMapping & mapping) {
+  auto & ctx = vecFunc.getContext();
+  auto * intTy = Type::getInt32Ty(ctx);
+  SmallVector<Metadata*, 8> ops;
+  ops.push_back(MDString::get(ctx, mapping.scalarFn->getName()));
+  ops.push_back(ConstantAsMetadata::get(ConstantInt::get(intTy, mapping.vectorWidth)));
+  ops.push_back(ConstantAsMetadata::get(ConstantInt::get(intTy, mapping.maskPos, true)));
+  ops.push_back(ConstantAsMetadata::get(ConstantInt::get(intTy, (int) mapping.predMode)));
+  ops.push_back(CreateShapeNode(ctx, mapping.resultShape));
+  for (const auto & argShape : mapping.argShapes) {
+    ops.push_back(CreateShapeNode(ctx, argShape));
+  }
+  vecFunc.setMetadata(rv_variant_string, MDNode::get(ctx, ops));
+}
+
+bool
+ReadVariantMapping(llvm::Function & vecFunc, VectorMapping & mapping) {
+  auto * variantNode = vecFunc.getMetadata(rv_variant_string);
+  if (!variantNode || variantNode->getNumOperands() < 5) return false;
+
+  auto * scaName = dyn_cast<MDString>(variantNode->getOperand(0));
+  if (!scaName) return false;
+  auto * scaFunc = vecFunc.getParent()->getFunction(scaName->getString());
+  if (!scaFunc || scaFunc->arg_size() + 5 != variantNode->getNumOperands()) return false;
+
+  auto * widthConst = mdconst::dyn_extract<ConstantInt>(variantNode->getOperand(1));
+  auto * maskPosConst = mdconst::dyn_extract<ConstantInt>(variantNode->getOperand(2));
+  auto * predModeConst = mdconst::dyn_extract<ConstantInt>(variantNode->getOperand(3));
+  if (!widthConst || !maskPosConst || !predModeConst) return false;
+
+  VectorShape resultShape;
+  if (!ReadShapeNode(variantNode->getOperand(4), resultShape)) return false;
+  VectorShapeVec argShapes;
+  for (unsigned i = 5; i < variantNode->getNumOperands(); ++i) {
+    VectorShape argShape;
+    if (!ReadShapeNode(variantNode->getOperand(i), argShape)) return false;
+    argShapes.push_back(argShape);
+  }
+
+  mapping = VectorMapping(scaFunc, &vecFunc, widthConst->getZExtValue(), maskPosConst->getSExtValue(),
+                          resultShape, argShapes, (CallPredicateMode) predModeConst->getZExtValue());
+  return true;
+}
+
 }
@@ -0,0 +1,284 @@
+//===- src/asyncVectorizer.cpp - background vectorization for JITs --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/asyncVectorizer.h"
+
+#include "rv/resolver/resolvers.h"
+#include "rv/rv.h"
+#include "rv/vectorizerSession.h"
+
+#include "report.h"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <algorithm>
+#include <cassert>
+
+using namespace llvm;
+
+namespace rv {
+
+static bool
+IsFinal(AsyncVectorizer::JobState state) {
+  return state == AsyncVectorizer::JobState::Done || state == AsyncVectorizer::JobState::Failed ||
+         state == AsyncVectorizer::JobState::Cancelled;
+}
+
+AsyncVectorizer::AsyncVectorizer(Config _config, unsigned numWorkers)
+: config(_config)
+, lock()
+, queueCond()
+, doneCond()
+, queues()
+, jobs()
+, workers()
+, nextId(1)
+, shutdown(false)
+{
+  if (numWorkers == 0) numWorkers = hardware_concurrency().compute_thread_count();
+
+  // open the RV_REPORT_FILE stream before the workers start reporting
+  ReportContinue();
+
+  for (unsigned i = 0; i < numWorkers; ++i) {
+    workers.emplace_back([this] { runWorker(); });
+  }
+}
+
+AsyncVectorizer::~AsyncVectorizer() {
+  std::vector<JobRef> dropped;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    shutdown = true;
+    for (auto & queue : queues) {
+      dropped.insert(dropped.end(), queue.begin(), queue.end());
+      queue.clear();
+    }
+    // running jobs stop at their next phase boundary
+    for (auto & itJob : jobs) {
+      if (itJob.second->state == JobState::Running) itJob.second->cancelRequested = true;
+    }
+  }
+  queueCond.notify_all();
+
+  for (auto & job : dropped) finishJob(*job, JobState::Cancelled);
+  for (auto & worker : workers) worker.join();
+}
+
+AsyncVectorizer::JobId
+AsyncVectorizer::submit(const VectorMapping & mapping, Priority priority, CompletionFn onDone) {
+  assert(mapping.scalarFn && !mapping.scalarFn->isDeclaration() && "scalar function without a body");
+  assert(mapping.vectorFn && mapping.vectorFn->isDeclaration() && "expected a vector declaration");
+
+  JobRef job;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    job = std::make_shared<Job>(nextId++, priority);
+  }
+  job->scalarName = mapping.scalarFn->getName().str();
+  job->vectorName = mapping.vectorFn->getName().str();
+  job->mapping = mapping;
+  job->mapping.scalarFn = nullptr;
+  job->mapping.vectorFn = nullptr;
+  job->onDone = onDone;
+
+  // snapshot on the calling thread: only the scalar function keeps its body
+  {
+    ValueToValueMapTy cloneMap;
+    const Function * scalarFn = mapping.scalarFn;
+    auto snapshotMod = CloneModule(*scalarFn->getParent(), cloneMap,
+                                   [scalarFn](const GlobalValue * GV) { return GV == scalarFn; });
+    raw_svector_ostream snapshotOut(job->snapshot);
+    WriteBitcodeToFile(*snapshotMod, snapshotOut);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    jobs[job->id] = job;
+    queues[(int) priority].push_back(job);
+  }
+  queueCond.notify_one();
+  return job->id;
+}
+
+AsyncVectorizer::JobRef
+AsyncVectorizer::lookup(JobId id) const {
+  std::lock_guard<std::mutex> guard(lock);
+  auto itJob = jobs.find(id);
+  return itJob != jobs.end() ? itJob->second : nullptr;
+}
+
+bool
+AsyncVectorizer::setPriority(JobId id, Priority priority) {
+  std::lock_guard<std::mutex> guard(lock);
+  auto itJob = jobs.find(id);
+  if (itJob == jobs.end() || itJob->second->state != JobState::Queued) return false;
+
+  auto job = itJob->second;
+  auto & oldQueue = queues[(int) job->priority];
+  auto itQueued = std::find(oldQueue.begin(), oldQueue.end(), job);
+  assert(itQueued != oldQueue.end());
+  oldQueue.erase(itQueued);
+  job->priority = priority;
+  queues[(int) priority].push_back(job);
+  return true;
+}
+
+bool
+AsyncVectorizer::cancel(JobId id) {
+  JobRef dropped;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto itJob = jobs.find(id);
+    if (itJob == jobs.end()) return false;
+    auto job = itJob->second;
+
+    if (job->state == JobState::Running) {
+      job->cancelRequested = true;
+      return true;
+    }
+    if (job->state != JobState::Queued) return false;
+
+    auto & queue = queues[(int) job->priority];
+    queue.erase(std::find(queue.begin(), queue.end(), job));
+    dropped = job;
+  }
+  finishJob(*dropped, JobState::Cancelled);
+  return true;
+}
+
+AsyncVectorizer::JobState
+AsyncVectorizer::getState(JobId id) const {
+  std::lock_guard<std::mutex> guard(lock);
+  auto itJob = jobs.find(id);
+  return itJob != jobs.end() ? itJob->second->state : JobState::Failed;
+}
+
+AsyncVectorizer::JobState
+AsyncVectorizer::wait(JobId id) {
+  auto job = lookup(id);
+  if (!job) return JobState::Failed;
+
+  std::unique_lock<std::mutex> guard(lock);
+  doneCond.wait(guard, [&] { return IsFinal(job->state); });
+  return job->state;
+}
+
+std::unique_ptr<Module>
+AsyncVectorizer::takeResult(JobId id, LLVMContext & ctx) {
+  JobRef job;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto itJob = jobs.find(id);
+    if (itJob == jobs.end() || itJob->second->state != JobState::Done) return nullptr;
+    job = itJob->second;
+    jobs.erase(itJob);
+  }
+
+  MemoryBufferRef resRef(StringRef(job->result.data(), job->result.size()), job->vectorName);
+  auto resModOrErr = parseBitcodeFile(resRef, ctx);
+  if (!resModOrErr) {
+    consumeError(resModOrErr.takeError());
+    return nullptr;
+  }
+  return std::move(*resModOrErr);
+}
+
+void
+AsyncVectorizer::forget(JobId id) {
+  std::lock_guard<std::mutex> guard(lock);
+  auto itJob = jobs.find(id);
+  if (itJob != jobs.end() && IsFinal(itJob->second->state)) jobs.erase(itJob);
+}
+
+AsyncVectorizer::JobRef
+AsyncVectorizer::popJob() {
+  std::unique_lock<std::mutex> guard(lock);
+  queueCond.wait(guard, [&] { return shutdown || !queues[0].empty() || !queues[1].empty(); });
+  if (shutdown) return nullptr;
+
+  // hot jobs first
+  auto & queue = queues[(int) Priority::Hot].empty() ? queues[(int) Priority::Cold] : queues[(int) Priority::Hot];
+  auto job = queue.front();
+  queue.pop_front();
+  job->state = JobState::Running;
+  return job;
+}
+
+void
+AsyncVectorizer::finishJob(Job & job, JobState state) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    job.state = state;
+  }
+  doneCond.notify_all();
+  if (job.onDone) job.onDone(job.id, state);
+}
+
+void
+AsyncVectorizer::runWorker() {
+  // the SLEEF modules stay loaded in workerCtx across jobs
+  LLVMContext workerCtx;
+  {
+    VectorizerSession session(config);
+    while (auto job = popJob()) {
+      runJob(*job, workerCtx, session);
+    }
+  }
+  releaseSleefModules(workerCtx);
+}
+
+void
+AsyncVectorizer::runJob(Job & job, LLVMContext & workerCtx, VectorizerSession & session) {
+  MemoryBufferRef srcRef(StringRef(job.snapshot.data(), job.snapshot.size()), job.scalarName);
+  auto modOrErr = parseBitcodeFile(srcRef, workerCtx);
+  if (!modOrErr) {
+    consumeError(modOrErr.takeError());
+    finishJob(job, JobState::Failed);
+    return;
+  }
+  std::unique_ptr<Module> mod = std::move(*modOrErr);
+  job.snapshot.clear();
+
+  VectorMapping wfvJob = job.mapping;
+  wfvJob.scalarFn = mod->getFunction(job.scalarName);
+  wfvJob.vectorFn = mod->getFunction(job.vectorName);
+  if (!wfvJob.scalarFn || !wfvJob.vectorFn) {
+    finishJob(job, JobState::Failed);
+    return;
+  }
+
+  session.attach(*mod);
+  bool vectorizeOk = session.vectorizeFunction(wfvJob, [&job] { return job.cancelRequested.load(); });
+  session.detach();
+
+  if (job.cancelRequested) {
+    finishJob(job, JobState::Cancelled);
+    return;
+  }
+  if (!vectorizeOk) {
+    finishJob(job, JobState::Failed);
+    return;
+  }
+
+  // the JIT can not resolve rv_* intrinsics, it already has the scalar function
+  lowerIntrinsics(*wfvJob.vectorFn);
+  wfvJob.scalarFn->deleteBody();
+
+  raw_svector_ostream resOut(job.result);
+  WriteBitcodeToFile(*mod, resOut);
+  finishJob(job, JobState::Done);
+}
+
+} // namespace rv
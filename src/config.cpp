@@ -7,10 +7,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "rv/config.h"
+#include "rv/analysis/costModel.h"
 #include "report.h"
 
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Function.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Target/TargetMachine.h>
 
 #include <cstdlib>
@@ -46,26 +48,103 @@ Config::Config()
 // backend defaults
 , scalarizeIndexComputation(true)
 , useScatterGatherIntrinsics(true)
+, enableGatherCost(!CheckFlag("RV_NO_GATHER_COST"))
 , enableMaskedMove(true)
 , useSafeDivisors(true)
+, enableMaskBits(!CheckFlag("RV_NO_MASK_BITS"))
+, enableDivisionLowering(!CheckFlag("RV_NO_DIV_LOWERING"))
+, enableFPEstimates(!CheckFlag("RV_NO_FP_ESTIMATES"))
+, enableNativeFPMinMax(!CheckFlag("RV_NO_NATIVE_FMINMAX"))
+, enableBitMasks(!CheckFlag("RV_NO_BIT_MASKS"))
+, enableIndexNarrowing(!CheckFlag("RV_NO_INDEX_NARROWING"))
+, enableVectorInductions(!CheckFlag("RV_NO_VECTOR_INDUCTIONS"))
+, enableTableLookup(!CheckFlag("RV_NO_TABLE_LOOKUP"))
+, enableDemandedLanes(!CheckFlag("RV_NO_DEMANDED_LANES"))
+, enableAVX512WidthPolicy(!CheckFlag("RV_NO_AVX512_WIDTH_POLICY"))
+, enableScatterCoalescing(CheckFlag("RV_SCATTER_COALESCE"))
+, enableAddressDispatch(CheckFlag("RV_ADDRESS_DISPATCH"))
+, enableIndexRuns(CheckFlag("RV_INDEX_RUNS"))
+, enableSpeculativeLoads(!CheckFlag("RV_NO_SPECULATIVE_LOADS"))
+, enableAccessMetadata(!CheckFlag("RV_NO_ACCESS_MD"))
+, enableVectorWidening(CheckFlag("RV_VECTOR_WIDENING"))
+, enableIntegerEmulation(!CheckFlag("RV_NO_INT_EMULATION"))
+, enableSelectAccessSplit(!CheckFlag("RV_NO_SELECT_SPLIT"))
+, enableComplexLowering(!CheckFlag("RV_NO_COMPLEX_LOWERING"))
+, enableNarrowIdioms(!CheckFlag("RV_NO_NARROW_IDIOMS"))
 
 // optimization defaults
 , enableSplitAllocas(!CheckFlag("RV_DISABLE_SPLITALLOCAS"))
 , enableStructOpt(!CheckFlag("RV_DISABLE_STRUCTOPT"))
+, enableSoAGathers(!CheckFlag("RV_NO_SOA_GATHERS"))
+, enablePromoteAllocas(!CheckFlag("RV_NO_PROMOTE_ALLOCAS"))
+, enablePromoteMemReductions(!CheckFlag("RV_NO_PROMOTE_MEMREDS"))
 , enableSROV(!CheckFlag("RV_DISABLE_SROV"))
 , enableIRPolish(CheckFlag("RV_ENABLE_POLISH"))
 , enableHeuristicBOSCC(CheckFlag("RV_EXP_BOSCC"))
 , enableCoherentIF(CheckFlag("RV_EXP_CIF"))
+, enableEarlyExits(CheckFlag("RV_EARLY_EXITS"))
+, enableUniformVersioning(CheckFlag("RV_UNIFORM_VERSIONING"))
+, enableTripCountVersioning(CheckFlag("RV_TRIPCOUNT_VERSIONING"))
+, enableSwitchDispatch(!CheckFlag("RV_NO_SWITCH_DISPATCH"))
+, laneProfileGen()
+, laneProfileUse()
 , enableOptimizedBlends(!CheckFlag("RV_NO_BLENDOPT"))
+, enableVectorLICM(!CheckFlag("RV_NO_VECTOR_LICM"))
+, enableExitBits(!CheckFlag("RV_NO_EXIT_BITS"))
+, enableRecursionToLoop(CheckFlag("RV_RECURSION_LOOPS"))
+, enableMathFusion(!CheckFlag("RV_NO_MATH_FUSION"))
+, enableSleefColdSplit(!CheckFlag("RV_NO_SLEEF_COLD_SPLIT"))
+, enablePressureWidth(!CheckFlag("RV_NO_PRESSURE_WIDTH"))
+, enablePressureSched(CheckFlag("RV_SCHED_PRESSURE"))
+, enableMaskCSE(!CheckFlag("RV_NO_MASK_CSE"))
+, enableInterleavedAccess(!CheckFlag("RV_NO_INTERLEAVED"))
+, enableGatherCoalescing(!CheckFlag("RV_NO_GATHER_COALESCING"))
+, enableShuffleTrees(!CheckFlag("RV_NO_SHUFFLE_TREES"))
+, enableTailFolding(CheckFlag("RV_TAIL_FOLDING"))
+, enableVectorEpilogue(CheckFlag("RV_VECTOR_EPILOGUE"))
+, enableOverlapTail(CheckFlag("RV_OVERLAP_TAIL"))
+, enableProfileTrips(!CheckFlag("RV_NO_PROFILE_TRIPS"))
+, enableAutoLoopVec(CheckFlag("RV_AUTO_LOOPVEC"))
+, enableRuntimeAliasChecks(CheckFlag("RV_RUNTIME_ALIAS_CHECKS"))
+, enableStrideVersioning(CheckFlag("RV_STRIDE_VERSIONING"))
+, enableAlignPeeling(CheckFlag("RV_ALIGN_PEEL"))
+, enableLaneRefill(CheckFlag("RV_LANE_REFILL"))
+, enableLoopCollapse(CheckFlag("RV_LOOP_COLLAPSE"))
+, enableDepForwarding(CheckFlag("RV_DEP_FORWARDING"))
+, enableSearchLoops(CheckFlag("RV_SEARCH_LOOPS"))
+, enablePrefetch(CheckFlag("RV_PREFETCH"))
+, enableStreamingStores(false)
 
 // enable greedy inter-procedural vectorization
 , enableGreedyIPV(CheckFlag("RV_IPV"))
+, enableShapeSummaries(!CheckFlag("RV_NO_SHAPE_SUMMARIES"))
+, enableWaterfallCalls(!CheckFlag("RV_NO_WATERFALL"))
+, enableTransposedReductions(!CheckFlag("RV_NO_TRANSPOSED_REDUCTIONS"))
+, enableUniformOffload(!CheckFlag("RV_NO_UNIFORM_OFFLOAD"))
+, enableResolverCosts(!CheckFlag("RV_NO_RESOLVER_COSTS"))
+, enableFastVariantCC(!CheckFlag("RV_NO_FAST_VARIANT_CC"))
 #ifdef LLVM_HAVE_VP
 , enableVP(!CheckFlag("RV_DISABLE_VP"))
 #else
 , enableVP(false)
 #endif
 , maxULPErrorBound(10)
+, vecLib(VecLib_None)
+, batchMapPath()
+, fpRedOrder(RedOrder_Fast)
+, redAccumulators(1)
+, interleave(0)
+, maxSplitParts(1)
+, maxVectorBits(0)
+, tileRows(1)
+, prefetchDistance(0)
+, streamingStoreMinBytes(0)
+, replicationBudget(48)
+, divLoopScalarTail(0)
+, codeGrowthBudget(32)
+, parallelChunks(0)
+, parallelRuntime("rv_parallel_for")
+, vaThreads(1)
 
 // feature flags
 , useVE(false)
@@ -73,11 +152,22 @@ Config::Config()
 , useAVX(false)
 , useAVX2(false)
 , useAVX512(false)
+, useAVX512VL(false)
+, useAVX512CD(false)
 , useNEON(false)
 , useADVSIMD(false)
+, useSVE(false)
+, useVNNI(false)
+, useDotProd(false)
+, useFP16(false)
+, useF16C(false)
+, useBF16(false)
 
 // codegen flags
 , useAVL(CheckFlag("RV_FORCE_AVL")) 
+, checkShapeHints(CheckFlag("RV_CHECK_SHAPES"))
+, shapeCheckHook()
+, laneStatsPath()
 {
   const char *ULP = getenv("RV_ACCURACY");
   if (ULP) {
@@ -85,6 +175,163 @@ Config::Config()
     if (CustomBound > 0) maxULPErrorBound = CustomBound;
     else Report() << "ERROR: Expected an > 0 integer for RV_ACCURACY\n";
   }
+
+  const char *LaneProfileGenPath = getenv("RV_LANE_PROFILE_GEN");
+  if (LaneProfileGenPath) laneProfileGen = LaneProfileGenPath;
+  const char *LaneProfilePath = getenv("RV_LANE_PROFILE");
+  if (LaneProfilePath) laneProfileUse = LaneProfilePath;
+
+  const char *ShapeCheckHook = getenv("RV_CHECK_SHAPES_HOOK");
+  if (ShapeCheckHook) {
+    shapeCheckHook = ShapeCheckHook;
+    checkShapeHints = true;
+  }
+
+  const char *LaneStatsPath = getenv("RV_LANE_STATS");
+  if (LaneStatsPath) laneStatsPath = LaneStatsPath;
+
+  const char *VecLibText = getenv("RV_VECLIB");
+  if (VecLibText) {
+    StringRef VecLibName(VecLibText);
+    if (VecLibName == "libmvec") vecLib = VecLib_LibMVec;
+    else if (VecLibName == "svml") vecLib = VecLib_SVML;
+    else Report() << "ERROR: Expected libmvec or svml for RV_VECLIB\n";
+  }
+
+  const char *BatchMapPath = getenv("RV_BATCH_MAP");
+  if (BatchMapPath) batchMapPath = BatchMapPath;
+
+  const char *RedOrderText = getenv("RV_RED_ORDER");
+  if (RedOrderText) {
+    StringRef RedOrderName(RedOrderText);
+    if (RedOrderName == "blocked") fpRedOrder = RedOrder_Blocked;
+    else if (RedOrderName == "fast" || RedOrderName == "0") fpRedOrder = RedOrder_Fast;
+    else fpRedOrder = RedOrder_Strict; // "strict" (and plain RV_RED_ORDER=1)
+  }
+
+  const char *RedAccus = getenv("RV_RED_ACCUMULATORS");
+  if (RedAccus) {
+    int NumAccus = atoi(RedAccus);
+    if (NumAccus > 0) redAccumulators = NumAccus;
+    else Report() << "ERROR: Expected an > 0 integer for RV_RED_ACCUMULATORS\n";
+  }
+
+  const char *InterleaveText = getenv("RV_INTERLEAVE");
+  if (InterleaveText) {
+    int Factor = atoi(InterleaveText);
+    if (Factor > 0) interleave = Factor;
+    else Report() << "ERROR: Expected an > 0 integer for RV_INTERLEAVE\n";
+  }
+
+  const char *SplitParts = getenv("RV_SPLIT_PARTS");
+  if (SplitParts) {
+    int NumParts = atoi(SplitParts);
+    if (NumParts > 0 && isPowerOf2_32(NumParts)) maxSplitParts = NumParts;
+    else Report() << "ERROR: Expected a power-of-two integer > 0 for RV_SPLIT_PARTS\n";
+  }
+
+  const char *TileRows = getenv("RV_TILE_ROWS");
+  if (TileRows) {
+    int NumRows = atoi(TileRows);
+    if (NumRows > 0) tileRows = NumRows;
+    else Report() << "ERROR: Expected an > 0 integer for RV_TILE_ROWS\n";
+  }
+
+  const char *PrefetchDist = getenv("RV_PREFETCH_DISTANCE");
+  if (PrefetchDist) {
+    int Distance = atoi(PrefetchDist);
+    if (Distance > 0) prefetchDistance = Distance;
+    else Report() << "ERROR: Expected an > 0 integer for RV_PREFETCH_DISTANCE\n";
+  }
+
+  const char *StreamingBytes = getenv("RV_NONTEMPORAL_BYTES");
+  if (StreamingBytes) {
+    int MinBytes = atoi(StreamingBytes);
+    if (MinBytes > 0) streamingStoreMinBytes = MinBytes;
+    else Report() << "ERROR: Expected an > 0 integer for RV_NONTEMPORAL_BYTES\n";
+  }
+
+  const char *ReplBudget = getenv("RV_REPLICATION_BUDGET");
+  if (ReplBudget) {
+    int Budget = atoi(ReplBudget);
+    if (Budget >= 0) replicationBudget = Budget;
+    else Report() << "ERROR: Expected an >= 0 integer for RV_REPLICATION_BUDGET\n";
+  }
+
+  const char *ScalarTail = getenv("RV_DIV_LOOP_SCALAR_TAIL");
+  if (ScalarTail) {
+    int Threshold = StringRef(ScalarTail) == "auto" ? -1 : atoi(ScalarTail);
+    if (Threshold >= -1) divLoopScalarTail = Threshold;
+    else Report() << "ERROR: Expected \"auto\" or an >= 0 integer for RV_DIV_LOOP_SCALAR_TAIL\n";
+  }
+
+  const char *GrowthBudget = getenv("RV_CODE_GROWTH_BUDGET");
+  if (GrowthBudget) {
+    int Budget = atoi(GrowthBudget);
+    if (Budget >= 0) codeGrowthBudget = Budget;
+    else Report() << "ERROR: Expected an >= 0 integer for RV_CODE_GROWTH_BUDGET\n";
+  }
+
+  const char *VectorBits = getenv("RV_MAX_VECTOR_BITS");
+  if (VectorBits) {
+    int Bits = atoi(VectorBits);
+    if (Bits >= 0) maxVectorBits = Bits;
+    else Report() << "ERROR: Expected an >= 0 integer for RV_MAX_VECTOR_BITS\n";
+  }
+
+  const char *ParChunks = getenv("RV_PARALLEL_CHUNKS");
+  if (ParChunks) {
+    int NumIters = atoi(ParChunks);
+    if (NumIters > 0) parallelChunks = NumIters;
+    else Report() << "ERROR: Expected an > 0 integer for RV_PARALLEL_CHUNKS\n";
+  }
+
+  const char *ParRuntime = getenv("RV_PARALLEL_RUNTIME");
+  if (ParRuntime) parallelRuntime = ParRuntime;
+
+  const char *VAThreads = getenv("RV_VA_THREADS");
+  if (VAThreads) {
+    int NumThreads = atoi(VAThreads);
+    if (NumThreads >= 0) vaThreads = NumThreads;
+    else Report() << "ERROR: Expected an >= 0 integer for RV_VA_THREADS\n";
+  }
+}
+
+// enable the target features of \p arch (RV_ARCH names).
+// Returns false for unknown archs.
+static bool
+ConfigureArch(Config & config, StringRef arch) {
+  if (arch == "avx2") {
+    config.useAVX2 = true;
+    config.useSSE = true;
+    config.useF16C = true; // every AVX2 core has F16C
+    return true;
+  } else if (arch == "avx512") {
+    config.useAVX512 = true;
+    config.useAVX512VL = true; // skylake-avx512 and later
+    config.useAVX512CD = true;
+    config.useAVX2 = true;
+    config.useSSE = true;
+    config.useF16C = true;
+    return true;
+  } else if (arch == "advsimd") {
+    config.useADVSIMD = true;
+    return true;
+  } else if (arch == "sve") {
+    config.useSVE = true;
+    config.useADVSIMD = true;
+    config.useNEON = true;
+    config.enableTailFolding = true; // predicated tails are cheap (the cost model still decides)
+    return true;
+#if 0
+  // LLVM upstream VP implementation is diverged from NEC sx-aurora-dev/llvm-project. Disable AVL for now
+  } else if (arch == "ve") {
+    config.useVE = true;
+    config.useAVL = !CheckFlag("RV_DISABLE_AVL");
+    return true;
+#endif
+  }
+  return false;
 }
 
 Config
@@ -94,28 +341,8 @@ Config::createDefaultConfig() {
   // override the RV target configuration
   char * rawArch = getenv("RV_ARCH");
 
-  if (rawArch) {
-    std::string arch = rawArch;
-    if (arch == "avx2") {
-      Report() << "RV_ARCH: configured for avx2!\n";
-      config.useAVX2 = true;
-      config.useSSE = true;
-    } else if (arch == "avx512") {
-      Report() << "RV_ARCH: configured for avx512!\n";
-      config.useAVX512 = true;
-      config.useAVX2 = true;
-      config.useSSE = true;
-    } else if (arch == "advsimd") {
-      Report() << "RV_ARCH: configured for arm advsimd!\n";
-      config.useADVSIMD = true;
-#if 0
-    // LLVM upstream VP implementation is diverged from NEC sx-aurora-dev/llvm-project. Disable AVL for now
-    } else if (arch == "ve") {
-      Report() << "RV_ARCH: configured for NEC SX-Aurora!\n";
-      config.useVE = true;
-      config.useAVL = !CheckFlag("RV_DISABLE_AVL");
-#endif
-    }
+  if (rawArch && ConfigureArch(config, rawArch)) {
+    Report() << "RV_ARCH: configured for " << rawArch << "!\n";
   }
 
   return config;
@@ -156,7 +383,17 @@ Config::createForFunction(Function & F) {
       {"+avx", [&config]() { config.useAVX = true; } },
       {"+avx2", [&config]() { config.useAVX2 = true; } },
       {"+avx512f", [&config]() { config.useAVX512 = true; } },
-      {"+neon", [&config]() { config.useADVSIMD = true; config.useNEON = true; } }
+      {"+avx512vl", [&config]() { config.useAVX512VL = true; } },
+      {"+avx512cd", [&config]() { config.useAVX512CD = true; } },
+      {"+neon", [&config]() { config.useADVSIMD = true; config.useNEON = true; } },
+      {"+sve", [&config]() { config.useSVE = true; config.enableTailFolding = true; } },
+      {"+avx512vnni", [&config]() { config.useVNNI = true; } },
+      {"+avxvnni", [&config]() { config.useVNNI = true; } },
+      {"+dotprod", [&config]() { config.useDotProd = true; } },
+      {"+avx512fp16", [&config]() { config.useFP16 = true; config.useF16C = true; } },
+      {"+fullfp16", [&config]() { config.useFP16 = true; } },
+      {"+f16c", [&config]() { config.useF16C = true; } },
+      {"+avx512bf16", [&config]() { config.useBF16 = true; } }
   };
 
   auto attribSet = F.getAttributes().getFnAttrs();
@@ -183,6 +420,41 @@ Config::createForFunction(Function & F) {
 
   }
 
+  // vector register bits: explicit for the function or, on AVX-512, by the density of heavy operations
+  Attribute bitsAttr = F.getFnAttribute("rv-max-vector-bits");
+  unsigned attrBits = 0;
+  if (bitsAttr.isStringAttribute() && !bitsAttr.getValueAsString().getAsInteger(10, attrBits)) {
+    config.maxVectorBits = attrBits;
+  } else if (config.useAVX512 && config.enableAVX512WidthPolicy && config.maxVectorBits == 0 && !F.isDeclaration()) {
+    config.maxVectorBits = CostModel::PickAVX512Bits(F);
+  }
+
+  return config;
+}
+
+Config
+Config::createForArch(Function & F, StringRef arch) {
+  Config config = createForFunction(F);
+
+  // replace the SIMD ISAs of F
+  config.useSSE = false;
+  config.useAVX = false;
+  config.useAVX2 = false;
+  config.useAVX512 = false;
+  config.useAVX512VL = false;
+  config.useAVX512CD = false;
+  config.useNEON = false;
+  config.useADVSIMD = false;
+  config.useSVE = false;
+  config.useVNNI = false;
+  config.useDotProd = false;
+  config.useFP16 = false;
+  config.useF16C = false;
+  config.useBF16 = false;
+  if (!ConfigureArch(config, arch)) {
+    Report() << "ERROR: unknown SIMD arch " << arch << "\n";
+  }
+
   return config;
 }
 
@@ -198,6 +470,28 @@ to_string(Config::VAMethod vam) {
   }
 }
 
+std::string
+to_string(Config::VecLib vecLib) {
+  switch(vecLib) {
+    case Config::VecLib_None: return "none";
+    case Config::VecLib_LibMVec: return "libmvec";
+    case Config::VecLib_SVML: return "svml";
+    default:
+        abort(); // invalid vector library
+  }
+}
+
+std::string
+to_string(Config::RedOrder redOrder) {
+  switch(redOrder) {
+    case Config::RedOrder_Fast: return "fast";
+    case Config::RedOrder_Strict: return "strict";
+    case Config::RedOrder_Blocked: return "blocked";
+    default:
+        abort(); // invalid reduction order
+  }
+}
+
 static void
 printVAFlags(const Config & config, llvm::raw_ostream & out) {
     out << "VA:   " << to_string(config.vaMethod) << ", foldAllBranches = " << config.foldAllBranches;
@@ -206,26 +500,106 @@ printVAFlags(const Config & config, llvm::raw_ostream & out) {
 static void
 printNativeFlags(const Config & config, llvm::raw_ostream & out) {
    out << "nat:  useScatterGather = " << config.useScatterGatherIntrinsics
-       << ", useSafeDiv = " << config.useSafeDivisors;
+       << ", enableGatherCost = " << config.enableGatherCost
+       << ", useSafeDiv = " << config.useSafeDivisors
+       << ", enableMaskBits = " << config.enableMaskBits
+       << ", enableDivisionLowering = " << config.enableDivisionLowering
+       << ", enableFPEstimates = " << config.enableFPEstimates
+       << ", enableNativeFPMinMax = " << config.enableNativeFPMinMax
+       << ", enableBitMasks = " << config.enableBitMasks
+       << ", enableIndexNarrowing = " << config.enableIndexNarrowing
+       << ", enableVectorInductions = " << config.enableVectorInductions
+       << ", enableTableLookup = " << config.enableTableLookup
+       << ", enableDemandedLanes = " << config.enableDemandedLanes
+       << ", enableAVX512WidthPolicy = " << config.enableAVX512WidthPolicy
+       << ", enableScatterCoalescing = " << config.enableScatterCoalescing
+       << ", enableAddressDispatch = " << config.enableAddressDispatch
+       << ", enableIndexRuns = " << config.enableIndexRuns
+       << ", enableSpeculativeLoads = " << config.enableSpeculativeLoads
+       << ", enableAccessMetadata = " << config.enableAccessMetadata
+       << ", enableVectorWidening = " << config.enableVectorWidening
+       << ", enableIntegerEmulation = " << config.enableIntegerEmulation
+       << ", enableSelectAccessSplit = " << config.enableSelectAccessSplit
+       << ", enableComplexLowering = " << config.enableComplexLowering
+       << ", enableNarrowIdioms = " << config.enableNarrowIdioms;
 }
 
 static void
 printOptFlags(const Config & config, llvm::raw_ostream & out) {
     out << "opts: enableSplitAllocas = " << config.enableSplitAllocas
         << ", enableStructOpt = " << config.enableStructOpt
+        << ", enableSoAGathers = " << config.enableSoAGathers
+        << ", enablePromoteAllocas = " << config.enablePromoteAllocas
+        << ", enablePromoteMemReductions = " << config.enablePromoteMemReductions
         << ", enableSROV = " << config.enableSROV
         << ", enableHeuristicBOSCC = " << config.enableHeuristicBOSCC
         << ", enableCoherentIF = " << config.enableCoherentIF
+        << ", enableEarlyExits = " << config.enableEarlyExits
+        << ", enableUniformVersioning = " << config.enableUniformVersioning
+        << ", enableTripCountVersioning = " << config.enableTripCountVersioning
+        << ", enableSwitchDispatch = " << config.enableSwitchDispatch
+        << ", laneProfileGen = " << config.laneProfileGen
+        << ", laneProfileUse = " << config.laneProfileUse
         << ", enableOptimizedBlends = " << config.enableOptimizedBlends
+        << ", enableVectorLICM = " << config.enableVectorLICM
+        << ", enableExitBits = " << config.enableExitBits
+        << ", enableRecursionToLoop = " << config.enableRecursionToLoop
+        << ", enableMathFusion = " << config.enableMathFusion
+        << ", enableSleefColdSplit = " << config.enableSleefColdSplit
+        << ", enablePressureWidth = " << config.enablePressureWidth
+        << ", enablePressureSched = " << config.enablePressureSched
+        << ", enableMaskCSE = " << config.enableMaskCSE
+        << ", enableInterleavedAccess = " << config.enableInterleavedAccess
+        << ", enableGatherCoalescing = " << config.enableGatherCoalescing
+        << ", enableShuffleTrees = " << config.enableShuffleTrees
+        << ", enableTailFolding = " << config.enableTailFolding
+        << ", enableVectorEpilogue = " << config.enableVectorEpilogue
+        << ", enableOverlapTail = " << config.enableOverlapTail
+        << ", enableProfileTrips = " << config.enableProfileTrips
+        << ", enableAutoLoopVec = " << config.enableAutoLoopVec
+        << ", enableRuntimeAliasChecks = " << config.enableRuntimeAliasChecks
+        << ", enableStrideVersioning = " << config.enableStrideVersioning
+        << ", enableAlignPeeling = " << config.enableAlignPeeling
+        << ", enableLaneRefill = " << config.enableLaneRefill
+        << ", enableLoopCollapse = " << config.enableLoopCollapse
+        << ", enableDepForwarding = " << config.enableDepForwarding
+        << ", enableSearchLoops = " << config.enableSearchLoops
+        << ", enablePrefetch = " << config.enablePrefetch
+        << ", enableStreamingStores = " << config.enableStreamingStores
         << ", enableIRPolish = " << config.enableIRPolish
         << ", greedyIPV = " << config.enableGreedyIPV
+        << ", enableShapeSummaries = " << config.enableShapeSummaries
+        << ", enableWaterfallCalls = " << config.enableWaterfallCalls
+        << ", enableTransposedReductions = " << config.enableTransposedReductions
+        << ", enableUniformOffload = " << config.enableUniformOffload
+        << ", enableResolverCosts = " << config.enableResolverCosts
+        << ", enableFastVariantCC = " << config.enableFastVariantCC
         << ", maxULPErrorBound = " << ulp_to_string(config.maxULPErrorBound)
-        << ", useAVL = " << config.useAVL << "\n";
+        << ", vecLib = " << to_string(config.vecLib)
+        << ", batchMapPath = " << config.batchMapPath
+        << ", fpRedOrder = " << to_string(config.fpRedOrder)
+        << ", redAccumulators = " << config.redAccumulators
+        << ", interleave = " << config.interleave
+        << ", maxSplitParts = " << config.maxSplitParts
+        << ", maxVectorBits = " << config.maxVectorBits
+        << ", tileRows = " << config.tileRows
+        << ", prefetchDistance = " << config.prefetchDistance
+        << ", streamingStoreMinBytes = " << config.streamingStoreMinBytes
+        << ", replicationBudget = " << config.replicationBudget
+        << ", divLoopScalarTail = " << config.divLoopScalarTail
+        << ", codeGrowthBudget = " << config.codeGrowthBudget
+        << ", parallelChunks = " << config.parallelChunks
+        << ", parallelRuntime = " << config.parallelRuntime
+        << ", vaThreads = " << config.vaThreads
+        << ", useAVL = " << config.useAVL
+        << ", checkShapeHints = " << config.checkShapeHints
+        << ", shapeCheckHook = " << config.shapeCheckHook
+        << ", laneStatsPath = " << config.laneStatsPath << "\n";
 }
 
 static void
 printFeatureFlags(const Config & config, llvm::raw_ostream & out) {
-  out << "arch: useSSE = " << config.useSSE << ", useAVX = " << config.useAVX << ", useAVX2 = " << config.useAVX2 << ", useAVX512 = " << config.useAVX512 << ", useNEON = " << config.useNEON << ", useADVSIMD = " << config.useADVSIMD << ", useVE = " << config.useVE << "\n";
+  out << "arch: useSSE = " << config.useSSE << ", useAVX = " << config.useAVX << ", useAVX2 = " << config.useAVX2 << ", useAVX512 = " << config.useAVX512 << ", useAVX512VL = " << config.useAVX512VL << ", useAVX512CD = " << config.useAVX512CD << ", useNEON = " << config.useNEON << ", useADVSIMD = " << config.useADVSIMD << ", useSVE = " << config.useSVE << ", useVNNI = " << config.useVNNI << ", useDotProd = " << config.useDotProd << ", useFP16 = " << config.useFP16 << ", useF16C = " << config.useF16C << ", useBF16 = " << config.useBF16 << ", useVE = " << config.useVE << "\n";
 }
 
 
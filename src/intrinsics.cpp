@@ -12,6 +12,7 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/IRBuilder.h>
 
 using namespace llvm;
 
@@ -27,6 +28,8 @@ MangleType(const Type & Ty) {
     return "nxv"+ std::to_string(ScalableVT->getElementCount().getKnownMinValue()) + MangleType(*ScalableVT->getElementType());
   } else if (auto FixedVT = dyn_cast<FixedVectorType>(&Ty)) {
     return "v" + std::to_string(FixedVT->getNumElements()) + MangleType(*FixedVT->getElementType());
+  } else if (auto PtrTy = dyn_cast<PointerType>(&Ty)) {
+    return "p" + std::to_string(PtrTy->getAddressSpace());
   }
   abort(); // TODO we really should use LLVM's facilities here...
 }
@@ -181,8 +184,8 @@ GetIntrinsicMapping(Function & func, RVIntrinsic rvIntrin) {
         &func,
         0, // no specific vector width
         -1, //
-        VectorShape::uni(),
-        {VectorShape::uni(), VectorShape::uni()},
+        VectorShape::varying(), // uniform for a uniform value (vectorShapeTransformer)
+        {VectorShape::varying(), VectorShape::varying()},
         CallPredicateMode::SafeWithoutPredicate
       ));
     } break;
@@ -235,6 +238,30 @@ GetIntrinsicMapping(Function & func, RVIntrinsic rvIntrin) {
         ));
     } break;
 
+    case RVIntrinsic::Uniform: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::uni(), // pinned by VectorizationAnalysis::init
+        {VectorShape::undef()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+
+    case RVIntrinsic::Strided: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::undef(), // pinned by VectorizationAnalysis::init
+        {VectorShape::undef(), VectorShape::uni()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+
     case RVIntrinsic::Compact: {
       return (VectorMapping(
         &func,
@@ -268,6 +295,94 @@ GetIntrinsicMapping(Function & func, RVIntrinsic rvIntrin) {
         CallPredicateMode::SafeWithoutPredicate
         ));
     } break;
+    case RVIntrinsic::ReduceAdd:
+    case RVIntrinsic::ReduceMul:
+    case RVIntrinsic::ReduceMin:
+    case RVIntrinsic::ReduceMax:
+    case RVIntrinsic::ReduceAnd:
+    case RVIntrinsic::ReduceOr: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::uni(),
+        {VectorShape::varying()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+    case RVIntrinsic::ScanAdd:
+    case RVIntrinsic::ScanMul:
+    case RVIntrinsic::ScanMin:
+    case RVIntrinsic::ScanMax:
+    case RVIntrinsic::ScanAnd:
+    case RVIntrinsic::ScanOr: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::varying(),
+        {VectorShape::varying()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+    case RVIntrinsic::ShuffleXor: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::varying(), // uniform for a uniform value (vectorShapeTransformer)
+        {VectorShape::varying(), VectorShape::uni()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+    case RVIntrinsic::Broadcast: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::varying(), // uniform for a uniform value or lane (vectorShapeTransformer)
+        {VectorShape::varying(), VectorShape::varying()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+    case RVIntrinsic::Sort:
+    case RVIntrinsic::Partition: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::varying(), // uniform for a uniform value (vectorShapeTransformer)
+        {VectorShape::varying(), VectorShape::varying()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+    case RVIntrinsic::Rank: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::varying(),
+        {VectorShape::varying()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
+    case RVIntrinsic::Philox: {
+      return (VectorMapping(
+        &func,
+        &func,
+        0, // no specific vector width
+        -1, //
+        VectorShape::varying(), // uniform for uniform operands (vectorShapeTransformer)
+        {VectorShape::varying(), VectorShape::varying(), VectorShape::varying()},
+        CallPredicateMode::SafeWithoutPredicate
+        ));
+    } break;
   }
 }
 
@@ -285,7 +400,8 @@ DeclareIntrinsic(RVIntrinsic id, llvm::Module & mod, Type *DataTy) {
     // TODO some decls are missing
     llvm_unreachable("unrecognized rv intrinsic");
 
-  case RVIntrinsic::EntryMask: {
+  case RVIntrinsic::EntryMask:
+  case RVIntrinsic::Mask: {
     auto *funcTy = FunctionType::get(boolTy, {}, false);
     rvFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
   } break;
@@ -310,6 +426,36 @@ DeclareIntrinsic(RVIntrinsic id, llvm::Module & mod, Type *DataTy) {
     rvFunc->setDoesNotRecurse();
   } break;
 
+  case RVIntrinsic::Extract: {
+    assert(DataTy && "rv_extract is declared per value type");
+    auto *funcTy = FunctionType::get(DataTy, {DataTy, intTy}, false);
+    rvFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
+  } break;
+
+  case RVIntrinsic::Insert: {
+    assert(DataTy && "rv_insert is declared per value type");
+    auto *funcTy = FunctionType::get(DataTy, {DataTy, intTy, DataTy}, false);
+    rvFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
+  } break;
+
+  case RVIntrinsic::Align: {
+    assert(DataTy && "rv_align is declared per pointer type");
+    auto *funcTy = FunctionType::get(DataTy, {DataTy, intTy}, false);
+    rvFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
+  } break;
+
+  case RVIntrinsic::Uniform: {
+    assert(DataTy && "rv_uniform is declared per value type");
+    auto *funcTy = FunctionType::get(DataTy, {DataTy}, false);
+    rvFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
+  } break;
+
+  case RVIntrinsic::Strided: {
+    assert(DataTy && "rv_strided is declared per value type");
+    auto *funcTy = FunctionType::get(DataTy, {DataTy, intTy}, false);
+    rvFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
+  } break;
+
   case RVIntrinsic::NumLanes:
   case RVIntrinsic::LaneID: {
     auto *funcTy = FunctionType::get(intTy, {}, false);
@@ -320,6 +466,12 @@ DeclareIntrinsic(RVIntrinsic id, llvm::Module & mod, Type *DataTy) {
     rvFunc->setDoesNotRecurse();
   } break;
 
+  case RVIntrinsic::Philox: {
+    auto *longTy = Type::getInt64Ty(context);
+    auto *funcTy = FunctionType::get(longTy, {longTy, longTy, longTy}, false);
+    rvFunc = Function::Create(funcTy, GlobalValue::ExternalLinkage, mangledName, &mod);
+  } break;
+
   }
 
   // set default attributes
@@ -330,5 +482,51 @@ DeclareIntrinsic(RVIntrinsic id, llvm::Module & mod, Type *DataTy) {
   return *rvFunc;
 }
 
+// Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC'11)
+static const uint64_t PhiloxM0 = 0xD2511F53;
+static const uint64_t PhiloxM1 = 0xCD9E8D57;
+static const uint64_t PhiloxW0 = 0x9E3779B9;
+static const uint64_t PhiloxW1 = 0xBB67AE85;
+static const unsigned PhiloxRounds = 10;
+
+Value *
+CreatePhilox4x32(IRBuilderBase & builder, Value * seed, Value * stream, Value * counter) {
+  auto * longTy = seed->getType();
+  auto * wordTy = longTy->getWithNewBitWidth(32);
+  auto loWord = [&](Value * val) { return builder.CreateTrunc(val, wordTy, "philox.lo"); };
+  auto hiWord = [&](Value * val) { return builder.CreateTrunc(builder.CreateLShr(val, 32), wordTy, "philox.hi"); };
+
+  // 32x32->64 bit product of a word and a multiplier constant
+  auto mulHiLo = [&](Value * word, uint64_t multiplier, Value *& hi, Value *& lo) {
+    auto * prod = builder.CreateMul(builder.CreateZExt(word, longTy), ConstantInt::get(longTy, multiplier), "philox.prod");
+    hi = hiWord(prod);
+    lo = loWord(prod);
+  };
+
+  Value * ctr[4] = {loWord(counter), hiWord(counter), loWord(stream), hiWord(stream)};
+  Value * key[2] = {loWord(seed), hiWord(seed)};
+
+  for (unsigned r = 0; r < PhiloxRounds; ++r) {
+    if (r > 0) {
+      key[0] = builder.CreateAdd(key[0], ConstantInt::get(wordTy, PhiloxW0), "philox.key");
+      key[1] = builder.CreateAdd(key[1], ConstantInt::get(wordTy, PhiloxW1), "philox.key");
+    }
+    Value *hi0, *lo0, *hi1, *lo1;
+    mulHiLo(ctr[0], PhiloxM0, hi0, lo0);
+    mulHiLo(ctr[2], PhiloxM1, hi1, lo1);
+    Value * next[4] = {
+      builder.CreateXor(builder.CreateXor(hi1, ctr[1]), key[0], "philox.ctr"),
+      lo1,
+      builder.CreateXor(builder.CreateXor(hi0, ctr[3]), key[1], "philox.ctr"),
+      lo0
+    };
+    std::copy(next, next + 4, ctr);
+  }
+
+  auto * lo = builder.CreateZExt(ctr[0], longTy);
+  auto * hi = builder.CreateShl(builder.CreateZExt(ctr[1], longTy), 32);
+  return builder.CreateOr(hi, lo, "philox");
+}
+
 }
 
@@ -0,0 +1,245 @@
+//===- src/native/DivisionBuilder.cpp - vector integer division --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "DivisionBuilder.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/IntrinsicsAArch64.h>
+#include <llvm/IR/IntrinsicsARM.h>
+#include <llvm/IR/IntrinsicsX86.h>
+#include <llvm/Support/MathExtras.h>
+
+#include "rv/config.h"
+
+using namespace llvm;
+
+namespace rv {
+
+static bool
+IsSignedDivision(Instruction::BinaryOps opcode) {
+  return opcode == Instruction::SDiv || opcode == Instruction::SRem;
+}
+
+static bool
+IsRemainder(Instruction::BinaryOps opcode) {
+  return opcode == Instruction::URem || opcode == Instruction::SRem;
+}
+
+// n - q * d
+static Value *
+CreateRemainder(IRBuilder<> &builder, Value &vecNum, Value &vecQuot, Value &vecDivisor) {
+  return builder.CreateSub(&vecNum, builder.CreateMul(&vecQuot, &vecDivisor), "div.rem");
+}
+
+// high half of the 2N-bit product of the N-bit vectors \p a and the splat of \p scaB
+static Value *
+CreateMulHigh(IRBuilder<> &builder, Value &vecA, Value &scaB, bool isSigned) {
+  auto *vecTy = cast<FixedVectorType>(vecA.getType());
+  unsigned numBits = vecTy->getScalarSizeInBits();
+  auto *wideTy = FixedVectorType::get(builder.getIntNTy(2 * numBits), vecTy->getNumElements());
+
+  auto *wideA = isSigned ? builder.CreateSExt(&vecA, wideTy) : builder.CreateZExt(&vecA, wideTy);
+  auto *wideB = builder.CreateVectorSplat(vecTy->getNumElements(),
+                                          isSigned ? builder.CreateSExt(&scaB, wideTy->getElementType())
+                                                   : builder.CreateZExt(&scaB, wideTy->getElementType()));
+  auto *product = builder.CreateMul(wideA, wideB, "div.mul");
+  auto *high = isSigned ? builder.CreateAShr(product, numBits) : builder.CreateLShr(product, numBits);
+  return builder.CreateTrunc(high, vecTy, "div.mulhi");
+}
+
+Value *
+CreateUniformDivision(IRBuilder<> &builder, Instruction::BinaryOps opcode, Value &vecNum, Value &scaDivisor) {
+  auto *vecTy = cast<FixedVectorType>(vecNum.getType());
+  auto *intTy = cast<IntegerType>(vecTy->getElementType());
+  unsigned numBits = intTy->getBitWidth();
+  unsigned width = vecTy->getNumElements();
+  assert(numBits <= 32 && "multiply-high needs twice the element width");
+  auto *wideTy = builder.getIntNTy(2 * numBits);
+  bool isSigned = IsSignedDivision(opcode);
+
+  // the source division executes for d == 0 only in undefined behavior but the multiplier is computed
+  // regardless of the mask: do not trap on a divisor that no active lane uses
+  auto *one = ConstantInt::get(intTy, 1);
+  auto *isZero = builder.CreateICmpEQ(&scaDivisor, ConstantInt::get(intTy, 0));
+  auto *safeDivisor = builder.CreateSelect(isZero, one, &scaDivisor, "div.safe");
+
+  Value *vecQuot = nullptr;
+  if (!isSigned) {
+    // l = ceil(log2(d)), m = floor(2^N * (2^l - d) / d) + 1
+    auto *log = builder.CreateSub(ConstantInt::get(intTy, numBits),
+                                  builder.CreateBinaryIntrinsic(Intrinsic::ctlz, builder.CreateSub(safeDivisor, one), builder.getFalse()), "div.log");
+    auto *wideDivisor = builder.CreateZExt(safeDivisor, wideTy);
+    auto *powLog = builder.CreateShl(ConstantInt::get(wideTy, 1), builder.CreateZExt(log, wideTy));
+    auto *dividend = builder.CreateShl(builder.CreateSub(powLog, wideDivisor), numBits);
+    auto *magic = builder.CreateTrunc(builder.CreateAdd(builder.CreateUDiv(dividend, wideDivisor), ConstantInt::get(wideTy, 1)), intTy, "div.magic");
+
+    // sh1 = min(l, 1), sh2 = max(l - 1, 0)
+    auto *logIsZero = builder.CreateICmpEQ(log, ConstantInt::get(intTy, 0));
+    auto *preShift = builder.CreateSelect(logIsZero, ConstantInt::get(intTy, 0), one, "div.sh1");
+    auto *postShift = builder.CreateSelect(logIsZero, ConstantInt::get(intTy, 0), builder.CreateSub(log, one), "div.sh2");
+
+    // q = (t + ((n - t) >> sh1)) >> sh2 with t = mulhi(m, n)
+    auto *high = CreateMulHigh(builder, vecNum, *magic, false);
+    auto *halfDiff = builder.CreateLShr(builder.CreateSub(&vecNum, high), builder.CreateVectorSplat(width, preShift));
+    vecQuot = builder.CreateLShr(builder.CreateAdd(high, halfDiff), builder.CreateVectorSplat(width, postShift), "div.quot");
+
+  } else {
+    // l = max(ceil(log2(|d|)), 1), m = 1 + floor(2^(N+l-1) / |d|) - 2^N (as N-bit value)
+    auto *absDivisor = builder.CreateBinaryIntrinsic(Intrinsic::abs, safeDivisor, builder.getFalse());
+    auto *ceilLog = builder.CreateSub(ConstantInt::get(intTy, numBits),
+                                      builder.CreateBinaryIntrinsic(Intrinsic::ctlz, builder.CreateSub(absDivisor, one), builder.getFalse()));
+    auto *log = builder.CreateBinaryIntrinsic(Intrinsic::umax, ceilLog, one, nullptr, "div.log");
+    auto *wideShift = builder.CreateAdd(builder.CreateZExt(log, wideTy), ConstantInt::get(wideTy, numBits - 1));
+    auto *dividend = builder.CreateShl(ConstantInt::get(wideTy, 1), wideShift);
+    auto *magic = builder.CreateTrunc(builder.CreateAdd(builder.CreateUDiv(dividend, builder.CreateZExt(absDivisor, wideTy)), ConstantInt::get(wideTy, 1)), intTy, "div.magic");
+
+    // q0 = ((n + mulsh(m, n)) >> (l - 1)) - (n >> (N - 1)), q = (q0 ^ sign(d)) - sign(d)
+    auto *high = CreateMulHigh(builder, vecNum, *magic, true);
+    auto *postShift = builder.CreateVectorSplat(width, builder.CreateSub(log, one));
+    auto *numSign = builder.CreateAShr(&vecNum, numBits - 1);
+    auto *absQuot = builder.CreateSub(builder.CreateAShr(builder.CreateAdd(&vecNum, high), postShift), numSign);
+    auto *divSign = builder.CreateVectorSplat(width, builder.CreateAShr(safeDivisor, numBits - 1), "div.sign");
+    vecQuot = builder.CreateSub(builder.CreateXor(absQuot, divSign), divSign, "div.quot");
+  }
+
+  if (!IsRemainder(opcode)) return vecQuot;
+  return CreateRemainder(builder, vecNum, *vecQuot, *builder.CreateVectorSplat(width, &scaDivisor));
+}
+
+Value *
+CreateFPDivision(IRBuilder<> &builder, Instruction::BinaryOps opcode, Value &vecNum, Value &vecDivisor, Type &fpElemTy) {
+  auto *vecTy = cast<FixedVectorType>(vecNum.getType());
+  auto *fpVecTy = FixedVectorType::get(&fpElemTy, vecTy->getNumElements());
+  bool isSigned = IsSignedDivision(opcode);
+
+  // rounding of n / d never reaches the next integer if n fits the mantissa, truncation then yields the quotient
+  auto *fpNum = isSigned ? builder.CreateSIToFP(&vecNum, fpVecTy) : builder.CreateUIToFP(&vecNum, fpVecTy);
+  auto *fpDivisor = isSigned ? builder.CreateSIToFP(&vecDivisor, fpVecTy) : builder.CreateUIToFP(&vecDivisor, fpVecTy);
+  auto *fpQuot = builder.CreateFDiv(fpNum, fpDivisor, "div.fp");
+  auto *vecQuot = isSigned ? builder.CreateFPToSI(fpQuot, vecTy, "div.quot") : builder.CreateFPToUI(fpQuot, vecTy, "div.quot");
+
+  if (!IsRemainder(opcode)) return vecQuot;
+  return CreateRemainder(builder, vecNum, *vecQuot, vecDivisor);
+}
+
+// more steps are slower than the division instruction (each step costs two dependent multiply-adds)
+static const int MaxNewtonSteps = 2;
+
+Intrinsic::ID
+GetFPEstimateIntrinsic(const Config &config, FPEstimate kind, FixedVectorType &vecTy, unsigned &estimateBits) {
+  bool isRcp = kind == FPEstimate::Reciprocal;
+  auto *elemTy = vecTy.getElementType();
+  if (!elemTy->isFloatTy() && !elemTy->isDoubleTy()) return Intrinsic::not_intrinsic;
+  bool isDouble = elemTy->isDoubleTy();
+  unsigned vecBits = vecTy.getPrimitiveSizeInBits().getFixedValue();
+
+  // relative error < 2^-14
+  if (config.useAVX512) {
+    estimateBits = 14;
+    switch (vecBits) {
+    case 512: return isDouble ? (isRcp ? Intrinsic::x86_avx512_rcp14_pd_512 : Intrinsic::x86_avx512_rsqrt14_pd_512)
+                              : (isRcp ? Intrinsic::x86_avx512_rcp14_ps_512 : Intrinsic::x86_avx512_rsqrt14_ps_512);
+    case 256: return isDouble ? (isRcp ? Intrinsic::x86_avx512_rcp14_pd_256 : Intrinsic::x86_avx512_rsqrt14_pd_256)
+                              : (isRcp ? Intrinsic::x86_avx512_rcp14_ps_256 : Intrinsic::x86_avx512_rsqrt14_ps_256);
+    case 128: return isDouble ? (isRcp ? Intrinsic::x86_avx512_rcp14_pd_128 : Intrinsic::x86_avx512_rsqrt14_pd_128)
+                              : (isRcp ? Intrinsic::x86_avx512_rcp14_ps_128 : Intrinsic::x86_avx512_rsqrt14_ps_128);
+    default: return Intrinsic::not_intrinsic;
+    }
+  }
+
+  // relative error < 1.5 * 2^-12, single precision only
+  if (config.useSSE || config.useAVX || config.useAVX2) {
+    estimateBits = 11;
+    if (isDouble) return Intrinsic::not_intrinsic;
+    if (vecBits == 128) return isRcp ? Intrinsic::x86_sse_rcp_ps : Intrinsic::x86_sse_rsqrt_ps;
+    if (vecBits == 256 && (config.useAVX || config.useAVX2)) return isRcp ? Intrinsic::x86_avx_rcp_ps_256 : Intrinsic::x86_avx_rsqrt_ps_256;
+    return Intrinsic::not_intrinsic;
+  }
+
+  // relative error < 2^-8
+  if (config.useADVSIMD) {
+    estimateBits = 8;
+    if (vecBits != 64 && vecBits != 128) return Intrinsic::not_intrinsic;
+    return isRcp ? Intrinsic::aarch64_neon_frecpe : Intrinsic::aarch64_neon_frsqrte;
+  }
+  if (config.useNEON) {
+    estimateBits = 8;
+    if (isDouble || (vecBits != 64 && vecBits != 128)) return Intrinsic::not_intrinsic;
+    return isRcp ? Intrinsic::arm_neon_vrecpe : Intrinsic::arm_neon_vrsqrte;
+  }
+
+  return Intrinsic::not_intrinsic;
+}
+
+int
+GetNewtonSteps(unsigned estimateBits, Type &elemTy, int maxULPError) {
+  // a refined estimate is not correctly rounded
+  if (maxULPError < 10) return -1;
+
+  // an error of 2^k ULP leaves k bits of the significand to be wrong
+  int mantissaBits = elemTy.isDoubleTy() ? 53 : 24;
+  int neededBits = mantissaBits - (int) Log2_32(maxULPError / 10);
+
+  // every step doubles the number of correct bits (minus rounding)
+  int bits = estimateBits;
+  int numSteps = 0;
+  for (; bits < neededBits; ++numSteps) {
+    if (numSteps == MaxNewtonSteps) return -1;
+    bits = 2 * bits - 1;
+  }
+  return numSteps;
+}
+
+Value *
+CreateFPEstimate(IRBuilder<> &builder, FPEstimate kind, Intrinsic::ID estimateID, Value &vecX, int numSteps) {
+  auto *vecTy = cast<FixedVectorType>(vecX.getType());
+  bool isRcp = kind == FPEstimate::Reciprocal;
+  const char *name = isRcp ? "rcp" : "rsqrt";
+
+  // the AVX-512 estimates take a pass-through vector and a lane mask
+  Value *estimate = nullptr;
+  switch (estimateID) {
+  case Intrinsic::x86_sse_rcp_ps:
+  case Intrinsic::x86_sse_rsqrt_ps:
+  case Intrinsic::x86_avx_rcp_ps_256:
+  case Intrinsic::x86_avx_rsqrt_ps_256:
+    estimate = builder.CreateIntrinsic(estimateID, {}, {&vecX}, nullptr, name);
+    break;
+  case Intrinsic::aarch64_neon_frecpe:
+  case Intrinsic::aarch64_neon_frsqrte:
+  case Intrinsic::arm_neon_vrecpe:
+  case Intrinsic::arm_neon_vrsqrte:
+    estimate = builder.CreateIntrinsic(estimateID, {vecTy}, {&vecX}, nullptr, name);
+    break;
+  default: {
+    unsigned maskBits = std::max<unsigned>(8, vecTy->getNumElements());
+    auto *allTrue = ConstantInt::get(builder.getIntNTy(maskBits), -1);
+    estimate = builder.CreateIntrinsic(estimateID, {}, {&vecX, Constant::getNullValue(vecTy), allTrue}, nullptr, name);
+  } break;
+  }
+
+  auto *one = ConstantFP::get(vecTy, 1.0);
+  Value *halfX = isRcp ? nullptr : builder.CreateFMul(&vecX, ConstantFP::get(vecTy, 0.5), "rsqrt.halfx");
+  for (int i = 0; i < numSteps; ++i) {
+    if (isRcp) {
+      // r' = r + r * (1 - x * r)
+      auto *err = builder.CreateIntrinsic(Intrinsic::fmuladd, {vecTy}, {builder.CreateFNeg(&vecX), estimate, one});
+      estimate = builder.CreateIntrinsic(Intrinsic::fmuladd, {vecTy}, {estimate, err, estimate}, nullptr, "rcp.step");
+    } else {
+      // r' = r + r * (0.5 - x/2 * r * r)
+      auto *halfErr = builder.CreateIntrinsic(Intrinsic::fmuladd, {vecTy},
+                                              {builder.CreateFNeg(builder.CreateFMul(halfX, estimate)), estimate, ConstantFP::get(vecTy, 0.5)});
+      estimate = builder.CreateIntrinsic(Intrinsic::fmuladd, {vecTy}, {estimate, halfErr, estimate}, nullptr, "rsqrt.step");
+    }
+  }
+  return estimate;
+}
+
+} // namespace rv
@@ -0,0 +1,67 @@
+//===- src/native/DivisionBuilder.h - vector integer division --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Most SIMD ISAs have no integer division, vector udiv/sdiv/urem/srem get
+// scalarized by the backend. These builders emit division-free sequences:
+//
+// - uniform divisors: the multiplier and shifts of the round-up method
+//   (Granlund, Montgomery, "Division by Invariant Integers using
+//   Multiplication", 1994) are computed once in scalar code, every lane
+//   takes a multiply-high, an add and two shifts.
+// - varying divisors: floating-point division and truncation, which is exact
+//   if both operands fit the mantissa of the fp type.
+//
+// Under fast-math, floating-point division and 1/sqrt(x) use the reciprocal
+// (square root) estimate instructions (rcp14/rsqrt14, rcpps/rsqrtps,
+// frecpe/frsqrte) and as many Newton-Raphson steps as the ULP error bound
+// requires.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_NATIVE_DIVISIONBUILDER_H
+#define RV_NATIVE_DIVISIONBUILDER_H
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Intrinsics.h>
+
+namespace rv {
+
+struct Config;
+
+// \p vecNum / \p scaDivisor (or the remainder) for a uniform divisor.
+// \p opcode is one of UDiv, SDiv, URem, SRem on integer elements of at most 32 bits.
+llvm::Value *CreateUniformDivision(llvm::IRBuilder<> &builder, llvm::Instruction::BinaryOps opcode, llvm::Value &vecNum,
+                                   llvm::Value &scaDivisor);
+
+// \p vecNum / \p vecDivisor (or the remainder) through floating-point division in \p fpElemTy.
+// The caller guarantees that all (absolute) operand values are exactly representable in \p fpElemTy
+// (24 bits for float, 53 bits for double).
+llvm::Value *CreateFPDivision(llvm::IRBuilder<> &builder, llvm::Instruction::BinaryOps opcode, llvm::Value &vecNum,
+                              llvm::Value &vecDivisor, llvm::Type &fpElemTy);
+
+// the estimates of 1/x and 1/sqrt(x)
+enum class FPEstimate { Reciprocal, RSqrt };
+
+// the estimate instruction of \p kind for \p vecTy on the ISA of \p config (Intrinsic::not_intrinsic if there is
+// none). \p estimateBits receives the precision of the estimate.
+llvm::Intrinsic::ID GetFPEstimateIntrinsic(const Config &config, FPEstimate kind, llvm::FixedVectorType &vecTy,
+                                           unsigned &estimateBits);
+
+// the Newton-Raphson steps that refine an estimate of \p estimateBits to an error of at most \p maxULPError
+// (tenth of ULP) in \p elemTy. \returns -1 if the bound is out of reach in a profitable number of steps.
+int GetNewtonSteps(unsigned estimateBits, llvm::Type &elemTy, int maxULPError);
+
+// 1/x or 1/sqrt(x) of the vector \p vecX as estimate \p estimateID refined by \p numSteps Newton-Raphson steps.
+// The result is undefined for zeros and infinities (ninf).
+llvm::Value *CreateFPEstimate(llvm::IRBuilder<> &builder, FPEstimate kind, llvm::Intrinsic::ID estimateID,
+                              llvm::Value &vecX, int numSteps);
+
+} // namespace rv
+
+#endif // RV_NATIVE_DIVISIONBUILDER_H
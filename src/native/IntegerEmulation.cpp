@@ -0,0 +1,150 @@
+//===- src/native/IntegerEmulation.cpp - vector integer operations --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "IntegerEmulation.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+
+using namespace llvm;
+
+namespace rv {
+
+// splat of the constant \p value in the element type of \p vecTy
+static Constant *
+GetSplat(Type &vecTy, uint64_t value) {
+  return ConstantInt::get(&vecTy, value);
+}
+
+// the byte pattern \p byte repeated over \p numBits bits
+static uint64_t
+RepeatByte(uint8_t byte, unsigned numBits) {
+  uint64_t pattern = 0;
+  for (unsigned i = 0; i < numBits; i += 8) pattern |= (uint64_t) byte << i;
+  return pattern;
+}
+
+unsigned
+GetIntrinsicEmulationSize(Intrinsic::ID id, FixedVectorType &vecTy) {
+  unsigned numBits = vecTy.getScalarSizeInBits();
+  if (!vecTy.getElementType()->isIntegerTy() || numBits < 8 || numBits > 64 || !isPowerOf2_32(numBits)) return 0;
+
+  switch (id) {
+  case Intrinsic::ctpop:
+    // 10 for the byte counts, two per byte sum step and the final mask
+    return 10 + 2 * Log2_32(numBits / 8) + (numBits > 8);
+  case Intrinsic::ctlz:
+  case Intrinsic::cttz:
+    // the double conversion of i64 is not exact
+    if (numBits > 32) return 0;
+    return 6 + (numBits < 32) + 2 * (id == Intrinsic::cttz);
+  default:
+    return 0;
+  }
+}
+
+unsigned
+GetShiftEmulationSize(Instruction::BinaryOps opcode, FixedVectorType &vecTy) {
+  unsigned numBits = vecTy.getScalarSizeInBits();
+  if (!vecTy.getElementType()->isIntegerTy()) return 0;
+  if (numBits == 64 && opcode == Instruction::AShr) return 4;
+  if (numBits == 8 && (opcode == Instruction::Shl || opcode == Instruction::LShr || opcode == Instruction::AShr)) return 4;
+  return 0;
+}
+
+Value *
+CreatePopCount(IRBuilder<> &builder, Value &vecX) {
+  auto &vecTy = *vecX.getType();
+  unsigned numBits = vecTy.getScalarSizeInBits();
+
+  // 2-bit, 4-bit and 8-bit sums
+  auto *x = builder.CreateSub(&vecX, builder.CreateAnd(builder.CreateLShr(&vecX, 1), GetSplat(vecTy, RepeatByte(0x55, numBits))));
+  auto *mask33 = GetSplat(vecTy, RepeatByte(0x33, numBits));
+  x = builder.CreateAdd(builder.CreateAnd(x, mask33), builder.CreateAnd(builder.CreateLShr(x, 2), mask33));
+  x = builder.CreateAnd(builder.CreateAdd(x, builder.CreateLShr(x, 4)), GetSplat(vecTy, RepeatByte(0x0f, numBits)));
+  if (numBits == 8) return x;
+
+  // sum up the bytes in the low byte (no multiply, there is no 64-bit vector multiply before AVX-512)
+  for (unsigned shift = 8; shift < numBits; shift *= 2) {
+    x = builder.CreateAdd(x, builder.CreateLShr(x, shift));
+  }
+  return builder.CreateAnd(x, GetSplat(vecTy, 2 * numBits - 1), "popcount");
+}
+
+Value *
+CreateZeroCount(IRBuilder<> &builder, Value &vecX, bool trailing) {
+  auto *vecTy = cast<FixedVectorType>(vecX.getType());
+  unsigned numBits = vecTy->getScalarSizeInBits();
+  unsigned numElems = vecTy->getNumElements();
+  auto *i32VecTy = FixedVectorType::get(builder.getInt32Ty(), numElems);
+  auto *i64VecTy = FixedVectorType::get(builder.getInt64Ty(), numElems);
+
+  // the lowest set bit (trailing) or the value itself (leading) is exact in double
+  Value *x = numBits < 32 ? builder.CreateZExt(&vecX, i32VecTy) : &vecX;
+  if (trailing) x = builder.CreateAnd(x, builder.CreateNeg(x));
+  auto *fpX = builder.CreateUIToFP(x, FixedVectorType::get(builder.getDoubleTy(), numElems));
+  auto *exponent = builder.CreateLShr(builder.CreateBitCast(fpX, i64VecTy), 52);
+
+  // the biased exponent of the highest set bit k is 1023 + k
+  Value *count = trailing ? builder.CreateSub(exponent, GetSplat(*i64VecTy, 1023))
+                          : builder.CreateSub(GetSplat(*i64VecTy, 1023 + numBits - 1), exponent);
+  count = builder.CreateTrunc(count, vecTy);
+  auto *isZero = builder.CreateICmpEQ(&vecX, Constant::getNullValue(vecTy));
+  return builder.CreateSelect(isZero, GetSplat(*vecTy, numBits), count, trailing ? "cttz" : "ctlz");
+}
+
+Value *
+CreateMulHigh64(IRBuilder<> &builder, Value &vecA, Value &vecB, bool isSigned) {
+  auto &vecTy = *vecA.getType();
+  auto *low32 = GetSplat(vecTy, 0xffffffffu);
+
+  // 32x32->64 bit products of the halves
+  auto *aLow = builder.CreateAnd(&vecA, low32);
+  auto *aHigh = builder.CreateLShr(&vecA, 32);
+  auto *bLow = builder.CreateAnd(&vecB, low32);
+  auto *bHigh = builder.CreateLShr(&vecB, 32);
+  auto *lowLow = builder.CreateMul(aLow, bLow);
+  auto *highLow = builder.CreateMul(aHigh, bLow);
+  auto *lowHigh = builder.CreateMul(aLow, bHigh);
+  auto *highHigh = builder.CreateMul(aHigh, bHigh);
+
+  // carries of the middle column (none of the sums overflows)
+  auto *mid = builder.CreateAdd(highLow, builder.CreateLShr(lowLow, 32));
+  auto *midCarry = builder.CreateAdd(builder.CreateAnd(mid, low32), lowHigh);
+  Value *high = builder.CreateAdd(builder.CreateAdd(highHigh, builder.CreateLShr(mid, 32)), builder.CreateLShr(midCarry, 32));
+  if (!isSigned) return high;
+
+  // a * b (signed) = a * b (unsigned) - 2^64 * ((a < 0 ? b : 0) + (b < 0 ? a : 0))
+  auto *zero = Constant::getNullValue(&vecTy);
+  auto *aCorr = builder.CreateSelect(builder.CreateICmpSLT(&vecA, zero), &vecB, zero);
+  auto *bCorr = builder.CreateSelect(builder.CreateICmpSLT(&vecB, zero), &vecA, zero);
+  return builder.CreateSub(high, builder.CreateAdd(aCorr, bCorr), "mulhi");
+}
+
+Value *
+CreateEmulatedShift(IRBuilder<> &builder, Instruction::BinaryOps opcode, Value &vecX, Value &vecAmount, bool uniformAmount) {
+  auto *vecTy = cast<FixedVectorType>(vecX.getType());
+  unsigned numBits = vecTy->getScalarSizeInBits();
+
+  // ashr of i64: the sign bit, shifted like the value, extends the sign through xor and sub
+  if (numBits == 64) {
+    assert(opcode == Instruction::AShr);
+    auto *signBit = builder.CreateLShr(GetSplat(*vecTy, 1ull << 63), &vecAmount);
+    auto *shifted = builder.CreateLShr(&vecX, &vecAmount);
+    return builder.CreateSub(builder.CreateXor(shifted, signBit), signBit, "ashr");
+  }
+
+  // i8: in wider lanes with a native shift (psllw for uniform amounts, vpsllvd for varying ones)
+  assert(numBits == 8);
+  auto *wideTy = FixedVectorType::get(builder.getIntNTy(uniformAmount ? 16 : 32), vecTy->getNumElements());
+  auto *wideX = opcode == Instruction::AShr ? builder.CreateSExt(&vecX, wideTy) : builder.CreateZExt(&vecX, wideTy);
+  auto *wideShift = builder.CreateBinOp(opcode, wideX, builder.CreateZExt(&vecAmount, wideTy));
+  return builder.CreateTrunc(wideShift, vecTy, "shift");
+}
+
+} // namespace rv
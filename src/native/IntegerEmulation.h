@@ -0,0 +1,56 @@
+//===- src/native/IntegerEmulation.h - vector integer operations --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Branch-free sequences for integer operations that some SIMD ISAs lack
+// (AVX2: 64-bit multiply-high, popcount, lzcnt/tzcnt, 64-bit arithmetic
+// shifts, 8-bit shifts) and that the backend would otherwise scalarize:
+//
+// - popcount: bit-sliced (SWAR) sums of 2, 4 and 8 bits, then byte sums.
+// - ctlz/cttz (up to 32 bits): the exponent of the exact double conversion of
+//   the highest (lowest) set bit.
+// - 64-bit multiply-high: four 32x32->64 bit products (pmuludq).
+// - 64-bit ashr: logical shift and sign extension through xor/sub.
+// - 8-bit shifts: shifts in 16-bit (uniform amounts) or 32-bit lanes.
+//
+// NatBuilder compares the sequence length with the TTI cost of the native
+// vector operation (Config::enableIntegerEmulation).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_NATIVE_INTEGEREMULATION_H
+#define RV_NATIVE_INTEGEREMULATION_H
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Intrinsics.h>
+
+namespace rv {
+
+// The number of vector instructions of the emulation of intrinsic \p id (ctpop, ctlz, cttz) or instruction
+// \p opcode (AShr, Shl, LShr) on \p vecTy. 0 if there is no emulation for this operation and type.
+unsigned GetIntrinsicEmulationSize(llvm::Intrinsic::ID id, llvm::FixedVectorType &vecTy);
+unsigned GetShiftEmulationSize(llvm::Instruction::BinaryOps opcode, llvm::FixedVectorType &vecTy);
+
+// ctpop(\p vecX) for integer elements of 8 to 64 bits
+llvm::Value *CreatePopCount(llvm::IRBuilder<> &builder, llvm::Value &vecX);
+
+// ctlz(\p vecX) or cttz(\p vecX) (\p trailing) for integer elements of at most 32 bits (the bit width for zeros)
+llvm::Value *CreateZeroCount(llvm::IRBuilder<> &builder, llvm::Value &vecX, bool trailing);
+
+// the high 64 bits of the 128-bit products of the i64 vectors \p vecA and \p vecB (always cheaper than the
+// scalarized i128 multiplication)
+llvm::Value *CreateMulHigh64(llvm::IRBuilder<> &builder, llvm::Value &vecA, llvm::Value &vecB, bool isSigned);
+
+// \p vecX >> \p vecAmount (AShr) on i64 elements or the shift \p opcode on i8 elements (in 16-bit lanes if
+// \p uniformAmount, 32-bit lanes otherwise)
+llvm::Value *CreateEmulatedShift(llvm::IRBuilder<> &builder, llvm::Instruction::BinaryOps opcode, llvm::Value &vecX,
+                                 llvm::Value &vecAmount, bool uniformAmount);
+
+} // namespace rv
+
+#endif // RV_NATIVE_INTEGEREMULATION_H
@@ -18,6 +18,12 @@
 
 const int64_t groupLimit = 64;
 
+// largest number of members of an interleaved group (RGB, XYZW, 6-float particles, ..)
+const int64_t maxInterleaveFactor = 8;
+
+// largest byte distance between the members of a coalesced gather (one cache line)
+const int64_t maxCoalescedSpan = 64;
+
 using namespace llvm;
 using namespace rv;
 
@@ -239,8 +245,16 @@ MemoryAccessGrouper::getConstantDiff(const llvm::SCEV * A, const llvm::SCEV * B,
       return true;
     }
 
+  // recurrences of the same loop with the same step differ in their start
+    case scAddRecExpr: {
+      auto * aRec = cast<SCEVAddRecExpr>(A);
+      auto * bRec = cast<SCEVAddRecExpr>(B);
+      if (aRec->getLoop() != bRec->getLoop() || !aRec->isAffine() || !bRec->isAffine()) return false;
+      if (!equals(aRec->getStepRecurrence(SE), bRec->getStepRecurrence(SE))) return false;
+      return getConstantDiff(aRec->getStart(), bRec->getStart(), oDelta);
+    }
+
     case scUDivExpr:
-    case scAddRecExpr:
     case scUMaxExpr:
     case scSMaxExpr:
     case scUnknown:
@@ -248,7 +262,7 @@ MemoryAccessGrouper::getConstantDiff(const llvm::SCEV * A, const llvm::SCEV * B,
       return false;
 
     default:
-      abort(); // unrecognized SCEVType
+      return false; // min/max and pointer casts are not diffed
   }
 
   // Otw, start decomposing the SCEVs
@@ -267,8 +281,228 @@ const MemoryGroup & MemoryAccessGrouper::getMemoryGroup(const SCEV *scev) {
   return emptyGroup;
 }
 
+static bool
+IsInterleavableType(Type & type) {
+  return (type.isIntegerTy() || type.isFloatingPointTy()) && !type.isX86_FP80Ty() && !type.isPPC_FP128Ty();
+}
+
+void
+MemoryAccessGrouper::collectInterleavedGroups(BasicBlock &BB, std::function<int64_t(Instruction &)> getStride,
+                                             bool allowStoreGaps, std::vector<InterleavedGroup> &oGroups) {
+  const DataLayout &layout = BB.getModule()->getDataLayout();
+
+  // strided accesses of the block in program order
+  std::vector<Instruction *> accesses;
+  for (auto &inst : BB) {
+    auto *load = dyn_cast<LoadInst>(&inst);
+    auto *store = dyn_cast<StoreInst>(&inst);
+    if (!(load && load->isSimple()) && !(store && store->isSimple())) continue;
+    auto &accessedType = *getLoadStoreType(&inst);
+    if (!IsInterleavableType(accessedType)) continue;
+
+    int64_t stride = getStride(inst);
+    int64_t slotSize = layout.getTypeStoreSize(&accessedType);
+    if (slotSize != (int64_t) layout.getTypeAllocSize(&accessedType)) continue;
+    if (stride <= slotSize || stride % slotSize != 0 || stride / slotSize > maxInterleaveFactor) continue;
+    accesses.push_back(&inst);
+  }
+
+  std::vector<Instruction *> grouped;
+  auto isGrouped = [&](Instruction *inst) { return std::find(grouped.begin(), grouped.end(), inst) != grouped.end(); };
+
+  for (auto *inst : accesses) {
+    if (isGrouped(inst)) continue;
+    bool isStore = isa<StoreInst>(inst);
+    int64_t stride = getStride(*inst);
+    int64_t slotSize = layout.getTypeStoreSize(getLoadStoreType(inst));
+    const SCEV *addr = SE.getSCEV(getLoadStorePointerOperand(inst));
+
+    // members by byte offset from inst
+    std::vector<std::pair<int64_t, Instruction *>> members;
+    members.emplace_back(0, inst);
+    for (auto *cand : accesses) {
+      if (cand == inst || isGrouped(cand) || isa<StoreInst>(cand) != isStore) continue;
+      if (getStride(*cand) != stride || (int64_t) layout.getTypeStoreSize(getLoadStoreType(cand)) != slotSize) continue;
+
+      int64_t offset;
+      if (!getConstantDiff(SE.getSCEV(getLoadStorePointerOperand(cand)), addr, offset)) continue;
+      if (offset % slotSize != 0 || std::abs(offset) >= stride) continue;
+      bool taken = false;
+      for (auto &member : members) taken |= (member.first == offset);
+      if (!taken) members.emplace_back(offset, cand);
+    }
+    if (members.size() < 2) continue;
+
+    // all members must fit into one stride
+    int64_t minOffset = members[0].first, maxOffset = members[0].first;
+    for (auto &member : members) {
+      minOffset = std::min(minOffset, member.first);
+      maxOffset = std::max(maxOffset, member.first);
+    }
+    if (maxOffset - minOffset >= stride) continue;
+
+    InterleavedGroup group;
+    group.stride = stride;
+    group.slotSize = (unsigned) slotSize;
+    group.members.resize(stride / slotSize, nullptr);
+    for (auto &member : members) group.members[(member.first - minOffset) / slotSize] = member.second;
+
+    // loads may read the bytes of inner gaps (they belong to the same objects) but not past the last member
+    if (!isStore && !group.members.back()) continue;
+    if (isStore && group.hasGaps() && !allowStoreGaps) continue;
+
+    // the group is generated at one program point: nothing in between may interfere
+    // (the first load is hoisted over writes, the last store sunk over all memory accesses)
+    Instruction *first = nullptr, *last = nullptr;
+    for (auto &i : BB) {
+      bool isMember = std::find(group.members.begin(), group.members.end(), &i) != group.members.end();
+      if (isMember) {
+        if (!first) first = &i;
+        last = &i;
+      }
+    }
+    bool interference = false;
+    for (auto it = first->getIterator(); &*it != last && !interference; ++it) {
+      bool isMember = std::find(group.members.begin(), group.members.end(), &*it) != group.members.end();
+      if (isMember) continue;
+      interference = isStore ? it->mayReadOrWriteMemory() : it->mayWriteToMemory();
+    }
+    if (interference) continue;
+
+    group.leader = isStore ? last : first;
+    for (auto *member : group.members) {
+      if (member) grouped.push_back(member);
+    }
+    IF_DEBUG_MG { group.print(errs()); }
+    oGroups.push_back(group);
+  }
+}
+
+void
+MemoryAccessGrouper::collectCoalescedGathers(BasicBlock &BB, std::function<bool(LoadInst &)> isGathered,
+                                            unsigned maxElemSize, std::vector<CoalescedGather> &oGroups) {
+  const DataLayout &layout = BB.getModule()->getDataLayout();
+
+  // gathered loads of the block in program order
+  std::vector<LoadInst *> loads;
+  for (auto &inst : BB) {
+    auto *load = dyn_cast<LoadInst>(&inst);
+    if (!load || !load->isSimple() || !IsInterleavableType(*load->getType())) continue;
+    uint64_t size = layout.getTypeStoreSize(load->getType());
+    if (size != layout.getTypeAllocSize(load->getType()) || size >= maxElemSize) continue;
+    if (isGathered(*load)) loads.push_back(load);
+  }
+
+  std::vector<LoadInst *> grouped;
+  auto isGrouped = [&](LoadInst *load) { return std::find(grouped.begin(), grouped.end(), load) != grouped.end(); };
+
+  for (size_t i = 0; i < loads.size(); ++i) {
+    auto *leader = loads[i];
+    if (isGrouped(leader)) continue;
+    const SCEV *addr = SE.getSCEV(leader->getPointerOperand());
+
+    // later loads by byte offset from the leader (the first load of an offset)
+    std::vector<std::pair<int64_t, LoadInst *>> cands;
+    cands.emplace_back(0, leader);
+    for (size_t j = i + 1; j < loads.size(); ++j) {
+      auto *cand = loads[j];
+      if (isGrouped(cand)) continue;
+      int64_t offset;
+      if (!getConstantDiff(SE.getSCEV(cand->getPointerOperand()), addr, offset)) continue;
+      if (std::abs(offset) >= maxCoalescedSpan) continue;
+      bool taken = false;
+      for (auto &member : cands) taken |= (member.first == offset);
+      if (!taken) cands.emplace_back(offset, cand);
+    }
+    if (cands.size() < 2) continue;
+
+    // all loads are executed under the same predicate: the windows may read any byte from the first to the last candidate
+    std::sort(cands.begin(), cands.end(), [](const std::pair<int64_t, LoadInst *> &a, const std::pair<int64_t, LoadInst *> &b) {
+      return a.first < b.first;
+    });
+    int64_t minOffset = cands.front().first;
+    int64_t endOffset = minOffset;
+    for (auto &cand : cands)
+      endOffset = std::max<int64_t>(endOffset, cand.first + layout.getTypeStoreSize(cand.second->getType()));
+    if (endOffset - minOffset > maxCoalescedSpan) continue;
+
+    CoalescedGather group;
+    group.elemSize = std::min<unsigned>(maxElemSize, PowerOf2Floor(endOffset - minOffset));
+    group.leader = leader;
+
+    // greedy windows: the next window starts at the first load it does not cover (but does not reach past the last)
+    for (auto &cand : cands) {
+      int64_t offset = cand.first;
+      int64_t size = layout.getTypeStoreSize(cand.second->getType());
+      auto fits = [&](int64_t start) {
+        return offset >= start && offset + size <= start + group.elemSize && (offset - start) % size == 0;
+      };
+      if (group.windows.empty() || !fits(group.windows.back())) {
+        int64_t start = std::min<int64_t>(offset, endOffset - group.elemSize);
+        if (!fits(start)) continue; // stays a gather of its own
+        group.windows.push_back(start);
+      }
+      group.members.push_back({cand.second, (unsigned) group.windows.size() - 1,
+                               (unsigned) ((offset - group.windows.back()) / size)});
+    }
+    if (group.members.size() < 2 || group.windows.size() >= group.members.size()) continue;
+
+    // the members are generated at the leader: nothing up to the last member may write memory
+    auto isMember = [&](Instruction &inst) {
+      for (auto &member : group.members) {
+        if (member.load == &inst) return true;
+      }
+      return false;
+    };
+    Instruction *last = leader;
+    for (auto it = leader->getIterator(); it != BB.end(); ++it) {
+      if (isMember(*it)) last = &*it;
+    }
+    bool interference = false;
+    for (auto it = leader->getIterator(); &*it != last && !interference; ++it) {
+      interference = !isMember(*it) && it->mayWriteToMemory();
+    }
+    if (interference) continue;
+
+    for (auto &member : group.members) grouped.push_back(member.load);
+    IF_DEBUG_MG { group.print(errs()); }
+    oGroups.push_back(group);
+  }
+}
+
 // MemoryAccessGrouper_END
 
+// InterleavedGroup_BEGIN
+
+bool InterleavedGroup::hasGaps() const {
+  return std::find(members.begin(), members.end(), nullptr) != members.end();
+}
+
+void InterleavedGroup::print(raw_ostream & out) const {
+  out << "InterleavedGroup (stride " << stride << ", slot size " << slotSize << ") {\n";
+  for (size_t i = 0; i < members.size(); ++i) {
+    out << i << " : ";
+    if (members[i]) out << *members[i] << (members[i] == leader ? " (leader)" : "");
+    else out << "gap";
+    out << "\n";
+  }
+  out << "}\n";
+}
+
+// InterleavedGroup_END
+
+// CoalescedGather_BEGIN
+
+void CoalescedGather::print(raw_ostream & out) const {
+  out << "CoalescedGather (" << windows.size() << " x " << elemSize << " bytes) {\n";
+  for (auto &member : members) {
+    out << windows[member.window] << " + " << member.slot << " : " << *member.load << (member.load == leader ? " (leader)" : "") << "\n";
+  }
+  out << "}\n";
+}
+
+// CoalescedGather_END
+
 // InstructionGroup_BEGIN
 
 InstructionGroup::InstructionGroup(Instruction *element) :
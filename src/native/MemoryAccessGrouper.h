@@ -12,6 +12,9 @@
 
 #include <llvm/Analysis/ScalarEvolution.h>
 #include <llvm/Analysis/MemoryDependenceAnalysis.h>
+#include <llvm/IR/Instructions.h>
+
+#include <functional>
 
 namespace rv {
   class MemoryGroup {
@@ -32,6 +35,37 @@ namespace rv {
     void dump() const;
   };
 
+  // loads (or stores) of one block that access the members of an interleaved (AoS) stream.
+  // Member types may differ as long as their sizes agree.
+  struct InterleavedGroup {
+    int64_t stride; // bytes between the accesses of consecutive lanes
+    unsigned slotSize; // bytes per member
+    std::vector<llvm::Instruction *> members; // by byte offset / slotSize from the first member, nullptr for gaps
+    llvm::Instruction *leader; // the group is generated here (first load, last store)
+
+    unsigned getFactor() const { return (unsigned) members.size(); }
+    bool isStoreGroup() const { return llvm::isa<llvm::StoreInst>(leader); }
+    bool hasGaps() const;
+
+    void print(llvm::raw_ostream &) const;
+  };
+
+  // varying loads of one block at small constant offsets from the same addresses (fields of the same structs).
+  // They are loaded with gathers of wide elements (windows) that are split into the members with shuffles.
+  struct CoalescedGather {
+    unsigned elemSize; // bytes per wide element
+    std::vector<int64_t> windows; // byte offsets of the wide elements from the leader address
+    struct Member {
+      llvm::LoadInst *load;
+      unsigned window; // index into windows
+      unsigned slot; // offset in the window / load size
+    };
+    std::vector<Member> members;
+    llvm::LoadInst *leader; // first load, all addresses are relative to its address
+
+    void print(llvm::raw_ostream &) const;
+  };
+
   class MemoryAccessGrouper {
     llvm::ScalarEvolution &SE;
     unsigned laneByteSize;
@@ -49,6 +83,16 @@ namespace rv {
     MemoryAccessGrouper(llvm::ScalarEvolution &SE, unsigned laneByteSize);
     const llvm::SCEV *add(llvm::Value *addrVal);
     const MemoryGroup & getMemoryGroup(const llvm::SCEV *scev);
+
+    // collect the interleaved groups of \p BB. \p getStride returns the byte stride between the lanes
+    // of an access (0 if it is not strided). With \p allowStoreGaps, store groups may skip slots (masked).
+    void collectInterleavedGroups(llvm::BasicBlock &BB, std::function<int64_t(llvm::Instruction &)> getStride,
+                                  bool allowStoreGaps, std::vector<InterleavedGroup> &oGroups);
+
+    // collect the coalesced gathers of \p BB among the loads that satisfy \p isGathered with wide elements of
+    // up to \p maxElemSize bytes. Only groups that need fewer gathers than they have members are returned.
+    void collectCoalescedGathers(llvm::BasicBlock &BB, std::function<bool(llvm::LoadInst &)> isGathered,
+                                 unsigned maxElemSize, std::vector<CoalescedGather> &oGroups);
   };
 
   class InstructionGroup {
@@ -9,12 +9,23 @@
 #include <deque>
 
 #include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/ADT/SmallSet.h>
+#include <llvm/Analysis/Loads.h>
+#include <llvm/Analysis/MemoryBuiltins.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/Analysis/VectorUtils.h>
+#include <llvm/Support/KnownBits.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Metadata.h>
+#include <llvm/IR/MDBuilder.h>
+#include "llvm/IR/IntrinsicsAArch64.h"
 #include "llvm/IR/IntrinsicsX86.h"
+#include "llvm/IR/PatternMatch.h"
 #include "llvm/Support/Alignment.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/LoopUtils.h"
 #include <report.h>
 #include <fstream>
@@ -27,14 +38,36 @@
 #include "rv/region/Region.h"
 #include "rv/rvDebug.h"
 #include "rv/intrinsics.h"
+#include "rv/annotations.h"
+#include "rv/utils.h"
 
 #include "rvConfig.h"
 #include "ShuffleBuilder.h"
+#include "DivisionBuilder.h"
+#include "IntegerEmulation.h"
+#include "utils/profileWriter.h"
+#include "utils/rvTools.h"
 
 #define IF_DEBUG_NAT  IF_DEBUG
 
+#define DEBUG_TYPE "rv-natbuilder"
+
 using namespace llvm;
 
+STATISTIC(NumNatGathers, "Number of (masked) gathers and scatters");
+STATISTIC(NumNatCascades, "Number of memory accesses replicated per lane");
+STATISTIC(NumNatInterleaved, "Number of interleaved loads and stores");
+STATISTIC(NumNatContiguous, "Number of contiguous vector loads and stores");
+STATISTIC(NumNatUniform, "Number of uniform loads and stores");
+STATISTIC(NumNatScalarized, "Number of instructions kept scalar");
+STATISTIC(NumNatReplicatedCalls, "Number of calls replicated per lane");
+STATISTIC(NumNatBlends, "Number of vector selects on varying conditions");
+STATISTIC(NumNatAnyGuards, "Number of any-guards around masked operations");
+
+// there is no lane profile for the guards in the vector code: every lane is assumed active with 1/2,
+// rv_any(mask) holds with 1-(1/2)^W
+static const double DefaultLaneProb = 0.5;
+
 // TODO move to vector builder class...
 Value*
 CreateBroadcast(IRBuilder<> & builder, Value & vec, int idx) {
@@ -56,20 +89,175 @@ CreateScalarBroadcast(IRBuilder<> & builder, Value & scaValue, int elemCount) {
   return CreateBroadcast(builder, firstLaneVec, 0);
 }
 
+// calls \p visit on the index path of every scalar leaf of the aggregate type \p aggTy
+static void
+ForEachAggregateLeaf(Type & aggTy, SmallVectorImpl<unsigned> & path, std::function<void(ArrayRef<unsigned>)> visit) {
+  if (auto * structTy = dyn_cast<StructType>(&aggTy)) {
+    for (unsigned i = 0; i < structTy->getNumElements(); ++i) {
+      path.push_back(i);
+      ForEachAggregateLeaf(*structTy->getElementType(i), path, visit);
+      path.pop_back();
+    }
+  } else if (auto * arrTy = dyn_cast<ArrayType>(&aggTy)) {
+    for (unsigned i = 0; i < arrTy->getNumElements(); ++i) {
+      path.push_back(i);
+      ForEachAggregateLeaf(*arrTy->getElementType(), path, visit);
+      path.pop_back();
+    }
+  } else {
+    visit(path);
+  }
+}
+
+// whether \p type is an aggregate of vectors (a varying aggregate in struct-of-vectors form)
+static bool
+IsStructOfVectors(Type & type) {
+  if (auto * structTy = dyn_cast<StructType>(&type)) {
+    if (structTy->getNumElements() == 0) return false;
+    for (auto * elemTy : structTy->elements()) {
+      if (!elemTy->isVectorTy() && !IsStructOfVectors(*elemTy)) return false;
+    }
+    return true;
+  }
+  if (auto * arrTy = dyn_cast<ArrayType>(&type)) {
+    return arrTy->getNumElements() > 0 && (arrTy->getElementType()->isVectorTy() || IsStructOfVectors(*arrTy->getElementType()));
+  }
+  return false;
+}
+
+// the aggregate of lane \p laneIdx of the struct-of-vectors value \p vecAgg
+static Value *
+CreateLaneAggregate(IRBuilder<> & builder, Value & vecAgg, Type & scaTy, unsigned laneIdx) {
+  Value * accu = UndefValue::get(&scaTy);
+  SmallVector<unsigned, 4> path;
+  ForEachAggregateLeaf(scaTy, path, [&](ArrayRef<unsigned> leafPath) {
+    auto * vecLeaf = builder.CreateExtractValue(&vecAgg, leafPath);
+    auto * laneLeaf = builder.CreateExtractElement(vecLeaf, builder.getInt32(laneIdx), "extract");
+    accu = builder.CreateInsertValue(accu, laneLeaf, leafPath);
+  });
+  return accu;
+}
+
+// struct-of-vectors value of type \p sovTy from the lane aggregates \p laneVals
+static Value *
+CreatePackedAggregate(IRBuilder<> & builder, Type & sovTy, Type & scaTy, ArrayRef<Value*> laneVals) {
+  Value * accu = UndefValue::get(&sovTy);
+  SmallVector<unsigned, 4> path;
+  ForEachAggregateLeaf(scaTy, path, [&](ArrayRef<unsigned> leafPath) {
+    auto * leafVecTy = ExtractValueInst::getIndexedType(&sovTy, leafPath);
+    Value * vecLeaf = UndefValue::get(leafVecTy);
+    for (unsigned i = 0; i < laneVals.size(); ++i) {
+      auto * laneLeaf = builder.CreateExtractValue(laneVals[i], leafPath);
+      vecLeaf = builder.CreateInsertElement(vecLeaf, laneLeaf, builder.getInt32(i), "_revec");
+    }
+    accu = builder.CreateInsertValue(accu, vecLeaf, leafPath);
+  });
+  return accu;
+}
+
+// struct-of-vectors value of type \p sovTy with every leaf of \p scaAgg broadcast to all lanes
+static Value *
+CreateBroadcastAggregate(IRBuilder<> & builder, Type & sovTy, Value & scaAgg, unsigned vectorWidth) {
+  if (isa<UndefValue>(scaAgg)) return UndefValue::get(&sovTy);
+  if (isa<ConstantAggregateZero>(scaAgg)) return Constant::getNullValue(&sovTy);
+
+  Value * accu = UndefValue::get(&sovTy);
+  SmallVector<unsigned, 4> path;
+  ForEachAggregateLeaf(*scaAgg.getType(), path, [&](ArrayRef<unsigned> leafPath) {
+    auto * scaLeaf = builder.CreateExtractValue(&scaAgg, leafPath);
+    accu = builder.CreateInsertValue(accu, builder.CreateVectorSplat(vectorWidth, scaLeaf), leafPath);
+  });
+  return accu;
+}
+
 namespace rv {
 
 unsigned numMaskedGather, numMaskedScatter, numGather, numScatter,
+    numMaskedCascadeLoads, numMaskedCascadeStores, numCascadeLoads, numCascadeStores, numSpanLoads, numMaskedSpanLoads,
     numInterMaskedLoads, numInterMaskedStores, numInterLoads, numInterStores,
-    numContMaskedLoads, numContMaskedStores, numContLoads, numContStores, numUniMaskedLoads, numUniMaskedStores,
-    numUniLoads, numUniStores, numUniAllocas, numSlowAllocas;
+    numContMaskedLoads, numContMaskedStores, numContLoads, numContStores, numUnmaskedContLoads, numUniMaskedLoads, numUniMaskedStores,
+    numSpecUniLoads, numUniLoads, numUniStores, numUniAllocas, numSlowAllocas, numStreamingStores;
 
 unsigned numVecGEPs, numScalGEPs, numInterGEPs, numVecBCs, numScalBCs;
+unsigned numNarrowedIndices;
+unsigned numFPEstimates;
+unsigned numNativeMinMax;
+unsigned numBitMasks;
 unsigned numVecCalls, numSemiCalls, numFallCalls, numCascadeCalls, numRVIntrinsics;
+unsigned numLaneLoops, numWaterfallCalls;
 unsigned numScalarized, numVectorized, numFallbacked, numLazy;
+unsigned numConflictAtomics;
+unsigned numDotProducts;
+unsigned numTransposedReductions;
+unsigned numRecurrences;
+unsigned numLaneSlabs;
+unsigned numTableLookups;
+unsigned numAddressDispatches;
+unsigned numIndexRunDispatches;
+unsigned numClusteredScatters;
+unsigned numSelectSplits;
+unsigned numCoalescedGathers, numCoalescedLoads;
+unsigned numVectorInductions;
+unsigned numIntEmulations;
+unsigned numSingleLaneInsts;
+unsigned numVPAccesses;
+unsigned numOutlinedMathCalls;
+
+unsigned numBlends;
+unsigned numAnyGuards;
 
 unsigned numConstLoadMasks, numUniLoadMasks, numVarLoadMasks;
 unsigned numConstStoreMasks, numUniStoreMasks, numVarStoreMasks;
 
+// counters of the per-function metrics (names as in the NAT_STAT_DUMP file)
+struct NatCounter {
+  const char * name;
+  unsigned * counter;
+  llvm::Statistic * statistic;
+};
+
+static const NatCounter NatCounters[] = {
+  {"masked-gather", &numMaskedGather, &NumNatGathers},
+  {"gather", &numGather, &NumNatGathers},
+  {"masked-scatter", &numMaskedScatter, &NumNatGathers},
+  {"scatter", &numScatter, &NumNatGathers},
+  {"masked-casc-load", &numMaskedCascadeLoads, &NumNatCascades},
+  {"cascade-load", &numCascadeLoads, &NumNatCascades},
+  {"masked-casc-store", &numMaskedCascadeStores, &NumNatCascades},
+  {"cascade-store", &numCascadeStores, &NumNatCascades},
+  {"interleaved-masked-load", &numInterMaskedLoads, &NumNatInterleaved},
+  {"interleaved-load", &numInterLoads, &NumNatInterleaved},
+  {"interleaved-masked-store", &numInterMaskedStores, &NumNatInterleaved},
+  {"interleaved-store", &numInterStores, &NumNatInterleaved},
+  {"contiguous-masked-load", &numContMaskedLoads, &NumNatContiguous},
+  {"contiguous-load", &numContLoads, &NumNatContiguous},
+  {"contiguous-masked-store", &numContMaskedStores, &NumNatContiguous},
+  {"contiguous-store", &numContStores, &NumNatContiguous},
+  {"uniform-masked-load", &numUniMaskedLoads, &NumNatUniform},
+  {"uniform-load", &numUniLoads, &NumNatUniform},
+  {"uniform-masked-store", &numUniMaskedStores, &NumNatUniform},
+  {"uniform-store", &numUniStores, &NumNatUniform},
+  {"vector-GEP", &numVecGEPs, nullptr},
+  {"scalar-GEP", &numScalGEPs, nullptr},
+  {"interleaved-GEP", &numInterGEPs, nullptr},
+  {"vector-BC", &numVecBCs, nullptr},
+  {"scalar-BC", &numScalBCs, nullptr},
+  {"const-load-mask", &numConstLoadMasks, nullptr},
+  {"uni-load-mask", &numUniLoadMasks, nullptr},
+  {"var-load-mask", &numVarLoadMasks, nullptr},
+  {"const-store-mask", &numConstStoreMasks, nullptr},
+  {"uni-store-mask", &numUniStoreMasks, nullptr},
+  {"var-store-mask", &numVarStoreMasks, nullptr},
+  {"vec-call", &numVecCalls, nullptr},
+  {"replicated-call", &numFallCalls, &NumNatReplicatedCalls},
+  {"cascaded-call", &numCascadeCalls, &NumNatReplicatedCalls},
+  {"scalarized", &numScalarized, &NumNatScalarized},
+  {"vectorized", &numVectorized, nullptr},
+  {"replicated", &numFallbacked, nullptr},
+  {"blend", &numBlends, &NumNatBlends},
+  {"any-guard", &numAnyGuards, &NumNatAnyGuards},
+};
+
 bool DumpStatistics(std::string &file) {
   char * envVal = getenv("NAT_STAT_DUMP");
   if (!envVal) return false;
@@ -95,9 +283,30 @@ void NatBuilder::printStatistics() {
            << "\tuni allocas: " << numUniAllocas << "\n"
            << "\tslow allocas: " << numSlowAllocas << "\n"
            << "\tscatter/gather: " << numScatter << "/" << numGather << ", masked " << numMaskedScatter << "/" << numMaskedGather << "\n"
+           << "\tcascade store/load: " << numCascadeStores << "/" << numCascadeLoads << ", masked " << numMaskedCascadeStores << "/" << numMaskedCascadeLoads << "\n"
+           << "\tstrided span load: " << numSpanLoads << ", masked " << numMaskedSpanLoads << "\n"
            << "\tinter load/store: " << numInterLoads << "/" << numInterStores << ", masked " << numInterMaskedLoads << "/" << numInterMaskedStores << "\n"
            << "\tcons load/store: " << numContLoads << "/" << numContStores << ", masked " <<  numContMaskedLoads << "/" << numContMaskedStores << "\n"
-           << "\tuni load/store: " << numUniLoads << "/" << numUniStores << ", masked " << numUniMaskedLoads << "/" << numUniMaskedStores << "\n"
+           << "\tstreaming stores: " << numStreamingStores << "\n"
+           << "\tnarrowed indices: " << numNarrowedIndices << "\n"
+           << "\tfp estimate divisions: " << numFPEstimates << "\n"
+           << "\tnative fp min/max: " << numNativeMinMax << "\n"
+           << "\tbit-packed masks: " << numBitMasks << "\n"
+           << "\tconflict-combined atomics: " << numConflictAtomics << "\n"
+           << "\tlane tables: " << numLaneSlabs << "\n"
+           << "\tregister table lookups: " << numTableLookups << "\n"
+           << "\taddress-shape dispatches: " << numAddressDispatches << "\n"
+           << "\tindex-run dispatches: " << numIndexRunDispatches << "\n"
+           << "\tclustered scatters: " << numClusteredScatters << "\n"
+           << "\tsplit select accesses: " << numSelectSplits << "\n"
+           << "\tcoalesced gathers: " << numCoalescedGathers << " (" << numCoalescedLoads << " loads)\n"
+           << "\tvector inductions: " << numVectorInductions << "\n"
+           << "\temulated integer operations: " << numIntEmulations << "\n"
+           << "\tsingle-lane instructions: " << numSingleLaneInsts << "\n"
+           << "\tblends/any-guards: " << numBlends << "/" << numAnyGuards << "\n"
+           << "\tunmasked contiguous loads: " << numUnmaskedContLoads << "\n"
+           << "\tvp load/store (AVL): " << numVPAccesses << "\n"
+           << "\tuni load/store: " << numUniLoads << "/" << numUniStores << ", masked " << numUniMaskedLoads << "/" << numUniMaskedStores << ", speculative " << numSpecUniLoads << "\n"
            << "\tstore masks (c/u/v): " << numConstStoreMasks << "/" << numUniStoreMasks << "/" << numVarStoreMasks << "\n"
            << "\tload  masks (c/u/v): " << numConstLoadMasks << "/" << numUniLoadMasks << "/" << numVarLoadMasks << "\n";
 
@@ -113,7 +322,13 @@ void NatBuilder::printStatistics() {
   Report() << "nat calls:\n"
            << "\tVectorized: " << numVecCalls << "/" << numSemiCalls << " fully/semi\n"
            << "\tReplicated: " << numFallCalls << "/" << numCascadeCalls << " replicated/cascaded\n"
-           << "\tRV Intrinsics: " << numRVIntrinsics << " intrinsics\n";
+           << "\tLane loops: " << numLaneLoops << " replicated instructions\n"
+           << "\tWaterfall: " << numWaterfallCalls << " indirect calls\n"
+           << "\tOut-of-line math: " << numOutlinedMathCalls << " split SLEEF calls\n"
+           << "\tRV Intrinsics: " << numRVIntrinsics << " intrinsics\n"
+           << "\tDot products: " << numDotProducts << " reductions\n"
+           << "\tTransposed: " << numTransposedReductions << " exit reduction groups\n"
+           << "\tRecurrences: " << numRecurrences << " spliced phis\n";
 
 #if 0
   // general statistics
@@ -136,10 +351,16 @@ void NatBuilder::printStatistics() {
   file << "Feature,Frequency\n";
 
   // memory statistics
-  file << (config.useScatterGatherIntrinsics ? "masked-scatter," : "masked-casc-store,") << numMaskedScatter << "\n";
-  file << (config.useScatterGatherIntrinsics ? "masked-gather," : "masked-casc-load,") << numMaskedGather << "\n";
-  file << (config.useScatterGatherIntrinsics ? "scatter," : "cascade-store,") << numScatter << "\n";
-  file << (config.useScatterGatherIntrinsics ? "gather," : "cascade-load,")  << numGather << "\n";
+  file << "masked-scatter," << numMaskedScatter << "\n";
+  file << "masked-gather," << numMaskedGather << "\n";
+  file << "scatter," << numScatter << "\n";
+  file << "gather," << numGather << "\n";
+  file << "masked-casc-store," << numMaskedCascadeStores << "\n";
+  file << "masked-casc-load," << numMaskedCascadeLoads << "\n";
+  file << "cascade-store," << numCascadeStores << "\n";
+  file << "cascade-load," << numCascadeLoads << "\n";
+  file << "strided-span-masked-load," << numMaskedSpanLoads << "\n";
+  file << "strided-span-load," << numSpanLoads << "\n";
   file << "interleaved-masked-load," << numInterMaskedLoads << "\n";
   file << "interleaved-masked-store," << numInterMaskedStores << "\n";
   file << "interleaved-load," << numInterLoads << "\n";
@@ -148,8 +369,11 @@ void NatBuilder::printStatistics() {
   file << "contiguous-masked-store," << numContMaskedStores << "\n";
   file << "contiguous-load," << numContLoads << "\n";
   file << "contiguous-store," << numContStores << "\n";
+  file << "contiguous-unmasked-load," << numUnmaskedContLoads << "\n";
+  file << "streaming-store," << numStreamingStores << "\n";
   file << "uniform-masked-load," << numUniMaskedLoads << "\n";
   file << "uniform-masked-store," << numUniMaskedStores << "\n";
+  file << "uniform-speculative-load," << numSpecUniLoads << "\n";
   file << "uniform-load," << numUniLoads << "\n";
   file << "uniform-store," << numUniStores << "\n";
 
@@ -157,6 +381,10 @@ void NatBuilder::printStatistics() {
   file << "vector-GEP," << numVecGEPs << "\n";
   file << "scalar-GEP," << numScalGEPs << "\n";
   file << "interleaved-GEP," << numInterGEPs << "\n";
+  file << "narrowed-index," << numNarrowedIndices << "\n";
+  file << "fp-estimate," << numFPEstimates << "\n";
+  file << "native-fminmax," << numNativeMinMax << "\n";
+  file << "bit-mask," << numBitMasks << "\n";
   file << "vector-BC," << numVecBCs << "\n";
   file << "scalar-BC," << numScalBCs << "\n";
 
@@ -165,6 +393,9 @@ void NatBuilder::printStatistics() {
   file << "semi-vec-call," << numSemiCalls << "\n";
   file << "replicated-call," << numFallCalls << "\n";
   file << "cascaded-call," << numCascadeCalls << "\n";
+  file << "lane-loop," << numLaneLoops << "\n";
+  file << "waterfall-call," << numWaterfallCalls << "\n";
+  file << "outlined-math-call," << numOutlinedMathCalls << "\n";
   file << "rv-intrinsic," << numRVIntrinsics << "\n";
 
   // general statistics
@@ -172,10 +403,52 @@ void NatBuilder::printStatistics() {
   file << "vectorized," << numVectorized << "\n";
   file << "replicated," << numFallbacked << "\n";
   file << "lazy-instr," << numLazy << "\n";
+  file << "lane-slab," << numLaneSlabs << "\n";
+  file << "table-lookup," << numTableLookups << "\n";
+  file << "address-dispatch," << numAddressDispatches << "\n";
+  file << "index-run-dispatch," << numIndexRunDispatches << "\n";
+  file << "clustered-scatter," << numClusteredScatters << "\n";
+  file << "select-split," << numSelectSplits << "\n";
+  file << "coalesced-gather," << numCoalescedGathers << "\n";
+  file << "coalesced-load," << numCoalescedLoads << "\n";
+  file << "vector-induction," << numVectorInductions << "\n";
+  file << "integer-emulation," << numIntEmulations << "\n";
+  file << "single-lane," << numSingleLaneInsts << "\n";
+  file << "vp-access," << numVPAccesses << "\n";
+  file << "blend," << numBlends << "\n";
+  file << "any-guard," << numAnyGuards << "\n";
 
   file.close();
 }
 
+void NatBuilder::reportMetrics() {
+  if (countersAtStart.empty()) return;
+
+  auto & scaFunc = vecInfo.getScalarFunction();
+  auto & vecFunc = vecInfo.getVectorFunction();
+  bool isLoop = vecInfo.getRegion().isVectorLoop();
+  MetricsRecord rec("natbuilder", vecFunc.getName().str(), isLoop ? vecInfo.getEntry().getName().str() : vecFunc.getName().str());
+
+  // the loop or the scalar function
+  DebugLoc loc;
+  if (isLoop) {
+    if (auto * L = loopInfo.getLoopFor(&vecInfo.getEntry())) loc = L->getStartLoc();
+  }
+  if (loc) {
+    rec.location = (loc->getFilename() + ":" + Twine(loc->getLine())).str();
+  } else if (auto * SP = scaFunc.getSubprogram()) {
+    rec.location = (SP->getFilename() + ":" + Twine(SP->getLine())).str();
+  }
+
+  size_t i = 0;
+  for (const auto & natCounter : NatCounters) {
+    unsigned delta = *natCounter.counter - countersAtStart[i++];
+    if (natCounter.statistic) *natCounter.statistic += delta;
+    rec.metrics.emplace_back(natCounter.name, delta);
+  }
+  ReportMetrics(rec);
+}
+
 VectorShape NatBuilder::getVectorShape(const Value &val) {
   if (vecInfo.hasKnownShape(val)) return vecInfo.getVectorShape(val);
   else return VectorShape::uni();
@@ -188,6 +461,7 @@ NatBuilder::NatBuilder(Config _config, PlatformInfo &_platInfo, VectorizationInf
     platInfo(_platInfo),
     vecInfo(_vecInfo),
     dominatorTree(FAM.getResult<DominatorTreeAnalysis>(vecInfo.getScalarFunction())),
+    loopInfo(FAM.getResult<LoopAnalysis>(vecInfo.getScalarFunction())),
     memDepRes(FAM.getResult<MemoryDependenceAnalysis>(vecInfo.getScalarFunction())),
     SE(FAM.getResult<ScalarEvolutionAnalysis>(vecInfo.getScalarFunction())),
     reda(_reda),
@@ -196,20 +470,34 @@ NatBuilder::NatBuilder(Config _config, PlatformInfo &_platInfo, VectorizationInf
     i1Ty(IntegerType::get(_vecInfo.getMapping().vectorFn->getContext(), 1)),
     i32Ty(IntegerType::get(_vecInfo.getMapping().vectorFn->getContext(), 32)),
     vecMaskArg(nullptr),
+    laneStatCounters(nullptr),
+    laneStatIndex(),
+    laneStatBlocks(),
     keepScalar(),
     cascadeLoadMap(),
     cascadeStoreMap(),
     vectorValueMap(),
+    laneAllocator(),
     scalarValueMap(),
     basicBlockMap(),
-    grouperMap(),
+    interleavedGroups(),
+    coalescedGathers(),
+    maskBitsMap(),
     phiVector(),
-    lazyInstructions() {}
+    lazyInstructions(),
+    prefetchDistance(0),
+    loadedObjects(),
+    numRegionStreamingStores(0),
+    inlineBudget(-1),
+    curScaBlock(nullptr) {}
 
 void NatBuilder::vectorize(bool embedRegion, ValueToValueMapTy * vecInstMap) {
   const Function *func = vecInfo.getMapping().scalarFn;
   Function *vecFunc = vecInfo.getMapping().vectorFn;
 
+  countersAtStart.clear();
+  for (const auto & natCounter : NatCounters) countersAtStart.push_back(*natCounter.counter);
+
   IF_DEBUG_NAT {
     errs() << "-- status before vector codegen --\n";
     vecInfo.dump();
@@ -252,6 +540,12 @@ void NatBuilder::vectorize(bool embedRegion, ValueToValueMapTy * vecInstMap) {
   if (config.scalarizeIndexComputation)
     visitMemInstructions();
 
+  if (config.enableStreamingStores && vecInfo.getRegion().isVectorLoop())
+    collectLoadedObjects();
+
+  if (config.enableDemandedLanes)
+    collectDemandedLanes();
+
   // create all BasicBlocks first and map them
   for (auto &block : *func) {
     if (!vecInfo.inRegion(block)) continue;
@@ -260,6 +554,8 @@ void NatBuilder::vectorize(bool embedRegion, ValueToValueMapTy * vecInstMap) {
     mapVectorValue(&block, vecBlock);
   }
 
+  if (!config.laneStatsPath.empty()) createLaneStatCounters();
+
   // traverse dominator tree in pre-order to ensure all uses have definitions vectorized first
   std::deque<const DomTreeNode *> nodeQueue;
   const DomTreeNode *rootNode = dominatorTree.getNode(&vecInfo.getEntry());
@@ -274,6 +570,7 @@ void NatBuilder::vectorize(bool embedRegion, ValueToValueMapTy * vecInstMap) {
     if (!vecInfo.inRegion(*bb)) continue;
 
     BasicBlock *vecBlock = getVectorBlock(*bb, false);
+    curScaBlock = bb;
     vectorize(bb, vecBlock);
 
     // populate queue with pre-order dominators
@@ -282,14 +579,24 @@ void NatBuilder::vectorize(bool embedRegion, ValueToValueMapTy * vecInstMap) {
     }
   }
 
+  curScaBlock = nullptr;
+
   // revisit PHINodes now and add the mapped incoming values
   if (!phiVector.empty()) addValuesToPHINodes();
+  if (exitReductions.size() > 1) combineExitReductions();
+
+  if (laneStatCounters) createLaneStatWriter();
+  if (config.checkShapeHints && !vecInfo.getRegion().isVectorLoop()) addArgumentShapeChecks();
+  if (!shapeHintChecks.empty()) createShapeHintTraps();
 
   // report statistics
   printStatistics();
+  reportMetrics();
 
   if (!vecInfo.getRegion().isVectorLoop()) return;
 
+  if (numRegionStreamingStores > 0) fenceStreamingStores();
+
   // TODO what about outside uses?
 
   // register vector insts
@@ -364,6 +671,8 @@ void NatBuilder::vectorize(BasicBlock *const bb, BasicBlock *vecBlock) {
       if (!lazyInstructions.empty())
         requestLazyInstructions(lazyInstructions.back());
       assert(lazyInstructions.empty() && "not all lazy instructions vectorized!!");
+
+      if (laneStatCounters && laneStatIndex.count(bb)) emitLaneStatUpdate(*bb);
     }
 
     PHINode *phi = dyn_cast<PHINode>(inst);
@@ -401,6 +710,20 @@ void NatBuilder::vectorize(BasicBlock *const bb, BasicBlock *vecBlock) {
       }
     }
 
+    // only one lane is read (collectDemandedLanes)
+    auto itSingleLane = singleLaneInsts.find(inst);
+    if (itSingleLane != singleLaneInsts.end()) {
+      if (call) copyCallInstruction(call, itSingleLane->second);
+      else copyInstruction(inst, itSingleLane->second);
+      ++numSingleLaneInsts;
+      continue;
+    }
+
+    // contiguous short vector accesses are transposed in registers, all others are replicated
+    if ((load || store) && !keepScalar.count(inst) && isWidenedShortVector(*getLoadStoreType(inst)) &&
+        shouldVectorize(inst) && vectorizeShortVectorMemory(*inst))
+      continue;
+
     // loads and stores need special treatment (masking, shuffling, etc) (build them lazily)
     if (canVectorize(inst) && (load || store))
       if (false) addLazyInstruction(inst);
@@ -412,7 +735,7 @@ void NatBuilder::vectorize(BasicBlock *const bb, BasicBlock *vecBlock) {
       Value *accessedPtr = store->getPointerOperand();
       VectorShape addrShape = getVectorShape(*accessedPtr);
 
-      if (needsMask && addrShape.isUniform()) {
+      if (needsMask && addrShape.isUniform() && !isWidenedShortVector(*store->getValueOperand()->getType())) {
         Value *storedValue = store->getValueOperand();
         Type *accessedType = storedValue->getType();
         Value *accessedPtr = store->getPointerOperand();
@@ -455,8 +778,28 @@ void NatBuilder::vectorize(BasicBlock *const bb, BasicBlock *vecBlock) {
         case RVIntrinsic::PopCount: vectorizePopCountCall(call); break;
         case RVIntrinsic::Index: vectorizeIndexCall(*call); break;
         case RVIntrinsic::Align: vectorizeAlignCall(call); break;
+        case RVIntrinsic::Uniform:
+        case RVIntrinsic::Strided: vectorizeShapeHintCall(call); break;
         case RVIntrinsic::LaneID: vectorizeLaneIDCall(call); break;
         case RVIntrinsic::NumLanes: vectorizeNumLanesCall(call); break;
+        case RVIntrinsic::Philox: vectorizePhiloxCall(call); break;
+        case RVIntrinsic::ReduceAdd:
+        case RVIntrinsic::ReduceMul:
+        case RVIntrinsic::ReduceMin:
+        case RVIntrinsic::ReduceMax:
+        case RVIntrinsic::ReduceAnd:
+        case RVIntrinsic::ReduceOr: vectorizeCrossLaneReduceCall(call, false); break;
+        case RVIntrinsic::ScanAdd:
+        case RVIntrinsic::ScanMul:
+        case RVIntrinsic::ScanMin:
+        case RVIntrinsic::ScanMax:
+        case RVIntrinsic::ScanAnd:
+        case RVIntrinsic::ScanOr: vectorizeCrossLaneReduceCall(call, true); break;
+        case RVIntrinsic::ShuffleXor: vectorizeShuffleXorCall(call); break;
+        case RVIntrinsic::Broadcast: vectorizeBroadcastCall(call); break;
+        case RVIntrinsic::Sort: vectorizeSortCall(call); break;
+        case RVIntrinsic::Partition: vectorizePartitionCall(call); break;
+        case RVIntrinsic::Rank: vectorizeRankCall(call); break;
         default: {
           if (false) addLazyInstruction(inst);
           else {
@@ -474,6 +817,12 @@ void NatBuilder::vectorize(BasicBlock *const bb, BasicBlock *vecBlock) {
       continue; // skipped
     } else if (atomicrmw) {
       vectorizeAtomicRMW(atomicrmw);
+    } else if ((isa<ExtractValueInst>(inst) || isa<InsertValueInst>(inst)) &&
+               getStructOfVectorsType(*inst->getOperand(0)->getType(), vectorWidth()) && shouldVectorize(inst)) {
+      vectorizeAggregateInstruction(*inst);
+    } else if ((isa<ExtractElementInst>(inst) || isa<InsertElementInst>(inst) || isa<ShuffleVectorInst>(inst)) &&
+               canWidenShortVectorOp(*inst) && shouldVectorize(inst)) {
+      vectorizeShortVectorInstruction(*inst);
     } else if (canVectorize(inst) && shouldVectorize(inst)) {
       vectorizeInstruction(inst);
     } else if (!canVectorize(inst) && shouldVectorize(inst)){
@@ -485,6 +834,77 @@ void NatBuilder::vectorize(BasicBlock *const bb, BasicBlock *vecBlock) {
   }
 }
 
+static
+bool IsVectorizableTy(const Type & ty) {
+  return ty.isPointerTy() || ty.isIntegerTy() || ty.isFloatingPointTy();
+}
+
+// whether \p inst computes each lane from the same lane of its operands only (and can be copied for a single lane)
+static bool
+IsLaneWise(const Instruction & inst) {
+  if (inst.mayHaveSideEffects() || inst.mayReadOrWriteMemory()) return false;
+  if (!IsVectorizableTy(*inst.getType())) return false;
+  if (isa<BinaryOperator>(inst) || isa<UnaryOperator>(inst) || isa<CmpInst>(inst) || isa<SelectInst>(inst)) return true;
+  if (isa<CastInst>(inst)) return !isa<BitCastInst>(inst);
+
+  // pure (math) functions on scalars
+  auto * call = dyn_cast<CallInst>(&inst);
+  if (!call || !call->getCalledFunction() || GetIntrinsicID(*call) != RVIntrinsic::Unknown) return false;
+  return all_of(call->args(), [](const Use & arg) { return IsVectorizableTy(*arg->getType()); });
+}
+
+void
+NatBuilder::collectDemandedLanes() {
+  // definitions before uses (the dominator tree pre-order of vectorize)
+  std::vector<const BasicBlock *> blocks;
+  std::deque<const DomTreeNode *> nodeQueue;
+  nodeQueue.push_back(dominatorTree.getNode(&vecInfo.getEntry()));
+  while (!nodeQueue.empty()) {
+    const DomTreeNode *node = nodeQueue.front();
+    nodeQueue.pop_front();
+    if (!vecInfo.inRegion(*node->getBlock())) continue;
+    blocks.push_back(node->getBlock());
+    for (const auto *child : node->children()) nodeQueue.push_back(child);
+  }
+
+  // backwards: the lane demanded by all users (users that are not lane-wise demand all lanes, phis included)
+  const int allLanes = -1, noLanes = -2;
+  for (auto itBlock = blocks.rbegin(); itBlock != blocks.rend(); ++itBlock) {
+    for (auto itInst = (*itBlock)->rbegin(); itInst != (*itBlock)->rend(); ++itInst) {
+      auto & inst = *itInst;
+      if (!IsLaneWise(inst) || getVectorShape(inst).isUniform()) continue;
+
+      int demanded = noLanes;
+      for (auto * user : inst.users()) {
+        int userLane = allLanes;
+        auto * userInst = dyn_cast<Instruction>(user);
+        auto * userCall = dyn_cast<CallInst>(user);
+        if (userInst && !vecInfo.inRegion(*userInst)) {
+          userLane = allLanes;
+        } else if (userCall && GetIntrinsicID(*userCall) == RVIntrinsic::Extract && userCall->getArgOperand(0) == &inst) {
+          auto * laneIdx = dyn_cast<ConstantInt>(userCall->getArgOperand(1));
+          if (laneIdx && laneIdx->getZExtValue() < (uint64_t) vectorWidth()) userLane = laneIdx->getZExtValue();
+        } else if (userInst) {
+          auto itUser = singleLaneInsts.find(userInst);
+          if (itUser != singleLaneInsts.end()) userLane = itUser->second;
+        }
+
+        if (userLane == allLanes || (demanded != noLanes && demanded != userLane)) {
+          demanded = allLanes;
+          break;
+        }
+        demanded = userLane;
+      }
+
+      if (demanded >= 0) singleLaneInsts[&inst] = demanded;
+    }
+  }
+
+  IF_DEBUG_NAT if (!singleLaneInsts.empty()) {
+    errs() << "nat: " << singleLaneInsts.size() << " instructions are only demanded in a single lane\n";
+  }
+}
+
 ValVec
 NatBuilder::scalarize(BasicBlock & scaBlock, Instruction & inst, bool packResult, std::function<Value*(IRBuilder<>&,size_t)> genFunc) {
   auto * vecTy = packResult ? FixedVectorType::get(inst.getType(), vectorWidth()) : nullptr;
@@ -523,6 +943,8 @@ NatBuilder::createAnyGuard(bool instNeedsGuard, BasicBlock & origBlock, Instruct
 
   // prologue (guard branch)
   if (needsGuard) {
+    ++numAnyGuards;
+
     // create a mask ptest
     Value * anyMask = createPTest(requestVectorValue(scalarMask), false);
 
@@ -532,8 +954,9 @@ NatBuilder::createAnyGuard(bool instNeedsGuard, BasicBlock & origBlock, Instruct
     continueBlock = BasicBlock::Create(vecInfo.getVectorFunction().getContext(), "cont_block",
                                                    &vecInfo.getVectorFunction());
 
-    // conditionally branch to both
-    builder.CreateCondBr(anyMask, memBlock, continueBlock);
+    // conditionally branch to both (likely taken unless all lanes are off)
+    auto * guardBr = builder.CreateCondBr(anyMask, memBlock, continueBlock);
+    setBranchProbability(*guardBr, getAnyLaneProbability(DefaultLaneProb, vectorWidth()));
     builder.SetInsertPoint(memBlock);
   }
 
@@ -660,6 +1083,102 @@ NatBuilder::scalarizeCascaded(BasicBlock & srcBlock, Instruction & inst, bool pa
    return resultVec;
 }
 
+bool
+NatBuilder::scalarizeInLoop(Instruction & inst, bool guarded) {
+  if (config.replicationBudget <= 0) return false;
+  if (inst.isTerminator() || isa<PHINode>(inst)) return false;
+
+  // the lane results are inserted into one vector
+  bool producesValue = !inst.getType()->isVoidTy();
+  if (producesValue && !IsVectorizableTy(*inst.getType())) return false;
+
+  // unguarded divisions would need a safe divisor per lane
+  auto opCode = inst.getOpcode();
+  if (!guarded && opCode >= Instruction::UDiv && opCode <= Instruction::FDiv) return false;
+
+  // size of the straight-line copies (copy, operand extracts and result insert per lane)
+  size_t numVaryingOps = 0;
+  for (auto & op : inst.operands()) {
+    if (isa<BasicBlock>(op.get())) return false;
+    if (getVectorShape(*op.get()).isUniform()) continue;
+    if (!IsVectorizableTy(*op->getType())) return false;
+    ++numVaryingOps;
+  }
+  size_t laneSize = 1 + numVaryingOps + (producesValue ? 1 : 0) + (guarded ? 2 : 0);
+  if (vectorWidth() * laneSize <= (size_t) config.replicationBudget) return false;
+
+  // operands (outside the lane loop)
+  SmallVector<Value*, 4> mappedOps;
+  for (auto & op : inst.operands()) {
+    bool uniformOp = getVectorShape(*op.get()).isUniform();
+    mappedOps.push_back(uniformOp ? requestScalarValue(op.get()) : requestVectorValue(op.get()));
+  }
+
+  // lanes to visit (bit i for lane i)
+  auto & context = builder.getContext();
+  auto * laneBitsTy = Type::getIntNTy(context, vectorWidth());
+  Value * laneBits = Constant::getAllOnesValue(laneBitsTy);
+  if (guarded) {
+    auto * vecMask = requestVectorValue(vecInfo.getPredicate(*inst.getParent()));
+    laneBits = builder.CreateBitCast(vecMask, laneBitsTy, "lane_bits");
+  }
+
+  auto * vecFunc = builder.GetInsertBlock()->getParent();
+  auto * entryBlock = builder.GetInsertBlock();
+  auto * loopBlock = BasicBlock::Create(context, "lane_loop", vecFunc);
+  auto * exitBlock = BasicBlock::Create(context, "lane_loop_end", vecFunc);
+  auto * zeroBits = Constant::getNullValue(laneBitsTy);
+  if (guarded) {
+    builder.CreateCondBr(builder.CreateICmpNE(laneBits, zeroBits), loopBlock, exitBlock);
+  } else {
+    builder.CreateBr(loopBlock);
+  }
+
+// loop over the set bits
+  builder.SetInsertPoint(loopBlock);
+  auto * vecTy = producesValue ? FixedVectorType::get(inst.getType(), vectorWidth()) : nullptr;
+  auto * bitsPhi = builder.CreatePHI(laneBitsTy, 2, "lane_bits");
+  bitsPhi->addIncoming(laneBits, entryBlock);
+  PHINode * accuPhi = nullptr;
+  if (vecTy) {
+    accuPhi = builder.CreatePHI(vecTy, 2, inst.getName() + ".lanes");
+    accuPhi->addIncoming(UndefValue::get(vecTy), entryBlock);
+  }
+
+  auto * mod = vecFunc->getParent();
+  auto * cttzDecl = Intrinsic::getDeclaration(mod, Intrinsic::cttz, {laneBitsTy});
+  auto * laneIdx = builder.CreateZExtOrTrunc(builder.CreateCall(cttzDecl, {bitsPhi, builder.getTrue()}), i32Ty, "lane");
+
+  auto * cpInst = inst.clone();
+  for (unsigned i = 0; i < inst.getNumOperands(); ++i) {
+    Value * mappedOp = mappedOps[i];
+    if (mappedOp->getType() != inst.getOperand(i)->getType()) {
+      mappedOp = builder.CreateExtractElement(mappedOp, laneIdx);
+    }
+    cpInst->setOperand(i, mappedOp);
+  }
+  builder.Insert(cpInst, inst.getName());
+
+  Value * nextAccu = vecTy ? builder.CreateInsertElement(accuPhi, cpInst, laneIdx, "lane_insert") : nullptr;
+  auto * nextBits = builder.CreateAnd(bitsPhi, builder.CreateSub(bitsPhi, ConstantInt::get(laneBitsTy, 1)), "lane_bits_next");
+  builder.CreateCondBr(builder.CreateICmpNE(nextBits, zeroBits), loopBlock, exitBlock);
+  bitsPhi->addIncoming(nextBits, loopBlock);
+  if (accuPhi) accuPhi->addIncoming(nextAccu, loopBlock);
+
+// map the result in the exit block
+  builder.SetInsertPoint(exitBlock);
+  if (vecTy) {
+    auto * resPhi = builder.CreatePHI(vecTy, 2, inst.getName() + ".lanes");
+    resPhi->addIncoming(nextAccu, loopBlock);
+    if (guarded) resPhi->addIncoming(UndefValue::get(vecTy), entryBlock);
+    mapVectorValue(&inst, resPhi);
+  }
+  mapVectorValue(inst.getParent(), exitBlock);
+
+  ++numLaneLoops;
+  return true;
+}
+
 /// Request all the vector function arguments for scalling \p vecCall at the (vectorized) call site of \p scaCall.
 // Stores all arranged vector-world arguments in \p vectorArgs.
 void
@@ -671,11 +1190,19 @@ NatBuilder::requestVectorCallArgs(CallInst & scaCall, Function & vecFunc, int ma
        ++vecIdx, ++itVecArg) {
 
     if (vecIdx == maskPos) {
-      vectorArgs.push_back(requestVectorPredicate(*scaCall.getParent()));
+      // all-active call sites of masked variants pass a constant (nothing to materialize, IPO can specialize the callee)
+      auto & scaBlock = *scaCall.getParent();
+      bool allActive = hasUniformPredicate(scaBlock) || undeadMasks.isAllTrue(*vecInfo.getPredicate(scaBlock), scaBlock);
+      auto * maskTy = dyn_cast<VectorType>(itVecArg->getType());
+      if (allActive && maskTy && maskTy->getElementType()->isIntegerTy(1)) {
+        vectorArgs.push_back(ConstantInt::getTrue(maskTy));
+      } else {
+        vectorArgs.push_back(requestVectorPredicate(scaBlock));
+      }
       // the mask argument does not exist in the scalar function
     } else {
       Value *op = scaCall.getArgOperand(scaIdx);
-      bool vecTypeArg = itVecArg->getType()->isVectorTy();
+      bool vecTypeArg = itVecArg->getType()->isVectorTy() || IsStructOfVectors(*itVecArg->getType());
       Value *mappedArg = vecTypeArg ? requestVectorValue(op) : requestScalarValue(op);
       vectorArgs.push_back(mappedArg);
       ++scaIdx; // actually consuming a scalar argument
@@ -722,13 +1249,12 @@ void NatBuilder::vectorizePHIInstruction(PHINode *const scalPhi) {
   assert(vecInfo.hasKnownShape(*scalPhi) && "no VectorShape for PHINode available!");
   VectorShape shape = getVectorShape(*scalPhi);
   Type *scalType = scalPhi->getType();
-  Type *type = !shape.isVarying() || scalType->isVectorTy() || scalType->isStructTy() ?
-               scalType : getVectorType(scalPhi->getType(), vectorWidth());
-  auto name = !shape.isVarying() || scalType->isVectorTy() || scalType->isStructTy() ?
-              scalPhi->getName() : scalPhi->getName() + "_SIMD";
+  bool replicate = shape.isVarying() && ((scalType->isVectorTy() && !isWidenedShortVector(*scalType)) || scalType->isStructTy());
+  Type *type = !shape.isVarying() || replicate ? scalType : getVectorType(scalPhi->getType(), vectorWidth());
+  auto name = !shape.isVarying() || replicate ? scalPhi->getName() : scalPhi->getName() + "_SIMD";
 
   // replicate phi <vector_width> times if type is not vectorizable
-  unsigned loopEnd = shape.isVarying() && (scalType->isVectorTy() || scalType->isStructTy()) ? vectorWidth() : 1;
+  unsigned loopEnd = replicate ? vectorWidth() : 1;
   for (unsigned lane = 0; lane < loopEnd; ++lane) {
     PHINode *phi = builder.CreatePHI(type, scalPhi->getNumIncomingValues(), name);
     if (loopEnd == 1 && shape.isVarying())
@@ -777,11 +1303,6 @@ NeedsGuarding(Instruction & inst) {
   // return isa<LoadInst>(inst) || isa<StoreInst>(inst) || isa<AtomicCmpXchgInst>(inst);
 }
 
-static
-bool IsVectorizableTy(const Type & ty) {
-  return ty.isPointerTy() || ty.isIntegerTy() || ty.isFloatingPointTy();
-}
-
 void NatBuilder::vectorizeAlloca(AllocaInst *const allocaInst) {
   auto allocAlign = allocaInst->getAlign();
   auto * allocTy = allocaInst->getAllocatedType();
@@ -802,7 +1323,7 @@ void NatBuilder::vectorizeAlloca(AllocaInst *const allocaInst) {
     baseAlloca->setAlignment(llvm::Align(allocAlign));
 
     // extract basePtrs
-    auto * offsetVec = createContiguousVector(vectorWidth(), indexTy, 0, 1);
+    auto * offsetVec = getLaneIndexVector(*indexTy);
     auto * allocaPtrVec = builder.CreateGEP(allocTy, baseAlloca, offsetVec, name + ".alloca_vec");
 
     // register as vectorized alloca
@@ -816,6 +1337,202 @@ void NatBuilder::vectorizeAlloca(AllocaInst *const allocaInst) {
   replicateInstruction(allocaInst);
 }
 
+static Value* CreateDynamicPermutation(IRBuilder<> & builder, Value * vecVal, Value * indices);
+
+// integer atomics whose updates can be combined across lanes (associative and commutative, sub as add)
+static bool
+IsCombinableAtomicRMW(const AtomicRMWInst & atomicrmw) {
+  if (!atomicrmw.getType()->isIntegerTy()) return false;
+  switch (atomicrmw.getOperation()) {
+    case AtomicRMWInst::Add:
+    case AtomicRMWInst::Sub:
+    case AtomicRMWInst::And:
+    case AtomicRMWInst::Or:
+    case AtomicRMWInst::Max:
+    case AtomicRMWInst::Min:
+    case AtomicRMWInst::UMax:
+    case AtomicRMWInst::UMin:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// reduction that combines the operands of equal-address lanes of \p op
+static RedKind
+GetCombiningRedKind(AtomicRMWInst::BinOp op) {
+  switch (op) {
+    case AtomicRMWInst::Add:
+    case AtomicRMWInst::Sub:  return RedKind::Add;
+    case AtomicRMWInst::And:  return RedKind::And;
+    case AtomicRMWInst::Or:   return RedKind::Or;
+    case AtomicRMWInst::Max:  return RedKind::SMax;
+    case AtomicRMWInst::Min:  return RedKind::SMin;
+    case AtomicRMWInst::UMax: return RedKind::UMax;
+    case AtomicRMWInst::UMin: return RedKind::UMin;
+    default:
+      llvm_unreachable("not a combinable atomic");
+  }
+}
+
+// vpconflictd/q for vectors of \p vecWidth \p elemBits-bit lanes, \p hasVL for AVX512VL (not_intrinsic if unavailable)
+static Intrinsic::ID
+GetConflictIntrinsic(unsigned vecWidth, unsigned elemBits, bool hasVL) {
+  unsigned vecBits = vecWidth * elemBits;
+  // 128/256-bit vpconflict is AVX512CD + AVX512VL
+  if (vecBits != 512 && !hasVL) return Intrinsic::not_intrinsic;
+  if (elemBits == 32) {
+    if (vecBits == 128) return Intrinsic::x86_avx512_conflict_d_128;
+    if (vecBits == 256) return Intrinsic::x86_avx512_conflict_d_256;
+    if (vecBits == 512) return Intrinsic::x86_avx512_conflict_d_512;
+  } else if (elemBits == 64) {
+    if (vecBits == 128) return Intrinsic::x86_avx512_conflict_q_128;
+    if (vecBits == 256) return Intrinsic::x86_avx512_conflict_q_256;
+    if (vecBits == 512) return Intrinsic::x86_avx512_conflict_q_512;
+  }
+  return Intrinsic::not_intrinsic;
+}
+
+// Lanes that access the same address are combined before a single atomic is issued per unique address (by the first such lane).
+// Lane results are reconstructed as if the lanes had executed the atomic one after another in lane order.
+void
+NatBuilder::createConflictFreeAtomicRMW(AtomicRMWInst & atomicrmw) {
+  ++numConflictAtomics;
+
+  const int vecWidth = vectorWidth();
+  auto & scaBlock = *atomicrmw.getParent();
+  auto * scaPtr = atomicrmw.getPointerOperand();
+  auto * elemTy = atomicrmw.getType();
+  auto * intPtrTy = cast<IntegerType>(layout.getIntPtrType(scaPtr->getType()));
+  auto * laneMaskTy = FixedVectorType::get(i1Ty, vecWidth);
+
+  Value * vecPtr = requestVectorValue(scaPtr);
+  Value * vecVal = requestVectorValue(atomicrmw.getValOperand());
+  Value * vecMask = hasUniformPredicate(scaBlock) ? ConstantInt::getTrue(laneMaskTy) : requestVectorPredicate(scaBlock);
+  auto * addrVec = builder.CreatePtrToInt(vecPtr, FixedVectorType::get(intPtrTy, vecWidth), "cd.addr");
+
+  // backEq[k-1][i]: lanes i and i-k are active and access the same address
+  std::vector<Value*> backEq;
+  Value * leaderIdx = getLaneIndexVector(*i32Ty);
+  Value * isLeader = nullptr;
+
+  Intrinsic::ID conflictID = (config.useAVX512 && config.useAVX512CD)
+                                ? GetConflictIntrinsic(vecWidth, intPtrTy->getBitWidth(), config.useAVX512VL)
+                                : Intrinsic::not_intrinsic;
+  if (conflictID != Intrinsic::not_intrinsic) {
+    // AVX-512CD: bit j of conflicts[i] is set if the earlier lane j has the same address
+    auto * mod = vecInfo.getVectorFunction().getParent();
+    auto * conflicts = builder.CreateCall(Intrinsic::getDeclaration(mod, conflictID), {addrVec}, "cd.conflicts");
+    auto * activeBits = createVectorMaskSummary(*intPtrTy, vecMask, builder, RVIntrinsic::Ballot);
+    auto * activeConflicts = builder.CreateAnd(conflicts, builder.CreateVectorSplat(vecWidth, activeBits), "cd.active.conflicts");
+    auto * zeroVec = Constant::getNullValue(activeConflicts->getType());
+    isLeader = builder.CreateAnd(vecMask, builder.CreateICmpEQ(activeConflicts, zeroVec), "cd.leader");
+
+    // the first lane with the same address is the lowest conflict bit
+    auto * cttzDecl = Intrinsic::getDeclaration(mod, Intrinsic::cttz, {activeConflicts->getType()});
+    auto * firstConflict = builder.CreateCall(cttzDecl, {activeConflicts, builder.getTrue()});
+    leaderIdx = builder.CreateSelect(isLeader, leaderIdx, builder.CreateTrunc(firstConflict, leaderIdx->getType()), "cd.leader.idx");
+
+    for (int k = 1; k < vecWidth; ++k) {
+      SmallVector<Constant*, 16> shiftAmounts, inRange;
+      for (int i = 0; i < vecWidth; ++i) {
+        shiftAmounts.push_back(ConstantInt::get(intPtrTy, i >= k ? i - k : 0));
+        inRange.push_back(builder.getInt1(i >= k));
+      }
+      auto * laneBit = builder.CreateAnd(builder.CreateLShr(activeConflicts, ConstantVector::get(shiftAmounts)), ConstantInt::get(activeConflicts->getType(), 1));
+      auto * eq = builder.CreateICmpNE(laneBit, zeroVec);
+      backEq.push_back(builder.CreateAnd(builder.CreateAnd(eq, vecMask), ConstantVector::get(inRange), "cd.eq"));
+    }
+
+  } else {
+    // emulation: compare against all earlier lanes
+    Value * anyConflict = ConstantInt::getFalse(laneMaskTy);
+    for (int k = 1; k < vecWidth; ++k) {
+      SmallVector<int, 16> backLanes;
+      SmallVector<Constant*, 16> inRange, leaderLanes;
+      for (int i = 0; i < vecWidth; ++i) {
+        backLanes.push_back(i >= k ? i - k : i);
+        inRange.push_back(builder.getInt1(i >= k));
+        leaderLanes.push_back(builder.getInt32(i >= k ? i - k : i));
+      }
+      auto * prevAddr = builder.CreateShuffleVector(addrVec, addrVec, backLanes);
+      auto * prevActive = builder.CreateShuffleVector(vecMask, vecMask, backLanes);
+      auto * eq = builder.CreateAnd(builder.CreateICmpEQ(addrVec, prevAddr), prevActive);
+      eq = builder.CreateAnd(builder.CreateAnd(eq, vecMask), ConstantVector::get(inRange), "cd.eq");
+      backEq.push_back(eq);
+
+      anyConflict = builder.CreateOr(anyConflict, eq);
+      // the largest k (the earliest lane) wins
+      leaderIdx = builder.CreateSelect(eq, ConstantVector::get(leaderLanes), leaderIdx, "cd.leader.idx");
+    }
+    isLeader = builder.CreateAnd(vecMask, builder.CreateNot(anyConflict), "cd.leader");
+  }
+
+  // leaders combine the operands of all later lanes with the same address,
+  // every lane accumulates the operands of the earlier ones (lane results)
+  RedKind combineKind = GetCombiningRedKind(atomicrmw.getOperation());
+  auto * neutralVec = builder.CreateVectorSplat(vecWidth, &GetNeutralElement(combineKind, *elemTy));
+  Value * combinedVal = vecVal;
+  Value * prefixVal = neutralVec;
+  bool needsResult = !atomicrmw.use_empty();
+  for (int k = 1; k < vecWidth; ++k) {
+    SmallVector<int, 16> fwdLanes, backLanes;
+    for (int i = 0; i < vecWidth; ++i) {
+      fwdLanes.push_back(i + k < vecWidth ? i + k : i);
+      backLanes.push_back(i >= k ? i - k : i);
+    }
+    // fwdEq[i] = backEq[i + k] (out of range lanes are cleared in backEq[i])
+    auto * fwdEq = builder.CreateShuffleVector(backEq[k - 1], backEq[k - 1], fwdLanes);
+    SmallVector<Constant*, 16> fwdInRange;
+    for (int i = 0; i < vecWidth; ++i) fwdInRange.push_back(builder.getInt1(i + k < vecWidth));
+    fwdEq = builder.CreateAnd(fwdEq, ConstantVector::get(fwdInRange));
+
+    auto * laterVal = builder.CreateShuffleVector(vecVal, vecVal, fwdLanes);
+    combinedVal = &CreateReductInst(builder, combineKind, *combinedVal, *builder.CreateSelect(fwdEq, laterVal, neutralVec));
+
+    if (needsResult) {
+      auto * earlierVal = builder.CreateShuffleVector(vecVal, vecVal, backLanes);
+      prefixVal = &CreateReductInst(builder, combineKind, *prefixVal, *builder.CreateSelect(backEq[k - 1], earlierVal, neutralVec));
+    }
+  }
+
+  // one atomic per leader
+  std::vector<BasicBlock*> condBlocks, maskedBlocks;
+  BasicBlock * resBlock = createCascadeBlocks(&vecInfo.getVectorFunction(), vecWidth, condBlocks, maskedBlocks);
+  condBlocks.push_back(resBlock);
+  builder.CreateBr(condBlocks[0]);
+  builder.SetInsertPoint(condBlocks[0]);
+
+  Value * leaderOld = UndefValue::get(vecVal->getType());
+  for (int lane = 0; lane < vecWidth; ++lane) {
+    builder.CreateCondBr(builder.CreateExtractElement(isLeader, lane), maskedBlocks[lane], condBlocks[lane + 1]);
+
+    builder.SetInsertPoint(maskedBlocks[lane]);
+    auto * laneAtomic = cast<AtomicRMWInst>(atomicrmw.clone());
+    laneAtomic->setOperand(0, builder.CreateExtractElement(vecPtr, lane));
+    laneAtomic->setOperand(1, builder.CreateExtractElement(combinedVal, lane));
+    builder.Insert(laneAtomic, atomicrmw.getName());
+    auto * laneOld = builder.CreateInsertElement(leaderOld, laneAtomic, lane);
+    builder.CreateBr(condBlocks[lane + 1]);
+
+    builder.SetInsertPoint(condBlocks[lane + 1]);
+    auto * oldPhi = builder.CreatePHI(leaderOld->getType(), 2, "cd.old");
+    oldPhi->addIncoming(leaderOld, condBlocks[lane]);
+    oldPhi->addIncoming(laneOld, maskedBlocks[lane]);
+    leaderOld = oldPhi;
+  }
+  mapVectorValue(&scaBlock, resBlock);
+
+  if (!needsResult) return;
+
+  // result of lane i: old value at its leader, updated by the earlier lanes with the same address
+  auto * laneBase = CreateDynamicPermutation(builder, leaderOld, leaderIdx);
+  Value * laneResult = atomicrmw.getOperation() == AtomicRMWInst::Sub ? builder.CreateSub(laneBase, prefixVal)
+                                                                      : &CreateReductInst(builder, combineKind, *laneBase, *prefixVal);
+  laneResult->setName(atomicrmw.getName());
+  mapVectorValue(&atomicrmw, laneResult);
+}
+
 void NatBuilder::vectorizeAtomicRMW(AtomicRMWInst *const atomicrmw) {
   VectorShape shape = getVectorShape(*atomicrmw);
   if (shape.isStrided() || shape.isContiguous()) {
@@ -843,6 +1560,11 @@ void NatBuilder::vectorizeAtomicRMW(AtomicRMWInst *const atomicrmw) {
     VectorShape ptrShape = getVectorShape(*ptr);
 
     if (!ptrShape.isUniform()) {
+      // combine lanes with equal addresses in-vector, one atomic per unique address
+      if (IsCombinableAtomicRMW(*atomicrmw)) {
+        createConflictFreeAtomicRMW(*atomicrmw);
+        return;
+      }
       replicateInstruction(atomicrmw);
       return;
     }
@@ -927,32 +1649,23 @@ void NatBuilder::vectorizeAtomicRMW(AtomicRMWInst *const atomicrmw) {
           vectorizedVal = builder.CreateSelect(vecMask, vectorizedVal, neutralElement);
       }
 
+      // one atomic for all active lanes (skipped if there are none)
       Value *finalVal = &CreateVectorReduce(config, builder, reduction, *vectorizedVal, nullptr);
-
       clonedInst->setOperand(1, finalVal);
-      builder.Insert(clonedInst);
+      Value *oldVal = &createAnyGuard(needsMask, *atomicrmw->getParent(), *atomicrmw, true, [&](IRBuilder<> & guardBuilder) {
+        guardBuilder.Insert(clonedInst);
+        return clonedInst;
+      });
 
-      Value *itervector = UndefValue::get(vectorizedVal->getType());
-      Value *itervar = clonedInst;
-      itervector = builder.CreateInsertElement(itervector, itervar, (uint64_t) 0);
-      for (int i  = 1; i < vectorWidth(); i++) {
-        Value *update = builder.CreateExtractElement(vectorizedVal, (uint64_t) i - 1);
-        switch (atomicrmw->getOperation()) {
-        case AtomicRMWInst::Add:  itervar = builder.CreateAdd(itervar, update); break;
-        case AtomicRMWInst::Sub:  itervar = builder.CreateSub(itervar, update); break;
-        case AtomicRMWInst::And:  itervar = builder.CreateAnd(itervar, update); break;
-        case AtomicRMWInst::Or:   itervar = builder.CreateOr(itervar, update); break;
-        case AtomicRMWInst::Max:  itervar = createMinMaxOp(builder, RecurKind::SMax, itervar, update); break;
-        case AtomicRMWInst::UMax: itervar = createMinMaxOp(builder, RecurKind::UMax, itervar, update); break;
-        case AtomicRMWInst::Min:  itervar = createMinMaxOp(builder, RecurKind::SMin, itervar, update); break;
-        case AtomicRMWInst::UMin: itervar = createMinMaxOp(builder, RecurKind::UMin, itervar, update); break;
-        default:
-          llvm_unreachable("case missing");
-        }
-        itervector = builder.CreateInsertElement(itervector, itervar, (uint64_t) i);
-      }
+      if (atomicrmw->use_empty()) break;
 
-      mapVectorValue(atomicrmw, itervector);
+      // lane results as if the lanes had issued their atomics in order: old value combined with an exclusive scan of the operands
+      auto & laneOffsets = CreateVectorScan(builder, reduction, *vectorizedVal, false);
+      Value *oldVec = builder.CreateVectorSplat(vectorWidth(), oldVal);
+      Value *laneResults = atomicrmw->getOperation() == AtomicRMWInst::Sub ? builder.CreateSub(oldVec, &laneOffsets)
+                                                                           : &CreateReductInst(builder, reduction, *oldVec, laneOffsets);
+      laneResults->setName(atomicrmw->getName());
+      mapVectorValue(atomicrmw, laneResults);
       break;
     }
     default:
@@ -986,7 +1699,10 @@ void NatBuilder::replicateInstruction(Instruction *const inst) {
         };
 
   bool packResult = IsVectorizableTy(*type);
-  if (nonTrivialMask && NeedsGuarding(*inst)) {
+  bool guarded = nonTrivialMask && NeedsGuarding(*inst);
+  if (scalarizeInLoop(*inst, guarded)) {
+    // compact loop over the lanes
+  } else if (guarded) {
     ValVec resVec = scalarizeCascaded(*inst->getParent(), *inst, packResult, replFunc);
   } else {
     scalarize(*inst->getParent(), *inst, packResult, replFunc);
@@ -996,16 +1712,422 @@ void NatBuilder::replicateInstruction(Instruction *const inst) {
 }
 
 /* expects that builder has valid insertion point set */
+// number of native registers the wider side of the cast \p inst spans at \p vectorWidth (1 if it fits one)
+static unsigned
+GetCastSplitParts(const CastInst &inst, unsigned vectorWidth, size_t vectorBits) {
+  auto *srcTy = inst.getSrcTy(), *destTy = inst.getDestTy();
+  if (!(srcTy->isIntegerTy() || srcTy->isFloatingPointTy()) || !(destTy->isIntegerTy() || destTy->isFloatingPointTy())) return 1;
+  size_t srcBits = srcTy->getPrimitiveSizeInBits(), destBits = destTy->getPrimitiveSizeInBits();
+  if (srcBits == destBits || vectorBits == 0) return 1;
+  size_t wideBits = std::max(srcBits, destBits) * vectorWidth;
+  if (wideBits <= vectorBits || wideBits % vectorBits != 0) return 1;
+  size_t numParts = wideBits / vectorBits;
+  return (isPowerOf2_64(numParts) && numParts < vectorWidth) ? numParts : 1;
+}
+
+Value *NatBuilder::createSplitCast(CastInst &scaCast, unsigned numParts) {
+  Value *vecOp = requestVectorValue(scaCast.getOperand(0));
+  unsigned partWidth = vectorWidth() / numParts;
+  auto *partTy = FixedVectorType::get(scaCast.getDestTy(), partWidth);
+
+  SmallVector<Value *, 8> parts;
+  for (unsigned p = 0; p < numParts; ++p) {
+    SmallVector<int, 16> partLanes;
+    for (unsigned i = 0; i < partWidth; ++i) partLanes.push_back(p * partWidth + i);
+    auto *opPart = builder.CreateShuffleVector(vecOp, partLanes, scaCast.getName() + ".part");
+    parts.push_back(builder.CreateCast(scaCast.getOpcode(), opPart, partTy, scaCast.getName() + ".part_SIMD"));
+  }
+  return concatenateVectors(builder, parts);
+}
+
+// whether \p val is known to be a non-negative value of at most \p numBits bits
+static bool
+FitsBits(Value &val, unsigned numBits, const DataLayout &layout) {
+  auto known = computeKnownBits(&val, layout);
+  return known.countMinLeadingZeros() >= known.getBitWidth() - numBits;
+}
+
+Value *NatBuilder::createIntegerDivision(Instruction &inst) {
+  auto *binOp = dyn_cast<BinaryOperator>(&inst);
+  if (!binOp) return nullptr;
+  auto opcode = binOp->getOpcode();
+  bool isSigned = opcode == Instruction::SDiv || opcode == Instruction::SRem;
+  if (!isSigned && opcode != Instruction::UDiv && opcode != Instruction::URem) return nullptr;
+
+  auto *intTy = dyn_cast<IntegerType>(inst.getType());
+  if (!intTy || intTy->getBitWidth() > 32) return nullptr;
+  unsigned numBits = intTy->getBitWidth();
+
+  // the backend expands constant divisors itself
+  auto *divisor = inst.getOperand(1);
+  if (isa<Constant>(divisor)) return nullptr;
+
+  auto *vecNum = requestVectorValue(inst.getOperand(0));
+  if (getVectorShape(*divisor).isUniform()) {
+    return CreateUniformDivision(builder, opcode, *vecNum, *requestScalarValue(divisor));
+  }
+
+  // varying divisors: float holds up to 24 bits exactly, double all 32 bit integers
+  auto *numerator = inst.getOperand(0);
+  bool fitsFloat = numBits <= 16 ||
+                   (FitsBits(*numerator, 24, layout) && FitsBits(*divisor, 24, layout));
+  auto *fpElemTy = fitsFloat ? Type::getFloatTy(inst.getContext()) : Type::getDoubleTy(inst.getContext());
+  return CreateFPDivision(builder, opcode, *vecNum, *requestVectorValue(divisor), *fpElemTy);
+}
+
+bool
+NatBuilder::isEmulationCheaper(unsigned emulationSize, InstructionCost nativeCost, FixedVectorType &vecTy) {
+  auto *tti = platInfo.getTTI();
+  if (!tti || emulationSize == 0 || !nativeCost.isValid()) return false;
+  // every instruction of the sequence costs about as much as a vector add on the same type (split types as well)
+  auto stepCost = tti->getArithmeticInstrCost(Instruction::Add, &vecTy, TargetTransformInfo::TCK_RecipThroughput);
+  return stepCost.isValid() && stepCost * emulationSize < nativeCost;
+}
+
+Value *NatBuilder::createIntegerEmulation(Instruction &inst) {
+  using namespace llvm::PatternMatch;
+  auto *intTy = dyn_cast<IntegerType>(inst.getType());
+  if (!intTy) return nullptr;
+  auto *vecTy = FixedVectorType::get(intTy, vectorWidth());
+
+  // (u)int64 multiply-high: the <W x i128> multiplication is scalarized on every target
+  Value *wideA = nullptr, *wideB = nullptr;
+  if (isa<TruncInst>(inst) && intTy->getBitWidth() == 64 &&
+      match(inst.getOperand(0), m_Shr(m_Mul(m_Value(wideA), m_Value(wideB)), m_SpecificInt(64)))) {
+    auto *zextA = dyn_cast<ZExtInst>(wideA), *zextB = dyn_cast<ZExtInst>(wideB);
+    auto *sextA = dyn_cast<SExtInst>(wideA), *sextB = dyn_cast<SExtInst>(wideB);
+    bool isSigned = sextA && sextB;
+    if (!(zextA && zextB) && !isSigned) return nullptr;
+    auto *opA = cast<CastInst>(wideA)->getOperand(0), *opB = cast<CastInst>(wideB)->getOperand(0);
+    if (opA->getType() != intTy || opB->getType() != intTy || wideA->getType()->getScalarSizeInBits() != 128) return nullptr;
+    return CreateMulHigh64(builder, *requestVectorValue(opA), *requestVectorValue(opB), isSigned);
+  }
+
+  // shifts without a native instruction for the element type
+  auto *binOp = dyn_cast<BinaryOperator>(&inst);
+  if (!binOp || !binOp->isShift()) return nullptr;
+  auto opcode = binOp->getOpcode();
+  unsigned emulationSize = GetShiftEmulationSize(opcode, *vecTy);
+  if (!emulationSize) return nullptr;
+  auto *tti = platInfo.getTTI();
+  if (!tti) return nullptr;
+  bool uniformAmount = getVectorShape(*inst.getOperand(1)).isUniform();
+  auto amountKind = uniformAmount ? TargetTransformInfo::OK_UniformValue : TargetTransformInfo::OK_AnyValue;
+  if (isa<Constant>(inst.getOperand(1))) amountKind = TargetTransformInfo::OK_UniformConstantValue;
+  auto nativeCost = tti->getArithmeticInstrCost(opcode, vecTy, TargetTransformInfo::TCK_RecipThroughput,
+                                                TargetTransformInfo::OK_AnyValue, amountKind);
+  if (!isEmulationCheaper(emulationSize, nativeCost, *vecTy)) return nullptr;
+  return CreateEmulatedShift(builder, opcode, *requestVectorValue(inst.getOperand(0)), *requestVectorValue(inst.getOperand(1)), uniformAmount);
+}
+
+Value *NatBuilder::createIntegerIntrinsic(CallInst &call) {
+  auto id = call.getIntrinsicID();
+  auto *intTy = dyn_cast<IntegerType>(call.getType());
+  if (!intTy || id == Intrinsic::not_intrinsic || !isTriviallyVectorizable(id)) return nullptr;
+  auto *vecTy = FixedVectorType::get(intTy, vectorWidth());
+
+  // popcount and leading/trailing zeros as bit tricks if TTI would scalarize them
+  unsigned emulationSize = config.enableIntegerEmulation ? GetIntrinsicEmulationSize(id, *vecTy) : 0;
+  if (emulationSize && platInfo.getTTI()) {
+    SmallVector<Type *, 2> argTys;
+    for (auto &arg : call.args()) argTys.push_back(arg->getType() == intTy ? (Type *) vecTy : arg->getType());
+    IntrinsicCostAttributes costAttrs(id, vecTy, argTys);
+    auto nativeCost = platInfo.getTTI()->getIntrinsicInstrCost(costAttrs, TargetTransformInfo::TCK_RecipThroughput);
+    if (isEmulationCheaper(emulationSize, nativeCost, *vecTy)) {
+      auto *vecX = requestVectorValue(call.getArgOperand(0));
+      ++numIntEmulations;
+      if (id == Intrinsic::ctpop) return CreatePopCount(builder, *vecX);
+      return CreateZeroCount(builder, *vecX, id == Intrinsic::cttz);
+    }
+  }
+
+  // the vector intrinsic (the backend legalizes it)
+  SmallVector<Value *, 3> vecArgs;
+  for (unsigned i = 0; i < call.arg_size(); ++i) {
+    auto *arg = call.getArgOperand(i);
+    vecArgs.push_back(hasVectorInstrinsicScalarOpd(id, i) ? requestScalarValue(arg) : requestVectorValue(arg));
+  }
+  auto *vecDecl = Intrinsic::getDeclaration(vecInfo.getVectorFunction().getParent(), id, {vecTy});
+  return builder.CreateCall(vecDecl, vecArgs, call.getName());
+}
+
+// whether \p func assumes the function-wide fast-math property \p attrName ("no-nans-fp-math", ..)
+static bool HasFPMathAttr(const Function &func, StringRef attrName) {
+  return func.getFnAttribute(attrName).getValueAsString() == "true" || func.getFnAttribute("unsafe-fp-math").getValueAsString() == "true";
+}
+
+// whether \p val is not NaN: the flags of its instruction (or \p flagInst) say so, or it is known
+static bool IsNaNFree(Value &val, const Instruction &flagInst) {
+  if (flagInst.hasNoNaNs() || HasFPMathAttr(*flagInst.getFunction(), "no-nans-fp-math")) return true;
+  auto *valInst = dyn_cast<Instruction>(&val);
+  if (valInst && isa<FPMathOperator>(valInst) && valInst->hasNoNaNs()) return true;
+  return isKnownNeverNaN(&val, nullptr);
+}
+
+// whether the floating-point min/max \p inst (minnum/maxnum, an ordered or unordered select(fcmp)) may use native min/max
+// instructions (nnan and nsz). The operands go to \p A and \p B, \p isMin tells min from max.
+static bool MatchNativeMinMax(Instruction &inst, Value *&A, Value *&B, bool &isMin) {
+  using namespace llvm::PatternMatch;
+  if (!inst.getType()->isFloatingPointTy()) return false;
+
+  // minnum/maxnum do not distinguish signed zeros
+  auto *call = dyn_cast<CallInst>(&inst);
+  if (call && (call->getIntrinsicID() == Intrinsic::minnum || call->getIntrinsicID() == Intrinsic::maxnum)) {
+    A = call->getArgOperand(0);
+    B = call->getArgOperand(1);
+    isMin = call->getIntrinsicID() == Intrinsic::minnum;
+    return IsNaNFree(*A, inst) && IsNaNFree(*B, inst);
+  }
+
+  auto *select = dyn_cast<SelectInst>(&inst);
+  if (!select) return false;
+  if (m_OrdFMin(m_Value(A), m_Value(B)).match(select) || m_UnordFMin(m_Value(A), m_Value(B)).match(select)) isMin = true;
+  else if (m_OrdFMax(m_Value(A), m_Value(B)).match(select) || m_UnordFMax(m_Value(A), m_Value(B)).match(select)) isMin = false;
+  else return false;
+
+  // the compare may carry the flags instead of the select
+  auto &cmp = *cast<Instruction>(select->getCondition());
+  bool noNaNs = (IsNaNFree(*A, *select) && IsNaNFree(*B, *select)) || cmp.hasNoNaNs();
+  bool noSignedZeros = select->hasNoSignedZeros() || cmp.hasNoSignedZeros() ||
+                       HasFPMathAttr(*select->getFunction(), "no-signed-zeros-fp-math");
+  return noNaNs && noSignedZeros;
+}
+
+Value *NatBuilder::createNativeMinMax(Instruction &inst) {
+  Value *A, *B;
+  bool isMin;
+  if (!MatchNativeMinMax(inst, A, B, isMin)) return nullptr;
+
+  IRBuilder<>::FastMathFlagGuard fmfGuard(builder);
+  FastMathFlags minMaxFMF;
+  minMaxFMF.setNoNaNs();
+  minMaxFMF.setNoSignedZeros();
+  builder.setFastMathFlags(minMaxFMF);
+  auto &vecMinMax = CreateFPMinMax(builder, *requestVectorValue(A), *requestVectorValue(B), isMin);
+  vecMinMax.setName(inst.getName() + "_SIMD");
+  return &vecMinMax;
+}
+
+FastMathFlags NatBuilder::getReductionFMF(Reduction &red) {
+  FastMathFlags redFMF;
+  if (!config.enableNativeFPMinMax || (red.kind != RedKind::FMin && red.kind != RedKind::FMax)) return redFMF;
+
+  // every update of the chain is a NaN-free min/max
+  for (auto *elem : red.elements) {
+    if (isa<PHINode>(elem)) continue;
+    Value *A, *B;
+    bool isMin;
+    if (!MatchNativeMinMax(*elem, A, B, isMin)) return redFMF;
+  }
+  redFMF.setNoNaNs();
+  redFMF.setNoSignedZeros();
+  return redFMF;
+}
+
+Value *NatBuilder::createApproxDivision(Instruction &inst) {
+  auto *binOp = dyn_cast<BinaryOperator>(&inst);
+  if (!binOp || binOp->getOpcode() != Instruction::FDiv) return nullptr;
+  // the refinement steps turn the estimates of 0 and inf into NaN
+  if (!binOp->hasNoInfs()) return nullptr;
+
+  // uniform divisors are inverted once in scalar code by the backend
+  auto *numerator = inst.getOperand(0);
+  auto *divisor = inst.getOperand(1);
+  if (getVectorShape(*divisor).isUniform()) return nullptr;
+
+  // x / sqrt(y) or x * (1 / y)
+  auto *sqrtCall = dyn_cast<CallInst>(divisor);
+  bool isRSqrt = sqrtCall && sqrtCall->getIntrinsicID() == Intrinsic::sqrt && sqrtCall->hasOneUse() &&
+                 sqrtCall->hasApproxFunc() && binOp->hasApproxFunc();
+  if (!isRSqrt && !binOp->hasAllowReciprocal()) return nullptr;
+
+  auto kind = isRSqrt ? FPEstimate::RSqrt : FPEstimate::Reciprocal;
+  auto *vecTy = cast<FixedVectorType>(getVectorType(inst.getType(), vectorWidth()));
+  unsigned estimateBits = 0;
+  auto estimateID = GetFPEstimateIntrinsic(config, kind, *vecTy, estimateBits);
+  if (estimateID == Intrinsic::not_intrinsic) return nullptr;
+
+  int ulpBound = isRSqrt ? ReadULPErrorBound(*sqrtCall) : ReadULPErrorBound(vecInfo.getScalarFunction());
+  if (ulpBound < 0) ulpBound = config.maxULPErrorBound;
+  int numSteps = GetNewtonSteps(estimateBits, *vecTy->getElementType(), ulpBound);
+  if (numSteps < 0) return nullptr;
+
+  // the vectorized sqrt of the divisor is dead code afterwards
+  auto *vecX = requestVectorValue(isRSqrt ? sqrtCall->getArgOperand(0) : divisor);
+  auto *estimate = CreateFPEstimate(builder, kind, estimateID, *vecX, numSteps);
+  auto *constNum = dyn_cast<ConstantFP>(numerator);
+  if (constNum && constNum->isExactlyValue(1.0)) return estimate;
+
+  auto *vecQuot = builder.CreateFMul(requestVectorValue(numerator), estimate, inst.getName() + "_SIMD");
+  if (auto *quotInst = dyn_cast<Instruction>(vecQuot)) quotInst->copyFastMathFlags(&inst);
+  return vecQuot;
+}
+
+Value *NatBuilder::createBitMask(Instruction &inst) {
+  using namespace llvm::PatternMatch;
+  if (!inst.getType()->isIntegerTy(1)) return nullptr;
+
+  // 0/1 bytes of bool arrays: testing the byte is cheaper than extracting bit 0 (vptestmb, cmtst)
+  auto *trunc = dyn_cast<TruncInst>(&inst);
+  auto *boolLoad = trunc ? dyn_cast<LoadInst>(trunc->getOperand(0)) : nullptr;
+  if (boolLoad) {
+    auto *rangeMD = boolLoad->getMetadata(LLVMContext::MD_range);
+    if (!rangeMD || getConstantRangeFromMetadata(*rangeMD).getUnsignedMax().ugt(1)) return nullptr;
+    auto *vecBytes = requestVectorValue(boolLoad);
+    return builder.CreateICmpNE(vecBytes, Constant::getNullValue(vecBytes->getType()), inst.getName() + "_SIMD");
+  }
+
+  // bitsets: (w >> s) & 1 and w & (1 << s)
+  Value *word, *shift;
+  ICmpInst::Predicate pred = ICmpInst::ICMP_NE;
+  if (!match(&inst, m_Trunc(m_LShr(m_Value(word), m_Value(shift)))) &&
+      !match(&inst, m_ICmp(pred, m_And(m_LShr(m_Value(word), m_Value(shift)), m_One()), m_Zero())) &&
+      !match(&inst, m_ICmp(pred, m_c_And(m_Value(word), m_Shl(m_One(), m_Value(shift))), m_Zero())))
+    return nullptr;
+  if (pred != ICmpInst::ICMP_NE && pred != ICmpInst::ICMP_EQ) return nullptr;
+  if (!word->getType()->isIntegerTy() || word->getType()->getIntegerBitWidth() > 64) return nullptr;
+
+  // lane l tests bit s + l of a word that all lanes share
+  if (!getVectorShape(*word).isUniform() || !getVectorShape(*shift).isContiguous()) return nullptr;
+
+  // bits beyond the word are poison in the scalar code, the lanes of a word that no lane tests are not
+  auto *laneBits = builder.CreateLShr(requestScalarValue(word), requestScalarValue(shift), "bitset.lanes");
+  auto *maskBits = builder.CreateZExtOrTrunc(builder.CreateFreeze(laneBits), builder.getIntNTy(vectorWidth()));
+  if (pred == ICmpInst::ICMP_EQ) maskBits = builder.CreateNot(maskBits);
+  return builder.CreateBitCast(maskBits, FixedVectorType::get(i1Ty, vectorWidth()), inst.getName() + "_SIMD");
+}
+
+Value *NatBuilder::createBitSetBits(Value &scaPayload, Value *vecMask) {
+  using namespace llvm::PatternMatch;
+  Value *cond, *shift;
+  if (!match(&scaPayload, m_Shl(m_ZExt(m_Value(cond)), m_Value(shift))) &&
+      !match(&scaPayload, m_Select(m_Value(cond), m_Shl(m_One(), m_Value(shift)), m_Zero())))
+    return nullptr;
+  auto *intTy = dyn_cast<IntegerType>(scaPayload.getType());
+  if (!intTy || intTy->getBitWidth() > 64 || !cond->getType()->isIntegerTy(1)) return nullptr;
+  if (!getVectorShape(*shift).isContiguous()) return nullptr;
+
+  // bit l of the ballot is set for lane l, it goes to bit s + l of the word
+  Value *condMask = requestVectorValue(cond);
+  if (vecMask) condMask = builder.CreateAnd(condMask, vecMask, "bitset.active");
+  auto *laneBitsTy = builder.getIntNTy(vectorWidth());
+  auto *laneBits = createVectorMaskSummary(*laneBitsTy, condMask, builder, RVIntrinsic::Ballot);
+  auto *firstShift = requestScalarValue(shift);
+  Value *wordBits;
+  if ((unsigned) vectorWidth() <= intTy->getBitWidth()) {
+    wordBits = builder.CreateShl(builder.CreateZExt(laneBits, intTy), firstShift, "bitset.bits");
+  } else {
+    wordBits = builder.CreateShl(laneBits, builder.CreateZExt(firstShift, laneBitsTy), "bitset.bits");
+    wordBits = builder.CreateTrunc(wordBits, intTy);
+  }
+  // lanes beyond the word were poison in the scalar code (and there is no active lane if the first one is)
+  ++numBitMasks;
+  return builder.CreateFreeze(wordBits);
+}
+
+Value *NatBuilder::createActiveLaneMask(Instruction &inst) {
+  auto *cmp = dyn_cast<ICmpInst>(&inst);
+  if (!cmp || cmp->getPredicate() != ICmpInst::ICMP_ULT) return nullptr;
+  auto *laneId = cmp->getOperand(0);
+  auto *bound = cmp->getOperand(1);
+  if (GetIntrinsicID(*laneId) != RVIntrinsic::LaneID || !getVectorShape(*bound).isUniform()) return nullptr;
+
+  // lane i is active iff 0 + i < bound
+  auto *maskTy = FixedVectorType::get(i1Ty, vectorWidth());
+  auto *scaBound = requestScalarValue(bound);
+  return builder.CreateIntrinsic(Intrinsic::get_active_lane_mask, {maskTy, scaBound->getType()},
+                                 {ConstantInt::get(scaBound->getType(), 0), scaBound}, nullptr, inst.getName() + "_SIMD");
+}
+
 void NatBuilder::vectorizeInstruction(Instruction *const inst) {
   assert(inst && "no instruction to vectorize");
   assert(builder.GetInsertBlock() && "no insertion point set");
+
+  // widening/narrowing casts of mixed-width regions convert one native register at a time (RV_SPLIT_PARTS)
+  auto *castInst = dyn_cast<CastInst>(inst);
+  if (castInst && config.maxSplitParts > 1) {
+    unsigned numParts = GetCastSplitParts(*castInst, vectorWidth(), CostModel(platInfo, config).getMaxVectorBits());
+    if (numParts > 1) {
+      mapVectorValue(inst, createSplitCast(*castInst, numParts));
+      ++numVectorized;
+      return;
+    }
+  }
+
+  // there is no SIMD integer division outside of SVE
+  if (config.enableDivisionLowering && !config.useSVE) {
+    if (auto *vecDiv = createIntegerDivision(*inst)) {
+      mapVectorValue(inst, vecDiv);
+      ++numVectorized;
+      return;
+    }
+  }
+
+  if (config.enableIntegerEmulation) {
+    if (auto *vecEmul = createIntegerEmulation(*inst)) {
+      mapVectorValue(inst, vecEmul);
+      ++numVectorized;
+      ++numIntEmulations;
+      return;
+    }
+  }
+
+  if (config.enableFPEstimates) {
+    if (auto *vecDiv = createApproxDivision(*inst)) {
+      mapVectorValue(inst, vecDiv);
+      ++numVectorized;
+      ++numFPEstimates;
+      return;
+    }
+  }
+
+  if (config.enableNativeFPMinMax) {
+    if (auto *vecMinMax = createNativeMinMax(*inst)) {
+      mapVectorValue(inst, vecMinMax);
+      ++numVectorized;
+      ++numNativeMinMax;
+      return;
+    }
+  }
+
+  if (config.enableBitMasks) {
+    if (auto *bitMask = createBitMask(*inst)) {
+      mapVectorValue(inst, bitMask);
+      ++numVectorized;
+      ++numBitMasks;
+      return;
+    }
+  }
+
+  // lane id range checks (the tail mask of folded loops) map to SVE whilelo
+  if (config.useSVE) {
+    if (auto *laneMask = createActiveLaneMask(*inst)) {
+      mapVectorValue(inst, laneMask);
+      ++numVectorized;
+      return;
+    }
+  }
+
   Instruction *vecInst = inst->clone();
 
+  auto *select = dyn_cast<SelectInst>(inst);
+  if (select && !getVectorShape(*select->getCondition()).isUniform()) ++numBlends;
+
   if (!vecInst->getType()->isVoidTy())
     vecInst->mutateType(getVectorType(inst->getType(), vectorWidth()));
 
   mapOperandsInto(inst, vecInst, true);
 
+  // a scalar condition selects whole short vectors: repeat the lane mask for each element
+  if (select && !select->getCondition()->getType()->isVectorTy() && select->getType()->isVectorTy()) {
+    unsigned numElems = cast<FixedVectorType>(select->getType())->getNumElements();
+    SmallVector<int, 32> repeatMask;
+    for (unsigned j = 0; j < numElems; ++j) {
+      for (int i = 0; i < vectorWidth(); ++i) repeatMask.push_back(i);
+    }
+    vecInst->setOperand(0, builder.CreateShuffleVector(vecInst->getOperand(0), repeatMask, "cond_widened"));
+  }
+
   if (vecInst->getType()->isVoidTy() || !inst->hasName())
     builder.Insert(vecInst);
   else
@@ -1058,6 +2180,14 @@ NatBuilder::vectorizeExtractCall(CallInst *rvCall) {
     return;
   }
 
+// only the extracted lane was computed
+  auto * vecArgInst = dyn_cast<Instruction>(vecArg);
+  auto itSingleLane = vecArgInst ? singleLaneInsts.find(vecArgInst) : singleLaneInsts.end();
+  if (itSingleLane != singleLaneInsts.end()) {
+    mapScalarValue(rvCall, requestScalarValue(vecArg, itSingleLane->second));
+    return;
+  }
+
 // non-uniform arg
   auto * vecVal = requestVectorValue(vecArg);
   assert(getVectorShape(*rvCall->getArgOperand(1)).isUniform());
@@ -1172,8 +2302,18 @@ NatBuilder::vectorizeShuffleCall(CallInst *rvCall) {
   auto * vecVal = requestVectorValue(vecArg);
   auto * amountVal = rvCall->getArgOperand(1);
   if (!isa<ConstantInt>(amountVal)) {
-    Error() << *rvCall << "\n";
-    fail("rv_shuffle: shift amount needs to be a constant!\n");
+    // lane i reads lane (i + S) mod W, S uniform or per lane (runtime butterflies, neighbor exchange)
+    auto * amountTy = amountVal->getType();
+    auto * amountVec = getVectorShape(*amountVal).isUniform()
+                     ? builder.CreateVectorSplat(vectorWidth(), requestScalarValue(amountVal), "rv_shfl.amount")
+                     : requestVectorValue(amountVal);
+    auto * widthVec = ConstantInt::get(amountVec->getType(), vectorWidth());
+    auto * shiftVec = builder.CreateSRem(amountVec, widthVec, "rv_shfl.amount");
+    shiftVec = builder.CreateAdd(shiftVec, widthVec); // non-negative
+    auto * laneIds = builder.CreateAdd(getLaneIndexVector(*amountTy), shiftVec);
+    laneIds = builder.CreateURem(laneIds, widthVec, "rv_shfl.idx");
+    mapVectorValue(rvCall, createLanePermute(*vecVal, *laneIds));
+    return;
   }
 
   int64_t shiftVal = cast<ConstantInt>(amountVal)->getSExtValue();
@@ -1201,6 +2341,10 @@ NatBuilder::createVectorMaskSummary(Type & indexTy, Value * vecVal, IRBuilder<>
   Value * result = nullptr;
   switch (mode) {
     case RVIntrinsic::Ballot: {
+      if (useMaskBits(vecWidth) && indexTy.getScalarSizeInBits() >= vecWidth) {
+        return builder.CreateZExt(requestMaskBits(*vecVal), &indexTy, "rv_ballot");
+      }
+
       // If SSE is available, but AVX and above are not, and the vector width is greater than 4, split the vector
       bool shouldSplitForISA = vecWidth > 4 && config.useSSE && !config.useAVX && !config.useAVX2 && !config.useAVX512;
       if (vecWidth > 8 || shouldSplitForISA) {
@@ -1226,8 +2370,8 @@ NatBuilder::createVectorMaskSummary(Type & indexTy, Value * vecVal, IRBuilder<>
 
       // AVX-specific code path
       if ((config.useSSE || config.useAVX || config.useAVX2 || config.useAVX512) && (vecWidth == 2 || vecWidth == 4 || vecWidth == 8)) {
-      // non-uniform arg
-        uint32_t bits = indexTy.getScalarSizeInBits();
+      // non-uniform arg (movmsk takes 32 bit lanes, 64 bit lanes for two)
+        uint32_t bits = 32;
         Intrinsic::ID id;
         switch (vecWidth) {
         case 2: id = Intrinsic::x86_sse2_movmsk_pd; bits = 64; break;
@@ -1241,6 +2385,7 @@ NatBuilder::createVectorMaskSummary(Type & indexTy, Value * vecVal, IRBuilder<>
 
         auto movMaskDecl = Intrinsic::getDeclaration(mod, id);
         result = builder.CreateCall(movMaskDecl, simdVal, "rv_ballot");
+        result = builder.CreateZExtOrTrunc(result, &indexTy);
 
       } else {
         // generic emulating code path
@@ -1264,7 +2409,12 @@ NatBuilder::createVectorMaskSummary(Type & indexTy, Value * vecVal, IRBuilder<>
     } break;
 
     case RVIntrinsic::PopCount: {
-      if (config.useAVX || config.useAVX2) {
+      if (useMaskBits(vecWidth) && indexTy.getScalarSizeInBits() >= vecWidth) {
+        auto *maskZExt = builder.CreateZExt(requestMaskBits(*vecVal), &indexTy);
+        auto *ctPopFunc = Intrinsic::getDeclaration(mod, Intrinsic::ctpop, &indexTy);
+        result = builder.CreateCall(ctPopFunc, {maskZExt}, "rv_popcount");
+
+      } else if (config.useAVX || config.useAVX2) {
         // ISPC popcount pattern
         auto maskIntTy = builder.getIntNTy(vectorWidth());
         auto maskBitCast = builder.CreateBitCast(vecVal, maskIntTy);
@@ -1311,16 +2461,16 @@ NatBuilder::vectorizeIndexCall(CallInst & rvCall) {
 
 // uniform arg
   if (argUniform) {
-    mapScalarValue(&rvCall, createContiguousVector(vecWidth, intLaneTy, 0, 1));
+    mapScalarValue(&rvCall, getLaneIndexVector(*intLaneTy));
     return;
   }
 
-// avx512vl - expand based implementation
-  if (config.useAVX512 && (vecWidth == 4 || vecWidth == 8)) {
+// avx512vl - expand based implementation (256-bit vexpandpd is AVX512VL)
+  if (config.useAVX512 && (vecWidth == 8 || (vecWidth == 4 && config.useAVX512VL))) {
     Intrinsic::ID id = Intrinsic::x86_avx512_mask_expand;
 
     auto * maskVec = maskInactiveLanes(requestVectorValue(condArg), rvCall.getParent(), false);
-    auto * contVec = createContiguousVector(vecWidth, intLaneTy, 0, 1);
+    auto * contVec = getLaneIndexVector(*intLaneTy);
 
 
     auto * fpLaneTy = Type::getDoubleTy(rvCall.getContext());
@@ -1403,15 +2553,162 @@ NatBuilder::vectorizeAlignCall(CallInst *rvCall) {
     mapVectorValue(rvCall, requestVectorValue(vecArg));
   else
     mapScalarValue(rvCall, requestScalarValue(vecArg));
+
+  if (!config.checkShapeHints) return;
+  auto * alignConst = dyn_cast<ConstantInt>(rvCall->getArgOperand(1));
+  if (!alignConst || !vecArg->getType()->isPointerTy()) return;
+  uint64_t alignment = alignConst->getZExtValue();
+  if (alignment <= 1 || !isPowerOf2_64(alignment)) return;
+
+  // varying pointers are aligned in every lane, uniform and contiguous ones in their base (the first lane)
+  auto * mappedPtr = getVectorShape(*vecArg).isVarying() ? requestVectorValue(vecArg) : requestScalarValue(vecArg);
+  auto * intTy = layout.getIntPtrType(mappedPtr->getType());
+  auto * lowBits = builder.CreateAnd(builder.CreatePtrToInt(mappedPtr, intTy), ConstantInt::get(intTy, alignment - 1));
+  auto * mismatch = builder.CreateICmpNE(lowBits, Constant::getNullValue(intTy), "rv_align_mismatch");
+  addShapeCheck(*mismatch, *rvCall->getParent(), *rvCall, "align");
 }
 
 void
-NatBuilder::vectorizeLaneIDCall(CallInst *rvCall) {
+NatBuilder::vectorizeShapeHintCall(CallInst *rvCall) {
   ++numRVIntrinsics;
 
-  assert(rvCall->arg_size() == 0 && "expected 0 arguments for rv_lane_id()");
-  Value *contVec = createContiguousVector(vectorWidth(), rvCall->getType(), 0, 1);
-  mapVectorValue(rvCall, contVec);
+  Value *hintedArg = rvCall->getArgOperand(0);
+  auto hintShape = getVectorShape(*rvCall);
+  if (hintShape.isVarying() || !getVectorShape(*hintedArg).isVarying()) {
+    // the hint adds nothing (non-constant stride) or VA knew better
+    if (getVectorShape(*hintedArg).isVarying()) mapVectorValue(rvCall, requestVectorValue(hintedArg));
+    else mapScalarValue(rvCall, requestScalarValue(hintedArg));
+    return;
+  }
+
+  // inactive lanes may hold anything, start from the first active lane
+  auto * vecArg = requestVectorValue(hintedArg);
+  auto * predicate = vecInfo.getPredicate(*rvCall->getParent());
+  auto * constPred = predicate ? dyn_cast<ConstantInt>(predicate) : nullptr;
+  bool allActive = !predicate || (constPred && constPred->isOne());
+
+  Value * firstLane = builder.getInt32(0);
+  if (!allActive) {
+    auto * activeBits = createVectorMaskSummary(*i32Ty, requestVectorValue(predicate), builder, RVIntrinsic::Ballot);
+    auto * leadingLane = builder.CreateBinaryIntrinsic(Intrinsic::cttz, activeBits, builder.getFalse());
+    // all-false blocks: any lane will do
+    firstLane = builder.CreateAnd(leadingLane, builder.getInt32(vectorWidth() - 1), "rv_first_lane");
+  }
+  Value * baseVal = builder.CreateExtractElement(vecArg, firstLane, "rv_hint");
+  int64_t stride = hintShape.getStride();
+  if (stride != 0 && !allActive) {
+    // step back to lane 0
+    auto * laneOffset = builder.CreateMul(builder.CreateSExt(firstLane, builder.getInt64Ty()), builder.getInt64(-stride));
+    if (baseVal->getType()->isPointerTy()) {
+      baseVal = builder.CreateGEP(builder.getInt8Ty(), baseVal, laneOffset, "rv_hint_base");
+    } else if (baseVal->getType()->isIntegerTy()) {
+      baseVal = builder.CreateAdd(baseVal, builder.CreateSExtOrTrunc(laneOffset, baseVal->getType()), "rv_hint_base");
+    } else {
+      baseVal = builder.CreateFAdd(baseVal, builder.CreateSIToFP(laneOffset, baseVal->getType()), "rv_hint_base");
+    }
+  }
+  mapScalarValue(rvCall, baseVal);
+
+  if (!config.checkShapeHints) return;
+
+  // compare the lanes bit-wise with the hinted vector
+  auto * hintedVec = &widenScalar(*baseVal, hintShape);
+  Value * actualVec = vecArg;
+  auto * vecTy = cast<FixedVectorType>(vecArg->getType());
+  auto * bitsTy = FixedVectorType::get(builder.getIntNTy(layout.getTypeSizeInBits(vecTy->getElementType())), vectorWidth());
+  if (vecTy->getElementType()->isPointerTy()) {
+    actualVec = builder.CreatePtrToInt(actualVec, bitsTy);
+    hintedVec = builder.CreatePtrToInt(hintedVec, bitsTy);
+  } else if (!vecTy->getElementType()->isIntegerTy()) {
+    actualVec = builder.CreateBitCast(actualVec, bitsTy);
+    hintedVec = builder.CreateBitCast(hintedVec, bitsTy);
+  }
+  auto * mismatch = builder.CreateICmpNE(actualVec, hintedVec, "rv_hint_mismatch");
+  addShapeCheck(*mismatch, *rvCall->getParent(), *rvCall, hintShape.isUniform() ? "uniform" : "strided");
+}
+
+void
+NatBuilder::addShapeCheck(Value & mismatch, const BasicBlock & scaBlock, const Value & hinted, const char * kind) {
+  Value * laneBits = nullptr;
+  Value * violated = &mismatch;
+  if (mismatch.getType()->isVectorTy()) {
+    laneBits = maskInactiveLanes(&mismatch, &scaBlock, false);
+    violated = createPTest(laneBits, false);
+  }
+  // folded: the shape holds by construction
+  auto * violatedInst = dyn_cast<Instruction>(violated);
+  if (!violatedInst) return;
+
+  std::string site;
+  raw_string_ostream siteOut(site);
+  siteOut << vecInfo.getMapping().scalarFn->getName() << ": ";
+  hinted.printAsOperand(siteOut, false);
+  auto * hintedInst = dyn_cast<Instruction>(&hinted);
+  if (hintedInst && hintedInst->getDebugLoc()) {
+    siteOut << " at ";
+    hintedInst->getDebugLoc().print(siteOut);
+  }
+  shapeHintChecks.push_back({violatedInst, laneBits, siteOut.str(), kind});
+}
+
+void
+NatBuilder::addArgumentShapeChecks() {
+  // the arguments are live at the entry of the vector function
+  IRBuilder<>::InsertPointGuard guard(builder);
+  auto & vecEntry = vecInfo.getVectorFunction().getEntryBlock();
+  builder.SetInsertPoint(&vecEntry, vecEntry.getFirstInsertionPt());
+
+  const auto & mapping = vecInfo.getMapping();
+  unsigned shapeIdx = 0;
+  for (const auto & sarg : mapping.scalarFn->args()) {
+    VectorShape argShape = mapping.argShapes[shapeIdx++];
+    if (argShape.isVarying() || !sarg.getType()->isPointerTy() || argShape.getAlignmentFirst() <= 1) continue;
+    auto * vecArg = requestScalarValue(const_cast<Argument *>(&sarg));
+    auto * intTy = layout.getIntPtrType(vecArg->getType());
+    auto * lowBits = builder.CreateAnd(builder.CreatePtrToInt(vecArg, intTy), argShape.getAlignmentFirst() - 1);
+    auto * mismatch = builder.CreateICmpNE(lowBits, ConstantInt::get(intTy, 0), sarg.getName() + ".align_mismatch");
+    addShapeCheck(*mismatch, vecInfo.getEntry(), sarg, "align");
+  }
+}
+
+void
+NatBuilder::createShapeHintTraps() {
+  auto & vecFunc = vecInfo.getVectorFunction();
+  auto & context = vecFunc.getContext();
+  FunctionCallee hookFunc;
+  if (!config.shapeCheckHook.empty()) {
+    auto * charPtrTy = Type::getInt8PtrTy(context);
+    hookFunc = vecFunc.getParent()->getOrInsertFunction(config.shapeCheckHook, Type::getVoidTy(context), charPtrTy, charPtrTy, Type::getInt64Ty(context));
+  }
+  auto & trapFunc = *Intrinsic::getDeclaration(vecFunc.getParent(), Intrinsic::trap);
+  auto * coldWeights = MDBuilder(context).createBranchWeights(1, 1 << 20);
+
+  for (const auto & check : shapeHintChecks) {
+    auto * failTerm = SplitBlockAndInsertIfThen(check.violated, check.violated->getNextNode(), !hookFunc, coldWeights);
+    if (!hookFunc) {
+      CallInst::Create(&trapFunc, {}, "", failTerm);
+      continue;
+    }
+    // report and go on with the lanes as they are
+    IRBuilder<> failBuilder(failTerm);
+    Value * lanes = failBuilder.getInt64(0);
+    if (check.laneBits) {
+      auto * ballot = createVectorMaskSummary(*failBuilder.getIntNTy(vectorWidth()), check.laneBits, failBuilder, RVIntrinsic::Ballot);
+      lanes = failBuilder.CreateZExtOrTrunc(ballot, failBuilder.getInt64Ty());
+    }
+    failBuilder.CreateCall(hookFunc, {failBuilder.CreateGlobalStringPtr(check.site), failBuilder.CreateGlobalStringPtr(check.kind), lanes});
+  }
+  Report() << "nat: checking " << shapeHintChecks.size() << " shapes at runtime (RV_CHECK_SHAPES"
+           << (hookFunc ? ", reporting to " + config.shapeCheckHook : std::string()) << ")\n";
+}
+
+void
+NatBuilder::vectorizeLaneIDCall(CallInst *rvCall) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 0 && "expected 0 arguments for rv_lane_id()");
+  Value *contVec = getLaneIndexVector(*rvCall->getType());
+  mapVectorValue(rvCall, contVec);
 }
 
 void
@@ -1422,6 +2719,472 @@ NatBuilder::vectorizeNumLanesCall(CallInst *rvCall) {
   mapScalarValue(rvCall, ConstantInt::get(rvCall->getType(), vectorWidth(), false));
 }
 
+void
+NatBuilder::vectorizePhiloxCall(CallInst *rvCall) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 3 && "expected 3 arguments for rv_philox(seed, stream, counter)");
+
+  // every lane runs the rounds on its own counter
+  if (getVectorShape(*rvCall).isUniform()) {
+    mapScalarValue(rvCall, CreatePhilox4x32(builder, requestScalarValue(rvCall->getArgOperand(0)),
+                                            requestScalarValue(rvCall->getArgOperand(1)),
+                                            requestScalarValue(rvCall->getArgOperand(2))));
+  } else {
+    mapVectorValue(rvCall, CreatePhilox4x32(builder, requestVectorValue(rvCall->getArgOperand(0)),
+                                            requestVectorValue(rvCall->getArgOperand(1)),
+                                            requestVectorValue(rvCall->getArgOperand(2))));
+  }
+}
+
+// reduction operator of the rv_reduce_*/rv_scan_* intrinsic @id on values of type @elemTy
+static RedKind
+GetCrossLaneRedKind(RVIntrinsic id, const Type & elemTy) {
+  bool isFloat = elemTy.isFloatingPointTy();
+  switch (id) {
+    case RVIntrinsic::ReduceAdd:
+    case RVIntrinsic::ScanAdd: return RedKind::Add;
+    case RVIntrinsic::ReduceMul:
+    case RVIntrinsic::ScanMul: return RedKind::Mul;
+    case RVIntrinsic::ReduceMin:
+    case RVIntrinsic::ScanMin: return isFloat ? RedKind::FMin : RedKind::SMin;
+    case RVIntrinsic::ReduceMax:
+    case RVIntrinsic::ScanMax: return isFloat ? RedKind::FMax : RedKind::SMax;
+    case RVIntrinsic::ReduceAnd:
+    case RVIntrinsic::ScanAnd: return RedKind::And;
+    case RVIntrinsic::ReduceOr:
+    case RVIntrinsic::ScanOr: return RedKind::Or;
+    default: return RedKind::Top;
+  }
+}
+
+void
+NatBuilder::vectorizeCrossLaneReduceCall(CallInst *rvCall, bool isScan) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 1 && "expected 1 argument for rv_reduce_*(vec)/rv_scan_*(vec)");
+
+  Value *vecArg = rvCall->getArgOperand(0);
+  auto & elemTy = *vecArg->getType();
+  RedKind redKind = GetCrossLaneRedKind(GetIntrinsicID(*rvCall), elemTy);
+  if (redKind == RedKind::Top || (elemTy.isFloatingPointTy() && (redKind == RedKind::And || redKind == RedKind::Or))) {
+    Error() << *rvCall << "\n";
+    fail("rv_reduce/rv_scan: unsupported operand type!\n");
+  }
+
+  // inactive lanes contribute the neutral element
+  auto * vecVal = requestVectorValue(vecArg);
+  const auto & block = *rvCall->getParent();
+  if (!hasUniformPredicate(block)) {
+    auto * neutralVec = builder.CreateVectorSplat(vectorWidth(), &GetNeutralElement(redKind, elemTy));
+    vecVal = builder.CreateSelect(requestVectorPredicate(block), vecVal, neutralVec, "rv_red.active");
+  }
+
+  // the lanes are unordered, floating-point operations may be re-associated
+  IRBuilder<>::FastMathFlagGuard fmfGuard(builder);
+  FastMathFlags redFMF = builder.getFastMathFlags();
+  redFMF.setAllowReassoc();
+  builder.setFastMathFlags(redFMF);
+
+  if (isScan) {
+    mapVectorValue(rvCall, &CreateVectorScan(builder, redKind, *vecVal, true));
+  } else {
+    mapScalarValue(rvCall, &CreateVectorReduce(config, builder, redKind, *vecVal, nullptr));
+  }
+}
+
+void
+NatBuilder::vectorizeShuffleXorCall(CallInst *rvCall) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 2 && "expected 2 arguments for rv_shuffle_xor(vec, laneMask)");
+
+  Value *vecArg = rvCall->getArgOperand(0);
+
+// uniform arg
+  if (getVectorShape(*vecArg).isUniform()) {
+    mapScalarValue(rvCall, requestScalarValue(vecArg));
+    return;
+  }
+
+// non-uniform arg
+  auto * maskArg = rvCall->getArgOperand(1);
+  if (!getVectorShape(*maskArg).isUniform() || !isPowerOf2_32(vectorWidth())) {
+    Error() << *rvCall << "\n";
+    fail("rv_shuffle_xor: lane mask needs to be uniform (and the vector width a power of two)!\n");
+  }
+
+  auto * vecVal = requestVectorValue(vecArg);
+  const int width = vectorWidth();
+  auto createButterfly = [&](Value * val, int laneXor) {
+    SmallVector<int, 32> shflIds(width);
+    for (int i = 0; i < width; i++) {
+      shflIds[i] = i ^ laneXor;
+    }
+    return builder.CreateShuffleVector(val, val, shflIds, "rv_shfl_xor");
+  };
+
+  if (auto * constMask = dyn_cast<ConstantInt>(maskArg)) {
+    mapVectorValue(rvCall, createButterfly(vecVal, constMask->getZExtValue() & (width - 1)));
+    return;
+  }
+
+  // one conditional butterfly stage per bit of the lane mask
+  auto * laneMask = requestScalarValue(maskArg);
+  Value * accu = vecVal;
+  for (int bit = 1; bit < width; bit *= 2) {
+    auto * maskBit = builder.CreateAnd(laneMask, ConstantInt::get(laneMask->getType(), bit));
+    auto * hasBit = builder.CreateICmpNE(maskBit, ConstantInt::getNullValue(laneMask->getType()), "rv_shfl_xor.bit");
+    accu = builder.CreateSelect(hasBit, createButterfly(accu, bit), accu);
+  }
+  mapVectorValue(rvCall, accu);
+}
+
+void
+NatBuilder::vectorizeBroadcastCall(CallInst *rvCall) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 2 && "expected 2 arguments for rv_broadcast(vec, laneId)");
+
+  Value *vecArg = rvCall->getArgOperand(0);
+  Value *laneArg = rvCall->getArgOperand(1);
+
+// uniform arg
+  if (getVectorShape(*vecArg).isUniform()) {
+    mapScalarValue(rvCall, requestScalarValue(vecArg));
+    return;
+  }
+
+// all lanes read the same lane
+  auto * vecVal = requestVectorValue(vecArg);
+  if (getVectorShape(*laneArg).isUniform()) {
+    auto * laneId = requestScalarValue(laneArg);
+    laneId = builder.CreateURem(laneId, ConstantInt::get(laneId->getType(), vectorWidth()));
+    mapScalarValue(rvCall, builder.CreateExtractElement(vecVal, laneId, "rv_bcast"));
+    return;
+  }
+
+// lane permutation
+  auto * laneIds = requestVectorValue(laneArg);
+  if (auto * constLaneIds = dyn_cast<Constant>(laneIds)) {
+    SmallVector<int, 32> shflIds;
+    for (int i = 0; i < vectorWidth(); ++i) {
+      auto * laneId = dyn_cast_or_null<ConstantInt>(constLaneIds->getAggregateElement(i));
+      if (!laneId) break;
+      shflIds.push_back(laneId->getZExtValue() % vectorWidth());
+    }
+    if ((int) shflIds.size() == vectorWidth()) {
+      mapVectorValue(rvCall, builder.CreateShuffleVector(vecVal, vecVal, shflIds, "rv_bcast"));
+      return;
+    }
+  }
+  mapVectorValue(rvCall, createLanePermute(*vecVal, *laneIds));
+}
+
+bool
+NatBuilder::hasRegisterPermute(const FixedVectorType & vecTy) const {
+  auto * elemTy = vecTy.getElementType();
+  if (!elemTy->isFloatingPointTy() && !elemTy->isIntegerTy()) return false;
+  const unsigned width = vecTy.getNumElements();
+  const unsigned elemBits = elemTy->getPrimitiveSizeInBits().getFixedSize();
+  const unsigned vecBits = width * elemBits;
+  return (config.useAVX2 && vecBits == 256 && elemBits == 32) ||
+         (config.useAVX512 && vecBits == 512 && (elemBits == 32 || elemBits == 64)) ||
+         (config.useADVSIMD && (vecBits == 128 || vecBits == 256) && elemBits % 8 == 0 && isPowerOf2_32(width));
+}
+
+Value*
+NatBuilder::createRegisterPermute(Value & vecVal, Value & laneIds) {
+  auto * vecTy = cast<FixedVectorType>(vecVal.getType());
+  if (!hasRegisterPermute(*vecTy)) return nullptr;
+  auto * elemTy = vecTy->getElementType();
+  const unsigned width = vecTy->getNumElements();
+  const unsigned elemBits = elemTy->getPrimitiveSizeInBits().getFixedSize();
+  const unsigned vecBits = width * elemBits;
+
+  // variable permutes (vpermd/vpermps, vpermq/vpermpd)
+  Intrinsic::ID permID = Intrinsic::not_intrinsic;
+  if (config.useAVX2 && vecBits == 256 && elemBits == 32) {
+    permID = elemTy->isFloatTy() ? Intrinsic::x86_avx2_permps : Intrinsic::x86_avx2_permd;
+  } else if (config.useAVX512 && vecBits == 512 && elemBits == 32) {
+    permID = elemTy->isFloatTy() ? Intrinsic::x86_avx512_permvar_sf_512 : Intrinsic::x86_avx512_permvar_si_512;
+  } else if (config.useAVX512 && vecBits == 512 && elemBits == 64) {
+    permID = elemTy->isDoubleTy() ? Intrinsic::x86_avx512_permvar_df_512 : Intrinsic::x86_avx512_permvar_di_512;
+  }
+  Module * mod = vecInfo.getMapping().vectorFn->getParent();
+  if (permID != Intrinsic::not_intrinsic) {
+    auto * idxTy = FixedVectorType::get(builder.getIntNTy(elemBits), width);
+    auto * idxVec = builder.CreateIntCast(&laneIds, idxTy, false, "rv_perm.idx");
+    return builder.CreateCall(Intrinsic::getDeclaration(mod, permID), {&vecVal, idxVec}, "rv_perm");
+  }
+
+  // otw, byte table lookup (tbl, tbl2 for two registers)
+  const unsigned elemBytes = elemBits / 8;
+  const unsigned numBytes = vecBits / 8;
+  auto * i8Ty = builder.getInt8Ty();
+  auto * byteTy = FixedVectorType::get(i8Ty, 16);
+
+  // byte j of lane i reads byte (laneIds[i] mod W) * elemBytes + j
+  auto * laneByteTy = FixedVectorType::get(i8Ty, width);
+  auto * laneBytes = builder.CreateIntCast(&laneIds, laneByteTy, false, "rv_tbl.idx");
+  laneBytes = builder.CreateAnd(laneBytes, ConstantInt::get(laneByteTy, width - 1));
+  laneBytes = builder.CreateMul(laneBytes, ConstantInt::get(laneByteTy, elemBytes));
+  SmallVector<int, 32> byteLanes;
+  SmallVector<Constant*, 32> byteOffsets;
+  for (unsigned i = 0; i < numBytes; ++i) {
+    byteLanes.push_back(i / elemBytes);
+    byteOffsets.push_back(ConstantInt::get(i8Ty, i % elemBytes));
+  }
+  auto * byteIds = builder.CreateShuffleVector(laneBytes, laneBytes, byteLanes);
+  byteIds = builder.CreateAdd(byteIds, ConstantVector::get(byteOffsets), "rv_tbl.idx");
+
+  auto * tableBytes = builder.CreateBitCast(&vecVal, FixedVectorType::get(i8Ty, numBytes));
+  if (numBytes == 16) {
+    auto * tblVal = builder.CreateCall(Intrinsic::getDeclaration(mod, Intrinsic::aarch64_neon_tbl1, {byteTy}),
+                                       {tableBytes, byteIds}, "rv_tbl");
+    return builder.CreateBitCast(tblVal, vecTy, "rv_perm");
+  }
+
+  SmallVector<int, 16> loBytes, hiBytes;
+  for (unsigned i = 0; i < 16; ++i) {
+    loBytes.push_back(i);
+    hiBytes.push_back(16 + i);
+  }
+  auto * tableLo = builder.CreateShuffleVector(tableBytes, tableBytes, loBytes);
+  auto * tableHi = builder.CreateShuffleVector(tableBytes, tableBytes, hiBytes);
+  auto & tbl2Func = *Intrinsic::getDeclaration(mod, Intrinsic::aarch64_neon_tbl2, {byteTy});
+  auto * resLo = builder.CreateCall(&tbl2Func, {tableLo, tableHi, builder.CreateShuffleVector(byteIds, byteIds, loBytes)}, "rv_tbl");
+  auto * resHi = builder.CreateCall(&tbl2Func, {tableLo, tableHi, builder.CreateShuffleVector(byteIds, byteIds, hiBytes)}, "rv_tbl");
+  SmallVector<int, 32> allBytes;
+  for (unsigned i = 0; i < 32; ++i) allBytes.push_back(i);
+  return builder.CreateBitCast(builder.CreateShuffleVector(resLo, resHi, allBytes), vecTy, "rv_perm");
+}
+
+Value*
+NatBuilder::createLanePermute(Value & vecVal, Value & laneIds) {
+  auto * vecTy = cast<FixedVectorType>(vecVal.getType());
+  auto * elemTy = vecTy->getElementType();
+  const unsigned width = vecTy->getNumElements();
+  const unsigned elemBits = elemTy->isPointerTy() ? 0 : elemTy->getPrimitiveSizeInBits().getFixedSize();
+  const unsigned halfBits = width * elemBits / 2;
+  const bool isNumeric = elemTy->isFloatingPointTy() || elemTy->isIntegerTy();
+
+  // single register (vpermd/vpermps/vpermq/vpermpd, tbl)
+  if (hasRegisterPermute(*vecTy)) return createRegisterPermute(vecVal, laneIds);
+
+  // two registers: vpermt2d/vpermt2ps/vpermt2q/vpermt2pd (vpermi2var)
+  const unsigned half = width / 2;
+  Intrinsic::ID perm2ID = Intrinsic::not_intrinsic;
+  if (config.useAVX512 && elemBits == 32) {
+    bool isFloat = elemTy->isFloatTy();
+    if (halfBits == 512) perm2ID = isFloat ? Intrinsic::x86_avx512_vpermi2var_ps_512 : Intrinsic::x86_avx512_vpermi2var_d_512;
+    if (halfBits == 256) perm2ID = isFloat ? Intrinsic::x86_avx512_vpermi2var_ps_256 : Intrinsic::x86_avx512_vpermi2var_d_256;
+    if (halfBits == 128) perm2ID = isFloat ? Intrinsic::x86_avx512_vpermi2var_ps_128 : Intrinsic::x86_avx512_vpermi2var_d_128;
+  } else if (config.useAVX512 && elemBits == 64) {
+    bool isDouble = elemTy->isDoubleTy();
+    if (halfBits == 512) perm2ID = isDouble ? Intrinsic::x86_avx512_vpermi2var_pd_512 : Intrinsic::x86_avx512_vpermi2var_q_512;
+    if (halfBits == 256) perm2ID = isDouble ? Intrinsic::x86_avx512_vpermi2var_pd_256 : Intrinsic::x86_avx512_vpermi2var_q_256;
+    if (halfBits == 128) perm2ID = isDouble ? Intrinsic::x86_avx512_vpermi2var_pd_128 : Intrinsic::x86_avx512_vpermi2var_q_128;
+  }
+  bool hasHalfPermute = isNumeric && half > 0 && hasRegisterPermute(*FixedVectorType::get(elemTy, half));
+
+  // the halves of the result select from the concatenated table by the low index bits
+  if (isNumeric && width >= 4 && isPowerOf2_32(width) && (perm2ID != Intrinsic::not_intrinsic || hasHalfPermute)) {
+    SmallVector<int, 32> loLanes, hiLanes;
+    for (unsigned i = 0; i < half; ++i) {
+      loLanes.push_back(i);
+      hiLanes.push_back(half + i);
+    }
+    auto * tableLo = builder.CreateShuffleVector(&vecVal, &vecVal, loLanes, "rv_perm.lo");
+    auto * tableHi = builder.CreateShuffleVector(&vecVal, &vecVal, hiLanes, "rv_perm.hi");
+    auto * idxTy = FixedVectorType::get(builder.getIntNTy(elemBits), width);
+    auto * idxVec = builder.CreateIntCast(&laneIds, idxTy, false, "rv_perm.idx");
+    auto * idxLo = builder.CreateShuffleVector(idxVec, idxVec, loLanes);
+    auto * idxHi = builder.CreateShuffleVector(idxVec, idxVec, hiLanes);
+
+    Value * permLo = nullptr;
+    Value * permHi = nullptr;
+    if (perm2ID != Intrinsic::not_intrinsic) {
+      auto & perm2Func = *Intrinsic::getDeclaration(vecInfo.getMapping().vectorFn->getParent(), perm2ID);
+      permLo = builder.CreateCall(&perm2Func, {tableLo, idxLo, tableHi}, "rv_perm2");
+      permHi = builder.CreateCall(&perm2Func, {tableLo, idxHi, tableHi}, "rv_perm2");
+    } else {
+      // permute both halves and blend by the table bit of the index (vpermd + vpermd + vblendvps)
+      auto permuteHalf = [&](Value * idxHalf) {
+        auto * fromLo = createRegisterPermute(*tableLo, *idxHalf);
+        auto * fromHi = createRegisterPermute(*tableHi, *idxHalf);
+        auto * halfBit = builder.CreateAnd(idxHalf, ConstantInt::get(idxHalf->getType(), half));
+        auto * readsHi = builder.CreateICmpNE(halfBit, Constant::getNullValue(idxHalf->getType()));
+        return builder.CreateSelect(readsHi, fromHi, fromLo, "rv_perm2");
+      };
+      permLo = permuteHalf(idxLo);
+      permHi = permuteHalf(idxHi);
+    }
+
+    SmallVector<int, 32> allLanes;
+    for (unsigned i = 0; i < width; ++i) allLanes.push_back(i);
+    return builder.CreateShuffleVector(permLo, permHi, allLanes, "rv_perm");
+  }
+
+  // otw, one extract per lane
+  Value * permVal = UndefValue::get(vecTy);
+  for (unsigned i = 0; i < width; ++i) {
+    auto * laneId = builder.CreateExtractElement(&laneIds, i, "rv_perm.idx");
+    laneId = builder.CreateURem(laneId, ConstantInt::get(laneId->getType(), width));
+    permVal = builder.CreateInsertElement(permVal, builder.CreateExtractElement(&vecVal, laneId), i, "rv_perm");
+  }
+  return permVal;
+}
+
+Value*
+NatBuilder::createLaneOrderLess(Value & lhsKey, Value & lhsLane, Value * lhsActive,
+                                Value & rhsKey, Value & rhsLane, Value * rhsActive) {
+  // keys first (signed for integers), then the original lane
+  bool isFloat = lhsKey.getType()->isFPOrFPVectorTy();
+  auto * keyLess = isFloat ? builder.CreateFCmpOLT(&lhsKey, &rhsKey) : builder.CreateICmpSLT(&lhsKey, &rhsKey);
+  auto * keyEqual = isFloat ? builder.CreateFCmpOEQ(&lhsKey, &rhsKey) : builder.CreateICmpEQ(&lhsKey, &rhsKey);
+  auto * laneLess = builder.CreateICmpULT(&lhsLane, &rhsLane);
+  auto * less = builder.CreateOr(keyLess, builder.CreateAnd(keyEqual, laneLess), "rv_sort.less");
+  if (!lhsActive) return less;
+
+  // active before inactive lanes, inactive lanes in lane order
+  auto * activeLess = builder.CreateSelect(rhsActive, less, builder.getTrue());
+  auto * inactiveLess = builder.CreateSelect(rhsActive, builder.getFalse(), laneLess);
+  return builder.CreateSelect(lhsActive, activeLess, inactiveLess, "rv_sort.less");
+}
+
+void
+NatBuilder::vectorizeSortCall(CallInst *rvCall) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 2 && "expected 2 arguments for rv_sort(key, value)");
+
+  Value *keyArg = rvCall->getArgOperand(0);
+  Value *valArg = rvCall->getArgOperand(1);
+
+// uniform value
+  if (getVectorShape(*valArg).isUniform()) {
+    mapScalarValue(rvCall, requestScalarValue(valArg));
+    return;
+  }
+
+  auto * keyTy = keyArg->getType();
+  const int width = vectorWidth();
+  if (!(keyTy->isIntegerTy() || keyTy->isFloatingPointTy()) || !isPowerOf2_32(width)) {
+    Error() << *rvCall << "\n";
+    fail("rv_sort: keys need to be integer or floating point (and the vector width a power of two)!\n");
+  }
+
+  // bitonic sort network on (key, lane, active) with the value as payload, log2(W) * (log2(W) + 1) / 2 stages
+  const auto & block = *rvCall->getParent();
+  Value * keyVec = requestVectorValue(keyArg);
+  Value * valVec = requestVectorValue(valArg);
+  Value * laneVec = getLaneIndexVector(*i32Ty);
+  Value * activeVec = hasUniformPredicate(block) ? nullptr : requestVectorPredicate(block);
+
+  for (int blockSize = 2; blockSize <= width; blockSize *= 2) {
+    for (int dist = blockSize / 2; dist > 0; dist /= 2) {
+      // lane i compares with lane i ^ dist and keeps the smaller pair if it is the lower lane in an ascending block
+      SmallVector<int, 32> shflIds(width);
+      SmallVector<Constant*, 32> keepsLarger(width);
+      for (int i = 0; i < width; ++i) {
+        shflIds[i] = i ^ dist;
+        bool isLower = !(i & dist);
+        bool isAscending = !(i & blockSize);
+        keepsLarger[i] = builder.getInt1(isLower != isAscending);
+      }
+      auto * otherKey = builder.CreateShuffleVector(keyVec, keyVec, shflIds, "rv_sort.key");
+      auto * otherLane = builder.CreateShuffleVector(laneVec, laneVec, shflIds, "rv_sort.lane");
+      auto * otherActive = activeVec ? builder.CreateShuffleVector(activeVec, activeVec, shflIds, "rv_sort.active") : nullptr;
+      auto * otherVal = builder.CreateShuffleVector(valVec, valVec, shflIds, "rv_sort.val");
+
+      // the order is strict and total, so "other is larger" is the negation of "other is smaller"
+      auto * otherLess = createLaneOrderLess(*otherKey, *otherLane, otherActive, *keyVec, *laneVec, activeVec);
+      auto * takeOther = builder.CreateXor(otherLess, ConstantVector::get(keepsLarger), "rv_sort.swap");
+
+      keyVec = builder.CreateSelect(takeOther, otherKey, keyVec);
+      laneVec = builder.CreateSelect(takeOther, otherLane, laneVec);
+      if (activeVec) activeVec = builder.CreateSelect(takeOther, otherActive, activeVec);
+      valVec = builder.CreateSelect(takeOther, otherVal, valVec, "rv_sort");
+    }
+  }
+  mapVectorValue(rvCall, valVec);
+}
+
+void
+NatBuilder::vectorizePartitionCall(CallInst *rvCall) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 2 && "expected 2 arguments for rv_partition(vec, mask)");
+
+  Value *vecArg = rvCall->getArgOperand(0);
+  Value *maskArg = rvCall->getArgOperand(1);
+
+// uniform arg
+  if (getVectorShape(*vecArg).isUniform()) {
+    mapScalarValue(rvCall, requestScalarValue(vecArg));
+    return;
+  }
+
+  // compact both sides (vpcompress on AVX-512) and rotate the second behind the first
+  const auto & block = *rvCall->getParent();
+  auto * vecVal = requestVectorValue(vecArg);
+  auto * maskVal = requestVectorValue(maskArg);
+  auto * restVal = builder.CreateNot(maskVal);
+  if (!hasUniformPredicate(block)) {
+    maskVal = maskInactiveLanes(maskVal, &block, false);
+    restVal = maskInactiveLanes(restVal, &block, false);
+  }
+  auto * frontVec = createCompactedVector(vecVal, maskVal);
+  auto * backVec = createCompactedVector(vecVal, restVal);
+
+  auto * numFront = createVectorMaskSummary(*i32Ty, maskVal, builder, RVIntrinsic::PopCount);
+  auto * laneVec = getLaneIndexVector(*i32Ty);
+  auto * numFrontVec = builder.CreateVectorSplat(vectorWidth(), numFront, "rv_partition.n");
+  auto * backLanes = builder.CreateSub(builder.CreateAdd(laneVec, ConstantInt::get(laneVec->getType(), vectorWidth())), numFrontVec);
+  auto * rotatedBack = createLanePermute(*backVec, *backLanes);
+  auto * isFront = builder.CreateICmpULT(laneVec, numFrontVec);
+  mapVectorValue(rvCall, builder.CreateSelect(isFront, frontVec, rotatedBack, "rv_partition"));
+}
+
+void
+NatBuilder::vectorizeRankCall(CallInst *rvCall) {
+  ++numRVIntrinsics;
+
+  assert(rvCall->arg_size() == 1 && "expected 1 argument for rv_rank(key)");
+
+  Value *keyArg = rvCall->getArgOperand(0);
+  auto * keyTy = keyArg->getType();
+  if (!(keyTy->isIntegerTy() || keyTy->isFloatingPointTy())) {
+    Error() << *rvCall << "\n";
+    fail("rv_rank: keys need to be integer or floating point!\n");
+  }
+
+  // count the active lanes that precede each lane, comparing with every rotation of the keys (W - 1 steps)
+  const auto & block = *rvCall->getParent();
+  const int width = vectorWidth();
+  auto * keyVec = requestVectorValue(keyArg);
+  auto * laneVec = getLaneIndexVector(*i32Ty);
+  Value * activeVec = hasUniformPredicate(block) ? nullptr : requestVectorPredicate(block);
+  auto * rankTy = FixedVectorType::get(rvCall->getType(), width);
+  Value * rankVec = Constant::getNullValue(rankTy);
+  for (int rot = 1; rot < width; ++rot) {
+    SmallVector<int, 32> shflIds(width);
+    for (int i = 0; i < width; ++i) shflIds[i] = (i + rot) % width;
+    auto * otherKey = builder.CreateShuffleVector(keyVec, keyVec, shflIds, "rv_rank.key");
+    auto * otherLane = builder.CreateShuffleVector(laneVec, laneVec, shflIds, "rv_rank.lane");
+    Value * otherLess = nullptr;
+    if (activeVec) {
+      auto * otherActive = builder.CreateShuffleVector(activeVec, activeVec, shflIds, "rv_rank.active");
+      otherLess = builder.CreateAnd(otherActive, createLaneOrderLess(*otherKey, *otherLane, nullptr, *keyVec, *laneVec, nullptr));
+    } else {
+      otherLess = createLaneOrderLess(*otherKey, *otherLane, nullptr, *keyVec, *laneVec, nullptr);
+    }
+    rankVec = builder.CreateAdd(rankVec, builder.CreateZExt(otherLess, rankTy), "rv_rank");
+  }
+  mapVectorValue(rvCall, rankVec);
+}
+
 void
 NatBuilder::vectorizeCompactCall(CallInst *rvCall) {
   ++numRVIntrinsics;
@@ -1440,21 +3203,85 @@ NatBuilder::vectorizeCompactCall(CallInst *rvCall) {
 // non-uniform arg
   auto * vecVal  = requestVectorValue(vecArg);
   auto * maskVal = requestVectorValue(maskArg);
+  mapVectorValue(rvCall, createCompactedVector(vecVal, maskVal));
+}
 
-  auto vecWidth = cast<FixedVectorType>(maskVal->getType())->getNumElements();
-  auto tableIndex = createVectorMaskSummary(*rvCall->getType(), maskVal, builder, RVIntrinsic::Ballot);
-  auto table = createCompactLookupTable(vecWidth);
-  auto intVecType = FixedVectorType::get(builder.getInt32Ty(), vecWidth);
-  auto intVecArrayType = ArrayType::get(intVecType, vecWidth * vecWidth);
-  auto gepPtr = builder.CreateInBoundsGEP(intVecArrayType, table, { builder.getInt32(0), tableIndex });
-  auto indices = builder.CreateLoad(intVecType, gepPtr, "rv_compact_indices");
-  Value * compacted = UndefValue::get(vecVal->getType());
+// permute @vecVal by the dynamic lane @indices
+static Value*
+CreateDynamicPermutation(IRBuilder<> & builder, Value * vecVal, Value * indices) {
+  auto vecWidth = cast<FixedVectorType>(vecVal->getType())->getNumElements();
+  Value * permuted = UndefValue::get(vecVal->getType());
   for (size_t i = 0; i < vecWidth; ++i) {
     auto index = builder.CreateExtractElement(indices, builder.getInt32(i), "rv_compact_index");
     auto elem = builder.CreateExtractElement(vecVal, index, "rv_compact_elem");
-    compacted = builder.CreateInsertElement(compacted, elem, builder.getInt32(i), "rv_compact");
+    permuted = builder.CreateInsertElement(permuted, elem, builder.getInt32(i), "rv_compact");
+  }
+  return permuted;
+}
+
+Value*
+NatBuilder::createCompactedVector(Value * vecVal, Value * maskVal) {
+  auto * vecTy = cast<FixedVectorType>(vecVal->getType());
+  unsigned vecWidth = vecTy->getNumElements();
+
+  // AVX-512 vcompress (32/64-bit lanes, 128 and 256 bit wide with AVX512VL)
+  auto * elemTy = vecTy->getElementType();
+  unsigned elemBits = elemTy->getScalarSizeInBits();
+  unsigned vecBits = vecWidth * elemBits;
+  bool hasNativeCompress = config.useAVX512 &&
+                           (elemTy->isIntegerTy() || elemTy->isFloatingPointTy()) &&
+                           (elemBits == 32 || elemBits == 64) &&
+                           (vecBits == 512 || (config.useAVX512VL && (vecBits == 128 || vecBits == 256)));
+  if (hasNativeCompress) {
+    auto * mod = vecInfo.getVectorFunction().getParent();
+    auto * compressDecl = Intrinsic::getDeclaration(mod, Intrinsic::x86_avx512_mask_compress, {vecTy});
+    return builder.CreateCall(compressDecl, {vecVal, UndefValue::get(vecTy), maskVal}, "rv_compact");
+  }
+
+  // permutation table lookup (2^W entries)
+  if (vecWidth <= 8) {
+    auto tableIndex = createVectorMaskSummary(*i32Ty, maskVal, builder, RVIntrinsic::Ballot);
+    auto table = createCompactLookupTable(vecWidth);
+    auto intVecType = FixedVectorType::get(builder.getInt32Ty(), vecWidth);
+    auto intVecArrayType = ArrayType::get(intVecType, 1u << vecWidth);
+    auto gepPtr = builder.CreateInBoundsGEP(intVecArrayType, table, { builder.getInt32(0), tableIndex });
+    auto indices = builder.CreateLoad(intVecType, gepPtr, "rv_compact_indices");
+    return CreateDynamicPermutation(builder, vecVal, indices);
+  }
+
+  // wider vectors: compact both halves and merge them (keeps the tables small)
+  assert(isPowerOf2_32(vecWidth) && "expected a power-of-two vector width");
+  unsigned halfWidth = vecWidth / 2;
+  SmallVector<int, 16> lowerLanes, upperLanes, allLanes;
+  for (unsigned i = 0; i < halfWidth; ++i) {
+    lowerLanes.push_back(i);
+    upperLanes.push_back(halfWidth + i);
   }
-  mapVectorValue(rvCall, compacted);
+  for (unsigned i = 0; i < vecWidth; ++i) allLanes.push_back(i);
+
+  auto * lowerMask = builder.CreateShuffleVector(maskVal, lowerLanes, "lowerMask");
+  auto * upperMask = builder.CreateShuffleVector(maskVal, upperLanes, "upperMask");
+  auto * lowerCompact = createCompactedVector(builder.CreateShuffleVector(vecVal, lowerLanes, "lowerLanes"), lowerMask);
+  auto * upperCompact = createCompactedVector(builder.CreateShuffleVector(vecVal, upperLanes, "higherLanes"), upperMask);
+  auto * joined = builder.CreateShuffleVector(lowerCompact, upperCompact, allLanes, "rv_compact_joined");
+
+  // lane i < n takes lower[i], otw upper[i - n] (n: active lanes in the lower half)
+  auto * lowerBits = builder.CreateBitCast(lowerMask, builder.getIntNTy(halfWidth));
+  auto * lowerCount = builder.CreateZExtOrTrunc(builder.CreateUnaryIntrinsic(Intrinsic::ctpop, lowerBits), i32Ty, "rv_compact_count");
+  auto * countVec = builder.CreateVectorSplat(vecWidth, lowerCount);
+  auto * laneIds = createContiguousVector(vecWidth, i32Ty, 0, 1);
+  auto * fromLower = builder.CreateICmpULT(laneIds, countVec);
+  auto * upperIds = builder.CreateAdd(laneIds, builder.CreateSub(ConstantInt::get(laneIds->getType(), halfWidth), countVec));
+  upperIds = builder.CreateAnd(upperIds, ConstantInt::get(laneIds->getType(), vecWidth - 1)); // tail lanes are unspecified
+  auto * indices = builder.CreateSelect(fromLower, laneIds, upperIds, "rv_compact_indices");
+  return CreateDynamicPermutation(builder, joined, indices);
+}
+
+Constant*
+NatBuilder::getLaneIndexVector(Type & laneTy, int stride) {
+  auto & entry = laneIndexPool[std::make_pair(&laneTy, stride)];
+  if (!entry) entry = cast<Constant>(createContiguousVector(vectorWidth(), &laneTy, 0, stride));
+  return entry;
 }
 
 Constant*
@@ -1512,10 +3339,34 @@ CopyTargetAttributes(Function & destFunc, Function & srcFunc) {
   }
 }
 
+// regions up to this many (scalar) instructions take inlined SLEEF fast paths
+static const int MaxInlinedRegionSize = 1000;
+
+bool
+NatBuilder::exceedsInlineBudget(Function &simdFunc) {
+  auto sizeAttr = simdFunc.getFnAttribute("rv-fast-path-size");
+  if (!sizeAttr.isStringAttribute()) return false;
+  int fastPathSize = 0;
+  if (sizeAttr.getValueAsString().getAsInteger(10, fastPathSize)) return false;
+
+  if (inlineBudget < 0) {
+    int regionSize = 0;
+    for (auto &block : vecInfo.getScalarFunction()) {
+      if (vecInfo.inRegion(block)) regionSize += block.size();
+    }
+    inlineBudget = std::max(0, MaxInlinedRegionSize - regionSize);
+  }
+
+  if (fastPathSize > inlineBudget) return true;
+  inlineBudget -= fastPathSize;
+  return false;
+}
+
 void
 NatBuilder::vectorizeCallInstruction(CallInst *const scalCall) {
   auto & scaBlock = *scalCall->getParent();
-  bool hasCallPredicate = !hasUniformPredicate(scaBlock);
+  // all-active call sites use the unmasked variant where there is one
+  bool hasCallPredicate = !hasUniformPredicate(scaBlock) && !undeadMasks.isAllTrue(*vecInfo.getPredicate(scaBlock), scaBlock);
 
   Value * callee = scalCall->getCalledOperand();
   StringRef calleeName = callee->getName();
@@ -1538,10 +3389,27 @@ NatBuilder::vectorizeCallInstruction(CallInst *const scalCall) {
     }
   }
 
+// integer intrinsics have no SLEEF or library variant
+  if (auto * vecIntrinsic = createIntegerIntrinsic(*scalCall)) {
+    mapVectorValue(scalCall, vecIntrinsic);
+    ++numVecCalls;
+    return;
+  }
+
+// NaN-free minnum/maxnum need no NaN-correct SLEEF expansion
+  if (config.enableNativeFPMinMax) {
+    if (auto * vecMinMax = createNativeMinMax(*scalCall)) {
+      mapVectorValue(scalCall, vecMinMax);
+      ++numVecCalls;
+      ++numNativeMinMax;
+      return;
+    }
+  }
+
 // Vectorize this function using a resolver provided vector function.
   auto & scaMask = *vecInfo.getPredicate(scaBlock);
   std::unique_ptr<FunctionResolver> funcResolver = nullptr;
-  if (calledFunction) funcResolver = platInfo.getResolver(calledFunction->getName(), *calledFunction->getFunctionType(), callArgShapes, vectorWidth(), hasCallPredicate);
+  if (calledFunction) funcResolver = platInfo.getResolver(calledFunction->getName(), *calledFunction->getFunctionType(), callArgShapes, vectorWidth(), hasCallPredicate, ReadULPErrorBound(*scalCall));
   if (funcResolver && !CheckFlag("RV_SPLIT")) {
     Function &simdFunc = funcResolver->requestVectorized();
     CopyTargetAttributes(simdFunc, vecInfo.getScalarFunction());
@@ -1565,6 +3433,10 @@ NatBuilder::vectorizeCallInstruction(CallInst *const scalCall) {
       [&](IRBuilder<> & builder) {
         auto *call = builder.CreateCall(&simdFunc, vectorArgs, callName);
         call->setCallingConv(simdFunc.getCallingConv());
+        if (exceedsInlineBudget(simdFunc)) {
+          call->setIsNoInline();
+          ++numOutlinedMathCalls;
+        }
         return call;
       });
 
@@ -1579,7 +3451,7 @@ NatBuilder::vectorizeCallInstruction(CallInst *const scalCall) {
     std::unique_ptr<FunctionResolver> funcResolver = nullptr;
     for (; calledFunction && vecWidth >= 2; vecWidth /= 2) {
       // FIXME update alignment in callArgShapes
-      funcResolver = platInfo.getResolver(calleeName, *calledFunction->getFunctionType(), callArgShapes, vecWidth, hasCallPredicate);
+      funcResolver = platInfo.getResolver(calleeName, *calledFunction->getFunctionType(), callArgShapes, vecWidth, hasCallPredicate, ReadULPErrorBound(*scalCall));
       if (funcResolver) break;
     }
     bool replicate = !funcResolver;
@@ -1627,6 +3499,12 @@ NatBuilder::vectorizeCallInstruction(CallInst *const scalCall) {
       return;
     }
 
+// dispatch varying function pointers per distinct target
+    if (vectorizeWaterfallCall(*scalCall)) {
+      ++numWaterfallCalls;
+      return;
+    }
+
 // fallback to replication
     // check if we need cascade first
     Value *predicate = vecInfo.getPredicate(*scalCall->getParent());
@@ -1646,7 +3524,9 @@ NatBuilder::vectorizeCallInstruction(CallInst *const scalCall) {
     bool packResult = IsVectorizableTy(*callType);
 
     ValVec resVec;
-    if (needCascade) {
+    if (scalarizeInLoop(*scalCall, needCascade)) {
+      // compact loop over the lanes
+    } else if (needCascade) {
       resVec = scalarizeCascaded(*scalCall->getParent(), *scalCall, packResult, replFunc);
     } else {
       resVec = scalarize(*scalCall->getParent(), *scalCall, packResult, replFunc);
@@ -1657,6 +3537,157 @@ NatBuilder::vectorizeCallInstruction(CallInst *const scalCall) {
   }
 }
 
+// known targets with a vector variant that the waterfall lowering tests for
+static const unsigned MaxWaterfallVariants = 4;
+
+bool
+NatBuilder::vectorizeWaterfallCall(CallInst & scalCall) {
+  if (!config.enableWaterfallCalls || scalCall.getCalledFunction() || scalCall.isInlineAsm()) return false;
+  Value * callee = scalCall.getCalledOperand();
+  if (!getVectorShape(*callee).isVarying()) return false;
+
+  bool producesValue = !scalCall.getType()->isVoidTy();
+  if (producesValue && !IsVectorizableTy(*scalCall.getType())) return false;
+  VectorShapeVec callArgShapes;
+  for (auto & arg : scalCall.args()) {
+    auto argShape = getVectorShape(*arg.get());
+    if (!argShape.isUniform() && !IsVectorizableTy(*arg->getType())) return false;
+    callArgShapes.push_back(argShape);
+  }
+  auto * vecTy = producesValue ? FixedVectorType::get(scalCall.getType(), vectorWidth()) : nullptr;
+
+// address-taken functions of the call type with a (predicated) vector variant
+  struct WaterfallVariant {
+    Function * target;
+    Function * simdFunc;
+    int maskPos;
+    std::vector<Value*> vectorArgs;
+  };
+  std::vector<WaterfallVariant> variants;
+  auto & vecFunc = vecInfo.getVectorFunction();
+  auto * mod = vecFunc.getParent();
+  for (auto & func : *mod) {
+    if (variants.size() >= MaxWaterfallVariants) break;
+    if (func.isIntrinsic() || !func.hasAddressTaken() || func.getFunctionType() != scalCall.getFunctionType()) continue;
+    auto resolver = platInfo.getResolver(func.getName(), *func.getFunctionType(), callArgShapes, vectorWidth(), true, ReadULPErrorBound(scalCall));
+    if (!resolver) continue;
+    auto & simdFunc = resolver->requestVectorized();
+    if (resolver->getCallSitePredicateMode() == CallPredicateMode::Unpredicated) continue;
+    if (producesValue && simdFunc.getReturnType() != vecTy) continue;
+    int maskPos = resolver->getMaskPos();
+    if (maskPos >= 0 && simdFunc.getArg(maskPos)->getType() != FixedVectorType::get(Type::getInt1Ty(func.getContext()), vectorWidth())) continue;
+    CopyTargetAttributes(simdFunc, vecInfo.getScalarFunction());
+    variants.push_back(WaterfallVariant{&func, &simdFunc, maskPos, {}});
+  }
+
+// loop invariant operands
+  auto & context = builder.getContext();
+  auto * laneBitsTy = Type::getIntNTy(context, vectorWidth());
+  auto * zeroBits = Constant::getNullValue(laneBitsTy);
+  auto * vecPtrs = requestVectorValue(callee);
+  SmallVector<Value*, 4> mappedArgs;
+  for (auto & arg : scalCall.args()) {
+    mappedArgs.push_back(getVectorShape(*arg.get()).isUniform() ? requestScalarValue(arg.get()) : requestVectorValue(arg.get()));
+  }
+  for (auto & variant : variants) {
+    requestVectorCallArgs(scalCall, *variant.simdFunc, variant.maskPos, variant.vectorArgs);
+  }
+  auto * laneBits = builder.CreateBitCast(requestVectorPredicate(*scalCall.getParent()), laneBitsTy, "wf.lanes");
+
+  auto * entryBlock = builder.GetInsertBlock();
+  auto * headBlock = BasicBlock::Create(context, "wf.head", &vecFunc);
+  auto * latchBlock = BasicBlock::Create(context, "wf.latch", &vecFunc);
+  auto * exitBlock = BasicBlock::Create(context, "wf.end", &vecFunc);
+  builder.CreateCondBr(builder.CreateICmpNE(laneBits, zeroBits), headBlock, exitBlock);
+
+// the target of the first remaining lane and all lanes that share it
+  builder.SetInsertPoint(headBlock);
+  auto * bitsPhi = builder.CreatePHI(laneBitsTy, 2, "wf.bits");
+  bitsPhi->addIncoming(laneBits, entryBlock);
+  PHINode * accuPhi = vecTy ? builder.CreatePHI(vecTy, 2, scalCall.getName() + ".wf") : nullptr;
+  if (accuPhi) accuPhi->addIncoming(UndefValue::get(vecTy), entryBlock);
+
+  auto * cttzDecl = Intrinsic::getDeclaration(mod, Intrinsic::cttz, {laneBitsTy});
+  auto * leadLane = builder.CreateCall(cttzDecl, {bitsPhi, builder.getTrue()}, "wf.lead");
+  auto * target = builder.CreateExtractElement(vecPtrs, leadLane, "wf.target");
+  auto * remainingMask = builder.CreateBitCast(bitsPhi, FixedVectorType::get(builder.getInt1Ty(), vectorWidth()));
+  auto * groupMask = builder.CreateAnd(builder.CreateICmpEQ(vecPtrs, builder.CreateVectorSplat(vectorWidth(), target)), remainingMask, "wf.group");
+  auto * groupBits = builder.CreateBitCast(groupMask, laneBitsTy, "wf.groupbits");
+
+  PHINode * latchAccu = nullptr;
+  if (vecTy) {
+    IRBuilder<> latchBuilder(latchBlock);
+    latchAccu = latchBuilder.CreatePHI(vecTy, variants.size() + 1, scalCall.getName() + ".wf.next");
+  }
+
+// vector variants of known targets
+  for (auto & variant : variants) {
+    auto * variantBlock = BasicBlock::Create(context, "wf.variant", &vecFunc);
+    auto * nextBlock = BasicBlock::Create(context, "wf.test", &vecFunc);
+    auto * targetPtr = builder.CreatePointerCast(variant.target, target->getType());
+    builder.CreateCondBr(builder.CreateICmpEQ(target, targetPtr), variantBlock, nextBlock);
+
+    builder.SetInsertPoint(variantBlock);
+    auto vectorArgs = variant.vectorArgs;
+    if (variant.maskPos >= 0) vectorArgs[variant.maskPos] = groupMask;
+    auto * call = builder.CreateCall(variant.simdFunc, vectorArgs, producesValue ? scalCall.getName() + ".wf.vec" : "");
+    call->setCallingConv(variant.simdFunc->getCallingConv());
+    if (latchAccu) latchAccu->addIncoming(builder.CreateSelect(groupMask, call, accuPhi), variantBlock);
+    builder.CreateBr(latchBlock);
+
+    builder.SetInsertPoint(nextBlock);
+  }
+
+// otw, call the target for every lane of the group
+  auto * groupHead = builder.GetInsertBlock();
+  auto * laneBlock = BasicBlock::Create(context, "wf.lane", &vecFunc);
+  builder.CreateBr(laneBlock);
+  builder.SetInsertPoint(laneBlock);
+  auto * groupPhi = builder.CreatePHI(laneBitsTy, 2, "wf.lanebits");
+  groupPhi->addIncoming(groupBits, groupHead);
+  PHINode * laneAccu = nullptr;
+  if (vecTy) {
+    laneAccu = builder.CreatePHI(vecTy, 2, scalCall.getName() + ".wf.lanes");
+    laneAccu->addIncoming(accuPhi, groupHead);
+  }
+  auto * laneIdx = builder.CreateCall(cttzDecl, {groupPhi, builder.getTrue()}, "wf.lane");
+  auto * laneCall = cast<CallInst>(scalCall.clone());
+  for (unsigned i = 0; i < scalCall.arg_size(); ++i) {
+    Value * mappedArg = mappedArgs[i];
+    if (mappedArg->getType() != scalCall.getArgOperand(i)->getType()) {
+      mappedArg = builder.CreateExtractElement(mappedArg, laneIdx);
+    }
+    laneCall->setArgOperand(i, mappedArg);
+  }
+  laneCall->setCalledOperand(target);
+  builder.Insert(laneCall, scalCall.getName());
+  auto * nextGroupBits = builder.CreateAnd(groupPhi, builder.CreateSub(groupPhi, ConstantInt::get(laneBitsTy, 1)));
+  groupPhi->addIncoming(nextGroupBits, laneBlock);
+  if (laneAccu) {
+    auto * nextLaneAccu = builder.CreateInsertElement(laneAccu, laneCall, laneIdx);
+    laneAccu->addIncoming(nextLaneAccu, laneBlock);
+    latchAccu->addIncoming(nextLaneAccu, laneBlock);
+  }
+  builder.CreateCondBr(builder.CreateICmpNE(nextGroupBits, zeroBits), laneBlock, latchBlock);
+
+// retire the group
+  builder.SetInsertPoint(latchBlock);
+  auto * nextBits = builder.CreateAnd(bitsPhi, builder.CreateNot(groupBits), "wf.bits.next");
+  bitsPhi->addIncoming(nextBits, latchBlock);
+  if (accuPhi) accuPhi->addIncoming(latchAccu, latchBlock);
+  builder.CreateCondBr(builder.CreateICmpNE(nextBits, zeroBits), headBlock, exitBlock);
+
+  builder.SetInsertPoint(exitBlock);
+  if (vecTy) {
+    auto * resPhi = builder.CreatePHI(vecTy, 2, scalCall.getName() + ".wf.res");
+    resPhi->addIncoming(latchAccu, latchBlock);
+    resPhi->addIncoming(UndefValue::get(vecTy), entryBlock);
+    mapVectorValue(&scalCall, resPhi);
+  }
+  mapVectorValue(scalCall.getParent(), exitBlock);
+  return true;
+}
+
 void NatBuilder::copyCallInstruction(CallInst *const scalCall, unsigned laneIdx) {
   // copying call instructions:
   // 1) get scalar callee
@@ -1729,6 +3760,33 @@ void NatBuilder::vectorizeMemoryInstruction(Instruction *const inst) {
     return replicateInstruction(inst);
   }
 
+  // the operands may be lazy accesses that are generated on the way
+  auto outerSources = std::move(accessSources);
+  accessSources.clear();
+
+  // members of an interleaved group are generated together at the group leader
+  if (auto *group = getInterleavedGroup(*inst)) {
+    if (inst == group->leader) {
+      for (auto *member : group->members) {
+        if (member) accessSources.push_back(member);
+      }
+      createInterleavedGroup(*group);
+    }
+    accessSources = std::move(outerSources);
+    return;
+  }
+
+  // so are the members of a coalesced gather
+  if (auto *group = getCoalescedGather(*inst)) {
+    if (inst == group->leader) {
+      for (auto &member : group->members) accessSources.push_back(member.load);
+      createCoalescedGather(*group);
+    }
+    accessSources = std::move(outerSources);
+    return;
+  }
+  accessSources.push_back(inst);
+
   LoadInst *load = dyn_cast<LoadInst>(inst);
   StoreInst *store = dyn_cast<StoreInst>(inst);
 
@@ -1768,20 +3826,32 @@ void NatBuilder::vectorizeMemoryInstruction(Instruction *const inst) {
   else
     mask = getConstantVector(vectorWidth(), i1Ty, 1);
 
+  // x = c ? a[i] : b[i] after if-conversion: two dense accesses instead of a gather/scatter
+  if (config.enableSelectAccessSplit && !addrShape.hasStridedShape()) {
+    if (auto *splitMem = createSelectSplitAccess(*inst, needsMask ? mask : nullptr)) {
+      mapVectorValue(inst, splitMem);
+      accessSources = std::move(outerSources);
+      return;
+    }
+  }
+
   // generate the address for the memory instruction now
   // uniform: uniform GEP
   // contiguous: contiguous GEP
-  // interleaved: multiple contiguous GEPs
   // varying: varying vector GEP
+  // (interleaved groups are generated by createInterleavedGroup)
 
   std::vector<Value *> addr;
   std::vector<Type *> addrTypess;
-  std::vector<Value *> srcs;
-  std::vector<Value *> masks;
   llvm::Align alignment;
-  bool interleaved = false;
   uint64_t byteSize = static_cast<uint64_t>(layout.getTypeStoreSize(accessedType));
 
+  // everything that is not a uniform or dense access is a gather/scatter, a per-lane cascade or a strided span load
+  bool isDense = addrShape.isUniform() ||
+                 ((addrShape.isContiguous() || addrShape.isStrided(byteSize)) && !(needsMask && !config.enableMaskedMove));
+  VaryingAccessKind varyingKind = isDense ? VaryingAccessKind::GatherScatter : pickVaryingAccess(*inst, needsMask);
+  bool isSpan = !isDense && varyingKind == VaryingAccessKind::StridedSpan;
+
   if (addrShape.isUniform()) {
     // scalar access
     addr.push_back(requestScalarValue(accessedPtr));
@@ -1796,19 +3866,13 @@ void NatBuilder::vectorizeMemoryInstruction(Instruction *const inst) {
     addr.push_back(ptr);
     addrTypess.push_back(vecType);
     alignment = llvm::Align(addrShape.getAlignmentFirst());
-  } else if ((addrShape.isStrided() && isInterleaved(inst, accessedPtr, byteSize, srcs)) && !(needsMask && !config.enableMaskedMove)) {
-    // interleaved access. ptrs: base, base+vector, base+2vector, ...
-    Value *srcPtr = getPointerOperand(cast<Instruction>(srcs[0]));
-    for (unsigned i = 0; i < srcs.size(); ++i) {
-      Value *ptr = requestInterleavedAddress(srcPtr, i, vecType);
-      addr.push_back(ptr);
-      addrTypess.push_back(accessedType);
-      if (needsMask)
-        masks.push_back(mask);
-    }
+  } else if (isSpan) {
+    // the span starts at the address of the first lane
+    addr.push_back(requestScalarValue(accessedPtr));
+    addrTypess.push_back(vecType);
     alignment = llvm::Align(addrShape.getAlignmentFirst());
-    interleaved = true;
-
+  } else if (varyingKind == VaryingAccessKind::TableLookup) {
+    // no address, the table is kept in registers
   } else {
     addr.push_back(requestVectorValue(accessedPtr));
     addrTypess.push_back(vecType);
@@ -1829,17 +3893,42 @@ void NatBuilder::vectorizeMemoryInstruction(Instruction *const inst) {
       assert(addrTypess.size() == 1 && "multiple address types for single access!");
 
       auto targetType = addrTypess[0];
-      vecMem = createContiguousLoad(targetType, addr[0], alignment, needsMask ? mask : nullptr, UndefValue::get(vecType));
+      // the masked-off lanes are undef: load all lanes if the whole vector footprint is dereferenceable
+      bool unmasked = needsMask && !addrShape.isUniform() && config.enableSpeculativeLoads &&
+                      isDereferenceableFootprint(*accessedPtr, *addr[0], layout.getTypeStoreSize(targetType), alignment);
+      auto *evl = (needsMask && addrShape.isContiguous()) ? requestEntryEVL() : nullptr;
+      if (evl) {
+        // the AVL masks the tail, the mask the remaining divergence
+        auto *vpMask = predicate == vecInfo.getEntryMask() ? getConstantVector(vectorWidth(), i1Ty, 1) : mask;
+        vecMem = createVPLoad(targetType, addr[0], alignment, vpMask, *evl);
+        ++numVPAccesses;
+      } else {
+        vecMem = createContiguousLoad(targetType, addr[0], alignment, (needsMask && !unmasked) ? mask : nullptr, UndefValue::get(vecType));
+      }
 
+      if (unmasked) ++numUnmaskedContLoads;
       addrShape.isUniform() ? ++numUniLoads : needsMask ? ++numContMaskedLoads : ++numContLoads;
 
-    } else if (interleaved && !(needsMask && !config.enableMaskedMove)) {
-      assert(addr.size() > 1 && "only one address for multiple accesses!");
-      createInterleavedMemory(load->getType(), vecType, alignment, &addr, &masks, nullptr, &srcs);
+    } else if (isSpan) {
+      assert(addr.size() == 1 && "multiple addresses for single access!");
+      unsigned factor = addrShape.getStride() / byteSize;
+      vecMem = createStridedSpanLoad(vecType, addr[0], alignment, needsMask ? mask : nullptr, factor);
+
+    } else if (varyingKind == VaryingAccessKind::TableLookup) {
+      // the inactive lanes read in-register entries as well
+      vecMem = createTableLookup(*inst);
 
     } else {
       assert(addr.size() == 1 && "multiple addresses for single access!");
-      vecMem = createVaryingMemory(vecType, alignment, addr[0], mask, nullptr);
+      emitPrefetches(*inst, *accessedPtr, *addr[0]);
+      Value *runIdx = (config.enableIndexRuns && !load->isVolatile() && !load->isAtomic()) ? getRunIndex(*load) : nullptr;
+      if (runIdx) {
+        vecMem = createIndexRunDispatch(*load, *runIdx, varyingKind, vecType, alignment, addr[0], mask);
+      } else if (config.enableAddressDispatch && !load->isVolatile() && !load->isAtomic()) {
+        vecMem = createAddressDispatch(*load, varyingKind, vecType, alignment, addr[0], mask);
+      } else {
+        vecMem = createVaryingMemory(varyingKind, vecType, alignment, addr[0], mask, nullptr);
+      }
     }
 
 
@@ -1848,7 +3937,24 @@ void NatBuilder::vectorizeMemoryInstruction(Instruction *const inst) {
     if (needsMask && addrShape.isUniform()) {
       assert(addr.size() == 1 && "multiple addresses for single access!");
       auto valShape = vecInfo.getVectorShape(*store->getValueOperand());
-      if (!valShape.isUniform()) {
+      Instruction * scaOldLoad = nullptr;
+      Value * scaPayload = nullptr;
+      RedKind memRed = valShape.isUniform() ? RedKind::Top : matchMemoryReduction(accessedPtr, storedValue, scaPayload, scaOldLoad);
+      if (memRed != RedKind::Top && vecInfo.getVectorShape(*scaOldLoad).isUniform()) {
+        // memory reduction "*p = *p + varyingValue": the inactive lanes contribute the neutral element
+        Value * reducedVal = nullptr;
+        if (memRed == RedKind::Or && config.enableBitMasks) {
+          // bitsets "*p |= zext(c) << s": the bits of the mask
+          if (auto * setBits = createBitSetBits(*scaPayload, mask)) reducedVal = builder.CreateOr(requestScalarValue(scaOldLoad), setBits);
+        }
+        if (!reducedVal) {
+          auto * vecPayload = requestVectorValue(scaPayload);
+          auto * vecNeutral = getSplat(&GetNeutralElement(memRed, *scaPayload->getType()));
+          auto * activePayload = builder.CreateSelect(mask, vecPayload, vecNeutral, scaPayload->getName() + ".active");
+          reducedVal = &CreateVectorReduce(config, builder, memRed, *activePayload, requestScalarValue(scaOldLoad));
+        }
+        vecMem = createUniformMaskedMemory(store, accessedType, alignment, addr[0], predicate, mask, reducedVal);
+      } else if (!valShape.isUniform()) {
         Value *mappedStoredVal = requestVectorValue(storedValue);
         vecMem = createVaryingToUniformStore(store, accessedType, alignment, addr[0], needsMask ? mask : nullptr, mappedStoredVal);
       } else {
@@ -1876,63 +3982,72 @@ void NatBuilder::vectorizeMemoryInstruction(Instruction *const inst) {
         }
 
         auto vecOldLoad = requestScalarValue(scaOldLoad);
-        auto vecPayload = requestVectorValue(scaPayload);
-        mappedStoredVal = &CreateVectorReduce(config, builder, memRed, *vecPayload, vecOldLoad);
+        auto * setBits = (memRed == RedKind::Or && config.enableBitMasks) ? createBitSetBits(*scaPayload, nullptr) : nullptr;
+        if (setBits) {
+          mappedStoredVal = builder.CreateOr(vecOldLoad, setBits);
+        } else {
+          auto vecPayload = requestVectorValue(scaPayload);
+          mappedStoredVal = &CreateVectorReduce(config, builder, memRed, *vecPayload, vecOldLoad);
+        }
       } else {
         mappedStoredVal = addrShape.isUniform() ? requestScalarValue(storedValue)
                                                 : requestVectorValue(storedValue);
       }
-      vecMem = createContiguousStore(mappedStoredVal, addr[0], alignment, needsMask ? mask : nullptr);
+      auto *evl = (needsMask && addrShape.isContiguous()) ? requestEntryEVL() : nullptr;
+      if (evl) {
+        auto *vpMask = predicate == vecInfo.getEntryMask() ? getConstantVector(vectorWidth(), i1Ty, 1) : mask;
+        vecMem = createVPStore(mappedStoredVal, addr[0], alignment, vpMask, *evl);
+        ++numVPAccesses;
+      } else {
+        vecMem = createContiguousStore(mappedStoredVal, addr[0], alignment, needsMask ? mask : nullptr);
+      }
 
       addrShape.isUniform() ? ++numUniStores : needsMask ? ++numContMaskedStores : ++numContStores;
 
-    } else if (interleaved && !(needsMask && !config.enableMaskedMove)) {
-      assert(addr.size() > 1 && "only one address for multiple accesses!");
-      std::vector<Value *> vals;
-      vals.reserve(addr.size());
-      for (unsigned i = 0; i < addr.size(); ++i) {
-        Value *srcVal = cast<StoreInst>(srcs[i])->getValueOperand();
-        Value *val = requestVectorValue(srcVal);
-        vals.push_back(val);
+      if (!needsMask && !addrShape.isUniform() && isStreamingStore(*store, *vecType, alignment)) {
+        auto *nontemporalMD = MDNode::get(builder.getContext(), ConstantAsMetadata::get(builder.getInt32(1)));
+        cast<StoreInst>(vecMem)->setMetadata(LLVMContext::MD_nontemporal, nontemporalMD);
+        ++numStreamingStores;
+        ++numRegionStreamingStores;
       }
-      createInterleavedMemory(store->getValueOperand()->getType(), vecType, alignment, &addr, &masks, &vals, &srcs);
 
     } else {
       assert(addr.size() == 1 && "multiple addresses for single access!");
       Value *mappedStoredVal = addrShape.isUniform() ? requestScalarValue(storedValue)
                                                        : requestVectorValue(storedValue);
-      vecMem = createVaryingMemory(vecType, alignment, addr[0], mask, mappedStoredVal);
-    }
-  }
-
-
-  // interleaved case creates mapping
-  if (!interleaved) {
-    if (addrShape.isUniform()) {
-      bool impreciseLoad = load && vecInfo.getVectorShape(*load).isVarying();
-      if (impreciseLoad) {
-        // loads and stores can have a uniform pointer but produce a varying result shape
-        // this is usually an artifact of SROV (if the VA is not re-run afterwards to make shapes more precise..)
-        // v = insertvalue(undef, 0, %unifomPtr) : uniform
-        // v1 = inservalue(%v, 1, %varyingValue) : varying
-        // ...
-        // %notActuallyVaryingPtr = extractvalue(%v1, 0) : varying  <--
-        // ...
-        // %x = load %notActuallyVaryingPtr // before SROC
-        // %x = load %v1 // after SROC
-        Report() << "nat: warning: load from uniform ptr with varing shape! " << *load << "\n";
-        for (int i = 0; i < vectorWidth(); ++i) {
-          mapScalarValue(inst, vecMem, i);
-        }
+      emitPrefetches(*inst, *accessedPtr, *addr[0]);
+      if (varyingKind == VaryingAccessKind::ClusteredScatter) {
+        vecMem = createClusteredScatter(*store, vecType, alignment, addr[0], mask, mappedStoredVal);
       } else {
-        mapScalarValue(inst, vecMem);
+        vecMem = createVaryingMemory(varyingKind, vecType, alignment, addr[0], mask, mappedStoredVal);
+      }
+    }
+  }
+
+  if (addrShape.isUniform()) {
+    bool impreciseLoad = load && vecInfo.getVectorShape(*load).isVarying();
+    if (impreciseLoad) {
+      // loads and stores can have a uniform pointer but produce a varying result shape
+      // this is usually an artifact of SROV (if the VA is not re-run afterwards to make shapes more precise..)
+      // v = insertvalue(undef, 0, %unifomPtr) : uniform
+      // v1 = inservalue(%v, 1, %varyingValue) : varying
+      // ...
+      // %notActuallyVaryingPtr = extractvalue(%v1, 0) : varying  <--
+      // ...
+      // %x = load %notActuallyVaryingPtr // before SROC
+      // %x = load %v1 // after SROC
+      Report() << "nat: warning: load from uniform ptr with varing shape! " << *load << "\n";
+      for (int i = 0; i < vectorWidth(); ++i) {
+        mapScalarValue(inst, vecMem, i);
       }
     } else {
-      mapVectorValue(inst, vecMem);
+      mapScalarValue(inst, vecMem);
     }
+  } else {
+    mapVectorValue(inst, vecMem);
   }
 
-  return;
+  accessSources = std::move(outerSources);
 }
 
 
@@ -2000,7 +4115,8 @@ NatBuilder::createVaryingToUniformStore(Instruction *inst, Type *accessedType, l
     Value * branchMask = createPTest(mask, false);
 #endif
 
-    builder.CreateCondBr(branchMask, memBlock, continueBlock);
+    auto * guardBr = builder.CreateCondBr(branchMask, memBlock, continueBlock);
+    setBranchProbability(*guardBr, getAnyLaneProbability(DefaultLaneProb, vectorWidth()));
 
   // insert store in guarded block
     builder.SetInsertPoint(memBlock);
@@ -2014,7 +4130,7 @@ NatBuilder::createVaryingToUniformStore(Instruction *inst, Type *accessedType, l
     auto * sxMask = builder.CreateSExt(mask, vecLaneTy);
 
     // AND with lane index vector
-    auto * laneIdxConst = createContiguousVector(vectorWidth(), nativeIntTy, 0, 1);
+    auto * laneIdxConst = getLaneIndexVector(*nativeIntTy);
     auto * activeLaneVec = builder.CreateAnd(sxMask, laneIdxConst);
 
     // horizontal MAX reduction
@@ -2036,6 +4152,7 @@ NatBuilder::createVaryingToUniformStore(Instruction *inst, Type *accessedType, l
   auto * lastLaneVal = builder.CreateExtractElement(values, indexVal, "xt.lastlane");
   auto * vecMem = builder.CreateStore(lastLaneVal, addr);
   cast<StoreInst>(vecMem)->setAlignment(llvm::Align(alignment));
+  tagAccess(vecMem);
 
   // proceed in continue block (if any)
   if (continueBlock) {
@@ -2050,8 +4167,9 @@ Value *NatBuilder::createUniformMaskedMemory(Instruction *inst, Type *accessedTy
                                              Value *addr, Value * scalarMask, Value * vectorMask, Value *values) {
   values ? ++numUniMaskedStores : ++numUniMaskedLoads;
 
-  // emit a scalar memory acccess within a any-guarded section
-  bool needsGuard = true;
+  // emit a scalar memory acccess within a any-guarded section (unless the load can not fault)
+  bool needsGuard = values || !config.enableSpeculativeLoads || !canSpeculateLoad(*cast<LoadInst>(inst), *accessedType, alignment);
+  if (!needsGuard) ++numSpecUniLoads;
   return &createAnyGuard(needsGuard, *inst->getParent(), *inst, isa<LoadInst>(inst),
       [=](IRBuilder<> & builder)
   {
@@ -2063,17 +4181,160 @@ Value *NatBuilder::createUniformMaskedMemory(Instruction *inst, Type *accessedTy
       vecMem = builder.CreateLoad(accessedType, addr, "scal_mask_mem");
       cast<LoadInst>(vecMem)->setAlignment(llvm::Align(alignment));
     }
+    tagAccess(vecMem);
     return vecMem;
   });
 }
 
-Value *NatBuilder::createVaryingMemory(Type *vecType, llvm::Align alignment, Value *addr, Value *mask,
-                                       Value *values) {
+Value *
+NatBuilder::createSelectSplitAccess(Instruction &inst, Value *mask) {
+  auto *load = dyn_cast<LoadInst>(&inst);
+  auto *store = dyn_cast<StoreInst>(&inst);
+  if ((load && !load->isSimple()) || (store && !store->isSimple())) return nullptr;
+  auto *sel = dyn_cast<SelectInst>(getLoadStorePointerOperand(&inst));
+  if (!sel || getVectorShape(*sel->getCondition()).isUniform()) return nullptr;
+  Type *accessedType = getLoadStoreType(&inst);
+  if (!accessedType->isIntegerTy() && !accessedType->isFloatingPointTy() && !accessedType->isPointerTy()) return nullptr;
+
+  // a masked vector access per dense arm, a scalar load per uniform arm
+  uint64_t byteSize = layout.getTypeStoreSize(accessedType);
+  Value *arms[2] = {sel->getTrueValue(), sel->getFalseValue()};
+  for (auto *arm : arms) {
+    auto armShape = getVectorShape(*arm);
+    if (armShape.isStrided(byteSize) && config.enableMaskedMove) continue;
+    if (load && armShape.isUniform()) continue;
+    return nullptr;
+  }
+
+  auto *vecCond = requestVectorValue(sel->getCondition());
+  auto *notCond = builder.CreateNot(vecCond, sel->getName() + ".false");
+  Value *armMasks[2] = {mask ? builder.CreateAnd(mask, vecCond) : vecCond, mask ? builder.CreateAnd(mask, notCond) : notCond};
+  llvm::Align origAlignment = getLoadStoreAlignment(&inst);
+  ++numSelectSplits;
+
+  if (store) {
+    auto *vecVal = requestVectorValue(store->getValueOperand());
+    Value *vecMem = nullptr;
+    for (int i = 0; i < 2; ++i) {
+      llvm::Align alignment = std::max<llvm::Align>(llvm::Align(getVectorShape(*arms[i]).getAlignmentFirst()), origAlignment);
+      vecMem = createContiguousStore(vecVal, requestScalarValue(arms[i]), alignment, armMasks[i]);
+      ++numContMaskedStores;
+    }
+    return vecMem;
+  }
+
+  Type *vecType = getVectorType(accessedType, vectorWidth());
+  Value *armValues[2];
+  for (int i = 0; i < 2; ++i) {
+    auto armShape = getVectorShape(*arms[i]);
+    llvm::Align alignment = std::max<llvm::Align>(llvm::Align(armShape.getAlignmentFirst()), origAlignment);
+    auto *armPtr = requestScalarValue(arms[i]);
+    if (!armShape.isUniform()) {
+      armValues[i] = createContiguousLoad(vecType, armPtr, alignment, armMasks[i], UndefValue::get(vecType));
+      ++numContMaskedLoads;
+      continue;
+    }
+
+    // the element is only read if some lane selects it
+    Value *scaVal = nullptr;
+    if (config.enableSpeculativeLoads && isDereferenceableAndAlignedPointer(arms[i], accessedType, alignment, layout)) {
+      scaVal = tagAccess(builder.CreateAlignedLoad(accessedType, armPtr, alignment, "split_uni_load"));
+      ++numSpecUniLoads;
+    } else {
+      auto *anyMask = builder.CreateVectorSplat(1, builder.CreateOrReduce(armMasks[i]));
+      auto *elem = tagAccess(builder.CreateMaskedLoad(FixedVectorType::get(accessedType, 1), armPtr, alignment, anyMask, nullptr, "split_uni_load"));
+      scaVal = builder.CreateExtractElement(elem, (uint64_t) 0);
+      ++numUniMaskedLoads;
+    }
+    armValues[i] = builder.CreateVectorSplat(vectorWidth(), scaVal);
+  }
+  ++numBlends;
+  return builder.CreateSelect(vecCond, armValues[0], armValues[1], inst.getName() + ".split");
+}
+
+bool
+NatBuilder::isDereferenceableFootprint(Value & scalarPtr, Value & vecPtr, uint64_t footprint, llvm::Align alignment) {
+  unsigned idxBits = layout.getIndexTypeSizeInBits(scalarPtr.getType());
+  APInt accessSize(idxBits, footprint);
+
+  // derived from a dereferenceable object by constant offsets
+  if (isDereferenceableAndAlignedPointer(&vecPtr, alignment, accessSize, layout)) return true;
+
+  // the lane-0 addresses of the scalar access stay within the footprint of their base object
+  // (the lanes are iterations of the scalar loop, so its value range bounds the lane-0 address)
+  if (!SE.isSCEVable(scalarPtr.getType())) return false;
+  const SCEV * ptrSCEV = SE.getSCEV(&scalarPtr);
+  auto * baseSCEV = dyn_cast<SCEVUnknown>(SE.getPointerBase(ptrSCEV));
+  if (!baseSCEV) return false;
+
+  bool canBeNull = false, canBeFreed = false;
+  uint64_t derefBytes = baseSCEV->getValue()->getPointerDereferenceableBytes(layout, canBeNull, canBeFreed);
+  if (!derefBytes || canBeNull || canBeFreed || derefBytes < footprint) return false;
+
+  const SCEV * offsetSCEV = SE.getMinusSCEV(ptrSCEV, baseSCEV);
+  if (isa<SCEVCouldNotCompute>(offsetSCEV)) return false;
+  ConstantRange offsetRange = SE.getSignedRange(offsetSCEV);
+  if (offsetRange.isFullSet() || offsetRange.getSignedMin().isNegative()) return false;
+  return offsetRange.getSignedMax().sle(derefBytes - footprint);
+}
+
+bool
+NatBuilder::canSpeculateLoad(LoadInst & load, Type & accessedType, llvm::Align alignment) {
+  if (load.isVolatile() || !load.isUnordered()) return false;
+  Value * ptr = load.getPointerOperand();
+
+  // dereferenceable arguments, allocas, globals (regardless of the context)
+  if (isDereferenceableAndAlignedPointer(ptr, &accessedType, alignment, layout)) return true;
+
+  // an access to the same pointer on a dominating path of the scalar function.
+  // In the linearized region, an access executes only if its block mask is non-empty.
+  // The dominating access has to be outside of the region or in a block that some lane always reaches.
+  uint64_t accessSize = layout.getTypeStoreSize(&accessedType);
+  BasicBlock & loadBlock = *load.getParent();
+  for (auto * user : ptr->users()) {
+    auto * domInst = dyn_cast<Instruction>(user);
+    if (!domInst || domInst == &load) continue;
+
+    Type * domType = nullptr;
+    if (auto * domLoad = dyn_cast<LoadInst>(domInst)) {
+      if (domLoad->getPointerOperand() != ptr || domLoad->isVolatile()) continue;
+      domType = domLoad->getType();
+    } else if (auto * domStore = dyn_cast<StoreInst>(domInst)) {
+      if (domStore->getPointerOperand() != ptr || domStore->isVolatile()) continue;
+      domType = domStore->getValueOperand()->getType();
+    } else {
+      continue;
+    }
+    if (layout.getTypeStoreSize(domType) < accessSize) continue;
+
+    BasicBlock & domBlock = *domInst->getParent();
+    if (&domBlock == &loadBlock || !dominatorTree.dominates(&domBlock, &loadBlock)) continue;
+    if (vecInfo.inRegion(domBlock)) {
+      auto * domPred = vecInfo.getPredicate(domBlock);
+      if (domPred && !undeadMasks.isUndead(*domPred, domBlock)) continue;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+VaryingAccessKind
+NatBuilder::pickVaryingAccess(Instruction &inst, bool needsMask) {
+  if (!platInfo.getTTI()) {
+    return config.useScatterGatherIntrinsics ? VaryingAccessKind::GatherScatter : VaryingAccessKind::Cascade;
+  }
+  CostModel costModel(platInfo, config, vecInfo);
+  return costModel.pickVaryingAccess(inst, needsMask);
+}
+
+Value *NatBuilder::createVaryingMemory(VaryingAccessKind kind, Type *vecType, llvm::Align alignment, Value *addr,
+                                       Value *mask, Value *values) {
   bool scatter(values != nullptr);
   bool maskNonConst(!isa<ConstantVector>(mask));
-  maskNonConst ? (scatter ? ++numMaskedScatter : ++numMaskedGather) : (scatter ? ++numScatter : ++numGather);
 
-  if (config.useScatterGatherIntrinsics) {
+  if (kind == VaryingAccessKind::GatherScatter) {
+    maskNonConst ? (scatter ? ++numMaskedScatter : ++numMaskedGather) : (scatter ? ++numScatter : ++numGather);
     auto * vecPtrTy = addr->getType();
 
     std::vector<Value *> args;
@@ -2086,80 +4347,745 @@ Value *NatBuilder::createVaryingMemory(Type *vecType, llvm::Align alignment, Val
     Function *intr = scatter ? Intrinsic::getDeclaration(mod, Intrinsic::masked_scatter, {vecType, vecPtrTy})
                              : Intrinsic::getDeclaration(mod, Intrinsic::masked_gather, {vecType, vecPtrTy});
     assert(intr && "scatter/gather not found!");
-    return builder.CreateCall(intr, args);
+    return tagAccess(builder.CreateCall(intr, args));
+  }
 
-  } else
-    return scatter ? requestCascadeStore(values, addr, alignment.value(), mask) : requestCascadeLoad(vecType, addr, alignment.value(), mask);
+  // the cascade function accesses memory on behalf of the call
+  maskNonConst ? (scatter ? ++numMaskedCascadeStores : ++numMaskedCascadeLoads) : (scatter ? ++numCascadeStores : ++numCascadeLoads);
+  return tagAccess(scatter ? requestCascadeStore(values, addr, alignment.value(), mask) : requestCascadeLoad(vecType, addr, alignment.value(), mask));
 }
 
-void NatBuilder::createInterleavedMemory(Type *targetType, Type *vecType, llvm::Align alignment, std::vector<Value *> *addr, std::vector<Value *> *masks,
-                                         std::vector<Value *> *values, std::vector<Value *> *srcs) {
+// prefetch distance (in vector iterations) without a cost model (no TTI)
+static const unsigned DefaultPrefetchDistance = 8;
+// cache line size if TTI does not know it
+static const unsigned DefaultCacheLineSize = 64;
+
+int64_t NatBuilder::getLoopStride(Value &ptr) {
+  auto *addRec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&ptr));
+  if (!addRec || !addRec->isAffine() || addRec->getLoop()->getHeader() != &vecInfo.getEntry()) return 0;
+  auto *step = dyn_cast<SCEVConstant>(addRec->getStepRecurrence(SE));
+  if (!step || step->getAPInt().getMinSignedBits() > 64) return 0;
+  return step->getAPInt().getSExtValue();
+}
 
-  unsigned stride = (unsigned) addr->size();
-  bool needsMask = masks->size() > 0;
-  bool load = values == nullptr;
+void NatBuilder::emitLanePrefetches(Value &ptrs, int64_t offset, bool forWrite) {
+  Module *mod = vecInfo.getMapping().vectorFn->getParent();
+  unsigned addrSpace = cast<PointerType>(ptrs.getType()->getScalarType())->getAddressSpace();
+  auto *i8PtrTy = builder.getInt8PtrTy(addrSpace);
+  Function *prefetchFunc = Intrinsic::getDeclaration(mod, Intrinsic::prefetch, {i8PtrTy});
+  for (int i = 0; i < vectorWidth(); ++i) {
+    Value *lanePtr = builder.CreatePointerCast(builder.CreateExtractElement(&ptrs, i), i8PtrTy);
+    if (offset) lanePtr = builder.CreateGEP(builder.getInt8Ty(), lanePtr, builder.getInt64(offset), "prefetch.ptr");
+    // read/write, locality 3 (keep in all cache levels), data cache
+    builder.CreateCall(prefetchFunc, {lanePtr, builder.getInt32(forWrite), builder.getInt32(3), builder.getInt32(1)});
+  }
+}
 
-  // tranpose mask and values if needed
-  ShuffleBuilder maskTransposer(vectorWidth());
-  if (needsMask)
-    maskTransposer.add(*masks);
+void NatBuilder::emitPrefetches(Instruction &inst, Value &scaPtr, Value &vecPtr) {
+  if (!config.enablePrefetch || !vecInfo.getRegion().isVectorLoop()) return;
 
-  // build interleaved loads/stores
-  Value *vecMem;
-  ShuffleBuilder transposer(vectorWidth());
-  if (!load)
-    transposer.add(*values);
+  if (!prefetchDistance) {
+    if (config.prefetchDistance > 0) {
+      prefetchDistance = config.prefetchDistance;
+    } else if (platInfo.getTTI()) {
+      CostModel costModel(platInfo, config, vecInfo);
+      prefetchDistance = costModel.pickPrefetchDistance();
+    } else {
+      prefetchDistance = DefaultPrefetchDistance;
+    }
+    Report() << "nat: prefetch distance " << prefetchDistance << " vector iterations\n";
+  }
+
+  bool forWrite = isa<StoreInst>(inst);
+  unsigned lineSize = platInfo.getTTI() ? platInfo.getTTI()->getCacheLineSize() : 0;
+  if (!lineSize) lineSize = DefaultCacheLineSize;
+  int64_t aheadIterations = (int64_t) prefetchDistance * vectorWidth();
+
+  // affine addresses: the hardware prefetchers only follow strides within a cache line
+  int64_t stride = getLoopStride(scaPtr);
+  if (stride) {
+    if ((uint64_t) std::abs(stride) < lineSize) return;
+    emitLanePrefetches(vecPtr, aheadIterations * stride, forWrite);
+    return;
+  }
+
+  // indirect accesses base[idx[i]]: load the indices of the iteration aheadIterations from now
+  auto *gep = dyn_cast<GetElementPtrInst>(&scaPtr);
+  if (!gep || gep->getNumIndices() != 1 || !getVectorShape(*gep->getPointerOperand()).isUniform()) return;
+  Value *scaIdx = gep->getOperand(1);
+  auto *idxCast = dyn_cast<CastInst>(scaIdx);
+  if (idxCast && !isa<SExtInst>(idxCast) && !isa<ZExtInst>(idxCast)) return;
+  auto *idxLoad = dyn_cast<LoadInst>(idxCast ? idxCast->getOperand(0) : scaIdx);
+  if (!idxLoad || !idxLoad->isSimple() || !vecInfo.inRegion(*idxLoad->getParent())) return;
+
+  Value *idxPtr = idxLoad->getPointerOperand();
+  Type *idxTy = idxLoad->getType();
+  uint64_t idxBytes = layout.getTypeStoreSize(idxTy);
+  if (getLoopStride(*idxPtr) != (int64_t) idxBytes) return;
+
+  // the loop exit does not guard the ahead load, it is clamped to the last vector of the index array
+  Value *idxObj = getUnderlyingObject(idxPtr);
+  auto *idxObjInst = dyn_cast<Instruction>(idxObj);
+  if (idxObjInst && vecInfo.inRegion(*idxObjInst->getParent())) return;
+  uint64_t objBytes = 0;
+  if (auto *arg = dyn_cast<Argument>(idxObj)) {
+    objBytes = arg->getDereferenceableBytes();
+  } else if (!getObjectSize(idxObj, objBytes, layout, platInfo.getTLI())) {
+    objBytes = 0;
+  }
+  uint64_t vecIdxBytes = idxBytes * vectorWidth();
+  if (objBytes < vecIdxBytes) return;
+
+  auto *intPtrTy = layout.getIntPtrType(idxPtr->getType());
+  Value *curInt = builder.CreatePtrToInt(requestScalarValue(idxPtr), intPtrTy);
+  Value *aheadInt = builder.CreateAdd(curInt, ConstantInt::get(intPtrTy, aheadIterations * idxBytes));
+  Value *lastInt = builder.CreateAdd(builder.CreatePtrToInt(idxObj, intPtrTy), ConstantInt::get(intPtrTy, objBytes - vecIdxBytes));
+  Value *clampedInt = builder.CreateSelect(builder.CreateICmpULT(aheadInt, lastInt), aheadInt, lastInt);
+
+  auto *vecIdxTy = getVectorType(idxTy, vectorWidth());
+  unsigned addrSpace = cast<PointerType>(idxPtr->getType())->getAddressSpace();
+  Value *aheadIdxPtr = builder.CreateIntToPtr(clampedInt, vecIdxTy->getPointerTo(addrSpace));
+  Value *aheadIdx = builder.CreateAlignedLoad(vecIdxTy, aheadIdxPtr, llvm::Align(1), "prefetch.idx");
+  if (idxCast) aheadIdx = builder.CreateCast(idxCast->getOpcode(), aheadIdx, getVectorType(idxCast->getDestTy(), vectorWidth()));
+
+  Value *base = requestScalarValue(gep->getPointerOperand());
+  Value *aheadPtrs = builder.CreateGEP(gep->getSourceElementType(), base, aheadIdx, "prefetch.ptrs");
+  emitLanePrefetches(*aheadPtrs, 0, forWrite);
+}
+
+Value *NatBuilder::createStridedSpanLoad(Type *vecType, Value *ptr, llvm::Align alignment, Value *mask, unsigned factor) {
+  unsigned width = vectorWidth();
+  unsigned spanLen = (width - 1) * factor + 1;
+  auto *elemTy = cast<VectorType>(vecType)->getElementType();
+  auto *spanTy = FixedVectorType::get(elemTy, spanLen);
+  auto *spanPtr = builder.CreatePointerCast(ptr, spanTy->getPointerTo(ptr->getType()->getPointerAddressSpace()), "span_ptr");
+
+  // only the elements of active lanes may be read (lane i reads element i * factor)
+  Value *spanMask = nullptr;
+  if (mask) {
+    SmallVector<int, 64> maskLanes;
+    for (unsigned j = 0; j < spanLen; ++j) maskLanes.push_back(j % factor == 0 ? j / factor : width);
+    spanMask = builder.CreateShuffleVector(mask, Constant::getNullValue(mask->getType()), maskLanes, "span_mask");
+  }
+  mask ? ++numMaskedSpanLoads : ++numSpanLoads;
+  auto *span = createContiguousLoad(spanTy, spanPtr, alignment, spanMask, UndefValue::get(spanTy));
+
+  SmallVector<int, 16> laneElems;
+  for (unsigned i = 0; i < width; ++i) laneElems.push_back(i * factor);
+  return builder.CreateShuffleVector(span, laneElems, "span_lanes");
+}
 
-  for (unsigned i = 0; i < stride; ++i) {
-    Value *ptr = (*addr)[i];
-    Value *mask = needsMask ? maskTransposer.shuffleToInterleaved(builder, stride, i) : nullptr;
+std::pair<Value *, Value *>
+NatBuilder::requestAddressTests(LoadInst &load, Value *vecPtrs, Value *mask) {
+  // accesses at constant offsets from the same base have the same address shape
+  auto *scaPtr = load.getPointerOperand();
+  auto *scaBase = scaPtr->stripInBoundsConstantOffsets();
+  uint64_t byteSize = layout.getTypeStoreSize(load.getType());
+  auto key = std::make_tuple(static_cast<const Value *>(scaBase), byteSize, static_cast<const BasicBlock *>(load.getParent()));
+  auto itTests = addressTestMap.find(key);
+  if (itTests != addressTestMap.end()) return itTests->second;
+
+  auto *baseVec = (scaBase == scaPtr) ? vecPtrs : requestVectorValue(scaBase);
+  auto *indexTy = getIndexTy(scaPtr);
+  auto *vecIndexTy = FixedVectorType::get(indexTy, vectorWidth());
+
+  // lane i is at lane 0 + i * byteSize (contiguous) or at lane 0 (uniform)
+  auto *baseInts = builder.CreatePtrToInt(baseVec, vecIndexTy, "addr_ints");
+  auto *splatLane0 = builder.CreateVectorSplat(vectorWidth(), builder.CreateExtractElement(baseInts, (uint64_t) 0), "addr_lane0");
+  auto *contInts = builder.CreateAdd(splatLane0, getLaneIndexVector(*indexTy, (int) byteSize), "addr_cont_ints");
+  Value *uniLanes = builder.CreateICmpEQ(baseInts, splatLane0, "addr_uni_lanes");
+  Value *contLanes = builder.CreateICmpEQ(baseInts, contInts, "addr_cont_lanes");
+
+  // inactive lanes do not count, the uniform load reads from lane 0
+  auto *constMask = dyn_cast<Constant>(mask);
+  bool masked = !constMask || !constMask->isAllOnesValue();
+  if (masked) {
+    auto *inactive = builder.CreateNot(mask, "addr_inactive");
+    uniLanes = builder.CreateOr(uniLanes, inactive);
+    contLanes = builder.CreateOr(contLanes, inactive);
+  }
+
+  Value *isUniform = createPTest(uniLanes, true);
+  Value *isContiguous = createPTest(contLanes, true);
+  if (masked) isUniform = builder.CreateAnd(isUniform, builder.CreateExtractElement(mask, (uint64_t) 0), "addr_is_uni");
+
+  auto tests = std::make_pair(isUniform, isContiguous);
+  addressTestMap[key] = tests;
+  return tests;
+}
+
+Value *NatBuilder::createAddressDispatch(LoadInst &load, VaryingAccessKind kind, Type *vecType, llvm::Align alignment,
+                                         Value *vecPtrs, Value *mask) {
+  auto &origBlock = *load.getParent();
+  auto &vecFunc = vecInfo.getVectorFunction();
+  auto &ctx = vecFunc.getContext();
+
+  Value *isUniform, *isContiguous;
+  std::tie(isUniform, isContiguous) = requestAddressTests(load, vecPtrs, mask);
+
+  auto *constMask = dyn_cast<Constant>(mask);
+  bool masked = !constMask || !constMask->isAllOnesValue();
+  auto *lane0Ptr = builder.CreateExtractElement(vecPtrs, (uint64_t) 0, "addr_ptr0");
+
+  auto *uniBlock = BasicBlock::Create(ctx, "addr_uni", &vecFunc);
+  auto *testContBlock = BasicBlock::Create(ctx, "addr_test_cont", &vecFunc);
+  auto *contBlock = BasicBlock::Create(ctx, "addr_cont", &vecFunc);
+  auto *varyingBlock = BasicBlock::Create(ctx, "addr_varying", &vecFunc);
+  auto *joinBlock = BasicBlock::Create(ctx, "addr_join", &vecFunc);
+  builder.CreateCondBr(isUniform, uniBlock, testContBlock);
+  builder.SetInsertPoint(testContBlock);
+  builder.CreateCondBr(isContiguous, contBlock, varyingBlock);
+
+  // uniform addresses: one scalar load (lane 0 is active)
+  builder.SetInsertPoint(uniBlock);
+  auto *uniLoad = builder.CreateAlignedLoad(load.getType(), lane0Ptr, alignment, load.getName() + ".uni");
+  tagAccess(uniLoad);
+  auto *uniVal = builder.CreateVectorSplat(vectorWidth(), uniLoad);
+  builder.CreateBr(joinBlock);
+
+  // contiguous addresses: one (masked) vector load from lane 0
+  builder.SetInsertPoint(contBlock);
+  auto *vecPtr = builder.CreatePointerCast(lane0Ptr, PointerType::get(vecType, load.getPointerAddressSpace()));
+  auto *contVal = createContiguousLoad(vecType, vecPtr, alignment, masked ? mask : nullptr, UndefValue::get(vecType));
+  auto *contEnd = builder.GetInsertBlock();
+  builder.CreateBr(joinBlock);
+
+  // general addresses
+  builder.SetInsertPoint(varyingBlock);
+  auto *varyingVal = createVaryingMemory(kind, vecType, alignment, vecPtrs, mask, nullptr);
+  auto *varyingEnd = builder.GetInsertBlock();
+  builder.CreateBr(joinBlock);
+
+  builder.SetInsertPoint(joinBlock);
+  auto *phi = builder.CreatePHI(vecType, 3, "addr_dispatch");
+  phi->addIncoming(uniVal, uniBlock);
+  phi->addIncoming(contVal, contEnd);
+  phi->addIncoming(varyingVal, varyingEnd);
+  mapVectorValue(&origBlock, joinBlock);
+
+  ++numAddressDispatches;
+  return phi;
+}
+
+Value *NatBuilder::getRunIndex(LoadInst &load) {
+  // base[idx] with a uniform base and elements of the loaded type
+  auto *gep = dyn_cast<GetElementPtrInst>(load.getPointerOperand());
+  if (!gep || gep->getNumIndices() != 1) return nullptr;
+  if (!vecInfo.getVectorShape(*gep->getPointerOperand()).isUniform()) return nullptr;
+  if (layout.getTypeAllocSize(gep->getSourceElementType()) != layout.getTypeStoreSize(load.getType())) return nullptr;
+  auto *scaIdx = gep->getOperand(1);
+  if (!scaIdx->getType()->isIntegerTy() || !vecInfo.getVectorShape(*scaIdx).isVarying()) return nullptr;
+
+  // the index is read from consecutive elements of an index array (col[j] in CSR kernels)
+  Value *loadedIdx = scaIdx;
+  if (isa<SExtInst>(scaIdx) || isa<ZExtInst>(scaIdx)) loadedIdx = cast<CastInst>(scaIdx)->getOperand(0);
+  auto *idxLoad = dyn_cast<LoadInst>(loadedIdx);
+  if (!idxLoad || idxLoad->isVolatile()) return nullptr;
+  int idxSize = (int) layout.getTypeStoreSize(idxLoad->getType());
+  if (!vecInfo.getVectorShape(*idxLoad->getPointerOperand()).isStrided(idxSize)) return nullptr;
+  return scaIdx;
+}
 
-    if (masks->size() == 1 && i == (stride - 1)) {
-      needsMask = true;
-      mask = masks->front();
+Value *NatBuilder::requestIndexRunTest(Value &scaIdx, const BasicBlock &scaBlock, Value *mask) {
+  // all accesses through the same (extended) index share the test
+  auto key = std::make_pair(static_cast<const Value *>(&scaIdx), &scaBlock);
+  auto itTest = indexRunTestMap.find(key);
+  if (itTest != indexRunTestMap.end()) return itTest->second;
+
+  // lane i holds idx[0] + i, compared on the extended index so that a run that wraps in the narrow type does not pass
+  auto *indexTy = scaIdx.getType();
+  auto *vecIdx = requestVectorValue(&scaIdx);
+  auto *splatLane0 = builder.CreateVectorSplat(vectorWidth(), builder.CreateExtractElement(vecIdx, (uint64_t) 0), "idx_lane0");
+  auto *runIdx = builder.CreateAdd(splatLane0, getLaneIndexVector(*indexTy), "idx_run");
+  Value *runLanes = builder.CreateICmpEQ(vecIdx, runIdx, "idx_run_lanes");
+
+  // inactive lanes do not count, the vector load is masked
+  auto *constMask = dyn_cast<Constant>(mask);
+  if (!constMask || !constMask->isAllOnesValue()) runLanes = builder.CreateOr(runLanes, builder.CreateNot(mask, "idx_inactive"));
+
+  auto *isRun = createPTest(runLanes, true);
+  indexRunTestMap[key] = isRun;
+  return isRun;
+}
+
+Value *NatBuilder::createIndexRunDispatch(LoadInst &load, Value &scaIdx, VaryingAccessKind kind, Type *vecType,
+                                          llvm::Align alignment, Value *vecPtrs, Value *mask) {
+  auto &origBlock = *load.getParent();
+  auto &vecFunc = vecInfo.getVectorFunction();
+  auto &ctx = vecFunc.getContext();
+
+  auto *isRun = requestIndexRunTest(scaIdx, origBlock, mask);
+  auto *constMask = dyn_cast<Constant>(mask);
+  bool masked = !constMask || !constMask->isAllOnesValue();
+
+  auto *runBlock = BasicBlock::Create(ctx, "idx_run", &vecFunc);
+  auto *varyingBlock = BasicBlock::Create(ctx, "idx_varying", &vecFunc);
+  auto *joinBlock = BasicBlock::Create(ctx, "idx_join", &vecFunc);
+  builder.CreateCondBr(isRun, runBlock, varyingBlock);
+
+  // consecutive indices: one (masked) vector load from base[idx[0]]
+  builder.SetInsertPoint(runBlock);
+  auto *lane0Ptr = builder.CreateExtractElement(vecPtrs, (uint64_t) 0, "idx_ptr0");
+  auto *vecPtr = builder.CreatePointerCast(lane0Ptr, PointerType::get(vecType, load.getPointerAddressSpace()));
+  auto *runVal = createContiguousLoad(vecType, vecPtr, alignment, masked ? mask : nullptr, UndefValue::get(vecType));
+  auto *runEnd = builder.GetInsertBlock();
+  builder.CreateBr(joinBlock);
+
+  // general indices
+  builder.SetInsertPoint(varyingBlock);
+  auto *varyingVal = createVaryingMemory(kind, vecType, alignment, vecPtrs, mask, nullptr);
+  auto *varyingEnd = builder.GetInsertBlock();
+  builder.CreateBr(joinBlock);
+
+  builder.SetInsertPoint(joinBlock);
+  auto *phi = builder.CreatePHI(vecType, 2, "idx_dispatch");
+  phi->addIncoming(runVal, runEnd);
+  phi->addIncoming(varyingVal, varyingEnd);
+  mapVectorValue(&origBlock, joinBlock);
+
+  ++numIndexRunDispatches;
+  return phi;
+}
+
+Value *NatBuilder::createClusteredScatter(StoreInst &store, Type *vecType, llvm::Align alignment, Value *vecPtrs,
+                                          Value *mask, Value *values) {
+  auto &origBlock = *store.getParent();
+  auto &vecFunc = vecInfo.getVectorFunction();
+  auto &ctx = vecFunc.getContext();
+  unsigned width = vectorWidth();
+  uint64_t byteSize = layout.getTypeStoreSize(cast<VectorType>(vecType)->getElementType());
+  auto *i64Ty = builder.getInt64Ty();
+  auto *offsetTy = FixedVectorType::get(i64Ty, width);
+
+  // the window starts at the lowest active address (all ones without active lanes, which store nothing)
+  auto *addrs = builder.CreatePtrToInt(vecPtrs, offsetTy, "cluster_addr");
+  auto *base = builder.CreateIntMinReduce(builder.CreateSelect(mask, addrs, Constant::getAllOnesValue(offsetTy)), false);
+  auto *offsets = builder.CreateSelect(mask, builder.CreateSub(addrs, builder.CreateVectorSplat(width, base)),
+                                       Constant::getNullValue(offsetTy), "cluster_offset");
+
+  // all active offsets are element aligned and below the vector size
+  uint64_t outsideBits = ~((width * byteSize - 1) & ~(byteSize - 1));
+  auto *outside = builder.CreateOrReduce(builder.CreateAnd(offsets, ConstantInt::get(offsetTy, outsideBits)));
+  auto *inWindow = builder.CreateICmpEQ(outside, ConstantInt::get(i64Ty, 0), "cluster_hit");
+
+  auto *windowBlock = BasicBlock::Create(ctx, "cluster_window", &vecFunc);
+  auto *scatterBlock = BasicBlock::Create(ctx, "cluster_scatter", &vecFunc);
+  auto *joinBlock = BasicBlock::Create(ctx, "cluster_join", &vecFunc);
+  builder.CreateCondBr(inWindow, windowBlock, scatterBlock);
+
+  // move the values to their slot in the window, lane by lane (inactive lanes have no slot)
+  builder.SetInsertPoint(windowBlock);
+  auto *slots = builder.CreateSelect(mask, builder.CreateLShr(offsets, Log2_64(byteSize)), ConstantInt::get(offsetTy, width),
+                                     "cluster_slot");
+  SmallVector<Constant *, 16> windowSlots;
+  for (unsigned i = 0; i < width; ++i) windowSlots.push_back(ConstantInt::get(i64Ty, i));
+  Value *windowVal = UndefValue::get(vecType);
+  Value *windowMask = getConstantVector(width, i1Ty, 0);
+  for (unsigned lane = 0; lane < width; ++lane) {
+    SmallVector<int, 16> broadcast(width, lane);
+    auto *isSlot = builder.CreateICmpEQ(builder.CreateShuffleVector(slots, broadcast), ConstantVector::get(windowSlots));
+    windowVal = builder.CreateSelect(isSlot, builder.CreateShuffleVector(values, broadcast), windowVal, "cluster_val");
+    windowMask = builder.CreateOr(windowMask, isSlot, "cluster_mask");
+  }
+  auto *basePtr = builder.CreateIntToPtr(base, vecPtrs->getType()->getScalarType(), "cluster_base");
+  createContiguousStore(windowVal, basePtr, alignment, windowMask);
+  builder.CreateBr(joinBlock);
+
+  // anything else
+  builder.SetInsertPoint(scatterBlock);
+  Config scatterConfig = config;
+  scatterConfig.enableScatterCoalescing = false;
+  auto scatterKind = platInfo.getTTI() ? CostModel(platInfo, scatterConfig, vecInfo).pickVaryingAccess(store, !isa<ConstantVector>(mask))
+                                       : VaryingAccessKind::GatherScatter;
+  auto *scatterMem = createVaryingMemory(scatterKind, vecType, alignment, vecPtrs, mask, values);
+  builder.CreateBr(joinBlock);
+
+  builder.SetInsertPoint(joinBlock);
+  mapVectorValue(&origBlock, joinBlock);
+
+  ++numClusteredScatters;
+  return scatterMem;
+}
+
+Value *NatBuilder::createTableLookup(Instruction &inst) {
+  CostModel costModel(platInfo, config, vecInfo);
+  TableLookup lookup;
+  bool isTable = costModel.getTableLookup(inst, lookup);
+  assert(isTable && "not a table lookup");
+  (void) isTable;
+
+  auto &elemTy = *inst.getType();
+  auto *tableTy = cast<ArrayType>(lookup.table->getValueType());
+  auto *tableInit = lookup.table->getInitializer();
+  auto *vecTy = FixedVectorType::get(&elemTy, vectorWidth());
+  unsigned width = vectorWidth();
+
+  // the table registers (constant vectors, materialized once by the backend)
+  SmallVector<Value *, 4> parts;
+  for (unsigned p = 0; p < lookup.numParts; ++p) {
+    SmallVector<Constant *, 16> entries;
+    for (unsigned i = 0; i < width; ++i) {
+      uint64_t k = p * width + i;
+      entries.push_back(k < tableTy->getNumElements() ? tableInit->getAggregateElement(k) : Constant::getNullValue(&elemTy));
     }
+    parts.push_back(ConstantVector::get(entries));
+  }
 
-    if (load) {
-      vecMem = createContiguousLoad(targetType, ptr, alignment, mask, UndefValue::get(vecType));
-      transposer.add(vecMem);
-    } else {
-      Value *val = transposer.shuffleToInterleaved(builder, stride, i);
-      vecMem = createContiguousStore(val, ptr, alignment, mask);
-      if (i < srcs->size())
-        mapVectorValue((*srcs)[i], vecMem);
+  // lane indices in the element width (pshufb/tbl take byte indices, vperm 32-bit indices)
+  auto &index = const_cast<Value &>(*lookup.index);
+  auto &idxTy = elemTy.isIntegerTy(8) ? *builder.getInt8Ty() : *builder.getInt32Ty();
+  Value *indices = index.getType()->getIntegerBitWidth() < idxTy.getBitWidth()
+                       ? builder.CreateSExt(requestVectorValue(&index), getVectorType(&idxTy, width), "table_idx")
+                       : requestNarrowIndex(index, idxTy);
+
+  // the permutation instructions only read the low index bits (in-bounds indices select within a group of registers)
+  Module *mod = vecInfo.getVectorFunction().getParent();
+  bool isFP = elemTy.isFloatingPointTy();
+  auto permute = [&](ArrayRef<Value *> regs) -> Value * {
+    if (elemTy.isIntegerTy(8)) {
+      if (config.useADVSIMD) {
+        static const Intrinsic::ID tblIDs[] = {Intrinsic::aarch64_neon_tbl1, Intrinsic::aarch64_neon_tbl2,
+                                               Intrinsic::aarch64_neon_tbl3, Intrinsic::aarch64_neon_tbl4};
+        SmallVector<Value *, 5> args(regs.begin(), regs.end());
+        args.push_back(indices);
+        return builder.CreateCall(Intrinsic::getDeclaration(mod, tblIDs[regs.size() - 1], {vecTy}), args, "table_tbl");
+      }
+      return builder.CreateCall(Intrinsic::getDeclaration(mod, Intrinsic::x86_ssse3_pshuf_b_128), {regs[0], indices}, "table_pshufb");
+    }
+    if (width == 16 && regs.size() == 2) {
+      auto id = isFP ? Intrinsic::x86_avx512_vpermi2var_ps_512 : Intrinsic::x86_avx512_vpermi2var_d_512;
+      return builder.CreateCall(Intrinsic::getDeclaration(mod, id), {regs[0], indices, regs[1]}, "table_vpermt2");
     }
+    Intrinsic::ID id = width == 16 ? (isFP ? Intrinsic::x86_avx512_permvar_sf_512 : Intrinsic::x86_avx512_permvar_si_512)
+                                   : (isFP ? Intrinsic::x86_avx2_permps : Intrinsic::x86_avx2_permd);
+    return builder.CreateCall(Intrinsic::getDeclaration(mod, id), {regs[0], indices}, "table_vperm");
+  };
+
+  // blend the lookups in the groups of registers by the high index bits
+  Value *result = nullptr;
+  for (unsigned p = 0; p < lookup.numParts; p += lookup.partsPerLookup) {
+    auto regs = ArrayRef<Value *>(parts).slice(p, std::min(lookup.partsPerLookup, lookup.numParts - p));
+    Value *groupVal = permute(regs);
+    if (!result) {
+      result = groupVal;
+      continue;
+    }
+    auto *inGroup = builder.CreateICmpUGE(indices, ConstantInt::get(indices->getType(), p * width), "table_group");
+    result = builder.CreateSelect(inGroup, groupVal, result, "table_blend");
   }
-  if (load) {
-    // de-interleave and map
-    for (unsigned i = 0; i < stride; ++i) {
-      vecMem = transposer.shuffleFromInterleaved(builder, stride, i);
-      if (i < srcs->size())
-        mapVectorValue((*srcs)[i], vecMem);
+
+  ++numTableLookups;
+  return result;
+}
+
+const InterleavedGroup *
+NatBuilder::getInterleavedGroup(Instruction &inst) {
+  if (!config.enableInterleavedAccess) return nullptr;
+
+  auto *block = inst.getParent();
+  auto itGroups = interleavedGroups.find(block);
+  if (itGroups == interleavedGroups.end()) {
+    auto &groups = interleavedGroups[block];
+    Value *predicate = vecInfo.getPredicate(*block);
+    bool needsMask = predicate && !vecInfo.getVectorShape(*predicate).isUniform();
+
+    // divergent blocks (and gaps in store groups) need masked moves
+    if (!needsMask || config.enableMaskedMove) {
+      MemoryAccessGrouper grouper(SE, 0);
+      grouper.collectInterleavedGroups(*block, [&](Instruction &access) -> int64_t {
+        if (keepScalar.count(&access)) return 0;
+        VectorShape addrShape = getVectorShape(*getLoadStorePointerOperand(&access));
+        return addrShape.isStrided() ? addrShape.getStride() : 0;
+      }, config.enableMaskedMove, groups);
+    }
+    itGroups = interleavedGroups.find(block);
+  }
+
+  for (auto &group : itGroups->second) {
+    if (std::find(group.members.begin(), group.members.end(), &inst) != group.members.end())
+      return &group;
+  }
+  return nullptr;
+}
+
+void NatBuilder::createInterleavedGroup(const InterleavedGroup &group) {
+  auto &leader = *group.leader;
+  bool isStore = group.isStoreGroup();
+  unsigned factor = group.getFactor();
+  auto &ctx = builder.getContext();
+
+  // members of different types are shuffled as integers of the slot size
+  Type *slotTy = nullptr;
+  for (auto *member : group.members) {
+    if (!member) continue;
+    Type *memberTy = getLoadStoreType(member);
+    if (!slotTy) slotTy = memberTy;
+    else if (slotTy != memberTy) slotTy = IntegerType::get(ctx, group.slotSize * 8);
+  }
+  auto *chunkTy = FixedVectorType::get(slotTy, vectorWidth());
+
+  // even/odd and low/high two-source shuffles are single permutes on these targets (uzp/zip, vpermt2*, shufps/unpck)
+  uint64_t chunkBits = layout.getTypeSizeInBits(chunkTy);
+  bool shuffleTrees = config.enableShuffleTrees && (config.useADVSIMD || config.useNEON || config.useAVX512 || (config.useSSE && chunkBits <= 128));
+
+  // slot m of the interleaved chunks is active in the lanes of the block predicate (none for store gaps)
+  Value *predicate = vecInfo.getPredicate(*leader.getParent());
+  bool needsMask = predicate && !vecInfo.getVectorShape(*predicate).isUniform();
+  bool maskGaps = isStore && group.hasGaps();
+  ShuffleBuilder maskTransposer(vectorWidth(), shuffleTrees);
+  if (needsMask || maskGaps) {
+    Value *laneMask = needsMask ? requestVectorValue(predicate) : getConstantVector(vectorWidth(), i1Ty, 1);
+    Value *noLanes = getConstantVector(vectorWidth(), i1Ty, 0);
+    for (auto *member : group.members)
+      maskTransposer.add((member || !isStore) ? laneMask : noLanes);
+  }
+
+  // chunk i starts i * vectorWidth slots after the first slot of lane 0
+  auto *leaderPtr = getLoadStorePointerOperand(&leader);
+  int64_t leaderOffset = (std::find(group.members.begin(), group.members.end(), &leader) - group.members.begin()) * group.slotSize;
+  Value *ptr = requestScalarValue(leaderPtr);
+  unsigned addrSpace = ptr->getType()->getPointerAddressSpace();
+  auto *indexTy = getIndexTy(ptr);
+  Value *basePtr = builder.CreatePointerCast(ptr, Type::getInt8PtrTy(ctx, addrSpace));
+  if (leaderOffset)
+    basePtr = builder.CreateGEP(builder.getInt8Ty(), basePtr, ConstantInt::get(indexTy, -leaderOffset), "inter_base");
+
+  auto *first = group.members[0];
+  VectorShape firstShape = getVectorShape(*getLoadStorePointerOperand(first));
+  llvm::Align baseAlign = std::max<llvm::Align>(llvm::Align(firstShape.getAlignmentFirst()), getLoadStoreAlignment(first));
+
+  std::vector<Value *> chunkPtrs;
+  std::vector<llvm::Align> chunkAligns;
+  for (unsigned i = 0; i < factor; ++i) {
+    uint64_t chunkOffset = i * vectorWidth() * group.slotSize;
+    Value *chunkPtr = basePtr;
+    if (chunkOffset)
+      chunkPtr = builder.CreateGEP(builder.getInt8Ty(), basePtr, ConstantInt::get(indexTy, chunkOffset), "inter_gep");
+    chunkPtrs.push_back(builder.CreatePointerCast(chunkPtr, chunkTy->getPointerTo(addrSpace)));
+    chunkAligns.push_back(commonAlignment(baseAlign, chunkOffset));
+    ++numInterGEPs;
+  }
+
+  ShuffleBuilder transposer(vectorWidth(), shuffleTrees);
+  if (!isStore) {
+    // load the chunks and de-interleave the members
+    for (unsigned i = 0; i < factor; ++i) {
+      Value *mask = needsMask ? maskTransposer.shuffleToInterleaved(builder, factor, i) : nullptr;
+      transposer.add(createContiguousLoad(chunkTy, chunkPtrs[i], chunkAligns[i], mask, UndefValue::get(chunkTy)));
+    }
+    needsMask ? ++numInterMaskedLoads : ++numInterLoads;
+
+    for (unsigned m = 0; m < factor; ++m) {
+      auto *member = group.members[m];
+      if (!member) continue;
+      Value *memberVal = transposer.shuffleFromInterleaved(builder, factor, m);
+      auto *memberVecTy = getVectorType(member->getType(), vectorWidth());
+      if (memberVal->getType() != memberVecTy)
+        memberVal = builder.CreateBitCast(memberVal, memberVecTy);
+      mapVectorValue(member, memberVal);
+    }
+    return;
+  }
+
+  // interleave the stored members (gaps are masked out)
+  for (auto *member : group.members) {
+    Value *val = member ? requestVectorValue(cast<StoreInst>(member)->getValueOperand()) : UndefValue::get(chunkTy);
+    if (val->getType() != chunkTy)
+      val = builder.CreateBitCast(val, chunkTy);
+    transposer.add(val);
+  }
+
+  Value *vecMem = nullptr;
+  for (unsigned i = 0; i < factor; ++i) {
+    Value *mask = (needsMask || maskGaps) ? maskTransposer.shuffleToInterleaved(builder, factor, i) : nullptr;
+    Value *chunk = transposer.shuffleToInterleaved(builder, factor, i);
+    vecMem = createContiguousStore(chunk, chunkPtrs[i], chunkAligns[i], mask);
+  }
+  (needsMask || maskGaps) ? ++numInterMaskedStores : ++numInterStores;
+
+  for (auto *member : group.members) {
+    if (member) mapVectorValue(member, vecMem);
+  }
+}
+
+// wide gather elements: 64 bit is the widest element of the native gathers (AVX2, AVX-512, SVE)
+static const unsigned MaxCoalescedElemSize = 8;
+
+const CoalescedGather *
+NatBuilder::getCoalescedGather(Instruction &inst) {
+  if (!config.enableGatherCoalescing || !isa<LoadInst>(inst)) return nullptr;
+
+  auto *block = inst.getParent();
+  auto itGroups = coalescedGathers.find(block);
+  if (itGroups == coalescedGathers.end()) {
+    auto &groups = coalescedGathers[block];
+    Value *predicate = vecInfo.getPredicate(*block);
+    bool needsMask = predicate && !vecInfo.getVectorShape(*predicate).isUniform();
+
+    // only loads that would become gathers (select splits, spans, cascades and tables are cheaper on their own)
+    MemoryAccessGrouper grouper(SE, 0);
+    grouper.collectCoalescedGathers(*block, [&](LoadInst &load) {
+      if (keepScalar.count(&load)) return false;
+      auto *ptr = load.getPointerOperand();
+      if (config.enableSelectAccessSplit && isa<SelectInst>(ptr)) return false;
+      VectorShape addrShape = getVectorShape(*ptr);
+      if (addrShape.isUniform() || addrShape.hasStridedShape()) return false;
+      return pickVaryingAccess(load, needsMask) == VaryingAccessKind::GatherScatter;
+    }, MaxCoalescedElemSize, groups);
+    itGroups = coalescedGathers.find(block);
+  }
+
+  for (auto &group : itGroups->second) {
+    for (auto &member : group.members) {
+      if (member.load == &inst) return &group;
     }
   }
+  return nullptr;
+}
+
+void NatBuilder::createCoalescedGather(const CoalescedGather &group) {
+  auto &leader = *group.leader;
+  auto &ctx = builder.getContext();
+
+  Value *predicate = vecInfo.getPredicate(*leader.getParent());
+  bool needsMask = predicate && !vecInfo.getVectorShape(*predicate).isUniform();
+  Value *mask = needsMask ? requestVectorValue(predicate) : getConstantVector(vectorWidth(), i1Ty, 1);
+
+  // window w of lane j starts group.windows[w] bytes after the leader address of lane j
+  auto *leaderPtr = leader.getPointerOperand();
+  Value *vecPtr = requestVectorValue(leaderPtr);
+  emitPrefetches(leader, *leaderPtr, *vecPtr);
+  unsigned addrSpace = leaderPtr->getType()->getPointerAddressSpace();
+  auto *indexTy = getIndexTy(leaderPtr);
+  Value *bytePtrs = builder.CreatePointerCast(vecPtr, FixedVectorType::get(Type::getInt8PtrTy(ctx, addrSpace), vectorWidth()));
+
+  auto *elemTy = IntegerType::get(ctx, group.elemSize * 8);
+  auto *wideTy = FixedVectorType::get(elemTy, vectorWidth());
+  auto *widePtrTy = FixedVectorType::get(elemTy->getPointerTo(addrSpace), vectorWidth());
+  VectorShape addrShape = getVectorShape(*leaderPtr);
+  llvm::Align leaderAlign = std::max<llvm::Align>(llvm::Align(addrShape.getAlignmentGeneral()), leader.getAlign());
+
+  std::vector<Value *> windows;
+  for (int64_t start : group.windows) {
+    Value *ptrs = bytePtrs;
+    if (start)
+      ptrs = builder.CreateGEP(builder.getInt8Ty(), bytePtrs, ConstantInt::get(indexTy, start), "coalesced_gep");
+    ptrs = builder.CreatePointerCast(ptrs, widePtrTy);
+    windows.push_back(createVaryingMemory(VaryingAccessKind::GatherScatter, wideTy, commonAlignment(leaderAlign, start), ptrs, mask, nullptr));
+  }
+  numCoalescedGathers += group.windows.size();
+  numCoalescedLoads += group.members.size();
+
+  // member m is every (elemSize / size)-th slot of its window
+  for (auto &member : group.members) {
+    auto *memberTy = member.load->getType();
+    unsigned size = layout.getTypeStoreSize(memberTy);
+    unsigned ratio = group.elemSize / size;
+    auto *slotsTy = FixedVectorType::get(IntegerType::get(ctx, size * 8), vectorWidth() * ratio);
+    Value *slots = builder.CreateBitCast(windows[member.window], slotsTy);
+
+    unsigned slot = layout.isLittleEndian() ? member.slot : ratio - 1 - member.slot;
+    SmallVector<int, 16> laneSlots;
+    for (int j = 0; j < vectorWidth(); ++j) laneSlots.push_back(j * ratio + slot);
+    Value *memberVal = builder.CreateShuffleVector(slots, laneSlots, member.load->getName() + ".field");
+
+    auto *memberVecTy = getVectorType(memberTy, vectorWidth());
+    if (memberVal->getType() != memberVecTy)
+      memberVal = builder.CreateBitCast(memberVal, memberVecTy);
+    mapVectorValue(member.load, memberVal);
+  }
 }
 
 Value *NatBuilder::createContiguousStore(Value *val, Value *ptr, llvm::Align alignment, Value *mask) {
   if (mask) {
-    return builder.CreateMaskedStore(val, ptr, alignment, mask);
+    return tagAccess(builder.CreateMaskedStore(val, ptr, alignment, mask));
 
   } else {
     StoreInst *store = builder.CreateStore(val, ptr);
     store->setAlignment(llvm::Align(alignment));
-    return store;
+    return tagAccess(store);
+  }
+}
+
+void NatBuilder::collectLoadedObjects() {
+  vecInfo.getRegion().for_blocks([&](const BasicBlock & block) {
+    for (auto & inst : block) {
+      if (auto *load = dyn_cast<LoadInst>(&inst))
+        loadedObjects.insert(getUnderlyingObject(load->getPointerOperand()));
+    }
+    return true;
+  });
+}
+
+bool NatBuilder::isStreamingStore(StoreInst &scaStore, Type &vecType, llvm::Align alignment) {
+  if (!config.enableStreamingStores || !vecInfo.getRegion().isVectorLoop() || !scaStore.isSimple()) return false;
+
+  // only whole aligned vectors bypass the cache (the backend splits everything else into regular stores)
+  if (alignment.value() < layout.getTypeStoreSize(&vecType)) return false;
+
+  // the loop must not read what it writes
+  return !loadedObjects.count(getUnderlyingObject(scaStore.getPointerOperand()));
+}
+
+void NatBuilder::fenceStreamingStores() {
+  bool isX86 = config.useSSE || config.useAVX || config.useAVX2 || config.useAVX512;
+  if (!isX86) return;
+
+  // nontemporal stores are weakly ordered on x86
+  SmallPtrSet<BasicBlock *, 4> exits;
+  vecInfo.getRegion().for_blocks([&](const BasicBlock & block) {
+    for (auto *succ : successors(&block)) {
+      if (!vecInfo.inRegion(*succ)) exits.insert(const_cast<BasicBlock *>(succ));
+    }
+    return true;
+  });
+
+  Module *mod = vecInfo.getMapping().vectorFn->getParent();
+  Function *sfence = Intrinsic::getDeclaration(mod, Intrinsic::x86_sse_sfence);
+  for (auto *exit : exits) {
+    IRBuilder<> exitBuilder(exit, exit->getFirstInsertionPt());
+    exitBuilder.CreateCall(sfence);
   }
 }
 
+Value *NatBuilder::requestEntryEVL() {
+  auto *avl = vecInfo.getEntryAVL();
+  if (!avl) return nullptr;
+  return builder.CreateZExtOrTrunc(requestScalarValue(avl), builder.getInt32Ty(), "evl");
+}
+
+Value *NatBuilder::createVPLoad(Type *vecType, Value *ptr, llvm::Align alignment, Value *mask, Value &evl) {
+  auto *vpLoad = builder.CreateIntrinsic(Intrinsic::vp_load, {vecType, ptr->getType()}, {ptr, mask, &evl}, nullptr, "vp_load");
+  vpLoad->addParamAttr(0, Attribute::getWithAlignment(builder.getContext(), alignment));
+  return tagAccess(vpLoad);
+}
+
+Value *NatBuilder::createVPStore(Value *val, Value *ptr, llvm::Align alignment, Value *mask, Value &evl) {
+  auto *vpStore = builder.CreateIntrinsic(Intrinsic::vp_store, {val->getType(), ptr->getType()}, {val, ptr, mask, &evl});
+  vpStore->addParamAttr(1, Attribute::getWithAlignment(builder.getContext(), alignment));
+  return tagAccess(vpStore);
+}
+
 Value *NatBuilder::createContiguousLoad(Type *targetType, Value *ptr, llvm::Align alignment, Value *mask, Value *passThru) {
   if (mask) {
-    return builder.CreateMaskedLoad(targetType, ptr, alignment, mask, passThru, "cont_load_masked");
+    return tagAccess(builder.CreateMaskedLoad(targetType, ptr, alignment, mask, passThru, "cont_load_masked"));
   } else {
     LoadInst *load = builder.CreateLoad(targetType, ptr, "cont_load");
     load->setAlignment(llvm::Align(alignment));
-    return load;
+    return tagAccess(load);
   }
 }
 
+Value *NatBuilder::tagAccess(Value *access) {
+  auto *accessInst = dyn_cast<Instruction>(access);
+  if (!config.enableAccessMetadata || !accessInst || accessSources.empty()) return access;
+
+  // every lane of the vector access is one of the scalar accesses (of the same underlying object), their common
+  // TBAA tags, scopes and access groups hold for the whole vector access
+  propagateMetadata(accessInst, accessSources);
+  return access;
+}
+
 void NatBuilder::addLazyInstruction(Instruction *const instr) {
   lazyInstructions.push_back(instr);
   ++numLazy;
@@ -2242,6 +5168,135 @@ SetInsertBeforeTerm(IRBuilder<> & builder, BasicBlock & block) {
     builder.SetInsertPoint(&block);
 }
 
+void
+NatBuilder::vectorizeAggregateInstruction(Instruction & inst) {
+  // varying aggregates are kept in struct-of-vectors form, insertvalue/extractvalue keep their indices
+  Value * vecVal = nullptr;
+  if (auto * extract = dyn_cast<ExtractValueInst>(&inst)) {
+    auto * vecAgg = requestVectorValue(extract->getAggregateOperand());
+    vecVal = builder.CreateExtractValue(vecAgg, extract->getIndices(), inst.getName());
+  } else {
+    auto & insert = cast<InsertValueInst>(inst);
+    auto * vecAgg = requestVectorValue(insert.getAggregateOperand());
+    auto * vecElem = requestVectorValue(insert.getInsertedValueOperand());
+    vecVal = builder.CreateInsertValue(vecAgg, vecElem, insert.getIndices(), inst.getName());
+  }
+
+  mapVectorValue(&inst, vecVal);
+  ++numVectorized;
+}
+
+bool
+NatBuilder::isWidenedShortVector(const Type & ty) const {
+  auto * vecTy = dyn_cast<FixedVectorType>(&ty);
+  if (!config.enableVectorWidening || !vecTy) return false;
+  auto * elemTy = vecTy->getElementType();
+  return elemTy->isIntegerTy() || elemTy->isFloatingPointTy();
+}
+
+bool
+NatBuilder::canWidenShortVectorOp(const Instruction & inst) const {
+  if (!isWidenedShortVector(*inst.getOperand(0)->getType())) return false;
+  // varying or dynamic element indices are replicated
+  if (auto * extract = dyn_cast<ExtractElementInst>(&inst)) return isa<ConstantInt>(extract->getIndexOperand());
+  if (auto * insert = dyn_cast<InsertElementInst>(&inst)) return isa<ConstantInt>(insert->getOperand(2));
+  return isa<ShuffleVectorInst>(inst);
+}
+
+void
+NatBuilder::vectorizeShortVectorInstruction(Instruction & inst) {
+  // element j of lane i is at j * W + i: element accesses become shuffles of whole W-lane groups
+  auto * vecOp = requestVectorValue(inst.getOperand(0));
+  unsigned numElems = cast<FixedVectorType>(inst.getOperand(0)->getType())->getNumElements();
+  int width = vectorWidth();
+
+  Value * vecVal = nullptr;
+  if (auto * extract = dyn_cast<ExtractElementInst>(&inst)) {
+    uint64_t elemIdx = cast<ConstantInt>(extract->getIndexOperand())->getZExtValue();
+    SmallVector<int, 16> laneMask;
+    for (int i = 0; i < width; ++i) laneMask.push_back(elemIdx < numElems ? (int) (elemIdx * width + i) : -1);
+    vecVal = builder.CreateShuffleVector(vecOp, laneMask, inst.getName() + "_SIMD");
+
+  } else if (auto * insert = dyn_cast<InsertElementInst>(&inst)) {
+    uint64_t elemIdx = cast<ConstantInt>(insert->getOperand(2))->getZExtValue();
+    if (elemIdx >= numElems) {
+      vecVal = PoisonValue::get(vecOp->getType());
+    } else {
+      // pad the inserted lanes to the wide vector, then blend them into their element group
+      auto * vecElem = requestVectorValue(insert->getOperand(1));
+      SmallVector<int, 32> padMask, blendMask;
+      for (unsigned k = 0; k < numElems * width; ++k) {
+        padMask.push_back(k < (unsigned) width ? (int) k : -1);
+        blendMask.push_back(k / width == elemIdx ? (int) (numElems * width + k % width) : (int) k);
+      }
+      auto * padded = builder.CreateShuffleVector(vecElem, padMask);
+      vecVal = builder.CreateShuffleVector(vecOp, padded, blendMask, inst.getName() + "_SIMD");
+    }
+
+  } else {
+    auto & shuffle = cast<ShuffleVectorInst>(inst);
+    auto * vecOp2 = requestVectorValue(shuffle.getOperand(1));
+    vecVal = builder.CreateShuffleVector(vecOp, vecOp2, getWidenedShuffleMask(shuffle.getShuffleMask(), width),
+                                         inst.getName() + "_SIMD");
+  }
+
+  mapVectorValue(&inst, vecVal);
+  ++numVectorized;
+}
+
+bool
+NatBuilder::vectorizeShortVectorMemory(Instruction & inst) {
+  auto * load = dyn_cast<LoadInst>(&inst);
+  auto * store = dyn_cast<StoreInst>(&inst);
+  if (load ? !load->isSimple() : !store->isSimple()) return false;
+
+  // only back-to-back short vectors (no padding as in <3 x float>)
+  auto * shortTy = cast<FixedVectorType>(getLoadStoreType(&inst));
+  auto * accessedPtr = getLoadStorePointerOperand(&inst);
+  uint64_t byteSize = layout.getTypeStoreSize(shortTy);
+  VectorShape addrShape = getVectorShape(*accessedPtr);
+  if (byteSize != layout.getTypeAllocSize(shortTy) || !addrShape.isStrided(byteSize)) return false;
+
+  Value * predicate = vecInfo.getPredicate(*inst.getParent());
+  bool needsMask = predicate && !vecInfo.getVectorShape(*predicate).isUniform();
+  if (needsMask && !config.enableMaskedMove) return false;
+
+  auto outerSources = std::move(accessSources);
+  accessSources.clear();
+  accessSources.push_back(&inst);
+
+  // memory holds the lanes in AoS order (lane i at i * k + j)
+  unsigned numElems = shortTy->getNumElements();
+  int width = vectorWidth();
+  auto * aosTy = FixedVectorType::get(shortTy->getElementType(), numElems * width);
+  Value * aosMask = nullptr;
+  if (needsMask) {
+    SmallVector<int, 32> laneMask;
+    for (int i = 0; i < width; ++i) {
+      for (unsigned j = 0; j < numElems; ++j) laneMask.push_back(i);
+    }
+    aosMask = builder.CreateShuffleVector(requestVectorValue(predicate), laneMask, "aos_mask");
+  }
+
+  Value * ptr = requestScalarValue(accessedPtr);
+  llvm::Align alignment = std::max<llvm::Align>(llvm::Align(addrShape.getAlignmentFirst()),
+                                                load ? load->getAlign() : store->getAlign());
+  if (load) {
+    auto * aosVal = createContiguousLoad(aosTy, ptr, alignment, aosMask, UndefValue::get(aosTy));
+    auto * soaVal = builder.CreateShuffleVector(aosVal, getTransposeMask(width, numElems), load->getName() + "_SIMD");
+    mapVectorValue(load, soaVal);
+    needsMask ? ++numContMaskedLoads : ++numContLoads;
+  } else {
+    auto * soaVal = requestVectorValue(store->getValueOperand());
+    auto * aosVal = builder.CreateShuffleVector(soaVal, getTransposeMask(numElems, width), "aos");
+    mapVectorValue(store, createContiguousStore(aosVal, ptr, alignment, aosMask));
+    needsMask ? ++numContMaskedStores : ++numContStores;
+  }
+
+  accessSources = std::move(outerSources);
+  return true;
+}
+
 llvm::Value*
 NatBuilder::requestVectorValue(Value *const value) {
   if (isa<GetElementPtrInst>(value))
@@ -2265,8 +5320,19 @@ NatBuilder::requestVectorValue(Value *const value) {
   auto oldIB = builder.GetInsertBlock();
 
   auto shape = getVectorShape(*value);
-  if (shape.isVarying()) { // !vecValue
-    auto * vecTy = FixedVectorType::get(value->getType(), vectorWidth());
+  auto * sovTy = shape.isVarying() ? getStructOfVectorsType(*value->getType(), vectorWidth()) : nullptr;
+  if (sovTy && value->getType()->isAggregateType()) {
+    // pack the replicated lane aggregates member-wise
+    ValVec laneVals;
+    for (int i = 0; i < vectorWidth(); ++i) {
+      laneVals.push_back(getScalarValue(*value, i));
+      auto * laneInst = dyn_cast<Instruction>(laneVals.back());
+      if (laneInst) SetInsertBeforeTerm(builder, *laneInst->getParent());
+    }
+    vecValue = CreatePackedAggregate(builder, *sovTy, *value->getType(), laneVals);
+
+  } else if (shape.isVarying()) { // !vecValue
+    auto * vecTy = getVectorType(value->getType(), vectorWidth());
     Value * accu = UndefValue::get(vecTy);
     auto * intTy = Type::getInt32Ty(builder.getContext());
 
@@ -2274,15 +5340,25 @@ NatBuilder::requestVectorValue(Value *const value) {
       auto * laneVal = getScalarValue(*value, i);
       auto * laneInst = dyn_cast<Instruction>(laneVal);
       if (laneInst) SetInsertBeforeTerm(builder, *laneInst->getParent());
-      accu = builder.CreateInsertElement(accu, laneVal, ConstantInt::get(intTy, i, false), "_revec");
+      if (laneVal->getType()->isVectorTy())
+        accu = createShortVectorLaneInsert(builder, accu, laneVal, vectorWidth(), i);
+      else
+        accu = builder.CreateInsertElement(accu, laneVal, ConstantInt::get(intTy, i, false), "_revec");
     }
     vecValue = accu;
 
   } else {
     vecValue = getScalarValue(*value);
     Instruction *vecInst = dyn_cast<Instruction>(vecValue);
+    auto * scaInst = dyn_cast<Instruction>(value);
+    const BasicBlock * broadcastBlock = (vecInst && scaInst) ? getBroadcastBlock(*scaInst) : nullptr;
+
+    if (broadcastBlock && broadcastBlock == curScaBlock) {
+      // right before the first user (all other users follow in this block or in blocks that it dominates)
+    } else if (broadcastBlock) {
+      SetInsertBeforeTerm(builder, *getVectorBlock(const_cast<BasicBlock&>(*broadcastBlock), true));
 
-    if (vecInst) {
+    } else if (vecInst) {
       SetInsertBeforeTerm(builder, *vecInst->getParent());
 
     } else {
@@ -2295,7 +5371,9 @@ NatBuilder::requestVectorValue(Value *const value) {
       }
     }
 
-    vecValue = &widenScalar(*vecValue, shape);
+    auto * intTy = dyn_cast<IntegerType>(value->getType());
+    Value * indVec = (intTy && !shape.isUniform()) ? requestInductionVector(*value, *intTy) : nullptr;
+    vecValue = indVec ? indVec : &widenScalar(*vecValue, shape);
   }
 
   // recover insertpoint
@@ -2305,12 +5383,57 @@ NatBuilder::requestVectorValue(Value *const value) {
   return vecValue;
 }
 
+const BasicBlock *
+NatBuilder::getBroadcastBlock(const Instruction & scaInst) {
+  if (!config.enableUniformOffload || !curScaBlock) return nullptr;
+  // predicates are also requested by blocks that do not use them
+  if (scaInst.getType()->isIntegerTy(1)) return nullptr;
+  const BasicBlock * defBlock = scaInst.getParent();
+  if (!vecInfo.inRegion(*defBlock)) return nullptr;
+
+  // nearest common dominator of all users
+  const BasicBlock * useDom = nullptr;
+  for (const Use & use : scaInst.uses()) {
+    auto * userInst = cast<Instruction>(use.getUser());
+    const BasicBlock * useBlock = userInst->getParent();
+    if (auto * phi = dyn_cast<PHINode>(userInst)) useBlock = phi->getIncomingBlock(use);
+    if (!vecInfo.inRegion(*useBlock)) return nullptr;
+    useDom = useDom ? dominatorTree.findNearestCommonDominator(useDom, useBlock) : useBlock;
+  }
+  if (!useDom) return nullptr;
+
+  // do not sink into loops that do not contain the definition (the broadcast stays in front of the loop)
+  for (;;) {
+    if (useDom == defBlock) return nullptr;
+    const Loop * useLoop = loopInfo.getLoopFor(useDom);
+    if (!useLoop || useLoop->contains(defBlock)) break;
+    useDom = dominatorTree.getNode(useDom)->getIDom()->getBlock();
+  }
+
+  // the current block or a complete block (dominator tree pre-order) that dominates it
+  if (useDom == curScaBlock) {
+    return builder.GetInsertBlock() == getVectorBlock(const_cast<BasicBlock&>(*curScaBlock), true) ? useDom : nullptr;
+  }
+  return dominatorTree.dominates(useDom, curScaBlock) ? useDom : nullptr;
+}
+
 Value&
 NatBuilder::widenScalar(Value & scaValue, VectorShape vecShape) {
+  if (scaValue.getType()->isAggregateType()) {
+    auto * sovTy = getStructOfVectorsType(*scaValue.getType(), vectorWidth());
+    assert(sovTy && vecShape.isUniform() && "can not widen this aggregate");
+    return *CreateBroadcastAggregate(builder, *sovTy, scaValue, vectorWidth());
+  }
+
   if (isa<Constant>(scaValue)) {
     return *getConstantVector(vectorWidth(), &cast<Constant>(scaValue));
   }
 
+  if (scaValue.getType()->isVectorTy()) {
+    assert(vecShape.isUniform() && "short vectors have no stride");
+    return *createShortVectorBroadcast(builder, &scaValue, vectorWidth());
+  }
+
   // create a vector GEP to widen pointers
   Value * vecValue = nullptr;
   if (scaValue.getType()->isPointerTy()) {
@@ -2329,12 +5452,12 @@ NatBuilder::widenScalar(Value & scaValue, VectorShape vecShape) {
       int scalarBytes = static_cast<int>(layout.getTypeStoreSize(ptrElemTy));
       if (vecShape.getStride() % scalarBytes == 0) {
         // stride aligned with object size
-        Value *contVec = createContiguousVector(vectorWidth(), intTy, 0, vecShape.getStride() / scalarBytes);
+        Value *contVec = getLaneIndexVector(*intTy, vecShape.getStride() / scalarBytes);
         vecValue = builder.CreateGEP(scalarPtrTy->getPointerElementType(), vecValue, contVec, "expand_strided_ptr");
       } else {
         // sub element stride
         auto * charPtrTy = builder.getInt8PtrTy(AddrSpace);
-        Value *contVec = createContiguousVector(vectorWidth(), intTy, 0, vecShape.getStride());
+        Value *contVec = getLaneIndexVector(*intTy, vecShape.getStride());
         vecValue = builder.CreateGEP(builder.getInt8Ty(), vecValue, contVec, "expand_byte_ptr");
       }
     }
@@ -2346,7 +5469,7 @@ NatBuilder::widenScalar(Value & scaValue, VectorShape vecShape) {
       assert(scaValue.getType()->isIntegerTy() || scaValue.getType()->isFloatingPointTy());
 
       auto *laneTy = scaValue.getType();
-      Value *contVec = createContiguousVector(vectorWidth(), laneTy, 0, vecShape.getStride());
+      Value *contVec = getLaneIndexVector(*laneTy, vecShape.getStride());
       vecValue = laneTy->isFloatingPointTy() ? builder.CreateFAdd(vecValue, contVec, "contiguous_add")
                                              : builder.CreateAdd(vecValue, contVec, "contiguous_add");
     }
@@ -2460,6 +5583,10 @@ Value *NatBuilder::requestScalarValue(Value *const value, unsigned laneIdx, bool
       if (isa<GetElementPtrInst>(mappedVal) && isa<GetElementPtrInst>(value)) {
         auto indexTy = getIndexTy(mappedVal);
         reqVal = builder.CreateGEP(cast<GetElementPtrInst>(mappedVal)->getSourceElementType(), mappedVal, ConstantInt::get(indexTy, laneIdx));
+      } else if (IsStructOfVectors(*mappedVal->getType())) {
+        reqVal = CreateLaneAggregate(builder, *mappedVal, *value->getType(), laneIdx);
+      } else if (value->getType()->isVectorTy()) {
+        reqVal = createShortVectorLaneExtract(builder, mappedVal, vectorWidth(), laneIdx);
       } else {
         reqVal = builder.CreateExtractElement(mappedVal, ConstantInt::get(i32Ty, laneIdx), "extract");
       }
@@ -2511,24 +5638,107 @@ NatBuilder::buildGEP(GetElementPtrInst *const gep, bool buildScalar, unsigned la
     VectorShape idxShape = getVectorShape(*idx);
 
     Value *vecIdx;
+    auto *idxTy = dyn_cast<IntegerType>(idx->getType());
     if (buildScalar || (idxShape.isUniform() && !basePtrShape.isUniform()))
       vecIdx = requestScalarValue(idx, laneIdx);
-    else {
+    else if (config.enableIndexNarrowing && idxShape.isVarying() && basePtrShape.isUniform() && idxTy &&
+             idxTy->getBitWidth() > 32 && fitsNarrowIndex(*idx, 32)) {
+      ++numNarrowedIndices;
+      Value *narrowIdx = requestNarrowIndex(*idx, *builder.getInt32Ty());
+      vecIdx = builder.CreateSExt(narrowIdx, getVectorType(idxTy, vectorWidth()), "narrow_idx");
+    } else {
       vecIdx = requestVectorValue(idx);
     }
 
     idxList.push_back(vecIdx);
   }
 
-  Value * vecGEP = builder.CreateGEP(vecBasePtrElementType, vecBasePtr, idxList, gep->getName());
-  auto * vecGEPInst = dyn_cast<GetElementPtrInst>(vecGEP);
-  if (vecGEPInst) {
-    vecGEPInst->setIsInBounds(gep->isInBounds());
+  Value * vecGEP = builder.CreateGEP(vecBasePtrElementType, vecBasePtr, idxList, gep->getName());
+  auto * vecGEPInst = dyn_cast<GetElementPtrInst>(vecGEP);
+  if (vecGEPInst) {
+    vecGEPInst->setIsInBounds(gep->isInBounds());
+  }
+
+  builder.SetInsertPoint(insertBlock, insertPoint);
+
+  return vecGEP;
+}
+
+bool
+NatBuilder::fitsNarrowIndex(Value &idx, unsigned bits) {
+  if (!SE.isSCEVable(idx.getType())) return false;
+  ConstantRange range = SE.getSignedRange(SE.getSCEV(&idx));
+  return range.getSignedMin().isSignedIntN(bits) && range.getSignedMax().isSignedIntN(bits);
+}
+
+// operations on narrowed indexes whose wide users are not rebuilt (one index chain)
+static const unsigned MaxNarrowDepth = 8;
+
+Value *
+NatBuilder::requestNarrowIndex(Value &idx, IntegerType &narrowTy, unsigned depth) {
+  auto key = std::make_pair(&idx, builder.GetInsertBlock());
+  auto itNarrow = narrowIndexMap.find(key);
+  if (itNarrow != narrowIndexMap.end()) return itNarrow->second;
+
+  // the low bits of add/sub/mul/shl/and/or/xor only depend on the low bits of their operands
+  unsigned narrowBits = narrowTy.getBitWidth();
+  auto *vecNarrowTy = getVectorType(&narrowTy, vectorWidth());
+  VectorShape shape = getVectorShape(idx);
+  auto *inst = dyn_cast<Instruction>(&idx);
+  Value *narrow = nullptr;
+
+  if (!shape.isUniform() && shape.hasStridedShape() && (narrow = requestInductionVector(idx, narrowTy))) {
+    // lanes of a vector induction in narrow lanes
+
+  } else if (shape.isUniform() || (shape.hasStridedShape() && std::abs(shape.getStride()) * vectorWidth() < (1ll << (narrowBits - 1)))) {
+    Value *laneZero = builder.CreateTrunc(requestScalarValue(&idx), &narrowTy);
+    narrow = builder.CreateVectorSplat(vectorWidth(), laneZero);
+    if (!shape.isUniform())
+      narrow = builder.CreateAdd(narrow, getLaneIndexVector(narrowTy, shape.getStride()), "narrow_lanes");
+
+  } else if (inst && vecInfo.inRegion(*inst) && depth < MaxNarrowDepth) {
+    switch (inst->getOpcode()) {
+    case Instruction::SExt:
+    case Instruction::ZExt: {
+      auto *src = inst->getOperand(0);
+      unsigned srcBits = src->getType()->getScalarSizeInBits();
+      if (srcBits == narrowBits) {
+        narrow = requestVectorValue(src);
+      } else if (srcBits < narrowBits) {
+        narrow = builder.CreateCast(cast<CastInst>(inst)->getOpcode(), requestVectorValue(src), vecNarrowTy);
+      }
+    } break;
+
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::Mul:
+    case Instruction::And:
+    case Instruction::Or:
+    case Instruction::Xor: {
+      auto *lhs = requestNarrowIndex(*inst->getOperand(0), narrowTy, depth + 1);
+      auto *rhs = requestNarrowIndex(*inst->getOperand(1), narrowTy, depth + 1);
+      narrow = builder.CreateBinOp(cast<BinaryOperator>(inst)->getOpcode(), lhs, rhs, inst->getName() + ".narrow");
+    } break;
+
+    case Instruction::Shl: {
+      auto *amount = dyn_cast<ConstantInt>(inst->getOperand(1));
+      if (amount && amount->getZExtValue() < narrowBits) {
+        auto *lhs = requestNarrowIndex(*inst->getOperand(0), narrowTy, depth + 1);
+        narrow = builder.CreateShl(lhs, amount->getZExtValue(), inst->getName() + ".narrow");
+      }
+    } break;
+
+    default:
+      break;
+    }
   }
 
-  builder.SetInsertPoint(insertBlock, insertPoint);
+  // keep the wide computation
+  if (!narrow)
+    narrow = builder.CreateTrunc(requestVectorValue(&idx), vecNarrowTy);
 
-  return vecGEP;
+  narrowIndexMap[key] = narrow;
+  return narrow;
 }
 
 llvm::Value*
@@ -2571,10 +5781,21 @@ NatBuilder::requestVectorBitCast(BitCastInst *const bc) {
 
   assert(bc->getNumOperands() == 1 && "code for bitcasts changed!");
   Value *op = bc->getOperand(0);
-  Value *vecOp = requestVectorValue(op);
   Type *vecType = getVectorType(bc->getType(), vectorWidth());
 
-  mapped = builder.CreateBitCast(vecOp, vecType, bc->getName());
+  if (cast<FixedVectorType>(vecType)->getNumElements() !=
+      cast<FixedVectorType>(getVectorType(op->getType(), vectorWidth()))->getNumElements()) {
+    // the SoA element order changes (<2 x i64> to <4 x i32>): cast each lane
+    mapped = UndefValue::get(vecType);
+    for (int i = 0; i < vectorWidth(); ++i) {
+      auto *laneVal = builder.CreateBitCast(requestScalarValue(op, i), bc->getType(), bc->getName());
+      mapped = laneVal->getType()->isVectorTy()
+                   ? createShortVectorLaneInsert(builder, mapped, laneVal, vectorWidth(), i)
+                   : builder.CreateInsertElement(mapped, laneVal, builder.getInt32(i), "_revec");
+    }
+  } else {
+    mapped = builder.CreateBitCast(requestVectorValue(op), vecType, bc->getName());
+  }
   mapVectorValue(bc, mapped);
 
   builder.SetInsertPoint(insertBlock, insertPoint);
@@ -2606,84 +5827,6 @@ Value *NatBuilder::requestScalarBitCast(llvm::BitCastInst *const bc, unsigned la
   return mapped;
 }
 
-llvm::Value*
-NatBuilder::requestInterleavedGEP(GetElementPtrInst *const gep, unsigned interleavedIdx) {
-  assert(gep->getNumOperands() - 1 == gep->getNumIndices() && "llvm implementation for GEP changed!");
-
-  // first, we need a vectorized base vecValue (or scalar if all_uniform). then, we have to calculate the indices
-  // we need vector values if something is not all_uniform. we need to extract an dimension if !buildAllDimensions
-  Value *scalBasePtr = gep->getPointerOperand();
-  Value *basePtr = requestScalarValue(scalBasePtr);
-  Type *st = isStructAccess(gep);
-
-  std::vector<Value *> idxList;
-  idxList.reserve(gep->getNumIndices());
-  for (unsigned i = 0; i < gep->getNumIndices(); ++i) {
-    Value *idx = gep->getOperand(i + 1);
-    Value *interIdx = requestScalarValue(idx);
-    VectorShape idxShape = getVectorShape(*idx);
-
-    if (st && !idxShape.isUniform() && interleavedIdx > 0) {
-      // calculate total offset from base and size of struct (1 if no struct)
-      unsigned offset = vectorWidth() * interleavedIdx + getStructOffset(gep);
-      unsigned structSize = getNumLeafElements(st, gep->getResultElementType(), layout);
-      unsigned k = offset / structSize;
-      if (k > 0)
-        interIdx = builder.CreateAdd(interIdx, ConstantInt::get(interIdx->getType(), k), "inter_struct_idx");
-
-      idxList.push_back(interIdx);
-
-      // create the actual struct access indices
-      for (++i; i < gep->getNumIndices(); ++i) {
-        idx = gep->getOperand(i + 1);
-        assert(isa<ConstantInt>(idx) && "element access with non-constant!");
-
-        unsigned idxValue = (unsigned) cast<ConstantInt>(idx)->getLimitedValue();
-        offset %= structSize;
-        st = st->getContainedType(idxValue);
-        structSize = getNumLeafElements(st, gep->getResultElementType(), layout);
-        k = offset / structSize;
-
-        idxList.push_back(ConstantInt::get(idx->getType(), k));
-      }
-      break;
-
-    } else if (interleavedIdx > 0 && !idxShape.isUniform()) {
-      interIdx = builder.CreateAdd(interIdx, ConstantInt::get(interIdx->getType(), vectorWidth() * interleavedIdx), "inter_idx");
-    }
-
-    idxList.push_back(interIdx);
-  }
-
-  auto *interGEP = builder.CreateGEP(gep->getSourceElementType(), basePtr, idxList, "inter_gep");
-  auto * interGEPInst = dyn_cast<GetElementPtrInst>(interGEP);
-  if (interGEPInst) interGEPInst->setIsInBounds(gep->isInBounds());
-
-  return interGEP;
-}
-
-llvm::Value *
-NatBuilder::requestInterleavedAddress(llvm::Value *const addr, unsigned interleavedIdx, Type *const vecType) {
-  ++numInterGEPs;
-  Value *interAddr = addr;
-
-  if (isa<BitCastInst>(interAddr))
-    interAddr = cast<BitCastInst>(interAddr)->getOperand(0);
-
-  if (isa<GetElementPtrInst>(interAddr))
-    interAddr = requestInterleavedGEP(cast<GetElementPtrInst>(interAddr), interleavedIdx);
-
-  else {
-    Value *ptr = requestScalarValue(addr, 0, true);
-    auto * indexTy = getIndexTy(ptr);
-    interAddr = builder.CreateGEP(vecType->getScalarType(), ptr, ConstantInt::get(indexTy, vectorWidth() * interleavedIdx), "inter_gep");
-  }
-
-  int AddrSpace = cast<PointerType>(addr->getType())->getAddressSpace();
-  PointerType *vecPtrType = vecType->getPointerTo(AddrSpace);
-  return interAddr;
-}
-
 llvm::Value *
 NatBuilder::requestCascadeLoad(Type *accessedType, Value *vecPtr, unsigned alignment, Value *mask) {
   unsigned bitWidth = accessedType->getScalarSizeInBits();
@@ -2871,6 +6014,14 @@ Value *NatBuilder::createPTest(Value *vector, bool isRv_all) {
   assert(cast<VectorType>(vector->getType())->getElementType()->isIntegerTy(1) &&
          "vector elements must have i1 type!");
 
+// bitmask fast path: any/all are a single scalar compare
+  unsigned width = cast<FixedVectorType>(vector->getType())->getNumElements();
+  if (!config.enableIRPolish && useMaskBits(width)) {
+    auto *maskBits = requestMaskBits(*vector);
+    return isRv_all ? builder.CreateICmpEQ(maskBits, Constant::getAllOnesValue(maskBits->getType()), "ptest_all")
+                    : builder.CreateICmpNE(maskBits, Constant::getNullValue(maskBits->getType()), "ptest_any");
+  }
+
 // new generic code path
   if (!config.enableIRPolish) {
     RedKind kind = isRv_all ? RedKind::And : RedKind::Or;
@@ -2895,12 +6046,105 @@ Value *NatBuilder::createPTest(Value *vector, bool isRv_all) {
   return ptest;
 }
 
+bool
+NatBuilder::useMaskBits(unsigned width) const {
+  bool isX86 = config.useSSE || config.useAVX || config.useAVX2 || config.useAVX512;
+  return config.enableMaskBits && isX86 && width <= 64;
+}
+
+Value *
+NatBuilder::requestMaskBits(Value &vecMask) {
+  auto itBits = maskBitsMap.find(&vecMask);
+  if (itBits != maskBitsMap.end() && itBits->second) return itBits->second;
+
+  unsigned width = cast<FixedVectorType>(vecMask.getType())->getNumElements();
+  auto *bitsTy = builder.getIntNTy(width);
+  Value *maskBits = nullptr;
+  if (auto *constMask = dyn_cast<Constant>(&vecMask)) {
+    maskBits = ConstantExpr::getBitCast(constMask, bitsTy);
+  } else {
+    // right after the definition, so that every test of the mask can use the bitmask
+    IRBuilder<> bitsBuilder(builder.getContext());
+    if (auto *maskInst = dyn_cast<Instruction>(&vecMask)) {
+      SetInsertPointAfterMappedInst(bitsBuilder, maskInst);
+    } else {
+      auto &entryBlock = vecInfo.getMapping().vectorFn->getEntryBlock();
+      bitsBuilder.SetInsertPoint(&entryBlock, entryBlock.getFirstInsertionPt());
+    }
+    maskBits = bitsBuilder.CreateBitCast(&vecMask, bitsTy, vecMask.getName() + ".bits");
+  }
+  maskBitsMap[&vecMask] = maskBits;
+  return maskBits;
+}
+
 bool
 NatBuilder::hasUniformPredicate(const BasicBlock & BB) const {
   if (!vecInfo.getRegion().contains(&BB) || !vecInfo.getPredicate(BB)) return true;
   else return vecInfo.getVectorShape(*vecInfo.getPredicate(BB)).isUniform();
 }
 
+// per block: executions, active lanes, histogram of the active lane count (0..vectorWidth)
+static unsigned
+GetNumLaneStatSlots(unsigned vectorWidth) { return 2 + vectorWidth + 1; }
+
+void
+NatBuilder::createLaneStatCounters() {
+  for (auto & block : *vecInfo.getMapping().scalarFn) {
+    if (!vecInfo.inRegion(block) || hasUniformPredicate(block)) continue;
+    laneStatIndex[&block] = laneStatBlocks.size();
+    laneStatBlocks.push_back(&block);
+  }
+  if (laneStatBlocks.empty()) return;
+
+  auto & mod = *vecInfo.getMapping().vectorFn->getParent();
+  unsigned numSlots = GetNumLaneStatSlots(vectorWidth());
+  laneStatCounters = &CreateCounterArray(mod, laneStatBlocks.size() * numSlots, "rv.lane.stats.counters");
+}
+
+void
+NatBuilder::emitLaneStatUpdate(const BasicBlock & scaBlock) {
+  auto * counterTy = builder.getInt64Ty();
+  auto * countersTy = laneStatCounters->getValueType();
+  unsigned baseIdx = laneStatIndex[&scaBlock] * GetNumLaneStatSlots(vectorWidth());
+
+  auto increment = [&](Value * slotIdx, Value * amount) {
+    auto * slotPtr = builder.CreateInBoundsGEP(countersTy, laneStatCounters, {builder.getInt32(0), slotIdx}, "lanestat.ptr");
+    auto * count = builder.CreateLoad(counterTy, slotPtr, "lanestat.count");
+    builder.CreateStore(builder.CreateAdd(count, amount), slotPtr);
+  };
+
+  auto * vecPred = requestVectorPredicate(scaBlock);
+  auto * numActive = createVectorMaskSummary(*i32Ty, vecPred, builder, RVIntrinsic::PopCount);
+
+  increment(builder.getInt32(baseIdx), ConstantInt::get(counterTy, 1));
+  increment(builder.getInt32(baseIdx + 1), builder.CreateZExt(numActive, counterTy));
+  increment(builder.CreateAdd(builder.getInt32(baseIdx + 2), numActive), ConstantInt::get(counterTy, 1));
+}
+
+void
+NatBuilder::createLaneStatWriter() {
+  auto & vecFunc = *vecInfo.getMapping().vectorFn;
+  unsigned numSlots = GetNumLaneStatSlots(vectorWidth());
+
+  // <function> <block index> <block name> <vector width> <executions> <active lanes> <histogram..>
+  ProfileWriter writer(*vecFunc.getParent(), config.laneStatsPath, "rv.lane.stats.write");
+  auto & writeBuilder = writer.getBuilder();
+  auto * funcNameStr = writeBuilder.CreateGlobalStringPtr(vecFunc.getName());
+  for (unsigned i = 0; i < laneStatBlocks.size(); ++i) {
+    StringRef blockName = laneStatBlocks[i]->hasName() ? laneStatBlocks[i]->getName() : "-";
+    unsigned baseIdx = i * numSlots;
+    writer.print("%s %u %s %u %llu %llu", {funcNameStr, writeBuilder.getInt32(i), writeBuilder.CreateGlobalStringPtr(blockName), writeBuilder.getInt32(vectorWidth()),
+                                           writer.loadCounter(*laneStatCounters, baseIdx), writer.loadCounter(*laneStatCounters, baseIdx + 1)});
+    for (unsigned slot = 2; slot < numSlots; ++slot) {
+      writer.print(" %llu", {writer.loadCounter(*laneStatCounters, baseIdx + slot)});
+    }
+    writer.print("\n", {});
+  }
+  writer.finalize();
+
+  Report() << "nat: lane statistics for " << laneStatBlocks.size() << " divergent blocks of " << vecFunc.getName() << "\n";
+}
+
 Value*
 NatBuilder::requestVectorPredicate(const BasicBlock& scaBlock) {
   return requestVectorValue(vecInfo.getPredicate(scaBlock));
@@ -3013,6 +6257,7 @@ NatBuilder::materializeStridePattern(rv::StridePattern & sp) {
   vecPhi.addIncoming(sp.phi->getIncomingValue(initOpIdx), sp.phi->getIncomingBlock(initOpIdx));
   auto * vecLatch = getVectorBlock(*sp.phi->getIncomingBlock(loopOpIdx), true);
   vecPhi.addIncoming(clonedReductor, vecLatch);
+  completeVectorInductions(sp, redShape.getStride());
 
   repairOutsideUses(*sp.phi,
                     [&](Value& usedVal, BasicBlock& userBlock) ->Value& {
@@ -3039,57 +6284,176 @@ NatBuilder::materializeStridePattern(rv::StridePattern & sp) {
   );
 }
 
+Value *
+NatBuilder::requestInductionVector(Value & val, IntegerType & laneTy) {
+  if (!config.enableVectorInductions || !vecInfo.getRegion().isVectorLoop()) return nullptr;
+  auto * inst = dyn_cast<Instruction>(&val);
+  if (!inst || !vecInfo.inRegion(*inst) || !SE.isSCEVable(val.getType())) return nullptr;
+  VectorShape shape = getVectorShape(val);
+  if (!shape.hasStridedShape() || shape.isUniform()) return nullptr;
+
+  // a strided header phi that is materialized as a stride pattern at a constant distance
+  auto & header = vecInfo.getEntry();
+  const PHINode * indPhi = nullptr;
+  const SCEVConstant * distance = nullptr;
+  for (auto & phi : header.phis()) {
+    if (phi.getType() != val.getType()) continue;
+    auto * sp = reda.getStrideInfo(phi);
+    if (!sp || sp->getShape(vectorWidth()).isUniform()) continue;
+    VectorShape phiShape = getVectorShape(phi);
+    if (!phiShape.hasStridedShape() || phiShape.getStride() != shape.getStride()) continue;
+    distance = dyn_cast<SCEVConstant>(SE.getMinusSCEV(SE.getSCEV(&val), SE.getSCEV(&phi)));
+    if (distance) {
+      indPhi = &phi;
+      break;
+    }
+  }
+  if (!indPhi) return nullptr;
+
+  PHINode * vecPhi = nullptr;
+  for (auto & ind : vectorInductions) {
+    if (ind.scaPhi == indPhi && ind.laneTy == &laneTy) vecPhi = ind.vecPhi;
+  }
+  if (!vecPhi) {
+    auto * vecHeader = getVectorBlock(header, false);
+    IRBuilder<> phiBuilder(vecHeader, vecHeader->getFirstInsertionPt());
+    vecPhi = phiBuilder.CreatePHI(getVectorType(&laneTy, vectorWidth()), 2, indPhi->getName() + ".vind");
+    vectorInductions.push_back({indPhi, &laneTy, vecPhi});
+    ++numVectorInductions;
+  }
+
+  // the lanes of val are the lanes of the induction plus the distance
+  APInt laneDistance = distance->getAPInt().trunc(laneTy.getBitWidth());
+  if (laneDistance.isZero()) return vecPhi;
+  auto * distanceVec = getConstantVector(vectorWidth(), ConstantInt::get(&laneTy, laneDistance));
+  return builder.CreateAdd(vecPhi, distanceVec, val.getName() + ".vind");
+}
+
 void
-NatBuilder::materializeRecurrence(Reduction & red, PHINode & scaPhi) {
-  abort(); // this code is broken
+NatBuilder::completeVectorInductions(StridePattern & sp, int64_t laneStride) {
+  for (auto & ind : vectorInductions) {
+    if (ind.scaPhi != sp.phi) continue;
+    auto & laneTy = *ind.laneTy;
+
+    // first iteration: the initial value plus the lane offsets (in front of the loop)
+    auto * initBlock = sp.phi->getIncomingBlock(sp.loopInitIdx);
+    IRBuilder<> initBuilder(initBlock->getTerminator());
+    auto * initVal = initBuilder.CreateTrunc(sp.phi->getIncomingValue(sp.loopInitIdx), &laneTy);
+    auto * initVec = initBuilder.CreateAdd(initBuilder.CreateVectorSplat(vectorWidth(), initVal),
+                                           getLaneIndexVector(laneTy, laneStride), sp.phi->getName() + ".vind.init");
+    ind.vecPhi->addIncoming(initVec, initBlock);
+
+    // next iteration: W * stride further
+    auto * vecLatch = getVectorBlock(*sp.phi->getIncomingBlock(sp.latchIdx), true);
+    IRBuilder<> latchBuilder(vecLatch->getTerminator());
+    auto * step = ConstantInt::getSigned(&laneTy, vectorWidth() * laneStride);
+    auto * nextVec = latchBuilder.CreateAdd(ind.vecPhi, getConstantVector(vectorWidth(), step), sp.phi->getName() + ".vind.next");
+    ind.vecPhi->addIncoming(nextVec, vecLatch);
+  }
+}
 
-  const int vectorWidth = vecInfo.getVectorWidth();
-  assert(vecInfo.getVectorShape(scaPhi).isVarying());
+Value &
+NatBuilder::materializeRecurrence(Reduction & red, PHINode & scaPhi) {
+  assert(red.isRecurrence());
 
-// construct new (vectorized) initial value
-  auto * vecPhi = getVectorValueAs<PHINode>(scaPhi);
-  auto * vecTy = vecPhi->getType();
+  // already spliced as the input of a higher order recurrence
+  auto * mappedVal = getVectorValue(scaPhi);
+  if (!isa<PHINode>(mappedVal)) return *mappedVal;
+  auto & vecPhi = cast<PHINode>(*mappedVal);
 
-  auto * inAtZero = dyn_cast<Instruction>(scaPhi.getIncomingValue(0));
-  int latchIdx = (inAtZero && vecInfo.inRegion(*inAtZero)) ? 0 : 1;
+  const int vectorWidth = vecInfo.getVectorWidth();
+  auto & scaInput = *red.recurrenceInput;
+  int latchIdx = scaPhi.getIncomingValue(0) == &scaInput ? 0 : 1;
   int initIdx = 1 - latchIdx;
-
   BasicBlock * vecInitInputBlock = scaPhi.getIncomingBlock(initIdx);
   BasicBlock * vecLoopInputBlock = getVectorBlock(*scaPhi.getIncomingBlock(latchIdx), true);
+  auto & vecHeader = *getVectorBlock(const_cast<BasicBlock&>(vecInfo.getEntry()), false);
+
+  IRBuilder<>::InsertPointGuard guard(builder);
+  auto setInsertAfter = [&](Value & def) {
+    auto * defInst = dyn_cast<Instruction>(&def);
+    if (!defInst) builder.SetInsertPoint(&vecHeader, vecHeader.getFirstInsertionPt());
+    else if (isa<PHINode>(defInst)) builder.SetInsertPoint(defInst->getParent(), defInst->getParent()->getFirstInsertionPt());
+    else builder.SetInsertPoint(defInst->getParent(), ++defInst->getIterator());
+  };
+
+// this iteration's vector of the forwarded value
+  Value * vecInput = nullptr;
+  if (auto * inputPhi = dyn_cast<PHINode>(&scaInput)) {
+    vecInput = &materializeRecurrence(*reda.getReductionInfo(*inputPhi), *inputPhi);
+  } else {
+    vecInput = getVectorValue(scaInput);
+  }
+  if (!vecInput) {
+    // uniform or strided input: widen it right after its definition
+    auto & scaInputVal = *getScalarValue(scaInput);
+    setInsertAfter(scaInputVal);
+    vecInput = &widenScalar(scaInputVal, getVectorShape(scaInput));
+  }
 
-// broadcast initial value to all lanes
+// splice the last lane of the previous iteration in front of this one: <prev[W-1], in[0], .., in[W-2]>
+  setInsertAfter(*vecInput);
+  SmallVector<int, 16> spliceLanes;
+  for (int i = 0; i < vectorWidth; ++i) spliceLanes.push_back(vectorWidth - 1 + i);
+  auto * splice = builder.CreateShuffleVector(&vecPhi, vecInput, spliceLanes, scaPhi.getName() + ".splice");
+
+  // users of the recurrence see the spliced vector
+  vecPhi.replaceUsesWithIf(splice, [&](Use & use) { return use.getUser() != splice; });
+  mapVectorValue(&scaPhi, splice);
+
+// the phi carries the input vector of the last iteration, the initial value enters in the last lane
   Value * scaInitValue = scaPhi.getIncomingValue(initIdx);
   IRBuilder<> phBuilder(vecInitInputBlock, vecInitInputBlock->getTerminator()->getIterator());
-  auto * intTy = Type::getInt32Ty(scaPhi.getContext());
-  auto * vecFirstLane = phBuilder.CreateInsertElement(UndefValue::get(vecTy), scaInitValue, ConstantInt::get(intTy, 0, false));
-  auto * vecInitVal = CreateBroadcast(phBuilder, *vecFirstLane, 0);
-  vecPhi->addIncoming(vecInitVal, vecInitInputBlock);
+  auto * vecInitVal = phBuilder.CreateInsertElement(UndefValue::get(vecPhi.getType()), scaInitValue, phBuilder.getInt32(vectorWidth - 1), scaPhi.getName() + ".init");
+  vecPhi.addIncoming(vecInitVal, vecInitInputBlock);
+  vecPhi.addIncoming(vecInput, vecLoopInputBlock);
+
+// the last lane for users after the loop
+  auto extractLast = [&](Value & vecVal) {
+    return [&](Value &, BasicBlock & userBlock) -> Value& {
+      auto * insertPt = userBlock.getFirstNonPHI();
+      IRBuilder<> builder(&userBlock, insertPt->getIterator());
+      return CreateExtract(builder, vecVal, -1);
+    };
+  };
+  repairOutsideUses(scaPhi, extractLast(*splice));
+  if (!isa<PHINode>(scaInput)) repairOutsideUses(scaInput, extractLast(*vecInput));
 
-// add latch update (extract last lane)
-  Instruction * scaLatchInst = cast<Instruction>(scaPhi.getIncomingValue(latchIdx));
-  auto * vecLatchInst = getVectorValueAs<Instruction>(*scaLatchInst);
-  auto itInsert = vecLatchInst->getIterator();
-  ++itInsert;
-  IRBuilder<> latchBuilder(vecLatchInst->getParent(), itInsert);
+  ++numRecurrences;
+  return *splice;
+}
 
-  // broadcast the last element
-  auto * latchUpdate = CreateBroadcast(latchBuilder, *vecLatchInst, vectorWidth - 1);
-  vecPhi->addIncoming(latchUpdate, vecLoopInputBlock);
+// whether the order of the updates of @red may change (integer, min/max or reassoc arithmetic)
+static bool
+IsReassociable(Reduction & red, PHINode & scaPhi) {
+  if (!scaPhi.getType()->isFPOrFPVectorTy()) return true;
+  if (red.kind != RedKind::Add && red.kind != RedKind::Mul) return true;
 
-// extract last lane for outside users
-  repairOutsideUses(*scaLatchInst,
-                    [&](Value & usedVal, BasicBlock & userBlock) ->Value& {
-                      // otw, replace with reduced value
-                      auto * insertPt = userBlock.getFirstNonPHI();
-                      IRBuilder<> builder(&userBlock, insertPt->getIterator());
-                      auto & extracted = CreateExtract(builder, *vecLatchInst, -1);
-                      return extracted;
-                    }
-  );
+  auto & func = *scaPhi.getFunction();
+  if (func.getFnAttribute("unsafe-fp-math").getValueAsString() == "true") return true;
+
+  for (auto * elem : red.elements) {
+    if (isa<BinaryOperator>(elem) && !elem->hasAllowReassoc()) return false;
+  }
+  return true;
+}
+
+// fold the vector @vecVal into the scalar @accu in lane order. @blocked reduces @vecVal as a tree first.
+static Value &
+CreateOrderedReduce(Config & config, IRBuilder<> & builder, RedKind kind, Value & vecVal, Value & accu, bool blocked) {
+  if (!blocked) return CreateVectorReduce(config, builder, kind, vecVal, &accu);
+
+  FastMathFlags treeFMF = builder.getFastMathFlags();
+  treeFMF.setAllowReassoc();
+  IRBuilder<>::FastMathFlagGuard guard(builder);
+  builder.setFastMathFlags(treeFMF);
+  auto & blockVal = CreateVectorReduce(config, builder, kind, vecVal, nullptr);
+  builder.clearFastMathFlags();
+  return CreateReductInst(builder, kind, accu, blockVal);
 }
 
 void
-NatBuilder::materializeOrderedReduction(Reduction & red, PHINode & scaPhi) {
+NatBuilder::materializeOrderedReduction(Reduction & red, PHINode & scaPhi, bool blocked) {
   assert((red.kind != RedKind::Top) && (red.kind != RedKind::Bot));
 
   const auto vectorWidth = vecInfo.getVectorWidth();
@@ -3119,7 +6483,7 @@ NatBuilder::materializeOrderedReduction(Reduction & red, PHINode & scaPhi) {
   orderPhi->addIncoming(scaInitValue, vecInitInputBlock);
 // (orderly) reduce vectors into scalars
   IRBuilder<> latchBuilder(&vecLatchBlock, vecLatchBlock.getTerminator()->getIterator());
-  auto & reducedUpdate = CreateVectorReduce(config, latchBuilder, red.kind, *vecLatchInst, orderPhi);
+  auto & reducedUpdate = CreateOrderedReduce(config, latchBuilder, red.kind, *vecLatchInst, *orderPhi, blocked);
   orderPhi->addIncoming(&reducedUpdate, &vecLatchBlock);
 
 // reduce reduction phi for outside users
@@ -3152,7 +6516,7 @@ NatBuilder::materializeOrderedReduction(Reduction & red, PHINode & scaPhi) {
                       IRBuilder<> builder(&userBlock, insertPt->getIterator());
                       // reduce all end-of-iteration values and request value of last iteration
                       auto & foldVec = *builder.CreateSelect(selMask, vecLatchInst, &vecElem, ".red");
-                      auto & reducedVector = CreateVectorReduce(config, builder, red.kind, foldVec, orderPhi);
+                      auto & reducedVector = CreateOrderedReduce(config, builder, red.kind, foldVec, *orderPhi, blocked);
                       return reducedVector;
                     }
     );
@@ -3194,10 +6558,25 @@ NatBuilder::materializeVaryingReduction(Reduction & red, PHINode & scaPhi) {
 // attach inputs (neutral elem and reduction inst)
   vecPhi->addIncoming(vecInitVal, vecInitInputBlock);
 
+// rotating accumulators: an update is read again @numAccus iterations later
+  unsigned numAccus = red.numChainNodes() == 2 ? config.redAccumulators : 1;
+  SmallVector<PHINode*, 4> accuPhis = {vecPhi};
+  for (unsigned i = 1; i < numAccus; ++i) {
+    auto * accuPhi = PHINode::Create(vecPhi->getType(), 2, scaPhi.getName() + ".accu" + std::to_string(i), vecPhi);
+    accuPhi->addIncoming(vecNeutral, vecInitInputBlock);
+    accuPhis.push_back(accuPhi);
+  }
+
 // add latch update
   Instruction * scaLatchInst = cast<Instruction>(scaPhi.getIncomingValue(latchIdx));
   auto * vecLatchInst = getVectorValueAs<Instruction>(*scaLatchInst);
-  vecPhi->addIncoming(vecLatchInst, vecLoopInputBlock);
+  for (unsigned i = 0; i + 1 < numAccus; ++i) {
+    accuPhis[i]->addIncoming(accuPhis[i + 1], vecLoopInputBlock);
+  }
+  accuPhis.back()->addIncoming(vecLatchInst, vecLoopInputBlock);
+
+// NaN-free min/max chains reduce with native min/max instructions (vector_reduce_fmin/fmax with nnan)
+  FastMathFlags redFMF = getReductionFMF(red);
 
 // reduce reduction phi for outside users
   repairOutsideUses(*scaLatchInst,
@@ -3205,7 +6584,14 @@ NatBuilder::materializeVaryingReduction(Reduction & red, PHINode & scaPhi) {
                       // otw, replace with reduced value
                       auto * insertPt = userBlock.getFirstNonPHI();
                       IRBuilder<> builder(&userBlock, insertPt->getIterator());
-                      auto & reducedVector = CreateVectorReduce(config, builder, red.kind, *vecLatchInst, nullptr);
+                      builder.setFastMathFlags(redFMF);
+                      // the last update and the accumulators that were not consumed in the last iteration
+                      Value * accuSum = vecLatchInst;
+                      for (unsigned i = 1; i < numAccus; ++i) {
+                        accuSum = &CreateReductInst(builder, red.kind, *accuSum, *accuPhis[i]);
+                      }
+                      auto & reducedVector = CreateVectorReduce(config, builder, red.kind, *accuSum, nullptr);
+                      if (auto * redCall = dyn_cast<CallInst>(&reducedVector)) exitReductions.emplace_back(redCall, red.kind);
                       return reducedVector;
                     }
   );
@@ -3233,6 +6619,7 @@ NatBuilder::materializeVaryingReduction(Reduction & red, PHINode & scaPhi) {
                       IRBuilder<> builder(&userBlock, insertPt->getIterator());
                       // reduce all end-of-iteration values and request value of last iteration
                       auto & foldVec = *builder.CreateSelect(selMask, vecLatchInst, &vecElem, ".red");
+                      builder.setFastMathFlags(redFMF);
                       auto & reducedVector = CreateVectorReduce(config, builder, red.kind, foldVec, nullptr);
                       return reducedVector;
                     }
@@ -3240,6 +6627,338 @@ NatBuilder::materializeVaryingReduction(Reduction & red, PHINode & scaPhi) {
   }
 }
 
+void
+NatBuilder::combineExitReductions() {
+  if (!config.enableTransposedReductions || !isPowerOf2_32(vectorWidth())) return;
+
+  // group by block, kind and vector type (in order of creation)
+  std::vector<std::vector<std::pair<CallInst*, RedKind>>> groups;
+  for (auto & exitRed : exitReductions) {
+    auto * redCall = exitRed.first;
+    auto * vecVal = redCall->getArgOperand(redCall->arg_size() - 1);
+    auto itGroup = std::find_if(groups.begin(), groups.end(), [&](const std::vector<std::pair<CallInst*, RedKind>> & group) {
+      auto * groupCall = group[0].first;
+      return groupCall->getParent() == redCall->getParent() && group[0].second == exitRed.second &&
+             groupCall->getArgOperand(groupCall->arg_size() - 1)->getType() == vecVal->getType();
+    });
+    if (itGroup != groups.end()) itGroup->push_back(exitRed);
+    else groups.push_back({exitRed});
+  }
+  exitReductions.clear();
+
+  for (auto & group : groups) {
+    auto & block = *group[0].first->getParent();
+    auto kind = group[0].second;
+
+    for (size_t start = 0; start + 1 < group.size(); start += vectorWidth()) {
+      SmallVector<CallInst*, 16> batch;
+      for (size_t i = start; i < group.size() && batch.size() < (size_t) vectorWidth(); ++i) {
+        batch.push_back(group[i].first);
+      }
+
+      // the combined reduction goes after the last horizontal reduction of the batch,
+      // drop those that have users in between
+      auto getLast = [&]() {
+        CallInst * last = batch[0];
+        for (auto * redCall : batch) if (last->comesBefore(redCall)) last = redCall;
+        return last;
+      };
+      auto * last = getLast();
+      auto itEnd = std::remove_if(batch.begin(), batch.end(), [&](CallInst * redCall) {
+        return std::any_of(redCall->user_begin(), redCall->user_end(), [&](User * user) {
+          auto * userInst = cast<Instruction>(user);
+          return userInst->getParent() == &block && !last->comesBefore(userInst);
+        });
+      });
+      batch.erase(itEnd, batch.end());
+      if (batch.size() < 2) continue;
+      last = getLast();
+
+      IRBuilder<> redBuilder(last->getNextNode());
+      if (isa<FPMathOperator>(last)) redBuilder.setFastMathFlags(last->getFastMathFlags());
+      SmallVector<Value*, 16> vecVals;
+      for (auto * redCall : batch) vecVals.push_back(redCall->getArgOperand(redCall->arg_size() - 1));
+
+      unsigned laneStride;
+      auto & packed = CreateTransposedReduce(redBuilder, kind, vecVals, laneStride);
+      for (size_t k = 0; k < batch.size(); ++k) {
+        auto * laneVal = redBuilder.CreateExtractElement(&packed, redBuilder.getInt32(k * laneStride), batch[k]->getName());
+        batch[k]->replaceAllUsesWith(laneVal);
+        batch[k]->eraseFromParent();
+      }
+      ++numTransposedReductions;
+    }
+  }
+}
+
+bool
+NatBuilder::materializeDotProductReduction(Reduction & red, PHINode & scaPhi) {
+  assert(red.isDotProduct() && red.kind == RedKind::Add);
+
+  auto * scaMul = red.dotProduct;
+  auto * extA = cast<CastInst>(scaMul->getOperand(0));
+  auto * extB = cast<CastInst>(scaMul->getOperand(1));
+  const unsigned narrowBits = extA->getSrcTy()->getScalarSizeInBits();
+  const unsigned vecBits = narrowBits * vectorWidth();
+  const bool signedA = isa<SExtInst>(extA);
+  const bool signedB = isa<SExtInst>(extB);
+
+// pick the instruction (all of them accumulate into i32 lanes)
+  Intrinsic::ID dotID = Intrinsic::not_intrinsic;
+  bool packOperands = false; // x86 expects the narrow operands as i32 vectors
+  bool vnniWidth = config.useVNNI && (vecBits == 128 || vecBits == 256 || (vecBits == 512 && config.useAVX512));
+  if (vnniWidth && narrowBits == 8 && signedA != signedB) {
+    // unsigned bytes (first operand) times signed bytes
+    dotID = vecBits == 512 ? Intrinsic::x86_avx512_vpdpbusd_512 : (vecBits == 256 ? Intrinsic::x86_avx512_vpdpbusd_256 : Intrinsic::x86_avx512_vpdpbusd_128);
+    if (signedA) std::swap(extA, extB);
+    packOperands = true;
+  } else if (vnniWidth && narrowBits == 16 && signedA && signedB) {
+    dotID = vecBits == 512 ? Intrinsic::x86_avx512_vpdpwssd_512 : (vecBits == 256 ? Intrinsic::x86_avx512_vpdpwssd_256 : Intrinsic::x86_avx512_vpdpwssd_128);
+    packOperands = true;
+  } else if (config.useDotProd && narrowBits == 8 && signedA == signedB && (vecBits == 64 || vecBits == 128)) {
+    dotID = signedA ? Intrinsic::aarch64_neon_sdot : Intrinsic::aarch64_neon_udot;
+  }
+  if (dotID == Intrinsic::not_intrinsic) return false;
+
+  auto * inAtZero = dyn_cast<Instruction>(scaPhi.getIncomingValue(0));
+  int latchIdx = (inAtZero && vecInfo.inRegion(*inAtZero)) ? 0 : 1;
+  int initIdx = 1 - latchIdx;
+
+  // the widened update has to be a plain vector add (seen through the blend of the tail)
+  auto * vecPhi = getVectorValueAs<PHINode>(scaPhi);
+  auto * scaLatchInst = cast<Instruction>(scaPhi.getIncomingValue(latchIdx));
+  auto * scaUpdate = red.isTailBlended() ? cast<Instruction>(red.tailBlend->getTrueValue()) : scaLatchInst;
+  auto * vecLatchInst = dyn_cast_or_null<BinaryOperator>(getVectorValue(*scaUpdate));
+  if (!vecLatchInst || vecLatchInst->getOpcode() != Instruction::Add) return false;
+  if (vecLatchInst->getOperand(0) != vecPhi && vecLatchInst->getOperand(1) != vecPhi) return false;
+
+  BasicBlock * vecInitInputBlock = scaPhi.getIncomingBlock(initIdx);
+  BasicBlock * vecLoopInputBlock = getVectorBlock(*scaPhi.getIncomingBlock(latchIdx), true);
+
+// partial sums (the initial value goes into the last one)
+  const unsigned accuLanes = vecBits / 32;
+  auto * accuTy = FixedVectorType::get(scaPhi.getType(), accuLanes);
+  IRBuilder<> phBuilder(vecInitInputBlock, vecInitInputBlock->getTerminator()->getIterator());
+  auto * accuInit = phBuilder.CreateInsertElement(Constant::getNullValue(accuTy), scaPhi.getIncomingValue(initIdx), phBuilder.getInt32(accuLanes - 1));
+  auto * accuPhi = PHINode::Create(accuTy, 2, scaPhi.getName() + ".dot", vecPhi);
+  accuPhi->addIncoming(accuInit, vecInitInputBlock);
+
+// one dot product instruction replaces the widened multiply-add
+  builder.SetInsertPoint(vecLatchInst);
+  Value * vecA = requestVectorValue(extA->getOperand(0));
+  Value * vecB = requestVectorValue(extB->getOperand(0));
+  builder.SetInsertPoint(vecLatchInst);
+  if (red.isTailBlended()) {
+    // masked-out lanes contribute zero products
+    Value * vecMask = requestVectorValue(red.tailBlend->getCondition());
+    builder.SetInsertPoint(vecLatchInst);
+    vecA = builder.CreateSelect(vecMask, vecA, Constant::getNullValue(vecA->getType()), "dot.tail");
+  }
+  auto * mod = vecInfo.getVectorFunction().getParent();
+  Function * dotFunc;
+  if (packOperands) {
+    vecA = builder.CreateBitCast(vecA, accuTy);
+    vecB = builder.CreateBitCast(vecB, accuTy);
+    dotFunc = Intrinsic::getDeclaration(mod, dotID);
+  } else {
+    dotFunc = Intrinsic::getDeclaration(mod, dotID, {accuTy, vecA->getType()});
+  }
+  auto * dotUpdate = builder.CreateCall(dotFunc, {accuPhi, vecA, vecB}, scaPhi.getName() + ".dotacc");
+  accuPhi->addIncoming(dotUpdate, vecLoopInputBlock);
+
+// reduce the partial sums for outside users
+  repairOutsideUses(*scaLatchInst,
+                    [&](Value & usedVal, BasicBlock & userBlock) ->Value& {
+                      auto * insertPt = userBlock.getFirstNonPHI();
+                      IRBuilder<> builder(&userBlock, insertPt->getIterator());
+                      return CreateVectorReduce(config, builder, red.kind, *dotUpdate, nullptr);
+                    }
+  );
+
+  // remap old vecPhi and erase (the widened add chain is dead now)
+  Value * vecNeutral = getSplat(&GetNeutralElement(red.kind, *scaPhi.getType()));
+  mapVectorValue(&scaPhi, vecNeutral);
+  vecPhi->replaceAllUsesWith(vecNeutral);
+  vecPhi->eraseFromParent();
+  ++numDotProducts;
+  return true;
+}
+
+void
+NatBuilder::materializeScanReduction(Reduction & red, PHINode & scaPhi) {
+  assert(red.isScan());
+
+  const auto vectorWidth = vecInfo.getVectorWidth();
+  auto * vecPhi = getVectorValueAs<PHINode>(scaPhi);
+
+  auto * inAtZero = dyn_cast<Instruction>(scaPhi.getIncomingValue(0));
+  int latchIdx = (inAtZero && vecInfo.inRegion(*inAtZero)) ? 0 : 1;
+  int initIdx = 1 - latchIdx;
+
+  BasicBlock * vecInitInputBlock = scaPhi.getIncomingBlock(initIdx);
+  BasicBlock * vecLoopInputBlock = getVectorBlock(*scaPhi.getIncomingBlock(latchIdx), true);
+
+// the phi carries the value after all previous iterations in every lane
+  Value * scaInitValue = scaPhi.getIncomingValue(initIdx);
+  IRBuilder<> phBuilder(vecInitInputBlock, vecInitInputBlock->getTerminator()->getIterator());
+  auto * vecInitVal = CreateScalarBroadcast(phBuilder, *scaInitValue, vectorWidth);
+  vecPhi->addIncoming(vecInitVal, vecInitInputBlock);
+
+// vectorized scan input (scalar if uniform)
+  Value * vecInput = red.scanInput;
+  auto * scaInputInst = dyn_cast<Instruction>(red.scanInput);
+  if (scaInputInst && vecInfo.inRegion(*scaInputInst)) {
+    vecInput = getVectorShape(*scaInputInst).isVarying() ? getVectorValue(*scaInputInst) : getScalarValue(*scaInputInst);
+  }
+
+  // the lane prefixes are available right after the input
+  IRBuilder<> scanBuilder(vecPhi->getParent(), vecPhi->getParent()->getFirstInsertionPt());
+  if (auto * vecInputInst = dyn_cast<Instruction>(vecInput)) {
+    if (isa<PHINode>(vecInputInst)) {
+      scanBuilder.SetInsertPoint(vecInputInst->getParent(), vecInputInst->getParent()->getFirstInsertionPt());
+    } else {
+      scanBuilder.SetInsertPoint(vecInputInst->getParent(), ++vecInputInst->getIterator());
+    }
+  }
+  if (!vecInput->getType()->isVectorTy()) {
+    vecInput = CreateScalarBroadcast(scanBuilder, *vecInput, vectorWidth);
+  }
+
+// lane i sees the carry combined with the inputs of lanes 0..i-1
+  SmallVector<Use*, 4> laneUses;
+  for (auto & use : vecPhi->uses()) laneUses.push_back(&use);
+
+  auto & exclusiveScan = CreateVectorScan(scanBuilder, red.kind, *vecInput, false);
+  auto & vecPrefix = CreateReductInst(scanBuilder, red.kind, *vecPhi, exclusiveScan);
+  for (auto * use : laneUses) use->set(&vecPrefix);
+  mapVectorValue(&scaPhi, &vecPrefix);
+
+// carry the last lane of the (inclusive) update into the next iteration
+  Instruction * scaLatchInst = cast<Instruction>(scaPhi.getIncomingValue(latchIdx));
+  auto * vecLatchInst = getVectorValueAs<Instruction>(*scaLatchInst);
+  auto itInsert = vecLatchInst->getIterator();
+  ++itInsert;
+  IRBuilder<> latchBuilder(vecLatchInst->getParent(), itInsert);
+  auto * latchUpdate = CreateBroadcast(latchBuilder, *vecLatchInst, vectorWidth - 1);
+  vecPhi->addIncoming(latchUpdate, vecLoopInputBlock);
+
+// the last lane is the value of the last iteration
+  repairOutsideUses(*scaLatchInst,
+                    [&](Value & usedVal, BasicBlock & userBlock) ->Value& {
+                      auto * insertPt = userBlock.getFirstNonPHI();
+                      IRBuilder<> builder(&userBlock, insertPt->getIterator());
+                      return CreateExtract(builder, *vecLatchInst, -1);
+                    }
+  );
+  repairOutsideUses(scaPhi,
+                    [&](Value & usedVal, BasicBlock & userBlock) ->Value& {
+                      auto * insertPt = userBlock.getFirstNonPHI();
+                      IRBuilder<> builder(&userBlock, insertPt->getIterator());
+                      return CreateExtract(builder, vecPrefix, -1);
+                    }
+  );
+}
+
+void
+NatBuilder::materializeIndexReduction(Reduction & red, PHINode & scaPhi) {
+  assert(red.isIndex());
+
+  const auto vectorWidth = vecInfo.getVectorWidth();
+  auto * vecPhi = getVectorValueAs<PHINode>(scaPhi);
+  auto & ctx = scaPhi.getContext();
+
+  auto * inAtZero = dyn_cast<Instruction>(scaPhi.getIncomingValue(0));
+  int latchIdx = (inAtZero && vecInfo.inRegion(*inAtZero)) ? 0 : 1;
+  int initIdx = 1 - latchIdx;
+
+  BasicBlock * vecInitInputBlock = scaPhi.getIncomingBlock(initIdx);
+  BasicBlock * vecLoopInputBlock = getVectorBlock(*scaPhi.getIncomingBlock(latchIdx), true);
+
+// every lane starts on the initial index
+  Value * scaInitValue = scaPhi.getIncomingValue(initIdx);
+  IRBuilder<> phBuilder(vecInitInputBlock, vecInitInputBlock->getTerminator()->getIterator());
+  vecPhi->addIncoming(CreateScalarBroadcast(phBuilder, *scaInitValue, vectorWidth), vecInitInputBlock);
+
+  auto * scaSelect = cast<SelectInst>(scaPhi.getIncomingValue(latchIdx));
+  auto * vecSelect = getVectorValueAs<Instruction>(*scaSelect);
+  vecPhi->addIncoming(vecSelect, vecLoopInputBlock);
+
+// track the lanes that picked an index at least once
+  bool pickTrue = scaSelect->getFalseValue() == &scaPhi;
+  auto * boolVecTy = FixedVectorType::get(Type::getInt1Ty(ctx), vectorWidth);
+  auto * foundPhi = PHINode::Create(boolVecTy, 2, scaPhi.getName() + ".found", vecPhi);
+  foundPhi->addIncoming(Constant::getNullValue(boolVecTy), vecInitInputBlock);
+
+  auto itInsert = vecSelect->getIterator();
+  ++itInsert;
+  IRBuilder<> latchBuilder(vecSelect->getParent(), itInsert);
+  auto * scaCond = scaSelect->getCondition();
+  Value * vecCond = scaCond;
+  if (auto * scaCondInst = dyn_cast<Instruction>(scaCond)) {
+    if (vecInfo.inRegion(*scaCondInst)) {
+      vecCond = getVectorShape(*scaCondInst).isVarying() ? getVectorValue(*scaCondInst) : getScalarValue(*scaCondInst);
+    }
+  }
+  if (!vecCond->getType()->isVectorTy()) vecCond = CreateScalarBroadcast(latchBuilder, *vecCond, vectorWidth);
+  auto * vecPicked = pickTrue ? vecCond : latchBuilder.CreateNot(vecCond);
+  auto & vecFound = *latchBuilder.CreateOr(foundPhi, vecPicked, scaPhi.getName() + ".found.upd");
+  foundPhi->addIncoming(&vecFound, vecLoopInputBlock);
+
+// argmin/argmax: key phi, its initial value and its vectorized latch update
+  auto * keyRed = red.keyReduction;
+  CmpInst * keyCmp = nullptr;
+  PHINode * keyPhi = nullptr;
+  Value * keyInit = nullptr;
+  Value * vecKeyLatch = nullptr;
+  if (keyRed) {
+    keyCmp = cast<CmpInst>(scaCond);
+    for (auto * op : keyCmp->operand_values()) {
+      auto * opPhi = dyn_cast<PHINode>(op);
+      if (opPhi && keyRed->contains(*opPhi)) keyPhi = opPhi;
+    }
+    assert(keyPhi && "key phi not an operand of the compare");
+    keyInit = keyPhi->getIncomingValueForBlock(vecInitInputBlock);
+    vecKeyLatch = getVectorValue(*keyPhi->getIncomingValueForBlock(scaPhi.getIncomingBlock(latchIdx)));
+  }
+
+// lanes keep their first (last) pick. Ties between lanes go to the earliest (latest) iteration.
+  bool laterWins = !keyRed || (keyCmp->isTrueWhenEqual() == pickTrue);
+  bool increasing = reda.getStrideInfo(*cast<Instruction>(red.indexValue))->inc > 0;
+  RedKind indexKind = laterWins == increasing ? RedKind::SMax : RedKind::SMin;
+
+  repairOutsideUses(*scaSelect,
+                    [&](Value & usedVal, BasicBlock & userBlock) ->Value& {
+                      auto * insertPt = userBlock.getFirstNonPHI();
+                      IRBuilder<> builder(&userBlock, insertPt->getIterator());
+
+                      Value * candidates = &vecFound;
+                      Value * keyWins = nullptr;
+                      if (keyRed) {
+                        // lanes that hold the reduced key
+                        auto & reducedKey = CreateVectorReduce(config, builder, keyRed->kind, *vecKeyLatch, nullptr);
+                        auto * keySplat = builder.CreateVectorSplat(vectorWidth, &reducedKey);
+                        auto * isKeyLane = reducedKey.getType()->isFloatingPointTy() ? builder.CreateFCmpOEQ(vecKeyLatch, keySplat) : builder.CreateICmpEQ(vecKeyLatch, keySplat);
+                        candidates = builder.CreateAnd(candidates, isKeyLane, ".keylanes");
+
+                        // the reduced key replaces the initial one under the compare of the loop
+                        Value * cmpOps[2];
+                        for (int i = 0; i < 2; ++i) {
+                          cmpOps[i] = keyCmp->getOperand(i) == keyPhi ? keyInit : &reducedKey;
+                        }
+                        keyWins = builder.CreateCmp(keyCmp->getPredicate(), cmpOps[0], cmpOps[1]);
+                        if (!pickTrue) keyWins = builder.CreateNot(keyWins);
+                      }
+
+                      auto * neutralSplat = getSplat(&GetNeutralElement(indexKind, *scaPhi.getType()));
+                      auto * laneIndices = builder.CreateSelect(candidates, vecSelect, neutralSplat);
+                      auto & pickedIndex = CreateVectorReduce(config, builder, indexKind, *laneIndices, nullptr);
+                      Value * anyPicked = &CreateVectorReduce(config, builder, RedKind::Or, *candidates, nullptr);
+                      if (keyWins) anyPicked = builder.CreateAnd(keyWins, anyPicked);
+                      return *builder.CreateSelect(anyPicked, &pickedIndex, scaInitValue, scaPhi.getName() + ".idx");
+                    }
+  );
+}
+
 void NatBuilder::addValuesToPHINodes() {
   // save current insertion point before continuing
 //  auto IB = builder.GetInsertBlock();
@@ -3251,7 +6970,7 @@ void NatBuilder::addValuesToPHINodes() {
     Type *scalType = scalPhi->getType();
 
     // replicate phi <vector_width> times if type is not vectorizable
-    bool replicate = shape.isVarying() && (scalType->isVectorTy() || scalType->isStructTy());
+    bool replicate = shape.isVarying() && ((scalType->isVectorTy() && !isWidenedShortVector(*scalType)) || scalType->isStructTy());
     unsigned loopEnd = replicate ? vectorWidth() : 1;
 
     auto *sp = reda.getStrideInfo(*scalPhi);
@@ -3269,8 +6988,12 @@ void NatBuilder::addValuesToPHINodes() {
     } else if (isVectorLoopHeader && shape.isVarying() && red && red->kind != RedKind::Bot) {
       // reduction phi handling
       IF_DEBUG_NAT { errs() << "-- materializing "; red->dump(); errs() << "\n"; }
-      if (CheckFlag("RV_RED_ORDER")) {
-        materializeOrderedReduction(*red, *scalPhi);
+      if (red->isScan()) {
+        materializeScanReduction(*red, *scalPhi);
+      } else if (red->isDotProduct() && materializeDotProductReduction(*red, *scalPhi)) {
+        // lowered to dot product instructions
+      } else if (config.fpRedOrder != Config::RedOrder_Fast && !IsReassociable(*red, *scalPhi)) {
+        materializeOrderedReduction(*red, *scalPhi, config.fpRedOrder == Config::RedOrder_Blocked);
       } else {
         materializeVaryingReduction(*red, *scalPhi);
       }
@@ -3278,7 +7001,11 @@ void NatBuilder::addValuesToPHINodes() {
     } else if (isVectorLoopHeader && red && red->kind == RedKind::Bot && shape.isVarying()) {
       // reduction phi handling
       IF_DEBUG_NAT { errs() << "-- materializing "; red->dump(); errs() << "\n"; }
-      materializeRecurrence(*red, *scalPhi);
+      if (red->isIndex()) {
+        materializeIndexReduction(*red, *scalPhi);
+      } else {
+        materializeRecurrence(*red, *scalPhi);
+      }
 
     } else {
       // default phi handling (includes fully uniform recurrences)
@@ -3345,9 +7072,14 @@ NatBuilder::getVectorBlock(BasicBlock & ScaBlock, bool ReturnLastBlock) {
 }
 
 void NatBuilder::mapScalarValue(const Value *const value, Value *mapValue, unsigned laneIdx) {
-  LaneValueVector &laneValues = scalarValueMap[value];
-  if (laneValues.size() < laneIdx) laneValues.resize(laneIdx);
-  laneValues.insert(laneValues.begin() + laneIdx, mapValue);
+  assert(laneIdx < (unsigned) vectorWidth());
+  Value **&laneValues = scalarValueMap[value];
+  if (!laneValues) {
+    laneValues = laneAllocator.Allocate<Value *>(vectorWidth());
+    std::fill_n(laneValues, vectorWidth(), nullptr);
+    ++numLaneSlabs;
+  }
+  laneValues[laneIdx] = mapValue;
 }
 
 Value *NatBuilder::getScalarValue(Value & ScaValue, unsigned laneIdx) {
@@ -3375,9 +7107,8 @@ Value *NatBuilder::getScalarValue(Value & ScaValue, unsigned laneIdx) {
       if (shape.isUniform()) laneIdx = 0;
     }
 
-    LaneValueVector &laneValues = scalarIt->second;
-    if (laneValues.size() > laneIdx) return laneValues[laneIdx];
-    else return nullptr;
+    if (laneIdx >= (unsigned) vectorWidth()) return nullptr;
+    return scalarIt->second[laneIdx];
   } else return nullptr;
 }
 
@@ -3423,7 +7154,8 @@ bool NatBuilder::canVectorize(Instruction *const inst) {
   }
 // check for type vectorizability
   auto * instTy = inst->getType();
-  if (!instTy->isVoidTy() && !instTy->isIntegerTy() && !instTy->isFloatingPointTy() && !instTy->isPointerTy()) return false;
+  if (!instTy->isVoidTy() && !instTy->isIntegerTy() && !instTy->isFloatingPointTy() && !instTy->isPointerTy() &&
+      !isWidenedShortVector(*instTy)) return false;
 
 // for AllocaInst: vectorize if not used in calls. replicate else
   if (isa<AllocaInst>(inst)) {
@@ -3459,7 +7191,7 @@ bool NatBuilder::shouldVectorize(Instruction *inst) {
 
   if (isa<ReturnInst>(inst)) {
     Function &func = vecInfo.getVectorFunction();
-    if (func.getReturnType()->isVectorTy()) {
+    if (func.getReturnType()->isVectorTy() || IsStructOfVectors(*func.getReturnType())) {
       IF_DEBUG {
         const VectorShape &retShape = getVectorShape(*inst);
         if (retShape.isUniform()) {
@@ -3488,10 +7220,6 @@ bool NatBuilder::shouldVectorize(Instruction *inst) {
   return false;
 }
 
-bool NatBuilder::isInterleaved(Instruction *inst, Value *accessedPtr, int byteSize, std::vector<Value *> &srcs) {
-  return false;
-}
-
 void NatBuilder::visitMemInstructions() {
   // iterate over all instructions of all basic blocks (order does not matter)
   // if we encounter a GEP of a memory instruction, check if we would scalarize or optimize it
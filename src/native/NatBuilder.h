@@ -12,6 +12,7 @@
 
 #include "MemoryAccessGrouper.h"
 
+#include <tuple>
 #include <vector>
 
 #include "rv/vectorizationInfo.h"
@@ -20,14 +21,17 @@
 #include "rv/intrinsics.h"
 #include "rv/analysis/UndeadMaskAnalysis.h"
 #include "rv/analysis/reductions.h"
+#include "rv/analysis/costModel.h"
 #include "llvm/IR/PassManager.h"
 
+#include <llvm/Analysis/LoopInfo.h>
 #include <llvm/Analysis/MemoryDependenceAnalysis.h>
 #include <llvm/IR/Dominators.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Allocator.h>
 
 
 namespace rv {
@@ -39,8 +43,7 @@ namespace rv {
   using ValVec = llvm::SmallVector<llvm::Value*, 16>;
 
   typedef std::map<const llvm::Function *, const rv::VectorMapping *> VectorMappingMap;
-  typedef std::vector<llvm::Value *> LaneValueVector;
-  typedef std::vector<llvm::BasicBlock *> BasicBlockVector;
+  typedef llvm::SmallVector<llvm::BasicBlock *, 2> BasicBlockVector;
 
   class NatBuilder {
     llvm::IRBuilder<> builder;
@@ -49,6 +52,7 @@ namespace rv {
     rv::PlatformInfo & platInfo;
     rv::VectorizationInfo &vecInfo;
     const llvm::DominatorTree &dominatorTree;
+    const llvm::LoopInfo &loopInfo;
     llvm::MemoryDependenceResults & memDepRes;
     llvm::ScalarEvolution &SE;
     rv::ReductionAnalysis & reda;
@@ -62,7 +66,37 @@ namespace rv {
     // the predicate argument in the vector function (WFV mode)
     llvm::Value * vecMaskArg;
 
+    // lane utilization counters of the divergent blocks (RV_LANE_STATS)
+    llvm::GlobalVariable * laneStatCounters;
+    llvm::DenseMap<const llvm::BasicBlock *, unsigned> laneStatIndex;
+    std::vector<const llvm::BasicBlock *> laneStatBlocks;
+
+    // allocate the counters for all blocks with a varying predicate
+    void createLaneStatCounters();
+    // count the execution and the active lanes of \p scaBlock (at the current insert point)
+    void emitLaneStatUpdate(const llvm::BasicBlock & scaBlock);
+    // dump the counters to the RV_LANE_STATS file at program exit
+    void createLaneStatWriter();
+
+    // runtime checks of shape hints and alignment assumptions (RV_CHECK_SHAPES)
+    struct ShapeCheck {
+      llvm::Instruction * violated; // scalar i1, set if the check fails
+      llvm::Value * laneBits; // <W x i1> of the violating lanes (nullptr for checks of scalar values)
+      std::string site; // function, hinted value and source location
+      const char * kind; // "uniform", "strided", "align"
+    };
+    std::vector<ShapeCheck> shapeHintChecks;
+    // record the check of the hinted value \p hinted with the per-lane (<W x i1>, inactive lanes of \p scaBlock masked out) or scalar result \p mismatch
+    void addShapeCheck(llvm::Value & mismatch, const llvm::BasicBlock & scaBlock, const llvm::Value & hinted, const char * kind);
+    // check the alignment of the aligned uniform pointer arguments of the WFV mapping at the function entry
+    void addArgumentShapeChecks();
+    // trap on (or report to Config::shapeCheckHook) the violated checks (after all blocks are vectorized)
+    void createShapeHintTraps();
+
     void printStatistics();
+    // the per-function deltas of the statistics counters as RV_REPORT_JSON metrics and llvm::Statistic
+    std::vector<unsigned> countersAtStart;
+    void reportMetrics();
 
     rv::VectorShape getVectorShape(const llvm::Value &val);
 
@@ -74,10 +108,19 @@ namespace rv {
 
     // generate reduction code (after all other instructions have been vectorized)
     void materializeVaryingReduction(rv::Reduction & red, llvm::PHINode & scaPhi);
-    void materializeOrderedReduction(rv::Reduction & red, llvm::PHINode & scaPhi);
-
-    // materialize a recurrence pattern (SCC only consists of phis and selects)
-    void materializeRecurrence(rv::Reduction & red, llvm::PHINode & scaPhi);
+    // horizontal reductions of the loop exit values (Config::enableTransposedReductions)
+    std::vector<std::pair<llvm::CallInst*, rv::RedKind>> exitReductions;
+    // reduce the exit reductions of the same kind and type in a block together (CreateTransposedReduce)
+    void combineExitReductions();
+    void materializeOrderedReduction(rv::Reduction & red, llvm::PHINode & scaPhi, bool blocked);
+    void materializeScanReduction(rv::Reduction & red, llvm::PHINode & scaPhi);
+    void materializeIndexReduction(rv::Reduction & red, llvm::PHINode & scaPhi);
+    // accumulate a dot product reduction with vpdpbusd/vpdpwssd/[su]dot. Returns false (and changes nothing) if the target has no matching instruction.
+    bool materializeDotProductReduction(rv::Reduction & red, llvm::PHINode & scaPhi);
+
+    // materialize a forward recurrence (prev = cur) by splicing the last lane of the previous vector
+    // in front of the current one. Returns the spliced vector (lower orders are materialized first).
+    llvm::Value & materializeRecurrence(rv::Reduction & red, llvm::PHINode & scaPhi);
 
     // fixup the
     void materializeStridePattern(rv::StridePattern & sp);
@@ -92,6 +135,15 @@ namespace rv {
     // scalarize without if-guard
     ValVec scalarize(llvm::BasicBlock & srcBlock, llvm::Instruction & srcInst, bool packResult, std::function<llvm::Value*(llvm::IRBuilder<>&,size_t)> genFunc);
 
+    // replicate \p srcInst in a loop over all lanes (only the active lanes if \p guarded) if straight-line copies would exceed Config::replicationBudget.
+    // Returns false (and emits nothing) if the straight-line copies are small enough or \p srcInst does not fit a lane loop.
+    bool scalarizeInLoop(llvm::Instruction & srcInst, bool guarded);
+
+    // waterfall lowering of a call through a varying function pointer: call each distinct target once for the lanes that share it,
+    // with its vector variant if the target is a known function with one (otw in a loop over those lanes).
+    // Returns false (and emits nothing) if \p scalCall does not qualify.
+    bool vectorizeWaterfallCall(llvm::CallInst & scalCall);
+
   public:
     NatBuilder(rv::Config config, rv::PlatformInfo &_platformInfo, rv::VectorizationInfo &_vecInfo,
                rv::ReductionAnalysis & _reda, llvm::FunctionAnalysisManager &FAM);
@@ -131,6 +183,11 @@ namespace rv {
     void vectorizeInstruction(llvm::Instruction *const inst);
     void vectorizePHIInstruction(llvm::PHINode *const scalPhi);
     void vectorizeMemoryInstruction(llvm::Instruction *const inst);
+    void vectorizeAggregateInstruction(llvm::Instruction & inst);
+    // extractelement, insertelement and shufflevector on widened short vectors (constant element indices)
+    void vectorizeShortVectorInstruction(llvm::Instruction & inst);
+    // contiguous loads and stores of short vectors, transposed between AoS in memory and SoA (false if not applicable)
+    bool vectorizeShortVectorMemory(llvm::Instruction & inst);
     void vectorizeCallInstruction(llvm::CallInst *const scalCall);
     void vectorizeReductionCall(llvm::CallInst *rvCall, bool isRv_all);
     void vectorizeExtractCall(llvm::CallInst *rvCall);
@@ -141,18 +198,48 @@ namespace rv {
     void vectorizeBallotCall(llvm::CallInst *rvCall);
     void vectorizePopCountCall(llvm::CallInst *rvCall);
     void vectorizeAlignCall(llvm::CallInst *rvCall);
+    // rv_uniform/rv_strided: the (first active) lane of the operand is the base of the hinted shape
+    void vectorizeShapeHintCall(llvm::CallInst *rvCall);
     void vectorizeIndexCall(llvm::CallInst & rvCall);
     void vectorizeCompactCall(llvm::CallInst * rvCall);
     void vectorizeLaneIDCall(llvm::CallInst *rvCall);
     void vectorizeNumLanesCall(llvm::CallInst *rvCall);
+    void vectorizePhiloxCall(llvm::CallInst *rvCall);
+    void vectorizeCrossLaneReduceCall(llvm::CallInst *rvCall, bool isScan);
+    void vectorizeShuffleXorCall(llvm::CallInst *rvCall);
+    void vectorizeBroadcastCall(llvm::CallInst *rvCall);
+    void vectorizeSortCall(llvm::CallInst *rvCall);
+    void vectorizePartitionCall(llvm::CallInst *rvCall);
+    void vectorizeRankCall(llvm::CallInst *rvCall);
+
+    // whether (key, lane) of \p lhs precedes that of \p rhs in the stable sort order of the active lanes
+    // (inactive lanes go last, \p lhsActive/\p rhsActive are nullptr for a full mask)
+    llvm::Value * createLaneOrderLess(llvm::Value & lhsKey, llvm::Value & lhsLane, llvm::Value * lhsActive,
+                                      llvm::Value & rhsKey, llvm::Value & rhsLane, llvm::Value * rhsActive);
+
+    // lane i of the result is lane laneIds[i] (modulo the vector width) of vecVal
+    // (one or two registers with variable permutes, otw one extract per lane)
+    llvm::Value * createLanePermute(llvm::Value & vecVal, llvm::Value & laneIds);
+    // whether vectors of \p vecTy permute with a single instruction (vpermd/vpermps/vpermq/vpermpd, tbl/tbl2)
+    bool hasRegisterPermute(const llvm::FixedVectorType & vecTy) const;
+    // that permute, nullptr if there is none
+    llvm::Value * createRegisterPermute(llvm::Value & vecVal, llvm::Value & laneIds);
 
     void vectorizeAtomicRMW(llvm::AtomicRMWInst *const atomicrmw);
 
     // create a lookup table for an efficient compaction intrinsic
     llvm::Constant* createCompactLookupTable(unsigned vecWidth);
+    // the <0, stride, .., (W-1) * stride> vector of \p laneTy, created once per region
+    llvm::DenseMap<std::pair<llvm::Type*, int>, llvm::Constant*> laneIndexPool;
+    llvm::Constant* getLaneIndexVector(llvm::Type & laneTy, int stride = 1);
+    // compact the active lanes of @vecVal (vcompress, lookup table or split-and-merge)
+    llvm::Value* createCompactedVector(llvm::Value * vecVal, llvm::Value * maskVal);
 
     void vectorizeAlloca(llvm::AllocaInst *const allocaInst);
 
+    // combine the varying-address atomic \p atomicrmw across lanes with equal addresses (vpconflict or emulation)
+    void createConflictFreeAtomicRMW(llvm::AtomicRMWInst & atomicrmw);
+
     // implement the mask summary function @mode (ballot/popcount) of @vecVal with @builder
     llvm::Value* createVectorMaskSummary(llvm::Type & indexTy, llvm::Value * vecVal, llvm::IRBuilder<> & builder, rv::RVIntrinsic mode);
 
@@ -171,9 +258,13 @@ namespace rv {
     llvm::DenseMap<unsigned, llvm::Function *> cascadeLoadMap;
     llvm::DenseMap<unsigned, llvm::Function *> cascadeStoreMap;
     llvm::DenseMap<const llvm::Value *, llvm::Value *> vectorValueMap;
-    std::map<const llvm::Value *, LaneValueVector> scalarValueMap;
-    std::map<const llvm::BasicBlock *, BasicBlockVector> basicBlockMap;
-    std::map<const llvm::Type *, rv::MemoryAccessGrouper> grouperMap;
+    // lane values of replicated values: one vectorWidth() slab per value from laneAllocator (nullptr for unmapped lanes)
+    llvm::BumpPtrAllocator laneAllocator;
+    llvm::DenseMap<const llvm::Value *, llvm::Value **> scalarValueMap;
+    llvm::DenseMap<const llvm::BasicBlock *, BasicBlockVector> basicBlockMap;
+    std::map<const llvm::BasicBlock *, std::vector<rv::InterleavedGroup>> interleavedGroups; // collected on first use
+    std::map<const llvm::BasicBlock *, std::vector<rv::CoalescedGather>> coalescedGathers; // collected on first use
+    llvm::ValueMap<llvm::Value *, llvm::WeakTrackingVH> maskBitsMap; // vector mask -> iW bitmask (see requestMaskBits)
     std::vector<llvm::PHINode *> phiVector;
     std::deque<llvm::Instruction *> lazyInstructions;
 
@@ -185,14 +276,33 @@ namespace rv {
     llvm::Value *requestScalarValue(llvm::Value *const value, unsigned laneIdx = 0,
                                     bool skipMapping = false);
     llvm::Value *buildGEP(llvm::GetElementPtrInst *const gep, bool buildScalar, unsigned laneIdx);
+
+    // index narrowing (Config::enableIndexNarrowing): varying GEP indexes wider than 32 bit whose value range fits
+    // 32 bits are computed in i32 lanes and sign-extended at the GEP (32-bit index gathers/scatters)
+    std::map<std::pair<const llvm::Value *, llvm::BasicBlock *>, llvm::Value *> narrowIndexMap;
+    // whether the value range of \p idx (ScalarEvolution) fits \p bits signed bits
+    bool fitsNarrowIndex(llvm::Value & idx, unsigned bits);
+    // the low \p narrowTy bits of \p idx in all lanes, computed in narrow lanes through add/sub/mul/shl/and/or/xor and extensions
+    llvm::Value *requestNarrowIndex(llvm::Value & idx, llvm::IntegerType & narrowTy, unsigned depth = 0);
+
+    // vector inductions (Config::enableVectorInductions): in vector loops, strided integers at a constant distance from a
+    // strided header phi are taken from a vector phi of that induction (stepped by splat(W * stride) in the latch)
+    // instead of broadcasting their scalar value and adding the lane offsets in every iteration
+    struct VectorInduction {
+      const llvm::PHINode *scaPhi;
+      llvm::IntegerType *laneTy; // the phi type or a narrow index type
+      llvm::PHINode *vecPhi; // completed by materializeStridePattern
+    };
+    std::vector<VectorInduction> vectorInductions;
+    // \p val in all lanes (truncated to \p laneTy) from a vector induction (nullptr if \p val is no such value)
+    llvm::Value *requestInductionVector(llvm::Value & val, llvm::IntegerType & laneTy);
+    // add the incoming values of the vector inductions of \p sp
+    void completeVectorInductions(rv::StridePattern & sp, int64_t laneStride);
     llvm::Value *requestVectorGEP(llvm::GetElementPtrInst *const gep);
     llvm::Value *requestScalarGEP(llvm::GetElementPtrInst *const gep, unsigned laneIdx, bool skipMapping);
     llvm::Value *requestVectorBitCast(llvm::BitCastInst *const bc);
     llvm::Value *requestScalarBitCast(llvm::BitCastInst *const bc, unsigned laneIdx, bool skipMapping);
 
-    llvm::Value *requestInterleavedGEP(llvm::GetElementPtrInst *const gep, unsigned interleavedIdx);
-    llvm::Value *requestInterleavedAddress(llvm::Value *const addr, unsigned interleavedIdx, llvm::Type *const vecType);
-
     llvm::Value *requestCascadeLoad(llvm::Type *accessedType, llvm::Value *vecPtr, unsigned alignment, llvm::Value *mask);
     llvm::Value *requestCascadeStore(llvm::Value *vecVal, llvm::Value *vecPtr, unsigned alignment, llvm::Value *mask);
     llvm::Function *createCascadeMemory(llvm::Type *accessedType, llvm::VectorType *pointerVectorType, unsigned alignment,
@@ -205,13 +315,24 @@ namespace rv {
     llvm::Value& widenScalar(llvm::Value & scaValue, VectorShape vecShape);
     bool hasUniformPredicate(const llvm::BasicBlock & BB) const;
     llvm::Value *createPTest(llvm::Value *vector, bool isRv_all);
+
+    // whether <W x i1> masks should be summarized through their iW bitmask (x86: kmask/movmsk)
+    bool useMaskBits(unsigned width) const;
+    // the iW bitmask of \p vecMask, created once next to the definition of \p vecMask
+    llvm::Value *requestMaskBits(llvm::Value &vecMask);
     llvm::Value *maskInactiveLanes(llvm::Value *const value, const llvm::BasicBlock* const block, bool invert);
 
     int vectorWidth() const;
 
     bool canVectorize(llvm::Instruction *inst);
+    // whether varying values of type \p ty are widened to SoA form (<k x T> to <k*W x T>)
+    bool isWidenedShortVector(const llvm::Type & ty) const;
+    bool canWidenShortVectorOp(const llvm::Instruction & inst) const;
     bool shouldVectorize(llvm::Instruction *inst);
-    bool isInterleaved(llvm::Instruction *inst, llvm::Value *accessedPtr, int byteSize, std::vector<llvm::Value *> &srcs);
+    // the interleaved group \p inst belongs to (nullptr if none)
+    const rv::InterleavedGroup *getInterleavedGroup(llvm::Instruction &inst);
+    // the coalesced gather \p inst belongs to (nullptr if none)
+    const rv::CoalescedGather *getCoalescedGather(llvm::Instruction &inst);
 
     // request and return all the vector arguments for calling \p vecCall with the vector mappings for the arguments in \p scaCall. this should also include the mask (if any).
     void requestVectorCallArgs(llvm::CallInst & scaCall, llvm::Function & vecCall, int maskPos, std::vector<llvm::Value*> & vectorArgs);
@@ -227,14 +348,132 @@ namespace rv {
     // a uniform value is stored to a uniform ptr (with a predicate)
     llvm::Value *createUniformMaskedMemory(llvm::Instruction *inst, llvm::Type *accessedType, llvm::Align alignment,
                                            llvm::Value *addr, llvm::Value * scalarMask, llvm::Value *vectorMask, llvm::Value *values);
-
-    llvm::Value *createVaryingMemory(llvm::Type *vecType, llvm::Align alignment, llvm::Value *addr, llvm::Value *mask,
-                                     llvm::Value *values);
-    void createInterleavedMemory(llvm::Type *targetType, llvm::Type *vecType, llvm::Align alignment, std::vector<llvm::Value *> *addr, std::vector<llvm::Value *> *mask,
-                                     std::vector<llvm::Value *> *values, std::vector<llvm::Value *> *srcs);
+    // whether \p load can execute without any active lane (Config::enableSpeculativeLoads): the pointer is dereferenceable
+    // or accessed on a dominating path that executes whenever the load's block is reached
+    bool canSpeculateLoad(llvm::LoadInst & load, llvm::Type & accessedType, llvm::Align alignment);
+    // whether the \p footprint bytes at \p vecPtr (lane 0 of the contiguous access to \p scalarPtr) can be loaded without a mask
+    bool isDereferenceableFootprint(llvm::Value & scalarPtr, llvm::Value & vecPtr, uint64_t footprint, llvm::Align alignment);
+
+    // division-free udiv/sdiv/urem/srem (see DivisionBuilder.h), nullptr if \p inst is not a supported division
+    llvm::Value *createIntegerDivision(llvm::Instruction &inst);
+    // fast-math fdiv (x / y, x / sqrt(y)) as a multiply by the refined reciprocal (square root) estimate
+    // (Config::enableFPEstimates), nullptr if the ISA has no estimate or the ULP error bound is out of reach
+    llvm::Value *createApproxDivision(llvm::Instruction &inst);
+    // select-based min/max and minnum/maxnum calls as native vector min/max (Config::enableNativeFPMinMax) if they are
+    // NaN-free and ignore signed zeros, nullptr otherwise
+    llvm::Value *createNativeMinMax(llvm::Instruction &inst);
+    // nnan and nsz for FMin/FMax reductions whose updates all qualify for createNativeMinMax, no flags otherwise
+    llvm::FastMathFlags getReductionFMF(rv::Reduction &red);
+
+    // integer operations without a native vector instruction (see IntegerEmulation.h): 64-bit multiply-high
+    // (trunc(lshr(mul(ext a, ext b), 64))), 64-bit ashr and 8-bit shifts. nullptr if \p inst is another instruction
+    // or the target has a cheaper vector instruction.
+    llvm::Value *createIntegerEmulation(llvm::Instruction &inst);
+    // the call \p call of an integer intrinsic (ctpop, smax, fshl, ..) as the vector intrinsic or its emulation,
+    // nullptr for other calls
+    llvm::Value *createIntegerIntrinsic(llvm::CallInst &call);
+    // whether \p emulationSize vector instructions on \p vecTy are cheaper than \p nativeCost (TTI)
+    bool isEmulationCheaper(unsigned emulationSize, llvm::InstructionCost nativeCost, llvm::FixedVectorType &vecTy);
+
+    // bit tests "(w >> s) & 1", "w & (1 << s)" of a uniform word w and a contiguous s as the lane bits of w bitcast to the
+    // mask (kmov, broadcast and compare with the lane bits, cmtst), tests of 0/1 bool loads as compares with 0
+    // (Config::enableBitMasks), nullptr for other instructions
+    llvm::Value *createBitMask(llvm::Instruction &inst);
+    // the bits that the bitset update "*p |= zext(c) << s" (contiguous s, vectorized as an Or memory reduction) sets in *p
+    // for the lanes of \p vecMask (all if nullptr), nullptr if \p scaPayload is not "zext(c) << s"
+    llvm::Value *createBitSetBits(llvm::Value &scaPayload, llvm::Value *vecMask);
+
+    // llvm.get.active.lane.mask for "rv_lane_id() < uniform bound" (nullptr if \p inst is another instruction)
+    llvm::Value *createActiveLaneMask(llvm::Instruction &inst);
+
+    // \p scaCast as \p numParts casts of native-width parts, concatenated to the full vector width
+    llvm::Value *createSplitCast(llvm::CastInst &scaCast, unsigned numParts);
+
+    // lowering of the non-dense access \p inst (by cost, see CostModel::pickVaryingAccess)
+    rv::VaryingAccessKind pickVaryingAccess(llvm::Instruction &inst, bool needsMask);
+
+    llvm::Value *createVaryingMemory(rv::VaryingAccessKind kind, llvm::Type *vecType, llvm::Align alignment, llvm::Value *addr,
+                                     llvm::Value *mask, llvm::Value *values);
+
+    // software prefetches (RV_PREFETCH) for the non-dense access \p inst in a loop region that will access the
+    // addresses of \p scaPtr (\p vecPtr in vector code) prefetchDistance vector iterations from now
+    unsigned prefetchDistance; // 0 until the first prefetch
+    void emitPrefetches(llvm::Instruction &inst, llvm::Value &scaPtr, llvm::Value &vecPtr);
+    // \p ptrs (a vector of pointers) + \p offset bytes per lane
+    void emitLanePrefetches(llvm::Value &ptrs, int64_t offset, bool forWrite);
+    // the byte stride of \p ptr per iteration of the vectorized loop, 0 if \p ptr is not affine in it
+    int64_t getLoopStride(llvm::Value &ptr);
+
+    // streaming stores (Config::enableStreamingStores): objects read in the loop region, stores that were made nontemporal
+    llvm::SmallPtrSet<const llvm::Value *, 8> loadedObjects;
+    unsigned numRegionStreamingStores;
+
+    // SLEEF fast paths (Config::enableSleefColdSplit): instructions that may still be inlined into the region (-1 until computed)
+    int inlineBudget;
+    // whether the call to the split SLEEF function \p simdFunc (rv-fast-path-size) must stay out-of-line to keep the region small
+    bool exceedsInlineBudget(llvm::Function &simdFunc);
+
+    // uniform offload (Config::enableUniformOffload): the scalar block that is being vectorized
+    const llvm::BasicBlock * curScaBlock;
+    // the block that ends with the broadcast of the uniform \p scaInst, nullptr to broadcast right after its definition
+    const llvm::BasicBlock * getBroadcastBlock(const llvm::Instruction & scaInst);
+    void collectLoadedObjects();
+    // demanded lanes (Config::enableDemandedLanes): varying lane-wise instructions whose only consumers read a single
+    // constant lane (rv_extract) and that are computed for that lane only
+    std::map<const llvm::Instruction *, unsigned> singleLaneInsts;
+    void collectDemandedLanes();
+    // whether the full-vector store \p scaStore (aligned to \p alignment) writes a write-only output stream
+    bool isStreamingStore(llvm::StoreInst &scaStore, llvm::Type &vecType, llvm::Align alignment);
+    // order the streaming stores before the code after the loop (x86: sfence in the region exits)
+    void fenceStreamingStores();
+    // address-shape dispatch (Config::enableAddressDispatch): the (isUniform, isContiguous) tests of the accesses of
+    // byte size n from the same base in a scalar block, computed once per block
+    std::map<std::tuple<const llvm::Value *, uint64_t, const llvm::BasicBlock *>, std::pair<llvm::Value *, llvm::Value *>> addressTestMap;
+    std::pair<llvm::Value *, llvm::Value *> requestAddressTests(llvm::LoadInst &load, llvm::Value *vecPtrs, llvm::Value *mask);
+    // the varying load \p load from \p vecPtrs as a branch to a broadcast scalar load (uniform addresses), a vector load
+    // (contiguous addresses) or the \p kind access
+    llvm::Value *createAddressDispatch(llvm::LoadInst &load, rv::VaryingAccessKind kind, llvm::Type *vecType, llvm::Align alignment,
+                                       llvm::Value *vecPtrs, llvm::Value *mask);
+    // index-run dispatch (Config::enableIndexRuns): the index of the varying load \p load from base[idx] if idx is
+    // (an extension of) a contiguous load from an index array, nullptr otherwise
+    llvm::Value *getRunIndex(llvm::LoadInst &load);
+    // whether the active lanes of the index \p scaIdx are idx[0] + laneid, computed once per index and scalar block
+    std::map<std::pair<const llvm::Value *, const llvm::BasicBlock *>, llvm::Value *> indexRunTestMap;
+    llvm::Value *requestIndexRunTest(llvm::Value &scaIdx, const llvm::BasicBlock &scaBlock, llvm::Value *mask);
+    // the varying load \p load through the index \p scaIdx as a branch to a vector load from lane 0 (consecutive indices)
+    // or the \p kind access
+    llvm::Value *createIndexRunDispatch(llvm::LoadInst &load, llvm::Value &scaIdx, rv::VaryingAccessKind kind, llvm::Type *vecType,
+                                        llvm::Align alignment, llvm::Value *vecPtrs, llvm::Value *mask);
+    // the load or store \p inst through select(varying c, p, q) of dense or (loads only) uniform p and q as an access
+    // to p under \p mask && c, one to q under \p mask && !c and a blend of the loaded values (Config::enableSelectAccessSplit).
+    // \p mask is nullptr for unpredicated accesses. Returns nullptr if \p inst does not have this form.
+    llvm::Value *createSelectSplitAccess(llvm::Instruction &inst, llvm::Value *mask);
+    // the store \p store of \p values to \p vecPtrs (VaryingAccessKind::ClusteredScatter): one masked vector store from the
+    // lowest active address if all active lanes fall within the vector from there (later lanes win on equal addresses),
+    // the cheapest other varying access otherwise
+    llvm::Value *createClusteredScatter(llvm::StoreInst &store, llvm::Type *vecType, llvm::Align alignment, llvm::Value *vecPtrs,
+                                        llvm::Value *mask, llvm::Value *values);
+    // the load \p inst from a small constant table (VaryingAccessKind::TableLookup) as permutations of the table registers
+    llvm::Value *createTableLookup(llvm::Instruction &inst);
+    // load the (vectorWidth - 1) * factor + 1 elements from \p ptr on and pick every \p factor-th element
+    llvm::Value *createStridedSpanLoad(llvm::Type *vecType, llvm::Value *ptr, llvm::Align alignment, llvm::Value *mask, unsigned factor);
+    // load (or store) all members of \p group as vectorWidth-wide chunks and (de-)interleave them with shuffles
+    void createInterleavedGroup(const rv::InterleavedGroup &group);
+    // gather the windows of \p group as wide integer elements and extract the members with shuffles
+    void createCoalescedGather(const rv::CoalescedGather &group);
 
     llvm::Value *createContiguousStore(llvm::Value *val, llvm::Value *ptr, llvm::Align alignment, llvm::Value *mask);
     llvm::Value *createContiguousLoad(llvm::Type *targetType, llvm::Value *ptr, llvm::Align alignment, llvm::Value *mask, llvm::Value *passThru);
+    // strip-mined loops (VectorizationInfo::getEntryAVL): the AVL as i32 explicit vector length, nullptr otherwise
+    llvm::Value *requestEntryEVL();
+    // contiguous vp.load/vp.store with explicit vector length \p evl (lanes beyond it are not accessed)
+    llvm::Value *createVPLoad(llvm::Type *vecType, llvm::Value *ptr, llvm::Align alignment, llvm::Value *mask, llvm::Value &evl);
+    llvm::Value *createVPStore(llvm::Value *val, llvm::Value *ptr, llvm::Align alignment, llvm::Value *mask, llvm::Value &evl);
+    // access metadata (Config::enableAccessMetadata): the scalar loads/stores that the memory instructions emitted next
+    // stand for (the access or the members of its interleaved group)
+    llvm::SmallVector<llvm::Value *, 4> accessSources;
+    // \p access keeps the TBAA, alias scope, noalias and access group metadata that all accessSources have, returns \p access
+    llvm::Value *tagAccess(llvm::Value *access);
 
     void visitMemInstructions();
 
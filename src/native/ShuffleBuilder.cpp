@@ -7,10 +7,13 @@
 //
 // @author montada
 
+#include <algorithm>
 #include <deque>
 #include "ShuffleBuilder.h"
 #include "Utils.h"
 
+#include <llvm/Support/MathExtras.h>
+
 using namespace llvm;
 
 namespace rv {
@@ -38,141 +41,111 @@ void ShuffleBuilder::add(std::vector<Value *> &sources) {
     cropped = true;
 }
 
-llvm::Value *ShuffleBuilder::shuffleFromInterleaved(llvm::IRBuilder<> &builder, unsigned stride, unsigned start) {
-  if (cropped)
-    prepareCroppedVector(builder);
-
-  // expects that the values of each input vector ARE interleaved. creates an non-interleaved value
-  // use a loop that builds shuffles until all input vectors have been used
-  // shuffles are build like this: take the last shuffle and the next input vector and the shuffle mask
-  // as shuffle mask, fixed positions from last shuffle, then all indices of form start + k * stride that are inside
-  // the second argument vector. the shuffle that is build becomes the new last shuffle
-  // initialize like this: last shuffle = inputVectors[0], next input vector = inputVectors[1],
-  // shuffleMask = <[start + k * stride](=m1)> for all m1 < vectorWidth
-  // lastly, return lastShuffle
-
-  assert(inputVectors.size() >= 2 && "not enough input vectors to build shuffle");
-  Value *lastShuffle = inputVectors[0];
-  Value *nextInput;
-  std::vector<unsigned> shuffleMask;
-  unsigned inputVectorIndex = 1;
-  unsigned indexLimit = vectorWidth * 2;
-  unsigned index = start;
-
-  // index init
-  while (index < vectorWidth) {
-    shuffleMask.push_back(index);
-    index += stride;
+llvm::Value *ShuffleBuilder::combineInputs(llvm::IRBuilder<> &builder, std::function<std::pair<unsigned, unsigned>(unsigned)> laneSource) {
+  // lane l of the result is element laneSource(l).second of input vector laneSource(l).first.
+  // inputs are merged into the result one at a time: every shuffle keeps the lanes taken so far
+  // and adds those of the next input, which is the least number of two-operand shuffles.
+  std::vector<unsigned> inputOrder;
+  for (unsigned l = 0; l < vectorWidth; ++l) {
+    unsigned input = laneSource(l).first;
+    assert(input < inputVectors.size() && "lane source out of bounds!");
+    if (std::find(inputOrder.begin(), inputOrder.end(), input) == inputOrder.end())
+      inputOrder.push_back(input);
   }
 
-  do {
-    nextInput = inputVectors[inputVectorIndex];
-
-    assert(index >= vectorWidth && index < vectorWidth * 2 && "index not inside 2nd vector!");
-
-    // index is now inside the 2nd vector. compute all indices that lie inside
-    while (index < indexLimit) {
-      shuffleMask.push_back(index);
-      index += stride;
+  auto getMask = [&](unsigned input, unsigned inputBase, bool keepTaken, std::vector<int> & mask) {
+    for (unsigned l = 0; l < vectorWidth; ++l) {
+      auto source = laneSource(l);
+      if (source.first == input) mask[l] = inputBase + source.second;
+      else if (keepTaken && mask[l] >= 0) mask[l] = l;
     }
-    unsigned undefIndex = static_cast<unsigned>(shuffleMask.size());
+  };
 
-    // build a shuffle and init next iteration (except nextInput to avoid out-of-bounds access
-    Value *shuffleMaskVector = getConstantVectorPadded(vectorWidth, builder.getInt32Ty(), shuffleMask);
-    lastShuffle = builder.CreateShuffleVector(lastShuffle, nextInput, shuffleMaskVector, "native_shuffle");
+  std::vector<int> shuffleMask(vectorWidth, -1);
+  Value *lastShuffle = inputVectors[inputOrder[0]];
+  getMask(inputOrder[0], 0, false, shuffleMask);
+  if (inputOrder.size() == 1)
+    return builder.CreateShuffleVector(lastShuffle, UndefValue::get(lastShuffle->getType()), shuffleMask, "native_shuffle");
 
-    // lastShuffle will have the first <undefIndex> elements set
-    shuffleMask.erase(shuffleMask.begin(), shuffleMask.end());
-    for (unsigned i = 0; i < undefIndex; ++i) {
-      shuffleMask.push_back(i);
-    }
-
-    assert(index >= vectorWidth * 2 && index < vectorWidth * 3 && "index not inside 3rd vector!");
-
-    // index now points to the 3rd vector. subtract vectorWidth as it will become new 2nd vector
-    index -= vectorWidth;
+  for (unsigned i = 1; i < inputOrder.size(); ++i) {
+    getMask(inputOrder[i], vectorWidth, i > 1, shuffleMask);
+    lastShuffle = builder.CreateShuffleVector(lastShuffle, inputVectors[inputOrder[i]], shuffleMask, "native_shuffle");
+  }
+  return lastShuffle;
+}
 
-    // go to next element
-    ++inputVectorIndex;
+bool ShuffleBuilder::useShuffleTree(unsigned stride) const {
+  return shuffleTrees && stride >= 4 && isPowerOf2_32(stride) && isPowerOf2_32(vectorWidth) && vectorWidth >= 2 &&
+         inputVectors.size() == stride;
+}
 
-  } while (inputVectorIndex < inputVectors.size());
+llvm::Value *ShuffleBuilder::getUnzipped(llvm::IRBuilder<> &builder, unsigned round, unsigned residue, unsigned index) {
+  if (round == 0) return inputVectors[index];
+  auto key = std::make_tuple(false, round, residue, index);
+  auto itCached = treeCache.find(key);
+  if (itCached != treeCache.end()) return itCached->second;
+
+  // every other element of two vectors of the coarser class, starting at the bit of this round
+  unsigned parentResidue = residue & ((1u << (round - 1)) - 1);
+  unsigned odd = (residue >> (round - 1)) & 1;
+  Value *lo = getUnzipped(builder, round - 1, parentResidue, 2 * index);
+  Value *hi = getUnzipped(builder, round - 1, parentResidue, 2 * index + 1);
+  std::vector<int> mask(vectorWidth);
+  for (unsigned l = 0; l < vectorWidth; ++l) mask[l] = 2 * l + odd;
+  Value *unzipped = builder.CreateShuffleVector(lo, hi, mask, odd ? "uzp_odd" : "uzp_even");
+
+  treeCache[key] = unzipped;
+  return unzipped;
+}
 
-  return lastShuffle;
+llvm::Value *ShuffleBuilder::getZipped(llvm::IRBuilder<> &builder, unsigned round, unsigned numRounds, unsigned residue, unsigned index) {
+  if (round == numRounds) return inputVectors[residue];
+  auto key = std::make_tuple(true, round, residue, index);
+  auto itCached = treeCache.find(key);
+  if (itCached != treeCache.end()) return itCached->second;
+
+  // the low (even index) or high half of the two finer classes, alternating
+  Value *even = getZipped(builder, round + 1, numRounds, residue, index / 2);
+  Value *odd = getZipped(builder, round + 1, numRounds, residue + (1u << round), index / 2);
+  unsigned half = (index % 2) * (vectorWidth / 2);
+  std::vector<int> mask(vectorWidth);
+  for (unsigned l = 0; l < vectorWidth; ++l) mask[l] = (l % 2) * vectorWidth + half + l / 2;
+  Value *zipped = builder.CreateShuffleVector(even, odd, mask, half ? "zip_hi" : "zip_lo");
+
+  treeCache[key] = zipped;
+  return zipped;
 }
 
-llvm::Value *ShuffleBuilder::shuffleToInterleaved(llvm::IRBuilder<> &builder, unsigned stride, unsigned start) {
+llvm::Value *ShuffleBuilder::shuffleFromInterleaved(llvm::IRBuilder<> &builder, unsigned stride, unsigned start) {
   if (cropped)
     prepareCroppedVector(builder);
+  cropped = false;
 
-  // expects that the values of each input vector are NOT interleaved. creates an interleaved value
-  // use a loop that builds shuffles until all <vectorWidth> positions are set
-  // shuffles are build like this: take the last shuffle and the next input vector and the shuffle mask
-  // as shuffle mask: all positions that have been set in lastShuffle, then all undef positions (will be k * stride)
-  // set to <vecWidth> + k. the shuffle that is build becomes the new last shuffle
-  // initialize like this: last shuffle = inputVectors[0], next input vector = inputVectors[1],
-  // shuffleMask = <[k * stride](=m1)> for all m1 < vectorWidth
-  // lastly, return lastShuffle
-
-  Type *i32Ty = builder.getInt32Ty();
-
-  assert(inputVectors.size() >= 2 && "not enough input vectors to build shuffle");
-  unsigned inputVectorIndex = ((vectorWidth % stride) * start) % static_cast<unsigned>(inputVectors.size());
-  Value *lastShuffle = inputVectors[inputVectorIndex];
-  Value *nextInput;
-  std::vector<Constant *> shuffleMask(vectorWidth, UndefValue::get(i32Ty));
-  inputVectorIndex = (inputVectorIndex + 1) % static_cast<unsigned>(inputVectors.size());
-  unsigned counter = 1;
-
-  // index init
-  unsigned i = (vectorWidth / stride) * start;
-  unsigned index = 0;
-  while (index < vectorWidth) {
-    Constant *constIdx = ConstantInt::get(i32Ty, i);
-    shuffleMask[index] = constIdx;
-    ++i;
-    index += stride;
-  }
+  if (useShuffleTree(stride))
+    return getUnzipped(builder, Log2_32(stride), start, 0);
 
-  do {
-    nextInput = inputVectors[inputVectorIndex];
-
-    // set shuffle mask for next input
-    i = ((vectorWidth / stride) * start) + vectorWidth;
-    index = counter;
-    while (index < vectorWidth) {
-      Constant *constIdx = ConstantInt::get(i32Ty, i);
-      shuffleMask[index] = constIdx;
-      ++i;
-      index += stride;
-    }
+  // expects that the values of each input vector ARE interleaved (member m of lane l at position l * stride + m
+  // of the concatenated inputs). creates the non-interleaved vector of member <start>
+  return combineInputs(builder, [&](unsigned lane) {
+    unsigned pos = lane * stride + start;
+    return std::make_pair(pos / vectorWidth, pos % vectorWidth);
+  });
+}
 
-    // if we create the right-most transposition for pseudo-shuffling, remove the very last index in the last iteration
-    // to get a vector size conform with the cropped size
-    if (start == inputVectors.size() - 1 && counter == inputVectors.size() - 1 && cropped)
-      for (unsigned k = 1; k < inputVectors.size(); ++k) {
-        shuffleMask.pop_back();
-      }
-
-    // create shuffle
-    Value *idxVector = ConstantVector::get(shuffleMask);
-    lastShuffle = builder.CreateShuffleVector(lastShuffle, nextInput, idxVector, "native_shuffle");
-
-    // prepare next iteration
-    inputVectorIndex = (inputVectorIndex + 1) % static_cast<unsigned>(inputVectors.size());
-    ++counter;
-
-    // loop over the shuffle mask and replace the already set positions with identity constant
-    for (i = 0; i < vectorWidth; ++i) {
-      Constant *constIdx = shuffleMask[i];
-      if (isa<UndefValue>(constIdx))
-        continue;
-      constIdx = ConstantInt::get(i32Ty, i);
-      shuffleMask[i] = constIdx;
-    }
+llvm::Value *ShuffleBuilder::shuffleToInterleaved(llvm::IRBuilder<> &builder, unsigned stride, unsigned start) {
+  if (cropped)
+    prepareCroppedVector(builder);
+  cropped = false;
 
-  } while (counter < inputVectors.size());
+  if (useShuffleTree(stride))
+    return getZipped(builder, 0, Log2_32(stride), 0, start);
 
-  return lastShuffle;
+  // expects that the values of each input vector are NOT interleaved (input m holds member m of all lanes).
+  // creates the <start>-th vector of the interleaved sequence
+  return combineInputs(builder, [&](unsigned lane) {
+    unsigned pos = start * vectorWidth + lane;
+    return std::make_pair(pos % stride, pos / stride);
+  });
 }
 
 Value *ShuffleBuilder::append(IRBuilder<> &builder) {
@@ -13,6 +13,9 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Value.h>
 
+#include <functional>
+#include <map>
+#include <tuple>
 #include <vector>
 
 namespace rv {
@@ -21,12 +24,28 @@ namespace rv {
     std::vector<llvm::Value *> inputVectors;
     bool cropped;
 
+    // power-of-two strides (>= 4) as log2(stride) rounds of two-source even/odd (uzp) or low/high (zip) shuffles,
+    // that is stride * log2(stride) shuffles for all members instead of (stride - 1) per member.
+    // intermediate vectors are shared by all members shuffled with this builder.
+    bool shuffleTrees;
+    std::map<std::tuple<bool, unsigned, unsigned, unsigned>, llvm::Value *> treeCache; // (interleave, round, class, vector)
+    bool useShuffleTree(unsigned stride) const;
+    // vector \p index of the elements at positions = \p residue (mod 2^round) of the interleaved inputs
+    llvm::Value *getUnzipped(llvm::IRBuilder<> &builder, unsigned round, unsigned residue, unsigned index);
+    // vector \p index of the interleaved members = \p residue (mod 2^round), \p numRounds: log2(stride)
+    llvm::Value *getZipped(llvm::IRBuilder<> &builder, unsigned round, unsigned numRounds, unsigned residue, unsigned index);
+
     void prepareCroppedVector(llvm::IRBuilder<> &builder);
 
+    // build the vector whose lane l is element laneSource(l).second of input vector laneSource(l).first
+    llvm::Value *combineInputs(llvm::IRBuilder<> &builder, std::function<std::pair<unsigned, unsigned>(unsigned)> laneSource);
+
   public:
-    ShuffleBuilder(unsigned vectorWidth) : vectorWidth(vectorWidth), inputVectors(), cropped(false) {}
+    ShuffleBuilder(unsigned vectorWidth, bool shuffleTrees = false) : vectorWidth(vectorWidth), inputVectors(), cropped(false),
+                                                                      shuffleTrees(shuffleTrees) {}
     ShuffleBuilder(std::vector<llvm::Value *> &sources, unsigned vectorWidth) : vectorWidth(vectorWidth),
-                                                                               inputVectors(sources), cropped(false) {}
+                                                                               inputVectors(sources), cropped(false),
+                                                                               shuffleTrees(false) {}
 
     void add(llvm::Value *vector);
     void add(std::vector<llvm::Value *> &sources);
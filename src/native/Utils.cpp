@@ -19,8 +19,10 @@ using namespace rv;
 Type *getVectorType(Type *type, unsigned width) {
   if (type->isVoidTy())
     return type;
-  else
-    return FixedVectorType::get(type, width);
+  // short vectors are widened element-major (SoA): element j of lane l is at j * width + l
+  if (auto *innerTy = dyn_cast<FixedVectorType>(type))
+    return FixedVectorType::get(innerTy->getElementType(), innerTy->getNumElements() * width);
+  return FixedVectorType::get(type, width);
 }
 
 Value *createContiguousVector(unsigned width, Type *type, int start, int stride) {
@@ -41,6 +43,15 @@ llvm::Value *getConstantVector(unsigned width, Type *type, unsigned value) {
 
 llvm::Value *getConstantVector(unsigned width, Constant *constant) {
   std::vector<Constant *> constants;
+  // short vector constants are broadcast in SoA order
+  if (auto *innerTy = dyn_cast<FixedVectorType>(constant->getType())) {
+    for (unsigned j = 0; j < innerTy->getNumElements(); ++j) {
+      for (unsigned i = 0; i < width; ++i) {
+        constants.push_back(constant->getAggregateElement(j));
+      }
+    }
+    return ConstantVector::get(constants);
+  }
   constants.reserve(width);
   for (unsigned i = 0; i < width; ++i) {
     constants.push_back(constant);
@@ -64,6 +75,53 @@ Value *getConstantVectorPadded(unsigned width, Type *type, std::vector<unsigned>
   return ConstantVector::get(constants);
 }
 
+Value *createShortVectorBroadcast(IRBuilder<> &builder, Value *shortVec, unsigned width) {
+  unsigned numElems = cast<FixedVectorType>(shortVec->getType())->getNumElements();
+  SmallVector<int, 32> mask;
+  for (unsigned j = 0; j < numElems; ++j) {
+    for (unsigned i = 0; i < width; ++i) mask.push_back(j);
+  }
+  return builder.CreateShuffleVector(shortVec, mask, shortVec->getName() + "_widened");
+}
+
+Value *createShortVectorLaneExtract(IRBuilder<> &builder, Value *wideVec, unsigned width, unsigned laneIdx) {
+  unsigned numElems = cast<FixedVectorType>(wideVec->getType())->getNumElements() / width;
+  SmallVector<int, 8> mask;
+  for (unsigned j = 0; j < numElems; ++j) mask.push_back(j * width + laneIdx);
+  return builder.CreateShuffleVector(wideVec, mask, "extract");
+}
+
+Value *createShortVectorLaneInsert(IRBuilder<> &builder, Value *wideVec, Value *shortVec, unsigned width, unsigned laneIdx) {
+  unsigned numWide = cast<FixedVectorType>(wideVec->getType())->getNumElements();
+  // spread the lane over the wide vector, then blend it into its lane positions
+  SmallVector<int, 32> spreadMask(numWide, -1);
+  SmallVector<int, 32> blendMask;
+  for (unsigned i = 0; i < numWide; ++i) blendMask.push_back(i);
+  for (unsigned j = 0; j * width < numWide; ++j) {
+    spreadMask[j * width + laneIdx] = j;
+    blendMask[j * width + laneIdx] = numWide + j * width + laneIdx;
+  }
+  auto *spread = builder.CreateShuffleVector(shortVec, spreadMask);
+  return builder.CreateShuffleVector(wideVec, spread, blendMask, "_revec");
+}
+
+SmallVector<int, 32> getWidenedShuffleMask(ArrayRef<int> mask, unsigned width) {
+  // element e of either operand (both widened) starts at e * width
+  SmallVector<int, 32> wideMask;
+  for (int elem : mask) {
+    for (unsigned i = 0; i < width; ++i) wideMask.push_back(elem < 0 ? -1 : elem * width + i);
+  }
+  return wideMask;
+}
+
+SmallVector<int, 32> getTransposeMask(unsigned numRows, unsigned numCols) {
+  SmallVector<int, 32> mask;
+  for (unsigned c = 0; c < numCols; ++c) {
+    for (unsigned r = 0; r < numRows; ++r) mask.push_back(r * numCols + c);
+  }
+  return mask;
+}
+
 Value *getPointerOperand(Instruction *instr) {
   LoadInst *load = dyn_cast<LoadInst>(instr);
   StoreInst *store = dyn_cast<StoreInst>(instr);
@@ -205,7 +263,7 @@ unsigned getStructOffset(GetElementPtrInst *const gep) {
   return 0;
 }
 
-void setInsertionToDomBlockEnd(IRBuilder<> &builder, std::vector<llvm::BasicBlock *> &blocks) {
+void setInsertionToDomBlockEnd(IRBuilder<> &builder, ArrayRef<llvm::BasicBlock *> blocks) {
   BasicBlock *domBlock = nullptr;
   for (BasicBlock *block : blocks) {
     if (block->getName().count("cascade_masked"))
@@ -17,6 +17,7 @@
 #include <rv/PlatformInfo.h>
 #include <llvm/IR/IRBuilder.h>
 
+// <width x type>, a short vector <k x T> becomes <k * width x T> (k vectors of width lanes)
 llvm::Type *getVectorType(llvm::Type *type, unsigned width);
 
 llvm::Value *createContiguousVector(unsigned width, llvm::Type *ElemType, int start, int stride);
@@ -25,6 +26,14 @@ llvm::Value *getConstantVector(unsigned width, llvm::Type *type, unsigned value)
 llvm::Value *getConstantVector(unsigned width, llvm::Constant *constant);
 llvm::Value *getConstantVectorPadded(unsigned width, llvm::Type *type, std::vector<unsigned> &values, bool padWithZero = false);
 
+// short vectors in SoA form (see getVectorType)
+llvm::Value *createShortVectorBroadcast(llvm::IRBuilder<> &builder, llvm::Value *shortVec, unsigned width);
+llvm::Value *createShortVectorLaneExtract(llvm::IRBuilder<> &builder, llvm::Value *wideVec, unsigned width, unsigned laneIdx);
+llvm::Value *createShortVectorLaneInsert(llvm::IRBuilder<> &builder, llvm::Value *wideVec, llvm::Value *shortVec, unsigned width, unsigned laneIdx);
+llvm::SmallVector<int, 32> getWidenedShuffleMask(llvm::ArrayRef<int> mask, unsigned width);
+// shuffle mask that transposes a row-major numRows x numCols matrix
+llvm::SmallVector<int, 32> getTransposeMask(unsigned numRows, unsigned numCols);
+
 llvm::Value *getPointerOperand(llvm::Instruction *instr);
 llvm::Value *getBasePointer(llvm::Value *addr);
 
@@ -42,6 +51,6 @@ llvm::StructType * isStructAccess(llvm::GetElementPtrInst *const address);
 unsigned getNumLeafElements(llvm::Type *const type, llvm::Type *const leafType, llvm::DataLayout &layout);
 unsigned getStructOffset(llvm::GetElementPtrInst *const gep);
 
-void setInsertionToDomBlockEnd(llvm::IRBuilder<> &builder, std::vector<llvm::BasicBlock *> &blocks);
+void setInsertionToDomBlockEnd(llvm::IRBuilder<> &builder, llvm::ArrayRef<llvm::BasicBlock *> blocks);
 
 #endif //NATIVE_UTILS_H
@@ -8,18 +8,18 @@
 
 #include "rv/passes.h"
 
-#include "llvm/Transforms/AggressiveInstCombine/AggressiveInstCombine.h"
 #include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils.h"
 
+#include "rv/passes/AoSoALayoutPass.h"
 #include "rv/passes/AutoMathPass.h"
 #include "rv/passes/LoopVectorizer.h"
+#include "rv/passes/cleanupPass.h"
 #include "rv/passes/WFVPass.h"
 #include "rv/passes/loopExitCanonicalizer.h"
 #include "rv/passes/lowerRVIntrinsics.h"
 
-#include "llvm/Transforms/Scalar/ADCE.h"
 #include "llvm/Transforms/Utils/LCSSA.h"
 #include "llvm/Transforms/Utils/LoopSimplify.h"
 
@@ -40,23 +40,19 @@ void addPreparatoryPasses(FunctionPassManager &FPM) {
 }
 
 void addPreparatoryPasses(ModulePassManager &MPM) {
+  // AoSoA layout for rv_layout annotated global arrays
+  MPM.addPass(AoSoALayoutWrapperPass());
+
   llvm::FunctionPassManager FPM;
   addPreparatoryPasses(FPM);
   MPM.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(FPM)));
 }
 
-static void addCleanupPasses(FunctionPassManager &FPM) {
-  // post rv cleanup
-  FPM.addPass(AggressiveInstCombinePass());
-  FPM.addPass(ADCEPass());
-}
-
 void addCleanupPasses(ModulePassManager &MPM) {
   // post rv cleanup
   MPM.addPass(AlwaysInlinerPass());
-  llvm::FunctionPassManager FPM;
-  addCleanupPasses(FPM);
-  MPM.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(FPM)));
+  // only on the functions that RV changed
+  MPM.addPass(CleanupWrapperPass());
 }
 
 void addRVPasses(ModulePassManager &MPM) {
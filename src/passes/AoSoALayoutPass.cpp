@@ -0,0 +1,389 @@
+//===- src/passes/AoSoALayoutPass.cpp - AoSoA layout for annotated global arrays --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/passes/AoSoALayoutPass.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MathExtras.h"
+
+#include "rvConfig.h"
+#include "report.h"
+
+#if 1
+#define IF_DEBUG_AOSOA IF_DEBUG
+#else
+#define IF_DEBUG_AOSOA if (true)
+#endif
+
+using namespace llvm;
+
+// elements per block if the annotation does not specify it
+static const unsigned DefaultBlockSize = 8;
+
+namespace rv {
+
+// "rv_layout" or "rv_layout=<block size>", 0 for other annotations
+static unsigned
+ParseLayoutAnnotation(StringRef annotation) {
+  if (!annotation.consume_front("rv_layout")) return 0;
+  if (annotation.empty()) return DefaultBlockSize;
+
+  unsigned blockSize;
+  if (!annotation.consume_front("=") || annotation.getAsInteger(10, blockSize) || !isPowerOf2_32(blockSize)) {
+    Report() << "aosoa: ignoring malformed annotation rv_layout" << annotation << "\n";
+    return 0;
+  }
+  return blockSize;
+}
+
+// uses of a global in llvm.global.annotations and llvm.(compiler.)used survive any layout
+static bool
+IsMetaUse(const User & user) {
+  if (auto * gv = dyn_cast<GlobalVariable>(&user)) {
+    StringRef name = gv->getName();
+    return name == "llvm.global.annotations" || name == "llvm.used" || name == "llvm.compiler.used";
+  }
+  auto * constUser = dyn_cast<Constant>(&user);
+  if (!constUser || isa<GlobalValue>(constUser) || isa<ConstantExpr>(constUser)) return false;
+  for (auto * metaUser : constUser->users()) {
+    if (!IsMetaUse(*metaUser)) return false;
+  }
+  return true;
+}
+
+// struct of scalar fields
+static bool
+IsLayoutStruct(Type & type) {
+  auto * structTy = dyn_cast<StructType>(&type);
+  if (!structTy || structTy->isOpaque() || structTy->getNumElements() == 0) return false;
+  for (auto * fieldTy : structTy->elements()) {
+    if (!fieldTy->isIntegerTy() && !fieldTy->isFloatingPointTy()) return false;
+  }
+  return true;
+}
+
+AoSoALayout::AoSoALayout(Module & _mod)
+: mod(_mod)
+, DL(_mod.getDataLayout())
+, elemTy(nullptr)
+, blockSize(0)
+, blockTy(nullptr)
+{}
+
+bool
+AoSoALayout::decomposeGEP(GetElementPtrInst & gep, Value *& elemDelta, int & field) const {
+  if (gep.getType()->isVectorTy()) return false;
+  auto * srcTy = gep.getSourceElementType();
+  unsigned numIndices = gep.getNumIndices();
+  auto itIdx = gep.idx_begin();
+  elemDelta = nullptr;
+  field = -1;
+
+  // constant byte offsets (canonical form of field accesses)
+  if (srcTy->isIntegerTy(8)) {
+    auto * offsetCI = dyn_cast<ConstantInt>(itIdx->get());
+    if (numIndices != 1 || !offsetCI || offsetCI->isNegative()) return false;
+    uint64_t elemSize = DL.getTypeAllocSize(elemTy).getFixedValue();
+    uint64_t offset = offsetCI->getZExtValue();
+    uint64_t fieldOffset = offset % elemSize;
+    elemDelta = ConstantInt::get(offsetCI->getType(), offset / elemSize);
+    if (fieldOffset == 0) return true;
+    auto * structLayout = DL.getStructLayout(elemTy);
+    unsigned fieldIdx = structLayout->getElementContainingOffset(fieldOffset);
+    if (structLayout->getElementOffset(fieldIdx) != fieldOffset) return false;
+    field = fieldIdx;
+    return true;
+  }
+
+  // [N x elemTy]: leading zero into the array
+  if (auto * arrTy = dyn_cast<ArrayType>(srcTy)) {
+    auto * zeroCI = dyn_cast<ConstantInt>(itIdx->get());
+    if (arrTy->getElementType() != elemTy || !zeroCI || !zeroCI->isZero() || numIndices < 2) return false;
+    ++itIdx;
+    --numIndices;
+  } else if (srcTy != elemTy) {
+    return false;
+  }
+
+  if (numIndices > 2) return false;
+  elemDelta = itIdx->get();
+  if (numIndices == 1) return true;
+
+  auto * fieldCI = dyn_cast<ConstantInt>((++itIdx)->get());
+  if (!fieldCI) return false;
+  field = fieldCI->getZExtValue();
+  return true;
+}
+
+bool
+AoSoALayout::checkUses(Value & ptr, int field) {
+  // element pointers are loaded and stored as their first field
+  auto * accessTy = elemTy->getElementType(std::max(field, 0));
+
+  for (auto & use : ptr.uses()) {
+    auto * user = use.getUser();
+
+    if (auto * gep = dyn_cast<GetElementPtrInst>(user)) {
+      Value * elemDelta;
+      int gepField;
+      if (field >= 0 || !decomposeGEP(*gep, elemDelta, gepField)) {
+        IF_DEBUG_AOSOA { errs() << "aosoa: unsupported address computation " << *gep << "\n"; }
+        return false;
+      }
+      if (!checkUses(*gep, gepField)) return false;
+
+    } else if (auto * load = dyn_cast<LoadInst>(user)) {
+      if (!load->isSimple() || load->getType() != accessTy) {
+        IF_DEBUG_AOSOA { errs() << "aosoa: unsupported load " << *load << "\n"; }
+        return false;
+      }
+
+    } else if (auto * store = dyn_cast<StoreInst>(user)) {
+      if (!store->isSimple() || use.getOperandNo() != store->getPointerOperandIndex() ||
+          store->getValueOperand()->getType() != accessTy) {
+        IF_DEBUG_AOSOA { errs() << "aosoa: unsupported store " << *store << "\n"; }
+        return false;
+      }
+
+    } else if (auto * call = dyn_cast<CallInst>(user)) {
+      // base pointers can be passed on to internal functions
+      auto * callee = call->getCalledFunction();
+      if (!basePtrs.count(&ptr) || !callee || callee->isDeclaration() || !callee->hasLocalLinkage() ||
+          !call->isArgOperand(&use) || callee->isVarArg()) {
+        IF_DEBUG_AOSOA { errs() << "aosoa: escaping to call " << *call << "\n"; }
+        return false;
+      }
+      auto * arg = callee->getArg(call->getArgOperandNo(&use));
+      if (basePtrs.insert(arg).second) baseQueue.push_back(arg);
+
+    } else if (!IsMetaUse(*user)) {
+      IF_DEBUG_AOSOA { errs() << "aosoa: unsupported use " << *user << "\n"; }
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+AoSoALayout::checkCallSites() const {
+  for (auto * basePtr : basePtrs) {
+    auto * arg = dyn_cast<Argument>(basePtr);
+    if (!arg) continue;
+    auto * func = arg->getParent();
+    for (auto & use : func->uses()) {
+      auto * call = dyn_cast<CallInst>(use.getUser());
+      if (!call || !call->isCallee(&use) || !basePtrs.count(call->getArgOperand(arg->getArgNo()))) {
+        IF_DEBUG_AOSOA { errs() << "aosoa: " << func->getName() << " may see other pointers at " << *use.getUser() << "\n"; }
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+Value *
+AoSoALayout::createFieldAddress(IRBuilder<> & builder, Value & basePtr, Value * elemIdx, int field) {
+  auto * idxTy = DL.getIndexType(basePtr.getType());
+  auto * idx = elemIdx ? builder.CreateSExtOrTrunc(elemIdx, idxTy) : ConstantInt::get(idxTy, 0);
+  auto * blockIdx = builder.CreateLShr(idx, Log2_32(blockSize), "aosoa.block");
+  auto * laneIdx = builder.CreateAnd(idx, blockSize - 1, "aosoa.lane");
+  return builder.CreateInBoundsGEP(blockTy, &basePtr, {blockIdx, builder.getInt32(std::max(field, 0)), laneIdx}, "aosoa.ptr");
+}
+
+void
+AoSoALayout::rewriteUses(Value & ptr, Value & basePtr, Value * elemIdx, int field, SmallVectorImpl<Instruction*> & deadInsts) {
+  SmallVector<User*, 8> users(ptr.users());
+  for (auto * user : users) {
+    auto * inst = dyn_cast<Instruction>(user);
+    if (!inst || isa<CallInst>(inst)) continue; // annotations, arguments are rewritten as bases
+
+    IRBuilder<> builder(inst);
+    if (auto * gep = dyn_cast<GetElementPtrInst>(inst)) {
+      Value * elemDelta;
+      int gepField;
+      bool isElemAccess = decomposeGEP(*gep, elemDelta, gepField);
+      assert(isElemAccess && "unchecked address computation");
+      (void) isElemAccess;
+
+      auto * gepIdx = elemDelta;
+      if (elemIdx) {
+        auto * idxTy = DL.getIndexType(basePtr.getType());
+        gepIdx = builder.CreateAdd(builder.CreateSExtOrTrunc(elemIdx, idxTy), builder.CreateSExtOrTrunc(elemDelta, idxTy), "aosoa.idx");
+      }
+      rewriteUses(*gep, basePtr, gepIdx, gepField, deadInsts);
+
+    } else if (auto * load = dyn_cast<LoadInst>(inst)) {
+      auto * fieldPtr = createFieldAddress(builder, basePtr, elemIdx, field);
+      auto * blockedLoad = builder.CreateAlignedLoad(load->getType(), fieldPtr, DL.getABITypeAlign(load->getType()), load->getName());
+      blockedLoad->copyMetadata(*load);
+      load->replaceAllUsesWith(blockedLoad);
+
+    } else if (auto * store = dyn_cast<StoreInst>(inst)) {
+      auto * fieldPtr = createFieldAddress(builder, basePtr, elemIdx, field);
+      auto * valTy = store->getValueOperand()->getType();
+      auto * blockedStore = builder.CreateAlignedStore(store->getValueOperand(), fieldPtr, DL.getABITypeAlign(valTy));
+      blockedStore->copyMetadata(*store);
+    }
+    deadInsts.push_back(inst);
+  }
+}
+
+Constant *
+AoSoALayout::transposeInitializer(Constant & init, ArrayType & blockedTy) const {
+  if (init.isNullValue()) return Constant::getNullValue(&blockedTy);
+  if (isa<UndefValue>(init)) return UndefValue::get(&blockedTy);
+
+  uint64_t numElems = cast<ArrayType>(init.getType())->getNumElements();
+  SmallVector<Constant*, 16> blocks;
+  for (uint64_t blockIdx = 0; blockIdx < blockedTy.getNumElements(); ++blockIdx) {
+    SmallVector<Constant*, 4> rows;
+    for (unsigned field = 0; field < elemTy->getNumElements(); ++field) {
+      auto * fieldTy = elemTy->getElementType(field);
+      SmallVector<Constant*, 16> lanes;
+      for (unsigned lane = 0; lane < blockSize; ++lane) {
+        uint64_t elemIdx = blockIdx * blockSize + lane;
+        // the padding of the last block is zero
+        if (elemIdx >= numElems) {
+          lanes.push_back(Constant::getNullValue(fieldTy));
+          continue;
+        }
+        auto * elem = init.getAggregateElement(elemIdx);
+        auto * fieldVal = elem ? elem->getAggregateElement(field) : nullptr;
+        if (!fieldVal) return nullptr;
+        lanes.push_back(fieldVal);
+      }
+      rows.push_back(ConstantArray::get(cast<ArrayType>(blockTy->getElementType(field)), lanes));
+    }
+    blocks.push_back(ConstantStruct::get(blockTy, rows));
+  }
+  return ConstantArray::get(&blockedTy, blocks);
+}
+
+bool
+AoSoALayout::transformType(ArrayRef<GlobalVariable*> globals) {
+  SmallVector<Type*, 4> rowTys;
+  for (auto * fieldTy : elemTy->elements()) rowTys.push_back(ArrayType::get(fieldTy, blockSize));
+  blockTy = StructType::get(mod.getContext(), rowTys, false);
+
+  // legality (all or nothing for the type)
+  basePtrs.clear();
+  baseQueue.clear();
+  SmallVector<Constant*, 4> blockedInits;
+  for (auto * gv : globals) {
+    auto * arrTy = cast<ArrayType>(gv->getValueType());
+    auto * blockedTy = ArrayType::get(blockTy, divideCeil(arrTy->getNumElements(), blockSize));
+    auto * blockedInit = transposeInitializer(*gv->getInitializer(), *blockedTy);
+    if (!blockedInit) {
+      Report() << "aosoa: can not transpose the initializer of " << gv->getName() << "\n";
+      return false;
+    }
+    blockedInits.push_back(blockedInit);
+    gv->removeDeadConstantUsers();
+    basePtrs.insert(gv);
+    baseQueue.push_back(gv);
+  }
+  while (!baseQueue.empty()) {
+    auto * basePtr = baseQueue.pop_back_val();
+    if (!checkUses(*basePtr, -1)) {
+      Report() << "aosoa: " << *elemTy << " keeps its layout (unsupported use of " << basePtr->getName() << ")\n";
+      return false;
+    }
+  }
+  if (!checkCallSites()) {
+    Report() << "aosoa: " << *elemTy << " keeps its layout (pointer arguments may see other data)\n";
+    return false;
+  }
+
+  // replace the globals
+  SmallVector<Instruction*, 32> deadInsts;
+  for (unsigned i = 0; i < globals.size(); ++i) {
+    auto * gv = globals[i];
+    auto * blockedInit = blockedInits[i];
+    auto * blockedGV = new GlobalVariable(mod, blockedInit->getType(), gv->isConstant(), gv->getLinkage(), blockedInit,
+                                          gv->getName() + ".aosoa", gv, gv->getThreadLocalMode(), gv->getAddressSpace());
+    blockedGV->copyAttributesFrom(gv);
+    // rows of the same field fill whole vectors
+    uint64_t rowAlign = PowerOf2Ceil(blockSize * DL.getTypeAllocSize(elemTy->getElementType(0)).getFixedValue());
+    blockedGV->setAlignment(std::max(gv->getAlign().valueOrOne(), Align(rowAlign)));
+
+    rewriteUses(*gv, *blockedGV, nullptr, -1, deadInsts);
+    gv->replaceAllUsesWith(blockedGV);
+    blockedGV->takeName(gv);
+  }
+  for (auto * basePtr : basePtrs) {
+    if (auto * arg = dyn_cast<Argument>(basePtr)) rewriteUses(*arg, *arg, nullptr, -1, deadInsts);
+  }
+
+  // users before their operands
+  for (auto * inst : deadInsts) {
+    if (!inst->getType()->isVoidTy()) inst->replaceAllUsesWith(UndefValue::get(inst->getType()));
+    inst->eraseFromParent();
+  }
+  for (auto * gv : globals) gv->eraseFromParent();
+
+  Report() << "aosoa: " << globals.size() << " arrays of " << *elemTy << " in blocks of " << blockSize << " ("
+           << (basePtrs.size() - globals.size()) << " pointer arguments)\n";
+  return true;
+}
+
+bool
+AoSoALayout::run() {
+  auto * annotations = mod.getNamedGlobal("llvm.global.annotations");
+  if (!annotations || !annotations->hasInitializer()) return false;
+  auto * entries = dyn_cast<ConstantArray>(annotations->getInitializer());
+  if (!entries) return false;
+
+  // annotated globals by type and block size
+  MapVector<std::pair<StructType*, unsigned>, SmallVector<GlobalVariable*, 4>> layoutTypes;
+  for (auto & entryUse : entries->operands()) {
+    auto * entry = dyn_cast<ConstantStruct>(entryUse.get());
+    if (!entry || entry->getNumOperands() < 2) continue;
+    auto * gv = dyn_cast<GlobalVariable>(entry->getOperand(0)->stripPointerCasts());
+    StringRef annotation;
+    if (!gv || !getConstantStringInfo(entry->getOperand(1)->stripPointerCasts(), annotation)) continue;
+    unsigned gvBlockSize = ParseLayoutAnnotation(annotation);
+    if (!gvBlockSize) continue;
+
+    auto * arrTy = dyn_cast<ArrayType>(gv->getValueType());
+    if (!arrTy || !IsLayoutStruct(*arrTy->getElementType()) || !gv->hasLocalLinkage() || !gv->hasInitializer()) {
+      Report() << "aosoa: " << gv->getName() << " is not an internal array of scalar structs\n";
+      continue;
+    }
+    auto & typeGlobals = layoutTypes[std::make_pair(cast<StructType>(arrTy->getElementType()), gvBlockSize)];
+    if (!is_contained(typeGlobals, gv)) typeGlobals.push_back(gv);
+  }
+
+  bool changed = false;
+  for (auto & it : layoutTypes) {
+    elemTy = it.first.first;
+    blockSize = it.first.second;
+    changed |= transformType(it.second);
+  }
+  return changed;
+}
+
+///// New PM Pass /////
+
+llvm::PreservedAnalyses
+AoSoALayoutWrapperPass::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  AoSoALayout layoutTrans(M);
+  if (layoutTrans.run())
+    return PreservedAnalyses::none();
+  else
+    return PreservedAnalyses::all();
+}
+
+} // namespace rv
@@ -8,7 +8,10 @@
 //===----------------------------------------------------------------------===//
 //
 // This path automatically supplement vector math functions using RV's resolver
-// API
+// API: vector math intrinsics (eg llvm.sin.v8f32 from LLVM's loop and SLP
+// vectorizers) call SLEEF or vector library (RV_VECLIB) functions instead.
+// On VE all vector intrinsics are resolved, on the other ISAs only those that
+// would otherwise expand into per-lane libm calls.
 //
 //===----------------------------------------------------------------------===//
 
@@ -16,6 +19,7 @@
 #include "rv/passes/AutoMathPass.h"
 
 #include "rv/analysis/costModel.h"
+#include "rv/annotations.h"
 #include "rv/analysis/reductionAnalysis.h"
 #include "rv/region/LoopRegion.h"
 #include "rv/region/Region.h"
@@ -30,7 +34,6 @@
 #include "rv/rvDebug.h"
 #include "rvConfig.h"
 
-#include "llvm/ADT/Triple.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
@@ -65,9 +68,29 @@ using namespace llvm;
 #define IF_DEBUG_AM IF_DEBUG
 #endif
 
-static bool IsForVE(Function &F) {
-  Triple Triple(F.getParent()->getTargetTriple());
-  return Triple.isVE();
+// whether the target of \p RVConfig has vector registers to supplement math for
+static bool HasVectorISA(const Config &RVConfig) {
+  return RVConfig.useVE || RVConfig.useSSE || RVConfig.useAVX ||
+         RVConfig.useAVX2 || RVConfig.useAVX512 || RVConfig.useNEON ||
+         RVConfig.useADVSIMD || RVConfig.useSVE;
+}
+
+// math intrinsics that have no vector instructions on x86 and AArch64 (the
+// backend expands their vector forms into one libm call per lane)
+static bool IsLibmIntrinsic(Intrinsic::ID ID) {
+  switch (ID) {
+  case Intrinsic::sin:
+  case Intrinsic::cos:
+  case Intrinsic::exp:
+  case Intrinsic::exp2:
+  case Intrinsic::log:
+  case Intrinsic::log2:
+  case Intrinsic::log10:
+  case Intrinsic::pow:
+    return true;
+  default:
+    return false;
+  }
 }
 
 static std::pair<Type *, unsigned> UnvectorizeType(Type *Ty) {
@@ -199,7 +222,8 @@ struct FuncSession {
 
     auto ResolverPtr = PlatInfo.getResolver(ScalarCallee->getName(),
                                             *ScalarCallee->getFunctionType(),
-                                            VecArgShapes, CalleeWidth, false);
+                                            VecArgShapes, CalleeWidth, false,
+                                            ReadULPErrorBound(F));
     if (!ResolverPtr) {
       IF_DEBUG_AM { errs() << "\tcould not get a resolver"; }
       return false;
@@ -209,9 +233,11 @@ struct FuncSession {
     return true;
   }
 
-  FuncSession(Function &F, TargetTransformInfo &TTI, TargetLibraryInfo &TLI)
-      : F(F), RVConfig(Config::createForFunction(F)),
+  FuncSession(Function &F, const Config &FuncConfig, TargetTransformInfo &TTI,
+              TargetLibraryInfo &TLI)
+      : F(F), RVConfig(FuncConfig),
         PlatInfo(*F.getParent(), &TTI, &TLI), Vectorizer(PlatInfo, RVConfig) {
+    addVectorLibraryResolver(RVConfig, PlatInfo);
     addSleefResolver(RVConfig, PlatInfo);
   }
 
@@ -219,6 +245,11 @@ struct FuncSession {
     if (C.getIntrinsicID() == Intrinsic::not_intrinsic)
       return false;
 
+    // VE supplements all vector intrinsics, the other ISAs lower everything
+    // but the libm functions natively
+    if (!RVConfig.useVE && !IsLibmIntrinsic(C.getIntrinsicID()))
+      return false;
+
     // Un-vectorize the callsite, generating a scalar intrinsic declaration
     // on-the-fly
     IF_DEBUG_AM { errs() << "Inspecting : " << C << "\n"; }
@@ -278,8 +309,10 @@ struct FuncSession {
     for (auto &ItJob : VectorJobs) {
       ResolverJob &ResJob = ItJob.second;
       auto &VecMathFunc = ResJob.ResolverPtr->requestVectorized();
-      // Use a fastcc and resolve conflicts (unless this is an intrinsic)
-      if (VecMathFunc.getIntrinsicID() == Intrinsic::not_intrinsic) {
+      // Use a fastcc and resolve conflicts (unless this is an intrinsic or an
+      // external vector library function)
+      if (VecMathFunc.getIntrinsicID() == Intrinsic::not_intrinsic &&
+          !VecMathFunc.isDeclaration()) {
         VecMathFunc.setLinkage(GlobalVariable::WeakAnyLinkage);
         VecMathFunc.setCallingConv(CallingConv::Fast);
       }
@@ -308,19 +341,20 @@ AutoMathPass::AutoMathPass() : PMS()
 
 bool AutoMathPass::run(Function &F) {
   // Should we vectorize math here?
-  if (!IsForVE(F))
+  Config RVConfig = Config::createForFunction(F);
+  if (!HasVectorISA(RVConfig))
     return false;
 
   // Setup the vectorizer
   auto &TLI = PMS.FAM.getResult<TargetLibraryAnalysis>(F);
   auto &TTI = PMS.FAM.getResult<TargetIRAnalysis>(F);
-  FuncSession FuncSession(F, TTI, TLI);
+  FuncSession FuncSession(F, RVConfig, TTI, TLI);
   return FuncSession.run();
 }
 
 bool AutoMathPass::run(Module &M) {
   bool Changed = false;
-  // analyze math function usage in all VE functions
+  // analyze math function usage in all functions
   for (auto &func : M) {
     if (func.isDeclaration())
       continue;
@@ -21,6 +21,14 @@
 #include "rv/resolver/resolvers.h"
 #include "rv/rv.h"
 #include "rv/transform/remTransform.h"
+#include "rv/transform/laneRefillTrans.h"
+#include "rv/transform/alignPeelTrans.h"
+#include "rv/transform/loopCollapseTrans.h"
+#include "rv/transform/searchLoopTrans.h"
+#include "rv/transform/narrowIdioms.h"
+#include "rv/transform/parallelChunkTrans.h"
+#include "rv/tuningFile.h"
+#include "rv/intrinsics.h"
 #include "rv/vectorMapping.h"
 
 #include "rv/passes/PassManagerSession.h"
@@ -31,6 +39,7 @@
 #endif
 #include "rvConfig.h"
 
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/IRBuilder.h"
@@ -40,19 +49,35 @@
 #include "llvm/Passes/PassBuilder.h"
 
 #include "llvm/ADT/GraphTraits.h"
+#include "llvm/Analysis/AssumptionCache.h"
 #include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/MemoryDependenceAnalysis.h"
 #include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#include "llvm/Transforms/Utils/UnrollLoop.h"
 #include <sstream>
 
+#include "utils/rvLinking.h"
 #include "report.h"
+#include <cmath>
+#include <limits>
 #include <map>
 
 using namespace rv;
@@ -70,21 +95,39 @@ cl::OptionCategory
     rvLoopVecCategory("RV LoopVectorizer Options",
                       "Configure the Outer-Loop Vectorizer of RV");
 
-static bool IsSupportedReduction(Loop &L, Reduction &red) {
-  // check that all users of the reduction are either (a) part of it or (b)
-  // outside the loop
+static bool IsSupportedReduction(Loop &L, Reduction &red,
+                                 ReductionAnalysis &Reda) {
+  // check that all users of the reduction are either (a) part of it, (b)
+  // outside the loop or (c) users of a prefix scan
   for (auto *inst : red.elements) {
     for (auto itUser : inst->users()) {
       auto *userInst = dyn_cast<Instruction>(itUser);
       if (!userInst)
         return false; // unsupported
-#if 0
-      // FIXME: This does not work with min/max reductions (the CmpInst is not an element of the reduction).
-      if (L.contains(userInst->getParent()) && !red.elements.count(userInst)) {
-        Report() << "Unsupported user of reduction: " << *userInst << "\n";
-        return false;
-      }
-#endif
+      // inductions and recurrences (Bot) are used anywhere in the loop, Top is
+      // rejected by the caller
+      if (red.kind == RedKind::Bot || red.kind == RedKind::Top)
+        continue;
+      if (red.contains(*userInst) || !L.contains(userInst->getParent()))
+        continue;
+      // (c) was checked by the ReductionAnalysis
+      if (red.isScan())
+        continue;
+      // min/max reductions: the compare of select(cmp(acc, x), acc, x) is not
+      // an element of the reduction. It may also pick the index of an
+      // argmin/argmax keyed on this reduction.
+      if (isa<CmpInst>(userInst) &&
+          all_of(userInst->users(), [&](User *cmpUser) {
+            auto *cmpUserInst = dyn_cast<Instruction>(cmpUser);
+            if (!cmpUserInst)
+              return false;
+            auto *userRed = Reda.getReductionInfo(*cmpUserInst);
+            return red.contains(*cmpUserInst) ||
+                   (userRed && userRed->keyReduction == &red);
+          }))
+        continue;
+      Report() << "Unsupported user of reduction: " << *userInst << "\n";
+      return false;
     }
   }
 
@@ -170,6 +213,19 @@ int LoopVectorizer::getTripCount(Loop &L) {
   return BTCVal + 1;
 }
 
+int LoopVectorizer::getProfiledTripCount(Loop &L, const LoopJob &LJ) {
+  if (LJ.Tuning && LJ.Tuning->trips > 0)
+    return LJ.Tuning->trips;
+  if (!RVConfig.enableProfileTrips)
+    return -1;
+
+  // average iterations per entry of the header (PGO branch weights of the latch)
+  auto EstimatedTrips = getLoopEstimatedTripCount(&L);
+  if (!EstimatedTrips || *EstimatedTrips == 0 || *EstimatedTrips > (unsigned)std::numeric_limits<int>::max())
+    return -1;
+  return *EstimatedTrips;
+}
+
 bool LoopVectorizer::hasVectorizableLoopStructure(Loop &L, bool EmitRemarks) {
   ReductionAnalysis MyReda(F, PMS.FAM);
   MyReda.analyze(L);
@@ -199,7 +255,7 @@ bool LoopVectorizer::hasVectorizableLoopStructure(Loop &L, bool EmitRemarks) {
       return false;
     }
 
-    if (!IsSupportedReduction(L, *redInfo)) {
+    if (!IsSupportedReduction(L, *redInfo, MyReda)) {
       if (EmitRemarks)
         remarkMiss("Invalid use of recurrence", "RVLoopVecNot", L, &Phi);
       Report() << " unsupported reduction: ";
@@ -220,7 +276,8 @@ bool LoopVectorizer::hasVectorizableLoopStructure(Loop &L, bool EmitRemarks) {
 
     // Unsupported recurrence (definition and use in different loop
     // iterations)
-    if (redInfo->kind == RedKind::Bot) {
+    if (redInfo->kind == RedKind::Bot && !redInfo->isIndex() &&
+        !redInfo->isRecurrence()) {
       if (EmitRemarks)
         remarkMiss("Unsupported loop-carried variable", "RVLoopVecNot", L,
                    &Phi);
@@ -237,6 +294,61 @@ bool LoopVectorizer::hasVectorizableLoopStructure(Loop &L, bool EmitRemarks) {
   return true;
 }
 
+// Upper bound on the number of symbolic strides versioned per loop
+static const unsigned MaxStrideChecks = 4;
+
+// Collect the loop-invariant values \p S of accesses in \p L whose address
+// advances by S elements per iteration. With S == 1 those accesses are
+// contiguous (instead of gathers/scatters).
+static void CollectSymbolicStrides(Loop &L, ScalarEvolution &SE,
+                                   std::vector<Value *> &Strides) {
+  for (auto *BB : L.blocks()) {
+    for (auto &I : *BB) {
+      auto *Ptr = getLoadStorePointerOperand(&I);
+      if (!Ptr)
+        continue;
+      auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+      if (!AR || AR->getLoop() != &L || !AR->isAffine())
+        continue;
+      const SCEV *Step = AR->getStepRecurrence(SE);
+      if (isa<SCEVConstant>(Step))
+        continue;
+
+      // Step = ElemSize * S (or just S for byte-sized elements)
+      const DataLayout &DL = I.getModule()->getDataLayout();
+      uint64_t ElemSize = DL.getTypeAllocSize(getLoadStoreType(&I));
+      const SCEV *Elems = nullptr;
+      if (auto *Mul = dyn_cast<SCEVMulExpr>(Step)) {
+        auto *Scale = dyn_cast<SCEVConstant>(Mul->getOperand(0));
+        if (Mul->getNumOperands() == 2 && Scale &&
+            Scale->getAPInt() == ElemSize)
+          Elems = Mul->getOperand(1);
+      } else if (ElemSize == 1) {
+        Elems = Step;
+      }
+      if (!Elems)
+        continue;
+
+      // the index may be extended to the pointer width
+      while (auto *Cast = dyn_cast<SCEVIntegralCastExpr>(Elems)) {
+        if (isa<SCEVTruncateExpr>(Cast))
+          break;
+        Elems = Cast->getOperand();
+      }
+      auto *Unknown = dyn_cast<SCEVUnknown>(Elems);
+      if (!Unknown || !L.isLoopInvariant(Unknown->getValue()))
+        continue;
+
+      Value *Stride = Unknown->getValue();
+      if (std::find(Strides.begin(), Strides.end(), Stride) != Strides.end())
+        continue;
+      if (Strides.size() >= MaxStrideChecks)
+        return;
+      Strides.push_back(Stride);
+    }
+  }
+}
+
 static unsigned getOnlyLine() {
   char *OnlyLine = getenv("RV_ONLY_LINE");
   if (!OnlyLine) return 0;
@@ -251,6 +363,23 @@ static std::string getTag(DebugLoc DL) {
   return ss.str();
 }
 
+// Emit a structured decision record (RV_REPORT_JSON)
+static void reportDecision(Function &F, Loop &L, ReportReason Reason,
+                           unsigned Width = 0, const unsigned *Score = nullptr) {
+  if (!HasDecisionReport())
+    return;
+
+  DecisionRecord Rec("loopvec", F.getName().str(),
+                     L.getHeader()->getName().str());
+  Rec.location = getTag(L.getStartLoc());
+  Rec.vectorized = Reason == ReportReason::Vectorized;
+  Rec.reason = Reason;
+  Rec.width = Width;
+  if (Score)
+    Rec.metrics.emplace_back("score", *Score);
+  ReportDecision(Rec);
+}
+
 bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
   Value *CodeRegion;
   DebugLoc DL;
@@ -260,8 +389,10 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
   Report() << " at " << getTag(DL) << "\n";
 
   if (unsigned OnlyLine = getOnlyLine()) {
-    if (DL.getLine() != OnlyLine)
+    if (DL.getLine() != OnlyLine) {
+      reportDecision(F, L, ReportReason::FilteredOnlyLine);
       return false;
+    }
     remark("Hit the RV_ONLY_LINE loop", "RVOnlyLine", L);
   }
 
@@ -269,6 +400,7 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
 
   if (mdAnnot.alreadyVectorized.safeGet(false)) {
     Report() << "x already vectorized\n";
+    reportDecision(F, L, ReportReason::AlreadyVectorized);
     return false;
   }
 
@@ -283,6 +415,7 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
   // (cheap-ish)
   if (!hasVectorizableLoopStructure(L, DoReportFail)) {
     Report() << "x unfit loop structure\n";
+    reportDecision(F, L, ReportReason::UnfitLoopStructure);
     return false;
   }
 
@@ -299,11 +432,28 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
     mdAnnot.print(ReportContinue()) << "\n";
   }
 
+  // Opt-in: prove the dependence distance of un-annotated loops ourselves
+  if (!mdAnnot.vectorizeEnable.safeGet(false) && RVConfig.enableAutoLoopVec) {
+    iter_t DepDist = computeDependenceDistance(
+        L, RVConfig.enableRuntimeAliasChecks ? &LJ.AliasChecks : nullptr);
+    if (enableDiagOutput)
+      Report() << "loopVecPass: derived dependence distance "
+               << DepDistToString(DepDist) << " for " << L.getName() << "\n";
+    if (DepDist > 1) {
+      mdAnnot.minDepDist = DepDist;
+      mdAnnot.vectorizeEnable = true;
+      if (enableDiagOutput && !LJ.AliasChecks.empty())
+        Report() << "loopVecPass: with " << LJ.AliasChecks.size()
+                 << " runtime alias checks\n";
+    }
+  }
+
   // only trigger on annotated loops
   if (!mdAnnot.vectorizeEnable.safeGet(false)) {
     if (enableDiagOutput)
       Report() << "x loopVecPass skip " << L.getName()
                << " . not explicitly triggered.\n";
+    reportDecision(F, L, ReportReason::NotAnnotated);
     return false;
   }
 
@@ -313,16 +463,20 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
     if (enableDiagOutput)
       Report() << "x loopVecPass skip " << L.getName()
                << " . already vectorized.\n";
+    reportDecision(F, L, ReportReason::AlreadyVectorized);
     return false;
   }
 
   LJ.DepDist = mdAnnot.minDepDist.safeGet(ParallelDistance);
+  if (RVConfig.enableAccessMetadata)
+    LJ.AccessGroups = GetParallelAccessGroups(L);
 
   // skip if iteration dependence distance precludes vectorization
   if (LJ.DepDist <= 1) {
     if (enableDiagOutput)
       Report() << "x loopVecPass skip " << L.getName()
                << " . Min dependence distance was " << LJ.DepDist << "\n";
+    reportDecision(F, L, ReportReason::DependenceDistance);
     return false;
   }
 
@@ -342,6 +496,23 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
           << LJ.VectorWidth << ")\n";
   }
 
+  // tuning file override (RV_TUNING)
+  if (const TuningFile *Tunings = TuningFile::get())
+    LJ.Tuning = Tunings->lookup(F.getName(), L.getHeader()->getName());
+  if (LJ.Tuning && LJ.Tuning->width > 0 && !userWidthText) {
+    if (LJ.Tuning->width == 1) {
+      if (enableDiagOutput)
+        Report() << "loopVecPass, RV_TUNING: width 1. not vectorizing!\n";
+      reportDecision(F, L, ReportReason::FilteredTuning);
+      return false;
+    }
+    hasFixedWidth = true;
+    LJ.VectorWidth = LJ.Tuning->width;
+    if (enableDiagOutput)
+      Report() << "loopVecPass: with tuned vector width (RV_TUNING) "
+               << LJ.VectorWidth << "\n";
+  }
+
   // Narrow VectorWidth to constant trip count (where applicable).
   int KnownTripCount = getTripCount(L);
   if (KnownTripCount > 1) {
@@ -354,21 +525,81 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
     }
   }
 
+  // Too few iterations per entry for the full width (profile)
+  int ProfiledTripCount = KnownTripCount > 1 ? -1 : getProfiledTripCount(L, LJ);
+  if (!hasFixedWidth && ProfiledTripCount > 0) {
+    if (ProfiledTripCount < 2) {
+      if (enableDiagOutput)
+        Report() << "loopVecPass, profile: " << ProfiledTripCount
+                 << " iterations per entry. not vectorizing!\n";
+      reportDecision(F, L, ReportReason::NotBeneficial);
+      return false;
+    }
+    size_t ProfiledWidth = PowerOf2Floor(ProfiledTripCount);
+    if (LJ.VectorWidth == 0 || LJ.VectorWidth > ProfiledWidth) {
+      LJ.VectorWidth = ProfiledWidth;
+      if (enableDiagOutput)
+        Report() << "loopVecPass, profile: narrowing to " << ProfiledWidth
+                 << " for " << ProfiledTripCount << " expected iterations\n";
+    }
+  }
+
   // pick a vectorization factor (unless user override is set)
   if (!hasFixedWidth) {
     size_t initialWidth = LJ.VectorWidth == 0 ? LJ.DepDist : LJ.VectorWidth;
 
-    // Re-fine using cost model
+    // Bound the width by what the types and calls in the loop allow
     CostModel costModel(vectorizer->getPlatformInfo(), RVConfig);
     LoopRegion tmpLoopRegionImpl(L);
     Region tmpLoopRegion(tmpLoopRegionImpl);
-    size_t refinedWidth = costModel.pickWidthForRegion(
-        tmpLoopRegion, initialWidth); // TODO run VA first
+    size_t maxWidth = costModel.pickWidthForRegion(tmpLoopRegion, initialWidth);
+
+    // Score the candidate widths with the VA shapes of each, widths whose
+    // code would grow beyond RV_CODE_GROWTH_BUDGET are out
+    // (with the speedups predicted by the learned model if RV_PROFIT_MODEL is set)
+    const ProfitModel *Model = ProfitModel::get();
+    size_t refinedWidth = 1;
+    unsigned BestScore = 0;
+    size_t NumOverBudget = 0;
+    for (size_t Width = maxWidth; Width > 1;
+         Width = (Width & (Width - 1)) ? PowerOf2Floor(Width) : Width / 2) {
+      ProfitFeatures Features;
+      RegionCost Cost = computeLoopCost(L, Width, false, &Features);
+      if (RVConfig.codeGrowthBudget > 0 &&
+          Cost.getCodeGrowth() > RVConfig.codeGrowthBudget) {
+        if (enableDiagOutput)
+          Report() << "loopVecPass, costModel: width " << Width
+                   << " exceeds the code growth budget ("
+                   << Cost.getCodeGrowth() << "x)\n";
+        ++NumOverBudget;
+        continue;
+      }
+      unsigned Score = Model ? Model->predictScore(Features) : Cost.getScore();
+      if (Model && enableDiagOutput)
+        Report() << "loopVecPass, profit model: width " << Width << " score "
+                 << Score << " (analytic " << Cost.getScore() << ")\n";
+      if (Score > BestScore) {
+        BestScore = Score;
+        refinedWidth = Width;
+      }
+    }
+    LS.Score = BestScore;
 
-    if (refinedWidth <= 1) {
+    if (NumOverBudget > 0 && refinedWidth == 1) {
+      if (enableDiagOutput)
+        Report() << "loopVecPass, costModel: no width within the code growth "
+                    "budget. not vectorizing!\n";
+      reportDecision(F, L, ReportReason::CodeGrowth);
+      return false;
+    }
+
+    // Explicit SIMD pragmas are honored even if the model disagrees
+    bool Beneficial = BestScore > 100 || (LS.HasSIMDAnnotation && refinedWidth > 1);
+    if (!Beneficial) {
       if (enableDiagOutput) {
         Report() << "loopVecPass, costModel: vectorization not beneficial\n";
       }
+      reportDecision(F, L, ReportReason::NotBeneficial, refinedWidth, &LS.Score);
       return false;
     } else if (refinedWidth != (size_t)LJ.VectorWidth) {
       if (enableDiagOutput) {
@@ -381,6 +612,8 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
       }
       LJ.VectorWidth = refinedWidth;
     }
+  } else {
+    LS.Score = computeLoopCost(L, LJ.VectorWidth, false).getScore();
   }
 
   static int GlobalLoopCount = 0;
@@ -393,6 +626,7 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
     if (SelLoop != GlobalLoopCount) {
       Report() << "loopVecPass, RV_SELECT_LOOP != " << GlobalLoopCount
                << ". not vectorizing!\n";
+      reportDecision(F, L, ReportReason::FilteredSelectLoop, LJ.VectorWidth);
       return false;
     }
   }
@@ -406,16 +640,595 @@ bool LoopVectorizer::scoreLoop(LoopJob &LJ, LoopScore &LS, Loop &L) {
     if (!SelectByName) {
       Report() << "loopVecPass, RV_SELECT_NAME != " << NameLoopTxt
                << ". not vectorizing!\n";
+      reportDecision(F, L, ReportReason::FilteredSelectName, LJ.VectorWidth);
       return false;
     }
   }
 
   LJ.TripAlign = getTripAlignment(L);
   LJ.Header = L.getHeader();
-  LS.Score = 0; // TODO compute score
+
+  // speculate on unit strides (the scalar loop handles all other strides)
+  if (RVConfig.enableStrideVersioning && L.getLoopPredecessor()) {
+    auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+    CollectSymbolicStrides(L, SE, LJ.StrideChecks);
+    if (enableDiagOutput && !LJ.StrideChecks.empty())
+      Report() << "loopVecPass: versioning on " << LJ.StrideChecks.size()
+               << " unit stride checks\n";
+  }
+
+  // independent outer iterations around a divergent inner loop: refill lanes
+  if (RVConfig.enableLaneRefill && LJ.DepDist == ParallelDistance &&
+      LJ.AliasChecks.empty() && LJ.StrideChecks.empty()) {
+    auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+    LaneRefillTransform RefillTrans(F, SE, vectorizer->getPlatformInfo(),
+                                    LJ.VectorWidth);
+    if (RefillTrans.canTransform(L)) {
+      // the lane loop runs exactly VectorWidth iterations
+      LJ.LaneRefill = true;
+      LJ.TripAlign = LJ.VectorWidth;
+      LJ.FoldTail = false;
+      LJ.EpilogueWidth = 0;
+      return true;
+    }
+  }
+
+  // peel a scalar prologue that aligns the main contiguous stream
+  if (RVConfig.enableAlignPeeling) {
+    auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+    auto &DT = PMS.FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+    AlignPeelTransform PeelTrans(F, DT, LI, SE, LJ.VectorWidth);
+    LJ.PeelAccess = PeelTrans.getPeelAccess(L);
+    // the peel loop consumes a runtime number of iterations
+    if (LJ.PeelAccess)
+      LJ.TripAlign = 1;
+  }
+
+  chooseRemainder(L, LJ);
+  chooseInterleave(L, LJ);
+  chooseStreamingStores(L, LJ);
+  chooseParallelChunks(L, LJ);
   return true;
 }
 
+// Upper bound on the number of pairwise runtime alias checks per loop
+static const unsigned MaxRuntimeAliasChecks = 8;
+
+// SCEV expressions that can be expanded in the preheader (no division by a
+// possibly zero value)
+static bool IsSafeToExpand(const SCEV *S) {
+  return !SCEVExprContains(S, [](const SCEV *E) {
+    auto *Div = dyn_cast<SCEVUDivExpr>(E);
+    return Div && !isa<SCEVConstant>(Div->getRHS());
+  });
+}
+
+// The byte range [Low, High) accessed by the load/store \p I over all
+// iterations of \p L. Returns a nullptr pair if it cannot be computed before the loop.
+static std::pair<const SCEV *, const SCEV *>
+GetAccessRange(Loop &L, Instruction &I, ScalarEvolution &SE) {
+  std::pair<const SCEV *, const SCEV *> Unknown(nullptr, nullptr);
+  auto *Ptr = getLoadStorePointerOperand(&I);
+  const DataLayout &DL = I.getModule()->getDataLayout();
+  auto *IdxTy = DL.getIndexType(Ptr->getType());
+  const SCEV *AccessSize = SE.getConstant(
+      IdxTy, (uint64_t)DL.getTypeStoreSize(getLoadStoreType(&I)));
+
+  const SCEV *PtrSCEV = SE.getSCEV(Ptr);
+  const SCEV *Low = PtrSCEV;
+  const SCEV *High = PtrSCEV;
+  if (!SE.isLoopInvariant(PtrSCEV, &L)) {
+    // affine addresses of L only (not of inner loops)
+    auto *AR = dyn_cast<SCEVAddRecExpr>(PtrSCEV);
+    if (!AR || AR->getLoop() != &L || !AR->isAffine())
+      return Unknown;
+    auto *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+    const SCEV *BTC = SE.getBackedgeTakenCount(&L);
+    if (!Step || isa<SCEVCouldNotCompute>(BTC))
+      return Unknown;
+
+    const SCEV *Last = SE.getAddExpr(
+        AR->getStart(),
+        SE.getMulExpr(Step, SE.getTruncateOrZeroExtend(BTC, Step->getType())));
+    Low = AR->getStart();
+    High = Last;
+    if (Step->getAPInt().isNegative())
+      std::swap(Low, High);
+  }
+  High = SE.getAddExpr(High, AccessSize);
+
+  if (!SE.isLoopInvariant(Low, &L) || !SE.isLoopInvariant(High, &L) ||
+      !IsSafeToExpand(Low) || !IsSafeToExpand(High))
+    return Unknown;
+  return std::make_pair(Low, High);
+}
+
+iter_t LoopVectorizer::computeDependenceDistance(
+    Loop &L,
+    std::vector<std::pair<Instruction *, Instruction *>> *AliasChecks) {
+  auto &DI = PMS.FAM.getResult<DependenceAnalysis>(F);
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  const unsigned Level = L.getLoopDepth();
+
+  std::vector<Instruction *> MemInsts;
+  bool HasWrites = false;
+  for (auto *BB : L.blocks()) {
+    for (auto &I : *BB) {
+      if (!I.mayReadOrWriteMemory())
+        continue;
+      // calls, atomics and volatile accesses are not analyzable
+      auto *Load = dyn_cast<LoadInst>(&I);
+      auto *Store = dyn_cast<StoreInst>(&I);
+      if (!(Load && Load->isUnordered()) && !(Store && Store->isUnordered()))
+        return 1;
+      HasWrites |= isa<StoreInst>(I);
+      MemInsts.push_back(&I);
+    }
+  }
+  if (!HasWrites)
+    return ParallelDistance;
+
+  iter_t MinDist = ParallelDistance;
+  for (size_t i = 0; i < MemInsts.size(); ++i) {
+    for (size_t j = i; j < MemInsts.size(); ++j) {
+      auto *Src = MemInsts[i];
+      auto *Dst = MemInsts[j];
+      if (!isa<StoreInst>(Src) && !isa<StoreInst>(Dst))
+        continue;
+
+      auto Dep = DI.depends(Src, Dst, true);
+      if (!Dep)
+        continue;
+
+      // distinct objects that may alias: check for overlap before the loop
+      if (Dep->isConfused() && AliasChecks) {
+        const Value *SrcObj = getUnderlyingObject(getLoadStorePointerOperand(Src));
+        const Value *DstObj = getUnderlyingObject(getLoadStorePointerOperand(Dst));
+        if (SrcObj != DstObj && GetAccessRange(L, *Src, SE).first &&
+            GetAccessRange(L, *Dst, SE).first &&
+            AliasChecks->size() < MaxRuntimeAliasChecks) {
+          AliasChecks->emplace_back(Src, Dst);
+          continue;
+        }
+      }
+
+      if (Dep->isConfused() || Level > Dep->getLevels())
+        return 1;
+
+      // carried by an outer loop or only within one iteration of L
+      bool CarriedOutside = false;
+      for (unsigned OuterLevel = 1; OuterLevel < Level; ++OuterLevel)
+        CarriedOutside |=
+            !(Dep->getDirection(OuterLevel) & Dependence::DVEntry::EQ);
+      if (CarriedOutside)
+        continue;
+      if (Dep->getDirection(Level) == Dependence::DVEntry::EQ)
+        continue;
+
+      auto *Dist = dyn_cast_or_null<SCEVConstant>(Dep->getDistance(Level));
+      if (!Dist)
+        return 1;
+      int64_t DistVal = std::abs(Dist->getAPInt().getSExtValue());
+      if (DistVal == 0)
+        continue;
+      MinDist = std::min<iter_t>(MinDist, DistVal);
+    }
+  }
+  return MinDist;
+}
+
+// Lanes masked out in the folded tail still advance inductions, only
+// (blended) reductions leave the loop with the right value.
+static bool HasOnlyReductionLiveOuts(Loop &L, ReductionAnalysis &Reda) {
+  auto *Latch = L.getLoopLatch();
+  for (auto *BB : L.blocks()) {
+    for (auto &I : *BB) {
+      bool UsedOutside = any_of(I.users(), [&](const User *U) {
+        return !L.contains(cast<Instruction>(U)->getParent());
+      });
+      if (!UsedOutside)
+        continue;
+
+      // a reduction phi or its latch update
+      bool IsReduction = false;
+      for (auto &Phi : L.getHeader()->phis()) {
+        if (Reda.getStrideInfo(Phi) || !Reda.getReductionInfo(Phi))
+          continue;
+        // the last lane of a scan is not the last active lane, inactive lanes
+        // would pick indices
+        auto *PhiRed = Reda.getReductionInfo(Phi);
+        if (PhiRed->isScan() || PhiRed->isIndex() || PhiRed->isRecurrence())
+          continue;
+        if (&I == &Phi || &I == Phi.getIncomingValueForBlock(Latch))
+          IsReduction = true;
+      }
+      if (!IsReduction)
+        return false;
+    }
+  }
+  return true;
+}
+
+// The tail blend of a folded loop would make forward recurrences depend on
+// themselves (prev = tail ? cur : prev)
+static bool HasForwardRecurrence(Loop &L, ReductionAnalysis &Reda) {
+  return any_of(L.getHeader()->phis(), [&](PHINode &Phi) {
+    auto *PhiRed = Reda.getReductionInfo(Phi);
+    return PhiRed && PhiRed->isRecurrence();
+  });
+}
+
+// Assumed trip count for loops without a (maximal) constant trip count
+static const unsigned DefaultTripCountEstimate = 128;
+
+void LoopVectorizer::chooseRemainder(Loop &L, LoopJob &LJ) {
+  const unsigned Width = LJ.VectorWidth;
+  LJ.FoldTail = false;
+  LJ.EpilogueWidth = 0;
+  LJ.OverlapTail = false;
+  if (Width <= 1 || (LJ.TripAlign % Width == 0))
+    return; // no remainder
+
+  // user override (RV_FORCE_REMAINDER=scalar|fold|epilogue|overlap)
+  StringRef Force;
+  if (const char *ForceText = getenv("RV_FORCE_REMAINDER"))
+    Force = ForceText;
+  if (Force == "scalar")
+    return;
+
+  bool ConsiderFold = Force == "fold" ||
+                      (Force.empty() && (RVConfig.enableTailFolding || RVConfig.useAVL));
+  bool ConsiderEpilogue = Force == "epilogue" || (Force.empty() && RVConfig.enableVectorEpilogue);
+  // the last iteration is shifted back over the previous one, the peeled
+  // alignment would not hold for it
+  bool ConsiderOverlap = (Force == "overlap" || (Force.empty() && RVConfig.enableOverlapTail)) &&
+                         !LJ.PeelAccess;
+  if (!ConsiderFold && !ConsiderEpilogue && !ConsiderOverlap)
+    return;
+
+  if (ConsiderOverlap) {
+    ReductionAnalysis MyReda(F, PMS.FAM);
+    MyReda.analyze(L);
+    RemainderTransform RemTrans(F, PMS.FAM, MyReda);
+    if (!RemTrans.canOverlapTail(L, LJ.AliasChecks)) {
+      if (enableDiagOutput)
+        Report() << "loopVecPass, overlapping tail: iterations are not "
+                    "idempotent\n";
+      ConsiderOverlap = false;
+    }
+  }
+
+  if (ConsiderFold) {
+    ReductionAnalysis MyReda(F, PMS.FAM);
+    MyReda.analyze(L);
+    if (!HasOnlyReductionLiveOuts(L, MyReda)) {
+      if (enableDiagOutput)
+        Report() << "loopVecPass, tail folding: live-outs other than "
+                    "reductions, keeping the scalar remainder\n";
+      ConsiderFold = false;
+    } else if (HasForwardRecurrence(L, MyReda)) {
+      if (enableDiagOutput)
+        Report() << "loopVecPass, tail folding: forward recurrence, keeping "
+                    "the scalar remainder\n";
+      ConsiderFold = false;
+    }
+  }
+
+  // AVL targets strip-mine: every iteration runs min(remaining, width) lanes,
+  // there is no remainder loop
+  if (Force == "fold" || (Force.empty() && RVConfig.useAVL && ConsiderFold)) {
+    LJ.FoldTail = ConsiderFold;
+    return;
+  }
+  if (Force == "epilogue") {
+    LJ.EpilogueWidth = Width / 2 > 1 ? Width / 2 : 0;
+    return;
+  }
+  if (Force == "overlap") {
+    LJ.OverlapTail = ConsiderOverlap;
+    return;
+  }
+
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  int TripCount = getTripCount(L);
+  int ProfiledTripCount = TripCount > 0 ? -1 : getProfiledTripCount(L, LJ);
+  unsigned MaxTripCount = SE.getSmallConstantMaxTripCount(&L);
+  double ExpectedTrips = TripCount > 0          ? TripCount
+                         : ProfiledTripCount > 0 ? ProfiledTripCount
+                         : MaxTripCount > 0      ? MaxTripCount
+                                                 : DefaultTripCountEstimate;
+
+  // Average over the possible remainders (unless the trip count is known or
+  // profiled) of the cost to finish them with RemWidth-wide steps and scalar code.
+  RegionCost Plain = computeLoopCost(L, Width, false);
+  double ScalarIterCost = Plain.scalarCost / Width;
+  int RemTripCount = TripCount > 0 ? TripCount : ProfiledTripCount;
+  auto remainderCost = [&](unsigned RemWidth, double RemVectorCost) {
+    unsigned First = RemTripCount > 0 ? RemTripCount % Width : 0;
+    unsigned Last = RemTripCount > 0 ? First : Width - 1;
+    double Sum = 0.0;
+    for (unsigned Rem = First; Rem <= Last; ++Rem) {
+      unsigned VectorSteps = RemWidth > 1 ? Rem / RemWidth : 0;
+      unsigned ScalarSteps = Rem - VectorSteps * RemWidth;
+      Sum += VectorSteps * RemVectorCost + ScalarSteps * ScalarIterCost;
+    }
+    return Sum / (Last - First + 1);
+  };
+
+  double MainCost = std::floor(ExpectedTrips / Width) * Plain.vectorCost;
+  double BestCost = MainCost + remainderCost(1, 0.0);
+  if (enableDiagOutput)
+    Report() << "loopVecPass, remainder: " << ExpectedTrips
+             << " expected iterations, scalar remainder cost " << BestCost
+             << "\n";
+
+  if (ConsiderFold) {
+    RegionCost Masked = computeLoopCost(L, Width, true);
+    double FoldedCost = std::ceil(ExpectedTrips / Width) * Masked.vectorCost;
+    if (enableDiagOutput)
+      Report() << "loopVecPass, remainder: folded tail cost " << FoldedCost
+               << "\n";
+    if (FoldedCost < BestCost) {
+      BestCost = FoldedCost;
+      LJ.FoldTail = true;
+    }
+  }
+
+  if (ConsiderOverlap) {
+    // one more full iteration for any remainder, loops shorter than a vector
+    // run scalar
+    double OverlapCost = ExpectedTrips < Width
+                             ? ExpectedTrips * ScalarIterCost
+                             : std::ceil(ExpectedTrips / Width) * Plain.vectorCost;
+    if (enableDiagOutput)
+      Report() << "loopVecPass, remainder: overlapping tail cost "
+               << OverlapCost << "\n";
+    if (OverlapCost < BestCost) {
+      BestCost = OverlapCost;
+      LJ.FoldTail = false;
+      LJ.OverlapTail = true;
+    }
+  }
+
+  if (ConsiderEpilogue) {
+    // half and quarter width epilogues
+    for (unsigned EpiWidth = Width / 2; EpiWidth > 1 && EpiWidth >= Width / 4;
+         EpiWidth /= 2) {
+      RegionCost Epi = computeLoopCost(L, EpiWidth, false);
+      double EpiCost = MainCost + remainderCost(EpiWidth, Epi.vectorCost);
+      if (enableDiagOutput)
+        Report() << "loopVecPass, remainder: width " << EpiWidth
+                 << " vector epilogue cost " << EpiCost << "\n";
+      if (EpiCost < BestCost) {
+        BestCost = EpiCost;
+        LJ.FoldTail = false;
+        LJ.OverlapTail = false;
+        LJ.EpilogueWidth = EpiWidth;
+      }
+    }
+  }
+}
+
+// Upper bound on the interleave factor chosen by the cost model
+static const unsigned MaxInterleave = 4;
+// Upper bound on the dependence distance groups per vector iteration (RV_DEP_FORWARDING)
+static const unsigned MaxForwardGroups = 8;
+
+void LoopVectorizer::chooseInterleave(Loop &L, LoopJob &LJ) {
+  LJ.Interleave = 1;
+  if (LJ.VectorWidth <= 1 || LJ.FoldTail)
+    return;
+
+  // user override (RV_INTERLEAVE=<n>)
+  if (RVConfig.interleave > 0) {
+    LJ.Interleave = RVConfig.interleave;
+    return;
+  }
+  if (LJ.Tuning && LJ.Tuning->interleave > 0) {
+    LJ.Interleave = LJ.Tuning->interleave;
+    return;
+  }
+
+  unsigned Interleave = 1;
+
+  // loops narrowed to their dependence distance (RV_DEP_FORWARDING): one copy
+  // per DepDist-lane group of the full register width. Copy k + 1 loads what
+  // copy k stored, the unrolled body forwards it in registers (GVN) and the
+  // independent parts of the groups overlap.
+  if (RVConfig.enableDepForwarding && LJ.DepDist != ParallelDistance &&
+      LJ.VectorWidth == LJ.DepDist) {
+    CostModel costModel(vectorizer->getPlatformInfo(), RVConfig);
+    LoopRegion tmpLoopRegionImpl(L);
+    Region tmpLoopRegion(tmpLoopRegionImpl);
+    size_t FullWidth =
+        costModel.pickWidthForRegion(tmpLoopRegion, ParallelDistance);
+    Interleave = std::min<size_t>(FullWidth / LJ.VectorWidth, MaxForwardGroups);
+    if (enableDiagOutput)
+      Report() << "loopVecPass, forwarding: " << Interleave << " groups of "
+               << LJ.VectorWidth << " (full width " << FullWidth << ")\n";
+  }
+
+  if (Interleave <= 1) {
+    // only loops that carry a reduction chain gain independent accumulators
+    ReductionAnalysis MyReda(F, PMS.FAM);
+    MyReda.analyze(L);
+    bool HasReduction = false;
+    for (auto &Phi : L.getHeader()->phis()) {
+      if (MyReda.getStrideInfo(Phi))
+        continue;
+      auto *RedInfo = MyReda.getReductionInfo(Phi);
+      if (RedInfo && RedInfo->kind != RedKind::Top &&
+          RedInfo->kind != RedKind::Bot && !RedInfo->isScan() &&
+          RedInfo->elements.size() == 2)
+        HasReduction = true;
+    }
+    if (!HasReduction)
+      return;
+
+    // enough copies to cover the latency of the update with the rest of the body
+    double UpdateLatency = GetValue<double>("IL_UPDATE_LATENCY", 4.0);
+    double BodyCost = computeLoopCost(L, LJ.VectorWidth, false).vectorCost;
+    Interleave = BodyCost > 0.0 ? std::ceil(UpdateLatency / BodyCost)
+                                : MaxInterleave;
+    Interleave = std::min(std::max(Interleave, 1u), MaxInterleave);
+    if (enableDiagOutput)
+      Report() << "loopVecPass, interleave: body cost " << BodyCost
+               << ", update latency " << UpdateLatency << " -> interleave "
+               << Interleave << "\n";
+  }
+
+  // keep a few iterations of the unrolled loop
+  int TripCount = getTripCount(L);
+  if (TripCount <= 0)
+    TripCount = getProfiledTripCount(L, LJ);
+  while (Interleave > 1 && TripCount > 0 &&
+         (unsigned)TripCount < 2 * Interleave * LJ.VectorWidth)
+    Interleave /= 2;
+
+  LJ.Interleave = Interleave;
+}
+
+void LoopVectorizer::chooseStreamingStores(Loop &L, LoopJob &LJ) {
+  LJ.StreamingStores = false;
+  if (LJ.VectorWidth <= 1)
+    return;
+
+  LoopMD Annot = GetLoopAnnotation(L);
+  if (Annot.nontemporalStores.isSet()) {
+    LJ.StreamingStores = Annot.nontemporalStores.get();
+    return;
+  }
+  if (RVConfig.streamingStoreMinBytes <= 0)
+    return;
+  int TripCount = getTripCount(L);
+  if (TripCount <= 0)
+    return;
+
+  // a write-only stream: unit-stride stores into an object the loop does not read
+  SmallPtrSet<const Value *, 8> LoadedObjects;
+  for (auto *BB : L.blocks()) {
+    for (auto &I : *BB) {
+      if (auto *Load = dyn_cast<LoadInst>(&I))
+        LoadedObjects.insert(getUnderlyingObject(Load->getPointerOperand()));
+    }
+  }
+
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  uint64_t StreamBytes = 0;
+  for (auto *BB : L.blocks()) {
+    for (auto &I : *BB) {
+      auto *Store = dyn_cast<StoreInst>(&I);
+      if (!Store || !Store->isSimple())
+        continue;
+      uint64_t StoreBytes =
+          DL.getTypeStoreSize(Store->getValueOperand()->getType());
+      auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Store->getPointerOperand()));
+      if (!AR || AR->getLoop() != &L || !AR->isAffine())
+        continue;
+      auto *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+      if (!Step || Step->getAPInt() != StoreBytes)
+        continue;
+      if (LoadedObjects.count(getUnderlyingObject(Store->getPointerOperand())))
+        continue;
+      StreamBytes = std::max<uint64_t>(StreamBytes, TripCount * StoreBytes);
+    }
+  }
+
+  LJ.StreamingStores =
+      StreamBytes >= (uint64_t)RVConfig.streamingStoreMinBytes;
+  if (enableDiagOutput && LJ.StreamingStores)
+    Report() << "loopVecPass: streaming stores for " << StreamBytes
+             << " bytes of output\n";
+}
+
+void LoopVectorizer::chooseParallelChunks(Loop &L, LoopJob &LJ) {
+  LJ.ChunkSize = 0;
+  if (LJ.VectorWidth <= 1 || LJ.DepDist != ParallelDistance)
+    return;
+
+  LoopMD Annot = GetLoopAnnotation(L);
+  iter_t VectorIters = Annot.parallelChunks.safeGet(RVConfig.parallelChunks);
+  if (VectorIters <= 0)
+    return;
+
+  // a peeled prologue or 2D tiles would shift the chunks off the vector width
+  if (LJ.PeelAccess || RVConfig.tileRows > 1) {
+    if (enableDiagOutput)
+      Report() << "loopVecPass: no thread chunks for " << L.getName()
+               << ", the loop is peeled or tiled\n";
+    return;
+  }
+
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  ParallelChunkTransform ChunkTrans(F, LI, SE);
+  const char *Reason = nullptr;
+  if (!ChunkTrans.canTransform(L, Reason)) {
+    if (enableDiagOutput)
+      Report() << "loopVecPass: no thread chunks for " << L.getName() << ", "
+               << Reason << "\n";
+    return;
+  }
+
+  // only the last chunk runs a remainder
+  LJ.ChunkSize = VectorIters * LJ.VectorWidth * LJ.Interleave;
+  LJ.TripAlign = GreatestCommonDivisor64(LJ.TripAlign, LJ.ChunkSize);
+}
+
+RegionCost LoopVectorizer::computeLoopCost(Loop &L, unsigned VectorWidth,
+                                           bool Masked,
+                                           ProfitFeatures *Features) {
+  if (VectorWidth <= 1)
+    return RegionCost();
+
+  ReductionAnalysis MyReda(F, PMS.FAM);
+  MyReda.analyze(L);
+
+  LoopRegion LoopRegionImpl(L);
+  Region LoopRegion(LoopRegionImpl);
+  VectorizationInfo vecInfo(F, VectorWidth, LoopRegion);
+
+  // Same header phi shapes as vectorizeLoop (unsupported recurrences are
+  // rejected later, do not trust them here)
+  for (auto &Phi : L.getHeader()->phis()) {
+    VectorShape PhiShape = VectorShape::varying();
+    if (auto *Pat = MyReda.getStrideInfo(Phi))
+      PhiShape = Pat->getShape(VectorWidth);
+    else if (auto *RedInfo = MyReda.getReductionInfo(Phi))
+      if (RedInfo->kind != RedKind::Top &&
+          (RedInfo->kind != RedKind::Bot || RedInfo->isIndex() ||
+           RedInfo->isRecurrence()))
+        PhiShape = RedInfo->getShape(VectorWidth);
+
+    if (PhiShape.isDefined())
+      vecInfo.setPinnedShape(Phi, PhiShape);
+  }
+
+  vectorizer->analyze(vecInfo, PMS.FAM);
+
+  // every block executes under the tail mask
+  if (Masked) {
+    LoopRegion.for_blocks([&](const BasicBlock &BB) {
+      vecInfo.setVaryingPredicateFlag(BB, true);
+      return true;
+    });
+  }
+
+  CostModel costModel(vectorizer->getPlatformInfo(), RVConfig, vecInfo);
+  RegionCost Cost = costModel.estimateRegionCost();
+  if (Features)
+    *Features = ProfitFeatures::Collect(vecInfo, Cost, RVConfig);
+  if (enableDiagOutput) {
+    Report() << "loopVecPass, costModel: width " << VectorWidth
+             << (Masked ? " (masked): " : ": ");
+    Cost.print(ReportContinue());
+    ReportContinue() << "\n";
+  }
+  return Cost;
+}
+
 enum ForLoopsControl {
   Descend = 0,     // continue for_loops into child lops
   SkipChildren = 1 // do not descend into child loops
@@ -456,6 +1269,153 @@ static void for_loops_post(LoopInfo &LI, std::function<bool(Loop &)> BodyFunc) {
 }
 #endif
 
+bool LoopVectorizer::vectorizeSearchLoops() {
+  unsigned VectorBytes =
+      PassTTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector).getFixedValue() / 8;
+  if (VectorBytes == 0)
+    return false;
+
+  std::vector<BasicBlock *> Headers;
+  for_loops(PMS.FAM.getResult<LoopAnalysis>(F), [&](Loop &L) {
+    if (!L.getSubLoops().empty())
+      return Descend;
+    if (!GetLoopAnnotation(L).alreadyVectorized.safeGet(false))
+      Headers.push_back(L.getHeader());
+    return SkipChildren;
+  });
+
+  bool Changed = false;
+  for (auto *Header : Headers) {
+    auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+    auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+    auto &L = *LI.getLoopFor(Header);
+    SearchLoopTransform SearchTrans(F, LI, SE, VectorBytes);
+    SearchLoopTransform::SearchLoop Search;
+    if (!SearchTrans.analyze(L, Search))
+      continue;
+
+    Report() << "loopVecPass: vector scan for search loop " << L.getName() << "\n";
+    remark("Vectorized search loop", "RVSearchLoop", L);
+    auto *VecHeader = SearchTrans.run(L, Search);
+    PMS.FAM.invalidate(F, PreservedAnalyses::none());
+    Changed = true;
+
+    // neither loop is a lock-step loop for the region vectorizer
+    auto &NewLI = PMS.FAM.getResult<LoopAnalysis>(F);
+    for (auto *Block : {VecHeader, Header}) {
+      LoopMD DoneMD;
+      DoneMD.alreadyVectorized = true;
+      SetLLVMLoopAnnotations(*NewLI.getLoopFor(Block), std::move(DoneMD));
+    }
+  }
+
+  return Changed;
+}
+
+namespace {
+// address progression of the memory accesses in a loop nest along one of its loops
+struct AccessShapes {
+  unsigned Contiguous = 0;
+  unsigned Uniform = 0;
+  unsigned Strided = 0; // gathers/scatters (or interleaved accesses)
+};
+} // namespace
+
+static AccessShapes ClassifyAccesses(Loop &Nest, Loop &Level,
+                                     ScalarEvolution &SE) {
+  AccessShapes Shapes;
+  const DataLayout &DL = Nest.getHeader()->getModule()->getDataLayout();
+  for (auto *BB : Nest.blocks()) {
+    for (auto &I : *BB) {
+      auto *Ptr = getLoadStorePointerOperand(&I);
+      if (!Ptr)
+        continue;
+
+      // strip the recurrences of loops inside of Level
+      const SCEV *PtrSCEV = SE.getSCEV(Ptr);
+      while (auto *AR = dyn_cast<SCEVAddRecExpr>(PtrSCEV)) {
+        if (AR->getLoop() == &Level || !Level.contains(AR->getLoop()))
+          break;
+        PtrSCEV = AR->getStart();
+      }
+
+      auto *AR = dyn_cast<SCEVAddRecExpr>(PtrSCEV);
+      auto *Step = AR && AR->getLoop() == &Level && AR->isAffine()
+                       ? dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE))
+                       : nullptr;
+      uint64_t ElemSize = DL.getTypeStoreSize(getLoadStoreType(&I));
+      if (SE.isLoopInvariant(PtrSCEV, &Level))
+        ++Shapes.Uniform;
+      else if (Step && Step->getAPInt() == ElemSize)
+        ++Shapes.Contiguous;
+      else
+        ++Shapes.Strided;
+    }
+  }
+  return Shapes;
+}
+
+LoopVectorizer::LoopJob LoopVectorizer::selectNestLevel(
+    Loop &L, LoopJob &LJ, LoopScore &LS,
+    std::vector<std::pair<LoopJob, LoopScore>> &InnerLevels) {
+  if (L.getSubLoops().empty())
+    return LJ;
+
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  auto printShapes = [&](Loop &Level, const AccessShapes &Shapes) {
+    Report() << "loopVecPass: nest " << L.getName() << ", level "
+             << Level.getName() << " (depth " << Level.getLoopDepth()
+             << "): " << Shapes.Contiguous << " contiguous, " << Shapes.Uniform
+             << " uniform, " << Shapes.Strided << " strided accesses";
+  };
+
+  // the outermost level wins unless an inner level has a better score (or
+  // the same score with fewer gathers)
+  LoopJob *BestLJ = &LJ;
+  unsigned BestScore = LS.Score;
+  AccessShapes BestShapes = ClassifyAccesses(L, L, SE);
+  printShapes(L, BestShapes);
+  ReportContinue() << ", score " << LS.Score << "\n";
+  for (auto &Level : InnerLevels) {
+    auto &InnerL = *LI.getLoopFor(Level.first.Header);
+    AccessShapes Shapes = ClassifyAccesses(L, InnerL, SE);
+    printShapes(InnerL, Shapes);
+    ReportContinue() << ", score " << Level.second.Score << "\n";
+    if (Level.second.Score > BestScore ||
+        (Level.second.Score == BestScore && Shapes.Strided < BestShapes.Strided)) {
+      BestLJ = &Level.first;
+      BestScore = Level.second.Score;
+      BestShapes = Shapes;
+    }
+  }
+
+  auto &BestL = *LI.getLoopFor(BestLJ->Header);
+  Report() << "loopVecPass: nest " << L.getName() << ": vectorizing level "
+           << BestL.getName()
+           << (BestLJ == &LJ ? " (outermost legal level)\n"
+                             : " (best score among the legal levels)\n");
+
+  // point out levels that would be better but are not known to be parallel
+  for_loops(L, [&](Loop &Level) {
+    if (&Level == &L || std::any_of(InnerLevels.begin(), InnerLevels.end(), [&](auto &Legal) {
+          return Legal.first.Header == Level.getHeader();
+        }))
+      return Descend;
+    AccessShapes Shapes = ClassifyAccesses(L, Level, SE);
+    if (Shapes.Strided < BestShapes.Strided) {
+      printShapes(Level, Shapes);
+      ReportContinue() << ", not known to be parallel (annotate it or "
+                          "interchange the nest to vectorize it)\n";
+    }
+    return Descend;
+  });
+
+  if (BestLJ != &LJ)
+    remark("Vectorizing an inner level of the annotated nest", "RVLoopVecLevel", BestL);
+  return *BestLJ;
+}
+
 bool LoopVectorizer::collectLoopJobs(LoopInfo &LI) {
 #if 0
   // Outer-loop preference (ignores nested 'pragma omp simd' loops).
@@ -492,6 +1452,7 @@ bool LoopVectorizer::collectLoopJobs(LoopInfo &LI) {
 
     // Check whether there is a legal inner loop with a vectorization pragma.
     bool FoundSIMDLoop = false;
+    std::vector<std::pair<LoopJob, LoopScore>> InnerLevels;
     for_loops(L, [&](Loop &InnerL) {
       // Skip parent scope.
       if (&InnerL == &L)
@@ -510,11 +1471,12 @@ bool LoopVectorizer::collectLoopJobs(LoopInfo &LI) {
         LoopsToPrepare.emplace_back(InnerLJ);
         return SkipChildren;
       }
+      InnerLevels.emplace_back(InnerLJ, InnerLS);
       return Descend;
     });
 
     if (!FoundSIMDLoop)
-      LoopsToPrepare.emplace_back(LJ);
+      LoopsToPrepare.emplace_back(selectNestLevel(L, LJ, LS, InnerLevels));
 
     return SkipChildren;
   });
@@ -523,114 +1485,575 @@ bool LoopVectorizer::collectLoopJobs(LoopInfo &LI) {
   return !LoopsToPrepare.empty();
 }
 
+// marks the access the loop was peeled for (until each vector loop of the job is annotated)
+static const char *AlignPeelMD = "rv.align.peel";
+
+// the alignment of the peeled access \p I in a vector loop of width \p VectorWidth
+static uint64_t GetPeelAlignment(Instruction &I, unsigned VectorWidth) {
+  const DataLayout &DL = I.getModule()->getDataLayout();
+  return VectorWidth * DL.getTypeAllocSize(getLoadStoreType(&I));
+}
+
+// Tell the VA that the peeled access is aligned in the vector loop \p L
+// (rv_align on its address).
+static void AnnotatePeeledAlignment(Loop &L, unsigned VectorWidth) {
+  auto &Mod = *L.getHeader()->getModule();
+  for (auto *BB : L.blocks()) {
+    for (auto &I : *BB) {
+      if (!I.getMetadata(AlignPeelMD))
+        continue;
+      I.setMetadata(AlignPeelMD, nullptr);
+
+      auto *Ptr = getLoadStorePointerOperand(&I);
+      unsigned AddrSpace = Ptr->getType()->getPointerAddressSpace();
+      auto *BytePtrTy = Type::getInt8PtrTy(Mod.getContext(), AddrSpace);
+      auto *AlignFunc = Mod.getFunction(GetIntrinsicName(RVIntrinsic::Align, BytePtrTy));
+      if (!AlignFunc)
+        AlignFunc = &DeclareIntrinsic(RVIntrinsic::Align, Mod, BytePtrTy);
+
+      IRBuilder<> Builder(&I);
+      auto *AlignedPtr = Builder.CreateCall(
+          AlignFunc, {Builder.CreatePointerCast(Ptr, BytePtrTy),
+                      Builder.getInt32(GetPeelAlignment(I, VectorWidth))},
+          "rv.peel.aligned");
+      unsigned PtrIdx = isa<LoadInst>(I) ? LoadInst::getPointerOperandIndex()
+                                         : StoreInst::getPointerOperandIndex();
+      I.setOperand(PtrIdx, Builder.CreatePointerCast(AlignedPtr, Ptr->getType()));
+    }
+  }
+}
+
+Value *LoopVectorizer::emitAliasChecks(Loop &L, LoopJob &LJ) {
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  auto *PreHeader = L.getLoopPredecessor();
+  assert(PreHeader && "runtime alias checks require a unique loop predecessor");
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  SCEVExpander Expander(SE, DL, "rv.alias");
+  IRBuilder<> Builder(PreHeader->getTerminator());
+  auto expandRange = [&](Instruction &I) {
+    auto Range = GetAccessRange(L, I, SE);
+    assert(Range.first && "access range was computable when scoring the loop");
+    auto *PtrTy = getLoadStorePointerOperand(&I)->getType();
+    return std::make_pair(
+        Expander.expandCodeFor(Range.first, PtrTy, PreHeader->getTerminator()),
+        Expander.expandCodeFor(Range.second, PtrTy, PreHeader->getTerminator()));
+  };
+
+  Value *Guard = Builder.getTrue();
+  // speculated strides are 1
+  for (auto *Stride : LJ.StrideChecks) {
+    auto *IsUnit = Builder.CreateICmpEQ(
+        Stride, ConstantInt::get(Stride->getType(), 1), "rv.stride.unit");
+    Guard = Builder.CreateAnd(Guard, IsUnit, "rv.stride.guard");
+  }
+
+  // ranges [LowA, HighA) and [LowB, HighB) are disjoint
+  for (auto &Check : LJ.AliasChecks) {
+    auto RangeA = expandRange(*Check.first);
+    auto RangeB = expandRange(*Check.second);
+    auto *LowB = Builder.CreatePointerCast(RangeB.first, RangeA.first->getType());
+    auto *HighB = Builder.CreatePointerCast(RangeB.second, RangeA.first->getType());
+    auto *AFirst = Builder.CreateICmpULE(RangeA.second, LowB, "rv.alias.before");
+    auto *BFirst = Builder.CreateICmpULE(HighB, RangeA.first, "rv.alias.after");
+    Guard = Builder.CreateAnd(Guard, Builder.CreateOr(AFirst, BFirst),
+                              "rv.alias.disjoint");
+  }
+
+  // the peel loop could not align the access (start not element aligned)
+  if (LJ.PeelAccess) {
+    auto *Ptr = getLoadStorePointerOperand(LJ.PeelAccess);
+    auto *PtrRec = cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+    auto *Start = Expander.expandCodeFor(PtrRec->getStart(), Ptr->getType(),
+                                         PreHeader->getTerminator());
+    auto *StartInt = Builder.CreatePtrToInt(Start, DL.getIntPtrType(Ptr->getType()));
+    auto *Misalign = Builder.CreateAnd(
+        StartInt, GetPeelAlignment(*LJ.PeelAccess, LJ.VectorWidth) - 1);
+    Guard = Builder.CreateAnd(
+        Guard,
+        Builder.CreateICmpEQ(Misalign, ConstantInt::get(Misalign->getType(), 0)),
+        "rv.peel.aligned");
+  }
+  return Guard;
+}
+
+// Replace the strides in the (guarded) loop \p L by 1 and fold the address
+// computations that become constant.
+static void SpecializeUnitStrides(Loop &L, ArrayRef<Value *> Strides) {
+  const DataLayout &DL = L.getHeader()->getModule()->getDataLayout();
+  std::vector<Instruction *> Worklist;
+  for (auto *Stride : Strides) {
+    auto *One = ConstantInt::get(Stride->getType(), 1);
+    for (auto UseIt = Stride->use_begin(); UseIt != Stride->use_end();) {
+      Use &U = *UseIt++;
+      auto *UserInst = dyn_cast<Instruction>(U.getUser());
+      if (!UserInst || !L.contains(UserInst))
+        continue;
+      U.set(One);
+      Worklist.push_back(UserInst);
+    }
+  }
+
+  // folded instructions stay in place until all users are rewritten
+  std::vector<Instruction *> Dead;
+  while (!Worklist.empty()) {
+    auto *I = Worklist.back();
+    Worklist.pop_back();
+    if (isa<PHINode>(I) || I->use_empty())
+      continue;
+    auto *Folded = ConstantFoldInstruction(I, DL);
+    if (!Folded)
+      continue;
+    for (auto *User : I->users())
+      if (auto *UserInst = dyn_cast<Instruction>(User))
+        Worklist.push_back(UserInst);
+    I->replaceAllUsesWith(Folded);
+    Dead.push_back(I);
+  }
+  for (auto *I : Dead)
+    I->eraseFromParent();
+}
+
 PreparedLoop LoopVectorizer::transformToVectorizableLoop(
-    Loop &L, int VectorWidth, int tripAlign, ValueSet &uniformOverrides) {
+    Loop &L, LoopJob &LJ, ValueSet &uniformOverrides) {
   IF_DEBUG {
     errs() << "\tPreparing loop structure of " << L.getName() << "\n";
   }
 
+  // emitted once, the epilogue loop shares the checks of the main loop
+  if ((!LJ.AliasChecks.empty() || !LJ.StrideChecks.empty() || LJ.PeelAccess) &&
+      !LJ.AliasGuard)
+    LJ.AliasGuard = emitAliasChecks(L, LJ);
+
   // try to applu the remainder transformation
   ReductionAnalysis MyReda(F, PMS.FAM);
   MyReda.analyze(L);
   RemainderTransform remTrans(F, PMS.FAM, MyReda);
   PreparedLoop LoopPrep = remTrans.createVectorizableLoop(
-      L, uniformOverrides, false, VectorWidth, tripAlign);
+      L, uniformOverrides, LJ.FoldTail, LJ.VectorWidth, LJ.TripAlign,
+      LJ.AliasGuard, LJ.OverlapTail);
+
+  if (LoopPrep.TheLoop && !LJ.StrideChecks.empty())
+    SpecializeUnitStrides(*LoopPrep.TheLoop, LJ.StrideChecks);
+  if (LoopPrep.TheLoop && LJ.PeelAccess)
+    AnnotatePeeledAlignment(*LoopPrep.TheLoop, LJ.VectorWidth);
 
   return LoopPrep;
 }
 
+bool LoopVectorizer::prepareLaneRefill(LoopJob &LJ) {
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &L = *LI.getLoopFor(LJ.Header);
+
+  LaneRefillTransform RefillTrans(F, SE, vectorizer->getPlatformInfo(),
+                                  LJ.VectorWidth);
+  if (!RefillTrans.canTransform(L))
+    return false;
+
+  Report() << "loopVecPass: lane refilling for " << L.getName() << "\n";
+  remark("Lanes refilled from the outer loop of a divergent inner loop",
+         "RVLaneRefill", L);
+  LJ.Header = RefillTrans.run(L);
+
+  // the loop nest was rebuilt
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+  PMS.FAM.getResult<LoopAnalysis>(F);
+  return true;
+}
+
+void LoopVectorizer::prepareAlignPeel(LoopJob &LJ) {
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &DT = PMS.FAM.getResult<DominatorTreeAnalysis>(F);
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &L = *LI.getLoopFor(LJ.Header);
+
+  Report() << "loopVecPass: alignment peeling for " << L.getName() << "\n";
+  AlignPeelTransform PeelTrans(F, DT, LI, SE, LJ.VectorWidth);
+  auto *PeelHeader = PeelTrans.run(L, *LJ.PeelAccess);
+  LJ.PeelAccess->setMetadata(AlignPeelMD, MDNode::get(F.getContext(), {}));
+
+  // the loop nest gained the peel loop
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+  auto &PeelLI = PMS.FAM.getResult<LoopAnalysis>(F);
+
+  // the peel loop runs less than VectorWidth iterations
+  LoopMD PeelLoopMD;
+  PeelLoopMD.alreadyVectorized = true;
+  SetLLVMLoopAnnotations(*PeelLI.getLoopFor(PeelHeader), std::move(PeelLoopMD));
+}
+
+void LoopVectorizer::prepareParallelChunks(LoopJob &LJ) {
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &L = *LI.getLoopFor(LJ.Header);
+
+  Report() << "loopVecPass: thread chunks of " << LJ.ChunkSize
+           << " iterations for " << L.getName() << "\n";
+  remark("Loop runs in thread chunks of " + std::to_string(LJ.ChunkSize) +
+             " iterations",
+         "RVParallelChunks", L);
+  ParallelChunkTransform ChunkTrans(F, LI, SE);
+  ChunkLoops.push_back(ChunkTrans.run(L, LJ.ChunkSize));
+
+  // the loop is nested in the chunk loop now
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+}
+
+bool LoopVectorizer::outlineParallelChunks() {
+  bool Changed = false;
+  for (auto &CL : ChunkLoops) {
+    if (ParallelChunkTransform::outlineTask(F, CL, RVConfig.parallelRuntime)) {
+      Changed = true;
+    } else {
+      Report() << "loopVecPass: could not outline the thread chunks in "
+               << F.getName() << ", they run in sequence\n";
+    }
+  }
+  ChunkLoops.clear();
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+  return Changed;
+}
+
+bool LoopVectorizer::prepareTiling(LoopJob &LJ) {
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &L = *LI.getLoopFor(LJ.Header);
+  auto *OuterL = L.getParentLoop();
+  if (!OuterL || OuterL->getSubLoops().size() != 1 || !L.getSubLoops().empty())
+    return false;
+
+  // the rows of a tile are consecutive iterations of the outer loop
+  LoopMD OuterMD = GetLoopAnnotation(*OuterL);
+  bool OuterParallel =
+      OuterL->isAnnotatedParallel() ||
+      (OuterMD.vectorizeEnable.safeGet(false) &&
+       OuterMD.minDepDist.safeGet(ParallelDistance) >= (iter_t)RVConfig.tileRows);
+  if (!OuterParallel) {
+    if (enableDiagOutput)
+      Report() << "loopVecPass: no 2D tiles for " << L.getName()
+               << ", the outer loop is not annotated parallel\n";
+    return false;
+  }
+
+  auto &DT = PMS.FAM.getResult<DominatorTreeAnalysis>(F);
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &DI = PMS.FAM.getResult<DependenceAnalysis>(F);
+  auto &AC = PMS.FAM.getResult<AssumptionAnalysis>(F);
+  if (!isSafeToUnrollAndJam(OuterL, SE, DT, DI, LI)) {
+    Report() << "loopVecPass: no 2D tiles for " << L.getName()
+             << ", can not unroll and jam " << OuterL->getName() << "\n";
+    return false;
+  }
+
+  unsigned TripCount = SE.getSmallConstantTripCount(OuterL);
+  unsigned TripMultiple = SE.getSmallConstantTripMultiple(OuterL);
+  auto Result = UnrollAndJamLoop(OuterL, RVConfig.tileRows, TripCount,
+                                 TripMultiple, false, &LI, &SE, &DT, &AC,
+                                 &PassTTI, &PassORE);
+  if (Result == LoopUnrollResult::Unmodified)
+    return false;
+
+  Report() << "loopVecPass: 2D tiles of " << RVConfig.tileRows << "x"
+           << LJ.VectorWidth << " for " << L.getName() << "\n";
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+  return true;
+}
+
+bool LoopVectorizer::prepareCollapse(LoopJob &LJ) {
+  if (LJ.LaneRefill || LJ.PeelAccess || LJ.ChunkSize > 0 ||
+      !LJ.AliasChecks.empty() || !LJ.StrideChecks.empty())
+    return false;
+
+  // the loop of LJ is the outer or the inner level of a two-level nest
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &L = *LI.getLoopFor(LJ.Header);
+  Loop *OuterL = L.getSubLoops().size() == 1 ? &L : L.getParentLoop();
+  if (!OuterL || OuterL->getSubLoops().size() != 1)
+    return false;
+  Loop *InnerL = OuterL->getSubLoops()[0];
+  Loop *OtherL = OuterL == &L ? InnerL : OuterL;
+
+  // only if the level of LJ leaves lanes idle
+  int TripCount = getTripCount(L);
+  CostModel costModel(vectorizer->getPlatformInfo(), RVConfig);
+  LoopRegion NestRegionImpl(*OuterL);
+  Region NestRegion(NestRegionImpl);
+  size_t FullWidth = costModel.pickWidthForRegion(NestRegion, ParallelDistance);
+  if (TripCount <= 0 || (size_t)TripCount >= FullWidth)
+    return false;
+
+  // lanes of a collapsed vector iteration span iterations of both levels
+  LoopMD OtherMD = GetLoopAnnotation(*OtherL);
+  iter_t OtherDepDist = 1;
+  if (OtherL->isAnnotatedParallel())
+    OtherDepDist = ParallelDistance;
+  else if (OtherMD.vectorizeEnable.safeGet(false))
+    OtherDepDist = OtherMD.minDepDist.safeGet(ParallelDistance);
+  else if (RVConfig.enableAutoLoopVec)
+    OtherDepDist = computeDependenceDistance(*OtherL, nullptr);
+
+  size_t Width = FullWidth;
+  for (iter_t DepDist : {LJ.DepDist, OtherDepDist})
+    if (DepDist != ParallelDistance)
+      Width = std::min<size_t>(Width, DepDist);
+  int OtherTripCount = getTripCount(*OtherL);
+  if (OtherTripCount > 0)
+    Width = std::min<size_t>(Width, (size_t)TripCount * OtherTripCount);
+  if (Width <= LJ.VectorWidth) {
+    if (enableDiagOutput)
+      Report() << "loopVecPass: not collapsing " << OuterL->getName()
+               << ", the nest does not allow more than width "
+               << LJ.VectorWidth << "\n";
+    return false;
+  }
+
+  auto &SE = PMS.FAM.getResult<ScalarEvolutionAnalysis>(F);
+  LoopCollapseTransform CollapseTrans(F, SE);
+  if (!CollapseTrans.canCollapse(*OuterL)) {
+    if (enableDiagOutput)
+      Report() << "loopVecPass: not collapsing " << OuterL->getName()
+               << ", not a perfect nest\n";
+    return false;
+  }
+
+  Report() << "loopVecPass: collapsing " << OuterL->getName() << " and "
+           << InnerL->getName() << " for width " << Width << "\n";
+  remark("Loop nest collapsed into one loop", "RVLoopCollapse", *OuterL);
+  LJ.Header = CollapseTrans.run(*OuterL);
+  LJ.VectorWidth = Width;
+  LJ.DepDist = std::min(LJ.DepDist, OtherDepDist);
+  LJ.EpilogueWidth = 0;
+  LJ.OverlapTail = false;
+  LJ.Interleave = 1;
+
+  // the nest is one loop now
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+  auto &CollapsedLI = PMS.FAM.getResult<LoopAnalysis>(F);
+  LJ.TripAlign = getTripAlignment(*CollapsedLI.getLoopFor(LJ.Header));
+  return true;
+}
+
 bool LoopVectorizer::prepareLoopVectorization() {
-  auto &LI = *PMS.FAM.getCachedResult<LoopAnalysis>(F);
   for (LoopJob &LJ : LoopsToPrepare) {
-    auto &L = *LI.getLoopFor(LJ.Header);
-
-    Report() << "loopVecPass: Vectorize " << L.getName()
-             << " with VW: " << LJ.VectorWidth
-             << " , Dependence Distance: " << DepDistToString(LJ.DepDist)
-             << " and TripAlignment: " << LJ.TripAlign << "\n";
-
-    // match vector loop structure
-    ValueSet uniOverrides;
-    auto LoopPrep = transformToVectorizableLoop(L, LJ.VectorWidth, LJ.TripAlign,
-                                                uniOverrides);
-    if (!LoopPrep.TheLoop) {
-      Report() << "loopVecPass: Cannot prepare vectorization of the loop\n";
+    bool Collapsed = RVConfig.enableLoopCollapse && prepareCollapse(LJ);
+    if (RVConfig.tileRows > 1 && !LJ.LaneRefill && !Collapsed)
+      prepareTiling(LJ);
+    if (LJ.LaneRefill && !prepareLaneRefill(LJ))
       return false;
+    if (LJ.PeelAccess)
+      prepareAlignPeel(LJ);
+    if (LJ.ChunkSize > 0)
+      prepareParallelChunks(LJ);
+
+    BasicBlock *ScalarHeader = LJ.Header;
+    if (!prepareLoopJob(LJ))
+      return false;
+
+    // vectorize the remainder loop at the epilogue width as well
+    if (LJ.EpilogueWidth > 1) {
+      LoopJob EpilogueLJ = LJ;
+      EpilogueLJ.Header = ScalarHeader;
+      EpilogueLJ.VectorWidth = LJ.EpilogueWidth;
+      EpilogueLJ.TripAlign = 1;
+      EpilogueLJ.FoldTail = false;
+      EpilogueLJ.OverlapTail = false;
+      EpilogueLJ.EpilogueWidth = 0;
+      EpilogueLJ.Interleave = 1;
+      if (!prepareLoopJob(EpilogueLJ))
+        return false;
     }
 
+    // the scalar loop keeps its unaligned accesses
+    if (LJ.PeelAccess)
+      LJ.PeelAccess->setMetadata(AlignPeelMD, nullptr);
+  }
+
+  LoopsToPrepare.clear();
+  return !LoopsToVectorize.empty();
+}
+
+bool LoopVectorizer::prepareLoopJob(LoopJob &LJ) {
+  auto &LI = *PMS.FAM.getCachedResult<LoopAnalysis>(F);
+  auto &L = *LI.getLoopFor(LJ.Header);
+
+  Report() << "loopVecPass: Vectorize " << L.getName()
+           << " with VW: " << LJ.VectorWidth
+           << " , Dependence Distance: " << DepDistToString(LJ.DepDist)
+           << " and TripAlignment: " << LJ.TripAlign
+           << (LJ.FoldTail ? " (folded tail)" : "")
+           << (LJ.OverlapTail ? " (overlapping tail)" : "")
+           << (LJ.EpilogueWidth > 1 ? " (vector epilogue)" : "")
+           << (LJ.Interleave > 1 ? " (interleaved x" + std::to_string(LJ.Interleave) + ")" : "")
+           << (LJ.AliasChecks.empty() ? "" : " (runtime alias checks)")
+           << (LJ.StrideChecks.empty() ? "" : " (stride versioning)")
+           << (LJ.PeelAccess ? " (alignment peeling)" : "") << "\n";
+
+  // match vector loop structure
+  ValueSet uniOverrides;
+  auto LoopPrep = transformToVectorizableLoop(L, LJ, uniOverrides);
+  if (!LoopPrep.TheLoop) {
+    Report() << "loopVecPass: Cannot prepare vectorization of the loop\n";
+    return false;
+  }
+
 #ifdef RV_ENABLE_LOOPDIST
-    /// BEGIN EXPERIMENTAL SECTION
-    {
-      ReductionAnalysis MyReda(*F, PMS.FAM);
-      MyReda.analyze(*LoopPrep.TheLoop);
-
-      LoopComponentAnalysis LCA(*F, *LoopPrep.TheLoop, PMS.FAM, MyReda);
-      LCA.run();
-      LoopDistributionTransform loopDistTrans(vectorizer->getPlatformInfo(),
-                                              LJ.VectorWidth, LCA);
-      loopDistTrans.run();
-    }
-    /// END EXPERIMENTAL SECTION
+  /// BEGIN EXPERIMENTAL SECTION
+  {
+    ReductionAnalysis MyReda(*F, PMS.FAM);
+    MyReda.analyze(*LoopPrep.TheLoop);
+
+    LoopComponentAnalysis LCA(*F, *LoopPrep.TheLoop, PMS.FAM, MyReda);
+    LCA.run();
+    LoopDistributionTransform loopDistTrans(vectorizer->getPlatformInfo(),
+                                            LJ.VectorWidth, LCA);
+    loopDistTrans.run();
+  }
+  /// END EXPERIMENTAL SECTION
 #endif
 
-    // Make sure that there is a preheader in any case
-    BasicBlock *UniquePred = nullptr;
-    if (!LoopPrep.TheLoop->getLoopPreheader()) {
-      auto *Head = LoopPrep.TheLoop->getHeader();
-      for (auto *InB : predecessors(Head)) {
-        if (LoopPrep.TheLoop->contains(InB))
-          continue;
-
-        if (!UniquePred) {
-          UniquePred = InB;
-        } else {
-          abort(); // Multiple edges to the loop header!!!
-        }
+  // Make sure that there is a preheader in any case
+  BasicBlock *UniquePred = nullptr;
+  if (!LoopPrep.TheLoop->getLoopPreheader()) {
+    auto *Head = LoopPrep.TheLoop->getHeader();
+    for (auto *InB : predecessors(Head)) {
+      if (LoopPrep.TheLoop->contains(InB))
+        continue;
+
+      if (!UniquePred) {
+        UniquePred = InB;
+      } else {
+        abort(); // Multiple edges to the loop header!!!
       }
+    }
 
-      // break the edge
-      std::string PHName = Head->getName().str() + ".ph";
-      auto *PH = BasicBlock::Create(F.getContext(), PHName, &F, Head);
-      UniquePred->getTerminator()->replaceUsesOfWith(Head, PH);
-      BranchInst::Create(Head, PH);
-      for (auto &phi : Head->phis()) {
-        for (unsigned i = 0; i < phi.getNumIncomingValues(); ++i) {
-          if (phi.getIncomingBlock(i) == UniquePred) {
-            phi.setIncomingBlock(i, PH);
-          }
+    // break the edge
+    std::string PHName = Head->getName().str() + ".ph";
+    auto *PH = BasicBlock::Create(F.getContext(), PHName, &F, Head);
+    UniquePred->getTerminator()->replaceUsesOfWith(Head, PH);
+    BranchInst::Create(Head, PH);
+    for (auto &phi : Head->phis()) {
+      for (unsigned i = 0; i < phi.getNumIncomingValues(); ++i) {
+        if (phi.getIncomingBlock(i) == UniquePred) {
+          phi.setIncomingBlock(i, PH);
         }
       }
+    }
 
-      auto *PHLoop = LI.getLoopFor(UniquePred);
-      if (PHLoop) {
-        PHLoop->addBasicBlockToLoop(PH, LI);
-      }
+    auto *PHLoop = LI.getLoopFor(UniquePred);
+    if (PHLoop) {
+      PHLoop->addBasicBlockToLoop(PH, LI);
     }
-    assert(L.getLoopPreheader());
+  }
+  assert(L.getLoopPreheader());
 
-    // mark the remainder loop as un-vectorizable
-    LoopMD llvmLoopMD;
-    llvmLoopMD.alreadyVectorized = true;
-    SetLLVMLoopAnnotations(L, std::move(llvmLoopMD));
+  // mark the remainder loop as un-vectorizable
+  LoopMD llvmLoopMD;
+  llvmLoopMD.alreadyVectorized = true;
+  SetLLVMLoopAnnotations(L, std::move(llvmLoopMD));
+  AddParallelAccessGroups(L, LJ.AccessGroups);
 
-    // clear loop annotations from our copy of the lop
-    ClearLoopVectorizeAnnotations(*LoopPrep.TheLoop);
+  // clear loop annotations from our copy of the lop
+  ClearLoopVectorizeAnnotations(*LoopPrep.TheLoop);
+
+  // print configuration banner once
+  if (!introduced) {
+    Report() << " rv::RVConfig: ";
+    RVConfig.print(ReportContinue());
+    introduced = true;
+  }
 
-    // print configuration banner once
-    if (!introduced) {
-      Report() << " rv::RVConfig: ";
-      RVConfig.print(ReportContinue());
-      introduced = true;
+  // use prepared loop instead
+  LJ.Header = LoopPrep.TheLoop->getHeader();
+  LoopsToVectorize.push_back(
+      LoopVectorizerJob{LJ, uniOverrides, LoopPrep.EntryAVL, LoopPrep.TailMask});
+
+  return true;
+}
+
+void LoopVectorizer::reportVectorized(LoopVectorizerJob &LVJob) {
+  auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  auto &L = *LI.getLoopFor(LVJob.LJ.Header);
+
+  std::stringstream Str;
+  Str << "Loop vectorized (width " << LVJob.LJ.VectorWidth << ")";
+  if (LVJob.TailMask) {
+    Str << " with folded tail";
+  } else if (LVJob.LJ.OverlapTail) {
+    Str << " with overlapping last iteration";
+  } else if (LVJob.LJ.EpilogueWidth > 1) {
+    Str << " with vector epilogue (width " << LVJob.LJ.EpilogueWidth << ")";
+  } else {
+    Str << " with scalar remainder loop";
+  }
+  if (!LVJob.LJ.AliasChecks.empty())
+    Str << " and " << LVJob.LJ.AliasChecks.size() << " runtime alias checks";
+  if (!LVJob.LJ.StrideChecks.empty())
+    Str << " and " << LVJob.LJ.StrideChecks.size() << " unit stride checks";
+  if (LVJob.LJ.PeelAccess)
+    Str << " after alignment peeling";
+  remark(Str.str(), "RVLoopVectorized", L);
+  reportDecision(F, L, ReportReason::Vectorized, LVJob.LJ.VectorWidth);
+}
+
+// successor lists of all blocks (without duplicates) in function order
+using CFGSnapshot = std::vector<std::pair<BasicBlock *, SmallVector<BasicBlock *, 2>>>;
+
+static void RecordCFG(Function &F, CFGSnapshot &CFG) {
+  for (auto &BB : F) {
+    CFG.emplace_back(&BB, SmallVector<BasicBlock *, 2>());
+    auto &Succs = CFG.back().second;
+    for (auto *Succ : successors(&BB)) {
+      if (!is_contained(Succs, Succ))
+        Succs.push_back(Succ);
     }
+  }
+}
 
-    // use prepared loop instead
-    LJ.Header = LoopPrep.TheLoop->getHeader();
-    LoopsToVectorize.push_back(
-        LoopVectorizerJob{LJ, uniOverrides, LoopPrep.EntryAVL});
+// dominator tree updates from \p OldCFG to the current CFG of \p F.
+// Returns false if blocks of \p OldCFG were erased since (their edges can not
+// be removed from the tree).
+static bool CollectCFGUpdates(Function &F, const CFGSnapshot &OldCFG,
+                              std::vector<DominatorTree::UpdateType> &Updates) {
+  DenseMap<BasicBlock *, const SmallVector<BasicBlock *, 2> *> OldSuccs;
+  for (auto &It : OldCFG)
+    OldSuccs[It.first] = &It.second;
+
+  CFGSnapshot NewCFG;
+  RecordCFG(F, NewCFG);
+  size_t NumKept = 0;
+  for (auto &It : NewCFG) {
+    auto *BB = It.first;
+    auto OldIt = OldSuccs.find(BB);
+    const SmallVector<BasicBlock *, 2> *Old =
+        OldIt == OldSuccs.end() ? nullptr : OldIt->second;
+    if (Old)
+      ++NumKept;
+
+    for (auto *Succ : It.second) {
+      if (!Old || !is_contained(*Old, Succ))
+        Updates.push_back({DominatorTree::Insert, BB, Succ});
+    }
+    if (!Old)
+      continue;
+    for (auto *Succ : *Old) {
+      if (!is_contained(It.second, Succ))
+        Updates.push_back({DominatorTree::Delete, BB, Succ});
+    }
   }
+  return NumKept == OldCFG.size();
+}
 
-  LoopsToPrepare.clear();
-  return !LoopsToVectorize.empty();
+// erase the unreachable blocks NatBuilder left behind
+static void EraseDeadBlocks(Function &F) {
+  SmallVector<BasicBlock *, 16> DeadBlocks;
+  for (auto &BB : F) {
+    if (&BB == &F.getEntryBlock() || !pred_empty(&BB) || BB.hasAddressTaken())
+      continue;
+    if (BB.size() == 1 && isa<UnreachableInst>(BB.getTerminator()))
+      DeadBlocks.push_back(&BB);
+  }
+  for (auto *BB : DeadBlocks)
+    BB->eraseFromParent();
 }
 
 bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
@@ -640,7 +2063,7 @@ bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
 
   // analyze the recurrence patterns of this loop
   ReductionAnalysis MyReda(F, PMS.FAM);
-  MyReda.analyze(L);
+  MyReda.analyze(L, LVJob.TailMask);
 
   // start vectorizing the prepared loop
   IF_DEBUG { errs() << "rv: Vectorizing loop " << L.getName() << "\n"; }
@@ -651,17 +2074,13 @@ bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
   Region LoopRegion(LoopRegionImpl);
 
   VectorizationInfo vecInfo(F, LVJob.LJ.VectorWidth, LoopRegion);
-  std::stringstream Str;
-  Str << "Loop vectorized (width " << LVJob.LJ.VectorWidth << ")";
-  assert(!LVJob.EntryAVL && "AVL support broken!");
- #if  0
-  if (LVJob.EntryAVL) {
-    vecInfo.setEntryAVL(LVJob.EntryAVL);
-    Str << " with dynamic VL";
-  } else {
-#endif
-  Str << " with scalar remainder loop";
-  remark(Str.str(), "RVLoopVectorized", L);
+  // the AVL of tail predicated loops is only consumed through the tail mask
+  assert((!LVJob.EntryAVL || LVJob.TailMask) && "AVL support broken!");
+  if (LVJob.TailMask)
+    vecInfo.setEntryMask(*LVJob.TailMask);
+  // strip-mined loops pass the AVL as explicit vector length
+  if (LVJob.EntryAVL && RVConfig.useAVL)
+    vecInfo.setEntryAVL(*LVJob.EntryAVL);
 
   // Check reduction patterns of vector loop phis
   // configure initial shape for induction variable
@@ -679,13 +2098,14 @@ bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
       rv::Reduction *redInfo = MyReda.getReductionInfo(*phi);
 
       assert(redInfo);
-      assert(IsSupportedReduction(L, *redInfo));
+      assert(IsSupportedReduction(L, *redInfo, MyReda));
       // unsupported reduction kind (operator in value SCC unrecognized)
       assert(redInfo->kind != RedKind::Top);
 
       // Unsupported recurrence (definition and use in different loop
       // iterations)
-      assert(redInfo->kind != RedKind::Bot);
+      assert(redInfo->kind != RedKind::Bot || redInfo->isIndex() ||
+             redInfo->isRecurrence());
 
       // Otw, this is a privatizable reduction pattern
       IF_DEBUG { redInfo->dump(); }
@@ -703,12 +2123,31 @@ bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
     vecInfo.setPinnedShape(*val, VectorShape::uni());
   }
 
+  // interleaved loops rotate their reductions through one accumulator per copy,
+  // streaming loops use nontemporal stores,
+  // tuned loops (RV_TUNING) override config flags
+  std::unique_ptr<VectorizerInterface> LoopConfigVectorizer;
+  VectorizerInterface *Vectorizer = vectorizer.get();
+  const TuningEntry *Tuning = LVJob.LJ.Tuning;
+  if (LVJob.LJ.Interleave > 1 || LVJob.LJ.StreamingStores ||
+      (Tuning && !Tuning->flags.empty())) {
+    Config LoopConfig = RVConfig;
+    LoopConfig.redAccumulators =
+        std::max<int>(LoopConfig.redAccumulators, LVJob.LJ.Interleave);
+    LoopConfig.enableStreamingStores = LVJob.LJ.StreamingStores;
+    if (Tuning)
+      Tuning->apply(LoopConfig);
+    LoopConfigVectorizer.reset(
+        new VectorizerInterface(vectorizer->getPlatformInfo(), LoopConfig));
+    Vectorizer = LoopConfigVectorizer.get();
+  }
+
   // early math func lowering
-  vectorizer->lowerRuntimeCalls(vecInfo, PMS.FAM);
+  Vectorizer->lowerRuntimeCalls(vecInfo, PMS.FAM);
 
   // Vectorize
   // vectorizationAnalysis
-  vectorizer->analyze(vecInfo, PMS.FAM);
+  Vectorizer->analyze(vecInfo, PMS.FAM);
 
   if (enableDiagOutput) {
     errs() << "-- VA result --\n";
@@ -721,7 +2160,13 @@ bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
   assert(L.getLoopPreheader());
 
   // control conversion
-  vectorizer->linearize(vecInfo, PMS.FAM);
+  Vectorizer->linearize(vecInfo, PMS.FAM);
+
+  // the dominator tree is valid for the linearized CFG (NatBuilder relies on
+  // it), code generation only rewires the loop region
+  auto &DT = PMS.FAM.getResult<DominatorTreeAnalysis>(F);
+  CFGSnapshot LinearizedCFG;
+  RecordCFG(F, LinearizedCFG);
 
   // vectorize the prepared loop embedding it in its context
   ValueToValueMapTy vecMap;
@@ -729,10 +2174,33 @@ bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
   ScalarEvolutionAnalysis adhocAnalysis;
   adhocAnalysis.run(F, PMS.FAM);
 
-  bool vectorizeOk = vectorizer->vectorize(vecInfo, PMS.FAM, &vecMap);
+  bool vectorizeOk = Vectorizer->vectorize(vecInfo, PMS.FAM, &vecMap);
   if (!vectorizeOk)
     llvm_unreachable("vector code generation failed");
 
+  // repair the dominator tree for the next loop job (cf vectorizeLoopRegions)
+  std::vector<DominatorTree::UpdateType> CFGUpdates;
+  if (CollectCFGUpdates(F, LinearizedCFG, CFGUpdates))
+    DT.applyUpdates(CFGUpdates);
+  else
+    DT.recalculate(F);
+  IF_DEBUG_LV assert(DT.verify(DominatorTree::VerificationLevel::Fast));
+
+  // the unroller replicates the body, copy k updates accumulator k
+  // (the vector accesses are in the access groups of their scalar accesses, the vector loop is as parallel as the scalar one)
+  if (LVJob.LJ.Interleave > 1 || !LVJob.LJ.AccessGroups.empty()) {
+    LoopInfo VecLI(DT);
+    auto *VecHeader = cast<BasicBlock>(vecMap[LVJob.LJ.Header]);
+    if (auto *VecLoop = VecLI.getLoopFor(VecHeader)) {
+      LoopMD VecLoopMD;
+      VecLoopMD.alreadyVectorized = true;
+      if (LVJob.LJ.Interleave > 1)
+        VecLoopMD.unrollCount = LVJob.LJ.Interleave;
+      SetLLVMLoopAnnotations(*VecLoop, std::move(VecLoopMD));
+      AddParallelAccessGroups(*VecLoop, LVJob.LJ.AccessGroups);
+    }
+  }
+
   if (enableDiagOutput) {
     errs() << "-- Vectorized --\n";
     for (const BasicBlock *BB : L.blocks()) {
@@ -745,24 +2213,267 @@ bool LoopVectorizer::vectorizeLoop(LoopVectorizerJob &LVJob) {
 }
 
 bool LoopVectorizer::vectorizeLoopRegions() {
+  if (numThreads > 1 && LoopsToVectorize.size() > 1)
+    return vectorizeLoopRegionsParallel();
+
   bool Changed = false;
 
-  for (auto &LVJob : LoopsToVectorize) {
-    auto PA = PreservedAnalyses::all();
-    // FIXME repair loop info on the go
-    // Rebuild analysis structured
-    PA.abandon<DominatorTreeAnalysis>();
-    PA.abandon<PostDominatorTreeAnalysis>();
-    PA.abandon<LoopAnalysis>();
-    PMS.FAM.invalidate(F, PA);
+  // the preparation steps leave the CFG analyses behind
+  auto PA = PreservedAnalyses::all();
+  PA.abandon<DominatorTreeAnalysis>();
+  PA.abandon<PostDominatorTreeAnalysis>();
+  PA.abandon<LoopAnalysis>();
+  PMS.FAM.invalidate(F, PA);
 
+  for (auto &LVJob : LoopsToVectorize) {
+    reportVectorized(LVJob);
     Changed |= vectorizeLoop(LVJob);
+
+    // vectorizeLoop repaired the dominator tree, the branch probabilities of
+    // the blocks outside of the loop are unchanged. Everything else is
+    // recomputed on demand.
+    PreservedAnalyses JobPA;
+    JobPA.preserve<DominatorTreeAnalysis>();
+    JobPA.preserve<BranchProbabilityAnalysis>();
+    JobPA.preserve<AssumptionAnalysis>();
+    PMS.FAM.invalidate(F, JobPA);
+
+    // NatBuilder keeps the old loop blocks around while LoopInfo refers to them
+    EraseDeadBlocks(F);
   }
   LoopsToVectorize.clear();
 
   return Changed;
 }
 
+///// Parallel loop vectorization (RV_LOOPVEC_THREADS) /////
+
+// Values of an outlined loop function are identified by their position
+// (arguments first, then instructions) when they cross LLVMContexts.
+static int GetValueIndex(Function &Fn, Value *V) {
+  int Idx = 0;
+  for (auto &Arg : Fn.args()) {
+    if (&Arg == V) return Idx;
+    ++Idx;
+  }
+  for (auto &I : instructions(Fn)) {
+    if (&I == V) return Idx;
+    ++Idx;
+  }
+  return -1;
+}
+
+static Value *GetValueByIndex(Function &Fn, int Idx) {
+  if (Idx < 0) return nullptr;
+  if (Idx < (int)Fn.arg_size()) return Fn.getArg(Idx);
+  Idx -= Fn.arg_size();
+  for (auto &I : instructions(Fn)) {
+    if (Idx-- == 0) return &I;
+  }
+  return nullptr;
+}
+
+// \p V as seen from the outlined function \p Fn called by \p Call
+static int GetOutlinedIndex(Function &Fn, CallInst &Call, Value *V) {
+  auto *I = dyn_cast<Instruction>(V);
+  if (I && I->getFunction() == &Fn)
+    return GetValueIndex(Fn, V);
+  for (unsigned i = 0; i < Call.arg_size(); ++i) {
+    if (Call.getArgOperand(i) == V) return i;
+  }
+  return -1;
+}
+
+static int GetBlockIndex(Function &Fn, BasicBlock *BB) {
+  int Idx = 0;
+  for (auto &Block : Fn) {
+    if (&Block == BB) return Idx;
+    ++Idx;
+  }
+  return -1;
+}
+
+static BasicBlock *GetBlockByIndex(Function &Fn, int Idx) {
+  for (auto &Block : Fn) {
+    if (Idx-- == 0) return &Block;
+  }
+  return nullptr;
+}
+
+namespace {
+// a prepared loop that was outlined into its own function
+struct OutlinedLoopJob {
+  size_t JobIdx;   // index into LoopsToVectorize
+  Function *LoopFn;
+  CallInst *Call;
+  int HeaderIdx;
+  std::vector<int> UniOverrideIdx;
+  int TailMaskIdx;
+  int EntryAVLIdx;
+};
+} // namespace
+
+bool LoopVectorizer::vectorizeLoopRegionsParallel() {
+  Module &M = *F.getParent();
+
+  // outline every prepared loop (remarks go out now, they need the original context)
+  std::vector<OutlinedLoopJob> Outlined;
+  std::vector<size_t> InPlaceJobs;
+  SmallPtrSet<AllocaInst *, 8> EntryAllocas;
+  for (auto &I : F.getEntryBlock())
+    if (auto *Alloca = dyn_cast<AllocaInst>(&I)) EntryAllocas.insert(Alloca);
+
+  for (size_t JobIdx = 0; JobIdx < LoopsToVectorize.size(); ++JobIdx) {
+    auto &LVJob = LoopsToVectorize[JobIdx];
+    PMS.FAM.invalidate(F, PreservedAnalyses::none());
+    reportVectorized(LVJob);
+
+    auto &DT = PMS.FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+    auto &L = *LI.getLoopFor(LVJob.LJ.Header);
+    CodeExtractorAnalysisCache CEAC(F);
+    CodeExtractor CE(DT, L, false, nullptr, nullptr, nullptr,
+                     "rv.loop" + std::to_string(JobIdx));
+    Function *LoopFn = CE.isEligible() ? CE.extractCodeRegion(CEAC) : nullptr;
+    if (!LoopFn) {
+      InPlaceJobs.push_back(JobIdx);
+      continue;
+    }
+
+    assert(LoopFn->hasOneUse());
+    auto *Call = cast<CallInst>(LoopFn->user_back());
+    OutlinedLoopJob OJ{JobIdx, LoopFn, Call, GetBlockIndex(*LoopFn, LVJob.LJ.Header), {}, -1, -1};
+    for (auto *V : LVJob.uniOverrides)
+      OJ.UniOverrideIdx.push_back(GetOutlinedIndex(*LoopFn, *Call, V));
+    if (LVJob.TailMask)
+      OJ.TailMaskIdx = GetOutlinedIndex(*LoopFn, *Call, LVJob.TailMask);
+    if (LVJob.EntryAVL)
+      OJ.EntryAVLIdx = GetOutlinedIndex(*LoopFn, *Call, LVJob.EntryAVL);
+    Outlined.push_back(OJ);
+  }
+
+  // every worker starts from the same snapshot of the module
+  SmallVector<char, 0> SrcBuffer;
+  {
+    raw_svector_ostream SrcOut(SrcBuffer);
+    WriteBitcodeToFile(M, SrcOut);
+  }
+
+  // the workers keep their reports per job, they are emitted in job order
+  std::vector<std::string> JobReports(Outlined.size());
+
+  const size_t NumWorkers = std::min<size_t>(numThreads, Outlined.size());
+  std::vector<SmallVector<char, 0>> ResultBuffers(NumWorkers);
+  ThreadPool Pool(hardware_concurrency(NumWorkers));
+  for (size_t WorkerIdx = 0; WorkerIdx < NumWorkers; ++WorkerIdx) {
+    Pool.async([&, WorkerIdx] {
+      LLVMContext WorkerCtx;
+      // the vector math modules parsed into WorkerCtx stay loaded across its jobs (released before WorkerCtx)
+      auto VecmathHandle = retainSleefModules(WorkerCtx);
+      MemoryBufferRef SrcRef(StringRef(SrcBuffer.data(), SrcBuffer.size()), M.getModuleIdentifier());
+      auto WorkerModOrErr = parseBitcodeFile(SrcRef, WorkerCtx);
+      if (!WorkerModOrErr)
+        report_fatal_error("loopVecPass: failed to materialize worker module");
+      auto &WorkerMod = **WorkerModOrErr;
+      // the analyses of the module's target (not the generic ones), the output must not depend on the thread count
+      auto WorkerTM = CreateTargetMachine(WorkerMod);
+
+      // round-robin job assignment
+      for (size_t i = WorkerIdx; i < Outlined.size(); i += NumWorkers) {
+        auto &OJ = Outlined[i];
+        auto &LoopFn = *WorkerMod.getFunction(OJ.LoopFn->getName());
+        ThreadReportBuffer JobReport(JobReports[i]);
+
+        // same as run(), on the outlined loop
+        PassManagerSession WorkerPMS(WorkerTM.get());
+        auto &TTI = WorkerPMS.FAM.getResult<TargetIRAnalysis>(LoopFn);
+        auto &TLI = WorkerPMS.FAM.getResult<TargetLibraryAnalysis>(LoopFn);
+        OptimizationRemarkEmitter WorkerORE(&LoopFn);
+        LoopVectorizer Worker(LoopFn, TTI, TLI, WorkerORE);
+        Worker.RVConfig = RVConfig;
+        Worker.enableDiagOutput = enableDiagOutput;
+        Worker.introduced = true;
+
+        PlatformInfo WorkerPlatInfo(WorkerMod, &TTI, &TLI);
+        Worker.vectorizer.reset(new VectorizerInterface(WorkerPlatInfo, Worker.RVConfig));
+        Worker.addResolvers(WorkerPlatInfo);
+
+        LoopVectorizerJob WorkerJob = LoopsToVectorize[OJ.JobIdx];
+        WorkerJob.LJ.Header = GetBlockByIndex(LoopFn, OJ.HeaderIdx);
+        // only used for remarks (already emitted)
+        WorkerJob.LJ.AliasChecks.clear();
+        WorkerJob.LJ.StrideChecks.clear();
+        WorkerJob.LJ.AliasGuard = nullptr;
+        WorkerJob.LJ.PeelAccess = nullptr;
+        WorkerJob.uniOverrides.clear();
+        for (int Idx : OJ.UniOverrideIdx) {
+          if (auto *V = GetValueByIndex(LoopFn, Idx))
+            WorkerJob.uniOverrides.insert(V);
+        }
+        WorkerJob.TailMask = GetValueByIndex(LoopFn, OJ.TailMaskIdx);
+        WorkerJob.EntryAVL = GetValueByIndex(LoopFn, OJ.EntryAVLIdx);
+
+        Worker.vectorizeLoop(WorkerJob);
+        Worker.vectorizer.reset();
+      }
+
+      raw_svector_ostream ResOut(ResultBuffers[WorkerIdx]);
+      WriteBitcodeToFile(WorkerMod, ResOut);
+
+      releaseSleefModules(WorkerCtx);
+    });
+  }
+
+  // meanwhile, vectorize the loops that could not be outlined
+  for (size_t JobIdx : InPlaceJobs) {
+    PMS.FAM.invalidate(F, PreservedAnalyses::none());
+    vectorizeLoop(LoopsToVectorize[JobIdx]);
+  }
+  Pool.wait();
+
+  for (auto &JobReport : JobReports)
+    ReportContinue() << JobReport;
+
+  // merge back in job order
+  std::vector<std::unique_ptr<Module>> ResultMods;
+  for (auto &ResBuffer : ResultBuffers) {
+    MemoryBufferRef ResRef(StringRef(ResBuffer.data(), ResBuffer.size()), M.getModuleIdentifier());
+    auto ResModOrErr = parseBitcodeFile(ResRef, M.getContext());
+    if (!ResModOrErr)
+      report_fatal_error("loopVecPass: failed to read back worker module");
+    ResultMods.push_back(std::move(*ResModOrErr));
+  }
+
+  for (size_t i = 0; i < Outlined.size(); ++i) {
+    auto &OJ = Outlined[i];
+    auto *SrcFn = ResultMods[i % NumWorkers]->getFunction(OJ.LoopFn->getName());
+    assert(SrcFn && !SrcFn->isDeclaration() && "worker did not vectorize the loop");
+    OJ.LoopFn->deleteBody();
+    cloneFunctionBodyInto(*SrcFn, *OJ.LoopFn);
+
+    InlineFunctionInfo IFI;
+    auto Res = InlineFunction(*OJ.Call, IFI, nullptr, false);
+    (void)Res;
+    assert(Res.isSuccess() && "could not inline the vectorized loop");
+    OJ.LoopFn->eraseFromParent();
+  }
+
+  // the outlined loops passed their live-outs through stack slots
+  SmallVector<AllocaInst *, 8> Promotable;
+  for (auto &I : F.getEntryBlock()) {
+    auto *Alloca = dyn_cast<AllocaInst>(&I);
+    if (Alloca && !EntryAllocas.count(Alloca) && isAllocaPromotable(Alloca))
+      Promotable.push_back(Alloca);
+  }
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+  if (!Promotable.empty())
+    PromoteMemToReg(Promotable, PMS.FAM.getResult<DominatorTreeAnalysis>(F));
+  PMS.FAM.invalidate(F, PreservedAnalyses::none());
+
+  LoopsToVectorize.clear();
+  return true;
+}
+
 LoopVectorizer::LoopVectorizer(Function &F, TargetTransformInfo &PassTTI,
                                TargetLibraryInfo &PassTLI,
                                OptimizationRemarkEmitter &PassORE)
@@ -771,6 +2482,35 @@ LoopVectorizer::LoopVectorizer(Function &F, TargetTransformInfo &PassTTI,
   // have we introduced ourself? (reporting output)
   enableDiagOutput = CheckFlag("LV_DIAG");
   introduced = false;
+
+  // opt-in: vectorize the loops of a function concurrently (0 == one worker per hardware thread)
+  numThreads = 1;
+  if (const char *threadsText = getenv("RV_LOOPVEC_THREADS")) {
+    numThreads = atoi(threadsText);
+    if (numThreads == 0)
+      numThreads = hardware_concurrency().compute_thread_count();
+  }
+}
+
+void LoopVectorizer::addResolvers(PlatformInfo &platInfo) {
+  // TODO translate fast-math flag to ULP error bound
+  addVectorLibraryResolver(RVConfig, platInfo);
+  if (!CheckFlag("RV_NO_SLEEF")) {
+    addSleefResolver(RVConfig, platInfo);
+  }
+  addBatchResolver(RVConfig, platInfo);
+
+  // enable inter-procedural vectorization
+  if (RVConfig.enableGreedyIPV) {
+    if (!introduced)
+      Report() << "Using greedy inter-procedural vectorization.\n";
+    addRecursiveResolver(RVConfig, platInfo);
+  }
+
+  // callee result shapes without vectorizing the callees
+  if (RVConfig.enableShapeSummaries) {
+    platInfo.computeShapeSummaries();
+  }
 }
 
 bool LoopVectorizer::run() {
@@ -793,17 +2533,7 @@ bool LoopVectorizer::run() {
   // setup PlatformInfo
   PlatformInfo platInfo(*F.getParent(), &PassTTI, &PassTLI);
   vectorizer.reset(new VectorizerInterface(platInfo, RVConfig));
-
-  // TODO translate fast-math flag to ULP error bound
-  if (!CheckFlag("RV_NO_SLEEF")) {
-    addSleefResolver(RVConfig, platInfo);
-  }
-
-  // enable inter-procedural vectorization
-  if (RVConfig.enableGreedyIPV) {
-    Report() << "Using greedy inter-procedural vectorization.\n";
-    addRecursiveResolver(RVConfig, platInfo);
-  }
+  addResolvers(platInfo);
 
   if (enableDiagOutput) {
     platInfo.print(ReportContinue());
@@ -811,11 +2541,18 @@ bool LoopVectorizer::run() {
 
   bool Changed = false;
 
+  // Step 0: search loops have data-dependent exits, they are scanned ahead instead of vectorized
+  if (RVConfig.enableSearchLoops)
+    Changed |= vectorizeSearchLoops();
+
   // Step 1: cost, legal, collect loopb jobs
   auto &LI = PMS.FAM.getResult<LoopAnalysis>(F);
+  // narrow integer idioms stay narrow before the widths are picked (the CFG is unchanged)
+  if (RVConfig.enableNarrowIdioms)
+    Changed |= FoldNarrowIdioms(F, &LI) > 0;
   bool FoundAnyLoops = collectLoopJobs(LI);
   if (!FoundAnyLoops)
-    return false;
+    return Changed;
 
   // Step 2: Refactor loop for vectorization
   bool PrepOK =
@@ -828,6 +2565,10 @@ bool LoopVectorizer::run() {
   // Step :3 Vectorize the prepare loops
   Changed |= vectorizeLoopRegions();
 
+  // Step 4: hand the thread chunks to the task runtime
+  if (!ChunkLoops.empty())
+    Changed |= outlineParallelChunks();
+
   if (CheckFlag("RV_PRINT_FUNCTION")) {
     errs() << " -- module after RV --\n";
     Dump(*F.getParent());
@@ -835,6 +2576,11 @@ bool LoopVectorizer::run() {
 
   // cleanup
   vectorizer.reset();
+
+  // RV_STREAMING: the vector math modules are parsed again (lazily) for the
+  // next function that needs them
+  if (Changed && CheckFlag("RV_STREAMING"))
+    releaseSleefModules(F.getContext());
   return Changed;
 }
 
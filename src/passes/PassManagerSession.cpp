@@ -1,16 +1,30 @@
 #include "rv/passes/PassManagerSession.h"
 
+#include "llvm/IR/Module.h"
+#include "llvm/MC/TargetRegistry.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
 
 using namespace rv;
 using namespace llvm;
 
-PassManagerSession::PassManagerSession() {
+PassManagerSession::PassManagerSession(TargetMachine *TM) {
   // setup LLVM analysis infrastructure
-  PassBuilder PB;
+  PassBuilder PB(TM);
   PB.registerModuleAnalyses(MAM);
   PB.registerFunctionAnalyses(FAM);
   PB.registerLoopAnalyses(LAM);
   PB.registerCGSCCAnalyses(CGAM);
   PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
 }
+
+std::unique_ptr<TargetMachine>
+rv::CreateTargetMachine(const Module &M) {
+  std::string Error;
+  const Target *TheTarget = TargetRegistry::lookupTarget(M.getTargetTriple(), Error);
+  if (!TheTarget)
+    return nullptr;
+  return std::unique_ptr<TargetMachine>(
+      TheTarget->createTargetMachine(M.getTargetTriple(), "", "", TargetOptions(), std::nullopt));
+}
@@ -9,6 +9,7 @@
 
 #include "rv/passes/WFVPass.h"
 #include "rv/legacy/LinkAllPasses.h"
+#include "rv/passes/cleanupPass.h"
 
 #include "rv/rv.h"
 #include "rv/vectorMapping.h"
@@ -19,12 +20,20 @@
 #include "rv/analysis/costModel.h"
 #include "rv/transform/remTransform.h"
 #include "rv/utils.h"
+#include "rv/vectorCache.h"
+#include "rv/tuningFile.h"
+#include "rv/transform/crtLowering.h"
+#include "rv/transform/dispatchWrapper.h"
+#include "rv/transform/narrowIdioms.h"
+#include "rv/transform/recursionToLoop.h"
 #include "rv/transform/singleReturnTrans.h"
 
 #include "rvConfig.h"
 #include "rv/rvDebug.h"
 #include "rv/region/FunctionRegion.h"
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/Instructions.h"
@@ -39,12 +48,25 @@
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
 #include "llvm/Analysis/MemoryDependenceAnalysis.h"
 #include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/CallGraph.h"
 
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/Sequence.h"
-
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "utils/phaseTimer.h"
+#include "utils/rvLinking.h"
 #include "report.h"
+#include <algorithm>
 #include <map>
+#include <numeric>
 #include <sstream>
 #include <cassert>
 
@@ -54,17 +76,59 @@ using namespace llvm;
 
 ///// Pass Implementation /////
 
-WFV::WFV() : PMS() {}
+WFV::WFV(bool _exportVariants) : TM(), PMS(std::make_unique<PassManagerSession>()), enableDiagOutput(false), exportVariants(_exportVariants), numThreads(1), streaming(false), shareShapes(true), inPlaceLastJob(true) {}
+
+// Emit a structured decision record (RV_REPORT_JSON)
+static void
+reportJobDecision(const VectorMapping & wfvJob, ReportReason reason, double codeGrowth = 0.0) {
+  if (!HasDecisionReport()) return;
+
+  DecisionRecord rec("wfv", wfvJob.scalarFn->getName().str(), wfvJob.vectorFn->getName().str());
+  if (auto * SP = wfvJob.scalarFn->getSubprogram()) {
+    rec.location = (SP->getFilename() + ":" + Twine(SP->getLine())).str();
+  }
+  rec.vectorized = true;
+  rec.reason = reason;
+  rec.width = wfvJob.vectorWidth;
+  if (codeGrowth > 0.0) rec.metrics.emplace_back("codeGrowth", codeGrowth);
+  ReportDecision(rec);
+}
+
+// jobs with the same key start from the same scalar code and argument shapes, they only differ in width (and name)
+static std::string
+GetSharedShapesKey(const VectorMapping & wfvJob) {
+  std::string key = wfvJob.scalarFn->getName().str() + "|" + std::to_string(wfvJob.maskPos) + "|" + wfvJob.resultShape.str();
+  for (const auto & argShape : wfvJob.argShapes) key += "|" + argShape.str();
+  return key;
+}
 
 void
-WFV::vectorizeFunction(VectorizerInterface & vectorizer, VectorMapping & wfvJob) {
-  // clone scalar function
+WFV::vectorizeFunction(VectorizerInterface & vectorizer, VectorMapping & wfvJob, bool shareAnalysis, bool inPlace) {
+  // skip the pipeline if this exact job has been vectorized before
+  std::string cacheKey;
+  if (cache.isEnabled()) {
+    cacheKey = cache.computeKey(wfvJob, vectorizer.getConfig());
+    if (cache.load(cacheKey, *wfvJob.vectorFn)) {
+      MarkForCleanup(*wfvJob.vectorFn);
+      reportJobDecision(wfvJob, ReportReason::CacheHit);
+      return;
+    }
+  }
+
+  // per job peak RSS (RV_TIME_PHASES)
+  PhaseTimer jobTimer("wfv-job", *wfvJob.scalarFn);
+
+  // clone scalar function (unless this job may consume it)
   ValueToValueMapTy cloneMap;
-  Function* scalarCopy = CloneFunction(wfvJob.scalarFn, cloneMap, nullptr);
+  Function* scalarFn = wfvJob.scalarFn;
+  Function* scalarCopy = inPlace ? scalarFn : CloneFunction(scalarFn, cloneMap, nullptr);
   wfvJob.scalarFn = scalarCopy;
 
   if (wfvJob.maskPos >= 0) {
     MaterializeEntryMask(*scalarCopy, vectorizer.getPlatformInfo());
+  } else if (vectorizer.getConfig().enableRecursionToLoop) {
+    // recursive calls in the copy still call scalarFn
+    RecursionToLoop(*scalarCopy, *scalarFn).run();
   }
 
   // regino setup
@@ -74,6 +138,11 @@ WFV::vectorizeFunction(VectorizerInterface & vectorizer, VectorMapping & wfvJob)
   // unify returns as necessary
   SingleReturnTrans::run(funcRegionWrapper);
 
+  // complex arithmetic on the real and imaginary parts instead of compiler-rt calls
+  if (vectorizer.getConfig().enableComplexLowering) LowerComplexArithmetic(*scalarCopy);
+  // saturating/averaging u8/i16 idioms in the narrow type
+  if (vectorizer.getConfig().enableNarrowIdioms) FoldNarrowIdioms(*scalarCopy, nullptr);
+
 // early math func lowering
   // vectorizer.lowerRuntimeCalls(vecInfo, LI);
   // DT->recalculate(*F);
@@ -84,8 +153,24 @@ WFV::vectorizeFunction(VectorizerInterface & vectorizer, VectorMapping & wfvJob)
   VectorizationInfo vecInfo(funcRegionWrapper, wfvJob);
 
 // Vectorize
-  // vectorizationAnalysis
-  vectorizer.analyze(vecInfo, PMS.FAM); // TODO can be shared across jobs
+  // vectorizationAnalysis (the result of another width applies unless a shape depended on the width)
+  std::string shapesKey = shareAnalysis ? GetSharedShapesKey(wfvJob) : std::string();
+  auto itShared = shareAnalysis ? sharedShapes.find(shapesKey) : sharedShapes.end();
+  bool reusedShapes = false;
+  if (itShared != sharedShapes.end()) {
+    // the analyses that VA would have computed
+    auto & LI = PMS->FAM.getResult<LoopAnalysis>(*scalarCopy);
+    PMS->FAM.getResult<DominatorTreeAnalysis>(*scalarCopy);
+    PMS->FAM.getResult<PostDominatorTreeAnalysis>(*scalarCopy);
+    reusedShapes = vecInfo.applySnapshot(itShared->second, LI);
+  }
+  if (reusedShapes) {
+    Report() << "wfv: " << wfvJob.vectorFn->getName() << " re-uses the VA result of another width\n";
+  } else {
+    vectorizer.analyze(vecInfo, PMS->FAM);
+    if (shareAnalysis && !vecInfo.isWidthDependent())
+      sharedShapes[shapesKey] = vecInfo.takeSnapshot();
+  }
 
   if (enableDiagOutput) {
     errs() << "-- VA result --\n";
@@ -96,28 +181,45 @@ WFV::vectorizeFunction(VectorizerInterface & vectorizer, VectorMapping & wfvJob)
   IF_DEBUG Dump(*scalarCopy);
 
   // control conversion
-  vectorizer.linearize(vecInfo, PMS.FAM);
+  vectorizer.linearize(vecInfo, PMS->FAM);
 
   // vectorize the prepared loop embedding it in its context
   ValueToValueMapTy vecMap;
 
   // FIXME SE is invalid at this point..
   ScalarEvolutionAnalysis adhocAnalysis;
-  adhocAnalysis.run(*scalarCopy, PMS.FAM);
+  adhocAnalysis.run(*scalarCopy, PMS->FAM);
 
   MemoryDependenceAnalysis mdAnalysis;
-  mdAnalysis.run(*scalarCopy, PMS.FAM);
+  mdAnalysis.run(*scalarCopy, PMS->FAM);
 
   // FIXME share state until this point (modified src function)
-  bool vectorizeOk = vectorizer.vectorize(vecInfo, PMS.FAM, &vecMap);
+  bool vectorizeOk = vectorizer.vectorize(vecInfo, PMS->FAM, &vecMap);
   if (!vectorizeOk)
     llvm_unreachable("vector code generation failed");
 
-  scalarCopy->eraseFromParent();
+  // cached results would otherwise outlive the copy (the caller erases a consumed scalar function)
+  PMS->FAM.clear(*scalarCopy, scalarCopy->getName());
+  if (!inPlace) {
+    scalarCopy->eraseFromParent();
+    wfvJob.scalarFn = scalarFn;
+  }
+
+  // nothing will query the vector function again
+  if (streaming)
+    PMS->FAM.clear(*wfvJob.vectorFn, wfvJob.vectorFn->getName());
+
+  if (!cacheKey.empty())
+    cache.store(cacheKey, *wfvJob.vectorFn, inheritedDefs);
+
+  reportJobDecision(wfvJob, ReportReason::Vectorized, vectorizer.getCodeGrowth());
 }
 
 void
 WFV::collectJobs(Function & F) {
+  // imported by ThinLTO, the exporting module provides the vector variants
+  if (F.hasAvailableExternallyLinkage()) return;
+
   auto attribSet = F.getAttributes().getFnAttrs();
 
   // parse SIMD signatures
@@ -127,13 +229,479 @@ WFV::collectJobs(Function & F) {
 
     VectorMapping vecMapping;
     if (!parseVectorMapping(F, attribText, vecMapping, true)) continue;
+    // already vectorized (eg in the ThinLTO pre-link pipeline) or user-provided
+    if (!vecMapping.vectorFn->isDeclaration()) continue;
 
     wfvJobs.push_back(vecMapping);
   }
+
+  // inbranch functions also get an unmasked variant for all-active call sites
+  if (CheckFlag("RV_NO_UNMASKED_VARIANT")) return;
+  size_t numDeclared = wfvJobs.size();
+  for (size_t i = 0; i < numDeclared; ++i) {
+    const VectorMapping & maskedJob = wfvJobs[i];
+    if (maskedJob.scalarFn != &F || maskedJob.maskPos < 0) continue;
+
+    StringRef maskedName = maskedJob.vectorFn->getName();
+    size_t maskIdx = maskedName.startswith("_ZGV_LLVM_") ? 10 : 5;
+    std::string unmaskedName = maskedName.str();
+    unmaskedName[maskIdx] = 'N';
+    if (F.hasFnAttribute(unmaskedName)) continue; // declared (and collected) already
+
+    StringRef unmaskedText = unmaskedName;
+    VectorMapping unmaskedMapping;
+    if (!parseVectorMapping(F, unmaskedText, unmaskedMapping, true)) continue;
+    if (!unmaskedMapping.vectorFn->isDeclaration()) continue;
+
+    F.addFnAttr(unmaskedName);
+    wfvJobs.push_back(unmaskedMapping);
+  }
+}
+
+// nothing calls or references \p F, it is dead once its last job is vectorized
+static bool
+IsScalarBodyDead(const Function &F) {
+  return F.hasLocalLinkage() && F.use_empty();
+}
+
+// the RV_TUNING entry of \p job, nullptr if its config is not tuned
+static const TuningEntry *
+GetTuning(const VectorMapping &job) {
+  const TuningFile *tunings = TuningFile::get();
+  if (!tunings) return nullptr;
+  const TuningEntry *tuning = tunings->lookup(job.scalarFn->getName(), "wfv");
+  if (!tuning || tuning->flags.empty()) return nullptr;
+  return tuning;
+}
+
+void
+WFV::initTarget(Module &M) {
+  PMS.reset();
+  TM = CreateTargetMachine(M);
+  PMS = std::make_unique<PassManagerSession>(TM.get());
+}
+
+void
+WFV::vectorizeJobs(Module &M, ArrayRef<size_t> jobIds, std::vector<std::string> *jobReports) {
+  auto &protoFunc = *wfvJobs[0].scalarFn;
+
+  Config rvConfig = Config::createForFunction(protoFunc);
+
+  auto &TTI = PMS->FAM.getResult<TargetIRAnalysis>(protoFunc);
+  auto &TLI = PMS->FAM.getResult<TargetLibraryAnalysis>(protoFunc);
+
+  // configure platInfo
+  PlatformInfo platInfo(M, &TTI, &TLI);
+  addVectorLibraryResolver(rvConfig, platInfo);
+  if (!CheckFlag("RV_NO_SLEEF"))
+    addSleefResolver(rvConfig, platInfo);
+  addBatchResolver(rvConfig, platInfo);
+
+  // add mappings for recursive vectorization
+  for (auto &job : wfvJobs) {
+    platInfo.addMapping(job);
+  }
+
+  // cached entries only carry definitions that vectorization added
+  if (cache.isEnabled()) {
+    for (auto &GO : M.global_objects())
+      if (!GO.isDeclaration()) inheritedDefs.insert(GO.getName());
+  }
+
+  // the last job of each function (multi-versioning vectorizes all of them again)
+  DenseMap<const Function *, size_t> lastJobs;
+  if (inPlaceLastJob && multiVersionArchs.empty()) {
+    for (size_t jobIdx : jobIds)
+      lastJobs[wfvJobs[jobIdx].scalarFn] = jobIdx;
+  }
+
+  // vectorize jobs
+  VectorizerInterface vectorizer(platInfo, rvConfig);
+  sharedShapes.clear();
+  size_t numInPlace = 0;
+  for (size_t jobIdx : jobIds) {
+    std::unique_ptr<ThreadReportBuffer> jobReport;
+    if (jobReports)
+      jobReport = std::make_unique<ThreadReportBuffer>((*jobReports)[jobIdx]);
+
+    Function *scalarFn = wfvJobs[jobIdx].scalarFn;
+    auto itLast = lastJobs.find(scalarFn);
+    bool inPlace = itLast != lastJobs.end() && itLast->second == jobIdx && IsScalarBodyDead(*scalarFn);
+
+    if (const TuningEntry *tuning = GetTuning(wfvJobs[jobIdx])) {
+      Config tunedConfig = rvConfig;
+      tuning->apply(tunedConfig);
+      VectorizerInterface tunedVectorizer(platInfo, tunedConfig);
+      vectorizeFunction(tunedVectorizer, wfvJobs[jobIdx], false, inPlace);
+    } else {
+      vectorizeFunction(vectorizer, wfvJobs[jobIdx], shareShapes, inPlace);
+    }
+    if (!inPlace)
+      continue;
+
+    // the job consumed the scalar function (mappings are looked up by function)
+    for (auto &job : wfvJobs) {
+      if (job.scalarFn != scalarFn)
+        continue;
+      platInfo.forgetMapping(job);
+      job.scalarFn = nullptr;
+    }
+    scalarFn->eraseFromParent();
+    ++numInPlace;
+  }
+  sharedShapes.clear();
+  if (numInPlace > 0)
+    Report() << "wfv: vectorized the last job of " << numInPlace << " unreferenced functions in place.\n";
+}
+
+void
+WFV::sortJobsBottomUp(Module &M, std::vector<size_t> &jobIds) const {
+  // post order of the SCCs: callees before their callers
+  CallGraph CG(M);
+  DenseMap<const Function *, size_t> sccIndex;
+  size_t numSCCs = 0;
+  for (auto it = scc_begin(&CG); !it.isAtEnd(); ++it, ++numSCCs) {
+    for (auto *node : *it)
+      if (auto *F = node->getFunction()) sccIndex[F] = numSCCs;
+  }
+
+  std::stable_sort(jobIds.begin(), jobIds.end(), [&](size_t a, size_t b) {
+    return sccIndex.lookup(wfvJobs[a].scalarFn) < sccIndex.lookup(wfvJobs[b].scalarFn);
+  });
+}
+
+// Turn all definitions that \p M inherited from the source module back into
+// declarations. What remains are the vector functions and whatever the
+// resolvers linked in.
+static void
+StripInheritedDefinitions(Module &M, const StringSet<> &srcDefs) {
+  for (auto &F : M) {
+    if (!F.isDeclaration() && srcDefs.count(F.getName()))
+      F.deleteBody();
+  }
+  for (auto &GV : M.globals()) {
+    if (!GV.hasInitializer() || !srcDefs.count(GV.getName()))
+      continue;
+    GV.setInitializer(nullptr);
+    GV.setLinkage(GlobalValue::ExternalLinkage);
+    GV.setComdat(nullptr);
+  }
+}
+
+void
+WFV::runParallel(Module &M) {
+  const size_t numWorkers = std::min<size_t>(numThreads, wfvJobs.size());
+
+  // every worker starts from the same snapshot of the module
+  SmallVector<char, 0> srcBuffer;
+  {
+    raw_svector_ostream srcOut(srcBuffer);
+    WriteBitcodeToFile(M, srcOut);
+  }
+
+  StringSet<> srcDefs;
+  for (auto &GO : M.global_objects())
+    if (!GO.isDeclaration()) srcDefs.insert(GO.getName());
+
+  // the workers keep their reports per job (and the rest per worker), they are emitted in job order
+  std::vector<std::string> jobReports(wfvJobs.size());
+  std::vector<std::string> workerReports(numWorkers);
+
+  std::vector<SmallVector<char, 0>> resultBuffers(numWorkers);
+  ThreadPool pool(hardware_concurrency(numWorkers));
+  for (size_t workerIdx = 0; workerIdx < numWorkers; ++workerIdx) {
+    pool.async([&, workerIdx] {
+      LLVMContext workerCtx;
+      // the vector math modules parsed into workerCtx stay loaded across its jobs (released before workerCtx)
+      auto vecmathHandle = retainSleefModules(workerCtx);
+      MemoryBufferRef srcRef(StringRef(srcBuffer.data(), srcBuffer.size()), M.getModuleIdentifier());
+      auto workerModOrErr = parseBitcodeFile(srcRef, workerCtx);
+      if (!workerModOrErr)
+        report_fatal_error("wfv: failed to materialize worker module");
+      auto &workerMod = **workerModOrErr;
+
+      ThreadReportBuffer workerReport(workerReports[workerIdx]);
+
+      // the job list is recovered in the same order as in M
+      WFV worker;
+      worker.initTarget(workerMod);
+      worker.enableDiagOutput = enableDiagOutput;
+      worker.shareShapes = shareShapes;
+      worker.inPlaceLastJob = inPlaceLastJob;
+      for (auto &func : workerMod) {
+        if (!func.isDeclaration())
+          worker.collectJobs(func);
+      }
+      assert(worker.wfvJobs.size() == wfvJobs.size());
+
+      // round-robin job assignment
+      std::vector<size_t> jobIds;
+      for (size_t jobIdx = workerIdx; jobIdx < wfvJobs.size(); jobIdx += numWorkers)
+        jobIds.push_back(jobIdx);
+      worker.vectorizeJobs(workerMod, jobIds, &jobReports);
+
+      StripInheritedDefinitions(workerMod, srcDefs);
+      raw_svector_ostream resOut(resultBuffers[workerIdx]);
+      WriteBitcodeToFile(workerMod, resOut);
+
+      releaseSleefModules(workerCtx);
+    });
+  }
+  pool.wait();
+
+  for (auto &jobReport : jobReports)
+    ReportContinue() << jobReport;
+  for (auto &workerReport : workerReports)
+    ReportContinue() << workerReport;
+
+  // merge back in job order
+  std::vector<std::unique_ptr<Module>> resultMods;
+  for (auto &resBuffer : resultBuffers) {
+    MemoryBufferRef resRef(StringRef(resBuffer.data(), resBuffer.size()), M.getModuleIdentifier());
+    auto resModOrErr = parseBitcodeFile(resRef, M.getContext());
+    if (!resModOrErr)
+      report_fatal_error("wfv: failed to read back worker module");
+    resultMods.push_back(std::move(*resModOrErr));
+  }
+
+  for (size_t jobIdx = 0; jobIdx < wfvJobs.size(); ++jobIdx) {
+    auto &destFn = *wfvJobs[jobIdx].vectorFn;
+    auto *srcFn = resultMods[jobIdx % numWorkers]->getFunction(destFn.getName());
+    assert(srcFn && !srcFn->isDeclaration() && "worker did not produce the vector function");
+    cloneFunctionBodyInto(*srcFn, destFn);
+  }
+}
+
+///// Function multi-versioning /////
+
+// bit positions in __cpu_model.__cpu_features[0] (enum ProcessorFeatures of
+// compiler-rt/libgcc cpu_model.c)
+enum X86CPUFeature : unsigned {
+  CPU_FEATURE_AVX2 = 10,
+  CPU_FEATURE_FMA = 14,
+  CPU_FEATURE_AVX512F = 15,
+  CPU_FEATURE_AVX512VL = 20,
+  CPU_FEATURE_AVX512BW = 21,
+  CPU_FEATURE_AVX512DQ = 22,
+  CPU_FEATURE_AVX512CD = 23,
+};
+
+static constexpr uint32_t
+CPUFeatureMask(std::initializer_list<X86CPUFeature> features) {
+  uint32_t mask = 0;
+  for (auto feature : features) mask |= 1u << feature;
+  return mask;
+}
+
+struct ISAVersion {
+  const char *arch;           // RV_ARCH name and clone suffix
+  const char *targetFeatures; // added to the target-features of the clone
+  uint32_t cpuFeatureMask;    // CPU features the clone requires
+};
+
+// most capable ISA first
+static const ISAVersion ISAVersions[] = {
+  {"avx512", "+avx,+avx2,+fma,+avx512f,+avx512cd,+avx512bw,+avx512dq,+avx512vl",
+   CPUFeatureMask({CPU_FEATURE_AVX2, CPU_FEATURE_FMA, CPU_FEATURE_AVX512F, CPU_FEATURE_AVX512VL,
+                   CPU_FEATURE_AVX512BW, CPU_FEATURE_AVX512DQ, CPU_FEATURE_AVX512CD})},
+  {"avx2", "+avx,+avx2,+fma",
+   CPUFeatureMask({CPU_FEATURE_AVX2, CPU_FEATURE_FMA})},
+};
+
+using ISAClone = std::pair<const ISAVersion*, Function*>;
+
+static void
+AddTargetFeatures(Function & F, StringRef features) {
+  std::string allFeatures = F.getFnAttribute("target-features").getValueAsString().str();
+  if (!allFeatures.empty()) allFeatures += ",";
+  allFeatures += features.str();
+  F.addFnAttr("target-features", allFeatures);
+}
+
+// turn \p defaultFn into an ifunc that dispatches to the best entry of \p clones
+static void
+EmitDispatcher(Module & M, Function & defaultFn, ArrayRef<ISAClone> clones) {
+  auto & ctx = M.getContext();
+  std::string fnName = defaultFn.getName().str();
+  defaultFn.setName(fnName + ".default");
+
+  auto * resolverTy = FunctionType::get(defaultFn.getType(), false);
+  auto * resolver = Function::Create(resolverTy, GlobalValue::InternalLinkage, fnName + ".resolver", &M);
+  auto * ifunc = GlobalIFunc::create(defaultFn.getFunctionType(), defaultFn.getAddressSpace(),
+                                     defaultFn.getLinkage(), fnName, resolver, &M);
+  ifunc->setVisibility(defaultFn.getVisibility());
+  defaultFn.replaceAllUsesWith(ifunc);
+  defaultFn.setLinkage(GlobalValue::InternalLinkage);
+
+  // same CPU model query as clang's target_clones resolvers
+  IRBuilder<> builder(BasicBlock::Create(ctx, "entry", resolver));
+  auto * int32Ty = builder.getInt32Ty();
+  builder.CreateCall(M.getOrInsertFunction("__cpu_indicator_init", builder.getVoidTy()));
+  auto * cpuModelTy = StructType::get(int32Ty, int32Ty, int32Ty, ArrayType::get(int32Ty, 1));
+  auto * cpuModel = M.getOrInsertGlobal("__cpu_model", cpuModelTy);
+  auto * featuresPtr = builder.CreateInBoundsGEP(cpuModelTy, cpuModel, {builder.getInt32(0), builder.getInt32(3), builder.getInt32(0)});
+  auto * cpuFeatures = builder.CreateLoad(int32Ty, featuresPtr, "cpu.features");
+
+  // the most capable supported clone wins
+  Value * chosen = &defaultFn;
+  for (auto it = clones.rbegin(); it != clones.rend(); ++it) {
+    auto * mask = builder.getInt32(it->first->cpuFeatureMask);
+    auto * supported = builder.CreateICmpEQ(builder.CreateAnd(cpuFeatures, mask), mask, Twine("has.") + it->first->arch);
+    chosen = builder.CreateSelect(supported, it->second, chosen);
+  }
+  builder.CreateRet(chosen);
+}
+
+void
+WFV::emitMultiVersions(Module &M) {
+  Triple triple(M.getTargetTriple());
+  if (!triple.isX86() || !triple.isOSBinFormatELF()) {
+    Report() << "wfv: RV_MULTIVERSION requires an x86 ELF target, skipping.\n";
+    return;
+  }
+
+  std::vector<const ISAVersion*> versions;
+  for (const auto & isa : ISAVersions) {
+    if (std::find(multiVersionArchs.begin(), multiVersionArchs.end(), isa.arch) != multiVersionArchs.end())
+      versions.push_back(&isa);
+  }
+  for (const auto & arch : multiVersionArchs) {
+    if (std::none_of(versions.begin(), versions.end(), [&](const ISAVersion * isa) { return arch == isa->arch; }))
+      Report() << "wfv: unknown RV_MULTIVERSION arch " << arch << ", ignoring.\n";
+  }
+  if (versions.empty()) return;
+
+  // one clone declaration per job and ISA
+  std::vector<std::vector<ISAClone>> jobClones(wfvJobs.size());
+  for (size_t jobIdx = 0; jobIdx < wfvJobs.size(); ++jobIdx) {
+    auto & defaultFn = *wfvJobs[jobIdx].vectorFn;
+    for (const auto * isa : versions) {
+      auto * cloneFn = Function::Create(defaultFn.getFunctionType(), GlobalValue::InternalLinkage,
+                                        defaultFn.getName() + "." + isa->arch, &M);
+      cloneFn->copyAttributesFrom(&defaultFn);
+      cloneFn->setLinkage(GlobalValue::InternalLinkage);
+      AddTargetFeatures(*cloneFn, isa->targetFeatures);
+      jobClones[jobIdx].emplace_back(isa, cloneFn);
+    }
+  }
+
+  // vectorize the clones, ISA by ISA
+  for (size_t isaIdx = 0; isaIdx < versions.size(); ++isaIdx) {
+    const auto * isa = versions[isaIdx];
+    auto & protoFunc = *wfvJobs[0].scalarFn;
+    Config rvConfig = Config::createForArch(protoFunc, isa->arch);
+
+    // TTI of a function with the clone's target features
+    auto &TTI = PMS->FAM.getResult<TargetIRAnalysis>(*jobClones[0][isaIdx].second);
+    auto &TLI = PMS->FAM.getResult<TargetLibraryAnalysis>(protoFunc);
+
+    // the SLEEF resolver links the implementations for this ISA
+    PlatformInfo platInfo(M, &TTI, &TLI);
+    addVectorLibraryResolver(rvConfig, platInfo);
+    if (!CheckFlag("RV_NO_SLEEF"))
+      addSleefResolver(rvConfig, platInfo);
+    addBatchResolver(rvConfig, platInfo);
+
+    // recursive calls go through the dispatcher
+    for (auto &job : wfvJobs) {
+      platInfo.addMapping(job);
+    }
+
+    VectorizerInterface vectorizer(platInfo, rvConfig);
+    sharedShapes.clear();
+    for (size_t jobIdx = 0; jobIdx < wfvJobs.size(); ++jobIdx) {
+      VectorMapping isaJob = wfvJobs[jobIdx];
+      isaJob.vectorFn = jobClones[jobIdx][isaIdx].second;
+      if (const TuningEntry *tuning = GetTuning(isaJob)) {
+        Config tunedConfig = rvConfig;
+        tuning->apply(tunedConfig);
+        VectorizerInterface tunedVectorizer(platInfo, tunedConfig);
+        vectorizeFunction(tunedVectorizer, isaJob, false, false);
+        continue;
+      }
+      vectorizeFunction(vectorizer, isaJob, shareShapes, false);
+    }
+    sharedShapes.clear();
+  }
+
+  for (size_t jobIdx = 0; jobIdx < wfvJobs.size(); ++jobIdx) {
+    EmitDispatcher(M, *wfvJobs[jobIdx].vectorFn, jobClones[jobIdx]);
+  }
+  Report() << "wfv: emitted " << versions.size() << " ISA clones for " << wfvJobs.size() << " vector functions.\n";
+}
+
+void
+WFV::emitDispatchWrappers() {
+  bool parallel = dispatchMode == "parallel";
+  MapVector<Function *, std::vector<const VectorMapping *>> jobsOfFunction;
+  for (auto &job : wfvJobs)
+    jobsOfFunction[job.scalarFn].push_back(&job);
+
+  size_t numWrappers = 0;
+  for (auto &it : jobsOfFunction) {
+    // the widest width with an unmasked and a masked variant, else the widest
+    const VectorMapping *bestUnmasked = nullptr, *bestMasked = nullptr;
+    for (const auto *job : it.second) {
+      const VectorMapping *unmasked = job->maskPos < 0 ? job : nullptr;
+      const VectorMapping *masked = job->maskPos < 0 ? nullptr : job;
+      for (const auto *other : it.second) {
+        if (other->vectorWidth != job->vectorWidth || other->argShapes != job->argShapes || other->resultShape != job->resultShape)
+          continue;
+        if (other->maskPos < 0)
+          unmasked = other;
+        else
+          masked = other;
+      }
+      auto isBetter = [&]() {
+        if (!bestUnmasked && !bestMasked)
+          return true;
+        unsigned bestWidth = (bestUnmasked ? bestUnmasked : bestMasked)->vectorWidth;
+        bool bestComplete = bestUnmasked && bestMasked;
+        if ((unmasked && masked) != bestComplete)
+          return unmasked && masked;
+        return job->vectorWidth > bestWidth;
+      };
+      if (isBetter()) {
+        bestUnmasked = unmasked;
+        bestMasked = masked;
+      }
+    }
+
+    Config config = Config::createForFunction(*it.first);
+    Function *wrapperFn = CreateDispatchWrapper(bestUnmasked, bestMasked, parallel, config.parallelRuntime);
+    if (!wrapperFn) {
+      Report() << "wfv: no dispatch wrapper for " << it.first->getName() << " (unsupported signature or name taken).\n";
+      continue;
+    }
+    ++numWrappers;
+  }
+  Report() << "wfv: emitted " << numWrappers << (parallel ? " parallel" : "") << " dispatch wrappers.\n";
 }
 
 bool WFV::run(Module &M) {
   enableDiagOutput = CheckFlag("WFV_DIAG");
+  streaming = CheckFlag("RV_STREAMING");
+  shareShapes = !CheckFlag("RV_NO_SHARED_VA");
+  inPlaceLastJob = !CheckFlag("RV_NO_INPLACE_WFV");
+  if (const char *dispatchText = getenv("RV_WFV_DISPATCH"))
+    dispatchMode = dispatchText;
+
+  // opt-in: vectorize jobs concurrently (0 == one worker per hardware thread)
+  if (const char *threadsText = getenv("RV_WFV_THREADS")) {
+    numThreads = atoi(threadsText);
+    if (numThreads == 0)
+      numThreads = hardware_concurrency().compute_thread_count();
+  }
+
+  // opt-in: additional clones for these ISAs (eg RV_MULTIVERSION=avx2,avx512)
+  if (const char *archsText = getenv("RV_MULTIVERSION")) {
+    SmallVector<StringRef, 4> archs;
+    StringRef(archsText).split(archs, ',', -1, false);
+    for (auto arch : archs)
+      multiVersionArchs.push_back(arch.trim().str());
+  }
+
+  initTarget(M);
 
   // collect WFV jobs
   for (auto &func : M) {
@@ -147,28 +715,54 @@ bool WFV::run(Module &M) {
   if (wfvJobs.empty())
     return false;
 
-  auto &protoFunc = *wfvJobs[0].scalarFn;
-
-  Config rvConfig = Config::createForFunction(protoFunc);
+  // the scalar tails of the wrappers keep the scalar functions alive
+  if (!dispatchMode.empty())
+    emitDispatchWrappers();
+
+  if (numThreads > 1 && wfvJobs.size() > 1) {
+    Report() << "wfv: vectorizing " << wfvJobs.size() << " jobs with " << std::min<size_t>(numThreads, wfvJobs.size()) << " threads.\n";
+    runParallel(M);
+  } else {
+    std::vector<size_t> jobIds(wfvJobs.size());
+    std::iota(jobIds.begin(), jobIds.end(), 0);
+    // the variants of callees are complete before their callers are vectorized
+    if (streaming)
+      sortJobsBottomUp(M, jobIds);
+    vectorizeJobs(M, jobIds);
+  }
 
-  auto &TTI = PMS.FAM.getResult<TargetIRAnalysis>(protoFunc);
-  auto &TLI = PMS.FAM.getResult<TargetLibraryAnalysis>(protoFunc);
+  // the vector functions (or their multi-version ifuncs) by name
+  std::vector<std::string> vectorNames;
+  if (exportVariants) {
+    for (auto &job : wfvJobs)
+      vectorNames.push_back(job.vectorFn->getName().str());
+  }
 
-  // configure platInfo
-  PlatformInfo platInfo(M, &TTI, &TLI);
-  addSleefResolver(rvConfig, platInfo);
+  if (!multiVersionArchs.empty())
+    emitMultiVersions(M);
 
-  // add mappings for recursive vectorization
-  for (auto &job : wfvJobs) {
-    platInfo.addMapping(job);
+  // the linked vector math functions are copies
+  if (streaming) {
+    PMS->FAM.clear();
+    releaseSleefModules(M.getContext());
+    Report() << "wfv: streaming: released analyses and vector math modules.\n";
   }
 
-  // vectorize jobs
-  VectorizerInterface vectorizer(platInfo, rvConfig);
-  for (auto &job : wfvJobs) {
-    vectorizeFunction(vectorizer, job);
+  // Callers in other modules only start referencing the variants after import.
+  // Keep them from being internalized and dropped by the thin link.
+  if (exportVariants) {
+    std::vector<GlobalValue *> usedVariants;
+    for (auto &name : vectorNames) {
+      auto *variant = M.getNamedValue(name);
+      if (variant && !variant->isDeclaration())
+        usedVariants.push_back(variant);
+    }
+    appendToUsed(M, usedVariants);
   }
 
+  if (cache.isEnabled())
+    VectorCache::printStatistics(Report());
+
   return true;
 }
 
@@ -204,11 +798,11 @@ INITIALIZE_PASS_END(WFVLegacyPass, "rv-function-vectorize", "RV - Vectorize func
 
 ///// New PM Pass /////
 
-WFVWrapperPass::WFVWrapperPass() {}
+WFVWrapperPass::WFVWrapperPass(bool _exportVariants) : exportVariants(_exportVariants) {}
 
 llvm::PreservedAnalyses WFVWrapperPass::run(llvm::Module &M,
                                             llvm::ModuleAnalysisManager &MAM) {
-  WFV WFVImpl;
+  WFV WFVImpl(exportVariants);
   if (WFVImpl.run(M))
     return llvm::PreservedAnalyses::none();
   else
@@ -0,0 +1,76 @@
+//===- src/passes/cleanupPass.cpp - cleanup of the functions RV changed --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/passes/cleanupPass.h"
+#include "rv/passes/irPolisher.h"
+#include "rv/config.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/Scalar/DCE.h"
+#include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+
+#include "report.h"
+
+using namespace llvm;
+
+static const char * const CleanupAttr = "rv-cleanup";
+
+namespace rv {
+
+void
+MarkForCleanup(Function & F) {
+  F.addFnAttr(CleanupAttr);
+}
+
+bool
+IsMarkedForCleanup(const Function & F) {
+  return F.hasFnAttribute(CleanupAttr);
+}
+
+///// New PM Pass /////
+
+CleanupWrapperPass::CleanupWrapperPass() {}
+
+llvm::PreservedAnalyses
+CleanupWrapperPass::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+  FunctionPassManager FPM;
+  FPM.addPass(InstCombinePass());
+  FPM.addPass(EarlyCSEPass());
+  FPM.addPass(DCEPass());
+  FPM.addPass(SimplifyCFGPass());
+  if (Config().enableIRPolish)
+    FPM.addPass(IRPolisherWrapperPass());
+
+  size_t numCleaned = 0;
+  for (auto &F : M) {
+    if (F.isDeclaration() || !IsMarkedForCleanup(F))
+      continue;
+    F.removeFnAttr(CleanupAttr);
+
+    // the analyses of all other functions stay valid
+    PreservedAnalyses FuncPA = FPM.run(F, FAM);
+    FAM.invalidate(F, FuncPA);
+    ++numCleaned;
+  }
+
+  if (numCleaned == 0)
+    return PreservedAnalyses::all();
+
+  Report() << "cleanup: " << numCleaned << " of " << M.size() << " functions\n";
+  PreservedAnalyses PA = PreservedAnalyses::none();
+  PA.preserve<FunctionAnalysisManagerModuleProxy>();
+  return PA;
+}
+
+} // namespace rv
@@ -154,9 +154,10 @@ Value *IRPolisher::lowerIntrinsicCall(llvm::CallInst* callInst) {
 
   auto isReduceOr = startsWith(callee->getName().data(), "rv_reduce_or");
   auto isReduceAnd = startsWith(callee->getName().data(), "rv_reduce_and");
-  auto isGather = startsWith(callee->getName().data(), "llvm.masked.gather");
+  // AVX-512 gathers take the mask in a k-register
+  auto isGather = !RVConfig.useAVX512 && startsWith(callee->getName().data(), "llvm.masked.gather");
 
-  // Insert instructions after the current one
+  // Insert instructions after the current one (on AVX-512 this selects kortest)
   if (isReduceOr || isReduceAnd) {
     IRBuilder<> builder(callInst);
     auto arg = callInst->getArgOperand(0);
@@ -266,6 +267,58 @@ Value *IRPolisher::lowerIntrinsicCall(llvm::CallInst* callInst) {
   return nullptr;
 }
 
+// f32 <-> half/bfloat vector conversions that the backend would otherwise scalarize
+Value *IRPolisher::lowerHalfConversion(llvm::CastInst* castInst) {
+  auto vecTy = dyn_cast<FixedVectorType>(castInst->getType());
+  auto srcTy = dyn_cast<FixedVectorType>(castInst->getSrcTy());
+  if (!vecTy || !srcTy) return nullptr;
+  auto vecLen = vecTy->getNumElements();
+  auto elemTy = vecTy->getElementType();
+  auto srcElemTy = srcTy->getElementType();
+
+  IRBuilder<> builder(castInst);
+  auto i16VecTy = FixedVectorType::get(builder.getInt16Ty(), vecLen);
+
+  // bfloat is the upper half of a float
+  if (isa<FPExtInst>(castInst) && srcElemTy->isBFloatTy() && elemTy->isFloatTy()) {
+    auto bits = builder.CreateZExt(builder.CreateBitCast(castInst->getOperand(0), i16VecTy), FixedVectorType::get(builder.getInt32Ty(), vecLen));
+    auto shifted = builder.CreateShl(bits, builder.CreateVectorSplat(vecLen, builder.getInt32(16)));
+    return builder.CreateBitCast(shifted, vecTy);
+  }
+
+  if (!isa<FPTruncInst>(castInst) || !srcElemTy->isFloatTy()) return nullptr;
+
+  // vcvtps2ph (rounding to nearest even)
+  Value *converted = nullptr;
+  auto module = castInst->getModule();
+  auto srcVal = castInst->getOperand(0);
+  if (elemTy->isHalfTy() && RVConfig.useF16C && !RVConfig.useFP16) {
+    if (vecLen == 4 || vecLen == 8) {
+      auto func = Intrinsic::getDeclaration(module, vecLen == 4 ? Intrinsic::x86_vcvtps2ph_128 : Intrinsic::x86_vcvtps2ph_256);
+      converted = builder.CreateCall(func, {srcVal, builder.getInt32(0)});
+    } else if (vecLen == 16 && RVConfig.useAVX512) {
+      auto func = Intrinsic::getDeclaration(module, Intrinsic::x86_avx512_mask_vcvtps2ph_512);
+      converted = builder.CreateCall(func, {srcVal, builder.getInt32(0), UndefValue::get(i16VecTy), builder.getInt16(0xFFFF)});
+    }
+  } else if (elemTy->isBFloatTy() && RVConfig.useBF16) {
+    if (vecLen == 4) {
+      auto func = Intrinsic::getDeclaration(module, Intrinsic::x86_avx512bf16_mask_cvtneps2bf16_128);
+      auto allTrue = Constant::getAllOnesValue(FixedVectorType::get(builder.getInt1Ty(), 4));
+      converted = builder.CreateCall(func, {srcVal, UndefValue::get(FixedVectorType::get(builder.getInt16Ty(), 8)), allTrue});
+    } else if (vecLen == 8 || vecLen == 16) {
+      auto func = Intrinsic::getDeclaration(module, vecLen == 8 ? Intrinsic::x86_avx512bf16_cvtneps2bf16_256 : Intrinsic::x86_avx512bf16_cvtneps2bf16_512);
+      converted = builder.CreateCall(func, {srcVal});
+    }
+  }
+  if (!converted) return nullptr;
+
+  // the 128bit variants return the 4 results in the lower half
+  if (GetVectorNumElements(converted->getType()) != vecLen) {
+    converted = builder.CreateShuffleVector(converted, ArrayRef<int>({0, 1, 2, 3}));
+  }
+  return builder.CreateBitCast(converted, vecTy);
+}
+
 Value *IRPolisher::replaceCmpInst(IRBuilder<> &builder, llvm::CmpInst *cmpInst, unsigned bitWidth) {
   auto left  = cmpInst->getOperand(0);
   auto right = cmpInst->getOperand(1);
@@ -579,8 +632,9 @@ bool IRPolisher::polish() {
   visitedInsts.clear();
   queue = std::queue<ExtInst>();
 
-  // Fill the queue with uses of the result of vector (f)cmps
-  for (auto it = inst_begin(F), end = inst_end(F); it != end; ++it) {
+  // Fill the queue with uses of the result of vector (f)cmps.
+  // AVX-512 keeps the <n x i1> masks in k-registers.
+  for (auto it = inst_begin(F), end = inst_end(F); !RVConfig.useAVX512 && it != end; ++it) {
     unsigned bitWidth;
     if (canReplaceInst(&*it, bitWidth))
       enqueueInst(&*it, bitWidth);
@@ -637,11 +691,23 @@ bool IRPolisher::polish() {
   }
   for (auto call : loweredCalls) call->eraseFromParent();
 
-  if (visitedInsts.size() > 0) {
-    Report() << "IRPolish: polished " << visitedInsts.size() << " instruction(s)\n";
+  // Select conversion instructions for half/bfloat vectors
+  std::vector<CastInst*> loweredCasts;
+  for (auto it = inst_begin(F), end = inst_end(F); it != end; ++it) {
+    if (auto castInst = dyn_cast<CastInst>(&*it)) {
+      if (auto newInst = lowerHalfConversion(castInst)) {
+        castInst->replaceAllUsesWith(newInst);
+        loweredCasts.push_back(castInst);
+      }
+    }
+  }
+  for (auto castInst : loweredCasts) castInst->eraseFromParent();
+
+  if (visitedInsts.size() + loweredCasts.size() > 0) {
+    Report() << "IRPolish: polished " << visitedInsts.size() << " instruction(s), " << loweredCasts.size() << " conversion(s)\n";
   }
 
-  return visitedInsts.size() > 0;
+  return visitedInsts.size() + loweredCasts.size() > 0;
 }
 
 ///// Old PM Pass /////
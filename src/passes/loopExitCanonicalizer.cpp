@@ -19,6 +19,7 @@
 #include "llvm/InitializePasses.h"
 
 #include "rvConfig.h"
+#include "utils/phaseTimer.h"
 #include "utils/rvTools.h"
 
 using namespace llvm;
@@ -73,6 +74,7 @@ llvm::PreservedAnalyses rv::LoopExitCanonicalizerWrapperPass::run(Function &F, F
 }
 
 bool LoopExitCanonicalizer::canonicalize(Function &F) {
+  PhaseTimer timer("loop-exit-canonicalizer", F);
 
   for (auto &L : mLoopInfo) {
     canonicalizeLoop(L);
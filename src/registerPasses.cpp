@@ -10,6 +10,7 @@
 #include "rv/passes.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 
@@ -57,6 +58,13 @@ static cl::opt<bool>
                         cl::desc("Use RV to auto-vectorize libm calls."),
                         cl::init(true), cl::ZeroOrMore, cl::cat(rvCategory));
 
+static cl::opt<bool>
+    rvLTO("rv-lto",
+          cl::desc("Prepare for (Thin)LTO: keep the vector variants of "
+                   "declare-simd functions alive for callers in other modules "
+                   "and vectorize again after cross-module import."),
+          cl::init(false), cl::ZeroOrMore, cl::cat(rvCategory));
+
 static bool mayVectorize() {
   return rvVectorizeEnabled && (rvWFVEnabled || rvLoopVecEnabled);
 }
@@ -140,13 +148,33 @@ void rv::addConfiguredRVPasses(PassBuilder &PB) {
           llvm::OptimizationLevel Level) {
         if (Level.getSpeedupLevel() < 3)
           return;
+        // Also runs in the ThinLTO pre-link (WFV exports the variants) and
+        // post-link pipeline (functions and attributes have been imported).
         if (shouldRunWFVPass())
-          MPM.addPass(rv::WFVWrapperPass());
+          MPM.addPass(rv::WFVWrapperPass(rvLTO));
         if (shouldAutoVectorizeMath()) 
           MPM.addPass(rv::AutoMathWrapperPass());
         if (mayVectorize())
           rv::addCleanupPasses(MPM);
       });
+
+#if LLVM_VERSION_MAJOR >= 15
+  // the full LTO pipeline has no vectorizer extension points of its own
+  PB.registerFullLinkTimeOptimizationLastEPCallback(
+      [&](llvm::ModulePassManager &MPM,
+          llvm::OptimizationLevel Level) {
+        if (!rvLTO || Level.getSpeedupLevel() < 3)
+          return;
+        if (shouldRunWFVPass())
+          MPM.addPass(rv::WFVWrapperPass(true));
+        if (shouldRunLoopVecPass())
+          MPM.addPass(createModuleToFunctionPassAdaptor(rv::LoopVectorizerWrapperPass()));
+        if (shouldAutoVectorizeMath())
+          MPM.addPass(rv::AutoMathWrapperPass());
+        if (mayVectorize())
+          rv::addCleanupPasses(MPM);
+      });
+#endif
   // PB.registerPipelineParsingCallback(buildDefaultRVPipeline);
 }
 
@@ -8,24 +8,34 @@
 
 #include "report.h"
 
+#include "rv/vectorizerSession.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
 #include <llvm/Support/raw_os_ostream.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <mutex>
+
 
 
 // RV_REPORT_FILE stream handle
 static std::unique_ptr<llvm::raw_fd_ostream> outFileStream;
 
+// report buffer of this thread (ThreadReportBuffer)
+static thread_local llvm::raw_ostream * threadReportBuffer = nullptr;
+
 static llvm::raw_ostream &
 reps() {
-  if (outFileStream) return *outFileStream;
-
   // no reporting
-  const bool hasReport = rv::CheckFlag("RV_REPORT");
+  const bool hasReport = outFileStream || rv::CheckFlag("RV_REPORT");
   if (!hasReport) {
     return llvm::nulls();
   }
 
+  if (threadReportBuffer) return *threadReportBuffer;
+  if (outFileStream) return *outFileStream;
+
   // std out
   const char * repFilePath = getenv("RV_REPORT_FILE");
   if (!repFilePath) {
@@ -58,6 +68,17 @@ ReportContinue() {
   return reps();
 }
 
+ThreadReportBuffer::ThreadReportBuffer(std::string & buffer)
+: out(buffer)
+, prevBuffer(threadReportBuffer)
+{
+  threadReportBuffer = &out;
+}
+
+ThreadReportBuffer::~ThreadReportBuffer() {
+  threadReportBuffer = prevBuffer;
+}
+
 llvm::raw_ostream &
 Error() {
   return (llvm::errs() << "rv ERROR: ");
@@ -69,5 +90,127 @@ fail(const std::string & text) {
   abort();
 }
 
+const char *
+to_string(ReportReason reason) {
+  switch (reason) {
+    case ReportReason::Vectorized: return "vectorized";
+    case ReportReason::CacheHit: return "cache-hit";
+    case ReportReason::AlreadyVectorized: return "already-vectorized";
+    case ReportReason::UnfitLoopStructure: return "unfit-loop-structure";
+    case ReportReason::NotAnnotated: return "not-annotated";
+    case ReportReason::DependenceDistance: return "dependence-distance";
+    case ReportReason::NotBeneficial: return "not-beneficial";
+    case ReportReason::FilteredOnlyLine: return "filtered-only-line";
+    case ReportReason::FilteredSelectLoop: return "filtered-select-loop";
+    case ReportReason::FilteredSelectName: return "filtered-select-name";
+    case ReportReason::FilteredTuning: return "filtered-tuning";
+    case ReportReason::CodeGrowth: return "code-growth";
+  }
+  return "unknown";
+}
+
+// RV_REPORT_JSON stream handle
+static std::mutex decisionMutex;
+static std::unique_ptr<llvm::raw_fd_ostream> decisionStream;
+
+// copy of the records of this thread (SetThreadReportStream)
+static thread_local llvm::raw_ostream * threadReportStream = nullptr;
+
+void
+SetThreadReportStream(llvm::raw_ostream * out) {
+  threadReportStream = out;
+}
+
+bool
+HasDecisionReport() {
+  return threadReportStream || getenv("RV_REPORT_JSON") != nullptr;
+}
+
+// the RV_REPORT_JSON stream (nullptr if not set), call with decisionMutex held
+static llvm::raw_fd_ostream *
+decisionOut() {
+  const char * jsonPath = getenv("RV_REPORT_JSON");
+  if (!jsonPath) return nullptr;
+  if (decisionStream) return decisionStream.get();
+
+  // append: every compiler invocation of a build adds to the same file
+  std::error_code EC;
+  decisionStream = std::make_unique<llvm::raw_fd_ostream>(llvm::StringRef(jsonPath), EC, llvm::sys::fs::OF_Append);
+  if (EC) {
+    Error() << "could not open RV_REPORT_JSON=" << jsonPath << ": " << EC.message() << "\n";
+    decisionStream.reset();
+  }
+  return decisionStream.get();
+}
+
+// append the JSON line \p line to the RV_REPORT_JSON file and the stream of this thread
+static void
+writeRecordLine(const std::string & line) {
+  if (threadReportStream) *threadReportStream << line << "\n";
+
+  // the mutex orders the threads of this process, the file lock concurrent compiler processes
+  std::lock_guard<std::mutex> guard(decisionMutex);
+  auto * outStream = decisionOut();
+  if (!outStream) return;
+  auto fileLock = outStream->lock();
+  if (!fileLock) {
+    Error() << "could not lock RV_REPORT_JSON: " << llvm::toString(fileLock.takeError()) << "\n";
+    return;
+  }
+  *outStream << line << "\n";
+  outStream->flush();
+}
+
+void
+ReportDecision(const DecisionRecord & record) {
+  if (!HasDecisionReport()) return;
+
+  std::string line;
+  llvm::raw_string_ostream out(line);
+  {
+    llvm::json::OStream J(out);
+    J.object([&] {
+      J.attribute("schema", 1);
+      J.attribute("pass", record.pass);
+      J.attribute("function", record.function);
+      J.attribute("region", record.region);
+      J.attribute("loc", record.location);
+      J.attribute("decision", record.vectorized ? "vectorized" : "skipped");
+      J.attribute("reason", to_string(record.reason));
+      J.attribute("width", (int64_t) record.width);
+      J.attributeObject("metrics", [&] {
+        for (const auto & metric : record.metrics)
+          J.attribute(metric.first, metric.second);
+      });
+    });
+  }
+  writeRecordLine(out.str());
+}
+
+void
+ReportMetrics(const MetricsRecord & record) {
+  if (!HasDecisionReport()) return;
+
+  std::string line;
+  llvm::raw_string_ostream out(line);
+  {
+    llvm::json::OStream J(out);
+    J.object([&] {
+      J.attribute("schema", 1);
+      J.attribute("kind", "metrics");
+      J.attribute("pass", record.pass);
+      J.attribute("function", record.function);
+      J.attribute("region", record.region);
+      J.attribute("loc", record.location);
+      J.attributeObject("metrics", [&] {
+        for (const auto & metric : record.metrics)
+          J.attribute(metric.first, metric.second);
+      });
+    });
+  }
+  writeRecordLine(out.str());
+}
+
+
 
 }
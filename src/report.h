@@ -12,6 +12,10 @@
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/Compiler.h>
 
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace rv {
 
 // check if an environment flag is set
@@ -23,10 +27,79 @@ llvm::raw_ostream & Report();
 // continue a "rv: " line started with "Report()"
 llvm::raw_ostream & ReportContinue();
 
+// Report() and ReportContinue() of this thread append to \p buffer while the
+// object lives (nests). Worker threads keep their output per job, the owner
+// emits it in job order.
+class ThreadReportBuffer {
+  llvm::raw_string_ostream out;
+  llvm::raw_ostream * prevBuffer;
+
+public:
+  ThreadReportBuffer(std::string & buffer);
+  ~ThreadReportBuffer();
+};
+
 // output stream for error
 llvm::raw_ostream & Error();
 
 [[noreturn]] void fail(const std::string &text);
+
+// stable reason codes of structured decision records (see ReportDecision)
+enum class ReportReason {
+  Vectorized = 0,
+  CacheHit = 1,
+  AlreadyVectorized = 2,
+  UnfitLoopStructure = 3,
+  NotAnnotated = 4,
+  DependenceDistance = 5,
+  NotBeneficial = 6,
+  FilteredOnlyLine = 7,
+  FilteredSelectLoop = 8,
+  FilteredSelectName = 9,
+  FilteredTuning = 10,
+  CodeGrowth = 11
+};
+
+const char * to_string(ReportReason reason);
+
+// one vectorization decision for a loop or function
+struct DecisionRecord {
+  const char * pass;      // "loopvec", "wfv"
+  std::string function;   // enclosing function
+  std::string region;     // loop header / vector function name
+  std::string location;   // "file:line" (if known)
+  bool vectorized;
+  ReportReason reason;
+  unsigned width;         // chosen vector width (0 if none)
+  std::vector<std::pair<std::string, double>> metrics; // cost-model numbers
+
+  DecisionRecord(const char * _pass, std::string _function, std::string _region)
+  : pass(_pass), function(_function), region(_region), location()
+  , vectorized(false), reason(ReportReason::NotAnnotated), width(0), metrics()
+  {}
+};
+
+// whether RV_REPORT_JSON is set or this thread copies its records (SetThreadReportStream)
+bool HasDecisionReport();
+
+// append \p record to the RV_REPORT_JSON file (JSON Lines, schema version 1)
+void ReportDecision(const DecisionRecord & record);
+
+// code quality counters of one vectorized function or loop
+struct MetricsRecord {
+  const char * pass;      // "natbuilder"
+  std::string function;   // vector function
+  std::string region;     // loop header / vector function name
+  std::string location;   // "file:line" (if known)
+  std::vector<std::pair<std::string, double>> metrics;
+
+  MetricsRecord(const char * _pass, std::string _function, std::string _region)
+  : pass(_pass), function(_function), region(_region), location(), metrics()
+  {}
+};
+
+// append \p record to the RV_REPORT_JSON file (kind "metrics", next to the decision records)
+void ReportMetrics(const MetricsRecord & record);
 }
 
 #endif // RV_REPORT_H_
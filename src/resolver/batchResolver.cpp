@@ -0,0 +1,251 @@
+//===- src/resolver/batchResolver.cpp - batch APIs of external functions --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Resolves calls to external scalar functions that have a batch API
+//
+//   void fn_batch(i64 n, const T0 * in0, .., const Tk * ink, U * out)
+//
+// (one input array per argument, no output array for void functions). The
+// batch function is named by the "rv-batch" attribute of the declaration or by
+// a "<function> <batch function>" line in the RV_BATCH_MAP file.
+// The vector function packs the active lanes into stack arrays, makes one
+// batch call for them and unpacks the results into their lanes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/resolver/resolvers.h"
+#include "rv/resolver/resolver.h"
+#include "rv/PlatformInfo.h"
+
+#include "rvConfig.h"
+#include "report.h"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <sstream>
+
+#if 1
+#define IF_DEBUG_BATCH IF_DEBUG
+#else
+#define IF_DEBUG_BATCH if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+// emits the packing vector function around the batch call
+class BatchFunctionResolver : public FunctionResolver {
+  std::string batchName;
+  std::string vecFuncName;
+  FunctionType & scaFuncTy;
+  VectorShapeVec argShapes;
+  int vectorWidth;
+  bool hasPredicate;
+
+  bool isVaryingArg(unsigned i) const { return !argShapes[i].isUniform(); }
+
+  Function & createVectorFunction();
+
+public:
+  BatchFunctionResolver(Module & _targetModule, std::string _batchName, std::string _vecFuncName, FunctionType & _scaFuncTy, const VectorShapeVec & _argShapes, int _vectorWidth, bool _hasPredicate)
+  : FunctionResolver(_targetModule)
+  , batchName(_batchName)
+  , vecFuncName(_vecFuncName)
+  , scaFuncTy(_scaFuncTy)
+  , argShapes(_argShapes)
+  , vectorWidth(_vectorWidth)
+  , hasPredicate(_hasPredicate)
+  {}
+
+  CallPredicateMode getCallSitePredicateMode() override {
+    return hasPredicate ? CallPredicateMode::PredicateArg : CallPredicateMode::SafeWithoutPredicate;
+  }
+
+  // the mask follows the arguments
+  int getMaskPos() override { return hasPredicate ? scaFuncTy.getNumParams() : -1; }
+
+  llvm::Function& requestVectorized() override {
+    auto * vecFunc = targetModule.getFunction(vecFuncName);
+    if (vecFunc) return *vecFunc;
+    return createVectorFunction();
+  }
+
+  VectorShape requestResultShape() override { return VectorShape::varying(); }
+};
+
+Function &
+BatchFunctionResolver::createVectorFunction() {
+  auto & ctx = targetModule.getContext();
+  auto * i64Ty = Type::getInt64Ty(ctx);
+  auto * ptrTy = PointerType::get(ctx, 0);
+  auto * retTy = scaFuncTy.getReturnType();
+  bool hasResult = !retTy->isVoidTy();
+
+  // void batch(i64 n, ptr in0, .., ptr ink, ptr out)
+  SmallVector<Type*, 6> batchParamTys{i64Ty};
+  batchParamTys.append(scaFuncTy.getNumParams() + hasResult, ptrTy);
+  auto batchFunc = targetModule.getOrInsertFunction(batchName, FunctionType::get(Type::getVoidTy(ctx), batchParamTys, false));
+
+  // uniform arguments stay scalar
+  SmallVector<Type*, 6> vecParamTys;
+  for (unsigned i = 0; i < scaFuncTy.getNumParams(); ++i) {
+    auto * paramTy = scaFuncTy.getParamType(i);
+    vecParamTys.push_back(isVaryingArg(i) ? FixedVectorType::get(paramTy, vectorWidth) : paramTy);
+  }
+  if (hasPredicate) vecParamTys.push_back(FixedVectorType::get(Type::getInt1Ty(ctx), vectorWidth));
+  auto * vecRetTy = hasResult ? FixedVectorType::get(retTy, vectorWidth) : retTy;
+  auto * vecFunc = Function::Create(FunctionType::get(vecRetTy, vecParamTys, false), GlobalValue::InternalLinkage, vecFuncName, &targetModule);
+  vecFunc->setDoesNotThrow();
+
+  IRBuilder<> builder(BasicBlock::Create(ctx, "entry", vecFunc));
+  SmallVector<Value*, 6> inArrays;
+  for (unsigned i = 0; i < scaFuncTy.getNumParams(); ++i) {
+    inArrays.push_back(builder.CreateAlloca(ArrayType::get(scaFuncTy.getParamType(i), vectorWidth), nullptr, "batch.in"));
+  }
+  Value * outArray = hasResult ? builder.CreateAlloca(ArrayType::get(retTy, vectorWidth), nullptr, "batch.out") : nullptr;
+
+  // pack the active lanes: every lane writes to the next free slot, which only inactive lanes leave free
+  Value * numItems = ConstantInt::get(i64Ty, 0);
+  SmallVector<Value*, 16> laneSlots;
+  Value * mask = hasPredicate ? vecFunc->getArg(scaFuncTy.getNumParams()) : nullptr;
+  for (int lane = 0; lane < vectorWidth; ++lane) {
+    laneSlots.push_back(numItems);
+    for (unsigned i = 0; i < scaFuncTy.getNumParams(); ++i) {
+      auto * paramTy = scaFuncTy.getParamType(i);
+      Value * laneArg = vecFunc->getArg(i);
+      if (isVaryingArg(i)) laneArg = builder.CreateExtractElement(laneArg, lane);
+      builder.CreateStore(laneArg, builder.CreateGEP(paramTy, inArrays[i], numItems));
+    }
+    if (mask) {
+      auto * isActive = builder.CreateExtractElement(mask, lane);
+      numItems = builder.CreateAdd(numItems, builder.CreateZExt(isActive, i64Ty), "batch.n");
+    } else {
+      numItems = ConstantInt::get(i64Ty, lane + 1);
+    }
+  }
+
+  // one call for all active lanes
+  SmallVector<Value*, 6> batchArgs{numItems};
+  batchArgs.append(inArrays.begin(), inArrays.end());
+  if (outArray) batchArgs.push_back(outArray);
+  if (mask) {
+    auto * callBlock = BasicBlock::Create(ctx, "batch.call", vecFunc);
+    auto * exitBlock = BasicBlock::Create(ctx, "batch.exit", vecFunc);
+    builder.CreateCondBr(builder.CreateICmpNE(numItems, ConstantInt::get(i64Ty, 0)), callBlock, exitBlock);
+    builder.SetInsertPoint(callBlock);
+    builder.CreateCall(batchFunc, batchArgs);
+    builder.CreateBr(exitBlock);
+    builder.SetInsertPoint(exitBlock);
+  } else {
+    builder.CreateCall(batchFunc, batchArgs);
+  }
+
+  if (!hasResult) {
+    builder.CreateRetVoid();
+    return *vecFunc;
+  }
+
+  // unpack (inactive lanes read the slot of the next active lane)
+  Value * result = UndefValue::get(vecRetTy);
+  for (int lane = 0; lane < vectorWidth; ++lane) {
+    auto * laneResult = builder.CreateLoad(retTy, builder.CreateGEP(retTy, outArray, laneSlots[lane]));
+    result = builder.CreateInsertElement(result, laneResult, lane);
+  }
+  builder.CreateRet(result);
+  return *vecFunc;
+}
+
+class BatchResolverService : public ResolverService {
+  StringMap<std::string> batchMap; // RV_BATCH_MAP
+
+  void readBatchMap(StringRef path);
+
+public:
+  BatchResolverService(const Config & config) {
+    if (!config.batchMapPath.empty()) readBatchMap(config.batchMapPath);
+  }
+
+  void print(llvm::raw_ostream & out) const override {
+    out << "BatchResolver { mapped = " << batchMap.size() << " }";
+  }
+
+  std::unique_ptr<FunctionResolver> resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) override;
+};
+
+void
+BatchResolverService::readBatchMap(StringRef path) {
+  auto bufferOrErr = MemoryBuffer::getFile(path);
+  if (!bufferOrErr) {
+    Report() << "ERROR: could not read RV_BATCH_MAP file " << path << "\n";
+    return;
+  }
+
+  SmallVector<StringRef, 32> lines;
+  (*bufferOrErr)->getBuffer().split(lines, '\n', -1, false);
+  for (auto line : lines) {
+    line = line.split('#').first.trim();
+    if (line.empty()) continue;
+    auto names = line.split(' ');
+    auto batchName = names.second.trim();
+    if (batchName.empty()) {
+      Report() << "ERROR: expected '<function> <batch function>' in RV_BATCH_MAP, got '" << line << "'\n";
+      continue;
+    }
+    batchMap[names.first] = batchName.str();
+  }
+}
+
+// integer, floating-point and pointer elements only
+static bool
+IsBatchElementType(Type & type) {
+  return type.isIntegerTy() || type.isFloatingPointTy() || type.isPointerTy();
+}
+
+std::unique_ptr<FunctionResolver>
+BatchResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) {
+  // the attribute of the declaration takes precedence over the mapping file
+  std::string batchName;
+  auto * scaFunc = destModule.getFunction(funcName);
+  if (scaFunc && scaFunc->hasFnAttribute("rv-batch")) {
+    batchName = scaFunc->getFnAttribute("rv-batch").getValueAsString().str();
+  } else {
+    auto it = batchMap.find(funcName);
+    if (it == batchMap.end()) return nullptr;
+    batchName = it->second;
+  }
+  if (batchName.empty()) return nullptr;
+
+  // uniform calls stay scalar
+  if (FunctionResolver::ComputeShape(argShapes).isUniform()) return nullptr;
+  auto * retTy = scaFuncTy.getReturnType();
+  if (scaFuncTy.isVarArg() || (!retTy->isVoidTy() && !IsBatchElementType(*retTy))) return nullptr;
+  for (auto * paramTy : scaFuncTy.params()) {
+    if (!IsBatchElementType(*paramTy)) return nullptr;
+  }
+
+  // <batch>.v<width>_<u|v per argument>[_m]
+  std::stringstream ss;
+  ss << batchName << ".v" << vectorWidth << "_";
+  for (const auto & argShape : argShapes) ss << (argShape.isUniform() ? "u" : "v");
+  if (hasPredicate) ss << "_m";
+  IF_DEBUG_BATCH { errs() << "batch: " << funcName << " -> " << ss.str() << "\n"; }
+
+  return std::make_unique<BatchFunctionResolver>(destModule, batchName, ss.str(), scaFuncTy, argShapes, vectorWidth, hasPredicate);
+}
+
+void
+addBatchResolver(const Config & config, PlatformInfo & platInfo) {
+  platInfo.addResolverService(std::make_unique<BatchResolverService>(config), false);
+}
+
+} // namespace rv
@@ -29,6 +29,12 @@ namespace rv {
 ListResolver::~ListResolver()
 {}
 
+void
+ListResolver::resetModule(llvm::Module & newModule) {
+  destModule = &newModule;
+  funcMappings.clear();
+}
+
 VectorMapping
 ListResolver::inferMapping(llvm::Function &scalarFnc,
                                           llvm::Function &simdFnc,
@@ -198,7 +204,13 @@ ListResolver::resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy,
       }
 
       // have we found a better mapping?
-      if (mapping.resultShape.morePreciseThan(bestResultShape)) {
+      bool better = mapping.resultShape.morePreciseThan(bestResultShape);
+      // at unpredicated call sites, prefer the unmasked variant of the same shape
+      if (better && bestMapping && !hasPredicate && mapping.maskPos >= 0 && bestMapping->maskPos < 0 &&
+          bestResultShape.morePreciseThan(mapping.resultShape)) {
+        better = false;
+      }
+      if (better) {
          bestResultShape = mapping.resultShape;
          bestMapping = &mapping;
       }
@@ -25,15 +25,20 @@
 #include <llvm/Analysis/BranchProbabilityInfo.h>
 #include <llvm/Passes/PassBuilder.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
 
 #include "rv/annotations.h"
 #include "rv/PlatformInfo.h"
+#include "rv/analysis/costModel.h"
+#include "utils/phaseTimer.h"
 #include "utils/rvTools.h"
 #include "rvConfig.h"
 #include "rv/rv.h"
 #include "rv/utils.h"
 #include "utils/rvTools.h"
 #include "rv/region/FunctionRegion.h"
+#include "rv/transform/recursionToLoop.h"
 #include "rv/transform/singleReturnTrans.h"
 #include "rv/passes/loopExitCanonicalizer.h"
 #include "rv/passes/PassManagerSession.h"
@@ -41,9 +46,14 @@
 
 using namespace llvm;
 
+// short vectors of integers and floats are widened to SoA form (RV_VECTOR_WIDENING)
 static bool
-CanVectorizeType(const Type& type) {
-  return type.isVoidTy() || (!type.isVectorTy() && (type.isFloatingPointTy() || type.isIntegerTy()));
+CanVectorizeType(const Type& type, bool widenVectors) {
+  if (auto * vecTy = dyn_cast<FixedVectorType>(&type)) {
+    auto * elemTy = vecTy->getElementType();
+    return widenVectors && (elemTy->isFloatingPointTy() || elemTy->isIntegerTy());
+  }
+  return type.isVoidTy() || type.isFloatingPointTy() || type.isIntegerTy();
 }
 
 #if 1
@@ -58,13 +68,34 @@ namespace rv {
 class RecursiveResolverService : public ResolverService {
   VectorizerInterface vectorizer;
 
+  // vector variants in the module by scalar function name.
+  // Variants are recorded on their vector function (SetVariantMapping) and
+  // are thus shared with later sessions (eg the next function of the LoopVectorizer).
+  bool scannedModule;
+  llvm::StringMap<std::vector<VectorMapping>> knownVariants;
+  // mangled names of variants that could not be vectorized
+  llvm::StringSet<> failedVariants;
+
+  // collect the recorded variants of \p mod
+  void collectKnownVariants(llvm::Module & mod);
+  // the known variant of \p scaFunc that serves a call site with \p argShapes best (nullptr if none)
+  const VectorMapping * findVariant(llvm::Function & scaFunc, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate) const;
+
 public:
   std::unique_ptr<FunctionResolver> resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) override;
 
   RecursiveResolverService(PlatformInfo & platInfo, Config config)
   : vectorizer(platInfo, config)
+  , scannedModule(false)
   {}
 
+  void resetModule(llvm::Module & newModule) override {
+    (void) newModule;
+    scannedModule = false;
+    knownVariants.clear();
+    failedVariants.clear();
+  }
+
   void print(raw_ostream & out) const override {
     out << "{RecursiveVectorizer}";
   }
@@ -102,6 +133,16 @@ public:
 
   bool isValid() const { return hasValidVectorFunc; }
 
+  const VectorMapping & getMapping() const { return recMapping; }
+
+  // resolver for a variant that has been emitted before
+  RecursiveResolver(VectorizerInterface & vectorizer, const VectorMapping & knownMapping)
+  : FunctionResolver(*knownMapping.scalarFn->getParent())
+  , hasValidVectorFunc(true)
+  , vectorizer(vectorizer)
+  , recMapping(knownMapping)
+  {}
+
   RecursiveResolver(VectorizerInterface & vectorizer, Function & scaFunc, VectorShapeVec argShapes, int vectorWidth, bool hasCallSitePredicate)
   : FunctionResolver(*scaFunc.getParent())
   , hasValidVectorFunc(false)
@@ -113,6 +154,8 @@ public:
     Function * clonedFunc = CloneFunction(&scaFunc, cloneMap);
     if (recMapping.maskPos >= 0) {
       MaterializeEntryMask(*clonedFunc, vectorizer.getPlatformInfo());
+    } else if (vectorizer.getConfig().enableRecursionToLoop) {
+      RecursionToLoop(*clonedFunc, scaFunc).run();
     }
 
     recMapping.scalarFn = clonedFunc;
@@ -195,7 +238,7 @@ public:
     // Would require proper inter-procedural VA to fix this.
 
     // bail if the return type did not turn out to be vectorizable
-    if (nextResultShape.isVarying() && !CanVectorizeType(*clonedFunc->getReturnType())) {
+    if (nextResultShape.isVarying() && !CanVectorizeType(*clonedFunc->getReturnType(), vectorizer.getConfig().enableVectorWidening)) {
       vectorizer.getPlatformInfo().forgetAllMappingsFor(*clonedFunc);
       clonedFunc->eraseFromParent();
       vectorizer.getPlatformInfo().forgetMapping(callMapping);        // drop the incomplete mapping
@@ -224,6 +267,11 @@ public:
       vecFunc = createVectorDeclaration(*clonedFunc, nextResultShape, callMapping.argShapes, callMapping.vectorWidth, callMapping.maskPos);
       vecFunc->setName(mangledName);
       vecFunc->copyAttributesFrom(&scaFunc);
+      // nothing outside of the module can call the variant of a module-local function
+      if (scaFunc.hasLocalLinkage() && vectorizer.getConfig().enableFastVariantCC) {
+        vecFunc->setLinkage(GlobalValue::InternalLinkage);
+        vecFunc->setCallingConv(CallingConv::Fast);
+      }
 
     // update mapping to use the declared \p vecFunc
       vectorizer.getPlatformInfo().forgetMapping(callMapping);
@@ -237,6 +285,28 @@ public:
 
     // generate the vector function body
       vectorizer.analyze(vecInfo, PMS.FAM);
+
+    // vectorWidth scalar calls could be cheaper (each lane extracts its varying operands and inserts its result)
+      if (vectorizer.getConfig().enableResolverCosts) {
+        Config costConfig = vectorizer.getConfig();
+        RegionCost calleeCost = CostModel(vectorizer.getPlatformInfo(), costConfig, vecInfo).estimateRegionCost();
+        size_t numTransfers = returnsVoid ? 0 : 1;
+        for (const auto & argShape : argShapes) numTransfers += !argShape.isUniform();
+        FunctionCost replCost{calleeCost.scalarCost + recMapping.vectorWidth * numTransfers};
+        setCostEstimates(FunctionCost{calleeCost.vectorCost}, replCost);
+
+        if (replCost.cost < calleeCost.vectorCost) {
+          Report() << "recursive vectorization of " << scaFunc.getName() << ": " << recMapping.vectorWidth
+                   << " scalar calls are cheaper (" << replCost.cost << " < " << calleeCost.vectorCost << ")\n";
+          vectorizer.getPlatformInfo().forgetAllMappingsFor(*clonedFunc);
+          clonedFunc->eraseFromParent();
+          vectorizer.getPlatformInfo().forgetMapping(callMapping);
+          if (vecFunc->use_empty()) vecFunc->eraseFromParent();
+          hasValidVectorFunc = false;
+          return;
+        }
+      }
+
       vectorizer.linearize(vecInfo, PMS.FAM);
       vectorizer.vectorize(vecInfo, PMS.FAM, nullptr);
       vectorizer.finalize();
@@ -260,6 +330,49 @@ public:
 };
 
 
+void
+RecursiveResolverService::collectKnownVariants(Module & mod) {
+  scannedModule = true;
+  for (auto & func : mod) {
+    VectorMapping variant;
+    if (func.isDeclaration() || !ReadVariantMapping(func, variant)) continue;
+    knownVariants[variant.scalarFn->getName()].push_back(variant);
+  }
+}
+
+const VectorMapping *
+RecursiveResolverService::findVariant(Function & scaFunc, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate) const {
+  auto itVariants = knownVariants.find(scaFunc.getName());
+  if (itVariants == knownVariants.end()) return nullptr;
+
+  const VectorMapping * bestVariant = nullptr;
+  int bestNumGeneralized = 0;
+  for (const auto & variant : itVariants->second) {
+    if (variant.scalarFn != &scaFunc || variant.vectorFn->isDeclaration()) continue;
+    if ((int) variant.vectorWidth != vectorWidth) continue;
+    if (hasPredicate && !variant.supportsPredicatedCall()) continue;
+
+    // the variant must accept the call site shapes.
+    // Do not generalize uniform/strided pointers to varying ones though: that would turn their accesses into gathers/scatters.
+    bool compatible = true;
+    int numGeneralized = 0;
+    for (int i = 0; compatible && i < (int) argShapes.size(); ++i) {
+      const auto & varShape = variant.argShapes[i];
+      if (varShape == argShapes[i]) continue;
+      compatible = varShape.contains(argShapes[i]) &&
+                   !(scaFunc.getArg(i)->getType()->isPointerTy() && varShape.isVarying());
+      ++numGeneralized;
+    }
+    if (!compatible) continue;
+
+    if (!bestVariant || numGeneralized < bestNumGeneralized) {
+      bestVariant = &variant;
+      bestNumGeneralized = numGeneralized;
+    }
+  }
+  return bestVariant;
+}
+
 std::unique_ptr<FunctionResolver>
 RecursiveResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) {
 // is this function defined?
@@ -271,7 +384,7 @@ RecursiveResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType &
   // have all varying params vectorizabel types?
   int i = 0;
   for (auto * paramTy : scaFuncTy.params()) {
-    if (argShapes[i++].isVarying() && !CanVectorizeType(*paramTy)) return nullptr;
+    if (argShapes[i++].isVarying() && !CanVectorizeType(*paramTy, vectorizer.getConfig().enableVectorWidening)) return nullptr;
   }
 
   // FIXME legality?
@@ -281,16 +394,39 @@ RecursiveResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType &
     return nullptr; // do not vectorize annotated critical sections
   }
 
-  // try to create vector code for this function
-  auto * recResolver = new RecursiveResolver(vectorizer, *scaFunc, argShapes, vectorWidth, hasPredicate);
+  // re-use an existing variant (from this or an earlier session)
+  if (!scannedModule) collectKnownVariants(destModule);
+  const auto * knownVariant = findVariant(*scaFunc, argShapes, vectorWidth, hasPredicate);
+  if (knownVariant) {
+    Report() << "re-using vector variant " << knownVariant->vectorFn->getName() << " of " << funcName << "\n";
+    vectorizer.getPlatformInfo().addMapping(*knownVariant); // serve the next call sites from the list resolver
+    return std::make_unique<RecursiveResolver>(vectorizer, *knownVariant);
+  }
+
+  // do not retry variants that failed before
+  int maskPos = hasPredicate ? argShapes.size() : -1;
+  std::string mangledName = vectorizer.getPlatformInfo().createMangledVectorName(funcName, argShapes, vectorWidth, maskPos);
+  if (failedVariants.count(mangledName)) return nullptr;
+
+  // try to create vector code for this function (nested for the callees of its call sites)
+  EntityTimer callTimer("call", *scaFunc, *scaFunc);
+  auto recResolver = std::make_unique<RecursiveResolver>(vectorizer, *scaFunc, argShapes, vectorWidth, hasPredicate);
   // the function could turn out to be unvectorizable (::isValid())
   if (!recResolver->isValid()) {
+    failedVariants.insert(mangledName);
     return nullptr;
   }
 
   Report() << "recursively vectorized function " << funcName << " -> " << recResolver->getVectorName() << "\n";
-  (void) recResolver->requestVectorized();
-  return std::unique_ptr<FunctionResolver>(std::move(recResolver));
+  auto & vecFunc = recResolver->requestVectorized();
+
+  // record the variant for later call sites
+  const auto & variant = recResolver->getMapping();
+  if (!vecFunc.isDeclaration()) { // still a declaration if this is a recursive invocation
+    SetVariantMapping(vecFunc, variant);
+    knownVariants[funcName].push_back(variant);
+  }
+  return recResolver;
 }
 
 
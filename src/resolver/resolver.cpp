@@ -9,10 +9,152 @@
 #include "rv/resolver/resolver.h"
 #include "rv/shape/vectorShape.h"
 
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+
 namespace rv {
 
+namespace {
+
+// reciprocal throughput of a scalar libm call and of a vector math call on one register (u35/u10 variants)
+struct MathCallCost {
+  double scalarCost;
+  double vectorCost;
+};
+
+// cycles per element of the scalar libm call and of the SLEEF implementation \p impl (xsinf_u35) on \p isa
+// (tools/rv-mathbench.py)
+struct MeasuredMathCost {
+  const char * isa;
+  const char * impl;
+  double scalarCycles;
+  double vectorCycles;
+  double maxULPError;
+};
+
+// MeasuredMathCosts (tools/rv-mathbench.py --cpp)
+#include "mathCosts.gen.inc"
+
+// rough reference costs (cycles on a current x86 core) for the functions without measurements
+const struct {
+  const char * name;
+  MathCallCost cost;
+} ReferenceMathCosts[] = {
+  {"sin", {20, 25}}, {"cos", {20, 25}}, {"tan", {30, 35}}, {"sincos", {30, 35}},
+  {"asin", {20, 25}}, {"acos", {20, 25}}, {"atan", {25, 30}}, {"atan2", {35, 45}},
+  {"sinh", {30, 35}}, {"cosh", {30, 35}}, {"tanh", {30, 35}},
+  {"asinh", {35, 45}}, {"acosh", {35, 45}}, {"atanh", {35, 45}},
+  {"exp", {12, 12}}, {"exp2", {12, 12}}, {"exp10", {15, 15}}, {"expm1", {20, 25}},
+  {"log", {15, 18}}, {"log2", {15, 18}}, {"log10", {18, 20}}, {"log1p", {20, 28}},
+  {"pow", {40, 50}}, {"cbrt", {25, 30}}, {"hypot", {15, 12}},
+  {"erf", {30, 40}}, {"erfc", {35, 50}}, {"lgamma", {60, 100}}, {"tgamma", {60, 100}},
+  {"fmod", {20, 25}}, {"sqrt", {6, 6}},
+};
+
+class MathCostTable {
+  StringMap<MathCallCost> costs;
+  StringMap<MeasuredMathCost> measured; // "<isa> <impl>"
+
+  void addMeasured(StringRef isa, StringRef impl, MeasuredMathCost cost) {
+    measured[(isa + " " + impl).str()] = cost;
+  }
+
+  void read(const char * costPath) {
+    auto bufferOrErr = MemoryBuffer::getFile(costPath);
+    if (!bufferOrErr) {
+      errs() << "RV_MATH_COSTS: could not read " << costPath << "\n";
+      return;
+    }
+    StringRef text = (*bufferOrErr)->getBuffer();
+    while (!text.empty()) {
+      StringRef line;
+      std::tie(line, text) = text.split('\n');
+      line = line.split('#').first.trim();
+      if (line.empty()) continue;
+
+      SmallVector<StringRef, 5> fields;
+      line.split(fields, ' ', -1, false);
+      if (fields.size() == 5) {
+        MeasuredMathCost cost{nullptr, nullptr, 0.0, 0.0, 0.0};
+        if (!fields[2].getAsDouble(cost.scalarCycles) && !fields[3].getAsDouble(cost.vectorCycles) &&
+            !fields[4].getAsDouble(cost.maxULPError)) {
+          addMeasured(fields[0], fields[1], cost);
+          continue;
+        }
+      }
+      MathCallCost cost;
+      if (fields.size() != 3 || fields[1].getAsDouble(cost.scalarCost) || fields[2].getAsDouble(cost.vectorCost)) {
+        errs() << "RV_MATH_COSTS: malformed line '" << line << "'\n";
+        continue;
+      }
+      costs[fields[0]] = cost;
+    }
+  }
+
+public:
+  MathCostTable() {
+    for (const auto & entry : ReferenceMathCosts) costs[entry.name] = entry.cost;
+    for (const auto & entry : MeasuredMathCosts) {
+      if (*entry.impl) addMeasured(entry.isa, entry.impl, entry);
+    }
+    if (const char * costPath = getenv("RV_MATH_COSTS")) read(costPath);
+  }
+
+  // \p funcName, its float variant (sinf) or llvm.<func> intrinsic
+  const MathCallCost * lookup(StringRef funcName) const {
+    StringRef baseName = funcName;
+    if (baseName.startswith("llvm.")) baseName = baseName.drop_front(5).split('.').first;
+    auto it = costs.find(baseName);
+    if (it == costs.end() && baseName.endswith("f")) it = costs.find(baseName.drop_back(1));
+    return it != costs.end() ? &it->second : nullptr;
+  }
+
+  // the measurement of the implementation \p impl on \p isa
+  const MeasuredMathCost * lookupMeasured(StringRef isa, StringRef impl) const {
+    if (isa.empty() || impl.empty()) return nullptr;
+    auto it = measured.find((isa + " " + impl).str());
+    return it != measured.end() ? &it->second : nullptr;
+  }
+};
+
+} // anonymous namespace
+
+void
+SetMathCallCosts(FunctionResolver & resolver, StringRef funcName, const FunctionType & scaFuncTy,
+                 int vectorWidth, unsigned registerBits, StringRef isa, StringRef impl) {
+  static std::once_flag loaded;
+  static std::unique_ptr<MathCostTable> costTable;
+  std::call_once(loaded, [] { costTable.reset(new MathCostTable()); });
+
+  // measured per element on this ISA
+  unsigned numTransfers = scaFuncTy.getNumParams() + 1;
+  if (const auto * measured = costTable->lookupMeasured(isa, impl)) {
+    if (vectorWidth <= 0) return;
+    resolver.setCostEstimates(FunctionCost{vectorWidth * measured->vectorCycles},
+                              FunctionCost{vectorWidth * (measured->scalarCycles + numTransfers)});
+    return;
+  }
+
+  const auto * cost = costTable->lookup(funcName);
+  unsigned elemBits = scaFuncTy.getReturnType()->getScalarSizeInBits();
+  if (!cost || vectorWidth <= 0 || elemBits == 0 || registerBits == 0) return;
+
+  // one call per register, each lane of a replicated call extracts its operands and inserts its result
+  unsigned numRegisters = std::max<unsigned>(1, (vectorWidth * elemBits + registerBits - 1) / registerBits);
+  resolver.setCostEstimates(FunctionCost{numRegisters * cost->vectorCost},
+                            FunctionCost{vectorWidth * (cost->scalarCost + numTransfers)});
+}
+
 ResolverService::~ResolverService()
 {}
 
@@ -10,6 +10,7 @@
 #include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/IR/InstIterator.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Dominators.h>
 #include <llvm/Analysis/PostDominators.h>
@@ -17,6 +18,10 @@
 #include <llvm/Analysis/ScalarEvolution.h>
 #include <llvm/Analysis/MemoryDependenceAnalysis.h>
 #include <llvm/Analysis/BranchProbabilityInfo.h>
+#include <llvm/Transforms/Utils/CodeExtractor.h>
+#if LLVM_VERSION_MAJOR >= 16
+#include <llvm/IR/ProfDataUtils.h>
+#endif
 #include <llvm/Passes/PassBuilder.h>
 #include "llvm/Transforms/Utils/LCSSA.h"
 
@@ -33,8 +38,16 @@
 #include "report.h"
 
 #include <llvm/IR/Verifier.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <algorithm>
+#include <map>
 #include <vector>
 #include <sstream>
+#include <mutex>
 
 #if 1
 #define IF_DEBUG_SLEEF IF_DEBUG
@@ -177,6 +190,12 @@ static const unsigned char** sleefModuleBuffers[] = {
     &advsimd_dp_Buffer,
 };
 
+// buffer names, also the file names of the external bitcode (RV_VECMATH_DIR)
+static const char * sleefModuleNames[] = {
+    "vla_sp", "sse_sp", "avx_sp", "avx2_sp", "avx512_sp", "advsimd_sp",
+    "vla_dp", "sse_dp", "avx_dp", "avx2_dp", "avx512_dp", "advsimd_dp",
+};
+
 static const size_t extraModuleBufferLens[] = {
     0, // VLA
     0, // SSE
@@ -195,19 +214,130 @@ static const unsigned char** extraModuleBuffers[] = {
     &advsimd_extras_Buffer,
 };
 
+static const char * extraModuleNames[] = {
+    nullptr, nullptr, nullptr, "avx2_extras", "avx512_extras", "advsimd_extras",
+};
 
+#ifndef RV_VECMATH_VERSION
+#define RV_VECMATH_VERSION "unversioned"
+#endif
 
-static Module *sleefModules[SLEEF_Enum_Entries * 2];
-static Module *extraModules[SLEEF_Enum_Entries * 2];
+// External bitcode (RV_VECMATH_DIR=<dir>): <dir>/<RV_VECMATH_VERSION>/<buffer name>.bc replaces the embedded
+// buffer. The files are memory-mapped once per process and never released (lazy modules read their function
+// bodies from them), so parallel compiler processes share the bytes through the page cache.
+static const MemoryBuffer *
+requestExternalBitcode(StringRef bufferName) {
+  static const char * vecmathDir = getenv("RV_VECMATH_DIR");
+  if (!vecmathDir) return nullptr;
+
+  static std::mutex externalMutex;
+  static auto * externalFiles = new StringMap<std::unique_ptr<MemoryBuffer>>();
+  std::lock_guard<std::mutex> guard(externalMutex);
+  auto itInserted = externalFiles->try_emplace(bufferName);
+  auto & file = itInserted.first->second;
+  if (!itInserted.second) return file.get();
+
+  SmallString<128> path(vecmathDir);
+  sys::path::append(path, RV_VECMATH_VERSION, bufferName + ".bc");
+  auto fileOrErr = MemoryBuffer::getFile(path, /* IsText */ false, /* RequiresNullTerminator */ false);
+  if (!fileOrErr) {
+    Report() << "vecmath: " << path << " n/a, using the builtin " << bufferName << "\n";
+    return nullptr;
+  }
+  file = std::move(*fileOrErr);
+  return file.get();
+}
 
-static Module &requestSharedModule(LLVMContext &Ctx) {
-  static Module *SharedModule = nullptr;
+// lazy module of the vecmath buffer \p bufferName, from RV_VECMATH_DIR if available
+static Module *
+createVecmathModule(StringRef bufferName, const unsigned char ** buffer, size_t length, LLVMContext & Ctx) {
+  if (const auto * file = requestExternalBitcode(bufferName))
+    return createLazyModuleFromBuffer(file->getBufferStart(), file->getBufferSize(), Ctx);
+  return createLazyModuleFromBuffer(reinterpret_cast<const char*>(buffer), length, Ctx);
+}
+
+
+
+// Vector math modules parsed into one LLVMContext. Like any other IR, they may
+// only be touched by the thread that currently uses the context.
+// The owners (SLEEF resolvers, retainSleefModules handles) share the modules,
+// the last one frees them. Owners must not outlive the context.
+struct VecmathModules {
+  LLVMContext & context;
+  Module *sleefModules[SLEEF_Enum_Entries * 2] = {};
+  Module *extraModules[SLEEF_Enum_Entries] = {};
+  Module *sharedModule = nullptr;
+  Module *crtModule = nullptr;
+
+  VecmathModules(LLVMContext & _context)
+  : context(_context)
+  {}
+
+  ~VecmathModules() {
+    for (auto *mod : sleefModules) delete mod;
+    for (auto *mod : extraModules) delete mod;
+    delete sharedModule;
+    delete crtModule;
+  }
+};
+
+// Process-wide registry of the per-context modules. It does not own them: an
+// entry of a destroyed context has expired with its owners, a new context at
+// the same address gets fresh modules.
+using VecmathCache = DenseMap<const LLVMContext*, std::weak_ptr<VecmathModules>>;
+static std::mutex vecmathCacheMutex;
+
+static VecmathCache &getVecmathCache() {
+  static VecmathCache cache;
+  return cache;
+}
+
+static std::shared_ptr<VecmathModules> requestVecmathModules(LLVMContext &Ctx) {
+  std::lock_guard<std::mutex> guard(vecmathCacheMutex);
+  auto &entry = getVecmathCache()[&Ctx];
+  auto modules = entry.lock();
+  if (!modules) {
+    modules = std::make_shared<VecmathModules>(Ctx);
+    entry = modules;
+  }
+  return modules;
+}
+
+std::shared_ptr<VecmathModules> retainSleefModules(LLVMContext &Ctx) {
+  return requestVecmathModules(Ctx);
+}
+
+void releaseSleefModules(LLVMContext &Ctx) {
+  std::lock_guard<std::mutex> guard(vecmathCacheMutex);
+  getVecmathCache().erase(&Ctx);
+}
+
+#ifdef RV_ENABLE_CRT
+extern const unsigned char * crt_Buffer;
+extern const size_t crt_BufferLen;
+#endif
+
+std::shared_ptr<Module> requestCompilerRTModule(LLVMContext &Ctx) {
+#ifdef RV_ENABLE_CRT
+  auto modules = requestVecmathModules(Ctx);
+  auto *&CRTModule = modules->crtModule;
+  if (!CRTModule)
+    CRTModule = createVecmathModule("crt", &crt_Buffer, crt_BufferLen, Ctx);
+  if (!CRTModule) return nullptr;
+  // shares the ownership of all modules of Ctx
+  return std::shared_ptr<Module>(modules, CRTModule);
+#else
+  return nullptr; // compiler-rt not available as bc module
+#endif
+}
+
+static std::shared_ptr<Module> requestSharedModule(LLVMContext &Ctx) {
+  auto modules = requestVecmathModules(Ctx);
+  auto *&SharedModule = modules->sharedModule;
   if (!SharedModule)
-    SharedModule =
-        createModuleFromBuffer(reinterpret_cast<const char *>(&rempitab_Buffer),
-                               rempitab_BufferLen, Ctx);
+    SharedModule = createVecmathModule("rempitab", &rempitab_Buffer, rempitab_BufferLen, Ctx);
   assert(SharedModule);
-  return *SharedModule;
+  return std::shared_ptr<Module>(modules, SharedModule);
 }
 
 const LinkerCallback SharedModuleLookup = [](GlobalValue& GV, Module& M) -> Value * {
@@ -225,8 +355,8 @@ const LinkerCallback SharedModuleLookup = [](GlobalValue& GV, Module& M) -> Valu
     return nullptr;
 
   // Lookup symbol in shared 'rempitab' module
-  auto &SharedMod = requestSharedModule(M.getContext());
-  auto *SharedGV = SharedMod.getNamedValue(GV.getName());
+  auto SharedMod = requestSharedModule(M.getContext());
+  auto *SharedGV = SharedMod->getNamedValue(GV.getName());
   // N/a in the shared module -> back to the original source.
   if (!SharedGV)
     return nullptr;
@@ -278,7 +408,7 @@ InitSleefMappings(PlainVecDescVector & archMappings, int floatWidth, int doubleW
           {"frfrexp", "xfrfrexp", doubleWidth},
           {"expfrexp", "xexpfrexp", doubleWidth},
           {"fmod", "xfmod", doubleWidth},
-          {"modf", "xmodf", floatWidth},
+          {"modf", "xmodf", doubleWidth},
 
           {"llvm.floor.f32", "xfloorf", floatWidth},
           {"llvm.fabs.f32", "xfabsf", floatWidth},
@@ -290,6 +420,16 @@ InitSleefMappings(PlainVecDescVector & archMappings, int floatWidth, int doubleW
           {"llvm.copysign.f64", "xcopysign", doubleWidth},
           {"llvm.minnum.f64", "xfmin", doubleWidth},
           {"llvm.maxnum.f64", "xfmax", doubleWidth},
+          {"llvm.fma.f32", "xfmaf", floatWidth},
+          {"llvm.trunc.f32", "xtruncf", floatWidth},
+          {"llvm.ceil.f32", "xceilf", floatWidth},
+          {"llvm.round.f32", "xroundf", floatWidth},
+          {"llvm.rint.f32", "xrintf", floatWidth},
+          {"llvm.fma.f64", "xfma", doubleWidth},
+          {"llvm.trunc.f64", "xtrunc", doubleWidth},
+          {"llvm.ceil.f64", "xceil", doubleWidth},
+          {"llvm.round.f64", "xround", doubleWidth},
+          {"llvm.rint.f64", "xrint", doubleWidth},
 
 #if 0
         // TODO VLA random number generator
@@ -327,6 +467,7 @@ InitSleefMappings(PlainVecDescVector & archMappings, int floatWidth, int doubleW
             ALSO_FINITE(expf,xexpf,floatWidth),
             ALSO_FINITE(expm1f,xexpm1f, floatWidth),
             ALSO_FINITE(log10f,xlog10f,floatWidth),
+            ALSO_FINITE(log2f,xlog2f,floatWidth),
             ALSO_FINITE(log1pf,xlog1pf,floatWidth),
             ALSO_FINITE(logf,xlogf, floatWidth),
             ALSO_FINITE(powf,xpowf,floatWidth),
@@ -362,6 +503,7 @@ InitSleefMappings(PlainVecDescVector & archMappings, int floatWidth, int doubleW
             {"exp10", "xexp10", doubleWidth},
             {"expm1", "xexpm1", doubleWidth},
             {"log10", "xlog10", doubleWidth},
+            {"log2", "xlog2", doubleWidth},
             {"log1p", "xlog1p", doubleWidth},
             {"sqrt", "xsqrt", doubleWidth},
             {"hypot", "xhypot", doubleWidth},
@@ -378,6 +520,7 @@ InitSleefMappings(PlainVecDescVector & archMappings, int floatWidth, int doubleW
             {"llvm.sqrt.f32", "xsqrtf", floatWidth},
             {"llvm.exp2.f32", "xexp2f", floatWidth},
             {"llvm.log10.f32", "xlog10f", floatWidth},
+            {"llvm.log2.f32", "xlog2f", floatWidth},
             {"llvm.sin.f64", "xsin", doubleWidth},
             {"llvm.cos.f64", "xcos", doubleWidth},
             {"llvm.log.f64", "xlog", doubleWidth},
@@ -385,7 +528,8 @@ InitSleefMappings(PlainVecDescVector & archMappings, int floatWidth, int doubleW
             {"llvm.pow.f64", "xpow", doubleWidth},
             {"llvm.sqrt.f64", "xsqrt", doubleWidth},
             {"llvm.exp2.f64", "xexp2", doubleWidth},
-            {"llvm.log10.f64", "xlog10", doubleWidth}
+            {"llvm.log10.f64", "xlog10", doubleWidth},
+            {"llvm.log2.f64", "xlog2", doubleWidth}
         };
         archMappings.insert(archMappings.end(), VecFuncs.begin(), VecFuncs.end());
 }
@@ -413,8 +557,29 @@ class SleefResolverService : public ResolverService {
 
   std::vector<ArchFunctionList*> archLists;
 
+  // scalar function name -> candidate mappings in order of precedence (arch order, then list order)
+  using MappingCandidate = std::pair<ArchFunctionList*, const PlainVecDesc*>;
+  llvm::StringMap<llvm::SmallVector<MappingCandidate, 4>> mappingIndex;
+
+  void buildMappingIndex() {
+    mappingIndex.clear();
+    for (auto * archList : archLists) {
+      for (const auto & vd : archList->commonVectorMappings) {
+        mappingIndex[vd.scalarFnName].emplace_back(archList, &vd);
+      }
+    }
+  }
+
   Config config;
 
+  // the vector math modules of the context this service resolves for, kept loaded while it lives
+  std::shared_ptr<VecmathModules> vecmathModules;
+
+  VecmathModules & requestModules(LLVMContext & Ctx) {
+    if (!vecmathModules || &vecmathModules->context != &Ctx) vecmathModules = requestVecmathModules(Ctx);
+    return *vecmathModules;
+  }
+
 
 public:
   void
@@ -433,6 +598,7 @@ public:
   SleefResolverService(PlatformInfo & _platInfo, const Config & _config)
   : platInfo(_platInfo)
   , config(_config)
+  , vecmathModules(requestVecmathModules(_platInfo.getContext()))
   {
   // ARM
 #ifdef RV_ENABLE_ADVSIMD
@@ -477,13 +643,21 @@ public:
 
     archLists.push_back(vlaArch);
 
+    buildMappingIndex();
   }
 
   ~SleefResolverService() {
     for (auto * archList : archLists) delete archList;
   }
 
-  std::unique_ptr<FunctionResolver> resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) override;
+  std::unique_ptr<FunctionResolver> resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) override {
+    return resolveWithAccuracy(funcName, scaFuncTy, argShapes, vectorWidth, hasPredicate, -1, destModule);
+  }
+
+  std::unique_ptr<FunctionResolver> resolveWithAccuracy(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, int maxULPError, llvm::Module & destModule) override;
+
+  // half/bfloat functions: native FP16 intrinsics or the f32 implementation
+  std::unique_ptr<FunctionResolver> resolveHalfPrecision(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, llvm::Type & halfTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, int maxULPError, llvm::Module & destModule);
 };
 
 
@@ -493,42 +667,189 @@ public:
 
 
 
+// wraps \p implFunc with a trailing <vectorWidth x i1> mask parameter.
+// Inactive lanes receive safe inputs (1.0 or 0) so they never take the slow
+// paths (denormals, huge argument range reduction) of the implementation.
+static Function &
+RequestMaskedWrapper(Function & implFunc, int vectorWidth) {
+  auto & mod = *implFunc.getParent();
+  std::string wrapperName = implFunc.getName().str() + "_masked";
+  auto * existingFunc = mod.getFunction(wrapperName);
+  if (existingFunc) return *existingFunc;
+
+  auto & ctx = implFunc.getContext();
+  auto * implFuncTy = implFunc.getFunctionType();
+  SmallVector<Type*, 4> paramTys(implFuncTy->param_begin(), implFuncTy->param_end());
+  paramTys.push_back(FixedVectorType::get(Type::getInt1Ty(ctx), vectorWidth));
+  auto * wrapperTy = FunctionType::get(implFuncTy->getReturnType(), paramTys, false);
+
+  auto * wrapper = Function::Create(wrapperTy, GlobalValue::InternalLinkage, wrapperName, &mod);
+  wrapper->copyAttributesFrom(&implFunc);
+  wrapper->setLinkage(GlobalValue::InternalLinkage);
+  wrapper->setCallingConv(CallingConv::C);
+  wrapper->addFnAttr(Attribute::AlwaysInline);
+  wrapper->setDoesNotRecurse();
+
+  IRBuilder<> builder(BasicBlock::Create(ctx, "entry", wrapper));
+  Value * mask = wrapper->getArg(implFunc.arg_size());
+  SmallVector<Value*, 4> safeArgs;
+  for (auto & arg : implFunc.args()) {
+    Value * wrapperArg = wrapper->getArg(arg.getArgNo());
+    wrapperArg->setName(arg.getName());
+    auto * argVecTy = dyn_cast<FixedVectorType>(arg.getType());
+    if (!argVecTy || (int) argVecTy->getNumElements() != vectorWidth) {
+      safeArgs.push_back(wrapperArg);
+      continue;
+    }
+    Constant * safeVal = argVecTy->getElementType()->isFloatingPointTy()
+                       ? ConstantFP::get(argVecTy, 1.0)
+                       : Constant::getNullValue(argVecTy);
+    safeArgs.push_back(builder.CreateSelect(mask, wrapperArg, safeVal, "safe"));
+  }
+
+  auto * implCall = builder.CreateCall(&implFunc, safeArgs);
+  implCall->setCallingConv(implFunc.getCallingConv());
+  if (wrapperTy->getReturnType()->isVoidTy()) {
+    builder.CreateRetVoid();
+  } else {
+    builder.CreateRet(implCall);
+  }
+  return *wrapper;
+}
+
+// A taken branch into a slow path of SLEEF (LIKELY/UNLIKELY annotated) needs
+// at least this many not taken ones.
+static const uint64_t MinHotColdRatio = 64;
+
+// whether \p block reads the Payne-Hanek reduction table (Sleef_rempitab)
+static bool
+ReadsRemPiTable(const BasicBlock & block) {
+  for (auto & inst : block) {
+    for (auto & op : inst.operands()) {
+      auto * gv = dyn_cast<GlobalVariable>(op->stripPointerCasts());
+      if (gv && gv->getName().contains("rempitab")) return true;
+    }
+  }
+  return false;
+}
+
+// the successor of \p branch (taken if any lane needs the slow path) that almost never executes
+static BasicBlock *
+GetColdSuccessor(BranchInst & branch) {
+  if (!branch.isConditional()) return nullptr;
+  uint64_t trueWeight, falseWeight;
+#if LLVM_VERSION_MAJOR >= 16
+  bool hasWeights = extractBranchWeights(branch, trueWeight, falseWeight);
+#else
+  bool hasWeights = branch.extractProfMetadata(trueWeight, falseWeight);
+#endif
+  if (hasWeights && trueWeight * MinHotColdRatio <= falseWeight) return branch.getSuccessor(0);
+  if (hasWeights && falseWeight * MinHotColdRatio <= trueWeight) return branch.getSuccessor(1);
+  // the large argument reduction is cold without annotation
+  for (int i = 0; i < 2; ++i) {
+    auto * succ = branch.getSuccessor(i);
+    if (ReadsRemPiTable(*succ) && !ReadsRemPiTable(*branch.getSuccessor(1 - i))) return succ;
+  }
+  return nullptr;
+}
+
+// Split the linked SLEEF function \p implFunc into its fast path (stays in
+// \p implFunc, small enough to inline) and out-of-line cold functions for the
+// slow paths. The branches into those test whether any lane needs the slow
+// path, so the vector code calls them under rv_any(needs_slow_path).
+// \returns the number of outlined slow paths
+static unsigned
+OutlineSlowPaths(Function & implFunc) {
+  unsigned numOutlined = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    DominatorTree DT(implFunc);
+    for (auto & block : implFunc) {
+      auto * branch = dyn_cast<BranchInst>(block.getTerminator());
+      auto * coldEntry = branch ? GetColdSuccessor(*branch) : nullptr;
+      if (!coldEntry || !coldEntry->getSinglePredecessor()) continue;
+
+      // the slow path: everything the cold successor dominates
+      SetVector<BasicBlock*> coldBlocks;
+      SmallVector<DomTreeNode*, 8> stack{DT.getNode(coldEntry)};
+      while (!stack.empty()) {
+        auto * node = stack.pop_back_val();
+        coldBlocks.insert(node->getBlock());
+        for (auto * child : *node) stack.push_back(child);
+      }
+
+      CodeExtractorAnalysisCache CEAC(implFunc);
+      CodeExtractor CE(coldBlocks.getArrayRef(), &DT, false, nullptr, nullptr, nullptr, false, false, nullptr, "cold");
+      if (!CE.isEligible()) continue;
+      auto * coldFunc = CE.extractCodeRegion(CEAC);
+      if (!coldFunc) continue;
+
+      coldFunc->setLinkage(GlobalValue::InternalLinkage);
+      coldFunc->addFnAttr(Attribute::Cold);
+      coldFunc->addFnAttr(Attribute::NoInline);
+      coldFunc->setDoesNotRecurse();
+      ++numOutlined;
+      changed = true;
+      break; // the dominator tree is stale
+    }
+  }
+  return numOutlined;
+}
+
 // simply links-in the pre-vectorized SLEEF function
 class SleefLookupResolver : public FunctionResolver {
   VectorShape resShape;
   Function & vecFunc;
   std::string destFuncName;
+  bool hasPredicate;
+  int vectorWidth;
+  bool masked;
+  bool splitSlowPaths;
 
   public:
-    SleefLookupResolver(Module & _targetModule, VectorShape resShape, Function & _vecFunc, std::string _destFuncName)
+    SleefLookupResolver(Module & _targetModule, VectorShape resShape, Function & _vecFunc, std::string _destFuncName, bool _hasPredicate = false, int _vectorWidth = 0, bool _splitSlowPaths = false)
     : FunctionResolver(_targetModule)
     , resShape(resShape)
     , vecFunc(_vecFunc)
     , destFuncName(_destFuncName)
+    , hasPredicate(_hasPredicate)
+    , vectorWidth(_vectorWidth)
+    , masked(false)
+    , splitSlowPaths(_splitSlowPaths)
   {}
 
   CallPredicateMode getCallSitePredicateMode() override {
-    // FIXME this is not entirely true for vector math
-    return CallPredicateMode::SafeWithoutPredicate;
+    // inactive lanes are blended with safe inputs by the masked wrapper
+    return masked ? CallPredicateMode::PredicateArg : CallPredicateMode::SafeWithoutPredicate;
   }
 
   // mask position (if any)
   int getMaskPos() override {
-    return -1; // FIXME vector math is unpredicated
+    return masked ? (int) vecFunc.arg_size() : -1;
   }
 
   llvm::Function&
   requestVectorized() override {
-    auto * existingFunc = targetModule.getFunction(destFuncName);
-    if (existingFunc) {
-      return *existingFunc;
+    auto * implFunc = targetModule.getFunction(destFuncName);
+    if (!implFunc) {
+      // Picks 'Sleef_rempitab' from the shared module.
+      implFunc = &cloneFunctionIntoModule(
+          vecFunc, targetModule, destFuncName, SharedModuleLookup);
+      implFunc->setDoesNotRecurse(); // SLEEF math does not recurse
+
+      // the call site decides whether the remaining fast path is inlined (NatBuilder::vectorizeCallInstruction)
+      unsigned numSlowPaths = splitSlowPaths ? OutlineSlowPaths(*implFunc) : 0;
+      if (numSlowPaths > 0) {
+        implFunc->addFnAttr("rv-fast-path-size", std::to_string(implFunc->getInstructionCount()));
+        Report() << "sleef: " << destFuncName << ": outlined " << numSlowPaths << " slow paths\n";
+      }
     }
 
-    // Picks 'Sleef_rempitab' from the shared module.
-    Function &clonedVecFunc = cloneFunctionIntoModule(
-        vecFunc, targetModule, destFuncName, SharedModuleLookup);
-    clonedVecFunc.setDoesNotRecurse(); // SLEEF math does not recurse
-    return clonedVecFunc;
+    // intrinsics (sqrt) have no slow paths to avoid
+    if (!hasPredicate || implFunc->isDeclaration()) return *implFunc;
+    masked = true;
+    return RequestMaskedWrapper(*implFunc, vectorWidth);
   }
 
   // result shape of function @funcName in target module @module
@@ -547,10 +868,12 @@ struct SleefVLAResolver : public FunctionResolver {
   VectorShapeVec argShapes;
   VectorShape resShape;
   int vectorWidth;
+  bool hasPredicate;
+  bool masked;
 
   std::string vecFuncName;
 
-  SleefVLAResolver(PlatformInfo & platInfo, std::string baseName, Config config, Function & _scaFunc, const VectorShapeVec & _argShapes, int _vectorWidth)
+  SleefVLAResolver(PlatformInfo & platInfo, std::string baseName, Config config, Function & _scaFunc, const VectorShapeVec & _argShapes, int _vectorWidth, bool _hasPredicate)
   : FunctionResolver(platInfo.getModule())
   , vectorizer(platInfo, config)
   , vecInfo(nullptr)
@@ -560,23 +883,32 @@ struct SleefVLAResolver : public FunctionResolver {
   , argShapes(_argShapes)
   , resShape(VectorShape::undef())
   , vectorWidth(_vectorWidth)
+  , hasPredicate(_hasPredicate)
+  , masked(false)
   , vecFuncName(platInfo.createMangledVectorName(baseName, argShapes, vectorWidth, -1))
   {
     IF_DEBUG_SLEEF { errs() << "VLA: " << vecFuncName << "\n"; }
   }
 
   CallPredicateMode getCallSitePredicateMode() override {
-    // FIXME this is not entirely true for vector math
-    return CallPredicateMode::SafeWithoutPredicate;
+    // inactive lanes are blended with safe inputs by the masked wrapper
+    return masked ? CallPredicateMode::PredicateArg : CallPredicateMode::SafeWithoutPredicate;
   }
 
   // mask position (if any)
   int getMaskPos() override {
-    return -1; // FIXME vector math is unpredicated
+    return masked ? (int) scaFunc.arg_size() : -1;
   }
 
   // materialized the vectorized function in the module @insertInto and returns a reference to it
   llvm::Function& requestVectorized() override {
+    auto & implFunc = requestUnmaskedVectorized();
+    if (!hasPredicate || implFunc.isDeclaration()) return implFunc;
+    masked = true;
+    return RequestMaskedWrapper(implFunc, vectorWidth);
+  }
+
+  llvm::Function& requestUnmaskedVectorized() {
     if (vecFunc) return *vecFunc;
     vecFunc = targetModule.getFunction(vecFuncName);
     if (vecFunc) return *vecFunc;
@@ -746,29 +1078,166 @@ GetLeastPreciseImpl(Module & mod, const std::string & funcPrefix, const unsigned
   return currBest;
 }
 
+// half/bfloat math
+static bool
+IsHalfType(const Type & type) { return type.isHalfTy() || type.isBFloatTy(); }
+
+static Type *
+GetHalfType(const FunctionType & funcTy) {
+  if (IsHalfType(*funcTy.getReturnType())) return funcTy.getReturnType();
+  for (auto * paramTy : funcTy.params()) {
+    if (IsHalfType(*paramTy)) return paramTy;
+  }
+  return nullptr;
+}
+
+// intrinsics that map to single instructions with native half arithmetic
+static bool
+HasNativeHalfInstruction(Intrinsic::ID id) {
+  switch (id) {
+    default: return false;
+    case Intrinsic::sqrt:
+    case Intrinsic::fabs:
+    case Intrinsic::copysign:
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+    case Intrinsic::minnum:
+    case Intrinsic::maxnum:
+    case Intrinsic::floor:
+    case Intrinsic::ceil:
+    case Intrinsic::trunc:
+    case Intrinsic::rint:
+    case Intrinsic::nearbyint:
+      return true;
+  }
+}
+
+// llvm.exp.f16 -> llvm.exp.f32
+static std::string
+GetFloatIntrinsicName(StringRef funcName) {
+  SmallVector<StringRef, 4> parts;
+  funcName.split(parts, '.');
+  std::string floatName;
+  for (auto part : parts) {
+    if (!floatName.empty()) floatName += ".";
+    floatName += (part == "f16" || part == "bf16") ? "f32" : part.str();
+  }
+  return floatName;
+}
+
+// implements a half/bfloat function with the vector variant of its f32 counterpart
+class HalfPromotionResolver : public FunctionResolver {
+  std::unique_ptr<FunctionResolver> floatResolver;
+  Type & halfTy;
+
+public:
+  HalfPromotionResolver(Module & _targetModule, std::unique_ptr<FunctionResolver> _floatResolver, Type & _halfTy)
+  : FunctionResolver(_targetModule)
+  , floatResolver(std::move(_floatResolver))
+  , halfTy(_halfTy)
+  {}
+
+  CallPredicateMode getCallSitePredicateMode() override { return floatResolver->getCallSitePredicateMode(); }
+  int getMaskPos() override { return floatResolver->getMaskPos(); }
+  VectorShape requestResultShape() override { return floatResolver->requestResultShape(); }
+
+  // the f32 call (the conversions are cheap next to it)
+  FunctionCost requestCostEstimate() override { return floatResolver->requestCostEstimate(); }
+  FunctionCost requestReplicationCostEstimate() override { return floatResolver->requestReplicationCostEstimate(); }
+
+  llvm::Function&
+  requestVectorized() override {
+    auto & floatFunc = floatResolver->requestVectorized();
+    std::string wrapperName = floatFunc.getName().str() + (halfTy.isBFloatTy() ? "_bf16" : "_f16");
+    auto * existingFunc = targetModule.getFunction(wrapperName);
+    if (existingFunc) return *existingFunc;
+
+    // the signature of floatFunc with half in place of float
+    auto narrowType = [&](Type * type) -> Type* {
+      if (type->isFloatTy()) return &halfTy;
+      auto * vecTy = dyn_cast<FixedVectorType>(type);
+      if (vecTy && vecTy->getElementType()->isFloatTy()) return FixedVectorType::get(&halfTy, vecTy->getNumElements());
+      return type;
+    };
+    auto * floatFuncTy = floatFunc.getFunctionType();
+    SmallVector<Type*, 4> paramTys;
+    for (auto * paramTy : floatFuncTy->params()) paramTys.push_back(narrowType(paramTy));
+    auto * wrapperTy = FunctionType::get(narrowType(floatFuncTy->getReturnType()), paramTys, false);
+
+    auto * wrapper = Function::Create(wrapperTy, GlobalValue::InternalLinkage, wrapperName, &targetModule);
+    wrapper->addFnAttr(Attribute::AlwaysInline);
+    wrapper->setDoesNotRecurse();
+
+    IRBuilder<> builder(BasicBlock::Create(targetModule.getContext(), "entry", wrapper));
+    SmallVector<Value*, 4> floatArgs;
+    for (auto & arg : wrapper->args()) {
+      Type * floatTy = floatFuncTy->getParamType(arg.getArgNo());
+      floatArgs.push_back(floatTy == arg.getType() ? (Value*) &arg : builder.CreateFPExt(&arg, floatTy));
+    }
+    auto * floatCall = builder.CreateCall(&floatFunc, floatArgs);
+    floatCall->setCallingConv(floatFunc.getCallingConv());
+    if (wrapperTy->getReturnType()->isVoidTy()) {
+      builder.CreateRetVoid();
+    } else if (wrapperTy->getReturnType() == floatCall->getType()) {
+      builder.CreateRet(floatCall);
+    } else {
+      builder.CreateRet(builder.CreateFPTrunc(floatCall, wrapperTy->getReturnType()));
+    }
+    return *wrapper;
+  }
+};
+
+std::unique_ptr<FunctionResolver>
+SleefResolverService::resolveHalfPrecision(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, Type & halfTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, int maxULPError, llvm::Module & destModule) {
+  if (!funcName.startswith("llvm.")) return nullptr;
+
+  // native FP16 instructions
+  Intrinsic::ID id = Function::lookupIntrinsicID(funcName);
+  bool bitwiseOp = id == Intrinsic::fabs || id == Intrinsic::copysign;
+  if (halfTy.isHalfTy() && HasNativeHalfInstruction(id) && (config.useFP16 || bitwiseOp)) {
+    auto * vecTy = FixedVectorType::get(&halfTy, vectorWidth);
+    auto * vecFunc = Intrinsic::getDeclaration(&destModule, id, {vecTy});
+    return std::make_unique<SleefLookupResolver>(destModule, FunctionResolver::ComputeShape(argShapes), *vecFunc, vecFunc->getName().str());
+  }
+
+  // compute in f32 (3.5 ULP of f32 are far below half an ULP of half and bfloat)
+  auto & floatTy = *Type::getFloatTy(destModule.getContext());
+  auto widenType = [&](Type * type) { return IsHalfType(*type) ? &floatTy : type; };
+  SmallVector<Type*, 4> floatParamTys;
+  for (auto * paramTy : scaFuncTy.params()) floatParamTys.push_back(widenType(paramTy));
+  auto * floatFuncTy = FunctionType::get(widenType(scaFuncTy.getReturnType()), floatParamTys, false);
+
+  const int floatULPError = std::max<int>(maxULPError >= 0 ? maxULPError : config.maxULPErrorBound, 35);
+  auto floatResolver = platInfo.getResolver(GetFloatIntrinsicName(funcName), *floatFuncTy, argShapes, vectorWidth, hasPredicate, floatULPError);
+  if (!floatResolver) return nullptr;
+  IF_DEBUG_SLEEF { errs() << "sleef: " << funcName << " computed in f32\n"; }
+  return std::make_unique<HalfPromotionResolver>(destModule, std::move(floatResolver), halfTy);
+}
+
 std::unique_ptr<FunctionResolver>
-SleefResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) {
+SleefResolverService::resolveWithAccuracy(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, int maxULPError, llvm::Module & destModule) {
   IF_DEBUG_SLEEF { errs() << "SLEEFResolverService: " << funcName << " for width " << vectorWidth << "\n"; }
 
-  (void) hasPredicate; // FIXME use predicated versions
+  // call-site accuracy takes precedence over RV_ACCURACY
+  const unsigned ulpBound = maxULPError >= 0 ? maxULPError : config.maxULPErrorBound;
+
+  // SLEEF has no half precision functions
+  auto * halfTy = GetHalfType(scaFuncTy);
+  if (halfTy) return resolveHalfPrecision(funcName, scaFuncTy, *halfTy, argShapes, vectorWidth, hasPredicate, maxULPError, destModule);
 
   // Otw, start looking for a SIMD-ized implementation
   ArchFunctionList * archList = nullptr;
   PlainVecDesc funcDesc;
-  for (auto * candList : archLists) {
-    // query custom mappings with precedence
-    std::string funcNameStr = funcName.str();
-    for (const auto & vd : candList->commonVectorMappings) {
-       if (vd.scalarFnName == funcNameStr &&
-          ((vd.vectorWidth <= 0) || (vd.vectorWidth == vectorWidth)))
-       {
-         funcDesc = vd;
-         archList = candList;
-         break;
-       }
-    };
-
-    if (archList) break;
+  auto itCands = mappingIndex.find(funcName);
+  if (itCands != mappingIndex.end()) {
+    for (const auto & cand : itCands->second) {
+      const auto & vd = *cand.second;
+      if ((vd.vectorWidth <= 0) || (vd.vectorWidth == vectorWidth)) {
+        funcDesc = vd;
+        archList = cand.first;
+        break;
+      }
+    }
   }
   IF_DEBUG_SLEEF { errs() << "\tsleef: n/a\n"; }
   if (!archList) return nullptr;
@@ -792,11 +1261,11 @@ SleefResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType & sca
   bool isExtraFunc = funcDesc.vectorFnName.find("_extra") != std::string::npos;
   if (isExtraFunc) {
     int modIdx = (int) isa;
-    auto *& mod = extraModules[modIdx];
-    if (!mod) mod = createModuleFromBuffer(reinterpret_cast<const char*>(extraModuleBuffers[modIdx]), extraModuleBufferLens[modIdx], Ctx);
+    auto *& mod = requestModules(Ctx).extraModules[modIdx];
+    if (!mod) mod = createVecmathModule(extraModuleNames[modIdx], extraModuleBuffers[modIdx], extraModuleBufferLens[modIdx], Ctx);
     Function *vecFunc = mod->getFunction(sleefName);
     assert(vecFunc && "mapped extra function not found in module!");
-    return std::make_unique<SleefLookupResolver>(destModule, /* RNG result */ VectorShape::varying(), *vecFunc, funcDesc.vectorFnName);
+    return std::make_unique<SleefLookupResolver>(destModule, /* RNG result */ VectorShape::varying(), *vecFunc, funcDesc.vectorFnName, hasPredicate, vectorWidth);
   }
 
   // Skip for fast builtin functions // FIXME should be in its own target-dependent resolver
@@ -811,11 +1280,14 @@ SleefResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType & sca
 
   // Look in SLEEF module
   auto modIndex = sleefModuleIndex(isa, doublePrecision);
-  llvm::Module*& mod = sleefModules[modIndex]; // TODO const Module
+  llvm::Module*& mod = requestModules(Ctx).sleefModules[modIndex]; // TODO const Module
   if (!mod) {
-    mod = createModuleFromBuffer(reinterpret_cast<const char*>(sleefModuleBuffers[modIndex]), sleefModuleBufferLens[modIndex], Ctx);
+    // only the requested functions (and their callees) will be materialized
+    mod = createVecmathModule(sleefModuleNames[modIndex], sleefModuleBuffers[modIndex], sleefModuleBufferLens[modIndex], Ctx);
 
     IF_DEBUG {
+      if (llvm::Error Err = mod->materializeAll())
+        report_fatal_error(std::move(Err));
       bool brokenMod = verifyModule(*mod, &errs());
       if (brokenMod) abort();
     }
@@ -823,13 +1295,15 @@ SleefResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType & sca
 
   if (isa == SLEEF_VLA) {
     // on-the-fly vectorization module
-    Function *vlaFunc = GetLeastPreciseImpl(*mod, sleefName, config.maxULPErrorBound);
+    Function *vlaFunc = GetLeastPreciseImpl(*mod, sleefName, ulpBound);
     if (!vlaFunc) {
-      IF_DEBUG_SLEEF { errs() << "sleef: " << sleefName << " n/a with maxULPError: " << config.maxULPErrorBound << "\n"; }
+      IF_DEBUG_SLEEF { errs() << "sleef: " << sleefName << " n/a with maxULPError: " << ulpBound << "\n"; }
       return nullptr;
     }
 
-    return std::make_unique<SleefVLAResolver>(platInfo, vlaFunc->getName().str(), config, *vlaFunc, argShapes, vectorWidth);
+    auto vlaResolver = std::make_unique<SleefVLAResolver>(platInfo, vlaFunc->getName().str(), config, *vlaFunc, argShapes, vectorWidth, hasPredicate);
+    if (config.enableResolverCosts) SetMathCallCosts(*vlaResolver, funcName, scaFuncTy, vectorWidth, platInfo.getMaxVectorBits(), "vla", vlaFunc->getName());
+    return vlaResolver;
 
   } else {
     // these are pure functions
@@ -842,18 +1316,153 @@ SleefResolverService::resolve(llvm::StringRef funcName, llvm::FunctionType & sca
     }
 
     // we'll have to link in the function
-    Function *vecFunc = GetLeastPreciseImpl(*mod, sleefName, config.maxULPErrorBound);
+    Function *vecFunc = GetLeastPreciseImpl(*mod, sleefName, ulpBound);
     if (!vecFunc) {
-      IF_DEBUG_SLEEF { errs() << "sleef: " << sleefName << " n/a with maxULPError: " << config.maxULPErrorBound << "\n"; }
+      IF_DEBUG_SLEEF { errs() << "sleef: " << sleefName << " n/a with maxULPError: " << ulpBound << "\n"; }
       return nullptr;
     }
 
     std::string vecFuncName = vecFunc->getName().str() + "_" + archList->archSuffix;
-    return std::make_unique<SleefLookupResolver>(destModule, resShape, *vecFunc, vecFuncName);
+    auto lookupResolver = std::make_unique<SleefLookupResolver>(destModule, resShape, *vecFunc, vecFuncName, hasPredicate, vectorWidth, config.enableSleefColdSplit);
+    if (config.enableResolverCosts) SetMathCallCosts(*lookupResolver, funcName, scaFuncTy, vectorWidth, platInfo.getMaxVectorBits(), archList->archSuffix, vecFunc->getName());
+    return lookupResolver;
+  }
+}
+
+
+
+// decode a linked SLEEF implementation "x<sin|cos>[f][_u<ulp>]_<arch>"
+struct SleefTrigCall {
+  bool isSin;
+  bool isFloat;
+  std::string ulpSuffix;
+  SleefISA isa;
+  std::string archSuffix;
+};
+
+static bool
+DecodeSleefTrigCall(const CallInst & call, SleefTrigCall & trig) {
+  if (call.arg_size() != 1) return false;
+  const auto * callee = call.getCalledFunction();
+  if (!callee || callee->isDeclaration()) return false;
+
+  StringRef name = callee->getName();
+  if (name.consume_front("xsin")) trig.isSin = true;
+  else if (name.consume_front("xcos")) trig.isSin = false;
+  else return false;
+  trig.isFloat = name.consume_front("f");
+
+  trig.ulpSuffix.clear();
+  if (name.startswith("_u")) {
+    size_t ulpEnd = name.find('_', 2);
+    if (ulpEnd == StringRef::npos) return false;
+    trig.ulpSuffix = name.substr(0, ulpEnd).str();
+    name = name.drop_front(ulpEnd);
   }
+
+  // no VLA: its on-the-fly vectorized variants are mangled
+  if (!name.consume_front("_")) return false;
+  trig.archSuffix = name.str();
+  if (name == "sse") trig.isa = SLEEF_SSE;
+  else if (name == "avx") trig.isa = SLEEF_AVX;
+  else if (name == "avx2") trig.isa = SLEEF_AVX2;
+  else if (name == "avx512") trig.isa = SLEEF_AVX512;
+  else if (name == "advsimd") trig.isa = SLEEF_ADVSIMD;
+  else return false;
+  return true;
 }
 
+bool
+FuseSleefSinCos(Function & vecFunc) {
+  auto & destModule = *vecFunc.getParent();
+  auto & Ctx = vecFunc.getContext();
+  // the implementations are cloned into destModule, their modules only need to live during the fusion
+  auto vecmathModules = requestVecmathModules(Ctx);
+  size_t numFused = 0;
+
+  for (auto & block : vecFunc) {
+    // sin and cos calls per operand and implementation (in block order)
+    struct SinCosPair {
+      CallInst * sinCall;
+      CallInst * cosCall;
+      SleefTrigCall trig;
+    };
+    std::vector<SinCosPair> pairs;
+    std::map<std::pair<Value*, std::string>, size_t> pairIndex;
+
+    for (auto & inst : block) {
+      auto * call = dyn_cast<CallInst>(&inst);
+      SleefTrigCall trig;
+      if (!call || !DecodeSleefTrigCall(*call, trig)) continue;
+
+      std::string implKey = trig.archSuffix + (trig.isFloat ? "f" : "") + trig.ulpSuffix;
+      auto itPair = pairIndex.emplace(std::make_pair(call->getArgOperand(0), implKey), pairs.size());
+      if (itPair.second) pairs.push_back(SinCosPair{nullptr, nullptr, trig});
+      auto & pair = pairs[itPair.first->second];
+      auto *& slot = trig.isSin ? pair.sinCall : pair.cosCall;
+      if (!slot) slot = call;
+    }
+
+    for (auto & pair : pairs) {
+      if (!pair.sinCall || !pair.cosCall) continue;
+      const auto & trig = pair.trig;
+
+      // link in x<sincos>[f][_u<ulp>]
+      std::string implName = std::string("xsincos") + (trig.isFloat ? "f" : "") + trig.ulpSuffix;
+      std::string fusedName = implName + "_" + trig.archSuffix;
+      auto * fusedFunc = destModule.getFunction(fusedName);
+      if (!fusedFunc) {
+        int modIndex = sleefModuleIndex(trig.isa, !trig.isFloat);
+        if (sleefModuleBufferLens[modIndex] == 0) continue;
+        llvm::Module*& mod = vecmathModules->sleefModules[modIndex];
+        if (!mod) mod = createVecmathModule(sleefModuleNames[modIndex], sleefModuleBuffers[modIndex], sleefModuleBufferLens[modIndex], Ctx);
+        auto * implFunc = mod->getFunction(implName);
+        if (!implFunc) {
+          IF_DEBUG_SLEEF { errs() << "sleef: " << implName << " n/a for " << trig.archSuffix << "\n"; }
+          continue;
+        }
+        fusedFunc = &cloneFunctionIntoModule(*implFunc, destModule, fusedName, SharedModuleLookup);
+        fusedFunc->setDoesNotRecurse(); // SLEEF math does not recurse
+      }
+
+      auto * firstCall = pair.sinCall->comesBefore(pair.cosCall) ? pair.sinCall : pair.cosCall;
+      IRBuilder<> builder(firstCall);
+      auto * arg = firstCall->getArgOperand(0);
+      Value * sinVal = nullptr;
+      Value * cosVal = nullptr;
+
+      // x86 returns the {sin, cos} pair through memory, ADVSIMD in registers
+      if (fusedFunc->hasStructRetAttr()) {
+        auto * pairTy = fusedFunc->getParamStructRetType(0);
+        IRBuilder<> allocaBuilder(&*vecFunc.getEntryBlock().getFirstInsertionPt());
+        auto * pairAlloca = allocaBuilder.CreateAlloca(pairTy, nullptr, "sincos.ret");
+        if (auto paramAlign = fusedFunc->getParamAlign(0)) pairAlloca->setAlignment(*paramAlign);
+        auto * fusedCall = builder.CreateCall(fusedFunc, {pairAlloca, arg});
+        fusedCall->setAttributes(fusedFunc->getAttributes());
+        fusedCall->setCallingConv(fusedFunc->getCallingConv());
+        sinVal = builder.CreateLoad(pairTy->getStructElementType(0), builder.CreateStructGEP(pairTy, pairAlloca, 0), "sin");
+        cosVal = builder.CreateLoad(pairTy->getStructElementType(1), builder.CreateStructGEP(pairTy, pairAlloca, 1), "cos");
+      } else {
+        auto * fusedCall = builder.CreateCall(fusedFunc, {arg}, "sincos");
+        fusedCall->setAttributes(fusedFunc->getAttributes());
+        fusedCall->setCallingConv(fusedFunc->getCallingConv());
+        sinVal = builder.CreateExtractValue(fusedCall, 0, "sin");
+        cosVal = builder.CreateExtractValue(fusedCall, 1, "cos");
+      }
+
+      pair.sinCall->replaceAllUsesWith(sinVal);
+      pair.cosCall->replaceAllUsesWith(cosVal);
+      pair.sinCall->eraseFromParent();
+      pair.cosCall->eraseFromParent();
+      numFused++;
+    }
+  }
 
+  if (numFused > 0) {
+    Report() << "sleef: fused " << numFused << " sin/cos pairs into sincos\n";
+  }
+  return numFused > 0;
+}
 
 void
 addSleefResolver(const Config & config, PlatformInfo & platInfo) {
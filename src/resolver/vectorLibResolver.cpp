@@ -0,0 +1,206 @@
+//===- src/resolver/vectorLibResolver.cpp - external vector math libraries --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Resolves math calls to the vector variants of an external library
+// (RV_VECLIB). Unlike SLEEF, nothing is linked into the module: the vector
+// function is only declared and provided by the library at link time.
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/resolver/resolvers.h"
+#include "rv/resolver/resolver.h"
+#include "rv/PlatformInfo.h"
+
+#include "rvConfig.h"
+#include "report.h"
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <sstream>
+
+#if 1
+#define IF_DEBUG_VECLIB IF_DEBUG
+#else
+#define IF_DEBUG_VECLIB if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+// (double precision) math functions with vector variants in libmvec and SVML
+static const char * VecLibFunctions[] = {
+  "sin", "cos", "tan", "asin", "acos", "atan", "atan2",
+  "sinh", "cosh", "tanh", "asinh", "acosh", "atanh",
+  "exp", "exp2", "exp10", "expm1", "log", "log2", "log10", "log1p",
+  "pow", "cbrt", "hypot", "erf", "erfc",
+};
+
+// documented accuracy of the library variants (tenth of ULP)
+static const int VecLibULPBound = 40;
+
+// an ISA and its native vector widths for float and double
+struct VecLibISA {
+  const char * abiToken; // Vector Function ABI ISA letter
+  int floatWidth;
+  int doubleWidth;
+};
+
+// declares the library function
+class VecLibFunctionResolver : public FunctionResolver {
+  std::string vecFuncName;
+  FunctionType & vecFuncTy;
+  VectorShape resShape;
+
+public:
+  VecLibFunctionResolver(Module & _targetModule, std::string _vecFuncName, FunctionType & _vecFuncTy, VectorShape _resShape)
+  : FunctionResolver(_targetModule)
+  , vecFuncName(_vecFuncName)
+  , vecFuncTy(_vecFuncTy)
+  , resShape(_resShape)
+  {}
+
+  CallPredicateMode getCallSitePredicateMode() override {
+    // library variants are unmasked
+    return CallPredicateMode::SafeWithoutPredicate;
+  }
+
+  int getMaskPos() override { return -1; }
+
+  llvm::Function& requestVectorized() override {
+    auto * vecFunc = targetModule.getFunction(vecFuncName);
+    if (vecFunc) return *vecFunc;
+
+    vecFunc = Function::Create(&vecFuncTy, GlobalValue::ExternalLinkage, vecFuncName, &targetModule);
+    vecFunc->setDoesNotThrow();
+    vecFunc->setDoesNotAccessMemory();
+    return *vecFunc;
+  }
+
+  VectorShape requestResultShape() override { return resShape; }
+};
+
+class VecLibResolverService : public ResolverService {
+  Config::VecLib vecLib;
+  bool estimateCosts;
+  int defaultULPBound; // Config::maxULPErrorBound for call sites without their own bound
+  std::vector<VecLibISA> isas; // widest first
+
+  std::unique_ptr<FunctionResolver> resolveVariant(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, llvm::Module & destModule);
+
+public:
+  VecLibResolverService(const Config & config, const Module & mod)
+  : vecLib(config.vecLib)
+  , estimateCosts(config.enableResolverCosts)
+  , defaultULPBound(config.maxULPErrorBound)
+  {
+    Triple triple(mod.getTargetTriple());
+    if (triple.isX86()) {
+      if (config.useAVX512) isas.push_back(VecLibISA{"e", 16, 8});
+      if (config.useAVX2 || config.useAVX512) isas.push_back(VecLibISA{"d", 8, 4});
+      else if (config.useAVX) isas.push_back(VecLibISA{"c", 8, 4});
+      if (config.useSSE || config.useAVX || config.useAVX2 || config.useAVX512) isas.push_back(VecLibISA{"b", 4, 2});
+    } else if (triple.isAArch64() && config.useADVSIMD && vecLib == Config::VecLib_LibMVec) {
+      isas.push_back(VecLibISA{"n", 4, 2});
+    }
+  }
+
+  void print(llvm::raw_ostream & out) const override {
+    out << "VecLibResolver(" << to_string(vecLib) << ") { isas = ";
+    bool later = false;
+    for (const auto & isa : isas) {
+      if (later) out << ",";
+      later = true;
+      out << isa.abiToken;
+    }
+    out << " }";
+  }
+
+  std::unique_ptr<FunctionResolver> resolve(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, llvm::Module & destModule) override {
+    return resolveWithAccuracy(funcName, scaFuncTy, argShapes, vectorWidth, hasPredicate, -1, destModule);
+  }
+
+  std::unique_ptr<FunctionResolver> resolveWithAccuracy(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, bool hasPredicate, int maxULPError, llvm::Module & destModule) override {
+    (void) hasPredicate; // the call is safe without predicate
+    // libmvec and SVML only guarantee 4 ULP, leave stricter call sites (and the default bound of 1 ULP) to SLEEF
+    int ulpBound = maxULPError >= 0 ? maxULPError : defaultULPBound;
+    if (ulpBound < VecLibULPBound) return nullptr;
+    return resolveVariant(funcName, scaFuncTy, argShapes, vectorWidth, destModule);
+  }
+};
+
+// libm name of \p funcName (accepts the llvm.<func>.f32/f64 intrinsics)
+static std::string
+GetLibmName(StringRef funcName, bool isFloat) {
+  StringRef baseName = funcName;
+  if (funcName.startswith("llvm.")) {
+    baseName = funcName.drop_front(5).split('.').first;
+  } else if (isFloat) {
+    if (!funcName.endswith("f")) return "";
+    baseName = funcName.drop_back(1);
+  }
+
+  for (const char * libFunc : VecLibFunctions) {
+    if (baseName == libFunc) return isFloat ? baseName.str() + "f" : baseName.str();
+  }
+  return "";
+}
+
+std::unique_ptr<FunctionResolver>
+VecLibResolverService::resolveVariant(llvm::StringRef funcName, llvm::FunctionType & scaFuncTy, const VectorShapeVec & argShapes, int vectorWidth, llvm::Module & destModule) {
+  // all operands and the result share one floating-point type
+  auto * elemTy = scaFuncTy.getReturnType();
+  if (!elemTy->isFloatTy() && !elemTy->isDoubleTy()) return nullptr;
+  for (auto * paramTy : scaFuncTy.params()) {
+    if (paramTy != elemTy) return nullptr;
+  }
+
+  bool isFloat = elemTy->isFloatTy();
+  std::string libmName = GetLibmName(funcName, isFloat);
+  if (libmName.empty()) return nullptr;
+
+  // pick the ISA with a matching native width
+  const VecLibISA * isa = nullptr;
+  for (const auto & cand : isas) {
+    if ((isFloat ? cand.floatWidth : cand.doubleWidth) == vectorWidth) {
+      isa = &cand;
+      break;
+    }
+  }
+  if (!isa) return nullptr;
+
+  std::stringstream ss;
+  if (vecLib == Config::VecLib_SVML) {
+    ss << "__svml_" << libmName << vectorWidth;
+  } else {
+    ss << "_ZGV" << isa->abiToken << "N" << vectorWidth;
+    for (size_t i = 0; i < scaFuncTy.getNumParams(); ++i) ss << "v";
+    ss << "_" << libmName;
+  }
+  IF_DEBUG_VECLIB { errs() << "veclib: " << funcName << " -> " << ss.str() << "\n"; }
+
+  auto * vecTy = FixedVectorType::get(elemTy, vectorWidth);
+  SmallVector<Type*, 3> vecParamTys(scaFuncTy.getNumParams(), vecTy);
+  auto * vecFuncTy = FunctionType::get(vecTy, vecParamTys, false);
+
+  auto vecLibResolver = std::make_unique<VecLibFunctionResolver>(destModule, ss.str(), *vecFuncTy, FunctionResolver::ComputeShape(argShapes));
+  if (estimateCosts) SetMathCallCosts(*vecLibResolver, funcName, scaFuncTy, vectorWidth, vectorWidth * elemTy->getPrimitiveSizeInBits());
+  return vecLibResolver;
+}
+
+void
+addVectorLibraryResolver(const Config & config, PlatformInfo & platInfo) {
+  if (config.vecLib == Config::VecLib_None) return;
+  auto vecLibRes = std::make_unique<VecLibResolverService>(config, platInfo.getModule());
+  platInfo.addResolverService(std::move(vecLibRes), false);
+}
+
+} // namespace rv
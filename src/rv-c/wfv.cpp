@@ -0,0 +1,138 @@
+#include "rv-c/wfv.h"
+
+#include "rv/PlatformInfo.h"
+#include "rv/config.h"
+#include "rv/resolver/resolvers.h"
+#include "rv/rv.h"
+#include "rv/utils.h"
+#include "rv/vectorMapping.h"
+#include "rv/vectorizerSession.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <memory>
+
+using namespace llvm;
+using namespace rv;
+
+namespace {
+
+// state shared by all functions vectorized through one RVVectorizerRef
+struct CVectorizer {
+  Module *mod;
+  std::string arch;
+  TargetMachine *TM;
+  std::unique_ptr<VectorizerSession> session;
+
+  CVectorizer(Module &_mod, TargetMachine *_TM, const char *_arch)
+  : mod(&_mod), arch(_arch ? _arch : ""), TM(_TM), session()
+  {}
+
+  // set up the session (once). \p protoFn selects the ISA if no arch was given.
+  void setup(Function &protoFn) {
+    if (!session) {
+      Config config = arch.empty() ? Config::createForFunction(protoFn)
+                                   : Config::createForArch(protoFn, arch);
+      session.reset(new VectorizerSession(config, TM));
+    }
+    session->attach(*mod);
+  }
+
+  void setModule(Module &newMod) {
+    mod = &newMod;
+    if (session) session->detach();
+  }
+
+  bool vectorizeFunction(VectorMapping &wfvJob);
+};
+
+} // namespace
+
+static CVectorizer *unwrap(RVVectorizerRef V) {
+  return reinterpret_cast<CVectorizer *>(V);
+}
+
+static RVVectorizerRef wrap(CVectorizer *V) {
+  return reinterpret_cast<RVVectorizerRef>(V);
+}
+
+static VectorShape DecodeShape(const RVShape &shape) {
+  unsigned alignment = shape.Alignment > 0 ? shape.Alignment : 1;
+  switch (shape.Kind) {
+  case RVShapeUniform: return VectorShape::uni(alignment);
+  case RVShapeContiguous: return VectorShape::cont(alignment);
+  case RVShapeStrided: return VectorShape::strided(shape.Stride, alignment);
+  case RVShapeVarying: return VectorShape::varying(alignment);
+  }
+  return VectorShape::varying();
+}
+
+bool CVectorizer::vectorizeFunction(VectorMapping &wfvJob) {
+  if (!session->vectorizeFunction(wfvJob))
+    return false;
+
+  // the JIT can not resolve rv_* intrinsics
+  lowerIntrinsics(*wfvJob.vectorFn);
+  return true;
+}
+
+RVVectorizerRef RVCreateVectorizer(LLVMModuleRef M, LLVMTargetMachineRef TM, const char *Arch) {
+  auto *targetMachine = reinterpret_cast<TargetMachine *>(TM);
+  return wrap(new CVectorizer(*llvm::unwrap(M), targetMachine, Arch));
+}
+
+void RVDisposeVectorizer(RVVectorizerRef V) {
+  delete unwrap(V);
+}
+
+LLVMValueRef RVVectorizeFunction(RVVectorizerRef V, LLVMValueRef ScalarFn, unsigned Width,
+                                 const RVShape *ArgShapes, unsigned NumArgShapes,
+                                 RVShape ResultShape, int MaskPos, const char *VectorName) {
+  auto &cVec = *unwrap(V);
+  auto *scalarFn = dyn_cast_or_null<Function>(llvm::unwrap(ScalarFn));
+  if (!scalarFn || scalarFn->isDeclaration() || Width == 0)
+    return nullptr;
+  if (ArgShapes && NumArgShapes != scalarFn->arg_size())
+    return nullptr;
+
+  VectorShapeVec argShapes;
+  for (unsigned i = 0; i < scalarFn->arg_size(); ++i) {
+    argShapes.push_back(ArgShapes ? DecodeShape(ArgShapes[i]) : VectorShape::uni());
+  }
+  VectorShape resShape = DecodeShape(ResultShape);
+
+  cVec.setup(*scalarFn);
+
+  // request the SIMD declaration
+  Function *vectorFn = VectorName ? cVec.mod->getFunction(VectorName) : nullptr;
+  if (vectorFn && !vectorFn->isDeclaration())
+    return nullptr;
+  if (!vectorFn) {
+    vectorFn = createVectorDeclaration(*scalarFn, resShape, argShapes, Width, MaskPos);
+    vectorFn->copyAttributesFrom(scalarFn);
+    if (VectorName) {
+      vectorFn->setName(VectorName);
+    } else {
+      vectorFn->setName(cVec.session->getPlatformInfo().createMangledVectorName(scalarFn->getName(), argShapes, Width, MaskPos));
+    }
+  }
+
+  auto predMode = MaskPos >= 0 ? CallPredicateMode::PredicateArg
+                               : CallPredicateMode::SafeWithoutPredicate;
+  VectorMapping wfvJob(scalarFn, vectorFn, Width, MaskPos, resShape, argShapes, predMode);
+  if (!cVec.vectorizeFunction(wfvJob)) {
+    cVec.session->getPlatformInfo().forgetMapping(wfvJob);
+    vectorFn->eraseFromParent();
+    return nullptr;
+  }
+  return wrap(vectorFn);
+}
+
+void RVSetVectorizerModule(RVVectorizerRef V, LLVMModuleRef M) {
+  unwrap(V)->setModule(*llvm::unwrap(M));
+}
+
+void RVReleaseContext(LLVMContextRef C) {
+  releaseSleefModules(*llvm::unwrap(C));
+}
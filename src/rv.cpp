@@ -24,27 +24,39 @@
 #include "rv/intrinsics.h"
 
 // Transform also exposed as LLVM passes
+#include "rv/passes/cleanupPass.h"
 #include "rv/passes/irPolisher.h"
 #include "rv/passes/loopExitCanonicalizer.h"
 
 #include "rv/PlatformInfo.h"
+#include "rv/resolver/resolvers.h"
 #include "rv/vectorizationInfo.h"
 #include "rv/analysis/reductionAnalysis.h"
+#include "rv/analysis/laneProfile.h"
+#include "rv/analysis/costModel.h"
+#include "rv/analysis/profitModel.h"
 
 // RV internal transformations.
 #include "rv/transform/CoherentIFTransform.h"
 #include "rv/transform/Linearizer.h"
+#include "rv/transform/blendOpt.h"
 #include "rv/transform/bosccTransform.h"
 #include "rv/transform/guardedDivLoopTrans.h"
 #include "rv/transform/lowerDivergentSwitches.h"
+#include "rv/transform/mathFusion.h"
 #include "rv/transform/memCopyElision.h"
+#include "rv/transform/promoteAllocas.h"
+#include "rv/transform/promoteMemReductions.h"
 #include "rv/transform/redOpt.h"
 #include "rv/transform/splitAllocas.h"
 #include "rv/transform/srovTransform.h"
 #include "rv/transform/structOpt.h"
+#include "rv/transform/uniformVersioning.h"
+#include "rv/transform/vectorLICM.h"
 
 #include "native/NatBuilder.h"
 
+#include "utils/phaseTimer.h"
 #include "utils/rvTools.h"
 
 #include "rvConfig.h"
@@ -62,8 +74,46 @@ namespace rv {
 VectorizerInterface::VectorizerInterface(PlatformInfo & _platInfo, Config _config)
         : config(_config)
         , platInfo(_platInfo)
+        , scalarRegionSize(0)
+        , outsideRegionSize(0)
+        , codeGrowth(1.0)
+        , laneLoopFallback(false)
+        , profitGathers(true)
 { }
 
+static size_t
+GetRegionSize(const VectorizationInfo & vecInfo) {
+  size_t numInsts = 0;
+  vecInfo.getRegion().for_blocks([&](const BasicBlock & block) {
+    numInsts += block.size();
+    return true;
+  });
+  return numInsts;
+}
+
+static size_t
+GetFunctionSize(const Function & func) {
+  size_t numInsts = 0;
+  for (const auto & block : func) numInsts += block.size();
+  return numInsts;
+}
+
+bool
+VectorizerInterface::exceedsGrowthBudget(VectorizationInfo & vecInfo, const char * phase, bool vectorized) {
+  if (config.codeGrowthBudget <= 0 || scalarRegionSize == 0) return false;
+
+  // the region is vectorized in place in loop mode
+  auto & func = vectorized ? vecInfo.getVectorFunction() : vecInfo.getScalarFunction();
+  size_t funcSize = GetFunctionSize(func);
+  if (&func == &vecInfo.getScalarFunction()) funcSize -= std::min(funcSize, outsideRegionSize);
+  codeGrowth = funcSize / (double) scalarRegionSize;
+
+  if (codeGrowth <= config.codeGrowthBudget) return false;
+  Report() << "code growth budget exceeded after " << phase << ": " << format("%.1f", codeGrowth) << "x of " << scalarRegionSize
+           << " instructions (RV_CODE_GROWTH_BUDGET=" << config.codeGrowthBudget << ")\n";
+  return true;
+}
+
 static void
 EmbedInlinedCode(BasicBlock & entry, Loop & hostLoop, LoopInfo & loopInfo, std::set<BasicBlock*> & funcBlocks) {
   for (auto itSucc : successors(&entry)) {
@@ -93,6 +143,19 @@ VectorizerInterface::lowerRuntimeCalls(VectorizationInfo & vecInfo, FunctionAnal
     funcBlocks.insert(&BB);
   }
 
+  // complex arithmetic is lowered inline (without compiler-rt)
+  bool loweredComplex = false;
+  if (config.enableComplexLowering) {
+    std::vector<CallInst*> complexCalls;
+    for (auto & BB : scalarFn) {
+      if (!vecInfo.inRegion(BB)) continue;
+      for (auto & Inst : BB) {
+        if (auto * call = dyn_cast<CallInst>(&Inst)) complexCalls.push_back(call);
+      }
+    }
+    for (auto * call : complexCalls) loweredComplex |= LowerComplexCall(*call);
+  }
+
   for (auto & BB : scalarFn) {
     if (!vecInfo.inRegion(BB)) continue;
 
@@ -143,6 +206,11 @@ VectorizerInterface::lowerRuntimeCalls(VectorizationInfo & vecInfo, FunctionAnal
     PA.abandon<DominatorTreeAnalysis>();
     PA.abandon<PostDominatorTreeAnalysis>();
     FAM.invalidate(vecInfo.getScalarFunction(), PA);
+  } else if (loweredComplex) {
+    // straight-line code, the CFG is unchanged
+    PreservedAnalyses PA;
+    PA.preserveSet<CFGAnalyses>();
+    FAM.invalidate(vecInfo.getScalarFunction(), PA);
   }
 }
 
@@ -159,56 +227,157 @@ VectorizerInterface::analyze(VectorizationInfo& vecInfo,
       vecInfo.dump();
     }
 
+    PhaseTimer timer("analyze", vecInfo);
+
     // determines value and control shapes
     VectorizationAnalysis vea(config, platInfo, vecInfo, FAM);
     vea.analyze();
 }
 
+void
+VectorizerInterface::updateAnalysis(VectorizationInfo& vecInfo,
+                                    FunctionAnalysisManager& FAM,
+                                    const std::vector<const Instruction*> & updateList)
+{
+    PhaseTimer timer("update-analysis", vecInfo);
+
+    VectorizationAnalysis vea(config, platInfo, vecInfo, FAM);
+    vea.updateAnalysis(updateList);
+}
+
 bool
 VectorizerInterface::linearize(VectorizationInfo& vecInfo,
                  FunctionAnalysisManager & FAM) {
-    
+    PhaseTimer timer("linearize", vecInfo);
+
+    // measure the code growth of this job from here on
+    scalarRegionSize = GetRegionSize(vecInfo);
+    outsideRegionSize = GetFunctionSize(vecInfo.getScalarFunction()) - scalarRegionSize;
+    codeGrowth = 1.0;
+    laneLoopFallback = false;
+    profitGathers = true;
+
     // TODO make this part of a new optimization phase
     // Scalar-Replication-Of-Varying-(Aggregates): split up structs of vectorizable elements to promote use of vector registers
     if (config.enableSROV) {
+      PhaseTimer srovTimer("srov", vecInfo);
       SROVTransform srovTransform(vecInfo, platInfo);
-      bool Changed = srovTransform.run();
+      std::vector<const Instruction*> replicates;
+      bool Changed = srovTransform.run(&replicates);
       while (Changed) {
-        // re-run DA
-        vecInfo.forgetInferredProperties();
-        analyze(vecInfo, FAM);
+        // re-compute the shapes of the replicates and their users
+        updateAnalysis(vecInfo, FAM, replicates);
 
         // re-run SROV
-        Changed = srovTransform.run();
+        replicates.clear();
+        Changed = srovTransform.run(&replicates);
       }
     } else {
       Report() << "SROV opt disabled (RV_DISABLE_SROV != 0)\n";
     }
+
+    // accumulate memory reductions of inner loops in registers
+    if (config.enablePromoteMemReductions) {
+      PhaseTimer promoteTimer("promote-mem-reductions", vecInfo);
+      PromoteMemReductions promote(vecInfo, FAM);
+      if (promote.run()) {
+        vecInfo.forgetInferredProperties();
+        analyze(vecInfo, FAM);
+      }
+    }
+
+    // fast path for a varying value that is uniform at runtime
+    if (config.enableUniformVersioning) {
+      PhaseTimer versioningTimer("uniform-versioning", vecInfo);
+      UniformVersioning uniVersioning(vecInfo, platInfo, FAM);
+      if (uniVersioning.run()) {
+        vecInfo.forgetInferredProperties();
+        vecInfo.forgetJoinPoints();
+        analyze(vecInfo, FAM);
+      }
+    }
+    bool overBudget = exceedsGrowthBudget(vecInfo, "uniform-versioning", false);
+
+    // uniform versions of divergent loops whose trip count is the same on all lanes at runtime
+    if (config.enableTripCountVersioning && !overBudget) {
+      PhaseTimer versioningTimer("tripcount-versioning", vecInfo);
+      UniformVersioning loopVersioning(vecInfo, platInfo, FAM);
+      if (loopVersioning.runLoops()) {
+        vecInfo.forgetInferredProperties();
+        vecInfo.forgetJoinPoints();
+        analyze(vecInfo, FAM);
+      }
+    }
+    overBudget = overBudget || exceedsGrowthBudget(vecInfo, "tripcount-versioning", false);
   
     // early lowering of divergent switch statements
-    LowerDivergentSwitches divSwitchTrans(vecInfo, FAM);
-    divSwitchTrans.run();
+    {
+      PhaseTimer switchTimer("divergent-switches", vecInfo);
+      LowerDivergentSwitches divSwitchTrans(config, vecInfo, platInfo, FAM);
+      divSwitchTrans.run();
+      if (divSwitchTrans.getNumDispatchLoops() > 0) {
+        vecInfo.forgetInferredProperties();
+        vecInfo.forgetJoinPoints();
+        analyze(vecInfo, FAM);
+      }
+    }
+    overBudget = overBudget || exceedsGrowthBudget(vecInfo, "divergent-switches", false);
 
     // FIXME materialize masks only very late in the process (risk of mask invalidation through transformations)
-    MaskExpander maskEx(vecInfo, FAM);
+    MaskExpander maskEx(config, vecInfo, FAM);
 
     // convert divergent loops inside the region to uniform loops
-    GuardedDivLoopTrans guardedDLT(platInfo, vecInfo, FAM);
-    guardedDLT.transformDivergentLoops();
+    {
+      PhaseTimer divLoopTimer("divergent-loops", vecInfo);
+      GuardedDivLoopTrans guardedDLT(config, platInfo, vecInfo, FAM);
+      guardedDLT.transformDivergentLoops();
+    }
+    overBudget = overBudget || exceedsGrowthBudget(vecInfo, "divergent-loops", false);
+
+    // lane occupancy profile of the divergent branches (RV_LANE_PROFILE_GEN, RV_LANE_PROFILE)
+    LaneProfile laneProfile(config, vecInfo, platInfo);
+    if (!config.laneProfileGen.empty()) {
+      PhaseTimer profTimer("lane-profile", vecInfo);
+      laneProfile.instrument();
+    }
+    const LaneProfile * branchProfile = config.laneProfileUse.empty() ? nullptr : &laneProfile;
+
+    // learned profitability model (RV_PROFIT_MODEL): BOSCC, CIF and gathers by the predicted speedup
+    bool useCIF = config.enableCoherentIF;
+    bool useBOSCC = config.enableHeuristicBOSCC;
+    if (const ProfitModel * profitModel = ProfitModel::get()) {
+      CostModel costModel(platInfo, config, vecInfo);
+      auto features = ProfitFeatures::Collect(vecInfo, costModel.estimateRegionCost(), config);
+      useCIF = profitModel->prefers(features, ProfitFeature::CIF, useCIF);
+      useBOSCC = profitModel->prefers(features, ProfitFeature::BOSCC, useBOSCC);
+      // a target without gathers does not get them
+      profitGathers = !config.useScatterGatherIntrinsics || profitModel->prefers(features, ProfitFeature::Gathers, true);
+      Report() << "profit model: cif " << useCIF << ", boscc " << useBOSCC << ", gathers " << profitGathers << "\n";
+    }
+
+    // first fallback: no code duplication for coherent branches
+    if (overBudget && (useCIF || useBOSCC || config.enableEarlyExits)) {
+      Report() << "code growth fallback: CIF and BOSCC disabled\n";
+    }
 
     // insert CIF branches if desired
-    if (config.enableCoherentIF) {
-      CoherentIFTransform CoherentIFTrans(vecInfo, platInfo, maskEx, FAM);
+    if (useCIF && !overBudget) {
+      PhaseTimer cifTimer("coherent-if", vecInfo);
+      CoherentIFTransform CoherentIFTrans(vecInfo, platInfo, maskEx, FAM, branchProfile);
       CoherentIFTrans.run();
     }
 
-    // insert BOSCC branches if desired
-    if (config.enableHeuristicBOSCC) {
-      BOSCCTransform bosccTrans(vecInfo, platInfo, maskEx, FAM);
+    // insert BOSCC branches (and early exits to the return) if desired
+    if ((useBOSCC || config.enableEarlyExits) && !overBudget) {
+      PhaseTimer bosccTimer("boscc", vecInfo);
+      BOSCCTransform bosccTrans(vecInfo, platInfo, maskEx, FAM, branchProfile, useBOSCC, config.enableEarlyExits);
       bosccTrans.run();
     }
     // expand masks after BOSCC
-    maskEx.expandRegionMasks();
+    {
+      PhaseTimer maskTimer("mask-expansion", vecInfo);
+      maskEx.expandRegionMasks();
+    }
 
     IF_DEBUG {
       errs() << "--- VecInfo before Linearizer ---\n";
@@ -219,15 +388,34 @@ VectorizerInterface::linearize(VectorizationInfo& vecInfo,
     ReductionAnalysis reda(vecInfo.getScalarFunction(), FAM);
     auto & LI = *FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction());
     auto * hostLoop = LI.getLoopFor(&vecInfo.getEntry());
-    if (hostLoop) reda.analyze(*hostLoop);
+    if (hostLoop) reda.analyze(*hostLoop, vecInfo.getEntryMask());
 
     // optimize reduction data flow
-    ReductionOptimization redOpt(vecInfo, reda, FAM);
-    redOpt.run();
+    {
+      PhaseTimer redOptTimer("reduction-opt", vecInfo);
+      ReductionOptimization redOpt(vecInfo, reda, FAM);
+      redOpt.run();
+    }
 
     // partially linearize acyclic control in the region
-    Linearizer linearizer(config, vecInfo, maskEx, FAM);
-    linearizer.run();
+    {
+      PhaseTimer linTimer("linearizer", vecInfo);
+      Linearizer linearizer(config, vecInfo, maskEx, FAM);
+      linearizer.run();
+    }
+
+    // merge and fold blends of the linearized region
+    if (config.enableOptimizedBlends) {
+      PhaseTimer blendTimer("blend-opt", vecInfo);
+      BlendOptimizer blendOpt(vecInfo, maskEx);
+      blendOpt.run();
+    }
+
+    // second fallback: scalarize in lane loops instead of W straight-line copies
+    if (exceedsGrowthBudget(vecInfo, "linearizer", false)) {
+      Report() << "code growth fallback: replicating in loops over the lanes\n";
+      laneLoopFallback = true;
+    }
 
     IF_DEBUG {
       errs() << "--- VecInfo after Linearizer ---\n";
@@ -240,22 +428,43 @@ VectorizerInterface::linearize(VectorizationInfo& vecInfo,
 // flag is set if the env var holds a string that starts on a non-'0' char
 bool
 VectorizerInterface::vectorize(VectorizationInfo &vecInfo, FunctionAnalysisManager &FAM, ValueToValueMapTy * vecInstMap) {
+  PhaseTimer timer("vectorize", vecInfo);
+
+  // pow(x, n) expansion, pow(exp(x), y) -> exp(x * y), exp(y * log(x)) -> pow(x, y), shared exp/log calls
+  if (config.enableMathFusion) {
+    PhaseTimer fusionTimer("math-fusion", vecInfo);
+    MathFusion fusion(vecInfo);
+    fusion.run();
+  }
+
   // divergent memcpy lowering
-  MemCopyElision mce(platInfo, vecInfo);
-  mce.run();
+  {
+    PhaseTimer mceTimer("memcpy-elision", vecInfo);
+    MemCopyElision mce(platInfo, vecInfo, FAM);
+    mce.run();
+  }
 
   // split structural allocas
   if (config.enableSplitAllocas) {
+    PhaseTimer splitTimer("split-allocas", vecInfo);
     SplitAllocas split(vecInfo);
     split.run();
   } else {
     Report() << "Split allocas opt disabled (RV_DISABLE_SPLITALLOCAS != 0)\n";
   }
 
+  // keep small arrays with dynamic indices in registers
+  if (config.enablePromoteAllocas) {
+    PhaseTimer promoteTimer("promote-allocas", vecInfo);
+    PromoteAllocas promote(vecInfo);
+    promote.run();
+  }
+
   // transform allocas from Array-of-struct into Struct-of-vector where possibe
   // FIXME Cannot happen before DA re-run because StructOpt modifies ptr shapes to created contiguous stack accesses!
   if (config.enableStructOpt) {
-    StructOpt sopt(vecInfo, platInfo.getDataLayout());
+    PhaseTimer soptTimer("struct-opt", vecInfo);
+    StructOpt sopt(vecInfo, platInfo.getDataLayout(), config.enableSoAGathers);
     sopt.run();
   } else {
     Report() << "Struct opt disabled (RV_DISABLE_STRUCTOPT != 0)\n";
@@ -265,14 +474,35 @@ VectorizerInterface::vectorize(VectorizationInfo &vecInfo, FunctionAnalysisManag
   auto &LI = *FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction());
   auto * hostLoop = LI.getLoopFor(&vecInfo.getEntry());
   ReductionAnalysis reda(vecInfo.getScalarFunction(), FAM);
-  if (hostLoop) reda.analyze(*hostLoop);
+  if (hostLoop) reda.analyze(*hostLoop, vecInfo.getEntryMask());
 
 // vectorize with native
-  NatBuilder natBuilder(config, platInfo, vecInfo, reda, FAM);
-  natBuilder.vectorize(true, vecInstMap);
+  {
+    PhaseTimer natTimer("natbuilder", vecInfo);
+    Config natConfig = config;
+    if (laneLoopFallback) natConfig.replicationBudget = 1;
+    if (!profitGathers) natConfig.useScatterGatherIntrinsics = false;
+    NatBuilder natBuilder(natConfig, platInfo, vecInfo, reda, FAM);
+    natBuilder.vectorize(true, vecInstMap);
+  }
+  // narrower widths are up to the caller (loop vectorization picks them with the cost model)
+  exceedsGrowthBudget(vecInfo, "natbuilder", true);
+
+  // one SLEEF sincos for sin(x) and cos(x)
+  if (config.enableMathFusion) {
+    FuseSleefSinCos(vecInfo.getVectorFunction());
+  }
+
+  // invariant masks, broadcasts and loads, blends with undef
+  if (config.enableVectorLICM) {
+    PhaseTimer licmTimer("vector-licm", vecInfo);
+    VectorLICM vecLICM(vecInfo.getVectorFunction());
+    vecLICM.run();
+  }
 
   // IR Polish phase: promote i1 vectors and perform early instruction (read: intrinsic) selection
   if (config.enableIRPolish) {
+    PhaseTimer polishTimer("ir-polisher", vecInfo);
     IRPolisher Polisher(vecInfo.getVectorFunction());
     Polisher.polish();
     Report() << "IR Polisher enabled (RV_ENABLE_POLISH != 0)\n";
@@ -280,6 +510,9 @@ VectorizerInterface::vectorize(VectorizationInfo &vecInfo, FunctionAnalysisManag
 
   IF_DEBUG verifyFunction(vecInfo.getVectorFunction());
 
+  // scoped InstCombine, EarlyCSE, .. (CleanupWrapperPass)
+  MarkForCleanup(vecInfo.getVectorFunction());
+
   return true;
 }
 
@@ -306,7 +539,26 @@ lowerIntrinsicCall(CallInst* call) {
     case RVIntrinsic::Extract:
     case RVIntrinsic::Shuffle:
     case RVIntrinsic::Align:
-    case RVIntrinsic::Compact: {
+    case RVIntrinsic::Uniform:
+    case RVIntrinsic::Strided:
+    case RVIntrinsic::Compact:
+    // a single lane reduces/scans/permutes to itself
+    case RVIntrinsic::ReduceAdd:
+    case RVIntrinsic::ReduceMul:
+    case RVIntrinsic::ReduceMin:
+    case RVIntrinsic::ReduceMax:
+    case RVIntrinsic::ReduceAnd:
+    case RVIntrinsic::ReduceOr:
+    case RVIntrinsic::ScanAdd:
+    case RVIntrinsic::ScanMul:
+    case RVIntrinsic::ScanMin:
+    case RVIntrinsic::ScanMax:
+    case RVIntrinsic::ScanAnd:
+    case RVIntrinsic::ScanOr:
+    case RVIntrinsic::ShuffleXor:
+    case RVIntrinsic::Broadcast:
+    case RVIntrinsic::Sort:
+    case RVIntrinsic::Partition: {
       lowerIntrinsicCall(call, [] (const CallInst* call) {
         return call->getOperand(0);
       });
@@ -363,11 +615,19 @@ lowerIntrinsicCall(CallInst* call) {
       });
     } break;
 
-    case RVIntrinsic::Index: {
+    case RVIntrinsic::Index:
+    case RVIntrinsic::Rank: {
       lowerIntrinsicCall(call, [] (CallInst* call) {
         return ConstantInt::get(call->getType(), 0, false);
       });
     } break;
+
+    case RVIntrinsic::Philox: {
+      lowerIntrinsicCall(call, [] (CallInst* call) {
+        IRBuilder<> builder(call);
+        return CreatePhilox4x32(builder, call->getArgOperand(0), call->getArgOperand(1), call->getArgOperand(2));
+      });
+    } break;
   }
 
   return true;
@@ -377,7 +637,10 @@ bool
 lowerIntrinsics(Module & mod) {
   bool changed = false;
   // TODO re-implement using RVIntrinsic enum
-  const char* names[] = {"rv_any", "rv_all", "rv_extract", "rv_insert", "rv_mask", "rv_load", "rv_store", "rv_shuffle", "rv_ballot", "rv_align", "rv_popcount", "rv_compact", "rv_num_lanes", "rv_lane_id", "rv_index"};
+  const char* names[] = {"rv_any", "rv_all", "rv_extract", "rv_insert", "rv_mask", "rv_load", "rv_store", "rv_shuffle", "rv_ballot", "rv_align", "rv_popcount", "rv_compact", "rv_num_lanes", "rv_lane_id", "rv_index", "rv_philox", "rv_uniform", "rv_strided",
+                         "rv_reduce_add", "rv_reduce_mul", "rv_reduce_min", "rv_reduce_max", "rv_reduce_and", "rv_reduce_or",
+                         "rv_scan_add", "rv_scan_mul", "rv_scan_min", "rv_scan_max", "rv_scan_and", "rv_scan_or",
+                         "rv_shuffle_xor", "rv_broadcast", "rv_sort", "rv_partition", "rv_rank"};
   for (int i = 0, n = sizeof(names) / sizeof(names[0]); i < n; i++) {
     auto func = mod.getFunction(names[i]);
     if (!func) continue;
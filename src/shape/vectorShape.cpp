@@ -11,6 +11,9 @@
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <mutex>
+#include <unordered_set>
+#include <llvm/ADT/Hashing.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Function.h>
 
@@ -68,51 +71,46 @@ getAlignment(const Constant* c) {
 
 namespace rv {
 
-// undef shape
-VectorShape::VectorShape()
-    : stride(0), hasConstantStride(false), alignment(0), defined(false) {}
+static_assert(sizeof(VectorShape) == 8, "VectorShape is expected to fit 64 bits");
 
+// the largest power-of-two divisor of \p n (0 for 0)
+static uint64_t
+Pow2Divisor(uint64_t n) {
+  return n & (~n + 1);
+}
+
+uint64_t
+VectorShape::encodeAlignment(align_t alignment) {
+  // any divisor of the alignment is still a valid alignment
+  if (alignment > AlignMask)
+    alignment = std::min<uint64_t>(Pow2Divisor(alignment), (AlignMask + 1) >> 1);
+  return uint64_t(alignment) << AlignShift;
+}
+
+// varying shape
 VectorShape::VectorShape(align_t _alignment)
-    : stride(0), hasConstantStride(false), alignment(_alignment),
-      defined(true) {}
+    : bits(encodeAlignment(_alignment) | DefinedBit) {}
 
 // constant stride constructor
 VectorShape::VectorShape(stride_t _stride, align_t _alignment)
-    : stride(_stride), hasConstantStride(true), alignment(_alignment),
-      defined(true) {}
+    : bits(0) {
+  if (fitsStride(_stride)) {
+    bits = encodeStrided(_stride) | encodeAlignment(_alignment);
+  } else {
+    // out of the encoding range: only the general alignment is kept
+    align_t strideAlign = std::min<uint64_t>(Pow2Divisor(std::abs(_stride)), (AlignMask + 1) >> 1);
+    bits = encodeAlignment(gcd(_alignment, strideAlign)) | DefinedBit;
+  }
+}
 
 VectorShape VectorShape::fromConstant(const Constant* C) {
   return VectorShape::uni(getAlignment(C));
 }
 
 align_t VectorShape::getAlignmentGeneral() const {
-  if (hasConstantStride) {
-    if (stride == 0)
-      return alignment;
-    else
-      return gcd(alignment, (align_t) std::abs(stride));
-  }
-  else
-    return alignment; // General alignment in case of varying shape
-}
-
-bool VectorShape::operator==(const VectorShape &a) const {
-  return
-      // both undef
-      (!defined && !a.defined) ||
-
-      // both are defined shapes
-      (defined && a.defined && alignment == a.alignment && (
-           // either both shapes are varying (with same alignment)
-           (!hasConstantStride && !a.hasConstantStride) ||
-           // both shapes are strided with same alignment
-           (hasConstantStride && a.hasConstantStride && stride == a.stride)
-        )
-      );
-}
-
-bool VectorShape::operator!=(const VectorShape &a) const {
-  return !(*this == a);
+  if (hasStridedShape() && !isUniform())
+    return gcd(getAlignmentFirst(), (align_t) std::abs(getStride()));
+  return getAlignmentFirst(); // General alignment in case of varying shape
 }
 
 bool
@@ -127,47 +125,45 @@ VectorShape::morePreciseThan(const VectorShape &a) const {
   if (!isDefined())
     return true; // Bottom is more precise then any defined shape
 
-  if (hasConstantStride && !a.hasConstantStride)
+  if (hasStridedShape() && !a.hasStridedShape())
     return true; // strided < varying
 
   // If both are of the same shape, decide by alignment
-  if ((hasConstantStride != a.hasConstantStride)) {
+  if ((hasStridedShape() != a.hasStridedShape())) {
     return false; // varying and strided are not comparable
-  } else if (hasConstantStride && stride != a.stride) {
+  } else if (hasStridedShape() && getStride() != a.getStride()) {
     return false; // stride mismatch
   }
 
   // it comes down to having a coarser alignment
-  return (alignment == 0 && a.alignment > 0) || // @this is the zero shape whereas @a is not
-         (a.alignment > 0 && (alignment % a.alignment == 0)); // the alignment of @this shape is divisible by the alignment of @a
-
-  // either incompatible alignments or @a is zero shape and @this is not
-  return false;
+  align_t alignment = getAlignmentFirst(), aAlignment = a.getAlignmentFirst();
+  return (alignment == 0 && aAlignment > 0) || // @this is the zero shape whereas @a is not
+         (aAlignment > 0 && (alignment % aAlignment == 0)); // the alignment of @this shape is divisible by the alignment of @a
 }
 
 VectorShape operator-(const VectorShape& a) {
-  if (!a.defined || !a.hasConstantStride) return a;
-  return VectorShape::strided(-a.stride, a.alignment);
+  if (!a.hasStridedShape()) return a;
+  return VectorShape::strided(-a.getStride(), a.getAlignmentFirst());
 }
 
 VectorShape operator+(const VectorShape& a, const VectorShape& b) {
-  if (!a.defined || !b.defined)
+  if (!a.isDefined() || !b.isDefined())
     return VectorShape::undef();
 
-  if (!a.hasConstantStride || !b.hasConstantStride)
+  if (!a.hasStridedShape() || !b.hasStridedShape())
     return VectorShape::varying(gcd(a.getAlignmentGeneral(), b.getAlignmentGeneral()));
 
-  return VectorShape::strided(a.stride + b.stride, gcd(a.alignment, b.alignment));
+  return VectorShape::strided(a.getStride() + b.getStride(), gcd(a.getAlignmentFirst(), b.getAlignmentFirst()));
 }
 
 VectorShape operator-(const VectorShape& a, const VectorShape& b) {
-  if (!a.defined || !b.defined)
+  if (!a.isDefined() || !b.isDefined())
     return VectorShape::undef();
 
-  if (!a.hasConstantStride || !b.hasConstantStride)
+  if (!a.hasStridedShape() || !b.hasStridedShape())
     return VectorShape::varying(gcd(a.getAlignmentGeneral(), b.getAlignmentGeneral()));
 
-  return VectorShape::strided(a.stride - b.stride, gcd(a.alignment, b.alignment));
+  return VectorShape::strided(a.getStride() - b.getStride(), gcd(a.getAlignmentFirst(), b.getAlignmentFirst()));
 }
 
 VectorShape operator*(int64_t m, const VectorShape &a) {
@@ -175,7 +171,7 @@ VectorShape operator*(int64_t m, const VectorShape &a) {
     return a;
 
   if (!a.hasStridedShape())
-    return VectorShape::varying(std::abs(m) * a.alignment);
+    return VectorShape::varying(std::abs(m) * a.getAlignmentFirst());
 
   // FIXME overflow
   return VectorShape::strided(m * a.getStride(),
@@ -212,8 +208,8 @@ VectorShape VectorShape::join(VectorShape a, VectorShape b) {
   if (!b.isDefined())
     return a;
 
-  if (a.hasConstantStride && b.hasConstantStride && a.getStride() == b.getStride()) {
-    return strided(a.stride, gcd<>(a.alignment, b.alignment));
+  if (a.hasStridedShape() && b.hasStridedShape() && a.getStride() == b.getStride()) {
+    return strided(a.getStride(), gcd<>(a.getAlignmentFirst(), b.getAlignmentFirst()));
   } else {
     return varying(gcd(a.getAlignmentGeneral(), b.getAlignmentGeneral()));
   }
@@ -232,11 +228,11 @@ std::string VectorShape::str() const {
   } else if (isContiguous()) {
     ss << "cont";
   } else {
-    ss << "stride(" << stride << ")";
+    ss << "stride(" << getStride() << ")";
   }
 
-  if (alignment > 1) {
-    ss << ", alignment(" << alignment << ", " << getAlignmentGeneral() << ")";
+  if (getAlignmentFirst() > 1) {
+    ss << ", alignment(" << getAlignmentFirst() << ", " << getAlignmentGeneral() << ")";
   }
 
   return ss.str();
@@ -313,4 +309,27 @@ VectorShape::parse(StringRef text, int & nextPos) {
   }
 }
 
+namespace {
+
+struct ShapeVecHash {
+  size_t operator()(const VectorShapeVec & shapes) const {
+    size_t h = hash_value(shapes.size());
+    for (const auto & shape : shapes)
+      h = hash_combine(h, shape.getKey());
+    return h;
+  }
+};
+
+}
+
+ShapeSignature
+InternShapes(const VectorShapeVec & shapes) {
+  static std::mutex tableMutex;
+  static std::unordered_set<VectorShapeVec, ShapeVecHash> table;
+
+  // elements of an unordered_set are not moved on rehashing
+  std::lock_guard<std::mutex> guard(tableMutex);
+  return &*table.insert(shapes).first;
+}
+
 } // namespace rv
@@ -11,6 +11,7 @@
 #include "rv/vectorizationInfo.h"
 #include "rv/intrinsics.h"
 #include "rv/PlatformInfo.h"
+#include "rv/analysis/shapeSummary.h"
 
 #include "utils/mathUtils.h"
 #include "utils/rvTools.h"
@@ -84,6 +85,10 @@ VectorShapeTransformer::computeShape(const Instruction& I, SmallValVec & tainted
   if (I.getType()->isPointerTy()) {
     // adjust result type to match alignment
     unsigned minAlignment = I.getPointerAlignment(DL).value();
+    if (alignFacts) {
+      auto it = alignFacts->find(&I);
+      if (it != alignFacts->end()) minAlignment = std::max<unsigned>(minAlignment, it->second);
+    }
     NewShape.setAlignment(
         std::max<unsigned>(minAlignment, NewShape.getAlignmentFirst()));
   } else if (isa<FPMathOperator>(I) && !isa<CallInst>(I)) {
@@ -93,6 +98,10 @@ VectorShapeTransformer::computeShape(const Instruction& I, SmallValVec & tainted
       NewShape = VectorShape::varying();
     }
   }
+  // the lanes of short vectors (<4 x float>) have no stride
+  if (I.getType()->isVectorTy() && NewShape.isDefined() && !NewShape.isUniform()) {
+    NewShape = VectorShape::varying();
+  }
   return NewShape;
 }
 
@@ -105,12 +114,14 @@ VectorShapeTransformer::computeIdealShapeForInst(const Instruction& I, SmallValV
   if (isa<AtomicRMWInst>(I)) return computeShapeForAtomicRMWInst(cast<const AtomicRMWInst>(I));
   if (isa<AtomicCmpXchgInst>(I)) return VectorShape::varying();
 
-  const DataLayout & layout = vecInfo.getDataLayout();
+  // the own copy: concurrent VA workers must not share the struct layout cache
+  const DataLayout & layout = DL;
   const BasicBlock & BB = *I.getParent();
 
   switch (I.getOpcode()) {
     case Instruction::Alloca:
     {
+      vecInfo.noteWidthDependence();
       const int alignment = vecInfo.getMapping().vectorWidth;
       auto* AllocatedType = I.getType()->getPointerElementType();
       const bool Vectorizable = false;
@@ -161,6 +172,7 @@ VectorShapeTransformer::computeIdealShapeForInst(const Instruction& I, SmallValV
           const int stride = diffShape.getStride();
           const int alignment = diffShape.getAlignmentFirst();
 
+          if (stride > 0) vecInfo.noteWidthDependence();
           if (stride >= 0 && alignment >= stride * vectorWidth)
             return VectorShape::uni();
 
@@ -260,6 +272,33 @@ VectorShapeTransformer::computeIdealShapeForInst(const Instruction& I, SmallValV
         return shape;
       }
 
+      // shape hints (pinned in VectorizationAnalysis::init, unless the stride is not a constant)
+      if (IsIntrinsic(call, RVIntrinsic::Uniform)) return VectorShape::uni();
+      if (IsIntrinsic(call, RVIntrinsic::Strided)) return getObservedShape(BB, *I.getOperand(0));
+
+      // counter-based rng: a pure function of its operands
+      if (IsIntrinsic(call, RVIntrinsic::Philox)) {
+        return GenericTransfer(getObservedShape(BB, *I.getOperand(0)), getObservedShape(BB, *I.getOperand(1)),
+                               getObservedShape(BB, *I.getOperand(2)));
+      }
+
+      // cross-lane permutations: uniform if all lanes read the same value
+      if (IsIntrinsic(call, RVIntrinsic::Shuffle) || IsIntrinsic(call, RVIntrinsic::ShuffleXor) ||
+          IsIntrinsic(call, RVIntrinsic::Broadcast)) {
+        auto valShape = getObservedShape(BB, *I.getOperand(0));
+        auto laneShape = getObservedShape(BB, *I.getOperand(1));
+        if (!valShape.isDefined() || !laneShape.isDefined()) return VectorShape::undef();
+        bool uniformLane = IsIntrinsic(call, RVIntrinsic::Broadcast) && laneShape.isUniform();
+        return valShape.isUniform() || uniformLane ? VectorShape::uni() : VectorShape::varying();
+      }
+
+      // lane reorderings of a uniform value
+      if (IsIntrinsic(call, RVIntrinsic::Sort) || IsIntrinsic(call, RVIntrinsic::Partition)) {
+        auto valShape = getObservedShape(BB, *I.getOperand(IsIntrinsic(call, RVIntrinsic::Sort) ? 1 : 0));
+        if (!valShape.isDefined()) return VectorShape::undef();
+        return valShape.isUniform() ? VectorShape::uni() : VectorShape::varying();
+      }
+
       // collect required argument shapes
       // bail if any shape was undefined
       bool allArgsUniform = true;
@@ -279,12 +318,20 @@ VectorShapeTransformer::computeIdealShapeForInst(const Instruction& I, SmallValV
         return VectorShape::uni();
       }
 
+      // side effect free callees: the summary knows which arguments the result depends on
+      if (const auto * summary = platInfo.getShapeSummary(*callee)) {
+        VectorShape summaryShape;
+        if (summary->getResultShape(callArgShapes, summaryShape)) return summaryShape;
+      }
+
       // next: query resolver mechanism // TODO account for predicate
       bool hasVaryingBlockPredicate = false;
       if (!vecInfo.getVaryingPredicateFlag(BB, hasVaryingBlockPredicate)) {
         hasVaryingBlockPredicate = false; // assume uniform block pred unless shown otherwise
       }
 
+      // vector variants are available per width
+      vecInfo.noteWidthDependence();
       auto resolver = platInfo.getResolver(callee->getName(), *callee->getFunctionType(), callArgShapes, vecInfo.getVectorWidth(), hasVaryingBlockPredicate);
       if (resolver) {
         return resolver->requestResultShape();
@@ -368,6 +415,17 @@ VectorShapeTransformer::computeGenericArithmeticTransfer(const Instruction & I)
   return AccuShape;
 }
 
+// whether all lanes of \p shape fall into the same block of \p blockSize (a power of two) values.
+// Then x / blockSize is uniform and x % blockSize keeps the stride with a first lane of zero
+// (AoSoA indexing: <8, 9, .., 15> / 8 = <1, 1, .., 1>, <8, 9, .., 15> % 8 = <0, 1, .., 7>)
+static bool
+IsInsideBlock(const VectorShape & shape, uint64_t blockSize, const VectorizationInfo & vecInfo) {
+  if (!shape.hasStridedShape() || shape.getStride() < 0) return false;
+  if (shape.getAlignmentFirst() % blockSize != 0) return false;
+  if (shape.getStride() > 0) vecInfo.noteWidthDependence();
+  return (uint64_t) shape.getStride() * (vecInfo.getVectorWidth() - 1) < blockSize;
+}
+
 VectorShape
 VectorShapeTransformer::computeShapeForBinaryInst(const BinaryOperator& I) const {
   Value* op1 = I.getOperand(0);
@@ -465,7 +523,31 @@ VectorShapeTransformer::computeShapeForBinaryInst(const BinaryOperator& I) const
       }
     } break;
 
-    // TODO Instruction::LShr
+    case Instruction::LShr: {
+      auto * shiftCI = dyn_cast<ConstantInt>(op2);
+      if (!shiftCI || shiftCI->getZExtValue() == 0 || shiftCI->getZExtValue() >= 64) break;
+      uint64_t blockSize = ((uint64_t) 1) << shiftCI->getZExtValue();
+      if (IsInsideBlock(shape1, blockSize, vecInfo)) {
+        return VectorShape::uni(shape1.getAlignmentFirst() / blockSize);
+      }
+    } break;
+
+    case Instruction::And: {
+      auto * maskCI = dyn_cast<ConstantInt>(op2);
+      if (!maskCI || maskCI->getBitWidth() > 64 || !isPowerOf2_64(maskCI->getZExtValue() + 1)) break;
+      if (IsInsideBlock(shape1, maskCI->getZExtValue() + 1, vecInfo)) {
+        return VectorShape::strided(shape1.getStride(), 0);
+      }
+    } break;
+
+    case Instruction::URem: {
+      auto * divisorCI = dyn_cast<ConstantInt>(op2);
+      if (!divisorCI || divisorCI->getBitWidth() > 64 || !isPowerOf2_64(divisorCI->getZExtValue())) break;
+      if (IsInsideBlock(shape1, divisorCI->getZExtValue(), vecInfo)) {
+        return VectorShape::strided(shape1.getStride(), 0);
+      }
+    } break;
+
     case Instruction::AShr: {
       // Special handling for implicit sign extend `(ashr X (shl X $v))`
       auto OpInst = dyn_cast<Instruction>(op1);
@@ -493,6 +575,11 @@ VectorShapeTransformer::computeShapeForBinaryInst(const BinaryOperator& I) const
     case Instruction::UDiv:
     {
       const ConstantInt* constDivisor = dyn_cast<ConstantInt>(op2);
+      if (constDivisor && I.getOpcode() == Instruction::UDiv && constDivisor->getBitWidth() <= 64 &&
+          isPowerOf2_64(constDivisor->getZExtValue()) &&
+          IsInsideBlock(shape1, constDivisor->getZExtValue(), vecInfo)) {
+        return VectorShape::uni(shape1.getAlignmentFirst() / constDivisor->getZExtValue());
+      }
       if (constDivisor) {
         return shape1 / constDivisor->getSExtValue();
       }
@@ -514,7 +601,7 @@ VectorShapeTransformer::computeShapeForCastInst(const CastInst& castI) const {
 
   const int aligned = castOpShape.getAlignmentFirst();
 
-  const DataLayout & layout = vecInfo.getDataLayout();
+  const DataLayout & layout = DL;
 
   if (castOpShape.isVarying()) return castOpShape;
 
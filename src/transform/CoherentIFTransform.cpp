@@ -9,6 +9,7 @@
 
 #include "rv/transform/CoherentIFTransform.h"
 #include "rv/analysis/BranchEstimate.h"
+#include "rv/analysis/laneProfile.h"
 
 #include <vector>
 #include <sstream>
@@ -40,6 +41,7 @@
 #include <rvConfig.h>
 #include "report.h"
 #include "utils/llvmDuplication.h"
+#include "utils/rvTools.h"
 #include "rv/utils.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/GenericDomTree.h"
@@ -66,9 +68,10 @@ struct CoherentIF{
   LoopInfo & loopInfo;
   Module & mod;
   BranchProbabilityInfo *pbInfo;
+  const LaneProfile * laneProfile;
   BranchEstimate BranchEst;
 
-CoherentIF(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo,  MaskExpander & _maskEx, DominatorTree & _domTree, PostDominatorTree & _postDomTree, LoopInfo & _loopInfo, BranchProbabilityInfo * _pbInfo)
+CoherentIF(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo,  MaskExpander & _maskEx, DominatorTree & _domTree, PostDominatorTree & _postDomTree, LoopInfo & _loopInfo, BranchProbabilityInfo * _pbInfo, const LaneProfile * _laneProfile)
 : vecInfo(_vecInfo)
 , platInfo(_platInfo)
 , maskEx(_maskEx)
@@ -77,6 +80,7 @@ CoherentIF(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo,  MaskExpander
 , loopInfo(_loopInfo)
 , mod(*vecInfo.getScalarFunction().getParent())
 , pbInfo(_pbInfo)
+, laneProfile(_laneProfile)
 , BranchEst(vecInfo, platInfo, maskEx, domTree, loopInfo, pbInfo)
 {}
 
@@ -169,6 +173,16 @@ void CloneBasicBlockForDominatedBBs (BasicBlock *BB, SmallVector<BasicBlock *, 1
   }
 }
 
+// probability that all lanes take successor @succIdx of @branch (the variant without masking runs)
+double
+getCoherentProbability(BranchInst & branch, int succIdx) {
+  const auto * profOutcomes = laneProfile ? laneProfile->getOutcomes(branch) : nullptr;
+  if (profOutcomes) return profOutcomes->getAllTakenRatio(succIdx);
+
+  // CIF bets on lanes that agree, the edge of one lane stands for all of them
+  return BranchEst.GetEdgeProb(*branch.getParent(), *branch.getSuccessor(succIdx));
+}
+
 //Utilizing uttermost the coherent control flow and mimimize the masked instruction numbers
 //Transform Warp-Coherent Condition
 void
@@ -181,6 +195,7 @@ transformCoherentCF (BranchInst & branch, int succIdx) {
   BasicBlock *ConBlock = branch.getSuccessor(succIdx);
 
   if (!domTree.dominates(branch.getParent(), ConBlock)) return;
+  double coherentProb = getCoherentProbability(branch, succIdx);
 
   //First we split the block containing the branch into 2 blocks
   auto * loop = loopInfo.getLoopFor(branch.getParent());
@@ -248,6 +263,7 @@ transformCoherentCF (BranchInst & branch, int succIdx) {
   // Create the runtime ckeck and insert the code variant
   auto * wccBr = builder.CreateCondBr(wccCond, clonedConBlock, EndBlock);
   vecInfo.setVectorShape(*wccBr, VectorShape::uni());
+  setBranchProbability(*wccBr, coherentProb);
 
   auto * CstartBr = BranchInst::Create(TrueBlock, StartBlock);
   vecInfo.setVectorShape(*CstartBr,VectorShape::uni());
@@ -429,6 +445,21 @@ IsAffine (Instruction* instruction)
 // currently only cope with BOSCC and CIF
 int
 PickSuccessorForCIF(BranchInst & branch, bool onTrueLegal, bool onFalseLegal) {
+  // profiled branches: variant for the successor that all active lanes took often enough
+  const auto * profOutcomes = laneProfile ? laneProfile->getOutcomes(branch) : nullptr;
+  if (profOutcomes) {
+    const double minCoherentRatio = GetValue<double>("CIF_PROFILE_T", 0.25);
+    double onTrueRatio = profOutcomes->getAllTakenRatio(0);
+    double onFalseRatio = profOutcomes->getAllTakenRatio(1);
+    IF_DEBUG_CIF { errs() << "CIF: profiled coherent ratios " << onTrueRatio << " / " << onFalseRatio << " (CIF_PROFILE_T=" << minCoherentRatio << ")\n"; }
+
+    bool couldTransTrue = onTrueLegal && onTrueRatio >= minCoherentRatio;
+    bool couldTransFalse = onFalseLegal && onFalseRatio >= minCoherentRatio;
+    if (couldTransTrue && (!couldTransFalse || onTrueRatio > onFalseRatio)) return -1;
+    if (couldTransFalse) return 1;
+    return 0;
+  }
+
   double trueRatio = 0.0;
   double falseRatio = 0.0;
   size_t onTrueScore = 0;
@@ -499,8 +530,9 @@ run() {
     }
 
 
-    // if affine fails, then use high probability
-    if (IsAffine(dyn_cast<Instruction>(branchCond))) {
+    // if affine fails, then use high probability (profiles take precedence)
+    bool profiled = laneProfile && laneProfile->getOutcomes(*branchInst);
+    if (!profiled && IsAffine(dyn_cast<Instruction>(branchCond))) {
       IF_DEBUG_CIF {errs()<< *branchCond << " is affine condition" << "\n";}
       ++numCIFBranches;
       transformCoherentCF(*branchInst, 0);
@@ -538,11 +570,11 @@ run() {
 
 bool
 CoherentIFTransform::run() {
-  CoherentIF coherentif(vecInfo, platInfo, maskEx, domTree, postDomTree, loopInfo, pbInfo);
+  CoherentIF coherentif(vecInfo, platInfo, maskEx, domTree, postDomTree, loopInfo, pbInfo, laneProfile);
   return coherentif.run();
 }
 
-CoherentIFTransform::CoherentIFTransform (VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, llvm::FunctionAnalysisManager &FAM)
+CoherentIFTransform::CoherentIFTransform (VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, llvm::FunctionAnalysisManager &FAM, const LaneProfile * _laneProfile)
 : vecInfo(_vecInfo)
 , platInfo(_platInfo)
 , maskEx(_maskEx)
@@ -550,4 +582,5 @@ CoherentIFTransform::CoherentIFTransform (VectorizationInfo & _vecInfo, Platform
 , postDomTree(FAM.getResult<PostDominatorTreeAnalysis>(vecInfo.getScalarFunction()))
 , loopInfo(*FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction()))
 , pbInfo(&FAM.getResult<BranchProbabilityAnalysis>(vecInfo.getScalarFunction()))
+, laneProfile(_laneProfile)
 {}
@@ -27,6 +27,7 @@
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/ADT/DepthFirstIterator.h>
 
 #include "llvm/Transforms/Utils/SSAUpdater.h"
 #include <cassert>
@@ -38,6 +39,7 @@
 #include "rvConfig.h"
 #include "rv/config.h"
 #include "rv/rvDebug.h"
+#include "utils/phaseTimer.h"
 #include "utils/rvTools.h"
 
 #if 1
@@ -63,7 +65,8 @@ using namespace llvm;
 namespace rv {
 
 Linearizer::Linearizer(Config _config, VectorizationInfo & _vecInfo, MaskExpander & _maskEx, llvm::FunctionAnalysisManager &FAM)
-: numCUniPhis(0)
+: usePressureSched(false)
+, numCUniPhis(0)
 , numCDivPhis(0)
 , numUniformAssignments(0)
 , numPreservedAssignments(0)
@@ -105,7 +108,8 @@ Linearizer::scheduleDomRegion(BasicBlock * domEntry, Loop * loop, std::string pa
 
   auto * domRegionNode = dt.getNode(domEntry);
 
-  // schedule all nested dom regions in rpo
+  // collect all nested dom regions in rpo
+  SmallVector<RPOT::rpo_iterator, 8> children;
   for (auto it = itStart; it != itEnd; ++it) {
     auto * BB = *it;
     if (!vecInfo.inRegion(*BB)) continue;
@@ -117,6 +121,13 @@ Linearizer::scheduleDomRegion(BasicBlock * domEntry, Loop * loop, std::string pa
     if (bbParentDom != domRegionNode) {
       continue;
     }
+    children.push_back(it);
+  }
+
+  if (usePressureSched) orderByPressure(*domEntry, loop, children);
+
+  for (auto it : children) {
+    auto * BB = *it;
 
 
   // schedule the entire loop as an IDom
@@ -165,6 +176,160 @@ Linearizer::scheduleLoop(Loop * loop, std::string padStr, RPOT::rpo_iterator itS
   }
 }
 
+// whether @inst occupies a vector register
+static bool
+IsVectorValue(const VectorizationInfo & vecInfo, const Instruction & inst) {
+  if (inst.getType()->isVoidTy() || !vecInfo.hasKnownShape(inst)) return false;
+  return !vecInfo.getVectorShape(inst).isUniform();
+}
+
+// the block where @use reads its value (the incoming block for phis)
+static const BasicBlock *
+GetUseBlock(const Use & use) {
+  auto * userInst = dyn_cast<Instruction>(use.getUser());
+  if (!userInst) return nullptr;
+  auto * phi = dyn_cast<PHINode>(userInst);
+  if (phi) return phi->getIncomingBlock(use);
+  return userInst->getParent();
+}
+
+// Greedy list scheduling of the dom subtrees below @domEntry: among the children whose sibling predecessors are
+// scheduled, pick the one that leaves the fewest additional vector values live (live-outs minus last uses).
+void
+Linearizer::orderByPressure(BasicBlock & domEntry, Loop * loop, SmallVectorImpl<RPOT::rpo_iterator> & children) const {
+  if (children.size() < 2) return;
+
+  // nested loops also schedule their exits, keep the rpo order on those levels
+  for (auto it : children) {
+    if (li.getLoopFor(*it) != loop) return;
+  }
+
+  int numChildren = children.size();
+  auto getChildOf = [&](const BasicBlock & block) {
+    for (int i = 0; i < numChildren; ++i) {
+      if (dt.dominates(*children[i], &block)) return i;
+    }
+    return -1;
+  };
+
+  // vector values from above that are used in a child and vector values that leave the child
+  std::vector<SmallPtrSet<const Instruction*, 16>> usedValues(numChildren);
+  std::vector<long> numLiveOuts(numChildren, 0);
+  for (int i = 0; i < numChildren; ++i) {
+    for (auto * node : depth_first(dt.getNode(*children[i]))) {
+      auto & block = *node->getBlock();
+      if (!inRegion(block)) continue;
+
+      for (auto & inst : block) {
+        if (!IsVectorValue(vecInfo, inst)) continue;
+        bool liveOut = false;
+        for (auto & use : inst.uses()) {
+          auto * useBlock = GetUseBlock(use);
+          if (!useBlock) continue;
+          liveOut |= !dt.dominates(*children[i], useBlock);
+        }
+        numLiveOuts[i] += liveOut;
+      }
+    }
+  }
+
+  // operands are read where their use is located (phi operands in the sibling they come from)
+  SmallPtrSet<const Instruction*, 32> escaping; // live beyond the children
+  for (auto & block : func) {
+    if (!inRegion(block)) continue;
+    for (auto & inst : block) {
+      for (auto & use : inst.operands()) {
+        auto * opInst = dyn_cast<Instruction>(use.get());
+        if (!opInst || !IsVectorValue(vecInfo, *opInst)) continue;
+        if (!dt.dominates(opInst->getParent(), &domEntry)) continue; // defined inside of a child
+
+        auto * useBlock = GetUseBlock(use);
+        if (!useBlock || useBlock == &domEntry || !dt.dominates(&domEntry, useBlock)) {
+          if (useBlock != &domEntry) escaping.insert(opInst);
+          continue;
+        }
+        int useChild = getChildOf(*useBlock);
+        if (useChild < 0) escaping.insert(opInst);
+        else usedValues[useChild].insert(opInst);
+      }
+    }
+  }
+
+  SmallVector<RPOT::rpo_iterator, 8> order;
+  std::vector<bool> scheduled(numChildren, false);
+  while ((int) order.size() < numChildren) {
+    int best = -1;
+    long bestScore = 0;
+    for (int i = 0; i < numChildren; ++i) {
+      if (scheduled[i]) continue;
+
+      // keep the index topological
+      bool ready = true;
+      for (auto * predBlock : predecessors(*children[i])) {
+        int predChild = getChildOf(*predBlock);
+        ready &= (predChild < 0) || (predChild == i) || scheduled[predChild];
+      }
+      if (!ready) continue;
+
+      long numKills = 0;
+      for (auto * val : usedValues[i]) {
+        if (escaping.count(val)) continue;
+        bool lastUse = true;
+        for (int j = 0; j < numChildren && lastUse; ++j) {
+          lastUse = (j == i) || scheduled[j] || !usedValues[j].count(val);
+        }
+        numKills += lastUse;
+      }
+
+      // ties keep the rpo order
+      long score = numLiveOuts[i] - numKills;
+      if (best < 0 || score < bestScore) {
+        best = i;
+        bestScore = score;
+      }
+    }
+
+    assert(best >= 0 && "cyclic dependence among dom siblings");
+    scheduled[best] = true;
+    order.push_back(children[best]);
+  }
+
+  IF_DEBUG_INDEX {
+    errs() << "pressure order below " << domEntry.getName() << ":";
+    for (auto it : order) errs() << " " << (*it)->getName();
+    errs() << "\n";
+  }
+  children.assign(order.begin(), order.end());
+}
+
+size_t
+Linearizer::estimateMaxLive() const {
+  int numBlocks = getNumBlocks();
+  std::vector<long> liveDelta(numBlocks + 1, 0);
+  for (int i = 0; i < numBlocks; ++i) {
+    for (auto & inst : getBlock(i)) {
+      if (!IsVectorValue(vecInfo, inst)) continue;
+
+      // live from the def to the last (indexed) use, uses outside the index keep it live until the end
+      int lastUse = i;
+      for (auto & use : inst.uses()) {
+        auto * useBlock = GetUseBlock(use);
+        if (!useBlock) continue;
+        lastUse = std::max(lastUse, hasIndex(*useBlock) ? getIndex(*useBlock) : numBlocks - 1);
+      }
+      ++liveDelta[i];
+      --liveDelta[lastUse + 1];
+    }
+  }
+
+  long numLive = 0, maxLive = 0;
+  for (int i = 0; i < numBlocks; ++i) {
+    numLive += liveDelta[i];
+    maxLive = std::max(maxLive, numLive);
+  }
+  return maxLive;
+}
+
 void
 Linearizer::buildBlockIndex() {
   relays.reserve(func.size());
@@ -176,7 +341,18 @@ Linearizer::buildBlockIndex() {
   Loop * topLoop = li.getLoopFor(&entryBlock);
 
   scheduleDomRegion(&entryBlock, topLoop, "", rpot.begin(), rpot.end());
-  return;
+  if (!config.enablePressureSched) return;
+
+  // re-schedule with the rpo order as the reference
+  size_t rpoMaxLive = estimateMaxLive();
+  relays.clear();
+  blockIndex.clear();
+
+  usePressureSched = true;
+  scheduleDomRegion(&entryBlock, topLoop, "", rpot.begin(), rpot.end());
+  usePressureSched = false;
+
+  Report() << "parlin schedule: max. " << rpoMaxLive << " live vector values in rpo order, " << estimateMaxLive() << " in pressure order\n";
 }
 
 Value&
@@ -458,8 +634,11 @@ DomTreeNodeBase<BasicBlock> *
 FindIDom(const T & inBlocks, DominatorTree & dt) {
   BasicBlock * commonDomBlock = nullptr;
   for (auto * predBlock : inBlocks) {
+    // repeated predecessors (multiple edges) and the root do not change the common dominator
+    if (predBlock == commonDomBlock) continue;
     if (!commonDomBlock) { commonDomBlock = predBlock; }
     else { commonDomBlock = dt.findNearestCommonDominator(commonDomBlock, predBlock); }
+    if (dt.getNode(commonDomBlock) == dt.getRootNode()) break;
 
     IF_DEBUG_DTFIX { errs() << "\t\t\t: dom with " << predBlock->getName() << " is " << commonDomBlock->getName() << "\n"; }
 
@@ -514,22 +693,22 @@ public:
   // return the most frequent incoming value of this phi node
   // TODO accept Undef (since extra-predication for undef is waste)
   Value*
-  getFrequentIncomingValue(PHINode & phi) const {
+  getFrequentIncomingValue(const IncomingValueMap & inValues) const {
     int incumbentCount = 1;
 
     std::map<const Value*, int> tally;
 
-    Value * incumbent = phi.getIncomingValueForBlock(inBlocks[0]);
+    Value * incumbent = inValues.lookup(inBlocks[0]);
     int i = 0;
 
     // forward to first non-undef incoming value
     for (i = 0; i < (int) inBlocks.size() && isa<UndefValue>(incumbent); ++i) {
-      incumbent = phi.getIncomingValueForBlock(inBlocks[i]);
+      incumbent = inValues.lookup(inBlocks[i]);
     }
 
     // pick most-frequent, non-undef incoming value
     for (; i < (int) inBlocks.size(); ++i) {
-      Value * otherInValue = phi.getIncomingValueForBlock(inBlocks[i]);
+      Value * otherInValue = inValues.lookup(inBlocks[i]);
 
       if (isa<UndefValue>(otherInValue)) continue;
 
@@ -580,7 +759,7 @@ GetCommonLoop(LoopInfo & li, SuperBlockVec & blocks) {
 
 /// \brief create a super input value for this phi node
 Value *
-Linearizer::createSuperInput(PHINode & phi, SuperInput & superInput) {
+Linearizer::createSuperInput(PHINode & phi, const IncomingValueMap & inValues, SuperInput & superInput) {
   Constant * falseMask = ConstantInt::getFalse(phi.getContext());
 
   auto & blocks = superInput.inBlocks;
@@ -592,7 +771,7 @@ Linearizer::createSuperInput(PHINode & phi, SuperInput & superInput) {
   auto * defaultValue = shadowValue;
   if (!defaultValue) {
     // just default to the first incoming value, otw
-    defaultValue = superInput.getFrequentIncomingValue(phi);
+    defaultValue = superInput.getFrequentIncomingValue(inValues);
   }
 
   // early exit: there is only one predecessor: no phis, no blend blocks -> return that value right away
@@ -631,7 +810,7 @@ Linearizer::createSuperInput(PHINode & phi, SuperInput & superInput) {
   auto phiShape = vecInfo.getVectorShape(phi);
   for (size_t i = 0; i < blocks.size(); ++i) {
     auto * inBlock = blocks[i];
-    auto * inVal = phi.getIncomingValueForBlock(inBlock);
+    auto * inVal = inValues.lookup(inBlock);
 
     // we are defaulting to this input anyway (no need to blend it in)
     if (inVal == defaultValue) {
@@ -780,7 +959,7 @@ Linearizer::foldPhis(BasicBlock & block) {
       IF_DEBUG_LIN { errs() << "\t   inspecting pred " << predBlock->getName() << "\n"; }
 
       assert(hasIndex(*predBlock));
-      auto & predReachingBlocks = getReachingBlocks(getIndex(*predBlock));
+      const auto & predRelay = getRelayUnchecked(getIndex(*predBlock));
 
       // all inputs that are incoming on this edge after folding
       SuperBlockVec superposedInBlocks;
@@ -789,7 +968,7 @@ Linearizer::foldPhis(BasicBlock & block) {
         auto * inBlock = protoPhi->getIncomingBlock(i);
 
         // otw, this value needs blending on any dominated input
-        if (predBlock == inBlock || predReachingBlocks.count(inBlock)) {
+        if (predBlock == inBlock || (hasIndex(*inBlock) && predRelay.isReachedBy(getIndex(*inBlock)))) {
           IF_DEBUG_LIN { errs() <<  "\t      - reaching in block " << inBlock->getName() << "\n";  }
           superposedInBlocks.push_back(inBlock);
           seenInputs.insert(inBlock);
@@ -849,6 +1028,10 @@ Linearizer::foldPhis(BasicBlock & block) {
   // materialize blended inputs
     auto phiShape = vecInfo.getVectorShape(*phi);
     auto & flatPhi = *PHINode::Create(phi->getType(), 6, phi->getName(), phi);
+    IncomingValueMap inValues;
+    for (size_t i = 0; i < phi->getNumIncomingValues(); ++i) {
+      inValues.try_emplace(phi->getIncomingBlock(i), phi->getIncomingValue(i));
+    }
     SmallPtrSet<const BasicBlock*, 4>  seenPreds;
     for (auto * predBlock : predecessors(&block)) {
       if (!seenPreds.insert(predBlock).second) continue;
@@ -858,7 +1041,7 @@ Linearizer::foldPhis(BasicBlock & block) {
       assert(itSuperInput != selectBlockMap.end());
 
       // folded iput
-      auto * superInVal = createSuperInput(*phi, itSuperInput->second);
+      auto * superInVal = createSuperInput(*phi, inValues, itSuperInput->second);
       auto & superInput = itSuperInput->second;
 
       auto * selectBlock = superInput.blendBlock ? superInput.blendBlock : predBlock;
@@ -1113,14 +1296,13 @@ Linearizer::containsOriginalPhis(BasicBlock & block) {
 void
 Linearizer::mergeInReaching(RelayNode & dest, RelayNode & source) {
   if (&dest == &source) return;
-  for (auto * bb: source.reachingBlocks) {
-    dest.addReachingBlock(*bb);
-  }
+  dest.reachingBlocks |= source.reachingBlocks;
 }
 
 
 void
 Linearizer::processBranch(BasicBlock & head, RelayNode * exitRelay, Loop * parentLoop) {
+  EntityTimer branchTimer("branch", head, *head.getParent());
   IF_DEBUG_LIN {
     errs() << "  processBranch : " << *head.getTerminator() << " of block " << head.getName() << "\n";
   }
@@ -1186,7 +1368,7 @@ Linearizer::processBranch(BasicBlock & head, RelayNode * exitRelay, Loop * paren
 
       // if the branch target feeds a phi and the edge is relayed -> track reachability
       if (containsOriginalPhis(destBlock)) {
-         relay.addReachingBlock(head);
+         relay.addReachingBlock(getIndex(head));
       }
 
       // redirect branch to relay
@@ -1233,7 +1415,7 @@ Linearizer::processBranch(BasicBlock & head, RelayNode * exitRelay, Loop * paren
 
   // the branch to secondBlock is relayed -> remember we came from head
   if (containsOriginalPhis(*secondBlock)) {
-    firstRelay->addReachingBlock(head);
+    firstRelay->addReachingBlock(getIndex(head));
   }
 
   firstRelay = &addTargetToRelay(firstRelay, secondId);
@@ -1268,9 +1450,9 @@ Linearizer::processBranch(BasicBlock & head, RelayNode * exitRelay, Loop * paren
 
   // auto & secondRelay = requestRelay(secondMustHaves);
   if (containsOriginalPhis(*secondBlock)) {
-    secondRelay.addReachingBlock(head);
+    secondRelay.addReachingBlock(getIndex(head));
   }
-  secondRelay.addReachingBlock(*firstBlock);
+  secondRelay.addReachingBlock(firstId);
 
 // mark branch as non-divergent
   vecInfo.setVectorShape(*branch, VectorShape::uni());
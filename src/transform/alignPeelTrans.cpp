@@ -0,0 +1,174 @@
+//===- src/transform/alignPeelTrans.cpp - peel iterations until an access is aligned --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/alignPeelTrans.h"
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include "rvConfig.h"
+
+#if 1
+#define IF_DEBUG_PEEL IF_DEBUG
+#else
+#define IF_DEBUG_PEEL if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+// the address recurrence of \p access if it advances by one element per iteration of \p L
+static const SCEVAddRecExpr *
+GetContiguousRecurrence(Loop & L, Instruction & access, ScalarEvolution & SE) {
+  auto * ptr = getLoadStorePointerOperand(&access);
+  auto * ptrRec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(ptr));
+  if (!ptrRec || ptrRec->getLoop() != &L || !ptrRec->isAffine()) return nullptr;
+
+  auto * step = dyn_cast<SCEVConstant>(ptrRec->getStepRecurrence(SE));
+  const DataLayout & DL = access.getModule()->getDataLayout();
+  uint64_t elemSize = DL.getTypeAllocSize(getLoadStoreType(&access));
+  if (!step || !isPowerOf2_64(elemSize) || step->getAPInt() != elemSize) return nullptr;
+  return ptrRec;
+}
+
+Instruction *
+AlignPeelTransform::getPeelAccess(Loop & L) const {
+  auto * latch = L.getLoopLatch();
+  if (!L.getLoopPreheader() || !latch || L.getExitingBlock() != latch || !L.getExitBlock()) return nullptr;
+  auto * latchBr = dyn_cast<BranchInst>(latch->getTerminator());
+  if (!latchBr || !latchBr->isConditional() || !isPowerOf2_32(vectorWidth)) return nullptr;
+
+  Instruction * loadAccess = nullptr;
+  for (auto * block : L.blocks()) {
+    if (LI.getLoopFor(block) != &L) continue; // accesses of inner loops do not stream with L
+    for (auto & inst : *block) {
+      auto * load = dyn_cast<LoadInst>(&inst);
+      auto * store = dyn_cast<StoreInst>(&inst);
+      if (!(load && load->isSimple()) && !(store && store->isSimple())) continue;
+
+      auto * ptrRec = GetContiguousRecurrence(L, inst, SE);
+      if (!ptrRec || !isSafeToExpand(ptrRec->getStart(), SE)) continue;
+
+      // nothing to gain if the start address is aligned already
+      const DataLayout & DL = inst.getModule()->getDataLayout();
+      uint64_t vecAlign = vectorWidth * DL.getTypeAllocSize(getLoadStoreType(&inst));
+      if (SE.GetMinTrailingZeros(ptrRec->getStart()) >= Log2_64(vecAlign)) continue;
+
+      // misaligned stores split cache lines on every write
+      if (store) return &inst;
+      if (!loadAccess) loadAccess = &inst;
+    }
+  }
+  return loadAccess;
+}
+
+BasicBlock *
+AlignPeelTransform::run(Loop & L, Instruction & access) {
+  formLCSSA(L, DT, &LI, &SE);
+
+  auto * preHeader = L.getLoopPreheader();
+  auto * header = L.getHeader();
+  auto * latch = L.getLoopLatch();
+  auto * exitBlock = L.getExitBlock();
+  auto & ctx = F.getContext();
+  const DataLayout & DL = F.getParent()->getDataLayout();
+
+  // number of iterations until the access is vector aligned
+  auto * ptr = getLoadStorePointerOperand(&access);
+  auto * ptrRec = GetContiguousRecurrence(L, access, SE);
+  assert(ptrRec && "not a peelable access");
+  uint64_t elemSize = DL.getTypeAllocSize(getLoadStoreType(&access));
+  uint64_t vecAlign = vectorWidth * elemSize;
+
+  SCEVExpander expander(SE, DL, "rv.peel");
+  auto * startPtr = expander.expandCodeFor(ptrRec->getStart(), ptr->getType(), preHeader->getTerminator());
+  IRBuilder<> builder(preHeader->getTerminator());
+  auto * intPtrTy = DL.getIntPtrType(ptr->getType());
+  auto * startInt = builder.CreatePtrToInt(startPtr, intPtrTy, "peel.start");
+  auto * misalign = builder.CreateAnd(builder.CreateNeg(startInt), vecAlign - 1, "peel.misalign");
+  auto * peelCount = builder.CreateLShr(misalign, Log2_64(elemSize), "peel.count");
+  auto * skipPeel = builder.CreateICmpEQ(peelCount, ConstantInt::get(intPtrTy, 0), "peel.skip");
+
+  // clone the loop body for the peel loop
+  ValueToValueMapTy cloneMap;
+  SmallVector<BasicBlock*, 16> peelBlocks;
+  for (auto * block : L.blocks()) {
+    auto * peelBlock = CloneBasicBlock(block, cloneMap, ".peel", &F);
+    cloneMap[block] = peelBlock;
+    peelBlocks.push_back(peelBlock);
+  }
+  remapInstructionsInBlocks(peelBlocks, cloneMap);
+  auto lookUp = [&](Value * val) -> Value * {
+    Value * clonedVal = cloneMap.lookup(val);
+    return clonedVal ? clonedVal : val;
+  };
+
+  auto * peelHeader = cast<BasicBlock>(cloneMap[header]);
+  auto * peelLatch = cast<BasicBlock>(cloneMap[latch]);
+
+  // the peel loop continues through peelNext, which leaves after peelCount iterations
+  auto * peelNext = BasicBlock::Create(ctx, "peel.next", &F);
+  auto * mainPreHeader = BasicBlock::Create(ctx, "peel.done", &F, header);
+  auto * peelBr = cast<BranchInst>(peelLatch->getTerminator());
+  for (unsigned i = 0; i < peelBr->getNumSuccessors(); ++i) {
+    if (peelBr->getSuccessor(i) == peelHeader) peelBr->setSuccessor(i, peelNext);
+  }
+  for (auto & phi : peelHeader->phis()) phi.replaceIncomingBlockWith(peelLatch, peelNext);
+
+  auto * iter = PHINode::Create(intPtrTy, 2, "peel.iter", peelHeader->getFirstNonPHI());
+  IRBuilder<> latchBuilder(peelBr);
+  auto * nextIter = latchBuilder.CreateAdd(iter, ConstantInt::get(intPtrTy, 1), "peel.iter.next");
+  iter->addIncoming(ConstantInt::get(intPtrTy, 0), preHeader);
+  iter->addIncoming(nextIter, peelNext);
+
+  IRBuilder<> nextBuilder(peelNext);
+  auto * peelDone = nextBuilder.CreateICmpEQ(nextIter, peelCount, "peel.done");
+  nextBuilder.CreateCondBr(peelDone, mainPreHeader, peelHeader);
+
+  // the loop starts from the state after the peel loop
+  auto * mainBr = BranchInst::Create(header, mainPreHeader);
+  for (auto & phi : header->phis()) {
+    int preHeaderIdx = phi.getBasicBlockIndex(preHeader);
+    auto * startPhi = PHINode::Create(phi.getType(), 2, phi.getName() + ".peel.start", mainBr);
+    startPhi->addIncoming(phi.getIncomingValue(preHeaderIdx), preHeader);
+    startPhi->addIncoming(lookUp(phi.getIncomingValueForBlock(latch)), peelNext);
+    phi.setIncomingBlock(preHeaderIdx, mainPreHeader);
+    phi.setIncomingValue(preHeaderIdx, startPhi);
+  }
+
+  // enter the peel loop if the access is misaligned
+  auto * entryBr = preHeader->getTerminator();
+  BranchInst::Create(mainPreHeader, peelHeader, skipPeel, entryBr);
+  entryBr->eraseFromParent();
+
+  // live-outs of trip counts below peelCount (LCSSA form)
+  for (auto & phi : exitBlock->phis()) {
+    phi.addIncoming(lookUp(phi.getIncomingValueForBlock(latch)), peelLatch);
+  }
+
+  IF_DEBUG_PEEL {
+    errs() << "alignPeel: peeling " << L.getName() << " to a " << vecAlign << " byte aligned " << access << "\n";
+  }
+
+  return peelHeader;
+}
+
+} // namespace rv
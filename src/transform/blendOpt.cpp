@@ -0,0 +1,211 @@
+//===- src/transform/blendOpt.cpp - simplify blends after linearization --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/blendOpt.h"
+
+#include "rv/transform/maskExpander.h"
+#include "rv/vectorizationInfo.h"
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/PatternMatch.h>
+#include <llvm/IR/ValueHandle.h>
+
+#include "rvConfig.h"
+#include "report.h"
+
+#if 1
+#define IF_DEBUG_BO IF_DEBUG
+#else
+#define IF_DEBUG_BO if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+// !@mask as an existing value (nullptr if there is none)
+static Value *
+GetNegatedMask(Value & mask) {
+  using namespace llvm::PatternMatch;
+  Value * X;
+  if (match(&mask, m_Not(m_Value(X)))) return X;
+  for (auto * user : mask.users()) {
+    if (match(user, m_Not(m_Specific(&mask)))) return user;
+  }
+  return nullptr;
+}
+
+// side-effect free computations that yield the same value in all lanes wherever they execute
+static bool
+IsRecomputable(const Instruction & inst) {
+  if (!isa<BinaryOperator>(inst) && !isa<CastInst>(inst) && !isa<GetElementPtrInst>(inst) && !isa<CmpInst>(inst)) return false;
+  return isSafeToSpeculativelyExecute(&inst);
+}
+
+static bool
+IsEquivalent(Value & a, Value & b) {
+  if (&a == &b) return true;
+  auto * aInst = dyn_cast<Instruction>(&a);
+  auto * bInst = dyn_cast<Instruction>(&b);
+  return aInst && bInst && IsRecomputable(*aInst) && aInst->isIdenticalTo(bInst);
+}
+
+// erase @blend and the blends that only fed it (the masks may be block predicates, leave them to the backend)
+static size_t
+EraseDeadBlend(SelectInst & blend) {
+  SmallVector<SelectInst*, 2> operandBlends;
+  for (auto & op : blend.operands()) {
+    auto * opBlend = dyn_cast<SelectInst>(op.get());
+    if (opBlend && opBlend != &blend && !is_contained(operandBlends, opBlend)) operandBlends.push_back(opBlend);
+  }
+  blend.eraseFromParent();
+
+  size_t numErased = 1;
+  for (auto * opBlend : operandBlends) {
+    if (opBlend->use_empty()) numErased += EraseDeadBlend(*opBlend);
+  }
+  return numErased;
+}
+
+bool
+BlendOptimizer::isDecided(Value & pred, SelectInst & blend, Value *& oValue) const {
+  auto & cond = *blend.getCondition();
+  if (!cond.getType()->isIntegerTy(1)) return false;
+
+  if (maskEx.implies(pred, cond)) {
+    oValue = blend.getTrueValue();
+    return true;
+  }
+  auto * negCond = GetNegatedMask(cond);
+  if (negCond && maskEx.implies(pred, *negCond)) {
+    oValue = blend.getFalseValue();
+    return true;
+  }
+  return false;
+}
+
+Value *
+BlendOptimizer::mergeChain(SelectInst & blend) {
+  auto & outerCond = *blend.getCondition();
+  if (!outerCond.getType()->isIntegerTy(1)) return nullptr;
+
+  // select(m1, a, select(m2, a, b)) -> select(m1 || m2, a, b)
+  auto * inner = dyn_cast<SelectInst>(blend.getFalseValue());
+  bool joinConds = inner && IsEquivalent(*blend.getTrueValue(), *inner->getTrueValue());
+  // select(m1, select(m2, a, b), b) -> select(m1 && m2, a, b)
+  if (!joinConds) {
+    inner = dyn_cast<SelectInst>(blend.getTrueValue());
+    if (!inner || !IsEquivalent(*blend.getFalseValue(), *inner->getFalseValue())) return nullptr;
+  }
+  // no savings if the inner blend stays
+  auto & innerCond = *inner->getCondition();
+  if (!inner->hasOneUse() || innerCond.getType() != outerCond.getType()) return nullptr;
+
+  IRBuilder<> builder(&blend);
+  auto * cond = joinConds ? builder.CreateOr(&outerCond, &innerCond, "blend.or")
+                          : builder.CreateAnd(&outerCond, &innerCond, "blend.and");
+  if (isa<Instruction>(cond)) {
+    vecInfo.setVectorShape(*cond, VectorShape::join(vecInfo.getVectorShape(outerCond), vecInfo.getVectorShape(innerCond)));
+  }
+
+  auto * trueVal = joinConds ? blend.getTrueValue() : inner->getTrueValue();
+  auto * falseVal = joinConds ? inner->getFalseValue() : blend.getFalseValue();
+  auto * merged = builder.CreateSelect(cond, trueVal, falseVal, blend.getName());
+  if (isa<Instruction>(merged)) vecInfo.setVectorShape(*merged, vecInfo.getVectorShape(blend));
+  return merged;
+}
+
+Value *
+BlendOptimizer::foldEqual(SelectInst & blend) {
+  if (!IsEquivalent(*blend.getTrueValue(), *blend.getFalseValue())) return nullptr;
+  return blend.getTrueValue();
+}
+
+Value *
+BlendOptimizer::foldImplied(SelectInst & blend) {
+  // lanes outside of the block predicate do not observe varying values of the block
+  if (vecInfo.getVectorShape(blend).isUniform()) return nullptr;
+  auto * pred = vecInfo.getPredicate(*blend.getParent());
+  Value * decidedVal = nullptr;
+  if (!pred || !isDecided(*pred, blend, decidedVal)) return nullptr;
+  return decidedVal;
+}
+
+bool
+BlendOptimizer::sinkIntoStore(StoreInst & store) {
+  // the store mask blends for us
+  auto * blend = dyn_cast<SelectInst>(store.getValueOperand());
+  auto * pred = vecInfo.getPredicate(*store.getParent());
+  Value * storedVal = nullptr;
+  if (!blend || !pred || !isDecided(*pred, *blend, storedVal)) return false;
+
+  IF_DEBUG_BO { errs() << "blendOpt: storing " << *storedVal << " instead of " << *blend << "\n"; }
+  store.setOperand(0, storedVal);
+  return true;
+}
+
+size_t
+BlendOptimizer::run() {
+  auto & func = vecInfo.getScalarFunction();
+  size_t numRemoved = 0;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    SmallVector<WeakVH, 32> blends;
+    SmallVector<StoreInst*, 16> stores;
+    for (auto & block : func) {
+      if (!vecInfo.inRegion(block)) continue;
+      for (auto & inst : block) {
+        if (isa<SelectInst>(inst)) blends.push_back(&inst);
+        else if (isa<StoreInst>(inst)) stores.push_back(cast<StoreInst>(&inst));
+      }
+    }
+
+    for (auto * store : stores) {
+      if (!sinkIntoStore(*store)) continue;
+      ++numStoreBlends;
+      changed = true;
+    }
+
+    for (auto & handle : blends) {
+      auto * blend = dyn_cast_or_null<SelectInst>(handle);
+      if (!blend) continue;
+
+      // blends that only fed stores
+      if (blend->use_empty()) {
+        numRemoved += EraseDeadBlend(*blend);
+        continue;
+      }
+
+      Value * replacement = nullptr;
+      size_t numCreated = 0;
+      if ((replacement = foldEqual(*blend))) ++numEqualBlends;
+      else if ((replacement = foldImplied(*blend))) ++numImpliedBlends;
+      else if ((replacement = mergeChain(*blend))) { ++numMergedBlends; numCreated = 1; }
+      else continue;
+
+      IF_DEBUG_BO { errs() << "blendOpt: replacing " << *blend << " with " << *replacement << "\n"; }
+      changed = true;
+      blend->replaceAllUsesWith(replacement);
+      numRemoved += EraseDeadBlend(*blend) - numCreated;
+    }
+  }
+
+  if (numRemoved > 0) {
+    Report() << "blendOpt: removed " << numRemoved << " blends (" << numMergedBlends << " merged chains, "
+             << numEqualBlends << " equal, " << numImpliedBlends << " implied, " << numStoreBlends << " stores)\n";
+  }
+  return numRemoved;
+}
+
+} // namespace rv
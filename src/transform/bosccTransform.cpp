@@ -9,6 +9,7 @@
 
 #include "rv/transform/bosccTransform.h"
 #include "rv/analysis/BranchEstimate.h"
+#include "rv/analysis/laneProfile.h"
 
 #include <vector>
 #include <sstream>
@@ -39,6 +40,7 @@
 #include "rv/rvDebug.h"
 #include <rvConfig.h>
 #include "report.h"
+#include "utils/rvTools.h"
 
 using namespace llvm;
 using namespace rv;
@@ -62,14 +64,30 @@ struct Impl {
   LoopInfo & loopInfo;
   Module & mod;
   BranchProbabilityInfo *pbInfo;
+  const LaneProfile * laneProfile;
+  bool heuristicBOSCC;
+  bool earlyExits;
 
   BranchEstimate BranchEst;
 
   // BOSCC region exit blocks (containing merge phis)
   BlockSet bosccExitBlocks;
 
+  // entry blocks of the skipped regions and their nesting level (1 for outermost regions)
+  std::vector<std::pair<const BasicBlock*, size_t>> bosccRegions;
 
-Impl(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo,  MaskExpander & _maskEx, DominatorTree & _domTree, PostDominatorTree & _postDomTree, LoopInfo & _loopInfo, BranchProbabilityInfo * _pbInfo)
+  // the number of skipped regions around @block
+  size_t
+  getBosccDepth(const BasicBlock & block) const {
+    size_t depth = 0;
+    for (auto & region : bosccRegions) {
+      if (domTree.dominates(region.first, &block)) depth = std::max(depth, region.second);
+    }
+    return depth;
+  }
+
+
+Impl(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo,  MaskExpander & _maskEx, DominatorTree & _domTree, PostDominatorTree & _postDomTree, LoopInfo & _loopInfo, BranchProbabilityInfo * _pbInfo, const LaneProfile * _laneProfile, bool _heuristicBOSCC, bool _earlyExits)
 : vecInfo(_vecInfo)
 , platInfo(_platInfo)
 , maskEx(_maskEx)
@@ -78,6 +96,9 @@ Impl(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo,  MaskExpander & _ma
 , loopInfo(_loopInfo)
 , mod(*vecInfo.getScalarFunction().getParent())
 , pbInfo(_pbInfo)
+, laneProfile(_laneProfile)
+, heuristicBOSCC(_heuristicBOSCC)
+, earlyExits(_earlyExits)
 , BranchEst(vecInfo, platInfo, maskEx, domTree, loopInfo, pbInfo)
 , bosccExitBlocks()
 {}
@@ -98,6 +119,9 @@ rec_createMergeBlock(BasicBlock & bosccEntry, BasicBlock & block, PHIMap & merge
 
     if (!domTree.dominates(&bosccEntry, &succ)) {
       IF_DEBUG_BOSCC errs() << "BOSCC EXIT " << bosccEntry.getName() << "  to  " << succ.getName() << "\n";
+      // nested region: the exit of the enclosing region already merges these values
+      if (bosccExitBlocks.count(&succ)) continue;
+
       // we reached a merge path (boscced control region merges with non-boscced control)
       for (auto & inst : succ) {
         auto * phi = dyn_cast<PHINode>(&inst);
@@ -195,6 +219,16 @@ createMergeBlock(BranchInst & branch, int succIdx) {
 }
 
 
+// probability that some lane enters successor @succIdx of @branch (the BOSCC branch does not skip it)
+double
+getEnterProbability(BranchInst & branch, int succIdx) {
+  const auto * profOutcomes = laneProfile ? laneProfile->getOutcomes(branch) : nullptr;
+  if (profOutcomes) return 1.0 - profOutcomes->getAllTakenRatio(1 - succIdx);
+
+  double laneProb = BranchEst.GetEdgeProb(*branch.getParent(), *branch.getSuccessor(succIdx));
+  return getAnyLaneProbability(laneProb, vecInfo.getVectorWidth());
+}
+
 void
 transformBranch(BranchInst & branch, int succIdx) {
   auto & context = branch.getContext();
@@ -206,6 +240,7 @@ transformBranch(BranchInst & branch, int succIdx) {
   auto * exitBlock = branch.getSuccessor(1 - succIdx);
   auto * branchCond = branch.getCondition();
   bool branchOnTrue = succIdx == 0;
+  double enterProb = getEnterProbability(branch, succIdx);
 
 
   assert(domTree.dominates(branch.getParent(), succBlock) && "can only BOSCC over dominated parts for now");
@@ -248,6 +283,7 @@ transformBranch(BranchInst & branch, int succIdx) {
 // create the BOSCC branch
   auto * bosccBr = builder.CreateCondBr(bosccCond, succBlock, exitBlock);
   vecInfo.setVectorShape(*bosccBr, VectorShape::uni());
+  setBranchProbability(*bosccBr, enterProb);
 
 // link bosccBranch into old branch
    branch.setSuccessor(succIdx, bosccBlock);
@@ -303,6 +339,21 @@ PickSuccessorForBoscc(BranchInst & branch) {
     errs () << "BOSCC: onFalseLegal to " << branch.getSuccessor(1)->getName() << " = " << onFalseLegal << "\n";
   }
 
+  // profiled branches: skip the successor that no active lane took often enough
+  const auto * profOutcomes = laneProfile ? laneProfile->getOutcomes(branch) : nullptr;
+  if (profOutcomes) {
+    const double minSkipRatio = GetValue<double>("BOSCC_PROFILE_T", 0.25);
+    double skipTrueRatio = profOutcomes->getAllTakenRatio(1);
+    double skipFalseRatio = profOutcomes->getAllTakenRatio(0);
+    IF_DEBUG_BOSCC { errs() << "BOSCC: profiled skip ratios " << skipTrueRatio << " / " << skipFalseRatio << " (BOSCC_PROFILE_T=" << minSkipRatio << ")\n"; }
+
+    bool couldTransTrue = onTrueLegal && skipTrueRatio >= minSkipRatio;
+    bool couldTransFalse = onFalseLegal && skipFalseRatio >= minSkipRatio;
+    if (couldTransTrue && (!couldTransFalse || skipTrueRatio > skipFalseRatio)) return -1;
+    if (couldTransFalse) return 1;
+    return 0;
+  }
+
   double trueRatio = 0.0;
   double falseRatio = 0.0;
   size_t onTrueScore = 0;
@@ -342,12 +393,58 @@ PickSuccessorForBoscc(BranchInst & branch) {
   return 0;
 }
 
+// whether @block runs into a return through unconditional branches (an early-out path, SingleReturnTrans joins the returns)
+static bool
+IsReturnPath(const BasicBlock & block) {
+  const size_t maxPathLength = 4;
+  const BasicBlock * pathBlock = &block;
+  for (size_t i = 0; i < maxPathLength; ++i) {
+    auto * term = pathBlock->getTerminator();
+    if (isa<ReturnInst>(term)) return true;
+    auto * branch = dyn_cast<BranchInst>(term);
+    if (!branch || branch->isConditional()) return false;
+    pathBlock = branch->getSuccessor(0);
+  }
+  return false;
+}
+
+// the successor of @branch that continues next to an early-out path (-1 if there is none or skipping it does not pay off).
+// Skipping it jumps to the return once all lanes returned.
+int
+PickEarlyExit(BranchInst & branch) {
+  bool onTrueLegal, onFalseLegal;
+  if (!BranchEst.CheckLegality(branch, onTrueLegal, onFalseLegal)) return -1;
+
+  bool trueReturns = IsReturnPath(*branch.getSuccessor(0));
+  bool falseReturns = IsReturnPath(*branch.getSuccessor(1));
+  if (trueReturns == falseReturns) return -1;
+  int contIdx = trueReturns ? 1 : 0;
+  if (!(contIdx == 0 ? onTrueLegal : onFalseLegal)) return -1;
+
+  double trueRatio = 0.0;
+  double falseRatio = 0.0;
+  size_t onTrueScore = 0;
+  size_t onFalseScore = 0;
+  BranchEst.analyze(branch, trueRatio, falseRatio, onTrueScore, onFalseScore);
+
+  // the exit check is a single rv_any, the remainder only has to outweigh that
+  const size_t minScore = GetValue<size_t>("BOSCC_EXIT_LIMIT", 24);
+  size_t contScore = contIdx == 0 ? onTrueScore : onFalseScore;
+  IF_DEBUG_BOSCC { errs() << "BOSCC: early exit at " << branch.getParent()->getName() << ", remainder score " << contScore << " (BOSCC_EXIT_LIMIT=" << minScore << ")\n"; }
+  return contScore >= minScore ? contIdx : -1;
+}
 
 bool
 run() {
   domTree.recalculate(vecInfo.getScalarFunction());
 
   size_t numBosccBranches = 0;
+  size_t numNestedBranches = 0;
+  size_t numEarlyExits = 0;
+
+  // nested regions get their own skip check up to this level
+  const size_t maxDepth = GetValue<size_t>("BOSCC_DEPTH", 8);
+  IF_DEBUG_BOSCC { errs() << "BOSCC_DEPTH=" << maxDepth << "\n"; }
 
   ReversePostOrderTraversal<Function*> RPOT(&vecInfo.getScalarFunction());
 
@@ -361,13 +458,27 @@ run() {
     if (!branchInst->isConditional()) continue;
     if (vecInfo.getVectorShape(*branchInst).isUniform()) continue;
 
-    // do not speculate across BOSCC exits
-    if (bosccExitBlocks.count(branchInst->getSuccessor(0)) || bosccExitBlocks.count(branchInst->getSuccessor(1))) return 0;
-    int score = PickSuccessorForBoscc(*branchInst);
-    if (score == 0) continue;
-    int succIdx = score < 0 ? 0 : 1;
+    // do not speculate across BOSCC exits (beyond the nesting budget)
+    size_t depth = getBosccDepth(*BB);
+    bool leavesRegion = bosccExitBlocks.count(branchInst->getSuccessor(0)) || bosccExitBlocks.count(branchInst->getSuccessor(1));
+    if (leavesRegion && depth == 0) return 0;
+    if (depth >= maxDepth) continue;
+
+    int succIdx = earlyExits ? PickEarlyExit(*branchInst) : -1;
+    bool isEarlyExit = succIdx >= 0;
+    if (!isEarlyExit && heuristicBOSCC) {
+      int score = PickSuccessorForBoscc(*branchInst);
+      if (score != 0) succIdx = score < 0 ? 0 : 1;
+    }
+    if (succIdx < 0) continue;
+
+    // the skipped successor itself is the merge block of the enclosing region
+    if (bosccExitBlocks.count(branchInst->getSuccessor(succIdx))) continue;
 
     ++numBosccBranches;
+    if (depth > 0) ++numNestedBranches;
+    if (isEarlyExit) ++numEarlyExits;
+    bosccRegions.emplace_back(branchInst->getSuccessor(succIdx), depth + 1);
 
     Report() << "boscc: skip succ " << branchInst->getSuccessor(succIdx)->getName() << " of block " << branchInst->getParent()->getName() << "\n";
 
@@ -377,7 +488,7 @@ run() {
     transformBranch(*branchInst, succIdx);
   }
 
-  if (numBosccBranches > 0) Report() << "boscc: inserted " << numBosccBranches << " BOSCC branches\n";
+  if (numBosccBranches > 0) Report() << "boscc: inserted " << numBosccBranches << " BOSCC branches (" << numNestedBranches << " nested, " << numEarlyExits << " early exits)\n";
 
   // recover
   postDomTree.recalculate(vecInfo.getScalarFunction());
@@ -397,12 +508,12 @@ run() {
 
 bool
 BOSCCTransform::run() {
-  Impl impl(vecInfo, platInfo, maskEx, domTree, postDomTree, loopInfo, pbInfo);
+  Impl impl(vecInfo, platInfo, maskEx, domTree, postDomTree, loopInfo, pbInfo, laneProfile, heuristicBOSCC, earlyExits);
   return impl.run();
 }
 
 
-BOSCCTransform::BOSCCTransform(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, FunctionAnalysisManager &FAM)
+BOSCCTransform::BOSCCTransform(VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, MaskExpander & _maskEx, FunctionAnalysisManager &FAM, const LaneProfile * _laneProfile, bool _heuristicBOSCC, bool _earlyExits)
 : vecInfo(_vecInfo)
 , platInfo(_platInfo)
 , maskEx(_maskEx)
@@ -410,4 +521,7 @@ BOSCCTransform::BOSCCTransform(VectorizationInfo & _vecInfo, PlatformInfo & _pla
 , postDomTree(FAM.getResult<PostDominatorTreeAnalysis>(vecInfo.getScalarFunction()))
 , loopInfo(*FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction()))
 , pbInfo(&FAM.getResult<BranchProbabilityAnalysis>(vecInfo.getScalarFunction()))
+, laneProfile(_laneProfile)
+, heuristicBOSCC(_heuristicBOSCC)
+, earlyExits(_earlyExits)
 {}
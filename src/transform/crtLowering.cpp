@@ -9,38 +9,252 @@
 
 #include "rv/transform/crtLowering.h"
 
+#include "rv/resolver/resolvers.h"
 #include "utils/rvLinking.h"
 #include "utils/rvTools.h"
 #include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 
 using namespace llvm;
 
-#ifdef RV_ENABLE_CRT
-extern const unsigned char * crt_Buffer;
-extern const size_t crt_BufferLen;
-
-#endif
-
 namespace rv {
 
 // compiler-rt early inlining
+// Only the requested routine (and what it uses) is materialized and cloned from the lazily loaded module.
 Function *
 requestScalarImplementation(const StringRef & funcName, FunctionType & funcTy, Module &insertInto) {
-#ifdef RV_ENABLE_CRT
-  static Module * scalarModule = nullptr;
-  if (!scalarModule) {
-    scalarModule = createModuleFromBuffer(reinterpret_cast<const char*>(&crt_Buffer), crt_BufferLen, insertInto.getContext());
+  auto scalarModule = requestCompilerRTModule(insertInto.getContext());
+  if (!scalarModule) return nullptr; // compiler-rt not available or could not load module
+
+  auto * scalarFn = scalarModule->getFunction(funcName);
+  if (!scalarFn || scalarFn->getFunctionType() != &funcTy) return nullptr;
+  return &cloneFunctionIntoModule(*scalarFn, insertInto, funcName, nullptr);
+}
+
+// complex arithmetic
+// Branch-free IR versions of the compiler-rt routines (as the __divdc3 and __mulxc3 of crt_vec.c), emitted
+// directly so that they do not depend on RV_ENABLE_CRT and stay in the SoA form of the real and imaginary parts.
+namespace {
+
+struct ComplexBuilder {
+  IRBuilder<> & builder;
+  Type & fpTy;
+  IntegerType & intTy;
+  int mantBits; // stored mantissa bits
+  int expBias;
+
+  ComplexBuilder(IRBuilder<> & builder, Type & fpTy)
+  : builder(builder)
+  , fpTy(fpTy)
+  , intTy(*builder.getIntNTy(fpTy.getPrimitiveSizeInBits()))
+  , mantBits(APFloat::semanticsPrecision(fpTy.getFltSemantics()) - 1)
+  , expBias(APFloat::semanticsMaxExponent(fpTy.getFltSemantics()))
+  {}
+
+  Value * fp(double val) { return ConstantFP::get(&fpTy, val); }
+  Value * inf() { return ConstantFP::getInfinity(&fpTy); }
+  Value * fabs(Value * x) { return builder.CreateUnaryIntrinsic(Intrinsic::fabs, x); }
+  Value * copysign(Value * mag, Value * sign) { return builder.CreateBinaryIntrinsic(Intrinsic::copysign, mag, sign); }
+  Value * isNaN(Value * x) { return builder.CreateFCmpUNO(x, x); }
+  Value * isInf(Value * x) { return builder.CreateFCmpOEQ(fabs(x), inf()); }
+  Value * isFinite(Value * x) { return builder.CreateFCmpONE(fabs(x), inf()); }
+  // copysign(isinf(x) ? 1 : 0, x)
+  Value * infUnit(Value * x) { return copysign(builder.CreateSelect(isInf(x), fp(1.0), fp(0.0)), x); }
+
+  // the exponent of the finite, non-zero x (logb, subnormals count as 1 - bias)
+  Value * exponent(Value * x) {
+    auto * bits = builder.CreateBitCast(x, &intTy);
+    auto * biased = builder.CreateAnd(builder.CreateLShr(bits, mantBits), (1ull << (intTy.getBitWidth() - 1 - mantBits)) - 1);
+    auto * isDenormal = builder.CreateICmpEQ(biased, ConstantInt::get(&intTy, 0));
+    biased = builder.CreateSelect(isDenormal, ConstantInt::get(&intTy, 1), biased);
+    return builder.CreateSub(biased, ConstantInt::get(&intTy, expBias));
   }
 
-  if (!scalarModule) return nullptr; // could not load module
+  // x * 2^-e in two steps by normal powers of two
+  Value * scaleDown(Value * x, Value * e) {
+    auto * e1 = builder.CreateAShr(e, 1);
+    auto * e2 = builder.CreateSub(e, e1);
+    auto * bias = ConstantInt::get(&intTy, expBias);
+    auto * f1 = builder.CreateBitCast(builder.CreateShl(builder.CreateSub(bias, e1), mantBits), &fpTy);
+    auto * f2 = builder.CreateBitCast(builder.CreateShl(builder.CreateSub(bias, e2), mantBits), &fpTy);
+    return builder.CreateFMul(builder.CreateFMul(x, f1), f2);
+  }
 
-  auto * scalarFn = scalarModule->getFunction(funcName);
-  if (!scalarFn) return nullptr;
-  return &cloneFunctionIntoModule(*scalarFn, insertInto, funcName);
-#else
-  return nullptr; // compiler-rt not available as bc module
-#endif
+  // compiler-rt __mulsc3/__muldc3
+  std::pair<Value*, Value*> multiply(Value * a, Value * b, Value * c, Value * d, bool fast) {
+    auto * ac = builder.CreateFMul(a, c), * bd = builder.CreateFMul(b, d);
+    auto * ad = builder.CreateFMul(a, d), * bc = builder.CreateFMul(b, c);
+    auto * real = builder.CreateFSub(ac, bd, "cmul.re");
+    auto * imag = builder.CreateFAdd(ad, bc, "cmul.im");
+    if (fast) return {real, imag};
+
+    // NaN + iNaN recovery: an infinite factor turns into a unit, NaNs of the other factor into zeros
+    auto * bothNaN = builder.CreateAnd(isNaN(real), isNaN(imag));
+    auto * infAB = builder.CreateOr(isInf(a), isInf(b));
+    auto * infCD = builder.CreateOr(isInf(c), isInf(d));
+    auto * infProd = builder.CreateOr(builder.CreateOr(isInf(ac), isInf(bd)), builder.CreateOr(isInf(ad), isInf(bc)));
+    a = builder.CreateSelect(infAB, infUnit(a), a);
+    b = builder.CreateSelect(infAB, infUnit(b), b);
+    c = builder.CreateSelect(infCD, infUnit(c), c);
+    d = builder.CreateSelect(infCD, infUnit(d), d);
+
+    auto * zeroAB = builder.CreateOr(infCD, builder.CreateAnd(builder.CreateNot(infAB), infProd));
+    auto * zeroCD = builder.CreateOr(infAB, builder.CreateAnd(builder.CreateNot(infCD), infProd));
+    auto zeroNaN = [&](Value * x, Value * zero) {
+      return builder.CreateSelect(builder.CreateAnd(zero, isNaN(x)), copysign(fp(0.0), x), x);
+    };
+    a = zeroNaN(a, zeroAB); b = zeroNaN(b, zeroAB);
+    c = zeroNaN(c, zeroCD); d = zeroNaN(d, zeroCD);
+
+    auto * recalc = builder.CreateAnd(bothNaN, builder.CreateOr(builder.CreateOr(infAB, infCD), infProd));
+    auto * realRe = builder.CreateFMul(inf(), builder.CreateFSub(builder.CreateFMul(a, c), builder.CreateFMul(b, d)));
+    auto * imagRe = builder.CreateFMul(inf(), builder.CreateFAdd(builder.CreateFMul(a, d), builder.CreateFMul(b, c)));
+    return {builder.CreateSelect(recalc, realRe, real, "cmul.re"), builder.CreateSelect(recalc, imagRe, imag, "cmul.im")};
+  }
+
+  // compiler-rt __divsc3/__divdc3
+  std::pair<Value*, Value*> divide(Value * a, Value * b, Value * c, Value * d, bool fast) {
+    if (fast) {
+      auto * denom = builder.CreateFAdd(builder.CreateFMul(c, c), builder.CreateFMul(d, d));
+      auto * real = builder.CreateFAdd(builder.CreateFMul(a, c), builder.CreateFMul(b, d));
+      auto * imag = builder.CreateFSub(builder.CreateFMul(b, c), builder.CreateFMul(a, d));
+      return {builder.CreateFDiv(real, denom, "cdiv.re"), builder.CreateFDiv(imag, denom, "cdiv.im")};
+    }
+
+    // scale the denominator by its exponent
+    auto * w = builder.CreateBinaryIntrinsic(Intrinsic::maxnum, fabs(c), fabs(d));
+    auto * normalW = builder.CreateAnd(isFinite(w), builder.CreateFCmpUNE(w, fp(0.0)));
+    auto * logbW = builder.CreateSelect(normalW, exponent(w), ConstantInt::get(&intTy, 0));
+    auto * sc = scaleDown(c, logbW);
+    auto * sd = scaleDown(d, logbW);
+    auto * denom = builder.CreateFAdd(builder.CreateFMul(sc, sc), builder.CreateFMul(sd, sd));
+    auto * real = scaleDown(builder.CreateFDiv(builder.CreateFAdd(builder.CreateFMul(a, sc), builder.CreateFMul(b, sd)), denom), logbW);
+    auto * imag = scaleDown(builder.CreateFDiv(builder.CreateFSub(builder.CreateFMul(b, sc), builder.CreateFMul(a, sd)), denom), logbW);
+
+    // recover infinities and zeros that computed as NaN + iNaN
+    auto * bothNaN = builder.CreateAnd(isNaN(real), isNaN(imag));
+    // (1) division by zero
+    auto * divByZero = builder.CreateAnd(builder.CreateFCmpOEQ(denom, fp(0.0)),
+                                         builder.CreateOr(builder.CreateNot(isNaN(a)), builder.CreateNot(isNaN(b))));
+    auto * infC = copysign(inf(), sc);
+    auto * real1 = builder.CreateFMul(infC, a), * imag1 = builder.CreateFMul(infC, b);
+    // (2) infinite numerator, finite denominator
+    auto * infNum = builder.CreateAnd(builder.CreateOr(isInf(a), isInf(b)), builder.CreateAnd(isFinite(sc), isFinite(sd)));
+    auto * infA = infUnit(a), * infB = infUnit(b);
+    auto * real2 = builder.CreateFMul(inf(), builder.CreateFAdd(builder.CreateFMul(infA, sc), builder.CreateFMul(infB, sd)));
+    auto * imag2 = builder.CreateFMul(inf(), builder.CreateFSub(builder.CreateFMul(infB, sc), builder.CreateFMul(infA, sd)));
+    // (3) finite numerator, infinite denominator
+    auto * infDen = builder.CreateAnd(isInf(w), builder.CreateAnd(isFinite(a), isFinite(b)));
+    auto * infC3 = infUnit(sc), * infD3 = infUnit(sd);
+    auto * real3 = builder.CreateFMul(fp(0.0), builder.CreateFAdd(builder.CreateFMul(a, infC3), builder.CreateFMul(b, infD3)));
+    auto * imag3 = builder.CreateFMul(fp(0.0), builder.CreateFSub(builder.CreateFMul(b, infC3), builder.CreateFMul(a, infD3)));
+
+    auto * use1 = builder.CreateAnd(bothNaN, divByZero);
+    auto * use2 = builder.CreateAnd(builder.CreateAnd(bothNaN, builder.CreateNot(divByZero)), infNum);
+    auto * use3 = builder.CreateAnd(builder.CreateAnd(bothNaN, builder.CreateNot(divByZero)),
+                                    builder.CreateAnd(builder.CreateNot(infNum), infDen));
+    real = builder.CreateSelect(use1, real1, builder.CreateSelect(use2, real2, builder.CreateSelect(use3, real3, real)), "cdiv.re");
+    imag = builder.CreateSelect(use1, imag1, builder.CreateSelect(use2, imag2, builder.CreateSelect(use3, imag3, imag)), "cdiv.im");
+    return {real, imag};
+  }
+};
+
+// the part (0 real, 1 imaginary) of the complex value that @user extracts, -1 otherwise
+static int
+GetComplexPartIndex(const User & user) {
+  if (auto * extract = dyn_cast<ExtractValueInst>(&user)) {
+    return extract->getNumIndices() == 1 ? (int) extract->getIndices()[0] : -1;
+  }
+  if (auto * extract = dyn_cast<ExtractElementInst>(&user)) {
+    auto * idx = dyn_cast<ConstantInt>(extract->getIndexOperand());
+    return (idx && idx->getZExtValue() < 2) ? (int) idx->getZExtValue() : -1;
+  }
+  return -1;
+}
+
+static bool
+IsFiniteMath(const CallInst & call) {
+  if (isa<FPMathOperator>(call) && call.hasNoNaNs() && call.hasNoInfs()) return true;
+  auto & func = *call.getFunction();
+  return func.getFnAttribute("no-nans-fp-math").getValueAsString() == "true" &&
+         func.getFnAttribute("no-infs-fp-math").getValueAsString() == "true";
+}
+
+}
+
+bool
+LowerComplexCall(CallInst & call) {
+  auto * callee = call.getCalledFunction();
+  if (!callee || !callee->isDeclaration()) return false;
+  auto name = callee->getName();
+  bool isMul = name == "__mulsc3" || name == "__muldc3";
+  bool isDiv = name == "__divsc3" || name == "__divdc3";
+  if ((!isMul && !isDiv) || call.arg_size() != 4) return false;
+
+  // (a + ib) op (c + id) returned as {T, T}, [2 x T] or <2 x T> depending on the ABI
+  auto * fpTy = call.getArgOperand(0)->getType();
+  if (!fpTy->isFloatTy() && !fpTy->isDoubleTy()) return false;
+  for (auto & arg : call.args()) {
+    if (arg->getType() != fpTy) return false;
+  }
+  auto * retTy = call.getType();
+  auto * structTy = dyn_cast<StructType>(retTy);
+  auto * arrTy = dyn_cast<ArrayType>(retTy);
+  auto * vecTy = dyn_cast<FixedVectorType>(retTy);
+  bool validRet = (structTy && structTy->getNumElements() == 2 && structTy->getElementType(0) == fpTy && structTy->getElementType(1) == fpTy) ||
+                  (arrTy && arrTy->getNumElements() == 2 && arrTy->getElementType() == fpTy) ||
+                  (vecTy && vecTy->getNumElements() == 2 && vecTy->getElementType() == fpTy);
+  if (!validRet) return false;
+
+  IRBuilder<> builder(&call);
+  ComplexBuilder complexBuilder(builder, *fpTy);
+  auto * a = call.getArgOperand(0), * b = call.getArgOperand(1);
+  auto * c = call.getArgOperand(2), * d = call.getArgOperand(3);
+  bool fast = IsFiniteMath(call);
+  auto parts = isMul ? complexBuilder.multiply(a, b, c, d, fast) : complexBuilder.divide(a, b, c, d, fast);
+
+  // users of the real or imaginary part use it directly, everything else gets the packed value
+  Value * packed = nullptr;
+  for (auto itUse = call.use_begin(); itUse != call.use_end(); ) {
+    auto & use = *itUse++;
+    auto * user = cast<Instruction>(use.getUser());
+    int partIdx = GetComplexPartIndex(*user);
+    if (partIdx == 0 || partIdx == 1) {
+      user->replaceAllUsesWith(partIdx == 0 ? parts.first : parts.second);
+      user->eraseFromParent();
+      continue;
+    }
+    if (!packed) {
+      packed = UndefValue::get(retTy);
+      if (vecTy) {
+        packed = builder.CreateInsertElement(packed, parts.first, (uint64_t) 0);
+        packed = builder.CreateInsertElement(packed, parts.second, (uint64_t) 1, call.getName());
+      } else {
+        packed = builder.CreateInsertValue(packed, parts.first, {0});
+        packed = builder.CreateInsertValue(packed, parts.second, {1}, call.getName());
+      }
+    }
+    use.set(packed);
+  }
+
+  call.eraseFromParent();
+  return true;
+}
+
+unsigned
+LowerComplexArithmetic(Function & func) {
+  std::vector<CallInst*> calls;
+  for (auto & inst : instructions(func)) {
+    if (auto * call = dyn_cast<CallInst>(&inst)) calls.push_back(call);
+  }
+  unsigned numLowered = 0;
+  for (auto * call : calls) {
+    if (LowerComplexCall(*call)) ++numLowered;
+  }
+  return numLowered;
 }
 
 } // namespace rv
@@ -0,0 +1,302 @@
+//===- src/transform/dispatchWrapper.cpp - SPMD dispatch loops for WFV variants --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/dispatchWrapper.h"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/Module.h>
+
+#include "rv/vectorMapping.h"
+
+using namespace llvm;
+
+namespace rv {
+
+namespace {
+
+class DispatchBuilder {
+  const VectorMapping * unmaskedJob;
+  const VectorMapping * maskedJob;
+  const VectorMapping & job; // shapes and width (the same for both variants)
+  Function & scalarFn;
+  Module & M;
+  LLVMContext & ctx;
+  unsigned width;
+  IntegerType * i64Ty;
+  PointerType * ptrTy;
+
+  bool hasVaryingResult() const {
+    return job.resultShape.isVarying() && !scalarFn.getReturnType()->isVoidTy();
+  }
+
+  Align getElementAlign(Type & elemTy) const { return M.getDataLayout().getABITypeAlign(&elemTy); }
+
+  // mask of the lanes of the chunk at @idx that are before @end
+  Value * createTailMask(IRBuilder<> & builder, Value * idx, Value * end) {
+    SmallVector<Constant*, 16> laneIds;
+    for (unsigned i = 0; i < width; ++i) laneIds.push_back(ConstantInt::get(i64Ty, i));
+    auto * remaining = builder.CreateVectorSplat(width, builder.CreateSub(end, idx), "remaining");
+    return builder.CreateICmpULT(ConstantVector::get(laneIds), remaining, "tail.mask");
+  }
+
+  // linear arguments of item @idx
+  Value * getLinearArg(IRBuilder<> & builder, VectorShape shape, Value * param, Value * idx) {
+    if (shape.isUniform()) return param;
+    auto * offset = builder.CreateMul(idx, ConstantInt::get(i64Ty, shape.getStride()));
+    auto * argTy = param->getType();
+    if (argTy->isPointerTy()) return builder.CreateGEP(builder.getInt8Ty(), param, offset, param->getName() + ".item");
+    if (argTy->isFloatingPointTy()) return builder.CreateFAdd(param, builder.CreateSIToFP(offset, argTy), param->getName() + ".item");
+    return builder.CreateAdd(param, builder.CreateSExtOrTrunc(offset, argTy), param->getName() + ".item");
+  }
+
+  void emitVectorCall(IRBuilder<> & builder, const VectorMapping & variant, ArrayRef<Value*> params, Value * idx,
+                      Value * tailMask) {
+    SmallVector<Value*, 8> args;
+    auto * vecFnTy = variant.vectorFn->getFunctionType();
+    for (unsigned vecIdx = 0, scaIdx = 0; vecIdx < vecFnTy->getNumParams(); ++vecIdx) {
+      if ((int) vecIdx == variant.maskPos) {
+        args.push_back(tailMask ? tailMask : Constant::getAllOnesValue(vecFnTy->getParamType(vecIdx)));
+        continue;
+      }
+      auto shape = variant.argShapes[scaIdx];
+      auto * param = params[scaIdx];
+      auto * elemTy = scalarFn.getFunctionType()->getParamType(scaIdx);
+      ++scaIdx;
+      if (!shape.isVarying()) {
+        args.push_back(getLinearArg(builder, shape, param, idx));
+        continue;
+      }
+      auto * vecTy = FixedVectorType::get(elemTy, width);
+      auto * elemPtr = builder.CreateGEP(elemTy, param, idx);
+      if (tailMask) {
+        args.push_back(builder.CreateMaskedLoad(vecTy, elemPtr, getElementAlign(*elemTy), tailMask, nullptr, param->getName() + ".chunk"));
+      } else {
+        args.push_back(builder.CreateAlignedLoad(vecTy, elemPtr, getElementAlign(*elemTy), param->getName() + ".chunk"));
+      }
+    }
+
+    auto * result = builder.CreateCall(variant.vectorFn, args);
+    if (!hasVaryingResult()) return;
+    auto * elemTy = scalarFn.getReturnType();
+    auto * outPtr = builder.CreateGEP(elemTy, params.back(), idx);
+    if (tailMask) builder.CreateMaskedStore(result, outPtr, getElementAlign(*elemTy), tailMask);
+    else builder.CreateAlignedStore(result, outPtr, getElementAlign(*elemTy));
+  }
+
+  // the varying inputs of the chunk DispatchPrefetchChunks ahead
+  void emitPrefetches(IRBuilder<> & builder, ArrayRef<Value*> params, Value * idx) {
+    auto * aheadIdx = builder.CreateAdd(idx, ConstantInt::get(i64Ty, DispatchPrefetchChunks * width));
+    for (unsigned i = 0; i < job.argShapes.size(); ++i) {
+      if (!job.argShapes[i].isVarying()) continue;
+      auto * elemTy = scalarFn.getFunctionType()->getParamType(i);
+      auto * ptr = builder.CreateGEP(elemTy, params[i], aheadIdx, "prefetch.ptr");
+      auto * prefetchFn = Intrinsic::getDeclaration(&M, Intrinsic::prefetch, {ptr->getType()});
+      // read, locality 3 (keep in all cache levels), data cache
+      builder.CreateCall(prefetchFn, {ptr, builder.getInt32(0), builder.getInt32(3), builder.getInt32(1)});
+    }
+  }
+
+  // the scalar function for each item of [idx, end)
+  void emitScalarTail(Function & func, IRBuilder<> & builder, ArrayRef<Value*> params, Value * idx, Value * end, BasicBlock & exit) {
+    auto * itemBlock = BasicBlock::Create(ctx, "tail.item", &func);
+    auto * preBlock = builder.GetInsertBlock();
+    builder.CreateBr(itemBlock);
+    builder.SetInsertPoint(itemBlock);
+    auto * item = builder.CreatePHI(i64Ty, 2, "item");
+    item->addIncoming(idx, preBlock);
+
+    SmallVector<Value*, 8> args;
+    for (unsigned i = 0; i < job.argShapes.size(); ++i) {
+      auto shape = job.argShapes[i];
+      auto * argTy = scalarFn.getFunctionType()->getParamType(i);
+      if (shape.isVarying()) {
+        args.push_back(builder.CreateAlignedLoad(argTy, builder.CreateGEP(argTy, params[i], item), getElementAlign(*argTy)));
+      } else {
+        args.push_back(getLinearArg(builder, shape, params[i], item));
+      }
+    }
+    auto * result = builder.CreateCall(&scalarFn, args);
+    if (hasVaryingResult()) {
+      auto * elemTy = scalarFn.getReturnType();
+      builder.CreateAlignedStore(result, builder.CreateGEP(elemTy, params.back(), item), getElementAlign(*elemTy));
+    }
+    auto * nextItem = builder.CreateAdd(item, ConstantInt::get(i64Ty, 1), "item.next", true, true);
+    item->addIncoming(nextItem, itemBlock);
+    builder.CreateCondBr(builder.CreateICmpSLT(nextItem, end), itemBlock, &exit);
+  }
+
+public:
+  DispatchBuilder(const VectorMapping * _unmaskedJob, const VectorMapping * _maskedJob)
+  : unmaskedJob(_unmaskedJob)
+  , maskedJob(_maskedJob)
+  , job(_unmaskedJob ? *_unmaskedJob : *_maskedJob)
+  , scalarFn(*job.scalarFn)
+  , M(*scalarFn.getParent())
+  , ctx(scalarFn.getContext())
+  , width(job.vectorWidth)
+  , i64Ty(Type::getInt64Ty(ctx))
+  , ptrTy(PointerType::get(ctx, 0))
+  {}
+
+  unsigned getWidth() const { return width; }
+
+  bool isSupported() const {
+    if (width == 0) return false;
+    auto & scaFnTy = *scalarFn.getFunctionType();
+    for (unsigned i = 0; i < scaFnTy.getNumParams(); ++i) {
+      auto shape = job.argShapes[i];
+      auto * argTy = scaFnTy.getParamType(i);
+      bool isScalarTy = argTy->isIntegerTy() || argTy->isFloatingPointTy() || argTy->isPointerTy();
+      if (!shape.isDefined() || !isScalarTy) return false;
+    }
+    auto * retTy = scaFnTy.getReturnType();
+    return !hasVaryingResult() || retTy->isIntegerTy() || retTy->isFloatingPointTy() || retTy->isPointerTy();
+  }
+
+  // the parameters after n: uniform and linear arguments, arrays for varying arguments and the varying result
+  SmallVector<Type*, 8> getParamTypes() const {
+    SmallVector<Type*, 8> paramTys;
+    for (unsigned i = 0; i < job.argShapes.size(); ++i) {
+      paramTys.push_back(job.argShapes[i].isVarying() ? ptrTy : scalarFn.getFunctionType()->getParamType(i));
+    }
+    if (hasVaryingResult()) paramTys.push_back(ptrTy);
+    return paramTys;
+  }
+
+  // the chunk loop over [begin, end) in @func, continuing from @builder and returning at the end
+  void emitChunkLoop(Function & func, IRBuilder<> & builder, Value * begin, Value * end, ArrayRef<Value*> params) {
+    auto * entry = builder.GetInsertBlock();
+    auto * header = BasicBlock::Create(ctx, "chunks", &func);
+    auto * body = BasicBlock::Create(ctx, "chunk.full", &func);
+    auto * tailCheck = BasicBlock::Create(ctx, "tail.check", &func);
+    auto * tail = BasicBlock::Create(ctx, "tail", &func);
+    auto * exit = BasicBlock::Create(ctx, "exit", &func);
+    builder.CreateBr(header);
+
+    builder.SetInsertPoint(header);
+    auto * idx = builder.CreatePHI(i64Ty, 2, "chunk.idx");
+    idx->addIncoming(begin, entry);
+    auto * remaining = builder.CreateSub(end, idx, "remaining");
+    builder.CreateCondBr(builder.CreateICmpSGE(remaining, ConstantInt::get(i64Ty, width)), body, tailCheck);
+
+    // full chunks
+    builder.SetInsertPoint(body);
+    emitPrefetches(builder, params, idx);
+    emitVectorCall(builder, unmaskedJob ? *unmaskedJob : *maskedJob, params, idx, nullptr);
+    auto * nextIdx = builder.CreateAdd(idx, ConstantInt::get(i64Ty, width), "chunk.idx.next", true, true);
+    idx->addIncoming(nextIdx, body);
+    builder.CreateBr(header);
+
+    // the tail (the mask is computed once)
+    builder.SetInsertPoint(tailCheck);
+    builder.CreateCondBr(builder.CreateICmpSGT(remaining, ConstantInt::get(i64Ty, 0)), tail, exit);
+    builder.SetInsertPoint(tail);
+    if (maskedJob) {
+      emitVectorCall(builder, *maskedJob, params, idx, createTailMask(builder, idx, end));
+      builder.CreateBr(exit);
+    } else {
+      emitScalarTail(func, builder, params, idx, end, *exit);
+    }
+
+    builder.SetInsertPoint(exit);
+    builder.CreateRetVoid();
+  }
+};
+
+// target features of @scalarFn (the chunks are vector code)
+static void
+CopyTargetAttributes(Function & from, Function & to) {
+  for (const char * attrName : {"target-cpu", "target-features", "tune-cpu"}) {
+    if (from.hasFnAttribute(attrName)) to.addFnAttr(from.getFnAttribute(attrName));
+  }
+}
+
+} // anonymous namespace
+
+Function *
+CreateDispatchWrapper(const VectorMapping * unmaskedJob, const VectorMapping * maskedJob, bool parallel,
+                      StringRef runtimeName) {
+  assert((unmaskedJob || maskedJob) && "no variant to dispatch to");
+  DispatchBuilder dispatchBuilder(unmaskedJob, maskedJob);
+  if (!dispatchBuilder.isSupported()) return nullptr;
+
+  auto & scalarFn = unmaskedJob ? *unmaskedJob->scalarFn : *maskedJob->scalarFn;
+  auto & M = *scalarFn.getParent();
+  auto & ctx = M.getContext();
+  std::string name = (scalarFn.getName() + "_dispatch").str();
+  if (M.getNamedValue(name)) return nullptr;
+
+  // void scalarFn_dispatch(i64 n, params...)
+  auto * i64Ty = Type::getInt64Ty(ctx);
+  auto paramTys = dispatchBuilder.getParamTypes();
+  SmallVector<Type*, 8> wrapperTys{i64Ty};
+  wrapperTys.append(paramTys.begin(), paramTys.end());
+  auto * wrapperTy = FunctionType::get(Type::getVoidTy(ctx), wrapperTys, false);
+  auto linkage = scalarFn.hasLocalLinkage() ? GlobalValue::InternalLinkage : GlobalValue::ExternalLinkage;
+  auto * wrapperFn = Function::Create(wrapperTy, linkage, name, M);
+  CopyTargetAttributes(scalarFn, *wrapperFn);
+  auto * numItems = wrapperFn->getArg(0);
+  numItems->setName("n");
+  SmallVector<Value*, 8> params;
+  for (unsigned i = 1; i < wrapperFn->arg_size(); ++i) {
+    auto * param = wrapperFn->getArg(i);
+    param->setName(i <= scalarFn.arg_size() ? scalarFn.getArg(i - 1)->getName() : "out");
+    params.push_back(param);
+  }
+
+  IRBuilder<> builder(BasicBlock::Create(ctx, "entry", wrapperFn));
+  if (!parallel) {
+    dispatchBuilder.emitChunkLoop(*wrapperFn, builder, ConstantInt::get(i64Ty, 0), numItems, params);
+    return wrapperFn;
+  }
+
+  // the parameters and n go through the context struct
+  SmallVector<Type*, 8> ctxTys{i64Ty};
+  ctxTys.append(paramTys.begin(), paramTys.end());
+  auto * ctxTy = StructType::create(ctx, ctxTys, name + ".ctx");
+
+  // void task(ptr ctx, i64 first, i64 last) for the blocks [first, last)
+  auto * ptrTy = PointerType::get(ctx, 0);
+  auto * taskTy = FunctionType::get(Type::getVoidTy(ctx), {ptrTy, i64Ty, i64Ty}, false);
+  auto * taskFn = Function::Create(taskTy, GlobalValue::InternalLinkage, name + ".task", M);
+  CopyTargetAttributes(scalarFn, *taskFn);
+  IRBuilder<> taskBuilder(BasicBlock::Create(ctx, "entry", taskFn));
+  SmallVector<Value*, 8> loaded;
+  for (unsigned i = 0; i < ctxTys.size(); ++i) {
+    auto * fieldPtr = taskBuilder.CreateStructGEP(ctxTy, taskFn->getArg(0), i);
+    loaded.push_back(taskBuilder.CreateLoad(ctxTys[i], fieldPtr, wrapperFn->getArg(i)->getName()));
+  }
+  auto * blockItems = ConstantInt::get(i64Ty, DispatchBlockChunks * dispatchBuilder.getWidth());
+  auto * begin = taskBuilder.CreateMul(taskFn->getArg(1), blockItems, "begin");
+  auto * blockEnd = taskBuilder.CreateMul(taskFn->getArg(2), blockItems);
+  auto * end = taskBuilder.CreateSelect(taskBuilder.CreateICmpSLT(blockEnd, loaded[0]), blockEnd, loaded[0], "end");
+  dispatchBuilder.emitChunkLoop(*taskFn, taskBuilder, begin, end, ArrayRef<Value*>(loaded).drop_front());
+
+  // runtime(task, ctx, ceil(n / blockItems))
+  auto * ctxAlloca = builder.CreateAlloca(ctxTy, nullptr, "dispatch.ctx");
+  for (unsigned i = 0; i < ctxTys.size(); ++i) {
+    builder.CreateStore(wrapperFn->getArg(i), builder.CreateStructGEP(ctxTy, ctxAlloca, i));
+  }
+  auto * numBlocks = builder.CreateUDiv(builder.CreateAdd(numItems, ConstantInt::get(i64Ty, blockItems->getZExtValue() - 1)),
+                                        blockItems, "num.blocks");
+  auto runtimeFn = M.getOrInsertFunction(runtimeName, Type::getVoidTy(ctx), ptrTy, ptrTy, i64Ty);
+  auto * hasItems = builder.CreateICmpSGT(numItems, ConstantInt::get(i64Ty, 0));
+  auto * runBlock = BasicBlock::Create(ctx, "run", wrapperFn);
+  auto * exitBlock = BasicBlock::Create(ctx, "exit", wrapperFn);
+  builder.CreateCondBr(hasItems, runBlock, exitBlock);
+  builder.SetInsertPoint(runBlock);
+  builder.CreateCall(runtimeFn, {taskFn, ctxAlloca, numBlocks});
+  builder.CreateBr(exitBlock);
+  builder.SetInsertPoint(exitBlock);
+  builder.CreateRetVoid();
+  return wrapperFn;
+}
+
+} // namespace rv
@@ -10,6 +10,10 @@
 #include "rv/transform/guardedDivLoopTrans.h"
 
 #include "rv/PlatformInfo.h"
+#include "rv/config.h"
+#include "rv/intrinsics.h"
+#include "rv/analysis/costModel.h"
+#include "utils/phaseTimer.h"
 #include "utils/rvTools.h"
 
 #include "rvConfig.h"
@@ -22,9 +26,13 @@
 #include <llvm/IR/Dominators.h>
 #include <llvm/IR/IRBuilder.h>
 
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/Transforms/Utils/SSAUpdater.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
 #include <llvm/IR/Verifier.h>
 
+#include <cmath>
+
 #if 1
 #define IF_DEBUG_DLT IF_DEBUG
 #else
@@ -57,6 +65,12 @@ ForAllLiveouts(BasicBlock & exitBlock, std::function<void(PHINode & lcPhi, int s
   }
 }
 
+// values that fit a single lane of a vector register (rv_extract/rv_insert)
+static bool
+IsLaneTy(const Type & ty) {
+  return ty.isIntegerTy() || ty.isFloatingPointTy() || ty.isPointerTy();
+}
+
 // make \p inputVal the incoming value in all missing incoming value slots of \p phi.
 static void
 AttachMissingInputs(PHINode & phi, Value & inputVal) {
@@ -96,7 +110,15 @@ GuardedTransformSession::finalizeLiveOutTrackers() {
     finalizeLiveOutTracker(itUpdate.second);
   }
   for (auto & itUpdate : exitDescs) {
-    finalizeLiveOutTracker(itUpdate.second);
+    if (!exitBits) {
+      finalizeLiveOutTracker(itUpdate.second);
+      continue;
+    }
+    // only lanes that take the exit in this iteration are set
+    auto & leftPhi = *itUpdate.second.updatePhi;
+    auto & noLanes = *ConstantInt::getFalse(leftPhi.getContext());
+    setShadowInput(leftPhi, noLanes);
+    AttachMissingInputs(leftPhi, noLanes);
   }
 }
 
@@ -147,6 +169,7 @@ GuardedTransformSession::transformLoop() {
 // insert phi_live (active live threads in the loop)
   IRBuilder<> trackerBuilder(&loopHeader, loopHeader.getFirstInsertionPt());
   auto * boolTy = trackerBuilder.getInt1Ty();
+  auto * bitsTy = trackerBuilder.getInt32Ty(); // rv_ballot
 
 // create the loop live mask (predicate of the loop header)
   liveMaskDesc.trackerPhi = trackerBuilder.CreatePHI(boolTy, 2, loopName + ".live");
@@ -225,13 +248,22 @@ GuardedTransformSession::transformLoop() {
 
   // track live out threads for this exit
     GuardedTrackerDesc exitDesc;
-    exitDesc.trackerPhi = trackerBuilder.CreatePHI(boolTy, 2, exitName + ".xtrack");
-    vecInfo.setVectorShape(*exitDesc.trackerPhi, exitShape);
-    exitDesc.updatePhi = latchBuilder.CreatePHI(boolTy, 2, exitName + ".xupd");
-    vecInfo.setVectorShape(*exitDesc.updatePhi, exitShape);
+    if (exitBits) {
+      // bitmask of the lanes that left (updated in the pure latch once all exits are rebound)
+      exitDesc.trackerPhi = trackerBuilder.CreatePHI(bitsTy, 2, exitName + ".xbits");
+      vecInfo.setVectorShape(*exitDesc.trackerPhi, VectorShape::uni());
+      exitDesc.updatePhi = latchBuilder.CreatePHI(boolTy, 2, exitName + ".xnow");
+      vecInfo.setVectorShape(*exitDesc.updatePhi, exitShape);
+      exitDesc.trackerPhi->addIncoming(ConstantInt::get(bitsTy, 0), loop.getLoopPreheader());
+    } else {
+      exitDesc.trackerPhi = trackerBuilder.CreatePHI(boolTy, 2, exitName + ".xtrack");
+      vecInfo.setVectorShape(*exitDesc.trackerPhi, exitShape);
+      exitDesc.updatePhi = latchBuilder.CreatePHI(boolTy, 2, exitName + ".xupd");
+      vecInfo.setVectorShape(*exitDesc.updatePhi, exitShape);
+      exitDesc.trackerPhi->addIncoming(latchBuilder.getFalse(), loop.getLoopPreheader());
+      exitDesc.trackerPhi->addIncoming(exitDesc.updatePhi, pureLatch);
+    }
     exitDescs[&exitBlock] = exitDesc;
-    exitDesc.trackerPhi->addIncoming(latchBuilder.getFalse(), loop.getLoopPreheader());
-    exitDesc.trackerPhi->addIncoming(exitDesc.updatePhi, pureLatch);
 
     // if exiting from a nested loop we will need to create LCSSA phis in the rebound block
     Loop * leftLoop = loopInfo.getLoopFor(exitingBlock);
@@ -343,6 +375,18 @@ GuardedTransformSession::transformLoop() {
    pureLatch->getTerminator()->eraseFromParent();
    {
      IRBuilder<> latchBuilder(pureLatch);
+     // one ballot and a scalar OR per exit and iteration, the exit masks do not occupy vector registers
+     if (exitBits) {
+       auto & ballotFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::Ballot);
+       for (auto & edge : loopExitEdges) {
+         auto & exitDesc = exitDescs[edge.second];
+         auto * leftBits = latchBuilder.CreateCall(&ballotFunc, {exitDesc.updatePhi}, exitDesc.updatePhi->getName() + ".bits");
+         auto * bitsUpd = latchBuilder.CreateOr(exitDesc.trackerPhi, leftBits, exitDesc.trackerPhi->getName() + ".upd");
+         vecInfo.setVectorShape(*leftBits, VectorShape::uni());
+         vecInfo.setVectorShape(*bitsUpd, VectorShape::uni());
+         exitDesc.trackerPhi->addIncoming(bitsUpd, pureLatch);
+       }
+     }
      latchBuilder.CreateBr(&loopHeader);
    }
 
@@ -412,18 +456,33 @@ GuardedTransformSession::transformLoop() {
      {
        IRBuilder<> divExitBuilder(&fusedExit);
        if (!fusedExit.empty()) divExitBuilder.SetInsertPoint(&*fusedExit.begin());
-       exitMaskPhi = divExitBuilder.CreatePHI(boolTy, 1, exitBlock.getName().str() + ".xlcssa");
-       vecInfo.setVectorShape(*exitMaskPhi, exitShape);
+       exitMaskPhi = divExitBuilder.CreatePHI(exitBits ? bitsTy : boolTy, 1, exitBlock.getName().str() + ".xlcssa");
+       vecInfo.setVectorShape(*exitMaskPhi, exitBits ? VectorShape::uni() : exitShape);
      }
 
      exitMaskPhi->addIncoming(exitDescs[&exitBlock].trackerPhi, &loopHeader);
 
+     // expand the bitmask to the exit mask: (bits >> laneid) & 1 (the last exit takes all remaining lanes)
+     Value * exitMask = exitMaskPhi;
+     if (exitBits && &lastExit != &exitBlock) {
+       IRBuilder<> maskBuilder(&fusedExit);
+       if (fusedExit.getTerminator()) maskBuilder.SetInsertPoint(fusedExit.getTerminator());
+       auto * laneId = maskBuilder.CreateCall(&platInfo.requestRVIntrinsicFunc(RVIntrinsic::LaneID), {}, exitBlock.getName().str() + ".laneid");
+       auto * laneBits = maskBuilder.CreateLShr(exitMaskPhi, laneId);
+       auto * laneBit = maskBuilder.CreateAnd(laneBits, ConstantInt::get(bitsTy, 1));
+       exitMask = maskBuilder.CreateICmpNE(laneBit, ConstantInt::get(bitsTy, 0), exitBlock.getName().str() + ".xmask");
+       vecInfo.setVectorShape(*laneId, VectorShape::cont());
+       for (auto * maskInst : {laneBits, laneBit, exitMask}) {
+         if (isa<Instruction>(maskInst)) vecInfo.setVectorShape(*maskInst, exitShape);
+       }
+     }
+
      // re-connect the exit to the CFG
      BranchInst * exitBr = nullptr;
 
      if (&lastExit != &exitBlock) {
        // this advances the ir builder to the next block
-       exitBr = & CreateIf(exitBuilder, *exitMaskPhi, exitBlock);
+       exitBr = & CreateIf(exitBuilder, *exitMask, exitBlock);
        auto & falseBlock = *exitBuilder.GetInsertBlock();
        // repair loopInfo
        if (loop.getParentLoop()) {
@@ -568,6 +627,297 @@ GuardedTransformSession::requestPureLatch() {
   return *pureLatch;
 }
 
+void
+GuardedTransformSession::cloneScalarTail(unsigned threshold) {
+  auto & header = *loop.getHeader();
+  auto & exitingBlock = *loop.getExitingBlock();
+  auto & exitBlock = *loop.getExitBlock();
+  auto & func = *header.getParent();
+
+  ValueToValueMapTy cloneMap;
+  for (auto * block : loop.blocks()) {
+    auto * clonedBlock = CloneBasicBlock(block, cloneMap, ".scalar", &func);
+    cloneMap[block] = clonedBlock;
+    clonedBlocks.push_back(clonedBlock);
+  }
+  remapInstructionsInBlocks(clonedBlocks, cloneMap);
+  clonedHeader = cast<BasicBlock>(cloneMap[&header]);
+
+  for (auto & inst : header) {
+    auto * phi = dyn_cast<PHINode>(&inst);
+    if (!phi) break;
+    clonedHeaderPhis.emplace_back(phi, cast<PHINode>(cloneMap[phi]));
+  }
+
+  // the clone leaves through a dedicated exit block (the original exit keeps its predecessors)
+  cloneExit = BasicBlock::Create(func.getContext(), loopName + ".scalar.exit", &func);
+  auto & clonedExitingBr = *cast<BranchInst>(cloneMap[exitingBlock.getTerminator()]);
+  for (unsigned i = 0; i < clonedExitingBr.getNumSuccessors(); ++i) {
+    if (clonedExitingBr.getSuccessor(i) == &exitBlock) clonedExitingBr.setSuccessor(i, cloneExit);
+  }
+
+  SmallPtrSet<Value*, 4> seenLiveOuts;
+  ForAllLiveouts(exitBlock, [&](PHINode & lcPhi, int slot) {
+    auto * liveOut = lcPhi.getIncomingValue(slot);
+    if (!seenLiveOuts.insert(liveOut).second) return;
+    auto itCloned = cloneMap.find(liveOut);
+    Value * clonedLiveOut = itCloned != cloneMap.end() ? &*itCloned->second : liveOut;
+    auto * scalarPhi = PHINode::Create(lcPhi.getType(), 1, liveOut->getName() + ".scalar", cloneExit);
+    scalarPhi->addIncoming(clonedLiveOut, clonedExitingBr.getParent());
+    clonedLiveOuts.emplace_back(liveOut, scalarPhi);
+  });
+
+  scalarTailThreshold = threshold;
+}
+
+void
+GuardedTransformSession::attachScalarTail() {
+  auto & header = *loop.getHeader();
+  auto & func = *header.getParent();
+  auto & context = func.getContext();
+  auto * boolTy = Type::getInt1Ty(context);
+  auto * i32Ty = Type::getInt32Ty(context);
+  const unsigned vectorWidth = vecInfo.getVectorWidth();
+
+  // header (br any(live), test, divexit)
+  auto & headerBr = *cast<BranchInst>(header.getTerminator());
+  assert(headerBr.getSuccessor(0) == testHead && "not a transformed loop header");
+  auto & fusedExit = *headerBr.getSuccessor(1);
+
+  auto * checkBlock = BasicBlock::Create(context, loopName + ".occupancy", &func, testHead);
+  auto * tailEntry = BasicBlock::Create(context, loopName + ".tail", &func, testHead);
+  auto * laneHead = BasicBlock::Create(context, loopName + ".tail.lane", &func, testHead);
+  auto * laneBody = BasicBlock::Create(context, loopName + ".tail.body", &func, testHead);
+  auto * laneLatch = BasicBlock::Create(context, loopName + ".tail.latch", &func, testHead);
+  auto * tailExit = BasicBlock::Create(context, loopName + ".tail.exit", &func, testHead);
+
+// leave for the scalar tail if too few lanes are live
+  // occupancy (br numLive < threshold, tail, test)
+  headerBr.setSuccessor(0, checkBlock);
+  IRBuilder<> checkBuilder(checkBlock);
+  auto * blockMask = checkBuilder.CreateCall(&platInfo.requestRVIntrinsicFunc(RVIntrinsic::Mask), {}, loopName + ".mask");
+  // lanes that never entered the loop start out live
+  auto * liveLanes = checkBuilder.CreateAnd(liveMaskDesc.trackerPhi, blockMask, loopName + ".lanes");
+  auto * numLive = checkBuilder.CreateCall(&platInfo.requestRVIntrinsicFunc(RVIntrinsic::PopCount), liveLanes, loopName + ".numlive");
+  auto * toScalar = checkBuilder.CreateICmpULT(numLive, checkBuilder.getInt32(scalarTailThreshold), loopName + ".toscalar");
+  auto & checkBr = *checkBuilder.CreateCondBr(toScalar, tailEntry, testHead);
+  vecInfo.setVectorShape(*blockMask, VectorShape::varying());
+  vecInfo.setVectorShape(*liveLanes, VectorShape::varying());
+  vecInfo.setVectorShape(*numLive, VectorShape::uni());
+  vecInfo.setVectorShape(*toScalar, VectorShape::uni());
+  vecInfo.setVectorShape(checkBr, VectorShape::uni());
+
+  auto & entryBr = *BranchInst::Create(laneHead, tailEntry);
+  vecInfo.setVectorShape(entryBr, VectorShape::uni());
+
+// the lanes update the live out trackers one after the other
+  struct TailTracker {
+    PHINode * vecTracker; // tracker phi (@header)
+    Value * laneVal;      // value of the lane when it leaves the clone (@cloneExit)
+    PHINode * headPhi;    // @laneHead
+    PHINode * latchPhi;   // @laneLatch
+    PHINode * exitPhi;    // @tailExit
+  };
+  SmallVector<TailTracker, 4> tailTrackers;
+  assert(exitDescs.size() == 1 && "scalar tails require a single exit");
+  tailTrackers.push_back({exitDescs.begin()->second.trackerPhi, ConstantInt::getTrue(context), nullptr, nullptr, nullptr});
+  for (auto & itLiveOut : clonedLiveOuts) {
+    tailTrackers.push_back({getGuardedTrackerDesc(*itLiveOut.first).trackerPhi, itLiveOut.second, nullptr, nullptr, nullptr});
+  }
+
+// loop over the live lanes
+  // lane (br extract(lanes, l), body, latch)
+  IRBuilder<> headBuilder(laneHead);
+  auto * lane = headBuilder.CreatePHI(i32Ty, 2, loopName + ".tail.l");
+  lane->addIncoming(headBuilder.getInt32(0), tailEntry);
+  vecInfo.setVectorShape(*lane, VectorShape::uni());
+  for (auto & tracker : tailTrackers) {
+    tracker.headPhi = headBuilder.CreatePHI(tracker.vecTracker->getType(), 2, tracker.vecTracker->getName() + ".tail");
+    tracker.headPhi->addIncoming(tracker.vecTracker, tailEntry);
+    vecInfo.setVectorShape(*tracker.headPhi, VectorShape::varying());
+  }
+  auto & extractFlagFunc = platInfo.requestIntrinsic(RVIntrinsic::Extract, boolTy);
+  auto * isLive = headBuilder.CreateCall(&extractFlagFunc, {liveLanes, lane}, loopName + ".tail.live");
+  auto & headBr = *headBuilder.CreateCondBr(isLive, laneBody, laneLatch);
+  vecInfo.setVectorShape(*isLive, VectorShape::uni());
+  vecInfo.setVectorShape(headBr, VectorShape::uni());
+
+// enter the scalar clone with the state of the lane
+  IRBuilder<> bodyBuilder(laneBody);
+  DenseMap<Value*, Value*> laneValues;
+  auto requestLaneValue = [&](Value & vecVal) -> Value* {
+    auto itLaneVal = laneValues.find(&vecVal);
+    if (itLaneVal != laneValues.end()) return itLaneVal->second;
+    auto & extractFunc = platInfo.requestIntrinsic(RVIntrinsic::Extract, vecVal.getType());
+    auto * laneVal = bodyBuilder.CreateCall(&extractFunc, {&vecVal, lane}, vecVal.getName() + ".lane");
+    vecInfo.setVectorShape(*laneVal, VectorShape::uni());
+    laneValues[&vecVal] = laneVal;
+    return laneVal;
+  };
+
+  auto * preHeader = loop.getLoopPreheader();
+  for (auto & itPhi : clonedHeaderPhis) {
+    auto & headerPhi = *itPhi.first;
+    auto & clonedPhi = *itPhi.second;
+    int preIdx = clonedPhi.getBasicBlockIndex(preHeader);
+    assert(preIdx >= 0);
+    Value * laneVal = vecInfo.getVectorShape(headerPhi).isUniform() ? &headerPhi : requestLaneValue(headerPhi);
+    clonedPhi.setIncomingValue(preIdx, laneVal);
+    clonedPhi.setIncomingBlock(preIdx, laneBody);
+  }
+
+  // the clone is scalar code
+  SmallVector<BasicBlock*, 16> scalarBlocks(clonedBlocks.begin(), clonedBlocks.end());
+  scalarBlocks.push_back(cloneExit);
+  for (auto * block : scalarBlocks) {
+    for (auto & inst : *block) vecInfo.setVectorShape(inst, VectorShape::uni());
+  }
+  // varying values from outside the loop enter with their value in this lane
+  for (auto * block : scalarBlocks) {
+    for (auto & inst : *block) {
+      for (auto & op : inst.operands()) {
+        if (!isa<Instruction>(op.get()) && !isa<Argument>(op.get())) continue;
+        if (vecInfo.getVectorShape(*op.get()).isUniform()) continue;
+        op.set(requestLaneValue(*op.get()));
+      }
+    }
+  }
+  auto & bodyBr = *bodyBuilder.CreateBr(clonedHeader);
+  vecInfo.setVectorShape(bodyBr, VectorShape::uni());
+
+  // write the exit flag and the live outs of the lane
+  IRBuilder<> cloneExitBuilder(cloneExit);
+  for (auto & tracker : tailTrackers) {
+    auto & insertFunc = platInfo.requestIntrinsic(RVIntrinsic::Insert, tracker.headPhi->getType());
+    tracker.laneVal = cloneExitBuilder.CreateCall(&insertFunc, {tracker.headPhi, lane, tracker.laneVal}, tracker.vecTracker->getName() + ".ins");
+    vecInfo.setVectorShape(*tracker.laneVal, VectorShape::varying());
+  }
+  auto & cloneExitBr = *cloneExitBuilder.CreateBr(laneLatch);
+  vecInfo.setVectorShape(cloneExitBr, VectorShape::uni());
+
+  // latch (br l + 1 < W, lane, tail.exit)
+  IRBuilder<> latchBuilder(laneLatch);
+  for (auto & tracker : tailTrackers) {
+    tracker.latchPhi = latchBuilder.CreatePHI(tracker.headPhi->getType(), 2, tracker.vecTracker->getName() + ".next");
+    tracker.latchPhi->addIncoming(tracker.headPhi, laneHead);
+    tracker.latchPhi->addIncoming(tracker.laneVal, cloneExit);
+    tracker.headPhi->addIncoming(tracker.latchPhi, laneLatch);
+    vecInfo.setVectorShape(*tracker.latchPhi, VectorShape::varying());
+  }
+  auto * nextLane = latchBuilder.CreateAdd(lane, latchBuilder.getInt32(1), loopName + ".tail.next");
+  lane->addIncoming(nextLane, laneLatch);
+  auto * moreLanes = latchBuilder.CreateICmpULT(nextLane, latchBuilder.getInt32(vectorWidth), loopName + ".tail.more");
+  auto & latchBr = *latchBuilder.CreateCondBr(moreLanes, laneHead, tailExit);
+  vecInfo.setVectorShape(*nextLane, VectorShape::uni());
+  vecInfo.setVectorShape(*moreLanes, VectorShape::uni());
+  vecInfo.setVectorShape(latchBr, VectorShape::uni());
+
+// join the vector loop at its exit
+  IRBuilder<> tailExitBuilder(tailExit);
+  for (auto & tracker : tailTrackers) {
+    tracker.exitPhi = tailExitBuilder.CreatePHI(tracker.headPhi->getType(), 1, tracker.vecTracker->getName() + ".final");
+    tracker.exitPhi->addIncoming(tracker.latchPhi, laneLatch);
+    vecInfo.setVectorShape(*tracker.exitPhi, VectorShape::varying());
+  }
+  auto & tailExitBr = *tailExitBuilder.CreateBr(&fusedExit);
+  vecInfo.setVectorShape(tailExitBr, VectorShape::uni());
+
+  for (auto & inst : fusedExit) {
+    auto * lcPhi = dyn_cast<PHINode>(&inst);
+    if (!lcPhi) break;
+    Value * inVal = lcPhi->getIncomingValueForBlock(&header);
+    for (auto & tracker : tailTrackers) {
+      if (tracker.vecTracker == inVal) inVal = tracker.exitPhi;
+    }
+    lcPhi->addIncoming(inVal, tailExit);
+  }
+
+// register with LoopInfo
+  loop.addBasicBlockToLoop(checkBlock, loopInfo);
+  loop.addBasicBlockToLoop(tailEntry, loopInfo);
+  loop.addBasicBlockToLoop(tailExit, loopInfo);
+
+  auto * laneLoop = loopInfo.AllocateLoop();
+  loop.addChildLoop(laneLoop);
+  laneLoop->addBasicBlockToLoop(laneHead, loopInfo); // header first
+  laneLoop->addBasicBlockToLoop(laneBody, loopInfo);
+  laneLoop->addBasicBlockToLoop(cloneExit, loopInfo);
+  laneLoop->addBasicBlockToLoop(laneLatch, loopInfo);
+
+  auto * scalarLoop = loopInfo.AllocateLoop();
+  laneLoop->addChildLoop(scalarLoop);
+  scalarLoop->addBasicBlockToLoop(clonedHeader, loopInfo);
+  for (auto * block : clonedBlocks) {
+    if (block != clonedHeader) scalarLoop->addBasicBlockToLoop(block, loopInfo);
+  }
+
+  IF_DEBUG_DLT { errs() << "dlt: scalar tail for " << loopName << " below " << scalarTailThreshold << " live lanes\n"; }
+}
+
+unsigned
+GuardedDivLoopTrans::getScalarTailThreshold(Loop & loop) const {
+  if (config.divLoopScalarTail == 0) return 0;
+  const unsigned vectorWidth = vecInfo.getVectorWidth();
+
+  // innermost loops with a single divergent exit
+  if (!loop.isInnermost() || !loop.getLoopPreheader() || !loop.getLoopLatch()) return 0;
+  auto * exitingBlock = loop.getExitingBlock();
+  auto * exitBlock = loop.getExitBlock();
+  if (!exitingBlock || !exitBlock || vecInfo.isKillExit(*exitBlock)) return 0;
+  if (!isa<BranchInst>(exitingBlock->getTerminator())) return 0;
+  for (auto & inst : *exitBlock) {
+    auto * lcPhi = dyn_cast<PHINode>(&inst);
+    if (!lcPhi) break;
+    if (!IsLaneTy(*lcPhi->getType())) return 0;
+  }
+
+  for (auto * block : loop.blocks()) {
+    for (auto & inst : *block) {
+      if (isa<AllocaInst>(inst)) return 0;
+      // the clone executes its calls as uniform calls
+      if (auto * call = dyn_cast<CallInst>(&inst)) {
+        if (GetIntrinsicID(*call) != RVIntrinsic::Unknown || call->mayHaveSideEffects()) return 0;
+      }
+      if (isa<PHINode>(inst) && block == loop.getHeader()) {
+        if (!vecInfo.getVectorShape(inst).isUniform() && !IsLaneTy(*inst.getType())) return 0;
+      }
+      // varying values from outside the loop are extracted lane by lane
+      for (auto & op : inst.operands()) {
+        auto * opInst = dyn_cast<Instruction>(op.get());
+        if (opInst ? loop.contains(opInst) : !isa<Argument>(op.get())) continue;
+        if (!vecInfo.getVectorShape(*op.get()).isUniform() && !IsLaneTy(*op->getType())) return 0;
+      }
+    }
+  }
+
+  int threshold = config.divLoopScalarTail;
+  if (threshold < 0) {
+    // switch once the live lanes take less time in scalar code than in a vector iteration
+    CostModel costModel(platInfo, config, vecInfo);
+    RegionCost iterCost;
+    for (auto * block : loop.blocks()) {
+      iterCost += costModel.estimateBlockCost(*block);
+    }
+    double laneCost = iterCost.scalarCost / vectorWidth;
+    if (laneCost <= 0.0) return 0;
+    threshold = std::min<int>(std::ceil(iterCost.vectorCost / laneCost), vectorWidth - 1);
+  }
+  threshold = std::min<int>(threshold, vectorWidth);
+  return threshold >= 2 ? threshold : 0;
+}
+
+bool
+GuardedDivLoopTrans::useExitBits(Loop & loop, unsigned tailThreshold) const {
+  // the scalar tail reads the exit tracker as a lane mask, ballots have 32 bits
+  if (!config.enableExitBits || tailThreshold > 0) return false;
+  if (vecInfo.getVectorWidth() > 32) return false;
+
+  // a single exit needs no more than one mask (and a select) per iteration either way
+  SmallVector<Loop::Edge, 4> exitEdges;
+  loop.getExitEdges(exitEdges);
+  return exitEdges.size() >= 2;
+}
+
 void
 GuardedDivLoopTrans::addLoopInitMasks(llvm::Loop & loop) {
   // FIXME use mask futures instead
@@ -583,8 +933,9 @@ GuardedDivLoopTrans::addLoopInitMasks(llvm::Loop & loop) {
   loopSession->finalizeLiveOutTrackers();
 }
 
-GuardedDivLoopTrans::GuardedDivLoopTrans(PlatformInfo & _platInfo, VectorizationInfo & _vecInfo, llvm::FunctionAnalysisManager &FAM)
-: platInfo(_platInfo)
+GuardedDivLoopTrans::GuardedDivLoopTrans(Config & _config, PlatformInfo & _platInfo, VectorizationInfo & _vecInfo, llvm::FunctionAnalysisManager &FAM)
+: config(_config)
+, platInfo(_platInfo)
 , vecInfo(_vecInfo)
 , FAM(FAM)
 , boolTy(Type::getInt1Ty(vecInfo.getContext()))
@@ -592,6 +943,8 @@ GuardedDivLoopTrans::GuardedDivLoopTrans(PlatformInfo & _platInfo, Vectorization
 , numDivergentLoops(0)
 , numKillExits(0)
 , numDivExits(0)
+, numScalarTails(0)
+, numExitBitLoops(0)
 {}
 
 
@@ -599,6 +952,7 @@ GuardedDivLoopTrans::~GuardedDivLoopTrans() {}
 
 bool
 GuardedDivLoopTrans::transformDivergentLoopControl(LoopInfo & LI, Loop & loop) {
+  EntityTimer loopTimer("loop", *loop.getHeader(), vecInfo.getScalarFunction());
   bool hasDivergentLoops = false;
 
   // make this loop uniform (all remaining divergent loops are properly nested)
@@ -612,7 +966,15 @@ GuardedDivLoopTrans::transformDivergentLoopControl(LoopInfo & LI, Loop & loop) {
     hasDivergentLoops = true;
 
     auto * loopSession = new GuardedTransformSession(loop, LI, vecInfo, platInfo);
+    unsigned tailThreshold = getScalarTailThreshold(loop);
+    if (tailThreshold > 0) loopSession->cloneScalarTail(tailThreshold);
+    loopSession->exitBits = useExitBits(loop, tailThreshold);
+    if (loopSession->exitBits) ++numExitBitLoops;
     loopSession->transformLoop();
+    if (tailThreshold > 0) {
+      loopSession->attachScalarTail();
+      ++numScalarTails;
+    }
     numKillExits += loopSession->numKillExits; // accumulate global stats
     numDivExits += loopSession->numDivExits; // accumulate global stats
     sessions[&loop] = loopSession;
@@ -694,6 +1056,12 @@ GuardedDivLoopTrans::transformDivergentLoops() {
         << "\t" << numDivergentLoops << " loops transformed,\n"
         << "\t" << numDivExits << " divergent exits,\n"
         << "\t" << numKillExits << " kill exits.\n";
+    if (numScalarTails > 0) {
+      ReportContinue() << "\t" << numScalarTails << " loops with a scalar tail.\n";
+    }
+    if (numExitBitLoops > 0) {
+      ReportContinue() << "\t" << numExitBitLoops << " loops with exit bitmasks.\n";
+    }
   }
 
 // cleanup
@@ -0,0 +1,334 @@
+//===- src/transform/laneRefillTrans.cpp - refill retired lanes of divergent inner loops --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/laneRefillTrans.h"
+#include "rv/PlatformInfo.h"
+#include "rv/intrinsics.h"
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+
+#include <iterator>
+
+#include "rvConfig.h"
+
+#if 1
+#define IF_DEBUG_REFILL IF_DEBUG
+#else
+#define IF_DEBUG_REFILL if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+using BlockSet = SmallPtrSet<BasicBlock*, 16>;
+
+// the block where \p use is evaluated (the incoming block for phis)
+static BasicBlock *
+GetUseBlock(Use & use) {
+  auto * user = cast<Instruction>(use.getUser());
+  if (auto * phi = dyn_cast<PHINode>(user)) return phi->getIncomingBlock(use);
+  return user->getParent();
+}
+
+// the blocks of \p L outside of \p Inner that run before (\p pre) and after (\p post) the inner loop.
+// Fails if the body of L is not of the form pre; Inner; post.
+static bool
+ClassifyBlocks(Loop & L, Loop & Inner, BlockSet & pre, BlockSet & post) {
+  auto * header = L.getHeader();
+  auto * latch = L.getLoopLatch();
+  auto * innerPH = Inner.getLoopPreheader();
+  auto * innerExit = Inner.getUniqueExitBlock();
+  auto * innerHeader = Inner.getHeader();
+  if (!latch || !innerPH || !innerExit || !L.contains(innerExit)) return false;
+
+  // backwards from the inner preheader up to the header
+  SmallVector<BasicBlock*, 8> stack;
+  stack.push_back(innerPH);
+  pre.insert(innerPH);
+  while (!stack.empty()) {
+    auto * block = stack.pop_back_val();
+    if (block == header) continue;
+    for (auto * pred : predecessors(block)) {
+      if (!L.contains(pred) || Inner.contains(pred)) return false;
+      if (pre.insert(pred).second) stack.push_back(pred);
+    }
+  }
+
+  // forwards from the inner exit down to the latch
+  stack.push_back(innerExit);
+  post.insert(innerExit);
+  while (!stack.empty()) {
+    auto * block = stack.pop_back_val();
+    for (auto * succ : successors(block)) {
+      if (block == latch && (succ == header || !L.contains(succ))) continue;
+      if (!L.contains(succ) || Inner.contains(succ)) return false;
+      if (post.insert(succ).second) stack.push_back(succ);
+    }
+  }
+
+  // every block of L in exactly one part
+  for (auto * block : L.blocks()) {
+    bool inPre = pre.count(block), inPost = post.count(block), inInner = Inner.contains(block);
+    if ((int) inPre + (int) inPost + (int) inInner != 1) return false;
+  }
+
+  // pre only leaves through the inner preheader
+  for (auto * block : pre) {
+    for (auto * succ : successors(block)) {
+      if (pre.count(succ)) continue;
+      if (block == innerPH && succ == innerHeader) continue;
+      return false;
+    }
+  }
+  return post.count(latch);
+}
+
+bool
+LaneRefillTransform::canTransform(Loop & L) const {
+  // the lane prefix sum is an i32 ballot
+  if (vectorWidth < 2 || vectorWidth > 32) return false;
+
+  if (L.getSubLoops().size() != 1) return false;
+  auto & Inner = *L.getSubLoops()[0];
+  if (!Inner.getSubLoops().empty()) return false;
+
+  auto * header = L.getHeader();
+  auto * latch = L.getLoopLatch();
+  if (!L.getLoopPreheader() || !latch || L.getExitingBlock() != latch || !L.getUniqueExitBlock()) return false;
+  if (!isa<BranchInst>(latch->getTerminator())) return false;
+
+  // a single integer induction variable with constant step
+  auto phiIt = header->phis();
+  if (std::distance(phiIt.begin(), phiIt.end()) != 1) return false;
+  auto & iv = *phiIt.begin();
+  if (!iv.getType()->isIntegerTy()) return false;
+  auto * ivRec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&iv));
+  if (!ivRec || ivRec->getLoop() != &L || !ivRec->isAffine() || !isa<SCEVConstant>(ivRec->getStepRecurrence(SE))) return false;
+  if (!SE.isLoopInvariant(ivRec->getStart(), &L)) return false;
+
+  // number of items, expanded before the loop
+  const SCEV * btc = SE.getBackedgeTakenCount(&L);
+  if (isa<SCEVCouldNotCompute>(btc)) return false;
+  bool hasUnsafeDiv = SCEVExprContains(btc, [](const SCEV * S) {
+    auto * div = dyn_cast<SCEVUDivExpr>(S);
+    return div && !isa<SCEVConstant>(div->getRHS());
+  });
+  if (hasUnsafeDiv) return false;
+
+  // inner loop: one latch, all exits lead to one block
+  auto * innerHeader = Inner.getHeader();
+  auto * innerLatch = Inner.getLoopLatch();
+  auto * innerExit = Inner.getUniqueExitBlock();
+  if (!innerLatch || !innerExit) return false;
+  for (auto & phi : innerHeader->phis()) {
+    if (phi.getNumIncomingValues() != 2) return false;
+  }
+  for (auto * pred : predecessors(innerExit)) {
+    if (!Inner.contains(pred)) return false;
+  }
+
+  BlockSet pre, post;
+  if (!ClassifyBlocks(L, Inner, pre, post)) return false;
+
+  for (auto * block : L.blocks()) {
+    for (auto & inst : *block) {
+      for (auto * user : inst.users()) {
+        auto * userInst = cast<Instruction>(user);
+        // items finish out of order, there is no last iteration to take live-outs from
+        if (!L.contains(userInst)) return false;
+        // values of the inner loop leave it through LCSSA phis
+        if (Inner.contains(block) && !Inner.contains(userInst) &&
+            !(isa<PHINode>(userInst) && userInst->getParent() == innerExit)) return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+BasicBlock *
+LaneRefillTransform::run(Loop & L) {
+  assert(canTransform(L));
+  auto & ctx = F.getContext();
+  auto & Inner = *L.getSubLoops()[0];
+
+  auto * preHeader = L.getLoopPreheader();
+  auto * header = L.getHeader();
+  auto * latch = L.getLoopLatch();
+  auto * exitBlock = L.getUniqueExitBlock();
+  auto * innerPH = Inner.getLoopPreheader();
+  auto * innerHeader = Inner.getHeader();
+  auto * innerLatch = Inner.getLoopLatch();
+
+  BlockSet pre, post;
+  ClassifyBlocks(L, Inner, pre, post);
+
+  auto & iv = *header->phis().begin();
+  auto * ivTy = cast<IntegerType>(iv.getType());
+  auto * ivRec = cast<SCEVAddRecExpr>(SE.getSCEV(&iv));
+  const SCEV * numItems = SE.getAddExpr(SE.getTruncateOrZeroExtend(SE.getBackedgeTakenCount(&L), ivTy), SE.getOne(ivTy));
+
+  // values of pre that are still needed by the inner loop or post
+  SmallVector<Instruction*, 8> liveThrough;
+  for (auto * block : L.blocks()) {
+    if (!pre.count(block)) continue;
+    for (auto & inst : *block) {
+      if (&inst == &iv) continue;
+      bool usedLater = false;
+      for (auto & use : inst.uses()) usedLater |= !pre.count(GetUseBlock(use));
+      if (usedLater) liveThrough.push_back(&inst);
+    }
+  }
+
+  IF_DEBUG_REFILL { errs() << "refill: " << L.getName() << " with " << liveThrough.size() << " live-through values\n"; }
+
+  // expand the item range
+  SCEVExpander expander(SE, F.getParent()->getDataLayout(), "rv.refill");
+  auto * phTerm = preHeader->getTerminator();
+  auto * numItemsVal = expander.expandCodeFor(numItems, ivTy, phTerm);
+  auto * ivStart = expander.expandCodeFor(ivRec->getStart(), ivTy, phTerm);
+  auto * ivStep = cast<SCEVConstant>(ivRec->getStepRecurrence(SE))->getValue();
+
+  auto * laneHeader = BasicBlock::Create(ctx, "refill.lanes", &F, header);
+  auto * refillHeader = BasicBlock::Create(ctx, "refill.header", &F, header);
+  auto * resumeBlock = BasicBlock::Create(ctx, "refill.resume", &F, innerHeader);
+  auto * refillLatch = BasicBlock::Create(ctx, "refill.latch", &F, exitBlock);
+  auto * laneLatch = BasicBlock::Create(ctx, "refill.lanes.latch", &F, exitBlock);
+  auto * i32Ty = Type::getInt32Ty(ctx);
+  auto * boolTy = Type::getInt1Ty(ctx);
+
+  phTerm->replaceUsesOfWith(header, laneHeader);
+
+  // lane loop (vectorized at vectorWidth, one iteration per lane)
+  IRBuilder<> builder(laneHeader);
+  auto * lanePhi = builder.CreatePHI(i32Ty, 2, "refill.lane");
+  lanePhi->addIncoming(ConstantInt::get(i32Ty, 0), preHeader);
+  builder.CreateBr(refillHeader);
+
+  // refill header: retired lanes pull the next items
+  builder.SetInsertPoint(refillHeader);
+  auto * cursorPhi = builder.CreatePHI(ivTy, 2, "refill.cursor");
+  auto * activePhi = builder.CreatePHI(boolTy, 2, "refill.active");
+  auto * itemPhi = builder.CreatePHI(ivTy, 2, "refill.item");
+  SmallVector<std::pair<PHINode*, PHINode*>, 4> innerState; // inner header phi -> state
+  for (auto & phi : innerHeader->phis()) {
+    innerState.emplace_back(&phi, builder.CreatePHI(phi.getType(), 2, phi.getName() + ".state"));
+  }
+  SmallVector<PHINode*, 8> liveState;
+  for (auto * inst : liveThrough) {
+    liveState.push_back(builder.CreatePHI(inst->getType(), 2, inst->getName() + ".state"));
+  }
+  cursorPhi->addIncoming(ConstantInt::get(ivTy, 0), laneHeader);
+  activePhi->addIncoming(builder.getFalse(), laneHeader);
+  itemPhi->addIncoming(UndefValue::get(ivTy), laneHeader);
+  for (auto & state : innerState) state.second->addIncoming(UndefValue::get(state.first->getType()), laneHeader);
+  for (auto * state : liveState) state->addIncoming(UndefValue::get(state->getType()), laneHeader);
+
+  auto & laneIdFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::LaneID);
+  auto & ballotFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::Ballot);
+  auto & popCountFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::PopCount);
+  auto & anyFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::Any);
+
+  auto * refill = builder.CreateNot(activePhi, "refill");
+  auto * laneId = builder.CreateCall(&laneIdFunc, {}, "refill.laneid");
+  auto * refillBits = builder.CreateCall(&ballotFunc, {refill}, "refill.bits");
+  auto * lowerLanes = builder.CreateSub(builder.CreateShl(ConstantInt::get(i32Ty, 1), laneId), ConstantInt::get(i32Ty, 1));
+  auto * rank = builder.CreateUnaryIntrinsic(Intrinsic::ctpop, builder.CreateAnd(refillBits, lowerLanes));
+  auto * newItem = builder.CreateAdd(cursorPhi, builder.CreateZExtOrTrunc(rank, ivTy), "refill.newitem");
+  auto * numRefill = builder.CreateCall(&popCountFunc, {refill}, "refill.num");
+  auto * nextCursor = builder.CreateAdd(cursorPhi, builder.CreateZExtOrTrunc(numRefill, ivTy), "refill.cursor.next");
+  auto * fetch = builder.CreateAnd(refill, builder.CreateICmpULT(newItem, numItemsVal), "refill.fetch");
+  auto * item = builder.CreateSelect(refill, newItem, itemPhi, "refill.item.cur");
+  auto * ivItem = builder.CreateAdd(ivStart, builder.CreateMul(item, ivStep), iv.getName() + ".item");
+  builder.CreateCondBr(fetch, header, resumeBlock);
+
+  // pre(k) now starts from the refill header
+  iv.replaceAllUsesWith(ivItem);
+  iv.eraseFromParent();
+
+  // lanes that did not fetch continue their inner loop (if any)
+  builder.SetInsertPoint(resumeBlock);
+  builder.CreateCondBr(activePhi, innerHeader, refillLatch);
+
+  // one inner iteration per step: the inner header resumes from the state
+  SmallVector<Value*, 4> innerNext;
+  for (auto & state : innerState) {
+    auto * phi = state.first;
+    innerNext.push_back(phi->getIncomingValueForBlock(innerLatch));
+    phi->removeIncomingValue(innerLatch, false);
+    phi->addIncoming(state.second, resumeBlock);
+  }
+  SmallVector<PHINode*, 8> liveMerged;
+  for (size_t i = 0; i < liveThrough.size(); ++i) {
+    auto * inst = liveThrough[i];
+    auto * merged = PHINode::Create(inst->getType(), 2, inst->getName() + ".live", &*innerHeader->getFirstInsertionPt());
+    inst->replaceUsesWithIf(merged, [&](Use & use) { return !pre.count(GetUseBlock(use)); });
+    merged->addIncoming(inst, innerPH);
+    merged->addIncoming(liveState[i], resumeBlock);
+    liveMerged.push_back(merged);
+  }
+  innerLatch->getTerminator()->replaceUsesOfWith(innerHeader, refillLatch);
+
+  // the item is done after post(k)
+  latch->getTerminator()->eraseFromParent();
+  BranchInst::Create(refillLatch, latch);
+
+  // refill latch: keep going while any lane is busy or items are left
+  builder.SetInsertPoint(refillLatch);
+  auto * nextActive = builder.CreatePHI(boolTy, 3, "refill.active.next");
+  nextActive->addIncoming(builder.getTrue(), innerLatch);
+  nextActive->addIncoming(builder.getFalse(), latch);
+  nextActive->addIncoming(builder.getFalse(), resumeBlock);
+  for (size_t i = 0; i < innerState.size(); ++i) {
+    auto * stateTy = innerState[i].second->getType();
+    auto * next = builder.CreatePHI(stateTy, 3, innerState[i].first->getName() + ".next");
+    next->addIncoming(innerNext[i], innerLatch);
+    next->addIncoming(UndefValue::get(stateTy), latch);
+    next->addIncoming(UndefValue::get(stateTy), resumeBlock);
+    innerState[i].second->addIncoming(next, refillLatch);
+  }
+  for (size_t i = 0; i < liveMerged.size(); ++i) {
+    auto * stateTy = liveState[i]->getType();
+    auto * next = builder.CreatePHI(stateTy, 3, liveThrough[i]->getName() + ".next");
+    next->addIncoming(liveMerged[i], innerLatch);
+    next->addIncoming(UndefValue::get(stateTy), latch);
+    next->addIncoming(UndefValue::get(stateTy), resumeBlock);
+    liveState[i]->addIncoming(next, refillLatch);
+  }
+  cursorPhi->addIncoming(nextCursor, refillLatch);
+  activePhi->addIncoming(nextActive, refillLatch);
+  itemPhi->addIncoming(item, refillLatch);
+
+  auto * anyActive = builder.CreateCall(&anyFunc, {nextActive}, "refill.anyactive");
+  auto * itemsLeft = builder.CreateICmpULT(nextCursor, numItemsVal, "refill.itemsleft");
+  builder.CreateCondBr(builder.CreateOr(anyActive, itemsLeft), refillHeader, laneLatch);
+
+  // lane latch
+  builder.SetInsertPoint(laneLatch);
+  auto * nextLane = builder.CreateAdd(lanePhi, ConstantInt::get(i32Ty, 1), "refill.lane.next");
+  lanePhi->addIncoming(nextLane, laneLatch);
+  builder.CreateCondBr(builder.CreateICmpULT(nextLane, ConstantInt::get(i32Ty, vectorWidth)), laneHeader, exitBlock);
+  for (auto & phi : exitBlock->phis()) {
+    int latchIdx = phi.getBasicBlockIndex(latch);
+    if (latchIdx >= 0) phi.setIncomingBlock(latchIdx, laneLatch);
+  }
+
+  return laneHeader;
+}
+
+} // namespace rv
@@ -10,6 +10,7 @@
 #include "rv/transform/loopCloner.h"
 #include "rv/utils.h"
 
+#include <llvm/IR/CFG.h>
 #include <llvm/IR/Constants.h>
 
 using namespace llvm;
@@ -73,9 +74,7 @@ struct LoopCloner {
 
     decltype(PDT->getNode(&clonedExiting)) clonedExitingPostDom = nullptr;
     if (PDT) {
-      auto * loopPostDom = PDT->getNode(loopExiting)->getIDom()->getBlock();
-      ClonePostDomTree(*loopPostDom, L, *loopExiting, valueMap);
-      PDT->recalculate(F);
+      ClonePostDomTree(*loopPreHead, L, valueMap);
       clonedExitingPostDom = PDT->getNode(&clonedExiting);
     }
 
@@ -140,18 +139,20 @@ struct LoopCloner {
   }
 
   // register with the post dom tree
+  // the clone only adds edges (the fake pre-header branch and all edges leaving cloned blocks)
   void
-  ClonePostDomTree(BasicBlock & clonedIDom, Loop & L, BasicBlock & currentBlock, ValueToValueMapTy & valueMap) {
+  ClonePostDomTree(BasicBlock & preHead, Loop & L, ValueToValueMapTy & valueMap) {
     assert(PDT);
-    if (!L.contains(&currentBlock)) return;
-
-    auto & currentClone = LookUp(valueMap, currentBlock);
-    PDT->addNewBlock(&currentClone, &clonedIDom);
-
-    auto * pDomNode = DT->getNode(&currentBlock);
-    for (auto * childPostDom : *pDomNode) {
-      ClonePostDomTree(currentClone, L, *childPostDom->getBlock(), valueMap);
+    SmallVector<PostDominatorTree::UpdateType, 16> updates;
+    updates.push_back({PostDominatorTree::Insert, &preHead, &LookUp(valueMap, *L.getHeader())});
+    for (auto * BB : L.blocks()) {
+      auto * clonedBlock = &LookUp(valueMap, *BB);
+      SmallPtrSet<BasicBlock*, 4> seen;
+      for (auto * succ : successors(clonedBlock)) {
+        if (seen.insert(succ).second) updates.push_back({PostDominatorTree::Insert, clonedBlock, succ});
+      }
     }
+    PDT->applyUpdates(updates);
   }
 
   // returns a dom tree node and a loop representing the cloned loop
@@ -0,0 +1,292 @@
+//===- src/transform/loopCollapseTrans.cpp - collapse perfect loop nests --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/loopCollapseTrans.h"
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Local.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+
+#include "rvConfig.h"
+
+#if 1
+#define IF_DEBUG_COLLAPSE IF_DEBUG
+#else
+#define IF_DEBUG_COLLAPSE if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+// the blocks of a perfect two-level nest
+struct LoopNest {
+  Loop * innerL;
+  BasicBlock * outerPreHeader;
+  BasicBlock * outerHeader;
+  BasicBlock * innerPreHeader; // may be outerHeader
+  BasicBlock * innerHeader;
+  BasicBlock * innerLatch; // exits to outerLatch
+  BasicBlock * outerLatch;
+  BasicBlock * exitBlock;
+};
+
+static bool
+GetLoopNest(Loop & outerL, LoopNest & nest) {
+  if (outerL.getSubLoops().size() != 1) return false;
+  auto & innerL = *outerL.getSubLoops()[0];
+  if (!innerL.getSubLoops().empty()) return false;
+
+  nest.innerL = &innerL;
+  nest.outerPreHeader = outerL.getLoopPreheader();
+  nest.outerHeader = outerL.getHeader();
+  nest.innerPreHeader = innerL.getLoopPreheader();
+  nest.innerHeader = innerL.getHeader();
+  nest.innerLatch = innerL.getLoopLatch();
+  nest.outerLatch = outerL.getLoopLatch();
+  nest.exitBlock = outerL.getExitBlock();
+  if (!nest.outerPreHeader || !nest.innerPreHeader || !nest.innerLatch || !nest.outerLatch || !nest.exitBlock) return false;
+
+  // single exits through the latches, the inner loop leaves to the outer latch
+  if (outerL.getExitingBlock() != nest.outerLatch || innerL.getExitingBlock() != nest.innerLatch) return false;
+  if (innerL.getExitBlock() != nest.outerLatch || nest.outerLatch == nest.outerHeader) return false;
+
+  // perfect nest: outer header (and inner preheader) run straight into the inner loop
+  unsigned numOuterBlocks = nest.innerPreHeader == nest.outerHeader ? 2 : 3;
+  if (outerL.getNumBlocks() != innerL.getNumBlocks() + numOuterBlocks) return false;
+  if (nest.outerHeader->getSingleSuccessor() != (numOuterBlocks == 2 ? nest.innerHeader : nest.innerPreHeader)) return false;
+  if (numOuterBlocks == 3 && (!nest.innerPreHeader->phis().empty() || nest.innerPreHeader->getSinglePredecessor() != nest.outerHeader)) return false;
+
+  auto * innerBr = dyn_cast<BranchInst>(nest.innerLatch->getTerminator());
+  auto * outerBr = dyn_cast<BranchInst>(nest.outerLatch->getTerminator());
+  return innerBr && innerBr->isConditional() && outerBr && outerBr->isConditional();
+}
+
+// the single incoming value of the LCSSA phi \p val of \p block
+static Value *
+StripLCSSA(Value * val, BasicBlock & block) {
+  auto * phi = dyn_cast<PHINode>(val);
+  if (phi && phi->getParent() == &block && phi->getNumIncomingValues() == 1) return phi->getIncomingValue(0);
+  return val;
+}
+
+// the outer header phi i with i_next = i + step
+static PHINode *
+GetOuterInduction(const LoopNest & nest, ConstantInt *& step) {
+  PHINode * induction = nullptr;
+  for (auto & phi : nest.outerHeader->phis()) {
+    auto * inc = dyn_cast<BinaryOperator>(phi.getIncomingValueForBlock(nest.outerLatch));
+    if (!inc || inc->getOpcode() != Instruction::Add) continue;
+    unsigned phiIdx = inc->getOperand(0) == &phi ? 0 : 1;
+    auto * incStep = dyn_cast<ConstantInt>(inc->getOperand(1 - phiIdx));
+    if (inc->getOperand(phiIdx) != &phi || !incStep) continue;
+    if (induction) return nullptr;
+    induction = &phi;
+    step = incStep;
+  }
+  return induction;
+}
+
+// \p phi of the outer header starts the inner header phi \p innerPhi and receives its final value
+// (a value carried through both loops)
+static bool
+IsCarriedPhi(const LoopNest & nest, PHINode & phi, PHINode *& innerPhi) {
+  if (!phi.hasOneUse()) return false;
+  innerPhi = dyn_cast<PHINode>(phi.user_back());
+  if (!innerPhi || innerPhi->getParent() != nest.innerHeader) return false;
+  if (innerPhi->getIncomingValueForBlock(nest.innerPreHeader) != &phi) return false;
+  auto * outerNext = StripLCSSA(phi.getIncomingValueForBlock(nest.outerLatch), *nest.outerLatch);
+  return outerNext == innerPhi->getIncomingValueForBlock(nest.innerLatch);
+}
+
+// the constant step of the inner induction \p phi (nullptr if \p phi is none)
+static const SCEVConstant *
+GetInnerStep(ScalarEvolution & SE, const LoopNest & nest, PHINode & phi) {
+  if (!phi.getType()->isIntegerTy()) return nullptr;
+  auto * rec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&phi));
+  if (!rec || rec->getLoop() != nest.innerL || !rec->isAffine()) return nullptr;
+  return dyn_cast<SCEVConstant>(rec->getStepRecurrence(SE));
+}
+
+bool
+LoopCollapseTransform::canCollapse(Loop & outerL) const {
+  LoopNest nest;
+  if (!GetLoopNest(outerL, nest)) return false;
+
+  // N * M with M independent of the outer loop
+  auto * outerBTC = SE.getBackedgeTakenCount(&outerL);
+  auto * innerBTC = SE.getBackedgeTakenCount(nest.innerL);
+  if (isa<SCEVCouldNotCompute>(outerBTC) || isa<SCEVCouldNotCompute>(innerBTC)) return false;
+  if (!SE.isLoopInvariant(innerBTC, &outerL)) return false;
+  if (SE.getTypeSizeInBits(outerBTC->getType()) > 64 || SE.getTypeSizeInBits(innerBTC->getType()) > 64) return false;
+  auto * insertPt = nest.outerPreHeader->getTerminator();
+  if (!isSafeToExpandAt(outerBTC, insertPt, SE) || !isSafeToExpandAt(innerBTC, insertPt, SE)) return false;
+
+  // outer header phis: the induction and values carried through the nest
+  ConstantInt * step = nullptr;
+  auto * outerInduction = GetOuterInduction(nest, step);
+  if (!outerInduction) return false;
+  for (auto & phi : nest.outerHeader->phis()) {
+    PHINode * innerPhi = nullptr;
+    if (&phi != outerInduction && !IsCarriedPhi(nest, phi, innerPhi)) return false;
+  }
+
+  // inner header phis are inductions that restart from values of before the nest (or are carried)
+  for (auto & phi : nest.innerHeader->phis()) {
+    auto * startVal = phi.getIncomingValueForBlock(nest.innerPreHeader);
+    auto * carried = dyn_cast<PHINode>(startVal);
+    PHINode * innerPhi = nullptr;
+    if (carried && carried->getParent() == nest.outerHeader && IsCarriedPhi(nest, *carried, innerPhi)) continue;
+    auto * startInst = dyn_cast<Instruction>(startVal);
+    if (startInst && outerL.contains(startInst)) return false;
+    if (!GetInnerStep(SE, nest, phi)) return false;
+  }
+
+  // the outer header runs for every iteration of the collapsed loop
+  for (auto * block : {nest.outerHeader, nest.innerPreHeader}) {
+    for (auto & inst : *block) {
+      if (isa<PHINode>(inst) || inst.isTerminator()) continue;
+      if (inst.mayReadOrWriteMemory() || inst.mayHaveSideEffects() || isa<AllocaInst>(inst)) return false;
+    }
+  }
+
+  // the outer latch only for the last one
+  for (auto & inst : *nest.outerLatch) {
+    if (inst.mayHaveSideEffects()) return false;
+  }
+  return true;
+}
+
+BasicBlock *
+LoopCollapseTransform::run(Loop & outerL) {
+  LoopNest nest;
+  bool isNest = GetLoopNest(outerL, nest);
+  assert(isNest && "not a perfect loop nest");
+  (void) isNest;
+
+  auto & ctx = F.getContext();
+  const DataLayout & DL = F.getParent()->getDataLayout();
+  auto * i64Ty = Type::getInt64Ty(ctx);
+  auto * outerPreHeader = nest.outerPreHeader;
+  auto * outerHeader = nest.outerHeader;
+  auto * innerPreHeader = nest.innerPreHeader;
+  auto * innerHeader = nest.innerHeader;
+  auto * innerLatch = nest.innerLatch;
+  auto * outerLatch = nest.outerLatch;
+  std::string outerName = outerL.getName().str();
+
+  // N * M iterations (both loops run at least once)
+  auto getTripCount = [&](Loop & L) {
+    return SE.getAddExpr(SE.getNoopOrZeroExtend(SE.getBackedgeTakenCount(&L), i64Ty), SE.getOne(i64Ty));
+  };
+  auto * innerSCEV = getTripCount(*nest.innerL);
+  auto * totalSCEV = SE.getMulExpr(getTripCount(outerL), innerSCEV);
+  SCEVExpander expander(SE, DL, "rv.collapse");
+  auto * innerTrips = expander.expandCodeFor(innerSCEV, i64Ty, outerPreHeader->getTerminator());
+  auto * totalTrips = expander.expandCodeFor(totalSCEV, i64Ty, outerPreHeader->getTerminator());
+
+  ConstantInt * step = nullptr;
+  auto * outerInduction = GetOuterInduction(nest, step);
+  assert(outerInduction && "no outer induction");
+  SmallVector<std::pair<PHINode*, const SCEVConstant*>, 8> innerInductions;
+  SmallVector<PHINode*, 4> carriedPhis;
+  for (auto & phi : innerHeader->phis()) {
+    auto * carried = dyn_cast<PHINode>(phi.getIncomingValueForBlock(innerPreHeader));
+    if (carried && carried->getParent() == outerHeader) {
+      carriedPhis.push_back(&phi);
+    } else {
+      innerInductions.emplace_back(&phi, GetInnerStep(SE, nest, phi));
+    }
+  }
+
+  // lane-wise closed forms: i = i0 + (k / M) * s and j = j0 + (k % M) * t of the collapsed iteration k
+  auto * iter = PHINode::Create(i64Ty, 2, "collapse.iter", innerHeader->getFirstNonPHI());
+  IRBuilder<> builder(innerHeader, innerHeader->getFirstInsertionPt());
+  auto * outerIdx = builder.CreateUDiv(iter, innerTrips, "collapse.outer");
+  auto * innerIdx = builder.CreateURem(iter, innerTrips, "collapse.inner");
+  auto * outerTy = outerInduction->getType();
+  auto * outerStart = outerInduction->getIncomingValueForBlock(outerPreHeader);
+  auto * outerIter = builder.CreateAdd(outerStart, builder.CreateMul(builder.CreateZExtOrTrunc(outerIdx, outerTy), step),
+                                       outerInduction->getName() + ".collapse");
+  for (auto & ind : innerInductions) {
+    auto * phi = ind.first;
+    auto * startVal = phi->getIncomingValueForBlock(innerPreHeader);
+    auto * innerStep = ConstantInt::get(phi->getType(), ind.second->getAPInt());
+    auto * innerVal = builder.CreateAdd(startVal, builder.CreateMul(builder.CreateZExtOrTrunc(innerIdx, phi->getType()), innerStep),
+                                        phi->getName() + ".collapse");
+    phi->replaceAllUsesWith(innerVal);
+    phi->eraseFromParent();
+  }
+
+  // so do the computations of the outer header
+  auto * insertPt = &*builder.GetInsertPoint();
+  SmallVector<BasicBlock*, 2> outerBlocks{outerHeader};
+  if (innerPreHeader != outerHeader) outerBlocks.push_back(innerPreHeader);
+  for (auto * block : outerBlocks) {
+    for (auto & inst : make_early_inc_range(*block)) {
+      if (isa<PHINode>(inst) || inst.isTerminator()) continue;
+      inst.moveBefore(insertPt);
+    }
+  }
+
+  // values carried through both loops keep updating across the inner exit
+  for (auto * phi : carriedPhis) {
+    auto * carried = cast<PHINode>(phi->getIncomingValueForBlock(innerPreHeader));
+    phi->setIncomingValue(phi->getBasicBlockIndex(innerPreHeader), carried->getIncomingValueForBlock(outerPreHeader));
+    phi->replaceIncomingBlockWith(innerPreHeader, outerPreHeader);
+  }
+
+  auto * innerBr = cast<BranchInst>(innerLatch->getTerminator());
+  builder.SetInsertPoint(innerBr);
+  auto * iterNext = builder.CreateAdd(iter, ConstantInt::get(i64Ty, 1), "collapse.iter.next");
+  iter->addIncoming(ConstantInt::get(i64Ty, 0), outerPreHeader);
+  iter->addIncoming(iterNext, innerLatch);
+
+  // the collapsed loop takes over the annotations of the outer loop
+  auto * outerBr = cast<BranchInst>(outerLatch->getTerminator());
+  auto * done = builder.CreateICmpEQ(iterNext, totalTrips, "collapse.done");
+  auto * collapsedBr = BranchInst::Create(outerLatch, innerHeader, done, innerBr);
+  collapsedBr->setMetadata(LLVMContext::MD_loop, outerBr->getMetadata(LLVMContext::MD_loop));
+  auto * innerCond = innerBr->getCondition();
+  innerBr->eraseFromParent();
+  RecursivelyDeleteTriviallyDeadInstructions(innerCond);
+
+  // the outer latch computes the live-outs of the last iteration
+  outerInduction->replaceAllUsesWith(outerIter);
+  auto * outerCond = outerBr->getCondition();
+  BranchInst::Create(nest.exitBlock, outerBr);
+  outerBr->eraseFromParent();
+  RecursivelyDeleteTriviallyDeadInstructions(outerCond);
+
+  // remove the outer header (the carried phis only started their inner phi)
+  outerPreHeader->getTerminator()->replaceUsesOfWith(outerHeader, innerHeader);
+  outerHeader->getTerminator()->eraseFromParent();
+  for (auto & phi : make_early_inc_range(outerHeader->phis())) {
+    assert(phi.use_empty());
+    phi.eraseFromParent();
+  }
+  if (innerPreHeader != outerHeader) {
+    innerPreHeader->getTerminator()->eraseFromParent();
+    innerPreHeader->eraseFromParent();
+  }
+  outerHeader->eraseFromParent();
+
+  IF_DEBUG_COLLAPSE {
+    errs() << "loopCollapse: collapsed " << outerL.getName() << " into " << innerHeader->getName() << "\n";
+  }
+
+  return innerHeader;
+}
+
+} // namespace rv
@@ -1,16 +1,34 @@
 #include "rv/transform/lowerDivergentSwitches.h"
 #include "rv/vectorizationInfo.h"
+#include "rv/PlatformInfo.h"
+#include "rv/config.h"
+#include "rv/intrinsics.h"
 
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/ADT/DepthFirstIterator.h"
 
+#include "rvConfig.h"
+#include "report.h"
+
+#include <algorithm>
 #include <cassert>
 
+#if 1
+#define IF_DEBUG_DS IF_DEBUG
+#else
+#define IF_DEBUG_DS if (true)
+#endif
+
 using namespace llvm;
 
+// bookkeeping of a dispatch iteration: ballot, first lane, extract, compare, uniform switch, retiring lanes, any
+static const unsigned DispatchOverhead = 8;
+
 namespace rv {
 
 void
@@ -69,10 +87,244 @@ LowerDivergentSwitches::lowerSwitch(SwitchInst & switchInst) {
   switchInst.eraseFromParent();
 }
 
-LowerDivergentSwitches::LowerDivergentSwitches(VectorizationInfo & _vecInfo, FunctionAnalysisManager & FAM)
-: vecInfo(_vecInfo)
+bool
+LowerDivergentSwitches::getCaseRegion(SwitchInst & switchInst, CaseRegion & caseRegion) {
+  auto & func = vecInfo.getScalarFunction();
+  auto & switchBlock = *switchInst.getParent();
+
+  // the first pending lane is found through a ballot (i32)
+  if (vecInfo.getVectorWidth() > 32 || !switchInst.getCondition()->getType()->isIntegerTy()) return false;
+
+  auto & DT = FAM.getResult<DominatorTreeAnalysis>(func);
+  auto & PDT = FAM.getResult<PostDominatorTreeAnalysis>(func);
+  auto * switchNode = PDT.getNode(&switchBlock);
+  auto * joinNode = switchNode ? switchNode->getIDom() : nullptr;
+  auto * joinBlock = joinNode ? joinNode->getBlock() : nullptr;
+  if (!joinBlock || !vecInfo.inRegion(*joinBlock)) return false;
+  if (LI.getLoopFor(joinBlock) != LI.getLoopFor(&switchBlock)) return false;
+
+  caseRegion.joinBlock = joinBlock;
+  caseRegion.blocks.clear();
+  caseRegion.numTargets = 0;
+  caseRegion.bodySize = 0;
+
+  SmallPtrSet<BasicBlock*, 8> targets;
+  for (auto * caseBlock : successors(&switchBlock)) {
+    if (!targets.insert(caseBlock).second) continue;
+    ++caseRegion.numTargets;
+    if (caseBlock == joinBlock) continue;
+    if (caseBlock == &switchBlock || caseBlock->getUniquePredecessor() != &switchBlock) return false;
+
+    // every path from the case block ends in the join block
+    SmallPtrSet<BasicBlock*, 16> caseBlocks;
+    for (auto * node : depth_first(DT.getNode(caseBlock))) caseBlocks.insert(node->getBlock());
+    if (caseBlocks.count(joinBlock)) return false;
+    for (auto * block : caseBlocks) {
+      if (block->getTerminator()->getNumSuccessors() == 0) return false;
+      for (auto * succ : successors(block)) {
+        if (succ != joinBlock && !caseBlocks.count(succ)) return false;
+      }
+      caseRegion.bodySize += block->size();
+    }
+    caseRegion.blocks.insert(caseBlocks.begin(), caseBlocks.end());
+  }
+
+  // the join block becomes the (dedicated) exit of the dispatch loop
+  for (auto * pred : predecessors(joinBlock)) {
+    if (pred != &switchBlock && !caseRegion.blocks.count(pred)) return false;
+  }
+
+  // values of the case blocks only leave through the phis of the join block
+  for (auto * block : caseRegion.blocks) {
+    for (auto & inst : *block) {
+      for (auto * user : inst.users()) {
+        auto * userBlock = cast<Instruction>(user)->getParent();
+        if (caseRegion.blocks.count(userBlock)) continue;
+        if (isa<PHINode>(user) && userBlock == joinBlock) continue;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool
+LowerDivergentSwitches::preferDispatch(const SwitchInst & switchInst, const CaseRegion & caseRegion) const {
+  // the linearized cascade runs one compare per case and every case body
+  unsigned cascadeCost = switchInst.getNumCases() + caseRegion.bodySize;
+
+  // lanes are matched by their target block (one select per case to number them), so the dispatch loop takes at most
+  // one iteration per lane and per distinct target. Each iteration runs one case body (estimated by the average).
+  unsigned maxIterations = std::min<unsigned>(vecInfo.getVectorWidth(), caseRegion.numTargets);
+  unsigned dispatchCost = switchInst.getNumCases() +
+                          maxIterations * (DispatchOverhead + caseRegion.bodySize / caseRegion.numTargets);
+
+  IF_DEBUG_DS {
+    errs() << "divSwitch: " << switchInst.getParent()->getName() << " cascade cost " << cascadeCost
+           << ", dispatch cost " << dispatchCost << " (at most " << maxIterations << " iterations)\n";
+  }
+  return dispatchCost < cascadeCost;
+}
+
+void
+LowerDivergentSwitches::lowerSwitchDispatch(SwitchInst & switchInst, CaseRegion & caseRegion) {
+  auto & switchBlock = *switchInst.getParent();
+  auto & func = *switchBlock.getParent();
+  auto & ctx = func.getContext();
+  auto * joinBlock = caseRegion.joinBlock;
+  auto * cond = switchInst.getCondition();
+  unsigned vectorWidth = vecInfo.getVectorWidth();
+
+  auto * headBlock = BasicBlock::Create(ctx, "divswitch.head", &func, joinBlock);
+  auto * dispatchBlock = BasicBlock::Create(ctx, "divswitch.dispatch", &func, joinBlock);
+  auto * latchBlock = BasicBlock::Create(ctx, "divswitch.latch", &func, joinBlock);
+
+  // number the distinct targets (the default first), every lane computes the number of its target
+  SmallVector<BasicBlock*, 8> targets;
+  auto getTargetId = [&](BasicBlock * target) {
+    auto itTarget = std::find(targets.begin(), targets.end(), target);
+    if (itTarget != targets.end()) return (unsigned) (itTarget - targets.begin());
+    targets.push_back(target);
+    return (unsigned) targets.size() - 1;
+  };
+  IRBuilder<> builder(&switchInst);
+  auto * idTy = builder.getInt32Ty();
+  getTargetId(switchInst.getDefaultDest());
+  Value * targetId = builder.getInt32(0);
+  SmallVector<Value*, 16> idValues;
+  for (auto & itCase : switchInst.cases()) {
+    auto * isCase = builder.CreateICmpEQ(cond, itCase.getCaseValue(), "divswitch.case");
+    targetId = builder.CreateSelect(isCase, ConstantInt::get(idTy, getTargetId(itCase.getCaseSuccessor())), targetId, "divswitch.target");
+    idValues.push_back(isCase);
+    idValues.push_back(targetId);
+  }
+
+  // the leader is the first pending lane (inactive lanes do not show in the ballot)
+  builder.SetInsertPoint(headBlock);
+  auto * pending = builder.CreatePHI(builder.getInt1Ty(), 2, "divswitch.pending");
+  auto & ballotFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::Ballot);
+  auto * pendingBits = builder.CreateCall(&ballotFunc, pending, "divswitch.bits");
+  // without any pending lane (empty block mask) some lane leads, its case runs under an empty mask
+  auto * firstLane = builder.CreateBinaryIntrinsic(Intrinsic::cttz, pendingBits, builder.getFalse());
+  auto * leaderLane = builder.CreateBinaryIntrinsic(Intrinsic::umin, firstLane, builder.getInt32(vectorWidth - 1), nullptr, "divswitch.lane");
+  auto & extractFunc = platInfo.requestIntrinsic(RVIntrinsic::Extract, idTy);
+  auto * leaderCall = builder.CreateCall(&extractFunc, {targetId, leaderLane});
+  auto * leaderVal = builder.CreateFreeze(leaderCall, "divswitch.val");
+  auto * isLeader = builder.CreateICmpEQ(targetId, leaderVal, "divswitch.match");
+  auto * headBr = builder.CreateCondBr(isLeader, dispatchBlock, latchBlock);
+
+  // all lanes with the leader's target run its case (one edge per target)
+  builder.SetInsertPoint(dispatchBlock);
+  auto getDest = [&](BasicBlock * target) { return target == joinBlock ? latchBlock : target; };
+  auto * dispatchSwitch = builder.CreateSwitch(leaderVal, getDest(targets[0]), targets.size() - 1);
+  for (unsigned id = 1; id < targets.size(); ++id) dispatchSwitch->addCase(builder.getInt32(id), getDest(targets[id]));
+  for (auto * caseBlock : targets) {
+    if (caseBlock == joinBlock) continue;
+    for (auto & phi : caseBlock->phis()) {
+      // several case values of this target (and their incoming values) collapse into one edge
+      phi.replaceIncomingBlockWith(&switchBlock, dispatchBlock);
+      bool seen = false;
+      for (int i = 0; i < (int) phi.getNumIncomingValues(); ++i) {
+        if (phi.getIncomingBlock(i) != dispatchBlock) continue;
+        if (seen) phi.removeIncomingValue(i--, false);
+        seen = true;
+      }
+    }
+  }
+
+  // the join values of the leader's lanes
+  builder.SetInsertPoint(latchBlock);
+  SmallVector<PHINode*, 4> joinPhis;
+  SmallVector<PHINode*, 4> leaderPhis;
+  for (auto & phi : joinBlock->phis()) {
+    auto * leaderPhi = builder.CreatePHI(phi.getType(), phi.getNumIncomingValues() + 1, phi.getName() + ".leader");
+    bool hasDispatchEdge = false;
+    for (unsigned i = 0; i < phi.getNumIncomingValues(); ++i) {
+      auto * inBlock = phi.getIncomingBlock(i);
+      if (inBlock == &switchBlock) {
+        // the switch edges into the join block are one dispatch edge into the latch
+        if (hasDispatchEdge) continue;
+        hasDispatchEdge = true;
+        inBlock = dispatchBlock;
+      }
+      leaderPhi->addIncoming(phi.getIncomingValue(i), inBlock);
+    }
+    leaderPhi->addIncoming(UndefValue::get(phi.getType()), headBlock);
+    vecInfo.setVectorShape(*leaderPhi, VectorShape::varying());
+    joinPhis.push_back(&phi);
+    leaderPhis.push_back(leaderPhi);
+  }
+
+  SmallPtrSet<BasicBlock*, 8> caseExits(pred_begin(joinBlock), pred_end(joinBlock));
+  for (auto * caseExit : caseExits) {
+    if (caseExit != &switchBlock) caseExit->getTerminator()->replaceSuccessorWith(joinBlock, latchBlock);
+  }
+
+  // retire the leader's lanes, the join block sees the accumulated values
+  auto * pendingNext = builder.CreateAnd(pending, builder.CreateNot(isLeader), "divswitch.pending.next");
+  for (unsigned i = 0; i < joinPhis.size(); ++i) {
+    auto & phi = *joinPhis[i];
+    auto * accPhi = PHINode::Create(phi.getType(), 2, phi.getName() + ".acc", headBlock->getFirstNonPHI());
+    auto * accNext = builder.CreateSelect(isLeader, leaderPhis[i], accPhi, phi.getName() + ".acc.next");
+    accPhi->addIncoming(UndefValue::get(phi.getType()), &switchBlock);
+    accPhi->addIncoming(accNext, latchBlock);
+    while (phi.getNumIncomingValues() > 0) phi.removeIncomingValue(0u, false);
+    phi.addIncoming(accNext, latchBlock);
+    vecInfo.setVectorShape(*accPhi, VectorShape::varying());
+    vecInfo.setVectorShape(*accNext, VectorShape::varying());
+  }
+  pending->addIncoming(builder.getTrue(), &switchBlock);
+  pending->addIncoming(pendingNext, latchBlock);
+  auto & anyFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::Any);
+  auto * anyPending = builder.CreateCall(&anyFunc, pendingNext, "divswitch.any");
+  auto * latchBr = builder.CreateCondBr(anyPending, headBlock, joinBlock);
+
+  auto * entryBr = BranchInst::Create(headBlock, &switchInst);
+  switchInst.eraseFromParent();
+
+  // update shapes
+  Value * varyingValues[] = {pending, isLeader, headBr, pendingNext};
+  for (auto * val : varyingValues) vecInfo.setVectorShape(*val, VectorShape::varying());
+  for (auto * val : idValues) vecInfo.setVectorShape(*val, vecInfo.getVectorShape(*cond));
+  Value * uniValues[] = {pendingBits, firstLane, leaderLane, leaderCall, leaderVal, dispatchSwitch, anyPending, latchBr, entryBr};
+  for (auto * val : uniValues) vecInfo.setVectorShape(*val, VectorShape::uni());
+
+  // update LI: the dispatch loop nests in the loop of the switch and adopts the loops of the cases
+  auto * switchLoop = LI.getLoopFor(&switchBlock);
+  auto * dispatchLoop = LI.AllocateLoop();
+  if (switchLoop) switchLoop->addChildLoop(dispatchLoop);
+  else LI.addTopLevelLoop(dispatchLoop);
+  dispatchLoop->addBasicBlockToLoop(headBlock, LI);
+  dispatchLoop->addBasicBlockToLoop(dispatchBlock, LI);
+  dispatchLoop->addBasicBlockToLoop(latchBlock, LI);
+  for (auto * block : caseRegion.blocks) {
+    dispatchLoop->addBlockEntry(block);
+    if (LI.getLoopFor(block) == switchLoop) LI.changeLoopFor(block, dispatchLoop);
+  }
+
+  SmallVector<Loop*, 4> caseLoops;
+  auto & siblingLoops = switchLoop ? switchLoop->getSubLoopsVector() : LI.getTopLevelLoopsVector();
+  for (auto * loop : siblingLoops) {
+    if (loop != dispatchLoop && caseRegion.blocks.count(loop->getHeader())) caseLoops.push_back(loop);
+  }
+  for (auto * loop : caseLoops) {
+    if (switchLoop) switchLoop->removeChildLoop(loop);
+    else LI.removeLoop(std::find(LI.begin(), LI.end(), loop));
+    dispatchLoop->addChildLoop(loop);
+  }
+
+  IF_DEBUG_DS {
+    errs() << "divSwitch: " << switchBlock.getName() << " dispatches " << targets.size() << " targets in a loop\n";
+  }
+}
+
+LowerDivergentSwitches::LowerDivergentSwitches(const Config & _config, VectorizationInfo & _vecInfo, PlatformInfo & _platInfo, FunctionAnalysisManager & FAM)
+: config(_config)
+, vecInfo(_vecInfo)
+, platInfo(_platInfo)
 , FAM(FAM)
 , LI(*FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction()))
+, numDispatchLoops(0)
 {}
 
 bool
@@ -88,18 +340,28 @@ LowerDivergentSwitches::run() {
       return true;
   });
 
+  auto & func = vecInfo.getScalarFunction();
   for (auto * swInst : switchInsts) {
-    lowerSwitch(*swInst);
-  }
+    CaseRegion caseRegion;
+    if (config.enableSwitchDispatch && getCaseRegion(*swInst, caseRegion) && preferDispatch(*swInst, caseRegion)) {
+      lowerSwitchDispatch(*swInst, caseRegion);
+      ++numDispatchLoops;
+    } else {
+      lowerSwitch(*swInst);
+    }
 
-  bool Changed = !switchInsts.empty();
-  if (Changed) {
+    // the next case region is taken from the new CFG
     auto PA = PreservedAnalyses::all();
     PA.abandon<DominatorTreeAnalysis>();
     PA.abandon<PostDominatorTreeAnalysis>();
-    FAM.invalidate(vecInfo.getScalarFunction(), PA);
+    FAM.invalidate(func, PA);
+  }
+
+  if (numDispatchLoops > 0) {
+    Report() << "divSwitch: " << numDispatchLoops << " of " << switchInsts.size() << " divergent switches of "
+             << func.getName() << " lowered to dispatch loops\n";
   }
-  return Changed;
+  return !switchInsts.empty();
 }
 
 
@@ -9,6 +9,7 @@
 
 #include "rv/transform/maskExpander.h"
 #include "rvConfig.h"
+#include "report.h"
 
 #include "llvm/Transforms/Utils/SSAUpdater.h"
 #include "llvm/IR/Verifier.h"
@@ -18,6 +19,9 @@
 
 #include <cassert>
 
+// recursion limit of the structural mask implication
+static const int MaxImplicationDepth = 4;
+
 #if 1
 #define IF_DEBUG_ME IF_DEBUG
 #else
@@ -100,18 +104,188 @@ CreateNot(IRBuilder<> & builder, Value & val, const Twine & name=Twine()) {
 return *builder.CreateNot(&val, name);
 }
 
-MaskExpander::MaskExpander(VectorizationInfo & _vecInfo, FunctionAnalysisManager & FAM)
-: vecInfo(_vecInfo)
+MaskExpander::MaskExpander(const Config & _config, VectorizationInfo & _vecInfo, FunctionAnalysisManager & FAM)
+: config(_config)
+, vecInfo(_vecInfo)
 , FAM(FAM)
 , loopInfo(*FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction()))
 , boolTy(Type::getInt1Ty(vecInfo.getContext()))
 , trueConst(ConstantInt::getTrue(vecInfo.getContext()))
 , falseConst(ConstantInt::getFalse(vecInfo.getContext()))
+, numFoldedMasks(0)
+, numReusedMasks(0)
+, numHoistedMasks(0)
 {}
 
 MaskExpander::~MaskExpander()
 {}
 
+bool
+MaskExpander::implies(Value & lhs, Value & rhs, int depth) const {
+  using namespace llvm::PatternMatch;
+
+  if (&lhs == &rhs || &lhs == falseConst || &rhs == trueConst) return true;
+  if (depth >= MaxImplicationDepth) return false;
+
+  Value *X, *Y;
+  // (X && Y) => rhs  if  X => rhs or Y => rhs
+  if (match(&lhs, m_LogicalAnd(m_Value(X), m_Value(Y))) &&
+      (implies(*X, rhs, depth + 1) || implies(*Y, rhs, depth + 1))) return true;
+  // (X || Y) => rhs  if  X => rhs and Y => rhs
+  if (match(&lhs, m_LogicalOr(m_Value(X), m_Value(Y))) &&
+      implies(*X, rhs, depth + 1) && implies(*Y, rhs, depth + 1)) return true;
+  // lhs => (X || Y)  if  lhs => X or lhs => Y
+  if (match(&rhs, m_LogicalOr(m_Value(X), m_Value(Y))) &&
+      (implies(lhs, *X, depth + 1) || implies(lhs, *Y, depth + 1))) return true;
+  // lhs => (X && Y)  if  lhs => X and lhs => Y
+  if (match(&rhs, m_LogicalAnd(m_Value(X), m_Value(Y))) &&
+      implies(lhs, *X, depth + 1) && implies(lhs, *Y, depth + 1)) return true;
+
+  // any lane in lhs is a live lane of rv_any(M)
+  auto * anyTestedMask = MatchMaskIntrinsic(rhs);
+  if (anyTestedMask) return implies(lhs, *anyTestedMask, depth + 1);
+
+  return false;
+}
+
+Value *
+MaskExpander::foldMaskOp(unsigned opcode, Value & lhs, Value * rhs) const {
+  using namespace llvm::PatternMatch;
+
+  if (opcode == Instruction::Xor) {
+    assert(!rhs && "not has a single operand");
+    Value * X;
+    if (match(&lhs, m_Not(m_Value(X)))) return X;
+    if (&lhs == trueConst) return falseConst;
+    if (&lhs == falseConst) return trueConst;
+    return nullptr;
+  }
+
+  assert(rhs && (opcode == Instruction::And || opcode == Instruction::Or));
+  bool isAnd = opcode == Instruction::And;
+  Value * absorbing = isAnd ? falseConst : trueConst;
+  Value * neutral = isAnd ? trueConst : falseConst;
+
+  if (&lhs == absorbing || rhs == absorbing) return absorbing;
+  if (&lhs == neutral) return rhs;
+  if (rhs == neutral || &lhs == rhs) return &lhs;
+
+  // x && !x, x || !x
+  if (match(&lhs, m_Not(m_Specific(rhs))) || match(rhs, m_Not(m_Specific(&lhs)))) return absorbing;
+
+  // the stronger mask for and, the weaker one for or
+  if (implies(lhs, *rhs)) return isAnd ? &lhs : rhs;
+  if (implies(*rhs, lhs)) return isAnd ? rhs : &lhs;
+  return nullptr;
+}
+
+// whether @inst is available at the insert point of @builder
+static bool
+DominatesInsertPoint(const DominatorTree & DT, const Instruction & inst, const IRBuilder<> & builder) {
+  auto * insertBlock = builder.GetInsertBlock();
+  auto insertPt = builder.GetInsertPoint();
+  if (insertPt == insertBlock->end()) return DT.dominates(inst.getParent(), insertBlock);
+  return DT.dominates(&inst, &*insertPt);
+}
+
+Instruction *
+MaskExpander::lookupMaskOp(unsigned opcode, Value & lhs, Value * rhs, IRBuilder<> & builder) const {
+  auto & DT = FAM.getResult<DominatorTreeAnalysis>(vecInfo.getScalarFunction());
+  // and/or are commutative (the key of not is symmetric)
+  for (auto key : {MaskOpKey(opcode, &lhs, rhs), MaskOpKey(opcode, rhs, &lhs)}) {
+    auto it = maskOps.find(key);
+    if (it == maskOps.end()) continue;
+
+    // erased or rewritten since
+    auto * inst = dyn_cast_or_null<Instruction>(it->second);
+    if (!inst || !is_contained(inst->operands(), &lhs) || (rhs && !is_contained(inst->operands(), rhs))) continue;
+
+    if (DominatesInsertPoint(DT, *inst, builder)) return inst;
+  }
+  return nullptr;
+}
+
+Instruction *
+MaskExpander::getHoistPoint(BasicBlock & insertBlock, Value & lhs, Value * rhs) const {
+  auto & DT = FAM.getResult<DominatorTreeAnalysis>(vecInfo.getScalarFunction());
+  Instruction * operands[] = {dyn_cast<Instruction>(&lhs), rhs ? dyn_cast<Instruction>(rhs) : nullptr};
+
+  Instruction * hoistPt = nullptr;
+  for (auto * loop = loopInfo.getLoopFor(&insertBlock); loop; loop = loop->getParentLoop()) {
+    auto * preHeader = loop->getLoopPreheader();
+    if (!preHeader || !vecInfo.inRegion(*preHeader)) break;
+
+    auto * preHeaderTerm = preHeader->getTerminator();
+    bool invariant = true;
+    for (auto * opInst : operands) {
+      if (!opInst) continue;
+      invariant &= !loop->contains(opInst) && DT.dominates(opInst, preHeaderTerm);
+    }
+    if (!invariant) break;
+    hoistPt = preHeaderTerm;
+  }
+  return hoistPt;
+}
+
+Value &
+MaskExpander::createMaskOp(IRBuilder<> & builder, unsigned opcode, Value & lhs, Value * rhs, VectorShape shape, const Twine & name) {
+  auto emitMaskOp = [&](IRBuilder<> & maskBuilder) -> Value & {
+    switch (opcode) {
+      case Instruction::And: return CreateAnd(maskBuilder, lhs, *rhs, name);
+      case Instruction::Or: return CreateOr(maskBuilder, lhs, *rhs, name);
+      case Instruction::Xor: return CreateNot(maskBuilder, lhs, name);
+      default: abort();
+    }
+  };
+
+  if (!config.enableMaskCSE) {
+    auto & mask = emitMaskOp(builder);
+    if (!isa<Constant>(mask)) vecInfo.setVectorShape(mask, shape);
+    return mask;
+  }
+
+  // mask algebra
+  auto * foldedMask = foldMaskOp(opcode, lhs, rhs);
+  if (foldedMask) {
+    ++numFoldedMasks;
+    IF_DEBUG_ME { errs() << "\t folded mask op to " << *foldedMask << "\n"; }
+    return *foldedMask;
+  }
+
+  // an identical expression is available already
+  auto * cachedMask = lookupMaskOp(opcode, lhs, rhs, builder);
+  if (cachedMask) {
+    ++numReusedMasks;
+    return *cachedMask;
+  }
+
+  // loop-invariant operands: compute the mask once before the loop
+  IRBuilder<> maskBuilder(builder.GetInsertBlock(), builder.GetInsertPoint());
+  auto * hoistPt = getHoistPoint(*builder.GetInsertBlock(), lhs, rhs);
+  if (hoistPt) {
+    maskBuilder.SetInsertPoint(hoistPt);
+    cachedMask = lookupMaskOp(opcode, lhs, rhs, maskBuilder);
+    if (cachedMask) {
+      ++numReusedMasks;
+      return *cachedMask;
+    }
+  }
+
+  auto & mask = emitMaskOp(maskBuilder);
+  if (isa<Constant>(mask)) return mask;
+  vecInfo.setVectorShape(mask, shape);
+
+  auto * maskInst = dyn_cast<Instruction>(&mask);
+  if (maskInst && maskInst != &lhs && maskInst != rhs) {
+    maskOps[MaskOpKey(opcode, &lhs, rhs)] = maskInst;
+    if (hoistPt) {
+      ++numHoistedMasks;
+      IF_DEBUG_ME { errs() << "\t hoisted " << *maskInst << "\n"; }
+    }
+  }
+  return mask;
+}
+
 
 
 
@@ -150,8 +324,7 @@ MaskExpander::requestBranchMask(Instruction & term, int succIdx, IRBuilder<> & b
 
     assert(succIdx == 1);
 
-    auto & negCond = CreateNot(builder, *condVal, "neg." + condVal->getName());
-    if (!isa<Constant>(negCond)) vecInfo.setVectorShape(negCond, vecInfo.getVectorShape(*condVal));
+    auto & negCond = createMaskOp(builder, Instruction::Xor, *condVal, nullptr, vecInfo.getVectorShape(*condVal), "neg." + condVal->getName());
     setBranchMask(sourceBlock, succIdx, negCond);
     return negCond;
 
@@ -172,13 +345,11 @@ MaskExpander::requestBranchMask(Instruction & term, int succIdx, IRBuilder<> & b
         auto & caseCmp = requestBranchMask(switchTerm, i, builder);
         if (!joinedMask) joinedMask = &caseCmp;
         else {
-          joinedMask = &CreateOr(builder, *joinedMask, caseCmp, "orcase_" + std::to_string(i));
-          vecInfo.setVectorShape(*joinedMask, valShape);
+          joinedMask = &createMaskOp(builder, Instruction::Or, *joinedMask, &caseCmp, valShape, "orcase_" + std::to_string(i));
         }
       }
 
-      auto & defaultMask = CreateNot(builder, *joinedMask);
-      vecInfo.setVectorShape(defaultMask, valShape);
+      auto & defaultMask = createMaskOp(builder, Instruction::Xor, *joinedMask, nullptr, valShape);
       setBranchMask(sourceBlock, succIdx, defaultMask);
       return defaultMask;
 
@@ -262,10 +433,10 @@ MaskExpander::requestEdgeMask(Instruction & term, int succIdx) {
   if (isa<Constant>(blockMask)) {
     edgeMask = &branchPred;
   } else {
-    edgeMask = &CreateAnd(builder, blockMask, branchPred, "edge_" + BB.getName().str() + "." + std::to_string(succIdx));
     auto maskShape = vecInfo.getVectorShape(blockMask);
     auto branchShape = vecInfo.getVectorShape(branchPred);
-    vecInfo.setVectorShape(*edgeMask, VectorShape::join(maskShape, branchShape));
+    edgeMask = &createMaskOp(builder, Instruction::And, blockMask, &branchPred, VectorShape::join(maskShape, branchShape),
+                             "edge_" + BB.getName().str() + "." + std::to_string(succIdx));
   }
 
   setEdgeMask(BB, succIdx, *edgeMask);
@@ -281,9 +452,15 @@ MaskExpander::requestBlockMask(BasicBlock & BB) {
 
   // region entry mask
   // - WFV mode: use the mask arg if available
-  // - region mode: true
+  // - region mode: the entry mask in vecInfo (tail folding) or true
   auto & entryBlock = vecInfo.getEntry();
   if (&BB == &entryBlock) {
+    auto * entryMask = vecInfo.getEntryMask();
+    if (entryMask) {
+      IF_DEBUG_ME {errs() << "region entryMask: " << *entryMask << "\n"; }
+      setBlockMask(BB, *entryMask);
+      return *entryMask;
+    }
     IF_DEBUG_ME {errs() << "region entryMask: true\n"; }
     setBlockMask(BB, *trueConst);
     return *trueConst;
@@ -453,8 +630,7 @@ MaskExpander::requestBlockMask(BasicBlock & BB) {
     auto divShape = vecInfo.getVectorShape(*orVec[i]);
     maskShape = VectorShape::join(maskShape, divShape);
 
-    blockMask = &CreateOr(builder, *blockMask, *orVec[i]);
-    vecInfo.setVectorShape(*blockMask, maskShape);
+    blockMask = &createMaskOp(builder, Instruction::Or, *blockMask, orVec[i], maskShape);
   }
 
   IF_DEBUG_ME { errs() << "> " << *blockMask << "\n"; }
@@ -525,6 +701,10 @@ MaskExpander::expandRegionMasks() {
   // finalize loop live masks by adding masks on loop entry
   // patchLoopMasks();
 
+  if (numFoldedMasks + numReusedMasks + numHoistedMasks > 0) {
+    Report() << "maskEx: folded " << numFoldedMasks << ", re-used " << numReusedMasks << ", hoisted " << numHoistedMasks << " mask ops\n";
+  }
+
   IF_DEBUG_ME {
     errs() << "-- Region after MaskExpander --\n";
     vecInfo.dump();
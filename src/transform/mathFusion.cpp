@@ -0,0 +1,367 @@
+//===- src/transform/mathFusion.cpp - fuse and expand math calls before vectorization --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include <llvm/ADT/APSInt.h>
+#include <llvm/ADT/DepthFirstIterator.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/PatternMatch.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include <rv/transform/mathFusion.h>
+#include <rv/vectorizationInfo.h>
+
+#include <rvConfig.h>
+#include "report.h"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+#if 1
+#define IF_DEBUG_MF IF_DEBUG
+#else
+#define IF_DEBUG_MF if (false)
+#endif
+
+namespace rv {
+
+// longest square-and-multiply chain for pow(x, n)
+static const int64_t MaxPowiExponent = 32;
+
+// \p call is a libm call or llvm intrinsic \p baseName on float or double
+static bool
+IsMathCall(const CallInst & call, StringRef baseName) {
+  if (!call.getType()->isFloatTy() && !call.getType()->isDoubleTy()) return false;
+  const auto * callee = call.getCalledFunction();
+  if (!callee) return false;
+  auto name = callee->getName();
+  if (name == baseName || name == (baseName + "f").str()) return true;
+  return name.startswith(("llvm." + baseName + ".").str());
+}
+
+// math functions whose calls on the same or related operands share their work
+static const char * ShareableFamilies[] = {"exp", "exp2", "expm1", "log", "log2", "log10", "log1p", "pow"};
+
+static StringRef
+GetShareableFamily(const CallInst & call) {
+  for (const char * family : ShareableFamilies) {
+    if (IsMathCall(call, family)) return family;
+  }
+  return StringRef();
+}
+
+static double
+ToDouble(const APFloat & val) {
+  APFloat asDouble(val);
+  bool losesInfo;
+  asDouble.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven, &losesInfo);
+  return asDouble.convertToDouble();
+}
+
+// \p a == \p b + offset for a constant offset
+static bool
+MatchOffset(Value & a, Value & b, double & offset) {
+  const APFloat * c;
+  if (match(&a, m_c_FAdd(m_Specific(&b), m_APFloat(c)))) { offset = ToDouble(*c); return true; }
+  if (match(&a, m_FSub(m_Specific(&b), m_APFloat(c)))) { offset = -ToDouble(*c); return true; }
+  if (match(&b, m_c_FAdd(m_Specific(&a), m_APFloat(c)))) { offset = -ToDouble(*c); return true; }
+  if (match(&b, m_FSub(m_Specific(&a), m_APFloat(c)))) { offset = ToDouble(*c); return true; }
+  return false;
+}
+
+// \p a == \p b * scale for a constant scale
+static bool
+MatchScale(Value & a, Value & b, double & scale) {
+  const APFloat * c;
+  if (match(&a, m_c_FMul(m_Specific(&b), m_APFloat(c)))) { scale = ToDouble(*c); return true; }
+  if (match(&a, m_FDiv(m_Specific(&b), m_APFloat(c)))) { scale = 1.0 / ToDouble(*c); return true; }
+  if (match(&b, m_c_FMul(m_Specific(&a), m_APFloat(c)))) { scale = 1.0 / ToDouble(*c); return true; }
+  if (match(&b, m_FDiv(m_Specific(&a), m_APFloat(c)))) { scale = ToDouble(*c); return true; }
+  return false;
+}
+
+// \p val as a constant of the float type \p ty, nullptr if it is not finite there
+static Constant *
+GetFiniteConstant(Type & ty, double val) {
+  if (ty.isFloatTy()) val = (float) val;
+  if (!std::isfinite(val)) return nullptr;
+  return ConstantFP::get(&ty, val);
+}
+
+MathFusion::MathFusion(VectorizationInfo & _vecInfo)
+  : vecInfo(_vecInfo)
+{}
+
+void
+MathFusion::setShape(Instruction & inst, Value & a, Value & b) {
+  auto isUniform = [&](const Value & val) {
+    return isa<Constant>(val) || (vecInfo.hasKnownShape(val) && vecInfo.getVectorShape(val).isUniform());
+  };
+  vecInfo.setVectorShape(inst, isUniform(a) && isUniform(b) ? VectorShape::uni() : VectorShape::varying());
+}
+
+bool
+MathFusion::expandPowi(CallInst & powCall) {
+  auto * expConst = dyn_cast<ConstantFP>(powCall.getArgOperand(1));
+  if (!expConst || !expConst->getValueAPF().isInteger()) return false;
+
+  APSInt intExp(64, false);
+  bool isExact = false;
+  if (expConst->getValueAPF().convertToInteger(intExp, APFloat::rmTowardZero, &isExact) != APFloat::opOK) return false;
+  int64_t n = intExp.getExtValue();
+  if (n < -MaxPowiExponent || n > MaxPowiExponent) return false;
+
+  // x * x is the correctly rounded x^2, longer chains (and reciprocals) accumulate rounding errors
+  if ((n < 0 || n > 2) && !powCall.hasApproxFunc()) return false;
+
+  IF_DEBUG_MF { errs() << "mathFusion: expand " << powCall << "\n"; }
+
+  auto * resTy = powCall.getType();
+  IRBuilder<> builder(&powCall);
+  builder.setFastMathFlags(powCall.getFastMathFlags());
+
+  auto createMul = [&](Value * a, Value * b) {
+    auto * mul = builder.CreateFMul(a, b, "powi");
+    if (auto * mulInst = dyn_cast<Instruction>(mul)) setShape(*mulInst, *a, *b);
+    return mul;
+  };
+
+  Value * base = powCall.getArgOperand(0);
+  Value * result = nullptr;
+  for (uint64_t m = n < 0 ? -n : n; m > 0; m >>= 1) {
+    if (m & 1) result = result ? createMul(result, base) : base;
+    if (m > 1) base = createMul(base, base);
+  }
+
+  // pow(x, 0) == 1 for any x (including NaN)
+  if (!result) result = ConstantFP::get(resTy, 1.0);
+
+  if (n < 0) {
+    auto * one = ConstantFP::get(resTy, 1.0);
+    auto * recip = builder.CreateFDiv(one, result, "powi.rcp");
+    if (auto * recipInst = dyn_cast<Instruction>(recip)) setShape(*recipInst, *one, *result);
+    result = recip;
+  }
+
+  powCall.replaceAllUsesWith(result);
+  vecInfo.dropVectorShape(powCall);
+  powCall.eraseFromParent();
+  return true;
+}
+
+bool
+MathFusion::fusePowExp(CallInst & powCall) {
+  auto * expCall = dyn_cast<CallInst>(powCall.getArgOperand(0));
+  if (!expCall || !expCall->hasOneUse() || !IsMathCall(*expCall, "exp")) return false;
+  if (expCall->getType() != powCall.getType()) return false;
+  if (!powCall.hasApproxFunc()) return false;
+
+  IF_DEBUG_MF { errs() << "mathFusion: fuse " << *expCall << " into " << powCall << "\n"; }
+
+  IRBuilder<> builder(&powCall);
+  builder.setFastMathFlags(powCall.getFastMathFlags());
+
+  auto * expArg = expCall->getArgOperand(0);
+  auto * y = powCall.getArgOperand(1);
+  auto * prod = builder.CreateFMul(expArg, y, "exp.arg");
+  auto * prodInst = dyn_cast<Instruction>(prod);
+  if (prodInst) setShape(*prodInst, *expArg, *y);
+
+  auto * fusedExp = builder.CreateCall(expCall->getFunctionType(), expCall->getCalledOperand(), {prod}, powCall.getName());
+  fusedExp->setAttributes(expCall->getAttributes());
+  fusedExp->setCallingConv(expCall->getCallingConv());
+  vecInfo.setVectorShape(*fusedExp, prodInst ? vecInfo.getVectorShape(*prodInst) : VectorShape::uni());
+
+  powCall.replaceAllUsesWith(fusedExp);
+  vecInfo.dropVectorShape(powCall);
+  powCall.eraseFromParent();
+  vecInfo.dropVectorShape(*expCall);
+  expCall->eraseFromParent();
+  return true;
+}
+
+bool
+MathFusion::fuseExpLog(CallInst & expCall) {
+  bool isExp2 = IsMathCall(expCall, "exp2");
+  if (!isExp2 && !IsMathCall(expCall, "exp")) return false;
+  // pow(x, y) is defined for negative x and integer y, exp(y * log(x)) is not
+  if (!expCall.hasApproxFunc() || !expCall.hasNoNaNs()) return false;
+
+  auto * mul = dyn_cast<BinaryOperator>(expCall.getArgOperand(0));
+  if (!mul || mul->getOpcode() != Instruction::FMul || !mul->hasOneUse() || !vecInfo.inRegion(*mul->getParent())) return false;
+
+  for (unsigned i = 0; i < 2; ++i) {
+    auto * logCall = dyn_cast<CallInst>(mul->getOperand(i));
+    if (!logCall || !logCall->hasOneUse() || !IsMathCall(*logCall, isExp2 ? "log2" : "log")) continue;
+    if (logCall->getType() != expCall.getType() || !vecInfo.inRegion(*logCall->getParent())) continue;
+
+    IF_DEBUG_MF { errs() << "mathFusion: fuse " << *logCall << " into " << expCall << "\n"; }
+
+    IRBuilder<> builder(&expCall);
+    builder.setFastMathFlags(expCall.getFastMathFlags());
+    auto * x = logCall->getArgOperand(0);
+    auto * y = mul->getOperand(1 - i);
+    auto * powFunc = Intrinsic::getDeclaration(expCall.getModule(), Intrinsic::pow, {expCall.getType()});
+    auto * powCall = builder.CreateCall(powFunc, {x, y}, expCall.getName());
+    setShape(*powCall, *x, *y);
+
+    expCall.replaceAllUsesWith(powCall);
+    vecInfo.dropVectorShape(expCall);
+    expCall.eraseFromParent();
+    vecInfo.dropVectorShape(*mul);
+    mul->eraseFromParent();
+    vecInfo.dropVectorShape(*logCall);
+    logCall->eraseFromParent();
+    return true;
+  }
+  return false;
+}
+
+bool
+MathFusion::shareMathCall(CallInst & call, CallInst & domCall, StringRef family) {
+  // the result of an approximate call does not stand in for an exact one
+  if (domCall.hasApproxFunc() && !call.hasApproxFunc()) return false;
+
+  IRBuilder<> builder(&call);
+  builder.setFastMathFlags(call.getFastMathFlags());
+  auto createOp = [&](Instruction::BinaryOps opcode, Value & a, Value & b) {
+    auto * op = builder.CreateBinOp(opcode, &a, &b, call.getName() + ".shared");
+    if (auto * opInst = dyn_cast<Instruction>(op)) setShape(*opInst, a, b);
+    return op;
+  };
+
+  Value * result = nullptr;
+  auto & ty = *call.getType();
+  if (std::equal(call.arg_begin(), call.arg_end(), domCall.arg_begin())) {
+    result = &domCall;
+
+  } else if (call.hasApproxFunc() && call.arg_size() == 1) {
+    auto & a = *call.getArgOperand(0);
+    auto & b = *domCall.getArgOperand(0);
+    bool isExp = family == "exp" || family == "exp2";
+    bool isLog = family == "log" || family == "log2" || family == "log10";
+    double c;
+    if (isExp && (match(&a, m_FNeg(m_Specific(&b))) || match(&b, m_FNeg(m_Specific(&a))))) {
+      // exp(-a) = 1 / exp(a)
+      result = createOp(Instruction::FDiv, *ConstantFP::get(&ty, 1.0), domCall);
+    } else if (isExp && MatchOffset(a, b, c)) {
+      // exp(a + c) = exp(a) * exp(c)
+      auto * factor = GetFiniteConstant(ty, family == "exp" ? std::exp(c) : std::exp2(c));
+      if (factor && !factor->isZeroValue()) result = createOp(Instruction::FMul, domCall, *factor);
+    } else if (isLog && MatchScale(a, b, c) && c > 0.0) {
+      // log(a * c) = log(a) + log(c)
+      auto * summand = GetFiniteConstant(ty, family == "log" ? std::log(c) : family == "log2" ? std::log2(c) : std::log10(c));
+      if (summand) result = createOp(Instruction::FAdd, domCall, *summand);
+    }
+  }
+  if (!result) return false;
+
+  IF_DEBUG_MF { errs() << "mathFusion: share " << domCall << " with " << call << "\n"; }
+
+  call.replaceAllUsesWith(result);
+  vecInfo.dropVectorShape(call);
+  call.eraseFromParent();
+  return true;
+}
+
+size_t
+MathFusion::shareMathCalls(const DominatorTree & domTree) {
+  // dominating calls come first
+  std::vector<std::pair<CallInst*, StringRef>> calls;
+  for (const auto * node : depth_first(domTree.getRootNode())) {
+    auto & block = *node->getBlock();
+    if (!vecInfo.inRegion(block)) continue;
+    for (auto & inst : block) {
+      auto * call = dyn_cast<CallInst>(&inst);
+      if (!call) continue;
+      auto family = GetShareableFamily(*call);
+      if (!family.empty()) calls.emplace_back(call, family);
+    }
+  }
+
+  // remaining calls per callee
+  std::map<const Value*, std::vector<CallInst*>> domCalls;
+  size_t numShared = 0;
+  for (auto & it : calls) {
+    auto & call = *it.first;
+    auto & candidates = domCalls[call.getCalledOperand()];
+    bool shared = false;
+    for (auto * domCall : candidates) {
+      if (domTree.dominates(domCall, &call) && shareMathCall(call, *domCall, it.second)) {
+        shared = true;
+        break;
+      }
+    }
+    if (shared) {
+      numShared++;
+    } else {
+      candidates.push_back(&call);
+    }
+  }
+  return numShared;
+}
+
+bool
+MathFusion::run() {
+  IF_DEBUG_MF { errs() << "-- math fusion log --\n"; }
+
+  std::vector<CallInst*> powCalls;
+  for (auto & block : vecInfo.getScalarFunction()) {
+    if (!vecInfo.inRegion(block)) continue;
+    for (auto & inst : block) {
+      auto * call = dyn_cast<CallInst>(&inst);
+      if (call && IsMathCall(*call, "pow")) powCalls.push_back(call);
+    }
+  }
+
+  size_t numFused = 0, numExpanded = 0;
+  for (auto * powCall : powCalls) {
+    // pow(exp(x), 2) -> exp(2 * x) rather than exp(x) * exp(x)
+    if (fusePowExp(*powCall)) {
+      numFused++;
+    } else if (expandPowi(*powCall)) {
+      numExpanded++;
+    }
+  }
+
+  // exp(y * log(x)) -> pow(x, y), after the pow rewrites (which remove and create exp calls)
+  std::vector<CallInst*> expCalls;
+  for (auto & block : vecInfo.getScalarFunction()) {
+    if (!vecInfo.inRegion(block)) continue;
+    for (auto & inst : block) {
+      auto * call = dyn_cast<CallInst>(&inst);
+      if (call && (IsMathCall(*call, "exp") || IsMathCall(*call, "exp2"))) expCalls.push_back(call);
+    }
+  }
+  size_t numPows = 0;
+  for (auto * expCall : expCalls) {
+    if (fuseExpLog(*expCall)) numPows++;
+  }
+
+  // one range reduction for calls on the same or related operands
+  DominatorTree domTree(vecInfo.getScalarFunction());
+  size_t numShared = shareMathCalls(domTree);
+
+  if (numFused + numExpanded + numPows + numShared > 0) {
+    Report() << "mathFusion: fused " << numFused << " pow(exp(x), y), expanded " << numExpanded << " pow(x, n), fused "
+             << numPows << " exp(y * log(x)), shared " << numShared << " math calls\n";
+  }
+
+  IF_DEBUG_MF { errs() << "-- end of math fusion log --\n"; }
+
+  return numFused + numExpanded + numPows + numShared > 0;
+}
+
+} // namespace rv
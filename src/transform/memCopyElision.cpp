@@ -1,4 +1,4 @@
-//===- src/transform/maskExpander.cpp - IR generator for edge and block predicates  --*- C++ -*-===//
+//===- src/transform/memCopyElision.cpp - lower divergent memcpy/-mov/-set to load store  --*- C++ -*-===//
 //
 // Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
 // See https://llvm.org/LICENSE.txt for license information.
@@ -16,7 +16,11 @@
 #include <llvm/IR/IRBuilder.h>
 // #include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/PostDominators.h>
 
+#include "rv/intrinsics.h"
 #include "rvConfig.h"
 
 using namespace rv;
@@ -136,60 +140,288 @@ MemCopyElision::lowerMemCopy(llvm::Value * destBase, llvm::Value * srcBase, llvm
 }
 
 bool
-MemCopyElision::run() {
-  std::vector<Instruction*> killVec;
+MemCopyElision::lowerTypedCopy(MemTransferInst & mcInst, size_t numBytes) {
+  auto srcVal = mcInst.getSource();
+  auto destVal = mcInst.getDest();
+  auto * srcBase = deriveBase(srcVal, numBytes);
+  auto * destBase = deriveBase(destVal, numBytes);
+  if (!srcBase || !destBase) {
+    IF_DEBUG_MCE  { errs() << "\tskip: could not derive suiteble base pointers!\n"; }
+    return false;
+  }
+
+// derive a common field-aligned type of both base pointers
+  auto * srcGep = llvm::cast<llvm::GetElementPtrInst>(srcBase);
+  auto * dstGep = llvm::cast<llvm::GetElementPtrInst>(destBase);
+  auto * commonTy = deriveCommonType(srcGep->getSourceElementType(), dstGep->getSourceElementType(), numBytes);
+  if (!commonTy) {
+    IF_DEBUG_MCE  { errs() << "\tskip: could not derive a common base type!\n"; }
+    return false;
+  }
+  IF_DEBUG_MCE  { errs() << "\tskip: common base type: " << *commonTy << "\n"; }
+
+// all checks passed -> create code
+  IRBuilder<> builder(&mcInst);
+  auto * srcPtr = createBaseGEP(srcBase, commonTy, builder);
+  auto * destPtr = createBaseGEP(destBase, commonTy, builder);
+  if (!srcPtr || !destPtr) {
+    return false;
+  }
+
+  IF_DEBUG_MCE  { errs() << "OK base gep src: " << *srcPtr << "   " << "base gep dest: " << *destPtr << "\n"; }
+  assert(srcPtr->getType() == destPtr->getType());
+
+  lowerMemCopy(destPtr, srcPtr, commonTy, builder, numBytes);
+  return true;
+}
+
+VectorShape
+MemCopyElision::getJoinedShape(Value * a, Value * b) const {
+  bool uniform = (!a || vecInfo.getVectorShape(*a).isUniform()) && (!b || vecInfo.getVectorShape(*b).isUniform());
+  return uniform ? VectorShape::uni() : VectorShape::varying();
+}
+
+void
+MemCopyElision::setShape(Value * val, VectorShape shape) {
+  // IRBuilder may fold to constants or existing values
+  auto * inst = dyn_cast<Instruction>(val);
+  if (inst && !vecInfo.hasKnownShape(*inst)) vecInfo.setVectorShape(*inst, shape);
+}
+
+Value *
+MemCopyElision::createChunkPtr(Value * ptr, Value * offset, Type * chunkTy, IRBuilder<> & builder) {
+  unsigned addrSpace = ptr->getType()->getPointerAddressSpace();
+  auto * bytePtr = builder.CreatePointerCast(ptr, builder.getInt8PtrTy(addrSpace), "mce.bytes");
+  setShape(bytePtr, getJoinedShape(ptr, nullptr));
+  auto * chunkPtr = builder.CreateGEP(builder.getInt8Ty(), bytePtr, offset, "mce.ptr");
+  setShape(chunkPtr, getJoinedShape(bytePtr, offset));
+  auto * typedPtr = builder.CreatePointerCast(chunkPtr, chunkTy->getPointerTo(addrSpace), "mce.chunkptr");
+  setShape(typedPtr, getJoinedShape(chunkPtr, nullptr));
+  return typedPtr;
+}
+
+Value *
+MemCopyElision::createChunkValue(MemIntrinsic & memInst, Type * chunkTy, Value * offset, Align srcAlign, IRBuilder<> & builder) {
+  // memset: replicate the byte into the chunk
+  if (auto * memSet = dyn_cast<MemSetInst>(&memInst)) {
+    auto * byteVal = memSet->getValue();
+    if (byteVal->getType() == chunkTy) return byteVal;
+    auto * wideVal = builder.CreateZExt(byteVal, chunkTy, "mce.byte");
+    auto * byteSplat = ConstantInt::get(chunkTy, APInt::getSplat(chunkTy->getIntegerBitWidth(), APInt(8, 1)));
+    auto * chunkVal = builder.CreateMul(wideVal, byteSplat, "mce.splat");
+    setShape(wideVal, getJoinedShape(byteVal, nullptr));
+    setShape(chunkVal, getJoinedShape(byteVal, nullptr));
+    return chunkVal;
+  }
+
+  auto & mcInst = cast<MemTransferInst>(memInst);
+  auto * srcPtr = createChunkPtr(mcInst.getRawSource(), offset, chunkTy, builder);
+  auto * chunkVal = builder.CreateAlignedLoad(chunkTy, srcPtr, srcAlign, "mce.chunk");
+  setShape(chunkVal, getJoinedShape(srcPtr, nullptr));
+  return chunkVal;
+}
+
+void
+MemCopyElision::storeChunk(MemIntrinsic & memInst, Value * chunkVal, Value * offset, Align destAlign, IRBuilder<> & builder) {
+  auto * destPtr = createChunkPtr(memInst.getRawDest(), offset, chunkVal->getType(), builder);
+  auto * store = builder.CreateAlignedStore(chunkVal, destPtr, destAlign);
+  vecInfo.setVectorShape(*store, getJoinedShape(destPtr, chunkVal));
+}
+
+static MaybeAlign
+GetSourceAlign(const MemIntrinsic & memInst) {
+  auto * mcInst = dyn_cast<MemTransferInst>(&memInst);
+  return mcInst ? mcInst->getSourceAlign() : MaybeAlign();
+}
+
+void
+MemCopyElision::lowerChunked(MemIntrinsic & memInst, size_t numBytes, IRBuilder<> & builder) {
+  auto & context = builder.getContext();
+  auto * offsetTy = memInst.getLength()->getType();
+  Align srcAlign = GetSourceAlign(memInst).valueOrOne();
+  Align destAlign = memInst.getDestAlign().valueOrOne();
+
+  // widest chunks first, all loads before the first store (memmove)
+  SmallVector<std::pair<size_t, Value*>, 8> chunks;
+  size_t offset = 0;
+  for (size_t chunkBytes = 8; chunkBytes > 0; chunkBytes /= 2) {
+    auto * chunkTy = IntegerType::get(context, 8 * chunkBytes);
+    for (; offset + chunkBytes <= numBytes; offset += chunkBytes) {
+      auto * chunkVal = createChunkValue(memInst, chunkTy, ConstantInt::get(offsetTy, offset), commonAlignment(srcAlign, offset), builder);
+      chunks.emplace_back(offset, chunkVal);
+    }
+  }
 
+  for (auto & chunk : chunks) {
+    storeChunk(memInst, chunk.second, ConstantInt::get(offsetTy, chunk.first), commonAlignment(destAlign, chunk.first), builder);
+  }
+}
+
+void
+MemCopyElision::lowerChunkLoop(MemIntrinsic & memInst, LoopInfo & LI) {
+  auto & context = memInst.getContext();
+  auto & block = *memInst.getParent();
+  auto & func = *block.getParent();
+  auto * blockPred = vecInfo.getPredicate(block);
+  auto * len = memInst.getLength();
+  auto * lenTy = cast<IntegerType>(len->getType());
+  auto * lenConst = dyn_cast<ConstantInt>(len);
+
+  const uint64_t chunkBytes = 8;
+  auto * chunkTy = IntegerType::get(context, 8 * chunkBytes);
+  auto * byteTy = IntegerType::get(context, 8);
+  // a constant length may not leave a tail
+  bool hasTail = !lenConst || lenConst->getZExtValue() % chunkBytes != 0;
+
+  // block (br chunk) -> chunk <-> chunk.body -> tail <-> tail.body -> cont (rest of block)
+  auto * contBlock = block.splitBasicBlock(memInst.getIterator(), block.getName() + ".mce.cont");
+  auto * chunkHead = BasicBlock::Create(context, block.getName() + ".mce.chunk", &func, contBlock);
+  auto * chunkBody = BasicBlock::Create(context, block.getName() + ".mce.chunk.body", &func, contBlock);
+  BasicBlock * tailHead = nullptr;
+  BasicBlock * tailBody = nullptr;
+  if (hasTail) {
+    tailHead = BasicBlock::Create(context, block.getName() + ".mce.tail", &func, contBlock);
+    tailBody = BasicBlock::Create(context, block.getName() + ".mce.tail.body", &func, contBlock);
+  }
+  auto & entryBr = *block.getTerminator();
+  entryBr.setSuccessor(0, chunkHead);
+  vecInfo.setVectorShape(entryBr, VectorShape::uni());
+
+  // the loop headers and the continuation run under the predicate of the memset/memcpy
+  if (blockPred) {
+    vecInfo.setPredicate(*contBlock, *blockPred);
+    vecInfo.setPredicate(*chunkHead, *blockPred);
+    if (hasTail) vecInfo.setPredicate(*tailHead, *blockPred);
+  }
+
+  // (br any(pred && inRange), body, exit), the body runs under the length mask
+  auto createLoopTest = [&](IRBuilder<> & builder, ICmpInst * inRange, BasicBlock * body, BasicBlock * exit) {
+    setShape(inRange, getJoinedShape(inRange->getOperand(0), inRange->getOperand(1)));
+    Value * lenMask = inRange;
+    if (blockPred) {
+      lenMask = builder.CreateAnd(blockPred, inRange, "mce.lanes");
+      setShape(lenMask, getJoinedShape(blockPred, inRange));
+    }
+    auto * anyLane = builder.CreateCall(&platInfo.requestRVIntrinsicFunc(RVIntrinsic::Any), lenMask, "mce.any");
+    auto & testBr = *builder.CreateCondBr(anyLane, body, exit);
+    vecInfo.setVectorShape(*anyLane, VectorShape::uni());
+    vecInfo.setVectorShape(testBr, VectorShape::uni());
+    vecInfo.setPredicate(*body, *lenMask);
+  };
+
+// full chunks: off = 0, 8, .. while some lane has a chunk left at off
+  IRBuilder<> chunkHeadBuilder(chunkHead);
+  auto * chunkOffset = chunkHeadBuilder.CreatePHI(lenTy, 2, "mce.off");
+  chunkOffset->addIncoming(ConstantInt::get(lenTy, 0), &block);
+  vecInfo.setVectorShape(*chunkOffset, VectorShape::uni());
+  auto * chunkEnd = chunkHeadBuilder.CreateAdd(chunkOffset, ConstantInt::get(lenTy, chunkBytes), "mce.end");
+  vecInfo.setVectorShape(*chunkEnd, VectorShape::uni());
+  auto * inChunk = cast<ICmpInst>(chunkHeadBuilder.CreateICmpULE(chunkEnd, len, "mce.inchunk"));
+  createLoopTest(chunkHeadBuilder, inChunk, chunkBody, hasTail ? tailHead : contBlock);
+
+  IRBuilder<> chunkBodyBuilder(chunkBody);
+  auto * chunkVal = createChunkValue(memInst, chunkTy, chunkOffset, commonAlignment(GetSourceAlign(memInst).valueOrOne(), chunkBytes), chunkBodyBuilder);
+  storeChunk(memInst, chunkVal, chunkOffset, commonAlignment(memInst.getDestAlign().valueOrOne(), chunkBytes), chunkBodyBuilder);
+  auto * nextChunkOffset = chunkBodyBuilder.CreateAdd(chunkOffset, ConstantInt::get(lenTy, chunkBytes), "mce.off.next");
+  chunkOffset->addIncoming(nextChunkOffset, chunkBody);
+  auto & chunkLatchBr = *chunkBodyBuilder.CreateBr(chunkHead);
+  vecInfo.setVectorShape(*nextChunkOffset, VectorShape::uni());
+  vecInfo.setVectorShape(chunkLatchBr, VectorShape::uni());
+
+// remaining bytes: every lane continues after its last full chunk
+  if (hasTail) {
+    IRBuilder<> entryBuilder(&entryBr);
+    auto * tailStart = entryBuilder.CreateAnd(len, ConstantInt::get(lenTy, ~(chunkBytes - 1)), "mce.tail.start");
+    setShape(tailStart, getJoinedShape(len, nullptr));
+
+    IRBuilder<> tailHeadBuilder(tailHead);
+    auto * tailOffset = tailHeadBuilder.CreatePHI(lenTy, 2, "mce.tail.off");
+    tailOffset->addIncoming(tailStart, chunkHead);
+    vecInfo.setVectorShape(*tailOffset, getJoinedShape(len, nullptr));
+    auto * inTail = cast<ICmpInst>(tailHeadBuilder.CreateICmpULT(tailOffset, len, "mce.intail"));
+    createLoopTest(tailHeadBuilder, inTail, tailBody, contBlock);
+
+    IRBuilder<> tailBodyBuilder(tailBody);
+    auto * byteVal = createChunkValue(memInst, byteTy, tailOffset, Align(1), tailBodyBuilder);
+    storeChunk(memInst, byteVal, tailOffset, Align(1), tailBodyBuilder);
+    auto * nextTailOffset = tailBodyBuilder.CreateAdd(tailOffset, ConstantInt::get(lenTy, 1), "mce.tail.next");
+    tailOffset->addIncoming(nextTailOffset, tailBody);
+    auto & tailLatchBr = *tailBodyBuilder.CreateBr(tailHead);
+    setShape(nextTailOffset, getJoinedShape(len, nullptr));
+    vecInfo.setVectorShape(tailLatchBr, VectorShape::uni());
+  }
+
+// register the blocks with the region and LoopInfo
+  auto * hostLoop = LI.getLoopFor(&block);
+  auto addLoop = [&](BasicBlock * head, BasicBlock * body) {
+    auto * copyLoop = LI.AllocateLoop();
+    if (hostLoop) hostLoop->addChildLoop(copyLoop);
+    else LI.addTopLevelLoop(copyLoop);
+    copyLoop->addBasicBlockToLoop(head, LI); // header first
+    copyLoop->addBasicBlockToLoop(body, LI);
+    vecInfo.getRegion().add(*head);
+    vecInfo.getRegion().add(*body);
+  };
+  addLoop(chunkHead, chunkBody);
+  if (hasTail) addLoop(tailHead, tailBody);
+  if (hostLoop) hostLoop->addBasicBlockToLoop(contBlock, LI);
+  vecInfo.getRegion().add(*contBlock);
+
+  IF_DEBUG_MCE { errs() << "\tlowered to a chunk loop in " << block.getName() << "\n"; }
+}
+
+bool
+MemCopyElision::run() {
   IF_DEBUG_MCE { errs() << "-- memCopy elision log --\n"; }
+
+  // collect first, the chunk loops split the blocks
+  std::vector<MemIntrinsic*> divergentInsts;
   for (auto & BB : vecInfo.getScalarFunction()) {
     if (!vecInfo.inRegion(BB)) continue;
 
     for (auto & Inst : BB) {
-      auto *mcInst = dyn_cast<MemTransferInst>(&Inst);
-      if (!mcInst) continue;
+      auto *memInst = dyn_cast<MemIntrinsic>(&Inst);
+      if (!memInst) continue;
       if (!IsDivergent(Inst)) continue;
-      IF_DEBUG_MCE  { errs() << "Found divergent memcpy: " << *mcInst << "\n"; }
-
-    // analyze eligiblity
-      auto srcVal = mcInst->getSource();
-      auto destVal = mcInst->getDest();
-      auto lenConst = dyn_cast<ConstantInt>(mcInst->getLength());
-      if (!lenConst) {
-        IF_DEBUG_MCE  { errs() << "\tskip: non-constant length!\n"; }
-        continue;
-      }
-      size_t numBytes = lenConst->getZExtValue();
-      auto * srcBase = deriveBase(srcVal, numBytes);
-      auto * destBase = deriveBase(destVal, numBytes);
-      if (!srcBase || !destBase) {
-        IF_DEBUG_MCE  { errs() << "\tskip: could not derive suiteble base pointers!\n"; }
-        continue;
-      }
-
-    // derive a common field-aligned type of both base pointers
-      auto * srcGep = llvm::cast<llvm::GetElementPtrInst>(srcBase);
-      auto * dstGep = llvm::cast<llvm::GetElementPtrInst>(destBase);
-      auto * commonTy = deriveCommonType(srcGep->getSourceElementType(), dstGep->getSourceElementType(), numBytes);
-      if (!commonTy) {
-        IF_DEBUG_MCE  { errs() << "\tskip: could not derive a common base type!\n"; }
-        continue;
-      }
-      IF_DEBUG_MCE  { errs() << "\tskip: common base type: " << *commonTy << "\n"; }
-
-    // all checks passed -> create code
-      IRBuilder<> builder(&BB, Inst.getIterator());
-      auto * srcPtr = createBaseGEP(srcBase, commonTy, builder);
-      auto * destPtr = createBaseGEP(destBase, commonTy, builder);
-      if (!srcPtr || !destPtr) {
-        continue;
-      }
-
-      IF_DEBUG_MCE  { errs() << "OK base gep src: " << *srcPtr << "   " << "base gep dest: " << *destPtr << "\n"; }
-      assert(srcPtr->getType() == destPtr->getType());
-
-      lowerMemCopy(destPtr, srcPtr, commonTy, builder, numBytes);
-
-      killVec.push_back(mcInst);
+      IF_DEBUG_MCE  { errs() << "Found divergent memcpy/memset: " << *memInst << "\n"; }
+      divergentInsts.push_back(memInst);
+    }
+  }
+
+  auto & LI = *FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction());
+  std::vector<Instruction*> killVec;
+  bool changedCFG = false;
+  for (auto * memInst : divergentInsts) {
+    if (memInst->isVolatile()) {
+      IF_DEBUG_MCE  { errs() << "\tskip: volatile!\n"; }
+      continue;
+    }
+
+    // field-wise copy with the common type of source and dest
+    auto * mcInst = dyn_cast<MemTransferInst>(memInst);
+    auto lenConst = dyn_cast<ConstantInt>(memInst->getLength());
+    if (mcInst && lenConst && lowerTypedCopy(*mcInst, lenConst->getZExtValue())) {
+      killVec.push_back(memInst);
+      continue;
     }
+
+    // small constant size: straight-line chunks
+    if (lenConst && lenConst->getZExtValue() <= MaxUnrolledBytes) {
+      IRBuilder<> builder(memInst);
+      lowerChunked(*memInst, lenConst->getZExtValue(), builder);
+      killVec.push_back(memInst);
+      continue;
+    }
+
+    // the chunk loop copies forward
+    if (isa<MemMoveInst>(memInst)) {
+      IF_DEBUG_MCE  { errs() << "\tskip: memmove of varying or large size!\n"; }
+      continue;
+    }
+
+    lowerChunkLoop(*memInst, LI);
+    killVec.push_back(memInst);
+    changedCFG = true;
   }
   IF_DEBUG_MCE { errs() << "-- end of memCopy elision log --\n"; }
 
@@ -199,5 +431,13 @@ MemCopyElision::run() {
     mcInst->eraseFromParent();
   }
 
+  // LoopInfo is up to date
+  if (changedCFG) {
+    auto PA = PreservedAnalyses::all();
+    PA.abandon<DominatorTreeAnalysis>();
+    PA.abandon<PostDominatorTreeAnalysis>();
+    FAM.invalidate(vecInfo.getScalarFunction(), PA);
+  }
+
   return changed;
 }
@@ -0,0 +1,306 @@
+//===- src/transform/narrowIdioms.cpp - saturating and averaging idioms on narrow integers --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/narrowIdioms.h"
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/PatternMatch.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <rvConfig.h>
+#include "report.h"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+#if 1
+#define IF_DEBUG_NI IF_DEBUG
+#else
+#define IF_DEBUG_NI if (false)
+#endif
+
+namespace rv {
+
+namespace {
+
+// clamp(x, lo, hi) over the signed value range [vmin, vmax] of x (all values fit in int64_t: wide types have at most
+// 64 bits, narrow types at most 32 bits)
+struct Clamp {
+  int64_t lo = std::numeric_limits<int64_t>::min();
+  int64_t hi = std::numeric_limits<int64_t>::max();
+
+  // the bounds that take effect on [vmin, vmax], false if the clamp is constant on it
+  bool restrict(int64_t vmin, int64_t vmax) {
+    if (lo > vmax || hi < vmin) return false;
+    lo = std::max(lo, vmin);
+    hi = std::min(hi, vmax);
+    return true;
+  }
+};
+
+}
+
+// the bit width of the integer type @ty
+static unsigned
+GetBits(const Type & ty) {
+  return ty.getIntegerBitWidth();
+}
+
+// the signed value range of the @bits bit integer type
+static int64_t MinSigned(unsigned bits) { return -(int64_t(1) << (bits - 1)); }
+static int64_t MaxSigned(unsigned bits) { return (int64_t(1) << (bits - 1)) - 1; }
+static int64_t MaxUnsigned(unsigned bits) { return (int64_t(1) << bits) - 1; }
+
+// peel the single-use smin/smax/umin/umax layers with constant bounds off @val and compose them into @clamp.
+// Returns the clamped value, nullptr if there is no layer. umin/umax only agree with smin/smax on non-negative values:
+// @needsNonNeg is set if there is one, the caller has to make sure that the clamped value is non-negative (all bounds
+// are then).
+static Value *
+PeelClamp(Value & val, Clamp & clamp, bool & needsNonNeg) {
+  std::vector<std::pair<bool, int64_t>> layers; // (isMax, bound), outermost first
+  bool hasNegBound = false;
+  needsNonNeg = false;
+  Value * runner = &val;
+  while (runner->hasOneUse()) {
+    Value * inner;
+    const APInt * C;
+    bool isMax, isUnsigned;
+    if (match(runner, m_SMax(m_Value(inner), m_APInt(C)))) { isMax = true; isUnsigned = false; }
+    else if (match(runner, m_SMin(m_Value(inner), m_APInt(C)))) { isMax = false; isUnsigned = false; }
+    else if (match(runner, m_UMax(m_Value(inner), m_APInt(C)))) { isMax = true; isUnsigned = true; }
+    else if (match(runner, m_UMin(m_Value(inner), m_APInt(C)))) { isMax = false; isUnsigned = true; }
+    else break;
+
+    needsNonNeg |= isUnsigned;
+    hasNegBound |= C->isNegative();
+    layers.emplace_back(isMax, C->getSExtValue());
+    runner = inner;
+  }
+  if (layers.empty() || (needsNonNeg && hasNegBound)) return nullptr;
+
+  // compose the layers from the inside out (min and max with constants compose to a clamp)
+  for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+    if (it->first) {
+      clamp.lo = std::max(clamp.lo, it->second);
+      clamp.hi = std::max(clamp.hi, it->second);
+    } else {
+      clamp.lo = std::min(clamp.lo, it->second);
+      clamp.hi = std::min(clamp.hi, it->second);
+    }
+  }
+  return runner;
+}
+
+// the narrow value that @val extends to the wide type (@isSigned tells sext from zext), nullptr if it is no extension
+static Value *
+MatchExt(Value & val, bool & isSigned) {
+  if (isa<ZExtInst>(val)) { isSigned = false; return cast<Instruction>(val).getOperand(0); }
+  if (isa<SExtInst>(val)) { isSigned = true; return cast<Instruction>(val).getOperand(0); }
+  return nullptr;
+}
+
+// the narrow operands @narrowA, @narrowB of a wide operation on @A and @B: extensions of the same kind of @narrowTy
+// values or one extension and a constant that fits @narrowTy
+static bool
+MatchExtPair(Value & A, Value & B, Type & narrowTy, Value *& narrowA, Value *& narrowB, bool & isSigned) {
+  bool signedA = false, signedB = false;
+  narrowA = MatchExt(A, signedA);
+  narrowB = MatchExt(B, signedB);
+  if (narrowA && narrowA->getType() != &narrowTy) narrowA = nullptr;
+  if (narrowB && narrowB->getType() != &narrowTy) narrowB = nullptr;
+  if (narrowA && narrowB) {
+    isSigned = signedA;
+    return signedA == signedB;
+  }
+  if (!narrowA && !narrowB) return false;
+
+  isSigned = narrowA ? signedA : signedB;
+  auto * constVal = dyn_cast<ConstantInt>(narrowA ? &B : &A);
+  if (!constVal) return false;
+  const unsigned bits = GetBits(narrowTy);
+  const auto & C = constVal->getValue();
+  if (isSigned ? !C.isSignedIntN(bits) : !C.isIntN(bits)) return false;
+  auto * narrowConst = ConstantInt::get(&narrowTy, C.trunc(bits));
+  if (narrowA) narrowB = narrowConst;
+  else narrowA = narrowConst;
+  return true;
+}
+
+// trunc(clamp(ext a +- ext b, MIN, MAX)) -> [us]{add,sub}.sat(a, b)
+static Value *
+FoldSaturatingArith(IRBuilder<> & builder, TruncInst & trunc) {
+  auto & narrowTy = *trunc.getType();
+  const unsigned M = GetBits(narrowTy);
+
+  Clamp clamp;
+  bool needsNonNeg;
+  auto * clamped = PeelClamp(*trunc.getOperand(0), clamp, needsNonNeg);
+  if (!clamped) return nullptr;
+
+  auto * binOp = dyn_cast<BinaryOperator>(clamped);
+  if (!binOp || (binOp->getOpcode() != Instruction::Add && binOp->getOpcode() != Instruction::Sub)) return nullptr;
+  bool isAdd = binOp->getOpcode() == Instruction::Add;
+  Value * narrowA, * narrowB;
+  bool isSigned;
+  if (!MatchExtPair(*binOp->getOperand(0), *binOp->getOperand(1), narrowTy, narrowA, narrowB, isSigned)) return nullptr;
+
+  // value range of the wide operation (it does not wrap since the wide type has at least one more bit)
+  int64_t vmin, vmax;
+  if (isSigned) {
+    vmin = isAdd ? 2 * MinSigned(M) : MinSigned(M) - MaxSigned(M);
+    vmax = isAdd ? 2 * MaxSigned(M) : MaxSigned(M) - MinSigned(M);
+  } else {
+    vmin = isAdd ? 0 : -MaxUnsigned(M);
+    vmax = isAdd ? 2 * MaxUnsigned(M) : MaxUnsigned(M);
+  }
+  if (needsNonNeg && vmin < 0) return nullptr;
+
+  // the clamp has to saturate to exactly the narrow range
+  Clamp satRange;
+  satRange.lo = isSigned ? MinSigned(M) : 0;
+  satRange.hi = isSigned ? MaxSigned(M) : MaxUnsigned(M);
+  if (!clamp.restrict(vmin, vmax) || !satRange.restrict(vmin, vmax)) return nullptr;
+  if (clamp.lo != satRange.lo || clamp.hi != satRange.hi) return nullptr;
+
+  Intrinsic::ID id;
+  if (isAdd) id = isSigned ? Intrinsic::sadd_sat : Intrinsic::uadd_sat;
+  else id = isSigned ? Intrinsic::ssub_sat : Intrinsic::usub_sat;
+  return builder.CreateBinaryIntrinsic(id, narrowA, narrowB, nullptr, trunc.getName());
+}
+
+// trunc((ext a + ext b [+ 1]) >> 1) -> (a | b) - ((a ^ b) >> 1), (a & b) + ((a ^ b) >> 1)
+static Value *
+FoldAverage(IRBuilder<> & builder, TruncInst & trunc) {
+  auto & narrowTy = *trunc.getType();
+
+  // the low bits of lshr and ashr agree below the top bit of the wide type
+  Value * sum;
+  auto * shift = trunc.getOperand(0);
+  if (!shift->hasOneUse()) return nullptr;
+  if (!match(shift, m_LShr(m_Value(sum), m_One())) && !match(shift, m_AShr(m_Value(sum), m_One()))) return nullptr;
+  if (!sum->hasOneUse()) return nullptr;
+
+  // the terms of the sum: two extensions and an optional rounding 1
+  SmallVector<Value*, 3> terms;
+  Value * X, * Y;
+  if (!match(sum, m_Add(m_Value(X), m_Value(Y)))) return nullptr;
+  for (auto * op : {X, Y}) {
+    Value * P, * Q;
+    if (op->hasOneUse() && match(op, m_Add(m_Value(P), m_Value(Q)))) {
+      terms.push_back(P);
+      terms.push_back(Q);
+    } else {
+      terms.push_back(op);
+    }
+  }
+
+  auto itOne = std::find_if(terms.begin(), terms.end(), [](Value * term) { return match(term, m_One()); });
+  bool roundUp = itOne != terms.end();
+  if (roundUp) terms.erase(itOne);
+  if (terms.size() != 2) return nullptr;
+
+  Value * narrowA, * narrowB;
+  bool isSigned;
+  if (!MatchExtPair(*terms[0], *terms[1], narrowTy, narrowA, narrowB, isSigned)) return nullptr;
+  if (isa<Constant>(narrowA) || isa<Constant>(narrowB)) return nullptr;
+
+  // a + b = 2 (a & b) + (a ^ b) = (a | b) + (a & b)
+  auto * diffBits = builder.CreateXor(narrowA, narrowB, "avg.x");
+  auto * halfDiff = isSigned ? builder.CreateAShr(diffBits, 1, "avg.h") : builder.CreateLShr(diffBits, 1, "avg.h");
+  if (roundUp) return builder.CreateSub(builder.CreateOr(narrowA, narrowB, "avg.o"), halfDiff, trunc.getName());
+  return builder.CreateAdd(builder.CreateAnd(narrowA, narrowB, "avg.a"), halfDiff, trunc.getName());
+}
+
+// trunc(clamp(ext x, lo, hi)) -> trunc(clamp(x, lo, hi)) for an x between the narrow and the wide type
+static Value *
+FoldSaturatingNarrow(IRBuilder<> & builder, TruncInst & trunc) {
+  const unsigned M = GetBits(*trunc.getType());
+
+  Clamp clamp;
+  bool needsNonNeg;
+  auto * clamped = PeelClamp(*trunc.getOperand(0), clamp, needsNonNeg);
+  if (!clamped) return nullptr;
+
+  bool isSigned;
+  auto * x = MatchExt(*clamped, isSigned);
+  if (!x || !x->getType()->isIntegerTy()) return nullptr;
+  const unsigned K = GetBits(*x->getType());
+  if (K <= M) return nullptr;
+
+  int64_t vmin = isSigned ? MinSigned(K) : 0;
+  int64_t vmax = isSigned ? MaxSigned(K) : MaxUnsigned(K);
+  if (needsNonNeg && vmin < 0) return nullptr;
+  if (!clamp.restrict(vmin, vmax)) return nullptr;
+
+  // bounds in the range of x (unsigned for zext)
+  auto & xTy = *x->getType();
+  Value * narrowClamp = x;
+  if (clamp.hi < vmax) {
+    narrowClamp = builder.CreateBinaryIntrinsic(isSigned ? Intrinsic::smin : Intrinsic::umin, narrowClamp,
+                                                ConstantInt::get(&xTy, clamp.hi, isSigned), nullptr, "sat.hi");
+  }
+  if (clamp.lo > vmin) {
+    narrowClamp = builder.CreateBinaryIntrinsic(isSigned ? Intrinsic::smax : Intrinsic::umax, narrowClamp,
+                                                ConstantInt::get(&xTy, clamp.lo, isSigned), nullptr, "sat.lo");
+  }
+  if (narrowClamp == x) return nullptr; // trunc(ext x) is up to instcombine
+  return builder.CreateTrunc(narrowClamp, trunc.getType(), trunc.getName());
+}
+
+bool
+FoldNarrowIdiom(TruncInst & trunc) {
+  auto * narrowTy = trunc.getType();
+  auto * wideTy = trunc.getSrcTy();
+  if (!narrowTy->isIntegerTy() || !wideTy->isIntegerTy()) return false;
+  if (GetBits(*narrowTy) < 2 || GetBits(*narrowTy) > 32 || GetBits(*wideTy) > 64) return false;
+
+  IRBuilder<> builder(&trunc);
+  Value * narrowVal = FoldSaturatingArith(builder, trunc);
+  if (!narrowVal) narrowVal = FoldAverage(builder, trunc);
+  if (!narrowVal) narrowVal = FoldSaturatingNarrow(builder, trunc);
+  if (!narrowVal) return false;
+
+  IF_DEBUG_NI { errs() << "narrowIdioms: " << trunc << " -> " << *narrowVal << "\n"; }
+
+  trunc.replaceAllUsesWith(narrowVal);
+  RecursivelyDeleteTriviallyDeadInstructions(&trunc);
+  return true;
+}
+
+unsigned
+FoldNarrowIdioms(Function & func, const LoopInfo * loopInfo) {
+  std::vector<WeakTrackingVH> truncs;
+  for (auto & block : func) {
+    if (loopInfo && !loopInfo->getLoopFor(&block)) continue;
+    for (auto & inst : block) {
+      if (isa<TruncInst>(inst)) truncs.emplace_back(&inst);
+    }
+  }
+
+  // folding deletes the dead wide operations, with them truncs of narrower values that only they used
+  unsigned numFolded = 0;
+  for (auto & truncHandle : truncs) {
+    auto * trunc = dyn_cast_or_null<TruncInst>(truncHandle);
+    if (trunc && FoldNarrowIdiom(*trunc)) ++numFolded;
+  }
+
+  if (numFolded > 0) {
+    Report() << "narrowIdioms: folded " << numFolded << " saturating/averaging idioms in " << func.getName() << "\n";
+  }
+  return numFolded;
+}
+
+} // namespace rv
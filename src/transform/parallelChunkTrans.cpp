@@ -0,0 +1,338 @@
+//===- src/transform/parallelChunkTrans.cpp - thread chunks of parallel loops --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/parallelChunkTrans.h"
+
+#include <llvm/ADT/SetVector.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/CodeExtractor.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+
+#include "rvConfig.h"
+
+#if 1
+#define IF_DEBUG_CHUNK IF_DEBUG
+#else
+#define IF_DEBUG_CHUNK if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+// the affine recurrence of \p V in \p L (nullptr if there is none we can expand)
+static const SCEVAddRecExpr *
+GetAffineRecurrence(Loop & L, Value & V, ScalarEvolution & SE) {
+  auto * rec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&V));
+  if (!rec || rec->getLoop() != &L || !rec->isAffine()) return nullptr;
+  if (!isSafeToExpand(rec->getStart(), SE) || !isSafeToExpand(rec->getStepRecurrence(SE), SE)) return nullptr;
+  return rec;
+}
+
+// the operand of the exit condition of \p L that varies with the iterations (nullptr if not affine)
+static Value *
+GetExitOperand(Loop & L, ScalarEvolution & SE) {
+  auto * latchBr = dyn_cast<BranchInst>(L.getLoopLatch()->getTerminator());
+  if (!latchBr || !latchBr->isConditional()) return nullptr;
+  auto * cmp = dyn_cast<ICmpInst>(latchBr->getCondition());
+  if (!cmp || !cmp->hasOneUse()) return nullptr;
+
+  for (int i = 0; i < 2; ++i) {
+    auto * op = cmp->getOperand(i);
+    if (L.isLoopInvariant(cmp->getOperand(1 - i)) && GetAffineRecurrence(L, *op, SE)) return op;
+  }
+  return nullptr;
+}
+
+bool
+ParallelChunkTransform::canTransform(Loop & L, const char *& reason) const {
+  auto * latch = L.getLoopLatch();
+  if (L.getParentLoop()) {
+    reason = "only outermost loops run in thread chunks";
+    return false;
+  }
+  if (!L.getLoopPreheader() || !latch || L.getExitingBlock() != latch || !L.getExitBlock()) {
+    reason = "the loop has several exits";
+    return false;
+  }
+
+  auto * backedgeCount = SE.getBackedgeTakenCount(&L);
+  if (isa<SCEVCouldNotCompute>(backedgeCount) || !isSafeToExpand(backedgeCount, SE)) {
+    reason = "the trip count is not computable";
+    return false;
+  }
+
+  // every chunk starts from the closed form of the header phis
+  for (auto & phi : L.getHeader()->phis()) {
+    if (!GetAffineRecurrence(L, phi, SE)) {
+      reason = "a loop-carried value is not an affine recurrence";
+      return false;
+    }
+  }
+  if (!GetExitOperand(L, SE)) {
+    reason = "the exit condition is not an affine comparison";
+    return false;
+  }
+
+  // chunks run concurrently, nothing may flow out of them
+  for (auto * block : L.blocks()) {
+    for (auto & inst : *block) {
+      for (auto * user : inst.users()) {
+        auto * userInst = dyn_cast<Instruction>(user);
+        if (!userInst || !L.contains(userInst->getParent())) {
+          reason = "the loop has live-out values";
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// \p rec after \p iter iterations, \p start and \p step are the expanded parts of \p rec
+static Value *
+EvaluateAtIteration(IRBuilder<> & builder, Value * start, Value * step, Value * iter, const Twine & name) {
+  auto * offset = builder.CreateMul(builder.CreateZExtOrTrunc(iter, step->getType()), step);
+  if (start->getType()->isPointerTy()) {
+    return builder.CreateGEP(builder.getInt8Ty(), start, offset, name);
+  }
+  return builder.CreateAdd(start, offset, name);
+}
+
+ChunkLoop
+ParallelChunkTransform::run(Loop & L, uint64_t chunkSize) {
+  auto * preHeader = L.getLoopPreheader();
+  auto * header = L.getHeader();
+  auto * latch = L.getLoopLatch();
+  auto * exitBlock = L.getExitBlock();
+  auto & ctx = F.getContext();
+  const DataLayout & DL = F.getParent()->getDataLayout();
+
+  // expand everything that needs SCEV before the CFG changes
+  auto * preHeaderTerm = preHeader->getTerminator();
+  SCEVExpander expander(SE, DL, "rv.chunk");
+  auto * backedgeCount = SE.getBackedgeTakenCount(&L);
+  auto * countTy = backedgeCount->getType();
+  auto * lastIter = expander.expandCodeFor(backedgeCount, countTy, preHeaderTerm);
+
+  struct Recurrence { Value * start; Value * step; };
+  auto expandRecurrence = [&](Value & V) {
+    auto * rec = GetAffineRecurrence(L, V, SE);
+    auto * stepTy = SE.getEffectiveSCEVType(V.getType());
+    return Recurrence{expander.expandCodeFor(rec->getStart(), V.getType(), preHeaderTerm),
+                      expander.expandCodeFor(rec->getStepRecurrence(SE), stepTy, preHeaderTerm)};
+  };
+  SmallVector<std::pair<PHINode*, Recurrence>, 4> phiRecs;
+  for (auto & phi : header->phis()) {
+    phiRecs.emplace_back(&phi, expandRecurrence(phi));
+  }
+  auto * exitOp = GetExitOperand(L, SE);
+  Recurrence exitRec = expandRecurrence(*exitOp);
+
+  IRBuilder<> builder(preHeaderTerm);
+  auto * chunkSizeVal = ConstantInt::get(countTy, chunkSize);
+  auto * numChunks = builder.CreateAdd(builder.CreateUDiv(lastIter, chunkSizeVal), ConstantInt::get(countTy, 1), "chunk.num");
+
+  auto * chunkHeader = BasicBlock::Create(ctx, "rv.chunk.header", &F, header);
+  auto * chunkBody = BasicBlock::Create(ctx, "rv.chunk.body", &F, header);
+  auto * chunkLatch = BasicBlock::Create(ctx, "rv.chunk.latch", &F, exitBlock);
+  preHeaderTerm->replaceUsesOfWith(header, chunkHeader);
+
+  IRBuilder<> headerBuilder(chunkHeader);
+  auto * chunkIdx = headerBuilder.CreatePHI(countTy, 2, "chunk.idx");
+  headerBuilder.CreateBr(chunkBody);
+
+  // first and last iteration of the chunk, the last chunk stops at the trip count
+  IRBuilder<> bodyBuilder(chunkBody);
+  auto * firstIter = bodyBuilder.CreateMul(chunkIdx, chunkSizeVal, "chunk.first", true, true);
+  auto * leftIters = bodyBuilder.CreateSub(lastIter, firstIter, "chunk.left");
+  auto * lastOffset = bodyBuilder.CreateSelect(bodyBuilder.CreateICmpULT(leftIters, ConstantInt::get(countTy, chunkSize - 1)),
+                                               leftIters, ConstantInt::get(countTy, chunkSize - 1));
+  auto * chunkLast = bodyBuilder.CreateAdd(firstIter, lastOffset, "chunk.last", true, true);
+  for (auto & it : phiRecs) {
+    auto * phi = it.first;
+    auto * chunkStart = EvaluateAtIteration(bodyBuilder, it.second.start, it.second.step, firstIter, phi->getName() + ".chunk");
+    int preIdx = phi->getBasicBlockIndex(preHeader);
+    phi->setIncomingBlock(preIdx, chunkBody);
+    phi->setIncomingValue(preIdx, chunkStart);
+  }
+  auto * exitValue = EvaluateAtIteration(bodyBuilder, exitRec.start, exitRec.step, chunkLast, "chunk.exit");
+  bodyBuilder.CreateBr(header);
+
+  // leave the loop exactly after the last iteration of the chunk
+  auto * latchBr = cast<BranchInst>(latch->getTerminator());
+  auto * oldCmp = cast<ICmpInst>(latchBr->getCondition());
+  bool exitOnTrue = !L.contains(latchBr->getSuccessor(0));
+  IRBuilder<> latchBuilder(latchBr);
+  auto * exitCmp = latchBuilder.CreateICmp(exitOnTrue ? ICmpInst::ICMP_EQ : ICmpInst::ICMP_NE, exitOp, exitValue, "chunk.cond");
+  latchBr->setCondition(exitCmp);
+  if (oldCmp->use_empty()) oldCmp->eraseFromParent();
+
+  latchBr->replaceUsesOfWith(exitBlock, chunkLatch);
+  for (auto & phi : exitBlock->phis()) {
+    phi.replaceIncomingBlockWith(latch, chunkLatch);
+  }
+
+  IRBuilder<> chunkLatchBuilder(chunkLatch);
+  auto * nextIdx = chunkLatchBuilder.CreateAdd(chunkIdx, ConstantInt::get(countTy, 1), "chunk.idx.next", true, true);
+  chunkLatchBuilder.CreateCondBr(chunkLatchBuilder.CreateICmpULT(nextIdx, numChunks), chunkHeader, exitBlock);
+  chunkIdx->addIncoming(ConstantInt::get(countTy, 0), preHeader);
+  chunkIdx->addIncoming(nextIdx, chunkLatch);
+
+  IF_DEBUG_CHUNK { errs() << "parallelChunk: " << L.getName() << " in chunks of " << chunkSize << " iterations\n"; }
+
+  ChunkLoop chunkLoop;
+  chunkLoop.header = chunkHeader;
+  chunkLoop.latch = chunkLatch;
+  chunkLoop.chunkIdx = chunkIdx;
+  chunkLoop.numChunks = numChunks;
+  chunkLoop.chunkSize = chunkSize;
+  return chunkLoop;
+}
+
+// mark the loop of \p latchBr as vectorized (the chunk loop of a task)
+static void
+MarkVectorized(BranchInst & latchBr) {
+  auto & ctx = latchBr.getContext();
+  Metadata * isVectorized[] = { MDString::get(ctx, "llvm.loop.isvectorized"),
+                                ConstantAsMetadata::get(ConstantInt::getTrue(ctx)) };
+  Metadata * loopArgs[] = { nullptr, MDNode::get(ctx, isVectorized) };
+  auto * loopID = MDNode::getDistinct(ctx, loopArgs);
+  loopID->replaceOperandWith(0, loopID);
+  latchBr.setMetadata(LLVMContext::MD_loop, loopID);
+}
+
+bool
+ParallelChunkTransform::outlineTask(Function & F, ChunkLoop & CL, StringRef runtimeName) {
+  auto & ctx = F.getContext();
+  auto & M = *F.getParent();
+
+  // the chunk body: everything between the chunk header and latch (the vectorized loop and its remainder)
+  auto * bodyEntry = CL.header->getSingleSuccessor();
+  SetVector<BasicBlock*> bodyBlocks;
+  SmallVector<BasicBlock*, 16> stack{bodyEntry};
+  while (!stack.empty()) {
+    auto * block = stack.pop_back_val();
+    if (block == CL.latch || !bodyBlocks.insert(block)) continue;
+    if (block == CL.header) return false;
+    for (auto * succ : successors(block)) stack.push_back(succ);
+  }
+
+  DominatorTree DT(F);
+  CodeExtractorAnalysisCache CEAC(F);
+  CodeExtractor CE(bodyBlocks.getArrayRef(), &DT, false, nullptr, nullptr, nullptr, false, false, nullptr, "rv.chunk");
+  if (!CE.isEligible()) return false;
+  SetVector<Value*> inputs, outputs, sinks;
+  CE.findInputsOutputs(inputs, outputs, sinks);
+  if (!outputs.empty()) return false;
+
+  auto * bodyFn = CE.extractCodeRegion(CEAC);
+  if (!bodyFn) return false;
+  assert(bodyFn->hasOneUse());
+  auto * bodyCall = cast<CallInst>(bodyFn->user_back());
+
+  // everything but the chunk index goes through the context struct
+  SmallVector<Value*, 8> captured;
+  SmallVector<Type*, 8> capturedTys;
+  for (auto & arg : bodyCall->args()) {
+    if (arg.get() == CL.chunkIdx) continue;
+    captured.push_back(arg.get());
+    capturedTys.push_back(arg->getType());
+  }
+  auto * ctxTy = StructType::create(ctx, capturedTys, (F.getName() + ".rv.chunk.ctx").str());
+
+  // void task(ptr ctx, i64 first, i64 last)
+  auto * ptrTy = PointerType::get(ctx, 0);
+  auto * i64Ty = Type::getInt64Ty(ctx);
+  auto * taskTy = FunctionType::get(Type::getVoidTy(ctx), {ptrTy, i64Ty, i64Ty}, false);
+  auto * taskFn = Function::Create(taskTy, GlobalValue::InternalLinkage, F.getName() + ".rv.chunks", M);
+  // same target features as F, the chunk body carries its vector code
+  taskFn->setAttributes(AttributeList::get(ctx, F.getAttributes().getFnAttrs(), AttributeSet(), {}));
+  auto * ctxArg = taskFn->getArg(0);
+  auto * taskEntry = BasicBlock::Create(ctx, "entry", taskFn);
+  auto * taskLoop = BasicBlock::Create(ctx, "chunks", taskFn);
+  auto * taskExit = BasicBlock::Create(ctx, "exit", taskFn);
+
+  IRBuilder<> entryBuilder(taskEntry);
+  SmallVector<Value*, 8> loaded;
+  for (size_t i = 0; i < captured.size(); ++i) {
+    auto * fieldPtr = entryBuilder.CreateStructGEP(ctxTy, ctxArg, i);
+    loaded.push_back(entryBuilder.CreateLoad(capturedTys[i], fieldPtr, captured[i]->getName()));
+  }
+  auto * idxTy = CL.chunkIdx->getType();
+  auto * first = entryBuilder.CreateTrunc(taskFn->getArg(1), idxTy, "first");
+  auto * last = entryBuilder.CreateTrunc(taskFn->getArg(2), idxTy, "last");
+  entryBuilder.CreateBr(taskLoop);
+
+  IRBuilder<> loopBuilder(taskLoop);
+  auto * idx = loopBuilder.CreatePHI(idxTy, 2, "chunk.idx");
+  SmallVector<Value*, 8> callArgs;
+  size_t nextCaptured = 0;
+  for (auto & arg : bodyCall->args()) {
+    callArgs.push_back(arg.get() == CL.chunkIdx ? idx : loaded[nextCaptured++]);
+  }
+  auto * taskCall = loopBuilder.CreateCall(bodyFn, callArgs);
+  auto * nextIdx = loopBuilder.CreateAdd(idx, ConstantInt::get(idxTy, 1), "chunk.idx.next", true, true);
+  auto * loopBr = loopBuilder.CreateCondBr(loopBuilder.CreateICmpULT(nextIdx, last), taskLoop, taskExit);
+  MarkVectorized(*loopBr);
+  idx->addIncoming(first, taskEntry);
+  idx->addIncoming(nextIdx, taskLoop);
+  ReturnInst::Create(ctx, taskExit);
+
+  InlineFunctionInfo IFI;
+  auto res = InlineFunction(*taskCall, IFI);
+  (void) res;
+  assert(res.isSuccess() && "could not inline the chunk body");
+  bodyFn->eraseFromParent();
+
+  // replace the chunk loop by the runtime call
+  BasicBlock * preHeader = nullptr;
+  for (auto * pred : predecessors(CL.header)) {
+    if (pred != CL.latch) preHeader = pred;
+  }
+  BasicBlock * exitBlock = nullptr;
+  for (auto * succ : successors(CL.latch)) {
+    if (succ != CL.header) exitBlock = succ;
+  }
+  assert(preHeader && exitBlock);
+
+  IRBuilder<> allocaBuilder(&*F.getEntryBlock().getFirstInsertionPt());
+  auto * ctxAlloca = allocaBuilder.CreateAlloca(ctxTy, nullptr, "chunk.ctx");
+  auto * preHeaderTerm = preHeader->getTerminator();
+  IRBuilder<> builder(preHeaderTerm);
+  for (size_t i = 0; i < captured.size(); ++i) {
+    builder.CreateStore(captured[i], builder.CreateStructGEP(ctxTy, ctxAlloca, i));
+  }
+  auto runtimeFn = M.getOrInsertFunction(runtimeName, Type::getVoidTy(ctx), ptrTy, ptrTy, i64Ty);
+  builder.CreateCall(runtimeFn, {taskFn, ctxAlloca, builder.CreateZExtOrTrunc(CL.numChunks, i64Ty)});
+  preHeaderTerm->replaceUsesOfWith(CL.header, exitBlock);
+  for (auto & phi : exitBlock->phis()) {
+    phi.replaceIncomingBlockWith(CL.latch, preHeader);
+  }
+
+  BasicBlock * deadBlocks[] = {CL.header, bodyCall->getParent(), CL.latch};
+  for (auto * block : deadBlocks) block->dropAllReferences();
+  for (auto * block : deadBlocks) block->eraseFromParent();
+
+  IF_DEBUG_CHUNK { errs() << "parallelChunk: outlined task " << taskFn->getName() << "\n"; }
+  CL = ChunkLoop();
+  return true;
+}
+
+} // namespace rv
@@ -0,0 +1,269 @@
+//===- src/transform/promoteAllocas.cpp - promote small varying arrays to registers  --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Transforms/Utils/SSAUpdater.h>
+
+#include <rv/transform/promoteAllocas.h>
+#include <rv/vectorizationInfo.h>
+
+#include <rvConfig.h>
+#include "report.h"
+
+#include <memory>
+
+using namespace llvm;
+
+#if 1
+#define IF_DEBUG_PA IF_DEBUG
+#else
+#define IF_DEBUG_PA if (false)
+#endif
+
+namespace rv {
+
+// every access costs one select per element
+static const unsigned MaxPromotedElements = 8;
+
+PromoteAllocas::PromoteAllocas(VectorizationInfo & _vecInfo)
+  : vecInfo(_vecInfo)
+{}
+
+bool
+PromoteAllocas::collectAccesses(AllocaInst & allocaInst, SmallVectorImpl<ElemAccess> & accesses,
+                                SmallVectorImpl<Instruction*> & deadInsts) const {
+  auto * arrTy = dyn_cast<ArrayType>(allocaInst.getAllocatedType());
+  if (!arrTy || allocaInst.isArrayAllocation() || arrTy->getNumElements() == 0 ||
+      arrTy->getNumElements() > MaxPromotedElements) {
+    return false;
+  }
+  auto * elemTy = arrTy->getElementType();
+  if (!elemTy->isIntegerTy() && !elemTy->isFloatingPointTy()) return false;
+
+  // (pointer, element index) pairs, only geps on the alloca itself are supported
+  auto * zeroIdx = ConstantInt::get(Type::getInt64Ty(allocaInst.getContext()), 0);
+  SmallVector<std::pair<Value*, Value*>, 8> ptrs;
+  ptrs.emplace_back(&allocaInst, zeroIdx);
+
+  while (!ptrs.empty()) {
+    auto * ptr = ptrs.back().first;
+    auto * elemIdx = ptrs.back().second;
+    ptrs.pop_back();
+
+    for (auto * user : ptr->users()) {
+      auto * inst = dyn_cast<Instruction>(user);
+      if (!inst || !vecInfo.inRegion(*inst)) {
+        IF_DEBUG_PA { errs() << "skip: use outside of the region\n"; }
+        return false;
+      }
+
+      if (auto * load = dyn_cast<LoadInst>(inst)) {
+        if (!load->isSimple() || load->getType() != elemTy) return false;
+        accesses.push_back({inst, elemIdx});
+
+      } else if (auto * store = dyn_cast<StoreInst>(inst)) {
+        if (!store->isSimple() || store->getPointerOperand() != ptr ||
+            store->getValueOperand()->getType() != elemTy) {
+          IF_DEBUG_PA { errs() << "skip: escaping or mistyped store " << *store << "\n"; }
+          return false;
+        }
+        accesses.push_back({inst, elemIdx});
+
+      } else if (auto * gep = dyn_cast<GetElementPtrInst>(inst)) {
+        if (ptr != &allocaInst) return false;
+
+        Value * gepIdx = nullptr;
+        if (gep->getSourceElementType() == arrTy && gep->getNumIndices() == 2) {
+          auto * firstIdx = dyn_cast<ConstantInt>(gep->getOperand(1));
+          if (!firstIdx || !firstIdx->isZero()) return false;
+          gepIdx = gep->getOperand(2);
+        } else if (gep->getSourceElementType() == elemTy && gep->getNumIndices() == 1) {
+          gepIdx = gep->getOperand(1);
+        } else {
+          IF_DEBUG_PA { errs() << "skip: non-element gep " << *gep << "\n"; }
+          return false;
+        }
+        ptrs.emplace_back(gep, gepIdx);
+        deadInsts.push_back(gep);
+
+      } else if (isa<DbgInfoIntrinsic>(inst) ||
+                 (isa<IntrinsicInst>(inst) && cast<IntrinsicInst>(inst)->isLifetimeStartOrEnd())) {
+        deadInsts.push_back(inst);
+
+      } else {
+        IF_DEBUG_PA { errs() << "skip: unsupported use " << *inst << "\n"; }
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+Value *
+PromoteAllocas::createElemMatch(IRBuilder<> & builder, Value * elemIdx, unsigned k) {
+  auto * match = builder.CreateICmpEQ(elemIdx, ConstantInt::get(elemIdx->getType(), k), "promote.match");
+  vecInfo.setVectorShape(*match, vecInfo.getVectorShape(*elemIdx).isUniform() ? VectorShape::uni() : VectorShape::varying());
+  return match;
+}
+
+void
+PromoteAllocas::promote(AllocaInst & allocaInst, ArrayRef<ElemAccess> accesses) {
+  auto * arrTy = cast<ArrayType>(allocaInst.getAllocatedType());
+  auto * elemTy = arrTy->getElementType();
+  unsigned numElems = arrTy->getNumElements();
+  auto varShape = VectorShape::varying();
+
+  // one SSA variable per array element
+  SmallVector<PHINode*, 16> insertedPhis;
+  SmallVector<std::unique_ptr<SSAUpdater>, 8> updaters;
+  for (unsigned k = 0; k < numElems; ++k) {
+    updaters.push_back(std::make_unique<SSAUpdater>(&insertedPhis));
+    updaters.back()->Initialize(elemTy, allocaInst.getName().str() + "." + std::to_string(k));
+  }
+
+  DenseMap<Instruction*, Value*> accessIdx;
+  SmallPtrSet<BasicBlock*, 8> accessBlocks;
+  for (auto & access : accesses) {
+    accessIdx[access.inst] = access.elemIdx;
+    accessBlocks.insert(access.inst->getParent());
+  }
+
+  // live-in values are resolved once all blocks have been rewritten
+  SmallVector<std::pair<Instruction*, unsigned>, 16> liveIns;
+  IRBuilder<> builder(allocaInst.getContext());
+
+  for (auto & block : vecInfo.getScalarFunction()) {
+    if (!accessBlocks.count(&block)) continue;
+
+    SmallVector<Value*, 8> current(numElems, nullptr);
+    SmallVector<Instruction*, 8> blockLiveIns(numElems, nullptr);
+    auto getCurrent = [&](unsigned k) {
+      if (current[k]) return current[k];
+      auto * liveIn = new FreezeInst(UndefValue::get(elemTy), "promote.livein", &*block.getFirstInsertionPt());
+      liveIns.emplace_back(liveIn, k);
+      blockLiveIns[k] = liveIn;
+      return current[k] = liveIn;
+    };
+
+    // stores only update the active lanes
+    auto * pred = vecInfo.getPredicate(block);
+    auto * cstPred = dyn_cast_or_null<ConstantInt>(pred);
+    if (cstPred && cstPred->isOne()) pred = nullptr;
+    bool uniformPred = !pred || (vecInfo.hasKnownShape(*pred) && vecInfo.getVectorShape(*pred).isUniform());
+
+    for (auto & inst : block) {
+      auto itAccess = accessIdx.find(&inst);
+      if (itAccess == accessIdx.end()) continue;
+      auto * elemIdx = itAccess->second;
+      auto * cstIdx = dyn_cast<ConstantInt>(elemIdx);
+      builder.SetInsertPoint(&inst);
+
+      if (auto * load = dyn_cast<LoadInst>(&inst)) {
+        Value * val = nullptr;
+        if (cstIdx) {
+          uint64_t j = cstIdx->getZExtValue();
+          val = j < numElems ? getCurrent(j) : UndefValue::get(elemTy);
+        } else {
+          val = getCurrent(0);
+          for (unsigned k = 1; k < numElems; ++k) {
+            val = builder.CreateSelect(createElemMatch(builder, elemIdx, k), getCurrent(k), val, load->getName());
+            vecInfo.setVectorShape(*val, varShape);
+          }
+        }
+        load->replaceAllUsesWith(val);
+        continue;
+      }
+
+      auto * storedVal = cast<StoreInst>(inst).getValueOperand();
+      for (unsigned k = 0; k < numElems; ++k) {
+        Value * cond = nullptr;
+        if (cstIdx) {
+          if (cstIdx->getZExtValue() != k) continue;
+          cond = pred;
+        } else {
+          cond = createElemMatch(builder, elemIdx, k);
+          if (pred) {
+            cond = builder.CreateAnd(cond, pred, "promote.active");
+            bool uniformCond = uniformPred && vecInfo.getVectorShape(*elemIdx).isUniform();
+            vecInfo.setVectorShape(*cond, uniformCond ? VectorShape::uni() : varShape);
+          }
+        }
+
+        if (!cond) {
+          current[k] = storedVal;
+        } else {
+          current[k] = builder.CreateSelect(cond, storedVal, getCurrent(k), allocaInst.getName() + ".upd");
+          vecInfo.setVectorShape(*current[k], varShape);
+        }
+      }
+    }
+
+    for (unsigned k = 0; k < numElems; ++k) {
+      if (current[k] && current[k] != blockLiveIns[k]) updaters[k]->AddAvailableValue(&block, current[k]);
+    }
+  }
+
+  for (auto & liveIn : liveIns) {
+    auto * liveInVal = updaters[liveIn.second]->GetValueInMiddleOfBlock(liveIn.first->getParent());
+    liveIn.first->replaceAllUsesWith(liveInVal);
+    liveIn.first->eraseFromParent();
+  }
+
+  for (auto * phi : insertedPhis) {
+    vecInfo.setVectorShape(*phi, varShape);
+  }
+}
+
+bool PromoteAllocas::run() {
+  IF_DEBUG_PA { errs() << "-- promote allocas opt log --\n"; }
+
+  std::vector<AllocaInst *> queue;
+  for (auto & bb : vecInfo.getScalarFunction()) {
+    if (!vecInfo.inRegion(bb)) continue;
+    for (auto & inst : bb) {
+      auto * allocaInst = dyn_cast<AllocaInst>(&inst);
+      if (allocaInst) queue.push_back(allocaInst);
+    }
+  }
+
+  size_t numPromoted = 0;
+  for (auto allocaInst : queue) {
+    if (vecInfo.getVectorShape(*allocaInst).isUniform()) continue;
+
+    IF_DEBUG_PA { errs() << "\n# trying to promote alloca " << *allocaInst << "\n"; }
+    SmallVector<ElemAccess, 16> accesses;
+    SmallVector<Instruction*, 16> deadInsts;
+    if (!collectAccesses(*allocaInst, accesses, deadInsts)) continue;
+
+    promote(*allocaInst, accesses);
+
+    for (auto & access : accesses) {
+      access.inst->eraseFromParent();
+    }
+    for (auto it = deadInsts.rbegin(); it != deadInsts.rend(); ++it) {
+      (*it)->eraseFromParent();
+    }
+    allocaInst->eraseFromParent();
+    numPromoted++;
+  }
+
+  if (numPromoted > 0) {
+    Report() << "promoteAllocas: promoted " << numPromoted << " allocas to registers\n";
+  }
+
+  IF_DEBUG_PA { errs() << "-- end of promote allocas opt log --\n"; }
+
+  return numPromoted > 0;
+}
+
+} // namespace rv
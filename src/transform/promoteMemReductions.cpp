@@ -0,0 +1,190 @@
+//===- src/transform/promoteMemReductions.cpp - keep in-loop memory reductions in registers  --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/MemoryLocation.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Transforms/Utils/SSAUpdater.h>
+
+#include <rv/transform/promoteMemReductions.h>
+#include <rv/transform/redTools.h>
+#include <rv/vectorizationInfo.h>
+
+#include <rvConfig.h>
+#include "report.h"
+
+using namespace llvm;
+
+#if 1
+#define IF_DEBUG_PMR IF_DEBUG
+#else
+#define IF_DEBUG_PMR if (false)
+#endif
+
+namespace rv {
+
+PromoteMemReductions::PromoteMemReductions(VectorizationInfo & _vecInfo, FunctionAnalysisManager & FAM)
+  : vecInfo(_vecInfo)
+  , LI(*FAM.getCachedResult<LoopAnalysis>(vecInfo.getScalarFunction()))
+  , AA(FAM.getCachedResult<AAManager>(vecInfo.getScalarFunction()))
+{}
+
+// the accumulated values are added up in a different order
+static bool
+MayReassociate(Instruction & reductor) {
+  if (!reductor.getType()->isFloatingPointTy()) return true;
+  if (reductor.hasAllowReassoc()) return true;
+  auto & func = *reductor.getFunction();
+  return func.getFnAttribute("unsafe-fp-math").getValueAsString() == "true";
+}
+
+bool
+PromoteMemReductions::matchReduction(Loop & L, StoreInst & store, MemReduction & red) const {
+  if (!store.isSimple()) return false;
+  auto * ptr = store.getPointerOperand();
+  if (!L.isLoopInvariant(ptr) || !vecInfo.getVectorShape(*ptr).isUniform()) return false;
+
+  // the per-iteration reduction of a varying value (uniform updates stay scalar anyway)
+  auto * reductor = dyn_cast<Instruction>(store.getValueOperand());
+  if (!reductor || !reductor->hasOneUse() || reductor->getParent() != store.getParent()) return false;
+  if (vecInfo.getVectorShape(*reductor).isUniform()) return false;
+
+  RedKind kind = InferInstRedKind(*reductor);
+  if (kind == RedKind::Top || kind == RedKind::Bot) return false;
+  if (!MayReassociate(*reductor)) return false;
+
+  // the old value only flows into the reductor
+  LoadInst * load = nullptr;
+  for (auto & op : reductor->operands()) {
+    auto * opLoad = dyn_cast<LoadInst>(op.get());
+    if (!opLoad || opLoad->getPointerOperand() != ptr) continue;
+    if (!opLoad->isSimple() || !opLoad->hasOneUse() || opLoad->getParent() != store.getParent()) continue;
+    if (opLoad->getType() != reductor->getType()) continue;
+    load = opLoad;
+  }
+  if (!load) return false;
+
+  red.load = load;
+  red.store = &store;
+  red.reductor = reductor;
+  red.kind = kind;
+  return true;
+}
+
+bool
+PromoteMemReductions::isDisjoint(Instruction & inst, const MemoryLocation & loc) const {
+  if (!inst.mayReadOrWriteMemory()) return true;
+
+  Value * ptr = nullptr;
+  if (auto * load = dyn_cast<LoadInst>(&inst)) ptr = load->getPointerOperand();
+  if (auto * store = dyn_cast<StoreInst>(&inst)) ptr = store->getPointerOperand();
+
+  // distinct allocations
+  if (ptr) {
+    auto * obj = getUnderlyingObject(ptr);
+    auto * accObj = getUnderlyingObject(loc.Ptr);
+    if (obj != accObj && isIdentifiedObject(obj) && isIdentifiedObject(accObj)) return true;
+  }
+
+  if (!AA) return false;
+  return !isModOrRefSet(AA->getModRefInfo(&inst, loc));
+}
+
+void
+PromoteMemReductions::promote(Loop & L, MemReduction & red) {
+  auto * ptr = red.store->getPointerOperand();
+  auto * elemTy = red.reductor->getType();
+  std::string accName = red.reductor->getName().str() + ".acc";
+
+  // the accumulator starts from the neutral element, memory is updated at the exits
+  SSAUpdater acc;
+  acc.Initialize(elemTy, accName);
+  acc.AddAvailableValue(L.getLoopPreheader(), &GetNeutralElement(red.kind, *elemTy));
+  acc.AddAvailableValue(red.store->getParent(), red.reductor);
+
+  // the update reads the register instead of memory
+  auto * accIn = acc.GetValueInMiddleOfBlock(red.load->getParent());
+  red.load->replaceAllUsesWith(accIn);
+
+  SmallVector<BasicBlock*, 4> exits;
+  L.getUniqueExitBlocks(exits);
+  for (auto * exit : exits) {
+    IRBuilder<> builder(exit, exit->getFirstInsertionPt());
+
+    // LCSSA
+    auto * accOut = builder.CreatePHI(elemTy, pred_size(exit), accName + ".lcssa");
+    for (auto * pred : predecessors(exit)) {
+      accOut->addIncoming(acc.GetValueAtEndOfBlock(pred), pred);
+    }
+
+    auto * oldVal = builder.CreateAlignedLoad(elemTy, ptr, red.load->getAlign(), red.load->getName());
+    auto & newVal = CreateReductInst(builder, red.kind, *oldVal, *accOut);
+    if (auto * newInst = dyn_cast<Instruction>(&newVal)) newInst->copyIRFlags(red.reductor);
+    auto * exitStore = builder.CreateAlignedStore(&newVal, ptr, red.store->getAlign());
+    exitStore->setDebugLoc(red.store->getDebugLoc());
+  }
+
+  red.store->eraseFromParent();
+  red.load->eraseFromParent();
+}
+
+bool PromoteMemReductions::run() {
+  IF_DEBUG_PMR { errs() << "-- promote memory reductions log --\n"; }
+
+  size_t numPromoted = 0;
+  for (auto * L : LI.getLoopsInPreorder()) {
+    // loops inside the region (the header phis of the vector loop itself are fixed)
+    if (!vecInfo.inRegion(*L->getHeader()) || L->getHeader() == &vecInfo.getEntry()) continue;
+    if (!L->getLoopPreheader() || !L->hasDedicatedExits()) continue;
+
+    SmallVector<BasicBlock*, 4> exits;
+    L->getUniqueExitBlocks(exits);
+    if (any_of(exits, [&](BasicBlock * exit) { return !vecInfo.inRegion(*exit); })) continue;
+
+    SmallVector<MemReduction, 4> reductions;
+    for (auto * block : L->blocks()) {
+      for (auto & inst : *block) {
+        auto * store = dyn_cast<StoreInst>(&inst);
+        MemReduction red;
+        if (store && matchReduction(*L, *store, red)) reductions.push_back(red);
+      }
+    }
+
+    for (auto & red : reductions) {
+      // no other access in the loop may touch the accumulator
+      auto loc = MemoryLocation::get(red.store);
+      bool disjoint = all_of(L->blocks(), [&](BasicBlock * block) {
+        return all_of(*block, [&](Instruction & inst) {
+          return &inst == red.load || &inst == red.store || isDisjoint(inst, loc);
+        });
+      });
+      if (!disjoint) {
+        IF_DEBUG_PMR { errs() << "skip: accumulator may alias in loop " << L->getName() << ": " << *red.store << "\n"; }
+        continue;
+      }
+
+      IF_DEBUG_PMR { errs() << "promoting " << *red.store << " in loop " << L->getName() << "\n"; }
+      promote(*L, red);
+      numPromoted++;
+    }
+  }
+
+  if (numPromoted > 0) {
+    Report() << "promoteMemReductions: promoted " << numPromoted << " accumulators to registers\n";
+  }
+
+  IF_DEBUG_PMR { errs() << "-- end of promote memory reductions log --\n"; }
+
+  return numPromoted > 0;
+}
+
+} // namespace rv
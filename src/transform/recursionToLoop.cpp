@@ -0,0 +1,259 @@
+//===- src/transform/recursionToLoop.cpp - self-recursion as a loop over an explicit stack --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/recursionToLoop.h"
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/PromoteMemToReg.h>
+
+#include "rv/transform/redTools.h"
+#include "utils/rvTools.h"
+
+#include "rvConfig.h"
+#include "report.h"
+
+#if 1
+#define IF_DEBUG_RECLOOP IF_DEBUG
+#else
+#define IF_DEBUG_RECLOOP if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+RecursionToLoop::RecursionToLoop(Function & _func, Function & _selfFunc, unsigned _stackDepth)
+: func(_func)
+, selfFunc(_selfFunc)
+, stackDepth(_stackDepth)
+, kind(RedKind::Bot)
+{}
+
+// the activations are combined in a different order
+static bool
+MayReassociate(Instruction & reductor) {
+  if (!reductor.getType()->isFloatingPointTy()) return true;
+  if (reductor.hasAllowReassoc()) return true;
+  auto & func = *reductor.getFunction();
+  return func.getFnAttribute("unsafe-fp-math").getValueAsString() == "true";
+}
+
+bool
+RecursionToLoop::matchResultChain(CallInst & call) {
+  Value * val = &call;
+  while (true) {
+    if (!val->hasOneUse()) return false;
+    auto * user = cast<Instruction>(*val->user_begin());
+    if (isa<ReturnInst>(user)) return true;
+
+    // the joined return of several paths
+    if (auto * phi = dyn_cast<PHINode>(user)) {
+      if (!phi->hasOneUse()) return false;
+      auto * ret = dyn_cast<ReturnInst>(*phi->user_begin());
+      return ret && ret->getParent() == phi->getParent();
+    }
+
+    RedKind userKind = InferInstRedKind(*user);
+    if (userKind == RedKind::Top || userKind == RedKind::Bot) return false;
+    if (!MayReassociate(*user)) return false;
+    if (kind != RedKind::Bot && kind != userKind) return false;
+    kind = userKind;
+    val = user;
+  }
+}
+
+bool
+RecursionToLoop::canTransform() {
+  if (func.isDeclaration() || func.isVarArg() || func.arg_empty()) return false;
+  if (selfFunc.getFunctionType() != func.getFunctionType()) return false;
+
+  auto * retTy = func.getReturnType();
+  if (!retTy->isVoidTy() && !retTy->isIntegerTy() && !retTy->isFloatingPointTy()) return false;
+  for (auto & arg : func.args()) {
+    if (arg.hasPassPointeeByValueCopyAttr() || arg.hasStructRetAttr()) return false;
+  }
+
+  for (auto & block : func) {
+    for (auto & inst : block) {
+      auto * call = dyn_cast<CallBase>(&inst);
+      if (call && call->getCalledFunction() == &selfFunc) {
+        auto * recCall = dyn_cast<CallInst>(call);
+        if (!recCall || recCall->isMustTailCall()) return false;
+        recCalls.push_back(recCall);
+        continue;
+      }
+
+      // all frames share the allocas of @func
+      if (auto * alloca = dyn_cast<AllocaInst>(&inst)) {
+        if (!alloca->isStaticAlloca()) return false;
+        continue;
+      }
+
+      if (!inst.mayWriteToMemory() || inst.isLifetimeStartOrEnd()) continue;
+      auto * store = dyn_cast<StoreInst>(&inst);
+      if (store && store->isSimple() && isa<AllocaInst>(getUnderlyingObject(store->getPointerOperand()))) continue;
+
+      IF_DEBUG_RECLOOP { errs() << "recLoop: side effect in " << func.getName() << ": " << inst << "\n"; }
+      return false;
+    }
+  }
+  if (recCalls.empty()) return false;
+
+  for (auto * call : recCalls) {
+    for (auto & arg : call->args()) {
+      if (arg->getType()->isPointerTy() && isa<AllocaInst>(getUnderlyingObject(arg.get()))) return false;
+    }
+    if (retTy->isVoidTy()) continue;
+    if (!matchResultChain(*call)) {
+      IF_DEBUG_RECLOOP { errs() << "recLoop: result of " << *call << " is not reduced into the return value\n"; }
+      return false;
+    }
+  }
+
+  // plain tail recursion is up to TailCallElim
+  return retTy->isVoidTy() || kind != RedKind::Bot;
+}
+
+void
+RecursionToLoop::accumulate(IRBuilder<> & builder, AllocaInst & accSlot, Value & val) {
+  auto * acc = builder.CreateLoad(accSlot.getAllocatedType(), &accSlot, "rec.acc");
+  auto & newAcc = CreateReductInst(builder, kind, *acc, val);
+  builder.CreateStore(&newAcc, &accSlot);
+}
+
+void
+RecursionToLoop::storeFrame(IRBuilder<> & builder, AllocaInst & stack, Value & sp, ArrayRef<Value*> args) {
+  auto * stackTy = stack.getAllocatedType();
+  for (unsigned i = 0; i < args.size(); ++i) {
+    auto * fieldPtr = builder.CreateInBoundsGEP(stackTy, &stack, {builder.getInt32(0), &sp, builder.getInt32(i)}, "rec.field");
+    builder.CreateStore(args[i], fieldPtr);
+  }
+}
+
+bool
+RecursionToLoop::run() {
+  if (!canTransform()) return false;
+  IF_DEBUG_RECLOOP { errs() << "recLoop: explicit stack for " << func.getName() << " (" << recCalls.size() << " recursive calls)\n"; }
+
+  auto & ctx = func.getContext();
+  auto * retTy = func.getReturnType();
+  bool returnsVoid = retTy->isVoidTy();
+
+  SmallVector<ReturnInst*, 4> returns;
+  for (auto & block : func) {
+    if (auto * ret = dyn_cast<ReturnInst>(block.getTerminator())) returns.push_back(ret);
+  }
+
+  // one frame per activation that has not started yet
+  SmallVector<Type*, 8> argTys;
+  for (auto & arg : func.args()) argTys.push_back(arg.getType());
+  auto * frameTy = StructType::get(ctx, argTys);
+  auto * stackTy = ArrayType::get(frameTy, stackDepth);
+
+  auto & oldEntry = func.getEntryBlock();
+  auto * entry = BasicBlock::Create(ctx, "rec.entry", &func, &oldEntry);
+  auto * header = BasicBlock::Create(ctx, "rec.header", &func, &oldEntry);
+  auto * pop = BasicBlock::Create(ctx, "rec.pop", &func, &oldEntry);
+  auto * exit = BasicBlock::Create(ctx, "rec.exit", &func);
+
+  IRBuilder<> builder(entry);
+  auto * indexTy = builder.getInt32Ty();
+  auto * stack = builder.CreateAlloca(stackTy, nullptr, "rec.stack");
+  auto * spSlot = builder.CreateAlloca(indexTy, nullptr, "rec.sp");
+  auto * accSlot = returnsVoid ? nullptr : builder.CreateAlloca(retTy, nullptr, "rec.acc.slot");
+
+  // loop header: run the next frame (if any)
+  builder.SetInsertPoint(header);
+  auto * sp = builder.CreateLoad(indexTy, spSlot, "rec.sp");
+  builder.CreateCondBr(builder.CreateICmpEQ(sp, builder.getInt32(0), "rec.empty"), exit, pop);
+
+  // the arguments of the activation come from the frame
+  builder.SetInsertPoint(pop);
+  auto * top = builder.CreateSub(sp, builder.getInt32(1), "rec.top");
+  builder.CreateStore(top, spSlot);
+  SmallVector<Value*, 8> initialArgs;
+  for (auto & arg : func.args()) {
+    auto * fieldPtr = builder.CreateInBoundsGEP(stackTy, stack, {builder.getInt32(0), top, builder.getInt32(arg.getArgNo())}, "rec.field");
+    auto * frameArg = builder.CreateLoad(arg.getType(), fieldPtr, arg.getName() + ".frame");
+    arg.replaceAllUsesWith(frameArg);
+    initialArgs.push_back(&arg);
+  }
+  builder.CreateBr(&oldEntry);
+
+  // the initial activation is the first frame
+  builder.SetInsertPoint(entry);
+  storeFrame(builder, *stack, *builder.getInt32(0), initialArgs);
+  builder.CreateStore(builder.getInt32(1), spSlot);
+  if (accSlot) builder.CreateStore(&GetNeutralElement(kind, *retTy), accSlot);
+  auto * entryTerm = builder.CreateBr(header);
+
+  // the allocas of @func are shared by all activations
+  for (auto it = oldEntry.begin(); it != oldEntry.end(); ) {
+    auto * alloca = dyn_cast<AllocaInst>(&*it++);
+    if (alloca) alloca->moveBefore(entryTerm);
+  }
+
+  builder.SetInsertPoint(exit);
+  if (accSlot) {
+    builder.CreateRet(builder.CreateLoad(retTy, accSlot, "rec.result"));
+  } else {
+    builder.CreateRetVoid();
+  }
+
+  // returns continue with the next frame
+  for (auto * ret : returns) {
+    builder.SetInsertPoint(ret);
+    if (accSlot) accumulate(builder, *accSlot, *ret->getReturnValue());
+    builder.CreateBr(header);
+    ret->eraseFromParent();
+  }
+
+  // recursive calls push a frame, once the stack is full the recursive function takes over
+  for (auto * call : recCalls) {
+    builder.SetInsertPoint(call);
+    auto * callSp = builder.CreateLoad(indexTy, spSlot, "rec.sp");
+    auto * isFull = builder.CreateICmpUGE(callSp, builder.getInt32(stackDepth), "rec.full");
+    Instruction * overflowTerm = nullptr;
+    Instruction * pushTerm = nullptr;
+    SplitBlockAndInsertIfThenElse(isFull, call, &overflowTerm, &pushTerm);
+    // the recursive fallback only runs once the stack overflows
+    auto * fullBr = cast<BranchInst>(overflowTerm->getParent()->getSinglePredecessor()->getTerminator());
+    setColdSuccessor(*fullBr, 0);
+
+    builder.SetInsertPoint(overflowTerm);
+    auto * overflowCall = cast<CallInst>(call->clone());
+    builder.Insert(overflowCall);
+    overflowCall->takeName(call);
+    if (accSlot) accumulate(builder, *accSlot, *overflowCall);
+
+    builder.SetInsertPoint(pushTerm);
+    SmallVector<Value*, 8> callArgs(call->arg_begin(), call->arg_end());
+    storeFrame(builder, *stack, *callSp, callArgs);
+    builder.CreateStore(builder.CreateAdd(callSp, builder.getInt32(1), "rec.push"), spSlot);
+
+    // the callee adds its result to the accumulator itself
+    if (accSlot) call->replaceAllUsesWith(&GetNeutralElement(kind, *retTy));
+    call->eraseFromParent();
+  }
+
+  // stack pointer and accumulator to registers
+  DominatorTree domTree(func);
+  SmallVector<AllocaInst*, 2> promotable;
+  promotable.push_back(spSlot);
+  if (accSlot) promotable.push_back(accSlot);
+  PromoteMemToReg(promotable, domTree);
+
+  Report() << "recursionToLoop: " << func.getName() << " runs " << recCalls.size() << " recursive calls from a stack of " << stackDepth << " frames\n";
+  return true;
+}
+
+} // namespace rv
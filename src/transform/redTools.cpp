@@ -6,23 +6,32 @@ using namespace llvm;
 
 namespace rv {
 
+Value&
+CreateFPMinMax(IRBuilder<> & builder, Value & A, Value & B, bool createMin) {
+  const auto & FMF = builder.getFastMathFlags();
+  if (FMF.noNaNs() && FMF.noSignedZeros()) {
+    // the backends select minps/maxps (fminnm/fmaxnm) for NaN-free minnum/maxnum
+    return *builder.CreateBinaryIntrinsic(createMin ? Intrinsic::minnum : Intrinsic::maxnum, &A, &B, nullptr, createMin ? "fmin" : "fmax");
+  }
+
+  auto * cmpInst = builder.CreateFCmpOGT(&A, &B);
+  return *builder.CreateSelect(cmpInst, createMin ? &B : &A, createMin ? &A : &B);
+}
+
 static
-Instruction&
+Value&
 CreateMinMax(IRBuilder<> & builder, Value & A, Value & B, bool createMin, bool isSigned) {
   auto * aTy = A.getType();
   bool isFloat = aTy->isFPOrFPVectorTy();
 
-  Value * cmpInst;
-  if (isFloat) {
-    cmpInst = builder.CreateFCmpOGT(&A, &B);
-  } else {
-    cmpInst = isSigned ? builder.CreateICmpSGT(&A, &B) : builder.CreateICmpUGT(&A, &B);
-  }
-  return *cast<Instruction>(builder.CreateSelect(cmpInst, createMin ? &B : &A, createMin ? &A : &B));
+  if (isFloat) return CreateFPMinMax(builder, A, B, createMin);
+
+  auto * cmpInst = isSigned ? builder.CreateICmpSGT(&A, &B) : builder.CreateICmpUGT(&A, &B);
+  return *builder.CreateSelect(cmpInst, createMin ? &B : &A, createMin ? &A : &B);
 }
 
 // materialize a single instance of firstArg [[RedKind~OpCode]] secondArg
-Instruction&
+Value&
 CreateReductInst(IRBuilder<> & builder, RedKind redKind, Value & firstArg, Value & secondArg) {
   auto * argTy = firstArg.getType();
   bool isFloat = argTy->isFPOrFPVectorTy();
@@ -30,21 +39,21 @@ CreateReductInst(IRBuilder<> & builder, RedKind redKind, Value & firstArg, Value
   switch (redKind) {
     case RedKind::Add:
       if (isFloat) {
-        return *cast<Instruction>(builder.CreateFAdd(&firstArg, &secondArg, secondArg.getName() + ".r"));
+        return *builder.CreateFAdd(&firstArg, &secondArg, secondArg.getName() + ".r");
       } else {
-        return *cast<Instruction>(builder.CreateAdd(&firstArg, &secondArg, secondArg.getName() + ".r"));
+        return *builder.CreateAdd(&firstArg, &secondArg, secondArg.getName() + ".r");
       }
 
     case RedKind::Or:
-        return *cast<Instruction>(builder.CreateOr(&firstArg, &secondArg, secondArg.getName() + ".r"));
+        return *builder.CreateOr(&firstArg, &secondArg, secondArg.getName() + ".r");
     case RedKind::And:
-        return *cast<Instruction>(builder.CreateAnd(&firstArg, &secondArg, secondArg.getName() + ".r"));
+        return *builder.CreateAnd(&firstArg, &secondArg, secondArg.getName() + ".r");
 
     case RedKind::Mul:
       if (isFloat) {
-        return *cast<Instruction>(builder.CreateFMul(&firstArg, &secondArg, secondArg.getName() + ".r"));
+        return *builder.CreateFMul(&firstArg, &secondArg, secondArg.getName() + ".r");
       } else {
-        return *cast<Instruction>(builder.CreateMul(&firstArg, &secondArg, secondArg.getName() + ".r"));
+        return *builder.CreateMul(&firstArg, &secondArg, secondArg.getName() + ".r");
       }
 
     case RedKind::UMax:
@@ -55,6 +64,10 @@ CreateReductInst(IRBuilder<> & builder, RedKind redKind, Value & firstArg, Value
     case RedKind::SMin:
       return CreateMinMax(builder, firstArg, secondArg, true, redKind == RedKind::SMin);
 
+    case RedKind::FMax:
+    case RedKind::FMin:
+      return CreateMinMax(builder, firstArg, secondArg, redKind == RedKind::FMin, false);
+
     default:
       abort(); // unsupported reduction
   }
@@ -103,6 +116,8 @@ GetIntrinsicID(RedKind kind, Type & elemTy, bool &oHasInitVal) {
     case RedKind::UMax: return elemTy.isFloatingPointTy() ? Intrinsic::vector_reduce_fmax : Intrinsic::vector_reduce_umax;
     case RedKind::SMin: return elemTy.isFloatingPointTy() ? Intrinsic::vector_reduce_fmin : Intrinsic::vector_reduce_smin;
     case RedKind::UMin: return elemTy.isFloatingPointTy() ? Intrinsic::vector_reduce_fmin : Intrinsic::vector_reduce_umin;
+    case RedKind::FMax: return Intrinsic::vector_reduce_fmax;
+    case RedKind::FMin: return Intrinsic::vector_reduce_fmin;
   }
 }
 
@@ -194,6 +209,81 @@ CreateVectorReduce(Config & config, IRBuilder<> & builder, RedKind redKind, Valu
   }
 }
 
+Value &
+CreateTransposedReduce(IRBuilder<> & builder, RedKind redKind, ArrayRef<Value*> vecVals, unsigned & laneStride) {
+  auto * vecTy = cast<FixedVectorType>(vecVals[0]->getType());
+  const unsigned vectorWidth = vecTy->getNumElements();
+  assert(IsPower2(vectorWidth) && vecVals.size() <= vectorWidth);
+
+  // pad to a power of two with neutral vectors
+  SmallVector<Value*, 16> level(vecVals.begin(), vecVals.end());
+  auto * neutralVec = builder.CreateVectorSplat(vectorWidth, &GetNeutralElement(redKind, *vecTy->getElementType()));
+  while (!IsPower2(level.size())) level.push_back(neutralVec);
+
+  // vectors of n segments (segLen lanes per reduction) are combined pairwise into vectors of 2n segments (segLen / 2 lanes)
+  unsigned segLen = vectorWidth;
+  for (; level.size() > 1; segLen /= 2) {
+    const unsigned numSegs = vectorWidth / segLen;
+    const unsigned half = segLen / 2;
+    SmallVector<int, 16> lowMask, highMask;
+    for (unsigned side = 0; side < 2; ++side) {
+      for (unsigned seg = 0; seg < numSegs; ++seg) {
+        for (unsigned i = 0; i < half; ++i) {
+          lowMask.push_back(side * vectorWidth + seg * segLen + i);
+          highMask.push_back(side * vectorWidth + seg * segLen + half + i);
+        }
+      }
+    }
+
+    SmallVector<Value*, 16> nextLevel;
+    for (size_t i = 0; i < level.size(); i += 2) {
+      auto * low = builder.CreateShuffleVector(level[i], level[i + 1], lowMask, "red.tlo");
+      auto * high = builder.CreateShuffleVector(level[i], level[i + 1], highMask, "red.thi");
+      nextLevel.push_back(&CreateReductInst(builder, redKind, *low, *high));
+    }
+    level = nextLevel;
+  }
+
+  // fold the remaining segments in place (the first lane of each segment accumulates it)
+  Value * accu = level[0];
+  for (unsigned range = segLen / 2; range >= 1; range /= 2) {
+    SmallVector<int, 16> foldMask;
+    for (unsigned i = 0; i < vectorWidth; ++i) {
+      foldMask.push_back(i + range < vectorWidth ? (int) (i + range) : UndefMaskElem);
+    }
+    auto * folded = builder.CreateShuffleVector(accu, foldMask, "red.tfold");
+    accu = &CreateReductInst(builder, redKind, *accu, *folded);
+  }
+
+  laneStride = segLen;
+  return *accu;
+}
+
+Value &
+CreateVectorScan(IRBuilder<> & builder, RedKind redKind, Value & vecVal, bool inclusive) {
+  auto * vecTy = cast<FixedVectorType>(vecVal.getType());
+  const int vectorWidth = vecTy->getNumElements();
+  auto * neutralVec = builder.CreateVectorSplat(vectorWidth, &GetNeutralElement(redKind, *vecTy->getElementType()));
+
+  // lanes shifted up by @dist, lanes below @dist read the neutral element (second shuffle operand)
+  auto shiftLanes = [&](Value & laneVal, int dist) {
+    SmallVector<int, 16> shiftMask;
+    for (int i = 0; i < vectorWidth; ++i) {
+      shiftMask.push_back(i >= dist ? i - dist : vectorWidth + i);
+    }
+    return builder.CreateShuffleVector(&laneVal, neutralVec, shiftMask, vecVal.getName() + ".scan.shift");
+  };
+
+  // Hillis-Steele: after step d every lane combines the 2d preceding lanes
+  Value * accu = &vecVal;
+  for (int dist = 1; dist < vectorWidth; dist *= 2) {
+    accu = &CreateReductInst(builder, redKind, *accu, *shiftLanes(*accu, dist));
+  }
+
+  if (inclusive) return *accu;
+  return *shiftLanes(*accu, 1);
+}
+
 Value &
 CreateExtract(IRBuilder<> & builder, Value & vecVal, int laneOffset) {
   auto * vecTy = dyn_cast<VectorType>(vecVal.getType());
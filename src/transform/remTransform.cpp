@@ -12,12 +12,14 @@
 #include "rv/analysis/reductionAnalysis.h"
 #include "rv/vectorizationInfo.h"
 #include "rv/transform/loopCloner.h"
+#include "rv/intrinsics.h"
 #include "rv/utils.h"
 
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instructions.h"
 
+#include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/Analysis/ScalarEvolution.h"
@@ -420,7 +422,10 @@ struct LoopTransformer {
 
   // use tail predication (instead of branching to the scalar loop)
   bool useTailPredication;
+  // finish with a full vector iteration that overlaps the previous one (instead of branching to the scalar loop)
+  bool useOverlapTail;
   Value * AVL; // computed AVL (only set if useTailPredication is set)
+  Value * TailMask; // rv_lane_id() < AVL (only set if useTailPredication is set)
 
   // exit condition builder for the vectorized loop
   BranchCondition & exitConditionBuilder;
@@ -432,6 +437,9 @@ struct LoopTransformer {
   int vectorWidth;
   int tripAlign;
 
+  // additional condition to enter the vector loop (eg runtime alias checks)
+  Value * vecLoopGuard;
+
   // - original loop -
   //
   // entry
@@ -484,7 +492,7 @@ struct LoopTransformer {
     return nullptr;
   }
 
-  LoopTransformer(Function & _F, DominatorTree & _DT, PostDominatorTree & _PDT, LoopInfo & _LI, ReductionAnalysis & _reda, std::set<Value*> & _uniOverrides, BranchCondition & _exitBuilder, Loop & _ScalarL, Loop & _ClonedL, ValueToValueMapTy & _vecValMap, bool _useTailPredication, int _vectorWidth, int _tripAlign)
+  LoopTransformer(Function & _F, DominatorTree & _DT, PostDominatorTree & _PDT, LoopInfo & _LI, ReductionAnalysis & _reda, std::set<Value*> & _uniOverrides, BranchCondition & _exitBuilder, Loop & _ScalarL, Loop & _ClonedL, ValueToValueMapTy & _vecValMap, bool _useTailPredication, bool _useOverlapTail, int _vectorWidth, int _tripAlign, Value * _vecLoopGuard)
   : F(_F)
   , DT(_DT)
   , PDT(_PDT)
@@ -492,13 +500,16 @@ struct LoopTransformer {
   , ScalarL(_ScalarL)
   , ClonedL(_ClonedL)
   , useTailPredication(_useTailPredication)
+  , useOverlapTail(_useOverlapTail)
   , AVL(nullptr)
+  , TailMask(nullptr)
   , exitConditionBuilder(_exitBuilder)
   , vecValMap(_vecValMap)
   , reda(_reda)
   , uniOverrides(_uniOverrides)
   , vectorWidth(_vectorWidth)
   , tripAlign(_tripAlign)
+  , vecLoopGuard(_vecLoopGuard)
   , entryBlock(ScalarL.getLoopPreheader())
   , loopExit(ScalarL.getExitBlock())
   , vecGuardBlock(nullptr)
@@ -570,7 +581,7 @@ struct LoopTransformer {
 
   // branch from vecToScalarExit to the scalarGuard
     // TODO add an early exit branch (whenever no iterations remain)
-    auto * remainderCond = useTailPredication ? constFalse : constTrue;
+    auto * remainderCond = (useTailPredication || useOverlapTail) ? constFalse : constTrue;
     BranchInst::Create(scalarGuardBlock, loopExit, remainderCond, vecToScalarExit);
 
   // make scalarGuard the new preheader of the scalar loop
@@ -723,8 +734,8 @@ struct LoopTransformer {
     // replicate the vector loop exit condition
     IRBuilder<> builder(&vecHead, vecHead.getTerminator()->getIterator());
 
-    // for tail predication, stay inside the loop while there is at least one iteration remaining
-    unsigned exitTriggerIteration = useTailPredication ? vectorWidth : 2 * vectorWidth;
+    // for tail predication (and overlapping tails), stay inside the loop while there is at least one iteration remaining
+    unsigned exitTriggerIteration = (useTailPredication || useOverlapTail) ? vectorWidth : 2 * vectorWidth;
 
     auto & exitVal =
       exitConditionBuilder.synthesize(exitTriggerIteration, ".vecExit", builder, &uniOverrides,
@@ -843,6 +854,22 @@ struct LoopTransformer {
     vecGuardBr.setCondition(&exitVal);
   }
 
+  // only enter the vector loop if vecLoopGuard holds
+  void
+  SupplementVecLoopGuard() {
+    if (!vecLoopGuard) return;
+
+    auto & vecGuardBr = *cast<BranchInst>(vecGuardBlock->getTerminator());
+    IRBuilder<> builder(vecGuardBlock, vecGuardBr.getIterator());
+    auto * guardCond = vecGuardBr.getCondition();
+
+    if (exitConditionBuilder.exitsOnTrue()) {
+      vecGuardBr.setCondition(builder.CreateOr(guardCond, builder.CreateNot(vecLoopGuard), "vecGuard.skip"));
+    } else {
+      vecGuardBr.setCondition(builder.CreateAnd(guardCond, vecLoopGuard, "vecGuard.enter"));
+    }
+  }
+
   // replicate the scalar loop exit condition in vecToScalarExit
   void
   SupplementVectorExit(ValueToValueMapTy & vecLoopPhis) {
@@ -859,7 +886,7 @@ struct LoopTransformer {
     auto & vecExitBr = *cast<BranchInst>(vecToScalarExit->getTerminator());
 
     // Whether we need control from the vector loop exit to the scalar loop.
-    if (!useTailPredication && (tripAlign % vectorWidth != 0)) {
+    if (!useTailPredication && !useOverlapTail && (tripAlign % vectorWidth != 0)) {
       IF_DEBUG { errs() << "remTrans: need a scalar remainder loop.\n"; }
     // replicate the exit condition
       // replace scalar reductors with their vector-loop versions
@@ -895,8 +922,8 @@ struct LoopTransformer {
 
     }
 
-    // the scalar loop is never executed (full SIMD vectors for all iteration or
-    // we are using tail predication for the vector loop)
+    // the scalar loop is never executed after the vector loop (full SIMD vectors for all iteration or
+    // we are using tail predication or an overlapping last iteration for the vector loop)
     // --> unconditionally branch to the loop exit
     vecExitBr.setCondition(ConstantInt::getTrue(vecExitBr.getContext()));
     vecExitBr.setSuccessor(0, loopExit);
@@ -960,12 +987,9 @@ struct LoopTransformer {
     }
   }
 
-  void
-  insertAVLComputation() {
-    IF_DEBUG_REM{ for (auto *BB : ClonedL.blocks()) Dump(*BB); }
-
-    auto &LoopHead = *ClonedL.getHeader();
-
+  // the iterations that remain from the header phi of the vector loop on (at the insert point of \p Builder)
+  Value &
+  synthesizeRemainingIterations(IRBuilder<> & Builder) {
     // map vector phis to their shapes
     std::map<Value*, PHINode*> headerPhis;
     std::map<Value*, PHINode*> reductors;
@@ -981,10 +1005,7 @@ struct LoopTransformer {
       }
     }
 
-    // compute the lane index
-    IRBuilder<> Builder(LoopHead.getFirstNonPHI());
-    auto & RawAVL =
-      exitConditionBuilder.synthesizeEVL(0, ".avl", Builder, &uniOverrides,
+    return exitConditionBuilder.synthesizeEVL(0, ".avl", Builder, &uniOverrides,
          [&](Instruction & inst) -> IterValue {
            assert (!isa<CallInst>(inst));
 
@@ -1012,6 +1033,17 @@ struct LoopTransformer {
            return IterValue(*headerPhi, offset);
        }
     );
+  }
+
+  void
+  insertAVLComputation() {
+    IF_DEBUG_REM{ for (auto *BB : ClonedL.blocks()) Dump(*BB); }
+
+    auto &LoopHead = *ClonedL.getHeader();
+
+    // compute the lane index
+    IRBuilder<> Builder(LoopHead.getFirstNonPHI());
+    auto & RawAVL = synthesizeRemainingIterations(Builder);
 
     // Convert to native avl type
     Type *AVLTy = Builder.getInt32Ty();
@@ -1025,6 +1057,32 @@ struct LoopTransformer {
     this->AVL = Builder.CreateSelect(&LessThanVW, AVLArg, VWConst, "select.avl");
     uniOverrides.insert(AVL);
 
+    // lanes [AVL, vectorWidth) are masked out in the last iteration
+    auto & Mod = *F.getParent();
+    auto * LaneIDFunc = Mod.getFunction(GetIntrinsicName(RVIntrinsic::LaneID));
+    if (!LaneIDFunc) LaneIDFunc = &DeclareIntrinsic(RVIntrinsic::LaneID, Mod);
+    auto * LaneID = Builder.CreateCall(LaneIDFunc, {}, "tail.lane");
+    TailMask = Builder.CreateICmpULT(LaneID, AVL, "tail.mask");
+
+    // masked-out lanes must not update recurrences
+    auto * Latch = ClonedL.getLoopLatch();
+    IRBuilder<> LatchBuilder(Latch->getTerminator());
+    for (auto & ScaPhi : ScalarL.getHeader()->phis()) {
+      if (reda.getStrideInfo(ScaPhi)) continue;
+
+      auto & VecPhi = cast<PHINode>(LookUp(vecValMap, ScaPhi));
+      int LatchIdx = VecPhi.getBasicBlockIndex(Latch);
+      auto * LatchVal = dyn_cast<Instruction>(VecPhi.getIncomingValue(LatchIdx));
+      if (!LatchVal) continue;
+
+      auto * Blend = LatchBuilder.CreateSelect(TailMask, LatchVal, &VecPhi, LatchVal->getName() + ".tail");
+      VecPhi.setIncomingValue(LatchIdx, Blend);
+
+      // live-outs of the vector loop use the blended value
+      auto * ScaLatchVal = ScaPhi.getIncomingValueForBlock(ScalarL.getLoopLatch());
+      vecValMap[ScaLatchVal] = Blend;
+    }
+
     // after splitting
     IF_DEBUG_REM {
       errs() << ":: after tail predication::\n";
@@ -1033,6 +1091,36 @@ struct LoopTransformer {
     }
   }
 
+  // the last iteration starts W iterations before the end and overlaps the previous one: the body uses the
+  // induction shifted back by max(0, W - remaining iterations) (uniform) instead of the header phi
+  void
+  insertOverlapShift() {
+    auto & ScaPhi = *ScalarL.getHeader()->begin();
+    auto & VecPhi = cast<PHINode>(LookUp(vecValMap, ScaPhi));
+    auto * Sp = reda.getStrideInfo(cast<PHINode>(ScaPhi));
+    assert(Sp && Sp->inc == 1 && "overlapping tails need a unit-step induction");
+    auto * VecReductor = &LookUp(vecValMap, *Sp->reductor);
+
+    // the users of the induction in the body (the reductor keeps stepping the unshifted phi)
+    SmallVector<Use*, 8> BodyUses;
+    for (auto & U : VecPhi.uses()) {
+      if (U.getUser() != VecReductor) BodyUses.push_back(&U);
+    }
+
+    auto &LoopHead = *ClonedL.getHeader();
+    IRBuilder<> Builder(LoopHead.getFirstNonPHI());
+    auto & Remaining = synthesizeRemainingIterations(Builder);
+    auto * Width = ConstantInt::get(Remaining.getType(), vectorWidth);
+    auto * IsLast = Builder.CreateICmpSLT(&Remaining, Width, "overlap.last");
+    auto * Back = Builder.CreateSub(&Remaining, Width, "overlap.back");
+    auto * Shift = Builder.CreateSelect(IsLast, Back, ConstantInt::get(Remaining.getType(), 0), "overlap.shift");
+    auto * PhiShift = Builder.CreateSExtOrTrunc(Shift, VecPhi.getType());
+    for (auto * Val : {IsLast, Back, Shift, PhiShift}) uniOverrides.insert(Val);
+    auto * ShiftedIV = Builder.CreateAdd(&VecPhi, PhiShift, VecPhi.getName() + ".overlap");
+
+    for (auto * U : BodyUses) U->set(ShiftedIV);
+  }
+
   void
   repairValueFlow() {
     ValueToValueMapTy vecLoopPhis, vecLiveOuts;
@@ -1042,6 +1130,7 @@ struct LoopTransformer {
 
     // when vectorizing with tail predication, insert the iteration guard now.
     if (useTailPredication) insertAVLComputation();
+    else if (useOverlapTail) insertOverlapShift();
 
     // let the scalar loop start from the remainder vector loop remainder (if the VL was executed)
     updateScalarLoopStartValues(vecLoopPhis);
@@ -1059,6 +1148,7 @@ struct LoopTransformer {
   // supplement the vector loop guard condition (vecGuardBlock -> vector loop edge)
     // the vector loop will execute on at least one full vector
     SupplementVectorGuard();
+    SupplementVecLoopGuard();
   }
 };
 
@@ -1140,8 +1230,65 @@ bool RemainderTransform::analyzeLoopStructure(Loop &L) {
   return branchCond;
 }
 
+bool
+RemainderTransform::canOverlapTail(Loop & L, const std::vector<std::pair<Instruction*, Instruction*>> & checkedPairs) {
+  if (!analyzeLoopStructure(L)) return false;
+
+  // a single unit-step induction (no reductions or recurrences)
+  auto phis = L.getHeader()->phis();
+  if (std::distance(phis.begin(), phis.end()) != 1) {
+    Report() << "remTrans, overlap: header phis other than the induction\n";
+    return false;
+  }
+  auto * sp = reda.getStrideInfo(*phis.begin());
+  if (!sp || sp->inc != 1) {
+    Report() << "remTrans, overlap: not a unit-step induction\n";
+    return false;
+  }
+
+  auto & AA = FAM.getResult<AAManager>(F);
+  std::vector<Instruction*> loads, stores;
+  for (auto * BB : L.blocks()) {
+    for (auto & I : *BB) {
+      // re-executed iterations must leave no trace but their stores
+      for (auto * user : I.users()) {
+        if (!L.contains(cast<Instruction>(user))) {
+          Report() << "remTrans, overlap: live-out " << I << "\n";
+          return false;
+        }
+      }
+      if (auto * load = dyn_cast<LoadInst>(&I)) {
+        if (!load->isSimple()) return false;
+        loads.push_back(load);
+      } else if (auto * store = dyn_cast<StoreInst>(&I)) {
+        if (!store->isSimple()) return false;
+        stores.push_back(store);
+      } else if (I.mayHaveSideEffects() || I.mayReadFromMemory()) {
+        Report() << "remTrans, overlap: side effects " << I << "\n";
+        return false;
+      }
+    }
+  }
+
+  // no load may read what a store of the loop writes (runtime-checked pairs do not overlap in the vector loop)
+  for (auto * store : stores) {
+    for (auto * load : loads) {
+      bool checked = std::find(checkedPairs.begin(), checkedPairs.end(), std::make_pair(load, store)) != checkedPairs.end() ||
+                     std::find(checkedPairs.begin(), checkedPairs.end(), std::make_pair(store, load)) != checkedPairs.end();
+      if (checked) continue;
+      auto loadLoc = MemoryLocation::getBeforeOrAfter(getLoadStorePointerOperand(load));
+      auto storeLoc = MemoryLocation::getBeforeOrAfter(getLoadStorePointerOperand(store));
+      if (!AA.isNoAlias(loadLoc, storeLoc)) {
+        Report() << "remTrans, overlap: " << *load << " may read the output " << *store << "\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 PreparedLoop
-RemainderTransform::createVectorizableLoop(Loop & L, ValueSet & uniOverrides, bool useTailPredication, int vectorWidth, int tripAlign) {
+RemainderTransform::createVectorizableLoop(Loop & L, ValueSet & uniOverrides, bool useTailPredication, int vectorWidth, int tripAlign, Value * vecLoopGuard, bool useOverlapTail) {
 // run capability checks
   // CFG caps
   if (!canTransformLoop(L)) return PreparedLoop();
@@ -1195,10 +1342,10 @@ RemainderTransform::createVectorizableLoop(Loop & L, ValueSet & uniOverrides, bo
   // reda.updateForClones(LI, cloneMap);
 
 // embed the cloned loop
-  LoopTransformer loopTrans(F, DT, PDT, LI, reda, uniOverrides, *branchCond, L, clonedLoop, cloneMap, useTailPredication, vectorWidth, tripAlign);
+  LoopTransformer loopTrans(F, DT, PDT, LI, reda, uniOverrides, *branchCond, L, clonedLoop, cloneMap, useTailPredication, useOverlapTail, vectorWidth, tripAlign, vecLoopGuard);
 
   // rebuild reduction information for cloned loop
-  reda.analyze(clonedLoop);
+  reda.analyze(clonedLoop, loopTrans.TailMask);
 
   IF_DEBUG_REM {
     errs() << "-- function after remTrans --\n";
@@ -1207,7 +1354,7 @@ RemainderTransform::createVectorizableLoop(Loop & L, ValueSet & uniOverrides, bo
 
   delete branchCond;
 
-  return PreparedLoop(&clonedLoop, loopTrans.AVL);
+  return PreparedLoop(&clonedLoop, loopTrans.AVL, loopTrans.TailMask);
 }
 
 } // namespace rv
@@ -0,0 +1,238 @@
+//===- src/transform/searchLoopTrans.cpp - speculative vectorization of search loops --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/searchLoopTrans.h"
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+
+#include "rvConfig.h"
+
+#if 1
+#define IF_DEBUG_SEARCH IF_DEBUG
+#else
+#define IF_DEBUG_SEARCH if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+// at most one bit per lane in an i64 ballot
+static const unsigned MaxSearchWidth = 64;
+
+// the element size of \p load if it advances contiguously through \p L, 0 otw
+static uint64_t
+GetContiguousElemSize(Loop & L, LoadInst & load, ScalarEvolution & SE) {
+  auto * ptrRec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(load.getPointerOperand()));
+  if (!ptrRec || ptrRec->getLoop() != &L || !ptrRec->isAffine()) return 0;
+
+  auto * step = dyn_cast<SCEVConstant>(ptrRec->getStepRecurrence(SE));
+  const DataLayout & DL = load.getModule()->getDataLayout();
+  uint64_t elemSize = DL.getTypeAllocSize(load.getType());
+  if (!step || !isPowerOf2_64(elemSize) || step->getAPInt() != elemSize) return 0;
+  if (!isSafeToExpand(ptrRec->getStart(), SE)) return 0;
+
+  // lanes must not straddle the start offset of the aligned block
+  if (load.getAlign().value() < elemSize) return 0;
+  return elemSize;
+}
+
+bool
+SearchLoopTransform::analyze(Loop & L, SearchLoop & search) const {
+  auto * preHeader = L.getLoopPreheader();
+  auto * header = L.getHeader();
+  auto * latch = L.getLoopLatch();
+  if (!preHeader || !latch || !L.getSubLoops().empty() || L.getNumBlocks() > 2) return false;
+  if (!isa<BranchInst>(preHeader->getTerminator())) return false;
+
+  // the data exit is taken first in every iteration
+  auto * headerBr = dyn_cast<BranchInst>(header->getTerminator());
+  if (!headerBr || !headerBr->isConditional()) return false;
+  search.exitOnMatch = !L.contains(headerBr->getSuccessor(0));
+  if (search.exitOnMatch == !L.contains(headerBr->getSuccessor(1))) return false;
+
+  search.cmp = dyn_cast<CmpInst>(headerBr->getCondition());
+  if (!search.cmp) return false;
+  search.load = dyn_cast<LoadInst>(search.cmp->getOperand(0));
+  search.key = search.cmp->getOperand(1);
+  if (!search.load) {
+    search.load = dyn_cast<LoadInst>(search.cmp->getOperand(1));
+    search.key = search.cmp->getOperand(0);
+  }
+  if (!search.load || search.load->getParent() != header || !search.load->isSimple() ||
+      !L.isLoopInvariant(search.key)) {
+    return false;
+  }
+  auto * elemTy = search.load->getType();
+  if (!elemTy->isIntegerTy() && !elemTy->isFloatingPointTy()) return false;
+  if (!GetContiguousElemSize(L, *search.load, SE)) return false;
+
+  // optional bound exit in the latch
+  search.exitCount = nullptr;
+  if (latch != header) {
+    auto * latchBr = dyn_cast<BranchInst>(latch->getTerminator());
+    if (!latchBr) return false;
+    if (latchBr->isConditional()) {
+      auto * exitCount = SE.getExitCount(&L, latch);
+      const DataLayout & DL = F.getParent()->getDataLayout();
+      auto * intPtrTy = DL.getIntPtrType(search.load->getPointerOperandType());
+      if (isa<SCEVCouldNotCompute>(exitCount) || !SE.isLoopInvariant(exitCount, &L) ||
+          !isSafeToExpand(exitCount, SE) ||
+          SE.getTypeSizeInBits(exitCount->getType()) > intPtrTy->getScalarSizeInBits()) {
+        return false;
+      }
+      search.exitCount = exitCount;
+    }
+  }
+  // the lanes beyond the terminating element can only be masked off by the trip count
+  if (!search.exitCount) {
+    IF_DEBUG_SEARCH { errs() << "searchLoop: " << L.getName() << " has no bound exit\n"; }
+    return false;
+  }
+
+  // nothing but the search load touches memory, the vector loop does not replicate the body
+  for (auto * block : L.blocks()) {
+    for (auto & inst : *block) {
+      if (&inst == search.load || isa<DbgInfoIntrinsic>(inst)) continue;
+      if (inst.mayReadOrWriteMemory() || inst.mayThrow()) return false;
+    }
+  }
+
+  // the scalar loop resumes with the closed form of every header phi
+  for (auto & phi : header->phis()) {
+    auto * phiRec = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&phi));
+    if (!phiRec || phiRec->getLoop() != &L || !phiRec->isAffine() ||
+        !isSafeToExpand(phiRec->getStepRecurrence(SE), SE)) {
+      IF_DEBUG_SEARCH { errs() << "searchLoop: no closed form for " << phi << "\n"; }
+      return false;
+    }
+  }
+
+  // lane i is bit i of the ballot
+  const DataLayout & DL = F.getParent()->getDataLayout();
+  return DL.isLittleEndian() && vectorBytes / DL.getTypeAllocSize(elemTy) >= 2;
+}
+
+BasicBlock *
+SearchLoopTransform::run(Loop & L, const SearchLoop & search) {
+  auto * preHeader = L.getLoopPreheader();
+  auto * header = L.getHeader();
+  auto & ctx = F.getContext();
+  const DataLayout & DL = F.getParent()->getDataLayout();
+
+  auto * elemTy = search.load->getType();
+  uint64_t elemSize = GetContiguousElemSize(L, *search.load, SE);
+  assert(elemSize && "not a search loop");
+  unsigned width = std::min<unsigned>(MaxSearchWidth, vectorBytes / elemSize);
+  uint64_t blockBytes = width * elemSize;
+
+  // expand everything that needs SCEV before the CFG changes
+  auto * ptr = search.load->getPointerOperand();
+  auto * ptrRec = cast<SCEVAddRecExpr>(SE.getSCEV(ptr));
+  auto * intPtrTy = DL.getIntPtrType(ptr->getType());
+  auto * preHeaderTerm = preHeader->getTerminator();
+  SCEVExpander expander(SE, DL, "rv.search");
+  auto * startPtr = expander.expandCodeFor(ptrRec->getStart(), ptr->getType(), preHeaderTerm);
+  auto * bound = expander.expandCodeFor(SE.getNoopOrZeroExtend(search.exitCount, intPtrTy), intPtrTy, preHeaderTerm);
+  SmallVector<std::pair<PHINode*, Value*>, 4> phiSteps;
+  for (auto & phi : header->phis()) {
+    auto * phiRec = cast<SCEVAddRecExpr>(SE.getSCEV(&phi));
+    auto * stepTy = SE.getEffectiveSCEVType(phi.getType());
+    phiSteps.emplace_back(&phi, expander.expandCodeFor(phiRec->getStepRecurrence(SE), stepTy, preHeaderTerm));
+  }
+
+  // first aligned block and the iteration of its first lane (<= 0)
+  IRBuilder<> builder(preHeaderTerm);
+  auto * startInt = builder.CreatePtrToInt(startPtr, intPtrTy, "search.start");
+  auto * misalign = builder.CreateAnd(startInt, blockBytes - 1, "search.misalign");
+  auto * alignedPtr = builder.CreateGEP(builder.getInt8Ty(), startPtr, builder.CreateNeg(misalign), "search.aligned");
+  auto * firstIter = builder.CreateNeg(builder.CreateLShr(misalign, Log2_64(elemSize)), "search.first");
+  auto * keyVec = builder.CreateVectorSplat(width, search.key, "search.key");
+  auto * boundVec = builder.CreateVectorSplat(width, bound, "search.bound");
+
+  auto * vecHeader = BasicBlock::Create(ctx, "search.vec", &F, header);
+  auto * resumeBlock = BasicBlock::Create(ctx, "search.resume", &F, header);
+  preHeaderTerm->replaceUsesOfWith(header, vecHeader);
+
+  // scan one aligned block per iteration
+  IRBuilder<> vecBuilder(vecHeader);
+  auto * blockPtr = vecBuilder.CreatePHI(alignedPtr->getType(), 2, "search.ptr");
+  auto * blockIter = vecBuilder.CreatePHI(intPtrTy, 2, "search.iter");
+  auto * vecTy = FixedVectorType::get(elemTy, width);
+
+  // only the lanes of iterations [0, bound] are read (those the scalar loop reads up to its bound exit)
+  SmallVector<Constant*, 16> laneOffsets;
+  for (unsigned i = 0; i < width; ++i) laneOffsets.push_back(ConstantInt::get(intPtrTy, i));
+  auto * laneIters = vecBuilder.CreateAdd(vecBuilder.CreateVectorSplat(width, blockIter), ConstantVector::get(laneOffsets), "search.lanes");
+  auto * pastBound = vecBuilder.CreateICmpSGT(laneIters, boundVec, "search.past");
+  auto * inRange = vecBuilder.CreateAnd(vecBuilder.CreateICmpSGE(laneIters, Constant::getNullValue(laneIters->getType())),
+                                        vecBuilder.CreateNot(pastBound), "search.inrange");
+  auto * block = vecBuilder.CreateMaskedLoad(vecTy, blockPtr, Align(blockBytes), inRange, nullptr, "search.block");
+
+  bool loadIsLHS = search.cmp->getOperand(0) == search.load;
+  Value * hit = vecBuilder.CreateCmp(search.cmp->getPredicate(), loadIsLHS ? block : keyVec, loadIsLHS ? keyVec : block, "search.hit");
+  if (!search.exitOnMatch) hit = vecBuilder.CreateNot(hit, "search.hit");
+
+  // lanes past the last iteration exit as well, the scalar loop takes the bound exit
+  Value * exitLanes = vecBuilder.CreateAnd(hit, inRange, "search.exit");
+  exitLanes = vecBuilder.CreateOr(exitLanes, pastBound, "search.exit");
+
+  auto * ballotTy = vecBuilder.getIntNTy(width);
+  auto * ballot = vecBuilder.CreateBitCast(exitLanes, ballotTy, "search.ballot");
+  auto * found = vecBuilder.CreateICmpNE(ballot, ConstantInt::get(ballotTy, 0), "search.found");
+  auto * nextPtr = vecBuilder.CreateGEP(vecBuilder.getInt8Ty(), blockPtr, ConstantInt::get(intPtrTy, blockBytes), "search.ptr.next");
+  auto * nextIter = vecBuilder.CreateAdd(blockIter, ConstantInt::get(intPtrTy, width), "search.iter.next");
+  vecBuilder.CreateCondBr(found, resumeBlock, vecHeader);
+
+  blockPtr->addIncoming(alignedPtr, preHeader);
+  blockPtr->addIncoming(nextPtr, vecHeader);
+  blockIter->addIncoming(firstIter, preHeader);
+  blockIter->addIncoming(nextIter, vecHeader);
+
+  // resume the scalar loop in the first exiting iteration
+  IRBuilder<> resumeBuilder(resumeBlock);
+  auto * exitLane = resumeBuilder.CreateBinaryIntrinsic(Intrinsic::cttz, ballot, resumeBuilder.getTrue());
+  Value * resumeIter = resumeBuilder.CreateAdd(blockIter, resumeBuilder.CreateZExtOrTrunc(exitLane, intPtrTy), "search.resume.iter");
+  resumeIter = resumeBuilder.CreateBinaryIntrinsic(Intrinsic::smin, resumeIter, bound, nullptr, "search.resume.iter");
+
+  for (auto & phiStep : phiSteps) {
+    auto & phi = *phiStep.first;
+    auto * step = phiStep.second;
+    int preHeaderIdx = phi.getBasicBlockIndex(preHeader);
+    auto * startVal = phi.getIncomingValue(preHeaderIdx);
+    Value * resumeVal = nullptr;
+    if (phi.getType()->isPointerTy()) {
+      auto * offset = resumeBuilder.CreateMul(resumeBuilder.CreateZExtOrTrunc(resumeIter, step->getType()), step);
+      resumeVal = resumeBuilder.CreateGEP(resumeBuilder.getInt8Ty(), startVal, offset, phi.getName() + ".resume");
+    } else {
+      auto * offset = resumeBuilder.CreateMul(resumeBuilder.CreateZExtOrTrunc(resumeIter, phi.getType()), step);
+      resumeVal = resumeBuilder.CreateAdd(startVal, offset, phi.getName() + ".resume");
+    }
+    phi.setIncomingBlock(preHeaderIdx, resumeBlock);
+    phi.setIncomingValue(preHeaderIdx, resumeVal);
+  }
+  resumeBuilder.CreateBr(header);
+
+  IF_DEBUG_SEARCH {
+    errs() << "searchLoop: scanning " << L.getName() << " in " << blockBytes << " byte blocks (" << width << " lanes)\n";
+  }
+
+  return vecHeader;
+}
+
+} // namespace rv
@@ -320,10 +320,20 @@ repairExternalUses(Instruction & inst) {
 }
 
 void
-finalize() {
+finalize(std::vector<const Instruction*> * replicates) {
   // attach inputs to replicated PHI nodes
   repairPhis();
 
+  if (replicates) {
+    for (auto itMapped : replMap.replMap) {
+      if (!isa<Instruction>(itMapped.first)) continue;
+      for (auto * replVal : itMapped.second) {
+        auto * replInst = dyn_cast<Instruction>(replVal);
+        if (replInst) replicates->push_back(replInst);
+      }
+    }
+  }
+
   // re-aggregate replicated values for external users
   for (auto itMapped : replMap.replMap) {
     if (keepSet.count(itMapped.first)) continue;
@@ -847,7 +857,7 @@ requestReplicate(Value & val) {
 
 
 bool
-run() {
+run(std::vector<const Instruction*> * replicates) {
   bool changedCode = false;
 
   IF_DEBUG_SROV errs() << "---- SROV run log ----\n";
@@ -926,7 +936,7 @@ run() {
 
 // cleanup
   IF_DEBUG_SROV { errs() << "- finalizing -\n";  }
-  finalize();
+  finalize(replicates);
 
   IF_DEBUG_SROV { errs() << "-- SROV finished --\n";  }
 
@@ -944,9 +954,9 @@ SROVTransform::SROVTransform(VectorizationInfo & _vecInfo, const PlatformInfo &
 
 
 bool
-SROVTransform::run() {
+SROVTransform::run(std::vector<const Instruction*> * replicates) {
   Impl impl(vecInfo.getScalarFunction(), vecInfo, platInfo);
-  return impl.run();
+  return impl.run(replicates);
 }
 
 }
@@ -19,6 +19,7 @@
 #include <llvm/IR/DataLayout.h>
 #include <llvm/Transforms/Utils/SSAUpdater.h>
 
+#include <rv/intrinsics.h>
 #include <rv/vectorizationInfo.h>
 
 
@@ -99,11 +100,13 @@ StructOpt::getVectorShape(llvm::Value & val) const {
   else return VectorShape::undef();
 }
 
-StructOpt::StructOpt(VectorizationInfo & _vecInfo, const DataLayout & _layout)
+StructOpt::StructOpt(VectorizationInfo & _vecInfo, const DataLayout & _layout, bool _allowVaryingIndices)
 : vecInfo(_vecInfo)
 , layout(_layout)
+, allowVaryingIndices(_allowVaryingIndices)
 , numTransformed(0)
 , numPromoted(0)
+, numVaryingAccesses(0)
 {}
 
 Value *
@@ -179,8 +182,50 @@ StructOpt::transformLoadStore(IRBuilder<> & builder,
   }
 }
 
+Value *
+StructOpt::createVaryingElemPtr(GetElementPtrInst & gep, AllocaInst & vecAlloc) {
+  IRBuilder<> builder(&gep);
+  auto * arrTy = cast<ArrayType>(gep.getSourceElementType());
+  auto * elemTy = arrTy->getElementType();
+  auto * idx = gep.getOperand(2);
+  int64_t vectorWidth = vecInfo.getVectorWidth();
+
+  // element j of lane i is at j * W + i (in 32 bit if the vectorized array has less than 2^31 elements)
+  auto * offsetTy = arrTy->getNumElements() * vectorWidth < (1ull << 31)
+                        ? builder.getInt32Ty()
+                        : cast<IntegerType>(layout.getIndexType(gep.getType()));
+
+  auto & mod = *vecInfo.getScalarFunction().getParent();
+  auto * laneIdFunc = mod.getFunction(GetIntrinsicName(RVIntrinsic::LaneID));
+  if (!laneIdFunc) laneIdFunc = &DeclareIntrinsic(RVIntrinsic::LaneID, mod);
+  auto * laneId = builder.CreateCall(laneIdFunc, {}, gep.getName() + ".lane");
+  vecInfo.setVectorShape(*laneId, VectorShape::cont());
+
+  auto setShape = [&](Value * val, VectorShape shape) {
+    if (isa<Instruction>(val) && val != idx) vecInfo.setVectorShape(*val, shape);
+  };
+
+  VectorShape idxShape = getVectorShape(*idx);
+  auto * elemIdx = builder.CreateSExtOrTrunc(idx, offsetTy, gep.getName() + ".idx");
+  setShape(elemIdx, idxShape);
+  auto * laneIdx = builder.CreateZExtOrTrunc(laneId, offsetTy);
+  setShape(laneIdx, VectorShape::cont());
+
+  VectorShape offsetShape = vectorWidth * idxShape + VectorShape::cont();
+  auto * scaledIdx = builder.CreateMul(elemIdx, ConstantInt::get(offsetTy, vectorWidth), gep.getName() + ".scaled");
+  setShape(scaledIdx, vectorWidth * idxShape);
+  auto * offset = builder.CreateAdd(scaledIdx, laneIdx, gep.getName() + ".offset");
+  setShape(offset, offsetShape);
+
+  auto * elemPtr = builder.CreateInBoundsGEP(elemTy, &vecAlloc, offset, gep.getName());
+  int64_t elemSize = (int64_t) layout.getTypeStoreSize(elemTy);
+  setShape(elemPtr, getVectorShape(vecAlloc) + elemSize * offsetShape);
+  return elemPtr;
+}
+
 void
-StructOpt::transformLayout(llvm::AllocaInst & allocaInst, ValueToValueMapTy & transformMap) {
+StructOpt::transformLayout(llvm::AllocaInst & allocaInst, ValueToValueMapTy & transformMap,
+                           ArrayRef<GetElementPtrInst*> varyingElemGeps) {
   SmallSet<Value*, 16> seen;
   std::vector<Instruction*> allocaUsers;
   allocaUsers.push_back(&allocaInst);
@@ -212,11 +257,31 @@ StructOpt::transformLayout(llvm::AllocaInst & allocaInst, ValueToValueMapTy & tr
       assert (transformMap.count(ptrVal));
       Value * vecPtrVal = transformMap[ptrVal];
 
+      // lane-wise access (gather/scatter)
+      if (is_contained(varyingElemGeps, ptrVal)) {
+        Instruction * laneAccess = nullptr;
+        if (load) {
+          laneAccess = builder.CreateAlignedLoad(load->getType(), vecPtrVal, load->getAlign(), load->getName());
+          load->replaceAllUsesWith(laneAccess);
+        } else {
+          laneAccess = builder.CreateAlignedStore(storeVal, vecPtrVal, store->getAlign(), store->isVolatile());
+        }
+        vecInfo.setVectorShape(*laneAccess, vecInfo.getVectorShape(*inst));
+        if (store) vecInfo.dropVectorShape(*store);
+        IF_DEBUG_SO { errs() << "\t\t result: " << *laneAccess << "\n"; }
+        continue;
+      }
+
       auto targetType = load ? load->getType() : store->getValueOperand()->getType();
       transformLoadStore(builder, true, inst, targetType, vecPtrVal, storeVal);
 
       continue; // don't step across load/store
 
+    } else if (gep && is_contained(varyingElemGeps, gep)) {
+      IF_DEBUG_SO { errs() << "\t- transform varying element gep " << *gep << "\n"; }
+      transformMap[gep] = createVaryingElemPtr(*gep, cast<AllocaInst>(*transformMap[&allocaInst]));
+      numVaryingAccesses += gep->getNumUses();
+
     } else if (gep) {
       IF_DEBUG_SO { errs() << "\t- transform gep " << *gep << "\n"; }
       auto vecBasePtr = transformMap[gep->getOperand(0)];
@@ -359,7 +424,30 @@ StructOpt::IsGEPByBitcast(Type * actualTy, Type * bcDestTy) {
 /// whether any address computation on this alloc is uniform
 /// the alloca can still be varying because of stored varying values
 bool
-StructOpt::allUniformGeps(llvm::AllocaInst & allocaInst) {
+StructOpt::isElementAccess(AllocaInst & allocaInst, GetElementPtrInst & gep) {
+  auto * arrTy = dyn_cast<ArrayType>(allocaInst.getAllocatedType());
+  if (!arrTy || gep.getPointerOperand() != &allocaInst || gep.getSourceElementType() != arrTy ||
+      gep.getNumIndices() != 2) {
+    return false;
+  }
+  auto * firstIdx = dyn_cast<ConstantInt>(gep.getOperand(1));
+  if (!firstIdx || !firstIdx->isZero()) return false;
+  auto * elemTy = arrTy->getElementType();
+  if (!elemTy->isIntegerTy() && !elemTy->isFloatingPointTy()) return false;
+
+  for (auto * user : gep.users()) {
+    auto * load = dyn_cast<LoadInst>(user);
+    auto * store = dyn_cast<StoreInst>(user);
+    if (load && load->getType() == elemTy) continue;
+    if (store && store->getPointerOperand() == &gep && store->getValueOperand()->getType() == elemTy) continue;
+    IF_DEBUG_SO { errs() << "skip: varying gep with non-element use: " << *user << "\n"; }
+    return false;
+  }
+  return true;
+}
+
+bool
+StructOpt::allUniformGeps(llvm::AllocaInst & allocaInst, SmallVectorImpl<GetElementPtrInst*> & varyingElemGeps) {
   SmallSet<Value*, 16> seen;
   std::vector<Instruction*> allocaUsers;
   allocaUsers.push_back(&allocaInst);
@@ -451,6 +539,10 @@ StructOpt::allUniformGeps(llvm::AllocaInst & allocaInst) {
       // check whether all gep operands are uniform (except the baseptr)
       for (size_t i = 1; i < gep->getNumOperands(); ++i) {
         if (!getVectorShape(*gep->getOperand(i)).isUniform()) {
+          if (allowVaryingIndices && isElementAccess(allocaInst, *gep)) {
+            varyingElemGeps.push_back(gep);
+            break;
+          }
           IF_DEBUG_SO { errs() << "skip: non uniform gep: " << *gep << " at index " << i << " : " << *gep->getOperand(i) << "\n"; }
           return false;
         }
@@ -552,7 +644,8 @@ StructOpt::optimizeAlloca(llvm::AllocaInst & allocaInst) {
   //
   // this alloca may only be:
   // loaded from, stored to (must note store the pointer) use to derive addresses (with uniform indicies) or passsed through phi nodes
-  if (!allUniformGeps(allocaInst)) return false;
+  SmallVector<GetElementPtrInst*, 4> varyingElemGeps;
+  if (!allUniformGeps(allocaInst, varyingElemGeps)) return false;
   IF_DEBUG_SO { errs() << "vectorizable uses!\n"; }
 
 
@@ -573,7 +666,7 @@ StructOpt::optimizeAlloca(llvm::AllocaInst & allocaInst) {
   transformMap[&allocaInst] = vecAlloc;
 
 // update all gep/phi shapes
-  transformLayout(allocaInst, transformMap);
+  transformLayout(allocaInst, transformMap, varyingElemGeps);
 
   numTransformed++;
 
@@ -637,7 +730,9 @@ StructOpt::run() {
   }
 
   if (numTransformed > 0) {
-    Report() << "structOpt: transformed " << numTransformed << " allocas to struct-of-vector layout\n";
+    Report() << "structOpt: transformed " << numTransformed << " allocas to struct-of-vector layout";
+    if (numVaryingAccesses > 0) ReportContinue() << " (" << numVaryingAccesses << " accesses with varying indices)";
+    ReportContinue() << "\n";
   }
   if (numPromoted > 0) {
     Report() << "structOpt: promoted " << numPromoted << " allocas to values\n";
@@ -0,0 +1,386 @@
+//===- src/transform/uniformVersioning.cpp - version regions on runtime-uniform values --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/uniformVersioning.h"
+
+#include "rv/PlatformInfo.h"
+#include "rv/intrinsics.h"
+#include "rv/region/Region.h"
+#include "rv/transform/singleReturnTrans.h"
+#include "rv/vectorizationInfo.h"
+
+#include <llvm/ADT/MapVector.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/PostDominators.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include "rvConfig.h"
+#include "report.h"
+
+#if 1
+#define IF_DEBUG_UV IF_DEBUG
+#else
+#define IF_DEBUG_UV if (true)
+#endif
+
+using namespace llvm;
+
+// give up tracing a branch condition after this many values
+static const size_t MaxTraceSize = 64;
+// version a loop on at most this many values
+static const size_t MaxLoopSources = 4;
+
+namespace rv {
+
+static Value *
+GetBranchCondition(Instruction & term) {
+  auto * branch = dyn_cast<BranchInst>(&term);
+  if (branch) return branch->isConditional() ? branch->getCondition() : nullptr;
+  auto * switchInst = dyn_cast<SwitchInst>(&term);
+  if (switchInst) return switchInst->getCondition();
+  return nullptr;
+}
+
+bool
+UniformVersioning::isCandidate(const Value & val) const {
+  auto * valTy = val.getType();
+  if (!valTy->isIntegerTy() && !valTy->isPointerTy()) return false;
+  if (!vecInfo.getVectorShape(val).isVarying()) return false;
+
+  if (isa<Argument>(val)) return true;
+
+  // defined (once) in the region entry
+  auto * inst = dyn_cast<Instruction>(&val);
+  if (!inst || inst->getParent() != &vecInfo.getEntry()) return false;
+  if (isa<PHINode>(inst) || isa<AllocaInst>(inst) || inst->isTerminator()) return false;
+  return GetIntrinsicID(*inst) == RVIntrinsic::Unknown;
+}
+
+Value *
+UniformVersioning::getDivergenceSource(Instruction & term) const {
+  auto * cond = GetBranchCondition(term);
+  if (!cond) return nullptr;
+
+  Value * source = nullptr;
+  SmallPtrSet<const Value*, 16> visited;
+  SmallVector<Value*, 16> worklist;
+  worklist.push_back(cond);
+
+  while (!worklist.empty()) {
+    auto * val = worklist.pop_back_val();
+    if (!visited.insert(val).second) continue;
+    if (visited.size() > MaxTraceSize) return nullptr;
+    if (vecInfo.getVectorShape(*val).isUniform()) continue;
+
+    if (isCandidate(*val)) {
+      if (source && source != val) return nullptr; // more than one cause
+      source = val;
+      continue;
+    }
+
+    // varying arguments, private memory and lane intrinsics stay varying in the fast path
+    auto * inst = dyn_cast<Instruction>(val);
+    if (!inst || isa<AllocaInst>(inst) || GetIntrinsicID(*inst) != RVIntrinsic::Unknown) return nullptr;
+
+    // phis that join divergent control
+    auto & block = *inst->getParent();
+    if (isa<PHINode>(inst) && (vecInfo.isJoinDivergent(block) || vecInfo.isDivergentLoopExit(block))) return nullptr;
+
+    for (auto & op : inst->operands()) {
+      if (!isa<BasicBlock>(op.get())) worklist.push_back(op.get());
+    }
+  }
+
+  return source;
+}
+
+void
+UniformVersioning::version(Value & source) {
+  auto & func = vecInfo.getScalarFunction();
+  auto & entry = vecInfo.getEntry();
+
+  // the check follows the definition of the source (static allocas stay in the entry block)
+  auto * sourceInst = dyn_cast<Instruction>(&source);
+  auto * splitPt = sourceInst ? sourceInst->getNextNode() : &*entry.getFirstInsertionPt();
+  while (isa<AllocaInst>(splitPt)) splitPt = splitPt->getNextNode();
+  auto * varyingEntry = entry.splitBasicBlock(splitPt, entry.getName() + ".varying");
+
+  IRBuilder<> builder(entry.getTerminator());
+  auto & extractFunc = platInfo.requestIntrinsic(RVIntrinsic::Extract, source.getType());
+  auto * uniSource = builder.CreateCall(&extractFunc, {&source, builder.getInt32(0)}, source.getName() + ".uni");
+  vecInfo.setPinnedShape(*uniSource, VectorShape::uni());
+
+  // clone the region below the check, with the uniform source
+  SmallVector<BasicBlock*, 16> regionBlocks;
+  for (auto & block : func) {
+    if (&block != &entry && vecInfo.inRegion(block)) regionBlocks.push_back(&block);
+  }
+
+  ValueToValueMapTy cloneMap;
+  cloneMap[&source] = uniSource;
+  SmallVector<BasicBlock*, 16> uniBlocks;
+  for (auto * block : regionBlocks) {
+    auto * uniBlock = CloneBasicBlock(block, cloneMap, ".uni", &func);
+    cloneMap[block] = uniBlock;
+    uniBlocks.push_back(uniBlock);
+  }
+  remapInstructionsInBlocks(uniBlocks, cloneMap);
+
+  // pinned shapes carry over to the clones
+  std::vector<const Value*> pinnedValues(vecInfo.pinned_values().begin(), vecInfo.pinned_values().end());
+  for (auto * pinned : pinnedValues) {
+    Value * clonedVal = cloneMap.lookup(pinned);
+    if (clonedVal && clonedVal != uniSource) vecInfo.setPinnedShape(*clonedVal, vecInfo.getVectorShape(*pinned));
+  }
+
+  // enter the fast path if all active lanes agree on the source
+  auto * isSame = builder.CreateICmpEQ(&source, uniSource, "uv.same");
+  auto & allFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::All);
+  auto * allSame = builder.CreateCall(&allFunc, isSame, "uv.allsame");
+  auto * entryBr = entry.getTerminator();
+  BranchInst::Create(cast<BasicBlock>(cloneMap[varyingEntry]), varyingEntry, allSame, entryBr);
+  entryBr->eraseFromParent();
+
+  SingleReturnTrans::run(vecInfo.getRegion());
+  invalidateCFG();
+}
+
+void
+UniformVersioning::invalidateCFG() {
+  auto & func = vecInfo.getScalarFunction();
+
+  // the CFG changed, re-compute LoopInfo (other transforms use the cached result)
+  auto PA = PreservedAnalyses::all();
+  PA.abandon<DominatorTreeAnalysis>();
+  PA.abandon<PostDominatorTreeAnalysis>();
+  PA.abandon<LoopAnalysis>();
+  FAM.invalidate(func, PA);
+  FAM.getResult<LoopAnalysis>(func);
+}
+
+bool
+UniformVersioning::run() {
+  auto & func = vecInfo.getScalarFunction();
+  if (vecInfo.getRegion().isVectorLoop() || &vecInfo.getEntry() != &func.getEntryBlock()) return false;
+
+  // the source that alone causes the divergence of most branches
+  MapVector<Value*, unsigned> numCausedBranches;
+  for (auto & block : func) {
+    if (!vecInfo.inRegion(block)) continue;
+    auto & term = *block.getTerminator();
+    if (term.getNumSuccessors() < 2 || vecInfo.getVectorShape(term).isUniform()) continue;
+
+    auto * source = getDivergenceSource(term);
+    IF_DEBUG_UV { if (source) errs() << "uniVersioning: " << block.getName() << " diverges on " << *source << "\n"; }
+    if (source) ++numCausedBranches[source];
+  }
+
+  Value * bestSource = nullptr;
+  unsigned bestNum = 0;
+  for (auto & it : numCausedBranches) {
+    if (it.second <= bestNum) continue;
+    bestSource = it.first;
+    bestNum = it.second;
+  }
+  if (!bestSource) return false;
+
+  version(*bestSource);
+  Report() << "uniVersioning: " << func.getName() << " has a uniform fast path for " << bestNum
+           << " varying branches on " << bestSource->getName() << "\n";
+  return true;
+}
+
+bool
+UniformVersioning::isVersionableLoop(const Loop & loop) const {
+  if (!loop.getLoopPreheader()) return false;
+
+  // every exit has the edge of its exiting block only (LoopExitCanonicalizer)
+  SmallVector<BasicBlock*, 4> exitBlocks;
+  loop.getExitBlocks(exitBlocks);
+  for (auto * exit : exitBlocks) {
+    if (!exit->getSinglePredecessor()) return false;
+  }
+
+  // values leave the loop through the phis of its exits only (LCSSA)
+  for (auto * block : loop.blocks()) {
+    for (auto & inst : *block) {
+      for (auto * user : inst.users()) {
+        auto * userInst = cast<Instruction>(user);
+        if (loop.contains(userInst)) continue;
+        if (!isa<PHINode>(userInst) || !is_contained(exitBlocks, userInst->getParent())) return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool
+UniformVersioning::getExitSources(const Loop & loop, SmallVectorImpl<Value*> & sources) const {
+  SmallPtrSet<const Value*, 16> visited;
+  SmallVector<Value*, 16> worklist;
+
+  SmallVector<BasicBlock*, 4> exitingBlocks;
+  loop.getExitingBlocks(exitingBlocks);
+  for (auto * exiting : exitingBlocks) {
+    auto & term = *exiting->getTerminator();
+    if (vecInfo.getVectorShape(term).isUniform()) continue;
+    auto * cond = GetBranchCondition(term);
+    if (!cond) return false;
+    worklist.push_back(cond);
+  }
+
+  while (!worklist.empty()) {
+    auto * val = worklist.pop_back_val();
+    if (!visited.insert(val).second) continue;
+    if (visited.size() > MaxTraceSize) return false;
+    if (vecInfo.getVectorShape(*val).isUniform()) continue;
+
+    // varying values of the loop entry (private memory and lane intrinsics are never the same on all lanes)
+    auto * inst = dyn_cast<Instruction>(val);
+    if (!inst || !loop.contains(inst)) {
+      auto * valTy = val->getType();
+      if (!valTy->isIntegerTy() && !valTy->isPointerTy()) return false;
+      if (inst && (isa<AllocaInst>(inst) || GetIntrinsicID(*inst) != RVIntrinsic::Unknown)) return false;
+      if (sources.size() == MaxLoopSources) return false;
+      sources.push_back(val);
+      continue;
+    }
+
+    if (isa<AllocaInst>(inst) || GetIntrinsicID(*inst) != RVIntrinsic::Unknown) return false;
+
+    // phis that join divergent control inside the loop
+    auto & block = *inst->getParent();
+    if (isa<PHINode>(inst) && (vecInfo.isJoinDivergent(block) || vecInfo.isDivergentLoopExit(block))) return false;
+
+    for (auto & op : inst->operands()) {
+      if (!isa<BasicBlock>(op.get())) worklist.push_back(op.get());
+    }
+  }
+
+  return !sources.empty();
+}
+
+void
+UniformVersioning::versionLoop(Loop & loop, ArrayRef<Value*> sources) {
+  auto & func = vecInfo.getScalarFunction();
+  auto & context = func.getContext();
+  auto & header = *loop.getHeader();
+  auto * preheader = loop.getLoopPreheader();
+
+  // each version gets a preheader of its own, the check stays in the old one
+  auto * divPreheader = preheader->splitBasicBlock(preheader->getTerminator(), header.getName() + ".div.pre");
+  auto * uniPreheader = BasicBlock::Create(context, header.getName() + ".uni.pre", &func, divPreheader);
+
+  IRBuilder<> builder(preheader->getTerminator());
+  ValueToValueMapTy cloneMap;
+  Value * allSame = nullptr;
+  for (auto * source : sources) {
+    auto & extractFunc = platInfo.requestIntrinsic(RVIntrinsic::Extract, source->getType());
+    auto * uniSource = builder.CreateCall(&extractFunc, {source, builder.getInt32(0)}, source->getName() + ".uni");
+    vecInfo.setPinnedShape(*uniSource, VectorShape::uni());
+    cloneMap[source] = uniSource;
+
+    auto * isSame = builder.CreateICmpEQ(source, uniSource, "tcv.same");
+    allSame = allSame ? builder.CreateAnd(allSame, isSame, "tcv.same") : isSame;
+  }
+  auto & allFunc = platInfo.requestRVIntrinsicFunc(RVIntrinsic::All);
+  auto * allSameCall = builder.CreateCall(&allFunc, allSame, "tcv.allsame");
+
+  // clone the loop with the uniform sources
+  cloneMap[divPreheader] = uniPreheader;
+  SmallVector<BasicBlock*, 16> uniBlocks;
+  for (auto * block : loop.blocks()) {
+    auto * uniBlock = CloneBasicBlock(block, cloneMap, ".uni", &func);
+    cloneMap[block] = uniBlock;
+    uniBlocks.push_back(uniBlock);
+  }
+  remapInstructionsInBlocks(uniBlocks, cloneMap);
+  BranchInst::Create(cast<BasicBlock>(cloneMap[&header]), uniPreheader);
+
+  // pinned shapes in the loop carry over to the clones
+  std::vector<const Value*> pinnedValues(vecInfo.pinned_values().begin(), vecInfo.pinned_values().end());
+  for (auto * pinned : pinnedValues) {
+    auto * pinnedInst = dyn_cast<Instruction>(pinned);
+    if (!pinnedInst || !loop.contains(pinnedInst)) continue;
+    if (Value * clonedVal = cloneMap.lookup(pinned)) vecInfo.setPinnedShape(*clonedVal, vecInfo.getVectorShape(*pinned));
+  }
+
+  // both versions leave through dedicated exits of their own that join in the old exit
+  SmallVector<BasicBlock*, 4> exitBlocks;
+  loop.getExitBlocks(exitBlocks);
+  for (auto * exit : exitBlocks) {
+    auto * exiting = exit->getSinglePredecessor();
+    auto * uniExiting = cast<BasicBlock>(cloneMap[exiting]);
+    auto * divExit = BasicBlock::Create(context, exit->getName() + ".div", &func, exit);
+    auto * uniExit = BasicBlock::Create(context, exit->getName() + ".uni", &func, exit);
+    exiting->getTerminator()->replaceSuccessorWith(exit, divExit);
+    uniExiting->getTerminator()->replaceSuccessorWith(exit, uniExit);
+    BranchInst::Create(exit, divExit);
+    BranchInst::Create(exit, uniExit);
+
+    for (auto & phi : exit->phis()) {
+      auto * liveOut = phi.getIncomingValueForBlock(exiting);
+      Value * uniLiveOut = cloneMap.lookup(liveOut);
+      if (!uniLiveOut) uniLiveOut = liveOut;
+
+      auto * divPhi = PHINode::Create(phi.getType(), 1, phi.getName() + ".div", divExit->getTerminator());
+      divPhi->addIncoming(liveOut, exiting);
+      auto * uniPhi = PHINode::Create(phi.getType(), 1, phi.getName() + ".uni", uniExit->getTerminator());
+      uniPhi->addIncoming(uniLiveOut, uniExiting);
+
+      phi.removeIncomingValue(exiting, false);
+      phi.addIncoming(divPhi, divExit);
+      phi.addIncoming(uniPhi, uniExit);
+    }
+  }
+
+  // enter the uniform version if all active lanes agree on the sources
+  auto * preheaderBr = preheader->getTerminator();
+  BranchInst::Create(uniPreheader, divPreheader, allSameCall, preheaderBr);
+  preheaderBr->eraseFromParent();
+}
+
+bool
+UniformVersioning::runLoops() {
+  auto & func = vecInfo.getScalarFunction();
+  if (vecInfo.getRegion().isVectorLoop()) return false;
+  auto & LI = FAM.getResult<LoopAnalysis>(func);
+
+  // outermost divergent loops that only diverge on values of their entry (the clone covers inner loops)
+  SmallVector<std::pair<Loop*, SmallVector<Value*, 4>>, 4> versionedLoops;
+  SmallVector<Loop*, 8> worklist(LI.begin(), LI.end());
+  while (!worklist.empty()) {
+    auto * loop = worklist.pop_back_val();
+    SmallVector<Value*, 4> sources;
+    if (vecInfo.inRegion(*loop->getHeader()) && vecInfo.isDivergentLoop(*loop) && isVersionableLoop(*loop) &&
+        getExitSources(*loop, sources)) {
+      versionedLoops.emplace_back(loop, sources);
+      continue;
+    }
+    worklist.append(loop->begin(), loop->end());
+  }
+  if (versionedLoops.empty()) return false;
+
+  for (auto & it : versionedLoops) {
+    auto & loop = *it.first;
+    IF_DEBUG_UV { errs() << "tripCountVersioning: " << loop.getHeader()->getName() << " on " << it.second.size() << " values\n"; }
+    Report() << "tripCountVersioning: " << func.getName() << " has a uniform version of loop "
+             << loop.getHeader()->getName() << " (" << it.second.size() << " varying trip-count values)\n";
+    versionLoop(loop, it.second);
+  }
+
+  invalidateCFG();
+  return true;
+}
+
+} // namespace rv
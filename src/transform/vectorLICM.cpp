@@ -0,0 +1,179 @@
+//===- src/transform/vectorLICM.cpp - hoist invariant vector code after vectorization --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+
+#include "rv/transform/vectorLICM.h"
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/ValueHandle.h>
+
+#include "rvConfig.h"
+#include "report.h"
+
+#if 1
+#define IF_DEBUG_VLICM IF_DEBUG
+#else
+#define IF_DEBUG_VLICM if (true)
+#endif
+
+using namespace llvm;
+
+namespace rv {
+
+VectorLICM::VectorLICM(Function & _vecFunc)
+: vecFunc(_vecFunc)
+, numHoisted(0)
+, numHoistedLoads(0)
+, numBlends(0)
+{}
+
+// plain and masked loads that always access the same lanes of the same address
+static bool
+IsHoistableLoad(const Instruction & inst) {
+  if (auto * load = dyn_cast<LoadInst>(&inst)) return load->isSimple();
+  auto * intrin = dyn_cast<IntrinsicInst>(&inst);
+  return intrin && intrin->getIntrinsicID() == Intrinsic::masked_load;
+}
+
+bool
+VectorLICM::canHoist(Loop & L, DominatorTree & domTree, Instruction & inst, bool loopWritesMemory) const {
+  if (isa<PHINode>(inst) || inst.isTerminator()) return false;
+  if (!inst.getType()->isVectorTy()) return false; // scalar code is up to LLVM's LICM
+
+  for (auto & op : inst.operands()) {
+    auto * opInst = dyn_cast<Instruction>(op.get());
+    if (opInst && L.contains(opInst)) return false;
+  }
+
+  if (IsHoistableLoad(inst)) {
+    // an invariant mask loads the same lanes in every iteration, the access must execute in all of them
+    if (loopWritesMemory) return false;
+    SmallVector<BasicBlock*, 4> exitingBlocks;
+    L.getExitingBlocks(exitingBlocks);
+    if (exitingBlocks.empty()) return false;
+    return all_of(exitingBlocks, [&](BasicBlock * exiting) { return domTree.dominates(inst.getParent(), exiting); });
+  }
+
+  if (inst.mayReadOrWriteMemory()) return false;
+  return isSafeToSpeculativelyExecute(&inst);
+}
+
+void
+VectorLICM::hoistFromLoop(Loop & L, LoopInfo & loopInfo, DominatorTree & domTree) {
+  // invariant code of inner loops ends up in their preheaders (which are blocks of @L)
+  for (auto * childLoop : L) {
+    hoistFromLoop(*childLoop, loopInfo, domTree);
+  }
+
+  auto * preHeader = L.getLoopPreheader();
+  if (!preHeader) return;
+
+  bool loopWritesMemory = any_of(L.blocks(), [](BasicBlock * block) {
+    return any_of(*block, [](Instruction & inst) { return inst.mayWriteToMemory(); });
+  });
+
+  // hoisted instructions make their users invariant
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto * block : L.blocks()) {
+      if (loopInfo.getLoopFor(block) != &L) continue;
+      for (auto it = block->begin(); it != block->end(); ) {
+        auto & inst = *it++;
+        if (!canHoist(L, domTree, inst, loopWritesMemory)) continue;
+
+        IF_DEBUG_VLICM { errs() << "vectorLICM: hoisting " << inst << " out of " << L.getHeader()->getName() << "\n"; }
+        inst.moveBefore(preHeader->getTerminator());
+        if (IsHoistableLoad(inst)) ++numHoistedLoads; else ++numHoisted;
+        changed = true;
+      }
+    }
+  }
+}
+
+// whether select(m, @other, @undefArm) may become @other (the same guard as InstSimplify)
+static bool
+IsFoldableUndefArm(const Value & undefArm, Value & other, SelectInst & blend) {
+  if (isa<PoisonValue>(undefArm)) return true;
+  return isa<UndefValue>(undefArm) && isGuaranteedNotToBeUndefOrPoison(&other, nullptr, &blend);
+}
+
+bool
+VectorLICM::simplifyBlend(SelectInst & blend) {
+  auto * cond = blend.getCondition();
+  auto * trueVal = blend.getTrueValue();
+  auto * falseVal = blend.getFalseValue();
+
+  // lanes that read undef may read the other value, unless that is poison there (eg nsw arithmetic of inactive lanes)
+  Value * replacement = nullptr;
+  if (trueVal == falseVal) replacement = trueVal;
+  else if (IsFoldableUndefArm(*falseVal, *trueVal, blend)) replacement = trueVal;
+  else if (IsFoldableUndefArm(*trueVal, *falseVal, blend)) replacement = falseVal;
+  if (replacement) {
+    blend.replaceAllUsesWith(replacement);
+    blend.eraseFromParent();
+    return true;
+  }
+
+  // the inner blend on the same mask is decided
+  auto * innerTrue = dyn_cast<SelectInst>(trueVal);
+  if (innerTrue && innerTrue->getCondition() == cond) {
+    blend.setOperand(1, innerTrue->getTrueValue());
+    return true;
+  }
+  auto * innerFalse = dyn_cast<SelectInst>(falseVal);
+  if (innerFalse && innerFalse->getCondition() == cond) {
+    blend.setOperand(2, innerFalse->getFalseValue());
+    return true;
+  }
+  return false;
+}
+
+bool
+VectorLICM::run() {
+  IF_DEBUG_VLICM { errs() << "-- vectorLICM log --\n"; }
+
+  // redundant blends first, their operands may be invariant
+  SmallVector<WeakVH, 32> blends;
+  for (auto & block : vecFunc) {
+    for (auto & inst : block) {
+      if (isa<SelectInst>(inst) && inst.getType()->isVectorTy()) blends.push_back(&inst);
+    }
+  }
+  for (auto & handle : blends) {
+    auto * blend = dyn_cast_or_null<SelectInst>(handle);
+    while (blend) {
+      // a rewritten blend may simplify further (erased blends leave a null handle)
+      if (!simplifyBlend(*blend)) break;
+      ++numBlends;
+      blend = dyn_cast_or_null<SelectInst>(handle);
+    }
+  }
+
+  DominatorTree domTree(vecFunc);
+  LoopInfo loopInfo(domTree);
+  for (auto * L : loopInfo) {
+    hoistFromLoop(*L, loopInfo, domTree);
+  }
+
+  size_t numChanged = numHoisted + numHoistedLoads + numBlends;
+  if (numChanged > 0) {
+    Report() << "vectorLICM: hoisted " << numHoisted << " vector instructions and " << numHoistedLoads
+             << " loads, removed " << numBlends << " blends\n";
+  }
+
+  IF_DEBUG_VLICM { errs() << "-- end of vectorLICM log --\n"; }
+  return numChanged > 0;
+}
+
+} // namespace rv
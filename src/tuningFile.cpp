@@ -0,0 +1,132 @@
+//===- src/tuningFile.cpp - per-loop/per-function tuning decisions --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/tuningFile.h"
+
+#include "rv/config.h"
+#include "report.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
+#include <mutex>
+
+using namespace llvm;
+
+namespace rv {
+
+// the Config toggle named \p name, nullptr if unknown
+static bool *
+GetConfigFlag(Config & config, StringRef name) {
+  if (name == "boscc") return &config.enableHeuristicBOSCC;
+  if (name == "cif") return &config.enableCoherentIF;
+  if (name == "srov") return &config.enableSROV;
+  if (name == "structopt") return &config.enableStructOpt;
+  if (name == "soa-gathers") return &config.enableSoAGathers;
+  if (name == "gathercost") return &config.enableGatherCost;
+  if (name == "gathers") return &config.useScatterGatherIntrinsics;
+  if (name == "table-lookup") return &config.enableTableLookup;
+  if (name == "address-dispatch") return &config.enableAddressDispatch;
+  if (name == "index-runs") return &config.enableIndexRuns;
+  if (name == "interleaved-access") return &config.enableInterleavedAccess;
+  if (name == "gather-coalescing") return &config.enableGatherCoalescing;
+  if (name == "tailfold") return &config.enableTailFolding;
+  if (name == "epilogue") return &config.enableVectorEpilogue;
+  if (name == "overlap-tail") return &config.enableOverlapTail;
+  if (name == "promote-allocas") return &config.enablePromoteAllocas;
+  if (name == "promote-memory-reductions") return &config.enablePromoteMemReductions;
+  if (name == "prefetch") return &config.enablePrefetch;
+  if (name == "nontemporal") return &config.enableStreamingStores;
+  return nullptr;
+}
+
+void
+TuningEntry::apply(Config & config) const {
+  for (auto & flag : flags) {
+    *GetConfigFlag(config, flag.first) = flag.second;
+  }
+}
+
+TuningFile::TuningFile(const std::string & tuningPath) {
+  read(tuningPath);
+}
+
+void
+TuningFile::read(const std::string & tuningPath) {
+  auto bufferOrErr = MemoryBuffer::getFile(tuningPath);
+  if (!bufferOrErr) {
+    Report() << "tuning: could not read " << tuningPath << "\n";
+    return;
+  }
+
+  Config dummyConfig;
+  StringRef text = (*bufferOrErr)->getBuffer();
+  while (!text.empty()) {
+    StringRef line;
+    std::tie(line, text) = text.split('\n');
+    line = line.split('#').first.trim();
+    if (line.empty()) continue;
+
+    SmallVector<StringRef, 8> fields;
+    line.split(fields, ' ', -1, false);
+    if (fields.size() < 2) {
+      Report() << "tuning: skipping malformed line '" << line << "'\n";
+      continue;
+    }
+
+    TuningEntry entry;
+    bool valid = true;
+    for (size_t i = 2; i < fields.size(); ++i) {
+      StringRef key, value;
+      std::tie(key, value) = fields[i].split('=');
+      unsigned num;
+      if (value.getAsInteger(10, num)) {
+        valid = false;
+      } else if (key == "width") {
+        entry.width = num;
+      } else if (key == "interleave") {
+        entry.interleave = num;
+      } else if (key == "trips") {
+        entry.trips = num;
+      } else if (GetConfigFlag(dummyConfig, key) && num <= 1) {
+        entry.flags.emplace_back(key.str(), num == 1);
+      } else {
+        valid = false;
+      }
+    }
+    if (!valid) {
+      Report() << "tuning: skipping malformed line '" << line << "'\n";
+      continue;
+    }
+
+    // later lines override earlier ones
+    entries[(fields[0] + " " + fields[1]).str()] = entry;
+  }
+}
+
+const TuningFile *
+TuningFile::get() {
+  static std::once_flag loaded;
+  static std::unique_ptr<TuningFile> tuningFile;
+  std::call_once(loaded, [] {
+    if (const char * tuningPath = getenv("RV_TUNING"))
+      tuningFile.reset(new TuningFile(tuningPath));
+  });
+  return tuningFile.get();
+}
+
+const TuningEntry *
+TuningFile::lookup(StringRef funcName, StringRef region) const {
+  auto it = entries.find((funcName + " " + region).str());
+  if (it == entries.end()) it = entries.find((funcName + " *").str());
+  if (it == entries.end()) return nullptr;
+  return &it->second;
+}
+
+} // namespace rv
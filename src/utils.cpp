@@ -49,57 +49,69 @@ void MaterializeEntryMask(Function &F, rv::PlatformInfo &platInfo) {
 }
 
 bool
-parseVectorMapping(Function & scalarFn, StringRef & attribText, VectorMapping & mapping, bool createMissingDecl) {
+parseVectorMapping(Function & scalarFn, StringRef & attribText, VectorMapping & mapping, bool createMissingDecl, StringRef vectorFnName) {
   // FIXME use LLVM VectorUtils
   if (!attribText.startswith("_ZGV")) return false;
 
-  if (attribText.size() < 6) return false;
+  // "_ZGV<ISA><NeedsMask><VectorWidth>", the ISA is a single letter or "_LLVM_"
+  size_t maskIdx = attribText.startswith("_ZGV_LLVM_") ? 10 : 5;
+  if (attribText.size() < maskIdx + 2) return false;
 
   // parse general vector attribs
   // int vecRegisterBits = ParseRegisterWidth(attribText[4]); // TODO use ISA hint for rvConfig
 
-  bool needsMask = attribText[5] == 'M';
+  bool needsMask = attribText[maskIdx] == 'M';
 
-  // parse vectorization factor
-  char * pos; // = attribText.begin() + 6; // "_ZGV<API><NeedsMask><VectorWidth>"
-  unsigned vectorWidth = strtol(attribText.begin() + 6, &pos, 10);
+  // parse vectorization factor (scalable 'x' variants are not supported)
+  std::string mangledText = attribText.str();
+  const char * pos = mangledText.c_str() + maskIdx + 1;
+  char * nextPos;
+  unsigned vectorWidth = strtol(pos, &nextPos, 10);
+  if (nextPos == pos || vectorWidth == 0) return false;
+  pos = nextPos;
 
   // process arument shapes
   VectorShapeVec argShapes;
 
-  auto * endText = attribText.end();
-
-  for (; pos != endText && *pos != '_'; ) {
+  for (; *pos != '\0' && *pos != '_'; ) {
     char token = *pos;
     switch(token) {
       case 'v': argShapes.push_back(VectorShape::varying()); ++pos; break;
       case 'u': argShapes.push_back(VectorShape::uni()); ++pos; break;
       case 'a': {
-        char * nextPos;
         ++pos;
         auto alignVal = strtol(pos, &nextPos, 10);
         pos = nextPos;
 
         int lastArgIdx = argShapes.size() - 1;
-        assert(lastArgIdx >= 0);
+        if (lastArgIdx < 0) return false;
         argShapes[lastArgIdx].setAlignment(alignVal);
       } break;
       case 'l': {
         ++pos;
-        char * nextPos;
+        // "l" (unit stride), "l<stride>" or "ln<negative stride>"
+        int sign = 1;
+        if (*pos == 'n') {
+          sign = -1;
+          ++pos;
+        }
         auto strideVal = strtol(pos, &nextPos, 10);
+        if (nextPos == pos) strideVal = 1;
         pos = nextPos;
 
-        argShapes.push_back(VectorShape::strided(strideVal));
+        argShapes.push_back(VectorShape::strided(sign * strideVal));
       } break;
-      // case 's': // ??
 
+      // linear references (R, L, U) and runtime strides (s) are not supported
       default:
-        abort();
+        return false;
     }
   }
 
-  Function * simdDecl = scalarFn.getParent()->getFunction(attribText);
+  if (argShapes.size() != scalarFn.arg_size()) return false;
+
+  StringRef declName = vectorFnName.empty() ? attribText : vectorFnName;
+  Function * simdDecl = scalarFn.getParent()->getFunction(declName);
   if (!createMissingDecl && !simdDecl) return false;
 
   mapping.scalarFn = &scalarFn;
@@ -112,7 +124,7 @@ parseVectorMapping(Function & scalarFn, StringRef & attribText, VectorMapping &
     mapping.vectorFn = simdDecl;
   } else {
     mapping.vectorFn = createVectorDeclaration(scalarFn, mapping.resultShape, mapping.argShapes, vectorWidth, mapping.maskPos);
-    mapping.vectorFn->setName(attribText);
+    mapping.vectorFn->setName(declName);
     mapping.vectorFn->setLinkage(GlobalValue::ExternalLinkage); // FIXME for debugging
   }
 
@@ -125,9 +137,44 @@ vectorizeType(Type* scalarTy, VectorShape shape, unsigned vectorWidth)
     if (scalarTy->isVoidTy()) return scalarTy;
     if (!shape.isDefined() || shape.hasStridedShape()) return scalarTy;
 
+    // varying aggregates are passed by value as one vector per member
+    if (scalarTy->isAggregateType()) {
+      auto * sovTy = getStructOfVectorsType(*scalarTy, vectorWidth);
+      if (sovTy) return sovTy;
+    }
+
+    // short vectors are passed in SoA order (element j of lane l at j * vectorWidth + l)
+    if (auto * innerTy = dyn_cast<FixedVectorType>(scalarTy)) {
+      return FixedVectorType::get(innerTy->getElementType(), innerTy->getNumElements() * vectorWidth);
+    }
+
     return FixedVectorType::get(scalarTy, vectorWidth);
 }
 
+Type*
+getStructOfVectorsType(Type & scalarTy, unsigned vectorWidth)
+{
+    if (scalarTy.isIntegerTy() || scalarTy.isFloatingPointTy()) {
+      return FixedVectorType::get(&scalarTy, vectorWidth);
+    }
+
+    if (auto * arrTy = dyn_cast<ArrayType>(&scalarTy)) {
+      auto * vecElemTy = arrTy->getNumElements() > 0 ? getStructOfVectorsType(*arrTy->getElementType(), vectorWidth) : nullptr;
+      return vecElemTy ? ArrayType::get(vecElemTy, arrTy->getNumElements()) : nullptr;
+    }
+
+    auto * structTy = dyn_cast<StructType>(&scalarTy);
+    if (!structTy || structTy->isOpaque() || structTy->isPacked() || structTy->getNumElements() == 0) return nullptr;
+
+    std::vector<Type*> vecElemTys;
+    for (auto * elemTy : structTy->elements()) {
+      auto * vecElemTy = getStructOfVectorsType(*elemTy, vectorWidth);
+      if (!vecElemTy) return nullptr;
+      vecElemTys.push_back(vecElemTy);
+    }
+    return StructType::get(scalarTy.getContext(), vecElemTys);
+}
+
 Function*
 createVectorDeclaration(Function& scalarFn, VectorShape resShape,
                         const VectorShapeVec& argShapes, unsigned vectorWidth,
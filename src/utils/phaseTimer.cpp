@@ -0,0 +1,262 @@
+//===- src/utils/phaseTimer.cpp - per-phase compile-time records --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "utils/phaseTimer.h"
+
+#include "rv/vectorizationInfo.h"
+#include "report.h"
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define RV_HAVE_GETRUSAGE
+#endif
+
+using namespace llvm;
+
+static std::mutex phaseLogMutex;
+static std::unique_ptr<raw_fd_ostream> phaseLogFile;
+
+// caller holds phaseLogMutex
+static raw_ostream &
+phaseLog() {
+  if (phaseLogFile) return *phaseLogFile;
+
+  std::string logPath;
+  if (const char *timeFile = getenv("RV_TIME_PHASES_FILE")) {
+    logPath = timeFile;
+  } else if (const char *repFile = getenv("RV_REPORT_FILE")) {
+    logPath = std::string(repFile) + ".phases.jsonl";
+  } else {
+    return errs();
+  }
+
+  std::error_code EC;
+  phaseLogFile = std::make_unique<raw_fd_ostream>(logPath, EC, sys::fs::OF_Append);
+  if (EC) {
+    rv::Error() << "could not open " << logPath << ": " << EC.message() << "\n";
+    phaseLogFile.reset();
+    return errs();
+  }
+  return *phaseLogFile;
+}
+
+// high-water mark of the resident set (kB), 0 if unknown
+static uint64_t
+getPeakRSS() {
+#ifdef RV_HAVE_GETRUSAGE
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024; // bytes
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+static size_t
+CountInstructions(const Function & F) {
+  return F.getInstructionCount();
+}
+
+static std::mutex traceMutex;
+static std::unique_ptr<raw_fd_ostream> traceFile;
+static bool traceHasEvents = false;
+
+// the RV_TRACE stream ("%p" in the path is the process id), nullptr if it cannot be opened.
+// Call with traceMutex held.
+static raw_ostream *
+traceLog() {
+  static bool opened = false;
+  if (opened) return traceFile.get();
+  opened = true;
+
+  std::string tracePath = getenv("RV_TRACE");
+  size_t pidPos = tracePath.find("%p");
+  if (pidPos != std::string::npos) tracePath.replace(pidPos, 2, std::to_string(sys::Process::getProcessId()));
+
+  std::error_code EC;
+  traceFile = std::make_unique<raw_fd_ostream>(tracePath, EC, sys::fs::OF_None);
+  if (EC) {
+    rv::Error() << "could not open RV_TRACE=" << tracePath << ": " << EC.message() << "\n";
+    traceFile.reset();
+    return nullptr;
+  }
+  // JSON array format, the closing bracket is optional
+  *traceFile << "[\n";
+  return traceFile.get();
+}
+
+// microseconds since the first traced scope
+static double
+TraceNowUs() {
+  static const auto origin = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+// append a complete event ("ph": "X") of the scope that started at \p startUs, \p writeArgs adds its "args"
+static void
+WriteTraceEvent(StringRef name, StringRef category, double startUs, function_ref<void(json::OStream &)> writeArgs) {
+  double durUs = TraceNowUs() - startUs;
+  auto threadId = std::hash<std::thread::id>()(std::this_thread::get_id()) & 0x7fffffff;
+
+  std::lock_guard<std::mutex> guard(traceMutex);
+  auto * out = traceLog();
+  if (!out) return;
+  if (traceHasEvents) *out << ",\n";
+  traceHasEvents = true;
+  {
+    json::OStream J(*out);
+    J.object([&] {
+      J.attribute("name", name);
+      J.attribute("cat", category);
+      J.attribute("ph", "X");
+      J.attribute("ts", startUs);
+      J.attribute("dur", durUs);
+      J.attribute("pid", (int64_t) sys::Process::getProcessId());
+      J.attribute("tid", (int64_t) threadId);
+      J.attributeObject("args", [&] { writeArgs(J); });
+    });
+  }
+  out->flush();
+}
+
+namespace rv {
+
+bool
+PhaseTimer::isEnabled() {
+  static const bool enabled = CheckFlag("RV_TIME_PHASES");
+  return enabled;
+}
+
+PhaseTimer::PhaseTimer(StringRef phaseName, const VectorizationInfo & vecInfo)
+: enabled(isEnabled())
+, traced(EntityTimer::isEnabled())
+, phase(phaseName.str())
+, scalarFn(&vecInfo.getScalarFunction())
+, vectorFn(vecInfo.getMapping().vectorFn)
+, instsBefore(0)
+, traceStartUs(0.0)
+{
+  if (vectorFn == scalarFn) vectorFn = nullptr;
+  if (!enabled && !traced) return;
+  instsBefore = countInstructions();
+  startTime = TimeRecord::getCurrentTime(true);
+  if (traced) traceStartUs = TraceNowUs();
+}
+
+PhaseTimer::PhaseTimer(StringRef phaseName, const Function & F)
+: enabled(isEnabled())
+, traced(EntityTimer::isEnabled())
+, phase(phaseName.str())
+, scalarFn(&F)
+, vectorFn(nullptr)
+, instsBefore(0)
+, traceStartUs(0.0)
+{
+  if (!enabled && !traced) return;
+  instsBefore = countInstructions();
+  startTime = TimeRecord::getCurrentTime(true);
+  if (traced) traceStartUs = TraceNowUs();
+}
+
+size_t
+PhaseTimer::countInstructions() const {
+  size_t numInsts = CountInstructions(*scalarFn);
+  if (vectorFn) numInsts += CountInstructions(*vectorFn);
+  return numInsts;
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (!enabled && !traced) return;
+
+  TimeRecord elapsed = TimeRecord::getCurrentTime(false);
+  elapsed -= startTime;
+  size_t instsAfter = countInstructions();
+
+  if (traced) {
+    WriteTraceEvent(phase, "phase", traceStartUs, [&](json::OStream & J) {
+      J.attribute("function", scalarFn->getName());
+      J.attribute("insts_before", (int64_t) instsBefore);
+      J.attribute("insts_after", (int64_t) instsAfter);
+      J.attribute("mem_delta_bytes", (int64_t) elapsed.getMemUsed());
+    });
+  }
+  if (!enabled) return;
+
+  std::lock_guard<std::mutex> guard(phaseLogMutex);
+  auto & out = phaseLog();
+  {
+    json::OStream J(out);
+    J.object([&] {
+      J.attribute("function", scalarFn->getName());
+      if (vectorFn) J.attribute("vector_function", vectorFn->getName());
+      J.attribute("phase", phase);
+      J.attribute("wall_ms", elapsed.getWallTime() * 1000.0);
+      J.attribute("user_ms", elapsed.getUserTime() * 1000.0);
+      J.attribute("insts_before", (int64_t) instsBefore);
+      J.attribute("insts_after", (int64_t) instsAfter);
+      J.attribute("mem_delta_bytes", (int64_t) elapsed.getMemUsed());
+      J.attribute("peak_rss_kb", (int64_t) getPeakRSS());
+    });
+  }
+  out << "\n";
+  out.flush();
+}
+
+bool
+EntityTimer::isEnabled() {
+  static const bool enabled = getenv("RV_TRACE") != nullptr;
+  return enabled;
+}
+
+EntityTimer::EntityTimer(const char * _kind, const Value & entity, const Function & F)
+: enabled(isEnabled())
+, kind(_kind)
+, name()
+, funcName()
+, startUs(0.0)
+, startMem(0)
+{
+  if (!enabled) return;
+  raw_string_ostream nameOut(name);
+  nameOut << kind << " ";
+  if (entity.hasName()) nameOut << entity.getName();
+  else entity.printAsOperand(nameOut, false);
+  nameOut.flush();
+  funcName = F.getName().str();
+
+  startMem = sys::Process::GetMallocUsage();
+  startUs = TraceNowUs();
+}
+
+EntityTimer::~EntityTimer() {
+  if (!enabled) return;
+
+  int64_t memDelta = (int64_t) sys::Process::GetMallocUsage() - (int64_t) startMem;
+  WriteTraceEvent(name, kind, startUs, [&](json::OStream & J) {
+    J.attribute("function", funcName);
+    J.attribute("mem_delta_bytes", memDelta);
+  });
+}
+
+} // namespace rv
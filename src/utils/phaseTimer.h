@@ -0,0 +1,86 @@
+//===- src/utils/phaseTimer.h - per-phase compile-time records --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// RAII timers for the phases of the vectorizer pipeline (RV_TIME_PHASES).
+// Every phase emits one JSON record (JSON Lines) with the wall/user time, the
+// instruction counts before and after the phase and the memory high-water
+// mark of the process.
+//
+// Records go to RV_TIME_PHASES_FILE, or to "<RV_REPORT_FILE>.phases.jsonl"
+// if only RV_REPORT_FILE is set, or to stderr otherwise.
+//
+// RV_TRACE=<file> writes a Chrome trace (JSON array format, chrome://tracing,
+// Perfetto, speedscope) of the phases and of the IR entities that the costly
+// parts of the pipeline process (EntityTimer: the divergent loops of
+// GuardedDivLoopTrans, the branches of the Linearizer, the callees of the
+// recursive resolver). Every event carries the allocated memory (malloc)
+// of its scope. Nested events make up the flame graph.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef RV_UTILS_PHASETIMER_H
+#define RV_UTILS_PHASETIMER_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Timer.h>
+
+#include <string>
+
+namespace llvm {
+  class Function;
+  class Value;
+}
+
+namespace rv {
+
+class VectorizationInfo;
+
+class PhaseTimer {
+  bool enabled;
+  bool traced; // RV_TRACE
+  std::string phase;
+  const llvm::Function * scalarFn;
+  const llvm::Function * vectorFn;
+  size_t instsBefore;
+  llvm::TimeRecord startTime;
+  double traceStartUs;
+
+  size_t countInstructions() const;
+
+public:
+  // time the phase \p phaseName on the scalar (and vector) function of \p vecInfo.
+  PhaseTimer(llvm::StringRef phaseName, const VectorizationInfo & vecInfo);
+  // time the phase \p phaseName on \p F.
+  PhaseTimer(llvm::StringRef phaseName, const llvm::Function & F);
+  ~PhaseTimer();
+
+  // whether RV_TIME_PHASES is set
+  static bool isEnabled();
+};
+
+// RAII trace event (RV_TRACE) for the IR entity \p entity (a loop header, branch block or callee)
+// of the kind \p kind ("loop", "branch", "call") in \p F.
+class EntityTimer {
+  bool enabled;
+  const char * kind;
+  std::string name; // "<kind> <entity>" (the entity may be gone at the end of the scope)
+  std::string funcName;
+  double startUs;
+  size_t startMem;
+
+public:
+  EntityTimer(const char * kind, const llvm::Value & entity, const llvm::Function & F);
+  ~EntityTimer();
+
+  // whether RV_TRACE is set
+  static bool isEnabled();
+};
+
+} // namespace rv
+
+#endif // RV_UTILS_PHASETIMER_H
@@ -0,0 +1,72 @@
+#include "utils/profileWriter.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
+using namespace llvm;
+
+namespace rv {
+
+ProfileWriter::ProfileWriter(Module & _mod, StringRef profilePath, StringRef writerName)
+: mod(_mod)
+, writerFunc(nullptr)
+, exitBlock(nullptr)
+, builder(_mod.getContext())
+, fileHandle(nullptr)
+, fprintfFunc()
+{
+  auto & ctx = mod.getContext();
+  auto * intTy = Type::getInt32Ty(ctx);
+  auto * charPtrTy = Type::getInt8PtrTy(ctx);
+
+  auto fopenFunc = mod.getOrInsertFunction("fopen", FunctionType::get(charPtrTy, {charPtrTy, charPtrTy}, false));
+  fprintfFunc = mod.getOrInsertFunction("fprintf", FunctionType::get(intTy, {charPtrTy, charPtrTy}, true));
+
+  writerFunc = Function::Create(FunctionType::get(Type::getVoidTy(ctx), false), GlobalValue::InternalLinkage, writerName, &mod);
+  auto * entryBlock = BasicBlock::Create(ctx, "entry", writerFunc);
+  auto * writeBlock = BasicBlock::Create(ctx, "write", writerFunc);
+  exitBlock = BasicBlock::Create(ctx, "exit", writerFunc);
+
+  builder.SetInsertPoint(entryBlock);
+  fileHandle = builder.CreateCall(fopenFunc, {builder.CreateGlobalStringPtr(profilePath), builder.CreateGlobalStringPtr("a")}, "profile.file");
+  builder.CreateCondBr(builder.CreateIsNull(fileHandle), exitBlock, writeBlock);
+
+  builder.SetInsertPoint(writeBlock);
+}
+
+Value *
+ProfileWriter::loadCounter(GlobalVariable & counters, unsigned idx) {
+  auto * counterPtr = builder.CreateConstInBoundsGEP2_32(counters.getValueType(), &counters, 0, idx);
+  return builder.CreateLoad(builder.getInt64Ty(), counterPtr);
+}
+
+void
+ProfileWriter::print(StringRef format, ArrayRef<Value*> args) {
+  SmallVector<Value*, 8> printArgs = {fileHandle, builder.CreateGlobalStringPtr(format)};
+  printArgs.append(args.begin(), args.end());
+  builder.CreateCall(fprintfFunc, printArgs);
+}
+
+void
+ProfileWriter::finalize() {
+  auto & ctx = mod.getContext();
+  auto fcloseFunc = mod.getOrInsertFunction("fclose", FunctionType::get(Type::getInt32Ty(ctx), {Type::getInt8PtrTy(ctx)}, false));
+  builder.CreateCall(fcloseFunc, {fileHandle});
+  builder.CreateBr(exitBlock);
+
+  builder.SetInsertPoint(exitBlock);
+  builder.CreateRetVoid();
+
+  appendToGlobalDtors(mod, writerFunc, 0);
+}
+
+GlobalVariable &
+CreateCounterArray(Module & mod, unsigned numCounters, StringRef name) {
+  auto * countersTy = ArrayType::get(Type::getInt64Ty(mod.getContext()), numCounters);
+  return *new GlobalVariable(mod, countersTy, false, GlobalValue::InternalLinkage, ConstantAggregateZero::get(countersTy), name);
+}
+
+} // namespace rv
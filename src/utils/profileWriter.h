@@ -0,0 +1,43 @@
+#ifndef RV_PROFILEWRITER_H
+#define RV_PROFILEWRITER_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/IRBuilder.h>
+
+namespace llvm {
+  class GlobalVariable;
+  class Module;
+}
+
+/// /brief Emits a function that appends profile counters to a text file at program exit.
+namespace rv {
+  class ProfileWriter {
+    llvm::Module & mod;
+    llvm::Function * writerFunc;
+    llvm::BasicBlock * exitBlock;
+    llvm::IRBuilder<> builder;
+    llvm::Value * fileHandle;
+    llvm::FunctionCallee fprintfFunc;
+
+  public:
+    // the writer opens \p profilePath in append mode and does nothing if that fails.
+    ProfileWriter(llvm::Module & _mod, llvm::StringRef profilePath, llvm::StringRef writerName);
+
+    // load the i64 counter \p idx of the counter array \p counters.
+    llvm::Value * loadCounter(llvm::GlobalVariable & counters, unsigned idx);
+
+    // append fprintf(file, \p format, \p args..).
+    void print(llvm::StringRef format, llvm::ArrayRef<llvm::Value*> args);
+
+    llvm::IRBuilder<> & getBuilder() { return builder; }
+
+    // close the file and register the writer as global destructor.
+    void finalize();
+  };
+
+  // zero-initialized, module-internal array of \p numCounters i64 counters.
+  llvm::GlobalVariable & CreateCounterArray(llvm::Module & mod, unsigned numCounters, llvm::StringRef name);
+}
+
+#endif // RV_PROFILEWRITER_H
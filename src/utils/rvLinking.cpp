@@ -6,6 +6,7 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/InstIterator.h>
+#include <llvm/Support/Error.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 #include "rvConfig.h"
@@ -108,6 +109,12 @@ Function &cloneFunctionIntoModule(Function &func, Module &cloneInto, StringRef n
   }
 #endif
 
+  // lazily loaded bitcode (SLEEF) - read the body (and with it, the callees) on demand
+  if (func.isMaterializable()) {
+    if (llvm::Error Err = func.materialize())
+      report_fatal_error(std::move(Err));
+  }
+
   // create function in new module, create the argument mapping, clone function into new function body, return
   Function & clonedFn = *Function::Create(func.getFunctionType(), Function::LinkageTypes::ExternalLinkage,
                                         name, &cloneInto);
@@ -154,4 +161,34 @@ Function &cloneFunctionIntoModule(Function &func, Module &cloneInto, StringRef n
   return clonedFn;
 }
 
+// Resolve globals by name in the destination module.
+static Value*
+LookupByName(GlobalValue &GV, Module &M) {
+  auto *destGV = M.getNamedValue(GV.getName());
+  if (!destGV || destGV->getType() != GV.getType()) return nullptr;
+  return destGV;
+}
+
+void cloneFunctionBodyInto(Function &srcFn, Function &destFn) {
+  auto &destMod = *destFn.getParent();
+
+  ValueToValueMapTy VMap;
+  auto destArg = destFn.arg_begin();
+  for (auto &srcArg : srcFn.args()) {
+    destArg->setName(srcArg.getName());
+    VMap[&srcArg] = &*destArg++;
+  }
+
+  for (auto &I : instructions(srcFn)) {
+    for (auto &Op : I.operands()) {
+      auto *usedConst = dyn_cast<Constant>(Op.get());
+      if (!usedConst) continue;
+      VMap[usedConst] = &cloneConstant(*usedConst, destMod, LookupByName);
+    }
+  }
+
+  SmallVector<ReturnInst *, 1> Returns; // unused
+  CloneFunctionInto(&destFn, &srcFn, VMap, CloneFunctionChangeType::DifferentModule, Returns);
+}
+
 } // namespace rv
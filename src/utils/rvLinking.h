@@ -18,6 +18,10 @@ namespace rv {
   llvm::Value & cloneConstant(llvm::Constant& constVal, llvm::Module & cloneInto, LinkerCallback LCB);
   llvm::GlobalValue & cloneGlobalIntoModule(llvm::GlobalValue &gv, llvm::Module &cloneInto, LinkerCallback LCB);
   llvm::Function &cloneFunctionIntoModule(llvm::Function &func, llvm::Module &cloneInto, llvm::StringRef name, LinkerCallback LCB);
+
+  // Give the declaration \p destFn the body of \p srcFn (same LLVMContext, different module).
+  // Globals used by \p srcFn are resolved by name in the module of \p destFn. Missing ones are cloned.
+  void cloneFunctionBodyInto(llvm::Function &srcFn, llvm::Function &destFn);
 }
 
 #endif // RV_RVLINKING_H
@@ -10,6 +10,10 @@
 
 #include "rvTools.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
 #include <sstream>   // stringstream
 #include <stdexcept> // logic_error
 #include <map>
@@ -23,9 +27,12 @@
 #include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/Attributes.h>
 #include <llvm/IR/Metadata.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/Analysis/LoopInfo.h> // Loop
 
+#include <llvm/Support/Compression.h>
 #include <llvm/Support/MemoryBuffer.h> // MemoryBuffer
+#include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/FileSystem.h>
@@ -132,9 +139,43 @@ typesMatch(Type* t1, Type* t2)
 #undef MATCH_RETURN
 }
 
+// zlib-compressed BC buffers (gen_cpp.py --compress, RV_COMPRESS_GENBC):
+// 'RVZ1', uncompressed size (8 bytes, little endian), zlib stream
+static const char CompressedBufferMagic[4] = {'R', 'V', 'Z', '1'};
+static const size_t CompressedBufferHeaderLen = 12;
+
+// inflates \p buffer once on first use (returns \p buffer if it is not compressed).
+// Lazy modules read from the inflated buffer, it is never released.
+static StringRef
+requestInflatedBuffer(const char buffer[], size_t length) {
+  if (length < CompressedBufferHeaderLen || std::memcmp(buffer, CompressedBufferMagic, 4) != 0)
+    return StringRef(buffer, length);
+
+  static std::mutex inflateMutex;
+  static auto * inflatedBuffers = new DenseMap<const char*, SmallVector<char, 0>*>();
+  std::lock_guard<std::mutex> guard(inflateMutex);
+  auto *& inflated = (*inflatedBuffers)[buffer];
+  if (inflated) return StringRef(inflated->data(), inflated->size());
+
+  uint64_t rawLength = 0;
+  for (int i = 0; i < 8; ++i) {
+    rawLength |= uint64_t((unsigned char) buffer[4 + i]) << (8 * i);
+  }
+
+  auto * rawBuffer = new SmallVector<char, 0>();
+  StringRef compressed(buffer + CompressedBufferHeaderLen, length - CompressedBufferHeaderLen);
+  if (Error err = zlib::uncompress(compressed, *rawBuffer, rawLength)) {
+    logAllUnhandledErrors(std::move(err), errs(), "rv::requestInflatedBuffer: ");
+    report_fatal_error("rv: could not inflate embedded bitcode (LLVM built without zlib?)");
+  }
+  inflated = rawBuffer;
+  return StringRef(inflated->data(), inflated->size());
+}
+
 Module*
 createModuleFromBuffer(const char buffer[], size_t length, LLVMContext & context) {
-  std::unique_ptr<MemoryBuffer> mb = MemoryBuffer::getMemBuffer(StringRef(buffer, length), "", false);
+  StringRef inflated = requestInflatedBuffer(buffer, length);
+  std::unique_ptr<MemoryBuffer> mb = MemoryBuffer::getMemBuffer(inflated, "", false);
   SMDiagnostic smDiag;
   std::unique_ptr<Module> modPtr = parseIR(*mb, smDiag, context);
   if (!modPtr) smDiag.print("rv::createModuleFromBuffer", errs());
@@ -142,6 +183,22 @@ createModuleFromBuffer(const char buffer[], size_t length, LLVMContext & context
   return modPtr.release();
 }
 
+Module*
+createLazyModuleFromBuffer(const char buffer[], size_t length, LLVMContext & context) {
+  StringRef inflated = requestInflatedBuffer(buffer, length);
+  auto *bufferStart = reinterpret_cast<const unsigned char*>(inflated.data());
+  if (!isBitcode(bufferStart, bufferStart + inflated.size()))
+    return createModuleFromBuffer(inflated.data(), inflated.size(), context);
+
+  MemoryBufferRef mbRef(inflated, "");
+  auto modOrErr = getLazyBitcodeModule(mbRef, context);
+  if (!modOrErr) {
+    logAllUnhandledErrors(modOrErr.takeError(), errs(), "rv::createLazyModuleFromBuffer: ");
+    return nullptr;
+  }
+  return modOrErr->release();
+}
+
 Module*
 createModuleFromFile(const std::string & fileName, LLVMContext & context) {
     SMDiagnostic smDiag;
@@ -207,6 +264,33 @@ getExitingBlocks(BasicBlock*                  exitBlock,
     }
 }
 
+///// branch weights /////
+// weight of a certain edge
+static const uint32_t BranchWeightScale = 1 << 20;
+
+void
+setBranchProbability(BranchInst & branch, double trueProb) {
+  assert(branch.isConditional());
+  trueProb = std::min(1.0, std::max(0.0, trueProb));
+
+  // an edge of weight 0 would be considered unreachable
+  uint32_t trueWeight = std::max<uint32_t>(1, (uint32_t) std::lround(trueProb * BranchWeightScale));
+  uint32_t falseWeight = std::max<uint32_t>(1, BranchWeightScale - std::min(trueWeight, BranchWeightScale));
+  branch.setMetadata(LLVMContext::MD_prof, MDBuilder(branch.getContext()).createBranchWeights(trueWeight, falseWeight));
+}
+
+void
+setColdSuccessor(BranchInst & branch, unsigned coldIdx) {
+  assert(coldIdx <= 1);
+  // weight 1 against BranchWeightScale - 1
+  setBranchProbability(branch, coldIdx == 0 ? 0.0 : 1.0);
+}
+
+double
+getAnyLaneProbability(double laneProb, unsigned vectorWidth) {
+  return 1.0 - std::pow(1.0 - std::min(1.0, std::max(0.0, laneProb)), (double) vectorWidth);
+}
+
 ///// defaulting phi semantics /////
 namespace {
    const char * ShadowInputMDName = "rv.shadow.in";
@@ -61,6 +61,15 @@ void dropShadowInput(PHINode & phi);
 // return the default input value of \p phi (if any)
 Value* getShadowInput(const PHINode & phi);
 
+// branch weights (!prof) of branches that RV inserts
+//
+// \p branch takes its true successor with probability \p trueProb
+void setBranchProbability(BranchInst & branch, double trueProb);
+// successor \p coldIdx of \p branch is a fallback path that almost never runs
+void setColdSuccessor(BranchInst & branch, unsigned coldIdx);
+// probability that at least one of \p vectorWidth independent lanes takes an edge of per-lane probability \p laneProb
+double getAnyLaneProbability(double laneProb, unsigned vectorWidth);
+
 void
 getExitingBlocks(BasicBlock*                  exitBlock,
                       const LoopInfo&              loopInfo,
@@ -72,6 +81,13 @@ createModuleFromFile(const std::string & fileName, LLVMContext & context);
 Module*
 createModuleFromBuffer(const char buffer[], size_t length, LLVMContext & context);
 
+// parse the bitcode in \p buffer lazily. Function bodies are only read when
+// they are materialized (eg by cloneFunctionIntoModule). \p buffer must
+// outlive the module. Falls back to createModuleFromBuffer for textual IR.
+// Compressed buffers (RV_COMPRESS_GENBC) are inflated on first use.
+Module*
+createLazyModuleFromBuffer(const char buffer[], size_t length, LLVMContext & context);
+
 void
 writeModuleToFile(const Module& mod, const std::string& fileName);
 
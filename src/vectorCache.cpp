@@ -0,0 +1,259 @@
+//===- src/vectorCache.cpp - persistent cache of vector functions --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/vectorCache.h"
+
+#include "utils/rvLinking.h"
+#include "report.h"
+#include "rvConfig.h"
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <atomic>
+
+#if 1
+#define IF_DEBUG_CACHE IF_DEBUG
+#else
+#define IF_DEBUG_CACHE if (true)
+#endif
+
+using namespace llvm;
+
+// bump this whenever the cached payload changes (or vector codegen changes in a way the key does not cover)
+static const char *CacheFormatTag = "rv-vector-cache-1";
+
+static std::atomic<unsigned> numCacheHits, numCacheMisses, numCacheStores;
+
+namespace rv {
+
+VectorCache::VectorCache(std::string _cacheDir)
+: cacheDir(_cacheDir)
+{}
+
+VectorCache::VectorCache()
+: cacheDir()
+{
+  const char *envDir = getenv("RV_CACHE_DIR");
+  if (envDir) cacheDir = envDir;
+}
+
+std::string
+VectorCache::getEntryPath(StringRef key) const {
+  SmallString<128> entryPath(cacheDir);
+  sys::path::append(entryPath, key + ".bc");
+  return std::string(entryPath.str());
+}
+
+// print the definitions that \p scaFn (transitively) uses into \p out, in use order.
+// Their bodies and initializers shape the vector code (inlining, constant folding, vector variants)
+// as much as the scalar function itself.
+static void
+PrintReachableDefs(const Function & scaFn, raw_ostream & out) {
+  std::vector<const Constant*> worklist;
+  SmallPtrSet<const Constant*, 32> visited;
+
+  auto pushUsedConstants = [&](const User & user) {
+    for (const auto & op : user.operands()) {
+      auto * usedConst = dyn_cast<Constant>(op.get());
+      if (usedConst && visited.insert(usedConst).second)
+        worklist.push_back(usedConst);
+    }
+  };
+
+  visited.insert(&scaFn);
+  for (auto & I : instructions(scaFn)) pushUsedConstants(I);
+
+  // depth-first, so the key follows the use order of the IR rather than pointer values
+  while (!worklist.empty()) {
+    const auto * C = worklist.back();
+    worklist.pop_back();
+
+    auto * GO = dyn_cast<GlobalObject>(C);
+    if (!GO) {
+      pushUsedConstants(*C);
+      continue;
+    }
+
+    if (auto * F = dyn_cast<Function>(GO)) {
+      if (F->isDeclaration()) {
+        out << "declare " << F->getName() << " " << *F->getFunctionType() << "\n";
+        continue;
+      }
+      F->print(out);
+      for (auto & I : instructions(*F)) pushUsedConstants(I);
+    } else if (auto * GV = dyn_cast<GlobalVariable>(GO)) {
+      GV->print(out);
+      out << "\n";
+      if (GV->hasInitializer()) pushUsedConstants(*GV);
+    }
+  }
+}
+
+std::string
+VectorCache::computeKey(const VectorMapping & mapping, const Config & config) const {
+  auto & scaFn = *mapping.scalarFn;
+  auto & mod = *scaFn.getParent();
+
+  std::string keyText;
+  raw_string_ostream keyOut(keyText);
+  keyOut << CacheFormatTag << " " << LLVM_VERSION_STRING << "\n";
+
+  // target
+  keyOut << mod.getTargetTriple() << "\n" << mod.getDataLayoutStr() << "\n";
+  keyOut << scaFn.getFnAttribute("target-cpu").getValueAsString() << "\n";
+  keyOut << scaFn.getFnAttribute("target-features").getValueAsString() << "\n";
+
+  // mapping
+  keyOut << mapping.vectorFn->getName() << " w" << mapping.vectorWidth << " m" << mapping.maskPos
+         << " p" << (int) mapping.predMode << " r" << mapping.resultShape.serialize();
+  for (const auto & argShape : mapping.argShapes) {
+    keyOut << "_" << argShape.serialize();
+  }
+  keyOut << "\n";
+
+  // configuration
+  config.print(keyOut);
+
+  // scalar IR, including the bodies of its callees and the globals it references
+  scaFn.print(keyOut);
+  PrintReachableDefs(scaFn, keyOut);
+  keyOut.flush();
+
+  return toHex(SHA1::hash(arrayRefFromStringRef(keyText)), /* LowerCase */ true);
+}
+
+bool
+VectorCache::load(StringRef key, Function & vecFn) {
+  if (!isEnabled()) return false;
+
+  auto bufferOrErr = MemoryBuffer::getFile(getEntryPath(key));
+  if (!bufferOrErr) {
+    ++numCacheMisses;
+    return false;
+  }
+
+  auto & Ctx = vecFn.getContext();
+  auto cachedModOrErr = parseBitcodeFile((*bufferOrErr)->getMemBufferRef(), Ctx);
+  if (!cachedModOrErr) {
+    consumeError(cachedModOrErr.takeError());
+    Report() << "cache: discarding unreadable entry " << key << "\n";
+    ++numCacheMisses;
+    return false;
+  }
+
+  auto * cachedFn = (*cachedModOrErr)->getFunction(vecFn.getName());
+  if (!cachedFn || cachedFn->isDeclaration() || cachedFn->getFunctionType() != vecFn.getFunctionType()) {
+    Report() << "cache: entry " << key << " does not match " << vecFn.getName() << "\n";
+    ++numCacheMisses;
+    return false;
+  }
+
+  IF_DEBUG_CACHE { errs() << "cache: hit for " << vecFn.getName() << " (" << key << ")\n"; }
+  cloneFunctionBodyInto(*cachedFn, vecFn);
+  ++numCacheHits;
+  return true;
+}
+
+// collect \p vecFn and the definitions it (transitively) uses that were added by vectorization.
+static void
+CollectExportedDefs(Function & vecFn, const StringSet<> & inheritedDefs, SmallPtrSet<const GlobalValue*, 16> & exported) {
+  std::vector<const Constant*> worklist;
+  SmallPtrSet<const Constant*, 32> visited;
+
+  auto pushUsedConstants = [&](const User & user) {
+    for (const auto & op : user.operands()) {
+      auto * usedConst = dyn_cast<Constant>(op.get());
+      if (usedConst && visited.insert(usedConst).second)
+        worklist.push_back(usedConst);
+    }
+  };
+
+  exported.insert(&vecFn);
+  for (auto & I : instructions(vecFn)) pushUsedConstants(I);
+
+  while (!worklist.empty()) {
+    const auto * C = worklist.back();
+    worklist.pop_back();
+
+    auto * GO = dyn_cast<GlobalObject>(C);
+    if (!GO) {
+      pushUsedConstants(*C);
+      continue;
+    }
+    if (GO->isDeclaration() || inheritedDefs.count(GO->getName())) continue;
+    if (!exported.insert(GO).second) continue;
+
+    if (auto * F = dyn_cast<Function>(GO)) {
+      for (auto & I : instructions(*F)) pushUsedConstants(I);
+    } else if (auto * GV = dyn_cast<GlobalVariable>(GO)) {
+      if (GV->hasInitializer()) pushUsedConstants(*GV);
+    }
+  }
+}
+
+void
+VectorCache::store(StringRef key, Function & vecFn, const StringSet<> & inheritedDefs) {
+  if (!isEnabled()) return;
+
+  SmallPtrSet<const GlobalValue*, 16> exported;
+  CollectExportedDefs(vecFn, inheritedDefs, exported);
+
+  ValueToValueMapTy VMap;
+  auto cachedMod = CloneModule(*vecFn.getParent(), VMap, [&](const GlobalValue * GV) {
+    return exported.count(GV) > 0;
+  });
+
+  SmallString<0> bcBuffer;
+  {
+    raw_svector_ostream bcOut(bcBuffer);
+    WriteBitcodeToFile(*cachedMod, bcOut);
+  }
+
+  // write to a temporary file and move it into place, concurrent builds may share the cache
+  if (sys::fs::create_directories(cacheDir)) {
+    Report() << "cache: could not create " << cacheDir << "\n";
+    return;
+  }
+
+  int tmpFD;
+  SmallString<128> tmpPath;
+  if (sys::fs::createUniqueFile(getEntryPath(key) + ".tmp%%%%%%", tmpFD, tmpPath)) {
+    Report() << "cache: could not create a temporary entry in " << cacheDir << "\n";
+    return;
+  }
+
+  {
+    raw_fd_ostream tmpOut(tmpFD, /* shouldClose */ true);
+    tmpOut << bcBuffer;
+  }
+
+  if (sys::fs::rename(tmpPath, getEntryPath(key))) {
+    sys::fs::remove(tmpPath);
+    return;
+  }
+  ++numCacheStores;
+}
+
+void
+VectorCache::printStatistics(raw_ostream & out) {
+  out << "cache: " << numCacheHits << " hits, " << numCacheMisses << " misses, " << numCacheStores << " stored\n";
+}
+
+} // namespace rv
@@ -34,9 +34,9 @@ bool VectorizationInfo::inRegion(const Instruction &inst) const {
 }
 
 void VectorizationInfo::remapPredicate(Value &dest, Value &old) {
-  for (auto it : predicates) {
+  for (auto &it : predicates) {
     if (it.second == &old) {
-      predicates[it.first] = &dest;
+      it.second = &dest;
     }
   }
 }
@@ -149,7 +149,8 @@ VectorizationInfo::VectorizationInfo(llvm::Function &parentFn,
                                      unsigned vectorWidth, Region &_region)
     : DL(parentFn.getParent()->getDataLayout()), region(_region),
       mapping(&parentFn, &parentFn, vectorWidth,
-              CallPredicateMode::SafeWithoutPredicate) {
+              CallPredicateMode::SafeWithoutPredicate),
+      widthDependent(false) {
   mapping.resultShape = VectorShape::uni();
   for (auto &arg : parentFn.args()) {
     RV_UNUSED(arg);
@@ -160,8 +161,10 @@ VectorizationInfo::VectorizationInfo(llvm::Function &parentFn,
 // VectorizationInfo
 VectorizationInfo::VectorizationInfo(Region &_region, VectorMapping _mapping)
     : DL(_region.getFunction().getParent()->getDataLayout()), region(_region),
-      mapping(_mapping) {
+      mapping(_mapping), widthDependent(false) {
   assert(mapping.argShapes.size() == mapping.scalarFn->arg_size());
+  // avoid re-hashing during VA
+  shapes.reserve(mapping.scalarFn->getInstructionCount() + mapping.scalarFn->arg_size());
   auto it = mapping.scalarFn->arg_begin();
   for (auto argShape : mapping.argShapes) {
     auto &arg = *it;
@@ -234,23 +237,111 @@ const DataLayout &VectorizationInfo::getDataLayout() const { return DL; }
 
 void
 VectorizationInfo::forgetInferredProperties() {
+  widthDependent = false;
   VaryingPredicateBlocks.clear();
   mDivergentLoops.clear();
   DivergentLoopExits.clear();
   JoinDivergentBlocks.clear();
 
-  std::set<const Value*> ForgetValues;
-  for (auto ItValShape : shapes) {
-    if (pinned.count(ItValShape.first)) continue;
-    ForgetValues.insert(ItValShape.first);
-  }
-  for (const Value * ForgetVal : ForgetValues) {
-    auto It = shapes.find(ForgetVal);
-    assert(It != shapes.end());
+  // DenseMap::erase does not invalidate iterators
+  for (auto It = shapes.begin(), ItEnd = shapes.end(); It != ItEnd; ++It) {
+    if (pinned.count(It->first)) continue;
     shapes.erase(It);
   }
 }
 
+// visit the arguments of \p F, then every block followed by its instructions
+template <typename VisitFn>
+static void
+VisitByPosition(const Function &F, VisitFn visit) {
+  unsigned pos = 0;
+  for (const Argument &arg : F.args())
+    visit(arg, pos++);
+  for (const BasicBlock &block : F) {
+    visit(block, pos++);
+    for (const Instruction &inst : block)
+      visit(inst, pos++);
+  }
+}
+
+static unsigned
+GetPositionOpcode(const Value &val) {
+  if (auto *inst = dyn_cast<Instruction>(&val))
+    return inst->getOpcode();
+  return 0;
+}
+
+VectorizationInfo::Snapshot
+VectorizationInfo::takeSnapshot() const {
+  Snapshot snapshot;
+  DenseMap<const BasicBlock *, unsigned> blockPositions;
+  VisitByPosition(*mapping.scalarFn, [&](const Value &val, unsigned pos) {
+    if (!isa<Argument>(val))
+      snapshot.opcodes.push_back(GetPositionOpcode(val));
+
+    auto itShape = shapes.find(&val);
+    if (itShape != shapes.end())
+      snapshot.shapes.emplace_back(pos, itShape->second);
+
+    auto *block = dyn_cast<BasicBlock>(&val);
+    if (!block)
+      return;
+    blockPositions[block] = pos;
+    bool isVarying;
+    if (getVaryingPredicateFlag(*block, isVarying))
+      snapshot.varyingPredicateBlocks.emplace_back(pos, isVarying);
+    if (DivergentLoopExits.count(block))
+      snapshot.divergentLoopExits.push_back(pos);
+    if (JoinDivergentBlocks.count(block))
+      snapshot.joinDivergentBlocks.push_back(pos);
+  });
+
+  for (const Loop *loop : mDivergentLoops)
+    snapshot.divergentLoopHeaders.push_back(blockPositions.lookup(loop->getHeader()));
+  return snapshot;
+}
+
+bool
+VectorizationInfo::applySnapshot(const Snapshot &snapshot, const LoopInfo &LI) {
+  std::vector<const Value *> values;
+  std::vector<unsigned> opcodes;
+  VisitByPosition(*mapping.scalarFn, [&](const Value &val, unsigned /* pos */) {
+    values.push_back(&val);
+    if (!isa<Argument>(val))
+      opcodes.push_back(GetPositionOpcode(val));
+  });
+  if (opcodes != snapshot.opcodes)
+    return false;
+
+  std::vector<const Loop *> divLoops;
+  for (unsigned pos : snapshot.divergentLoopHeaders) {
+    auto *header = cast<BasicBlock>(values[pos]);
+    const Loop *loop = LI.getLoopFor(header);
+    if (!loop || loop->getHeader() != header)
+      return false;
+    divLoops.push_back(loop);
+  }
+
+  for (const auto &it : snapshot.shapes)
+    setVectorShape(*values[it.first], it.second);
+  for (const auto &it : snapshot.varyingPredicateBlocks)
+    setVaryingPredicateFlag(*cast<BasicBlock>(values[it.first]), it.second);
+  for (unsigned pos : snapshot.divergentLoopExits)
+    addDivergentLoopExit(*cast<BasicBlock>(values[pos]));
+  for (unsigned pos : snapshot.joinDivergentBlocks)
+    addJoinDivergentBlock(*cast<BasicBlock>(values[pos]));
+  for (const Loop *loop : divLoops)
+    addDivergentLoop(*loop);
+  return true;
+}
+
+const VectorizationInfo::JoinPoints &
+VectorizationInfo::cacheJoinPoints(const Instruction &term, JoinPoints joinPoints) {
+  auto &cached = joinPointCache[&term];
+  cached.reset(new JoinPoints(std::move(joinPoints)));
+  return *cached;
+}
+
 void VectorizationInfo::dropVectorShape(const Value &val) {
   auto it = shapes.find(&val);
   if (it == shapes.end())
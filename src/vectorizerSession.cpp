@@ -0,0 +1,139 @@
+//===- src/vectorizerSession.cpp - long-lived vectorizer state --*- C++ -*-===//
+//
+// Part of the RV Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "rv/vectorizerSession.h"
+
+#include "rv/PlatformInfo.h"
+#include "rv/region/FunctionRegion.h"
+#include "rv/region/Region.h"
+#include "rv/resolver/resolvers.h"
+#include "rv/rv.h"
+#include "rv/transform/singleReturnTrans.h"
+#include "rv/utils.h"
+#include "rv/vectorMapping.h"
+#include "rv/vectorizationInfo.h"
+
+#include "report.h"
+
+#include <llvm/Analysis/MemoryDependenceAnalysis.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+using namespace llvm;
+
+namespace rv {
+
+VectorizerSession::VectorizerSession(Config _config, TargetMachine *TM)
+: config(_config)
+, PMS(TM)
+, platInfo()
+, vectorizer()
+, attachedMod(nullptr)
+{}
+
+VectorizerSession::~VectorizerSession() {
+  detach();
+}
+
+void
+VectorizerSession::attach(Module & mod) {
+  if (attachedMod == &mod) return;
+  detach();
+  attachedMod = &mod;
+
+  if (platInfo) {
+    platInfo->setModule(mod);
+    return;
+  }
+
+  // same resolver chain as the WFV pass
+  platInfo.reset(new PlatformInfo(mod, nullptr, nullptr));
+  addVectorLibraryResolver(config, *platInfo);
+  if (!CheckFlag("RV_NO_SLEEF"))
+    addSleefResolver(config, *platInfo);
+  addBatchResolver(config, *platInfo);
+  addRecursiveResolver(config, *platInfo);
+  vectorizer.reset(new VectorizerInterface(*platInfo, config));
+}
+
+void
+VectorizerSession::detach() {
+  if (!attachedMod) return;
+  PMS.FAM.clear();
+  PMS.LAM.clear();
+  PMS.CGAM.clear();
+  PMS.MAM.clear();
+  if (platInfo) {
+    platInfo->setTTI(nullptr);
+    platInfo->setTLI(nullptr);
+  }
+  attachedMod = nullptr;
+}
+
+// same pipeline as WFV::vectorizeFunction
+bool
+VectorizerSession::vectorizeFunction(VectorMapping & wfvJob, const std::function<bool()> & isCancelled) {
+  assert(attachedMod && wfvJob.scalarFn->getParent() == attachedMod && "function of another module");
+  Function *scalarFn = wfvJob.scalarFn;
+  auto cancelled = [&] { return isCancelled && isCancelled(); };
+
+  // the cost model and resolvers query the target of this function
+  auto &FAM = PMS.FAM;
+  platInfo->setTTI(&FAM.getResult<TargetIRAnalysis>(*scalarFn));
+  platInfo->setTLI(&FAM.getResult<TargetLibraryAnalysis>(*scalarFn));
+
+  // recursive calls
+  platInfo->addMapping(wfvJob);
+
+  ValueToValueMapTy cloneMap;
+  Function *scalarCopy = CloneFunction(scalarFn, cloneMap, nullptr);
+  wfvJob.scalarFn = scalarCopy;
+
+  if (wfvJob.maskPos >= 0)
+    MaterializeEntryMask(*scalarCopy, *platInfo);
+
+  FunctionRegion funcRegion(*scalarCopy);
+  Region funcRegionWrapper(funcRegion);
+  SingleReturnTrans::run(funcRegionWrapper);
+
+  bool vectorizeOk = false;
+  VectorizationInfo vecInfo(funcRegionWrapper, wfvJob);
+  vectorizer->analyze(vecInfo, FAM);
+  if (!cancelled()) {
+    vectorizer->linearize(vecInfo, FAM);
+  }
+
+  if (!cancelled()) {
+    ScalarEvolutionAnalysis adhocAnalysis;
+    adhocAnalysis.run(*scalarCopy, FAM);
+    MemoryDependenceAnalysis mdAnalysis;
+    mdAnalysis.run(*scalarCopy, FAM);
+
+    ValueToValueMapTy vecMap;
+    vectorizeOk = vectorizer->vectorize(vecInfo, FAM, &vecMap);
+  }
+
+  scalarCopy->eraseFromParent();
+  wfvJob.scalarFn = scalarFn;
+  FAM.clear();
+
+  if (vectorizeOk && HasDecisionReport()) {
+    DecisionRecord rec("wfv", scalarFn->getName().str(), wfvJob.vectorFn->getName().str());
+    if (auto * SP = scalarFn->getSubprogram())
+      rec.location = (SP->getFilename() + ":" + Twine(SP->getLine())).str();
+    rec.vectorized = true;
+    rec.reason = ReportReason::Vectorized;
+    rec.width = wfvJob.vectorWidth;
+    ReportDecision(rec);
+  }
+  return vectorizeOk;
+}
+
+} // namespace rv
@@ -87,6 +87,12 @@ def rvClang(clangArgs):
 def primaryName(fileName):
     return path.basename(fileName).split(".")[0]
 
+# the metrics records for instruction-mix budgets (RV_REPORT_JSON)
+def rvToolEnv(options):
+    if options.get('metricsFile'):
+      return {"RV_REPORT_JSON": options['metricsFile']}
+    return None
+
 async def rvToolOuterLoop(scalarLL, destFile, scalarName = "foo", options = {}, logPrefix=None):
     baseName = primaryName(scalarLL)
     cmd = rvToolLine + " -loopvec -i " + scalarLL
@@ -102,8 +108,10 @@ async def rvToolOuterLoop(scalarLL, destFile, scalarName = "foo", options = {},
       cmd += " --math-prec {}".format(options["ulp_math_prec"])
     if 0 < len(options['extraShapes'].items()):
       cmd = cmd + " -x " + ",".join("{}={}".format(k,v) for k,v in options['extraShapes'].items())
+    if options.get('predictFile'):
+      cmd += " --predict " + options['predictFile']
 
-    return await shellCmdAsync(cmd,  None, logPrefix)
+    return await shellCmdAsync(cmd, rvToolEnv(options), logPrefix)
 
 async def rvToolWFV(scalarLL, destFile, scalarName = "foo", options = {}, logPrefix=None):
     cmd = rvToolLine + " -wfv -lower -i " + scalarLL
@@ -119,10 +127,12 @@ async def rvToolWFV(scalarLL, destFile, scalarName = "foo", options = {}, logPre
       cmd += " --math-prec {}".format(options["ulp_math_prec"])
     if 0 < len(options['extraShapes'].items()):
       cmd = cmd + " -x " + ",".join("{}={}".format(k,v) for k,v in options['extraShapes'].items())
+    if options.get('predictFile'):
+      cmd += " --predict " + options['predictFile']
 
     cmd += " --math-prec {}".format(testULPBound)
 
-    return await shellCmdAsync(cmd,  None, logPrefix)
+    return await shellCmdAsync(cmd, rvToolEnv(options), logPrefix)
 
 
 
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <iostream>
+
+#include <cassert>
+#include <cstdint>
+
+#include "launcherTools.h"
+
+extern "C" void foo(int64_t * A, int64_t * B, int64_t * C, int n);
+
+// random 64-bit values over the full range (rand() covers 31 bits), every 16th one zero
+static int64_t * allocateRand64Array(int n) {
+  auto * data = new int64_t[n];
+  for (int i = 0; i < n; ++i) {
+    uint64_t val = ((uint64_t) rand() << 33) ^ ((uint64_t) rand() << 11) ^ (uint64_t) rand();
+    data[i] = i % 16 == 5 ? 0 : (int64_t) val;
+  }
+  return data;
+}
+
+int main(int argc, char ** argv) {
+  srand(42);
+
+  const uint vectorWidth = 8;
+
+  const uint n = vectorWidth * 800 + 3;
+
+  int64_t * A = allocateRand64Array(n);
+  int64_t * B = allocateRand64Array(n);
+  int64_t * C = new int64_t[n];
+
+  foo(A, B, C, n);
+
+  size_t hash = hashArray(C, n, 0);
+
+  delete [] A;
+  delete [] B;
+  delete [] C;
+
+  std::cerr << hash << "\n";
+
+  return 0;
+}
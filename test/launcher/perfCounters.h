@@ -0,0 +1,186 @@
+/*
+ * perfCounters.h
+ *
+ * Hardware performance counters for the profile launchers (perf_event_open on
+ * Linux, falls back to the time stamp counter elsewhere).
+ * Enabled by setting RV_PERF_COUNTERS. Results go to stderr, stdout is
+ * reserved for the speedup read by test_rv.py.
+ */
+
+#ifndef TESTS_LAUNCHER_PERFCOUNTERS_H_
+#define TESTS_LAUNCHER_PERFCOUNTERS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define LAUNCHER_HAVE_PERF_EVENTS
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LAUNCHER_HAVE_RDTSC
+#endif
+
+struct CounterSample {
+	double cycles;       // core cycles (TSC ticks in the fallback)
+	double refCycles;    // reference cycles, cycles / refCycles < 1 indicates throttling (AVX-512 license)
+	double instructions;
+	double l1dMisses;
+	double llcMisses;
+	bool hasPerfEvents;  // otw only cycles are valid
+
+	double ipc() const { return cycles > 0 ? instructions / cycles : 0.0; }
+	double freqRatio() const { return refCycles > 0 ? cycles / refCycles : 0.0; }
+};
+
+static bool
+PerfCountersEnabled() {
+	return getenv("RV_PERF_COUNTERS") != nullptr;
+}
+
+class PerfCounters {
+	enum Event { Cycles = 0, RefCycles, Instructions, L1DMisses, LLCMisses, NumEvents };
+	int fds[NumEvents];
+	bool hasPerfEvents;
+	uint64_t tscStart;
+
+	static uint64_t readTSC() {
+#ifdef LAUNCHER_HAVE_RDTSC
+		return __rdtsc();
+#else
+		auto now = std::chrono::time_point_cast<std::chrono::nanoseconds>(GetTime());
+		return now.time_since_epoch().count();
+#endif
+	}
+
+#ifdef LAUNCHER_HAVE_PERF_EVENTS
+	static int openEvent(uint32_t type, uint64_t config, int groupFd) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = groupFd == -1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		return (int) syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+	}
+
+	uint64_t readEvent(Event e) const {
+		uint64_t val = 0;
+		if (fds[e] < 0 || read(fds[e], &val, sizeof(val)) != sizeof(val)) return 0;
+		return val;
+	}
+#endif
+
+public:
+	PerfCounters()
+	: hasPerfEvents(false)
+	, tscStart(0)
+	{
+		for (int i = 0; i < NumEvents; ++i) fds[i] = -1;
+#ifdef LAUNCHER_HAVE_PERF_EVENTS
+		const uint64_t l1dReadMiss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		fds[Cycles] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+		if (fds[Cycles] < 0) return; // no access (perf_event_paranoid) or no PMU
+		fds[RefCycles] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES, fds[Cycles]);
+		fds[Instructions] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, fds[Cycles]);
+		fds[L1DMisses] = openEvent(PERF_TYPE_HW_CACHE, l1dReadMiss, fds[Cycles]);
+		fds[LLCMisses] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, fds[Cycles]);
+		hasPerfEvents = true;
+#endif
+	}
+
+	~PerfCounters() {
+#ifdef LAUNCHER_HAVE_PERF_EVENTS
+		for (int i = 0; i < NumEvents; ++i) {
+			if (fds[i] >= 0) close(fds[i]);
+		}
+#endif
+	}
+
+	void start() {
+#ifdef LAUNCHER_HAVE_PERF_EVENTS
+		if (hasPerfEvents) {
+			ioctl(fds[Cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(fds[Cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+			return;
+		}
+#endif
+		tscStart = readTSC();
+	}
+
+	CounterSample stop() {
+		CounterSample sample;
+		memset(&sample, 0, sizeof(sample));
+#ifdef LAUNCHER_HAVE_PERF_EVENTS
+		if (hasPerfEvents) {
+			ioctl(fds[Cycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			sample.cycles = readEvent(Cycles);
+			sample.refCycles = readEvent(RefCycles);
+			sample.instructions = readEvent(Instructions);
+			sample.l1dMisses = readEvent(L1DMisses);
+			sample.llcMisses = readEvent(LLCMisses);
+			sample.hasPerfEvents = true;
+			return sample;
+		}
+#endif
+		sample.cycles = double(readTSC() - tscStart);
+		return sample;
+	}
+};
+
+// average counters of \p numRuns calls to \p func (after \p numWarmup untimed calls)
+template<typename Func>
+static CounterSample
+MeasureCounters(Func func, uint numRuns = 101, uint numWarmup = 10) {
+	for (uint i = 0; i < numWarmup; ++i) func();
+
+	PerfCounters counters;
+	counters.start();
+	for (uint i = 0; i < numRuns; ++i) func();
+	CounterSample sample = counters.stop();
+
+	sample.cycles /= numRuns;
+	sample.refCycles /= numRuns;
+	sample.instructions /= numRuns;
+	sample.l1dMisses /= numRuns;
+	sample.llcMisses /= numRuns;
+	return sample;
+}
+
+static void
+PrintCounters(const char * label, const CounterSample & sample) {
+	if (!sample.hasPerfEvents) {
+		fprintf(stderr, "%s: %.1f ticks (no perf events)\n", label, sample.cycles);
+		return;
+	}
+	fprintf(stderr, "%s: %.1f cycles, %.1f insts, IPC %.2f, freq ratio %.2f, L1D misses %.1f, LLC misses %.1f\n",
+	        label, sample.cycles, sample.instructions, sample.ipc(), sample.freqRatio(), sample.l1dMisses, sample.llcMisses);
+}
+
+// per-kernel counters of the scalar and the vector kernel (\p vectorWidth lanes).
+// Lane efficiency is the cycle speedup per lane.
+static void
+PrintCounterComparison(const CounterSample & scalar, const CounterSample & vector, uint vectorWidth) {
+	PrintCounters("scalar", scalar);
+	PrintCounters("vector", vector);
+	if (vector.cycles <= 0) return;
+	double speedup = scalar.cycles / vector.cycles;
+	fprintf(stderr, "cycle speedup %.2f, lane efficiency %.2f", speedup, speedup / vectorWidth);
+	if (scalar.hasPerfEvents && vector.instructions > 0) {
+		fprintf(stderr, ", instruction ratio %.2f", scalar.instructions / vector.instructions);
+	}
+	fprintf(stderr, "\n");
+}
+
+#endif /* TESTS_LAUNCHER_PERFCOUNTERS_H_ */
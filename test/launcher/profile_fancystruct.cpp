@@ -1,6 +1,7 @@
 #include <iostream>
 #include "launcherTools.h"
 #include "timing.h"
+#include "perfCounters.h"
 
 #include <random>
 
@@ -28,19 +29,15 @@ int main(int argc, char ** argv) {
     *(((float*) d) + j) = randGen(randSource);
   }
 
-  auto vecStart = GetTime();
   float8 simdRes = foo_SIMD(0, d);
-  auto vecEnd = GetTime();
 
   float vecRes[8];
   toArray(simdRes, vecRes);
 
   float expectedRes[8];
-  auto start = GetTime();
   for (int l = 0; l < width; ++l) {
     expectedRes[l] = foo(l, d);
   }
-  auto end = GetTime();
 
   bool error = false;
   for (int l = 0; l < width; ++l) {
@@ -52,8 +49,18 @@ int main(int argc, char ** argv) {
 
   if (error) return -1;
 
-  double vecTime = double(GetTimeDiff(vecStart, vecEnd));
-  double scalarTime = double(GetTimeDiff(start, end));
+  auto vecKernel = [&]() { simdRes = foo_SIMD(0, d); };
+  auto scalarKernel = [&]() {
+    for (int l = 0; l < width; ++l) {
+      expectedRes[l] = foo(l, d);
+    }
+  };
+  double vecTime = MeasureMedianTime(vecKernel);
+  double scalarTime = MeasureMedianTime(scalarKernel);
+
+  if (PerfCountersEnabled()) {
+    PrintCounterComparison(MeasureCounters(scalarKernel), MeasureCounters(vecKernel), width);
+  }
 
   printf("%lf\n",(scalarTime / vecTime));
 
@@ -13,6 +13,7 @@
 
 #include "launcherTools.h"
 #include "timing.h"
+#include "perfCounters.h"
 
 extern "C" float foo(float a, float b);
 extern "C" float8 foo_SIMD(float8 a, float8 b);
@@ -28,24 +29,32 @@ int main(int argc, char ** argv) {
     b[i] = (float) wfvRand();
   }
 
-  auto vecStart = GetTime();
   float8 rVec = foo_SIMD(*((float8*) &a), *((float8*) &b));
-  auto vecEnd = GetTime();
   float r[8];
   toArray(rVec, r);
 
-  auto start = GetTime();
   for (uint i = 0; i < vectorWidth; ++i) {
     float expectedRes = foo(a[i], b[i]);
     if (r[i] != expectedRes) {
       return -1;
     }
   }
-  auto end = GetTime();
 
+  // volatile sinks keep the timed calls alive
+  volatile float8 vecSink;
+  volatile float scalarSink;
+  auto vecKernel = [&]() { vecSink = foo_SIMD(*((float8*) &a), *((float8*) &b)); };
+  auto scalarKernel = [&]() {
+    for (uint i = 0; i < vectorWidth; ++i) {
+      scalarSink = foo(a[i], b[i]);
+    }
+  };
+  double vecTime = MeasureMedianTime(vecKernel);
+  double scalarTime = MeasureMedianTime(scalarKernel);
 
-  double vecTime = double(GetTimeDiff(vecStart, vecEnd));
-  double scalarTime = double(GetTimeDiff(start, end));
+  if (PerfCountersEnabled()) {
+    PrintCounterComparison(MeasureCounters(scalarKernel), MeasureCounters(vecKernel), vectorWidth);
+  }
 
   printf("%lf\n",(scalarTime / vecTime));
 
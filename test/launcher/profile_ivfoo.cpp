@@ -7,6 +7,7 @@
 
 #include "launcherTools.h"
 #include "timing.h"
+#include "perfCounters.h"
 
 // typedef float float4 __attribute__((ext_vector_type(4)));
 
@@ -28,16 +29,12 @@ int main(int argc, char ** argv) {
   }
 
   // invoke SIMD
-  auto vecStart = GetTime();
   foo_SIMD(0, aVec);
-  auto vecEnd = GetTime();
 
   // invoke scalar
-  auto start = GetTime();
   for (int j = 0; j < vectorWidth; ++j) {
     foo(j, aScalar);
   }
-  auto end = GetTime();
 
   for (uint i = 0; i < padded; ++i) {
 
@@ -46,8 +43,18 @@ int main(int argc, char ** argv) {
     }
   }
 
-  double vecTime = double(GetTimeDiff(vecStart, vecEnd));
-  double scalarTime = double(GetTimeDiff(start, end));
+  auto vecKernel = [&]() { foo_SIMD(0, aVec); };
+  auto scalarKernel = [&]() {
+    for (int j = 0; j < vectorWidth; ++j) {
+      foo(j, aScalar);
+    }
+  };
+  double vecTime = MeasureMedianTime(vecKernel);
+  double scalarTime = MeasureMedianTime(scalarKernel);
+
+  if (PerfCountersEnabled()) {
+    PrintCounterComparison(MeasureCounters(scalarKernel), MeasureCounters(vecKernel), vectorWidth);
+  }
 
   printf("%lf\n",(scalarTime / vecTime));
 
@@ -53,6 +53,28 @@ GetTimeDiff(clock_t start, clock_t end) {
 
 #endif
 
+#include <algorithm>
+#include <vector>
+
+// median time of \p numRuns calls to \p func after \p numWarmup untimed calls.
+// A single call of a test kernel is too short to be timed reliably.
+template<typename Func>
+static double
+MeasureMedianTime(Func func, uint numRuns = 101, uint numWarmup = 10) {
+	for (uint i = 0; i < numWarmup; ++i) func();
+
+	std::vector<double> samples;
+	samples.reserve(numRuns);
+	for (uint i = 0; i < numRuns; ++i) {
+		auto start = GetTime();
+		func();
+		auto end = GetTime();
+		samples.push_back(double(GetTimeDiff(start, end)));
+	}
+
+	std::nth_element(samples.begin(), samples.begin() + numRuns / 2, samples.end());
+	return samples[numRuns / 2];
+}
 
 
 #endif /* TESTS_LAUNCHER_TIMING_H_ */
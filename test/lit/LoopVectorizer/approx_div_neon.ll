@@ -0,0 +1,48 @@
+; REQUIRES: aarch64-registered-target
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; On NEON the estimate is frecpe (8 bits): two steps for 1 ULP.
+
+; CHECK-LABEL: @rcp_neon(
+; CHECK-NOT: fdiv <4 x float>
+; CHECK: call <4 x float> @llvm.aarch64.neon.frecpe.v4f32(
+; CHECK-COUNT-4: call <4 x float> @llvm.fmuladd.v4f32(
+; CHECK: store <4 x float>
+
+target datalayout = "e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-unknown-linux-gnu"
+
+define dso_local void @rcp_neon(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf arcp float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !2
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="generic" "target-features"="+neon" }
+
+!0 = !{!"llvm.loop.vectorize.enable", i1 true}
+!1 = !{!"llvm.loop.vectorize.width", i32 4}
+!2 = distinct !{!2, !1, !0}
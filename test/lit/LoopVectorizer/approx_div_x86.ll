@@ -0,0 +1,309 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Varying fast-math divisions (ninf and arcp) multiply by a reciprocal estimate
+; refined by Newton-Raphson steps (two fmuladds each). The number of steps
+; follows from the estimate precision of the ISA (rcp14: 14 bits, rcpps: 11
+; bits) and the ULP error bound (rv.ulp, in 1/10 ULP).
+
+; 14 bits, 1 ULP: one step
+; CHECK-LABEL: @rcp_avx512(
+; CHECK-NOT: fdiv <16 x float>
+; CHECK: call <16 x float> @llvm.x86.avx512.rcp14.ps.512(<16 x float> %{{.*}}, <16 x float> zeroinitializer, i16 -1)
+; CHECK-COUNT-2: call <16 x float> @llvm.fmuladd.v16f32(
+; CHECK-NOT: call <16 x float> @llvm.fmuladd.v16f32(
+; CHECK: store <16 x float>
+
+; 11 bits, 1 ULP: two steps
+; CHECK-LABEL: @rcp_avx2(
+; CHECK-NOT: fdiv <8 x float>
+; CHECK: call <8 x float> @llvm.x86.avx.rcp.ps.256(
+; CHECK-COUNT-4: call <8 x float> @llvm.fmuladd.v8f32(
+; CHECK: store <8 x float>
+
+; CHECK-LABEL: @rcp_sse(
+; CHECK-NOT: fdiv <4 x float>
+; CHECK: call <4 x float> @llvm.x86.sse.rcp.ps(
+; CHECK-COUNT-4: call <4 x float> @llvm.fmuladd.v4f32(
+; CHECK: store <4 x float>
+
+; 11 bits, 100 ULP: one step
+; CHECK-LABEL: @rcp_avx2_loose(
+; CHECK: call <8 x float> @llvm.x86.avx.rcp.ps.256(
+; CHECK-COUNT-2: call <8 x float> @llvm.fmuladd.v8f32(
+; CHECK-NOT: call <8 x float> @llvm.fmuladd.v8f32(
+; CHECK: store <8 x float>
+
+; 14 bits, 1024 ULP: the estimate as is
+; CHECK-LABEL: @rcp_avx512_loose(
+; CHECK-NOT: @llvm.fmuladd.v16f32
+; CHECK: call <16 x float> @llvm.x86.avx512.rcp14.ps.512(
+; CHECK-NOT: @llvm.fmuladd.v16f32
+; CHECK: store <16 x float>
+
+; the refinement turns the estimates of 0 and inf into NaN
+; CHECK-LABEL: @div_no_ninf(
+; CHECK-NOT: @llvm.x86.avx.rcp.ps.256
+; CHECK: fdiv arcp <8 x float>
+
+; CHECK-LABEL: @div_no_arcp(
+; CHECK-NOT: @llvm.x86.avx.rcp.ps.256
+; CHECK: fdiv ninf <8 x float>
+
+; the backend inverts a uniform divisor once
+; CHECK-LABEL: @div_uniform(
+; CHECK-NOT: @llvm.x86.avx.rcp.ps.256
+; CHECK: <8 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @rcp_avx512(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #3 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf arcp float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @rcp_avx2(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf arcp float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !5
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @rcp_sse(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #2 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf arcp float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !6
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @rcp_avx2_loose(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #1 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf arcp float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !7
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @rcp_avx512_loose(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #4 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf arcp float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !8
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @div_no_ninf(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv arcp float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !9
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @div_no_arcp(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf float %a, %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !10
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @div_uniform(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, float %s, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %r = fdiv ninf arcp float %a, %s
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !11
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2,+fma,+sse2" }
+attributes #1 = { nofree norecurse nounwind "rv.ulp"="1000" "target-cpu"="haswell" "target-features"="+avx,+avx2,+fma,+sse2" }
+attributes #2 = { nofree norecurse nounwind "target-cpu"="x86-64" "target-features"="+sse2" }
+attributes #3 = { nofree norecurse nounwind "target-cpu"="skylake-avx512" "target-features"="+avx,+avx2,+avx512f,+avx512vl,+fma,+sse2" }
+attributes #4 = { nofree norecurse nounwind "rv.ulp"="10240" "target-cpu"="skylake-avx512" "target-features"="+avx,+avx2,+avx512f,+avx512vl,+fma,+sse2" }
+
+!0 = !{!"llvm.loop.vectorize.enable", i1 true}
+!1 = !{!"llvm.loop.vectorize.width", i32 4}
+!2 = !{!"llvm.loop.vectorize.width", i32 8}
+!3 = !{!"llvm.loop.vectorize.width", i32 16}
+!4 = distinct !{!4, !3, !0}
+!5 = distinct !{!5, !2, !0}
+!6 = distinct !{!6, !1, !0}
+!7 = distinct !{!7, !2, !0}
+!8 = distinct !{!8, !3, !0}
+!9 = distinct !{!9, !2, !0}
+!10 = distinct !{!10, !2, !0}
+!11 = distinct !{!11, !2, !0}
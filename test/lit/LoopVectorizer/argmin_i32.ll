@@ -0,0 +1,51 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; argmin: the index recurrence picks the induction value under the compare of
+; the min chain. At the exit the key is reduced and the earliest index among
+; the lanes holding it is taken.
+
+; REMARK: remark: {{.*}}Loop vectorized (width 8)
+
+; CHECK-LABEL: @argmin(
+; CHECK: call i32 @llvm.vector.reduce.smin.v8i32(
+; CHECK: call i64 @llvm.vector.reduce.{{s|u}}min.v8i64(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local i64 @argmin(ptr nocapture readonly %A, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %for.body ]
+  %min = phi i32 [ 2147483647, %for.body.preheader ], [ %min.next, %for.body ]
+  %idx = phi i64 [ -1, %for.body.preheader ], [ %idx.next, %for.body ]
+  %arrayidx = getelementptr inbounds i32, ptr %A, i64 %indvars.iv
+  %0 = load i32, ptr %arrayidx, align 4
+  %lt = icmp slt i32 %0, %min
+  %min.next = select i1 %lt, i32 %0, i32 %min
+  %idx.next = select i1 %lt, i64 %indvars.iv, i64 %idx
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %n
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  %idx.lcssa = phi i64 [ %idx.next, %for.body ]
+  br label %for.end
+
+for.end:
+  %result = phi i64 [ -1, %entry ], [ %idx.lcssa, %for.end.loopexit ]
+  ret i64 %result
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,155 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_NO_BIT_MASKS=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s --check-prefix=OFF
+
+; Bit tests of a bitset word at an aligned index take the lane bits with one
+; scalar shift and bitcast them to the mask. The update W[i / 8] |= c << (i % 8)
+; stores the ballot of c shifted into place. Bool bytes are compared with 0.
+
+; CHECK-LABEL: @bitset_test(
+; CHECK: lshr i8 %{{.*}}, %{{.*}}
+; CHECK: bitcast i8 %{{.*}} to <8 x i1>
+; CHECK: select <8 x i1> %{{.*}}, <8 x float>
+
+; OFF-LABEL: @bitset_test(
+; OFF-NOT: bitcast i8 %{{.*}} to <8 x i1>
+; OFF: select <8 x i1> %{{.*}}, <8 x float>
+
+; CHECK-LABEL: @bitset_store(
+; CHECK: fcmp ogt <8 x float>
+; CHECK: call i32 @llvm.x86.avx.movmsk.ps.256(
+; CHECK: trunc i32 %{{.*}} to i8
+; CHECK: shl i8
+; CHECK: or i8
+; CHECK: store i8
+
+; OFF-LABEL: @bitset_store(
+; OFF-NOT: @llvm.x86.avx.movmsk.ps.256
+; OFF: store i8
+
+; CHECK-LABEL: @bool_bytes(
+; CHECK-NOT: and <8 x i8>
+; CHECK: icmp ne <8 x i8> %{{.*}}, zeroinitializer
+; CHECK: select <8 x i1> %{{.*}}, <8 x float>
+
+; without the 0/1 range of a bool only bit 0 counts
+; CHECK-LABEL: @byte_flags(
+; CHECK: and <8 x i8> %{{.*}}, <i8 1, i8 1, i8 1, i8 1, i8 1, i8 1, i8 1, i8 1>
+; CHECK: select <8 x i1> %{{.*}}, <8 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; C[i] = (W[i / 8] >> (i % 8)) & 1 ? A[i] : 0.0
+define dso_local void @bitset_test(ptr noalias nocapture readonly %W, ptr noalias nocapture readonly %A, ptr noalias nocapture %C, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.body ]
+  %word.idx = lshr i64 %i, 3
+  %w.ptr = getelementptr inbounds i8, ptr %W, i64 %word.idx
+  %w = load i8, ptr %w.ptr, align 1
+  %bit.idx = and i64 %i, 7
+  %s = trunc i64 %bit.idx to i8
+  %shr = lshr i8 %w, %s
+  %bit = and i8 %shr, 1
+  %set = icmp ne i8 %bit, 0
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %r = select i1 %set, float %a, float 0.000000e+00
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %n
+  br i1 %exitcond.not, label %for.end, label %for.body, !llvm.loop !0
+
+for.end:
+  ret void
+}
+
+; W[i / 8] |= (A[i] > 0.0) << (i % 8)
+define dso_local void @bitset_store(ptr noalias nocapture %W, ptr noalias nocapture readonly %A, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %pos = fcmp ogt float %a, 0.000000e+00
+  %z = zext i1 %pos to i8
+  %bit.idx = and i64 %i, 7
+  %s = trunc i64 %bit.idx to i8
+  %bits = shl i8 %z, %s
+  %word.idx = lshr i64 %i, 3
+  %w.ptr = getelementptr inbounds i8, ptr %W, i64 %word.idx
+  %w = load i8, ptr %w.ptr, align 1
+  %w.new = or i8 %w, %bits
+  store i8 %w.new, ptr %w.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %n
+  br i1 %exitcond.not, label %for.end, label %for.body, !llvm.loop !3
+
+for.end:
+  ret void
+}
+
+; C[i] = B[i] ? A[i] : 0.0 with bool B
+define dso_local void @bool_bytes(ptr noalias nocapture readonly %B, ptr noalias nocapture readonly %A, ptr noalias nocapture %C, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1, !range !5
+  %set = trunc i8 %b to i1
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %r = select i1 %set, float %a, float 0.000000e+00
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %n
+  br i1 %exitcond.not, label %for.end, label %for.body, !llvm.loop !4
+
+for.end:
+  ret void
+}
+
+; as above, B is a byte array
+define dso_local void @byte_flags(ptr noalias nocapture readonly %B, ptr noalias nocapture readonly %A, ptr noalias nocapture %C, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %set = trunc i8 %b to i1
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %r = select i1 %set, float %a, float 0.000000e+00
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %n
+  br i1 %exitcond.not, label %for.end, label %for.body, !llvm.loop !6
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
+!5 = !{i8 0, i8 2}
+!6 = distinct !{!6, !1, !2}
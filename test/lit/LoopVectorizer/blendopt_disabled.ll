@@ -0,0 +1,64 @@
+; RUN: env RV_REPORT=1 RV_NO_BLENDOPT=1 opt %s -O3 -disable-output | FileCheck %s
+; RUN: env RV_REPORT=1 RV_NO_BLENDOPT=1 opt %s -O3 -pass-remarks=rv-loopvec -disable-output 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; The loop of blendopt_chain.ll with RV_NO_BLENDOPT set. The blends of the
+; linearized region stay as the Linearizer emitted them.
+
+; CHECK-NOT: blendOpt:
+
+; REMARK: remark: {{.*}}Loop vectorized (width 8)
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @classify(ptr nocapture readonly %A, ptr nocapture %B, ptr nocapture %C, ptr nocapture %D, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %for.inc ]
+  %arrayidx = getelementptr inbounds i32, ptr %A, i64 %indvars.iv
+  %x = load i32, ptr %arrayidx, align 4
+  %big = icmp sgt i32 %x, 10
+  br i1 %big, label %if.big, label %if.notbig
+
+if.big:
+  %arrayidx.b = getelementptr inbounds i32, ptr %B, i64 %indvars.iv
+  store i32 %x, ptr %arrayidx.b, align 4
+  br label %for.inc
+
+if.notbig:
+  %pos = icmp sgt i32 %x, 0
+  br i1 %pos, label %if.pos, label %for.inc
+
+if.pos:
+  %dbl = shl nsw i32 %x, 1
+  %arrayidx.c = getelementptr inbounds i32, ptr %C, i64 %indvars.iv
+  store i32 %dbl, ptr %arrayidx.c, align 4
+  br label %for.inc
+
+for.inc:
+  %class = phi i32 [ 7, %if.big ], [ 7, %if.pos ], [ %x, %if.notbig ]
+  %arrayidx.d = getelementptr inbounds i32, ptr %D, i64 %indvars.iv
+  store i32 %class, ptr %arrayidx.d, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
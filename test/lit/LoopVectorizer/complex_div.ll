@@ -0,0 +1,107 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; __divdc3 is lowered inline: the denominator is scaled by the exponent of
+; max(|c|, |d|) and the Annex G cases (division by zero, infinite numerator or
+; denominator) are blended in. With no-nans and no-infs fp math it is the
+; plain formula with one division per part.
+
+; CHECK-LABEL: @cdiv(
+; CHECK: call <8 x double> @llvm.maxnum.v8f64(
+; CHECK: fdiv <8 x double>
+; CHECK: fcmp uno <8 x double>
+; CHECK: select <8 x i1>
+; CHECK: store <8 x double>
+
+; CHECK-LABEL: @cdiv_finite(
+; CHECK-NOT: @llvm.maxnum.v8f64
+; CHECK-NOT: fcmp uno <8 x double>
+; CHECK: fdiv <8 x double>
+; CHECK: store <8 x double>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @cdiv(ptr noalias nocapture readonly %Ar, ptr noalias nocapture readonly %Ai, ptr noalias nocapture readonly %Br, ptr noalias nocapture readonly %Bi, ptr noalias nocapture %Cr, ptr noalias nocapture %Ci, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds double, ptr %Ar, i64 %i
+  %a = load double, ptr %a.ptr, align 8
+  %b.ptr = getelementptr inbounds double, ptr %Ai, i64 %i
+  %b = load double, ptr %b.ptr, align 8
+  %c.ptr = getelementptr inbounds double, ptr %Br, i64 %i
+  %c = load double, ptr %c.ptr, align 8
+  %d.ptr = getelementptr inbounds double, ptr %Bi, i64 %i
+  %d = load double, ptr %d.ptr, align 8
+  %r = call { double, double } @__divdc3(double %a, double %b, double %c, double %d) #2
+  %re = extractvalue { double, double } %r, 0
+  %im = extractvalue { double, double } %r, 1
+  %cr.ptr = getelementptr inbounds double, ptr %Cr, i64 %i
+  store double %re, ptr %cr.ptr, align 8
+  %ci.ptr = getelementptr inbounds double, ptr %Ci, i64 %i
+  store double %im, ptr %ci.ptr, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @cdiv_finite(ptr noalias nocapture readonly %Ar, ptr noalias nocapture readonly %Ai, ptr noalias nocapture readonly %Br, ptr noalias nocapture readonly %Bi, ptr noalias nocapture %Cr, ptr noalias nocapture %Ci, i32 %n) local_unnamed_addr #1 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds double, ptr %Ar, i64 %i
+  %a = load double, ptr %a.ptr, align 8
+  %b.ptr = getelementptr inbounds double, ptr %Ai, i64 %i
+  %b = load double, ptr %b.ptr, align 8
+  %c.ptr = getelementptr inbounds double, ptr %Br, i64 %i
+  %c = load double, ptr %c.ptr, align 8
+  %d.ptr = getelementptr inbounds double, ptr %Bi, i64 %i
+  %d = load double, ptr %d.ptr, align 8
+  %r = call { double, double } @__divdc3(double %a, double %b, double %c, double %d) #2
+  %re = extractvalue { double, double } %r, 0
+  %im = extractvalue { double, double } %r, 1
+  %cr.ptr = getelementptr inbounds double, ptr %Cr, i64 %i
+  store double %re, ptr %cr.ptr, align 8
+  %ci.ptr = getelementptr inbounds double, ptr %Ci, i64 %i
+  store double %im, ptr %ci.ptr, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+declare { double, double } @__divdc3(double, double, double, double)
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+attributes #1 = { nofree norecurse nounwind "no-infs-fp-math"="true" "no-nans-fp-math"="true" "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+attributes #2 = { nounwind readnone }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
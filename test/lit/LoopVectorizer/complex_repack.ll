@@ -0,0 +1,145 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; The complex return value is { T, T } (x86-64 double), <2 x T> (x86-64
+; float) or [2 x T] (AArch64). Extracts of the parts use the lowered parts
+; directly (the { T, T } case is in complex_mul.ll). Other users get the
+; parts packed into the return type. @cmul_vector takes the fast path from the
+; nnan and ninf flags of the call, the others from the function attributes.
+
+; CHECK-LABEL: @cmul_array(
+; CHECK-NOT: extractvalue
+; CHECK: fsub <8 x double>
+; CHECK: store <8 x double>
+
+; CHECK-LABEL: @cmul_vector(
+; CHECK-NOT: fcmp uno <8 x float>
+; CHECK-NOT: extractelement <2 x float>
+; CHECK: fsub <8 x float>
+; CHECK: store <8 x float>
+
+; CHECK-LABEL: @cmul_vector_packed(
+; CHECK: fsub <8 x float>
+; CHECK: store <2 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @cmul_array(ptr noalias nocapture readonly %Ar, ptr noalias nocapture readonly %Ai, ptr noalias nocapture readonly %Br, ptr noalias nocapture readonly %Bi, ptr noalias nocapture %Cr, ptr noalias nocapture %Ci, i32 %n) local_unnamed_addr #1 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds double, ptr %Ar, i64 %i
+  %a = load double, ptr %a.ptr, align 8
+  %b.ptr = getelementptr inbounds double, ptr %Ai, i64 %i
+  %b = load double, ptr %b.ptr, align 8
+  %c.ptr = getelementptr inbounds double, ptr %Br, i64 %i
+  %c = load double, ptr %c.ptr, align 8
+  %d.ptr = getelementptr inbounds double, ptr %Bi, i64 %i
+  %d = load double, ptr %d.ptr, align 8
+  %r = call [2 x double] @__muldc3(double %a, double %b, double %c, double %d) #2
+  %re = extractvalue [2 x double] %r, 0
+  %im = extractvalue [2 x double] %r, 1
+  %cr.ptr = getelementptr inbounds double, ptr %Cr, i64 %i
+  store double %re, ptr %cr.ptr, align 8
+  %ci.ptr = getelementptr inbounds double, ptr %Ci, i64 %i
+  store double %im, ptr %ci.ptr, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @cmul_vector(ptr noalias nocapture readonly %Ar, ptr noalias nocapture readonly %Ai, ptr noalias nocapture readonly %Br, ptr noalias nocapture readonly %Bi, ptr noalias nocapture %Cr, ptr noalias nocapture %Ci, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %Ar, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %Ai, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %Br, i64 %i
+  %c = load float, ptr %c.ptr, align 4
+  %d.ptr = getelementptr inbounds float, ptr %Bi, i64 %i
+  %d = load float, ptr %d.ptr, align 4
+  %r = call nnan ninf <2 x float> @__mulsc3(float %a, float %b, float %c, float %d) #2
+  %re = extractelement <2 x float> %r, i64 0
+  %im = extractelement <2 x float> %r, i64 1
+  %cr.ptr = getelementptr inbounds float, ptr %Cr, i64 %i
+  store float %re, ptr %cr.ptr, align 4
+  %ci.ptr = getelementptr inbounds float, ptr %Ci, i64 %i
+  store float %im, ptr %ci.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @cmul_vector_packed(ptr noalias nocapture readonly %Ar, ptr noalias nocapture readonly %Ai, ptr noalias nocapture readonly %Br, ptr noalias nocapture readonly %Bi, ptr noalias nocapture %Cr, ptr noalias nocapture %Ci, i32 %n) local_unnamed_addr #1 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %Ar, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %Ai, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %Br, i64 %i
+  %c = load float, ptr %c.ptr, align 4
+  %d.ptr = getelementptr inbounds float, ptr %Bi, i64 %i
+  %d = load float, ptr %d.ptr, align 4
+  %r = call <2 x float> @__mulsc3(float %a, float %b, float %c, float %d) #2
+  %out.ptr = getelementptr inbounds <2 x float>, ptr %Cr, i64 %i
+  store <2 x float> %r, ptr %out.ptr, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+declare [2 x double] @__muldc3(double, double, double, double)
+declare <2 x float> @__mulsc3(float, float, float, float)
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+attributes #1 = { nofree norecurse nounwind "no-infs-fp-math"="true" "no-nans-fp-math"="true" "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+attributes #2 = { nounwind readnone }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
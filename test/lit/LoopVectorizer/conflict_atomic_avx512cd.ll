@@ -0,0 +1,45 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Lanes of a varying-address atomic that hit the same bin are combined in-vector
+; and only the first lane of each address issues the atomic. With AVX512CD the
+; equal-address lanes come from vpconflict (8 x 64-bit addresses, 512 bits).
+
+; CHECK-LABEL: @histogram(
+; CHECK: call <8 x i64> @llvm.x86.avx512.conflict.q.512(<8 x i64>
+; CHECK: atomicrmw add ptr
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @histogram(ptr nocapture readonly %Idx, ptr %H, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %for.body ]
+  %arrayidx = getelementptr inbounds i32, ptr %Idx, i64 %indvars.iv
+  %bin = load i32, ptr %arrayidx, align 4
+  %idxprom = sext i32 %bin to i64
+  %slot = getelementptr inbounds i32, ptr %H, i64 %idxprom
+  %old = atomicrmw add ptr %slot, i32 1 monotonic, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nounwind "target-cpu"="skylake-avx512" "target-features"="+avx,+avx2,+avx512f,+avx512cd,+avx512vl" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
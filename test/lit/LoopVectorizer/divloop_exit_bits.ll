@@ -0,0 +1,152 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_REPORT=1 opt %s -O3 -disable-output | FileCheck %s --check-prefix=REPORT
+; RUN: env RV_NO_EXIT_BITS=1 RV_REPORT=1 opt %s -O3 -disable-output | FileCheck %s --check-prefix=OFF
+
+; A divergent loop with two or more exits tracks the lanes that left through
+; each exit in a uniform i32 bitmask. Every iteration ORs a ballot of the lanes
+; that leave in this iteration into it. The bitmask becomes a lane mask again
+; only after the loop.
+
+; REPORT-COUNT-2: 1 loops with exit bitmasks.
+; OFF-NOT: exit bitmasks
+
+; CHECK-LABEL: @two_exits(
+; CHECK: phi i32 [ 0, %{{.*}} ], [ %{{.*}}, %{{.*}} ]
+; CHECK: phi i32 [ 0, %{{.*}} ], [ %{{.*}}, %{{.*}} ]
+; CHECK: call i32 @llvm.x86.avx.movmsk.ps.256(
+; CHECK: or i32
+; CHECK: call i32 @llvm.x86.avx.movmsk.ps.256(
+; CHECK: or i32
+
+; CHECK-LABEL: @three_exits(
+; CHECK-COUNT-3: phi i32 [ 0, %{{.*}} ], [ %{{.*}}, %{{.*}} ]
+; CHECK: call i32 @llvm.x86.avx.movmsk.ps.256(
+; CHECK: or i32
+; CHECK: call i32 @llvm.x86.avx.movmsk.ps.256(
+; CHECK: or i32
+; CHECK: call i32 @llvm.x86.avx.movmsk.ps.256(
+; CHECK: or i32
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; S[i] = steps until the sequence from A[i] hits %key, F[i] = 0.0 when it does not within %lim steps
+define dso_local void @two_exits(ptr noalias nocapture readonly %A, ptr noalias nocapture %S, ptr noalias nocapture %F, i32 %key, i32 %lim, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %a.ptr = getelementptr inbounds i32, ptr %A, i64 %i
+  %x0 = load i32, ptr %a.ptr, align 4
+  br label %while.body
+
+while.body:
+  %x = phi i32 [ %x0, %for.body ], [ %x.next, %while.cont ]
+  %j = phi i32 [ 0, %for.body ], [ %j.next, %while.cont ]
+  %hit = icmp eq i32 %x, %key
+  br i1 %hit, label %found, label %while.cont
+
+while.cont:
+  %mul = mul i32 %x, 3
+  %up = add i32 %mul, 1
+  %x.next = lshr i32 %up, 1
+  %j.next = add nuw nsw i32 %j, 1
+  %more = icmp slt i32 %j.next, %lim
+  br i1 %more, label %while.body, label %notfound
+
+found:
+  %j.found = phi i32 [ %j, %while.body ]
+  %s.ptr = getelementptr inbounds i32, ptr %S, i64 %i
+  store i32 %j.found, ptr %s.ptr, align 4
+  br label %for.latch
+
+notfound:
+  %f.ptr = getelementptr inbounds float, ptr %F, i64 %i
+  store float 0.000000e+00, ptr %f.ptr, align 4
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+; as above, O[i] = 1 when the sequence turns negative first
+define dso_local void @three_exits(ptr noalias nocapture readonly %A, ptr noalias nocapture %S, ptr noalias nocapture %F, ptr noalias nocapture %O, i32 %key, i32 %lim, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %a.ptr = getelementptr inbounds i32, ptr %A, i64 %i
+  %x0 = load i32, ptr %a.ptr, align 4
+  br label %while.body
+
+while.body:
+  %x = phi i32 [ %x0, %for.body ], [ %x.next, %while.cont ]
+  %j = phi i32 [ 0, %for.body ], [ %j.next, %while.cont ]
+  %hit = icmp eq i32 %x, %key
+  br i1 %hit, label %found, label %while.step
+
+while.step:
+  %mul = mul i32 %x, 3
+  %x.next = add i32 %mul, 1
+  %neg = icmp slt i32 %x.next, 0
+  br i1 %neg, label %overflow, label %while.cont
+
+while.cont:
+  %j.next = add nuw nsw i32 %j, 1
+  %more = icmp slt i32 %j.next, %lim
+  br i1 %more, label %while.body, label %notfound
+
+found:
+  %j.found = phi i32 [ %j, %while.body ]
+  %s.ptr = getelementptr inbounds i32, ptr %S, i64 %i
+  store i32 %j.found, ptr %s.ptr, align 4
+  br label %for.latch
+
+overflow:
+  %o.ptr = getelementptr inbounds i8, ptr %O, i64 %i
+  store i8 1, ptr %o.ptr, align 1
+  br label %for.latch
+
+notfound:
+  %f.ptr = getelementptr inbounds float, ptr %F, i64 %i
+  store float 0.000000e+00, ptr %f.ptr, align 4
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
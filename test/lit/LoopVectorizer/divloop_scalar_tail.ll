@@ -0,0 +1,65 @@
+; RUN: env RV_DIV_LOOP_SCALAR_TAIL=4 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_DIV_LOOP_SCALAR_TAIL=4 opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; The divergent inner loop checks its occupancy in every iteration. Once fewer
+; than 4 of the 8 lanes are live, each live lane finishes in a scalar clone of
+; the inner loop.
+
+; REMARK: remark: {{.*}}Loop vectorized (width 8)
+
+; CHECK-LABEL: @collatz(
+; CHECK: call i32 @llvm.ctpop.i32(
+; CHECK: icmp ult i32 %{{.*}}, 4
+; CHECK: .scalar{{.*}}:
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @collatz(ptr nocapture readonly %A, ptr nocapture %S, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %while.end ]
+  %arrayidx = getelementptr inbounds i32, ptr %A, i64 %indvars.iv
+  %x0 = load i32, ptr %arrayidx, align 4
+  br label %while.body
+
+while.body:
+  %x = phi i32 [ %x0, %for.body ], [ %x.next, %while.body ]
+  %steps = phi i32 [ 0, %for.body ], [ %steps.next, %while.body ]
+  %bit = and i32 %x, 1
+  %odd = icmp ne i32 %bit, 0
+  %mul = mul nsw i32 %x, 3
+  %up = add nsw i32 %mul, 1
+  %down = lshr i32 %x, 1
+  %x.next = select i1 %odd, i32 %up, i32 %down
+  %steps.next = add nuw nsw i32 %steps, 1
+  %cont = icmp sgt i32 %x.next, 1
+  br i1 %cont, label %while.body, label %while.end
+
+while.end:
+  %steps.lcssa = phi i32 [ %steps.next, %while.body ]
+  %arrayidx2 = getelementptr inbounds i32, ptr %S, i64 %indvars.iv
+  store i32 %steps.lcssa, ptr %arrayidx2, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
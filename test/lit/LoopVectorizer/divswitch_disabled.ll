@@ -0,0 +1,300 @@
+; RUN: env RV_NO_SWITCH_DISPATCH=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_NO_SWITCH_DISPATCH=1 opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; RV_NO_SWITCH_DISPATCH: the divergent switch is linearized into a compare
+; cascade even though a dispatch loop would be cheaper.
+
+; REMARK: remark: {{.*}}Loop vectorized (width 4)
+
+; CHECK-LABEL: @dispatch(
+; CHECK-NOT: @llvm.cttz.i32
+; CHECK: ret void
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @dispatch(ptr nocapture readonly %A, ptr nocapture %B) local_unnamed_addr #0 {
+entry:
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %entry ], [ %indvars.iv.next, %sw.join ]
+  %arrayidx = getelementptr inbounds i32, ptr %A, i64 %indvars.iv
+  %x = load i32, ptr %arrayidx, align 4
+  %sel = and i32 %x, 255
+  switch i32 %sel, label %sw.join [
+    i32 0, label %sw.case0
+    i32 1, label %sw.case1
+    i32 2, label %sw.case2
+    i32 3, label %sw.case3
+    i32 4, label %sw.case4
+    i32 5, label %sw.case5
+    i32 6, label %sw.case6
+    i32 7, label %sw.case7
+    i32 8, label %sw.case8
+    i32 9, label %sw.case9
+    i32 10, label %sw.case10
+    i32 11, label %sw.case11
+    i32 12, label %sw.case12
+    i32 13, label %sw.case13
+    i32 14, label %sw.case14
+    i32 15, label %sw.case15
+  ]
+
+sw.case0:
+  %c0.0 = mul i32 %x, 3
+  %c0.1 = xor i32 %c0.0, 16
+  %c0.2 = add i32 %c0.1, 29
+  %c0.3 = sub i32 %c0.2, 42
+  %c0.4 = shl i32 %c0.3, 5
+  %c0.5 = or i32 %c0.4, 68
+  %c0.6 = lshr i32 %c0.5, 2
+  %c0.7 = and i32 %c0.6, 94
+  %c0.8 = mul i32 %c0.7, 107
+  %c0.9 = xor i32 %c0.8, 120
+  %c0.10 = add i32 %c0.9, 133
+  %c0.11 = sub i32 %c0.10, 146
+  br label %sw.join
+
+sw.case1:
+  %c1.0 = sub i32 %x, 20
+  %c1.1 = shl i32 %c1.0, 2
+  %c1.2 = or i32 %c1.1, 46
+  %c1.3 = lshr i32 %c1.2, 4
+  %c1.4 = and i32 %c1.3, 72
+  %c1.5 = mul i32 %c1.4, 85
+  %c1.6 = xor i32 %c1.5, 98
+  %c1.7 = add i32 %c1.6, 111
+  %c1.8 = sub i32 %c1.7, 124
+  %c1.9 = shl i32 %c1.8, 5
+  %c1.10 = or i32 %c1.9, 150
+  %c1.11 = lshr i32 %c1.10, 2
+  br label %sw.join
+
+sw.case2:
+  %c2.0 = lshr i32 %x, 1
+  %c2.1 = and i32 %c2.0, 50
+  %c2.2 = mul i32 %c2.1, 63
+  %c2.3 = xor i32 %c2.2, 76
+  %c2.4 = add i32 %c2.3, 89
+  %c2.5 = sub i32 %c2.4, 102
+  %c2.6 = shl i32 %c2.5, 2
+  %c2.7 = or i32 %c2.6, 128
+  %c2.8 = lshr i32 %c2.7, 4
+  %c2.9 = and i32 %c2.8, 154
+  %c2.10 = mul i32 %c2.9, 167
+  %c2.11 = xor i32 %c2.10, 180
+  br label %sw.join
+
+sw.case3:
+  %c3.0 = xor i32 %x, 54
+  %c3.1 = add i32 %c3.0, 67
+  %c3.2 = sub i32 %c3.1, 80
+  %c3.3 = shl i32 %c3.2, 4
+  %c3.4 = or i32 %c3.3, 106
+  %c3.5 = lshr i32 %c3.4, 1
+  %c3.6 = and i32 %c3.5, 132
+  %c3.7 = mul i32 %c3.6, 145
+  %c3.8 = xor i32 %c3.7, 158
+  %c3.9 = add i32 %c3.8, 171
+  %c3.10 = sub i32 %c3.9, 184
+  %c3.11 = shl i32 %c3.10, 2
+  br label %sw.join
+
+sw.case4:
+  %c4.0 = shl i32 %x, 1
+  %c4.1 = or i32 %c4.0, 84
+  %c4.2 = lshr i32 %c4.1, 3
+  %c4.3 = and i32 %c4.2, 110
+  %c4.4 = mul i32 %c4.3, 123
+  %c4.5 = xor i32 %c4.4, 136
+  %c4.6 = add i32 %c4.5, 149
+  %c4.7 = sub i32 %c4.6, 162
+  %c4.8 = shl i32 %c4.7, 4
+  %c4.9 = or i32 %c4.8, 188
+  %c4.10 = lshr i32 %c4.9, 1
+  %c4.11 = and i32 %c4.10, 214
+  br label %sw.join
+
+sw.case5:
+  %c5.0 = and i32 %x, 88
+  %c5.1 = mul i32 %c5.0, 101
+  %c5.2 = xor i32 %c5.1, 114
+  %c5.3 = add i32 %c5.2, 127
+  %c5.4 = sub i32 %c5.3, 140
+  %c5.5 = shl i32 %c5.4, 1
+  %c5.6 = or i32 %c5.5, 166
+  %c5.7 = lshr i32 %c5.6, 3
+  %c5.8 = and i32 %c5.7, 192
+  %c5.9 = mul i32 %c5.8, 205
+  %c5.10 = xor i32 %c5.9, 218
+  %c5.11 = add i32 %c5.10, 231
+  br label %sw.join
+
+sw.case6:
+  %c6.0 = add i32 %x, 105
+  %c6.1 = sub i32 %c6.0, 118
+  %c6.2 = shl i32 %c6.1, 3
+  %c6.3 = or i32 %c6.2, 144
+  %c6.4 = lshr i32 %c6.3, 5
+  %c6.5 = and i32 %c6.4, 170
+  %c6.6 = mul i32 %c6.5, 183
+  %c6.7 = xor i32 %c6.6, 196
+  %c6.8 = add i32 %c6.7, 209
+  %c6.9 = sub i32 %c6.8, 222
+  %c6.10 = shl i32 %c6.9, 1
+  %c6.11 = or i32 %c6.10, 248
+  br label %sw.join
+
+sw.case7:
+  %c7.0 = or i32 %x, 122
+  %c7.1 = lshr i32 %c7.0, 2
+  %c7.2 = and i32 %c7.1, 148
+  %c7.3 = mul i32 %c7.2, 161
+  %c7.4 = xor i32 %c7.3, 174
+  %c7.5 = add i32 %c7.4, 187
+  %c7.6 = sub i32 %c7.5, 200
+  %c7.7 = shl i32 %c7.6, 3
+  %c7.8 = or i32 %c7.7, 226
+  %c7.9 = lshr i32 %c7.8, 5
+  %c7.10 = and i32 %c7.9, 252
+  %c7.11 = mul i32 %c7.10, 265
+  br label %sw.join
+
+sw.case8:
+  %c8.0 = mul i32 %x, 139
+  %c8.1 = xor i32 %c8.0, 152
+  %c8.2 = add i32 %c8.1, 165
+  %c8.3 = sub i32 %c8.2, 178
+  %c8.4 = shl i32 %c8.3, 5
+  %c8.5 = or i32 %c8.4, 204
+  %c8.6 = lshr i32 %c8.5, 2
+  %c8.7 = and i32 %c8.6, 230
+  %c8.8 = mul i32 %c8.7, 243
+  %c8.9 = xor i32 %c8.8, 256
+  %c8.10 = add i32 %c8.9, 269
+  %c8.11 = sub i32 %c8.10, 282
+  br label %sw.join
+
+sw.case9:
+  %c9.0 = sub i32 %x, 156
+  %c9.1 = shl i32 %c9.0, 2
+  %c9.2 = or i32 %c9.1, 182
+  %c9.3 = lshr i32 %c9.2, 4
+  %c9.4 = and i32 %c9.3, 208
+  %c9.5 = mul i32 %c9.4, 221
+  %c9.6 = xor i32 %c9.5, 234
+  %c9.7 = add i32 %c9.6, 247
+  %c9.8 = sub i32 %c9.7, 260
+  %c9.9 = shl i32 %c9.8, 5
+  %c9.10 = or i32 %c9.9, 286
+  %c9.11 = lshr i32 %c9.10, 2
+  br label %sw.join
+
+sw.case10:
+  %c10.0 = lshr i32 %x, 1
+  %c10.1 = and i32 %c10.0, 186
+  %c10.2 = mul i32 %c10.1, 199
+  %c10.3 = xor i32 %c10.2, 212
+  %c10.4 = add i32 %c10.3, 225
+  %c10.5 = sub i32 %c10.4, 238
+  %c10.6 = shl i32 %c10.5, 2
+  %c10.7 = or i32 %c10.6, 264
+  %c10.8 = lshr i32 %c10.7, 4
+  %c10.9 = and i32 %c10.8, 290
+  %c10.10 = mul i32 %c10.9, 303
+  %c10.11 = xor i32 %c10.10, 316
+  br label %sw.join
+
+sw.case11:
+  %c11.0 = xor i32 %x, 190
+  %c11.1 = add i32 %c11.0, 203
+  %c11.2 = sub i32 %c11.1, 216
+  %c11.3 = shl i32 %c11.2, 4
+  %c11.4 = or i32 %c11.3, 242
+  %c11.5 = lshr i32 %c11.4, 1
+  %c11.6 = and i32 %c11.5, 268
+  %c11.7 = mul i32 %c11.6, 281
+  %c11.8 = xor i32 %c11.7, 294
+  %c11.9 = add i32 %c11.8, 307
+  %c11.10 = sub i32 %c11.9, 320
+  %c11.11 = shl i32 %c11.10, 2
+  br label %sw.join
+
+sw.case12:
+  %c12.0 = shl i32 %x, 1
+  %c12.1 = or i32 %c12.0, 220
+  %c12.2 = lshr i32 %c12.1, 3
+  %c12.3 = and i32 %c12.2, 246
+  %c12.4 = mul i32 %c12.3, 259
+  %c12.5 = xor i32 %c12.4, 272
+  %c12.6 = add i32 %c12.5, 285
+  %c12.7 = sub i32 %c12.6, 298
+  %c12.8 = shl i32 %c12.7, 4
+  %c12.9 = or i32 %c12.8, 324
+  %c12.10 = lshr i32 %c12.9, 1
+  %c12.11 = and i32 %c12.10, 350
+  br label %sw.join
+
+sw.case13:
+  %c13.0 = and i32 %x, 224
+  %c13.1 = mul i32 %c13.0, 237
+  %c13.2 = xor i32 %c13.1, 250
+  %c13.3 = add i32 %c13.2, 263
+  %c13.4 = sub i32 %c13.3, 276
+  %c13.5 = shl i32 %c13.4, 1
+  %c13.6 = or i32 %c13.5, 302
+  %c13.7 = lshr i32 %c13.6, 3
+  %c13.8 = and i32 %c13.7, 328
+  %c13.9 = mul i32 %c13.8, 341
+  %c13.10 = xor i32 %c13.9, 354
+  %c13.11 = add i32 %c13.10, 367
+  br label %sw.join
+
+sw.case14:
+  %c14.0 = add i32 %x, 241
+  %c14.1 = sub i32 %c14.0, 254
+  %c14.2 = shl i32 %c14.1, 3
+  %c14.3 = or i32 %c14.2, 280
+  %c14.4 = lshr i32 %c14.3, 5
+  %c14.5 = and i32 %c14.4, 306
+  %c14.6 = mul i32 %c14.5, 319
+  %c14.7 = xor i32 %c14.6, 332
+  %c14.8 = add i32 %c14.7, 345
+  %c14.9 = sub i32 %c14.8, 358
+  %c14.10 = shl i32 %c14.9, 1
+  %c14.11 = or i32 %c14.10, 384
+  br label %sw.join
+
+sw.case15:
+  %c15.0 = or i32 %x, 258
+  %c15.1 = lshr i32 %c15.0, 2
+  %c15.2 = and i32 %c15.1, 284
+  %c15.3 = mul i32 %c15.2, 297
+  %c15.4 = xor i32 %c15.3, 310
+  %c15.5 = add i32 %c15.4, 323
+  %c15.6 = sub i32 %c15.5, 336
+  %c15.7 = shl i32 %c15.6, 3
+  %c15.8 = or i32 %c15.7, 362
+  %c15.9 = lshr i32 %c15.8, 5
+  %c15.10 = and i32 %c15.9, 388
+  %c15.11 = mul i32 %c15.10, 401
+  br label %sw.join
+
+sw.join:
+  %r = phi i32 [ %x, %for.body ], [ %c0.11, %sw.case0 ], [ %c1.11, %sw.case1 ], [ %c2.11, %sw.case2 ], [ %c3.11, %sw.case3 ], [ %c4.11, %sw.case4 ], [ %c5.11, %sw.case5 ], [ %c6.11, %sw.case6 ], [ %c7.11, %sw.case7 ], [ %c8.11, %sw.case8 ], [ %c9.11, %sw.case9 ], [ %c10.11, %sw.case10 ], [ %c11.11, %sw.case11 ], [ %c12.11, %sw.case12 ], [ %c13.11, %sw.case13 ], [ %c14.11, %sw.case14 ], [ %c15.11, %sw.case15 ]
+  %arrayidx2 = getelementptr inbounds i32, ptr %B, i64 %indvars.iv
+  store i32 %r, ptr %arrayidx2, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, 1024
+  br i1 %exitcond.not, label %for.end, label %for.body, !llvm.loop !0
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 4}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
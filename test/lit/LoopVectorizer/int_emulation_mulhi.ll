@@ -0,0 +1,93 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; 64-bit multiply-high, trunc(lshr(mul(ext a, ext b), 64)), becomes four
+; 32x32->64 bit multiplies of the halves instead of a scalarized i128 multiply.
+; The signed variant subtracts the sign corrections from the unsigned result.
+
+; CHECK-LABEL: @mulhi_u64(
+; CHECK-COUNT-4: mul <8 x i64>
+; CHECK: lshr <8 x i64> %{{.*}}, {{.*}}i64 32
+; CHECK: store <8 x i64>
+
+; CHECK-LABEL: @mulhi_s64(
+; CHECK-COUNT-4: mul <8 x i64>
+; CHECK: icmp slt <8 x i64>
+; CHECK: sub <8 x i64>
+; CHECK: store <8 x i64>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @mulhi_u64(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i64, ptr %A, i64 %i
+  %a = load i64, ptr %a.ptr, align 8
+  %b.ptr = getelementptr inbounds i64, ptr %B, i64 %i
+  %b = load i64, ptr %b.ptr, align 8
+  %ea = zext i64 %a to i128
+  %eb = zext i64 %b to i128
+  %prod = mul nuw i128 %ea, %eb
+  %high = lshr i128 %prod, 64
+  %r = trunc i128 %high to i64
+  %c.ptr = getelementptr inbounds i64, ptr %C, i64 %i
+  store i64 %r, ptr %c.ptr, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @mulhi_s64(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i64, ptr %A, i64 %i
+  %a = load i64, ptr %a.ptr, align 8
+  %b.ptr = getelementptr inbounds i64, ptr %B, i64 %i
+  %b = load i64, ptr %b.ptr, align 8
+  %ea = sext i64 %a to i128
+  %eb = sext i64 %b to i128
+  %prod = mul nsw i128 %ea, %eb
+  %high = lshr i128 %prod, 64
+  %r = trunc i128 %high to i64
+  %c.ptr = getelementptr inbounds i64, ptr %C, i64 %i
+  store i64 %r, ptr %c.ptr, align 8
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
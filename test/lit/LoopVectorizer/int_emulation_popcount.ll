@@ -0,0 +1,59 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_NO_INT_EMULATION=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s --check-prefix=OFF
+
+; On AVX2 there is no vector popcount: TTI prices llvm.ctpop.v8i32 above the
+; SWAR sequence (2-, 4- and 8-bit sums, then the bytes summed up by shifts).
+
+; CHECK-LABEL: @popcount_i32(
+; CHECK-NOT: @llvm.ctpop.v8i32
+; CHECK: and <8 x i32> %{{.*}}, {{.*}}i32 1431655765
+; CHECK: and <8 x i32> %{{.*}}, {{.*}}i32 858993459
+; CHECK: and <8 x i32> %{{.*}}, {{.*}}i32 252645135
+; CHECK: lshr <8 x i32> %{{.*}}, {{.*}}i32 8
+; CHECK: lshr <8 x i32> %{{.*}}, {{.*}}i32 16
+; CHECK: and <8 x i32> %{{.*}}, {{.*}}i32 63
+; CHECK: store <8 x i32>
+
+; OFF-LABEL: @popcount_i32(
+; OFF: call <8 x i32> @llvm.ctpop.v8i32(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @popcount_i32(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i32, ptr %A, i64 %i
+  %a = load i32, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %x = xor i32 %a, %b
+  %r = call i32 @llvm.ctpop.i32(i32 %x)
+  %c.ptr = getelementptr inbounds i32, ptr %C, i64 %i
+  store i32 %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+declare i32 @llvm.ctpop.i32(i32)
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,90 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_NO_INT_EMULATION=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s --check-prefix=OFF
+
+; x86 has no 8-bit vector shifts. With varying amounts the i8 lanes are
+; widened to i32 for vpsravd/vpsllvd and truncated back.
+
+; CHECK-LABEL: @ashr_i8(
+; CHECK: sext <16 x i8> %{{.*}} to <16 x i32>
+; CHECK: ashr <16 x i32>
+; CHECK: trunc <16 x i32> %{{.*}} to <16 x i8>
+; CHECK: store <16 x i8>
+
+; CHECK-LABEL: @shl_i8(
+; CHECK: shl <16 x i32>
+; CHECK: trunc <16 x i32> %{{.*}} to <16 x i8>
+; CHECK: store <16 x i8>
+
+; OFF-LABEL: @ashr_i8(
+; OFF: ashr <16 x i8>
+; OFF-LABEL: @shl_i8(
+; OFF: shl <16 x i8>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @ashr_i8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %r = ashr i8 %a, %b
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @shl_i8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %r = shl i8 %a, %b
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 16}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
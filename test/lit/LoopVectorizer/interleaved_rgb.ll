@@ -0,0 +1,59 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; The three stride-3 loads form one interleaved group (factor 3): contiguous
+; chunk loads and de-interleaving shuffles instead of gathers. The two stride-3
+; stores form a store group with a gap, which is masked out.
+
+; CHECK-LABEL: @rgb(
+; CHECK-NOT: @llvm.masked.gather
+; CHECK: load <8 x i32>
+; CHECK: shufflevector <8 x i32>
+; CHECK: call void @llvm.masked.store.v8i32.p0(
+; CHECK-NOT: @llvm.masked.scatter
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @rgb(ptr nocapture readonly %In, ptr nocapture %Out, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %for.body ]
+  %base = mul nuw nsw i64 %indvars.iv, 3
+  %arrayidx.r = getelementptr inbounds i32, ptr %In, i64 %base
+  %r = load i32, ptr %arrayidx.r, align 4
+  %idx.g = add nuw nsw i64 %base, 1
+  %arrayidx.g = getelementptr inbounds i32, ptr %In, i64 %idx.g
+  %g = load i32, ptr %arrayidx.g, align 4
+  %idx.b = add nuw nsw i64 %base, 2
+  %arrayidx.b = getelementptr inbounds i32, ptr %In, i64 %idx.b
+  %b = load i32, ptr %arrayidx.b, align 4
+  %rg = add nsw i32 %r, %g
+  %rgb = add nsw i32 %rg, %b
+  %gb = sub nsw i32 %g, %b
+  %out.0 = getelementptr inbounds i32, ptr %Out, i64 %base
+  store i32 %rgb, ptr %out.0, align 4
+  %out.2 = getelementptr inbounds i32, ptr %Out, i64 %idx.b
+  store i32 %gb, ptr %out.2, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,63 @@
+; RUN: env RV_LANE_REFILL=1 opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s
+
+; Items finish out of order under lane refilling, so there is no last outer
+; iteration to take live-outs from. The total is a live-out of the outer loop:
+; the loop is vectorized in lock-step instead.
+
+; CHECK-NOT: Lanes refilled
+; CHECK: remark: {{.*}}Loop vectorized (width 8)
+; CHECK-NOT: Lanes refilled
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local i32 @collatz_total(ptr nocapture readonly %A, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %while.end ]
+  %total = phi i32 [ 0, %for.body.preheader ], [ %total.next, %while.end ]
+  %arrayidx = getelementptr inbounds i32, ptr %A, i64 %indvars.iv
+  %x0 = load i32, ptr %arrayidx, align 4
+  br label %while.body
+
+while.body:
+  %x = phi i32 [ %x0, %for.body ], [ %x.next, %while.body ]
+  %steps = phi i32 [ 0, %for.body ], [ %steps.next, %while.body ]
+  %bit = and i32 %x, 1
+  %odd = icmp ne i32 %bit, 0
+  %mul = mul nsw i32 %x, 3
+  %up = add nsw i32 %mul, 1
+  %down = lshr i32 %x, 1
+  %x.next = select i1 %odd, i32 %up, i32 %down
+  %steps.next = add nuw nsw i32 %steps, 1
+  %cont = icmp sgt i32 %x.next, 1
+  br i1 %cont, label %while.body, label %while.end
+
+while.end:
+  %steps.lcssa = phi i32 [ %steps.next, %while.body ]
+  %total.next = add nsw i32 %total, %steps.lcssa
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  %total.lcssa = phi i32 [ %total.next, %while.end ]
+  br label %for.end
+
+for.end:
+  %result = phi i32 [ 0, %entry ], [ %total.lcssa, %for.end.loopexit ]
+  ret i32 %result
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
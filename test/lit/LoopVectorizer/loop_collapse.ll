@@ -0,0 +1,145 @@
+; RUN: env RV_LOOP_COLLAPSE=1 RV_REPORT=1 opt %s -O3 -disable-output | FileCheck %s --check-prefix=REPORT
+; RUN: env RV_LOOP_COLLAPSE=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; The annotated inner loop has 4 iterations, half of the 8 lanes. The perfect
+; nest with a parallel outer loop becomes one loop of n * 4 iterations that
+; recovers i = k / 4 and j = k % 4 from its iteration number k. Sums over the
+; nest keep accumulating. An outer header that reads memory keeps the nest.
+
+; REPORT: loopVecPass: collapsing {{.*}} for width 8
+; REPORT: loopVecPass: collapsing {{.*}} for width 8
+; REPORT-NOT: loopVecPass: collapsing
+
+; CHECK-LABEL: @collapse_rows(
+; CHECK: and <8 x i{{[0-9]+}}> %{{.*}}, <i{{[0-9]+}} 3, 
+; CHECK: <8 x float>
+
+; CHECK-LABEL: @collapse_sum(
+; CHECK: phi <8 x float>
+; CHECK: call {{.*}}float @llvm.vector.reduce.fadd.v8f32(
+
+; CHECK-LABEL: @outer_load_rejected(
+; CHECK-NOT: <8 x
+; CHECK: <4 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; C[4 * i + j] = A[4 * i + j] * W[j] for j < 4
+define dso_local void @collapse_rows(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %W, ptr noalias nocapture %C, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.outer, label %for.end
+
+for.outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.outer.latch ]
+  %row = shl nsw i64 %i, 2
+  br label %for.inner
+
+for.inner:
+  %j = phi i64 [ 0, %for.outer ], [ %j.next, %for.inner ]
+  %idx = add nuw nsw i64 %row, %j
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %idx
+  %a = load float, ptr %a.ptr, align 4, !llvm.access.group !10
+  %w.ptr = getelementptr inbounds float, ptr %W, i64 %j
+  %w = load float, ptr %w.ptr, align 4, !llvm.access.group !10
+  %r = fmul float %a, %w
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %idx
+  store float %r, ptr %c.ptr, align 4, !llvm.access.group !10
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.done = icmp eq i64 %j.next, 4
+  br i1 %inner.done, label %for.outer.latch, label %for.inner, !llvm.loop !0
+
+for.outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.done = icmp eq i64 %i.next, %n
+  br i1 %outer.done, label %for.end, label %for.outer, !llvm.loop !4
+
+for.end:
+  ret void
+}
+
+; sum of A[4 * i + j] over the nest
+define dso_local float @collapse_sum(ptr noalias nocapture readonly %A, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.outer, label %for.end
+
+for.outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.outer.latch ]
+  %sum.outer = phi float [ 0.000000e+00, %entry ], [ %sum.lcssa, %for.outer.latch ]
+  %row = shl nsw i64 %i, 2
+  br label %for.inner
+
+for.inner:
+  %j = phi i64 [ 0, %for.outer ], [ %j.next, %for.inner ]
+  %sum = phi float [ %sum.outer, %for.outer ], [ %sum.next, %for.inner ]
+  %idx = add nuw nsw i64 %row, %j
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %idx
+  %a = load float, ptr %a.ptr, align 4, !llvm.access.group !11
+  %sum.next = fadd fast float %sum, %a
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.done = icmp eq i64 %j.next, 4
+  br i1 %inner.done, label %for.outer.latch, label %for.inner, !llvm.loop !5
+
+for.outer.latch:
+  %sum.lcssa = phi float [ %sum.next, %for.inner ]
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.done = icmp eq i64 %i.next, %n
+  br i1 %outer.done, label %for.end, label %for.outer, !llvm.loop !6
+
+for.end:
+  %res = phi float [ 0.000000e+00, %entry ], [ %sum.lcssa, %for.outer.latch ]
+  ret float %res
+}
+
+; C[4 * i + j] = A[4 * i + j] * S[i]: the load of S[i] only runs once per row
+define dso_local void @outer_load_rejected(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %S, ptr noalias nocapture %C, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.outer, label %for.end
+
+for.outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.outer.latch ]
+  %row = shl nsw i64 %i, 2
+  %s.ptr = getelementptr inbounds float, ptr %S, i64 %i
+  %s = load float, ptr %s.ptr, align 4, !llvm.access.group !12
+  br label %for.inner
+
+for.inner:
+  %j = phi i64 [ 0, %for.outer ], [ %j.next, %for.inner ]
+  %idx = add nuw nsw i64 %row, %j
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %idx
+  %a = load float, ptr %a.ptr, align 4, !llvm.access.group !12
+  %r = fmul float %a, %s
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %idx
+  store float %r, ptr %c.ptr, align 4, !llvm.access.group !12
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.done = icmp eq i64 %j.next, 4
+  br i1 %inner.done, label %for.outer.latch, label %for.inner, !llvm.loop !7
+
+for.outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.done = icmp eq i64 %i.next, %n
+  br i1 %outer.done, label %for.end, label %for.outer, !llvm.loop !8
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.enable", i1 true}
+!2 = !{!"llvm.loop.unroll.disable"}
+!3 = !{!"llvm.loop.parallel_accesses", !10}
+!4 = distinct !{!4, !3}
+!5 = distinct !{!5, !1, !2}
+!6 = distinct !{!6, !9}
+!7 = distinct !{!7, !1, !2}
+!8 = distinct !{!8, !13}
+!9 = !{!"llvm.loop.parallel_accesses", !11}
+!10 = distinct !{}
+!11 = distinct !{}
+!12 = distinct !{}
+!13 = !{!"llvm.loop.parallel_accesses", !12}
@@ -0,0 +1,181 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Averages of two narrow values computed in a wider type are folded to the
+; carry-free narrow forms: (a | b) - ((a ^ b) >> 1) rounds up and
+; (a & b) + ((a ^ b) >> 1) rounds down. The shift is arithmetic for
+; sign-extended operands.
+
+; CHECK-LABEL: @avg_round_u8(
+; CHECK-NOT: zext <16 x i8>
+; CHECK: xor <16 x i8>
+; CHECK: lshr <16 x i8>
+; CHECK: or <16 x i8>
+; CHECK: sub <16 x i8>
+
+; CHECK-LABEL: @avg_floor_u8(
+; CHECK-NOT: zext <16 x i8>
+; CHECK: xor <16 x i8>
+; CHECK: lshr <16 x i8>
+; CHECK: and <16 x i8>
+; CHECK: add <16 x i8>
+
+; CHECK-LABEL: @avg_round_s8(
+; CHECK-NOT: sext <16 x i8>
+; CHECK: xor <16 x i8>
+; CHECK: ashr <16 x i8>
+; CHECK: or <16 x i8>
+; CHECK: sub <16 x i8>
+
+; CHECK-LABEL: @avg_floor_s8(
+; CHECK-NOT: sext <16 x i8>
+; CHECK: xor <16 x i8>
+; CHECK: ashr <16 x i8>
+; CHECK: and <16 x i8>
+; CHECK: add <16 x i8>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @avg_round_u8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = zext i8 %a to i16
+  %eb = zext i8 %b to i16
+  %sum = add nsw i16 %ea, %eb
+  %sum1 = add nsw i16 %sum, 1
+  %half = lshr i16 %sum1, 1
+  %r = trunc i16 %half to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @avg_floor_u8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = zext i8 %a to i16
+  %eb = zext i8 %b to i16
+  %sum = add nsw i16 %ea, %eb
+  %half = lshr i16 %sum, 1
+  %r = trunc i16 %half to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @avg_round_s8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = sext i8 %a to i16
+  %eb = sext i8 %b to i16
+  %sum = add nsw i16 %ea, %eb
+  %sum1 = add nsw i16 %sum, 1
+  %half = ashr i16 %sum1, 1
+  %r = trunc i16 %half to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @avg_floor_s8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = sext i8 %a to i16
+  %eb = sext i8 %b to i16
+  %sum = add nsw i16 %ea, %eb
+  %half = ashr i16 %sum, 1
+  %r = trunc i16 %half to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !5
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 16}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
+!5 = distinct !{!5, !1, !2}
@@ -0,0 +1,88 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; A varying i64 gather index whose range fits 32 bits is computed in i32 lanes
+; (twice as many per register) and sign extended at the gather. An index
+; without a known range keeps the i64 computation.
+
+; CHECK-LABEL: @gather_bounded(
+; CHECK-NOT: mul nsw <16 x i64>
+; CHECK: sext <16 x i16> %{{.*}} to <16 x i32>
+; CHECK: mul <16 x i32> %{{.*}}, {{.*}}i32 3
+; CHECK: sext <16 x i32> %{{.*}} to <16 x i64>
+; CHECK: getelementptr inbounds float, ptr %A, <16 x i64>
+; CHECK: store <16 x float>
+
+; CHECK-LABEL: @gather_unbounded(
+; CHECK-NOT: <16 x i32>
+; CHECK: mul nsw <16 x i64> %{{.*}}, {{.*}}i64 3
+; CHECK: getelementptr inbounds float, ptr %A, <16 x i64>
+; CHECK: store <16 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @gather_bounded(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i16, ptr %B, i64 %i
+  %b = load i16, ptr %b.ptr, align 2
+  %e = sext i16 %b to i64
+  %idx = mul nsw i64 %e, 3
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %idx
+  %r = load float, ptr %a.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @gather_unbounded(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i64, ptr %B, i64 %i
+  %b = load i64, ptr %b.ptr, align 8
+  %idx = mul nsw i64 %b, 3
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %idx
+  %r = load float, ptr %a.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="skylake-avx512" "target-features"="+avx,+avx2,+avx512f,+avx512vl,+sse2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 16}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
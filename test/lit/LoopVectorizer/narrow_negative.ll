@@ -0,0 +1,138 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Wide operations that are not the narrow idioms stay wide:
+; - a sum of one sign- and one zero-extended operand,
+; - a clamp to [0, 250] that does not saturate to the u8 range,
+; - an average whose sum has another user.
+
+; CHECK-LABEL: @add_mixed_ext(
+; CHECK-NOT: @llvm.sadd.sat
+; CHECK-NOT: @llvm.uadd.sat
+; CHECK: ret void
+
+; CHECK-LABEL: @add_clamp_250(
+; CHECK: zext <16 x i8>
+; CHECK-NOT: @llvm.uadd.sat
+; CHECK: ret void
+
+; CHECK-LABEL: @avg_sum_used(
+; CHECK: zext <16 x i8>
+; CHECK: lshr <16 x i16>
+; CHECK: ret void
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @add_mixed_ext(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = sext i8 %a to i16
+  %eb = zext i8 %b to i16
+  %sum = add nsw i16 %ea, %eb
+  %lo = call i16 @llvm.smax.i16(i16 %sum, i16 -128)
+  %sat = call i16 @llvm.smin.i16(i16 %lo, i16 127)
+  %r = trunc i16 %sat to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @add_clamp_250(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = zext i8 %a to i16
+  %eb = zext i8 %b to i16
+  %sum = add nuw nsw i16 %ea, %eb
+  %sat = call i16 @llvm.umin.i16(i16 %sum, i16 250)
+  %r = trunc i16 %sat to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @avg_sum_used(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, ptr noalias nocapture %S, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = zext i8 %a to i16
+  %eb = zext i8 %b to i16
+  %sum = add nuw nsw i16 %ea, %eb
+  %s.ptr = getelementptr inbounds i16, ptr %S, i64 %i
+  store i16 %sum, ptr %s.ptr, align 2
+  %half = lshr i16 %sum, 1
+  %r = trunc i16 %half to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+declare i16 @llvm.smax.i16(i16, i16)
+declare i16 @llvm.smin.i16(i16, i16)
+declare i16 @llvm.umin.i16(i16, i16)
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 16}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
@@ -0,0 +1,53 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; The packus idiom: an i16 value clamped to [0, 255] in i32 and truncated to
+; i8. The clamp moves to the i16 source, the vector loop clamps and truncates
+; <16 x i16> without widening to i32.
+
+; CHECK-LABEL: @pack_u8(
+; CHECK-NOT: sext <16 x i16>
+; CHECK-DAG: call <16 x i16> @llvm.smin.v16i16(
+; CHECK-DAG: call <16 x i16> @llvm.smax.v16i16(
+; CHECK: trunc <16 x i16> %{{.*}} to <16 x i8>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @pack_u8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i16, ptr %A, i64 %i
+  %a = load i16, ptr %a.ptr, align 2
+  %ea = sext i16 %a to i32
+  %hi = call i32 @llvm.smin.i32(i32 %ea, i32 255)
+  %lo = call i32 @llvm.smax.i32(i32 %hi, i32 0)
+  %r8 = trunc i32 %lo to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r8, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+declare i32 @llvm.smax.i32(i32, i32)
+declare i32 @llvm.smin.i32(i32, i32)
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 16}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
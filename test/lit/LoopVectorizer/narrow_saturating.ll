@@ -0,0 +1,94 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Saturating arithmetic written in a wider type is folded back to the narrow
+; saturating intrinsics before vectorization, so the vector loop works on
+; narrow lanes.
+
+; CHECK-LABEL: @add_u8(
+; CHECK-NOT: zext <16 x i8>
+; CHECK: call <16 x i8> @llvm.uadd.sat.v16i8(
+
+; CHECK-LABEL: @sub_i16(
+; CHECK-NOT: sext <16 x i16>
+; CHECK: call <16 x i16> @llvm.ssub.sat.v16i16(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @add_u8(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i8, ptr %A, i64 %i
+  %a = load i8, ptr %a.ptr, align 1
+  %b.ptr = getelementptr inbounds i8, ptr %B, i64 %i
+  %b = load i8, ptr %b.ptr, align 1
+  %ea = zext i8 %a to i16
+  %eb = zext i8 %b to i16
+  %sum = add nuw nsw i16 %ea, %eb
+  %sat = call i16 @llvm.umin.i16(i16 %sum, i16 255)
+  %r = trunc i16 %sat to i8
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @sub_i16(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds i16, ptr %A, i64 %i
+  %a = load i16, ptr %a.ptr, align 2
+  %b.ptr = getelementptr inbounds i16, ptr %B, i64 %i
+  %b = load i16, ptr %b.ptr, align 2
+  %ea = sext i16 %a to i32
+  %eb = sext i16 %b to i32
+  %diff = sub nsw i32 %ea, %eb
+  %lo = call i32 @llvm.smax.i32(i32 %diff, i32 -32768)
+  %sat = call i32 @llvm.smin.i32(i32 %lo, i32 32767)
+  %r = trunc i32 %sat to i16
+  %c.ptr = getelementptr inbounds i16, ptr %C, i64 %i
+  store i16 %r, ptr %c.ptr, align 2
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+declare i16 @llvm.umin.i16(i16, i16)
+declare i32 @llvm.smax.i32(i32, i32)
+declare i32 @llvm.smin.i32(i32, i32)
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 16}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
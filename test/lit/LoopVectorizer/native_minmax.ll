@@ -0,0 +1,157 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; A select(fcmp) min/max whose compare carries nnan and nsz becomes a minnum or
+; maxnum with these flags (minps/maxps). Without nsz the select stays, because
+; the native instructions do not order -0 and +0. A min reduction of such
+; selects reduces with nnan and nsz as well.
+
+; CHECK-LABEL: @fmin_select(
+; CHECK-NOT: select <8 x i1>
+; CHECK: call nnan nsz <8 x float> @llvm.minnum.v8f32(
+; CHECK: store <8 x float>
+
+; CHECK-LABEL: @fmax_select(
+; CHECK-NOT: select <8 x i1>
+; CHECK: call nnan nsz <8 x float> @llvm.maxnum.v8f32(
+; CHECK: store <8 x float>
+
+; CHECK-LABEL: @fmin_select_signed_zeros(
+; CHECK-NOT: @llvm.minnum.v8f32
+; CHECK: fcmp nnan olt <8 x float>
+; CHECK: select <8 x i1>
+; CHECK: store <8 x float>
+
+; CHECK-LABEL: @fmin_reduction(
+; CHECK: call nnan nsz <8 x float> @llvm.minnum.v8f32(
+; CHECK: call nnan nsz float @llvm.vector.reduce.fmin.v8f32(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @fmin_select(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %lt = fcmp nnan nsz olt float %a, %b
+  %r = select i1 %lt, float %a, float %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @fmax_select(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %gt = fcmp nnan nsz ogt float %a, %b
+  %r = select i1 %gt, float %a, float %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @fmin_select_signed_zeros(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %i
+  %b = load float, ptr %b.ptr, align 4
+  %lt = fcmp nnan olt float %a, %b
+  %r = select i1 %lt, float %a, float %b
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local float @fmin_reduction(ptr noalias nocapture readonly %A, float %init, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %m = phi float [ %init, %for.body.preheader ], [ %m.next, %for.body ]
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  %a = load float, ptr %a.ptr, align 4
+  %lt = fcmp nnan nsz olt float %a, %m
+  %m.next = select i1 %lt, float %a, float %m
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !5
+
+for.end.loopexit:
+  %m.lcssa = phi float [ %m.next, %for.body ]
+  br label %for.end
+
+for.end:
+  %res = phi float [ %init, %entry ], [ %m.lcssa, %for.end.loopexit ]
+  ret float %res
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
+!5 = distinct !{!5, !1, !2}
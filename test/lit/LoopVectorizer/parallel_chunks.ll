@@ -0,0 +1,50 @@
+; RUN: env RV_PARALLEL_CHUNKS=4 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_PARALLEL_CHUNKS=4 opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; A parallel loop is split into chunks of 4 vector iterations. The vectorized
+; chunk body is outlined into a task that the runtime calls once per chunk.
+
+; REMARK: remark: {{.*}}Loop runs in thread chunks of {{[0-9]+}} iterations
+; REMARK: remark: {{.*}}Loop vectorized (width 8)
+
+; CHECK-LABEL: @vector_add(
+; CHECK: call void @rv_parallel_for(ptr {{.*}}@{{.*}}, ptr
+; CHECK: declare void @rv_parallel_for(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @vector_add(ptr nocapture readonly %A, ptr nocapture readonly %B, ptr nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %for.body ]
+  %arrayidx = getelementptr inbounds float, ptr %A, i64 %indvars.iv
+  %0 = load float, ptr %arrayidx, align 4
+  %arrayidx2 = getelementptr inbounds float, ptr %B, i64 %indvars.iv
+  %1 = load float, ptr %arrayidx2, align 4
+  %add = fadd float %0, %1
+  %arrayidx4 = getelementptr inbounds float, ptr %C, i64 %indvars.iv
+  store float %add, ptr %arrayidx4, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
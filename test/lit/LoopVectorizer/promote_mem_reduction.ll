@@ -0,0 +1,184 @@
+; RUN: env RV_REPORT=1 opt %s -O3 -disable-output | FileCheck %s --check-prefix=REPORT
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; sum[k] += v in an inner loop of the vectorized loop, with a uniform k and a
+; varying v, accumulates in a vector register and updates memory once at the
+; inner loop exit. It stays a per-iteration update if another access of the
+; loop may alias the accumulator or if the fadd may not be reassociated. LICM
+; does not promote the conditional store to a global.
+
+; REPORT-NOT: promoteMemReductions
+; REPORT: rv: promoteMemReductions: promoted 1 accumulators to registers
+; REPORT-NOT: promoteMemReductions
+
+; CHECK-LABEL: @sum_may_alias(
+; CHECK-NOT: phi <8 x float>
+; CHECK: ret void
+
+; CHECK-LABEL: @sum_no_reassoc(
+; CHECK-NOT: phi <8 x float>
+; CHECK: ret void
+
+; CHECK-LABEL: @sum_promoted(
+; CHECK: phi <8 x float>
+; CHECK: call reassoc float @llvm.vector.reduce.fadd.v8f32(
+; CHECK: ret void
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@sum = dso_local global [16 x float] zeroinitializer, align 64
+
+define dso_local void @sum_may_alias(ptr noalias nocapture readonly %X, ptr noalias nocapture readonly %Y, ptr nocapture %D, i64 %k, i32 %n, i32 %m) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  %inner.trip.count = zext i32 %m to i64
+  %sum.ptr = getelementptr inbounds [16 x float], ptr @sum, i64 0, i64 %k
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %inner.end ]
+  %x.ptr = getelementptr inbounds float, ptr %X, i64 %i
+  %x = load float, ptr %x.ptr, align 4
+  br label %inner.body
+
+inner.body:
+  %j = phi i64 [ 0, %for.body ], [ %j.next, %inner.latch ]
+  %y.ptr = getelementptr inbounds float, ptr %Y, i64 %j
+  %y = load float, ptr %y.ptr, align 4
+  %v = fmul float %x, %y
+  %pos = fcmp ogt float %v, 0.000000e+00
+  br i1 %pos, label %inner.update, label %inner.latch
+
+inner.update:
+  %s = load float, ptr %sum.ptr, align 4
+  %s.next = fadd reassoc float %s, %v
+  store float %s.next, ptr %sum.ptr, align 4
+  br label %inner.latch
+
+inner.latch:
+  %d.ptr = getelementptr inbounds float, ptr %D, i64 %j
+  store float %y, ptr %d.ptr, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.done = icmp uge i64 %j.next, %inner.trip.count
+  br i1 %inner.done, label %inner.end, label %inner.body
+
+inner.end:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @sum_no_reassoc(ptr noalias nocapture readonly %X, ptr noalias nocapture readonly %Y, ptr nocapture %D, i64 %k, i32 %n, i32 %m) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  %inner.trip.count = zext i32 %m to i64
+  %sum.ptr = getelementptr inbounds [16 x float], ptr @sum, i64 0, i64 %k
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %inner.end ]
+  %x.ptr = getelementptr inbounds float, ptr %X, i64 %i
+  %x = load float, ptr %x.ptr, align 4
+  br label %inner.body
+
+inner.body:
+  %j = phi i64 [ 0, %for.body ], [ %j.next, %inner.latch ]
+  %y.ptr = getelementptr inbounds float, ptr %Y, i64 %j
+  %y = load float, ptr %y.ptr, align 4
+  %v = fmul float %x, %y
+  %pos = fcmp ogt float %v, 0.000000e+00
+  br i1 %pos, label %inner.update, label %inner.latch
+
+inner.update:
+  %s = load float, ptr %sum.ptr, align 4
+  %s.next = fadd float %s, %v
+  store float %s.next, ptr %sum.ptr, align 4
+  br label %inner.latch
+
+inner.latch:
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.done = icmp uge i64 %j.next, %inner.trip.count
+  br i1 %inner.done, label %inner.end, label %inner.body
+
+inner.end:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @sum_promoted(ptr noalias nocapture readonly %X, ptr noalias nocapture readonly %Y, ptr nocapture %D, i64 %k, i32 %n, i32 %m) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  %inner.trip.count = zext i32 %m to i64
+  %sum.ptr = getelementptr inbounds [16 x float], ptr @sum, i64 0, i64 %k
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %inner.end ]
+  %x.ptr = getelementptr inbounds float, ptr %X, i64 %i
+  %x = load float, ptr %x.ptr, align 4
+  br label %inner.body
+
+inner.body:
+  %j = phi i64 [ 0, %for.body ], [ %j.next, %inner.latch ]
+  %y.ptr = getelementptr inbounds float, ptr %Y, i64 %j
+  %y = load float, ptr %y.ptr, align 4
+  %v = fmul float %x, %y
+  %pos = fcmp ogt float %v, 0.000000e+00
+  br i1 %pos, label %inner.update, label %inner.latch
+
+inner.update:
+  %s = load float, ptr %sum.ptr, align 4
+  %s.next = fadd reassoc float %s, %v
+  store float %s.next, ptr %sum.ptr, align 4
+  br label %inner.latch
+
+inner.latch:
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.done = icmp uge i64 %j.next, %inner.trip.count
+  br i1 %inner.done, label %inner.end, label %inner.body
+
+inner.end:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
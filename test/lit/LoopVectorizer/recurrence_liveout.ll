@@ -0,0 +1,54 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; Both the recurrence phi and its input are used after the loop. The input
+; leaves the vector loop as its last lane, the phi as the last lane of the
+; splice, which is lane W-2 of the input.
+
+; REMARK: remark: {{.*}}Loop vectorized (width 8)
+
+; CHECK-LABEL: @last_pair(
+; CHECK: shufflevector <8 x i32> %{{.*}}, <8 x i32> %{{.*}}, <8 x i32> <i32 7, i32 8, i32 9, i32 10, i32 11, i32 12, i32 13, i32 14>
+; CHECK-DAG: extractelement <8 x i32> %{{.*}}, i64 7
+; CHECK-DAG: extractelement <8 x i32> %{{.*}}, i64 6
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @last_pair(ptr noalias nocapture readonly %A, ptr noalias nocapture %B, ptr noalias nocapture %P, ptr noalias nocapture %C, i32 %x0, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %prev = phi i32 [ %x0, %for.body.preheader ], [ %cur, %for.body ]
+  %a.ptr = getelementptr inbounds i32, ptr %A, i64 %i
+  %cur = load i32, ptr %a.ptr, align 4
+  %d = sub nsw i32 %cur, %prev
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  store i32 %d, ptr %b.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  %prev.lcssa = phi i32 [ %prev, %for.body ]
+  %cur.lcssa = phi i32 [ %cur, %for.body ]
+  store i32 %prev.lcssa, ptr %P, align 4
+  store i32 %cur.lcssa, ptr %C, align 4
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,44 @@
+; RUN: opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; %prev is stored before %cur is loaded. The spliced vector is only
+; available after the load, so the recurrence is rejected and the loop is
+; not vectorized.
+
+; REMARK: remark: {{.*}}Unsupported loop-carried variable
+; REMARK-NOT: Loop vectorized
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @shift(ptr noalias nocapture readonly %A, ptr noalias nocapture %B, i32 %x0, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %prev = phi i32 [ %x0, %for.body.preheader ], [ %cur, %for.body ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  store i32 %prev, ptr %b.ptr, align 4
+  %a.ptr = getelementptr inbounds i32, ptr %A, i64 %i
+  %cur = load i32, ptr %a.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,46 @@
+; RUN: env RV_SEARCH_LOOPS=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_SEARCH_LOOPS=1 opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; memchr-like search with a trip count: the vector scan reads aligned blocks
+; with masked loads (no lane before the start or past the bound is read) and
+; the scalar loop resumes at the first matching lane.
+
+; REMARK: remark: {{.*}}Vectorized search loop
+
+; CHECK-LABEL: @find(
+; CHECK: call <{{[0-9]+}} x i8> @llvm.masked.load.v{{[0-9]+}}i8.p0(
+; CHECK: call {{.*}}@llvm.cttz.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local i64 @find(ptr nocapture readonly %S, i8 signext %key, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp.guard = icmp eq i64 %n, 0
+  br i1 %cmp.guard, label %return, label %for.body.preheader
+
+for.body.preheader:
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.inc ]
+  %arrayidx = getelementptr inbounds i8, ptr %S, i64 %i
+  %c = load i8, ptr %arrayidx, align 1
+  %found = icmp eq i8 %c, %key
+  br i1 %found, label %return.loopexit, label %for.inc
+
+for.inc:
+  %i.next = add nuw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %return.loopexit, label %for.body
+
+return.loopexit:
+  %res.ph = phi i64 [ %i, %for.body ], [ -1, %for.inc ]
+  br label %return
+
+return:
+  %res = phi i64 [ -1, %entry ], [ %res.ph, %return.loopexit ]
+  ret i64 %res
+}
+
+attributes #0 = { nofree norecurse nounwind readonly "target-cpu"="haswell" "target-features"="+avx,+avx2" }
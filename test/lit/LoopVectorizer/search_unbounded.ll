@@ -0,0 +1,35 @@
+; RUN: env RV_SEARCH_LOOPS=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_SEARCH_LOOPS=1 opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; strlen-like search without a bound exit: nothing masks off the lanes past
+; the terminating element, so a vector scan could read beyond the object. The
+; loop stays scalar.
+
+; REMARK-NOT: Vectorized search loop
+
+; CHECK-LABEL: @find_unbounded(
+; CHECK-NOT: @llvm.masked.load
+; CHECK: load i8, ptr
+; CHECK-NOT: @llvm.masked.load
+; CHECK: ret i64
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local i64 @find_unbounded(ptr nocapture readonly %S, i8 signext %key) local_unnamed_addr #0 {
+entry:
+  br label %while.cond
+
+while.cond:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %while.cond ]
+  %arrayidx = getelementptr inbounds i8, ptr %S, i64 %i
+  %c = load i8, ptr %arrayidx, align 1
+  %i.next = add nuw i64 %i, 1
+  %found = icmp eq i8 %c, %key
+  br i1 %found, label %while.end, label %while.cond
+
+while.end:
+  ret i64 %i
+}
+
+attributes #0 = { nofree norecurse nounwind readonly "target-cpu"="haswell" "target-features"="+avx,+avx2" }
@@ -0,0 +1,142 @@
+; RUN: rm -f %t.json
+; RUN: env RV_REPORT_JSON=%t.json opt %s -O3 -disable-output
+; RUN: FileCheck %s < %t.json
+
+; A uniform load in a divergent block runs under an any-guard (a branch on
+; "some lane is active") unless it can not fault: the pointer is
+; dereferenceable, or an access to it dominates the load in a block that
+; always has an active lane. A dominating access in a block whose mask may be
+; empty does not help. The stores to %C and %D may alias %p and keep the loads
+; in the loop.
+
+; dereferenceable(4) argument
+; CHECK: "pass":"natbuilder"{{.*}}"uniform-masked-load":1,{{.*}}"any-guard":0}
+
+; dominating load in the loop header
+; CHECK: "pass":"natbuilder"{{.*}}"uniform-masked-load":1,{{.*}}"any-guard":0}
+
+; dominating load in a divergent block
+; CHECK: "pass":"natbuilder"{{.*}}"uniform-masked-load":2,{{.*}}"any-guard":2}
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @deref_arg(ptr noalias nocapture readonly %B, ptr nocapture %C, ptr nocapture %D, ptr nocapture align 4 dereferenceable(4) %p, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.inc ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %pos = icmp sgt i32 %b, 0
+  br i1 %pos, label %if.then, label %for.inc
+
+if.then:
+  %v = load float, ptr %p, align 4
+  %d.ptr = getelementptr inbounds float, ptr %D, i64 %i
+  store float %v, ptr %d.ptr, align 4
+  br label %for.inc
+
+for.inc:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @dominating_header(ptr noalias nocapture readonly %B, ptr nocapture %C, ptr nocapture %D, ptr nocapture %p, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.inc ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %h = load float, ptr %p, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %h, ptr %c.ptr, align 4
+  %pos = icmp sgt i32 %b, 0
+  br i1 %pos, label %if.then, label %for.inc
+
+if.then:
+  %v = load float, ptr %p, align 4
+  %d.ptr = getelementptr inbounds float, ptr %D, i64 %i
+  store float %v, ptr %d.ptr, align 4
+  br label %for.inc
+
+for.inc:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @dominating_divergent(ptr noalias nocapture readonly %B, ptr nocapture %C, ptr nocapture %D, ptr nocapture %p, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.inc ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %pos = icmp sgt i32 %b, 0
+  br i1 %pos, label %if.then, label %for.inc
+
+if.then:
+  %h = load float, ptr %p, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %h, ptr %c.ptr, align 4
+  %big = icmp sgt i32 %b, 10
+  br i1 %big, label %if.big, label %for.inc
+
+if.big:
+  %v = load float, ptr %p, align 4
+  %d.ptr = getelementptr inbounds float, ptr %D, i64 %i
+  store float %v, ptr %d.ptr, align 4
+  br label %for.inc
+
+for.inc:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
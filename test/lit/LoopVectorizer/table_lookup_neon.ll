@@ -0,0 +1,88 @@
+; REQUIRES: aarch64-registered-target
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; On AArch64 byte tables of up to four registers are one tbl lookup.
+
+; CHECK-LABEL: @lookup_tbl1(
+; CHECK-NOT: @llvm.masked.gather
+; CHECK: call <16 x i8> @llvm.aarch64.neon.tbl1.v16i8(<16 x i8> <i8
+; CHECK: store <16 x i8>
+
+; CHECK-LABEL: @lookup_tbl4(
+; CHECK-NOT: @llvm.masked.gather
+; CHECK: call <16 x i8> @llvm.aarch64.neon.tbl4.v16i8(
+; CHECK-NOT: select <16 x i1>
+; CHECK: store <16 x i8>
+
+target datalayout = "e-m:e-i8:8:32-i16:16:32-i64:64-i128:128-n32:64-S128"
+target triple = "aarch64-unknown-linux-gnu"
+
+@nbytes16 = internal unnamed_addr constant [16 x i8] [i8 -83, i8 -17, i8 -41, i8 68, i8 0, i8 -25, i8 65, i8 42, i8 -60, i8 17, i8 60, i8 -10, i8 -63, i8 22, i8 112, i8 -20], align 64
+@nbytes64 = internal unnamed_addr constant [64 x i8] [i8 71, i8 126, i8 55, i8 -11, i8 -101, i8 -15, i8 -56, i8 90, i8 19, i8 -44, i8 -51, i8 32, i8 -71, i8 -74, i8 -21, i8 96, i8 -30, i8 28, i8 -120, i8 65, i8 127, i8 -108, i8 80, i8 -87, i8 123, i8 -74, i8 107, i8 77, i8 86, i8 71, i8 -32, i8 117, i8 -56, i8 118, i8 57, i8 -41, i8 -88, i8 -74, i8 79, i8 -52, i8 6, i8 110, i8 123, i8 122, i8 87, i8 -94, i8 46, i8 1, i8 -102, i8 -44, i8 -77, i8 -11, i8 -11, i8 107, i8 -117, i8 101, i8 81, i8 -46, i8 51, i8 -23, i8 62, i8 69, i8 48, i8 -117], align 64
+
+define dso_local void @lookup_tbl1(ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %idx = urem i32 %b, 16
+  %idx.ext = zext i32 %idx to i64
+  %t.ptr = getelementptr inbounds [16 x i8], ptr @nbytes16, i64 0, i64 %idx.ext
+  %r = load i8, ptr %t.ptr, align 1
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !2
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @lookup_tbl4(ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %idx = urem i32 %b, 64
+  %idx.ext = zext i32 %idx to i64
+  %t.ptr = getelementptr inbounds [64 x i8], ptr @nbytes64, i64 0, i64 %idx.ext
+  %r = load i8, ptr %t.ptr, align 1
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="generic" "target-features"="+neon" }
+
+!0 = !{!"llvm.loop.vectorize.enable", i1 true}
+!1 = !{!"llvm.loop.vectorize.width", i32 16}
+!2 = distinct !{!2, !1, !0}
+!3 = distinct !{!3, !1, !0}
@@ -0,0 +1,171 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Varying loads from small constant tables become register permutations:
+; vpermps per 8 entries on AVX2 (blended by the high index bits), vpermt2ps
+; per 32 entries on AVX-512 and pshufb for 16 bytes. Tables of more than four
+; registers keep the gather.
+
+; CHECK-LABEL: @lookup_avx2(
+; CHECK-NOT: @llvm.masked.gather
+; CHECK: call <8 x float> @llvm.x86.avx2.permps(<8 x float> <float
+; CHECK: call <8 x float> @llvm.x86.avx2.permps(<8 x float> <float
+; CHECK: icmp ugt <8 x i32> %{{.*}}, {{.*}}i32 7
+; CHECK: select <8 x i1>
+; CHECK: store <8 x float>
+
+; CHECK-LABEL: @lookup_avx512(
+; CHECK-NOT: @llvm.masked.gather
+; CHECK: call <16 x float> @llvm.x86.avx512.vpermi2var.ps.512(<16 x float> <float
+; CHECK-NOT: select <16 x i1>
+; CHECK: store <16 x float>
+
+; CHECK-LABEL: @lookup_sse(
+; CHECK-NOT: @llvm.masked.gather
+; CHECK: call <16 x i8> @llvm.x86.ssse3.pshuf.b.128(<16 x i8> <i8
+; CHECK: store <16 x i8>
+
+; 80 entries, five registers
+; CHECK-LABEL: @lookup_avx512_large(
+; CHECK-NOT: @llvm.x86.avx512.vpermi2var.ps.512
+; CHECK: call <16 x float> @llvm.masked.gather.v16f32
+; CHECK: store <16 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@tab16 = internal unnamed_addr constant [16 x float] [float -4.500000e+00, float -8.250000e+00, float 1.750000e+00, float 3.250000e+00, float 1.150000e+01, float -1.500000e+01, float 1.575000e+01, float 7.500000e+00, float 3.500000e+00, float 1.125000e+01, float 1.500000e+00, float -1.475000e+01, float 1.175000e+01, float -1.525000e+01, float 1.175000e+01, float 6.750000e+00], align 64
+@tab32 = internal unnamed_addr constant [32 x float] [float 1.300000e+01, float 6.250000e+00, float -2.500000e+00, float -1.325000e+01, float 1.025000e+01, float 1.375000e+01, float -6.000000e+00, float 7.500000e-01, float -7.750000e+00, float -1.025000e+01, float 3.000000e+00, float 1.425000e+01, float 1.500000e+00, float -1.125000e+01, float 7.750000e+00, float 1.150000e+01, float 6.250000e+00, float -1.350000e+01, float -1.500000e+01, float 1.500000e+00, float -1.750000e+00, float -1.350000e+01, float 1.275000e+01, float 5.500000e+00, float -7.500000e-01, float 7.500000e-01, float -5.250000e+00, float -1.300000e+01, float -5.500000e+00, float 1.400000e+01, float -3.000000e+00, float 1.425000e+01], align 64
+@bytes16 = internal unnamed_addr constant [16 x i8] [i8 -120, i8 -24, i8 -75, i8 16, i8 -108, i8 -63, i8 -62, i8 -23, i8 -31, i8 -110, i8 83, i8 -43, i8 -16, i8 -42, i8 -11, i8 119], align 64
+@tab80 = internal unnamed_addr constant [80 x float] [float -6.000000e+00, float 1.100000e+01, float -2.500000e+00, float 5.250000e+00, float 7.250000e+00, float 1.050000e+01, float -6.750000e+00, float -8.000000e+00, float 4.250000e+00, float 1.125000e+01, float -7.250000e+00, float 1.375000e+01, float -6.500000e+00, float 5.000000e+00, float 4.250000e+00, float 3.000000e+00, float -1.275000e+01, float 4.500000e+00, float 5.500000e+00, float -3.750000e+00, float -1.525000e+01, float 1.600000e+01, float -3.000000e+00, float -6.250000e+00, float -3.500000e+00, float -6.750000e+00, float -8.000000e+00, float 3.750000e+00, float 1.550000e+01, float 1.275000e+01, float -2.500000e+00, float -1.475000e+01, float 1.200000e+01, float 9.000000e+00, float 8.000000e+00, float -1.000000e+01, float -1.600000e+01, float -7.500000e+00, float -6.500000e+00, float 6.250000e+00, float -5.000000e-01, float 9.750000e+00, float -1.075000e+01, float -1.275000e+01, float -9.500000e+00, float -1.000000e+01, float -1.250000e+01, float 1.250000e+01, float -1.100000e+01, float 1.275000e+01, float 1.000000e+00, float -9.250000e+00, float 3.000000e+00, float 1.175000e+01, float 7.750000e+00, float 1.225000e+01, float -1.500000e+01, float -4.750000e+00, float 1.475000e+01, float 2.000000e+00, float 1.075000e+01, float 5.000000e+00, float -1.425000e+01, float -1.075000e+01, float -1.025000e+01, float -2.500000e-01, float -7.500000e-01, float 2.750000e+00, float 1.475000e+01, float 1.525000e+01, float 5.000000e+00, float 1.400000e+01, float -1.075000e+01, float 1.325000e+01, float -8.250000e+00, float 2.500000e+00, float -2.500000e-01, float -1.500000e+01, float -1.225000e+01, float 0.000000e+00], align 64
+
+define dso_local void @lookup_avx2(ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %idx = urem i32 %b, 16
+  %idx.ext = zext i32 %idx to i64
+  %t.ptr = getelementptr inbounds [16 x float], ptr @tab16, i64 0, i64 %idx.ext
+  %r = load float, ptr %t.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @lookup_avx512(ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #1 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %idx = urem i32 %b, 32
+  %idx.ext = zext i32 %idx to i64
+  %t.ptr = getelementptr inbounds [32 x float], ptr @tab32, i64 0, i64 %idx.ext
+  %r = load float, ptr %t.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @lookup_sse(ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #2 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %idx = urem i32 %b, 16
+  %idx.ext = zext i32 %idx to i64
+  %t.ptr = getelementptr inbounds [16 x i8], ptr @bytes16, i64 0, i64 %idx.ext
+  %r = load i8, ptr %t.ptr, align 1
+  %c.ptr = getelementptr inbounds i8, ptr %C, i64 %i
+  store i8 %r, ptr %c.ptr, align 1
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !5
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @lookup_avx512_large(ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #1 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %idx = urem i32 %b, 80
+  %idx.ext = zext i32 %idx to i64
+  %t.ptr = getelementptr inbounds [80 x float], ptr @tab80, i64 0, i64 %idx.ext
+  %r = load float, ptr %t.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !6
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2,+sse2,+ssse3" }
+attributes #1 = { nofree norecurse nounwind "target-cpu"="skylake-avx512" "target-features"="+avx,+avx2,+avx512f,+avx512vl,+sse2,+ssse3" }
+attributes #2 = { nofree norecurse nounwind "target-cpu"="x86-64" "target-features"="+sse2,+ssse3" }
+
+!0 = !{!"llvm.loop.vectorize.enable", i1 true}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.width", i32 16}
+!3 = distinct !{!3, !1, !0}
+!4 = distinct !{!4, !2, !0}
+!5 = distinct !{!5, !2, !0}
+!6 = distinct !{!6, !2, !0}
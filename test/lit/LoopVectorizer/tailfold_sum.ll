@@ -0,0 +1,49 @@
+; RUN: env RV_FORCE_REMAINDER=fold opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_FORCE_REMAINDER=fold opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; The last partial iteration runs under the tail mask. The blend of the latch
+; update keeps the partial sums of masked-out lanes and the chain is still
+; reduced as a sum.
+
+; REMARK: remark: {{.*}}Loop vectorized (width 8) with folded tail
+
+; CHECK-LABEL: @sum(
+; CHECK: for.body{{.*}}.rv:
+; CHECK: select <8 x i1> %{{.*}}, <8 x i32> {{.*}}, <8 x i32> {{.*}}
+; CHECK: call i32 @llvm.vector.reduce.add.v8i32(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local i32 @sum(ptr nocapture readonly %A, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp5 = icmp sgt i32 %n, 0
+  br i1 %cmp5, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %for.body ]
+  %s.06 = phi i32 [ 0, %for.body.preheader ], [ %add, %for.body ]
+  %arrayidx = getelementptr inbounds i32, ptr %A, i64 %indvars.iv
+  %0 = load i32, ptr %arrayidx, align 4
+  %add = add nsw i32 %0, %s.06
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  %s.0.lcssa = phi i32 [ 0, %entry ], [ %add, %for.end.loopexit ]
+  ret i32 %s.0.lcssa
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
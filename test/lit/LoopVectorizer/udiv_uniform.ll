@@ -0,0 +1,46 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; A uniform divisor: the magic multiplier is computed once with a scalar 64-bit
+; division and every lane takes a multiply-high instead of a vector udiv.
+
+; CHECK-LABEL: @udiv_uniform(
+; CHECK: udiv i64
+; CHECK-NOT: udiv <8 x i32>
+; CHECK: mul {{.*}}<8 x i64>
+; CHECK-NOT: udiv <8 x i32>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @udiv_uniform(ptr nocapture readonly %A, ptr nocapture %Q, i32 %d, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %for.body.preheader ], [ %indvars.iv.next, %for.body ]
+  %arrayidx = getelementptr inbounds i32, ptr %A, i64 %indvars.iv
+  %0 = load i32, ptr %arrayidx, align 4
+  %div = udiv i32 %0, %d
+  %arrayidx2 = getelementptr inbounds i32, ptr %Q, i64 %indvars.iv
+  store i32 %div, ptr %arrayidx2, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond.not = icmp eq i64 %indvars.iv.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
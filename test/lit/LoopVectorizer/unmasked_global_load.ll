@@ -0,0 +1,83 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; A contiguous load in a divergent block loads all lanes if the whole vector
+; footprint is dereferenceable. Here the lane-0 index i runs up to 1023, so
+; the 8 lanes read up to element 1030 of the global.
+
+; 1031 elements: unmasked
+; CHECK-LABEL: @footprint_fits(
+; CHECK-NOT: @llvm.masked.load
+; CHECK: load <8 x float>, ptr %{{.*}}, align 4
+; CHECK: call void @llvm.masked.store.v8f32.p0(
+
+; 1030 elements: the last vector reads past the object
+; CHECK-LABEL: @footprint_exceeds(
+; CHECK: call <8 x float> @llvm.masked.load.v8f32.p0(
+; CHECK: call void @llvm.masked.store.v8f32.p0(
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@G = dso_local global [1031 x float] zeroinitializer, align 64
+@H = dso_local global [1030 x float] zeroinitializer, align 64
+
+define dso_local void @footprint_fits(ptr noalias nocapture readonly %B, ptr noalias nocapture %C) local_unnamed_addr #0 {
+entry:
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.inc ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %pos = icmp sgt i32 %b, 0
+  br i1 %pos, label %if.then, label %for.inc
+
+if.then:
+  %g.ptr = getelementptr inbounds [1031 x float], ptr @G, i64 0, i64 %i
+  %g = load float, ptr %g.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %g, ptr %c.ptr, align 4
+  br label %for.inc
+
+for.inc:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, 1024
+  br i1 %exitcond.not, label %for.end, label %for.body, !llvm.loop !0
+
+for.end:
+  ret void
+}
+
+define dso_local void @footprint_exceeds(ptr noalias nocapture readonly %B, ptr noalias nocapture %C) local_unnamed_addr #0 {
+entry:
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.inc ]
+  %b.ptr = getelementptr inbounds i32, ptr %B, i64 %i
+  %b = load i32, ptr %b.ptr, align 4
+  %pos = icmp sgt i32 %b, 0
+  br i1 %pos, label %if.then, label %for.inc
+
+if.then:
+  %g.ptr = getelementptr inbounds [1030 x float], ptr @H, i64 0, i64 %i
+  %g = load float, ptr %g.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %g, ptr %c.ptr, align 4
+  br label %for.inc
+
+for.inc:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, 1024
+  br i1 %exitcond.not, label %for.end, label %for.body, !llvm.loop !3
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
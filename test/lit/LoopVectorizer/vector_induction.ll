@@ -0,0 +1,84 @@
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: env RV_NO_VECTOR_INDUCTIONS=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s --check-prefix=OFF
+
+; Strided integers at a constant distance from the induction variable are kept
+; as a vector phi that is stepped by splat(W * stride) once per iteration
+; instead of a splat of the scalar plus the lane offsets in every iteration.
+; A narrowed gather index gets its own i32 induction.
+
+; CHECK-LABEL: @vind_stride3(
+; CHECK: %[[V:.*]] = phi <8 x i64> [ <i64 0, i64 3, i64 6, i64 9, i64 12, i64 15, i64 18, i64 21>, %{{.*}} ]
+; CHECK: add <8 x i64> %[[V]], <i64 7, i64 7, i64 7, i64 7, i64 7, i64 7, i64 7, i64 7>
+; CHECK: add{{.*}} <8 x i64> %[[V]], <i64 24, i64 24, i64 24, i64 24, i64 24, i64 24, i64 24, i64 24>
+
+; CHECK-LABEL: @vind_narrow_index(
+; CHECK-NOT: phi <8 x i64>
+; CHECK: %[[N:.*]] = phi <8 x i32> [ <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7>, %{{.*}} ]
+; CHECK: add{{.*}} <8 x i32> %[[N]], %{{.*}}
+; CHECK: sext <8 x i32> %{{.*}} to <8 x i64>
+; CHECK: call <8 x float> @llvm.masked.gather.v8f32
+; CHECK: add{{.*}} <8 x i32> %[[N]], <i32 8, i32 8, i32 8, i32 8, i32 8, i32 8, i32 8, i32 8>
+
+; OFF-LABEL: @vind_narrow_index(
+; OFF-NOT: phi <8 x i32>
+; OFF: call <8 x float> @llvm.masked.gather.v8f32
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; C[i] = i + 7 for i = 0, 3, 6, ...
+define dso_local void @vind_stride3(ptr noalias nocapture %C, i64 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i64 %n, 0
+  br i1 %cmp, label %for.body, label %for.end
+
+for.body:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %for.body ]
+  %v = add nuw nsw i64 %i, 7
+  %c.ptr = getelementptr inbounds i64, ptr %C, i64 %i
+  store i64 %v, ptr %c.ptr, align 8
+  %i.next = add nuw nsw i64 %i, 3
+  %cmp.next = icmp slt i64 %i.next, %n
+  br i1 %cmp.next, label %for.body, label %for.end, !llvm.loop !0
+
+for.end:
+  ret void
+}
+
+; C[i] = A[i + B[i]] with fewer than 2^16 iterations
+define dso_local void @vind_narrow_index(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i16 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp ugt i16 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i16 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.body ]
+  %b.ptr = getelementptr inbounds i16, ptr %B, i64 %i
+  %b = load i16, ptr %b.ptr, align 2
+  %e = sext i16 %b to i64
+  %idx = add nsw i64 %i, %e
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %idx
+  %r = load float, ptr %a.ptr, align 4
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  store float %r, ptr %c.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
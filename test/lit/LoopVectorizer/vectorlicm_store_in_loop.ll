@@ -0,0 +1,75 @@
+; RUN: env RV_REPORT=1 opt %s -O3 -disable-output | FileCheck %s
+; RUN: env RV_REPORT=1 opt %s -O3 -pass-remarks=rv-loopvec -disable-output 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; The same masked load of A[i] as in vectorlicm_masked_load.ll, but the inner
+; loop also stores to D[j]. The store may write A[i], so the load stays in the
+; inner loop.
+
+; CHECK-NOT: rv: vectorLICM: hoisted {{[0-9]+}} vector instructions and {{[1-9][0-9]*}} loads
+
+; REMARK: remark: {{.*}}Loop vectorized (width 8)
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @dot_pos_copy(ptr nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture readonly %C, ptr nocapture %D, ptr noalias nocapture %Out, i32 %n, i32 %m) local_unnamed_addr #0 {
+entry:
+  %cmp.n = icmp sgt i32 %n, 0
+  %cmp.m = icmp sgt i32 %m, 0
+  %cmp = and i1 %cmp.n, %cmp.m
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.n = zext i32 %n to i64
+  %wide.m = zext i32 %m to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %c.ptr = getelementptr inbounds float, ptr %C, i64 %i
+  %c = load float, ptr %c.ptr, align 4
+  %pos = fcmp ogt float %c, 0.000000e+00
+  %a.ptr = getelementptr inbounds float, ptr %A, i64 %i
+  br label %inner.body
+
+inner.body:
+  %j = phi i64 [ 0, %for.body ], [ %j.next, %inner.latch ]
+  %s = phi float [ 0.000000e+00, %for.body ], [ %s.next, %inner.latch ]
+  %b.ptr = getelementptr inbounds float, ptr %B, i64 %j
+  %b = load float, ptr %b.ptr, align 4
+  %d.ptr = getelementptr inbounds float, ptr %D, i64 %j
+  store float %b, ptr %d.ptr, align 4
+  br i1 %pos, label %inner.then, label %inner.latch
+
+inner.then:
+  %a = load float, ptr %a.ptr, align 4
+  %prod = fmul float %a, %b
+  %s.add = fadd float %s, %prod
+  br label %inner.latch
+
+inner.latch:
+  %s.next = phi float [ %s, %inner.body ], [ %s.add, %inner.then ]
+  %j.next = add nuw nsw i64 %j, 1
+  %inner.exit = icmp eq i64 %j.next, %wide.m
+  br i1 %inner.exit, label %for.latch, label %inner.body
+
+for.latch:
+  %s.lcssa = phi float [ %s.next, %inner.latch ]
+  %out.ptr = getelementptr inbounds float, ptr %Out, i64 %i
+  store float %s.lcssa, ptr %out.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.n
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind optsize "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,52 @@
+; RUN: env RV_VECTOR_WIDENING=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; A bitcast from <2 x i64> to <4 x i32> changes the element count, so the SoA
+; positions of the elements change as well. The cast is done lane by lane, the
+; arithmetic before and after it stays widened.
+
+; CHECK-LABEL: @halves(
+; CHECK: add <16 x i64>
+; CHECK: bitcast <2 x i64> %{{.*}} to <4 x i32>
+; CHECK: add <32 x i32>
+; CHECK: store <32 x i32>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @halves(ptr noalias nocapture readonly %A, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %a.ptr = getelementptr inbounds <2 x i64>, ptr %A, i64 %i
+  %a = load <2 x i64>, ptr %a.ptr, align 16
+  %inc = add <2 x i64> %a, <i64 1, i64 1>
+  %parts = bitcast <2 x i64> %inc to <4 x i32>
+  %r = add <4 x i32> %parts, <i32 1, i32 2, i32 3, i32 4>
+  %c.ptr = getelementptr inbounds <4 x i32>, ptr %C, i64 %i
+  store <4 x i32> %r, ptr %c.ptr, align 16
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,62 @@
+; RUN: env RV_VECTOR_WIDENING=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+; RUN: opt %s -O3 -S -o /dev/stdout | FileCheck %s --check-prefix=OFF
+; RUN: env RV_VECTOR_WIDENING=1 opt %s -O3 -pass-remarks=rv-loopvec -S -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+
+; C[i] = (A[i] + B[i]) * 2 on float4 elements. With RV_VECTOR_WIDENING the
+; varying <4 x float> values become <32 x float> (SoA, element j of lane l at
+; j * 8 + l) and each operation stays one instruction. By default the float4
+; values are replicated per lane.
+
+; REMARK: remark: {{.*}}Loop vectorized (width 8)
+
+; CHECK-LABEL: @scale_add(
+; CHECK: load <32 x float>
+; CHECK: load <32 x float>
+; CHECK: fadd <32 x float>
+; CHECK: fmul <32 x float>
+; CHECK: store <32 x float>
+
+; OFF-LABEL: @scale_add(
+; OFF-NOT: fadd <32 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @scale_add(ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %a.ptr = getelementptr inbounds <4 x float>, ptr %A, i64 %i
+  %a = load <4 x float>, ptr %a.ptr, align 16
+  %b.ptr = getelementptr inbounds <4 x float>, ptr %B, i64 %i
+  %b = load <4 x float>, ptr %b.ptr, align 16
+  %sum = fadd <4 x float> %a, %b
+  %scaled = fmul <4 x float> %sum, <float 2.000000e+00, float 2.000000e+00, float 2.000000e+00, float 2.000000e+00>
+  %c.ptr = getelementptr inbounds <4 x float>, ptr %C, i64 %i
+  store <4 x float> %scaled, ptr %c.ptr, align 16
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
@@ -0,0 +1,91 @@
+; RUN: env RV_VECTOR_WIDENING=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Constant-index extractelement, insertelement and shufflevector on widened
+; float4 values become shuffles of whole 8-lane element groups: x and y of all
+; lanes are read as <8 x float>, the product is blended back as element w and
+; the reversing shuffle is no per-lane code.
+
+; CHECK-LABEL: @xy_product(
+; CHECK: load <32 x float>
+; CHECK: fmul <8 x float>
+; CHECK: store <32 x float>
+; CHECK-NOT: extractelement <4 x float>
+
+; CHECK-LABEL: @reverse(
+; CHECK: load <32 x float>
+; CHECK: shufflevector <32 x float>
+; CHECK: store <32 x float>
+; CHECK-NOT: shufflevector <4 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @xy_product(ptr noalias nocapture readonly %A, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %a.ptr = getelementptr inbounds <4 x float>, ptr %A, i64 %i
+  %a = load <4 x float>, ptr %a.ptr, align 16
+  %x = extractelement <4 x float> %a, i64 0
+  %y = extractelement <4 x float> %a, i64 1
+  %xy = fmul float %x, %y
+  %w = insertelement <4 x float> %a, float %xy, i64 3
+  %c.ptr = getelementptr inbounds <4 x float>, ptr %C, i64 %i
+  store <4 x float> %w, ptr %c.ptr, align 16
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @reverse(ptr noalias nocapture readonly %A, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %a.ptr = getelementptr inbounds <4 x float>, ptr %A, i64 %i
+  %a = load <4 x float>, ptr %a.ptr, align 16
+  %r = shufflevector <4 x float> %a, <4 x float> poison, <4 x i32> <i32 3, i32 2, i32 1, i32 0>
+  %c.ptr = getelementptr inbounds <4 x float>, ptr %C, i64 %i
+  store <4 x float> %r, ptr %c.ptr, align 16
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
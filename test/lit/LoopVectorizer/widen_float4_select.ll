@@ -0,0 +1,53 @@
+; RUN: env RV_VECTOR_WIDENING=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; A select with a varying scalar condition picks whole float4 values. The
+; <8 x i1> condition is repeated for each of the four element groups.
+
+; CHECK-LABEL: @pick(
+; CHECK: shufflevector <8 x i1> %{{.*}}, <8 x i1> {{.*}}, <32 x i32> <i32 0, i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7, i32 0, i32 1,
+; CHECK: select <32 x i1> %{{.*}}, <32 x float>
+; CHECK: store <32 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @pick(ptr noalias nocapture readonly %S, ptr noalias nocapture readonly %A, ptr noalias nocapture readonly %B, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %s.ptr = getelementptr inbounds float, ptr %S, i64 %i
+  %s = load float, ptr %s.ptr, align 4
+  %pos = fcmp ogt float %s, 0.000000e+00
+  %a.ptr = getelementptr inbounds <4 x float>, ptr %A, i64 %i
+  %a = load <4 x float>, ptr %a.ptr, align 16
+  %b.ptr = getelementptr inbounds <4 x float>, ptr %B, i64 %i
+  %b = load <4 x float>, ptr %b.ptr, align 16
+  %r = select i1 %pos, <4 x float> %a, <4 x float> %b
+  %c.ptr = getelementptr inbounds <4 x float>, ptr %C, i64 %i
+  store <4 x float> %r, ptr %c.ptr, align 16
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
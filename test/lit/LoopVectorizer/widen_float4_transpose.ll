@@ -0,0 +1,150 @@
+; RUN: env RV_VECTOR_WIDENING=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; Contiguous float4 loads and stores keep their AoS layout in memory: the 8
+; lanes are one <32 x float> access that is transposed in registers. Under a
+; varying condition the store is masked with the lane mask repeated for the
+; four elements of each lane.
+
+; CHECK-LABEL: @split_xyzw(
+; CHECK: load <32 x float>
+; CHECK-COUNT-4: store <8 x float>
+
+; CHECK-LABEL: @pack_xyzw(
+; CHECK-COUNT-4: load <8 x float>
+; CHECK: store <32 x float>
+
+; CHECK-LABEL: @pack_if_positive(
+; CHECK: shufflevector <8 x i1> %{{.*}}, <8 x i1> {{.*}}, <32 x i32> <i32 0, i32 0, i32 0, i32 0, i32 1, i32 1, i32 1, i32 1,
+; CHECK: call void @llvm.masked.store.v32f32.p0(<32 x float>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define dso_local void @split_xyzw(ptr noalias nocapture readonly %A, ptr noalias nocapture %X, ptr noalias nocapture %Y, ptr noalias nocapture %Z, ptr noalias nocapture %W, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %a.ptr = getelementptr inbounds <4 x float>, ptr %A, i64 %i
+  %a = load <4 x float>, ptr %a.ptr, align 16
+  %x = extractelement <4 x float> %a, i64 0
+  %y = extractelement <4 x float> %a, i64 1
+  %z = extractelement <4 x float> %a, i64 2
+  %w = extractelement <4 x float> %a, i64 3
+  %x.ptr = getelementptr inbounds float, ptr %X, i64 %i
+  store float %x, ptr %x.ptr, align 4
+  %y.ptr = getelementptr inbounds float, ptr %Y, i64 %i
+  store float %y, ptr %y.ptr, align 4
+  %z.ptr = getelementptr inbounds float, ptr %Z, i64 %i
+  store float %z, ptr %z.ptr, align 4
+  %w.ptr = getelementptr inbounds float, ptr %W, i64 %i
+  store float %w, ptr %w.ptr, align 4
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !0
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @pack_xyzw(ptr noalias nocapture readonly %X, ptr noalias nocapture readonly %Y, ptr noalias nocapture readonly %Z, ptr noalias nocapture readonly %W, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %x.ptr = getelementptr inbounds float, ptr %X, i64 %i
+  %x = load float, ptr %x.ptr, align 4
+  %y.ptr = getelementptr inbounds float, ptr %Y, i64 %i
+  %y = load float, ptr %y.ptr, align 4
+  %z.ptr = getelementptr inbounds float, ptr %Z, i64 %i
+  %z = load float, ptr %z.ptr, align 4
+  %w.ptr = getelementptr inbounds float, ptr %W, i64 %i
+  %w = load float, ptr %w.ptr, align 4
+  %v0 = insertelement <4 x float> poison, float %x, i64 0
+  %v1 = insertelement <4 x float> %v0, float %y, i64 1
+  %v2 = insertelement <4 x float> %v1, float %z, i64 2
+  %v3 = insertelement <4 x float> %v2, float %w, i64 3
+  %c.ptr = getelementptr inbounds <4 x float>, ptr %C, i64 %i
+  store <4 x float> %v3, ptr %c.ptr, align 16
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !3
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+define dso_local void @pack_if_positive(ptr noalias nocapture readonly %X, ptr noalias nocapture readonly %Y, ptr noalias nocapture readonly %Z, ptr noalias nocapture readonly %W, ptr noalias nocapture %C, i32 %n) local_unnamed_addr #0 {
+entry:
+  %cmp = icmp sgt i32 %n, 0
+  br i1 %cmp, label %for.body.preheader, label %for.end
+
+for.body.preheader:
+  %wide.trip.count = zext i32 %n to i64
+  br label %for.body
+
+for.body:
+  %i = phi i64 [ 0, %for.body.preheader ], [ %i.next, %for.latch ]
+  %x.ptr = getelementptr inbounds float, ptr %X, i64 %i
+  %x = load float, ptr %x.ptr, align 4
+  %pos = fcmp ogt float %x, 0.000000e+00
+  br i1 %pos, label %if.then, label %for.latch
+
+if.then:
+  %y.ptr = getelementptr inbounds float, ptr %Y, i64 %i
+  %y = load float, ptr %y.ptr, align 4
+  %z.ptr = getelementptr inbounds float, ptr %Z, i64 %i
+  %z = load float, ptr %z.ptr, align 4
+  %w.ptr = getelementptr inbounds float, ptr %W, i64 %i
+  %w = load float, ptr %w.ptr, align 4
+  %v0 = insertelement <4 x float> poison, float %x, i64 0
+  %v1 = insertelement <4 x float> %v0, float %y, i64 1
+  %v2 = insertelement <4 x float> %v1, float %z, i64 2
+  %v3 = insertelement <4 x float> %v2, float %w, i64 3
+  %c.ptr = getelementptr inbounds <4 x float>, ptr %C, i64 %i
+  store <4 x float> %v3, ptr %c.ptr, align 16
+  br label %for.latch
+
+for.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %exitcond.not = icmp eq i64 %i.next, %wide.trip.count
+  br i1 %exitcond.not, label %for.end.loopexit, label %for.body, !llvm.loop !4
+
+for.end.loopexit:
+  br label %for.end
+
+for.end:
+  ret void
+}
+
+attributes #0 = { nofree norecurse nounwind "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+
+!0 = distinct !{!0, !1, !2}
+!1 = !{!"llvm.loop.vectorize.width", i32 8}
+!2 = !{!"llvm.loop.vectorize.enable", i1 true}
+!3 = distinct !{!3, !1, !2}
+!4 = distinct !{!4, !1, !2}
@@ -0,0 +1,93 @@
+; RUN: env RV_RECURSION_LOOPS=1 RV_REPORT=1 opt %s -O3 -disable-output | FileCheck %s --check-prefix=REPORT
+; RUN: env RV_RECURSION_LOOPS=1 opt %s -O3 -S -o /dev/stdout | FileCheck %s
+
+; A self-recursive SIMD function runs as a divergent loop over a stack of 64
+; argument frames per lane. The call results are added into one accumulator,
+; so the operation that combines them has to be associative: fp adds need
+; reassoc, and all results have to be combined by the same operation. Calls
+; beyond 64 frames go to the recursive function.
+
+; REPORT-NOT: recursionToLoop: {{.*}}rejected
+; REPORT: recursionToLoop: {{.*}}tree_sum{{.*}} runs 2 recursive calls from a stack of 64 frames
+; REPORT-NOT: recursionToLoop: {{.*}}rejected
+
+; CHECK-LABEL: define {{.*}}<8 x float> @_ZGVdN8vv_tree_sum(
+; CHECK: alloca {{.*}}[64 x
+; CHECK: icmp ugt {{.*}}i32 63
+; CHECK: call {{.*}}tree_sum
+; CHECK: fadd reassoc <8 x float>
+
+; CHECK-LABEL: define {{.*}}<8 x float> @_ZGVdN8vv_tree_noreassoc_rejected(
+; CHECK-NOT: [64 x
+; CHECK: ret <8 x float>
+
+; CHECK-LABEL: define {{.*}}<8 x i32> @_ZGVdN8v_mixed_ops_rejected(
+; CHECK-NOT: [64 x
+; CHECK: ret <8 x i32>
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; tree_sum(x, d) = d > 0 ? tree_sum(x / 2, d - 1) + tree_sum(x / 4, d - 1) : x
+define dso_local float @tree_sum(float %x, i32 %d) local_unnamed_addr #0 {
+entry:
+  %leaf = icmp slt i32 %d, 1
+  br i1 %leaf, label %return, label %recurse
+
+recurse:
+  %d.next = add nsw i32 %d, -1
+  %x.l = fmul float %x, 5.000000e-01
+  %l = tail call float @tree_sum(float %x.l, i32 %d.next)
+  %x.r = fmul float %x, 2.500000e-01
+  %r = tail call float @tree_sum(float %x.r, i32 %d.next)
+  %sum = fadd reassoc float %l, %r
+  br label %return
+
+return:
+  %res = phi float [ %sum, %recurse ], [ %x, %entry ]
+  ret float %res
+}
+
+; the order of the fp adds is fixed
+define dso_local float @tree_noreassoc_rejected(float %x, i32 %d) local_unnamed_addr #1 {
+entry:
+  %leaf = icmp slt i32 %d, 1
+  br i1 %leaf, label %return, label %recurse
+
+recurse:
+  %d.next = add nsw i32 %d, -1
+  %x.l = fmul float %x, 5.000000e-01
+  %l = tail call float @tree_noreassoc_rejected(float %x.l, i32 %d.next)
+  %x.r = fmul float %x, 2.500000e-01
+  %r = tail call float @tree_noreassoc_rejected(float %x.r, i32 %d.next)
+  %sum = fadd float %l, %r
+  br label %return
+
+return:
+  %res = phi float [ %sum, %recurse ], [ %x, %entry ]
+  ret float %res
+}
+
+; mixed_ops(n) = n > 1 ? mixed_ops(n - 1) + 3 * mixed_ops(n - 2) : 1 (a mul and an add)
+define dso_local i32 @mixed_ops_rejected(i32 %n) local_unnamed_addr #2 {
+entry:
+  %leaf = icmp slt i32 %n, 2
+  br i1 %leaf, label %return, label %recurse
+
+recurse:
+  %n.1 = add nsw i32 %n, -1
+  %a = tail call i32 @mixed_ops_rejected(i32 %n.1)
+  %n.2 = add nsw i32 %n, -2
+  %b = tail call i32 @mixed_ops_rejected(i32 %n.2)
+  %b3 = mul nsw i32 %b, 3
+  %sum = add nsw i32 %b3, %a
+  br label %return
+
+return:
+  %res = phi i32 [ %sum, %recurse ], [ 1, %entry ]
+  ret i32 %res
+}
+
+attributes #0 = { nofree nosync nounwind readnone "_ZGVdN8vv_tree_sum" "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+attributes #1 = { nofree nosync nounwind readnone "_ZGVdN8vv_tree_noreassoc_rejected" "target-cpu"="haswell" "target-features"="+avx,+avx2" }
+attributes #2 = { nofree nosync nounwind readnone "_ZGVdN8v_mixed_ops_rejected" "target-cpu"="haswell" "target-features"="+avx,+avx2" }
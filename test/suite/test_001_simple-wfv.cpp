@@ -1,4 +1,4 @@
-// Shapes: T_TrT, LaunchCode: foo2f8
+// Shapes: T_TrT, LaunchCode: foo2f8, Budget: gather=0;scatter=0;scalarized=0;blend=0
 
 extern "C" float
 foo(float a, float b)
@@ -1,4 +1,4 @@
-// Shapes: U_TrT, LaunchCode: foout2f
+// Shapes: U_TrT, LaunchCode: foout2f, Budget: gather=0;scatter=0;blend=2
 
 #include <cmath>
 
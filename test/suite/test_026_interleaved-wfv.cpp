@@ -1,4 +1,4 @@
-// Shapes: C_U, LaunchCode: ivfoo
+// Shapes: C_U, LaunchCode: ivfoo, Budget: gather=0;scatter=0;cascade=0
 typedef float float4 __attribute__((ext_vector_type(4)));
 
 extern "C"
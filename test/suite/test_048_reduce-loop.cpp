@@ -1,4 +1,4 @@
-// LoopHint: 0, LaunchCode: fooAn
+// LoopHint: 0, LaunchCode: fooAn, Budget: gather=0;scatter=0;scalarized=0
 
 extern "C" int
 foo(int * A, int n) {
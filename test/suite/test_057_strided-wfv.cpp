@@ -1,4 +1,4 @@
-// Shapes: C_U, LaunchCode: ivfoo
+// Shapes: C_U, LaunchCode: ivfoo, Budget: gather=1;scatter=1;blend=0, Budget[avx512]: cascade=0
 
 extern "C"
 void
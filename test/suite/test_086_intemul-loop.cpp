@@ -0,0 +1,22 @@
+// LoopHint: 0, LaunchCode: foolABCn, Budget: scalarized=0
+
+#include <cstdint>
+
+// the integer operations that RV emulates (multiply-high, popcount, ctlz, 64-bit ashr, 8-bit shifts);
+// the scalar build of this loop uses the native instructions
+extern "C" void
+foo(int64_t * A, int64_t * B, int64_t * C, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    uint64_t a = A[i], b = B[i];
+    uint64_t mulHigh = (uint64_t) (((unsigned __int128) a * b) >> 64);
+    int64_t sMulHigh = (int64_t) (((__int128) (int64_t) a * (int64_t) b) >> 64);
+    uint32_t low = (uint32_t) a;
+    uint64_t popCount = __builtin_popcount(low);
+    uint64_t leadZeros = low ? __builtin_clz(low) : 32;
+    int64_t ashr = (int64_t) b >> (a & 63);
+    uint8_t byteShl = (uint8_t) ((uint8_t) b << (a & 7));
+    int8_t byteAshr = (int8_t) ((int8_t) (b >> 8) >> ((a >> 8) & 7));
+    C[i] = (int64_t) (mulHigh ^ (uint64_t) sMulHigh ^ (uint64_t) ashr) + (int64_t) (popCount | leadZeros << 8 | (uint64_t) byteShl << 16 | (uint64_t) (uint8_t) byteAshr << 24);
+  }
+}
@@ -7,6 +7,8 @@ from glob import glob
 from binaries import *
 from os import path
 import csv
+import json
+import platform
 import time
 import re
 
@@ -24,9 +26,58 @@ Shapes: <ArgumentShapes>[r<ReturnValueShape] // WFV only
 Width: <vectorizationFactor>
 ULPMathPrec: <ULPError*10> // ULP error bound on math functions (in 10*ULP)
 VarShape[<GlobalVariable>]=<Shape> // Assign shape <Shape> to value <GlobalVariable>
+Budget: <metric>=<max>[;<metric>=<max>..] // instruction-mix budget of the vectorized code (metrics below)
+Budget[<isa>]: <metric>=<max>[;..] // budget on one ISA only (avx512, avx2, avx, sse, sve, neon), overrides Budget
+-- Budget metrics --
+gather, scatter, cascade, interleaved, scalarized, replicated-call, blend, any-guard, shuffle (non-splat shufflevector)
+or any counter name of the "natbuilder" metrics records (RV_REPORT_JSON)
 """
   print(text)
 
+# ISA name of the host for Budget[<isa>] options (RVT_ISA overrides)
+def hostISA():
+  global cachedISA
+  if cachedISA is None:
+    cachedISA = os.getenv("RVT_ISA") or detectISA()
+  return cachedISA
+
+cachedISA = None
+
+def detectISA():
+  flags = set()
+  try:
+    with open("/proc/cpuinfo") as f:
+      for line in f:
+        if line.startswith("flags") or line.startswith("Features"):
+          flags.update(line.split(":", 1)[1].split())
+          break
+  except IOError:
+    pass
+  if platform.machine() in ("aarch64", "arm64"):
+    return "sve" if "sve" in flags else "neon"
+  for isa, flag in (("avx512", "avx512f"), ("avx2", "avx2"), ("avx", "avx")):
+    if flag in flags:
+      return isa
+  return "sse" if platform.machine() in ("x86_64", "AMD64") else platform.machine()
+
+# "gather=0;blend=2" -> {"gather": 0, "blend": 2}
+def parseBudget(text):
+  budget = dict()
+  for entry in text.split(";"):
+    if not entry.strip():
+      continue
+    metric, bound = entry.split("=")
+    budget[metric.strip()] = int(bound)
+  return budget
+
+# Budget metrics that sum up several natbuilder counters
+budgetGroups = {
+  "gather": ["gather", "masked-gather"],
+  "scatter": ["scatter", "masked-scatter"],
+  "cascade": ["cascade-load", "masked-casc-load", "cascade-store", "masked-casc-store"],
+  "interleaved": ["interleaved-load", "interleaved-masked-load", "interleaved-store", "interleaved-masked-store"],
+}
+
 class TestCase:
   def getFilename(self, filetype):
     primaryName = self.baseName.split(".")[0]
@@ -46,6 +97,10 @@ class TestCase:
       return "build/" + primaryName + ".loopvec.ll"
     elif filetype == 'loopLogPrefix':
       return "logs/" + primaryName + ".loopvec"
+    elif filetype == 'predict':
+      return "logs/" + primaryName + ".predict.jsonl"
+    elif filetype == 'metrics':
+      return "logs/" + primaryName + ".metrics.jsonl"
 
   def __init__(self, testfile):
     self.srcFile = testfile
@@ -62,6 +117,8 @@ class TestCase:
     self.options['ulp_math_prec'] = 10
 
     self.options['extraShapes'] = dict()
+    self.options['budget'] = dict()
+    isaBudget = dict()
 
     # default outer loop stencil
     self.options['width'] = 8 if self.mode == 'loop' else None
@@ -86,6 +143,11 @@ class TestCase:
         self.options['width'] = int(rhsPart)
       elif lhsPart == "ULPMathPrec":
         self.options['ulp_math_prec'] = int(rhsPart)
+      elif lhsPart == "Budget":
+        self.options['budget'].update(parseBudget(rhsPart))
+      elif lhsPart.startswith("Budget["):
+        if lhsPart == "Budget[{}]".format(hostISA()):
+          isaBudget.update(parseBudget(rhsPart))
       else:
         namedMatch = re.search("\[(.*)\]", option)
         if not namedMatch is None:
@@ -94,11 +156,52 @@ class TestCase:
           keyName = namedMatch.groups()[0]
           self.options['extraShapes'][keyName] = rhsPart
 
+    self.options['budget'].update(isaBudget)
+
   def requestLauncher(self, prefix, profileMode):
     launcherCpp = "launcher/" + prefix + "_" + self.options['launchCode'] + ".cpp"
     return (launcherCpp, "-Ilauncher/include")
 
 
+# sums up the natbuilder metrics records of the last rvTool run and the shuffles in the vectorized module
+def readMetrics(metricsFile, vectorizedLL):
+  metrics = dict()
+  if path.exists(metricsFile):
+    with open(metricsFile) as f:
+      for line in f:
+        if not line.strip():
+          continue
+        rec = json.loads(line)
+        if rec.get("kind") != "metrics" or rec.get("pass") != "natbuilder":
+          continue
+        for name, value in rec["metrics"].items():
+          metrics[name] = metrics.get(name, 0) + value
+
+  # splats (zeroinitializer masks) are broadcasts, not data movement
+  numShuffles = 0
+  with open(vectorizedLL) as f:
+    for line in f:
+      if " = shufflevector " in line and not line.rstrip().endswith("zeroinitializer"):
+        numShuffles += 1
+  metrics["shuffle"] = numShuffles
+  return metrics
+
+def checkBudget(testCase):
+  budget = testCase.options['budget']
+  if not budget:
+    return
+  vectorizedLL = testCase.getFilename('wfvLL' if testCase.mode == "wfv" else 'loopLL')
+  metricsFile = testCase.getFilename('metrics')
+  metrics = readMetrics(metricsFile, vectorizedLL)
+
+  exceeded = []
+  for metric, bound in sorted(budget.items()):
+    value = sum(metrics.get(name, 0) for name in budgetGroups.get(metric, [metric]))
+    if value > bound:
+      exceeded.append("{}={} (max {})".format(metric, value, bound))
+  if exceeded:
+    raise TestFailure("instruction-mix budget exceeded on {}: {}".format(hostISA(), ", ".join(exceeded)), metricsFile)
+
 def runOuterLoopTester(scaLauncherBin, vecLauncherBin, profileMode):
   scalarSuccess, rawScalarRes = runForOutput(scaLauncherBin)
   scalarRes = rawScalarRes.decode('utf-8') if rawScalarRes else ""
@@ -119,7 +222,34 @@ def runOuterLoopTester(scaLauncherBin, vecLauncherBin, profileMode):
     return scalarRes == vecRes
 
 
+# hardware counters of the last profile launcher run (RV_PERF_COUNTERS) as {"scalar": {"cycles": ..}, ..}
+lastCounters = dict()
+
+# "1.0 cycles", "IPC 2.00", "freq ratio 1.00" -> ("cycles", 1.0), ("ipc", 2.0), ("freq_ratio", 1.0)
+def parseCounter(text):
+  words = re.sub(r"\(.*\)", "", text).split()
+  for numPos, namePos in ((0, slice(1, None)), (-1, slice(0, -1))):
+    try:
+      return "_".join(words[namePos]).lower(), float(words[numPos])
+    except (ValueError, IndexError):
+      continue
+  return None
+
+# split the launcher output into the counter lines (stderr) and the result
+def splitCounters(output):
+  counters = dict()
+  resultLines = []
+  for line in output.splitlines():
+    match = re.match(r"^(scalar|vector): (.*)$", line) or re.match(r"^(cycle speedup .*)$", line)
+    if not match:
+      resultLines.append(line)
+      continue
+    label, text = (match.group(1), match.group(2)) if match.lastindex == 2 else ("comparison", match.group(1))
+    counters[label] = dict(filter(None, (parseCounter(item) for item in text.split(","))))
+  return counters, "\n".join(resultLines)
+
 def runWFVTester(launcherBin, profileMode):
+  global lastCounters
   success, rawResult = runForOutput(launcherBin)
 
   result = rawResult.decode('utf-8') if rawResult else ""
@@ -128,6 +258,7 @@ def runWFVTester(launcherBin, profileMode):
     raise TestFailure("wfv launcher crashed! Output:\n{}".format(result), None)
 
   if profileMode:
+    lastCounters, result = splitCounters(result)
     speedup = float(result)
     return 1.0, speedup # because code below expects runtimes and (spedup / 1.0 == speedup)
   else:
@@ -277,10 +408,15 @@ Options:
  -h               print help text and exit.
  -t <toolchain>   run test cases with the selected toolchain.
  -p               run in profile mode.
+ -j <file>        (profile mode) write the results to <file> as JSON.
 
 Environment variables:
  RVT_DEBUG=1      dump all shell commands before they are run.
  NUM_SAMPLES=<n>  take median of <n> samples when in profile mode.
+ RVT_TARGET=<name> target name recorded in the JSON results (eg skylake, zen3).
+ RVT_ISA=<isa>    ISA that selects the Budget[<isa>] options (default: detected from the host).
+ RV_PERF_COUNTERS=1 (profile mode) launchers print hardware counters (IPC, cache misses, ..) to stderr,
+                  -j records them per test.
 
 """
   print(text)
@@ -294,12 +430,20 @@ printBanner()
 toolChainName="clang"
 patterns=None
 profileMode=False
+jsonFile=None
 startArg = 1
 while startArg < len(sys.argv):
     if sys.argv[startArg] == "-p":
       profileMode = True
       startArg += 1
 
+    elif sys.argv[startArg] == "-j":
+      if startArg + 1 >= len(sys.argv):
+        print("Expected -j <file>")
+        raise SystemExit(-1)
+      jsonFile = sys.argv[startArg + 1]
+      startArg += 2
+
     elif sys.argv[startArg] == "-t":
       if startArg + 1 >= len(sys.argv):
         print("Expected -t <toolChainName>")
@@ -322,19 +466,29 @@ if patterns is None or len(patterns) == 0:
 
 
 
+# predicted speedup of the last region rvTool vectorized for this test (None if unknown)
+def readPrediction(testCase, key="predicted_speedup"):
+  predictFile = testCase.options.get('predictFile')
+  if not predictFile or not path.exists(predictFile):
+    return None
+  with open(predictFile) as f:
+    lines = [line for line in f if line.strip()]
+  return json.loads(lines[-1]).get(key) if lines else None
+
+# returns the median sample and all speedups (defTime / rvTime)
 def profileTest(numSamples, func):
   samples = []
   for i in range(numSamples):
     s = func()
     if s is None:
-      return None
+      return None, None
     samples.append(s)
 
   if None in samples:
-    return None
+    return None, None
 
   resList = sorted(samples)
-  return resList[len(resList) // 2]
+  return resList[len(resList) // 2], [defTime / rvTime for rvTime, defTime in samples]
 
 
 
@@ -360,6 +514,7 @@ printRule()
 
 # run stuff
 AllPassed = True
+jsonResults = []
 
 async def build_test(test, profileMode):
   try:
@@ -399,6 +554,16 @@ for pattern in patterns:
   for test in test_cases:
     # parse test case line ("// A: x, B: y .." line in test source file)
     test.parseOptions()
+    # cost model predictions for the JSON results
+    if profileMode and jsonFile:
+      test.options['predictFile'] = test.getFilename('predict')
+      if path.exists(test.options['predictFile']):
+        os.remove(test.options['predictFile'])
+    # rvTool appends to the metrics records
+    if not profileMode and test.options['budget']:
+      test.options['metricsFile'] = test.getFilename('metrics')
+      if path.exists(test.options['metricsFile']):
+        os.remove(test.options['metricsFile'])
 
   asyncio.run(build_tests())
 
@@ -420,14 +585,31 @@ for pattern in patterns:
     # run the test
     try:
       if profileMode:
-        rvTime, defTime = profileTest(numSamples, runner)
-        success = not (rvTime is None or defTime is None)
+        lastCounters = dict()
+        median, speedups = profileTest(numSamples, runner)
+        success = median is not None
         if success:
             num_success_tests += 1
+            rvTime, defTime = median
         print("{:5.3f}".format(float(defTime) / rvTime) if success else "failed!")
         results.append([test.baseName, "{:5.3f}".format(defTime / rvTime) if success else "0"])
+        if success:
+          width = test.options['width'] or defaultVectorWidth
+          jsonResults.append({
+            "test": test.baseName,
+            "width": width,
+            "speedup": defTime / rvTime,
+            "laneEfficiency": defTime / rvTime / width,
+            "minSpeedup": min(speedups),
+            "maxSpeedup": max(speedups),
+            "samples": len(speedups),
+            "predictedSpeedup": readPrediction(test),
+            "features": readPrediction(test, "features"),
+            "counters": lastCounters or None
+          })
 
       else:
+        checkBudget(test)
         success = runner()
         if success:
             num_success_tests += 1
@@ -446,6 +628,11 @@ if profileMode:
     writer = csv.writer(f)
     writer.writerows(results) 
 
+  if jsonFile:
+    with open(jsonFile, 'w') as f:
+      target = os.getenv("RVT_TARGET", platform.machine())
+      json.dump({"date": time.strftime("%Y-%m-%d-%H:%M:%S"), "toolchain": toolChainName, "target": target, "isa": hostISA(), "results": jsonResults}, f, indent=2)
+
 # Goodbye
 printRule()
 if AllPassed:
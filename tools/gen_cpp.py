@@ -1,39 +1,129 @@
 #!/usr/bin/env python3
+#
+# Embed a bitcode file as a C array.
+#
+# usage: gen_cpp.py out.gen.cpp bufferName in.bc [options]
+#
+# in.bc may also be a previously generated .gen.cpp file (eg from
+# vecmath/prebuilt_genbc), its buffer is transcoded.
+#
+# options:
+#   --keep <file>          strip all functions that are not reachable from the
+#                          listed functions (one name per line, '#' comments).
+#                          A name also keeps its ULP variants (<name>_u<digits>).
+#   --llvm-extract <path>  llvm-extract binary (required by --keep)
+#   --llvm-nm <path>       llvm-nm binary (required by --keep)
+#   --compress             zlib-compress the buffer. Compressed buffers start
+#                          with 'RVZ1' and the uncompressed size (8 bytes,
+#                          little endian), RV inflates them on first use.
+#   --bc <file>            also write the (pruned, uncompressed) bitcode to
+#                          <file>, the external library RV memory-maps from
+#                          RV_VECMATH_DIR (RV_EXTERNAL_GENBC).
 
+import os
+import re
+import struct
+import subprocess
 import sys
+import tempfile
+import zlib
 
-cppFileName, bufferName, bcFile = sys.argv[1:4]
-
-if (sys.version_info > (3, 0)):
-    cbyte = lambda x: x
-else:
-    cbyte = lambda x: ord(x)
-
-def bytes_from_file(filename, chunksize=8192):
-    with open(filename, "rb") as f:
-        while True:
-            chunk = f.read(chunksize)
-            if chunk:
-                for b in chunk:
-                    yield cbyte(b)
-            else:
-                break
-
-with open(cppFileName, 'w') as out:
-    # prologue
-    out.write('#include<string>\n')
-    out.write('extern "C" const unsigned char %s_Buffer[] = {' % bufferName)
-
-    for idx, byte in enumerate(bytes_from_file(bcFile)):
-        # transcode file
-        if idx > 0:
-            out.write(',')
-        if idx % 16 == 0:
-            out.write('\n')
-
-        out.write("0x{:02X}".format(byte))
-
-    # epilogue
-    out.write("\n")
-    out.write("};\n")
-    out.write('extern "C" const size_t %s_BufferLen = sizeof(%s_Buffer);\n' % (bufferName, bufferName))
+GENBC_MAGIC = b'RVZ1'
+
+def parse_args(argv):
+    positional = []
+    opts = {'keep': None, 'llvm-extract': None, 'llvm-nm': None, 'bc': None, 'compress': False}
+    i = 0
+    while i < len(argv):
+        arg = argv[i]
+        if arg == '--compress':
+            opts['compress'] = True
+        elif arg.startswith('--') and arg[2:] in opts:
+            i += 1
+            opts[arg[2:]] = argv[i]
+        else:
+            positional.append(arg)
+        i += 1
+    if len(positional) != 3:
+        sys.exit('usage: gen_cpp.py out.gen.cpp bufferName in.bc [--keep file --llvm-extract path --llvm-nm path] [--compress] [--bc out.bc]')
+    return positional, opts
+
+def read_input(fileName):
+    with open(fileName, 'rb') as f:
+        data = f.read()
+    if not fileName.endswith('.cpp'):
+        return data
+    # transcode a generated buffer
+    text = data.decode('ascii')
+    body = text[text.index('{') + 1:text.index('};')]
+    return bytes(int(byte, 16) for byte in re.findall(r'0x([0-9A-Fa-f]{2})', body))
+
+def read_keep_list(fileName):
+    names = []
+    with open(fileName) as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if line:
+                names.append(line)
+    return names
+
+def prune(data, keepNames, llvmExtract, llvmNm):
+    with tempfile.TemporaryDirectory() as tmpDir:
+        inBC = os.path.join(tmpDir, 'in.bc')
+        outBC = os.path.join(tmpDir, 'out.bc')
+        with open(inBC, 'wb') as f:
+            f.write(data)
+
+        # only request the kept functions that this module defines (llvm-extract fails on missing ones)
+        nmOut = subprocess.check_output([llvmNm, '--defined-only', '--format=just-symbols', inBC]).decode()
+        defined = set(nmOut.split())
+        keepPattern = re.compile('^(%s)(_u[0-9]+)?$' % '|'.join(re.escape(name) for name in keepNames))
+        roots = sorted(name for name in defined if keepPattern.match(name))
+        if not roots:
+            # nothing is mapped to this module, keep it intact
+            return data
+
+        cmd = [llvmExtract, '--recursive', '--keep-const-init', '-o', outBC, inBC]
+        cmd += ['--func=%s' % name for name in roots]
+        subprocess.check_call(cmd)
+        with open(outBC, 'rb') as f:
+            return f.read()
+
+def compress(data):
+    return GENBC_MAGIC + struct.pack('<Q', len(data)) + zlib.compress(data, 9)
+
+def main():
+    (cppFileName, bufferName, bcFile), opts = parse_args(sys.argv[1:])
+
+    data = read_input(bcFile)
+    if opts['keep']:
+        if not opts['llvm-extract'] or not opts['llvm-nm']:
+            sys.exit('gen_cpp.py: --keep requires --llvm-extract and --llvm-nm')
+        data = prune(data, read_keep_list(opts['keep']), opts['llvm-extract'], opts['llvm-nm'])
+    if opts['bc']:
+        with open(opts['bc'], 'wb') as f:
+            f.write(data)
+    if opts['compress']:
+        data = compress(data)
+
+    with open(cppFileName, 'w') as out:
+        # prologue
+        out.write('#include<string>\n')
+        out.write('extern "C" const unsigned char %s_Buffer[] = {' % bufferName)
+
+        for idx, byte in enumerate(data):
+            # transcode file
+            if idx > 0:
+                out.write(',')
+            if idx % 16 == 0:
+                out.write('\n')
+
+            out.write("0x{:02X}".format(byte))
+
+        # epilogue
+        out.write("\n")
+        out.write("};\n")
+        out.write('extern "C" const size_t %s_BufferLen = sizeof(%s_Buffer);\n' % (bufferName, bufferName))
+
+if __name__ == '__main__':
+    main()
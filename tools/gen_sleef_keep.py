@@ -0,0 +1,37 @@
+#!/usr/bin/env python3
+#
+# Write the SLEEF functions that RV maps (the InitSleefMappings table of
+# src/resolver/sleefResolver.cpp) as a keep list for gen_cpp.py --keep.
+#
+# usage: gen_sleef_keep.py sleefResolver.cpp out.keep
+
+import re
+import sys
+
+# requested by name outside of the mapping table
+EXTRA_ROOTS = [
+    'xsincos', 'xsincosf', # FuseSleefSinCos
+]
+
+def main():
+    resolverFile, keepFile = sys.argv[1:3]
+    with open(resolverFile) as f:
+        source = f.read()
+
+    # skip disabled mappings
+    source = re.sub(r'#if 0.*?#endif', '', source, flags=re.S)
+
+    names = set(EXTRA_ROOTS)
+    # {"scalar", "vector", width} and emplace_back("scalar", "vector", width)
+    names.update(re.findall(r'"\w+"\s*,\s*"(x\w+)"', source))
+    # ALSO_FINITE(IRNAME, SLEEFNAME, WIDTH), ALSO_FINITE_ULP(IRNAME, ULP, SLEEFNAME, WIDTH)
+    names.update(re.findall(r'ALSO_FINITE\(\s*\w+\s*,\s*(x\w+)\s*,', source))
+    names.update(re.findall(r'ALSO_FINITE_ULP\(\s*\w+\s*,\s*\w+\s*,\s*(x\w+)\s*,', source))
+
+    with open(keepFile, 'w') as out:
+        out.write('# generated by gen_sleef_keep.py from %s\n' % resolverFile)
+        for name in sorted(names):
+            out.write(name + '\n')
+
+if __name__ == '__main__':
+    main()
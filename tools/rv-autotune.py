@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+#
+# Empirical autotuner for the vector width, the interleave factor and the
+# transformation flags of RV, per loop and per WFV function.
+#
+# The regions to tune are taken from the decision records (RV_REPORT_JSON) of
+# a baseline build. Every region is tuned by coordinate descent: width, then
+# interleave factor, then one flag at a time. Each candidate is built with
+# RV_TUNING set to the current tuning file and timed with the run command.
+# The result is a tuning file for RV_TUNING (see include/rv/tuningFile.h).
+#
+# usage: rv-autotune.py --build "<cmd>" --run "<cmd>" -o tuning.txt [options]
+#
+# options:
+#   --samples <n>        timed runs per candidate (median, default 5)
+#   --widths <list>      loop widths to try (default 1,2,4,8,16)
+#   --interleave <list>  loop interleave factors to try (default 1,2,4)
+#   --flags <list>       Config toggles to try (default boscc,cif,srov,structopt,gathercost)
+#   --min-gain <x>       keep a candidate only if it is faster by this fraction (default 0.02)
+#   --parse-time         use the last number printed by the run command as its time
+#   --only <fn[:region]> only tune these regions (repeatable)
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+DEFAULT_FLAGS = "boscc,cif,srov,structopt,gathercost"
+
+class Region:
+    def __init__(self, function, region):
+        self.function = function
+        self.region = region
+        self.settings = {} # key -> value (tuned so far)
+
+    def isLoop(self):
+        return self.region != "wfv"
+
+    def line(self, settings=None):
+        settings = self.settings if settings is None else settings
+        if not settings:
+            return None
+        return "{} {} {}".format(self.function, self.region, " ".join("{}={}".format(k, v) for k, v in sorted(settings.items())))
+
+def write_tuning(path, regions, override=None):
+    with open(path, "w") as f:
+        f.write("# generated by rv-autotune.py\n")
+        for region in regions:
+            settings = region.settings
+            if override and override[0] is region:
+                settings = override[1]
+            line = region.line(settings)
+            if line:
+                f.write(line + "\n")
+
+def run_shell(cmd, env):
+    return subprocess.run(cmd, shell=True, env=env, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
+def collect_regions(args, env):
+    reportFile = os.path.join(args.workDir, "baseline.report.jsonl")
+    if os.path.exists(reportFile):
+        os.remove(reportFile)
+    buildEnv = dict(env)
+    buildEnv["RV_REPORT_JSON"] = reportFile
+    buildEnv.pop("RV_TUNING", None)
+    proc = run_shell(args.build, buildEnv)
+    if proc.returncode != 0:
+        sys.exit("baseline build failed:\n" + proc.stderr.decode(errors="replace"))
+
+    regions = []
+    seen = set()
+    if not os.path.exists(reportFile):
+        return regions
+    with open(reportFile) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            rec = json.loads(line)
+            if rec.get("kind", "decision") != "decision":
+                continue
+            if rec["pass"] == "wfv":
+                key = (rec["function"], "wfv")
+            elif rec["decision"] == "vectorized" or rec["reason"] == "not-beneficial":
+                key = (rec["function"], rec["region"])
+            else:
+                continue
+            if key in seen:
+                continue
+            if args.only and not any(key[0] == fn and (reg is None or key[1] == reg) for fn, reg in args.only):
+                continue
+            seen.add(key)
+            regions.append(Region(*key))
+    return regions
+
+def measure(args, env, regions, override=None):
+    tuningFile = os.path.join(args.workDir, "candidate.tuning")
+    write_tuning(tuningFile, regions, override)
+    runEnv = dict(env)
+    runEnv["RV_TUNING"] = tuningFile
+
+    proc = run_shell(args.build, runEnv)
+    if proc.returncode != 0:
+        return None
+
+    samples = []
+    for i in range(args.samples):
+        start = time.time()
+        proc = run_shell(args.run, runEnv)
+        elapsed = time.time() - start
+        if proc.returncode != 0:
+            return None
+        if args.parse_time:
+            numbers = re.findall(r"[-+]?\d*\.?\d+(?:[eE][-+]?\d+)?", proc.stdout.decode(errors="replace"))
+            if not numbers:
+                return None
+            elapsed = float(numbers[-1])
+        samples.append(elapsed)
+    samples.sort()
+    return samples[len(samples) // 2]
+
+def tune_key(args, env, regions, region, key, values, best):
+    for value in values:
+        candidate = dict(region.settings)
+        candidate[key] = value
+        if candidate == region.settings:
+            continue
+        t = measure(args, env, regions, (region, candidate))
+        desc = region.line(candidate)
+        if t is None:
+            print("  {}: failed".format(desc))
+            continue
+        print("  {}: {:.6g}".format(desc, t))
+        if t < best * (1.0 - args.minGain):
+            best = t
+            region.settings = candidate
+    return best
+
+def main():
+    parser = argparse.ArgumentParser(description="RV autotuner")
+    parser.add_argument("--build", required=True, help="build command (RV_TUNING is set in its environment)")
+    parser.add_argument("--run", required=True, help="run command to time")
+    parser.add_argument("-o", "--output", required=True, help="tuning file to write")
+    parser.add_argument("--samples", type=int, default=5)
+    parser.add_argument("--widths", default="1,2,4,8,16")
+    parser.add_argument("--interleave", default="1,2,4")
+    parser.add_argument("--flags", default=DEFAULT_FLAGS)
+    parser.add_argument("--min-gain", dest="minGain", type=float, default=0.02)
+    parser.add_argument("--parse-time", dest="parse_time", action="store_true")
+    parser.add_argument("--only", action="append", default=[])
+    args = parser.parse_args()
+
+    args.only = [(spec.split(":", 1)[0], spec.split(":", 1)[1] if ":" in spec else None) for spec in args.only]
+    args.workDir = tempfile.mkdtemp(prefix="rv-autotune")
+    env = dict(os.environ)
+
+    regions = collect_regions(args, env)
+    if not regions:
+        sys.exit("no vectorization candidates in the baseline build")
+    print("tuning {} regions".format(len(regions)))
+
+    best = measure(args, env, regions)
+    if best is None:
+        sys.exit("baseline run failed")
+    print("baseline: {:.6g}".format(best))
+
+    widths = [int(w) for w in args.widths.split(",") if w]
+    interleaves = [int(i) for i in args.interleave.split(",") if i]
+    flags = [flag for flag in args.flags.split(",") if flag]
+
+    for region in regions:
+        print("- {} {}".format(region.function, region.region))
+        if region.isLoop():
+            best = tune_key(args, env, regions, region, "width", widths, best)
+            if region.settings.get("width") != 1:
+                best = tune_key(args, env, regions, region, "interleave", interleaves, best)
+        for flag in flags:
+            best = tune_key(args, env, regions, region, flag, [0, 1], best)
+
+    write_tuning(args.output, regions)
+    print("best: {:.6g}, written to {}".format(best, args.output))
+
+if __name__ == "__main__":
+    main()
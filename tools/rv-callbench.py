@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+#
+# Per-call overhead of vector function calls in vectorized loops.
+#
+# A loop over out[i] = callee(args) is vectorized with rvTool -loopvec, the
+# callee (a small module-local function) goes through the recursive resolver
+# and becomes a vector variant that the vector loop calls. The same loop with
+# the callee body written into the loop is the baseline: the difference of the
+# two is the cost of the call itself (mask setup, argument packing in
+# NatBuilder::requestVectorCallArgs, the return value and the call and return).
+#
+# The configurations cover
+#   args     the shapes of the callee arguments: U uniform float, L linear
+#            (contiguous) i32, V varying float, e.g. "ULV" for callee(u, i, x)
+#   masked   the call under a divergent if (masked variant) or in every
+#            iteration (unmasked variant)
+#   ret      scalar (float) or struct ({float, float}) results
+#   width    the vector width of the loop and of the variant
+# Calls are measured with the fast calling convention of module-local variants
+# and without it (RV_NO_FAST_VARIANT_CC).
+#
+# usage: rv-callbench.py [options]
+#
+# options:
+#   --rvtool <path>     rvTool binary (default: rvTool)
+#   --clang <path>      clang to build the drivers (default: clang)
+#   --isa <name>        sse, avx2, avx512 or advsimd (default: the widest the host runs)
+#   --widths <list>     comma-separated vector widths (default: 4,8,16)
+#   --args <list>       comma-separated argument shapes (default: V,UV,LV,ULV,VVVV)
+#   -j <file>           write all measurements as JSON
+#   -n <elems>          loop iterations (default 4096)
+#   -r <reps>           timed repetitions (default 200)
+
+import argparse
+import json
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+
+# ISA -> (triple, target-features, clang flags, /proc/cpuinfo flags)
+ISAS = {
+    "sse":     ("x86_64-unknown-linux-gnu", "+sse2,+sse4.1", ["-msse4.1"], ["sse4_1"]),
+    "avx2":    ("x86_64-unknown-linux-gnu", "+sse2,+avx,+avx2,+fma", ["-mavx2", "-mfma"], ["avx2", "fma"]),
+    "avx512":  ("x86_64-unknown-linux-gnu", "+sse2,+avx,+avx2,+fma,+avx512f,+avx512dq,+avx512bw,+avx512vl",
+                ["-mavx512f", "-mavx512dq", "-mavx512bw", "-mavx512vl", "-mfma"],
+                ["avx512f", "avx512dq", "avx512bw", "avx512vl"]),
+    "advsimd": ("aarch64-unknown-linux-gnu", "+neon", [], []),
+}
+
+def host_isa():
+    machine = platform.machine()
+    if machine in ("aarch64", "arm64"):
+        return "advsimd"
+    flags = set()
+    if os.path.exists("/proc/cpuinfo"):
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("flags"):
+                    flags.update(line.split(":", 1)[1].split())
+                    break
+    for isa in ("avx512", "avx2", "sse"):
+        if all(flag in flags for flag in ISAS[isa][3]):
+            return isa
+    return None
+
+# argument kind -> (IR type, value in the loop)
+ARG_KINDS = {"U": ("float", "%u"), "L": ("i32", "%lin"), "V": ("float", "%x")}
+
+def callee_body(argVals, argKinds, structRet, prefix):
+    """the callee computation on argVals, returns (lines, result value)"""
+    lines = []
+    terms = []
+    for i, (val, kind) in enumerate(zip(argVals, argKinds)):
+        if ARG_KINDS[kind][0] == "i32":
+            lines.append("  %{}f{} = sitofp i32 {} to float".format(prefix, i, val))
+            terms.append("%{}f{}".format(prefix, i))
+        else:
+            terms.append(val)
+    acc = terms[0]
+    for i, term in enumerate(terms[1:]):
+        lines.append("  %{}s{} = fadd float {}, {}".format(prefix, i, acc, term))
+        acc = "%{}s{}".format(prefix, i)
+    lines.append("  %{}m = fmul float {}, 1.5".format(prefix, acc))
+    lines.append("  %{}r = fadd float %{}m, 1.0".format(prefix, prefix))
+    if not structRet:
+        return lines, "%{}r".format(prefix)
+    lines.append("  %{}p = insertvalue {{ float, float }} undef, float %{}r, 0".format(prefix, prefix))
+    lines.append("  %{}q = insertvalue {{ float, float }} %{}p, float %{}m, 1".format(prefix, prefix, prefix))
+    return lines, "%{}q".format(prefix)
+
+def write_kernel(path, isa, argKinds, masked, structRet, inline):
+    triple, features = ISAS[isa][0], ISAS[isa][1]
+    retTy = "{ float, float }" if structRet else "float"
+    lines = ['target triple = "{}"'.format(triple), ""]
+
+    if not inline:
+        params = ["{} %a{}".format(ARG_KINDS[kind][0], i) for i, kind in enumerate(argKinds)]
+        body, res = callee_body(["%a{}".format(i) for i in range(len(argKinds))], argKinds, structRet, "c")
+        lines.append("define internal {} @callee({}) #1 {{".format(retTy, ", ".join(params)))
+        lines += body
+        lines.append("  ret {} {}".format(retTy, res))
+        lines += ["}", ""]
+
+    lines += [
+        "define void @foo(float* noalias %out, float* noalias %in, float %u, i64 %n) #0 {",
+        "entry:",
+        "  %nonempty = icmp sgt i64 %n, 0",
+        "  br i1 %nonempty, label %loop, label %exit",
+        "loop:",
+        "  %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]",
+        "  %lin = trunc i64 %i to i32",
+        "  %inPtr = getelementptr inbounds float, float* %in, i64 %i",
+        "  %x = load float, float* %inPtr",
+    ]
+    if masked:
+        lines += ["  %active = fcmp ogt float %x, 0.0", "  br i1 %active, label %call, label %latch"]
+    else:
+        lines.append("  br label %call")
+    lines.append("call:")
+    argVals = [ARG_KINDS[kind][1] for kind in argKinds]
+    if inline:
+        body, res = callee_body(argVals, argKinds, structRet, "b")
+        lines += body
+    else:
+        args = ", ".join("{} {}".format(ARG_KINDS[kind][0], val) for kind, val in zip(argKinds, argVals))
+        lines.append("  %res = call {} @callee({})".format(retTy, args))
+        res = "%res"
+    if structRet:
+        lines += ["  %res0 = extractvalue { float, float } " + res + ", 0",
+                  "  %res1 = extractvalue { float, float } " + res + ", 1",
+                  "  %val = fadd float %res0, %res1"]
+    else:
+        lines.append("  %val = fadd float {}, 0.0".format(res))
+    lines.append("  br label %latch")
+    lines.append("latch:")
+    if masked:
+        lines.append("  %outVal = phi float [ %val, %call ], [ 0.0, %loop ]")
+    else:
+        lines.append("  %outVal = phi float [ %val, %call ]")
+    lines += [
+        "  %outPtr = getelementptr inbounds float, float* %out, i64 %i",
+        "  store float %outVal, float* %outPtr",
+        "  %i.next = add nuw nsw i64 %i, 1",
+        "  %more = icmp slt i64 %i.next, %n",
+        "  br i1 %more, label %loop, label %exit",
+        "exit:",
+        "  ret void",
+        "}",
+        "",
+        'attributes #0 = {{ nounwind "target-features"="{}" }}'.format(features),
+        'attributes #1 = {{ noinline nounwind readnone "target-features"="{}" }}'.format(features),
+    ]
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+# C driver: best time of foo over all repetitions, in ticks per element
+DRIVER = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+static unsigned long long ticks(void) { return __rdtsc(); }
+#else
+// nanoseconds
+static unsigned long long ticks(void) {
+  struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+void foo(float * out, float * in, float u, long n);
+
+int main(int argc, char ** argv) {
+  long n = atol(argv[1]);
+  int reps = atoi(argv[2]);
+  float * in = malloc(n * sizeof(float));
+  float * out = malloc(n * sizeof(float));
+  srand(42);
+  // half of the lanes take the masked call
+  for (long i = 0; i < n; ++i) in[i] = -1.0f + 2.0f * (rand() / (float) RAND_MAX);
+
+  unsigned long long best = ~0ull;
+  for (int r = 0; r < reps; ++r) {
+    unsigned long long start = ticks();
+    foo(out, in, 0.5f, n);
+    __asm__ volatile("" :: "r"(out) : "memory");
+    unsigned long long elapsed = ticks() - start;
+    if (elapsed < best) best = elapsed;
+  }
+  printf("%f\n", best / (double) n);
+  return 0;
+}
+"""
+
+def run(cmd, env=None):
+    return subprocess.run(cmd, env=env, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+
+# ticks per element of one build of the loop, None on failure
+def measure(args, workDir, isa, width, argKinds, masked, structRet, inline, fastCC):
+    kernel = os.path.join(workDir, "kernel.ll")
+    write_kernel(kernel, isa, argKinds, masked, structRet, inline)
+    env = dict(os.environ, RV_NO_RESOLVER_COSTS="1")
+    if not fastCC:
+        env["RV_NO_FAST_VARIANT_CC"] = "1"
+    vectorized = os.path.join(workDir, "kernel.rv.ll")
+    proc = run([args.rvtool, "-loopvec", "-lower", "-i", kernel, "-o", vectorized, "-k", "foo", "-w", str(width)], env)
+    if proc.returncode != 0:
+        print("  rvTool failed\n{}".format(proc.stderr), file=sys.stderr)
+        return None
+    # Vector Function ABI or RV_LEGACY_MANGLING names of the variant
+    with open(vectorized) as f:
+        text = f.read()
+    if not inline and not re.search(r'call [^\n]*@(_ZGV\w*_callee|callee_\w+)\(', text):
+        print("  no vector variant of the callee (the call was replicated)", file=sys.stderr)
+        return None
+    binary = os.path.join(workDir, "bench")
+    proc = run([args.clang, "-O2", "-w"] + ISAS[isa][2] + [os.path.join(workDir, "driver.c"), vectorized, "-o", binary])
+    if proc.returncode != 0:
+        print("  build failed\n{}".format(proc.stderr), file=sys.stderr)
+        return None
+    proc = run([binary, str(args.n), str(args.reps)])
+    if proc.returncode != 0:
+        print("  run failed", file=sys.stderr)
+        return None
+    return float(proc.stdout)
+
+def main():
+    parser = argparse.ArgumentParser(description="benchmark the per-call overhead of RV vector variants")
+    parser.add_argument("--rvtool", default="rvTool")
+    parser.add_argument("--clang", default="clang")
+    parser.add_argument("--isa", choices=sorted(ISAS))
+    parser.add_argument("--widths", default="4,8,16")
+    parser.add_argument("--args", default="V,UV,LV,ULV,VVVV")
+    parser.add_argument("-j", "--json")
+    parser.add_argument("-n", type=int, default=4096)
+    parser.add_argument("-r", "--reps", type=int, default=200)
+    args = parser.parse_args()
+
+    isa = args.isa or host_isa()
+    if not isa:
+        sys.exit("no supported ISA on this host (--isa)")
+    widths = [int(w) for w in args.widths.split(",")]
+    argShapes = args.args.split(",")
+    for shape in argShapes:
+        if not shape or any(kind not in ARG_KINDS for kind in shape):
+            sys.exit("argument shapes are strings of U, L and V: {}".format(shape))
+    print("ISA {}, ticks per element (overhead per call = difference to the inlined body * width)".format(isa))
+
+    results = []
+    with tempfile.TemporaryDirectory(prefix="rv-callbench") as workDir:
+        with open(os.path.join(workDir, "driver.c"), "w") as f:
+            f.write(DRIVER)
+        for width in widths:
+            for shape in argShapes:
+                for masked in (False, True):
+                    for structRet in (False, True):
+                        inlined = measure(args, workDir, isa, width, shape, masked, structRet, True, True)
+                        fast = measure(args, workDir, isa, width, shape, masked, structRet, False, True)
+                        plain = measure(args, workDir, isa, width, shape, masked, structRet, False, False)
+                        if inlined is None or fast is None or plain is None:
+                            continue
+                        res = {"isa": isa, "width": width, "args": shape, "masked": masked,
+                               "ret": "struct" if structRet else "scalar", "inlined": inlined,
+                               "call": plain, "call_fastcc": fast,
+                               "overhead": (plain - inlined) * width, "overhead_fastcc": (fast - inlined) * width}
+                        results.append(res)
+                        print("  w{width:<3} {args:6} {0:8} {ret:6} inlined {inlined:7.2f} call {call:7.2f} "
+                              "fastcc {call_fastcc:7.2f} /elem, per call {overhead:7.2f} fastcc {overhead_fastcc:7.2f}".format(
+                              "masked" if masked else "unmasked", **res))
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"target": platform.machine(), "results": results}, f, indent=1)
+
+if __name__ == "__main__":
+    main()
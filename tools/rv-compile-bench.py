@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+#
+# Compile-time benchmark for the vectorizer itself.
+# Generates synthetic WFV kernels of controlled size and shape, vectorizes
+# them with rvTool (RV_TIME_PHASES) and summarizes the per-phase wall time and
+# the memory high-water mark per kernel family and size.
+#
+# usage: rv-compile-bench.py [--rvtool path] [--width 8] [--sizes 16,64,256]
+#                            [--families nest,switch,...] [--keep dir] [--json]
+#
+# Families:
+#   nest       divergent if-nest of depth <size>
+#   switch     divergent switch with <size> cases
+#   reduction  dependence chain of <size> fmul/fadd pairs
+#   mem        <size> contiguous load/store pairs
+#   math       <size> calls to math functions (mapped to SLEEF)
+#   diamonds   chain of <size> divergent if-then-else diamonds with a phi each
+#   ladder     <size> divergent early exits into one join block (relays that
+#              reach over the whole region, a phi with <size> + 1 inputs)
+#
+# The growth column is (time / previous time) / (size / previous size) of the
+# phase, values well above 1 point at superlinear behaviour.
+#
+# Expected scaling of the linearizer: the relay chains merge in one pass over
+# their block indices, reaching blocks are bit vectors by block index and phi
+# folding looks incoming values up in a map built once per phi. diamonds should
+# stay at a growth of about 1, ladder at most linear in the number of relayed
+# edges per block (the folded phi needs one blend per input). Growth well above
+# that on e.g. --sizes 256,1024,4096 is a regression.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+from collections import defaultdict
+
+# foo(tid, A, x): tid is contiguous, A uniform, x varying
+SIGNATURE = "define float @foo(i32 %tid, float* %A, float %x)"
+SHAPES = "C_U_TrT"
+
+def gen_nest(n):
+    lines = [SIGNATURE + " {", "L0:", "  %v0 = fadd float %x, 0.0"]
+    for i in range(n):
+        if i > 0:
+            lines.append("L{}:".format(i))
+        lines.append("  %v{} = fadd float %v{}, 1.0".format(i + 1, i))
+        lines.append("  %c{} = fcmp ogt float %v{}, {}.0".format(i, i + 1, i))
+        lines.append("  br i1 %c{}, label %L{}, label %J{}".format(i, i + 1, i))
+    lines.append("L{}:".format(n))
+    lines.append("  br label %J{}".format(n - 1))
+    for i in reversed(range(n)):
+        innerVal, innerBlock = ("%v{}".format(n), "%L{}".format(n)) if i == n - 1 else ("%s{}".format(i + 1), "%J{}".format(i + 1))
+        lines.append("J{}:".format(i))
+        lines.append("  %r{} = phi float [ %v{}, %L{} ], [ {}, {} ]".format(i, i + 1, i, innerVal, innerBlock))
+        lines.append("  %s{} = fmul float %r{}, 0.5".format(i, i))
+        lines.append("  br label %J{}".format(i - 1) if i > 0 else "  ret float %s0")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_switch(n):
+    lines = [SIGNATURE + " {", "entry:", "  %sel = fptosi float %x to i32", "  switch i32 %sel, label %join ["]
+    lines += ["    i32 {}, label %case{}".format(i, i) for i in range(n)]
+    lines.append("  ]")
+    for i in range(n):
+        lines.append("case{}:".format(i))
+        lines.append("  %v{} = fadd float %x, {}.0".format(i, i + 1))
+        lines.append("  br label %join")
+    incoming = ["[ %x, %entry ]"] + ["[ %v{}, %case{} ]".format(i, i) for i in range(n)]
+    lines.append("join:")
+    lines.append("  %res = phi float " + ", ".join(incoming))
+    lines.append("  ret float %res")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_reduction(n):
+    lines = [SIGNATURE + " {", "entry:", "  %r0 = fadd float %x, 0.0"]
+    for i in range(n):
+        lines.append("  %m{} = fmul float %r{}, 0.5".format(i, i))
+        lines.append("  %r{} = fadd float %m{}, %x".format(i + 1, i))
+    lines.append("  ret float %r{}".format(n))
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_mem(n):
+    lines = [SIGNATURE + " {", "entry:"]
+    for i in range(n):
+        lines.append("  %i{} = add i32 %tid, {}".format(i, i * 8))
+        lines.append("  %p{} = getelementptr inbounds float, float* %A, i32 %i{}".format(i, i))
+        lines.append("  %l{} = load float, float* %p{}, align 4".format(i, i))
+        lines.append("  %a{} = fadd float %l{}, %x".format(i, i))
+        lines.append("  store float %a{}, float* %p{}, align 4".format(i, i))
+    lines.append("  ret float %x")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+MATH_FUNCS = ["sinf", "cosf", "expf", "logf", "sqrtf"]
+
+def gen_math(n):
+    lines = [SIGNATURE + " {", "entry:", "  %r0 = fadd float %x, 0.0"]
+    for i in range(n):
+        lines.append("  %r{} = call float @{}(float %r{})".format(i + 1, MATH_FUNCS[i % len(MATH_FUNCS)], i))
+    lines.append("  ret float %r{}".format(n))
+    lines.append("}")
+    lines += ["declare float @{}(float) readnone nounwind".format(name) for name in MATH_FUNCS]
+    return "\n".join(lines) + "\n"
+
+def gen_diamonds(n):
+    lines = [SIGNATURE + " {", "D0:", "  %v0 = fadd float %x, 0.0"]
+    for i in range(n):
+        if i > 0:
+            lines.append("D{}:".format(i))
+            lines.append("  %v{} = phi float [ %t{}, %T{} ], [ %e{}, %E{} ]".format(i, i - 1, i - 1, i - 1, i - 1))
+        lines.append("  %c{} = fcmp ogt float %v{}, {}.0".format(i, i, i))
+        lines.append("  br i1 %c{}, label %T{}, label %E{}".format(i, i, i))
+        lines.append("T{}:".format(i))
+        lines.append("  %t{} = fadd float %v{}, 1.0".format(i, i))
+        lines.append("  br label %D{}".format(i + 1))
+        lines.append("E{}:".format(i))
+        lines.append("  %e{} = fmul float %v{}, 0.5".format(i, i))
+        lines.append("  br label %D{}".format(i + 1))
+    lines.append("D{}:".format(n))
+    lines.append("  %v{} = phi float [ %t{}, %T{} ], [ %e{}, %E{} ]".format(n, n - 1, n - 1, n - 1, n - 1))
+    lines.append("  ret float %v{}".format(n))
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_ladder(n):
+    lines = [SIGNATURE + " {", "L0:", "  %v0 = fadd float %x, 0.0"]
+    for i in range(n):
+        if i > 0:
+            lines.append("L{}:".format(i))
+        lines.append("  %v{} = fadd float %v{}, 1.0".format(i + 1, i))
+        lines.append("  %c{} = fcmp ogt float %v{}, {}.0".format(i, i + 1, i))
+        lines.append("  br i1 %c{}, label %L{}, label %exit".format(i, i + 1))
+    lines.append("L{}:".format(n))
+    lines.append("  br label %exit")
+    incoming = ["[ %v{}, %L{} ]".format(i + 1, i) for i in range(n)] + ["[ %v{}, %L{} ]".format(n, n)]
+    lines.append("exit:")
+    lines.append("  %res = phi float " + ", ".join(incoming))
+    lines.append("  ret float %res")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+FAMILIES = {
+    "nest": gen_nest,
+    "switch": gen_switch,
+    "reduction": gen_reduction,
+    "mem": gen_mem,
+    "math": gen_math,
+    "diamonds": gen_diamonds,
+    "ladder": gen_ladder,
+}
+
+def run_rvtool(rvTool, width, kernelFile, outFile, phaseFile):
+    env = dict(os.environ)
+    env["RV_TIME_PHASES"] = "1"
+    env["RV_TIME_PHASES_FILE"] = phaseFile
+    cmd = [rvTool, "-wfv", "-lower", "-i", kernelFile, "-o", outFile, "-k", "foo", "-s", SHAPES, "-w", str(width)]
+    start = time.time()
+    proc = subprocess.run(cmd, env=env, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    wallMs = (time.time() - start) * 1000.0
+    if proc.returncode != 0:
+        sys.stderr.write("rvTool failed on {}:\n{}\n".format(kernelFile, proc.stderr.decode(errors="replace")))
+        return None
+    return wallMs
+
+def read_phases(phaseFile):
+    phaseMs = defaultdict(float)
+    peakRSS = 0
+    if not os.path.exists(phaseFile):
+        return phaseMs, peakRSS
+    with open(phaseFile) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            rec = json.loads(line)
+            phaseMs[rec["phase"]] += rec["wall_ms"]
+            peakRSS = max(peakRSS, rec.get("peak_rss_kb", 0))
+    return phaseMs, peakRSS
+
+def main():
+    parser = argparse.ArgumentParser(description="RV compile-time benchmark")
+    parser.add_argument("--rvtool", default="rvTool")
+    parser.add_argument("--width", type=int, default=8)
+    parser.add_argument("--sizes", default="16,64,256")
+    parser.add_argument("--families", default=",".join(FAMILIES))
+    parser.add_argument("--keep", default=None, help="keep the generated kernels in this directory")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    args = parser.parse_args()
+
+    sizes = [int(size) for size in args.sizes.split(",")]
+    families = args.families.split(",")
+    for family in families:
+        if family not in FAMILIES:
+            sys.exit("unknown kernel family: {}".format(family))
+
+    workDir = args.keep or tempfile.mkdtemp(prefix="rv-compile-bench")
+    os.makedirs(workDir, exist_ok=True)
+
+    results = []
+    for family in families:
+        for size in sizes:
+            baseName = os.path.join(workDir, "{}_{}".format(family, size))
+            kernelFile = baseName + ".ll"
+            phaseFile = baseName + ".phases.jsonl"
+            with open(kernelFile, "w") as f:
+                f.write(FAMILIES[family](size))
+            if os.path.exists(phaseFile):
+                os.remove(phaseFile)
+
+            wallMs = run_rvtool(args.rvtool, args.width, kernelFile, baseName + ".wfv.ll", phaseFile)
+            if wallMs is None:
+                continue
+            phaseMs, peakRSS = read_phases(phaseFile)
+            results.append({"family": family, "size": size, "width": args.width, "total_ms": wallMs,
+                            "peak_rss_kb": peakRSS, "phases": dict(phaseMs)})
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2)
+        print()
+        return
+
+    prev = {}
+    for res in results:
+        print("{} (size {}): {:.1f} ms total, peak RSS {} kB".format(res["family"], res["size"], res["total_ms"], res["peak_rss_kb"]))
+        for phase, ms in sorted(res["phases"].items(), key=lambda item: -item[1]):
+            growth = ""
+            last = prev.get((res["family"], phase))
+            if last and last[1] > 0:
+                growth = "  growth {:.2f}".format((ms / last[1]) / (res["size"] / last[0]))
+            print("  {:28} {:10.2f} ms{}".format(phase, ms, growth))
+            prev[(res["family"], phase)] = (res["size"], ms)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# Compare the speedups predicted by RV's cost model with measured speedups.
+#
+# Input are the JSON results of test/test_rv.py -p -j <file> (one file per
+# target machine, RVT_TARGET names the target). Per target, a correction
+# factor c is fitted such that measured ~ c * predicted (least squares on
+# log speedups, i.e. c is the geometric mean of measured / predicted).
+# Kernels whose corrected prediction is off by more than the threshold are
+# flagged.
+#
+# usage: rv-costmodel-check.py [--threshold 0.25] [--json] results.json [results.json ...]
+
+import argparse
+import json
+import math
+import sys
+from collections import defaultdict
+
+def read_results(paths):
+    samples = defaultdict(list) # target -> [(test, width, predicted, measured)]
+    for resPath in paths:
+        with open(resPath) as f:
+            data = json.load(f)
+        target = data.get("target", "unknown")
+        for res in data["results"]:
+            predicted = res.get("predictedSpeedup")
+            measured = res.get("speedup")
+            if not predicted or not measured or predicted <= 0 or measured <= 0:
+                continue
+            samples[target].append((res["test"], res.get("width", 0), predicted, measured))
+    return samples
+
+def check_target(samples, threshold):
+    logRatios = [math.log(measured / predicted) for _, _, predicted, measured in samples]
+    factor = math.exp(sum(logRatios) / len(logRatios))
+
+    # rms error of the log speedups before and after correction
+    rawError = math.sqrt(sum(r * r for r in logRatios) / len(logRatios))
+    corrError = math.sqrt(sum((r - math.log(factor)) ** 2 for r in logRatios) / len(logRatios))
+
+    outliers = []
+    for test, width, predicted, measured in samples:
+        corrected = factor * predicted
+        deviation = measured / corrected - 1.0
+        if abs(deviation) > threshold:
+            outliers.append({"test": test, "width": width, "predicted": predicted,
+                             "corrected": corrected, "measured": measured, "deviation": deviation})
+    outliers.sort(key=lambda o: -abs(o["deviation"]))
+    return {"kernels": len(samples), "factor": factor, "logRmsError": rawError,
+            "correctedLogRmsError": corrError, "outliers": outliers}
+
+def main():
+    parser = argparse.ArgumentParser(description="RV cost model validation")
+    parser.add_argument("--threshold", type=float, default=0.25,
+                        help="flag kernels whose measured speedup deviates more than this fraction from the corrected prediction")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    parser.add_argument("results", nargs="+")
+    args = parser.parse_args()
+
+    samples = read_results(args.results)
+    if not samples:
+        sys.exit("no kernels with both a predicted and a measured speedup")
+
+    report = {target: check_target(targetSamples, args.threshold) for target, targetSamples in sorted(samples.items())}
+
+    if args.json:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+        return
+
+    for target, res in report.items():
+        print("{}: {} kernels, correction factor {:.3f}, log rms error {:.3f} -> {:.3f} (corrected)".format(
+            target, res["kernels"], res["factor"], res["logRmsError"], res["correctedLogRmsError"]))
+        for o in res["outliers"]:
+            print("  {:50} w{:<3} predicted {:6.2f} (corrected {:6.2f}) measured {:6.2f} ({:+.0%})".format(
+                o["test"], o["width"], o["predicted"], o["corrected"], o["measured"], o["deviation"]))
+
+if __name__ == "__main__":
+    main()
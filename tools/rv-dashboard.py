@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+#
+# End-to-end performance summary of one RV build per ISA.
+# Runs the runtime benchmarks (test/test_rv.py -p, with the hardware counters
+# of RV_PERF_COUNTERS), the compile-time corpus (rv-compile-bench.py) and the
+# codegen suite (test/test_rv.py in verification mode with the instruction-mix
+# budgets), collects the RV_REPORT_JSON records of the codegen run (merged as
+# by rv-report-merge.py) and writes
+#
+#   <out>/rv-dashboard-<isa>-<version>.json   all results, the diff against the baseline
+#   <out>/rv-dashboard-<isa>-<version>.html   the same as tables, regressions highlighted
+#
+# The baseline is <out>/baseline-<isa>.json (or --baseline), --update-baseline
+# replaces it by the current results.
+#
+# usage: rv-dashboard.py [--rvtool path] [--testdir dir] [--toolchain clang] [--isa isa]
+#                        [--version v] [--baseline file] [--update-baseline]
+#                        [--skip runtime,compile,codegen] [--sizes 16,64,256]
+#                        [--threshold 0.05] -o outdir [test patterns ...]
+#
+# A speedup below (1 - threshold) * baseline, a compile time or peak memory above
+# (1 + threshold) * baseline, a codegen counter above its baseline and a test
+# that passed in the baseline and fails now are regressions.
+
+import argparse
+import html
+import importlib.util
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+SCHEMA = 1
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+STAGES = ("runtime", "compile", "codegen")
+
+def load_tool(fileName):
+    spec = importlib.util.spec_from_file_location(fileName.replace("-", "_")[:-3], os.path.join(TOOLS_DIR, fileName))
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+def rv_version():
+    try:
+        return subprocess.check_output(["git", "describe", "--always", "--dirty"], cwd=TOOLS_DIR,
+                                       stderr=subprocess.DEVNULL).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+def tool_env(args, extra):
+    env = dict(os.environ, **extra)
+    # test_rv.py calls rvTool from the PATH
+    env["PATH"] = os.path.dirname(os.path.abspath(args.rvtool)) + os.pathsep + env.get("PATH", "")
+    if args.isa:
+        env["RVT_ISA"] = args.isa
+    return env
+
+def run_runtime(args, workDir):
+    resultFile = os.path.join(workDir, "runtime.json")
+    cmd = [sys.executable, "test_rv.py", "-p", "-j", resultFile, "-t", args.toolchain] + args.patterns
+    subprocess.call(cmd, cwd=args.testdir, env=tool_env(args, {"RV_PERF_COUNTERS": "1"}))
+    if not os.path.exists(resultFile):
+        return None, None
+    with open(resultFile) as f:
+        data = json.load(f)
+    tests = dict()
+    for res in data["results"]:
+        tests[res["test"]] = {key: res.get(key) for key in ("width", "speedup", "minSpeedup", "maxSpeedup",
+                                                            "laneEfficiency", "predictedSpeedup", "counters")}
+    return tests, data.get("isa")
+
+def run_compile(args):
+    cmd = [sys.executable, os.path.join(TOOLS_DIR, "rv-compile-bench.py"), "--rvtool", args.rvtool, "--json"]
+    if args.sizes:
+        cmd += ["--sizes", args.sizes]
+    try:
+        results = json.loads(subprocess.check_output(cmd).decode())
+    except (subprocess.CalledProcessError, ValueError):
+        return None
+    return {"{}_{}".format(res["family"], res["size"]): {"total_ms": res["total_ms"], "peak_rss_kb": res["peak_rss_kb"],
+                                                         "phases": res["phases"]} for res in results}
+
+# "- name.c      passed" lines of test_rv.py
+TEST_LINE = re.compile(r"^- (\S+)\s+(.*)$")
+
+def run_codegen(args, workDir):
+    reportFile = os.path.join(workDir, "report.jsonl")
+    cmd = [sys.executable, "test_rv.py", "-t", args.toolchain] + args.patterns
+    proc = subprocess.run(cmd, cwd=args.testdir, env=tool_env(args, {"RV_REPORT_JSON": reportFile}),
+                          stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    status = dict()
+    for line in proc.stdout.decode(errors="replace").splitlines():
+        match = TEST_LINE.match(line)
+        if not match or match.group(2).strip() == "built":
+            continue
+        text = match.group(2).strip()
+        status[match.group(1)] = "passed" if text == "passed" else "unsupported" if text.startswith("(") else "failed"
+
+    merge = load_tool("rv-report-merge.py")
+    metrics, decisions = dict(), dict()
+    if os.path.exists(reportFile):
+        decisionCounts, _, _, passMetrics = merge.summarize(merge.read_records([reportFile]))
+        metrics = {passName: dict(counters) for passName, counters in passMetrics.items()}
+        for (passName, decision), count in decisionCounts.items():
+            decisions.setdefault(passName, dict())[decision] = count
+    return {"tests": status, "metrics": metrics, "decisions": decisions}
+
+# (key, value, lower is better) of all compared numbers
+def flatten(summary):
+    for test, res in sorted((summary.get("runtime") or {}).items()):
+        if res.get("speedup") is not None:
+            yield "runtime/{}/speedup".format(test), res["speedup"], False
+    for kernel, res in sorted((summary.get("compile") or {}).items()):
+        yield "compile/{}/total_ms".format(kernel), res["total_ms"], True
+        if res.get("peak_rss_kb") is not None:
+            yield "compile/{}/peak_rss_kb".format(kernel), res["peak_rss_kb"], True
+    for passName, counters in sorted(((summary.get("codegen") or {}).get("metrics") or {}).items()):
+        for name, value in sorted(counters.items()):
+            yield "codegen/{}/{}".format(passName, name), value, True
+
+def diff_summaries(current, baseline, threshold):
+    baseValues = {key: (value, lowerIsBetter) for key, value, lowerIsBetter in flatten(baseline)}
+    entries = []
+    for key, value, lowerIsBetter in flatten(current):
+        if key not in baseValues:
+            continue
+        base = baseValues[key][0]
+        change = (value - base) / base if base else (0.0 if value == base else float("inf"))
+        # codegen counters are exact, timings are noisy
+        tolerance = 0.0 if key.startswith("codegen/") else threshold
+        regression = change > tolerance if lowerIsBetter else change < -tolerance
+        improvement = change < -tolerance if lowerIsBetter else change > tolerance
+        if regression or improvement:
+            entries.append({"key": key, "baseline": base, "current": value, "change": change, "regression": regression})
+
+    baseTests = ((baseline.get("codegen") or {}).get("tests") or {})
+    for test, status in sorted(((current.get("codegen") or {}).get("tests") or {}).items()):
+        baseStatus = baseTests.get(test)
+        if baseStatus and baseStatus != status:
+            entries.append({"key": "codegen/tests/{}".format(test), "baseline": baseStatus, "current": status,
+                            "change": None, "regression": baseStatus == "passed"})
+    entries.sort(key=lambda e: (not e["regression"], e["key"]))
+    return entries
+
+def fmt(value):
+    if isinstance(value, float):
+        return "{:.3f}".format(value)
+    return html.escape(str(value))
+
+def html_table(title, header, rows, rowClasses=None):
+    out = ["<h2>{}</h2>".format(html.escape(title)), "<table>",
+           "<tr>" + "".join("<th>{}</th>".format(html.escape(h)) for h in header) + "</tr>"]
+    for i, row in enumerate(rows):
+        cls = ' class="{}"'.format(rowClasses[i]) if rowClasses and rowClasses[i] else ""
+        out.append("<tr{}>".format(cls) + "".join("<td>{}</td>".format(fmt(c)) for c in row) + "</tr>")
+    out.append("</table>")
+    return "\n".join(out)
+
+def write_html(summary, path):
+    parts = ["<!DOCTYPE html>", "<html><head><meta charset=\"utf-8\">",
+             "<title>RV {} ({})</title>".format(html.escape(summary["version"]), html.escape(summary["isa"])),
+             "<style>body{font-family:sans-serif} table{border-collapse:collapse;margin-bottom:1em}"
+             " td,th{border:1px solid #ccc;padding:2px 8px;text-align:right} td:first-child{text-align:left}"
+             " .regression{background:#f8d0d0} .improvement{background:#d0f0d0}</style>",
+             "</head><body>",
+             "<h1>RV {} on {}</h1>".format(html.escape(summary["version"]), html.escape(summary["isa"])),
+             "<p>{}, baseline {}</p>".format(html.escape(summary["date"]), html.escape(str(summary.get("baselineVersion"))))]
+
+    diff = summary.get("diff") or []
+    if diff:
+        parts.append(html_table("Changes against the baseline", ["metric", "baseline", "current", "change"],
+                                [[e["key"], e["baseline"], e["current"],
+                                  "" if e["change"] is None else "{:+.1%}".format(e["change"])] for e in diff],
+                                ["regression" if e["regression"] else "improvement" for e in diff]))
+
+    runtime = summary.get("runtime") or {}
+    if runtime:
+        rows = []
+        for test, res in sorted(runtime.items()):
+            counters = res.get("counters") or {}
+            vecCounters = counters.get("vector", {})
+            rows.append([test, res.get("width"), res.get("speedup"), res.get("laneEfficiency"), res.get("predictedSpeedup"),
+                         vecCounters.get("ipc", ""), vecCounters.get("l1d_misses", ""), vecCounters.get("llc_misses", "")])
+        parts.append(html_table("Runtime", ["test", "width", "speedup", "lane efficiency", "predicted",
+                                            "vector IPC", "vector L1D misses", "vector LLC misses"], rows))
+
+    compileRes = summary.get("compile") or {}
+    if compileRes:
+        parts.append(html_table("Compile time", ["kernel", "total ms", "peak RSS kB"],
+                                [[kernel, res["total_ms"], res["peak_rss_kb"]] for kernel, res in sorted(compileRes.items())]))
+
+    codegen = summary.get("codegen") or {}
+    if codegen.get("tests"):
+        tests = sorted(codegen["tests"].items())
+        parts.append(html_table("Codegen tests", ["test", "status"], [list(t) for t in tests],
+                                ["regression" if status == "failed" else None for _, status in tests]))
+    for passName, counters in sorted((codegen.get("metrics") or {}).items()):
+        parts.append(html_table("Codegen metrics ({})".format(passName), ["counter", "value"],
+                                [[name, value] for name, value in sorted(counters.items())]))
+
+    parts.append("</body></html>")
+    with open(path, "w") as f:
+        f.write("\n".join(parts) + "\n")
+
+def main():
+    parser = argparse.ArgumentParser(description="RV performance dashboard")
+    parser.add_argument("--rvtool", default="rvTool")
+    parser.add_argument("--testdir", default=os.path.join(TOOLS_DIR, "..", "test"))
+    parser.add_argument("--toolchain", default="clang")
+    parser.add_argument("--isa", default=os.getenv("RVT_ISA"), help="ISA name (default: detected by test_rv.py)")
+    parser.add_argument("--version", default=None, help="version recorded in the summary (default: git describe)")
+    parser.add_argument("--baseline", default=None, help="baseline summary (default: <out>/baseline-<isa>.json)")
+    parser.add_argument("--update-baseline", action="store_true", help="store the current summary as the baseline")
+    parser.add_argument("--skip", default="", help="comma separated stages to skip: " + ",".join(STAGES))
+    parser.add_argument("--sizes", default=None, help="kernel sizes of the compile-time corpus")
+    parser.add_argument("--threshold", type=float, default=0.05, help="relative noise margin of timings")
+    parser.add_argument("-o", "--out", required=True)
+    parser.add_argument("patterns", nargs="*")
+    args = parser.parse_args()
+
+    skip = set(filter(None, args.skip.split(",")))
+    for stage in skip:
+        if stage not in STAGES:
+            sys.exit("unknown stage: {}".format(stage))
+    os.makedirs(args.out, exist_ok=True)
+    workDir = tempfile.mkdtemp(prefix="rv-dashboard")
+
+    summary = {"schema": SCHEMA, "version": args.version or rv_version(), "date": time.strftime("%Y-%m-%d-%H:%M:%S"),
+               "toolchain": args.toolchain, "isa": args.isa}
+    if "runtime" not in skip:
+        summary["runtime"], detectedISA = run_runtime(args, workDir)
+        summary["isa"] = summary["isa"] or detectedISA
+    if "compile" not in skip:
+        summary["compile"] = run_compile(args)
+    if "codegen" not in skip:
+        summary["codegen"] = run_codegen(args, workDir)
+    summary["isa"] = summary["isa"] or "host"
+
+    baselinePath = args.baseline or os.path.join(args.out, "baseline-{}.json".format(summary["isa"]))
+    if os.path.exists(baselinePath):
+        with open(baselinePath) as f:
+            baseline = json.load(f)
+        if baseline.get("schema") == SCHEMA:
+            summary["baselineVersion"] = baseline.get("version")
+            summary["diff"] = diff_summaries(summary, baseline, args.threshold)
+
+    baseName = os.path.join(args.out, "rv-dashboard-{}-{}".format(summary["isa"], summary["version"]))
+    with open(baseName + ".json", "w") as f:
+        json.dump(summary, f, indent=2)
+    write_html(summary, baseName + ".html")
+    if args.update_baseline:
+        shutil.copyfile(baseName + ".json", baselinePath)
+    shutil.rmtree(workDir, ignore_errors=True)
+
+    regressions = [e for e in summary.get("diff") or [] if e["regression"]]
+    print("{}.json, {}.html: {} regressions against {}".format(baseName, baseName, len(regressions),
+                                                              summary.get("baselineVersion", "no baseline")))
+    for e in regressions:
+        print("  {}: {} -> {}".format(e["key"], e["baseline"], e["current"]))
+    return 1 if regressions else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,347 @@
+#!/usr/bin/env python3
+#
+# Vector math throughput and accuracy benchmark of the SLEEF mappings of RV
+# (the InitSleefMappings table of src/resolver/sleefResolver.cpp).
+#
+# Every mapped libm function is vectorized with rvTool -wfv -lower for every
+# SLEEF ISA (sse, avx, avx2, avx512, advsimd and the vla fallback) and every
+# accuracy level (RV_ACCURACY 5, 10, 35: the u05, u10 and u35 variants), then
+# linked with a timing driver and run over representative inputs. Reported are
+# the cycles per element of the scalar libm call and of the SLEEF variant and
+# the maximum ULP error observed against a long double reference. ISAs the
+# host can not execute are skipped.
+#
+# The results are the measured cost table of the call resolvers (see
+# SetMathCallCosts in include/rv/resolver/resolver.h): either a file for
+# RV_MATH_COSTS=<file> or src/resolver/mathCosts.gen.inc, the table compiled
+# into RV (cmake target rv-mathbench).
+#
+# usage: rv-mathbench.py [options]
+#
+# options:
+#   --rvtool <path>     rvTool binary (default: rvTool)
+#   --clang <path>      clang to build the drivers (default: clang)
+#   --resolver <file>   sleefResolver.cpp (default: next to this script)
+#   -o <file>           write a cost file for RV_MATH_COSTS=<file>
+#   --cpp <file>        write src/resolver/mathCosts.gen.inc
+#   -j <file>           write all measurements as JSON
+#   --isa <name>        only benchmark this ISA (repeatable)
+#   --func <name>       only benchmark this libm function (repeatable)
+#   -n <elems>          elements per input set (default 4096)
+#   -r <reps>           timed repetitions (default 200)
+
+import argparse
+import json
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+
+# ISA -> (triple, target-features, clang flags, float width, double width, /proc/cpuinfo flags)
+ISAS = {
+    "sse":     ("x86_64-unknown-linux-gnu", "+sse2,+sse4.1", ["-msse4.1"], 4, 2, ["sse4_1"]),
+    "avx":     ("x86_64-unknown-linux-gnu", "+sse2,+avx", ["-mavx"], 8, 4, ["avx"]),
+    "avx2":    ("x86_64-unknown-linux-gnu", "+sse2,+avx,+avx2,+fma", ["-mavx2", "-mfma"], 8, 4, ["avx2", "fma"]),
+    "avx512":  ("x86_64-unknown-linux-gnu", "+sse2,+avx,+avx2,+fma,+avx512f,+avx512dq",
+                ["-mavx512f", "-mavx512dq", "-mfma"], 16, 8, ["avx512f", "avx512dq"]),
+    "advsimd": ("aarch64-unknown-linux-gnu", "+neon", [], 4, 2, []),
+    # no target features: the scalar SLEEF implementations vectorized on the fly
+    "vla":     (None, None, [], 8, 4, []),
+}
+
+# RV_ACCURACY levels (tenth of ULP), one per SLEEF variant
+ACCURACIES = [5, 10, 35]
+
+# parameters of the functions that are not unary
+SIGNATURES = {
+    "atan2": "ff", "pow": "ff", "fmod": "ff", "hypot": "ff", "copysign": "ff", "fmax": "ff", "fmin": "ff",
+    "fdim": "ff", "nextafter": "ff", "fma": "fff",
+}
+
+# integer results, out-parameters and SLEEF functions without a libm counterpart
+UNSUPPORTED = {"ilogb", "modf", "frfrexp", "expfrexp"}
+
+# reference results (long double a0, a1, a2) other than the long double libm function
+REFERENCES = {"nextafter": "SCALAR(a0, a1)"}
+
+# input ranges per (double) function name, default [-100, 100]
+RANGES = {
+    "sin": (-10, 10), "cos": (-10, 10), "tan": (-10, 10),
+    "asin": (-1, 1), "acos": (-1, 1), "atanh": (-0.999, 0.999), "acosh": (1, 100),
+    "log": (1e-3, 1e3), "log2": (1e-3, 1e3), "log10": (1e-3, 1e3), "log1p": (-0.9, 100),
+    "exp": (-80, 80), "exp2": (-100, 100), "exp10": (-30, 30), "expm1": (-10, 10),
+    "sinh": (-80, 80), "cosh": (-80, 80), "tanh": (-10, 10),
+    "pow": (1e-2, 100), "erf": (-5, 5), "erfc": (-5, 5), "lgamma": (0.1, 30), "tgamma": (0.1, 30),
+    "sqrt": (0, 1e6), "cbrt": (-1e3, 1e3),
+}
+# second operand of the binary functions
+SECOND_RANGES = {"pow": (-5, 5)}
+
+def read_mappings(resolverFile):
+    with open(resolverFile) as f:
+        source = f.read()
+    source = re.sub(r'#if 0.*?#endif', '', source, flags=re.S)
+    source = source[source.find("InitSleefMappings("):]
+    source = source[:source.find("archMappings.insert")]
+
+    mappings = {} # libm name -> (SLEEF base name, is float)
+    pairs = re.findall(r'\{\s*"(\w+)"\s*,\s*"(x\w+)"\s*,\s*(\w+)\s*\}', source)
+    pairs += re.findall(r'ALSO_FINITE\(\s*(\w+)\s*,\s*(x\w+)\s*,\s*(\w+)\s*\)', source)
+    pairs += [(name, sleef, width) for name, _, sleef, width in
+              re.findall(r'ALSO_FINITE_ULP\(\s*(\w+)\s*,\s*(\w+)\s*,\s*(x\w+)\s*,\s*(\w+)\s*\)', source)]
+    for name, sleefName, width in pairs:
+        # aliases of the libm names
+        if name.startswith("llvm.") or name.startswith("__"):
+            continue
+        mappings[name] = (sleefName, width == "floatWidth")
+    return mappings
+
+def base_name(name, isFloat):
+    return name[:-1] if isFloat else name
+
+def host_isas():
+    machine = platform.machine()
+    flags = set()
+    if os.path.exists("/proc/cpuinfo"):
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("flags"):
+                    flags.update(line.split(":", 1)[1].split())
+                    break
+    usable = []
+    for isa, (triple, _, _, _, _, cpuFlags) in ISAS.items():
+        if triple is None:
+            usable.append(isa)
+        elif triple.startswith("x86_64") and machine == "x86_64" and all(flag in flags for flag in cpuFlags):
+            usable.append(isa)
+        elif triple.startswith("aarch64") and machine in ("aarch64", "arm64"):
+            usable.append(isa)
+    return usable
+
+def signature(name, isFloat):
+    kinds = SIGNATURES.get(base_name(name, isFloat), "f")
+    fpTy = "float" if isFloat else "double"
+    return [fpTy for kind in kinds], fpTy
+
+def write_kernel(path, name, isFloat, isa):
+    triple, features = ISAS[isa][0], ISAS[isa][1]
+    paramTys, fpTy = signature(name, isFloat)
+    params = ", ".join("{} %x{}".format(ty, i) for i, ty in enumerate(paramTys))
+    with open(path, "w") as f:
+        if triple:
+            f.write('target triple = "{}"\n\n'.format(triple))
+        f.write("declare {} @{}({}) nounwind readnone\n\n".format(fpTy, name, ", ".join(paramTys)))
+        f.write("define {} @foo({}) #0 {{\n".format(fpTy, params))
+        f.write("  %r = call {} @{}({})\n".format(fpTy, name, params))
+        f.write("  ret {} %r\n}}\n\n".format(fpTy))
+        f.write('attributes #0 = {{ nounwind "target-features"="{}" }}\n'.format(features or ""))
+
+# C driver: times the vector kernel foo_SIMD and the scalar libm call, checks against the long double reference
+DRIVER = r"""
+#define _GNU_SOURCE
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+static unsigned long long ticks(void) { return __rdtsc(); }
+#else
+// nanoseconds
+static unsigned long long ticks(void) {
+  struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+typedef FP vec __attribute__((vector_size(W * sizeof(FP))));
+vec foo_SIMD(PARAMS_VEC);
+static long double reference(PARAMS_REF) { return REF_EXPR; }
+
+// distance of res to ref in ulps of FP at ref, 1e9 for wrong infinities and NaNs
+static double ulp_error(FP res, long double ref) {
+  if (isnan(res) && isnan(ref)) return 0.0;
+  if ((long double) res == ref) return 0.0;
+  if (isnan(res) || isnan(ref) || isinf(res) || isinf(ref)) return 1e9;
+  FP mag = (FP) fabsl(ref);
+  if (isinf(mag)) mag = MAXV;
+  FP ulp = NEXTAFTER(mag, (FP) INFINITY) - mag;
+  if (isinf(ulp)) ulp = mag - NEXTAFTER(mag, (FP) 0);
+  if (ulp == 0) ulp = NEXTAFTER((FP) 0, (FP) 1);
+  return (double) (fabsl((long double) res - ref) / ulp);
+}
+
+int main(int argc, char ** argv) {
+  int n = atoi(argv[1]) / W * W, reps = atoi(argv[2]);
+  FP * out = malloc(n * sizeof(FP));
+  DECL_INPUTS
+  srand(42);
+  for (int i = 0; i < n; ++i) { INIT_INPUTS }
+
+  unsigned long long vecBest = ~0ull, scaBest = ~0ull;
+  for (int r = 0; r < reps; ++r) {
+    unsigned long long start = ticks();
+    for (int i = 0; i < n; i += W) {
+      LOAD_VECTORS
+      vec res = foo_SIMD(ARGS_VEC);
+      memcpy(out + i, &res, sizeof(vec));
+    }
+    unsigned long long vecTicks = ticks() - start;
+    if (vecTicks < vecBest) vecBest = vecTicks;
+  }
+  double maxULP = 0.0;
+  for (int i = 0; i < n; ++i) {
+    double err = ulp_error(out[i], reference(ARGS_REF));
+    if (err > maxULP) maxULP = err;
+  }
+  for (int r = 0; r < reps; ++r) {
+    unsigned long long start = ticks();
+    for (int i = 0; i < n; ++i) out[i] = SCALAR(ARGS_SCALAR);
+    __asm__ volatile("" :: "r"(out) : "memory");
+    unsigned long long scaTicks = ticks() - start;
+    if (scaTicks < scaBest) scaBest = scaTicks;
+  }
+  printf("%f %f %f\n", scaBest / (double) n, vecBest / (double) n, maxULP);
+  return 0;
+}
+"""
+
+def write_driver(path, name, isFloat, width):
+    paramTys, _ = signature(name, isFloat)
+    fp = "float" if isFloat else "double"
+    base = base_name(name, isFloat)
+    lo, hi = RANGES.get(base, (-100, 100))
+    cTys = [fp for _ in paramTys]
+    decl, init, load = [], [], []
+    for i, cTy in enumerate(cTys):
+        rlo, rhi = SECOND_RANGES.get(base, (lo, hi)) if i > 0 else (lo, hi)
+        decl.append("{0} * in{1} = malloc(n * sizeof({0}));".format(cTy, i))
+        init.append("in{0}[i] = ({1}) ({2!r} + ({3!r} - {2!r}) * (rand() / (double) RAND_MAX));".format(i, cTy, float(rlo), float(rhi)))
+        load.append("vec v{0}; memcpy(&v{0}, in{0} + i, sizeof(vec));".format(i))
+    refArgs = ", ".join("a{}".format(i) for i in range(len(cTys)))
+    text = DRIVER.replace("REF_EXPR", REFERENCES.get(base, "{}l({})".format(base, refArgs)))
+    subst = {
+        "FP": fp, "W": str(width), "SCALAR": name,
+        "NEXTAFTER": "nextafterf" if isFloat else "nextafter", "MAXV": "FLT_MAX" if isFloat else "DBL_MAX",
+        "PARAMS_VEC": ", ".join("vec" for _ in cTys),
+        "PARAMS_REF": ", ".join("long double a{}".format(i) for i in range(len(cTys))),
+        "DECL_INPUTS": " ".join(decl), "INIT_INPUTS": " ".join(init), "LOAD_VECTORS": " ".join(load),
+        "ARGS_VEC": ", ".join("v{}".format(i) for i in range(len(cTys))),
+        "ARGS_REF": ", ".join("in{}[i]".format(i) for i in range(len(cTys))),
+        "ARGS_SCALAR": ", ".join("in{}[i]".format(i) for i in range(len(cTys))),
+    }
+    for key in sorted(subst, key=len, reverse=True):
+        text = re.sub(r'\b{}\b'.format(key), subst[key], text)
+    with open(path, "w") as f:
+        f.write(text)
+
+def run(cmd, env=None):
+    return subprocess.run(cmd, env=env, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+
+# the SLEEF implementation rvTool linked into the vectorized kernel, None if the call was replicated
+def linked_impl(wfvFile, sleefName):
+    with open(wfvFile) as f:
+        text = f.read()
+    match = re.search(r'define [^@]*@\S*?({}(?:_u\d+)?)(?:_\w+)?\('.format(re.escape(sleefName)), text)
+    return match.group(1) if match else None
+
+def bench(args, workDir, name, sleefName, isFloat, isa):
+    width = ISAS[isa][3] if isFloat else ISAS[isa][4]
+    kernel = os.path.join(workDir, "kernel.ll")
+    write_kernel(kernel, name, isFloat, isa)
+    driver = os.path.join(workDir, "driver.c")
+    write_driver(driver, name, isFloat, width)
+    shapes = "_".join("T" for _ in signature(name, isFloat)[0]) + "rT"
+
+    results = []
+    seen = set()
+    for accuracy in ACCURACIES:
+        env = dict(os.environ, RV_ACCURACY=str(accuracy), RV_NO_RESOLVER_COSTS="1")
+        wfv = os.path.join(workDir, "kernel.wfv.ll")
+        proc = run([args.rvtool, "-wfv", "-lower", "-i", kernel, "-o", wfv, "-k", "foo", "-s", shapes, "-w", str(width)], env)
+        if proc.returncode != 0:
+            print("  {} {}: rvTool failed\n{}".format(isa, name, proc.stderr), file=sys.stderr)
+            continue
+        impl = linked_impl(wfv, sleefName)
+        if not impl or impl in seen:
+            continue
+        seen.add(impl)
+
+        binary = os.path.join(workDir, "bench")
+        proc = run([args.clang, "-O2", "-w"] + ISAS[isa][2] + [driver, wfv, "-lm", "-o", binary])
+        if proc.returncode != 0:
+            print("  {} {}: build failed\n{}".format(isa, impl, proc.stderr), file=sys.stderr)
+            continue
+        proc = run([binary, str(args.n), str(args.reps)])
+        if proc.returncode != 0:
+            print("  {} {}: run failed".format(isa, impl), file=sys.stderr)
+            continue
+        scalar, vector, maxULP = (float(v) for v in proc.stdout.split())
+        results.append({"isa": isa, "func": name, "impl": impl, "width": width,
+                        "scalar": scalar, "vector": vector, "max_ulp": maxULP})
+        print("  {:8} {:12} {:16} scalar {:8.2f} vector {:8.2f} /elem, max ulp {:.2f}".format(
+              isa, name, impl, scalar, vector, maxULP))
+    return results
+
+def write_costs(path, results):
+    with open(path, "w") as f:
+        f.write("# generated by rv-mathbench.py (cycles per element)\n")
+        f.write("# <isa> <impl> <scalar> <vector> <max ulp>\n")
+        for res in results:
+            f.write("{isa} {impl} {scalar:.3f} {vector:.3f} {max_ulp:.3f}\n".format(**res))
+
+def write_cpp(path, results, target):
+    lines = ['  {{"{isa}", "{impl}", {scalar:.3f}, {vector:.3f}, {max_ulp:.3f}}},'.format(**res) for res in results]
+    if not lines:
+        lines = ['  {"", "", 0.0, 0.0, 0.0},']
+    with open(path, "w") as f:
+        f.write("// generated by tools/rv-mathbench.py --cpp ({} measurements on {})\n".format(len(results), target))
+        f.write("// Cycles per element of the scalar libm call and of the SLEEF implementation on <isa>.\n\n")
+        f.write("static const MeasuredMathCost MeasuredMathCosts[] = {\n")
+        f.write("\n".join(lines) + "\n};\n")
+
+def main():
+    parser = argparse.ArgumentParser(description="benchmark the SLEEF mappings of RV")
+    parser.add_argument("--rvtool", default="rvTool")
+    parser.add_argument("--clang", default="clang")
+    parser.add_argument("--resolver", default=os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                           "..", "src", "resolver", "sleefResolver.cpp"))
+    parser.add_argument("-o", "--output")
+    parser.add_argument("--cpp")
+    parser.add_argument("-j", "--json")
+    parser.add_argument("--isa", action="append")
+    parser.add_argument("--func", action="append")
+    parser.add_argument("-n", type=int, default=4096)
+    parser.add_argument("-r", "--reps", type=int, default=200)
+    args = parser.parse_args()
+    if not args.output and not args.cpp and not args.json:
+        sys.exit("nothing to write (-o, --cpp and/or -j)")
+
+    mappings = read_mappings(args.resolver)
+    isas = [isa for isa in host_isas() if not args.isa or isa in args.isa]
+    print("{} functions, ISAs: {}".format(len(mappings), " ".join(isas)))
+
+    results = []
+    with tempfile.TemporaryDirectory(prefix="rv-mathbench") as workDir:
+        for isa in isas:
+            for name in sorted(mappings):
+                sleefName, isFloat = mappings[name]
+                if base_name(name, isFloat) in UNSUPPORTED or (args.func and name not in args.func):
+                    continue
+                results += bench(args, workDir, name, sleefName, isFloat, isa)
+
+    target = platform.machine()
+    if args.output:
+        write_costs(args.output, results)
+    if args.cpp:
+        write_cpp(args.cpp, results, target)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"target": target, "results": results}, f, indent=1)
+
+if __name__ == "__main__":
+    main()
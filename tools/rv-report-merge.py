@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Merge the JSON Lines decision records written by RV (RV_REPORT_JSON) across
+# translation units and summarize them per pass, decision and reason. The
+# metrics records of the vector code generator are summed up per counter.
+#
+# usage: rv-report-merge.py [--json] report.jsonl [report.jsonl ...]
+
+import json
+import sys
+from collections import Counter, defaultdict
+
+SCHEMA = 1
+
+def read_records(paths):
+    for path in paths:
+        with open(path) as f:
+            for lineNo, line in enumerate(f, 1):
+                line = line.strip()
+                if not line:
+                    continue
+                try:
+                    rec = json.loads(line)
+                except ValueError:
+                    sys.stderr.write("{}:{}: skipping malformed record\n".format(path, lineNo))
+                    continue
+                if rec.get("schema") != SCHEMA:
+                    sys.stderr.write("{}:{}: skipping record with unknown schema\n".format(path, lineNo))
+                    continue
+                yield rec
+
+def summarize(records):
+    decisions = Counter()
+    reasons = defaultdict(Counter)
+    widths = defaultdict(Counter)
+    metrics = defaultdict(Counter)
+    for rec in records:
+        # code quality counters of a vectorized function or loop
+        if rec.get("kind", "decision") == "metrics":
+            for name, value in rec["metrics"].items():
+                metrics[rec["pass"]][name] += value
+            continue
+        key = (rec["pass"], rec["decision"])
+        decisions[key] += 1
+        reasons[key][rec["reason"]] += 1
+        if rec["decision"] == "vectorized":
+            widths[rec["pass"]][rec.get("width", 0)] += 1
+    return decisions, reasons, widths, metrics
+
+def main(argv):
+    asJson = "--json" in argv
+    paths = [a for a in argv if a != "--json"]
+    if not paths:
+        sys.stderr.write("usage: rv-report-merge.py [--json] report.jsonl [report.jsonl ...]\n")
+        return 1
+
+    decisions, reasons, widths, metrics = summarize(read_records(paths))
+
+    if asJson:
+        out = defaultdict(dict)
+        for (passName, decision), count in sorted(decisions.items()):
+            out[passName][decision] = {"count": count, "reasons": dict(reasons[(passName, decision)])}
+        for passName, hist in widths.items():
+            out[passName]["widths"] = {str(w): n for w, n in sorted(hist.items())}
+        for passName, totals in metrics.items():
+            out[passName]["metrics"] = dict(totals)
+        json.dump(out, sys.stdout, indent=2, sort_keys=True)
+        sys.stdout.write("\n")
+        return 0
+
+    for (passName, decision), count in sorted(decisions.items()):
+        print("{} {}: {}".format(passName, decision, count))
+        for reason, n in reasons[(passName, decision)].most_common():
+            print("  {:<24} {}".format(reason, n))
+    for passName, hist in sorted(widths.items()):
+        print("{} vector widths: {}".format(passName, ", ".join("{}x{}".format(w, n) for w, n in sorted(hist.items()))))
+    for passName, totals in sorted(metrics.items()):
+        print("{} metrics:".format(passName))
+        for name, value in sorted(totals.items()):
+            if value:
+                print("  {:<24} {:g}".format(name, value))
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
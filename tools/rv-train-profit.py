@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+#
+# Fit the learned profitability model of RV (RV_PROFIT_MODEL, see
+# include/rv/analysis/profitModel.h) to measured speedups.
+#
+# Input are the JSON results of test/test_rv.py -p -j <file> (one file per
+# target machine, RVT_TARGET names the target). Every result carries the
+# static features of its region ("features", written by rvTool --predict) and
+# the measured speedup. The model is a gradient-boosted ensemble of regression
+# trees on the log of measured over analytic speedup (the "score" feature).
+#
+# usage: rv-train-profit.py [options] results.json [results.json ...]
+#
+# options:
+#   -o <file>          write a model file for RV_PROFIT_MODEL=<file>
+#   --cpp <file>       write src/analysis/profitModel.gen.inc (RV_PROFIT_MODEL=builtin)
+#   --target <name>    only use the results of this target (default: all)
+#   --trees <n>        number of trees (default 50)
+#   --depth <n>        maximum tree depth (default 3)
+#   --rate <x>         learning rate (default 0.1)
+#   --min-leaf <n>     minimum samples per leaf (default 3)
+
+import argparse
+import json
+import math
+import sys
+
+# same order as ProfitFeature (include/rv/analysis/profitModel.h)
+FEATURES = [
+    "width", "score", "code_growth", "replication_share", "gather_scatter_share", "cascade_share", "blend_share",
+    "mask_share", "num_instructions", "varying_share", "divergent_branches", "masked_block_share",
+    "uniform_mem_share", "contiguous_mem_share", "varying_mem_share", "boscc", "cif", "gathers"
+]
+
+class Node:
+    def __init__(self, value=0.0, feature=None, threshold=0.0, left=None, right=None):
+        self.value = value
+        self.feature = feature # None for leaves
+        self.threshold = threshold
+        self.left = left
+        self.right = right
+
+def read_samples(paths, target):
+    samples = [] # (feature vector, log(measured / analytic))
+    for resPath in paths:
+        with open(resPath) as f:
+            data = json.load(f)
+        if target and data.get("target", "unknown") != target:
+            continue
+        for res in data["results"]:
+            features = res.get("features")
+            measured = res.get("speedup")
+            if not features or not measured or measured <= 0:
+                continue
+            analytic = features.get("score", 0) / 100.0
+            if analytic <= 0:
+                continue
+            samples.append(([float(features.get(name, 0.0)) for name in FEATURES], math.log(measured / analytic)))
+    return samples
+
+def sse(values):
+    if not values:
+        return 0.0
+    mean = sum(values) / len(values)
+    return sum((v - mean) ** 2 for v in values)
+
+def best_split(rows, residuals, minLeaf):
+    best = None # (sse, feature, threshold)
+    for feature in range(len(FEATURES)):
+        order = sorted(range(len(rows)), key=lambda i: rows[i][feature])
+        for pos in range(minLeaf, len(order) - minLeaf + 1):
+            lo = rows[order[pos - 1]][feature]
+            hi = rows[order[pos]][feature] if pos < len(order) else None
+            if hi is None or lo == hi:
+                continue
+            left = [residuals[i] for i in order[:pos]]
+            right = [residuals[i] for i in order[pos:]]
+            cost = sse(left) + sse(right)
+            if best is None or cost < best[0]:
+                best = (cost, feature, (lo + hi) / 2.0)
+    return best
+
+def fit_tree(rows, residuals, depth, minLeaf, rate):
+    mean = sum(residuals) / len(residuals)
+    if depth == 0 or len(rows) < 2 * minLeaf:
+        return Node(rate * mean)
+    split = best_split(rows, residuals, minLeaf)
+    if split is None or sse(residuals) - split[0] < 1e-9 * len(rows):
+        return Node(rate * mean)
+    _, feature, threshold = split
+    leftIdx = [i for i in range(len(rows)) if rows[i][feature] < threshold]
+    rightIdx = [i for i in range(len(rows)) if rows[i][feature] >= threshold]
+    left = fit_tree([rows[i] for i in leftIdx], [residuals[i] for i in leftIdx], depth - 1, minLeaf, rate)
+    right = fit_tree([rows[i] for i in rightIdx], [residuals[i] for i in rightIdx], depth - 1, minLeaf, rate)
+    return Node(feature=feature, threshold=threshold, left=left, right=right)
+
+def predict(tree, row):
+    while tree.feature is not None:
+        tree = tree.left if row[tree.feature] < tree.threshold else tree.right
+    return tree.value
+
+def fit(samples, args):
+    rows = [row for row, _ in samples]
+    targets = [y for _, y in samples]
+    predictions = [0.0] * len(samples)
+    trees = []
+    for _ in range(args.trees):
+        residuals = [y - p for y, p in zip(targets, predictions)]
+        tree = fit_tree(rows, residuals, args.depth, args.minLeaf, args.rate)
+        trees.append(tree)
+        predictions = [p + predict(tree, row) for p, row in zip(predictions, rows)]
+    return trees, predictions
+
+# the nodes of @tree in pre-order, root first
+def flatten(tree):
+    nodes = []
+    def visit(node):
+        idx = len(nodes)
+        nodes.append(node)
+        if node.feature is not None:
+            node.leftId = visit(node.left)
+            node.rightId = visit(node.right)
+        return idx
+    visit(tree)
+    return nodes
+
+def write_model(path, trees, target):
+    with open(path, "w") as f:
+        f.write("# generated by rv-train-profit.py\n")
+        f.write("target {}\n".format(target or "any"))
+        for tree in trees:
+            f.write("tree\n")
+            for idx, node in enumerate(flatten(tree)):
+                if node.feature is None:
+                    f.write("leaf {} {!r}\n".format(idx, node.value))
+                else:
+                    f.write("node {} {} {!r} {} {}\n".format(idx, FEATURES[node.feature], node.threshold, node.leftId, node.rightId))
+
+def write_cpp(path, trees, target, numSamples):
+    nodeLines = []
+    roots = []
+    for tree in trees:
+        base = len(nodeLines)
+        roots.append(base)
+        for node in flatten(tree):
+            if node.feature is None:
+                nodeLines.append("  {{-1, 0.0, -1, -1, {!r}}},".format(node.value))
+            else:
+                nodeLines.append("  {{{}, {!r}, {}, {}, 0.0}},".format(node.feature, node.threshold, base + node.leftId, base + node.rightId))
+    if not trees:
+        nodeLines.append("  {-1, 0.0, -1, -1, 0.0},")
+        roots.append(-1)
+    with open(path, "w") as f:
+        f.write("// generated by tools/rv-train-profit.py --cpp ({} training samples)\n".format(numSamples))
+        f.write("// The sum of the leaves of all trees is log(measured / analytic speedup).\n\n")
+        f.write("static const char * BuiltinProfitTarget = \"{}\";\n\n".format(target or "any"))
+        f.write("static const ProfitNode BuiltinProfitNodes[] = {\n")
+        f.write("\n".join(nodeLines) + "\n};\n\n")
+        f.write("static const int BuiltinProfitRoots[] = {\n")
+        f.write("  " + ", ".join(str(root) for root in roots) + ",\n};\n")
+
+def rms(values):
+    return math.sqrt(sum(v * v for v in values) / len(values)) if values else 0.0
+
+def main():
+    parser = argparse.ArgumentParser(description="fit the RV profitability model")
+    parser.add_argument("results", nargs="+")
+    parser.add_argument("-o", "--output")
+    parser.add_argument("--cpp")
+    parser.add_argument("--target")
+    parser.add_argument("--trees", type=int, default=50)
+    parser.add_argument("--depth", type=int, default=3)
+    parser.add_argument("--rate", type=float, default=0.1)
+    parser.add_argument("--min-leaf", dest="minLeaf", type=int, default=3)
+    args = parser.parse_args()
+    if not args.output and not args.cpp:
+        sys.exit("nothing to write (-o and/or --cpp)")
+
+    samples = read_samples(args.results, args.target)
+    if not samples:
+        print("no results with features, writing an empty model")
+        trees = []
+    else:
+        trees, predictions = fit(samples, args)
+        before = rms([y for _, y in samples])
+        after = rms([y - p for (_, y), p in zip(samples, predictions)])
+        print("{} samples, rms log error {:.3f} (analytic) -> {:.3f} (model)".format(len(samples), before, after))
+
+    if args.output:
+        write_model(args.output, trees, args.target)
+    if args.cpp:
+        write_cpp(args.cpp, trees, args.target, len(samples))
+
+if __name__ == "__main__":
+    main()
@@ -7,9 +7,14 @@
 
 #include "rvTool.h"
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
@@ -34,9 +39,23 @@
 #include "llvm/Transforms/Utils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Support/Compiler.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 #include "ArgumentReader.h"
 
 #include "rv/passes.h"
@@ -45,6 +64,7 @@
 #include "rv/rvDebug.h"
 #include "rv/utils.h"
 #include "rv/vectorMapping.h"
+#include "rv/vectorizerSession.h"
 #include "rv/passes/PassManagerSession.h"
 
 #include "rv/region/FunctionRegion.h"
@@ -53,6 +73,8 @@
 #include "rv/vectorizationInfo.h"
 
 #include "rv/analysis/UndeadMaskAnalysis.h"
+#include "rv/analysis/costModel.h"
+#include "rv/analysis/profitModel.h"
 #include "rv/analysis/reductionAnalysis.h"
 #include "rv/passes/loopExitCanonicalizer.h"
 #include "rv/transform/remTransform.h"
@@ -60,14 +82,19 @@
 
 using namespace llvm;
 
+// per-entry options are thread_local, batch entries run concurrently (-batch)
 #define ValidAnalysisString "da|udm"
-static std::string PrintAnalysis = "";
+static thread_local std::string PrintAnalysis = "";
 
 static bool AnalyzeOnly() { return !PrintAnalysis.empty(); }
 
 static bool PrintOnlyDA() { return PrintAnalysis == "da"; }
 static bool PrintOnlyUDM() { return PrintAnalysis == "udm"; }
 
+// append the cost model prediction of every vectorized region to this file (--predict)
+static thread_local std::string PredictFile = "";
+static std::mutex PredictFileLock;
+
 static bool HasValidAnalysisSetting() {
   return !AnalyzeOnly() || PrintOnlyDA() | PrintOnlyUDM();
 }
@@ -82,13 +109,18 @@ static const char STRIDEDCHAR = 'S';
 static const char VARCHAR = 'T';
 
 // be verbose (rvTool level only)
-static bool verbose = false;
+static thread_local bool verbose = false;
 #define IF_VERBOSE if (verbose)
 
+// manifest line of the batch entry on this thread (nullptr: single mode)
+static thread_local const std::string *BatchEntry = nullptr;
+
 [[noreturn]] static void fail();
 
 static void fail() {
   std::cerr << '\n';
+  if (BatchEntry)
+    std::cerr << "in batch entry: " << *BatchEntry << '\n';
   assert(false);
   exit(-1);
 }
@@ -98,11 +130,72 @@ template <class... Args> static void fail(std::string arg, Args... rest) {
   fail(rest...);
 }
 
-Module *createModuleFromFile(const std::string &fileName,
-                             LLVMContext &context) {
+// batch mode reads every input file once and parses it per entry
+static bool UseInputCache = false;
+static std::mutex InputCacheLock;
+static StringMap<std::unique_ptr<MemoryBuffer>> InputCache;
+
+static std::unique_ptr<Module> createModuleFromFile(const std::string &fileName,
+                                                    LLVMContext &context) {
   SMDiagnostic diag;
-  auto modPtr = llvm::parseIRFile(fileName, diag, context);
-  return modPtr.release();
+  if (!UseInputCache)
+    return llvm::parseIRFile(fileName, diag, context);
+
+  MemoryBufferRef inputRef;
+  {
+    std::lock_guard<std::mutex> guard(InputCacheLock);
+    auto &inputBuffer = InputCache[fileName];
+    if (!inputBuffer) {
+      auto bufferOrErr = MemoryBuffer::getFileOrSTDIN(fileName);
+      if (!bufferOrErr)
+        return nullptr;
+      inputBuffer = std::move(*bufferOrErr);
+    }
+    inputRef = inputBuffer->getMemBufferRef();
+  }
+  return llvm::parseIR(inputRef, diag, context);
+}
+
+// append the predicted speedup of \p vecInfo (after VA) to PredictFile as one JSON line
+static void writePrediction(rv::PlatformInfo &platInfo, rv::Config &config,
+                            const rv::VectorizationInfo &vecInfo,
+                            const char *mode) {
+  if (PredictFile.empty())
+    return;
+
+  rv::CostModel costModel(platInfo, config, vecInfo);
+  rv::RegionCost cost = costModel.estimateRegionCost();
+
+  std::lock_guard<std::mutex> guard(PredictFileLock);
+  std::error_code EC;
+  raw_fd_ostream out(PredictFile, EC, sys::fs::OF_Append);
+  if (EC)
+    fail("could not open " + PredictFile + ": " + EC.message());
+
+  json::OStream J(out);
+  J.object([&] {
+    J.attribute("function", vecInfo.getScalarFunction().getName());
+    J.attribute("mode", mode);
+    J.attribute("width", (int64_t)vecInfo.getVectorWidth());
+    J.attribute("scalar_cost", cost.scalarCost);
+    J.attribute("vector_cost", cost.vectorCost);
+    J.attribute("predicted_speedup", cost.vectorCost > 0.0 ? cost.scalarCost / cost.vectorCost : 0.0);
+    J.attribute("replication_cost", cost.replicationCost);
+    J.attribute("gather_scatter_cost", cost.gatherScatterCost);
+    J.attribute("cascade_cost", cost.cascadeCost);
+    J.attribute("blend_cost", cost.blendCost);
+    J.attribute("mask_cost", cost.maskCost);
+
+    // training input of tools/rv-train-profit.py
+    rv::ProfitFeatures features = rv::ProfitFeatures::Collect(vecInfo, cost, config);
+    J.attributeObject("features", [&] {
+      for (int i = 0; i < (int)rv::ProfitFeature::NumFeatures; ++i)
+        J.attribute(rv::ProfitFeatures::GetName((rv::ProfitFeature)i), features.values[i]);
+    });
+    if (const rv::ProfitModel *model = rv::ProfitModel::get())
+      J.attribute("model_speedup", model->predictScore(features) / 100.0);
+  });
+  out << "\n";
 }
 
 void writeModuleToFile(Module *mod, const std::string &fileName) {
@@ -246,12 +339,14 @@ void vectorizeLoop(Function &parentFn, Loop &TheLoop, unsigned vectorWidth,
     // Expand all block masks and show which block masks are considered 'undead'
     // (never all false).
     rv::UndeadMaskAnalysis UDM(vecInfo, FAM);
-    rv::MaskExpander maskEx(vecInfo, FAM);
+    rv::MaskExpander maskEx(config, vecInfo, FAM);
     maskEx.expandRegionMasks();
     UDM.print(outs());
     return;
   }
 
+  writePrediction(platInfo, config, vecInfo, "loopvec");
+
   // control conversion
   vectorizer.linearize(vecInfo, FAM);
   // if (!maskEx) fail("mask generation failed.");
@@ -434,12 +529,14 @@ void vectorizeFunction(rv::VectorMapping &vectorizerJob, ShapeMap extraShapes,
     // Expand all block masks and show which block masks are considered 'undead'
     // (never all false).
     rv::UndeadMaskAnalysis UDM(vecInfo, PMS.FAM);
-    rv::MaskExpander maskEx(vecInfo, PMS.FAM);
+    rv::MaskExpander maskEx(config, vecInfo, PMS.FAM);
     maskEx.expandRegionMasks();
     UDM.print(outs());
     return;
   }
 
+  writePrediction(platInfo, config, vecInfo, "wfv");
+
   // mask generator
   vectorizer.linearize(vecInfo, PMS.FAM);
   // if (!maskEx) fail("mask generation failed.");
@@ -523,6 +620,44 @@ rv::VectorShape decodeShape(std::stringstream &shapestream) {
   abort();
 }
 
+// argument and result shapes of \p scalarFn (-s, uniform arguments by default)
+static void readShapes(ArgumentReader &reader, Function &scalarFn,
+                       rv::VectorShapeVec &argShapes, rv::VectorShape &resShape) {
+  std::string shapeText;
+  if (reader.readOption<std::string>("-s", shapeText)) {
+    std::stringstream shapestream(shapeText);
+    // allow functions without arguments
+    if (shapestream.peek() != 'r') {
+      readList<>(LISTSEPERATOR, shapestream,
+                 [&argShapes](decltype(shapestream) &in) {
+                   argShapes.push_back(decodeShape(in));
+                 });
+    }
+
+    // fail on excessive specification
+    if (argShapes.size() > scalarFn.arg_size()) {
+      fail("too many arg shapes specified");
+    }
+
+    // pad with uniform shapes
+    while (argShapes.size() < scalarFn.arg_size()) {
+      argShapes.push_back(rv::VectorShape::uni());
+    }
+
+    if (shapestream.peek() != EOF) { // return shape
+      if (shapestream.get() != RETURNSHAPESEPERATOR)
+        fail("expected return shape");
+      resShape = decodeShape(shapestream);
+    }
+
+  } else {
+    for (auto &it : scalarFn.args()) {
+      (void)it;
+      argShapes.push_back(rv::VectorShape::uni());
+    }
+  }
+}
+
 static void PrintHelp() {
   std::cerr
       << "RV command line tool (rvTool)\n"
@@ -551,12 +686,23 @@ static void PrintHelp() {
       << "-x GVSHAPES        : comma-separated list of global value and "
          "function-return shapes, e.g. \"gvar=C,func=S4\".\n"
       << "-w WIDTH           : vectorization factor.\n"
-      << "-v                 : enable verbose output (rvTool level output).\n";
+      << "--predict FILE     : append the cost model prediction (JSON line) to FILE.\n"
+      << "-v                 : enable verbose output (rvTool level output).\n"
+      << "\nBatch mode:\n"
+      << "-batch MANIFEST    : run the rvTool command lines in MANIFEST (one per line, "
+         "'#' comments), every entry needs -o.\n"
+      << "-j THREADS         : worker threads for -batch (0: one per hardware thread, default 1).\n"
+      << "--batch-stats FILE : write the status and time of every batch entry to FILE (JSON lines).\n"
+      << "\nCompile server:\n"
+      << "-serve SOCKET      : vectorize the requests of clients on the Unix socket SOCKET "
+         "(-wfv with warm sessions per configuration, -loopvec).\n"
+      << "-j THREADS         : requests served concurrently by -serve (0: one per hardware thread, default).\n"
+      << "-connect SOCKET    : send this command line (with -i and -o) to the server at SOCKET.\n"
+      << "--report FILE      : (-connect) append the report records of the request to FILE (JSON lines).\n";
 }
 
-int main(int argc, char **argv) {
-  ArgumentReader reader(argc, argv);
-
+// run one rvTool command line on a module in \p context
+static int runTool(ArgumentReader &reader, LLVMContext &context) {
   // verbose debug output (rvTool level)
   verbose = reader.hasOption("-v");
 
@@ -567,6 +713,7 @@ int main(int argc, char **argv) {
   bool hasKernelName = reader.readOption<std::string>("-k", kernelName);
 
   PrintAnalysis = reader.getOption<std::string>("-analyze", "");
+  reader.readOption<std::string>("--predict", PredictFile);
   if (!HasValidAnalysisSetting()) {
     errs() << "Invalid setting for '-analyze', expected " ValidAnalysisString
               ".\n";
@@ -600,10 +747,15 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  LLVMContext context;
+  // batch entries can not share stdout
+  if (BatchEntry && (!hasOutFile || AnalyzeOnly())) {
+    errs() << "batch entries need -o and can not use -analyze: " << *BatchEntry << "\n";
+    return -1;
+  }
 
   // Load module
-  llvm::Module *mod = createModuleFromFile(inFile, context);
+  std::unique_ptr<Module> modOwner = createModuleFromFile(inFile, context);
+  llvm::Module *mod = modOwner.get();
   if (!mod) {
     errs() << "Could not load module " << inFile << ". Aborting!\n";
     return 1;
@@ -667,39 +819,7 @@ int main(int argc, char **argv) {
 
     rv::VectorShape resShape;
     rv::VectorShapeVec argShapes;
-    std::string shapeText;
-    if (reader.readOption<std::string>("-s", shapeText)) {
-      std::stringstream shapestream(shapeText);
-      // allow functions without arguments
-      if (shapestream.peek() != 'r') {
-        readList<>(LISTSEPERATOR, shapestream,
-                   [&argShapes](decltype(shapestream) &in) {
-                     argShapes.push_back(decodeShape(in));
-                   });
-      }
-
-      // fail on excessive specification
-      if (argShapes.size() > scalarFn->arg_size()) {
-        fail("too many arg shapes specified");
-      }
-
-      // pad with uniform shapes
-      while (argShapes.size() < scalarFn->arg_size()) {
-        argShapes.push_back(rv::VectorShape::uni());
-      }
-
-      if (shapestream.peek() != EOF) { // return shape
-        if (shapestream.get() != RETURNSHAPESEPERATOR)
-          fail("expected return shape");
-        resShape = decodeShape(shapestream);
-      }
-
-    } else {
-      for (auto &it : scalarFn->args()) {
-        (void)it;
-        argShapes.push_back(rv::VectorShape::uni());
-      }
-    }
+    readShapes(reader, *scalarFn, argShapes, resShape);
 
     unsigned vectorWidth = reader.getOption<unsigned>("-w", 8);
 
@@ -764,3 +884,511 @@ int main(int argc, char **argv) {
 
   return 0;
 }
+
+struct BatchEntryResult {
+  int status = 0;
+  double wallMs = 0.0;
+};
+
+// split a manifest line into an argv for ArgumentReader (argv[0] is the tool name)
+static std::vector<std::string> SplitCommandLine(const std::string &line) {
+  std::vector<std::string> args = {"rvTool"};
+  std::istringstream lineStream(line);
+  std::string arg;
+  while (lineStream >> arg)
+    args.push_back(arg);
+  return args;
+}
+
+// -batch MANIFEST [-j THREADS] [--batch-stats FILE]
+// Every worker keeps its LLVMContext (and the SLEEF modules parsed into it)
+// across entries, input files are read once.
+static int runBatch(ArgumentReader &reader) {
+  std::string manifestFile = reader.getOption<std::string>("-batch", "");
+  std::string statsFile = reader.getOption<std::string>("--batch-stats", "");
+  unsigned numThreads = reader.getOption<unsigned>("-j", 1);
+  if (numThreads == 0)
+    numThreads = hardware_concurrency().compute_thread_count();
+
+  std::ifstream manifest(manifestFile);
+  if (!manifest) {
+    errs() << "Could not open batch manifest " << manifestFile << ". Aborting!\n";
+    return 1;
+  }
+
+  std::vector<std::string> entries;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    auto start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+    entries.push_back(line.substr(start));
+  }
+  if (entries.empty()) {
+    errs() << "Empty batch manifest " << manifestFile << ".\n";
+    return 1;
+  }
+
+  UseInputCache = true;
+  numThreads = std::min<size_t>(numThreads, entries.size());
+
+  std::vector<BatchEntryResult> results(entries.size());
+  std::atomic<size_t> nextEntry(0);
+  auto batchStart = std::chrono::steady_clock::now();
+
+  auto runWorker = [&] {
+    LLVMContext workerCtx;
+    // the SLEEF modules parsed into workerCtx stay loaded across entries (released before workerCtx)
+    auto vecmathHandle = rv::retainSleefModules(workerCtx);
+    for (size_t entryIdx = nextEntry++; entryIdx < entries.size(); entryIdx = nextEntry++) {
+      std::vector<std::string> args = SplitCommandLine(entries[entryIdx]);
+      std::vector<char *> argv;
+      for (auto &arg : args)
+        argv.push_back(&arg[0]);
+      ArgumentReader entryReader(argv.size(), argv.data());
+
+      BatchEntry = &entries[entryIdx];
+      auto entryStart = std::chrono::steady_clock::now();
+      results[entryIdx].status = runTool(entryReader, workerCtx);
+      results[entryIdx].wallMs =
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entryStart).count();
+      BatchEntry = nullptr;
+    }
+    rv::releaseSleefModules(workerCtx);
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < numThreads; ++i)
+    workers.emplace_back(runWorker);
+  runWorker();
+  for (auto &worker : workers)
+    worker.join();
+
+  double batchMs =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchStart).count();
+
+  // aggregate statistics
+  size_t numFailed = 0;
+  double sumMs = 0.0, maxMs = 0.0;
+  size_t slowestIdx = 0;
+  for (size_t entryIdx = 0; entryIdx < results.size(); ++entryIdx) {
+    auto &res = results[entryIdx];
+    if (res.status != 0) {
+      ++numFailed;
+      errs() << "batch entry " << entryIdx << " failed (" << res.status << "): " << entries[entryIdx] << "\n";
+    }
+    sumMs += res.wallMs;
+    if (res.wallMs > maxMs) {
+      maxMs = res.wallMs;
+      slowestIdx = entryIdx;
+    }
+  }
+
+  errs() << "rvTool batch: " << entries.size() << " entries (" << numFailed << " failed) on " << numThreads
+         << " threads in " << format("%.1f", batchMs) << " ms, " << format("%.1f", sumMs / entries.size())
+         << " ms per entry, slowest " << format("%.1f", maxMs) << " ms: " << entries[slowestIdx] << "\n";
+
+  if (!statsFile.empty()) {
+    std::error_code EC;
+    raw_fd_ostream out(statsFile, EC, sys::fs::OF_None);
+    if (EC) {
+      errs() << "could not open " << statsFile << ": " << EC.message() << "\n";
+      return 1;
+    }
+    for (size_t entryIdx = 0; entryIdx < results.size(); ++entryIdx) {
+      json::OStream J(out);
+      J.object([&] {
+        J.attribute("entry", (int64_t)entryIdx);
+        J.attribute("command", entries[entryIdx]);
+        J.attribute("status", (int64_t)results[entryIdx].status);
+        J.attribute("wall_ms", results[entryIdx].wallMs);
+      });
+      out << "\n";
+    }
+  }
+
+  return numFailed > 0 ? 1 : 0;
+}
+
+// Compile server (-serve) and its client (-connect).
+// Every message is a sequence of frames (4 byte little endian length, payload):
+//   request:  command line (rvTool options without -i/-o), input module (bitcode or textual IR)
+//   response: status (JSON object), output module (bitcode, empty on errors),
+//             report (the RV_REPORT_JSON records of the request, JSON lines)
+// A connection may carry any number of requests, one after the other.
+#ifdef LLVM_ON_UNIX
+static const uint32_t MaxFrameSize = 1u << 30;
+
+static bool ReadAll(int fd, char *data, size_t len) {
+  while (len > 0) {
+    ssize_t numRead = ::recv(fd, data, len, 0);
+    if (numRead < 0 && errno == EINTR)
+      continue;
+    if (numRead <= 0)
+      return false;
+    data += numRead;
+    len -= numRead;
+  }
+  return true;
+}
+
+static bool WriteAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t numWritten = ::send(fd, data, len, MSG_NOSIGNAL);
+    if (numWritten < 0 && errno == EINTR)
+      continue;
+    if (numWritten <= 0)
+      return false;
+    data += numWritten;
+    len -= numWritten;
+  }
+  return true;
+}
+
+static bool ReadFrame(int fd, std::string &frame) {
+  unsigned char header[4];
+  if (!ReadAll(fd, reinterpret_cast<char *>(header), 4))
+    return false;
+  uint32_t len = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+  if (len > MaxFrameSize)
+    return false;
+  frame.resize(len);
+  return len == 0 || ReadAll(fd, &frame[0], len);
+}
+
+static bool WriteFrame(int fd, StringRef payload) {
+  uint32_t len = payload.size();
+  unsigned char header[4] = {(unsigned char)len, (unsigned char)(len >> 8), (unsigned char)(len >> 16),
+                             (unsigned char)(len >> 24)};
+  return WriteAll(fd, reinterpret_cast<const char *>(header), 4) && WriteAll(fd, payload.data(), payload.size());
+}
+
+static bool MakeSocketAddress(const std::string &socketPath, sockaddr_un &addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socketPath.empty() || socketPath.size() >= sizeof(addr.sun_path)) {
+    errs() << "invalid socket path '" << socketPath << "'\n";
+    return false;
+  }
+  std::strcpy(addr.sun_path, socketPath.c_str());
+  return true;
+}
+
+// A server worker keeps its LLVMContext (and the SLEEF modules parsed into it)
+// and one VectorizerSession per configuration across requests.
+struct ServerWorker {
+  LLVMContext context;
+  std::map<std::string, std::unique_ptr<rv::VectorizerSession>> sessions;
+
+  ~ServerWorker() {
+    sessions.clear();
+    rv::releaseSleefModules(context);
+  }
+};
+
+// vectorize \p input as \p commandLine asks, the vectorized module goes to \p output (bitcode)
+static int serveRequest(ServerWorker &worker, const std::string &commandLine, StringRef input,
+                        SmallVectorImpl<char> &output) {
+  std::vector<std::string> args = SplitCommandLine(commandLine);
+  std::vector<char *> argv;
+  for (auto &arg : args)
+    argv.push_back(&arg[0]);
+  ArgumentReader reader(argv.size(), argv.data());
+
+  for (const char *unsupported : {"-i", "-o", "-analyze", "-normalize", "-x", "--predict"}) {
+    if (reader.hasOption(unsupported)) {
+      errs() << "rvTool server: " << unsupported << " is not supported in requests: " << commandLine << "\n";
+      return 1;
+    }
+  }
+
+  SMDiagnostic diag;
+  std::unique_ptr<Module> mod = parseIR(MemoryBufferRef(input, "request"), diag, worker.context);
+  if (!mod) {
+    diag.print("rvTool server", errs());
+    return 1;
+  }
+  if (verifyModule(*mod, &errs())) {
+    errs() << "Broken module!\n";
+    return 1;
+  }
+
+  std::string kernelName;
+  if (!reader.readOption<std::string>("-k", kernelName)) {
+    errs() << "kernel name argument missing!\n";
+    return 1;
+  }
+  Function *scalarFn = mod->getFunction(kernelName);
+  if (!scalarFn)
+    return 2;
+
+  unsigned vectorWidth = reader.getOption<unsigned>("-w", 8);
+  int ulpErrorBound = 10;
+  reader.readOption<int>("--math-prec", ulpErrorBound);
+
+  if (reader.hasOption("-wfv")) {
+    rv::VectorShape resShape;
+    rv::VectorShapeVec argShapes;
+    readShapes(reader, *scalarFn, argShapes, resShape);
+    int maskPos = -1;
+    reader.readOption<int>("-m", maskPos);
+    std::string targetDeclName;
+    bool hasTargetDeclName = reader.readOption<std::string>("-t", targetDeclName);
+
+    // warm session of this configuration
+    auto config = rv::Config::createForFunction(*scalarFn);
+    config.maxULPErrorBound = ulpErrorBound;
+    std::string configKey;
+    raw_string_ostream keyStream(configKey);
+    config.print(keyStream);
+    auto &session = worker.sessions[keyStream.str()];
+    if (!session)
+      session = std::make_unique<rv::VectorizerSession>(config);
+    session->attach(*mod);
+
+    Function *vectorFn = hasTargetDeclName ? mod->getFunction(targetDeclName) : nullptr;
+    if (!vectorFn) {
+      vectorFn = rv::createVectorDeclaration(*scalarFn, resShape, argShapes, vectorWidth, maskPos);
+      vectorFn->copyAttributesFrom(scalarFn);
+      if (hasTargetDeclName)
+        vectorFn->setName(targetDeclName);
+      else
+        vectorFn->setName(session->getPlatformInfo().createMangledVectorName(scalarFn->getName(), argShapes,
+                                                                             vectorWidth, maskPos));
+    }
+
+    auto predMode = maskPos >= 0 ? rv::CallPredicateMode::PredicateArg
+                                 : rv::CallPredicateMode::SafeWithoutPredicate;
+    rv::VectorMapping vectorizerJob(scalarFn, vectorFn, vectorWidth, maskPos, resShape, argShapes, predMode);
+    bool vectorizeOk = session->vectorizeFunction(vectorizerJob);
+    session->detach();
+    if (!vectorizeOk)
+      return 3;
+
+  } else if (reader.hasOption("-loopvec")) {
+    vectorizeFirstLoop(*scalarFn, vectorWidth, ulpErrorBound);
+  } else {
+    errs() << "rvTool server: requests need -wfv or -loopvec: " << commandLine << "\n";
+    return 1;
+  }
+
+  if (reader.hasOption("-lower-func"))
+    rv::lowerIntrinsics(*scalarFn);
+  else if (reader.hasOption("-lower"))
+    rv::lowerIntrinsics(*mod);
+
+  raw_svector_ostream outStream(output);
+  WriteBitcodeToFile(*mod, outStream);
+  return 0;
+}
+
+// -serve SOCKET [-j THREADS]
+// Every worker thread accepts one connection at a time and serves its requests.
+static int runServer(ArgumentReader &reader) {
+  std::string socketPath = reader.getOption<std::string>("-serve", "");
+  unsigned numThreads = reader.getOption<unsigned>("-j", 0);
+  if (numThreads == 0)
+    numThreads = hardware_concurrency().compute_thread_count();
+
+  sockaddr_un addr;
+  if (!MakeSocketAddress(socketPath, addr))
+    return 1;
+  int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0) {
+    errs() << "could not create a socket: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  // a stale socket of a previous server, never any other file
+  struct stat st;
+  if (::lstat(socketPath.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      errs() << "could not listen on " << socketPath << ": the path exists and is not a socket\n";
+      ::close(listenFd);
+      return 1;
+    }
+    ::unlink(socketPath.c_str());
+  }
+  if (::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, 128) != 0) {
+    errs() << "could not listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+    ::close(listenFd);
+    return 1;
+  }
+  errs() << "rvTool server: listening on " << socketPath << " with " << numThreads << " workers\n";
+
+  auto runWorker = [&] {
+    ServerWorker worker;
+    while (true) {
+      int clientFd = ::accept(listenFd, nullptr, nullptr);
+      if (clientFd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        errs() << "rvTool server: accept failed: " << std::strerror(errno) << "\n";
+        return;
+      }
+
+      std::string commandLine, input;
+      while (ReadFrame(clientFd, commandLine) && ReadFrame(clientFd, input)) {
+        std::string report;
+        raw_string_ostream reportStream(report);
+        SmallVector<char, 0> output;
+
+        auto requestStart = std::chrono::steady_clock::now();
+        rv::SetThreadReportStream(&reportStream);
+        int status = serveRequest(worker, commandLine, input, output);
+        rv::SetThreadReportStream(nullptr);
+        double wallMs =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requestStart).count();
+        if (status != 0)
+          output.clear();
+
+        std::string header;
+        raw_string_ostream headerStream(header);
+        {
+          json::OStream J(headerStream);
+          J.object([&] {
+            J.attribute("status", (int64_t)status);
+            J.attribute("wall_ms", wallMs);
+            J.attribute("sessions", (int64_t)worker.sessions.size());
+          });
+        }
+        if (!WriteFrame(clientFd, headerStream.str()) || !WriteFrame(clientFd, StringRef(output.data(), output.size())) ||
+            !WriteFrame(clientFd, reportStream.str()))
+          break;
+      }
+      ::close(clientFd);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < numThreads; ++i)
+    workers.emplace_back(runWorker);
+  runWorker();
+  for (auto &worker : workers)
+    worker.join();
+  ::close(listenFd);
+  return 1;
+}
+
+// -connect SOCKET -i MODULE [-o MODULE] [--report FILE] <request options>
+static int runClient(ArgumentReader &reader, int argc, char **argv) {
+  std::string socketPath = reader.getOption<std::string>("-connect", "");
+  std::string inFile = reader.getOption<std::string>("-i", "");
+  std::string outFile = reader.getOption<std::string>("-o", "");
+  std::string reportFile = reader.getOption<std::string>("--report", "");
+  if (inFile.empty()) {
+    PrintHelp();
+    return -1;
+  }
+
+  // the server gets all other options
+  std::string commandLine;
+  for (int i = 1; i < argc; ++i) {
+    StringRef arg(argv[i]);
+    if (arg == "-connect" || arg == "-i" || arg == "-o" || arg == "--report") {
+      ++i;
+      continue;
+    }
+    if (!commandLine.empty())
+      commandLine += " ";
+    commandLine += arg.str();
+  }
+
+  auto inputOrErr = MemoryBuffer::getFileOrSTDIN(inFile);
+  if (!inputOrErr) {
+    errs() << "Could not load module " << inFile << ". Aborting!\n";
+    return 1;
+  }
+
+  sockaddr_un addr;
+  if (!MakeSocketAddress(socketPath, addr))
+    return 1;
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    errs() << "could not connect to " << socketPath << ": " << std::strerror(errno) << "\n";
+    if (fd >= 0)
+      ::close(fd);
+    return 1;
+  }
+
+  std::string header, output, report;
+  bool ok = WriteFrame(fd, commandLine) && WriteFrame(fd, (*inputOrErr)->getBuffer()) && ReadFrame(fd, header) &&
+            ReadFrame(fd, output) && ReadFrame(fd, report);
+  ::close(fd);
+  if (!ok) {
+    errs() << "lost the connection to " << socketPath << "\n";
+    return 1;
+  }
+
+  int64_t status = 1;
+  if (auto headerOrErr = json::parse(header)) {
+    if (auto *headerObj = headerOrErr->getAsObject())
+      status = headerObj->getInteger("status").value_or(1);
+  } else {
+    consumeError(headerOrErr.takeError());
+  }
+
+  if (!reportFile.empty() && !report.empty()) {
+    std::error_code EC;
+    raw_fd_ostream reportOut(reportFile, EC, sys::fs::OF_Append);
+    if (EC) {
+      errs() << "could not open " << reportFile << ": " << EC.message() << "\n";
+      return 1;
+    }
+    reportOut << report;
+  }
+
+  if (status != 0) {
+    errs() << "rvTool server: request failed (" << status << "): " << commandLine << "\n";
+    return status;
+  }
+
+  // bitcode as it is, textual IR like the local tool
+  if (StringRef(outFile).endswith(".bc")) {
+    std::error_code EC;
+    raw_fd_ostream out(outFile, EC, sys::fs::OF_None);
+    if (EC) {
+      errs() << "could not open " << outFile << ": " << EC.message() << "\n";
+      return 1;
+    }
+    out << output;
+    return 0;
+  }
+
+  LLVMContext context;
+  SMDiagnostic diag;
+  std::unique_ptr<Module> mod = parseIR(MemoryBufferRef(output, "response"), diag, context);
+  if (!mod) {
+    diag.print("rvTool client", errs());
+    return 1;
+  }
+  if (outFile.empty())
+    mod->print(llvm::outs(), nullptr, false, true);
+  else
+    writeModuleToFile(mod.get(), outFile);
+  return 0;
+}
+#else
+static int runServer(ArgumentReader &reader) {
+  errs() << "rvTool: -serve requires Unix domain sockets\n";
+  return 1;
+}
+
+static int runClient(ArgumentReader &reader, int argc, char **argv) {
+  errs() << "rvTool: -connect requires Unix domain sockets\n";
+  return 1;
+}
+#endif
+
+int main(int argc, char **argv) {
+  ArgumentReader reader(argc, argv);
+
+  if (reader.hasOption("-batch"))
+    return runBatch(reader);
+  if (reader.hasOption("-serve"))
+    return runServer(reader);
+  if (reader.hasOption("-connect"))
+    return runClient(reader, argc, argv);
+
+  LLVMContext context;
+  return runTool(reader, context);
+}
@@ -22,13 +22,13 @@
 // #include "ctzdi2.c"
 // #include "ctzsi2.c"
 // #include "ctzti2.c"
-#include "divdc3.c"
+// #include "divdc3.c" // crt_vec.c
 #include "divdf3.c"
 #include "divmoddi4.c"
 #include "divmodsi4.c"
 #include "divsf3.c"
 #include "divsi3.c"
-#include "divti3.c"
+// #include "divti3.c" // crt_vec.c
 #include "divtf3.c"
 #include "divxc3.c"
 // #include "extendsfdf2.c"
@@ -79,7 +79,7 @@
 #include "muldi3.c"
 #include "mulodi4.c"
 #include "mulosi4.c"
-#include "muloti4.c"
+// #include "muloti4.c" // crt_vec.c
 #include "mulsc3.c"
 // #include "mulsf3.c"
 #include "multi3.c"
@@ -87,7 +87,7 @@
 #include "mulvdi3.c"
 #include "mulvsi3.c"
 #include "mulvti3.c"
-#include "mulxc3.c"
+// #include "mulxc3.c" // crt_vec.c
 #include "negdf2.c"
 #include "negdi2.c"
 #include "negsf2.c"
@@ -125,3 +125,6 @@
 #include "umoddi3.c"
 #include "umodsi3.c"
 #include "umodti3.c"
+
+// branch-free divdc3, divti3, muloti4, mulxc3
+#include "crt_vec.c"
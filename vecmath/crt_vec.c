@@ -0,0 +1,184 @@
+// Branch-free replacements of compiler-rt routines that show up in vectorized loops.
+//
+// The compiler-rt versions take data-dependent branches (early exits of the
+// 128-bit division, NaN/Inf recovery of the complex arithmetic). After
+// inlining, each of those becomes a divergent branch of the vectorized code.
+// These versions compute all cases and select the result, so only uniform
+// control flow remains (the fixed trip count loop of the division).
+//
+// Helpers are always_inline: each routine is cloned and inlined as a single
+// function body before vectorization.
+
+#include "int_lib.h"
+#include "int_math.h"
+
+#define RV_CRT_INLINE static __inline __attribute__((always_inline))
+
+#ifdef CRT_HAS_128BIT
+
+// restoring shift-subtract division (128 steps, no early exit)
+RV_CRT_INLINE tu_int rv_udivmod128(tu_int n, tu_int d, tu_int *rem) {
+  tu_int q = 0;
+  tu_int r = 0;
+  for (int i = 127; i >= 0; --i) {
+    // the bit shifted out of r is only set if r >= d already held before the step (then d > 2^127 as well)
+    tu_int carry = r >> 127;
+    r = (r << 1) | ((n >> i) & 1);
+    tu_int fits = -(tu_int)((r >= d) | carry);
+    r -= d & fits;
+    q |= (fits & 1) << i;
+  }
+  *rem = r;
+  return q;
+}
+
+// Returns: a / b
+COMPILER_RT_ABI ti_int __divti3(ti_int a, ti_int b) {
+  const int bits_in_tword_m1 = (int)(sizeof(ti_int) * CHAR_BIT) - 1;
+  ti_int s_a = a >> bits_in_tword_m1; // s_a = a < 0 ? -1 : 0
+  ti_int s_b = b >> bits_in_tword_m1; // s_b = b < 0 ? -1 : 0
+  tu_int abs_a = (tu_int)((a ^ s_a) - s_a);
+  tu_int abs_b = (tu_int)((b ^ s_b) - s_b);
+  s_a ^= s_b; // sign of quotient
+  tu_int rem;
+  return ((ti_int)rv_udivmod128(abs_a, abs_b, &rem) ^ s_a) - s_a;
+}
+
+// Returns: a * b
+// Effects: sets *overflow to 1 if a * b overflows
+COMPILER_RT_ABI ti_int __muloti4(ti_int a, ti_int b, int *overflow) {
+  const int bits_in_tword_m1 = (int)(sizeof(ti_int) * CHAR_BIT) - 1;
+  ti_int s_a = a >> bits_in_tword_m1;
+  ti_int s_b = b >> bits_in_tword_m1;
+  tu_int abs_a = (tu_int)((a ^ s_a) - s_a);
+  tu_int abs_b = (tu_int)((b ^ s_b) - s_b);
+  int negative = (int)((s_a ^ s_b) & 1);
+
+  // full 256-bit product of the magnitudes from 64-bit limbs
+  tu_int a_lo = (du_int)abs_a, a_hi = abs_a >> 64;
+  tu_int b_lo = (du_int)abs_b, b_hi = abs_b >> 64;
+  tu_int lo_lo = a_lo * b_lo;
+  tu_int hi_lo = a_hi * b_lo;
+  tu_int lo_hi = a_lo * b_hi;
+  tu_int hi_hi = a_hi * b_hi;
+  tu_int mid = (lo_lo >> 64) + (du_int)hi_lo + (du_int)lo_hi;
+  tu_int prod_lo = (mid << 64) | (du_int)lo_lo;
+  tu_int prod_hi = hi_hi + (hi_lo >> 64) + (lo_hi >> 64) + (mid >> 64);
+
+  // |result| <= 2^127 - 1 (positive) or <= 2^127 (negative)
+  tu_int limit = ((tu_int)1 << 127) - 1 + (tu_int)negative;
+  *overflow = (prod_hi != 0) | (prod_lo > limit);
+
+  ti_int sign = -(ti_int)negative;
+  return (ti_int)((prod_lo ^ (tu_int)sign) - (tu_int)sign);
+}
+
+#endif // CRT_HAS_128BIT
+
+// the exponent of the finite, non-zero x (logb, subnormals count as -1022)
+RV_CRT_INLINE int rv_exponent(double x) {
+  du_int bits;
+  __builtin_memcpy(&bits, &x, sizeof(bits));
+  int biased = (int)((bits >> 52) & 0x7ff);
+  return (biased ? biased : 1) - 1023;
+}
+
+// x * 2^-e for |e| <= 1023 in two steps by normal powers of two (scalbn without the libm call).
+// Results that are subnormal after the first step may round twice.
+RV_CRT_INLINE double rv_scale_down(double x, int e) {
+  int e1 = e >> 1;
+  int e2 = e - e1;
+  du_int s1 = (du_int)(1023 - e1) << 52;
+  du_int s2 = (du_int)(1023 - e2) << 52;
+  double f1, f2;
+  __builtin_memcpy(&f1, &s1, sizeof(f1));
+  __builtin_memcpy(&f2, &s2, sizeof(f2));
+  return (x * f1) * f2;
+}
+
+// Returns: the quotient of (a + ib) / (c + id)
+COMPILER_RT_ABI Dcomplex __divdc3(double __a, double __b, double __c, double __d) {
+  double w = crt_fmax(crt_fabs(__c), crt_fabs(__d));
+  int __ilogbw = (crt_isfinite(w) && w != 0.0) ? rv_exponent(w) : 0;
+  double c = rv_scale_down(__c, __ilogbw);
+  double d = rv_scale_down(__d, __ilogbw);
+  double __denom = c * c + d * d;
+  double real = rv_scale_down((__a * c + __b * d) / __denom, __ilogbw);
+  double imag = rv_scale_down((__b * c - __a * d) / __denom, __ilogbw);
+
+  // recover infinities and zeros that computed as NaN + iNaN (computed for all inputs, selected below)
+  int bothNaN = crt_isnan(real) && crt_isnan(imag);
+
+  // (1) division by zero
+  int divByZero = (__denom == 0.0) && (!crt_isnan(__a) || !crt_isnan(__b));
+  double infC = crt_copysign(CRT_INFINITY, c);
+
+  // (2) infinite numerator, finite denominator
+  int infNum = (crt_isinf(__a) || crt_isinf(__b)) && crt_isfinite(c) && crt_isfinite(d);
+  double infA = crt_copysign(crt_isinf(__a) ? 1.0 : 0.0, __a);
+  double infB = crt_copysign(crt_isinf(__b) ? 1.0 : 0.0, __b);
+
+  // (3) finite numerator, infinite denominator
+  int infDen = crt_isinf(w) && crt_isfinite(__a) && crt_isfinite(__b);
+  double infCc = crt_copysign(crt_isinf(c) ? 1.0 : 0.0, c);
+  double infDd = crt_copysign(crt_isinf(d) ? 1.0 : 0.0, d);
+
+  double real1 = infC * __a, imag1 = infC * __b;
+  double real2 = CRT_INFINITY * (infA * c + infB * d), imag2 = CRT_INFINITY * (infB * c - infA * d);
+  double real3 = 0.0 * (__a * infCc + __b * infDd), imag3 = 0.0 * (__b * infCc - __a * infDd);
+
+  int use1 = bothNaN && divByZero;
+  int use2 = bothNaN && !divByZero && infNum;
+  int use3 = bothNaN && !divByZero && !infNum && infDen;
+  real = use1 ? real1 : use2 ? real2 : use3 ? real3 : real;
+  imag = use1 ? imag1 : use2 ? imag2 : use3 ? imag3 : imag;
+
+  Dcomplex z;
+  COMPLEX_REAL(z) = real;
+  COMPLEX_IMAGINARY(z) = imag;
+  return z;
+}
+
+#if !_ARCH_PPC
+
+// Returns: the product of a + ib and c + id
+COMPILER_RT_ABI Lcomplex __mulxc3(long double __a, long double __b, long double __c, long double __d) {
+  long double __ac = __a * __c;
+  long double __bd = __b * __d;
+  long double __ad = __a * __d;
+  long double __bc = __b * __c;
+  long double real = __ac - __bd;
+  long double imag = __ad + __bc;
+
+  // NaN + iNaN recovery (computed for all inputs, selected below)
+  int bothNaN = crt_isnan(real) && crt_isnan(imag);
+
+  // an infinite factor turns into a unit, NaNs of the other factor into zeros
+  int infAB = crt_isinf(__a) || crt_isinf(__b);
+  int infCD = crt_isinf(__c) || crt_isinf(__d);
+  int infProd = crt_isinf(__ac) || crt_isinf(__bd) || crt_isinf(__ad) || crt_isinf(__bc);
+
+  long double a = infAB ? crt_copysignl(crt_isinf(__a) ? 1.0L : 0.0L, __a) : __a;
+  long double b = infAB ? crt_copysignl(crt_isinf(__b) ? 1.0L : 0.0L, __b) : __b;
+  long double c = infCD ? crt_copysignl(crt_isinf(__c) ? 1.0L : 0.0L, __c) : __c;
+  long double d = infCD ? crt_copysignl(crt_isinf(__d) ? 1.0L : 0.0L, __d) : __d;
+
+  // zero the NaNs of the finite factor (or of both factors if only a product overflowed)
+  int zeroAB = infCD || (!infAB && infProd);
+  int zeroCD = infAB || (!infCD && infProd);
+  a = (zeroAB && crt_isnan(a)) ? crt_copysignl(0.0L, a) : a;
+  b = (zeroAB && crt_isnan(b)) ? crt_copysignl(0.0L, b) : b;
+  c = (zeroCD && crt_isnan(c)) ? crt_copysignl(0.0L, c) : c;
+  d = (zeroCD && crt_isnan(d)) ? crt_copysignl(0.0L, d) : d;
+
+  int recalc = bothNaN && (infAB || infCD || infProd);
+  long double realRe = CRT_INFINITY * (a * c - b * d);
+  long double imagRe = CRT_INFINITY * (a * d + b * c);
+
+  Lcomplex z;
+  COMPLEX_REAL(z) = recalc ? realRe : real;
+  COMPLEX_IMAGINARY(z) = recalc ? imagRe : imag;
+  return z;
+}
+
+#endif // !_ARCH_PPC